@@ -76,6 +76,35 @@ inline static int64_t atomic_int64_test_and_set(atomic_int64_t* d, int64_t v)
 	return v;
 }
 
+/** @brief Atomic compare and exchange
+ *
+ * The value of the atomic_int64_t var is replaced by v, if it is equal to old.
+ *
+ * @param d Pointer to the atomic_int64_t var you want to exchange
+ * @param old The expected value of the var
+ * @param v The new value of the var
+ *
+ * @return The value of the atomic_int64_t var before the operation
+ */
+inline static int64_t atomic_int64_cmpxchg(atomic_int64_t* d, int64_t old, int64_t v)
+{
+	int64_t ret;
+	uint32_t tmp;
+
+	asm volatile(
+		"1:\n\t"
+		"ldaxr %0, %2\n\t"
+		"cmp %0, %3\n\t"
+		"b.ne 2f\n\t"
+		"stlxr %w1, %4, %2\n\t"
+		"cbnz %w1, 1b\n\t"
+		"2:"
+		: "=&r"(ret), "=&r"(tmp), "+Q"(d->counter)
+		: "r"(old), "r"(v)
+		: "memory", "cc");
+	return ret;
+}
+
 /** @brief Atomic addition of values to atomic_int64_t vars
  *
  * This function lets you add values in an atomic operation
@@ -57,6 +57,9 @@ extern "C" {
 #define INT_PPI_SPHYS_TIMER		(16+13)
 #define INT_PPI_NSPHYS_TIMER		(16+14)
 
+/* SGI, which triggers the scheduler of the receiving core */
+#define RESCHED_INT			1
+
 /** @brief Pointer-type to IRQ-handling functions
  *
  * Whenever you write a IRQ-handling function it has to match this signature.
@@ -76,6 +79,28 @@ int irq_install_handler(unsigned int irq, irq_handler_t handler);
  */
 int irq_uninstall_handler(unsigned int irq);
 
+/** @brief Send a software generated interrupt to a core
+ *
+ * @param core_id The receiving core
+ * @param sgi The interrupt number (0 - 15)
+ * @return 0 on success, -EINVAL if the core isn't known by the GIC
+ */
+int gic_send_sgi(uint32_t core_id, uint32_t sgi);
+
+/** @brief Default destination of the n-th device interrupt
+ *
+ * The GIC distributor isn't retargeted, this is only the placement
+ * of the threads, which process device interrupts.
+ */
+uint32_t irq_default_core(uint32_t n);
+
+/** @brief Route the device interrupts of a core to the other cores
+ *
+ * The GIC distributor isn't retargeted, the threads, which process
+ * device interrupts, are placed by irq_default_core().
+ */
+static inline void irq_migrate_core(uint32_t core) {}
+
 /** @brief Procedure to initialize IRQ
  *
  * This procedure is just a small collection of calls:
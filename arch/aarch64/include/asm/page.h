@@ -44,7 +44,7 @@
 /// Page offset bits
 #define PAGE_BITS		12
 #define PAGE_2M_BITS		21
-#define HUGE_PAGE_BITS		12
+#define HUGE_PAGE_BITS		21
 /// The size of a single page in bytes
 #define PAGE_SIZE		( 1L << PAGE_BITS)
 #define PAGE_2M_SIZE		( 1L << PAGE_2M_BITS)
@@ -77,7 +77,7 @@
 /// Align to 2M boundary
 #define PAGE_2M_FLOOR(addr)	( (addr)                   & ((~0L) << 21))
 /// Align to next huge boundary
-#define PAGE_HUGE_CEIL(addr)	(((addr) + HUGE_PAGE_MASK - 1) & HUGE_PAGE_MASK)
+#define PAGE_HUGE_CEIL(addr)	(((addr) + HUGE_PAGE_SIZE - 1) & HUGE_PAGE_MASK)
 /// Align to huge page boundary
 #define PAGE_HUGE_FLOOR(addr)	( (addr)                  & HUGE_PAGE_MASK)
 // Align the kernel end
@@ -117,6 +117,16 @@
 #define PT_SELF			(1UL << 55)
 #define PT_AF			(1UL << 10)	/* Access Flag */
 #define PT_CONTIG		(1UL << 52)	/* Contiguous bit */
+/// Number of pages, which share a TLB entry by the contiguous bit
+#define PT_CONTIG_PAGES		16
+
+/// Descriptor type of a block (bits 1:0 = 01), tables and pages use 11
+#define PT_TYPE_MASK		3UL
+#define PT_TYPE_BLOCK		1UL
+/// Does the entry of a level 2 table (self[1]) map a 2 MiB block?
+#define PT_IS_BLOCK(entry)	(((entry) & PT_TYPE_MASK) == PT_TYPE_BLOCK)
+/// Converts the attributes of a page into the attributes of a block
+#define PT_TO_BLOCK(attr)	(((attr) & ~PT_TYPE_MASK) | PT_TYPE_BLOCK)
 #define PT_S			(3UL << 8)
 #define PT_PXN			(1UL << 53)
 #define PT_UXN			(1UL << 54)
@@ -145,7 +155,6 @@ int page_init(void);
  * @param phyaddr Physical address to map from
  * @param npages The region's size in number of pages
  * @param bits Further page flags
- * @param do_ipi if set, inform via IPI all other cores
  * @return
  */
 int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits);
@@ -186,6 +195,60 @@ int page_unmap(size_t viraddr, size_t npages);
  */
 int page_set_flags(size_t viraddr, uint32_t npages, int flags);
 
+/** @brief Unmap a region of anonymous memory and release its page frames
+ *
+ * Huge pages are released as a whole.
+ *
+ * @param viraddr The virtual start address
+ * @param npages The range's size in pages
+ * @return
+ * - 0 on success
+ */
+int page_discard(size_t viraddr, size_t npages);
+
+/** @brief Unmap the pages of a range and release their page frames
+ *
+ * In contrast to page_discard(), only pages, which lie completely within
+ * the range, are released. Huge pages crossing a boundary are kept.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if start isn't page aligned
+ */
+int page_trim(size_t start, size_t end);
+
+/** @brief Map zeroed pages into a region of anonymous memory
+ *
+ * Mapped pages are kept. VMA_HUGE and VMA_HUGE_1G select larger pages,
+ * where the region is suitably aligned.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ * @param flags VMA flags of the region
+ * @return
+ * - 0 on success
+ * - -ENOMEM (-12) or -ENOSYS (-38) on failure
+ */
+int page_populate(size_t start, size_t end, uint32_t flags);
+
+/** @brief Map the pages of a file mapping, which contain an address
+ *
+ * @return
+ * - the end of the mapped range on success
+ * - 0 on failure
+ */
+size_t page_map_file(size_t viraddr, size_t start, size_t end, uint32_t flags);
+
+/** @brief Map page frames, which aren't managed by the kernel, into a region
+ *
+ * @return
+ * - 0 on success
+ * - -ENOSYS (-38) on failure
+ */
+int page_map_frames(size_t viraddr, size_t phyaddr, size_t npages, uint32_t flags);
+
 /** @brief Handler to map on demand pages for the heap
  *
  * * @param viraddr Virtual address, which triggers the page fault
@@ -197,6 +260,12 @@ int page_set_flags(size_t viraddr, uint32_t npages, int flags);
  */
 int page_fault_handler(size_t viraddr, size_t pc);
 
+/*
+ * All cores share the page tables and the inner shareable domain. The
+ * broadcast forms of TLBI ("...is") invalidate the entries on all cores,
+ * i.e. unlike x86_64 no shootdown IPIs are required.
+ */
+
 /** @brief Flush Translation Lookaside Buffer
  */
 static inline void tlb_flush(void)
@@ -230,6 +299,28 @@ static inline void tlb_flush_one_page(size_t addr)
 	);
 }
 
+/** @brief Flush a specific page entry in the TLB of the current core
+ *
+ * Sufficient for a stale entry of the current core, e.g. if another
+ * core has already mapped the page.
+ *
+ * @param addr The (virtual) address of the page to flush
+ */
+static inline void tlb_flush_one_page_local(size_t addr)
+{
+	addr = addr >> PAGE_BITS;
+
+	asm volatile(
+		"dsb nshst\n\t"        // ensure write has completed
+		"tlbi vale1, %0 \n\t"
+		"dsb nsh\n\t"          // ensure completion of TLB invalidation
+		"isb"                   // synchronize context
+		:
+		: "r"(addr)
+		: "memory"
+	);
+}
+
 /** @brief Flush a range of page entries in TLB
  * @param addr The (virtual) start address
  * @param end The (virtual) end address
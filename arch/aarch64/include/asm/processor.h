@@ -37,6 +37,7 @@
 #define __ARCH_PROCESSOR_H__
 
 #include <hermit/stddef.h>
+#include <hermit/clocksource.h>
 #include <asm/irqflags.h>
 #include <asm/atomic.h>
 
@@ -428,6 +429,24 @@ uint32_t detect_cpu_frequency(void);
  */
 uint32_t get_cpu_frequency(void);
 
+/** @brief Get the time in ns, which the hypervisor has stolen from a core
+ *
+ * Currently, no steal time is available on aarch64.
+ */
+static inline uint64_t get_steal_time(uint32_t core_id)
+{
+	return 0;
+}
+
+/** @brief Get the last level cache, which is used by a core
+ *
+ * Currently, no topology information is available on aarch64.
+ */
+static inline uint32_t get_cache_domain(uint32_t core_id)
+{
+	return 0;
+}
+
 /** @brief Busywait an microseconds interval of time
  * @param usecs The time to wait in microseconds
  */
@@ -436,6 +455,12 @@ void udelay(uint32_t usecs);
 /// Finalize the GIC initialization
 int irq_post_init(void);
 
+/// Initialize the banked part of the GIC on a secondary core
+int irq_cpu_init(void);
+
+/// Start the secondary cores via PSCI
+int smp_init(void);
+
 /// Sets up the system clock
 int timer_calibration(void);
 
@@ -451,8 +476,12 @@ static inline int system_calibration(void)
 {
 	irq_post_init();
 	timer_calibration();
+	clocksource_init();
 	atomic_int32_inc(&cpu_online);
 	irq_enable();
+#if MAX_CORES > 1
+	smp_init();
+#endif
 
 	return 0;
 }
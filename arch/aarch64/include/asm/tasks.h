@@ -55,6 +55,33 @@ extern "C" {
  */
 int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t core_id);
 
+/** @brief Switch between two fibers of the current task
+ *
+ * @param old_stack Location to store the stack pointer of the current fiber
+ * @param new_stack Saved stack pointer of the next fiber
+ */
+void fiber_switch(size_t** old_stack, size_t* new_stack);
+
+/** @brief Create the initial frame of a fiber, which is restored by fiber_switch()
+ *
+ * @param stack Stack of the fiber
+ * @param size Size of the stack
+ * @param entry Function, which is called by the first fiber_switch()
+ * @return Initial stack pointer of the fiber
+ */
+size_t* create_fiber_frame(void* stack, size_t size, void (*entry)(void));
+
+/** @brief Enable the FPU for the current task
+ */
+static inline void fpu_enable(void) {}
+
+/** @brief Save the FPU state of a task, which is already switched out
+ */
+static inline void save_fpu_state_of(task_t* task)
+{
+	save_fpu_state(task->fpu);
+}
+
 /** @brief Architecture dependent initialize routine
  */
 static inline void arch_init_task(task_t* task) {}
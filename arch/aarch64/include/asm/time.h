@@ -42,6 +42,8 @@ extern "C" {
 
 int timer_deadline(uint32_t t);
 
+int timer_deadline_tsc(uint64_t t);
+
 void timer_disable(void);
 
 int timer_is_running(void);
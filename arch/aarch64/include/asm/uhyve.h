@@ -35,14 +35,31 @@
 #define __ARCH_UHYVE_H__
 
 #include <hermit/stddef.h>
+#include <asm/processor.h>
+#ifdef SYSSTAT
+#include <hermit/sysstat.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** @brief Issue a hypercall
+ *
+ * With SYSSTAT, the calls and the cycles, for which the vCPU is blocked,
+ * are accounted per port (see sys_hcstat).
+ */
 inline static void uhyve_send(unsigned short _port, unsigned int _data)
 {
+#ifdef SYSSTAT
+	uint64_t start = get_rdtsc();
+
 	*((unsigned int*)(size_t)_port) = _data;
+
+	hcstat_account(_port, get_rdtsc() - start);
+#else
+	*((unsigned int*)(size_t)_port) = _data;
+#endif
 }
 
 #ifdef __cplusplus
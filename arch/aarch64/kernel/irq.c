@@ -58,6 +58,11 @@
 #define GICD_CTLR_ENABLEGRP0		(1 << 0)
 #define GICD_CTLR_ENABLEGRP1		(1 << 1)
 
+/* Target list filter and CPU target list of GICD_SGIR */
+#define GICD_SGIR_TARGET_LIST		(0 << 24)
+#define GICD_SGIR_TARGET_SELF		(2 << 24)
+#define GICD_SGIR_CPU(mask)		(((mask) & 0xFF) << 16)
+
 /* Physical CPU Interface registers */
 #define GICC_CTLR			0x0
 #define GICC_PMR			0x4
@@ -77,7 +82,6 @@
 #define GICC_CTLR_ACKCTL		(1 << 2)
 
 #define MAX_HANDLERS			256
-#define RESCHED_INT			1
 
 /** @brief IRQ handle pointers
 *
@@ -92,6 +96,9 @@ static size_t gicd_base = GICD_BASE;
 static size_t gicc_base = GICC_BASE;
 static uint32_t nr_irqs = 0;
 
+/// CPU interface masks of the cores, the GIC numbers them independently of our core ids
+static uint8_t gic_cpu_mask[MAX_CORES] = {[0 ... MAX_CORES-1] = 0};
+
 static inline uint32_t gicd_read(size_t off)
 {
 	uint32_t value;
@@ -147,13 +154,11 @@ static void gicc_set_priority(uint32_t priority)
 
 static void gic_set_enable(uint32_t vector, uint8_t enable)
 {
-	if (enable) {
-		uint32_t regoff = GICD_ISENABLER + 4 * (vector / 32);
-		gicd_write(regoff, gicd_read(regoff) | (1 << (vector % 32)));
-	} else {
-		uint32_t regoff = GICD_ICENABLER + 4 * (vector / 32);
-		gicd_write(regoff, gicd_read(regoff) | (1 << (vector % 32)));
-	}
+	// both registers ignore zero bits => no read-modify-write
+	if (enable)
+		gicd_write(GICD_ISENABLER + 4 * (vector / 32), 1 << (vector % 32));
+	else
+		gicd_write(GICD_ICENABLER + 4 * (vector / 32), 1 << (vector % 32));
 }
 
 static int unmask_interrupt(uint32_t vector)
@@ -193,6 +198,16 @@ int irq_install_handler(unsigned int irq, irq_handler_t handler)
 	return 0;
 }
 
+uint32_t irq_default_core(uint32_t n)
+{
+	return housekeeping_core(n);
+}
+
+int sys_irqstat(size_t size, void* stats)
+{
+	return -ENOSYS;
+}
+
 /* This clears the handler for a given IRQ */
 int irq_uninstall_handler(unsigned int irq)
 {
@@ -206,8 +221,69 @@ int irq_uninstall_handler(unsigned int irq)
 	return 0;
 }
 
+/*
+ * The SGIs and PPIs (interrupts 0 - 31) and the CPU interface are banked,
+ * every core has to initialize its own copy.
+ */
+static void gic_cpu_init(void)
+{
+	gicc_disable();
+
+	gicd_write(GICD_ICENABLER, 0xffff0000);
+	gicd_write(GICD_ISENABLER, 0x0000ffff);
+	gicd_write(GICD_ICPENDR, 0xffffffff);
+	gicd_write(GICD_IGROUPR, 0);
+
+	for (uint32_t i = 0; i < 32 / 4; i++) {
+		gicd_write(GICD_IPRIORITYR + i * 4, 0x80808080);
+	}
+
+	// each byte of the banked GICD_ITARGETSR0 returns the mask of the reading core
+	gic_cpu_mask[CORE_ID] = gicd_read(GICD_ITARGETSR) & 0xFF;
+
+	// the PPIs, which are already in use (e.g. the timer), are needed on all cores
+	for (uint32_t i = 16; i < 32; i++) {
+		if (irq_routines[i])
+			gic_set_enable(i, 1);
+	}
+
+	gicc_set_priority(0xF0);
+	gicc_enable();
+}
+
+int irq_cpu_init(void)
+{
+	if (BUILTIN_EXPECT(!nr_irqs, 0))
+		return -EINVAL;
+
+	gic_cpu_init();
+
+	return 0;
+}
+
+int gic_send_sgi(uint32_t core_id, uint32_t sgi)
+{
+	if (BUILTIN_EXPECT((core_id >= MAX_CORES) || (sgi >= 16), 0))
+		return -EINVAL;
+
+	if (core_id == CORE_ID) {
+		gicd_write(GICD_SGIR, GICD_SGIR_TARGET_SELF | sgi);
+		return 0;
+	}
+
+	if (BUILTIN_EXPECT(!gic_cpu_mask[core_id], 0))
+		return -EINVAL;
+
+	// the SGI has to be sent after all previous memory operations are visible
+	asm volatile("dsb ishst" ::: "memory");
+	gicd_write(GICD_SGIR, GICD_SGIR_TARGET_LIST | GICD_SGIR_CPU(gic_cpu_mask[core_id]) | sgi);
+
+	return 0;
+}
+
 int irq_post_init(void)
 {
+	uint32_t targets;
 	int ret;
 
 	LOG_INFO("Enable interrupt handling\n");
@@ -228,15 +304,10 @@ int irq_post_init(void)
 
 	nr_irqs = ((gicd_read(GICD_TYPER) & 0x1f) + 1) * 32;
 	LOG_INFO("Number of supported interrupts %u\n", nr_irqs);
+	LOG_INFO("Number of CPU interfaces %u\n", ((gicd_read(GICD_TYPER) >> 5) & 0x7) + 1);
 
-	gicd_write(GICD_ICENABLER, 0xffff0000);
-	gicd_write(GICD_ISENABLER, 0x0000ffff);
-	gicd_write(GICD_ICPENDR, 0xffffffff);
-	gicd_write(GICD_IGROUPR, 0);
-
-	for (uint32_t i = 0; i < 32 / 4; i++) {
-		gicd_write(GICD_IPRIORITYR + i * 4, 0x80808080);
-	}
+	// device interrupts are delivered to the boot processor
+	targets = (gicd_read(GICD_ITARGETSR) & 0xFF) * 0x01010101;
 
 	for (uint32_t i = 32/16; i < nr_irqs / 16; i++) {
 		gicd_write(GICD_NSACR + i * 4, 0xffffffff);
@@ -249,14 +320,13 @@ int irq_post_init(void)
 	}
 
 	for (uint32_t i = 32/4; i < nr_irqs / 4; i++) {
-		gicd_write(GICD_ITARGETSR + i * 4, 0);
+		gicd_write(GICD_ITARGETSR + i * 4, targets);
 		gicd_write(GICD_IPRIORITYR + i * 4, 0x80808080);
 	}
 
 	gicd_enable();
 
-	gicc_set_priority(0xF0);
-	gicc_enable();
+	gic_cpu_init();
 
 	unmask_interrupt(RESCHED_INT);
 
@@ -326,12 +396,18 @@ size_t** do_fiq(void *regs)
 	// Check if timers have expired that would unblock tasks
 	check_workqueues_in_irqhandler(vector);
 
-	if ((vector == INT_PPI_NSPHYS_TIMER) || (vector == RESCHED_INT)) {
+	// deferred work of the interrupt handlers
+	softirq_run();
+
+	if (vector == INT_PPI_NSPHYS_TIMER) {
 		// a timer interrupt may have caused unblocking of tasks
+		ret = preempt_scheduler();
+	} else if (vector == RESCHED_INT) {
+		// reschedule() yields the core by this interrupt
 		ret = scheduler();
 	} else if (get_highest_priority() > per_core(current_task)->prio) {
 		// there's a ready task with higher priority
-		ret = scheduler();
+		ret = preempt_scheduler();
 	}
 
 	gicc_write(GICC_EOIR, iar);
@@ -350,6 +426,9 @@ size_t** do_irq(void *regs)
 	// Check if timers have expired that would unblock tasks
 	check_workqueues_in_irqhandler(vector);
 
+	// deferred work of the interrupt handlers
+	softirq_run();
+
 	if (get_highest_priority() > per_core(current_task)->prio) {
 		// there's a ready task with higher priority
 		ret = scheduler();
@@ -380,6 +459,6 @@ void do_bad_mode(void *regs, int reason)
 
 void reschedule(void)
 {
-	// (2 << 24) = Forward the interrupt only to the CPU interface of the PE that requested the interrupt
-	gicd_write(GICD_SGIR, (2 << 24) | RESCHED_INT);
+	// Forward the interrupt only to the CPU interface of the PE that requested the interrupt
+	gicd_write(GICD_SGIR, GICD_SGIR_TARGET_SELF | RESCHED_INT);
 }
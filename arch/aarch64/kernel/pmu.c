@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file arch/aarch64/kernel/pmu.c
+ * @brief Performance counters aren't supported on aarch64 yet
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/tasks.h>
+#include <hermit/pmu.h>
+#include <hermit/errno.h>
+
+void pmu_init(void)
+{
+}
+
+void pmu_switch(task_t* prev, task_t* next)
+{
+}
+
+int pmu_open(uint32_t type, uint64_t config)
+{
+	return -ENODEV;
+}
+
+int pmu_read(int handle, uint64_t* value)
+{
+	return -EINVAL;
+}
+
+int pmu_reset(int handle)
+{
+	return -EINVAL;
+}
+
+int pmu_close(int handle)
+{
+	return -EINVAL;
+}
+
+int pmu_profile_start(uint32_t type, uint64_t config, uint64_t period)
+{
+	return -ENODEV;
+}
+
+int pmu_profile_stop(void)
+{
+	return 0;
+}
+
+int pmu_profile_read(uint32_t core, pmu_sample_t* buf, size_t n)
+{
+	return -EINVAL;
+}
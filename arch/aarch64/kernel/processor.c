@@ -29,6 +29,7 @@
 #include <hermit/stdio.h>
 #include <hermit/logging.h>
 #include <hermit/spinlock.h>
+#include <hermit/errno.h>
 #include <asm/processor.h>
 
 /*
@@ -102,3 +103,9 @@ int cpu_detection(void)
 
 	return 0;
 }
+
+int sys_pstate_boost(int enable)
+{
+	// P-states aren't controlled by HermitCore on aarch64
+	return -ENOSYS;
+}
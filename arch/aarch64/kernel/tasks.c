@@ -31,8 +31,13 @@
 #include <hermit/errno.h>
 #include <hermit/logging.h>
 #include <hermit/string.h>
+#include <hermit/memory.h>
+#include <hermit/boottime.h>
+#include <asm/irq.h>
+#include <asm/page.h>
 
 extern int smp_main(void);
+extern tid_t set_idle_task(void);
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
@@ -43,8 +48,25 @@ extern const void tls_end;
 extern const void tdata_end;
 
 extern atomic_int32_t cpu_online;
+extern atomic_int32_t possible_cpus;
 extern atomic_int32_t current_boot_id;
 
+/// entry point of all cores (see entry.S)
+extern const void _start;
+/// stack pointer of the next secondary core, set by smp_init
+extern size_t smp_boot_stack;
+
+/* PSCI function ids (SMC64 calling convention) */
+#define PSCI_VERSION		0x84000000
+#define PSCI_CPU_ON		0xC4000003
+
+#define PSCI_SUCCESS		0
+
+/// KVM numbers the vcpus with 16 cores per cluster (Aff0) and the clusters in Aff1
+#define MPIDR_CLUSTER_SIZE	16
+/// A GICv2 can deliver SGIs to 8 CPU interfaces at most
+#define GIC_MAX_CPUS		8
+
 typedef union dtv
 {
 	size_t counter;
@@ -179,15 +201,124 @@ int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t cor
 	return 0;
 }
 
+size_t* create_fiber_frame(void* stack, size_t size, void (*entry)(void))
+{
+	// the stack pointer has to be 16 byte aligned
+	size_t* top = (size_t*) (((size_t) stack + size) & ~0xFULL);
+	size_t* frame = top - 22;
+
+	memset(frame, 0x00, 22 * sizeof(size_t));
+	// x30 (link register) is the return address of fiber_switch()
+	frame[11] = (size_t) entry;
+
+	return frame;
+}
+
 #if MAX_CORES > 1
+static inline int64_t psci_call(uint64_t fn, uint64_t arg0, uint64_t arg1, uint64_t arg2)
+{
+	register uint64_t x0 asm("x0") = fn;
+	register uint64_t x1 asm("x1") = arg0;
+	register uint64_t x2 asm("x2") = arg1;
+	register uint64_t x3 asm("x3") = arg2;
+
+#ifdef PSCI_SMC
+	asm volatile("smc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+#else
+	asm volatile("hvc #0" : "+r"(x0) : "r"(x1), "r"(x2), "r"(x3) : "memory");
+#endif
+
+	return (int64_t) x0;
+}
+
+static inline uint64_t core_mpidr(uint32_t core_id)
+{
+	return ((core_id / MPIDR_CLUSTER_SIZE) << 8) | (core_id % MPIDR_CLUSTER_SIZE);
+}
+
+int smp_init(void)
+{
+	int32_t n = atomic_int32_read(&possible_cpus);
+	int64_t ret;
+	uint32_t i, j;
+
+	if (n <= 1)
+		return -EINVAL;
+
+	boot_phase_begin(BOOT_PHASE_SMP_INIT);
+
+	if (n > MAX_CORES)
+		n = MAX_CORES;
+	if (n > GIC_MAX_CPUS) {
+		LOG_WARNING("The GIC is able to address only %d of %d cores\n", GIC_MAX_CPUS, n);
+		n = GIC_MAX_CPUS;
+	}
+
+	ret = psci_call(PSCI_VERSION, 0, 0, 0);
+	LOG_INFO("PSCI version %lld.%lld\n", ret >> 16, ret & 0xFFFF);
+
+	/*
+	 * The cores are started one after another, because they share
+	 * current_boot_id and smp_boot_stack. They enter the kernel at
+	 * _start like the boot processor and jump to smp_start.
+	 */
+	for(i=1; i<(uint32_t) n; i++) {
+		void* stack = kmalloc(KERNEL_STACK_SIZE);
+		if (BUILTIN_EXPECT(!stack, 0))
+			break;
+
+		smp_boot_stack = (size_t) stack + KERNEL_STACK_SIZE - 0x10;
+		atomic_int32_set(&current_boot_id, i);
+
+		// the new core reads cpu_online with a disabled MMU => bypasses the caches
+		asm volatile("dsb ish; dc cvac, %0; dsb ish" :: "r"(&cpu_online) : "memory");
+
+		ret = psci_call(PSCI_CPU_ON, core_mpidr(i), virt_to_phys((size_t) &_start), 0);
+		if (ret != PSCI_SUCCESS) {
+			LOG_ERROR("Unable to wakeup processor %u (MPIDR 0x%llx): %lld\n", i, core_mpidr(i), ret);
+			kfree(stack);
+			break;
+		}
+
+		for(j=0; (atomic_int32_read(&cpu_online) <= (int32_t) i) && (j < 1000); j++)
+			udelay(1000);
+
+		if (atomic_int32_read(&cpu_online) <= (int32_t) i) {
+			// the stack remains allocated, the core may wake up later
+			LOG_ERROR("Processor %u doesn't respond\n", i);
+			break;
+		}
+	}
+
+	boot_phase_end(BOOT_PHASE_SMP_INIT);
+
+	if (atomic_int32_read(&cpu_online) < atomic_int32_read(&possible_cpus)) {
+		LOG_ERROR("Only %d of %d cores are online\n", atomic_int32_read(&cpu_online), atomic_int32_read(&possible_cpus));
+		// don't wait for the missing cores
+		atomic_int32_set(&possible_cpus, atomic_int32_read(&cpu_online));
+		return -EIO;
+	}
+
+	LOG_INFO("%d cores online\n", atomic_int32_read(&cpu_online));
+
+	return 0;
+}
+
 int smp_start(void)
 {
 	int32_t core_id = atomic_int32_read(&current_boot_id);
+	tid_t id;
 
 	LOG_INFO("Try to initialize processor (local id %d)\n", core_id);
 
 	cpu_detection();
 
+	// banked part of the GIC
+	irq_cpu_init();
+
+	id = set_idle_task();
+	set_boot_stack(id, smp_boot_stack + 0x10 - KERNEL_STACK_SIZE, 0);
+
 	atomic_int32_inc(&cpu_online);
 
 	irq_enable();
@@ -208,12 +339,30 @@ void wait_for_task(void)
 
 void wakeup_core(uint32_t core_id)
 {
-	// Currently not required...
+	// no self IPI required
+	if (core_id == CORE_ID)
+		return;
+
+	// wfi returns on the SGI and the scheduler finds the new task
+	LOG_DEBUG("wakeup core %d\n", core_id);
+	gic_send_sgi(core_id, RESCHED_INT);
+}
+
+void reschedule_core(uint32_t core_id)
+{
+	// no self IPI required
+	if (core_id == CORE_ID)
+		return;
+
+	// the SGI triggers always the scheduler
+	LOG_DEBUG("reschedule core %d\n", core_id);
+	gic_send_sgi(core_id, RESCHED_INT);
 }
 
 void shutdown_system(void)
 {
 	LOG_INFO("Try to shutdown system\n");
+	mem_print_stats();
 
 	atomic_int32_dec(&cpu_online);
 	while(1) {
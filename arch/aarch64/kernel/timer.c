@@ -33,6 +33,8 @@
 #include <hermit/errno.h>
 #include <hermit/spinlock.h>
 #include <hermit/logging.h>
+#include <hermit/clocksource.h>
+#include <hermit/vclock.h>
 #include <asm/irq.h>
 
 /*
@@ -50,7 +52,7 @@ extern int32_t boot_processor;
 
 #ifdef DYNAMIC_TICKS
 DEFINE_PER_CORE(uint64_t, last_tsc, 0);
-static uint64_t boot_tsc __attribute__ ((section(".data"))) = 0;
+uint64_t boot_tsc __attribute__ ((section(".data"))) = 0;
 
 void check_ticks(void)
 {
@@ -105,6 +107,22 @@ int timer_deadline(uint32_t ticks)
 	return 0;
 }
 
+int timer_deadline_tsc(uint64_t t)
+{
+	const uint64_t now = get_cntpct();
+	uint64_t diff = 1;
+
+	if (t > now)
+		diff = t - now;
+	if (diff > 0x7FFFFFFFULL)
+		diff = 0x7FFFFFFFULL;
+
+	set_cntp_tval((uint32_t) diff);
+	set_cntp_ctl(1);
+
+	return 0;
+}
+
 void timer_disable(void)
 {
 	/* stop timer */
@@ -191,6 +209,43 @@ int timer_wait(unsigned int ticks)
 	return 0;
 }
 
+static uint64_t generic_timer_mult = 0;
+
+static uint64_t generic_timer_read(void)
+{
+	return (uint64_t) (((unsigned __int128) get_cntpct() * generic_timer_mult) >> 32);
+}
+
+static int generic_timer_probe(clocksource_t* cs)
+{
+	cs->freq_hz = get_cntfrq();
+	if (BUILTIN_EXPECT(!cs->freq_hz, 0))
+		return -ENODEV;
+
+	cs->rating = 300;
+	generic_timer_mult = (1000000000ULL << 32) / cs->freq_hz;
+
+	return 0;
+}
+
+static clocksource_t generic_timer_clocksource = {
+	.name = "arch_timer",
+	.probe = generic_timer_probe,
+	.read = generic_timer_read,
+	.vclock_mode = VCLOCK_MODE_TSC,
+};
+
+clocksource_t* arch_clocksources[] = {
+	&generic_timer_clocksource,
+	NULL
+};
+
+uint64_t get_boot_time(void)
+{
+	// no real-time clock is supported yet
+	return 0;
+}
+
 int clock_init(void)
 {
 #ifdef DYNAMIC_TICKS
@@ -27,11 +27,13 @@
 
 #include <hermit/stddef.h>
 #include <hermit/stdlib.h>
+#include <hermit/slab.h>
 #include <hermit/stdio.h>
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/boottime.h>
 
 #include <asm/atomic.h>
 #include <asm/page.h>
@@ -46,6 +48,9 @@ typedef struct free_list {
 	struct free_list* prev;
 } free_list_t;
 
+/// object cache of the free list entries
+static kmem_cache_t free_list_cache = KMEM_CACHE_INIT("free_list", sizeof(free_list_t), NULL);
+
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
  * maintaining a value, rather their address is their value.
@@ -94,7 +99,7 @@ size_t get_pages(size_t npages)
 			else
 				free_start = curr->next;
 			if (curr != &init_list)
-				kfree(curr);
+				kmem_cache_free(&free_list_cache, curr);
 			goto out;
 		}
 
@@ -113,6 +118,58 @@ out:
 	return ret;
 }
 
+size_t get_huge_page(void)
+{
+	const size_t npages = HUGE_PAGE_SIZE >> PAGE_BITS;
+	free_list_t* curr;
+	size_t ret = 0;
+
+	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
+		return 0;
+
+	spinlock_lock(&list_lock);
+
+	for(curr = free_start; curr; curr = curr->next) {
+		size_t start = PAGE_HUGE_CEIL(curr->start);
+
+		if (start + HUGE_PAGE_SIZE > curr->end)
+			continue;
+
+		if (start == curr->start) {
+			curr->start += HUGE_PAGE_SIZE;
+		} else if (start + HUGE_PAGE_SIZE == curr->end) {
+			curr->end = start;
+		} else {
+			// split the region, the part in front of the page remains in the list
+			free_list_t* n = kmem_cache_alloc(&free_list_cache);
+
+			if (BUILTIN_EXPECT(!n, 0))
+				break;
+
+			n->start = start + HUGE_PAGE_SIZE;
+			n->end = curr->end;
+			n->prev = curr;
+			n->next = curr->next;
+			if (curr->next)
+				curr->next->prev = n;
+			curr->next = n;
+			curr->end = start;
+		}
+
+		ret = start;
+		break;
+	}
+
+	spinlock_unlock(&list_lock);
+
+	if (ret) {
+		atomic_int64_add(&total_allocated_pages, npages);
+		atomic_int64_sub(&total_available_pages, npages);
+	}
+
+	return ret;
+}
+
 DEFINE_PER_CORE(size_t, ztmp_addr, 0);
 
 size_t get_zeroed_page(void)
@@ -166,8 +223,8 @@ int put_pages(size_t phyaddr, size_t npages)
 		} else if (phyaddr == curr->end) {
 			curr->end += npages*PAGE_SIZE;
 			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
+		} if ((phyaddr > curr->end) && (!curr->next || (phyaddr + npages*PAGE_SIZE < curr->next->start))) {
+			free_list_t* n = kmem_cache_alloc(&free_list_cache);
 
 			if (BUILTIN_EXPECT(!n, 0))
 				goto out_err;
@@ -177,7 +234,10 @@ int put_pages(size_t phyaddr, size_t npages)
 			n->end = phyaddr + npages * PAGE_SIZE;
 			n->prev = curr;
 			n->next = curr->next;
+			if (curr->next)
+				curr->next->prev = n;
 			curr->next = n;
+			goto out;
 		}
 
 		curr = curr->next;
@@ -229,7 +289,7 @@ void* page_alloc(size_t sz, uint32_t flags)
 		vma_free(viraddr, viraddr+npages*PAGE_SIZE);
 		put_pages(phyaddr, npages);
 		viraddr = 0;
-	}
+	} else mem_account(MEM_TAG_DRIVER, npages, 0);
 
 oom:
 	return (void*) viraddr;
@@ -246,8 +306,10 @@ void page_free(void* viraddr, size_t sz)
 
 	vma_free((size_t) viraddr, (size_t) viraddr + PAGE_FLOOR(sz));
 
-	if (phyaddr)
+	if (phyaddr) {
 		put_pages(phyaddr, PAGE_FLOOR(sz) >> PAGE_BITS);
+		mem_account(MEM_TAG_DRIVER, -(int64_t) (PAGE_FLOOR(sz) >> PAGE_BITS), 0);
+	}
 }
 
 int memory_init(void)
@@ -255,7 +317,9 @@ int memory_init(void)
 	int ret = 0;
 
 	// enable paging and map Multiboot modules etc.
+	boot_phase_begin(BOOT_PHASE_PAGE_INIT);
 	ret = page_init();
+	boot_phase_end(BOOT_PHASE_PAGE_INIT);
 	if (BUILTIN_EXPECT(ret, 0)) {
 		LOG_ERROR("Failed to initialize paging!\n");
 		return ret;
@@ -285,7 +349,7 @@ int memory_init(void)
 		LOG_WARNING("Failed to initialize VMA regions: %d\n", ret);
 
 	if (limit > GICD_BASE + GICD_SIZE + GICC_SIZE) {
-		init_list.next = kmalloc(sizeof(free_list_t));
+		init_list.next = kmem_cache_alloc(&free_list_cache);
 		if (BUILTIN_EXPECT(!init_list.next, 0)) {
 			LOG_ERROR("Unable to allocate new element for the free list\n");
 			goto oom;
@@ -39,6 +39,7 @@
 #include <hermit/errno.h>
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
+#include <hermit/rwlock.h>
 #include <hermit/tasks.h>
 #include <hermit/logging.h>
 
@@ -58,8 +59,13 @@ extern const void kernel_start;
 
 extern size_t l0_pgtable;
 
-/** Single-address space operating system => one lock for all tasks */
-static spinlock_irqsave_t page_lock = SPINLOCK_IRQSAVE_INIT;
+/** Single-address space operating system => one lock for all tasks
+ *
+ * Page faults only read the page tables, if another core has already
+ * mapped the page, and share the lock. Page tables are never released,
+ * which allows to walk them without deferred reclamation.
+ */
+static rwlock_irqsave_t page_lock = RWLOCK_IRQSAVE_INIT;
 
 /** A self-reference enables direct access to all page tables */
 static size_t* const self[PAGE_LEVELS] = {
@@ -73,8 +79,14 @@ static uint8_t expect_zeroed_pages = 0;
 
 size_t virt_to_phys(size_t addr)
 {
+	size_t entry = self[1][addr >> PAGE_2M_BITS];
+
+	// the address is covered by a 2 MiB block
+	if (PT_IS_BLOCK(entry))
+		return ((entry & PAGE_2M_MASK) | (addr & ~PAGE_2M_MASK)) & ((1ULL << VIRT_BITS) - 1);
+
 	size_t vpn   = addr >> PAGE_BITS;	// virtual page number
-	size_t entry = self[0][vpn];		// page table entry
+	entry        = self[0][vpn];		// page table entry
 	size_t off   = addr  & ~PAGE_MASK;	// offset within page
 	size_t phy   = entry &  PAGE_MASK;	// physical page frame number
 
@@ -95,13 +107,28 @@ int page_set_flags(size_t viraddr, uint32_t npages, int flags)
 	return -EINVAL;
 }
 
+/*
+ * Clears the contiguous hint of the 16 entries around vpn. Has to be
+ * called before one of them is changed. The caller flushes the TLB.
+ */
+static void break_contig(size_t vpn)
+{
+	size_t i;
+
+	if (!(self[0][vpn] & PT_CONTIG))
+		return;
+
+	vpn &= ~(PT_CONTIG_PAGES-1);
+	for(i=0; i<PT_CONTIG_PAGES; i++)
+		self[0][vpn+i] &= ~PT_CONTIG;
+}
+
 int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits)
 {
 	int lvl, ret = -ENOMEM;
 	ssize_t vpn = viraddr >> PAGE_BITS;
 	ssize_t first[PAGE_LEVELS], last[PAGE_LEVELS];
-	size_t page_counter = 0;
-	size_t cflags = 0;
+	const size_t mem = (bits & PG_DEVICE) ? PT_DEVICE : PT_MEM;
 
 	//kprintf("Map %d pages at 0x%zx\n", npages, viraddr);
 
@@ -111,22 +138,47 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits)
 		last[lvl]  = (vpn+npages-1) >> (lvl * PAGE_MAP_BITS);
 	}
 
-	spinlock_irqsave_lock(&page_lock);
+	/* physical address of the virtual page number n */
+	size_t phys(ssize_t n) {
+		return phyaddr + (n - first[0]) * PAGE_SIZE;
+	}
+
+	rwlock_irqsave_write_lock(&page_lock);
 
 	/* Start iterating through the entries
 	 * beginning at the root table */
 	for (lvl=PAGE_LEVELS-1; lvl>=0; lvl--) {
 		for (vpn=first[lvl]; vpn<=last[lvl]; vpn++) {
+			if (lvl == 1) {
+				ssize_t n = vpn << PAGE_MAP_BITS;
+
+				/* Use a 2 MiB block, if it lies completely within the
+				 * region and no page table exists for it */
+				if ((n >= first[0]) && (n + PAGE_MAP_ENTRIES - 1 <= last[0])
+				    && !(phys(n) & ~PAGE_2M_MASK)
+				    && (!self[lvl][vpn] || PT_IS_BLOCK(self[lvl][vpn]))) {
+					self[lvl][vpn] = phys(n) | PT_TO_BLOCK(mem);
+					continue;
+				}
+
+				if (BUILTIN_EXPECT(PT_IS_BLOCK(self[lvl][vpn]), 0)) {
+					LOG_ERROR("__page_map: 0x%zx is part of a 2 MiB block\n", n << PAGE_BITS);
+					ret = -EINVAL;
+					goto out;
+				}
+			}
+
 			if (lvl) {
 				if (!self[lvl][vpn]) {
 					/* There's no table available which covers the region.
 					 * Therefore we need to create a new empty table. */
-					size_t phyaddr = get_pages(1);
-					if (BUILTIN_EXPECT(!phyaddr, 0))
+					size_t paddr = get_pages(1);
+					if (BUILTIN_EXPECT(!paddr, 0))
 						goto out;
+					mem_account(MEM_TAG_PGTABLE, 1, 0);
 
 					/* Reference the new table within its parent */
-					self[lvl][vpn] = phyaddr | PT_PT;
+					self[lvl][vpn] = paddr | PT_PT;
 
 					/* Fill new table with zeros */
 					//LOG_INFO("Clear new page table at %p for 0x%zx, %d\n", &self[lvl-1][vpn<<PAGE_MAP_BITS], viraddr, lvl-1);
@@ -135,42 +187,40 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits)
 					memset(&self[lvl-1][vpn<<PAGE_MAP_BITS], 0, PAGE_SIZE);
 				}
 			} else { /* page table */
+				const ssize_t group = vpn & ~(PT_CONTIG_PAGES-1);
+				size_t cflags = 0;
+
+				// covered by a block
+				if (PT_IS_BLOCK(self[1][vpn >> PAGE_MAP_BITS])) {
+					vpn |= PAGE_MAP_ENTRIES-1;
+					continue;
+				}
+
 				/*if (self[lvl][vpn]) {
 					kprintf("Remap address 0x%zx at core %d\n", viraddr, CORE_ID);
 				}*/
 
-#if 0
-				if ((viraddr & 0xFFFFULL) == 0) {
-					if ((ssize_t)npages-(ssize_t)page_counter >= 16)
-						cflags = PT_CONTIG;
-					else if ((ssize_t)npages-(ssize_t)page_counter < 16)
-						cflags = 0;
-				}
-#endif
-
-				if (bits & PG_DEVICE)
-					self[lvl][vpn] = phyaddr | PT_DEVICE | cflags;
+				/* 16 physically contiguous pages, which we map completely,
+				 * share a single TLB entry */
+				if ((group >= first[0]) && (group + PT_CONTIG_PAGES - 1 <= last[0])
+				    && !(phys(group) & (PT_CONTIG_PAGES*PAGE_SIZE-1)))
+					cflags = PT_CONTIG;
 				else
-					self[lvl][vpn] = phyaddr | PT_MEM | cflags;
+					break_contig(vpn);
+
+				self[lvl][vpn] = phys(vpn) | mem | cflags;
 
 				//if (bits & PG_DEVICE)
 				//	kprintf("viradd 0x%zx, reference 0x%zx\n", viraddr, self[lvl][vpn]);
-
-				//if (cflags && !(viraddr & 0xFFFFULL))
-				//	kprintf("usre PT_CONTIG for 0x%zx, reference 0x%zx\n", viraddr, self[lvl][vpn]);
-
-				page_counter++;
-				phyaddr += PAGE_SIZE;
-				viraddr += PAGE_SIZE;
 			}
 		}
 	}
 
-	tlb_flush_range(viraddr, viraddr+npages*PAGE_SIZE);
-
 	ret = 0;
 out:
-	spinlock_irqsave_unlock(&page_lock);
+	tlb_flush_range(viraddr, viraddr+npages*PAGE_SIZE);
+
+	rwlock_irqsave_write_unlock(&page_lock);
 
 	return ret;
 }
@@ -182,26 +232,69 @@ int page_unmap(size_t viraddr, size_t npages)
 
 	//kprintf("Unmap %d pages at 0x%zx\n", npages, viraddr);
 
-	spinlock_irqsave_lock(&page_lock);
+	rwlock_irqsave_write_lock(&page_lock);
 
 	/* Start iterating through the entries.
-	 * Only the PGT entries are removed. Tables remain allocated. */
+	 * Only the PGT entries are removed. Tables remain allocated.
+	 * Blocks are removed as a whole. */
 	size_t vpn, start = viraddr>>PAGE_BITS;
 	for (vpn=start; vpn<start+npages; vpn++) {
-		self[0][vpn] = 0;
+		size_t* pde = &self[1][vpn >> PAGE_MAP_BITS];
+
+		if (!self[3][vpn >> (3*PAGE_MAP_BITS)] || !self[2][vpn >> (2*PAGE_MAP_BITS)] || !*pde) {
+			continue;
+		} else if (PT_IS_BLOCK(*pde)) {
+			*pde = 0;
+			vpn |= PAGE_MAP_ENTRIES-1;
+		} else {
+			break_contig(vpn);
+			self[0][vpn] = 0;
+		}
 	}
 
 	tlb_flush_range(viraddr, viraddr+npages*PAGE_SIZE);
 
-	spinlock_irqsave_unlock(&page_lock);
+	rwlock_irqsave_write_unlock(&page_lock);
 
 	/* This can't fail because we don't make checks here */
 	return 0;
 }
 
+/*
+ * Anonymous and file mappings aren't supported on aarch64 yet, the page
+ * fault handler maps only the heap. mm/mmap.c refuses these mappings
+ * with -ENOSYS, consequently the following functions aren't reached.
+ */
+int page_discard(size_t viraddr, size_t npages)
+{
+	return -ENOSYS;
+}
+
+/// the heap keeps its frames after a shrinking sys_sbrk()
+int page_trim(size_t start, size_t end)
+{
+	return -ENOSYS;
+}
+
+int page_populate(size_t start, size_t end, uint32_t flags)
+{
+	return -ENOSYS;
+}
+
+size_t page_map_file(size_t viraddr, size_t start, size_t end, uint32_t flags)
+{
+	return 0;
+}
+
+int page_map_frames(size_t viraddr, size_t phyaddr, size_t npages, uint32_t flags)
+{
+	return -ENOSYS;
+}
+
 int page_fault_handler(size_t viraddr, size_t pc)
 {
 	task_t* task = per_core(current_task);
+	uint64_t tsc = get_rdtsc();
 
 	int check_pagetables(size_t vaddr)
 	{
@@ -219,52 +312,90 @@ int page_fault_handler(size_t viraddr, size_t pc)
 
 			if (!self[lvl][vpn])
 				return 0;
+
+			// the address is covered by a 2 MiB block
+			if ((lvl == 1) && PT_IS_BLOCK(self[lvl][vpn]))
+				return 1;
 		}
 
 		return 1;
 	}
 
-	spinlock_irqsave_lock(&page_lock);
-
 	//:wpage_dump();
 
 	if ((task->heap) && (viraddr >= task->heap->start) && (viraddr < task->heap->end)) {
+		uint8_t irq_flags;
+		int ret;
+
 		/*
 		 * do we have a valid page table entry? => flush TLB and return
 		 */
+		rwlock_irqsave_read_lock(&page_lock, &irq_flags);
+		ret = check_pagetables(viraddr);
+		rwlock_irqsave_read_unlock(&page_lock, irq_flags);
+		if (ret) {
+			// only our TLB may contain a stale entry => no broadcast
+			tlb_flush_one_page_local(viraddr);
+			pf_account(viraddr, tsc, PF_KIND_SPURIOUS, 0, 0);
+			return 0;
+		}
+
+		rwlock_irqsave_write_lock(&page_lock);
+
+		// another core may have mapped the page in the meantime
 		if (check_pagetables(viraddr)) {
-			tlb_flush_one_page(viraddr);
-			spinlock_irqsave_unlock(&page_lock);
+			rwlock_irqsave_write_unlock(&page_lock);
+			tlb_flush_one_page_local(viraddr);
+			pf_account(viraddr, tsc, PF_KIND_SPURIOUS, 0, 0);
 			return 0;
 		}
 
-		 // on demand userspace heap mapping
-		viraddr &= PAGE_MASK;
+		size_t flags = PG_USER|PG_RW;
+		size_t npages = 1;
+		size_t phyaddr = 0;
+
+		 // on demand userspace heap mapping by 2 MiB blocks like on x86_64,
+		 // 4 KiB pages are used only, if the region contains already pages
+		if (!self[3][viraddr >> (PAGE_BITS + 3*PAGE_MAP_BITS)] || !self[2][viraddr >> (PAGE_BITS + 2*PAGE_MAP_BITS)]
+		    || !self[1][viraddr >> PAGE_2M_BITS]) {
+			phyaddr = get_huge_page();
+			if (phyaddr) {
+				viraddr &= HUGE_PAGE_MASK;
+				npages = HUGE_PAGE_SIZE >> PAGE_BITS;
+			}
+		}
 
-		size_t phyaddr = expect_zeroed_pages ? get_zeroed_page() : get_page();
+		if (!phyaddr) {
+			viraddr &= PAGE_MASK;
+			phyaddr = expect_zeroed_pages ? get_zeroed_page() : get_page();
+		}
 		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			rwlock_irqsave_write_unlock(&page_lock);
 			LOG_ERROR("out of memory: task = %u\n", task->id);
 			goto default_handler;
 		}
 
-		size_t flags = PG_USER|PG_RW;
-		int ret = __page_map(viraddr, phyaddr, 1, flags);
+		ret = __page_map(viraddr, phyaddr, npages, flags);
+		if (!ret && expect_zeroed_pages && (npages > 1))
+			memset((void*) viraddr, 0x00, HUGE_PAGE_SIZE);
+		if (!ret)
+			mem_account(MEM_TAG_HEAP, npages, 0);
+
+		rwlock_irqsave_write_unlock(&page_lock);
 
 		if (BUILTIN_EXPECT(ret, 0)) {
 			LOG_ERROR("map_region: could not map %#lx to %#lx, task = %u\n", phyaddr, viraddr, task->id);
-			put_page(phyaddr);
+			put_pages(phyaddr, npages);
 
 			goto default_handler;
 		}
 
-		spinlock_irqsave_unlock(&page_lock);
+		pf_account(viraddr, tsc, (npages > 1) ? PF_KIND_HUGE : PF_KIND_SMALL, 0, 0);
 
 		return 0;
 	}
 
 default_handler:
-	spinlock_irqsave_unlock(&page_lock);
-
 	/* indicate unrecoverable page fault to the hypervisor */
 	uhyve_pfault_t arg = {pc, viraddr, -1};
 	/*
@@ -339,7 +470,7 @@ void page_dump(void)
 		page_entry_t* stop = entry + PAGE_MAP_ENTRIES;
 		for (; entry != stop; entry++) {
 			if (*entry) {
-				if (level) { // do "pre-order" traversal
+				if (level && !((level == 1) && PT_IS_BLOCK(*entry))) { // do "pre-order" traversal
 					// TODO: handle "inheritance" of page table flags (see get_page_flags())
 					traverse(level-1, get_child_entry(entry));
 				} else {
@@ -46,6 +46,8 @@ extern "C" {
 #define APIC_EOI		0x00B0
 /// Required for future compatiblity
 #define	APIC_EOI_ACK		0x0000
+/// Logical Destination Register
+#define APIC_LDR		0x00D0
 /// Spurious Interrupt Vector Register
 #define APIC_SVR		0x00F0
 /// Error Status Register
@@ -208,9 +210,47 @@ int apic_is_enabled(void);
 int apic_enable_timer(void);
 int apic_disable_timer(void);
 int apic_timer_deadline(uint32_t);
+int apic_timer_deadline_tsc(uint64_t);
 int apic_timer_is_running(void);
 int apic_send_ipi(uint64_t dest, uint8_t irq);
+/// route the performance counter interrupt of the current core to vector
+void apic_lvt_pmc(uint8_t vector, int enable);
+/// is the core online and able to receive interrupts?
+int apic_core_online(uint32_t core_id);
 int ioapic_inton(uint8_t irq, uint8_t apicid);
+
+#if MAX_CORES > 1
+/// interrupt vector of the remote function calls
+#define SMP_CALL_IRQ	(32+83)
+
+/// function of a remote call, runs on the target in interrupt context
+typedef void (*smp_call_func_t)(void* arg);
+
+/** @brief Call a function on several cores
+ *
+ * The calls are queued in lock-free per-core queues and a target core
+ * receives an IPI only, if its queue was empty. If the current core is a
+ * target, the function runs directly with disabled interrupts.
+ *
+ * @param cores Array of the target cores
+ * @param n Number of target cores
+ * @param func Function, which is called on each target
+ * @param arg Argument of func
+ * @param wait 1 => wait until all targets have finished func,
+ *             0 => return, after the calls are queued
+ * @return
+ * - 0 on success
+ * - -EINVAL if a target isn't online
+ * - -ENOMEM if the request can't be allocated
+ */
+int smp_call_function_many(const uint32_t* cores, uint32_t n, smp_call_func_t func, void* arg, int wait);
+
+/// call func on the core core_id (see smp_call_function_many)
+int smp_call_function_single(uint32_t core_id, smp_call_func_t func, void* arg, int wait);
+
+/// call func on all other online cores (see smp_call_function_many)
+int smp_call_function(smp_call_func_t func, void* arg, int wait);
+#endif
 int ioapic_intoff(uint8_t irq, uint8_t apicid);
 int map_apic(void);
 
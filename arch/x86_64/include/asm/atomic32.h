@@ -67,6 +67,23 @@ inline static int32_t atomic_int32_test_and_set(atomic_int32_t* d, int32_t ret)
 	return ret;
 }
 
+/** @brief Atomic compare and exchange
+ *
+ * The value of the atomic_int32_t var is replaced by v, if it is equal to old.
+ *
+ * @param d Pointer to the atomic_int32_t var you want to exchange
+ * @param old The expected value of the var
+ * @param v The new value of the var
+ *
+ * @return The value of the atomic_int32_t var before the operation
+ */
+inline static int32_t atomic_int32_cmpxchg(atomic_int32_t* d, int32_t old, int32_t v)
+{
+	int32_t ret;
+	asm volatile(LOCK "cmpxchgl %2, %1" : "=a"(ret), "+m"(d->counter) : "r"(v), "0"(old) : "memory", "cc");
+	return ret;
+}
+
 /** @brief Atomic addition of values to atomic_int32_t vars
  *
  * This function lets you add values in an atomic operation
@@ -67,6 +67,23 @@ inline static int64_t atomic_int64_test_and_set(atomic_int64_t* d, int64_t ret)
 	return ret;
 }
 
+/** @brief Atomic compare and exchange
+ *
+ * The value of the atomic_int64_t var is replaced by v, if it is equal to old.
+ *
+ * @param d Pointer to the atomic_int64_t var you want to exchange
+ * @param old The expected value of the var
+ * @param v The new value of the var
+ *
+ * @return The value of the atomic_int64_t var before the operation
+ */
+inline static int64_t atomic_int64_cmpxchg(atomic_int64_t* d, int64_t old, int64_t v)
+{
+	int64_t ret;
+	asm volatile(LOCK "cmpxchgq %2, %1" : "=a"(ret), "+m"(d->counter) : "r"(v), "0"(old) : "memory", "cc");
+	return ret;
+}
+
 /** @brief Atomic addition of values to atomic_int64_t vars
  *
  * This function lets you add values in an atomic operation
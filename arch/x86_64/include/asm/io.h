@@ -119,6 +119,17 @@ inline static void cmos_write(uint8_t offset, uint8_t val)
 	outportb(CMOS_PORT_DATA, val);
 }
 
+/**
+ * read a byte from CMOS
+ *  @param offset CMOS offset
+ *  @return the value at offset
+ */
+inline static uint8_t cmos_read(uint8_t offset)
+{
+	outportb(CMOS_PORT_ADDRESS, offset);
+	return inportb(CMOS_PORT_DATA);
+}
+
 
 #ifdef __cplusplus
 }
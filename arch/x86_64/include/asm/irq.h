@@ -49,6 +49,10 @@ extern "C" {
  */
 typedef void (*irq_handler_t)(struct state *);
 
+/** @brief Range of interrupt vectors, which are dynamically assigned (e.g. to MSI/MSI-X) */
+#define IRQ_DYN_FIRST	56
+#define IRQ_DYN_LAST	111
+
 /** @brief Install a custom IRQ handler for a given IRQ 
  *
  * @param irq The desired irq
@@ -62,6 +66,124 @@ int irq_install_handler(unsigned int irq, irq_handler_t handler);
  */
 int irq_uninstall_handler(unsigned int irq);
 
+/** @brief Reserve an unused interrupt vector
+ *
+ * The vector is in the range of IRQ_DYN_FIRST to IRQ_DYN_LAST and
+ * can be used as target of MSI and MSI-X messages.
+ *
+ * @return
+ * - the vector on success
+ * - -ENOSPC if all vectors are in use
+ */
+int irq_alloc_vector(void);
+
+/** @brief Release a vector, which is reserved by irq_alloc_vector
+ *
+ * The handler of this vector will be uninstalled.
+ *
+ * @param vector The vector to release
+ */
+int irq_free_vector(unsigned int vector);
+
+/// types of the interrupt sources, which are routed to a core
+enum {
+	IRQ_ROUTE_NONE = 0,
+	IRQ_ROUTE_IOAPIC,
+	IRQ_ROUTE_MSI,
+	IRQ_ROUTE_MSIX
+};
+
+/** @brief Reprograms the source of an interrupt to a new destination
+ *
+ * @param arg The argument of irq_route_register (e.g. the PCI device)
+ * @param data The source within arg (e.g. the pin or the MSI-X entry)
+ * @param vector The interrupt vector
+ * @param core The new destination
+ */
+typedef int (*irq_retarget_t)(void* arg, uint32_t data, uint8_t vector, uint32_t core);
+
+/** @brief Record the routing of a device interrupt
+ *
+ * Has to be called by the owner of the source, before the source is
+ * programmed. The returned destination respects the boot options
+ * -irqaffinity=<vector>:<core>,... and -irqcore=<core>.
+ *
+ * @param vector The interrupt vector
+ * @param type Type of the source (IRQ_ROUTE_*)
+ * @param func Reprograms the source to another core
+ * @param arg, data Arguments of func
+ * @param core The requested destination
+ *
+ * @return The destination, which has to be programmed
+ */
+uint32_t irq_route_register(unsigned int vector, uint8_t type, irq_retarget_t func, void* arg, uint32_t data, uint32_t core);
+
+/** @brief Forget the routing of a vector, e.g. if the device is disabled */
+void irq_route_unregister(unsigned int vector);
+
+/** @brief Route a device interrupt to a core
+ *
+ * Stops following a task (see irq_follow_task).
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the vector has no route or the core isn't online
+ */
+int irq_set_affinity(unsigned int vector, uint32_t core);
+
+/** @brief Get the destination of a device interrupt
+ *
+ * @return The core or -ENOENT (-2) if the vector has no route
+ */
+int irq_get_affinity(unsigned int vector);
+
+/** @brief Let a device interrupt follow the task, which consumes it
+ *
+ * If the interrupt arrives on another core than the last core of the
+ * task, the interrupt will be rerouted to the core of the task.
+ * The routing is fixed again, if the task terminates.
+ *
+ * @param vector The interrupt vector
+ * @param id The consuming task
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the vector has no route or the task doesn't exist
+ */
+int irq_follow_task(unsigned int vector, tid_t id);
+
+/** @brief Default destination of the n-th device interrupt
+ *
+ * This is the core of -irqcore=<core>, otherwise the interrupts are
+ * distributed round-robin over the cores, which aren't isolated.
+ */
+uint32_t irq_default_core(uint32_t n);
+
+/** @brief Route the device interrupts of a core to the other cores
+ *
+ * Is called by cpu_down().
+ */
+void irq_migrate_core(uint32_t core);
+
+/** @brief Apply the boot options to the routes, which are registered
+ * before the application processors are online
+ */
+void irq_affinity_init(void);
+
+/// current routing of a device interrupt (see sys_irqstat)
+typedef struct irqstat {
+	/// interrupt vector
+	uint32_t vector;
+	/// type of the source (IRQ_ROUTE_*)
+	uint32_t type;
+	/// destination of the interrupt
+	uint32_t core;
+	/// followed task or 0
+	uint32_t follow;
+	/// received interrupts on all cores
+	uint64_t count;
+} irqstat_t;
+
 /** @brief Procedure to initialize IRQ
  *
  * This procedure is just a small collection of calls:
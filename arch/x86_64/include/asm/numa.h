@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file arch/x86_64/include/asm/numa.h
+ * @brief Discovery of the NUMA nodes
+ *
+ * The nodes are taken from a table of the loader or from the ACPI SRAT.
+ * Without any information, the whole memory belongs to node 0.
+ */
+
+#ifndef __ARCH_NUMA_H__
+#define __ARCH_NUMA_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of NUMA nodes
+#define MAX_NUMA_NODES		8
+/// maximal number of memory ranges with a node affinity
+#define MAX_NUMA_RANGES		32
+
+/** @brief Memory range with its node, the loader uses the same layout */
+typedef struct numa_mem {
+	/// physical start address
+	uint64_t start;
+	/// physical end address (exclusive)
+	uint64_t end;
+	/// node of the range
+	uint32_t node;
+	uint32_t reserved;
+} __attribute__ ((packed)) numa_mem_t;
+
+/** @brief Discover the NUMA nodes
+ *
+ * Has to be called after the page allocator is able to map the tables.
+ *
+ * @return number of nodes
+ */
+uint32_t numa_init(void);
+
+/** @brief Determine the node of the calling core by its APIC id */
+void numa_register_core(void);
+
+/** @brief Number of nodes */
+uint32_t numa_nodes(void);
+
+/** @brief Node of the calling core */
+uint32_t numa_node(void);
+
+/** @brief Node of a core */
+uint32_t numa_core_node(uint32_t core_id);
+
+/** @brief Node of a physical address */
+uint32_t numa_phys_node(size_t phyaddr);
+
+/** @brief End of the range, which has the same node as phyaddr
+ *
+ * @return first address behind phyaddr, which may belong to another node
+ */
+size_t numa_phys_limit(size_t phyaddr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -45,15 +45,18 @@
 #define PAGE_BITS		12
 #define PAGE_2M_BITS		21
 #define HUGE_PAGE_BITS		21
+#define PAGE_1G_BITS		30
 
 /// The size of a single page in bytes
 #define PAGE_SIZE		(1UL << PAGE_BITS)
 #define PAGE_2M_SIZE		(1UL << PAGE_2M_BITS)
 #define HUGE_PAGE_SIZE		(1UL << HUGE_PAGE_BITS)
+#define PAGE_1G_SIZE		(1UL << PAGE_1G_BITS)
 /// Mask the page address without page map flags and XD flag
 #define PAGE_MASK		(((~0UL) << PAGE_BITS) & ~PG_XD)
 #define PAGE_2M_MASK		(((~0UL) << PAGE_2M_BITS) & ~PG_XD)
 #define HUGE_PAGE_MASK		(((~0UL) << HUGE_PAGE_BITS) & ~PG_XD)
+#define PAGE_1G_MASK		(((~0UL) << PAGE_1G_BITS) & ~PG_XD)
 
 /// Total operand width in bits
 #define BITS			64
@@ -97,6 +100,8 @@ static inline size_t sign_extend(ssize_t addr, int bits)
 #define PAGE_2M_FLOOR(addr)	( (addr)                   & ((~0UL) << PAGE_2M_BITS))
 /// Align to nex huge page boundary
 #define HUGE_PAGE_FLOOR(addr)	( (addr)                  & ((~0UL) << HUGE_PAGE_BITS))
+/// Align to 1G boundary
+#define PAGE_1G_FLOOR(addr)	( (addr)                  & ((~0UL) << PAGE_1G_BITS))
 /// Align end of the kernel
 #define KERNEL_END_CEIL(addr)   (PAGE_2M_CEIL((addr)))
 
@@ -188,8 +193,8 @@ int page_unmap(size_t viraddr, size_t npages);
 
 /** @brief Change the page permission in the page tables of the current task
  *
- * Applies given flags noted in the 'flags' parameter to
- * the range denoted by virtual start and end addresses.
+ * Applies the access rights of the VMA flags in the 'flags' parameter to
+ * the mapped pages of the range.
  *
  * @param start Range's virtual start address
  * @param end Range's virtual end address
@@ -201,4 +206,91 @@ int page_unmap(size_t viraddr, size_t npages);
  */
 int page_set_flags(size_t viraddr, uint32_t npages, int flags);
 
+/** @brief Unmap a region of anonymous memory and release its page frames
+ *
+ * Huge pages are released as a whole. The function waits until the
+ * other cores have dropped their translations, i.e. the caller must not
+ * disable interrupts or hold page_lock.
+ *
+ * @param viraddr The virtual start address
+ * @param npages The range's size in pages
+ * @return
+ * - 0 on success
+ */
+int page_discard(size_t viraddr, size_t npages);
+
+/** @brief Unmap the pages of a range and release their page frames
+ *
+ * In contrast to page_discard(), only pages, which lie completely within
+ * the range, are released. Huge pages crossing a boundary are kept. Like
+ * page_discard(), it waits for the other cores to drop their translations.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if start isn't page aligned
+ */
+int page_trim(size_t start, size_t end);
+
+/** @brief Map zeroed pages into a region of anonymous memory
+ *
+ * Mapped pages are kept. VMA_HUGE and VMA_HUGE_1G select larger pages,
+ * where the region is suitably aligned.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ * @param flags VMA flags of the region
+ * @return
+ * - 0 on success
+ * - -ENOMEM (-12) or -ENOSYS (-38) on failure
+ */
+int page_populate(size_t start, size_t end, uint32_t flags);
+
+/** @brief Map the pages of a file mapping, which contain an address
+ *
+ * The host copies the 2 MiB chunk, which contains viraddr, into new page
+ * frames (readahead). The chunk is clipped to the mapping. Read-only
+ * chunks are backed by a huge page, if possible. A mapped page within the chunk limits the
+ * readahead to the page at viraddr.
+ *
+ * @param viraddr Address within a VMA with the flag VMA_FILE
+ * @param start Start address of the VMA
+ * @param end End address of the VMA
+ * @param flags VMA flags of the region
+ * @return
+ * - the end of the mapped range on success
+ * - 0 on failure
+ */
+size_t page_map_file(size_t viraddr, size_t start, size_t end, uint32_t flags);
+
+/** @brief Map page frames, which aren't managed by the kernel, into a region
+ *
+ * The frames (e.g. of the virtio-fs DAX window) aren't released by
+ * page_unmap(). Huge pages are only used, if the flags contain VMA_HUGE.
+ *
+ * @param viraddr Virtual start address of the region
+ * @param phyaddr Physical address of the first frame
+ * @param npages Number of pages
+ * @param flags VMA flags of the region
+ * @return
+ * - 0 on success
+ * - -ENOMEM (-12) or -ENOSYS (-38) on failure
+ */
+int page_map_frames(size_t viraddr, size_t phyaddr, size_t npages, uint32_t flags);
+
+/** @brief Map the heap range [start, end) ahead of its first use
+ *
+ * Huge pages (or 1 GiB pages with -heap=1G) are mapped in batches,
+ * which share one acquisition of the page table lock. Already mapped
+ * pages are skipped.
+ *
+ * @param start Range's virtual start address
+ * @param end Range's virtual end address
+ * @return
+ * - 0 on success
+ * - -ENOMEM (-12) on failure
+ */
+int page_prefault(size_t start, size_t end);
+
 #endif
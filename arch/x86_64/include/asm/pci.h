@@ -46,15 +46,36 @@ typedef struct {
 	uint32_t base[6];
 	uint32_t size[6];
 	uint32_t irq;
+	/* location of the device */
+	uint32_t bus;
+	uint32_t slot;
+	/* offsets of the MSI and MSI-X capabilities (0 if not available) */
+	uint8_t msi_cap;
+	uint8_t msix_cap;
+	/* number of entries of the MSI-X table */
+	uint16_t msix_size;
+	/* MSI-X table, which is mapped by pci_msix_enable */
+	volatile uint32_t* msix_table;
 } pci_info_t;
 
 #define PCI_IGNORE_SUBID	(0)
 
+/* capability IDs */
+#define PCI_CAP_ID_MSI		0x05
+#define PCI_CAP_ID_VNDR		0x09
+#define PCI_CAP_ID_MSIX		0x11
+
 /** @brief Initialize the PCI environment
+ *
+ * Scans the buses, which are reachable from bus 0 via bridges, once and
+ * stores the devices with their BARs and capabilities in a table. Further
+ * calls return immediately.
  */
 int pci_init(void);
 
 /** @brief Determine the IObase address and the interrupt number of a specific device
+ *
+ * The device is looked up in the device table of pci_init().
  *
  * @param vendor_id The device's vendor ID
  * @param device_id The device's ID
@@ -68,6 +89,98 @@ int pci_init(void);
  */
 int pci_get_device_info(uint32_t vendor_id, uint32_t device_id, uint32_t subsystem_id, pci_info_t* info, int8_t enble_bus_master);
 
+/** @brief Look up the first device of a class
+ *
+ * Drivers of standardized interfaces (e.g. NVMe) don't depend on the vendor.
+ *
+ * @param class_code Class code, subclass and programming interface (e.g. 0x010802)
+ * @param info Pointer to the record pci_info_t, which receives the description of the device
+ * @param enable_bus_master If true, the bus mastering will be enabled.
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if there is no such device
+ */
+int pci_get_class_info(uint32_t class_code, pci_info_t* info, int8_t enable_bus_master);
+
+/** @brief Find a capability of a device
+ *
+ * @param info The record of the device
+ * @param id The capability ID
+ * @param prev Offset of the previous match or 0 to start at the beginning
+ *
+ * @return offset of the capability in the configuration space or 0 if there is no further match
+ */
+uint8_t pci_find_capability(const pci_info_t* info, uint8_t id, uint8_t prev);
+
+/** @brief Read a 32 bit register from the configuration space of a device
+ *
+ * @param info The record of the device
+ * @param off The offset of the register (will be aligned to 4 bytes)
+ */
+uint32_t pci_read_config(const pci_info_t* info, uint32_t off);
+
+/** @brief Map a region of a memory BAR uncached into the kernel space
+ *
+ * @param info The record of the device
+ * @param bar The number of the BAR
+ * @param off The offset of the region within the BAR
+ * @param len The length of the region
+ *
+ * @return virtual address of the region or NULL on failure
+ */
+void* pci_map_bar(const pci_info_t* info, uint8_t bar, uint32_t off, uint32_t len);
+
+/** @brief Enable MSI and route the interrupt of the device to a core
+ *
+ * The legacy interrupt (INTx) of the device will be disabled.
+ *
+ * @param info The record of the device
+ * @param vector The interrupt vector (see irq_alloc_vector)
+ * @param core The destination of the interrupt
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV (-19) if the device doesn't support MSI
+ */
+int pci_msi_enable(pci_info_t* info, uint8_t vector, uint32_t core);
+
+/** @brief Enable MSI-X
+ *
+ * Maps the MSI-X table and masks all entries. Afterwards, the
+ * entries have to be configured by pci_msix_set_vector. The
+ * legacy interrupt (INTx) of the device will be disabled.
+ *
+ * @param info The record of the device
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV (-19) if the device doesn't support MSI-X
+ * - -ENOMEM (-12) if the table isn't mappable
+ */
+int pci_msix_enable(pci_info_t* info);
+
+/** @brief Route an entry of the MSI-X table to a core and unmask it
+ *
+ * @param info The record of the device
+ * @param entry The entry of the MSI-X table
+ * @param vector The interrupt vector (see irq_alloc_vector)
+ * @param core The destination of the interrupt
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if MSI-X isn't enabled or the entry doesn't exist
+ */
+int pci_msix_set_vector(pci_info_t* info, uint16_t entry, uint8_t vector, uint32_t core);
+
+/** @brief Disable MSI and MSI-X and switch back to the legacy interrupt
+ *
+ * @param info The record of the device
+ *
+ * @return 0 in any case
+ */
+int pci_msi_disable(pci_info_t* info);
+
 /** @brief Print information of existing pci adapters
  *
  * @return 0 in any case
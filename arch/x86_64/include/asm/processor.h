@@ -37,6 +37,7 @@
 #define __ARCH_PROCESSOR_H__
 
 #include <hermit/stddef.h>
+#include <hermit/clocksource.h>
 #include <asm/gdt.h>
 #include <asm/apic.h>
 #include <asm/irqflags.h>
@@ -70,11 +71,13 @@ extern "C" {
 #define CPU_FEATURE_EST				(1 << 7)
 #define CPU_FEATURE_SSE3			(1 << 9)
 #define CPU_FEATURE_FMA				(1 << 12)
+#define CPU_FEATURE_PCID			(1 << 17)
 #define CPU_FEATURE_DCA				(1 << 18)
 #define CPU_FEATURE_SSE4_1			(1 << 19)
 #define CPU_FEATURE_SSE4_2			(1 << 20)
 #define CPU_FEATURE_X2APIC			(1 << 21)
 #define CPU_FEATURE_MOVBE			(1 << 22)
+#define CPU_FEATURE_TSC_DEADLINE		(1 << 24)
 #define CPU_FEATURE_XSAVE			(1 << 26)
 #define CPU_FEATURE_OSXSAVE			(1 << 27)
 #define CPU_FEATURE_AVX				(1 << 28)
@@ -236,6 +239,12 @@ extern "C" {
 
 #define MSR_IA32_PERFCTR0			0x000000c1
 #define MSR_IA32_PERFCTR1			0x000000c2
+#define MSR_IA32_PERFEVTSEL0			0x00000186
+#define MSR_IA32_FIXED_CTR0			0x00000309
+#define MSR_IA32_FIXED_CTR_CTRL			0x0000038d
+#define MSR_IA32_PERF_GLOBAL_STATUS		0x0000038e
+#define MSR_IA32_PERF_GLOBAL_CTRL		0x0000038f
+#define MSR_IA32_PERF_GLOBAL_OVF_CTRL		0x00000390
 #define MSR_FSB_FREQ				0x000000cd
 #define MSR_PLATFORM_INFO			0x000000ce
 
@@ -248,6 +257,7 @@ extern "C" {
 #define MSR_IA32_PERF_CTL			0x00000199
 #define MSR_IA32_CR_PAT				0x00000277
 #define MSR_MTRRdefType				0x000002ff
+#define MSR_IA32_TSC_DEADLINE			0x000006e0
 
 #define MSR_PPERF				0x0000064e
 #define MSR_PERF_LIMIT_REASONS			0x0000064f
@@ -301,6 +311,9 @@ typedef struct {
 
 extern cpu_info_t cpu_info;
 
+/// hint for mwait in the idle loop, validated by cpu_detection()
+extern uint32_t mwait_hint;
+
 // reset FS & GS registers to the default values
 int reset_fsgs(int32_t core_id);
 
@@ -319,7 +332,7 @@ inline static size_t get_hbmem_base(void) {
 }
 
 inline static size_t get_hbmem_size(void) {
-	return hbmem_base;
+	return hbmem_size;
 }
 
 inline static uint32_t has_fpu(void) {
@@ -408,6 +421,10 @@ inline static uint32_t has_x2apic(void) {
 	return (cpu_info.feature2 & CPU_FEATURE_X2APIC);
 }
 
+inline static uint32_t has_tsc_deadline(void) {
+	return (cpu_info.feature2 & CPU_FEATURE_TSC_DEADLINE);
+}
+
 inline static uint32_t has_xsave(void) {
 	return (cpu_info.feature2 & CPU_FEATURE_XSAVE);
 }
@@ -433,6 +450,18 @@ inline static uint32_t has_nx(void)
 	return (cpu_info.feature3 & CPU_FEATURE_NX);
 }
 
+inline static uint32_t has_1gbhp(void) {
+	return (cpu_info.feature3 & CPU_FEATURE_1GBHP);
+}
+
+inline static uint32_t has_pcid(void) {
+	return (cpu_info.feature2 & CPU_FEATURE_PCID);
+}
+
+inline static uint32_t has_invpcid(void) {
+	return (cpu_info.feature4 & CPU_FEATURE_INVPCID);
+}
+
 inline static uint32_t has_fsgsbase(void) {
 	return (cpu_info.feature4 & CPU_FEATURE_FSGSBASE);
 }
@@ -718,15 +747,94 @@ inline static void invalidate_cache(void) {
 /// Send IPIs to the other core, which flush the TLB on the other cores.
 int ipi_tlb_flush(void);
 
+/** @brief Invalidate a range of virtual addresses in the TLBs of the other cores
+ *
+ * Small ranges are invalidated page by page, larger ones by a full flush.
+ * Requests, which arrive at a core before it has handled the previous
+ * one, are merged and don't send an IPI on their own.
+ *
+ * @param start Start address of the range
+ * @param end End address of the range
+ */
+int ipi_tlb_shootdown(size_t start, size_t end);
+
+/** @brief Invalidate a range of virtual addresses in the TLBs of the other cores
+ * and wait until all of them are done
+ *
+ * Afterwards, no core is able to access the pages of the range through a
+ * stale translation. Interrupts of the other cores have to be enabled,
+ * i.e. the caller must not hold locks, which they wait for with disabled
+ * interrupts.
+ *
+ * @param start Start address of the range
+ * @param end End address of the range
+ */
+int ipi_tlb_shootdown_sync(size_t start, size_t end);
+
+/** @brief Flush the TLBs of the other cores and wait until all of them are done
+ *
+ * Interrupts of the other cores have to be enabled, i.e. the caller must
+ * not hold locks, which they wait for with disabled interrupts.
+ */
+int ipi_tlb_flush_sync(void);
+
+/// invalidate a single address of a PCID, except global translations
+#define INVPCID_ADDRESS		0
+/// invalidate all translations of a PCID, except global translations
+#define INVPCID_CONTEXT		1
+/// invalidate all translations including global translations
+#define INVPCID_ALL_GLOBAL	2
+/// invalidate all translations except global translations
+#define INVPCID_ALL		3
+
+/** @brief Invalidate translations by the INVPCID instruction
+ *
+ * @param type One of the INVPCID_* types
+ * @param pcid Process-context identifier
+ * @param addr Linear address for INVPCID_ADDRESS
+ */
+static inline void invpcid(size_t type, size_t pcid, size_t addr)
+{
+	struct {
+		uint64_t pcid;
+		uint64_t addr;
+	} desc = { pcid, addr };
+
+	asm volatile("invpcid %0, %1" :: "m"(desc), "r"(type) : "memory");
+}
+
+/// are PCIDs enabled and INVPCID supported?
+static inline int use_invpcid(void)
+{
+	return has_invpcid() && (read_cr4() & CR4_PCIDE);
+}
+
+/** @brief Flush the whole TLB including global pages */
+static inline void tlb_flush_all(void)
+{
+	size_t cr4 = read_cr4();
+
+	if (use_invpcid()) {
+		invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+	} else if (cr4 & CR4_PGE) {
+		write_cr4(cr4 & ~CR4_PGE);
+		write_cr4(cr4);
+	} else write_cr3(read_cr3());
+}
+
 /** @brief Flush Translation Lookaside Buffer
  *
- * Just reads cr3 and writes the same value back into it.
+ * Just reads cr3 and writes the same value back into it. If PCIDs are
+ * enabled, INVPCID invalidates the context without a CR3 reload.
  */
 static inline void tlb_flush(uint8_t with_ipi)
 {
 	size_t val = read_cr3();
 
-	if (val)
+	// all tasks share PCID 0 => invalidate its non-global translations
+	if (use_invpcid())
+		invpcid(INVPCID_CONTEXT, 0, 0);
+	else if (val)
 		write_cr3(val);
 
 #if MAX_CORES > 1
@@ -976,6 +1084,38 @@ inline static int system_init(void)
  */
 uint32_t detect_cpu_frequency(void);
 
+/** @brief Read out the TSC frequency, which CPUID reports
+ *
+ * The value of the loader, the hypervisor leaf 0x40000010 and the
+ * leafs 0x15 and 0x16 are evaluated.
+ *
+ * @return The TSC frequency in Hz or 0, if CPUID doesn't report it
+ */
+uint64_t get_tsc_frequency(void);
+
+/** @brief Read out the frequency of the APIC timer without calibration
+ *
+ * The value of the loader, the hypervisor leaf 0x40000010 and the
+ * crystal clock of leaf 0x15 are evaluated.
+ *
+ * @return The frequency in Hz or 0, if it isn't known
+ */
+uint64_t get_apic_frequency(void);
+
+/// policies of the P-state governor (kernel command line -governor=...)
+#define PSTATE_PERFORMANCE	0
+#define PSTATE_POWERSAVE	1
+#define PSTATE_ONDEMAND		2
+
+/** @brief Account idle time of the current core for the P-state governor
+ *
+ * With the ondemand policy, the governor adjusts the P-state of the
+ * core, whenever a measurement window has elapsed.
+ *
+ * @param cycles Length of the idle period in TSC cycles
+ */
+void pstate_account_idle(uint64_t cycles);
+
 /** @brief Read out CPU frequency if detected before
  *
  * If you did not issue the detect_cpu_frequency() function before,
@@ -985,6 +1125,23 @@ uint32_t detect_cpu_frequency(void);
  */
 uint32_t get_cpu_frequency(void);
 
+/** @brief Get the time in ns, which the hypervisor has stolen from a core
+ *
+ * The time is read from KVM's steal time area of the core.
+ *
+ * @return Stolen time since the registration (0 without KVM steal time)
+ */
+uint64_t get_steal_time(uint32_t core_id);
+
+/** @brief Get the last level cache, which is used by a core
+ *
+ * Cores with the same identifier share their last level cache.
+ *
+ * @param core_id Id of the core
+ * @return Identifier of the cache domain
+ */
+uint32_t get_cache_domain(uint32_t core_id);
+
 /** @brief Busywait an microseconds interval of time
  * @param usecs The time to wait in microseconds
  */
@@ -1000,7 +1157,8 @@ static inline void register_task(void)
 
 /** @brief System calibration
  *
- * This procedure will detect the CPU frequency and calibrate the APIC timer.
+ * This procedure will detect the CPU frequency, select the clock source
+ * and calibrate the APIC timer.
  *
  * @return 0 in any case.
  */
@@ -1021,6 +1179,8 @@ inline static int system_calibration(void)
 
 	irq_enable();
 	detect_cpu_frequency();
+	// before the other cores are started
+	clocksource_init();
 	apic_calibration();
 
 	return 0;
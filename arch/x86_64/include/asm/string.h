@@ -26,8 +26,69 @@
 extern "C" {
 #endif
 
+/// rep movsb/stosb is fast (enhanced rep movsb/stosb)
+#define STRING_ERMS	(1 << 0)
+/// rep movsb is also fast for short copies
+#define STRING_FSRM	(1 << 1)
+
+/// STRING_* features of the processor, are set by cpu_detection()
+extern uint32_t string_features;
+
+/// size of the last level cache, larger copies use non-temporal stores
+extern size_t memcpy_nt_threshold;
+
+/// copies of at most this size are done without rep
+#define MEMCPY_SMALL	16
+
+typedef uint64_t __attribute__ ((may_alias, aligned(1))) unaligned_u64_t;
+typedef uint32_t __attribute__ ((may_alias, aligned(1))) unaligned_u32_t;
+
+/** @brief Copy at most MEMCPY_SMALL bytes
+ *
+ * Uses two overlapping loads and stores instead of a loop.
+ */
+inline static void memcpy_small(void* dest, const void* src, size_t count)
+{
+	uint8_t* d = (uint8_t*) dest;
+	const uint8_t* s = (const uint8_t*) src;
+
+	if (count >= 8) {
+		const uint64_t a = *(const unaligned_u64_t*) s;
+		const uint64_t b = *(const unaligned_u64_t*) (s + count - 8);
+
+		*(unaligned_u64_t*) d = a;
+		*(unaligned_u64_t*) (d + count - 8) = b;
+	} else if (count >= 4) {
+		const uint32_t a = *(const unaligned_u32_t*) s;
+		const uint32_t b = *(const unaligned_u32_t*) (s + count - 4);
+
+		*(unaligned_u32_t*) d = a;
+		*(unaligned_u32_t*) (d + count - 4) = b;
+	} else if (count) {
+		const uint8_t a = s[0], b = s[count / 2], c = s[count - 1];
+
+		d[0] = a;
+		d[count / 2] = b;
+		d[count - 1] = c;
+	}
+}
+
+/** @brief Copy with non-temporal stores
+ *
+ * The copy bypasses the caches, which is useful, if another core or
+ * the host reads the destination (e.g. the buffers of mmnif). The
+ * stores are ordered with a sfence before the function returns.
+ */
+void* memcpy_nt(void* dest, const void* src, size_t count);
+
+/// determine the STRING_* features and memcpy_nt_threshold
+void string_init(void);
+
 #if HAVE_ARCH_MEMCPY
 /** @brief Copy a byte range from source to dest
+ *
+ * Short copies avoid the startup of rep movs, copies larger than the
+ * last level cache use non-temporal stores (see memcpy_nt).
  *
  * @param dest Destination address
  * @param src Source address
@@ -40,13 +101,27 @@ inline static void *memcpy(void* dest, const void *src, size_t count)
 	if (BUILTIN_EXPECT(!dest || !src, 0))
 		return dest;
 
-	asm volatile (
-		"cld; rep movsq\n\t"
-		"movq %4, %%rcx\n\t"
-		"andq $7, %%rcx\n\t"
-		"rep movsb\n\t"
-		: "=&c"(i), "=&D"(j), "=&S"(k)
-		: "0"(count/8), "g"(count), "1"(dest), "2"(src) : "memory","cc");
+	if (count <= MEMCPY_SMALL) {
+		memcpy_small(dest, src, count);
+		return dest;
+	}
+
+	if (BUILTIN_EXPECT(count >= memcpy_nt_threshold, 0))
+		return memcpy_nt(dest, src, count);
+
+	if (string_features & STRING_ERMS) {
+		asm volatile ("cld; rep movsb"
+			: "=&c"(i), "=&D"(j), "=&S"(k)
+			: "0"(count), "1"(dest), "2"(src) : "memory","cc");
+	} else {
+		asm volatile (
+			"cld; rep movsq\n\t"
+			"movq %4, %%rcx\n\t"
+			"andq $7, %%rcx\n\t"
+			"rep movsb\n\t"
+			: "=&c"(i), "=&D"(j), "=&S"(k)
+			: "0"(count/8), "g"(count), "1"(dest), "2"(src) : "memory","cc");
+	}
 
 	return dest;
 }
@@ -66,7 +141,13 @@ inline static void *memset(void* dest, int val, size_t count)
 	if (BUILTIN_EXPECT(!dest, 0))
 		return dest;
 
-	if (val) {
+	if (count <= MEMCPY_SMALL) {
+		const uint64_t pattern = 0x0101010101010101ULL * (uint8_t) val;
+
+		memcpy_small(dest, &pattern, count > 8 ? 8 : count);
+		if (count > 8)
+			memcpy_small((uint8_t*) dest + 8, &pattern, count - 8);
+	} else if (val || (string_features & STRING_ERMS)) {
 		asm volatile ("cld; rep stosb"
 			: "=&c"(i), "=&D"(j)
 			: "a"(val), "1"(dest), "0"(count) : "memory","cc");
@@ -38,6 +38,7 @@
 #define __ASM_TASKS_H__
 
 #include <hermit/stddef.h>
+#include <asm/processor.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +51,24 @@ extern "C" {
  */
 void switch_context(size_t** stack);
 
+/**
+ * @brief Switch between two fibers of the current task
+ *
+ * @param old_stack Location to store the stack pointer of the current fiber
+ * @param new_stack Saved stack pointer of the next fiber
+ */
+void fiber_switch(size_t** old_stack, size_t* new_stack);
+
+/**
+ * @brief Create the initial frame of a fiber, which is restored by fiber_switch()
+ *
+ * @param stack Stack of the fiber
+ * @param size Size of the stack
+ * @param entry Function, which is called by the first fiber_switch()
+ * @return Initial stack pointer of the fiber
+ */
+size_t* create_fiber_frame(void* stack, size_t size, void (*entry)(void));
+
 /** @brief Setup a default frame for a new task
  *
  * @param task Pointer to the task structure
@@ -62,6 +81,31 @@ void switch_context(size_t** stack);
  */
 int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t core_id);
 
+/** @brief Enable the FPU for the current task
+ *
+ * Clears CR0.TS, which is set after each context switch.
+ */
+static inline void fpu_enable(void)
+{
+	clts();
+}
+
+/** @brief Save the FPU state of a task, which is already switched out
+ *
+ * CR0.TS is set after a context switch. Consequently, the FPU is
+ * temporarily enabled to save the registers of the previous owner.
+ *
+ * @param task Pointer to the task, which owns the FPU of the current core
+ */
+static inline void save_fpu_state_of(task_t* task)
+{
+	size_t cr0 = read_cr0();
+
+	clts();
+	save_fpu_state(task->fpu);
+	write_cr0(cr0);
+}
+
 /** @brief Jump to user code
  *
  * This function runs the user code after stopping it just as if
@@ -116,6 +116,22 @@ typedef struct {
 	uint64_t status_reg;
 } bndcsr_t;
 
+typedef struct {
+	uint64_t opmask[8];
+} opmask_t;
+
+typedef struct {
+	uint32_t zmmh_space[128];
+} zmmh_t;
+
+typedef struct {
+	uint32_t hi16_zmm_space[256];
+} hi16_zmm_t;
+
+/*
+ * Standard (non-compacted) layout of the XSAVE area up to the AVX-512
+ * components. cpu_detection() disables all components, which exceed it.
+ */
 typedef struct {
 	i387_fxsave_t fxsave;
 	xsave_header_t hdr;
@@ -123,6 +139,10 @@ typedef struct {
 	lwp_t lwp;
 	bndregs_t bndregs;
 	bndcsr_t bndcsr;
+	uint8_t padding[48];
+	opmask_t opmask;
+	zmmh_t zmmh;
+	hi16_zmm_t hi16_zmm;
 } xsave_t __attribute__ ((aligned (64)));
 
 union fpu_state {
@@ -36,14 +36,64 @@
 
 #include <hermit/stddef.h>
 #include <asm/io.h>
+#include <asm/processor.h>
+#ifdef SYSSTAT
+#include <hermit/sysstat.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// UHYVE_PORT_WRITE
+typedef struct {
+	int fd;
+	const char* buf;
+	size_t len;
+} __attribute__((packed)) uhyve_write_t;
+
+// UHYVE_PORT_READ
+typedef struct {
+	int fd;
+	char* buf;
+	size_t len;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_read_t;
+
+// UHYVE_PORT_LSEEK
+typedef struct {
+	int fd;
+	off_t offset;
+	int whence;
+} __attribute__((packed)) uhyve_lseek_t;
+
+// UHYVE_PORT_MMAP, the host copies len bytes of the file at offset
+// into the guest physical memory at phyaddr and returns the number of
+// copied bytes (less at the end of the file) or -errno
+typedef struct {
+	int fd;
+	off_t offset;
+	size_t phyaddr;
+	size_t len;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_mmap_t;
+
+/** @brief Issue a hypercall
+ *
+ * With SYSSTAT, the calls and the cycles, for which the vCPU is blocked,
+ * are accounted per port (see sys_hcstat).
+ */
 inline static void uhyve_send(unsigned short _port, unsigned int _data)
 {
+#ifdef SYSSTAT
+	uint64_t start = get_rdtsc();
+
 	outportl(_port, _data);
+
+	hcstat_account(_port, get_rdtsc() - start);
+#else
+	outportl(_port, _data);
+#endif
 }
 
 #ifdef __cplusplus
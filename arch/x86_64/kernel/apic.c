@@ -34,14 +34,17 @@
 #include <hermit/time.h>
 #include <hermit/spinlock.h>
 #include <hermit/vma.h>
+#include <hermit/memory.h>
 #include <hermit/tasks.h>
 #include <hermit/logging.h>
+#include <hermit/boottime.h>
 #include <asm/irq.h>
 #include <asm/idt.h>
 #include <asm/irqflags.h>
 #include <asm/io.h>
 #include <asm/page.h>
 #include <asm/apic.h>
+#include <asm/numa.h>
 #include <hermit/boot.h>
 
 /*
@@ -73,10 +76,26 @@ static apic_config_table_t* apic_config = NULL;
 static size_t lapic = 0;
 static volatile ioapic_t* ioapic = NULL;
 static uint32_t icr = 0;
+static uint8_t tsc_deadline = 0;
+static uint64_t tsc_per_tick = 0;
 static uint32_t ncores = 1;
 static uint8_t irq_redirect[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xA, 0xB, 0xC, 0xD, 0xE, 0xF};
 static uint8_t apic_initialized = 0;
 static uint8_t online[MAX_APIC_CORES] = {[0 ... MAX_APIC_CORES-1] = 0};
+/// logical x2APIC ids (cluster << 16 | 1 << position in the cluster)
+static uint32_t x2apic_ldr[MAX_APIC_CORES] = {[0 ... MAX_APIC_CORES-1] = 0};
+
+#if MAX_CORES > 1
+/*
+ * Boot stacks of the application processors, which are woken up at once.
+ * Each processor claims one of them in entry.asm (NULL => the loader boots
+ * the processors one after another on the default boot stack).
+ */
+size_t* ap_boot_stacks __attribute__ ((section (".data"))) = NULL;
+// serializes the part of smp_start, which depends on current_boot_id
+static atomic_int32_t ap_boot_lock = ATOMIC_INIT(0);
+DECLARE_PER_CORE(size_t, boot_stack_bottom);
+#endif
 
 /*
  * The Multiprocessor Specification 1.4 (1997) suggests a 10ms delay
@@ -185,6 +204,14 @@ static inline void lapic_timer_periodic(void)
 	lapic_write(APIC_LVT_T, 0x2007B);
 }
 
+static inline void lapic_timer_tsc_deadline(void)
+{
+	lapic_write(APIC_LVT_T, 0x4007B);
+	// the LVT write has to be visible before the deadline MSR is written
+	mb();
+	wrmsr(MSR_IA32_TSC_DEADLINE, 0);
+}
+
 extern uint32_t disable_x2apic;
 
 static inline void x2apic_disable(void)
@@ -234,11 +261,132 @@ static inline void x2apic_enable(void)
 	LOG_DEBUG("Enable X2APIC support!\n");
 }
 
+#define KVM_CPUID_SIGNATURE		0x40000000
+#define KVM_CPUID_FEATURES		0x40000001
+
+/// features of KVM's paravirtual interfaces (0 without KVM)
+static uint32_t kvm_features(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0;
+	uint32_t features = 0;
+	char signature[13] = {[0 ... 12] = 0};
+
+	if (!on_hypervisor())
+		return 0;
+
+	cpuid(KVM_CPUID_SIGNATURE, &a, (uint32_t*) signature, (uint32_t*) (signature+4), (uint32_t*) (signature+8));
+	if (strncmp(signature, "KVMKVMKVM", 12) || (a < KVM_CPUID_FEATURES))
+		return 0;
+
+	c = 0;
+	cpuid(KVM_CPUID_FEATURES, &features, &b, &c, &d);
+
+	return features;
+}
+
+#define MSR_KVM_PV_EOI_EN		0x4b564d04
+#define KVM_FEATURE_PV_EOI		(1 << 6)
+
+/*
+ * With PV EOI, KVM sets the flag of a core, if the interrupt, which it
+ * injects, needs no EOI cycle of the local APIC (e.g. no other interrupt
+ * is pending and the vector isn't level triggered). The guest clears
+ * the flag instead of writing the EOI register and avoids the VM exit.
+ */
+static uint32_t pv_eoi_flag[MAX_APIC_CORES] __attribute__ ((aligned (4)));
+
+/// is PV EOI enabled?
+static uint8_t pv_eoi = 0;
+
+static void pv_eoi_enable_cpu(void)
+{
+	if (pv_eoi)
+		wrmsr(MSR_KVM_PV_EOI_EN, virt_to_phys((size_t) &pv_eoi_flag[CORE_ID]) | 1);
+}
+
+static void pv_eoi_init(void)
+{
+	if (!(kvm_features() & KVM_FEATURE_PV_EOI))
+		return;
+
+	pv_eoi = 1;
+	pv_eoi_enable_cpu();
+
+	LOG_INFO("Use KVM's paravirtual EOI\n");
+}
+
+#define MSR_KVM_STEAL_TIME		0x4b564d03
+#define KVM_FEATURE_STEAL_TIME		(1 << 5)
+
+/// steal time area of a vCPU, which is shared with KVM
+typedef struct kvm_steal_time {
+	/// time in ns, which the vCPU was runnable, but not running on the host
+	uint64_t steal;
+	/// odd, while KVM updates the area
+	uint32_t version;
+	uint32_t flags;
+	/// KVM sets KVM_VCPU_PREEMPTED, while the host has descheduled the vCPU
+	uint8_t preempted;
+	uint8_t pad0[3];
+	uint32_t pad[11];
+} __attribute__ ((aligned (64))) kvm_steal_time_t;
+
+static kvm_steal_time_t steal_time[MAX_APIC_CORES];
+
+/// are the steal time areas registered?
+static uint8_t steal_time_enabled = 0;
+
+static void steal_time_enable_cpu(void)
+{
+	if (steal_time_enabled)
+		wrmsr(MSR_KVM_STEAL_TIME, virt_to_phys((size_t) &steal_time[CORE_ID]) | 1);
+}
+
+static void steal_time_init(void)
+{
+	if (!(kvm_features() & KVM_FEATURE_STEAL_TIME))
+		return;
+
+	steal_time_enabled = 1;
+	steal_time_enable_cpu();
+
+	LOG_INFO("Read the steal time of the vCPUs from KVM\n");
+}
+
+uint64_t get_steal_time(uint32_t core_id)
+{
+	const volatile kvm_steal_time_t* st;
+	uint32_t version;
+	uint64_t steal;
+
+	if (!steal_time_enabled || (core_id >= MAX_APIC_CORES))
+		return 0;
+
+	st = steal_time + core_id;
+	do {
+		version = st->version;
+		rmb();
+		steal = st->steal;
+		rmb();
+	} while ((version & 1) || (version != st->version));
+
+	return steal;
+}
+
 /*
  * Send a 'End of Interrupt' command to the APIC
  */
 void apic_eoi(size_t int_no)
 {
+	if (pv_eoi) {
+		uint8_t set;
+
+		// only KVM and the own core change the flag => no lock prefix
+		asm volatile ("btrl $0, %0; setc %1" : "+m"(pv_eoi_flag[CORE_ID]), "=r"(set) :: "memory", "cc");
+		if (set)
+			return;
+	}
+
 	/*
 	 * If the IDT entry that was invoked was greater-than-or-equal to 48,
 	 * then we use the APIC
@@ -315,6 +463,9 @@ static inline void set_ipi_dest(uint32_t cpu_id) {
 int apic_timer_is_running(void)
 {
 	if (BUILTIN_EXPECT(apic_is_enabled(), 1)) {
+		// the deadline MSR is cleared, when the timer fires
+		if (tsc_deadline)
+			return rdmsr(MSR_IA32_TSC_DEADLINE) != 0;
 		return lapic_read(APIC_CCR) != 0;
 	}
 
@@ -323,6 +474,13 @@ int apic_timer_is_running(void)
 
 int apic_timer_deadline(uint32_t ticks)
 {
+	if (tsc_deadline && BUILTIN_EXPECT(apic_is_enabled(), 1)) {
+		LOG_DEBUG("timer deadline %ld at core %d\n", ticks, CORE_ID);
+		wrmsr(MSR_IA32_TSC_DEADLINE, rdtsc() + ticks * tsc_per_tick);
+
+		return 0;
+	}
+
 	if (BUILTIN_EXPECT(apic_is_enabled() && icr, 1)) {
 		LOG_DEBUG("timer oneshot %ld at core %d\n", ticks, CORE_ID);
 		lapic_timer_oneshot();
@@ -334,13 +492,45 @@ int apic_timer_deadline(uint32_t ticks)
 	return -EINVAL;
 }
 
+int apic_timer_deadline_tsc(uint64_t deadline)
+{
+	if (tsc_deadline && BUILTIN_EXPECT(apic_is_enabled(), 1)) {
+		// a deadline in the past fires immediately, zero disarms the timer
+		wrmsr(MSR_IA32_TSC_DEADLINE, deadline ? deadline : 1);
+
+		return 0;
+	}
+
+	if (BUILTIN_EXPECT(apic_is_enabled() && icr && get_cpu_frequency(), 1)) {
+		const uint64_t now = rdtsc();
+		const uint64_t cycles = (1000000ULL * (uint64_t) get_cpu_frequency()) / TIMER_FREQ;
+		uint64_t counter = 1;
+
+		// round up, the timer must not expire too early
+		if (deadline > now)
+			counter = ((deadline - now) * (uint64_t) icr + cycles - 1) / cycles;
+		if (counter > 0xFFFFFFFFULL)
+			counter = 0xFFFFFFFFULL;
+
+		lapic_timer_oneshot();
+		lapic_timer_set_counter((uint32_t) counter);
+
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
 int apic_disable_timer(void)
 {
 	if (BUILTIN_EXPECT(!apic_is_enabled(), 0))
 		return -EINVAL;
 
 	//kprintf("Disable local APIC timer at core %d\n", CORE_ID);
-	lapic_timer_disable();
+	if (tsc_deadline)
+		wrmsr(MSR_IA32_TSC_DEADLINE, 0);
+	else
+		lapic_timer_disable();
 
 	return 0;
 }
@@ -445,7 +635,10 @@ static int lapic_reset(void)
 	lapic_write(APIC_SVR, 0x17F);	// enable the apic and connect to the idt entry 127
 	lapic_write(APIC_TPR, 0x00);	// allow all interrupts
 #ifdef DYNAMIC_TICKS
-	lapic_timer_disable();
+	if (tsc_deadline)
+		lapic_timer_tsc_deadline();
+	else
+		lapic_timer_disable();
 #else
 	if (icr) {
 		lapic_timer_periodic();
@@ -461,19 +654,55 @@ static int lapic_reset(void)
 	lapic_write(APIC_LINT1, 0x00010000);	// disable LINT1
 	lapic_write(APIC_LVT_ER, 0x7E);	// connect error to idt entry 126
 
+	// the logical id is derived from the x2APIC id and is read-only
+	if (has_x2apic()) {
+		uint32_t id = apic_cpu_id();
+
+		if (id < MAX_APIC_CORES)
+			x2apic_ldr[id] = lapic_read(APIC_LDR);
+	}
+
 	return 0;
 }
 
 #if MAX_CORES > 1
+/*
+ * send an INIT or STARTUP IPI to the application processor id
+ */
+static int send_boot_ipi(uint32_t id, uint32_t mode)
+{
+	uint32_t i;
+
+	if (has_x2apic()) {
+		wrmsr(0x800 + (APIC_ICR1 >> 4), ((uint64_t)id << 32)|mode);
+
+		return 0;
+	}
+
+	for(i=0; (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (i < 1000); i++)
+		PAUSE;
+	if (lapic_read(APIC_ICR1) & APIC_ICR_BUSY)
+		return -EIO;
+
+	set_ipi_dest(id);
+	lapic_write(APIC_ICR1, mode);
+
+	return 0;
+}
+
 /*
  * use the universal startup algorithm of Intel's MultiProcessor Specification
+ *
+ * Each step is sent to all application processors, before we wait for the
+ * required delay. Hence, the delays are paid once and not per processor.
+ * The result of each processor is stored in err[].
  */
-static int wakeup_ap(uint32_t start_eip, uint32_t id)
+static void wakeup_aps(uint32_t start_eip, uint32_t n, int* err)
 {
 	static char* reset_vector = 0;
 	uint32_t i;
 
-	LOG_INFO("Wakeup application processor %d via IPI\n", id);
+	LOG_INFO("Wakeup %u application processors via IPI\n", n-1);
 
 	// set shutdown code to 0x0A
 	cmos_write(0x0F, 0x0A);
@@ -488,85 +717,52 @@ static int wakeup_ap(uint32_t start_eip, uint32_t id)
 	*((volatile unsigned short *) (reset_vector+2)) = start_eip >> 4;
 	*((volatile unsigned short *) reset_vector) = 0x00;
 
-	if (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) {
-		LOG_ERROR("Previous send not complete\n");
-		return -EIO;
+	// send out INIT to all APs
+	LOG_DEBUG("Send IPIs\n");
+	for(i=1; i<n; i++)
+		err[i] = send_boot_ipi(i, APIC_INT_LEVELTRIG|APIC_INT_ASSERT|APIC_DM_INIT);
+	if (traditional_delay)
+		udelay(200);
+	else
+		udelay(10);
+
+	// reset INIT
+	for(i=1; i<n; i++) {
+		if (!err[i])
+			err[i] = send_boot_ipi(i, APIC_INT_LEVELTRIG|APIC_DM_INIT);
 	}
+	if (traditional_delay)
+		udelay(10000);
+	else
+		udelay(10);
 
-	// send out INIT to AP
-	LOG_DEBUG("Send IPI\n");
-	if (has_x2apic()) {
-		uint64_t dest = ((uint64_t)id << 32);
-
-		wrmsr(0x800 + (APIC_ICR1 >> 4), dest|APIC_INT_LEVELTRIG|APIC_INT_ASSERT|APIC_DM_INIT);
-		if (traditional_delay)
-			udelay(200);
-		else
-			udelay(10);
-		// reset INIT
-		wrmsr(0x800 + (APIC_ICR1 >> 4), APIC_INT_LEVELTRIG|APIC_DM_INIT);
-		if (traditional_delay)
-			udelay(10000);
-		else
-			udelay(10);
-		// send out the startup
-		wrmsr(0x800 + (APIC_ICR1 >> 4), dest|APIC_DM_STARTUP|(start_eip >> 12));
-		if (traditional_delay)
-			udelay(200);
-		else
-			udelay(10);
-		// do it again
-		wrmsr(0x800 + (APIC_ICR1 >> 4), dest|APIC_DM_STARTUP|(start_eip >> 12));
-		if (traditional_delay)
-			udelay(200);
-		else
-			udelay(10);
-
-		LOG_DEBUG("IPI done...\n");
+	// send out the startup
+	for(i=1; i<n; i++) {
+		if (!err[i])
+			err[i] = send_boot_ipi(i, APIC_DM_STARTUP|(start_eip >> 12));
+	}
+	if (traditional_delay)
+		udelay(200);
+	else
+		udelay(10);
 
-		return 0;
-	} else {
-		set_ipi_dest(id);
-		lapic_write(APIC_ICR1, APIC_INT_LEVELTRIG|APIC_INT_ASSERT|APIC_DM_INIT);
-		if (traditional_delay)
-			udelay(200);
-		else
-			udelay(10);
-		// reset INIT
-		lapic_write(APIC_ICR1, APIC_INT_LEVELTRIG|APIC_DM_INIT);
-		if (traditional_delay)
-			udelay(10000);
-		else
-			udelay(10);
-		// send out the startup
-		set_ipi_dest(id);
-		lapic_write(APIC_ICR1, APIC_DM_STARTUP|(start_eip >> 12));
-		if (traditional_delay)
-			udelay(200);
-		else
-			udelay(10);
-		// do it again
-		set_ipi_dest(id);
-		lapic_write(APIC_ICR1, APIC_DM_STARTUP|(start_eip >> 12));
-		if (traditional_delay)
-			udelay(200);
-		else
-			udelay(10);
-
-		LOG_DEBUG("IPI done...\n");
-
-		i = 0;
-	        while((lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (i < 1000))
-			i++; // wait for it to finish, give up eventualy tho
-
-		return ((lapic_read(APIC_ICR1) & APIC_ICR_BUSY) ? -EIO : 0); // did it fail (still delivering) or succeed ?
+	// do it again
+	for(i=1; i<n; i++) {
+		if (!err[i])
+			err[i] = send_boot_ipi(i, APIC_DM_STARTUP|(start_eip >> 12));
 	}
+	if (traditional_delay)
+		udelay(200);
+	else
+		udelay(10);
+
+	LOG_DEBUG("IPIs done...\n");
 }
 
 int smp_init(void)
 {
-	uint32_t i, j;
-	int err;
+	static int err[MAX_CORES];
+	uint32_t i, j, n;
 
 	if (ncores <= 1)
 		return -EINVAL;
@@ -596,23 +792,46 @@ int smp_init(void)
 		}
 	}
 
-	for(i=1; (i<ncores) && (i<MAX_CORES); i++)
-	{
-		atomic_int32_set(&current_boot_id, i);
+	n = (ncores < MAX_CORES) ? ncores : MAX_CORES;
+
+	// each application processor needs its own stack until tss_init
+	ap_boot_stacks = (size_t*) kmalloc(n * sizeof(size_t));
+	if (BUILTIN_EXPECT(!ap_boot_stacks, 0))
+		return -ENOMEM;
+
+	for(i=1; i<n; i++) {
+		ap_boot_stacks[i-1] = (size_t) kmalloc(KERNEL_STACK_SIZE);
+		if (BUILTIN_EXPECT(!ap_boot_stacks[i-1], 0)) {
+			while(--i > 0)
+				kfree((void*) ap_boot_stacks[i-1]);
+			kfree(ap_boot_stacks);
+			ap_boot_stacks = NULL;
+			return -ENOMEM;
+		}
+	}
 
-		err = wakeup_ap(SMP_SETUP_ADDR, i);
-		if (err)
-			LOG_WARNING("Unable to wakeup application processor %d: %d\n", i, err);
+	wakeup_aps(SMP_SETUP_ADDR, n, err);
 
-		for(j=0; (i >= atomic_int32_read(&cpu_online)) && (j < 1000); j++)
-			udelay(1000);
+	for(j=0; (atomic_int32_read(&cpu_online) < (int32_t) n) && (j < 1000); j++)
+		udelay(1000);
 
-		if (i >= atomic_int32_read(&cpu_online)) {
-			LOG_ERROR("Unable to wakeup processor %d, cpu_online %d\n", i, atomic_int32_read(&cpu_online));
-			return -EIO;
+	if (atomic_int32_read(&cpu_online) < (int32_t) n) {
+		for(i=1; i<n; i++) {
+			if (!online[i])
+				LOG_ERROR("Unable to wakeup processor %d: %d\n", i, err[i]);
 		}
+
+		LOG_ERROR("Only %d of %u cores are online\n", atomic_int32_read(&cpu_online), n);
+		// processors, which wake up later, still need their boot stack
+		return -EIO;
 	}
 
+	// all processors run on the stacks of their idle tasks
+	for(i=1; i<n; i++)
+		kfree((void*) ap_boot_stacks[i-1]);
+	kfree(ap_boot_stacks);
+	ap_boot_stacks = NULL;
+
 	LOG_DEBUG("%d cores online\n", atomic_int32_read(&cpu_online));
 
 	return 0;
@@ -639,6 +858,32 @@ int apic_calibration(void)
 	const uint64_t cycles_per_ms = cpu_freq_hz / 1000ULL;
 	const uint64_t wait_cycles = cycles_per_ms * APIC_TIMER_CALIBRATION_TICKS;
 
+#if defined(DYNAMIC_TICKS) && defined(TSC_DEADLINE)
+	// the timer expires directly at a TSC value => no calibration required
+	if (has_tsc_deadline() && cpu_freq_hz) {
+		tsc_deadline = 1;
+		tsc_per_tick = cpu_freq_hz / TIMER_FREQ;
+
+		lapic_reset();
+
+		LOG_INFO("APIC timer uses the TSC-deadline mode\n");
+
+		goto calibrated;
+	}
+#endif
+
+	// the frequency of the APIC timer is known => no calibration required
+	const uint64_t apic_hz = get_apic_frequency();
+	if (apic_hz >= TIMER_FREQ) {
+		icr = (uint32_t) (apic_hz / TIMER_FREQ);
+
+		lapic_reset();
+
+		LOG_INFO("APIC timer runs at %llu Hz => ICR of 0x%x\n", apic_hz, icr);
+
+		goto calibrated;
+	}
+
 	// disable interrupts to increase calibration accuracy
 	flags = irq_nested_disable();
 
@@ -665,7 +910,9 @@ int apic_calibration(void)
 
 	LOG_INFO("APIC calibration determined an ICR of 0x%x\n", icr);
 
+calibrated:
 	apic_initialized = 1;
+	numa_register_core();
 	atomic_int32_inc(&cpu_online);
 
 	if (is_single_kernel()) {
@@ -691,8 +938,14 @@ int apic_calibration(void)
 	}
 
 #if MAX_CORES > 1
-	if (is_single_kernel())
+	if (is_single_kernel()) {
+		boot_phase_begin(BOOT_PHASE_SMP_INIT);
 		smp_init();
+		boot_phase_end(BOOT_PHASE_SMP_INIT);
+
+		// the boot options may route interrupts to the application processors
+		irq_affinity_init();
+	}
 #endif
 
 	return 0;
@@ -913,9 +1166,79 @@ extern void gdt_flush(void);
 extern tid_t set_idle_task(void);
 
 #if MAX_CORES > 1
-int smp_start(void)
+static uint32_t apic_initial_id(void)
+{
+	uint32_t a, b, c = 0, d;
+
+	cpuid(0, &a, &b, &c, &d);
+	if (a >= 0xB) {
+		c = 0;
+		cpuid(0xB, &a, &b, &c, &d);
+		if (b & 0xFFFF)
+			return d;	// x2APIC id
+	}
+
+	c = 0;
+	cpuid(1, &a, &b, &c, &d);
+
+	return b >> 24;
+}
+
+#define KVM_FEATURE_PV_TLB_FLUSH	(1 << 9)
+
+#define KVM_VCPU_PREEMPTED		(1 << 0)
+#define KVM_VCPU_FLUSH_TLB		(1 << 1)
+
+/// does KVM flush the TLB of a preempted vCPU on request?
+static uint8_t pv_tlb_flush = 0;
+
+static void pv_tlb_init(void)
 {
-	int32_t core_id = atomic_int32_read(&current_boot_id);
+	if (!steal_time_enabled || !(kvm_features() & KVM_FEATURE_PV_TLB_FLUSH))
+		return;
+
+	pv_tlb_flush = 1;
+
+	LOG_INFO("Defer the TLB shootdowns of preempted vCPUs to KVM\n");
+}
+
+/*
+ * If the host has descheduled the vCPU, ask KVM to flush its TLB before
+ * the vCPU enters the guest again instead of waiting for the IPI.
+ * Fails, if the vCPU is running (or KVM restarts it concurrently).
+ */
+static inline int pv_tlb_defer(uint32_t core_id)
+{
+	uint8_t state;
+
+	if (!pv_tlb_flush)
+		return 0;
+
+	state = steal_time[core_id].preempted;
+	if (!(state & KVM_VCPU_PREEMPTED))
+		return 0;
+
+	return __atomic_compare_exchange_n(&steal_time[core_id].preempted, &state,
+		state | KVM_VCPU_FLUSH_TLB, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+int smp_start(int32_t slot)
+{
+	int32_t core_id;
+
+	/*
+	 * The processors are woken up at once => the boot id is derived from
+	 * the APIC id (smp_init uses the APIC id as core id). current_boot_id
+	 * is read by cpu_detection and tss_init and is published under a lock.
+	 */
+	if (slot >= 0) {
+		while (atomic_int32_test_and_set(&ap_boot_lock, 1))
+			PAUSE;
+
+		atomic_int32_set(&current_boot_id, apic_initial_id());
+	}
+
+	core_id = atomic_int32_read(&current_boot_id);
 
 	LOG_DEBUG("Try to initialize processor (local id %d)\n", core_id);
 
@@ -933,6 +1256,11 @@ int smp_start(void)
 	// reset APIC
 	lapic_reset();
 
+	pv_eoi_enable_cpu();
+	steal_time_enable_cpu();
+
+	numa_register_core();
+
 	LOG_DEBUG("Processor %d (local id %d) is entering its idle task\n", apic_cpu_id(), core_id);
 	LOG_DEBUG("CR0 of core %u: 0x%x\n", core_id, read_cr0());
 	online[core_id] = 1;
@@ -940,8 +1268,13 @@ int smp_start(void)
 	tid_t id = set_idle_task();
 
 	// initialize task state segment
+	if (slot >= 0)
+		set_per_core(boot_stack_bottom, ap_boot_stacks[slot]);
 	tss_init(id);
 
+	if (slot >= 0)
+		atomic_int32_set(&ap_boot_lock, 0);
+
 	// set task switched flag for the first FPU access
 	// => initialize the FPU
 	size_t cr0 = read_cr0();
@@ -961,66 +1294,429 @@ int smp_start(void)
 	return smp_main();
 }
 
-int ipi_tlb_flush(void)
+/// ranges above this number of pages are invalidated by a full flush
+#define TLB_SHOOTDOWN_PAGES	32
+
+/*
+ * Pending shootdown requests of each core. Requests, which arrive before
+ * the core has handled the previous IPI, are merged into its range and
+ * don't need an IPI on their own.
+ */
+static struct {
+	atomic_int32_t lock;
+	/// is an IPI on its way, which covers the range?
+	uint32_t open;
+	size_t start, end;
+	/// number of the last request
+	uint64_t seq;
+	/// number of the last request, which the core has completed
+	volatile uint64_t done;
+} __attribute__ ((aligned (CACHE_LINE))) shootdown[MAX_APIC_CORES];
+
+static inline void shootdown_lock(uint32_t core_id)
 {
-	uint32_t id = CORE_ID;
+	while (atomic_int32_test_and_set(&shootdown[core_id].lock, 1))
+		PAUSE;
+}
 
-	if (atomic_int32_read(&cpu_online) <= 1)
-		return 0;
+static inline void shootdown_unlock(uint32_t core_id)
+{
+	atomic_int32_set(&shootdown[core_id].lock, 0);
+}
+
+/*
+ * Send the vector to all cores with target[i] != 0. In the single-kernel
+ * all processors belong to us => if all other cores are targets, the
+ * shorthand "all excluding self" reaches them with one write. Otherwise,
+ * x2APIC sends one write per cluster of 16 logical ids.
+ */
+static void ipi_multicast(const uint8_t* target, uint32_t ntargets, uint8_t irq)
+{
+	uint32_t i, j, nclusters = 0;
+	uint32_t clusters[(MAX_APIC_CORES+15)/16];
+	const uint32_t id = CORE_ID;
+
+	if (!ntargets)
+		return;
+
+	/*
+	 * Make previous memory operations globally visible before
+	 * sending the IPI => serializing
+	 */
+	mb();
+
+	if (is_single_kernel() && (ntargets+1 == ncores) && (ntargets+1 == (uint32_t) atomic_int32_read(&cpu_online))) {
+		if (has_x2apic()) {
+			wrmsr(0x830, APIC_DEST_ALLBUT|APIC_INT_ASSERT|APIC_DM_FIXED|irq);
+		} else {
+			for(j=0; (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (j < 1000); j++)
+				PAUSE;
+			lapic_write(APIC_ICR1, APIC_DEST_ALLBUT|APIC_INT_ASSERT|APIC_DM_FIXED|irq);
+		}
+
+		return;
+	}
 
 	if (has_x2apic()) {
-		uint8_t flags = irq_nested_disable();
-		for(uint64_t i=0; i<MAX_APIC_CORES; i++)
-		{
-			if (i == id)
+		// merge the logical ids of each cluster
+		for(i=0; i<MAX_APIC_CORES; i++) {
+			if (!target[i] || (i == id))
 				continue;
-			if (!online[i])
+
+			if (BUILTIN_EXPECT(!x2apic_ldr[i] || (nclusters >= (MAX_APIC_CORES+15)/16), 0)) {
+				wrmsr(0x830, ((uint64_t)i << 32)|APIC_INT_ASSERT|APIC_DM_FIXED|irq);
 				continue;
+			}
 
-			LOG_DEBUG("Send IPI to %zd\n", i);
-			/*
-			 * Make previous memory operations globally visible before
-			 * sending the IPI through x2apic wrmsr. => serializing
-			 */
-			mb();
-			wrmsr(0x830, (i << 32)|APIC_INT_ASSERT|APIC_DM_FIXED|112);
+			for(j=0; j<nclusters; j++) {
+				if ((clusters[j] >> 16) == (x2apic_ldr[i] >> 16))
+					break;
+			}
+			if (j == nclusters)
+				clusters[nclusters++] = x2apic_ldr[i];
+			else
+				clusters[j] |= x2apic_ldr[i];
 		}
-		irq_nested_enable(flags);
-	} else {
-		if (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) {
-			LOG_ERROR("Previous send not complete");
-			return -EIO;
+
+		for(j=0; j<nclusters; j++)
+			wrmsr(0x830, ((uint64_t)clusters[j] << 32)|APIC_DEST_LOGICAL|APIC_INT_ASSERT|APIC_DM_FIXED|irq);
+
+		return;
+	}
+
+	// xAPIC => wait only, if the previous IPI isn't accepted yet
+	for(i=0; i<MAX_APIC_CORES; i++) {
+		if (!target[i] || (i == id))
+			continue;
+
+		for(j=0; (lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (j < 1000); j++)
+			PAUSE;
+		set_ipi_dest(i);
+		lapic_write(APIC_ICR1, APIC_INT_ASSERT|APIC_DM_FIXED|irq);
+	}
+}
+
+int ipi_tlb_shootdown(size_t start, size_t end)
+{
+	uint8_t target[MAX_APIC_CORES];
+	uint32_t id = CORE_ID;
+	uint32_t ntargets = 0;
+
+	if (atomic_int32_read(&cpu_online) <= 1)
+		return 0;
+
+	uint8_t flags = irq_nested_disable();
+	for(uint64_t i=0; i<MAX_APIC_CORES; i++)
+	{
+		uint32_t send;
+
+		target[i] = 0;
+		if (i == id)
+			continue;
+		if (!online[i])
+			continue;
+
+		shootdown_lock(i);
+		shootdown[i].seq++;
+		send = !shootdown[i].open;
+		if (send && pv_tlb_defer(i)) {
+			// KVM flushes the whole TLB, before the vCPU runs again
+			shootdown[i].done = shootdown[i].seq;
+			send = 0;
+		} else if (send) {
+			shootdown[i].open = 1;
+			shootdown[i].start = start;
+			shootdown[i].end = end;
+		} else {
+			if (start < shootdown[i].start)
+				shootdown[i].start = start;
+			if (end > shootdown[i].end)
+				shootdown[i].end = end;
 		}
+		shootdown_unlock(i);
 
-		uint8_t flags = irq_nested_disable();
-		for(uint64_t i=0; i<MAX_APIC_CORES; i++)
-		{
-			if (i == id)
-				continue;
-			if (!online[i])
-				continue;
+		// the pending IPI handles also this request
+		if (!send)
+			continue;
 
-			LOG_DEBUG("Send IPI to %zd\n", i);
-			set_ipi_dest(i);
-			lapic_write(APIC_ICR1, APIC_INT_ASSERT|APIC_DM_FIXED|112);
+		target[i] = 1;
+		ntargets++;
+	}
+
+	LOG_DEBUG("Send TLB shootdown to %u cores\n", ntargets);
+	ipi_multicast(target, ntargets, 112);
+	irq_nested_enable(flags);
+
+	return 0;
+}
+
+int ipi_tlb_flush(void)
+{
+	return ipi_tlb_shootdown(0, (size_t) -1);
+}
+
+int ipi_tlb_shootdown_sync(size_t start, size_t end)
+{
+	uint32_t id = CORE_ID;
+	uint64_t seq;
+	int ret;
+
+	ret = ipi_tlb_shootdown(start, end);
+	if (ret || (atomic_int32_read(&cpu_online) <= 1))
+		return ret;
+
+	for(uint64_t i=0; i<MAX_APIC_CORES; i++)
+	{
+		if ((i == id) || !online[i])
+			continue;
+
+		// the request, which covers ours, has at least this number
+		shootdown_lock(i);
+		seq = shootdown[i].seq;
+		shootdown_unlock(i);
+
+		while (shootdown[i].done < seq)
+			PAUSE;
+	}
+
+	return 0;
+}
+
+int ipi_tlb_flush_sync(void)
+{
+	return ipi_tlb_shootdown_sync(0, (size_t) -1);
+}
+
+static void apic_tlb_handler(struct state *s)
+{
+	uint32_t core_id = CORE_ID;
+	size_t start, end;
+	uint64_t seq;
+
+	shootdown_lock(core_id);
+	start = shootdown[core_id].start;
+	end = shootdown[core_id].end;
+	seq = shootdown[core_id].seq;
+	shootdown[core_id].open = 0;
+	shootdown_unlock(core_id);
+
+	LOG_DEBUG("Receive IPI at core %d to flush the TLB (0x%zx - 0x%zx)\n", core_id, start, end);
+
+	if (end - start > TLB_SHOOTDOWN_PAGES * PAGE_SIZE) {
+		tlb_flush_all();
+	} else {
+		for(start &= PAGE_MASK; start < end; start += PAGE_SIZE)
+			asm volatile("invlpg (%0)" : : "r"(start) : "memory");
+	}
+
+	/*
+	 * A deferred request may have completed a newer request in the
+	 * meantime => done increases only
+	 */
+	shootdown_lock(core_id);
+	if (shootdown[core_id].done < seq)
+		shootdown[core_id].done = seq;
+	shootdown_unlock(core_id);
+}
+
+/// remote calls of a single request, which are placed on the stack of the caller
+#define SMP_CALL_STACK_NODES	8
+
+/// entry of a call queue, each target core has its own node of a request
+typedef struct smp_call_node {
+	struct smp_call_node* next;
+	struct smp_call_req* req;
+} smp_call_node_t;
+
+typedef struct smp_call_req {
+	smp_call_func_t func;
+	void* arg;
+	/// number of target cores, which haven't finished func
+	atomic_int32_t pending;
+	/// asynchronous request => the last target frees it
+	uint32_t autofree;
+	smp_call_node_t nodes[];
+} smp_call_req_t;
+
+/*
+ * Lock-free call queues: the callers push their nodes with a CAS and the
+ * target takes the whole queue with a single exchange. Only the caller,
+ * which finds the queue empty, sends an IPI => calls, which arrive before
+ * the target has handled the IPI, are batched.
+ */
+static struct {
+	smp_call_node_t* volatile head;
+} __attribute__ ((aligned (CACHE_LINE))) call_queue[MAX_APIC_CORES];
+
+static void smp_call_push(uint32_t core_id, smp_call_node_t* node)
+{
+	smp_call_node_t* old;
 
-			uint32_t j = 0;
-			while((lapic_read(APIC_ICR1) & APIC_ICR_BUSY) && (j < 1000))
-				j++; // wait for it to finish, give up eventualy tho
+	do {
+		old = call_queue[core_id].head;
+		node->next = old;
+	} while (!__sync_bool_compare_and_swap(&call_queue[core_id].head, old, node));
+
+	if (!old)
+		apic_send_ipi(core_id, SMP_CALL_IRQ);
+}
+
+static void smp_call_run(smp_call_req_t* req)
+{
+	req->func(req->arg);
+
+	// the caller may release the request, as soon as pending is zero
+	if ((atomic_int32_dec(&req->pending) == 0) && req->autofree)
+		kfree(req);
+}
+
+/// run all calls, which are queued on the current core
+static void smp_call_drain(void)
+{
+	smp_call_node_t* node;
+	smp_call_node_t* fifo = NULL;
+	uint32_t core_id = CORE_ID;
+
+	node = __sync_lock_test_and_set(&call_queue[core_id].head, NULL);
+
+	// the queue is LIFO => reverse it to keep the order of the callers
+	while (node) {
+		smp_call_node_t* next = node->next;
+
+		node->next = fifo;
+		fifo = node;
+		node = next;
+	}
+
+	while (fifo) {
+		smp_call_node_t* next = fifo->next;
+
+		// the node may be released together with its request
+		smp_call_run(fifo->req);
+		fifo = next;
+	}
+}
+
+static void apic_call_handler(struct state* s)
+{
+	smp_call_drain();
+}
+
+/*
+ * Queues a request for n targets. cores == NULL selects the other online
+ * cores in ascending order. Cores aren't taken offline, consequently at
+ * least n of them are found.
+ */
+static int smp_call_submit(const uint32_t* cores, uint32_t n, smp_call_func_t func, void* arg, int wait)
+{
+	union {
+		smp_call_req_t req;
+		uint8_t buf[sizeof(smp_call_req_t) + SMP_CALL_STACK_NODES*sizeof(smp_call_node_t)];
+	} stack_req;
+	smp_call_req_t* req = &stack_req.req;
+	uint32_t i, target, self = 0, core_id = CORE_ID;
+	uint8_t flags;
+
+	if (!wait || (n > SMP_CALL_STACK_NODES)) {
+		req = (smp_call_req_t*) kmalloc(sizeof(smp_call_req_t) + n*sizeof(smp_call_node_t));
+		if (BUILTIN_EXPECT(!req, 0))
+			return -ENOMEM;
+	}
+
+	req->func = func;
+	req->arg = arg;
+	req->autofree = !wait;
+	atomic_int32_set(&req->pending, n);
+
+	for(i=0; cores && (i<n); i++)
+		self += (cores[i] == core_id);
+
+	/*
+	 * pending covers also the nodes, which aren't pushed yet
+	 * => the request isn't released before the last push
+	 */
+	flags = irq_nested_disable();
+	for(i=0, target=0; i<n; i++, target++) {
+		if (cores) {
+			target = cores[i];
+			if (target == core_id)
+				continue;
+		} else {
+			while ((target == core_id) || !online[target])
+				target++;
 		}
+
+		req->nodes[i].req = req;
+		smp_call_push(target, req->nodes + i);
+	}
+
+	// the current core is a target => run the function directly
+	for(i=0; i<self; i++)
+		smp_call_run(req);
+	irq_nested_enable(flags);
+
+	if (!wait)
+		return 0;
+
+	// handle the calls to the current core to avoid a deadlock with other waiters
+	while (atomic_int32_read(&req->pending) > 0) {
+		flags = irq_nested_disable();
+		smp_call_drain();
 		irq_nested_enable(flags);
+		PAUSE;
 	}
 
+	if (req != &stack_req.req)
+		kfree(req);
+
 	return 0;
 }
 
-static void apic_tlb_handler(struct state *s)
+int smp_call_function_many(const uint32_t* cores, uint32_t n, smp_call_func_t func, void* arg, int wait)
+{
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(!func || !cores, 0))
+		return -EINVAL;
+	if (!n)
+		return 0;
+
+	for(i=0; i<n; i++) {
+		if ((cores[i] >= MAX_APIC_CORES) || !online[cores[i]])
+			return -EINVAL;
+	}
+
+	return smp_call_submit(cores, n, func, arg, wait);
+}
+
+int smp_call_function_single(uint32_t core_id, smp_call_func_t func, void* arg, int wait)
 {
-	LOG_DEBUG("Receive IPI at core %d to flush the TLB\n", CORE_ID);
-	write_cr3(read_cr3());
+	return smp_call_function_many(&core_id, 1, func, arg, wait);
+}
+
+int smp_call_function(smp_call_func_t func, void* arg, int wait)
+{
+	uint32_t i, n = 0, core_id = CORE_ID;
+
+	if (BUILTIN_EXPECT(!func, 0))
+		return -EINVAL;
+
+	for(i=0; i<MAX_APIC_CORES; i++)
+		n += ((i != core_id) && online[i]);
+
+	if (!n)
+		return 0;
+
+	return smp_call_submit(NULL, n, func, arg, wait);
 }
 #endif
 
+void apic_lvt_pmc(uint8_t vector, int enable)
+{
+	// the delivery of a PMI masks the entry, the handler has to enable it again
+	lapic_write(APIC_LVT_PMC, enable ? vector : 0x10000);
+}
+
 int apic_send_ipi(uint64_t dest, uint8_t irq)
 {
 	uint8_t flags = irq_nested_disable();
@@ -1097,6 +1793,7 @@ void shutdown_system(void)
 
 	if (if_bootprocessor) {
 		print_irq_stats();
+		mem_print_stats();
 		LOG_INFO("System goes down...\n");
 	}
 
@@ -1128,11 +1825,16 @@ int apic_init(void)
 	if (ret)
 		return ret;
 
+	pv_eoi_init();
+	steal_time_init();
+
 	// set APIC error handler
 	irq_install_handler(121, apic_wakeup);
 	irq_install_handler(126, apic_err_handler);
 #if MAX_CORES > 1
+	pv_tlb_init();
 	irq_install_handler(80+32, apic_tlb_handler);
+	irq_install_handler(SMP_CALL_IRQ, apic_call_handler);
 #endif
 	irq_install_handler(81+32, apic_shutdown);
 	if (apic_processors[boot_processor])
@@ -1144,16 +1846,16 @@ int apic_init(void)
 	return 0;
 }
 
-int ioapic_inton(uint8_t irq, uint8_t apicid)
+int apic_core_online(uint32_t core_id)
+{
+	return (core_id < MAX_APIC_CORES) && online[core_id];
+}
+
+static int ioapic_route(uint8_t irq, uint8_t apicid)
 {
 	ioapic_route_t route;
 	uint32_t off;
 
-	if (BUILTIN_EXPECT(irq > 24, 0)){
-		LOG_ERROR("IOAPIC: trying to turn on irq %i which is too high\n", irq);
-		return -EINVAL;
-	}
-
 	if (irq < 16)
 		off = irq_redirect[irq]*2;
 	else
@@ -1182,6 +1884,23 @@ int ioapic_inton(uint8_t irq, uint8_t apicid)
 	return 0;
 }
 
+static int ioapic_retarget(void* arg, uint32_t data, uint8_t vector, uint32_t core)
+{
+	return ioapic_route((uint8_t) data, (uint8_t) core);
+}
+
+int ioapic_inton(uint8_t irq, uint8_t apicid)
+{
+	if (BUILTIN_EXPECT(irq > 24, 0)){
+		LOG_ERROR("IOAPIC: trying to turn on irq %i which is too high\n", irq);
+		return -EINVAL;
+	}
+
+	apicid = irq_route_register(0x20+irq, IRQ_ROUTE_IOAPIC, ioapic_retarget, NULL, irq, apicid);
+
+	return ioapic_route(irq, apicid);
+}
+
 int ioapic_intoff(uint8_t irq, uint8_t apicid)
 {
 	ioapic_route_t route;
@@ -1192,6 +1911,8 @@ int ioapic_intoff(uint8_t irq, uint8_t apicid)
 		return -EINVAL;
 	}
 
+	irq_route_unregister(0x20+irq);
+
 	if (irq < 16)
 		off = irq_redirect[irq]*2;
 	else
@@ -57,6 +57,14 @@ _pmstart:
 	mov gs, ax
 	mov ss, ax
 
+	; all application processors are woken up at once, but they share
+	; the boot stack => only one of them runs the trampoline at a time
+Lboot_wait:
+	lock bts dword [boot_lock], 0
+	jnc Lboot_locked
+	pause
+	jmp short Lboot_wait
+Lboot_locked:
 	mov esp, boot_stack+KERNEL_STACK_SIZE-16
 	jmp short stublet
 	jmp $
@@ -197,8 +205,15 @@ cpu_init:
 [BITS 64]
 ALIGN 8
 start64:
-    push kernel_start
-    ret
+    ; the kernel doesn't need the boot stack
+    ; => release the trampoline for the next processor
+    mov rax, kernel_start
+    mov dword [boot_lock], 0
+    jmp rax
+
+ALIGN 4
+boot_lock:
+    dd 0
 
 ALIGN 16
 global boot_stack
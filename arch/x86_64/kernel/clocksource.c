@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file arch/x86_64/kernel/clocksource.c
+ * @brief Clock sources: kvmclock and the time stamp counter
+ *
+ * kvmclock is preferred, because KVM corrects its time info after a
+ * migration or a change of the TSC frequency. Otherwise the TSC is used
+ * with the frequency, which CPUID reports. A TSC, which isn't invariant,
+ * is used only as a last resort.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/string.h>
+#include <hermit/clocksource.h>
+#include <hermit/vclock.h>
+#include <hermit/processor.h>
+#include <hermit/errno.h>
+#include <asm/atomic.h>
+#include <asm/irqflags.h>
+#include <asm/page.h>
+
+#define MSR_KVM_SYSTEM_TIME_NEW			0x4b564d01
+
+#define KVM_CPUID_SIGNATURE			0x40000000
+#define KVM_CPUID_FEATURES			0x40000001
+
+#define KVM_FEATURE_CLOCKSOURCE2		(1 << 3)
+#define KVM_FEATURE_CLOCKSOURCE_STABLE_BIT	(1 << 24)
+
+// CPUID.80000007H:EDX
+#define CPU_FEATURE_INVARIANT_TSC		(1 << 8)
+
+#define TSC_SHIFT	32
+
+static uint64_t tsc_mult = 0;
+
+/// one time info per core, 32 bytes never cross a page boundary
+static pvclock_vcpu_time_info_t kvmclock_info[MAX_CORES] __attribute__ ((aligned (32)));
+
+/// are the time infos of all cores equal?
+static uint8_t kvmclock_stable = 0;
+
+/// last returned time, if the time infos of the cores differ
+static atomic_int64_t kvmclock_last = ATOMIC_INIT(0);
+
+static uint64_t tsc_read(void)
+{
+	return (uint64_t) (((unsigned __int128) rdtsc() * tsc_mult) >> TSC_SHIFT);
+}
+
+static int tsc_probe(clocksource_t* cs)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, extended = 0;
+
+	cs->freq_hz = get_tsc_frequency();
+	if (!cs->freq_hz)
+		cs->freq_hz = 1000000ULL * (uint64_t) get_cpu_frequency();
+	if (BUILTIN_EXPECT(!cs->freq_hz, 0))
+		return -ENODEV;
+
+	cpuid(0x80000000, &extended, &b, &c, &d);
+	if (extended >= 0x80000007) {
+		c = 0;
+		cpuid(0x80000007, &a, &b, &c, &d);
+	} else d = 0;
+
+	// a TSC, which depends on the power state, is only the last resort
+	cs->rating = (d & CPU_FEATURE_INVARIANT_TSC) ? 300 : 100;
+	tsc_mult = (1000000000ULL << TSC_SHIFT) / cs->freq_hz;
+
+	return 0;
+}
+
+static clocksource_t tsc_clocksource = {
+	.name = "tsc",
+	.probe = tsc_probe,
+	.read = tsc_read,
+	.vclock_mode = VCLOCK_MODE_TSC,
+};
+
+static int kvmclock_register(void)
+{
+	size_t phyaddr = virt_to_phys((size_t) &kvmclock_info[CORE_ID]);
+
+	if (BUILTIN_EXPECT(!phyaddr, 0))
+		return -EFAULT;
+
+	// bit 0 enables the updates of the time info
+	wrmsr(MSR_KVM_SYSTEM_TIME_NEW, phyaddr | 1);
+
+	return 0;
+}
+
+static uint64_t kvmclock_read(void)
+{
+	uint64_t ns, last, old;
+	uint8_t flags;
+
+	if (kvmclock_stable)
+		return pvclock_read_ns(&kvmclock_info[0]);
+
+	flags = irq_nested_disable();
+	ns = pvclock_read_ns(&kvmclock_info[CORE_ID]);
+	irq_nested_enable(flags);
+
+	// the time must not run backwards, if the task migrates to another core
+	last = (uint64_t) atomic_int64_read(&kvmclock_last);
+	while (ns > last) {
+		old = (uint64_t) atomic_int64_cmpxchg(&kvmclock_last, (int64_t) last, (int64_t) ns);
+		if (old == last)
+			return ns;
+		last = old;
+	}
+
+	return last;
+}
+
+static int kvmclock_probe(clocksource_t* cs)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0;
+	uint32_t features = 0;
+	char signature[13] = {[0 ... 12] = 0};
+	const pvclock_vcpu_time_info_t* ti = &kvmclock_info[0];
+	uint64_t freq_hz;
+	int ret;
+
+	if (!on_hypervisor())
+		return -ENODEV;
+
+	cpuid(KVM_CPUID_SIGNATURE, &a, (uint32_t*) signature, (uint32_t*) (signature+4), (uint32_t*) (signature+8));
+	if (strncmp(signature, "KVMKVMKVM", 12) || (a < KVM_CPUID_FEATURES))
+		return -ENODEV;
+
+	c = 0;
+	cpuid(KVM_CPUID_FEATURES, &features, &b, &c, &d);
+	if (!(features & KVM_FEATURE_CLOCKSOURCE2))
+		return -ENODEV;
+
+	ret = kvmclock_register();
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	// KVM fills the time info before the write to the MSR returns
+	mb();
+	if (BUILTIN_EXPECT(!ti->version || !ti->tsc_to_system_mul, 0))
+		return -EIO;
+
+	kvmclock_stable = (features & KVM_FEATURE_CLOCKSOURCE_STABLE_BIT) && (ti->flags & PVCLOCK_TSC_STABLE_BIT);
+
+	// invert ns = ((delta << shift) * mul) >> 32
+	freq_hz = (1000000000ULL << 32) / ti->tsc_to_system_mul;
+	if (ti->tsc_shift >= 0)
+		freq_hz >>= ti->tsc_shift;
+	else
+		freq_hz <<= -ti->tsc_shift;
+
+	cs->rating = 400;
+	cs->freq_hz = freq_hz;
+	cs->vclock_mode = kvmclock_stable ? VCLOCK_MODE_PVCLOCK : VCLOCK_MODE_TSC;
+	cs->pvclock = kvmclock_stable ? ti : NULL;
+
+	return 0;
+}
+
+static int kvmclock_enable_cpu(clocksource_t* cs)
+{
+	return kvmclock_register();
+}
+
+static clocksource_t kvmclock_clocksource = {
+	.name = "kvmclock",
+	.probe = kvmclock_probe,
+	.enable_cpu = kvmclock_enable_cpu,
+	.read = kvmclock_read,
+	.vclock_mode = VCLOCK_MODE_TSC,
+};
+
+clocksource_t* arch_clocksources[] = {
+	&kvmclock_clocksource,
+	&tsc_clocksource,
+	NULL
+};
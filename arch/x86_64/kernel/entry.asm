@@ -76,6 +76,13 @@ align 4
     global hcgateway
     global hcmask
     global host_logical_addr
+    global numa_mem_addr
+    global numa_mem_count
+    global numa_apic_addr
+    global numa_apic_count
+    global boot_gtod
+    global tsc_freq
+    global apic_freq
     base dq 0
     limit dq 0
     cpu_freq dd 0
@@ -107,6 +114,13 @@ align 4
     hcgateway db 10,0,5,1
     hcmask db 255,255,255,0
     host_logical_addr dq 0
+    numa_mem_addr dq 0   ; physical address of numa_mem_t[numa_mem_count]
+    numa_mem_count dd 0
+    numa_apic_addr dq 0  ; physical address of the nodes (uint8_t) per APIC id
+    numa_apic_count dd 0
+    boot_gtod dq 0       ; wall-clock time at boot in microseconds since the epoch
+    tsc_freq dq 0        ; TSC frequency in Hz, if the loader knows it
+    apic_freq dq 0       ; frequency of the APIC timer in Hz, if the loader knows it
 
 ; Bootstrap page tables are used during the initialization.
 align 4096
@@ -244,8 +258,25 @@ Lno_pml4_init:
 %if MAX_CORES > 1
 ALIGN 64
 Lsmp_main:
+    ; application processors, which are booted at once by smp_init,
+    ; claim their own boot stack
+    extern ap_boot_stacks
+    mov rsi, QWORD [ap_boot_stacks]
+    cmp rsi, 0
+    je Lsmp_serial
+    mov eax, 1
+    lock xadd DWORD [ap_boot_slot], eax
+    mov edi, eax               ; 1st argument = boot slot
+    mov rsp, QWORD [rsi+rdi*8]
+    add rsp, KERNEL_STACK_SIZE-0x10
+    jmp Lsmp_start
+
+Lsmp_serial:
     ; set default stack pointer
     mov rsp, stack_top-0x10
+    mov edi, -1                ; no boot slot => use current_boot_id
+
+Lsmp_start:
     mov rbp, rsp
 
     extern smp_start
@@ -376,16 +407,17 @@ isrstub_pseudo_error 9
     jmp common_stub
 %endmacro
 
-; Create entries for the interrupts 0 to 23
+; Create entries for the interrupts 0 to 79
+; (24 to 79 are dynamically assigned, e.g. to MSI/MSI-X vectors)
 %assign i 0
-%rep    24
+%rep    80
     irqstub i
 %assign i i+1
 %endrep
 
-; Create entries for the interrupts 80 to 82
+; Create entries for the interrupts 80 to 83
 %assign i 80
-%rep 3
+%rep 4
   irqstub i
 %assign i i+1
 %endrep
@@ -515,6 +547,34 @@ Lno_context:
     call exit
     jmp $
 
+; void fiber_switch(size_t** old_stack, size_t* new_stack)
+; saves the callee-saved registers and the FPU control words on the
+; stack of the current fiber and continues the next fiber
+global fiber_switch
+align 64
+fiber_switch:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    sub rsp, 8
+    stmxcsr [rsp]
+    fnstcw [rsp+4]
+    mov QWORD [rdi], rsp
+    mov rsp, rsi
+    ldmxcsr [rsp]
+    fldcw [rsp+4]
+    add rsp, 8
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
+
 global switch_context
 align 64
 switch_context:
@@ -734,25 +794,48 @@ sighandler_epilog:
 global replace_boot_stack
 replace_boot_stack:
     ; rdi = 1st argument = desination address
+    ; rsi = 2nd argument = bottom of the boot stack (0 => stack_bottom)
+    cmp rsi, 0
+    jne Lreplace_stack
+    mov rsi, stack_bottom
 
+Lreplace_stack:
     ; set rsp to the new stack
-    sub rsp, stack_bottom
+    sub rsp, rsi
     add rsp, rdi
 
     ; currently we omit the frame point => no recalculation
-    ;sub rbp, stack_bottom
+    ;sub rbp, rsi
     ;add rbp, rdi
 
     ; copy boot stack to the new one
     cld
     mov rcx, KERNEL_STACK_SIZE
-    mov rsi, stack_bottom
     rep movsb
 
     ret
 
 SECTION .data
 
+; NASM macro to store the entry point of an interrupt
+%macro irqaddr 1
+    dq irq%1
+%endmacro
+
+; Create a table of the dynamically assigned interrupts 24 to 79
+global irq_dyn_stubs
+align 8
+irq_dyn_stubs:
+%assign i 24
+%rep 56
+    irqaddr i
+%assign i i+1
+%endrep
+
+; next free entry of ap_boot_stacks, not part of the loader's boot info
+align 4
+ap_boot_slot dd 0
+
 align 4096
 stack_bottom:
     TIMES KERNEL_STACK_SIZE DB 0xcd
@@ -59,12 +59,15 @@ extern void gdt_flush(void);
  * This is defined in entry.asm. We use this to properly replace
  * the current stack
  */
-extern void replace_boot_stack(size_t);
+extern void replace_boot_stack(size_t dest, size_t src);
 
 extern int32_t boot_processor;
 extern atomic_int32_t possible_cpus;
 extern atomic_int32_t current_boot_id;
 
+/// bottom of the current boot stack (0 => stack_bottom of entry.asm)
+DEFINE_PER_CORE(size_t, boot_stack_bottom, 0);
+
 void set_tss(size_t rps0, size_t ist1)
 {
 	task_state_segments[CORE_ID]->rsp0 = rps0;
@@ -243,7 +246,7 @@ void tss_init(tid_t id /* => current task id */)
 	set_boot_stack(id, rsp0, ist1);
 
 	// replace the stack pointer
-	replace_boot_stack(rsp0);
+	replace_boot_stack(rsp0, per_core(boot_stack_bottom));
 
 	gdt_flush();
 	reset_fsgs(core_id);
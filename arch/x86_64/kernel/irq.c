@@ -34,6 +34,7 @@
  */
 
 #include <hermit/stdio.h>
+#include <hermit/stdlib.h>
 #include <hermit/string.h>
 #include <hermit/tasks.h>
 #include <hermit/errno.h>
@@ -76,6 +77,7 @@ extern void irq23(void);
 extern void irq80(void);
 extern void irq81(void);
 extern void irq82(void);
+extern void irq83(void);
 extern void apic_timer(void);
 extern void apic_lint0(void);
 extern void apic_lint1(void);
@@ -83,6 +85,7 @@ extern void apic_error(void);
 extern void apic_svr(void);
 extern void wakeup(void);
 extern void mmnif_irq(void);
+extern const size_t irq_dyn_stubs[];
 
 #define MAX_HANDLERS	256
 //#define MEASURE_IRQ
@@ -98,6 +101,39 @@ static uint64_t irq_counter[MAX_CORES][MAX_HANDLERS] = {[0 ... MAX_CORES-1][0 ..
 static int go = 0;
 #endif
 
+/** @brief Bitmap of the dynamically assigned interrupt vectors, which are in use */
+static uint64_t irq_dyn_used = 0;
+static spinlock_irqsave_t irq_dyn_lock = SPINLOCK_IRQSAVE_INIT;
+
+/** @brief Routing of a device interrupt
+ *
+ * The owner of the source (IOAPIC, MSI, MSI-X) registers a function,
+ * which reprograms the destination of the interrupt.
+ */
+typedef struct irq_route {
+	/// reprograms the source
+	irq_retarget_t func;
+	/// arguments of func
+	void* arg;
+	uint32_t data;
+	/// current destination
+	uint32_t core;
+	/// requested destination, which may be offline at registration
+	uint32_t target;
+	/// task, which consumes the interrupt, or 0
+	tid_t follow;
+	/// type of the source or IRQ_ROUTE_NONE
+	uint8_t type;
+} irq_route_t;
+
+static irq_route_t irq_routes[MAX_HANDLERS] = {[0 ... MAX_HANDLERS-1] = {NULL, NULL, 0, 0, 0, 0, IRQ_ROUTE_NONE}};
+static spinlock_irqsave_t irq_route_lock = SPINLOCK_IRQSAVE_INIT;
+
+/// destinations of -irqaffinity=<vector>:<core>,... or -1
+static int16_t irq_override[MAX_HANDLERS] = {[0 ... MAX_HANDLERS-1] = -1};
+/// destination of all device interrupts from -irqcore=<core> or -1
+static int32_t irq_core = -1;
+
 /* This installs a custom IRQ handler for the given IRQ */
 int irq_install_handler(unsigned int irq, irq_handler_t handler)
 {
@@ -120,6 +156,299 @@ int irq_uninstall_handler(unsigned int irq)
 	return 0;
 }
 
+/* This reserves an unused interrupt vector, e.g. for MSI/MSI-X */
+int irq_alloc_vector(void)
+{
+	int ret = -ENOSPC;
+
+	spinlock_irqsave_lock(&irq_dyn_lock);
+	for(unsigned int i=0; i<=IRQ_DYN_LAST-IRQ_DYN_FIRST; i++) {
+		if (!(irq_dyn_used & (1ULL << i))) {
+			irq_dyn_used |= (1ULL << i);
+			ret = IRQ_DYN_FIRST + i;
+			break;
+		}
+	}
+	spinlock_irqsave_unlock(&irq_dyn_lock);
+
+	return ret;
+}
+
+/* This releases a vector, which is reserved by irq_alloc_vector */
+int irq_free_vector(unsigned int vector)
+{
+	if ((vector < IRQ_DYN_FIRST) || (vector > IRQ_DYN_LAST))
+		return -EINVAL;
+
+	irq_uninstall_handler(vector);
+	irq_route_unregister(vector);
+
+	spinlock_irqsave_lock(&irq_dyn_lock);
+	irq_dyn_used &= ~(1ULL << (vector - IRQ_DYN_FIRST));
+	spinlock_irqsave_unlock(&irq_dyn_lock);
+
+	return 0;
+}
+
+uint32_t irq_route_register(unsigned int vector, uint8_t type, irq_retarget_t func, void* arg, uint32_t data, uint32_t core)
+{
+	irq_route_t* route;
+	uint32_t target = core;
+
+	if (BUILTIN_EXPECT((vector >= MAX_HANDLERS) || !func, 0))
+		return core;
+
+	if (irq_override[vector] >= 0)
+		target = irq_override[vector];
+	else if (irq_core >= 0)
+		target = irq_core;
+
+	route = irq_routes + vector;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	route->func = func;
+	route->arg = arg;
+	route->data = data;
+	route->target = target;
+	route->follow = 0;
+	route->type = type;
+	// the application processors are started later (see irq_affinity_init)
+	if (!apic_core_online(target))
+		target = core;
+	route->core = target;
+	spinlock_irqsave_unlock(&irq_route_lock);
+
+	return target;
+}
+
+void irq_route_unregister(unsigned int vector)
+{
+	if (BUILTIN_EXPECT(vector >= MAX_HANDLERS, 0))
+		return;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	irq_routes[vector].type = IRQ_ROUTE_NONE;
+	irq_routes[vector].func = NULL;
+	irq_routes[vector].follow = 0;
+	spinlock_irqsave_unlock(&irq_route_lock);
+}
+
+/// reprogram the source of the vector, irq_route_lock has to be held
+static int irq_route_move(unsigned int vector, uint32_t core)
+{
+	irq_route_t* route = irq_routes + vector;
+	int ret;
+
+	if (route->core == core)
+		return 0;
+
+	ret = route->func(route->arg, route->data, (uint8_t) vector, core);
+	if (!ret)
+		route->core = core;
+
+	return ret;
+}
+
+int irq_set_affinity(unsigned int vector, uint32_t core)
+{
+	int ret = -EINVAL;
+
+	if (BUILTIN_EXPECT((vector >= MAX_HANDLERS) || !apic_core_online(core) || core_is_offline(core), 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	if (irq_routes[vector].type != IRQ_ROUTE_NONE) {
+		irq_routes[vector].follow = 0;
+		irq_routes[vector].target = core;
+		ret = irq_route_move(vector, core);
+	}
+	spinlock_irqsave_unlock(&irq_route_lock);
+
+	if (!ret)
+		LOG_INFO("irq: vector %u is routed to core %u\n", vector, core);
+
+	return ret;
+}
+
+int irq_get_affinity(unsigned int vector)
+{
+	if (BUILTIN_EXPECT((vector >= MAX_HANDLERS) || (irq_routes[vector].type == IRQ_ROUTE_NONE), 0))
+		return -ENOENT;
+
+	return irq_routes[vector].core;
+}
+
+int irq_follow_task(unsigned int vector, tid_t id)
+{
+	task_t* task;
+	int ret = -EINVAL;
+
+	if (BUILTIN_EXPECT((vector >= MAX_HANDLERS) || get_task(id, &task), 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	if (irq_routes[vector].type != IRQ_ROUTE_NONE) {
+		irq_routes[vector].follow = id;
+		ret = 0;
+	}
+	spinlock_irqsave_unlock(&irq_route_lock);
+
+	return ret;
+}
+
+/// reroute the vector to the last core of the consuming task
+static void irq_route_follow(unsigned int vector)
+{
+	irq_route_t* route = irq_routes + vector;
+	const tid_t id = route->follow;
+	task_t* task;
+	uint32_t core;
+
+	if (BUILTIN_EXPECT(get_task(id, &task) || (task->status == TASK_FINISHED), 0)) {
+		// the consumer is gone => keep the current destination
+		route->follow = 0;
+		return;
+	}
+
+	core = task->last_core;
+	if ((core == route->core) || !apic_core_online(core) || core_is_offline(core))
+		return;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	if ((route->follow == id) && (route->type != IRQ_ROUTE_NONE)) {
+		route->target = core;
+		irq_route_move(vector, core);
+	}
+	spinlock_irqsave_unlock(&irq_route_lock);
+}
+
+uint32_t irq_default_core(uint32_t n)
+{
+	if (irq_core >= 0)
+		return irq_core;
+
+	return housekeeping_core(n);
+}
+
+void irq_migrate_core(uint32_t core)
+{
+	uint32_t i, n = 0;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	for(i=0; i<MAX_HANDLERS; i++) {
+		irq_route_t* route = irq_routes + i;
+		uint32_t target;
+
+		if ((route->type == IRQ_ROUTE_NONE) || (route->core != core))
+			continue;
+
+		// -irqcore= may point to the offline core
+		target = irq_default_core(n++);
+		if (target == core)
+			target = housekeeping_core(n);
+
+		route->follow = 0;
+		route->target = target;
+		if (irq_route_move(i, target))
+			LOG_WARNING("irq: unable to move vector %u away from core %u\n", i, core);
+	}
+	spinlock_irqsave_unlock(&irq_route_lock);
+}
+
+void irq_affinity_init(void)
+{
+	uint32_t i;
+
+	spinlock_irqsave_lock(&irq_route_lock);
+	for(i=0; i<MAX_HANDLERS; i++) {
+		irq_route_t* route = irq_routes + i;
+
+		if ((route->type == IRQ_ROUTE_NONE) || (route->core == route->target))
+			continue;
+
+		if (!apic_core_online(route->target)) {
+			LOG_WARNING("irq: core %u of vector %u isn't online\n", route->target, i);
+			route->target = route->core;
+		} else irq_route_move(i, route->target);
+	}
+	spinlock_irqsave_unlock(&irq_route_lock);
+}
+
+/// parse the boot options -irqcore=<core> and -irqaffinity=<vector>:<core>,...
+static void irq_parse_cmdline(void)
+{
+	const char* cmdline = get_cmdline();
+	char* found;
+
+	if (!cmdline)
+		return;
+
+	found = strstr((char*) cmdline, "-irqcore=");
+	if (found) {
+		irq_core = atoi(found+strlen("-irqcore="));
+		if ((irq_core < 0) || (irq_core >= MAX_CORES))
+			irq_core = -1;
+		else
+			LOG_INFO("irq: route the device interrupts to core %d\n", irq_core);
+	}
+
+	found = strstr((char*) cmdline, "-irqaffinity=");
+	if (found) {
+		found += strlen("-irqaffinity=");
+		while ((*found >= '0') && (*found <= '9')) {
+			uint32_t vector = atoi(found);
+			int32_t core;
+
+			while ((*found >= '0') && (*found <= '9'))
+				found++;
+			if (*found != ':')
+				break;
+			core = atoi(++found);
+			while ((*found >= '0') && (*found <= '9'))
+				found++;
+
+			if ((vector < MAX_HANDLERS) && (core >= 0) && (core < MAX_CORES))
+				irq_override[vector] = core;
+
+			if (*found != ',')
+				break;
+			found++;
+		}
+	}
+}
+
+int sys_irqstat(size_t size, void* stats)
+{
+	irqstat_t* buf = (irqstat_t*) stats;
+	size_t n = size / sizeof(irqstat_t);
+	uint32_t i, j;
+	int ret = 0;
+
+	// without a buffer, print the routing and the counters
+	if (!stats) {
+		print_irq_stats();
+		return 0;
+	}
+
+	for(i=0; (i<MAX_HANDLERS) && ((size_t) ret < n); i++) {
+		const irq_route_t* route = irq_routes + i;
+
+		if (route->type == IRQ_ROUTE_NONE)
+			continue;
+
+		buf[ret].vector = i;
+		buf[ret].type = route->type;
+		buf[ret].core = route->core;
+		buf[ret].follow = route->follow;
+		buf[ret].count = 0;
+		for(j=0; j<MAX_CORES; j++)
+			buf[ret].count += irq_counter[j][i];
+		ret++;
+	}
+
+	return ret;
+}
+
 /** @brief Remapping IRQs with a couple of IO output operations
  *
  * Normally, IRQs 0 to 7 are mapped to entries 8 to 15. This
@@ -228,12 +557,19 @@ static int irq_install(void)
 	idt_set_gate(55, (size_t)irq23, KERNEL_CODE_SELECTOR,
 		IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
 
+	// dynamically assigned interrupts (e.g. MSI/MSI-X)
+	for(int i=IRQ_DYN_FIRST; i<=IRQ_DYN_LAST; i++)
+		idt_set_gate(i, irq_dyn_stubs[i-IRQ_DYN_FIRST], KERNEL_CODE_SELECTOR,
+			IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
+
 	idt_set_gate(112, (size_t)irq80, KERNEL_CODE_SELECTOR,
 		IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
 	idt_set_gate(113, (size_t)irq81, KERNEL_CODE_SELECTOR,
 		IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
 	idt_set_gate(114, (size_t)irq82, KERNEL_CODE_SELECTOR,
 	    IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
+	idt_set_gate(115, (size_t)irq83, KERNEL_CODE_SELECTOR,
+		IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
 
 	idt_set_gate(121, (size_t)wakeup, KERNEL_CODE_SELECTOR,
                 IDT_FLAG_PRESENT|IDT_FLAG_RING0|IDT_FLAG_32BIT|IDT_FLAG_INTTRAP, 1);
@@ -260,6 +596,7 @@ int irq_init(void)
 	idt_install();
 	isrs_install();
 	irq_install();
+	irq_parse_cmdline();
 
 	return 0;
 }
@@ -307,6 +644,9 @@ size_t** irq_handler(struct state *s)
 		LOG_ERROR("Unhandled IRQ %d\n", s->int_no);
 	}
 
+	if (BUILTIN_EXPECT(irq_routes[s->int_no].follow, 0))
+		irq_route_follow(s->int_no);
+
 	// Check if timers have expired that would unblock tasks
 	check_workqueues_in_irqhandler((int) s->int_no);
 
@@ -314,12 +654,16 @@ size_t** irq_handler(struct state *s)
 		apic_eoi(s->int_no);
 	}
 
-	if ((s->int_no == 32) || (s->int_no == 123)) {
+	// deferred work of the interrupt handlers
+	softirq_run();
+
+	if ((s->int_no == 32) || (s->int_no == 121) || (s->int_no == 123)) {
 		// a timer interrupt may have caused unblocking of tasks
-		ret = scheduler();
+		// and a wakeup interrupt signals new work or a migration
+		ret = preempt_scheduler();
 	} else if ((s->int_no >= 32) && (get_highest_priority() > per_core(current_task)->prio)) {
 		// there's a ready task with higher priority
-		ret = scheduler();
+		ret = preempt_scheduler();
 	}
 
 #ifdef MEASURE_IRQ
@@ -355,4 +699,11 @@ void print_irq_stats(void)
 				LOG_INFO("Core %d, IRQ %d: %lld interrupts\n", i, j, irq_counter[i][j]);
 		}
 	}
+
+	for(j=0; j<MAX_HANDLERS; j++)
+	{
+		if (irq_routes[j].type != IRQ_ROUTE_NONE)
+			LOG_INFO("IRQ %d is routed to core %u%s\n", j, irq_routes[j].core,
+				irq_routes[j].follow ? " (follows a task)" : "");
+	}
 }
@@ -29,8 +29,11 @@
 #include <hermit/string.h>
 #include <hermit/errno.h>
 #include <hermit/logging.h>
+#include <hermit/vma.h>
 #include <asm/irqflags.h>
+#include <asm/irq.h>
 #include <asm/io.h>
+#include <asm/page.h>
 
 #include <asm/pci.h>
 #ifdef WITH_PCI_IDS
@@ -48,6 +51,34 @@
 #define PCI_CSID	0x2C	/* Configuration Subsystem Id & Subsystem Vendor Id */
 #define	PCI_CFIT	0x3c	/* Configuration Interrupt */
 #define	PCI_CFDA	0x40	/* Configuration Driver Area */
+#define PCI_CAPP	0x34	/* Capabilities Pointer */
+
+#define PCI_CMD_INTX_DISABLE	(1 << 10)
+#define PCI_STATUS_CAP_LIST	(1 << 20)
+
+/*
+ * Registers of MSI and MSI-X
+ */
+#define PCI_MSI_ENABLE		(1 << 16)
+#define PCI_MSI_MME_MASK	(7 << 20)	/* Multiple Message Enable */
+#define PCI_MSI_64BIT		(1 << 23)
+#define PCI_MSI_ADDR_LO		0x04
+#define PCI_MSI_ADDR_HI		0x08
+#define PCI_MSI_DATA_32		0x08
+#define PCI_MSI_DATA_64		0x0C
+
+#define PCI_MSIX_ENABLE		(1 << 31)
+#define PCI_MSIX_MASKALL	(1 << 30)
+#define PCI_MSIX_SIZE(ctrl)	((((ctrl) >> 16) & 0x7FF) + 1)
+#define PCI_MSIX_TABLE		0x04
+#define PCI_MSIX_BIR_MASK	0x7
+#define PCI_MSIX_ENTRY_SIZE	16
+#define PCI_MSIX_ENTRY_CTRL_MASKBIT	1
+
+/* address of the local APIC, which receives the message */
+#define MSI_ADDR(core)		(0xFEE00000 | (((core) & 0xFF) << 12))
+/* fixed delivery mode, edge triggered */
+#define MSI_DATA(vector)	((uint32_t) (vector))
 
 #define PHYS_IO_MEM_START	0
 #define	PCI_MEM			0
@@ -63,9 +94,35 @@
 
 #define MAX_BUS			16
 #define MAX_SLOTS		32
+/// maximal number of devices in the device table
+#define MAX_DEVICES		64
+
+#define PCI_HEADER_TYPE(cflt)	(((cflt) >> 16) & 0x7F)
+#define PCI_HEADER_BRIDGE	0x01
+#define PCI_BRIDGE_BUSES	0x18	/* primary, secondary and subordinate bus */
 
 static uint32_t mechanism = 0;
-static uint32_t adapters[MAX_BUS][MAX_SLOTS] = {[0 ... MAX_BUS-1][0 ... MAX_SLOTS-1] = -1};
+
+/** @brief Entry of the device table, which pci_init() fills once
+ *
+ * The configuration space is accessed by port I/O, each one a VM exit
+ * under emulation => the drivers look up their devices in this table.
+ */
+typedef struct {
+	/// vendor and device id
+	uint32_t id;
+	/// subsystem and subsystem vendor id
+	uint32_t subid;
+	/// class code, subclass and programming interface
+	uint32_t class_code;
+	/// BARs and capabilities of the device
+	pci_info_t info;
+} pci_dev_t;
+
+static pci_dev_t devices[MAX_DEVICES];
+static uint32_t nr_devices = 0;
+/// the buses are scanned => the device table is complete
+static uint8_t scanned = 0;
 
 static void pci_conf_write(uint32_t bus, uint32_t slot, uint32_t off, uint32_t val)
 {
@@ -134,7 +191,10 @@ static inline uint32_t pci_what_size(uint32_t bus, uint32_t slot, uint32_t nr)
 
 	// determine size
 	pci_conf_write(bus, slot, PCI_CBIO + nr*4, 0xFFFFFFFF);
-	ret = ~pci_conf_read(bus, slot, PCI_CBIO + nr*4) + 1;
+	ret = pci_conf_read(bus, slot, PCI_CBIO + nr*4);
+	// the lowest bits describe the type of the BAR
+	ret &= (tmp & 0x1) ? 0xFFFFFFFC : 0xFFFFFFF0;
+	ret = ~ret + 1;
 
 	// restore original value
 	pci_conf_write(bus, slot, PCI_CBIO + nr*4, tmp);
@@ -142,43 +202,327 @@ static inline uint32_t pci_what_size(uint32_t bus, uint32_t slot, uint32_t nr)
 	return ret;
 }
 
+static inline void pci_intx(uint32_t bus, uint32_t slot, int enable)
+{
+	uint32_t cmd = pci_conf_read(bus, slot, PCI_CFCS);
+
+	if (enable)
+		cmd &= ~PCI_CMD_INTX_DISABLE;
+	else
+		cmd |= PCI_CMD_INTX_DISABLE;
+	// don't clear the write-1-to-clear bits of the status register
+	pci_conf_write(bus, slot, PCI_CFCS, cmd & 0xFFFF);
+}
+
+/*
+ * walk through the capability list and return the offset of the
+ * capability, which follows the capability at prev (0 = start of the list)
+ */
+static uint8_t pci_find_cap(uint32_t bus, uint32_t slot, uint8_t id, uint8_t prev)
+{
+	uint8_t off;
+	uint32_t i = 0;
+
+	if (!(pci_conf_read(bus, slot, PCI_CFCS) & PCI_STATUS_CAP_LIST))
+		return 0;
+
+	if (prev)
+		off = (pci_conf_read(bus, slot, prev) >> 8) & 0xFC;
+	else
+		off = pci_conf_read(bus, slot, PCI_CAPP) & 0xFC;
+	// the limit protects us against broken (circular) lists
+	while (off && (i++ < 48)) {
+		uint32_t cap = pci_conf_read(bus, slot, off);
+
+		if ((cap & 0xFF) == id)
+			return off;
+		off = (cap >> 8) & 0xFC;
+	}
+
+	return 0;
+}
+
+uint8_t pci_find_capability(const pci_info_t* info, uint8_t id, uint8_t prev)
+{
+	if (BUILTIN_EXPECT(!info, 0))
+		return 0;
+
+	return pci_find_cap(info->bus, info->slot, id, prev);
+}
+
+uint32_t pci_read_config(const pci_info_t* info, uint32_t off)
+{
+	if (BUILTIN_EXPECT(!info, 0))
+		return -1;
+
+	return pci_conf_read(info->bus, info->slot, off & 0xFC);
+}
+
+void* pci_map_bar(const pci_info_t* info, uint8_t bar, uint32_t off, uint32_t len)
+{
+	size_t phys, viraddr, size, start;
+
+	if (BUILTIN_EXPECT(!info || (bar > 5) || !info->base[bar] || (info->base[bar] & 0x1), 0))
+		return NULL;
+
+	phys = info->base[bar] & ~0xFULL;
+	// upper half of a 64 bit BAR
+	if (((info->base[bar] & 0x6) == 0x4) && (bar < 5))
+		phys |= ((size_t) info->base[bar+1]) << 32;
+	phys += off;
+
+	start = phys & (PAGE_SIZE-1);
+	size = PAGE_CEIL(start + len);
+
+	viraddr = vma_alloc(size, VMA_READ|VMA_WRITE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return NULL;
+
+	if (BUILTIN_EXPECT(page_map(viraddr, PAGE_FLOOR(phys), size >> PAGE_BITS, PG_GLOBAL|PG_RW|PG_PCD), 0)) {
+		vma_free(viraddr, viraddr + size);
+		return NULL;
+	}
+
+	return (void*) (viraddr + start);
+}
+
+/// source of a MSI route: bus, slot and capability of the device
+#define MSI_ROUTE(info)		(((info)->bus << 16) | ((info)->slot << 8) | (info)->msi_cap)
+
+static int pci_msi_retarget(void* arg, uint32_t data, uint8_t vector, uint32_t core)
+{
+	const uint32_t bus = data >> 16, slot = (data >> 8) & 0xFF, cap = data & 0xFF;
+	uint32_t ctrl = pci_conf_read(bus, slot, cap);
+
+	// the device must not send a message with a partial address
+	pci_conf_write(bus, slot, cap, ctrl & ~PCI_MSI_ENABLE);
+	pci_conf_write(bus, slot, cap + PCI_MSI_ADDR_LO, MSI_ADDR(core));
+	pci_conf_write(bus, slot, cap, ctrl);
+
+	return 0;
+}
+
+static int pci_msix_retarget(void* arg, uint32_t data, uint8_t vector, uint32_t core)
+{
+	volatile uint32_t* e = (volatile uint32_t*) arg + data*PCI_MSIX_ENTRY_SIZE/4;
+
+	e[3] |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+	e[0] = MSI_ADDR(core);
+	e[3] &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
+
+	return 0;
+}
+
+int pci_msi_enable(pci_info_t* info, uint8_t vector, uint32_t core)
+{
+	uint32_t ctrl, data_off, tmp;
+
+	if (BUILTIN_EXPECT(!info || !info->msi_cap, 0))
+		return -ENODEV;
+
+	core = irq_route_register(vector, IRQ_ROUTE_MSI, pci_msi_retarget, NULL, MSI_ROUTE(info), core);
+
+	ctrl = pci_conf_read(info->bus, info->slot, info->msi_cap);
+	pci_conf_write(info->bus, info->slot, info->msi_cap, ctrl & ~PCI_MSI_ENABLE);
+
+	pci_conf_write(info->bus, info->slot, info->msi_cap + PCI_MSI_ADDR_LO, MSI_ADDR(core));
+	if (ctrl & PCI_MSI_64BIT) {
+		pci_conf_write(info->bus, info->slot, info->msi_cap + PCI_MSI_ADDR_HI, 0);
+		data_off = PCI_MSI_DATA_64;
+	} else data_off = PCI_MSI_DATA_32;
+
+	// the data register has only 16 bits
+	tmp = pci_conf_read(info->bus, info->slot, info->msi_cap + data_off);
+	tmp = (tmp & 0xFFFF0000) | MSI_DATA(vector);
+	pci_conf_write(info->bus, info->slot, info->msi_cap + data_off, tmp);
+
+	// we use only a single message
+	ctrl = (ctrl & ~PCI_MSI_MME_MASK) | PCI_MSI_ENABLE;
+	pci_conf_write(info->bus, info->slot, info->msi_cap, ctrl);
+	pci_intx(info->bus, info->slot, 0);
+
+	LOG_INFO("PCI device %u:%u uses MSI vector %u (core %u)\n",
+		info->bus, info->slot, (uint32_t) vector, core);
+
+	return 0;
+}
+
+int pci_msix_enable(pci_info_t* info)
+{
+	uint32_t ctrl, table;
+
+	if (BUILTIN_EXPECT(!info || !info->msix_cap, 0))
+		return -ENODEV;
+
+	ctrl = pci_conf_read(info->bus, info->slot, info->msix_cap);
+	table = pci_conf_read(info->bus, info->slot, info->msix_cap + PCI_MSIX_TABLE);
+	info->msix_size = PCI_MSIX_SIZE(ctrl);
+
+	if (!info->msix_table) {
+		info->msix_table = pci_map_bar(info, table & PCI_MSIX_BIR_MASK,
+			table & ~PCI_MSIX_BIR_MASK, info->msix_size * PCI_MSIX_ENTRY_SIZE);
+		if (BUILTIN_EXPECT(!info->msix_table, 0))
+			return -ENOMEM;
+	}
+
+	// enable MSI-X, but mask all vectors until the table is initialized
+	pci_conf_write(info->bus, info->slot, info->msix_cap, ctrl | PCI_MSIX_ENABLE | PCI_MSIX_MASKALL);
+	for(uint32_t i=0; i<info->msix_size; i++)
+		info->msix_table[i*PCI_MSIX_ENTRY_SIZE/4 + 3] |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+	pci_intx(info->bus, info->slot, 0);
+	pci_conf_write(info->bus, info->slot, info->msix_cap, (ctrl | PCI_MSIX_ENABLE) & ~PCI_MSIX_MASKALL);
+
+	LOG_INFO("PCI device %u:%u supports %u MSI-X vectors\n",
+		info->bus, info->slot, (uint32_t) info->msix_size);
+
+	return 0;
+}
+
+int pci_msix_set_vector(pci_info_t* info, uint16_t entry, uint8_t vector, uint32_t core)
+{
+	volatile uint32_t* e;
+
+	if (BUILTIN_EXPECT(!info || !info->msix_table || (entry >= info->msix_size), 0))
+		return -EINVAL;
+
+	core = irq_route_register(vector, IRQ_ROUTE_MSIX, pci_msix_retarget, (void*) info->msix_table, entry, core);
+
+	e = info->msix_table + entry*PCI_MSIX_ENTRY_SIZE/4;
+	e[3] |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+	e[0] = MSI_ADDR(core);
+	e[1] = 0;
+	e[2] = MSI_DATA(vector);
+	e[3] &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
+
+	return 0;
+}
+
+int pci_msi_disable(pci_info_t* info)
+{
+	uint32_t ctrl;
+
+	if (!info)
+		return 0;
+
+	if (info->msi_cap) {
+		ctrl = pci_conf_read(info->bus, info->slot, info->msi_cap);
+		pci_conf_write(info->bus, info->slot, info->msi_cap, ctrl & ~PCI_MSI_ENABLE);
+	}
+
+	if (info->msix_cap) {
+		ctrl = pci_conf_read(info->bus, info->slot, info->msix_cap);
+		pci_conf_write(info->bus, info->slot, info->msix_cap, ctrl & ~(PCI_MSIX_ENABLE|PCI_MSIX_MASKALL));
+	}
+
+	pci_intx(info->bus, info->slot, 1);
+
+	return 0;
+}
+
+/*
+ * Adds the devices of a bus to the device table and continues with the
+ * secondary buses of its bridges. visited protects us against broken
+ * bus numbers.
+ */
+static void pci_scan_bus(uint32_t bus, uint32_t* visited)
+{
+	uint32_t slot, i, id;
+
+	if ((bus >= MAX_BUS) || (*visited & (1U << bus)))
+		return;
+	*visited |= (1U << bus);
+
+	for (slot = 0; slot < MAX_SLOTS; slot++) {
+		pci_info_t* info;
+
+		id = pci_conf_read(bus, slot, PCI_CFID);
+		if ((id == 0xffffffff) || ((id & 0xffff) == 0xffff))
+			continue;
+
+		if (PCI_HEADER_TYPE(pci_conf_read(bus, slot, PCI_CFLT)) == PCI_HEADER_BRIDGE) {
+			pci_scan_bus((pci_conf_read(bus, slot, PCI_BRIDGE_BUSES) >> 8) & 0xFF, visited);
+			continue;
+		}
+
+		if (BUILTIN_EXPECT(nr_devices >= MAX_DEVICES, 0)) {
+			LOG_WARNING("PCI device table is full, ignore device %u:%u\n", bus, slot);
+			continue;
+		}
+
+		devices[nr_devices].id = id;
+		devices[nr_devices].subid = pci_subid(bus, slot);
+		devices[nr_devices].class_code = pci_conf_read(bus, slot, PCI_CFRV) >> 8;
+		info = &devices[nr_devices].info;
+		for(i=0; i<6; i++) {
+			info->base[i] = pci_what_iobase(bus, slot, i);
+			info->size[i] = (info->base[i]) ? pci_what_size(bus, slot, i) : 0;
+		}
+		info->irq = pci_what_irq(bus, slot);
+		info->bus = bus;
+		info->slot = slot;
+		info->msi_cap = pci_find_cap(bus, slot, PCI_CAP_ID_MSI, 0);
+		info->msix_cap = pci_find_cap(bus, slot, PCI_CAP_ID_MSIX, 0);
+		info->msix_size = info->msix_cap ? PCI_MSIX_SIZE(pci_conf_read(bus, slot, info->msix_cap)) : 0;
+		info->msix_table = NULL;
+		nr_devices++;
+	}
+}
+
 int pci_init(void)
 {
-	uint32_t slot, bus;
+	uint32_t visited = 0;
+
+	if (scanned)
+		return 0;
 
-	for (bus = 0; bus < MAX_BUS; bus++)
-		for (slot = 0; slot < MAX_SLOTS; slot++)
-			adapters[bus][slot] = pci_conf_read(bus, slot, PCI_CFID);
+	// uhyve doesn't emulate a PCI bus
+	if (!is_uhyve())
+		pci_scan_bus(0, &visited);
+	scanned = 1;
+
+	LOG_INFO("Found %u PCI devices\n", nr_devices);
 
 	return 0;
 }
 
 int pci_get_device_info(uint32_t vendor_id, uint32_t device_id, uint32_t subsystem_id, pci_info_t* info, int8_t bus_master)
 {
-	uint32_t slot, bus, i;
+	uint32_t i;
 
 	if (!info)
 		return -EINVAL;
 
-	if (!mechanism && !is_uhyve())
-		pci_init();
-
-	for (bus = 0; bus < MAX_BUS; bus++) {
-		for (slot = 0; slot < MAX_SLOTS; slot++) {
-			if (adapters[bus][slot] != -1) {
-				if (((adapters[bus][slot] & 0xffff) == vendor_id) &&
-				   (((adapters[bus][slot] & 0xffff0000) >> 16) == device_id) &&
-				   (((pci_subid(bus, slot) >> 16) & subsystem_id) == subsystem_id)) {
-					for(i=0; i<6; i++) {
-						info->base[i] = pci_what_iobase(bus, slot, i);
-						info->size[i] = (info->base[i]) ? pci_what_size(bus, slot, i) : 0;
-					}
-					info->irq = pci_what_irq(bus, slot);
-					if (bus_master)
-						pci_bus_master(bus, slot);
-					return 0;
-				}
-			}
+	pci_init();
+
+	for (i = 0; i < nr_devices; i++) {
+		if (((devices[i].id & 0xffff) == vendor_id) &&
+		   (((devices[i].id & 0xffff0000) >> 16) == device_id) &&
+		   (((devices[i].subid >> 16) & subsystem_id) == subsystem_id)) {
+			memcpy(info, &devices[i].info, sizeof(pci_info_t));
+			if (bus_master)
+				pci_bus_master(info->bus, info->slot);
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+int pci_get_class_info(uint32_t class_code, pci_info_t* info, int8_t bus_master)
+{
+	uint32_t i;
+
+	if (!info)
+		return -EINVAL;
+
+	pci_init();
+
+	for (i = 0; i < nr_devices; i++) {
+		if (devices[i].class_code == (class_code & 0xFFFFFF)) {
+			memcpy(info, &devices[i].info, sizeof(pci_info_t));
+			if (bus_master)
+				pci_bus_master(info->bus, info->slot);
+			return 0;
 		}
 	}
 
@@ -187,47 +531,37 @@ int pci_get_device_info(uint32_t vendor_id, uint32_t device_id, uint32_t subsyst
 
 int print_pci_adapters(void)
 {
-	uint32_t slot, bus;
-	uint32_t counter = 0;
+	uint32_t n;
 #ifdef WITH_PCI_IDS
 	uint32_t i;
 #endif
 
-	if (!mechanism)
-		pci_init();
+	pci_init();
 
-	for (bus = 0; bus < MAX_BUS; bus++) {
-                for (slot = 0; slot < MAX_SLOTS; slot++) {
+	for (n = 0; n < nr_devices; n++) {
+		const uint32_t id = devices[n].id;
 
-		if (adapters[bus][slot] != -1) {
-				counter++;
-				LOG_INFO("%d) Vendor ID: 0x%x  Device Id: 0x%x\n",
-					counter, adapters[bus][slot] & 0xffff,
-					(adapters[bus][slot] & 0xffff0000) >> 16);
+		LOG_INFO("%d) Vendor ID: 0x%x  Device Id: 0x%x\n",
+			n+1, id & 0xffff, (id & 0xffff0000) >> 16);
 
 #ifdef WITH_PCI_IDS
-				for (i=0; i<PCI_VENTABLE_LEN; i++) {
-					if ((adapters[bus][slot] & 0xffff) ==
-					    (uint32_t)PciVenTable[i].VenId)
-						LOG_INFO("\tVendor is %s\n",
-							PciVenTable[i].VenShort);
-				}
+		for (i=0; i<PCI_VENTABLE_LEN; i++) {
+			if ((id & 0xffff) == (uint32_t)PciVenTable[i].VenId)
+				LOG_INFO("\tVendor is %s\n",
+					PciVenTable[i].VenShort);
+		}
 
-				for (i=0; i<PCI_DEVTABLE_LEN; i++) {
-					if ((adapters[bus][slot] & 0xffff) ==
-					    (uint32_t)PciDevTable[i].VenId) {
-						if (((adapters[bus][slot] & 0xffff0000) >> 16) ==
-						    PciDevTable[i].DevId) {
-							LOG_INFO
-							    ("\tChip: %s ChipDesc: %s\n",
-							     PciDevTable[i].Chip,
-							     PciDevTable[i].ChipDesc);
-						}
-					}
+		for (i=0; i<PCI_DEVTABLE_LEN; i++) {
+			if ((id & 0xffff) == (uint32_t)PciDevTable[i].VenId) {
+				if (((id & 0xffff0000) >> 16) == PciDevTable[i].DevId) {
+					LOG_INFO
+					    ("\tChip: %s ChipDesc: %s\n",
+					     PciDevTable[i].Chip,
+					     PciDevTable[i].ChipDesc);
 				}
-#endif
 			}
 		}
+#endif
 	}
 
 	return 0;
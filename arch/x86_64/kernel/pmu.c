@@ -0,0 +1,676 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file arch/x86_64/kernel/pmu.c
+ * @brief Architectural performance monitoring of Intel processors
+ *
+ * The counters are described by CPUID leaf 0xA, version 2 (Core 2) or later
+ * is required. The fixed counters are used for instructions, core and
+ * reference cycles, if they are available, all other events occupy
+ * general-purpose counters. A task owns all counters while it runs;
+ * IA32_PERF_GLOBAL_CTRL disables them, while a task without events runs.
+ *
+ * The profiler reserves the last general-purpose counter on all cores
+ * (pmu_reserved). It raises an interrupt after each period and the handler
+ * records the interrupted code into the ring of the core.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/pmu.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/processor.h>
+#include <asm/irqflags.h>
+#include <asm/irq.h>
+#include <asm/apic.h>
+
+/// maximum number of general-purpose counters, which are used
+#define PMU_MAX_GP		8
+/// maximum number of fixed counters, which are used
+#define PMU_MAX_FIXED		3
+/// maximum number of events per task
+#define PMU_MAX_EVENTS		(PMU_MAX_GP + PMU_MAX_FIXED)
+
+/// counter of an event, values from PMU_FIXED on are fixed counters
+#define PMU_FIXED		PMU_MAX_GP
+#define PMU_UNUSED		0xFF
+
+#define EVTSEL_USR		(1ULL << 16)
+#define EVTSEL_OS		(1ULL << 17)
+#define EVTSEL_INT		(1ULL << 20)
+#define EVTSEL_EN		(1ULL << 22)
+/// bits of IA32_PERFEVTSELx, which a raw event may set (edge, inv and cmask)
+#define EVTSEL_RAW_MASK		0xFF84FFFFULL
+
+/// enables a fixed counter in ring 0 and 3
+#define FIXED_CTRL_EN(i)	(0x3ULL << (4 * (i)))
+
+typedef struct pmu_event {
+	/// counter of the event or PMU_UNUSED
+	uint8_t counter;
+	/// value of IA32_PERFEVTSELx
+	uint64_t evtsel;
+	/// count of the previous time slices
+	uint64_t count;
+} pmu_event_t;
+
+/// per-task state, is allocated by the first pmu_open()
+typedef struct pmu_task {
+	/// value of IA32_PERF_GLOBAL_CTRL
+	uint64_t global_ctrl;
+	/// value of IA32_FIXED_CTR_CTRL
+	uint64_t fixed_ctrl;
+	pmu_event_t events[PMU_MAX_EVENTS];
+} pmu_task_t;
+
+/// description of a generic event
+typedef struct pmu_hw_event {
+	/// event select and umask
+	uint16_t code;
+	/// fixed counter, which counts the event, or PMU_UNUSED
+	uint8_t fixed;
+	/// bit of CPUID.0AH:EBX, which signals that the event is unavailable, or PMU_UNUSED
+	uint8_t arch_bit;
+} pmu_hw_event_t;
+
+static const pmu_hw_event_t pmu_hw_events[PMU_HW_MAX] = {
+	[PMU_HW_CPU_CYCLES] = {0x003C, 1, 0},
+	[PMU_HW_INSTRUCTIONS] = {0x00C0, 0, 1},
+	[PMU_HW_REF_CPU_CYCLES] = {0x013C, 2, 2},
+	[PMU_HW_CACHE_REFERENCES] = {0x4F2E, PMU_UNUSED, 3},
+	[PMU_HW_CACHE_MISSES] = {0x412E, PMU_UNUSED, 4},
+	[PMU_HW_BRANCH_INSTRUCTIONS] = {0x00C4, PMU_UNUSED, 5},
+	[PMU_HW_BRANCH_MISSES] = {0x00C5, PMU_UNUSED, 6},
+	// model-specific, DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK and
+	// ITLB_MISSES.MISS_CAUSES_A_WALK of Nehalem up to Skylake
+	[PMU_HW_DTLB_MISSES] = {0x0108, PMU_UNUSED, PMU_UNUSED},
+	[PMU_HW_ITLB_MISSES] = {0x0185, PMU_UNUSED, PMU_UNUSED},
+};
+
+/// version of the architectural performance monitoring, 0 without PMU
+static uint32_t pmu_version = 0;
+static uint32_t pmu_nr_gp = 0;
+static uint32_t pmu_nr_fixed = 0;
+static uint64_t pmu_gp_mask = 0;
+static uint64_t pmu_fixed_mask = 0;
+/// CPUID.0AH:EBX, a set bit marks an unavailable architectural event
+static uint32_t pmu_unavailable = ~0U;
+/// the model-specific events are known
+static uint8_t pmu_model_events = 0;
+
+/// bit of the profiler's counter in IA32_PERF_GLOBAL_CTRL, 0 while it is stopped
+static volatile uint64_t pmu_reserved = 0;
+
+/// samples of a core, are only written by the PMI handler of the core
+typedef struct pmu_profile_ring {
+	/// number of recorded samples
+	uint64_t head;
+	/// PMU_PROFILE_SIZE samples
+	pmu_sample_t* samples;
+} __attribute__ ((aligned (CACHE_LINE))) pmu_profile_ring_t;
+
+static pmu_profile_ring_t pmu_profile_rings[MAX_CORES];
+/// value of IA32_PERFEVTSELx of the profiler
+static uint64_t pmu_profile_evtsel = 0;
+/// number of events between two samples
+static uint64_t pmu_profile_period = 0;
+/// interrupt vector of the PMI
+static int pmu_profile_vector = -1;
+/// serializes pmu_profile_start() and pmu_profile_stop()
+static spinlock_t pmu_profile_lock = SPINLOCK_INIT;
+
+extern int32_t possible_cpus;
+
+void pmu_init(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0;
+	uint32_t i;
+
+	if (!pmu_version) {
+		cpuid(0, &a, &b, &c, &d);
+		// GenuineIntel
+		if ((b != 0x756e6547) || (d != 0x49656e69) || (c != 0x6c65746e) || (a < 0xA))
+			return;
+
+		a = b = c = d = 0;
+		cpuid(1, &a, &b, &c, &d);
+		pmu_model_events = (((a >> 8) & 0xF) == 6) && ((((a >> 4) & 0xF) | ((a >> 12) & 0xF0)) >= 0x1A);
+
+		a = b = c = d = 0;
+		cpuid(0xA, &a, &b, &c, &d);
+		if ((a & 0xFF) < 2)
+			return;
+
+		pmu_nr_gp = (a >> 8) & 0xFF;
+		if (pmu_nr_gp > PMU_MAX_GP)
+			pmu_nr_gp = PMU_MAX_GP;
+		pmu_gp_mask = (1ULL << ((a >> 16) & 0xFF)) - 1;
+		pmu_nr_fixed = d & 0x1F;
+		if (pmu_nr_fixed > PMU_MAX_FIXED)
+			pmu_nr_fixed = PMU_MAX_FIXED;
+		pmu_fixed_mask = (1ULL << ((d >> 5) & 0xFF)) - 1;
+		// bits beyond the length of EBX are unavailable as well
+		pmu_unavailable = b | ~((1U << ((a >> 24) & 0x1F)) - 1);
+		pmu_version = a & 0xFF;
+
+		LOG_INFO("PMU: version %u, %u general-purpose and %u fixed counters\n",
+			pmu_version, pmu_nr_gp, pmu_nr_fixed);
+	}
+
+	// the counters are disabled, until a task with events runs
+	wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, 0);
+	wrmsr(MSR_IA32_FIXED_CTR_CTRL, 0);
+	for (i = 0; i < pmu_nr_gp; i++)
+		wrmsr(MSR_IA32_PERFEVTSEL0 + i, 0);
+}
+
+static inline uint64_t pmu_read_counter(uint8_t counter)
+{
+	if (counter >= PMU_FIXED)
+		return rdmsr(MSR_IA32_FIXED_CTR0 + counter - PMU_FIXED) & pmu_fixed_mask;
+
+	return rdmsr(MSR_IA32_PERFCTR0 + counter) & pmu_gp_mask;
+}
+
+static inline void pmu_write_counter(uint8_t counter, uint64_t value)
+{
+	if (counter >= PMU_FIXED)
+		wrmsr(MSR_IA32_FIXED_CTR0 + counter - PMU_FIXED, value);
+	else
+		wrmsr(MSR_IA32_PERFCTR0 + counter, value);
+}
+
+static inline uint64_t pmu_counter_bit(uint8_t counter)
+{
+	if (counter >= PMU_FIXED)
+		return 1ULL << (32 + counter - PMU_FIXED);
+
+	return 1ULL << counter;
+}
+
+/// the counter of an event belongs to the task and not to the profiler
+static inline int pmu_owned(uint8_t counter)
+{
+	return !(pmu_counter_bit(counter) & pmu_reserved);
+}
+
+/// program the counters of pmu on the current core and start them
+static void pmu_load(pmu_task_t* pmu)
+{
+	uint32_t i;
+
+	for (i = 0; i < PMU_MAX_EVENTS; i++) {
+		pmu_event_t* ev = pmu->events + i;
+
+		if ((ev->counter == PMU_UNUSED) || !pmu_owned(ev->counter))
+			continue;
+
+		pmu_write_counter(ev->counter, 0);
+		if (ev->counter < PMU_FIXED)
+			wrmsr(MSR_IA32_PERFEVTSEL0 + ev->counter, ev->evtsel);
+	}
+
+	wrmsr(MSR_IA32_FIXED_CTR_CTRL, pmu->fixed_ctrl);
+	wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, (pmu->global_ctrl & ~pmu_reserved) | pmu_reserved);
+}
+
+/// stop the counters of the current core and add them to the counts of pmu
+static void pmu_save(pmu_task_t* pmu)
+{
+	uint32_t i;
+
+	// the profiler keeps running
+	wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, pmu_reserved);
+
+	for (i = 0; i < PMU_MAX_EVENTS; i++) {
+		pmu_event_t* ev = pmu->events + i;
+
+		if ((ev->counter != PMU_UNUSED) && pmu_owned(ev->counter))
+			ev->count += pmu_read_counter(ev->counter);
+	}
+}
+
+void pmu_switch(task_t* prev, task_t* next)
+{
+	if (prev->pmu)
+		pmu_save(prev->pmu);
+	if (next->pmu)
+		pmu_load(next->pmu);
+}
+
+/// search a free counter of the task, which is able to count the event
+static int pmu_alloc_counter(pmu_task_t* pmu, uint8_t fixed)
+{
+	uint64_t used = pmu_reserved;
+	uint32_t i;
+
+	for (i = 0; i < PMU_MAX_EVENTS; i++) {
+		if (pmu->events[i].counter != PMU_UNUSED)
+			used |= pmu_counter_bit(pmu->events[i].counter);
+	}
+
+	if ((fixed < pmu_nr_fixed) && !(used & pmu_counter_bit(PMU_FIXED + fixed)))
+		return PMU_FIXED + fixed;
+
+	for (i = 0; i < pmu_nr_gp; i++) {
+		if (!(used & pmu_counter_bit(i)))
+			return i;
+	}
+
+	return -EBUSY;
+}
+
+static pmu_event_t* pmu_get_event(int handle)
+{
+	task_t* curr_task = per_core(current_task);
+	pmu_event_t* ev;
+
+	if (BUILTIN_EXPECT(!curr_task->pmu || (handle < 0) || (handle >= PMU_MAX_EVENTS), 0))
+		return NULL;
+
+	ev = curr_task->pmu->events + handle;
+	if (ev->counter == PMU_UNUSED)
+		return NULL;
+
+	return ev;
+}
+
+/// determine IA32_PERFEVTSELx and the fixed counter of an event
+static int pmu_event_config(uint32_t type, uint64_t config, uint64_t* evtsel, uint8_t* fixed)
+{
+	if (BUILTIN_EXPECT(!pmu_version, 0))
+		return -ENODEV;
+
+	*fixed = PMU_UNUSED;
+
+	if (type == PMU_TYPE_HARDWARE) {
+		const pmu_hw_event_t* hw;
+
+		if (BUILTIN_EXPECT(config >= PMU_HW_MAX, 0))
+			return -ENOENT;
+
+		hw = pmu_hw_events + config;
+		if (hw->arch_bit != PMU_UNUSED) {
+			if (pmu_unavailable & (1U << hw->arch_bit))
+				return -ENOENT;
+		} else if (!pmu_model_events) {
+			return -ENOENT;
+		}
+
+		*evtsel = hw->code;
+		*fixed = hw->fixed;
+	} else if (type == PMU_TYPE_RAW) {
+		if (BUILTIN_EXPECT(config & ~EVTSEL_RAW_MASK, 0))
+			return -EINVAL;
+
+		*evtsel = config;
+	} else {
+		return -EINVAL;
+	}
+
+	*evtsel |= EVTSEL_USR | EVTSEL_OS | EVTSEL_EN;
+
+	return 0;
+}
+
+int pmu_open(uint32_t type, uint64_t config)
+{
+	task_t* curr_task = per_core(current_task);
+	pmu_task_t* pmu;
+	pmu_event_t* ev = NULL;
+	uint64_t evtsel;
+	uint8_t fixed;
+	uint8_t flags;
+	int counter, handle, ret;
+
+	ret = pmu_event_config(type, config, &evtsel, &fixed);
+	if (ret)
+		return ret;
+
+	if (!curr_task->pmu) {
+		uint32_t i;
+
+		pmu = kmalloc(sizeof(pmu_task_t));
+		if (BUILTIN_EXPECT(!pmu, 0))
+			return -ENOMEM;
+
+		memset(pmu, 0x00, sizeof(pmu_task_t));
+		for (i = 0; i < PMU_MAX_EVENTS; i++)
+			pmu->events[i].counter = PMU_UNUSED;
+
+		flags = irq_nested_disable();
+		curr_task->pmu = pmu;
+		irq_nested_enable(flags);
+	}
+
+	pmu = curr_task->pmu;
+
+	for (handle = 0; handle < PMU_MAX_EVENTS; handle++) {
+		if (pmu->events[handle].counter == PMU_UNUSED) {
+			ev = pmu->events + handle;
+			break;
+		}
+	}
+
+	counter = pmu_alloc_counter(pmu, fixed);
+	if (!ev || (counter < 0))
+		return -EBUSY;
+
+	// the task owns the counters of this core, until the scheduler saves them
+	flags = irq_nested_disable();
+	pmu_save(pmu);
+	ev->counter = counter;
+	ev->evtsel = evtsel;
+	ev->count = 0;
+	if (counter >= PMU_FIXED)
+		pmu->fixed_ctrl |= FIXED_CTRL_EN(counter - PMU_FIXED);
+	pmu->global_ctrl |= pmu_counter_bit(counter);
+	pmu_load(pmu);
+	irq_nested_enable(flags);
+
+	return handle;
+}
+
+int pmu_read(int handle, uint64_t* value)
+{
+	pmu_event_t* ev;
+	uint8_t flags;
+	int ret = -EINVAL;
+
+	if (BUILTIN_EXPECT(!value, 0))
+		return -EINVAL;
+
+	flags = irq_nested_disable();
+	ev = pmu_get_event(handle);
+	if (ev) {
+		*value = ev->count;
+		if (pmu_owned(ev->counter))
+			*value += pmu_read_counter(ev->counter);
+		ret = 0;
+	}
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
+int pmu_reset(int handle)
+{
+	pmu_event_t* ev;
+	uint8_t flags;
+	int ret = -EINVAL;
+
+	flags = irq_nested_disable();
+	ev = pmu_get_event(handle);
+	if (ev) {
+		ev->count = 0;
+		if (pmu_owned(ev->counter))
+			pmu_write_counter(ev->counter, 0);
+		ret = 0;
+	}
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
+int pmu_close(int handle)
+{
+	task_t* curr_task = per_core(current_task);
+	pmu_event_t* ev;
+	uint8_t flags;
+	int ret = -EINVAL;
+
+	flags = irq_nested_disable();
+	ev = pmu_get_event(handle);
+	if (ev) {
+		pmu_task_t* pmu = curr_task->pmu;
+
+		pmu_save(pmu);
+		if (ev->counter >= PMU_FIXED)
+			pmu->fixed_ctrl &= ~FIXED_CTRL_EN(ev->counter - PMU_FIXED);
+		else if (pmu_owned(ev->counter))
+			wrmsr(MSR_IA32_PERFEVTSEL0 + ev->counter, 0);
+		pmu->global_ctrl &= ~pmu_counter_bit(ev->counter);
+		ev->counter = PMU_UNUSED;
+		pmu_load(pmu);
+		ret = 0;
+	}
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
+/// return the end of the stack, which contains sp, or 0 if it is unknown
+static size_t pmu_stack_top(task_t* task, size_t sp)
+{
+	size_t base = (size_t) task->stack;
+
+	if (base && (sp >= base) && (sp < base + DEFAULT_STACK_SIZE))
+		return base + DEFAULT_STACK_SIZE;
+
+	base = (size_t) task->ist_addr;
+	if (base && (sp >= base) && (sp < base + KERNEL_STACK_SIZE))
+		return base + KERNEL_STACK_SIZE;
+
+	return 0;
+}
+
+static void pmu_profile_sample(struct state* s)
+{
+	const uint32_t core_id = CORE_ID;
+	pmu_profile_ring_t* ring = pmu_profile_rings + core_id;
+	task_t* curr_task = per_core(current_task);
+	pmu_sample_t* sample;
+	size_t lo, hi, frame;
+	uint32_t depth = 0;
+
+	if (BUILTIN_EXPECT(!ring->samples, 0))
+		return;
+
+	sample = ring->samples + (ring->head % PMU_PROFILE_SIZE);
+	sample->rip = s->rip;
+	sample->tsc = get_rdtsc();
+	sample->task = curr_task->id;
+	sample->core = core_id;
+
+	// follow the frame pointers, as long as they stay on the interrupted stack
+	lo = s->userrsp;
+	hi = pmu_stack_top(curr_task, lo);
+	frame = s->rbp;
+	while ((depth < PMU_CALLCHAIN) && (frame >= lo) && (frame + 2 * sizeof(size_t) <= hi)
+	       && !(frame & (sizeof(size_t) - 1))) {
+		const size_t* fp = (const size_t*) frame;
+
+		sample->callchain[depth++] = fp[1];
+		lo = frame + 2 * sizeof(size_t);
+		frame = fp[0];
+	}
+	sample->depth = depth;
+
+	ring->head++;
+}
+
+static void pmu_pmi_handler(struct state* s)
+{
+	const uint64_t status = rdmsr(MSR_IA32_PERF_GLOBAL_STATUS);
+	const uint64_t reserved = pmu_reserved;
+
+	if (status & reserved) {
+		pmu_profile_sample(s);
+		// the write is sign-extended from bit 31
+		wrmsr(MSR_IA32_PERFCTR0 + pmu_nr_gp - 1, -pmu_profile_period);
+	}
+
+	wrmsr(MSR_IA32_PERF_GLOBAL_OVF_CTRL, status);
+	apic_lvt_pmc(pmu_profile_vector, reserved != 0);
+}
+
+/// program the profiler's counter of the current core, interrupts are disabled
+static void pmu_profile_setup(void* arg)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint32_t counter = pmu_nr_gp - 1;
+	const uint64_t bit = pmu_counter_bit(counter);
+	uint64_t ctrl = curr_task->pmu ? curr_task->pmu->global_ctrl : 0;
+
+	wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, ctrl & ~bit);
+	wrmsr(MSR_IA32_PERFEVTSEL0 + counter, 0);
+
+	if (pmu_reserved) {
+		wrmsr(MSR_IA32_PERFCTR0 + counter, -pmu_profile_period);
+		wrmsr(MSR_IA32_PERFEVTSEL0 + counter, pmu_profile_evtsel);
+		apic_lvt_pmc(pmu_profile_vector, 1);
+		wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, ctrl | bit);
+	} else {
+		apic_lvt_pmc(pmu_profile_vector, 0);
+	}
+}
+
+/// program the profiler on all cores
+static int pmu_profile_setup_all(void)
+{
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+	pmu_profile_setup(NULL);
+	irq_nested_enable(flags);
+
+#if MAX_CORES > 1
+	return smp_call_function(pmu_profile_setup, NULL, 1);
+#else
+	return 0;
+#endif
+}
+
+int pmu_profile_start(uint32_t type, uint64_t config, uint64_t period)
+{
+	uint32_t i, ncores = possible_cpus;
+	uint64_t evtsel;
+	uint8_t fixed;
+	int ret;
+
+	if (BUILTIN_EXPECT(!pmu_version || !pmu_nr_gp, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!period || (period > 0x7FFFFFFFULL), 0))
+		return -EINVAL;
+
+	// the profiler uses always a general-purpose counter
+	ret = pmu_event_config(type, config, &evtsel, &fixed);
+	if (ret)
+		return ret;
+
+	if (ncores > MAX_CORES)
+		ncores = MAX_CORES;
+
+	spinlock_lock(&pmu_profile_lock);
+
+	if (pmu_reserved) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (pmu_profile_vector < 0) {
+		ret = irq_alloc_vector();
+		if (ret < 0)
+			goto out;
+
+		pmu_profile_vector = ret;
+		irq_install_handler(pmu_profile_vector, pmu_pmi_handler);
+	}
+
+	for (i = 0; i < ncores; i++) {
+		if (!pmu_profile_rings[i].samples) {
+			pmu_profile_rings[i].samples = kmalloc(PMU_PROFILE_SIZE * sizeof(pmu_sample_t));
+			if (BUILTIN_EXPECT(!pmu_profile_rings[i].samples, 0)) {
+				LOG_ERROR("PMU: unable to allocate the samples of core %u\n", i);
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+
+		memset(pmu_profile_rings[i].samples, 0x00, PMU_PROFILE_SIZE * sizeof(pmu_sample_t));
+		pmu_profile_rings[i].head = 0;
+	}
+
+	pmu_profile_evtsel = evtsel | EVTSEL_INT;
+	pmu_profile_period = period;
+	pmu_reserved = pmu_counter_bit(pmu_nr_gp - 1);
+
+	ret = pmu_profile_setup_all();
+
+	LOG_INFO("PMU: start profiler with event 0x%llx and period %llu\n", pmu_profile_evtsel, period);
+
+out:
+	spinlock_unlock(&pmu_profile_lock);
+
+	return ret;
+}
+
+int pmu_profile_stop(void)
+{
+	int ret = 0;
+
+	spinlock_lock(&pmu_profile_lock);
+	if (pmu_reserved) {
+		pmu_reserved = 0;
+		ret = pmu_profile_setup_all();
+	}
+	spinlock_unlock(&pmu_profile_lock);
+
+	return ret;
+}
+
+int pmu_profile_read(uint32_t core, pmu_sample_t* buf, size_t n)
+{
+	pmu_profile_ring_t* ring;
+	uint64_t first, head;
+	size_t copied = 0;
+
+	if (BUILTIN_EXPECT(!buf || (core >= MAX_CORES), 0))
+		return -EINVAL;
+
+	ring = pmu_profile_rings + core;
+	if (!ring->samples)
+		return -EINVAL;
+
+	// a snapshot, the core may overwrite samples while we copy them
+	head = ring->head;
+	first = head > PMU_PROFILE_SIZE ? head - PMU_PROFILE_SIZE : 0;
+	if (head - first > n)
+		first = head - n;
+
+	for (; first < head; first++)
+		buf[copied++] = ring->samples[first % PMU_PROFILE_SIZE];
+
+	return (int) copied;
+}
@@ -35,8 +35,13 @@
 #include <hermit/spinlock.h>
 #include <hermit/rcce.h>
 #include <hermit/islelock.h>
+#include <hermit/errno.h>
+#include <hermit/syscall.h>
+#include <hermit/pmu.h>
 #include <asm/page.h>
 #include <asm/multiboot.h>
+#include <asm/apic.h>
+#include <asm/irqflags.h>
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
@@ -50,7 +55,10 @@ extern void* Lpatch1;
 extern void* Lpatch2;
 extern atomic_int32_t current_boot_id;
 
+uint32_t mwait_hint = MWAIT_HINT;
+
 islelock_t* rcce_lock = NULL;
+atomic_int32_t* rcce_doorbell = NULL;
 rcce_mpb_t* rcce_mpb = NULL;
 
 extern void isrsyscall(void);
@@ -78,6 +86,7 @@ int init_rcce(void)
 	}
 
 	rcce_lock = (islelock_t*) addr;
+	rcce_doorbell = (atomic_int32_t*) (addr + RCCE_DOORBELL_OFFSET);
 	rcce_mpb = (rcce_mpb_t*) (addr + CACHE_LINE*(RCCE_MAXNP+1));
 
 	LOG_INFO("Map rcce_lock at %p and rcce_mpb at %p\n", rcce_lock, rcce_mpb);
@@ -98,6 +107,8 @@ cpu_info_t cpu_info = { 0, 0, 0, 0, 0};
 static char cpu_vendor[13] = {[0 ... 12] = 0};
 static char cpu_brand[4*3*sizeof(uint32_t)+1] = {[0 ... 4*3*sizeof(uint32_t)] = 0};
 extern uint32_t cpu_freq;
+extern uint64_t tsc_freq;
+extern uint64_t apic_freq;
 
 static void default_save_fpu_state(union fpu_state* state)
 {
@@ -216,6 +227,35 @@ static void fpu_init_xsave(union fpu_state* fpu)
 	xs->fxsave.mxcsr = 0x1f80;
 }
 
+static void save_fpu_state_xsaveopt(union fpu_state* state)
+{
+	// skips unmodified components and components in their initial state
+	asm volatile ("xsaveoptq %0" : "=m"(state->xsave) : "a"(-1), "d"(-1) : "memory");
+}
+
+static void save_fpu_state_xsaves(union fpu_state* state)
+{
+	// compacted format with the init and modified optimization
+	asm volatile ("xsaves64 %0" : "=m"(state->xsave) : "a"(-1), "d"(-1) : "memory");
+}
+
+static void restore_fpu_state_xsaves(union fpu_state* state)
+{
+	asm volatile ("xrstors64 %0" :: "m"(state->xsave), "a"(-1), "d"(-1));
+}
+
+static void fpu_init_xsaves(union fpu_state* fpu)
+{
+	xsave_t* xs = &fpu->xsave;
+
+	memset(xs, 0x00, sizeof(xsave_t));
+	xs->fxsave.cwd = 0x37f;
+	xs->fxsave.mxcsr = 0x1f80;
+	// x87 and SSE state are valid, all other components are in their initial state
+	xs->hdr.xstate_bv = 0x3;
+	xs->hdr.xcomp_bv = (1ULL << 63) | xgetbv(0);
+}
+
 static uint32_t get_frequency_from_mbinfo(void)
 {
 	if (mb_info && (mb_info->flags & MULTIBOOT_INFO_CMDLINE) && (cmdline))
@@ -273,6 +313,83 @@ static uint32_t get_frequency_from_brand(void)
 	return 0;
 }
 
+uint64_t get_tsc_frequency(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, level = 0;
+
+	// the loader already knows the frequency
+	if (tsc_freq)
+		return tsc_freq;
+
+	// the hypervisor may pass the TSC frequency in kHz
+	if (on_hypervisor()) {
+		cpuid(0x40000000, &level, &b, &c, &d);
+		if ((level >= 0x40000010) && (level < 0x40010000)) {
+			c = 0;
+			cpuid(0x40000010, &a, &b, &c, &d);
+			if (a)
+				return 1000ULL * (uint64_t) a;
+		}
+	}
+
+	c = 0;
+	cpuid(0, &level, &b, &c, &d);
+
+	// ratio of the TSC and the core crystal clock
+	if (level >= 0x15) {
+		a = b = c = d = 0;
+		cpuid(0x15, &a, &b, &c, &d);
+		if (a && b && c)
+			return ((uint64_t) c * (uint64_t) b) / (uint64_t) a;
+	}
+
+	// the TSC runs at the base frequency of the processor
+	if (level >= 0x16) {
+		a = b = c = d = 0;
+		cpuid(0x16, &a, &b, &c, &d);
+		if (a & 0xFFFF)
+			return 1000000ULL * (uint64_t) (a & 0xFFFF);
+	}
+
+	return 0;
+}
+
+uint64_t get_apic_frequency(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, level = 0;
+
+	// the loader already knows the frequency
+	if (apic_freq)
+		return apic_freq;
+
+	// the hypervisor may pass the frequency of the APIC bus in kHz
+	if (on_hypervisor()) {
+		cpuid(0x40000000, &level, &b, &c, &d);
+		if ((level >= 0x40000010) && (level < 0x40010000)) {
+			c = 0;
+			cpuid(0x40000010, &a, &b, &c, &d);
+			if (b)
+				return 1000ULL * (uint64_t) b;
+		}
+	}
+
+	if (strncmp(cpu_vendor, "GenuineIntel", 12))
+		return 0;
+
+	c = 0;
+	cpuid(0, &level, &b, &c, &d);
+
+	// the APIC timer is driven by the core crystal clock
+	if (level >= 0x15) {
+		a = b = c = d = 0;
+		cpuid(0x15, &a, &b, &c, &d);
+		if (c)
+			return (uint64_t) c;
+	}
+
+	return 0;
+}
+
 uint32_t detect_cpu_frequency(void)
 {
 	uint64_t start, end, diff;
@@ -282,6 +399,9 @@ uint32_t detect_cpu_frequency(void)
 		return cpu_freq;
 
 	cpu_freq = get_frequency_from_mbinfo();
+	if (cpu_freq > 0)
+		return cpu_freq;
+	cpu_freq = (uint32_t) ((get_tsc_frequency() + 500000ULL) / 1000000ULL);
 	if (cpu_freq > 0)
 		return cpu_freq;
 	cpu_freq = get_frequency_from_brand();
@@ -352,6 +472,134 @@ static void set_pstate(int pstate)
 	wrmsr(MSR_IA32_PERF_CTL, v);
 }
 
+/// length of the window, in which the governor measures the idle ratio (in ms)
+#define PSTATE_WINDOW_MS	10
+/// load in percent, above which ondemand selects the highest P-state
+#define PSTATE_UP_THRESHOLD	80
+
+static uint8_t pstate_policy = PSTATE_PERFORMANCE;
+/// is the P-state controllable by HermitCore?
+static uint8_t est_enabled = 0;
+/// number of active turbo requests (see sys_pstate_boost)
+static atomic_int32_t pstate_boosts = ATOMIC_INIT(0);
+
+static struct {
+	uint64_t window_start;
+	uint64_t idle;
+	/// load of the last window in percent
+	uint32_t load;
+	int pstate;
+} __attribute__ ((aligned (CACHE_LINE))) pstate_gov[MAX_CORES];
+
+static int pstate_target(uint32_t load)
+{
+	const int high = is_turbo ? turbo_pstate : max_pstate;
+
+	if (atomic_int32_read(&pstate_boosts) > 0)
+		return high;
+
+	switch(pstate_policy) {
+	case PSTATE_POWERSAVE:
+		return min_pstate;
+	case PSTATE_ONDEMAND:
+		if (load >= PSTATE_UP_THRESHOLD)
+			return high;
+		return min_pstate + ((max_pstate - min_pstate) * (int) load) / PSTATE_UP_THRESHOLD;
+	default:
+		return high;
+	}
+}
+
+/// select the P-state of the policy on the current core
+static void pstate_apply(void* arg)
+{
+	const uint32_t core_id = CORE_ID;
+	const int pstate = pstate_target(pstate_gov[core_id].load);
+
+	if (pstate != pstate_gov[core_id].pstate) {
+		set_pstate(pstate);
+		pstate_gov[core_id].pstate = pstate;
+	}
+}
+
+void pstate_account_idle(uint64_t cycles)
+{
+	const uint32_t core_id = CORE_ID;
+	uint64_t now, window;
+
+	if (!est_enabled || (pstate_policy != PSTATE_ONDEMAND))
+		return;
+
+	now = get_rdtsc();
+	pstate_gov[core_id].idle += cycles;
+	window = now - pstate_gov[core_id].window_start;
+	if (window < (clocksource_tsc_hz() / 1000ULL) * PSTATE_WINDOW_MS)
+		return;
+
+	if (pstate_gov[core_id].idle >= window)
+		pstate_gov[core_id].load = 0;
+	else
+		pstate_gov[core_id].load = 100 - (uint32_t) ((pstate_gov[core_id].idle * 100) / window);
+	pstate_gov[core_id].window_start = now;
+	pstate_gov[core_id].idle = 0;
+
+	pstate_apply(NULL);
+}
+
+int sys_pstate_boost(int enable)
+{
+	uint8_t flags;
+
+	if (!est_enabled)
+		return -ENOSYS;
+
+	if (enable)
+		atomic_int32_inc(&pstate_boosts);
+	else if (atomic_int32_dec(&pstate_boosts) < 0)
+		atomic_int32_inc(&pstate_boosts);
+
+	flags = irq_nested_disable();
+	pstate_apply(NULL);
+	irq_nested_enable(flags);
+
+#if MAX_CORES > 1
+	// the other cores switch without waiting for their next window
+	smp_call_function(pstate_apply, NULL, 0);
+#endif
+
+	return 0;
+}
+
+static void pstate_governor_init(uint8_t out)
+{
+	const uint32_t core_id = CORE_ID;
+
+	if (out) {
+		const char* cmdline = get_cmdline();
+		const char* policy = cmdline ? strstr(cmdline, "-governor=") : NULL;
+
+		if (policy) {
+			policy += strlen("-governor=");
+			if (!strncmp(policy, "powersave", strlen("powersave")))
+				pstate_policy = PSTATE_POWERSAVE;
+			else if (!strncmp(policy, "ondemand", strlen("ondemand")))
+				pstate_policy = PSTATE_ONDEMAND;
+			else
+				pstate_policy = PSTATE_PERFORMANCE;
+		}
+
+		LOG_INFO("P-state governor uses the policy %s\n",
+			pstate_policy == PSTATE_POWERSAVE ? "powersave" :
+			pstate_policy == PSTATE_ONDEMAND ? "ondemand" : "performance");
+	}
+
+	est_enabled = 1;
+	pstate_gov[core_id].window_start = get_rdtsc();
+	pstate_gov[core_id].load = 100;
+	pstate_gov[core_id].pstate = -1;
+	pstate_apply(NULL);
+}
+
 void dump_pstate(void)
 {
 	if (!has_est())
@@ -430,11 +678,8 @@ static void check_est(uint8_t out)
 	min_pstate = get_min_pstate();
 	turbo_pstate = get_turbo_pstate();
 
-	// set maximum p-state to get peak performance
-	if (is_turbo)
-		set_pstate(turbo_pstate);
-	else
-		set_pstate(max_pstate);
+	// per default the maximum p-state to get peak performance
+	pstate_governor_init(out);
 
 	if (out)
 		dump_pstate();
@@ -442,6 +687,55 @@ static void check_est(uint8_t out)
 	return;
 }
 
+/// identifier of the last level cache for each core
+static uint32_t cache_domain[MAX_CORES] = {[0 ... MAX_CORES-1] = 0};
+
+uint32_t get_cache_domain(uint32_t core_id)
+{
+	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
+		return 0;
+
+	return cache_domain[core_id];
+}
+
+static void detect_cache_domain(uint32_t core_id)
+{
+	uint32_t a=0, b=0, c=0, d=0, level = 0;
+	uint32_t apic_id, nr_sharing = 1, shift = 0, i;
+
+	cpuid(0, &level, &b, &c, &d);
+
+	a = b = c = d = 0;
+	cpuid(1, &a, &b, &c, &d);
+	apic_id = b >> 24;
+	// without any cache information, the package is the cache domain
+	if (d & (1 << 28))
+		nr_sharing = (b >> 16) & 0xFF;
+
+	if (level >= 0xB) {
+		a = b = c = d = 0;
+		cpuid(0xB, &a, &b, &c, &d);
+		apic_id = d;
+	}
+
+	if (level >= 4) {
+		// the caches are enumerated up to the last level cache
+		for(i=0; i<16; i++) {
+			a = b = d = 0;
+			c = i;
+			cpuid(4, &a, &b, &c, &d);
+			if (!(a & 0x1F))
+				break;
+			nr_sharing = ((a >> 14) & 0xFFF) + 1;
+		}
+	}
+
+	while((1U << shift) < nr_sharing)
+		shift++;
+
+	cache_domain[core_id] = apic_id >> shift;
+}
+
 int reset_fsgs(int32_t core_id)
 {
 	writefs(0);
@@ -496,10 +790,12 @@ int cpu_detection(void) {
 			a = b = c = d = 0;
 			cpuid(7, &a, &cpu_info.feature4, &c, &d);
 		}
+
+		string_init();
 	}
 
 	if (first_time) {
-		kprintf("Paging features: %s%s%s%s%s%s%s%s\n",
+		kprintf("Paging features: %s%s%s%s%s%s%s%s%s%s\n",
 				(cpu_info.feature1 & CPU_FEATURE_PSE) ? "PSE (2/4Mb) " : "",
 				(cpu_info.feature1 & CPU_FEATURE_PAE) ? "PAE " : "",
 				(cpu_info.feature1 & CPU_FEATURE_PGE) ? "PGE " : "",
@@ -507,6 +803,8 @@ int cpu_detection(void) {
 				(cpu_info.feature1 & CPU_FEATURE_PSE36) ? "PSE36 " : "",
 				(cpu_info.feature3 & CPU_FEATURE_NX) ? "NX " : "",
 				(cpu_info.feature3 & CPU_FEATURE_1GBHP) ? "PSE (1Gb) " : "",
+				(cpu_info.feature2 & CPU_FEATURE_PCID) ? "PCID " : "",
+				(cpu_info.feature4 & CPU_FEATURE_INVPCID) ? "INVPCID " : "",
 				(cpu_info.feature3 & CPU_FEATURE_LM) ? "LM" : "");
 
 		kprintf("Physical adress-width: %u bits\n", cpu_info.addr_width & 0xff);
@@ -536,6 +834,9 @@ int cpu_detection(void) {
 		cr4 |= CR4_PGE;
 	if (has_fsgsbase())
 		cr4 |= CR4_FSGSBASE;
+	// PCIDE may only be set, if CR3 selects PCID 0
+	if (has_pcid() && !(read_cr3() & 0xFFF))
+		cr4 |= CR4_PCIDE;
 	if (has_mce())
 		cr4 |= CR4_MCE;		// enable machine check exceptions
 	//if (has_vmx())
@@ -574,6 +875,16 @@ int cpu_detection(void) {
 			xcr0 |= 0xE0;
 		xsetbv(0, xcr0);
 
+		// the enabled components have to fit into union fpu_state
+		a = b = c = d = 0;
+		cpuid(0xd, &a, &b, &c, &d);
+		if (b > sizeof(xsave_t)) {
+			if (first_time)
+				LOG_WARNING("XSAVE area (%u bytes) exceeds xsave_t, disable AVX-512 state\n", b);
+			xcr0 &= ~0xE0ULL;
+			xsetbv(0, xcr0);
+		}
+
 		if (first_time)
 			kprintf("Set XCR0 to 0x%llx\n", xgetbv(0));
 	}
@@ -603,6 +914,11 @@ int cpu_detection(void) {
 	set_per_core(__core_id, atomic_int32_read(&current_boot_id));
 	LOG_INFO("Core id is set to %d\n", CORE_ID);
 
+	detect_cache_domain(CORE_ID);
+	LOG_INFO("Core %d uses cache domain %u\n", CORE_ID, get_cache_domain(CORE_ID));
+
+	pmu_init();
+
 	if (has_fpu()) {
 		if (first_time)
 			LOG_INFO("Found and initialized FPU!\n");
@@ -614,7 +930,7 @@ int cpu_detection(void) {
 		a = b = c = d = 0;
                 cpuid(1, &a, &b, &cpu_info.feature2, &cpu_info.feature1);
 
-		LOG_INFO("CPU features: %s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n",
+		LOG_INFO("CPU features: %s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s\n",
 			has_sse() ? "SSE " : "",
 			has_sse2() ? "SSE2 " : "",
 			has_sse3() ? "SSE3 " : "",
@@ -626,6 +942,7 @@ int cpu_detection(void) {
 			has_fma() ? "FMA " : "",
 			has_movbe() ? "MOVBE " : "",
 			has_x2apic() ? "X2APIC " : "",
+			has_tsc_deadline() ? "TSC-DEADLINE " : "",
 			has_mce() ? "MCE " : "",
 			has_fpu() ? "FPU " : "",
 			has_fxsr() ? "FXSR " : "",
@@ -669,9 +986,31 @@ int cpu_detection(void) {
 		cpuid(0xd, &a, &b, &c, &d);
 		LOG_INFO("Ext_Save_Area_4: offset %d, size %d\n", b, a);
 
-		save_fpu_state = save_fpu_state_xsave;
-		restore_fpu_state = restore_fpu_state_xsave;
-		fpu_init = fpu_init_xsave;
+		a = b = d = 0;
+		c = 0;
+		cpuid(0xd, &a, &b, &c, &d);
+		LOG_INFO("Size of the XSAVE area: %u bytes\n", b);
+
+		// determine the supported XSAVE extensions
+		a = b = d = 0;
+		c = 1;
+		cpuid(0xd, &a, &b, &c, &d);
+
+		if (a & (1 << 3)) {
+			LOG_INFO("Use XSAVES (compacted size %u bytes)\n", b);
+			save_fpu_state = save_fpu_state_xsaves;
+			restore_fpu_state = restore_fpu_state_xsaves;
+			fpu_init = fpu_init_xsaves;
+		} else if (a & (1 << 0)) {
+			LOG_INFO("Use XSAVEOPT\n");
+			save_fpu_state = save_fpu_state_xsaveopt;
+			restore_fpu_state = restore_fpu_state_xsave;
+			fpu_init = fpu_init_xsave;
+		} else {
+			save_fpu_state = save_fpu_state_xsave;
+			restore_fpu_state = restore_fpu_state_xsave;
+			fpu_init = fpu_init_xsave;
+		}
 	} else if (first_time && has_fxsr()) {
 		save_fpu_state = save_fpu_state_fxsr;
 		restore_fpu_state = restore_fpu_state_fxsr;
@@ -681,6 +1020,26 @@ int cpu_detection(void) {
 	// initialize Enhanced SpeedStep Technology
 	check_est(first_time);
 
+	if (first_time && has_mwait()) {
+		uint32_t cstate = ((mwait_hint >> 4) & 0xF) + 1;
+		uint32_t substate = mwait_hint & 0xF;
+
+		// determine the supported sub-states of each C-state
+		a = b = c = d = 0;
+		cpuid(0, &level, &b, &c, &d);
+		if (level >= 5) {
+			a = b = c = d = 0;
+			cpuid(5, &a, &b, &c, &d);
+		}
+
+		if ((cstate > 7) || (((d >> (4*cstate)) & 0xF) <= substate)) {
+			LOG_INFO("MWAIT hint 0x%x isn't supported, use C1\n", mwait_hint);
+			mwait_hint = 0;
+		} else {
+			LOG_INFO("Use MWAIT hint 0x%x (C%u, sub-state %u)\n", mwait_hint, cstate, substate);
+		}
+	}
+
 	if (first_time && on_hypervisor()) {
 		char vendor_id[13];
 
@@ -691,6 +1050,10 @@ int cpu_detection(void) {
 
 		LOG_INFO("Hypervisor Vendor Id: %s\n", vendor_id);
 		LOG_INFO("Maximum input value for hypervisor: 0x%x\n", a);
+
+#ifdef PVLOCK
+		pvlock_init();
+#endif
 	}
 
 
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file arch/x86_64/kernel/pvlock.c
+ * @brief Paravirtual spinlocks
+ *
+ * If the host preempts the vCPU of a lock owner, the waiters would spin
+ * for the whole time slice of the host. With KVM's PV unhalt feature, a
+ * waiter registers its ticket and halts its vCPU after a bounded spin.
+ * The releaser kicks the vCPU of the waiter, whose ticket is served, by
+ * the hypercall KVM_HC_KICK_CPU. A kick, which arrives before the
+ * waiter executes hlt, isn't lost: KVM returns from the next hlt
+ * immediately.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/logging.h>
+#include <hermit/spinlock.h>
+#include <asm/processor.h>
+#include <asm/irqflags.h>
+
+#ifdef PVLOCK
+
+#define KVM_CPUID_SIGNATURE	0x40000000
+#define KVM_CPUID_FEATURES	0x40000001
+
+#define KVM_FEATURE_PV_UNHALT	(1 << 7)
+
+#define KVM_HC_KICK_CPU		5
+
+/*
+ * Ticket, which the vCPU waits for. The registration isn't removed:
+ * tickets are served only once, so a stale entry never matches again.
+ */
+typedef struct pvlock_waiter {
+	atomic_int64_t* volatile dequeue;
+	volatile int64_t ticket;
+} __attribute__ ((aligned (CACHE_LINE))) pvlock_waiter_t;
+
+static pvlock_waiter_t pvlock_waiters[MAX_CORES];
+
+uint8_t pvlock_enabled = 0;
+atomic_int64_t pvlock_waiting = ATOMIC_INIT(0);
+
+int pvlock_init(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0;
+	uint32_t features = 0;
+	char signature[13] = {[0 ... 12] = 0};
+
+	if (!on_hypervisor())
+		return -ENODEV;
+
+	cpuid(KVM_CPUID_SIGNATURE, &a, (uint32_t*) signature, (uint32_t*) (signature+4), (uint32_t*) (signature+8));
+	if (strncmp(signature, "KVMKVMKVM", 12) || (a < KVM_CPUID_FEATURES))
+		return -ENODEV;
+
+	c = 0;
+	cpuid(KVM_CPUID_FEATURES, &features, &b, &c, &d);
+	if (!(features & KVM_FEATURE_PV_UNHALT))
+		return -ENODEV;
+
+	pvlock_enabled = 1;
+	LOG_INFO("Use paravirtual spinlocks\n");
+
+	return 0;
+}
+
+void pvlock_wait(atomic_int64_t* dequeue, int64_t ticket)
+{
+	uint8_t flags = irq_nested_disable();
+	pvlock_waiter_t* waiter = pvlock_waiters + CORE_ID;
+
+	waiter->dequeue = dequeue;
+	waiter->ticket = ticket;
+
+	/*
+	 * The locked increment orders the registration before the check.
+	 * The releaser increments dequeue before it reads pvlock_waiting,
+	 * so either the check or the releaser sees the other side.
+	 */
+	atomic_int64_inc(&pvlock_waiting);
+
+	if (atomic_int64_read(dequeue) != ticket) {
+		// the owner may be preempted on this core => keep interrupts enabled
+		if (flags)
+			asm volatile ("sti; hlt" ::: "memory");
+		else
+			HALT;
+	}
+
+	atomic_int64_dec(&pvlock_waiting);
+	irq_nested_enable(flags);
+}
+
+void pvlock_kick(atomic_int64_t* dequeue, int64_t ticket)
+{
+	uint32_t i;
+
+	// the core id is the APIC id of the vCPU
+	for(i=0; i<MAX_CORES; i++) {
+		if ((pvlock_waiters[i].dequeue == dequeue) && (pvlock_waiters[i].ticket == ticket)) {
+			vmcall2(KVM_HC_KICK_CPU, 0, i);
+			break;
+		}
+	}
+}
+
+#endif
@@ -31,16 +31,123 @@
 #include <hermit/tasks.h>
 #include <hermit/dequeue.h>
 #include <hermit/logging.h>
+#include <hermit/stdlib.h>
 #include <asm/apic.h>
 #include <asm/irq.h>
 #include <asm/atomic.h>
 
 #define SIGNAL_IRQ (32 + 82)
-#define SIGNAL_BUFFER_SIZE (16)
 
-// Per-core signal queue and buffer
-static dequeue_t signal_queue[MAX_CORES];
-static sig_t signal_buffer[MAX_CORES][SIGNAL_BUFFER_SIZE];
+extern int32_t possible_cpus;
+
+// Per-core signal queue, the queues of the detected cores are allocated by signal_init()
+static dequeue_t* signal_queue = NULL;
+
+// A signal IPI to the core is on its way => senders don't need to send another one
+static atomic_int32_t* signal_pending = NULL;
+
+// number of cores, which have a signal queue
+static uint32_t nr_signal_queues = 0;
+
+/* Injects the signal handler of dest_task into its control flow. s is the
+ * interrupted state, if dest_task is the running task, otherwise NULL.
+ */
+static void signal_inject(task_t* dest_task, int signum, struct state* s)
+{
+	/* We will inject the signal handler into the control flow when
+	 * the task will continue it's exection the next time. There are
+	 * 3 cases how the task was interrupted:
+	 *
+	 *   1. call to reschedule() by own intend
+	 *   2. a timer interrupt lead to rescheduling to another task
+	 *   3. this IRQ interrupted the task
+	 *
+	 * Depending on those cases, the state of the task can either be
+	 * saved to it's own stack (1.), it's interrupt stack (IST, 2.)
+	 * or the stack of this interrupt handler (3.).
+	 *
+	 * When the signal handler finishes it's execution, we need to
+	 * restore the task state, so we make the signal handler return
+	 * first to sighandler_epilog() which then restores the original
+	 * state.
+	 *
+	 * For cases 2+3, when task was interrupted by an IRQ, we modify
+	 * the existing state on the interrupt stack to execute the
+	 * signal handler, wherease in case 1, we craft a new state and
+	 * place it on top of the task stack.
+	 *
+	 * The task stack will have the following layout:
+	 *
+	 * |         ...          | <- task's rsp before interruption
+	 * |----------------------|
+	 * |     saved state      |
+	 * |----------------------|
+	 * | &sighandler_epilog() | <- rsp after IRQ
+	 * |----------------------|
+	 * |----------------------| Only for case 1:
+	 * | signal handler state | Craft signal handler state, so it
+	 * |----------------------| executes before task is continued
+	 */
+
+	size_t* task_stackptr;
+	struct state *task_state, *sighandler_state;
+
+	LOG_DEBUG("  Task is%s running\n", s ? "" : " not");
+
+	// location of task state depends of type of interruption
+	task_state = (!s) ?
+	/* case 1+2: */	(struct state*) dest_task->last_stack_pointer :
+	/* case 3:   */ s;
+
+	// pseudo state pushed by reschedule() has INT no. 0
+	const int state_on_task_stack = task_state->int_no == 0;
+
+	if(state_on_task_stack) {
+		LOG_DEBUG("  State is already on task stack\n");
+		// stack pointer was saved by switch_context() after saving
+		// task state to task stack
+		task_stackptr = dest_task->last_stack_pointer;
+	} else {
+		// stack pointer is last rsp, since task state is saved to
+		// interrupt stack
+		task_stackptr = (size_t*) task_state->rsp;
+
+		LOG_DEBUG("  Copy state to task stack\n");
+		task_stackptr -= sizeof(struct state) / sizeof(size_t);
+		memcpy(task_stackptr, task_state, sizeof(struct state));
+	}
+
+	// signal handler will return to this function to restore
+	// register state
+	extern void sighandler_epilog();
+	*(--task_stackptr) = (uint64_t) &sighandler_epilog;
+	size_t* sighandler_rsp = task_stackptr;
+
+	if(state_on_task_stack) {
+		LOG_DEBUG("  Craft state for signal handler on task stack\n");
+
+		// we actually only care for ss, rflags, cs, fs and gs
+		task_stackptr -= sizeof(struct state) / sizeof(size_t);
+		sighandler_state = (struct state*) task_stackptr;
+		memcpy(sighandler_state, task_state, sizeof(struct state));
+
+		// advance stack pointer so signal handler state will be
+		// restored first
+		dest_task->last_stack_pointer = (size_t*) sighandler_state;
+	} else {
+		LOG_DEBUG("  Reuse state on IST for signal handler\n");
+		sighandler_state = task_state;
+	}
+
+	// update rsp so that sighandler_epilog() will be executed
+	// after signal handler
+	sighandler_state->rsp = (uint64_t) sighandler_rsp;
+	sighandler_state->userrsp = sighandler_state->rsp;
+
+	// call signal handler instead of continuing task's execution
+	sighandler_state->rdi = (uint64_t) signum;
+	sighandler_state->rip = (uint64_t) dest_task->signal_handler;
+}
 
 static void _signal_irq_handler(struct state* s)
 {
@@ -50,6 +157,10 @@ static void _signal_irq_handler(struct state* s)
 	task_t* dest_task;
 	task_t* curr_task = per_core(current_task);
 
+	// signals, which are queued after this point, need a new IPI
+	atomic_int32_set(&signal_pending[CORE_ID], 0);
+
+	// deliver all queued signals with this IPI
 	while(dequeue_pop(&signal_queue[CORE_ID], &signal) == 0) {
 		LOG_DEBUG("  Deliver signal %d\n", signal.signum);
 
@@ -65,100 +176,8 @@ static void _signal_irq_handler(struct state* s)
 			if(dest_task->signal_handler) {
 				LOG_DEBUG("  Has signal handler (%p)\n", dest_task->signal_handler);
 
-				/* We will inject the signal handler into the control flow when
-				 * the task will continue it's exection the next time. There are
-				 * 3 cases how the task was interrupted:
-				 *
-				 *   1. call to reschedule() by own intend
-				 *   2. a timer interrupt lead to rescheduling to another task
-				 *   3. this IRQ interrupted the task
-				 *
-				 * Depending on those cases, the state of the task can either be
-				 * saved to it's own stack (1.), it's interrupt stack (IST, 2.)
-				 * or the stack of this interrupt handler (3.).
-				 *
-				 * When the signal handler finishes it's execution, we need to
-				 * restore the task state, so we make the signal handler return
-				 * first to sighandler_epilog() which then restores the original
-				 * state.
-				 *
-				 * For cases 2+3, when task was interrupted by an IRQ, we modify
-				 * the existing state on the interrupt stack to execute the
-				 * signal handler, wherease in case 1, we craft a new state and
-				 * place it on top of the task stack.
-				 *
-				 * The task stack will have the following layout:
-				 *
-				 * |         ...          | <- task's rsp before interruption
-				 * |----------------------|
-				 * |     saved state      |
-				 * |----------------------|
-				 * | &sighandler_epilog() | <- rsp after IRQ
-				 * |----------------------|
-				 * |----------------------| Only for case 1:
-				 * | signal handler state | Craft signal handler state, so it
-				 * |----------------------| executes before task is continued
-				 */
-
-				size_t* task_stackptr;
-				struct state *task_state, *sighandler_state;
-
-				const int task_is_running = dest_task == curr_task;
-				LOG_DEBUG("  Task is%s running\n", task_is_running ? "" : " not");
-
-				// location of task state depends of type of interruption
-				task_state = (!task_is_running) ?
-				/* case 1+2: */	(struct state*) dest_task->last_stack_pointer :
-				/* case 3:   */ s;
-
-				// pseudo state pushed by reschedule() has INT no. 0
-				const int state_on_task_stack = task_state->int_no == 0;
-
-				if(state_on_task_stack) {
-					LOG_DEBUG("  State is already on task stack\n");
-					// stack pointer was saved by switch_context() after saving
-					// task state to task stack
-					task_stackptr = dest_task->last_stack_pointer;
-				} else {
-					// stack pointer is last rsp, since task state is saved to
-					// interrupt stack
-					task_stackptr = (size_t*) task_state->rsp;
-
-					LOG_DEBUG("  Copy state to task stack\n");
-					task_stackptr -= sizeof(struct state) / sizeof(size_t);
-					memcpy(task_stackptr, task_state, sizeof(struct state));
-				}
-
-				// signal handler will return to this function to restore
-				// register state
-				extern void sighandler_epilog();
-				*(--task_stackptr) = (uint64_t) &sighandler_epilog;
-				size_t* sighandler_rsp = task_stackptr;
-
-				if(state_on_task_stack) {
-					LOG_DEBUG("  Craft state for signal handler on task stack\n");
-
-					// we actually only care for ss, rflags, cs, fs and gs
-					task_stackptr -= sizeof(struct state) / sizeof(size_t);
-					sighandler_state = (struct state*) task_stackptr;
-					memcpy(sighandler_state, task_state, sizeof(struct state));
-
-					// advance stack pointer so signal handler state will be
-					// restored first
-					dest_task->last_stack_pointer = (size_t*) sighandler_state;
-				} else {
-					LOG_DEBUG("  Reuse state on IST for signal handler\n");
-					sighandler_state = task_state;
-				}
-
-				// update rsp so that sighandler_epilog() will be executed
-				// after signal handler
-				sighandler_state->rsp = (uint64_t) sighandler_rsp;
-				sighandler_state->userrsp = sighandler_state->rsp;
-
-				// call signal handler instead of continuing task's execution
-				sighandler_state->rdi = (uint64_t) signal.signum;
-				sighandler_state->rip = (uint64_t) dest_task->signal_handler;
+				signal_inject(dest_task, signal.signum,
+				              dest_task == curr_task ? s : NULL);
 			} else {
 				LOG_DEBUG("  No signal handler installed\n");
 			}
@@ -199,25 +218,78 @@ int hermit_kill(tid_t dest, int signum)
 		return 0;
 	}
 
+	// a task on this core isn't running => deliver it at the switch to the task
+	if(dest_core == CORE_ID && signum >= 0 && signum < MAX_SIGNALS) {
+		LOG_DEBUG("  Destination on the same core, defer the signal to the next switch\n");
+		__atomic_fetch_or(&task->signal_pending, 1U << signum, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	if(BUILTIN_EXPECT(dest_core >= nr_signal_queues, 0)) {
+		LOG_ERROR("  Core %d has no signal queue, dropping the signal\n", dest_core);
+		return -EINVAL;
+	}
+
 	sig_t signal = {dest, signum};
 	if(dequeue_push(&signal_queue[dest_core], &signal)) {
 		LOG_ERROR("  Cannot push signal to task's signal queue, dropping it\n");
 		return -ENOMEM;
 	}
 
-	// send IPI to destination core
-	LOG_DEBUG("  Send signal IPI (%d) to core %d\n", SIGNAL_IRQ, dest_core);
-	apic_send_ipi(dest_core, SIGNAL_IRQ);
+	// send IPI to destination core, unless an earlier one isn't handled yet
+	if(atomic_int32_test_and_set(&signal_pending[dest_core], 1) == 0) {
+		LOG_DEBUG("  Send signal IPI (%d) to core %d\n", SIGNAL_IRQ, dest_core);
+		apic_send_ipi(dest_core, SIGNAL_IRQ);
+	}
 
 	return 0;
 }
 
+void signal_switch_in(task_t* task)
+{
+	uint32_t pending = __atomic_exchange_n(&task->signal_pending, 0, __ATOMIC_ACQUIRE);
+
+	if(!task->signal_handler)
+		return;
+
+	while(pending) {
+		const int signum = __builtin_ctz(pending);
+
+		pending &= pending - 1;
+		LOG_DEBUG("  Deliver deferred signal %d to task %d\n", signum, task->id);
+		signal_inject(task, signum, NULL);
+	}
+}
+
 void signal_init(void)
 {
+	uint32_t ncores = possible_cpus;
+
+	if(ncores <= CORE_ID)
+		ncores = CORE_ID + 1;
+	if(ncores > MAX_CORES)
+		ncores = MAX_CORES;
+
+	signal_queue = kmalloc(ncores * sizeof(dequeue_t));
+	signal_pending = kmalloc(ncores * sizeof(atomic_int32_t));
+	if(BUILTIN_EXPECT(!signal_queue || !signal_pending, 0)) {
+		LOG_ERROR("Unable to allocate the signal queues\n");
+		return;
+	}
+	memset(signal_queue, 0x00, ncores * sizeof(dequeue_t));
+	nr_signal_queues = ncores;
+
 	// initialize per-core signal queue
-	for(int i = 0; i < MAX_CORES; i++) {
-		dequeue_init(&signal_queue[i], signal_buffer[i],
-		             SIGNAL_BUFFER_SIZE, sizeof(sig_t));
+	for(uint32_t i = 0; i < ncores; i++) {
+		void* buffer = kmalloc(SIGNAL_QUEUE_SIZE * DEQUEUE_SLOT_SIZE(sizeof(sig_t)));
+
+		if(BUILTIN_EXPECT(!buffer, 0)) {
+			LOG_ERROR("Unable to allocate the signal queue of core %u\n", i);
+			continue;
+		}
+
+		dequeue_init(&signal_queue[i], buffer, SIGNAL_QUEUE_SIZE, sizeof(sig_t));
+		atomic_int32_set(&signal_pending[i], 0);
 	}
 
 	irq_install_handler(SIGNAL_IRQ, _signal_irq_handler);
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file arch/x86/kernel/string.c
+ * @brief Processor specific variants of memcpy and memset
+ *
+ * The kernel doesn't use the vector registers (they belong to the
+ * application), therefore the non-temporal copy uses movnti with
+ * general purpose registers.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/logging.h>
+#include <asm/processor.h>
+
+/// CPUID.(EAX=7,ECX=0):EDX, fast short rep movsb
+#define CPU_FEATURE_FSRM	(1 << 4)
+
+uint32_t string_features = 0;
+size_t memcpy_nt_threshold = (size_t) -1;
+
+void* memcpy_nt(void* dest, const void* src, size_t count)
+{
+	uint8_t* d = (uint8_t*) dest;
+	const uint8_t* s = (const uint8_t*) src;
+	size_t head;
+
+	if (BUILTIN_EXPECT(!dest || !src, 0))
+		return dest;
+
+	if (count < 64) {
+		memcpy_small(d, s, count > MEMCPY_SMALL ? MEMCPY_SMALL : count);
+		for(head = MEMCPY_SMALL; head < count; head += MEMCPY_SMALL)
+			memcpy_small(d + head, s + head, count - head > MEMCPY_SMALL ? MEMCPY_SMALL : count - head);
+		return dest;
+	}
+
+	// movnti is faster with an aligned destination
+	head = (-(size_t) d) & 7;
+	memcpy_small(d, s, head);
+	d += head;
+	s += head;
+	count -= head;
+
+	for(; count >= 32; count -= 32, d += 32, s += 32) {
+		const uint64_t a = ((const unaligned_u64_t*) s)[0];
+		const uint64_t b = ((const unaligned_u64_t*) s)[1];
+		const uint64_t c = ((const unaligned_u64_t*) s)[2];
+		const uint64_t e = ((const unaligned_u64_t*) s)[3];
+
+		asm volatile ("movnti %4, %0\n\t"
+			"movnti %5, %1\n\t"
+			"movnti %6, %2\n\t"
+			"movnti %7, %3"
+			: "=m"(((uint64_t*) d)[0]), "=m"(((uint64_t*) d)[1]),
+			  "=m"(((uint64_t*) d)[2]), "=m"(((uint64_t*) d)[3])
+			: "r"(a), "r"(b), "r"(c), "r"(e));
+	}
+
+	for(; count >= 8; count -= 8, d += 8, s += 8)
+		asm volatile ("movnti %1, %0" : "=m"(*(uint64_t*) d) : "r"(*(const unaligned_u64_t*) s));
+
+	memcpy_small(d, s, count);
+
+	// the non-temporal stores are weakly ordered
+	asm volatile ("sfence" ::: "memory");
+
+	return dest;
+}
+
+/// size of the largest cache in bytes or 0
+static size_t llc_size(void)
+{
+	uint32_t a, b, c, d, i;
+	size_t size = 0;
+
+	// deterministic cache parameters (Intel)
+	for(i=0; i<16; i++) {
+		a = b = d = 0;
+		c = i;
+		cpuid(4, &a, &b, &c, &d);
+		if (!(a & 0x1F))
+			break;
+
+		// ways * partitions * line size * sets
+		size = (size_t) (((b >> 22) & 0x3FF) + 1) * (((b >> 12) & 0x3FF) + 1)
+			* ((b & 0xFFF) + 1) * (c + 1);
+	}
+
+	if (!size) {
+		// AMD reports the L2 cache in ECX and the L3 cache in EDX
+		cpuid(0x80000000, &a, &b, &c, &d);
+		if (a >= 0x80000006) {
+			cpuid(0x80000006, &a, &b, &c, &d);
+			if (d >> 18)
+				size = (size_t) (d >> 18) * 512 * 1024;
+			else
+				size = (size_t) (c >> 16) * 1024;
+		}
+	}
+
+	return size;
+}
+
+void string_init(void)
+{
+	uint32_t a = 0, b = 0, c = 0, d = 0, level;
+	size_t size;
+
+	cpuid(0, &level, &b, &c, &d);
+	if (level >= 7) {
+		a = b = c = d = 0;
+		cpuid(7, &a, &b, &c, &d);
+		if (b & CPU_FEATURE_ERMS)
+			string_features |= STRING_ERMS;
+		if (d & CPU_FEATURE_FSRM)
+			string_features |= STRING_FSRM;
+	}
+
+	size = (level >= 4) ? llc_size() : 0;
+	if (size)
+		memcpy_nt_threshold = size;
+
+	LOG_INFO("memcpy: rep movsb %s, non-temporal stores above %zd KB\n",
+		(string_features & STRING_FSRM) ? "is fast (FSRM)" : ((string_features & STRING_ERMS) ? "is fast (ERMS)" : "is slow"),
+		size >> 10);
+	if (!size)
+		LOG_INFO("memcpy: cache size is unknown, memcpy doesn't use non-temporal stores\n");
+}
@@ -35,6 +35,8 @@
 #include <hermit/vma.h>
 #include <hermit/rcce.h>
 #include <hermit/logging.h>
+#include <hermit/time.h>
+#include <hermit/signal.h>
 #include <asm/tss.h>
 #include <asm/page.h>
 #include <asm/multiboot.h>
@@ -46,43 +48,94 @@
 #define TSL_ALIGNMASK		((~0L) << TLS_ALIGNBITS)
 #define TLS_FLOOR(addr)		((((size_t)addr) + TLS_ALIGNSIZE - 1) & TSL_ALIGNMASK)
 
+/*
+ * TLS images of at least TLS_LAZY_SIZE bytes are placed at the top of a
+ * lazily mapped stack (see create_lazy_stack()) instead of the heap. Only
+ * .tdata is copied, the pages of .tbss are mapped on demand as zero pages.
+ * The blocks are reused by the stack cache, the full pages of .tbss are
+ * trimmed before, so that they are zero pages again.
+ */
+#define TLS_LAZY_SIZE		(4*PAGE_SIZE)
+/// size of the stack, which contains the TLS image and the self pointer
+#define TLS_BLOCK_SIZE(sz)	PAGE_CEIL((sz) + TLS_ALIGNSIZE + sizeof(size_t))
+
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
  * maintaining a value, rather their address is their value.
  */
 extern const void tls_start;
+extern const void tdata_end;
 extern const void tls_end;
 extern const void percore_start;
 extern const void percore_end0;
 
 extern uint64_t base;
 
+/// zeroes the part of [start, end), which may contain data of a previous thread
+static void tls_zero_bss(size_t start, size_t end, int lazy)
+{
+	size_t first = PAGE_CEIL(start);
+	size_t last = PAGE_FLOOR(end);
+
+	// without full pages or without zero pages, everything has to be cleared
+	if (!lazy || (first >= last)) {
+		memset((void*) start, 0x00, end - start);
+		return;
+	}
+
+	memset((void*) start, 0x00, first - start);
+	memset((void*) last, 0x00, end - last);
+}
+
 static int init_tls(void)
 {
 	task_t* curr_task = per_core(current_task);
 
 	// do we have a thread local storage?
 	if (((size_t) &tls_end - (size_t) &tls_start) > 0) {
+		size_t tdata_size = (size_t) &tdata_end - (size_t) &tls_start;
 		char* tls_addr = NULL;
 		size_t fs;
 
 		curr_task->tls_addr = (size_t) &tls_start;
 		curr_task->tls_size = (size_t) &tls_end - (size_t) &tls_start;
 
-		tls_addr = kmalloc(curr_task->tls_size + TLS_ALIGNSIZE + sizeof(size_t));
-		if (BUILTIN_EXPECT(!tls_addr, 0)) {
-			LOG_ERROR("load_task: heap is missing!\n");
-			return -ENOMEM;
+		if (curr_task->tls_size >= TLS_LAZY_SIZE) {
+			const size_t sz = TLS_BLOCK_SIZE(curr_task->tls_size);
+			size_t top;
+			vma_t vma;
+
+			tls_addr = create_lazy_stack(sz);
+			if (BUILTIN_EXPECT(!tls_addr, 0)) {
+				LOG_ERROR("load_task: unable to map the TLS!\n");
+				return -ENOMEM;
+			}
+
+			// the self pointer lies in the top page, which is always mapped
+			top = (size_t) tls_addr + sz;
+			fs = ((top - sizeof(size_t) - curr_task->tls_size) & TSL_ALIGNMASK) + curr_task->tls_size;
+
+			memcpy((void*) (fs - curr_task->tls_size), (void*) curr_task->tls_addr, tdata_size);
+			tls_zero_bss(fs - curr_task->tls_size + tdata_size, fs,
+			             !vma_lookup((size_t) tls_addr, &vma) && (vma.flags & VMA_ANON));
+		} else {
+			tls_addr = kmalloc(curr_task->tls_size + TLS_ALIGNSIZE + sizeof(size_t));
+			if (BUILTIN_EXPECT(!tls_addr, 0)) {
+				LOG_ERROR("load_task: heap is missing!\n");
+				return -ENOMEM;
+			}
+
+			memset(tls_addr, 0x00, TLS_ALIGNSIZE);
+			fs = (size_t) TLS_FLOOR(tls_addr) + curr_task->tls_size;
+			memcpy((void*) TLS_FLOOR(tls_addr), (void*) curr_task->tls_addr, tdata_size);
+			tls_zero_bss(TLS_FLOOR(tls_addr) + tdata_size, fs, 0);
 		}
 
-		memset(tls_addr, 0x00, TLS_ALIGNSIZE);
-		memcpy((void*) TLS_FLOOR(tls_addr), (void*) curr_task->tls_addr, curr_task->tls_size);
-		fs = (size_t) TLS_FLOOR(tls_addr) + curr_task->tls_size;
 		*((size_t*)fs) = fs;
 
 		// set fs register to the TLS segment
 		set_tls(fs);
-		LOG_INFO("TLS of task %d on core %d starts at 0x%zx (size 0x%zx)\n", curr_task->id, CORE_ID, TLS_FLOOR(tls_addr), curr_task->tls_size);
+		LOG_INFO("TLS of task %d on core %d starts at 0x%zx (size 0x%zx)\n", curr_task->id, CORE_ID, fs - curr_task->tls_size, curr_task->tls_size);
 	} else set_tls(0); // no TLS => clear fs register
 
 	return 0;
@@ -93,10 +146,26 @@ void destroy_tls(void)
 	task_t* curr_task = per_core(current_task);
 
 	// do we need to release the TLS?
-	void* tls_addr = (void*)get_tls();
-	if (tls_addr) {
-		//LOG_INFO("Release TLS at %p\n", (char*)tls_addr - curr_task->tls_size);
-		kfree((char*)tls_addr - curr_task->tls_size - TLS_OFFSET);
+	size_t fs = get_tls();
+	if (!fs)
+		return;
+
+	if (curr_task->tls_size >= TLS_LAZY_SIZE) {
+		const size_t sz = TLS_BLOCK_SIZE(curr_task->tls_size);
+		const size_t top = PAGE_CEIL(fs + sizeof(size_t));
+		const size_t tbss = fs - curr_task->tls_size + ((size_t) &tdata_end - (size_t) &tls_start);
+		vma_t vma;
+
+		set_tls(0);
+
+		// the next user of the block finds zero pages again
+		if (!vma_lookup(top - sz, &vma) && (vma.flags & VMA_ANON) && (PAGE_CEIL(tbss) < PAGE_FLOOR(fs)))
+			page_trim(PAGE_CEIL(tbss), PAGE_FLOOR(fs));
+
+		destroy_stack((void*) (top - sz), sz);
+	} else {
+		//LOG_INFO("Release TLS at %p\n", (char*)fs - curr_task->tls_size);
+		kfree((char*)fs - curr_task->tls_size - TLS_OFFSET);
 	}
 }
 
@@ -142,6 +211,10 @@ size_t* get_current_stack(void)
 
 	set_tss(stptr, (size_t) curr_task->ist_addr + KERNEL_STACK_SIZE - 0x10);
 
+	// signals from the same core are delivered now instead of by an IPI
+	if (__atomic_load_n(&curr_task->signal_pending, __ATOMIC_RELAXED))
+		signal_switch_in(curr_task);
+
 	return curr_task->last_stack_pointer;
 }
 
@@ -160,7 +233,9 @@ int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t cor
 	LOG_INFO("Task %d uses memory region [%p - %p] as stack\n", task->id, task->stack, (char*) task->stack + DEFAULT_STACK_SIZE - 1);
 	LOG_INFO("Task %d uses memory region [%p - %p] as IST1\n", task->id, task->ist_addr, (char*) task->ist_addr + KERNEL_STACK_SIZE - 1);
 
+#ifndef LAZY_STACKS
 	memset(task->stack, 0xCD, DEFAULT_STACK_SIZE);
+#endif
 
 	/* The difference between setting up a task for SW-task-switching
 	 * and not for HW-task-switching is setting up a stack and not a TSS.
@@ -206,37 +281,112 @@ int create_default_frame(task_t* task, entry_point_t ep, void* arg, uint32_t cor
 	return 0;
 }
 
+size_t* create_fiber_frame(void* stack, size_t size, void (*entry)(void))
+{
+	// the ABI expects rsp+8 to be 16 byte aligned at the entry of a function
+	size_t* top = (size_t*) (((size_t) stack + size) & ~0xFULL);
+	size_t* frame = top - 9;
+
+	memset(frame, 0x00, 9 * sizeof(size_t));
+	// default values of MXCSR and of the x87 control word
+	frame[0] = 0x1F80ULL | (0x037FULL << 32);
+	// return address of fiber_switch(), frame[8] is a pseudo return address of entry
+	frame[7] = (size_t) entry;
+
+	return frame;
+}
+
 #define USE_MWAIT
 
+/// set while a core sleeps in hlt and needs an IPI to notice new work
+static struct {
+	volatile uint32_t halted;
+} __attribute__ ((aligned (CACHE_LINE))) idle_state[MAX_CORES];
+
+static inline void halt_for_task(void)
+{
+	const uint32_t core_id = CORE_ID;
+
+	idle_state[core_id].halted = 1;
+	mb();
+
+	// a waker, which hasn't seen the flag, has enqueued its task before
+	if (is_task_available())
+		irq_enable();
+	else
+		asm volatile ("sti; hlt" ::: "memory");
+
+	idle_state[core_id].halted = 0;
+}
+
 void wait_for_task(void)
 {
+	int ret;
+
+	irq_disable();
+	if (is_task_available()) {
+		irq_enable();
+		return;
+	}
+
+	ret = steal_task();
+	if (!ret) {
+		irq_enable();
+		return;
+	}
+
+	// use the idle time to prepare zeroed huge pages for the page fault handler
+	irq_enable();
+	if (fill_zeroed_pool())
+		return;
 	irq_disable();
+
+	// a task could arrive while the pool was filled
 	if (is_task_available()) {
 		irq_enable();
 		return;
 	}
 
+#ifdef DYNAMIC_TICKS
+	// work stealing is enabled => look periodically for work on the other cores
+	if ((ret != -ENOSYS) && !timer_is_running())
+		timer_deadline(1);
+#endif
+
+	const uint64_t idle_start = get_rdtsc();
+
 #ifndef USE_MWAIT
-	asm volatile ("sti; hlt" ::: "memory");
+	halt_for_task();
 #else
 	if (!has_mwait()) {
-		asm volatile ("sti; hlt" ::: "memory");
+		halt_for_task();
 	} else {
 		void* queue = get_readyqueue();
 
 		if (has_clflush())
 			clflush(queue);
 
+		// the monitored cache line contains nr_tasks
+		// => wakeup_task() doesn't need to send an IPI
 		monitor(queue, 0, 0);
 
+		// a new task could arrive before the monitor was armed
+		if (is_task_available()) {
+			irq_enable();
+			return;
+		}
+
 		/*
 		 * NOTE: we use the ecx=0 => we
 		 * handle the IRQ and not just wake from it.
 		 */
-		asm volatile("sti; mwait" :: "a" (0x2) /* 0x2 = c3, 0xF = c0 */,
+		asm volatile("sti; mwait" :: "a" (mwait_hint) /* target C-state */,
 			"c" (0) /* break on interrupt flag */ : "memory");
 	}
 #endif
+
+	// the P-state governor derives the load from the idle time
+	pstate_account_idle(get_rdtsc() - idle_start);
 }
 
 void wakeup_core(uint32_t core_id)
@@ -251,10 +401,28 @@ void wakeup_core(uint32_t core_id)
 	if (core_id == CORE_ID)
 		return;
 
+	// the enqueued task has to be visible before the flag is read
+	mb();
+
+	// a polling core finds the new task without an IPI
+	if (!idle_state[core_id].halted)
+		return;
+
 	LOG_DEBUG("wakeup core %d\n", core_id);
 	apic_send_ipi(core_id, 121);
 }
 
+void reschedule_core(uint32_t core_id)
+{
+	// no self IPI required
+	if (core_id == CORE_ID)
+		return;
+
+	// the wakeup interrupt triggers always the scheduler
+	LOG_DEBUG("reschedule core %d\n", core_id);
+	apic_send_ipi(core_id, 121);
+}
+
 void reschedule(void)
 {
 	size_t** stack;
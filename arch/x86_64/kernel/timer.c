@@ -33,6 +33,7 @@
 #include <hermit/errno.h>
 #include <hermit/spinlock.h>
 #include <hermit/logging.h>
+#include <hermit/clocksource.h>
 #include <asm/irq.h>
 #include <asm/irqflags.h>
 #include <asm/io.h>
@@ -44,6 +45,7 @@
 DEFINE_PER_CORE(uint64_t, timer_ticks, 0);
 extern uint32_t cpu_freq;
 extern int32_t boot_processor;
+extern uint64_t boot_gtod;
 
 #ifdef DYNAMIC_TICKS
 DEFINE_PER_CORE(uint64_t, last_rdtsc, 0);
@@ -59,7 +61,7 @@ void check_ticks(void)
 	mb();
 
 	const uint64_t diff_cycles = curr_rdtsc - per_core(last_rdtsc);
-	const uint64_t cpu_freq_hz = 1000000ULL * (uint64_t) get_cpu_frequency();
+	const uint64_t cpu_freq_hz = clocksource_tsc_hz();
 	const uint64_t diff_ticks = (diff_cycles * (uint64_t) TIMER_FREQ) / cpu_freq_hz;
 
 	if (diff_ticks > 0) {
@@ -71,6 +73,10 @@ void check_ticks(void)
 
 uint64_t get_uptime(void)
 {
+	// avoid the division by the frequency
+	if (clocksource_get())
+		return clocksource_ns() / 1000000ULL;
+
 	if (!cpu_freq)
 		return 0;
 
@@ -181,6 +187,87 @@ static int pit_init(void)
 	return 0;
 }
 
+static inline uint32_t bcd_to_bin(uint8_t val)
+{
+	return (val & 0x0F) + (val >> 4) * 10;
+}
+
+/// days since 1970-01-01 of the given date in the proleptic Gregorian calendar
+static uint64_t days_since_epoch(uint32_t year, uint32_t month, uint32_t day)
+{
+	// shift the year to start in March, such that the leap day is the last one
+	if (month <= 2) {
+		year--;
+		month += 12;
+	}
+
+	return 365ULL*year + year/4 - year/100 + year/400 + (153*(month-3)+2)/5 + day - 1 - 719468ULL;
+}
+
+/// read the real-time clock of the CMOS in seconds since the epoch
+static uint64_t rtc_read(void)
+{
+	uint32_t sec, min, hour, day, month, year, century;
+	uint8_t status;
+	uint32_t i;
+
+	// wait until the clock isn't updated
+	for(i=0; (i<1000000) && (cmos_read(0x0A) & 0x80); i++)
+		PAUSE;
+
+	sec = cmos_read(0x00);
+	min = cmos_read(0x02);
+	hour = cmos_read(0x04);
+	day = cmos_read(0x07);
+	month = cmos_read(0x08);
+	year = cmos_read(0x09);
+	century = cmos_read(0x32);
+	status = cmos_read(0x0B);
+
+	// BCD mode?
+	if (!(status & 0x04)) {
+		sec = bcd_to_bin(sec);
+		min = bcd_to_bin(min);
+		hour = bcd_to_bin(hour & 0x7F) | (hour & 0x80);
+		day = bcd_to_bin(day);
+		month = bcd_to_bin(month);
+		year = bcd_to_bin(year);
+		century = bcd_to_bin(century);
+	}
+
+	// 12 hour mode?
+	if (!(status & 0x02) && (hour & 0x80))
+		hour = ((hour & 0x7F) + 12) % 24;
+
+	if ((century < 19) || (century > 99))
+		century = 20;
+	year += century * 100;
+
+	if (!day || !month || (month > 12))
+		return 0;
+
+	return ((days_since_epoch(year, month, day) * 24 + hour) * 60 + min) * 60 + sec;
+}
+
+uint64_t get_boot_time(void)
+{
+	// has the loader passed the time?
+	if (boot_gtod)
+		return boot_gtod;
+
+	// uhyve doesn't emulate the CMOS and the host owns it in a multi-kernel
+	if (!is_single_kernel() || is_uhyve())
+		return 0;
+
+	const uint64_t now = rtc_read();
+	if (!now)
+		return 0;
+
+	boot_gtod = now * 1000000ULL - get_uptime() * 1000ULL;
+
+	return boot_gtod;
+}
+
 int clock_init(void)
 {
 #ifdef DYNAMIC_TICKS
@@ -27,6 +27,7 @@
 
 #include <hermit/stddef.h>
 #include <hermit/stdlib.h>
+#include <hermit/slab.h>
 #include <hermit/stdio.h>
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
@@ -36,61 +37,113 @@
 #include <asm/atomic.h>
 #include <asm/page.h>
 
+/** @brief Free range of high bandwidth memory
+ *
+ * The list is sorted by the start address and adjacent ranges are merged.
+ */
 typedef struct free_list {
 	size_t start, end;
 	struct free_list* next;
 	struct free_list* prev;
 } free_list_t;
 
+/// object cache of the free list entries
+static kmem_cache_t free_list_cache = KMEM_CACHE_INIT("free_list", sizeof(free_list_t), NULL);
+
 extern size_t hbmem_base;
 extern size_t hbmem_size;
 
-static spinlock_t list_lock = SPINLOCK_INIT;
+static spinlock_irqsave_t list_lock = SPINLOCK_IRQSAVE_INIT;
 
 static free_list_t init_list = {0, 0, NULL, NULL};
-static free_list_t* free_start = &init_list;
+static free_list_t* free_start = NULL;
 
 extern atomic_int64_t total_pages;
 extern atomic_int64_t total_allocated_pages;
 extern atomic_int64_t total_available_pages;
 
-size_t hbmem_get_pages(size_t npages)
+/// free high bandwidth memory in pages
+static atomic_int64_t hbmem_available_pages = ATOMIC_INIT(0);
+
+/** @brief Remove a range from the free list
+ *
+ * Has to be called with list_lock.
+ */
+static void range_unlink(free_list_t* curr)
+{
+	if (curr->prev)
+		curr->prev->next = curr->next;
+	else
+		free_start = curr->next;
+	if (curr->next)
+		curr->next->prev = curr->prev;
+
+	if (curr != &init_list)
+		kmem_cache_free(&free_list_cache, curr);
+}
+
+size_t hbmem_get_aligned_pages(size_t npages, size_t align)
 {
-	size_t i, ret = 0;
-	free_list_t* curr = free_start;
+	const size_t size = npages * PAGE_SIZE;
+	free_list_t* curr;
+	free_list_t* tail;
+	size_t ret = 0;
 
 	if (BUILTIN_EXPECT(!npages, 0))
 		return 0;
-	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
+	if (BUILTIN_EXPECT(npages > atomic_int64_read(&hbmem_available_pages), 0))
 		return 0;
-
-	spinlock_lock(&list_lock);
-
-	while(curr) {
-		i = (curr->end - curr->start) / PAGE_SIZE;
-		if (i > npages) {
-			ret = curr->start;
-			curr->start += npages * PAGE_SIZE;
-			goto out;
-		} else if (i == npages) {
-			ret = curr->start;
-			if (curr->prev)
-				curr->prev = curr->next;
-			else
-				free_start = curr->next;
-			if (curr != &init_list)
-				kfree(curr);
-			goto out;
+	if (align < PAGE_SIZE)
+		align = PAGE_SIZE;
+
+	// allocate the node in advance, a split in the middle requires it
+	tail = kmem_cache_alloc(&free_list_cache);
+
+	spinlock_irqsave_lock(&list_lock);
+
+	for(curr=free_start; curr; curr=curr->next) {
+		size_t start = (curr->start + align - 1) & ~(align - 1);
+
+		if ((start < curr->start) || (start + size > curr->end))
+			continue;
+
+		ret = start;
+		if ((start > curr->start) && (start + size < curr->end)) {
+			// split the range, the node is required
+			if (BUILTIN_EXPECT(!tail, 0)) {
+				ret = 0;
+				continue;
+			}
+
+			tail->start = start + size;
+			tail->end = curr->end;
+			tail->prev = curr;
+			tail->next = curr->next;
+			if (curr->next)
+				curr->next->prev = tail;
+			curr->next = tail;
+			curr->end = start;
+			tail = NULL;
+		} else if (start > curr->start) {
+			curr->end = start;
+		} else if (start + size < curr->end) {
+			curr->start += size;
+		} else {
+			range_unlink(curr);
 		}
 
-		curr = curr->next;
+		break;
 	}
-out:
-	LOG_DEBUG("get_pages: ret 0%llx, curr->start 0x%llx, curr->end 0x%llx\n", ret, curr->start, curr->end);
 
-	spinlock_unlock(&list_lock);
+	LOG_DEBUG("hbmem_get_pages: ret 0x%zx, npages %zd\n", ret, npages);
+
+	spinlock_irqsave_unlock(&list_lock);
+
+	if (tail)
+		kmem_cache_free(&free_list_cache, tail);
 
 	if (ret) {
+		atomic_int64_sub(&hbmem_available_pages, npages);
 		atomic_int64_add(&total_allocated_pages, npages);
 		atomic_int64_sub(&total_available_pages, npages);
 	}
@@ -98,60 +151,135 @@ out:
 	return ret;
 }
 
-/* TODO: reunion of elements is still missing */
+size_t hbmem_get_pages(size_t npages)
+{
+	return hbmem_get_aligned_pages(npages, PAGE_SIZE);
+}
+
+size_t hbmem_get_huge_page(void)
+{
+	return hbmem_get_aligned_pages(HUGE_PAGE_SIZE/PAGE_SIZE, HUGE_PAGE_SIZE);
+}
+
 int hbmem_put_pages(size_t phyaddr, size_t npages)
 {
-	free_list_t* curr = free_start;
+	const size_t end = phyaddr + npages * PAGE_SIZE;
+	free_list_t* curr;
+	free_list_t* prev = NULL;
+	free_list_t* n;
 
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -EINVAL;
 	if (BUILTIN_EXPECT(!npages, 0))
 		return -EINVAL;
+	if (BUILTIN_EXPECT(!is_hbmem_addr(phyaddr), 0))
+		return -EINVAL;
 
-	spinlock_lock(&list_lock);
-
-	while(curr) {
-		if (phyaddr+npages*PAGE_SIZE == curr->start) {
-			curr->start = phyaddr;
-			goto out;
-		} else if (phyaddr == curr->end) {
-			curr->end += npages*PAGE_SIZE;
-			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
-
-			if (BUILTIN_EXPECT(!n, 0))
-				goto out_err;
-
-			/* add new element */
-			n->start = phyaddr;
-			n->end = phyaddr + npages * PAGE_SIZE;
-			n->prev = curr;
-			n->next = curr->next;
-			curr->next = n;
-		}
+	// allocate the node in advance, freeing in a gap requires it
+	n = kmem_cache_alloc(&free_list_cache);
+
+	spinlock_irqsave_lock(&list_lock);
+
+	// determine the neighbours of the released range
+	for(curr=free_start; curr && (curr->start < phyaddr); curr=curr->next)
+		prev = curr;
 
-		curr = curr->next;
+	if (BUILTIN_EXPECT((prev && (prev->end > phyaddr)) || (curr && (curr->start < end)), 0)) {
+		LOG_ERROR("hbmem_put_pages: range 0x%zx - 0x%zx is already free\n", phyaddr, end);
+		goto out_err;
 	}
-out:
-	spinlock_unlock(&list_lock);
 
+	if (prev && (prev->end == phyaddr)) {
+		prev->end = end;
+
+		// the released range closes the gap to the next range
+		if (curr && (curr->start == end)) {
+			prev->end = curr->end;
+			range_unlink(curr);
+		}
+	} else if (curr && (curr->start == end)) {
+		curr->start = phyaddr;
+	} else {
+		if (BUILTIN_EXPECT(!n, 0))
+			goto out_err;
+
+		n->start = phyaddr;
+		n->end = end;
+		n->prev = prev;
+		n->next = curr;
+		if (curr)
+			curr->prev = n;
+		if (prev)
+			prev->next = n;
+		else
+			free_start = n;
+		n = NULL;
+	}
+
+	spinlock_irqsave_unlock(&list_lock);
+
+	if (n)
+		kmem_cache_free(&free_list_cache, n);
+
+	atomic_int64_add(&hbmem_available_pages, npages);
 	atomic_int64_sub(&total_allocated_pages, npages);
 	atomic_int64_add(&total_available_pages, npages);
 
 	return 0;
 
 out_err:
-	spinlock_unlock(&list_lock);
+	spinlock_irqsave_unlock(&list_lock);
+
+	if (n)
+		kmem_cache_free(&free_list_cache, n);
 
 	return -ENOMEM;
 }
 
+size_t hbmem_available(void)
+{
+	return atomic_int64_read(&hbmem_available_pages) * PAGE_SIZE;
+}
+
 int is_hbmem_available(void)
 {
 	return (hbmem_base != 0);
 }
 
+int is_hbmem_addr(size_t phyaddr)
+{
+	return hbmem_base && (phyaddr >= hbmem_base) && (phyaddr < hbmem_base + hbmem_size);
+}
+
+int hbmem_hotadd(size_t start, size_t size)
+{
+	if (BUILTIN_EXPECT(!start || !size || (start & ~PAGE_MASK) || (size & ~PAGE_MASK), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(start + size < start, 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&list_lock);
+	if (!hbmem_base) {
+		hbmem_size = size;
+		hbmem_base = start;
+	} else if (start == hbmem_base + hbmem_size) {
+		// the pool covers a single range => it can only grow at the end
+		hbmem_size += size;
+	} else {
+		spinlock_irqsave_unlock(&list_lock);
+		return (start < hbmem_base + hbmem_size) ? -EEXIST : -EINVAL;
+	}
+	spinlock_irqsave_unlock(&list_lock);
+
+	// the range is accounted as allocated and released into the free list
+	atomic_int64_add(&total_pages, size >> PAGE_BITS);
+	atomic_int64_add(&total_allocated_pages, size >> PAGE_BITS);
+
+	LOG_INFO("Hot-add hbmem 0x%zx - 0x%zx\n", start, start + size);
+
+	return hbmem_put_pages(start, size >> PAGE_BITS);
+}
+
 int hbmemory_init(void)
 {
 	if (!hbmem_base)
@@ -160,10 +288,12 @@ int hbmemory_init(void)
 	// determine available memory
 	atomic_int64_add(&total_pages, hbmem_size >> PAGE_BITS);
 	atomic_int64_add(&total_available_pages, hbmem_size >> PAGE_BITS);
+	atomic_int64_set(&hbmem_available_pages, hbmem_size >> PAGE_BITS);
 
 	//initialize free list
 	init_list.start = hbmem_base;
 	init_list.end = hbmem_base + hbmem_size;
+	free_start = &init_list;
 
 	LOG_INFO("free list for hbmem starts at 0x%zx, limit 0x%zx\n", init_list.start, init_list.end);
 
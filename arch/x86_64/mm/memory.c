@@ -27,15 +27,20 @@
 
 #include <hermit/stddef.h>
 #include <hermit/stdlib.h>
+#include <hermit/slab.h>
 #include <hermit/stdio.h>
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/boottime.h>
 
 #include <asm/atomic.h>
 #include <asm/page.h>
 #include <asm/multiboot.h>
+#include <asm/numa.h>
+#include <asm/irq.h>
+#include <asm/uhyve.h>
 
 #define GAP_BELOW	0x100000ULL
 #define IB_POOL_SIZE 0x400000ULL
@@ -46,12 +51,47 @@
 extern uint64_t base;
 extern uint64_t limit;
 
+/// largest block order of the page allocator (2^20 pages = 4 GiB)
+#define MAX_ORDER		20
+/// order of a 2 MiB block
+#define HUGE_ORDER		(HUGE_PAGE_BITS - PAGE_BITS)
+/// number of buckets to find the buddy of a free block
+#define BLOCK_HASH_BITS		10
+#define BLOCK_HASH_SIZE		(1 << BLOCK_HASH_BITS)
+
+/*
+ * Each allocation or release of the buddy allocator consumes at most
+ * 2 * (MAX_ORDER + 1) descriptors. The reserve is refilled outside of the
+ * list lock, because the object cache may request new pages on its own.
+ */
+#define NODE_LOW		(3 * (MAX_ORDER + 1))
+#define NODE_HIGH		(5 * (MAX_ORDER + 1))
+
+/*
+ * Descriptor of a free block. The first four members are shared with the
+ * uhyve freelist interface: all free blocks are chained by next / prev and
+ * each describes the address range [start, end).
+ */
 typedef struct free_list {
 	size_t start, end;
 	struct free_list* next;
 	struct free_list* prev;
+	/// neighbours in the list of blocks with the same order
+	struct free_list* order_next;
+	struct free_list* order_prev;
+	/// next block in the same hash bucket
+	struct free_list* hash_next;
+	/// size of the block is 2^order pages
+	uint32_t order;
+	/// NUMA node of the block
+	uint16_t node;
+	/// the block has still to be split at the node boundaries
+	uint16_t pending;
 } free_list_t;
 
+/// object cache of the free list entries
+static kmem_cache_t free_list_cache = KMEM_CACHE_INIT("free_list", sizeof(free_list_t), NULL);
+
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
  * maintaining a value, rather their address is their value.
@@ -63,73 +103,421 @@ extern const void kernel_start;
 
 static spinlock_irqsave_t list_lock = SPINLOCK_IRQSAVE_INIT;
 
-static free_list_t init_list = {0, 0, NULL, NULL};
-static free_list_t* free_start = &init_list;
+/// end of the physical memory, which the boot info or an earlier hot-add has reported
+static size_t mem_end = 0;
+
+/// all free blocks, exported by get_free_list()
+static free_list_t* free_start = NULL;
+/// free blocks per node and order
+static free_list_t* free_area[MAX_NUMA_NODES][MAX_ORDER+1] = {[0 ... MAX_NUMA_NODES-1] = {[0 ... MAX_ORDER] = NULL}};
+/// free blocks hashed by their start address
+static free_list_t* block_hash[BLOCK_HASH_SIZE] = {[0 ... BLOCK_HASH_SIZE-1] = NULL};
+
+/// descriptors, which are used before the object cache is usable
+static free_list_t boot_nodes[NODE_HIGH];
+static free_list_t* boot_reserve = NULL;
+/// descriptors from the object cache
+static free_list_t* node_reserve = NULL;
+static uint32_t nr_reserve = 0;
+static uint8_t refilling = 0;
 
 atomic_int64_t total_pages = ATOMIC_INIT(0);
 atomic_int64_t total_allocated_pages = ATOMIC_INIT(0);
 atomic_int64_t total_available_pages = ATOMIC_INIT(0);
 
+/// share of each NUMA node in total_allocated_pages and total_available_pages
+atomic_int64_t node_allocated_pages[MAX_NUMA_NODES] = {[0 ... MAX_NUMA_NODES-1] = ATOMIC_INIT(0)};
+atomic_int64_t node_available_pages[MAX_NUMA_NODES] = {[0 ... MAX_NUMA_NODES-1] = ATOMIC_INIT(0)};
+
+static inline void account_alloc(size_t phyaddr, size_t npages)
+{
+	const uint32_t node = numa_phys_node(phyaddr);
+
+	atomic_int64_add(&total_allocated_pages, npages);
+	atomic_int64_sub(&total_available_pages, npages);
+	atomic_int64_add(&node_allocated_pages[node], npages);
+	atomic_int64_sub(&node_available_pages[node], npages);
+}
+
+static inline void account_free(size_t phyaddr, size_t npages)
+{
+	const uint32_t node = numa_phys_node(phyaddr);
+
+	atomic_int64_sub(&total_allocated_pages, npages);
+	atomic_int64_add(&total_available_pages, npages);
+	atomic_int64_sub(&node_allocated_pages[node], npages);
+	atomic_int64_add(&node_available_pages[node], npages);
+}
+
+static inline uint32_t block_hash_index(size_t start)
+{
+	return ((start >> PAGE_BITS) * 0x9E3779B97F4A7C15ULL) >> (64 - BLOCK_HASH_BITS);
+}
+
+static inline int is_boot_node(free_list_t* n)
+{
+	return (n >= boot_nodes) && (n < boot_nodes + NODE_HIGH);
+}
+
+static void node_put(free_list_t* n)
+{
+	if (is_boot_node(n)) {
+		n->next = boot_reserve;
+		boot_reserve = n;
+	} else {
+		n->next = node_reserve;
+		node_reserve = n;
+		nr_reserve++;
+	}
+}
+
+static free_list_t* node_get(void)
+{
+	free_list_t* n = node_reserve;
+
+	if (n) {
+		node_reserve = n->next;
+		nr_reserve--;
+	} else if ((n = boot_reserve) != NULL) {
+		boot_reserve = n->next;
+	}
+
+	return n;
+}
+
+/*
+ * Tops up the descriptor reserve. Has to be called with list_lock held and
+ * before the free lists are inspected, because the lock is dropped while the
+ * object cache is called.
+ */
+static void node_refill(void)
+{
+	if (refilling || (nr_reserve >= NODE_LOW))
+		return;
+
+	refilling = 1;
+	while (nr_reserve < NODE_HIGH) {
+		spinlock_irqsave_unlock(&list_lock);
+		free_list_t* n = kmem_cache_alloc(&free_list_cache);
+		spinlock_irqsave_lock(&list_lock);
+
+		if (BUILTIN_EXPECT(!n, 0))
+			break;
+
+		n->next = node_reserve;
+		node_reserve = n;
+		nr_reserve++;
+	}
+	refilling = 0;
+}
+
+/*
+ * Detaches the descriptors above the high watermark. They are returned to
+ * the object cache by node_release() after list_lock is dropped, because
+ * kmem_cache_free() may end up in put_pages().
+ */
+static free_list_t* node_trim(void)
+{
+	free_list_t* excess = NULL;
+
+	while (nr_reserve > NODE_HIGH) {
+		free_list_t* n = node_reserve;
+
+		node_reserve = n->next;
+		nr_reserve--;
+		n->next = excess;
+		excess = n;
+	}
+
+	return excess;
+}
+
+static void node_release(free_list_t* n)
+{
+	while (n) {
+		free_list_t* next = n->next;
+
+		kmem_cache_free(&free_list_cache, n);
+		n = next;
+	}
+}
+
+static free_list_t* block_insert(size_t start, uint32_t order)
+{
+	free_list_t* n = node_get();
+	uint32_t idx = block_hash_index(start);
+	uint32_t node = numa_phys_node(start);
+
+	if (BUILTIN_EXPECT(!n, 0)) {
+		LOG_ERROR("Page allocator runs out of descriptors, lose 0x%zx - 0x%zx\n",
+			start, start + (PAGE_SIZE << order));
+		return NULL;
+	}
+
+	n->start = start;
+	n->end = start + (PAGE_SIZE << order);
+	n->order = order;
+	n->node = node;
+	n->pending = 0;
+
+	n->prev = NULL;
+	n->next = free_start;
+	if (free_start)
+		free_start->prev = n;
+	free_start = n;
+
+	n->order_prev = NULL;
+	n->order_next = free_area[node][order];
+	if (free_area[node][order])
+		free_area[node][order]->order_prev = n;
+	free_area[node][order] = n;
+
+	n->hash_next = block_hash[idx];
+	block_hash[idx] = n;
+
+	return n;
+}
+
+static void block_remove(free_list_t* n)
+{
+	free_list_t** p = &block_hash[block_hash_index(n->start)];
+
+	if (n->prev)
+		n->prev->next = n->next;
+	else
+		free_start = n->next;
+	if (n->next)
+		n->next->prev = n->prev;
+
+	if (n->order_prev)
+		n->order_prev->order_next = n->order_next;
+	else
+		free_area[n->node][n->order] = n->order_next;
+	if (n->order_next)
+		n->order_next->order_prev = n->order_prev;
+
+	while (*p != n)
+		p = &(*p)->hash_next;
+	*p = n->hash_next;
+}
+
+static free_list_t* block_lookup(size_t start)
+{
+	free_list_t* n = block_hash[block_hash_index(start)];
+
+	while (n && (n->start != start))
+		n = n->hash_next;
+
+	return n;
+}
+
+/// release a naturally aligned block and merge it with its free buddies of the same node
+static void block_free(size_t start, uint32_t order)
+{
+	const uint32_t node = numa_phys_node(start);
+
+	while (order < MAX_ORDER) {
+		free_list_t* buddy = block_lookup(start ^ (PAGE_SIZE << order));
+
+		if (!buddy || (buddy->order != order) || (buddy->node != node) || buddy->pending)
+			break;
+
+		block_remove(buddy);
+		node_put(buddy);
+		start &= ~(PAGE_SIZE << order);
+		order++;
+	}
+
+	block_insert(start, order);
+}
+
+/*
+ * Releases an arbitrary page range by splitting it into maximal aligned
+ * blocks. A block never crosses the boundary of a NUMA node.
+ */
+static void range_free(size_t start, size_t end)
+{
+	while (start < end) {
+		size_t limit = numa_phys_limit(start);
+		uint32_t order = 0;
+
+		if (limit > end)
+			limit = end;
+
+		while ((order < MAX_ORDER)
+			&& !(start & ((PAGE_SIZE << (order+1)) - 1))
+			&& (start + (PAGE_SIZE << (order+1)) <= limit))
+			order++;
+
+		block_free(start, order);
+		start += PAGE_SIZE << order;
+	}
+}
+
+/// allocate a block of 2^order pages, preferably from the given NUMA node
+static size_t block_alloc(uint32_t node, uint32_t order)
+{
+	const uint32_t nodes = numa_nodes();
+	uint32_t i = order, k;
+	uint16_t pending;
+	free_list_t* n;
+	size_t ret;
+
+	for(k=0; k<nodes; k++) {
+		node = (node + (k ? 1 : 0)) % nodes;
+		for(i=order; (i <= MAX_ORDER) && !free_area[node][i]; i++)
+			;
+		if (i <= MAX_ORDER)
+			break;
+	}
+	if (k >= nodes)
+		return 0;
+
+	n = free_area[node][i];
+	ret = n->start;
+	pending = n->pending;
+	block_remove(n);
+	node_put(n);
+
+	// split the block and put the upper halves back
+	while (i > order) {
+		i--;
+		n = block_insert(ret + (PAGE_SIZE << i), i);
+		if (n)
+			n->pending = pending;
+	}
+
+	return ret;
+}
+
+#if PAGE_CACHE_DEPTH > 0
+#define PAGE_CACHE_BATCH	((PAGE_CACHE_DEPTH + 1) / 2)
+/// huge pages are cached in smaller numbers to limit the hoarded memory
+#define HUGE_CACHE_DEPTH	4
+#define HUGE_CACHE_BATCH	2
+
+typedef struct page_cache {
+	/// physical addresses of the cached blocks
+	size_t addr[PAGE_CACHE_DEPTH+1];
+	/// number of cached blocks
+	uint32_t nr;
+} __attribute__ ((aligned (CACHE_LINE))) page_cache_t;
+
+/// per-core caches of single pages [0] and huge pages [1]
+static page_cache_t page_cache[MAX_CORES][2];
+
+/*
+ * Takes a block of 2^order pages from the cache of the current core.
+ * An empty cache is refilled by a batch of blocks, which are allocated with
+ * a single acquisition of list_lock.
+ */
+static size_t page_cache_get(uint32_t order)
+{
+	page_cache_t* cache;
+	free_list_t* excess = NULL;
+	uint32_t i, depth, batch;
+	size_t ret = 0;
+	uint8_t flags;
+
+	depth = order ? HUGE_CACHE_DEPTH : PAGE_CACHE_DEPTH;
+	batch = order ? HUGE_CACHE_BATCH : PAGE_CACHE_BATCH;
+
+	flags = irq_nested_disable();
+	cache = &page_cache[CORE_ID][!!order];
+
+	if (!cache->nr) {
+		spinlock_irqsave_lock(&list_lock);
+		// node_refill() may reenter the cache => recheck the bounds
+		node_refill();
+		for(i=0; (i<batch) && (cache->nr < depth); i++) {
+			size_t addr = block_alloc(numa_node(), order);
+			if (BUILTIN_EXPECT(!addr, 0))
+				break;
+			cache->addr[cache->nr++] = addr;
+		}
+		excess = node_trim();
+		spinlock_irqsave_unlock(&list_lock);
+	}
+
+	if (cache->nr)
+		ret = cache->addr[--cache->nr];
+	irq_nested_enable(flags);
+
+	node_release(excess);
+
+	return ret;
+}
+
+/*
+ * Puts a block of 2^order pages into the cache of the current core.
+ * A full cache returns a batch of blocks at once to the buddy allocator.
+ */
+static void page_cache_put(size_t phyaddr, uint32_t order)
+{
+	page_cache_t* cache;
+	free_list_t* excess = NULL;
+	uint32_t i, depth, batch;
+	uint8_t flags;
+
+	depth = order ? HUGE_CACHE_DEPTH : PAGE_CACHE_DEPTH;
+	batch = order ? HUGE_CACHE_BATCH : PAGE_CACHE_BATCH;
+
+	flags = irq_nested_disable();
+	cache = &page_cache[CORE_ID][!!order];
+	cache->addr[cache->nr++] = phyaddr;
+
+	if (cache->nr > depth) {
+		spinlock_irqsave_lock(&list_lock);
+		node_refill();
+		for(i=0; (i<batch) && cache->nr; i++) {
+			size_t addr = cache->addr[--cache->nr];
+			block_free(addr, order);
+		}
+		excess = node_trim();
+		spinlock_irqsave_unlock(&list_lock);
+	}
+	irq_nested_enable(flags);
+
+	node_release(excess);
+}
+#endif
+
 static size_t __get_pages(size_t npages, size_t align)
 {
-	size_t i, ret = 0;
-	free_list_t* curr = free_start;
+	free_list_t* excess;
+	size_t ret;
+	uint32_t order = 0;
 
 	if (BUILTIN_EXPECT(!npages, 0))
 		return 0;
 	if (BUILTIN_EXPECT(npages > atomic_int64_read(&total_available_pages), 0))
 		return 0;
 
+	// blocks are naturally aligned => the order covers size and alignment
+	while (((1UL << order) < npages) || ((PAGE_SIZE << order) < align))
+		order++;
+	if (BUILTIN_EXPECT(order > MAX_ORDER, 0))
+		return 0;
+
 	spinlock_irqsave_lock(&list_lock);
 
-	while(curr) {
-		i = (curr->end - curr->start) / PAGE_SIZE;
-		if (i > npages) {
-			if (!(curr->start & (align-1)))	 {
-				ret = curr->start;
-				curr->start += npages * PAGE_SIZE;
-				goto out;
-			} else {
-				size_t tmp = HUGE_PAGE_CEIL(curr->start);
-				if (tmp < curr->end) {
-					// Ok, we have to split the list
-					free_list_t* n = kmalloc(sizeof(free_list_t));
-					if (n) {
-						n->start = tmp;
-						n->end = curr->end;
-						curr->end = n->start;
-						n->prev = curr;
-						n->next = curr->next;
-						curr->next = n;
-					}
-				}
-			}
-		} else if ((i == npages) && !(curr->start & (align-1))) {
-			ret = curr->start;
-			if (curr->prev) {
-				if (curr->next)
-					curr->next->prev = curr->prev;
-				curr->prev->next = curr->next;
-			} else {
-				free_start = curr->next;
-				free_start->prev = NULL;
-			}
-			if (curr != &init_list)
-				kfree(curr);
-			goto out;
-		}
+	node_refill();
 
-		curr = curr->next;
-	}
-out:
-	LOG_DEBUG("get_pages: ret 0%llx, curr->start 0x%llx, curr->end 0x%llx\n", ret, curr->start, curr->end);
+	ret = block_alloc(numa_node(), order);
+	// give the unused tail back
+	if (ret && ((1UL << order) > npages))
+		range_free(ret + npages * PAGE_SIZE, ret + (PAGE_SIZE << order));
+
+	excess = node_trim();
+
+	LOG_DEBUG("get_pages: ret 0x%zx, npages %zd, order %u\n", ret, npages, order);
 
 	spinlock_irqsave_unlock(&list_lock);
 
-	if (ret) {
-		atomic_int64_add(&total_allocated_pages, npages);
-		atomic_int64_sub(&total_available_pages, npages);
-	}
+	node_release(excess);
+
+	if (ret)
+		account_alloc(ret, npages);
 
 	return ret;
 }
@@ -141,12 +529,37 @@ free_list_t *get_free_list(void)
 
 size_t get_pages(size_t npages)
 {
+#if PAGE_CACHE_DEPTH > 0
+	if (npages == 1) {
+		size_t ret = page_cache_get(0);
+
+		if (ret)
+			account_alloc(ret, 1);
+
+		return ret;
+	}
+#endif
+
 	return __get_pages(npages, PAGE_SIZE);
 }
 
 size_t get_huge_page(void)
 {
-	return __get_pages(HUGE_PAGE_SIZE/PAGE_SIZE, HUGE_PAGE_SIZE);
+#if PAGE_CACHE_DEPTH > 0
+	size_t ret = page_cache_get(HUGE_ORDER);
+
+	if (ret)
+		account_alloc(ret, 1UL << HUGE_ORDER);
+
+	return ret;
+#else
+	return __get_pages(1UL << HUGE_ORDER, HUGE_PAGE_SIZE);
+#endif
+}
+
+size_t get_1g_page(void)
+{
+	return __get_pages(PAGE_1G_SIZE/PAGE_SIZE, PAGE_1G_SIZE);
 }
 
 DEFINE_PER_CORE(size_t, ztmp_addr, 0);
@@ -177,7 +590,7 @@ size_t get_zeroed_page(void)
 	uint8_t flags = irq_nested_disable();
 
 	size_t viraddr = get_ztmp_addr();
-	if (!viraddr) {
+	if (viraddr) {
 		__page_map(viraddr, phyaddr, 1, PG_GLOBAL|PG_RW|PG_PRESENT, 0);
 
 		memset((void*) viraddr, 0x00, PAGE_SIZE);
@@ -188,75 +601,255 @@ size_t get_zeroed_page(void)
 	return phyaddr;
 }
 
+/// returns a 2 MiB aligned virtual window, which is able to map a huge page
+static size_t alloc_huge_window(void)
+{
+	size_t viraddr = vma_alloc(2*HUGE_PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return 0;
+
+	return HUGE_PAGE_CEIL(viraddr);
+}
+
+/*
+ * Maps the huge page into the window of the current core and clears it by
+ * non-temporal stores, which don't evict the working set from the caches.
+ */
+static void zero_huge_page(size_t viraddr, size_t phyaddr)
+{
+	size_t i;
+
+	__page_map(viraddr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, PG_GLOBAL|PG_RW|PG_PRESENT, 0);
+
+	for(i=0; i<HUGE_PAGE_SIZE; i+=4*sizeof(size_t)) {
+		asm volatile ("movnti %1, 0(%0); movnti %1, 8(%0); movnti %1, 16(%0); movnti %1, 24(%0)"
+			:: "r" (viraddr+i), "r" (0UL) : "memory");
+	}
+	asm volatile ("sfence" ::: "memory");
+}
+
+/// window of the page fault path, only used with disabled interrupts
+DEFINE_PER_CORE(size_t, zhuge_addr, 0);
+
+#if ZEROED_POOL_SIZE > 0
+static spinlock_irqsave_t zeroed_lock = SPINLOCK_IRQSAVE_INIT;
+/// zeroed pages per NUMA node, an idle core fills the pool of its own node
+static size_t zeroed_pool[MAX_NUMA_NODES][ZEROED_POOL_SIZE];
+/// number of zeroed pages in the pool
+static uint32_t nr_zeroed[MAX_NUMA_NODES] = {[0 ... MAX_NUMA_NODES-1] = 0};
+/// number of pages, which are currently zeroed by idle cores
+static uint32_t nr_zeroing[MAX_NUMA_NODES] = {[0 ... MAX_NUMA_NODES-1] = 0};
+/// the pool is filled after the first request for a zeroed huge page
+static volatile uint8_t zeroed_demand = 0;
+
+/// window of the idle task, which is never migrated to another core
+DEFINE_PER_CORE(size_t, zidle_addr, 0);
+
+int fill_zeroed_pool(void)
+{
+	// the idle task is never migrated => the node is stable
+	const uint32_t node = numa_node();
+	size_t viraddr, phyaddr;
+
+	if (!zeroed_demand)
+		return 0;
+
+	spinlock_irqsave_lock(&zeroed_lock);
+	if (nr_zeroed[node] + nr_zeroing[node] >= ZEROED_POOL_SIZE) {
+		spinlock_irqsave_unlock(&zeroed_lock);
+		return 0;
+	}
+	nr_zeroing[node]++;
+	spinlock_irqsave_unlock(&zeroed_lock);
+
+	viraddr = per_core(zidle_addr);
+	if (!viraddr) {
+		viraddr = alloc_huge_window();
+		set_per_core(zidle_addr, viraddr);
+	}
+
+	phyaddr = viraddr ? get_huge_page() : 0;
+	if (phyaddr)
+		zero_huge_page(viraddr, phyaddr);
+
+	spinlock_irqsave_lock(&zeroed_lock);
+	nr_zeroing[node]--;
+	if (phyaddr)
+		zeroed_pool[node][nr_zeroed[node]++] = phyaddr;
+	spinlock_irqsave_unlock(&zeroed_lock);
+
+	return phyaddr ? 1 : 0;
+}
+
+static size_t zeroed_pool_get(void)
+{
+	size_t phyaddr = 0;
+	uint32_t node;
+
+	zeroed_demand = 1;
+
+	spinlock_irqsave_lock(&zeroed_lock);
+	node = numa_node();
+	if (nr_zeroed[node])
+		phyaddr = zeroed_pool[node][--nr_zeroed[node]];
+	spinlock_irqsave_unlock(&zeroed_lock);
+
+	return phyaddr;
+}
+#else
+int fill_zeroed_pool(void)
+{
+	return 0;
+}
+#endif
+
 size_t get_zeroed_huge_page(void)
 {
-	size_t phyaddr = get_huge_page();
+	size_t phyaddr, viraddr;
+	uint8_t flags;
+
+#if ZEROED_POOL_SIZE > 0
+	phyaddr = zeroed_pool_get();
+	if (phyaddr)
+		return phyaddr;
+#endif
 
+	phyaddr = get_huge_page();
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return 0;
 
-	uint8_t flags = irq_nested_disable();
+	flags = irq_nested_disable();
 
-	size_t viraddr = get_ztmp_addr();
-	if (!viraddr) {
-		for(uint32_t i=0; i<HUGE_PAGE_SIZE/PAGE_SIZE; i++) {
-			__page_map(viraddr, phyaddr+i*PAGE_SIZE, 1, PG_GLOBAL|PG_RW|PG_PRESENT, 0);
-			memset((void*) viraddr, 0x00, PAGE_SIZE);
-		}
+	viraddr = per_core(zhuge_addr);
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		viraddr = alloc_huge_window();
+		set_per_core(zhuge_addr, viraddr);
 	}
 
+	if (viraddr)
+		zero_huge_page(viraddr, phyaddr);
+
 	irq_nested_enable(flags);
 
+	if (BUILTIN_EXPECT(!viraddr, 0)) {
+		put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+		return 0;
+	}
+
 	return phyaddr;
 }
 
-/* TODO: reunion of elements is still missing */
 int put_pages(size_t phyaddr, size_t npages)
 {
-	free_list_t* curr = free_start;
+	free_list_t* excess;
 
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -EINVAL;
 	if (BUILTIN_EXPECT(!npages, 0))
 		return -EINVAL;
 
-	spinlock_irqsave_lock(&list_lock);
+	// frames of the high bandwidth memory have their own free list
+	if (is_hbmem_addr(phyaddr))
+		return hbmem_put_pages(phyaddr, npages);
 
-	while(curr) {
-		if (phyaddr+npages*PAGE_SIZE == curr->start) {
-			curr->start = phyaddr;
-			goto out;
-		} else if (phyaddr == curr->end) {
-			curr->end += npages*PAGE_SIZE;
-			goto out;
-		} if (phyaddr > curr->end) {
-			free_list_t* n = kmalloc(sizeof(free_list_t));
-
-			if (BUILTIN_EXPECT(!n, 0))
-				goto out_err;
-
-			/* add new element */
-			n->start = phyaddr;
-			n->end = phyaddr + npages * PAGE_SIZE;
-			n->prev = curr;
-			n->next = curr->next;
-			curr->next = n;
-		}
+#if PAGE_CACHE_DEPTH > 0
+	// the caches hold only frames of the local node
+	if (((npages == 1) || ((npages == (1UL << HUGE_ORDER)) && !(phyaddr & (HUGE_PAGE_SIZE-1))))
+	    && (numa_phys_node(phyaddr) == numa_node())) {
+		page_cache_put(phyaddr, (npages == 1) ? 0 : HUGE_ORDER);
 
-		curr = curr->next;
+		account_free(phyaddr, npages);
+
+		return 0;
 	}
-out:
+#endif
+
+	spinlock_irqsave_lock(&list_lock);
+
+	node_refill();
+	range_free(phyaddr, phyaddr + npages * PAGE_SIZE);
+	excess = node_trim();
+
 	spinlock_irqsave_unlock(&list_lock);
 
-	atomic_int64_sub(&total_allocated_pages, npages);
-	atomic_int64_add(&total_available_pages, npages);
+	node_release(excess);
+
+	account_free(phyaddr, npages);
 
 	return 0;
+}
+
+/// add a free region during initialization, the counters are already set
+static void add_region(size_t start, size_t end, int refill)
+{
+	LOG_INFO("Add region 0x%zx - 0x%zx\n", start, end);
+
+	spinlock_irqsave_lock(&list_lock);
+
+	if (refill)
+		node_refill();
+	range_free(start, end);
+
+	spinlock_irqsave_unlock(&list_lock);
+}
+
+/*
+ * Moves the free blocks, which the boot code has added to node 0, to the
+ * lists of their NUMA nodes and initializes the statistics of the nodes.
+ * Blocks, which cross a node boundary, are split. The descriptor reserve
+ * is refilled between two blocks, which may allocate pages => the
+ * remaining blocks are marked as pending.
+ */
+static void numa_redistribute(void)
+{
+	free_list_t* excess;
+	free_list_t* n;
+	size_t start, end, buddy_free = 0;
+	int64_t cached;
+	uint32_t i;
+
+	spinlock_irqsave_lock(&list_lock);
+
+	for(n=free_start; n && (numa_nodes() > 1); n=n->next)
+		n->pending = 1;
+
+	while (numa_nodes() > 1) {
+		node_refill();
+
+		for(n=free_start; n && !n->pending; n=n->next)
+			;
+		if (!n)
+			break;
+
+		start = n->start;
+		end = n->end;
+		block_remove(n);
+		node_put(n);
+		range_free(start, end);
+	}
+
+	// reset the statistics of the nodes
+	for(i=0; i<MAX_NUMA_NODES; i++) {
+		atomic_int64_set(&node_allocated_pages[i], 0);
+		atomic_int64_set(&node_available_pages[i], 0);
+	}
+	for(n=free_start; n; n=n->next) {
+		atomic_int64_add(&node_available_pages[n->node], 1L << n->order);
+		buddy_free += 1UL << n->order;
+	}
+
+	excess = node_trim();
 
-out_err:
 	spinlock_irqsave_unlock(&list_lock);
 
-	return -ENOMEM;
+	node_release(excess);
+
+	// earlier allocations and the page caches are accounted to node 0
+	cached = atomic_int64_read(&total_available_pages) - (int64_t) buddy_free
+		- (int64_t) (hbmem_available() >> PAGE_BITS);
+	atomic_int64_add(&node_available_pages[0], cached);
+	atomic_int64_set(&node_allocated_pages[0], atomic_int64_read(&total_allocated_pages)
+		- (int64_t) (has_hbmem() ? (get_hbmem_size() - hbmem_available()) >> PAGE_BITS : 0));
 }
 
 void* page_alloc(size_t sz, uint32_t flags)
@@ -292,7 +885,7 @@ void* page_alloc(size_t sz, uint32_t flags)
 		vma_free(viraddr, viraddr+npages*PAGE_SIZE);
 		put_pages(phyaddr, npages);
 		viraddr = 0;
-	}
+	} else mem_account(MEM_TAG_DRIVER, npages, 0);
 
 oom:
 	return (void*) viraddr;
@@ -309,16 +902,98 @@ void page_free(void* viraddr, size_t sz)
 
 	vma_free((size_t) viraddr, (size_t) viraddr + PAGE_CEIL(sz));
 
-	if (phyaddr)
+	if (phyaddr) {
 		put_pages(phyaddr, PAGE_CEIL(sz) >> PAGE_BITS);
+		mem_account(MEM_TAG_DRIVER, -(int64_t) (PAGE_CEIL(sz) >> PAGE_BITS), 0);
+	}
+}
+
+int memory_hotadd(size_t start, size_t size)
+{
+	const size_t end = start + size;
+	size_t addr;
+
+	if (BUILTIN_EXPECT(!size || (start & ~PAGE_MASK) || (size & ~PAGE_MASK), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(end < start, 0))
+		return -EINVAL;
+	// the range must not overlap the I/O gap or the high bandwidth memory
+	if (BUILTIN_EXPECT((start < IO_GAP_START+IO_GAP_SIZE) && (end > IO_GAP_START), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(has_hbmem() && (start < get_hbmem_base()+get_hbmem_size())
+	    && (end > get_hbmem_base()), 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&list_lock);
+	if (BUILTIN_EXPECT(start < mem_end, 0)) {
+		spinlock_irqsave_unlock(&list_lock);
+		return -EEXIST;
+	}
+	mem_end = end;
+	spinlock_irqsave_unlock(&list_lock);
+
+	atomic_int64_add(&total_pages, size >> PAGE_BITS);
+	atomic_int64_add(&total_available_pages, size >> PAGE_BITS);
+	for(addr=start; addr<end; ) {
+		size_t next = numa_phys_limit(addr);
+
+		if ((next <= addr) || (next > end))
+			next = end;
+		atomic_int64_add(&node_available_pages[numa_phys_node(addr)], (next-addr) >> PAGE_BITS);
+		addr = next;
+	}
+
+	add_region(start, end, 1);
+
+	LOG_INFO("Hot-added 0x%zx - 0x%zx, %zd pages in total\n", start, end,
+		(size_t) atomic_int64_read(&total_pages));
+
+	return 0;
+}
+
+#define UHYVE_IRQ_MEMHOTADD	10
+
+/*
+ * Request of uhyve to add physical memory. The kernel answers with the
+ * result of the previous range and uhyve sends the next one, until the
+ * size is zero.
+ */
+static struct {
+	uint64_t start;
+	uint64_t size;
+	uint32_t hbm;
+	int32_t ret;
+} __attribute__((packed)) memhotadd_req;
+
+static void uhyve_irq_memhotadd_handler(struct state* s)
+{
+	memhotadd_req.ret = 0;
+	memhotadd_req.size = 0;
+	uhyve_send(UHYVE_PORT_MEMHOTADD, (unsigned)virt_to_phys((size_t)&memhotadd_req));
+
+	while (memhotadd_req.size) {
+		if (memhotadd_req.hbm)
+			memhotadd_req.ret = hbmem_hotadd(memhotadd_req.start, memhotadd_req.size);
+		else
+			memhotadd_req.ret = memory_hotadd(memhotadd_req.start, memhotadd_req.size);
+		if (memhotadd_req.ret)
+			LOG_WARNING("Failed to add memory 0x%llx - 0x%llx: %d\n", memhotadd_req.start,
+				memhotadd_req.start + memhotadd_req.size, memhotadd_req.ret);
+
+		memhotadd_req.size = 0;
+		uhyve_send(UHYVE_PORT_MEMHOTADD, (unsigned)virt_to_phys((size_t)&memhotadd_req));
+	}
 }
 
 int memory_init(void)
 {
+	size_t init_start = 0, init_end = 0;
 	int ret = 0;
 
 	// enable paging and map Multiboot modules etc.
+	boot_phase_begin(BOOT_PHASE_PAGE_INIT);
 	ret = page_init();
+	boot_phase_end(BOOT_PHASE_PAGE_INIT);
 	if (BUILTIN_EXPECT(ret, 0)) {
 		LOG_ERROR("Failed to initialize paging!\n");
 		return ret;
@@ -342,36 +1017,38 @@ int memory_init(void)
 					LOG_INFO("Free region 0x%zx - 0x%zx\n", start_addr, end_addr);
 
 					if ((start_addr <= base) && (end_addr >= PAGE_2M_FLOOR((size_t) &kernel_start + image_size))) {
-						init_list.start = PAGE_2M_CEIL((size_t) &kernel_start + image_size);
-						init_list.end = end_addr;
-
-						LOG_INFO("Add region 0x%zx - 0x%zx\n", init_list.start, init_list.end);
+						init_start = PAGE_2M_CEIL((size_t) &kernel_start + image_size);
+						init_end = end_addr;
 					}
 
+					if (end_addr > mem_end)
+						mem_end = end_addr;
+
 					// determine available memory
 					atomic_int64_add(&total_pages, (end_addr-start_addr) >> PAGE_BITS);
 					atomic_int64_add(&total_available_pages, (end_addr-start_addr) >> PAGE_BITS);
 				}
 			}
 
-			if (!init_list.end)
+			if (!init_end)
 				goto oom;
 		} else {
 			goto oom;
 		}
 	} else {
-		init_list.start = PAGE_2M_CEIL(base + image_size);
+		init_start = PAGE_2M_CEIL(base + image_size);
+		mem_end = limit;
 
 		if (limit < IO_GAP_START) {
 			atomic_int64_add(&total_pages, (limit-base) >> PAGE_BITS);
 			atomic_int64_add(&total_available_pages, (limit-base) >> PAGE_BITS);
 
-			init_list.end = limit;
+			init_end = limit;
 		} else {
 			atomic_int64_add(&total_pages, (limit-base-IO_GAP_SIZE) >> PAGE_BITS);
 			atomic_int64_add(&total_available_pages, (limit-base-IO_GAP_SIZE) >> PAGE_BITS);
 
-			init_list.end = IO_GAP_START;
+			init_end = IO_GAP_START;
 		}
 	}
 
@@ -379,7 +1056,12 @@ int memory_init(void)
 	atomic_int64_add(&total_allocated_pages, PAGE_2M_CEIL(image_size) >> PAGE_BITS);
 	atomic_int64_sub(&total_available_pages, PAGE_2M_CEIL(image_size) >> PAGE_BITS);
 
-	LOG_INFO("free list starts at 0x%zx, limit 0x%zx\n", init_list.start, init_list.end);
+	LOG_INFO("free list starts at 0x%zx, limit 0x%zx\n", init_start, init_end);
+
+	// the object cache isn't usable yet => start with the static descriptors
+	for(uint32_t i=0; i<NODE_HIGH; i++)
+		node_put(boot_nodes+i);
+	add_region(init_start, init_end, 0);
 
 	// init high bandwidth memory subsystem
 	hbmemory_init();
@@ -391,7 +1073,6 @@ int memory_init(void)
 	// add missing free regions
 	if (mb_info) {
 		if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP) {
-			free_list_t* last = &init_list;
 			size_t end_addr, start_addr;
 			multiboot_memory_map_t* mmap = (multiboot_memory_map_t*) ((size_t) mb_info->mmap_addr);
 			multiboot_memory_map_t* mmap_end = (void*) ((size_t) mb_info->mmap_addr + mb_info->mmap_length);
@@ -421,37 +1102,23 @@ int memory_init(void)
 					if (start_addr >= end_addr)
 						continue;
 
-					last->next = kmalloc(sizeof(free_list_t));
-					if (BUILTIN_EXPECT(!last->next, 0))
-						goto oom;
-
-					LOG_INFO("Add region 0x%zx - 0x%zx\n", start_addr, end_addr);
-
-					last->next->prev = last;
-					last = last->next;
-					last->next = NULL;
-					last->start = start_addr;
-					last->end = end_addr;
+					add_region(start_addr, end_addr, 1);
 				}
 			}
 		}
 	} else {
 		// add region after the pci gap
-		if (limit > IO_GAP_START+IO_GAP_SIZE) {
-			free_list_t* last = &init_list;
-
-			last->next = kmalloc(sizeof(free_list_t));
-			if (BUILTIN_EXPECT(!last->next, 0))
-				goto oom;
+		if (limit > IO_GAP_START+IO_GAP_SIZE)
+			add_region(IO_GAP_START+IO_GAP_SIZE, limit, 1);
+	}
 
-			last->next->prev = last;
-			last = last->next;
-			last->next = NULL;
-			last->start = IO_GAP_START+IO_GAP_SIZE;
-			last->end = limit;
+	// discover the NUMA nodes and sort the free blocks into their lists
+	numa_init();
+	numa_redistribute();
 
-			LOG_INFO("Add region 0x%zx - 0x%zx\n", last->start, last->end);
-		}
+	if (is_uhyve()) {
+		LOG_INFO("memory hot-add uses irq %d\n", UHYVE_IRQ_MEMHOTADD);
+		irq_install_handler(32+UHYVE_IRQ_MEMHOTADD, uhyve_irq_memhotadd_handler);
 	}
 
 	// Ok, we are now able to use our memory management => update tss
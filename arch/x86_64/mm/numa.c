@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/memory.h>
+#include <hermit/vma.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+
+#include <asm/page.h>
+#include <asm/apic.h>
+#include <asm/uhyve.h>
+#include <asm/numa.h>
+
+/// number of APIC ids, which have a node
+#define MAX_NUMA_APICS		256
+
+/// tables of the loader, which are set in entry.asm
+extern uint64_t numa_mem_addr;
+extern uint32_t numa_mem_count;
+extern uint64_t numa_apic_addr;
+extern uint32_t numa_apic_count;
+
+typedef struct acpi_rsdp {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt;
+	uint32_t length;
+	uint64_t xsdt;
+	uint8_t ext_checksum;
+	uint8_t reserved[3];
+} __attribute__ ((packed)) acpi_rsdp_t;
+
+typedef struct acpi_header {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__ ((packed)) acpi_header_t;
+
+/// the affinity structures start behind the header and 12 reserved bytes
+#define SRAT_ENTRIES		(sizeof(acpi_header_t) + 12)
+
+#define SRAT_LAPIC		0
+#define SRAT_MEMORY		1
+#define SRAT_X2APIC		2
+
+#define SRAT_ENABLED		(1 << 0)
+
+/// memory ranges sorted by their start address
+static numa_mem_t ranges[MAX_NUMA_RANGES];
+static uint32_t nr_ranges = 0;
+static uint32_t nr_nodes = 1;
+
+/// proximity domains of the ACPI, which are mapped to the nodes
+static uint32_t domains[MAX_NUMA_NODES];
+static uint32_t nr_domains = 0;
+
+static uint8_t apic_node[MAX_NUMA_APICS] = {[0 ... MAX_NUMA_APICS-1] = 0};
+static uint8_t core_node[MAX_CORES] = {[0 ... MAX_CORES-1] = 0};
+
+/// map a physical range temporarily to read firmware or loader tables
+static void* phys_map(size_t phyaddr, size_t size)
+{
+	size_t start = PAGE_FLOOR(phyaddr);
+	size_t npages = (PAGE_CEIL(phyaddr + size) - start) >> PAGE_BITS;
+	size_t viraddr = vma_alloc(npages * PAGE_SIZE, VMA_READ);
+
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return NULL;
+
+	if (BUILTIN_EXPECT(page_map(viraddr, start, npages, PG_GLOBAL|PG_NX), 0)) {
+		vma_free(viraddr, viraddr + npages * PAGE_SIZE);
+		return NULL;
+	}
+
+	return (void*) (viraddr + (phyaddr - start));
+}
+
+static void phys_unmap(void* addr, size_t size)
+{
+	size_t start = PAGE_FLOOR((size_t) addr);
+	size_t npages = (PAGE_CEIL((size_t) addr + size) - start) >> PAGE_BITS;
+
+	page_unmap(start, npages);
+	vma_free(start, start + npages * PAGE_SIZE);
+}
+
+static uint8_t acpi_checksum(const void* addr, size_t size)
+{
+	const uint8_t* p = (const uint8_t*) addr;
+	uint8_t sum = 0;
+	size_t i;
+
+	for(i=0; i<size; i++)
+		sum += p[i];
+
+	return sum;
+}
+
+/// map a complete ACPI table, which is validated by its checksum
+static acpi_header_t* acpi_map_table(size_t phyaddr)
+{
+	acpi_header_t* header = (acpi_header_t*) phys_map(phyaddr, sizeof(acpi_header_t));
+	uint32_t length;
+
+	if (BUILTIN_EXPECT(!header, 0))
+		return NULL;
+
+	length = header->length;
+	phys_unmap(header, sizeof(acpi_header_t));
+	if (BUILTIN_EXPECT(length < sizeof(acpi_header_t), 0))
+		return NULL;
+
+	header = (acpi_header_t*) phys_map(phyaddr, length);
+	if (header && acpi_checksum(header, length)) {
+		phys_unmap(header, length);
+		return NULL;
+	}
+
+	return header;
+}
+
+/// search the RSDP in the BIOS area and return the address of the RSDT / XSDT
+static size_t acpi_find_root(int* xsdt)
+{
+	const size_t start = 0xE0000, end = 0x100000;
+	uint8_t* area = (uint8_t*) phys_map(start, end - start);
+	size_t ret = 0, i;
+
+	if (BUILTIN_EXPECT(!area, 0))
+		return 0;
+
+	for(i=0; i<end-start; i+=16) {
+		acpi_rsdp_t* rsdp = (acpi_rsdp_t*) (area + i);
+
+		if (memcmp(rsdp->signature, "RSD PTR ", 8) || acpi_checksum(rsdp, 20))
+			continue;
+
+		if ((rsdp->revision >= 2) && rsdp->xsdt) {
+			*xsdt = 1;
+			ret = rsdp->xsdt;
+		} else {
+			*xsdt = 0;
+			ret = rsdp->rsdt;
+		}
+		break;
+	}
+
+	phys_unmap(area, end - start);
+
+	return ret;
+}
+
+static uint32_t domain_to_node(uint32_t domain)
+{
+	uint32_t i;
+
+	for(i=0; i<nr_domains; i++) {
+		if (domains[i] == domain)
+			return i;
+	}
+
+	if (BUILTIN_EXPECT(nr_domains >= MAX_NUMA_NODES, 0)) {
+		LOG_WARNING("Proximity domain %u exceeds the supported nodes, use node 0\n", domain);
+		return 0;
+	}
+
+	domains[nr_domains] = domain;
+
+	return nr_domains++;
+}
+
+/// add a memory range and keep the list sorted by the start address
+static void add_range(size_t start, size_t end, uint32_t node)
+{
+	uint32_t i;
+
+	if ((start >= end) || (node >= MAX_NUMA_NODES))
+		return;
+	if (BUILTIN_EXPECT(nr_ranges >= MAX_NUMA_RANGES, 0)) {
+		LOG_WARNING("Too many NUMA memory ranges, ignore 0x%zx - 0x%zx\n", start, end);
+		return;
+	}
+
+	for(i=nr_ranges; (i>0) && (ranges[i-1].start > start); i--)
+		ranges[i] = ranges[i-1];
+
+	ranges[i].start = start;
+	ranges[i].end = end;
+	ranges[i].node = node;
+	nr_ranges++;
+
+	if (node >= nr_nodes)
+		nr_nodes = node + 1;
+}
+
+static int parse_srat(acpi_header_t* srat)
+{
+	size_t off = SRAT_ENTRIES;
+	uint8_t* p = (uint8_t*) srat;
+
+	while (off + 2 <= srat->length) {
+		uint8_t type = p[off];
+		uint8_t len = p[off+1];
+
+		if (BUILTIN_EXPECT(!len || (off + len > srat->length), 0))
+			break;
+
+		if ((type == SRAT_LAPIC) && (len >= 16)) {
+			uint32_t flags = *(uint32_t*) (p+off+4);
+			uint32_t domain = p[off+2] | (p[off+9] << 8) | (p[off+10] << 16) | (p[off+11] << 24);
+			uint8_t apic = p[off+3];
+
+			if (flags & SRAT_ENABLED)
+				apic_node[apic] = domain_to_node(domain);
+		} else if ((type == SRAT_X2APIC) && (len >= 24)) {
+			uint32_t domain = *(uint32_t*) (p+off+4);
+			uint32_t apic = *(uint32_t*) (p+off+8);
+			uint32_t flags = *(uint32_t*) (p+off+12);
+
+			if ((flags & SRAT_ENABLED) && (apic < MAX_NUMA_APICS))
+				apic_node[apic] = domain_to_node(domain);
+		} else if ((type == SRAT_MEMORY) && (len >= 40)) {
+			uint32_t domain = *(uint32_t*) (p+off+2);
+			uint64_t start = *(uint64_t*) (p+off+8);
+			uint64_t size = *(uint64_t*) (p+off+16);
+			uint32_t flags = *(uint32_t*) (p+off+28);
+
+			if ((flags & SRAT_ENABLED) && size)
+				add_range(start, start + size, domain_to_node(domain));
+		}
+
+		off += len;
+	}
+
+	return nr_ranges ? 0 : -ENOENT;
+}
+
+static int acpi_numa_init(void)
+{
+	acpi_header_t* root;
+	size_t root_addr, entry_size, i;
+	int xsdt = 0, ret = -ENOENT;
+
+	root_addr = acpi_find_root(&xsdt);
+	if (!root_addr)
+		return -ENOENT;
+
+	root = acpi_map_table(root_addr);
+	if (BUILTIN_EXPECT(!root, 0))
+		return -ENOENT;
+
+	entry_size = xsdt ? sizeof(uint64_t) : sizeof(uint32_t);
+	for(i=sizeof(acpi_header_t); (ret == -ENOENT) && (i+entry_size<=root->length); i+=entry_size) {
+		size_t addr = xsdt ? *(uint64_t*) ((uint8_t*) root + i) : *(uint32_t*) ((uint8_t*) root + i);
+		acpi_header_t* table = acpi_map_table(addr);
+
+		if (!table)
+			continue;
+
+		if (!memcmp(table->signature, "SRAT", 4)) {
+			LOG_INFO("Found SRAT at 0x%zx\n", addr);
+			ret = parse_srat(table);
+		}
+
+		phys_unmap(table, table->length);
+	}
+
+	phys_unmap(root, root->length);
+
+	return ret;
+}
+
+static int loader_numa_init(void)
+{
+	numa_mem_t* mem;
+	uint8_t* apic;
+	uint32_t i;
+
+	if (!numa_mem_addr || !numa_mem_count)
+		return -ENOENT;
+
+	mem = (numa_mem_t*) phys_map(numa_mem_addr, numa_mem_count * sizeof(numa_mem_t));
+	if (BUILTIN_EXPECT(!mem, 0))
+		return -ENOMEM;
+
+	for(i=0; i<numa_mem_count; i++)
+		add_range(mem[i].start, mem[i].end, mem[i].node);
+	phys_unmap(mem, numa_mem_count * sizeof(numa_mem_t));
+
+	if (numa_apic_addr && numa_apic_count) {
+		apic = (uint8_t*) phys_map(numa_apic_addr, numa_apic_count);
+		if (BUILTIN_EXPECT(!apic, 0))
+			return -ENOMEM;
+
+		for(i=0; (i<numa_apic_count) && (i<MAX_NUMA_APICS); i++)
+			apic_node[i] = (apic[i] < MAX_NUMA_NODES) ? apic[i] : 0;
+		phys_unmap(apic, numa_apic_count);
+	}
+
+	return nr_ranges ? 0 : -ENOENT;
+}
+
+uint32_t numa_init(void)
+{
+	uint32_t i;
+
+	if (loader_numa_init() && (is_uhyve() || acpi_numa_init())) {
+		LOG_INFO("No NUMA information found, the memory belongs to node 0\n");
+		nr_ranges = 0;
+		nr_nodes = 1;
+		return nr_nodes;
+	}
+
+	for(i=0; i<nr_ranges; i++)
+		LOG_INFO("NUMA node %u: 0x%zx - 0x%zx\n", ranges[i].node, ranges[i].start, ranges[i].end);
+	LOG_INFO("Found %u NUMA nodes\n", nr_nodes);
+
+	return nr_nodes;
+}
+
+void numa_register_core(void)
+{
+	uint32_t apic = apic_cpu_id();
+
+	core_node[CORE_ID] = (apic < MAX_NUMA_APICS) ? apic_node[apic] : 0;
+
+	if (nr_nodes > 1)
+		LOG_INFO("Core %u (APIC id %u) belongs to node %u\n", CORE_ID, apic, core_node[CORE_ID]);
+}
+
+uint32_t numa_nodes(void)
+{
+	return nr_nodes;
+}
+
+uint32_t numa_node(void)
+{
+	return core_node[CORE_ID];
+}
+
+uint32_t numa_core_node(uint32_t core_id)
+{
+	return (core_id < MAX_CORES) ? core_node[core_id] : 0;
+}
+
+uint32_t numa_phys_node(size_t phyaddr)
+{
+	uint32_t i;
+
+	for(i=0; (i<nr_ranges) && (ranges[i].start <= phyaddr); i++) {
+		if (phyaddr < ranges[i].end)
+			return ranges[i].node;
+	}
+
+	return 0;
+}
+
+size_t numa_phys_limit(size_t phyaddr)
+{
+	uint32_t i;
+
+	for(i=0; i<nr_ranges; i++) {
+		if (phyaddr < ranges[i].start)
+			return ranges[i].start;
+		if (phyaddr < ranges[i].end)
+			return ranges[i].end;
+	}
+
+	return (size_t) -1;
+}
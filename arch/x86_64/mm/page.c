@@ -39,20 +39,29 @@
 #include <hermit/errno.h>
 #include <hermit/string.h>
 #include <hermit/spinlock.h>
+#include <hermit/rwlock.h>
 #include <hermit/tasks.h>
 #include <hermit/logging.h>
+#include <hermit/vma.h>
 
 #include <asm/multiboot.h>
+#include <asm/io.h>
 #include <asm/irq.h>
 #include <asm/page.h>
+#include <asm/uhyve.h>
 
 /* Note that linker symbols are not variables, they have no memory
  * allocated for maintaining a value, rather their address is their value. */
 extern const void kernel_start;
 extern const void __bss_start;
 
-/** Single-address space operating system => one lock for all tasks */
-static spinlock_irqsave_t page_lock = SPINLOCK_IRQSAVE_INIT;
+/** Single-address space operating system => one lock for all tasks
+ *
+ * Page faults only read the page tables, if another core has already
+ * mapped the page, and share the lock. Page tables are never released,
+ * which allows to walk them without deferred reclamation.
+ */
+static rwlock_irqsave_t page_lock = RWLOCK_IRQSAVE_INIT;
 
 /** A self-reference enables direct access to all page tables */
 static size_t* const self[PAGE_LEVELS] = {
@@ -64,6 +73,22 @@ static size_t* const self[PAGE_LEVELS] = {
 
 static uint8_t expect_zeroed_pages = 0;
 
+/// back 1 GiB aligned parts of the heap by 1 GiB pages (boot flag -heap=1G)
+static uint8_t heap_1g_pages = 0;
+
+/// place the heap preferentially in high bandwidth memory (boot flag -heap=hbm)
+static uint8_t heap_hbmem = 0;
+
+#define UHYVE_IRQ_PFSTAT	14
+
+/// describes the statistics for uhyve, which reads them via the physical addresses
+static struct {
+	uint64_t stats;
+	uint64_t trace;
+	uint32_t nr_cores;
+	uint32_t trace_size;
+} __attribute__((packed)) pf_channel;
+
 size_t virt_to_phys(size_t addr)
 {
 	task_t* task = per_core(current_task);
@@ -78,6 +103,10 @@ size_t virt_to_phys(size_t addr)
 
 		return phy | off;
 	} else if ((task->heap) && (addr >= task->heap->start) && (addr < task->heap->end)) {
+		// part of the heap, which is mapped by a 1 GiB page?
+		if (heap_1g_pages && (self[2][addr >> PAGE_1G_BITS] & PG_PSE))
+			return (self[2][addr >> PAGE_1G_BITS] & PAGE_1G_MASK) | (addr & ~PAGE_1G_MASK);
+
 		size_t vpn   = addr >> (HUGE_PAGE_BITS); // virtual page number
 		size_t entry = (HUGE_PAGE_SIZE == PAGE_2M_SIZE) ? self[1][vpn] : self[2][vpn];	// page table entry
 		size_t off   = addr  & ~HUGE_PAGE_MASK;	// offset within page
@@ -85,6 +114,12 @@ size_t virt_to_phys(size_t addr)
 
 		return phy | off;
 	} else {
+		// the address may be covered by a 1 GiB or a 2 MiB page
+		if (self[2][addr >> PAGE_1G_BITS] & PG_PSE)
+			return (self[2][addr >> PAGE_1G_BITS] & PAGE_1G_MASK) | (addr & ~PAGE_1G_MASK);
+		if (self[1][addr >> PAGE_2M_BITS] & PG_PSE)
+			return (self[1][addr >> PAGE_2M_BITS] & PAGE_2M_MASK) | (addr & ~PAGE_2M_MASK);
+
 		size_t vpn   = addr >> PAGE_BITS;	// virtual page number
 		size_t entry = self[0][vpn];		// page table entry
 		size_t off   = addr  & ~PAGE_MASK;	// offset within page
@@ -102,10 +137,83 @@ int getpagesize(void)
 	return PAGE_SIZE;
 }
 
-//TODO: code is missing
+/// bits of a page table entry, which describe the access rights
+#define PG_ACCESS_BITS	(PG_PRESENT|PG_RW|PG_USER|PG_PCD|PG_XD)
+
+/// page table bits for the access rights of a VMA
+static size_t vma_to_bits(uint32_t flags)
+{
+	size_t bits = 0;
+
+	if (!(flags & VMA_NO_ACCESS))
+		bits |= PG_PRESENT;
+	if (flags & VMA_WRITE)
+		bits |= PG_RW;
+	if (flags & VMA_USER)
+		bits |= PG_USER;
+	if (!(flags & VMA_CACHEABLE))
+		bits |= PG_PCD;
+	if (!(flags & VMA_EXECUTE) && has_nx())
+		bits |= PG_XD;
+
+	return bits;
+}
+
+/*
+ * Returns the entry, which terminates the walk through the page tables for
+ * vaddr: the first missing entry, the entry of a huge page or the entry of
+ * the page table. An entry without PG_PRESENT, but with a frame address, is
+ * a page, which mprotect(PROT_NONE) has made inaccessible.
+ */
+static size_t* page_entry(size_t vaddr, int* level)
+{
+	size_t vpn = vaddr >> PAGE_BITS;
+	int lvl;
+
+	for (lvl=PAGE_LEVELS-1; lvl>0; lvl--) {
+		size_t* entry = &self[lvl][vpn >> (lvl * PAGE_MAP_BITS)];
+
+		if (!(*entry & PG_PRESENT) || (*entry & PG_PSE))
+			break;
+	}
+
+	*level = lvl;
+
+	return &self[lvl][vpn >> (lvl * PAGE_MAP_BITS)];
+}
+
+/// does the entry, which page_entry() returns, contain a page?
+static inline int is_page_entry(size_t* entry, int lvl)
+{
+	return (*entry & PAGE_MASK) && (!lvl || (*entry & PG_PSE));
+}
+
 int page_set_flags(size_t viraddr, uint32_t npages, int flags)
 {
-	return -EINVAL;
+	size_t bits = vma_to_bits(flags);
+	size_t addr = viraddr & PAGE_MASK;
+	size_t end = addr + npages * PAGE_SIZE;
+
+	rwlock_irqsave_write_lock(&page_lock);
+
+	while (addr < end) {
+		int lvl;
+		size_t* entry = page_entry(addr, &lvl);
+		size_t size = PAGE_SIZE << (lvl * PAGE_MAP_BITS);
+
+		if (is_page_entry(entry, lvl)) {
+			*entry = (*entry & ~PG_ACCESS_BITS) | bits;
+			tlb_flush_one_page(addr, 0);
+		}
+
+		addr = (addr & ~(size-1)) + size;
+	}
+
+	ipi_tlb_shootdown(viraddr & PAGE_MASK, end);
+
+	rwlock_irqsave_write_unlock(&page_lock);
+
+	return 0;
 }
 
 int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8_t do_ipi)
@@ -121,7 +229,15 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 
 	//kprintf("Map %d pages at 0x%zx (0x%zx)\n", npages, viraddr, phyaddr);
 
-	if ((HUGE_PAGE_SIZE != PAGE_SIZE) && !(viraddr & (HUGE_PAGE_SIZE-1))
+	if (!(viraddr & (PAGE_1G_SIZE-1)) && !(phyaddr & (PAGE_1G_SIZE-1))
+	   && (npages == PAGE_1G_SIZE/PAGE_SIZE) && has_1gbhp()) {
+		LOG_DEBUG("Map 1G page...\n");
+
+		npages = 1;
+		page_size = PAGE_1G_SIZE;
+		page_bits = PAGE_1G_BITS;
+		offset = 2;
+	} else if ((HUGE_PAGE_SIZE != PAGE_SIZE) && !(viraddr & (HUGE_PAGE_SIZE-1))
 	   && !(phyaddr & (HUGE_PAGE_SIZE-1))
 	   && (npages == HUGE_PAGE_SIZE/PAGE_SIZE)) {
 		LOG_DEBUG("Map huge page...\n");
@@ -142,7 +258,7 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 		last[lvl]  = (vpn+npages-1) >> (lvl * PAGE_MAP_BITS);
 	}
 
-	spinlock_irqsave_lock(&page_lock);
+	rwlock_irqsave_write_lock(&page_lock);
 
 	/* Start iterating through the entries
 	 * beginning at the root table (PGD or PML4) */
@@ -155,6 +271,7 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 					size_t paddr = get_pages(1);
 					if (BUILTIN_EXPECT(!paddr, 0))
 						goto out;
+					mem_account(MEM_TAG_PGTABLE, 1, 0);
 
 					/* Reference the new table within its parent */
 					self[lvl][vpn] = (paddr | bits | PG_PRESENT | PG_USER | PG_RW | PG_ACCESSED | PG_DIRTY) & ~PG_XD;
@@ -186,11 +303,11 @@ int __page_map(size_t viraddr, size_t phyaddr, size_t npages, size_t bits, uint8
 	}
 
 	if (do_ipi && send_ipi)
-		ipi_tlb_flush();
+		ipi_tlb_shootdown(viraddr, viraddr + npages * page_size);
 
 	ret = 0;
 out:
-	spinlock_irqsave_unlock(&page_lock);
+	rwlock_irqsave_write_unlock(&page_lock);
 
 	return ret;
 }
@@ -202,26 +319,601 @@ int page_unmap(size_t viraddr, size_t npages)
 
 	//kprintf("Unmap %d pages at 0x%zx\n", npages, viraddr);
 
-	spinlock_irqsave_lock(&page_lock);
+	rwlock_irqsave_write_lock(&page_lock);
 
 	/* Start iterating through the entries.
-	 * Only the PGT entries are removed. Tables remain allocated. */
+	 * Only the PGT entries are removed. Tables remain allocated.
+	 * Entries of huge pages, which __page_map() has created for
+	 * aligned regions, are removed at their level. */
 	size_t start = viraddr>>PAGE_BITS;
 	for (size_t vpn=viraddr>>PAGE_BITS; vpn<start+npages; vpn++) {
-		self[0][vpn] = 0;
-		tlb_flush_one_page(vpn << PAGE_BITS, 0);
+		size_t* pdpte = &self[2][vpn >> (2*PAGE_MAP_BITS)];
+		size_t* pde = &self[1][vpn >> PAGE_MAP_BITS];
+
+		if (!(self[3][vpn >> (3*PAGE_MAP_BITS)] & PG_PRESENT)) {
+			continue;
+		} else if (*pdpte & PG_PSE) {
+			*pdpte = 0;
+			tlb_flush_one_page(vpn << PAGE_BITS, 0);
+			vpn |= (1UL << (2*PAGE_MAP_BITS)) - 1;
+		} else if (!(*pdpte & PG_PRESENT)) {
+			continue;
+		} else if (*pde & PG_PSE) {
+			*pde = 0;
+			tlb_flush_one_page(vpn << PAGE_BITS, 0);
+			vpn |= (1UL << PAGE_MAP_BITS) - 1;
+		} else if (*pde & PG_PRESENT) {
+			self[0][vpn] = 0;
+			tlb_flush_one_page(vpn << PAGE_BITS, 0);
+		}
 	}
 
-	ipi_tlb_flush();
+	ipi_tlb_shootdown(viraddr, viraddr + npages * PAGE_SIZE);
 
-	spinlock_irqsave_unlock(&page_lock);
+	rwlock_irqsave_write_unlock(&page_lock);
 
 	/* This can't fail because we don't make checks here */
 	return 0;
 }
 
+typedef struct {
+	size_t phyaddr;
+	size_t len;
+} __attribute__((packed)) uhyve_discard_t;
+
+/// tag of the memory accounting for the pages at addr
+static uint32_t addr_to_tag(size_t addr)
+{
+	task_t* task = per_core(current_task);
+	vma_t vma;
+
+	if (task->heap && (addr >= task->heap->start) && (addr < HEAP_START + HEAP_SIZE))
+		return MEM_TAG_HEAP;
+	if (!vma_lookup(addr, &vma) && (vma.flags & VMA_ANON) && !(vma.flags & VMA_USER))
+		return MEM_TAG_STACK;
+
+	return MEM_TAG_ANON;
+}
+
+/*
+ * Releases page frames, which are no longer mapped. uhyve is told about
+ * them beforehand, so that it is able to return the memory to the host.
+ * The next access to the frames reads zeros.
+ */
+static void release_frames(size_t phyaddr, size_t npages, uint32_t tag)
+{
+	mem_account(tag, -(int64_t) npages, 0);
+
+	if (is_uhyve()) {
+		uhyve_discard_t arg = {phyaddr, npages * PAGE_SIZE};
+
+		uhyve_send(UHYVE_PORT_DISCARD, (unsigned)virt_to_phys((size_t) &arg));
+	}
+
+	put_pages(phyaddr, npages);
+}
+
+/// number of frame runs, which discard_range() collects before it releases them
+#define DISCARD_BATCH	16
+
+/*
+ * Unmaps the pages of [start, end) and releases their frames. The frames
+ * are collected in batches, because they must not be reused before the
+ * other cores have dropped their translations. page_lock is released,
+ * while we wait for them. If whole is set, pages crossing the boundaries
+ * of the range are kept.
+ */
+static void discard_range(size_t start, size_t end, uint32_t tag, int whole)
+{
+	struct {
+		size_t phyaddr;
+		size_t npages;
+	} runs[DISCARD_BATCH];
+	size_t addr = start;
+	uint32_t i, n;
+
+	while (addr < end) {
+		size_t lo = (size_t) -1, hi = 0;
+
+		n = 0;
+		rwlock_irqsave_write_lock(&page_lock);
+
+		while ((addr < end) && (n < DISCARD_BATCH)) {
+			int lvl;
+			size_t* entry = page_entry(addr, &lvl);
+			size_t size = PAGE_SIZE << (lvl * PAGE_MAP_BITS);
+			size_t base = addr & ~(size-1);
+
+			if (is_page_entry(entry, lvl) && (!whole || ((base >= start) && (base + size <= end)))) {
+				size_t phyaddr = *entry & PAGE_MASK & ~(size-1);
+
+				*entry = 0;
+				tlb_flush_one_page(base, 0);
+
+				if (n && (runs[n-1].phyaddr + (runs[n-1].npages << PAGE_BITS) == phyaddr)) {
+					runs[n-1].npages += size >> PAGE_BITS;
+				} else {
+					runs[n].phyaddr = phyaddr;
+					runs[n].npages = size >> PAGE_BITS;
+					n++;
+				}
+
+				if (base < lo)
+					lo = base;
+				hi = base + size;
+			}
+
+			addr = base + size;
+		}
+
+		rwlock_irqsave_write_unlock(&page_lock);
+
+		if (!n)
+			continue;
+
+		// no core is able to access the frames afterwards
+		ipi_tlb_shootdown_sync(lo, hi);
+
+		for (i = 0; i < n; i++)
+			release_frames(runs[i].phyaddr, runs[i].npages, tag);
+	}
+}
+
+int page_discard(size_t viraddr, size_t npages)
+{
+	discard_range(viraddr & PAGE_MASK, (viraddr & PAGE_MASK) + npages * PAGE_SIZE, addr_to_tag(viraddr), 0);
+
+	return 0;
+}
+
+int page_trim(size_t start, size_t end)
+{
+	if (BUILTIN_EXPECT(start & ~PAGE_MASK, 0))
+		return -EINVAL;
+
+	discard_range(start, end, addr_to_tag(start), 1);
+
+	return 0;
+}
+
+/*
+ * Maps a zeroed page for the anonymous VMA [start, end), which covers
+ * viraddr. The largest page size, which the VMA requests and which fits
+ * into the VMA and the page tables, is used. Has to be called with
+ * page_lock held.
+ *
+ * Returns the end of the page, which covers viraddr, or 0 on failure.
+ */
+static size_t map_anon_page(size_t viraddr, size_t start, size_t end, uint32_t flags)
+{
+	size_t bits = vma_to_bits(flags) & ~PG_PRESENT;
+	size_t base, phyaddr;
+	int lvl;
+	size_t* entry = page_entry(viraddr, &lvl);
+	// anonymous memory of the kernel is used by lazily mapped stacks
+	const uint32_t tag = (flags & VMA_USER) ? MEM_TAG_ANON : MEM_TAG_STACK;
+
+	// already mapped
+	if (is_page_entry(entry, lvl))
+		return (viraddr & ~((PAGE_SIZE << (lvl * PAGE_MAP_BITS)) - 1)) + (PAGE_SIZE << (lvl * PAGE_MAP_BITS));
+
+	base = PAGE_1G_FLOOR(viraddr);
+	if ((flags & VMA_HUGE_1G) && has_1gbhp() && (lvl >= 2) && (base >= start) && (base + PAGE_1G_SIZE <= end)) {
+		phyaddr = get_1g_page();
+		if (phyaddr) {
+			if (!__page_map(base, phyaddr, PAGE_1G_SIZE/PAGE_SIZE, bits|PG_RW, 0)) {
+				memset((void*) base, 0x00, PAGE_1G_SIZE);
+				if (!(flags & VMA_WRITE)) {
+					*page_entry(base, &lvl) &= ~PG_RW;
+					tlb_flush_one_page(base, 0);
+				}
+				mem_account(tag, PAGE_1G_SIZE >> PAGE_BITS, 0);
+				return base + PAGE_1G_SIZE;
+			}
+			put_pages(phyaddr, PAGE_1G_SIZE/PAGE_SIZE);
+		}
+	}
+
+	base = HUGE_PAGE_FLOOR(viraddr);
+	if ((flags & (VMA_HUGE|VMA_HUGE_1G)) && (lvl >= 1) && (base >= start) && (base + HUGE_PAGE_SIZE <= end)) {
+		phyaddr = get_zeroed_huge_page();
+		if (phyaddr) {
+			if (!__page_map(base, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, bits, 0)) {
+				mem_account(tag, HUGE_PAGE_SIZE >> PAGE_BITS, 0);
+				return base + HUGE_PAGE_SIZE;
+			}
+			put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+		}
+	}
+
+	base = PAGE_FLOOR(viraddr);
+	phyaddr = get_zeroed_page();
+	if (BUILTIN_EXPECT(!phyaddr, 0))
+		return 0;
+
+	if (BUILTIN_EXPECT(__page_map(base, phyaddr, 1, bits, 0), 0)) {
+		put_page(phyaddr);
+		return 0;
+	}
+	mem_account(tag, 1, 0);
+
+	return base + PAGE_SIZE;
+}
+
+int page_populate(size_t start, size_t end, uint32_t flags)
+{
+	size_t addr = start;
+	int ret = 0;
+
+	rwlock_irqsave_write_lock(&page_lock);
+
+	while (addr < end) {
+		addr = map_anon_page(addr, start, end, flags);
+		if (BUILTIN_EXPECT(!addr, 0)) {
+			ret = -ENOMEM;
+			break;
+		}
+	}
+
+	rwlock_irqsave_write_unlock(&page_lock);
+
+	if (!ret && (flags & VMA_NO_ACCESS))
+		ret = page_set_flags(start, (end - start) >> PAGE_BITS, flags);
+
+	return ret;
+}
+
+/// are the pages in [start, end) unmapped? Has to be called with page_lock held.
+static int range_unmapped(size_t start, size_t end)
+{
+	size_t addr;
+
+	for (addr = start; addr < end; ) {
+		int lvl;
+		size_t* entry = page_entry(addr, &lvl);
+		size_t size = PAGE_SIZE << (lvl * PAGE_MAP_BITS);
+
+		if (is_page_entry(entry, lvl))
+			return 0;
+
+		addr = (addr & ~(size-1)) + size;
+	}
+
+	return 1;
+}
+
+size_t page_map_file(size_t viraddr, size_t start, size_t end, uint32_t flags)
+{
+	size_t bits = vma_to_bits(flags) & ~PG_PRESENT;
+	size_t base, len, phyaddr = 0, mstart, mend;
+	uint8_t irq_flags;
+	off_t offset;
+	int fd, lvl, ret;
+
+	if (BUILTIN_EXPECT(mmap_file_lookup(viraddr, &fd, &offset, &mstart, &mend), 0))
+		return 0;
+
+	if (mstart > start)
+		start = mstart;
+	if (mend < end)
+		end = mend;
+
+	// readahead of the 2 MiB chunk, which contains viraddr
+	base = HUGE_PAGE_FLOOR(viraddr);
+	len = HUGE_PAGE_SIZE;
+	if (base < start) {
+		len -= start - base;
+		base = start;
+	}
+	if (base + len > end)
+		len = end - base;
+
+	rwlock_irqsave_read_lock(&page_lock, &irq_flags);
+	if (!range_unmapped(base, base + len)) {
+		base = PAGE_FLOOR(viraddr);
+		len = PAGE_SIZE;
+	}
+	rwlock_irqsave_read_unlock(&page_lock, irq_flags);
+
+	// sys_munmap() releases huge pages as a whole => private modifications need small pages
+	if ((len == HUGE_PAGE_SIZE) && !(base & (HUGE_PAGE_SIZE-1)) && !(flags & VMA_WRITE))
+		phyaddr = get_huge_page();
+	if (!phyaddr)
+		phyaddr = get_pages(len >> PAGE_BITS);
+	if (!phyaddr) {
+		base = PAGE_FLOOR(viraddr);
+		len = PAGE_SIZE;
+		phyaddr = get_page();
+		if (BUILTIN_EXPECT(!phyaddr, 0))
+			return 0;
+	}
+
+	// the page table lock isn't held, while the host reads the file
+	uhyve_mmap_t uhyve_mmap = {fd, offset + (off_t) (base - mstart), phyaddr, len, -1};
+
+	uhyve_send(UHYVE_PORT_MMAP, (unsigned)virt_to_phys((size_t) &uhyve_mmap));
+
+	if (BUILTIN_EXPECT(uhyve_mmap.ret < 0, 0)) {
+		LOG_ERROR("page_map_file: host could not read fd %d at 0x%llx (%zd)\n", fd, (long long) uhyve_mmap.offset, uhyve_mmap.ret);
+		put_pages(phyaddr, len >> PAGE_BITS);
+		return 0;
+	}
+
+	rwlock_irqsave_write_lock(&page_lock);
+
+	// another core may have mapped the chunk in the meantime
+	if (!range_unmapped(base, base + len)) {
+		rwlock_irqsave_write_unlock(&page_lock);
+		put_pages(phyaddr, len >> PAGE_BITS);
+		return PAGE_FLOOR(viraddr) + PAGE_SIZE;
+	}
+
+	if ((size_t) uhyve_mmap.ret >= len) {
+		ret = __page_map(base, phyaddr, len >> PAGE_BITS, bits, 0);
+	} else {
+		// the file ends within the chunk => zero the remainder
+		ret = __page_map(base, phyaddr, len >> PAGE_BITS, bits|PG_RW, 0);
+		if (!ret) {
+			memset((void*) (base + uhyve_mmap.ret), 0x00, len - uhyve_mmap.ret);
+			if (!(flags & VMA_WRITE)) {
+				size_t addr;
+
+				for (addr = base; addr < base + len; addr += PAGE_SIZE << (lvl * PAGE_MAP_BITS)) {
+					*page_entry(addr, &lvl) &= ~PG_RW;
+					tlb_flush_one_page(addr, 0);
+				}
+			}
+		}
+	}
+
+	rwlock_irqsave_write_unlock(&page_lock);
+
+	if (BUILTIN_EXPECT(ret, 0)) {
+		put_pages(phyaddr, len >> PAGE_BITS);
+		return 0;
+	}
+
+	mem_account(MEM_TAG_ANON, len >> PAGE_BITS, 0);
+
+	return base + len;
+}
+
+int page_map_frames(size_t viraddr, size_t phyaddr, size_t npages, uint32_t flags)
+{
+	size_t bits = vma_to_bits(flags) & ~PG_PRESENT;
+	size_t addr = viraddr, end = viraddr + (npages << PAGE_BITS);
+	int ret = 0;
+
+	while (!ret && (addr < end)) {
+		size_t next = (addr + HUGE_PAGE_SIZE) & ~(HUGE_PAGE_SIZE-1);
+		size_t n = ((next < end ? next : end) - addr) >> PAGE_BITS;
+
+		// __page_map() uses a huge page for an aligned region of its size
+		if (!(flags & VMA_HUGE) && (n == HUGE_PAGE_SIZE >> PAGE_BITS))
+			n--;
+
+		ret = __page_map(addr, phyaddr, n, bits, 0);
+		addr += n << PAGE_BITS;
+		phyaddr += n << PAGE_BITS;
+	}
+
+	if (!ret && (flags & VMA_NO_ACCESS))
+		ret = page_set_flags(viraddr, npages, flags);
+
+	return ret;
+}
+
+/*
+ * Returns a huge page for the heap. The page is taken preferentially
+ * from the high bandwidth memory. zero is set, if the caller has to
+ * clear the page after mapping it.
+ */
+static size_t get_heap_huge_page(int* zero)
+{
+	size_t phyaddr = 0;
+
+	*zero = 0;
+	if (heap_hbmem) {
+		phyaddr = hbmem_get_huge_page();
+		if (phyaddr) {
+			*zero = expect_zeroed_pages;
+			return phyaddr;
+		}
+	}
+
+	return expect_zeroed_pages ? get_zeroed_huge_page() : get_huge_page();
+}
+
+/// number of huge pages, which page_prefault() maps per acquisition of page_lock
+#define PREFAULT_BATCH	64
+
+int page_prefault(size_t start, size_t end)
+{
+	size_t flags = PG_USER|PG_RW;
+	size_t addr = HUGE_PAGE_FLOOR(start);
+	size_t phyaddr;
+	uint32_t n;
+	int lvl, zero, ret = 0;
+
+	if (has_nx()) // set no execution flag to protect the heap
+		flags |= PG_XD;
+
+	while (!ret && (addr < end)) {
+		rwlock_irqsave_write_lock(&page_lock);
+
+		for(n=0; (n<PREFAULT_BATCH) && (addr<end); n++) {
+			size_t* entry = page_entry(addr, &lvl);
+
+			// skip pages, which the page fault handler has already mapped
+			if (is_page_entry(entry, lvl) || (lvl < 1)) {
+				addr = (addr & ~((PAGE_SIZE << (lvl * PAGE_MAP_BITS)) - 1)) + (PAGE_SIZE << (lvl * PAGE_MAP_BITS));
+				continue;
+			}
+
+			if (heap_1g_pages && !heap_hbmem && (lvl >= 2) && !(addr & ~PAGE_1G_MASK) && (addr + PAGE_1G_SIZE <= end)) {
+				phyaddr = get_1g_page();
+				if (phyaddr) {
+					if (!__page_map(addr, phyaddr, PAGE_1G_SIZE/PAGE_SIZE, flags, 0)) {
+						if (expect_zeroed_pages)
+							memset((void*) addr, 0x00, PAGE_1G_SIZE);
+						mem_account(MEM_TAG_HEAP, PAGE_1G_SIZE >> PAGE_BITS, 0);
+						addr += PAGE_1G_SIZE;
+						continue;
+					}
+					put_pages(phyaddr, PAGE_1G_SIZE/PAGE_SIZE);
+				}
+			}
+
+			phyaddr = get_heap_huge_page(&zero);
+			if (BUILTIN_EXPECT(!phyaddr, 0)) {
+				ret = -ENOMEM;
+				break;
+			}
+
+			if (BUILTIN_EXPECT(__page_map(addr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, flags, 0), 0)) {
+				put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
+				ret = -ENOMEM;
+				break;
+			}
+
+			if (zero)
+				memset((void*) addr, 0x00, HUGE_PAGE_SIZE);
+			mem_account(MEM_TAG_HEAP, HUGE_PAGE_SIZE >> PAGE_BITS, 0);
+
+			addr += HUGE_PAGE_SIZE;
+		}
+
+		rwlock_irqsave_write_unlock(&page_lock);
+	}
+
+	return ret;
+}
+
+static void uhyve_irq_pfstat_handler(struct state* s)
+{
+	uhyve_send(UHYVE_PORT_PFSTAT, (unsigned)virt_to_phys((size_t)&pf_channel));
+}
+
+#define UHYVE_IRQ_DIRTY		15
+
+/// number of physical ranges, which a report of dirty pages contains at most
+#define DIRTY_RANGES		1024
+
+/// range [start, end) of guest-physical memory, which changed since the last report
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+} __attribute__((packed)) dirty_range_t;
+
+static dirty_range_t dirty_ranges[DIRTY_RANGES];
+
+/*
+ * Report of the dirty pages for live migration and checkpointing. uhyve
+ * triggers the report again, until complete is set.
+ */
+static struct {
+	uint64_t ranges;
+	uint32_t nr;
+	uint32_t complete;
+} __attribute__((packed)) dirty_report;
+
+/// virtual page number, at which the next scan for dirty pages continues
+static size_t dirty_cursor = 0;
+
+/// appends a physical range to the report, returns -ENOMEM if it is full
+static int dirty_add(size_t phyaddr, size_t size)
+{
+	if (dirty_report.nr && (dirty_ranges[dirty_report.nr-1].end == phyaddr)) {
+		dirty_ranges[dirty_report.nr-1].end += size;
+		return 0;
+	}
+
+	if (dirty_report.nr >= DIRTY_RANGES)
+		return -ENOMEM;
+
+	dirty_ranges[dirty_report.nr].start = phyaddr;
+	dirty_ranges[dirty_report.nr].end = phyaddr + size;
+	dirty_report.nr++;
+
+	return 0;
+}
+
+/*
+ * Reports the dirty pages, which the table of level lvl maps from the
+ * virtual page number vpn on, and clears their PG_DIRTY bits. The page
+ * tables are reported always. Has to be called with page_lock held.
+ */
+static int dirty_scan(int lvl, size_t vpn)
+{
+	const size_t span = 1UL << (lvl * PAGE_MAP_BITS);
+	size_t i;
+
+	for(i=0; i<PAGE_MAP_ENTRIES; i++, vpn+=span) {
+		size_t* entry = &self[lvl][vpn >> (lvl * PAGE_MAP_BITS)];
+
+		if (vpn + span <= dirty_cursor)
+			continue;
+		// skip the self-reference
+		if ((lvl == PAGE_LEVELS-1) && (i == PAGE_MAP_ENTRIES-1))
+			continue;
+		if (!(*entry & PG_PRESENT))
+			continue;
+
+		if (!lvl || (*entry & PG_PSE)) {
+			if (!(*entry & PG_DIRTY))
+				continue;
+
+			if (dirty_add(*entry & PAGE_MASK & ~((span << PAGE_BITS) - 1), span << PAGE_BITS)) {
+				dirty_cursor = vpn;
+				return -ENOMEM;
+			}
+
+			// the CPU sets the bit concurrently
+			__sync_fetch_and_and(entry, ~PG_DIRTY);
+		} else {
+			if ((vpn >= dirty_cursor) && dirty_add(*entry & PAGE_MASK, PAGE_SIZE)) {
+				dirty_cursor = vpn;
+				return -ENOMEM;
+			}
+
+			if (dirty_scan(lvl-1, vpn))
+				return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void uhyve_irq_dirty_handler(struct state* s)
+{
+	int ret;
+
+	rwlock_irqsave_write_lock(&page_lock);
+
+	dirty_report.ranges = virt_to_phys((size_t) dirty_ranges);
+	dirty_report.nr = 0;
+	if (!dirty_cursor)
+		dirty_add(read_cr3() & PAGE_MASK, PAGE_SIZE);
+
+	ret = dirty_scan(PAGE_LEVELS-1, 0);
+	dirty_report.complete = !ret;
+	if (!ret)
+		dirty_cursor = 0;
+
+	rwlock_irqsave_write_unlock(&page_lock);
+
+	// stale translations would write to the pages without setting PG_DIRTY
+	tlb_flush_all();
+#if MAX_CORES > 1
+	ipi_tlb_flush_sync();
+#endif
+
+	uhyve_send(UHYVE_PORT_DIRTY, (unsigned)virt_to_phys((size_t)&dirty_report));
+}
+
 void page_fault_handler(struct state *s)
 {
+	uint64_t tsc = get_rdtsc();
 	size_t viraddr = read_cr2();
 	task_t* task = per_core(current_task);
 
@@ -242,58 +934,182 @@ void page_fault_handler(struct state *s)
 
 			if (!(self[lvl][vpn] & PG_PRESENT))
 				return 0;
+
+			// the address is covered by a 1 GiB page
+			if ((lvl == 2) && (self[lvl][vpn] & PG_PSE))
+				return 1;
 		}
 
 		return 1;
 	}
 
-	spinlock_irqsave_lock(&page_lock);
+	/*
+	 * Tries to map the 1 GiB page, which contains vaddr. The page has to be
+	 * part of the heap and no smaller page may be mapped within it.
+	 */
+	int map_1g_page(size_t vaddr, size_t flags)
+	{
+		size_t start = PAGE_1G_FLOOR(vaddr);
+		size_t phyaddr;
+
+		if ((start < task->heap->start) || (start + PAGE_1G_SIZE > task->heap->end))
+			return 0;
+		if ((self[3][start >> (PAGE_1G_BITS + PAGE_MAP_BITS)] & PG_PRESENT)
+		    && (self[2][start >> PAGE_1G_BITS] & PG_PRESENT))
+			return 0;
+
+		phyaddr = get_1g_page();
+		if (!phyaddr)
+			return 0;
+
+		if (BUILTIN_EXPECT(__page_map(start, phyaddr, PAGE_1G_SIZE/PAGE_SIZE, flags, 0), 0)) {
+			put_pages(phyaddr, PAGE_1G_SIZE/PAGE_SIZE);
+			return 0;
+		}
+
+		if (expect_zeroed_pages)
+			memset((void*) start, 0x00, PAGE_1G_SIZE);
+		mem_account(MEM_TAG_HEAP, PAGE_1G_SIZE >> PAGE_BITS, 0);
+
+		return 1;
+	}
 
 	if (((task->heap) && (viraddr >= task->heap->start) && (viraddr < task->heap->end))
 	   || ((viraddr >= (size_t) &__bss_start) && (viraddr < (size_t) &kernel_start + image_size))) {
+		uint8_t irq_flags;
 		size_t flags;
 		int ret;
 
 		/*
 		 * do we have a valid page table entry? => flush TLB and return
 		 */
-		if (check_pagetables(viraddr)) {
+		rwlock_irqsave_read_lock(&page_lock, &irq_flags);
+		ret = check_pagetables(viraddr);
+		rwlock_irqsave_read_unlock(&page_lock, irq_flags);
+		if (ret) {
 			//tlb_flush_one_page(viraddr, 0);
-			spinlock_irqsave_unlock(&page_lock);
+			pf_account(viraddr, tsc, PF_KIND_SPURIOUS, s->error, 0);
+			return;
+		}
+
+		rwlock_irqsave_write_lock(&page_lock);
+
+		// another core may have mapped the page in the meantime
+		if (check_pagetables(viraddr)) {
+			rwlock_irqsave_write_unlock(&page_lock);
+			pf_account(viraddr, tsc, PF_KIND_SPURIOUS, s->error, 0);
 			return;
 		}
 
-		 // on demand userspace heap mapping
+		flags = PG_USER|PG_RW;
+		if (has_nx()) // set no execution flag to protect the heap
+			flags |= PG_XD;
+
+		// large heaps are backed by 1 GiB pages, if possible
+		if (heap_1g_pages && !heap_hbmem && task->heap && (viraddr >= task->heap->start)
+		    && (viraddr < task->heap->end) && map_1g_page(viraddr, flags)) {
+			rwlock_irqsave_write_unlock(&page_lock);
+			pf_account(viraddr, tsc, PF_KIND_1G, s->error, expect_zeroed_pages);
+			write_cr2(0);
+			return;
+		}
+
+		 // on demand userspace heap mapping, the frames are taken from
+		 // the NUMA node of the faulting core (first touch)
 		viraddr &= HUGE_PAGE_MASK;
 
-		size_t phyaddr = expect_zeroed_pages ? get_zeroed_huge_page() : get_huge_page();
+		int zero;
+		size_t phyaddr = get_heap_huge_page(&zero);
 		if (BUILTIN_EXPECT(!phyaddr, 0)) {
+			rwlock_irqsave_write_unlock(&page_lock);
 			LOG_ERROR("out of memory: task = %u\n", task->id);
 			goto default_handler;
 		}
 
-		flags = PG_USER|PG_RW;
-		if (has_nx()) // set no execution flag to protect the heap
-			flags |= PG_XD;
 		ret = __page_map(viraddr, phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE, flags, 0);
+		if (!ret && zero)
+			memset((void*) viraddr, 0x00, HUGE_PAGE_SIZE);
+
+		rwlock_irqsave_write_unlock(&page_lock);
 
 		if (BUILTIN_EXPECT(ret, 0)) {
 			LOG_ERROR("map_region: could not map %#lx to %#lx, task = %u\n", phyaddr, viraddr, task->id);
-			put_page(phyaddr);
+			put_pages(phyaddr, HUGE_PAGE_SIZE/PAGE_SIZE);
 
 			goto default_handler;
 		}
 
-		spinlock_irqsave_unlock(&page_lock);
+		mem_account(MEM_TAG_HEAP, HUGE_PAGE_SIZE >> PAGE_BITS, 0);
+
+		// pages of the heap are zeroed by the handler or in advance by an idle core
+		pf_account(viraddr, tsc, PF_KIND_HUGE, s->error, expect_zeroed_pages);
 
 		// clear cr2 to signalize that the pagefault is solved by the pagefault handler
 		write_cr2(0);
 
 		return;
+	} else {
+		vma_t vma;
+
+		// anonymous memory of mmap() is mapped on demand
+		if (!(s->error & 0x1) && !vma_lookup(viraddr, &vma) && (vma.flags & VMA_ANON)
+		    && !(vma.flags & VMA_NO_ACCESS) && (!(s->error & 0x2) || (vma.flags & VMA_WRITE))) {
+			size_t ret;
+			uint32_t kind = PF_KIND_SMALL;
+			int lvl = 0;
+
+			rwlock_irqsave_write_lock(&page_lock);
+			ret = map_anon_page(viraddr, vma.start, vma.end, vma.flags);
+			if (ret)
+				page_entry(viraddr, &lvl);
+			rwlock_irqsave_write_unlock(&page_lock);
+
+			if (BUILTIN_EXPECT(!ret, 0)) {
+				LOG_ERROR("out of memory: task = %u\n", task->id);
+				goto default_handler;
+			}
+
+			// anonymous memory is always zeroed
+			if (lvl >= 2)
+				kind = PF_KIND_1G;
+			else if (lvl == 1)
+				kind = PF_KIND_HUGE;
+			pf_account(viraddr, tsc, kind, s->error, 1);
+
+			// clear cr2 to signalize that the pagefault is solved by the pagefault handler
+			write_cr2(0);
+
+			return;
+		}
+
+		// file mappings are read from the host on demand
+		if (!(s->error & 0x1) && !vma_lookup(viraddr, &vma) && (vma.flags & VMA_FILE)
+		    && !(vma.flags & VMA_NO_ACCESS) && (!(s->error & 0x2) || (vma.flags & VMA_WRITE))) {
+			uint8_t irq_flags;
+			int lvl = 0;
+
+			if (BUILTIN_EXPECT(!page_map_file(viraddr, vma.start, vma.end, vma.flags), 0)) {
+				LOG_ERROR("could not map file page: task = %u\n", task->id);
+				goto default_handler;
+			}
+
+			rwlock_irqsave_read_lock(&page_lock, &irq_flags);
+			page_entry(viraddr, &lvl);
+			rwlock_irqsave_read_unlock(&page_lock, irq_flags);
+
+			pf_account(viraddr, tsc, lvl ? PF_KIND_HUGE : PF_KIND_SMALL, s->error, 0);
+
+			// clear cr2 to signalize that the pagefault is solved by the pagefault handler
+			write_cr2(0);
+
+			return;
+		}
 	}
 
 default_handler:
-	spinlock_irqsave_unlock(&page_lock);
+	// the guard page below the stack is never mapped
+	if (task->stack && (viraddr >= (size_t) task->stack - PAGE_SIZE) && (viraddr < (size_t) task->stack))
+		LOG_ERROR("Stack overflow of task %u\n", task->id);
 
 	LOG_ERROR("Page Fault Exception (%d) on core %d at cs:ip = %#x:%#lx, fs = %#lx, gs = %#lx, rflags 0x%lx, task = %u, addr = %#lx, error = %#x [ %s %s %s %s %s ]\n",
 		s->int_no, CORE_ID, s->cs, s->rip, s->fs, s->gs, s->rflags, task->id, viraddr, s->error,
@@ -319,6 +1135,9 @@ void __attribute__((weak)) runtime_osinit();
 
 int page_init(void)
 {
+	const pf_stats_t* pf_stats;
+	const pf_trace_t* pf_trace;
+
 	// do we have Go application? => weak symbol isn't zeroe
 	// => Go expect zeroed pages => set zeroed_pages to true
 	if (runtime_osinit) {
@@ -326,6 +1145,20 @@ int page_init(void)
 		LOG_INFO("Detect Go runtime! Consequently, HermitCore zeroed heap.\n");
 	}
 
+	if (get_cmdline() && strstr(get_cmdline(), "-heap=1G")) {
+		if (has_1gbhp()) {
+			heap_1g_pages = 1;
+			LOG_INFO("Back the heap by 1 GiB pages\n");
+		} else LOG_WARNING("CPU doesn't support 1 GiB pages, use 2 MiB pages for the heap\n");
+	}
+
+	if (get_cmdline() && strstr(get_cmdline(), "-heap=hbm")) {
+		if (is_hbmem_available()) {
+			heap_hbmem = 1;
+			LOG_INFO("Place the heap preferentially in high bandwidth memory\n");
+		} else LOG_WARNING("No high bandwidth memory available, place the heap in the main memory\n");
+	}
+
 	if (mb_info && (mb_info->flags & MULTIBOOT_INFO_CMDLINE) && (cmdline))
 	{
 		size_t i = 0;
@@ -342,5 +1175,19 @@ int page_init(void)
 	irq_uninstall_handler(14);
 	irq_install_handler(14, page_fault_handler);
 
+	page_fault_buffers(&pf_stats, &pf_trace);
+	pf_channel.stats = virt_to_phys((size_t) pf_stats);
+	if (pf_trace)
+		pf_channel.trace = virt_to_phys((size_t) pf_trace);
+	pf_channel.nr_cores = MAX_CORES;
+	pf_channel.trace_size = PAGE_FAULT_TRACE;
+
+	if (is_uhyve()) {
+		LOG_INFO("page fault statistics channel uses irq %d\n", UHYVE_IRQ_PFSTAT);
+		irq_install_handler(32+UHYVE_IRQ_PFSTAT, uhyve_irq_pfstat_handler);
+		LOG_INFO("dirty page tracking uses irq %d\n", UHYVE_IRQ_DIRTY);
+		irq_install_handler(32+UHYVE_IRQ_DIRTY, uhyve_irq_dirty_handler);
+	}
+
 	return 0;
 }
@@ -7,3 +7,24 @@ add_compile_options(${HERMIT_APP_FLAGS})
 # supplied with the toolchain, if built from top-level
 link_directories(${LOCAL_PREFIX_ARCH_LIB_DIR})
 include_directories(BEFORE ${LOCAL_PREFIX_ARCH_INCLUDE_DIR})
+
+# link a cpio archive ("newc" format, e.g. 'find . | cpio -o -H newc') into
+# TARGET; the kernel serves read-only opens of its files from memory
+function(add_romfs_image TARGET ARCHIVE)
+	get_filename_component(_ARCHIVE ${ARCHIVE} ABSOLUTE)
+	set(_SOURCE ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}-romfs.c)
+
+	file(WRITE ${_SOURCE}
+		"/* generated by add_romfs_image(), the symbols are used by kernel/romfs.c */\n"
+		"__asm__(\".section .rodata.romfs, \\\"a\\\"\\n\"\n"
+		"\t\".balign 16\\n\"\n"
+		"\t\".global romfs_image_start\\n\"\n"
+		"\t\"romfs_image_start:\\n\"\n"
+		"\t\".incbin \\\"${_ARCHIVE}\\\"\\n\"\n"
+		"\t\".global romfs_image_end\\n\"\n"
+		"\t\"romfs_image_end:\\n\"\n"
+		"\t\".previous\\n\");\n")
+
+	set_source_files_properties(${_SOURCE} PROPERTIES OBJECT_DEPENDS ${_ARCHIVE})
+	target_sources(${TARGET} PRIVATE ${_SOURCE})
+endfunction(add_romfs_image)
@@ -5,7 +5,7 @@ set(MAX_CORES "512" CACHE STRING
 	"Maximum number of cores that can be managed")
 
 set(MAX_TASKS "((MAX_CORES * 2) + 2)" CACHE STRING
-	"Maximum number of tasks")
+	"Maximum number of tasks (beyond the idle tasks, task structures are allocated on demand)")
 
 set(MAX_ISLE "8" CACHE STRING
 	"Maximum number of NUMA isles")
@@ -23,9 +23,194 @@ set(MAX_ARGC_ENVC 128 CACHE STRING
 	"Maximum number of command line parameters and enviroment variables
 	forwarded to uhyve")
 
+set(TIMESLICE_US "10000" CACHE STRING
+	"Time slice in microseconds, after which a task is preempted by a ready task of the same priority (0 disables the slice timer)")
+
+set(SOFTIRQ_BUDGET "64" CACHE STRING
+	"Maximal number of deferred work items (tasklets), which a core runs at an interrupt exit or in the idle loop")
+
+set(FLEXSC_THREADS "4" CACHE STRING
+	"Number of threads on the syscall core, which execute exception-less system calls (a blocked call doesn't stall the others)")
+
+set(FLEXSC_POLL_US "100" CACHE STRING
+	"Time in microseconds, which an idle syscall thread keeps polling for requests before it blocks")
+
+set(STEAL_THRESHOLD "0" CACHE STRING
+	"Minimal number of tasks on a core before an idle core steals one of them
+	(0 disables work stealing, can be overwritten by the boot option -steal<n>)")
+
+set(TIMER_SLACK_NSEC "50000" CACHE STRING
+	"Time in nanoseconds, by which the high-resolution timers of a new task may
+	expire late to share an interrupt with nearby timers (0 disables coalescing)")
+
+set(LWIP_TIMER_SLACK_NSEC "1000000" CACHE STRING
+	"Timer slack of LwIP's tcpip thread in nanoseconds, which batches the
+	timeouts of the TCP/IP stack with other wakeups")
+
+set(SEM_SPIN_NSEC "1000" CACHE STRING
+	"Time in nanoseconds, which a task spins for a semaphore before it blocks
+	(0 disables spinning)")
+
+set(BARRIER_SPIN_NSEC "20000" CACHE STRING
+	"Time in nanoseconds, which a task spins at a barrier before it sleeps
+	(0 disables spinning)")
+
+set(STACK_CACHE_DEPTH "4" CACHE STRING
+	"Maximum number of released stacks per size, which each core keeps mapped
+	for new threads (0 disables the stack cache)")
+
+set(MALLOC_CACHE_DEPTH "32" CACHE STRING
+	"Maximum number of released small kmalloc() blocks per size, which each
+	core keeps for new allocations (0 disables the caches)")
+
+set(PAGE_CACHE_DEPTH "32" CACHE STRING
+	"Maximum number of released 4 KiB pages, which each core keeps for new
+	allocations (0 disables the page caches)")
+
+set(ZEROED_POOL_SIZE "8" CACHE STRING
+	"Number of huge pages, which idle cores zero in advance for the page fault
+	handler (0 disables the pool)")
+
+set(PAGE_FAULT_TRACE "0" CACHE STRING
+	"Number of entries of the per-core page fault trace (0 disables the trace)")
+
+set(VIOIF_MTU "1460" CACHE STRING
+	"MTU of the virtio network interface (limited by the host if it advises an MTU)")
+
+set(VIOIF_TX_BATCH "16" CACHE STRING
+	"Number of sent packets per TX completion interrupt of the virtio network interface (with event index)")
+
+set(E1000_TX_BATCH "16" CACHE STRING
+	"Maximum number of sent packets of e1000 per write of the TX tail register (1 disables batching)")
+
+set(E1000_ITR_RATE "8000" CACHE STRING
+	"Maximum number of interrupts per second of e1000 (0 disables the throttling)")
+
+set(E1000_RX_DELAY "0" CACHE STRING
+	"Delay of the RX interrupt of e1000 in units of 1.024 us (0 disables the delay timer)")
+
+set(VIRTIO_MMIO_BASE "0x0a000000" CACHE STRING
+	"Physical address of the first virtio-mmio slot on aarch64 (QEMU virt machine, -virtio_mmio=<base>:<irq> overrides it)")
+
+set(VIRTIO_MMIO_SLOTS "32" CACHE STRING
+	"Number of virtio-mmio slots, which vioif probes on aarch64")
+
+set(VIRTIO_MMIO_IRQ "48" CACHE STRING
+	"GIC interrupt of the first virtio-mmio slot on aarch64, the following slots use consecutive interrupts")
+
+set(NAPI_BUDGET "64" CACHE STRING
+	"Maximum number of received packets per poll of a network device")
+
+set(NAPI_BUSY_POLL_CORE "-1" CACHE STRING
+	"Core, which polls the network devices permanently (-1 disables busy polling)")
+
+set(NAPI_CONTEXTS "0" CACHE STRING
+	"Maximum number of per-core contexts, which poll the RX queues of the network
+	devices instead of the tcpip thread (0 disables them)")
+
+set(UHYVE_NET_RX_BATCH "64" CACHE STRING
+	"Maximum number of received packets, which uhyve-net passes to the tcpip thread with one callback (power of two)")
+
+set(METRICS_PORT "0" CACHE STRING
+	"TCP port of the endpoint, which serves the kernel statistics as Prometheus text or JSON (0 disables it)")
+
+set(MMNIF_POLL_NSEC "0" CACHE STRING
+	"Time in nanoseconds, which mmnif keeps polling for the next packet before it waits for an interrupt")
+
+set(UHYVE_PAGE_CACHE_MB "64" CACHE STRING
+	"Maximum size of the guest-side page cache of host files in MiB (0 disables the cache)")
+
+set(TMPFS_PATH "/tmp" CACHE STRING
+	"Mount point of the in-memory file system for scratch files (without trailing slash, empty disables it)")
+
+set(BLKFS_PATH "/blk" CACHE STRING
+	"Mount point of the extent-based file system on the virtio-blk device (without trailing slash, empty disables it)")
+
+set(VIRTIOFS_PATH "/host" CACHE STRING
+	"Mount point of the host directory, which a virtio-fs device shares (without trailing slash, empty disables it)")
+
+set(VIRTIOFS_DAX_SIZE "268435456" CACHE STRING
+	"Maximum size of the virtio-fs DAX window in bytes, which is mapped into the kernel (multiple of 2 MiB)")
+
+set(VIRTIO_BLK_POLL_NSEC "0" CACHE STRING
+	"Time in nanoseconds, which a task polls the queue for the completion of its block request before it sleeps")
+
+set(LOCALSOCK_BUFSIZE "65536" CACHE STRING
+	"Size of the receive buffer of a local socket in bytes (power of two)")
+
+set(VSOCK_BUFSIZE "65536" CACHE STRING
+	"Size of the receive buffer of a vsock socket in bytes (power of two)")
+
+set(CONSOLE_BUFSIZE "4096" CACHE STRING
+	"Size of the per-core buffers of stdout and stderr in bytes (0 disables the buffering)")
+
+set(CONSOLE_FLUSH_MS "10" CACHE STRING
+	"Maximum time in milliseconds, which buffered console output waits before it is written")
+
+set(KLOG_RING_SIZE "0" CACHE STRING
+	"Size of the per-core ring of kernel log messages in bytes, which are formatted later
+	(power of two, 0 writes the messages synchronously)")
+
+set(SIGNAL_QUEUE_SIZE "256" CACHE STRING
+	"Maximum number of pending signals per core, which hermit_kill() queues")
+
+set(MWAIT_HINT "0x2" CACHE STRING
+	"Hint for mwait in the idle loop (bits 7:4 = target C-state - 1,
+	bits 3:0 = sub-state), unsupported hints fall back to C1")
+
 option(DYNAMIC_TICKS
 	"Don't use a periodic timer event to keep track of time" ON)
 
+option(TSC_DEADLINE
+	"Use the TSC-deadline mode of the APIC timer, if the CPU supports it" ON)
+
+option(PSCI_SMC
+	"Use smc instead of hvc for PSCI calls on aarch64 (firmware without a hypervisor)" OFF)
+
+option(PVLOCK
+	"Halt the vCPUs of spinlock waiters on KVM with PV unhalt support (x86_64)" ON)
+
+option(LOCKSTAT
+	"Record contention statistics of the kernel spinlocks" OFF)
+
+option(SYSSTAT
+	"Count the system calls and record histograms of their latency" OFF)
+
+set(KERNEL_TRACE_MODULES "" CACHE STRING
+	"Kernel modules, whose functions are traced (e.g. 'kernel;mm;drivers;lwip;arch',
+	empty disables the function trace)")
+
+set(PMU_PROFILE_SIZE "8192" CACHE STRING
+	"Number of samples of the per-core ring of the PMU profiler")
+
+set(KERNEL_TRACE_SIZE "65536" CACHE STRING
+	"Number of entries of the per-core function trace of the kernel (power of two)")
+
+if(NOT "${KERNEL_TRACE_MODULES}" STREQUAL "")
+	set(KERNEL_TRACE ON)
+endif()
+
+option(LAZY_STACKS
+	"Map the pages of thread stacks on demand" OFF)
+
+option(MMNIF_ZERO_COPY
+	"Use 64 KiB frames between the isles and pass received frames to LwIP without copying" OFF)
+
+option(VIRTIO_BLK_POLL
+	"Complete block requests only by polling, the virtio-blk queues don't raise interrupts" OFF)
+
+option(NVME_POLL
+	"Complete block requests only by polling, the NVMe completion queues don't raise interrupts" OFF)
+
+option(NETSTATS
+	"Maintain per-interface statistics and an RX latency histogram in the network drivers" ON)
+
+option(NETSTAMP
+	"Timestamp the packets and record the latencies of the stages of the RX/TX path (requires NETSTATS)" OFF)
+
+option(USER_MALLOC
+	"Replace newlib's malloc() by per-core arenas, which don't serialize the threads" ON)
+
 option(SAVE_FPU
 	"Save FPU registers on context switch" ON)
 
@@ -33,14 +218,17 @@ set(HAVE_ARCH_MEMSET "1" CACHE STRING
 	"Use machine specific version of memset")
 set(HAVE_ARCH_MEMCPY "1" CACHE STRING
 	"Use machine specific version of memcpy")
+if("${HERMIT_ARCH}" STREQUAL "aarch64")
 set(HAVE_ARCH_STRLEN "1" CACHE STRING
 	"Use machine specific version of strlen")
-if("${HERMIT_ARCH}" STREQUAL "aarch64")
 set(HAVE_ARCH_STRCPY "0" CACHE STRING
 	"Use machine specific version of strcpy")
 set(HAVE_ARCH_STRNCPY "0" CACHE STRING
 	"Use machine specific version of strncpy")
 else()
+# repne scasb is slower than the word-at-a-time version in libkern
+set(HAVE_ARCH_STRLEN "0" CACHE STRING
+	"Use machine specific version of strlen")
 set(HAVE_ARCH_STRCPY  "0" CACHE STRING
 	"Use machine specific version of strcpy")
 set(HAVE_ARCH_STRNCPY "0" CACHE STRING
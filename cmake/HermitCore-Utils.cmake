@@ -17,6 +17,11 @@ macro(add_kernel_module_sources MODULE SOURCE_GLOB)
     list(APPEND _KERNEL_MODULES "${MODULE}")
     list(REMOVE_DUPLICATES _KERNEL_MODULES)
 
+    # instrument the module for the kernel function trace
+    if("${MODULE}" IN_LIST KERNEL_TRACE_MODULES)
+        set(_KERNEL_TRACE_${MODULE} ON)
+    endif()
+
     # append sources for module
     list(APPEND "_KERNEL_SOURCES_${MODULE}" "${SOURCES}")
 endmacro(add_kernel_module_sources)
@@ -27,6 +32,15 @@ macro(get_kernel_module_sources VAR MODULE)
 endmacro(get_kernel_module_sources)
 
 
+macro(get_kernel_module_traced VAR MODULE)
+    if(_KERNEL_TRACE_${MODULE})
+        set(${VAR} ON)
+    else()
+        set(${VAR} OFF)
+    endif()
+endmacro(get_kernel_module_traced)
+
+
 macro(get_kernel_modules VAR)
 	set(${VAR} ${_KERNEL_MODULES})
 endmacro(get_kernel_modules)
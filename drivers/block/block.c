@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Front end of the block API. blk_init() selects the first driver, which
+ * finds its device: a dedicated NVMe controller is preferred to a
+ * virtio-blk device. The asynchronous requests are passed to the driver,
+ * the synchronous transfers are split into requests of the maximum size
+ * of the device and kept in flight at once.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/tasks.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/block.h>
+#include <block/block.h>
+
+/* number of requests, which blk_read and blk_write keep in flight */
+#define BLK_RW_DEPTH	16
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+static const blk_driver_t* const drivers[] = {
+	&nvme_driver,
+	&vblk_driver
+};
+
+static const blk_driver_t* driver = NULL;
+/* description of the device, which is cached by blk_init */
+static blk_info_t dev_info;
+
+int blk_init(void)
+{
+	if (driver)
+		return 0;
+
+	for(uint32_t i=0; i<sizeof(drivers)/sizeof(drivers[0]); i++) {
+		if (drivers[i]->init())
+			continue;
+		if (drivers[i]->info(&dev_info))
+			continue;
+
+		LOG_INFO("blk: use %s device with %llu sectors\n", drivers[i]->name, dev_info.sectors);
+		driver = drivers[i];
+		return 0;
+	}
+
+	return -ENODEV;
+}
+
+int blk_info(blk_info_t* info)
+{
+	if (BUILTIN_EXPECT(!driver, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!info, 0))
+		return -EINVAL;
+
+	memcpy(info, &dev_info, sizeof(blk_info_t));
+
+	return 0;
+}
+
+int blk_submit(blk_request_t* req, uint16_t queue)
+{
+	if (BUILTIN_EXPECT(!driver, 0))
+		return -ENODEV;
+
+	return driver->submit(req, queue);
+}
+
+int blk_poll(uint16_t queue, uint32_t budget)
+{
+	if (BUILTIN_EXPECT(!driver, 0))
+		return -ENODEV;
+
+	return driver->poll(queue, budget);
+}
+
+int blk_wait(blk_request_t* req)
+{
+	if (BUILTIN_EXPECT(!driver, 0))
+		return -ENODEV;
+
+	return driver->wait(req);
+}
+
+/* post a request, a full queue is drained by polling or the interrupt */
+static int blk_submit_wait(blk_request_t* req)
+{
+	int ret;
+
+	while ((ret = driver->submit(req, BLK_QUEUE_ANY)) == -EBUSY) {
+		if (driver->poll(BLK_QUEUE_ANY, 0) <= 0)
+			reschedule();
+	}
+
+	return ret;
+}
+
+/*
+ * Split a transfer into requests of the maximum size and keep up to
+ * BLK_RW_DEPTH of them in flight. After an error, no further request is
+ * posted, but the requests in flight are awaited. A transfer, which fits
+ * into a single request, doesn't allocate the requests.
+ */
+static ssize_t blk_rw_direct(uint32_t op, uint64_t sector, void* buf, size_t len)
+{
+	blk_request_t single;
+	blk_request_t* reqs = &single;
+	uint32_t depth = 1, first = 0, count = 0;
+	size_t off = 0;
+	int ret = 0;
+
+	if (len > dev_info.max_xfer) {
+		depth = MIN(BLK_RW_DEPTH, (len + dev_info.max_xfer - 1) / dev_info.max_xfer);
+		reqs = kmalloc(depth * sizeof(blk_request_t));
+		if (BUILTIN_EXPECT(!reqs, 0))
+			return -ENOMEM;
+	}
+
+	while (count || (!ret && (off < len))) {
+		while (!ret && (off < len) && (count < depth)) {
+			blk_request_t* req = reqs + (first + count) % depth;
+			int err;
+
+			memset(req, 0x00, sizeof(blk_request_t));
+			req->op = op;
+			req->sector = sector + (off >> BLK_SECTOR_BITS);
+			req->buf = (uint8_t*) buf + off;
+			req->len = MIN(len - off, dev_info.max_xfer);
+
+			// our own requests leave a full queue
+			if (count)
+				err = driver->submit(req, BLK_QUEUE_ANY);
+			else
+				err = blk_submit_wait(req);
+			if (err == -EBUSY)
+				break;
+			if (err) {
+				ret = err;
+				break;
+			}
+
+			off += req->len;
+			count++;
+		}
+
+		if (count) {
+			int err = driver->wait(reqs + first);
+
+			if (err && !ret)
+				ret = err;
+			first = (first + 1) % depth;
+			count--;
+		}
+	}
+
+	if (reqs != &single)
+		kfree(reqs);
+
+	return ret ? ret : (ssize_t) len;
+}
+
+/*
+ * Copy a transfer, which doesn't match the logical blocks or the buffer
+ * alignment of the device, through a bounce buffer. Each step covers the
+ * logical blocks of up to max_xfer bytes, a partially written block is
+ * read before.
+ */
+static ssize_t blk_rw_bounce(uint32_t op, uint64_t sector, uint8_t* buf, size_t len)
+{
+	const size_t lba = dev_info.lba_size;
+	const uint64_t end = (sector << BLK_SECTOR_BITS) + len;
+	uint64_t pos = sector << BLK_SECTOR_BITS;
+	size_t size, done = 0;
+	uint8_t* bounce;
+	ssize_t ret = 0;
+
+	size = MIN(dev_info.max_xfer, ((len + lba - 1) & ~(lba - 1)) + lba);
+	bounce = kmalloc(size);
+	if (BUILTIN_EXPECT(!bounce, 0))
+		return -ENOMEM;
+
+	while (pos < end) {
+		const uint64_t start = pos & ~((uint64_t) lba - 1);
+		const size_t n = MIN(((end + lba - 1) & ~((uint64_t) lba - 1)) - start, size);
+		const size_t head = pos - start;
+		const size_t chunk = MIN(end - pos, n - head);
+
+		if ((op == BLK_OP_READ) || head || (chunk < n)) {
+			ret = blk_rw_direct(BLK_OP_READ, start >> BLK_SECTOR_BITS, bounce, n);
+			if (ret < 0)
+				break;
+		}
+
+		if (op == BLK_OP_READ) {
+			memcpy(buf + done, bounce + head, chunk);
+		} else {
+			memcpy(bounce + head, buf + done, chunk);
+			ret = blk_rw_direct(BLK_OP_WRITE, start >> BLK_SECTOR_BITS, bounce, n);
+			if (ret < 0)
+				break;
+		}
+
+		pos += chunk;
+		done += chunk;
+	}
+
+	kfree(bounce);
+
+	return (ret < 0) ? ret : (ssize_t) len;
+}
+
+static ssize_t blk_rw(uint32_t op, uint64_t sector, void* buf, size_t len)
+{
+	if (BUILTIN_EXPECT(!driver, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!buf || (len & (BLK_SECTOR_SIZE-1)), 0))
+		return -EINVAL;
+
+	if ((((sector << BLK_SECTOR_BITS) | len) & (dev_info.lba_size - 1))
+	    || ((size_t) buf & (dev_info.buf_align - 1)))
+		return blk_rw_bounce(op, sector, (uint8_t*) buf, len);
+
+	return blk_rw_direct(op, sector, buf, len);
+}
+
+ssize_t blk_read(uint64_t sector, void* buf, size_t len)
+{
+	return blk_rw(BLK_OP_READ, sector, buf, len);
+}
+
+ssize_t blk_write(uint64_t sector, const void* buf, size_t len)
+{
+	return blk_rw(BLK_OP_WRITE, sector, (void*) buf, len);
+}
+
+int blk_flush(void)
+{
+	blk_request_t req;
+	int ret;
+
+	if (BUILTIN_EXPECT(!driver, 0))
+		return -ENODEV;
+
+	// without a volatile cache, the device writes through
+	if (!dev_info.flush)
+		return 0;
+
+	memset(&req, 0x00, sizeof(blk_request_t));
+	req.op = BLK_OP_FLUSH;
+
+	ret = blk_submit_wait(&req);
+	if (ret)
+		return ret;
+
+	return driver->wait(&req);
+}
@@ -0,0 +1,853 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Driver of NVMe controllers, e.g. a device, which is passed through to
+ * the virtual machine.
+ *
+ * Each core posts its requests to its own pair of submission and
+ * completion queues, so that submitters don't share a lock, and the MSI-X
+ * vector of a completion queue is routed to the core, which uses it. With
+ * NVME_POLL, the completion queues don't raise interrupts at all: the
+ * submitters reap their completions by the phase tag of the entries. The
+ * data buffer is described by PRP entries, one per page, which are
+ * determined by virt_to_phys() or taken from the physical address of the
+ * request. The first namespace is used as block device.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/stdlib.h>
+#include <hermit/processor.h>
+#include <hermit/tasks.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/block.h>
+#include <hermit/nvme.h>
+#include <hermit/vma.h>
+#include <asm/page.h>
+#include <asm/io.h>
+#include <asm/irq.h>
+#include <asm/pci.h>
+#include <block/block.h>
+#include <block/nvme.h>
+
+#define NVME_ADMIN_DEPTH	32
+#define NVME_QUEUE_LIMIT	256
+/* time in microseconds, which an admin command may take during the initialization */
+#define NVME_ADMIN_TIMEOUT	1000000
+/* entries of a PRP list: the pages of a transfer after the first one */
+#define NVME_PRP_ENTRIES	(BLK_MAX_XFER >> PAGE_BITS)
+/* number of completion callbacks, which are collected under the queue lock */
+#define NVME_BATCH		32
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+static nvme_t* nvme = NULL;
+
+extern atomic_int32_t possible_cpus;
+
+static inline uint32_t nvme_read32(nvme_t* dev, uint32_t off)
+{
+	return *((volatile uint32_t*) (dev->regs + off));
+}
+
+static inline void nvme_write32(nvme_t* dev, uint32_t off, uint32_t val)
+{
+	*((volatile uint32_t*) (dev->regs + off)) = val;
+}
+
+/* 64 bit registers are accessed as two halves, the lower one first */
+static inline uint64_t nvme_read64(nvme_t* dev, uint32_t off)
+{
+	uint64_t val = nvme_read32(dev, off);
+
+	return val | ((uint64_t) nvme_read32(dev, off + 4) << 32);
+}
+
+static inline void nvme_write64(nvme_t* dev, uint32_t off, uint64_t val)
+{
+	nvme_write32(dev, off, (uint32_t) val);
+	nvme_write32(dev, off + 4, (uint32_t) (val >> 32));
+}
+
+/* the controller has written the next completion queue entry */
+static inline int nvme_pending(nvme_queue_t* q)
+{
+	return (q->cq[q->cq_head].status & NVME_STATUS_PHASE) == q->phase;
+}
+
+/* consume the entry at the head of the completion queue */
+static inline void nvme_cq_advance(nvme_queue_t* q)
+{
+	if (++q->cq_head == q->depth) {
+		q->cq_head = 0;
+		q->phase ^= 1;
+	}
+}
+
+static inline nvme_queue_t* nvme_queue(nvme_t* dev, uint16_t queue)
+{
+	if (queue == BLK_QUEUE_ANY)
+		queue = CORE_ID % dev->nr_queues;
+	else if (BUILTIN_EXPECT(queue >= dev->nr_queues, 0))
+		return NULL;
+
+	return dev->queues + queue;
+}
+
+static int nvme_status(uint16_t status)
+{
+	if (!NVME_STATUS_SCT(status)) {
+		switch(NVME_STATUS_SC(status)) {
+		case NVME_SC_SUCCESS:
+			return 0;
+		case NVME_SC_INVALID_OPCODE:
+			return -EOPNOTSUPP;
+		case NVME_SC_LBA_RANGE:
+			return -EINVAL;
+		default:
+			break;
+		}
+	}
+
+	return -EIO;
+}
+
+/* physical address of the byte at offset off of the buffer */
+static inline size_t nvme_phys(blk_request_t* req, size_t off)
+{
+	size_t addr;
+
+	if (req->phys)
+		return req->phys + off;
+
+	addr = (size_t) req->buf + off;
+	// map lazily allocated pages, before their physical address is taken
+	(void) *((volatile uint8_t*) addr);
+
+	return virt_to_phys(addr);
+}
+
+/*
+ * Describe a buffer by PRP entries: prp1 points to the first byte, the
+ * following entries to the start of each further page.
+ *
+ * @return number of further entries or -EINVAL, if the buffer isn't dword aligned
+ */
+static int nvme_prps(blk_request_t* req, uint64_t* prp1, uint64_t* prps)
+{
+	size_t first = nvme_phys(req, 0);
+	size_t off = PAGE_SIZE - (first & (PAGE_SIZE-1));
+	int n = 0;
+
+	if (BUILTIN_EXPECT(first & 0x3, 0))
+		return -EINVAL;
+
+	*prp1 = first;
+	for(; off < req->len; off += PAGE_SIZE)
+		prps[n++] = nvme_phys(req, off);
+
+	return n;
+}
+
+static int nvme_submit(blk_request_t* req, uint16_t queue)
+{
+	uint64_t prps[NVME_PRP_ENTRIES];
+	nvme_t* dev = nvme;
+	nvme_queue_t* q;
+	struct nvme_command* cmd;
+	uint64_t prp1 = 0, lba = 0;
+	uint32_t nlb = 0;
+	uint16_t cid;
+	uint8_t opcode;
+	int n = 0;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!req, 0))
+		return -EINVAL;
+
+	switch(req->op) {
+	case BLK_OP_READ:
+	case BLK_OP_WRITE:
+		// the transfer has to consist of whole logical blocks
+		if (BUILTIN_EXPECT((!req->buf && !req->phys) || !req->len || (req->len & ((1UL << dev->lba_shift)-1))
+		    || (req->len > dev->max_xfer), 0))
+			return -EINVAL;
+		if (BUILTIN_EXPECT(req->sector & ((1UL << (dev->lba_shift - BLK_SECTOR_BITS))-1), 0))
+			return -EINVAL;
+		if (BUILTIN_EXPECT((req->sector >= dev->capacity)
+		    || ((req->len >> BLK_SECTOR_BITS) > dev->capacity - req->sector), 0))
+			return -EINVAL;
+
+		n = nvme_prps(req, &prp1, prps);
+		if (n < 0)
+			return n;
+
+		lba = req->sector >> (dev->lba_shift - BLK_SECTOR_BITS);
+		nlb = (req->len >> dev->lba_shift) - 1;
+		opcode = (req->op == BLK_OP_READ) ? NVME_CMD_READ : NVME_CMD_WRITE;
+		break;
+	case BLK_OP_FLUSH:
+		opcode = NVME_CMD_FLUSH;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	q = nvme_queue(dev, queue);
+	if (BUILTIN_EXPECT(!q, 0))
+		return -EINVAL;
+
+	req->queue = q - dev->queues;
+	req->waiter = 0;
+	req->status = BLK_PENDING;
+
+	spinlock_irqsave_lock(&q->lock);
+
+	if (BUILTIN_EXPECT(!q->nr_free, 0)) {
+		spinlock_irqsave_unlock(&q->lock);
+		return -EBUSY;
+	}
+
+	cid = q->free_cids[--q->nr_free];
+
+	cmd = q->sq + q->sq_tail;
+	memset(cmd, 0x00, sizeof(struct nvme_command));
+	cmd->opcode = opcode;
+	cmd->cid = cid;
+	cmd->nsid = dev->nsid;
+	cmd->prp1 = prp1;
+	if (n == 1) {
+		cmd->prp2 = prps[0];
+	} else if (n > 1) {
+		// more than two pages are described by the PRP list of the command
+		memcpy(q->prps + cid * NVME_PRP_ENTRIES, prps, n * sizeof(uint64_t));
+		cmd->prp2 = q->prps_phys + cid * NVME_PRP_ENTRIES * sizeof(uint64_t);
+	}
+	cmd->cdw10 = (uint32_t) lba;
+	cmd->cdw11 = (uint32_t) (lba >> 32);
+	cmd->cdw12 = nlb;
+
+	q->reqs[cid] = req;
+	req->id = cid;
+
+	if (++q->sq_tail == q->depth)
+		q->sq_tail = 0;
+	// the controller has to see the command before the new tail
+	mb();
+	*q->sq_db = q->sq_tail;
+	q->submitted++;
+
+	spinlock_irqsave_unlock(&q->lock);
+
+	return 0;
+}
+
+/*
+ * Reap the completed requests of a queue. The waiters are woken up under
+ * the queue lock (see nvme_wait), the callbacks are invoked without it, so
+ * that they are able to post the next request.
+ */
+static int nvme_complete(nvme_t* dev, nvme_queue_t* q, uint32_t budget)
+{
+	blk_request_t* reqs[NVME_BATCH];
+	blk_done_t cbs[NVME_BATCH];
+	uint32_t total = 0;
+
+	while (1) {
+		uint32_t nr_cbs = 0, reaped = 0;
+
+		spinlock_irqsave_lock(&q->lock);
+
+		while ((nr_cbs < NVME_BATCH) && (!budget || (total < budget)) && nvme_pending(q)) {
+			volatile struct nvme_completion* cqe = q->cq + q->cq_head;
+			blk_request_t* req;
+			uint16_t cid, status;
+
+			// read the entry after its phase tag
+			mb();
+			cid = cqe->cid;
+			status = cqe->status;
+			nvme_cq_advance(q);
+			reaped++;
+			total++;
+
+			if (BUILTIN_EXPECT((cid >= q->depth) || !q->reqs[cid], 0)) {
+				LOG_ERROR("nvme: controller completes unknown command %u (queue %u)\n", cid, q->qid);
+				continue;
+			}
+
+			req = q->reqs[cid];
+			q->reqs[cid] = NULL;
+			q->free_cids[q->nr_free++] = cid;
+			q->completed++;
+
+			// the owner may release the request, as soon as the status is set
+			tid_t waiter = req->waiter;
+			blk_done_t done = req->done;
+
+			if (done) {
+				reqs[nr_cbs] = req;
+				cbs[nr_cbs] = done;
+				nr_cbs++;
+			}
+
+			req->status = nvme_status(status);
+
+			if (waiter)
+				wakeup_task(waiter);
+		}
+
+		// release the entries to the controller
+		if (reaped)
+			*q->cq_db = q->cq_head;
+
+		spinlock_irqsave_unlock(&q->lock);
+
+		for(uint32_t i=0; i<nr_cbs; i++)
+			cbs[i](reqs[i]);
+
+		if ((budget && (total >= budget)) || !nvme_pending(q))
+			break;
+	}
+
+	return total;
+}
+
+#ifndef NVME_POLL
+static void nvme_handler(struct state* s)
+{
+	nvme_t* dev = nvme;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return;
+
+	for(uint16_t i=0; i<dev->nr_queues; i++) {
+		// the legacy interrupt is shared by all queues
+		if (dev->msix_enabled && (dev->vectors[i % dev->nr_vectors] != s->int_no))
+			continue;
+
+		dev->queues[i].interrupts++;
+		nvme_complete(dev, dev->queues+i, 0);
+	}
+}
+#endif
+
+static int nvme_poll(uint16_t queue, uint32_t budget)
+{
+	nvme_t* dev = nvme;
+	nvme_queue_t* q;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+
+	q = nvme_queue(dev, queue);
+	if (BUILTIN_EXPECT(!q, 0))
+		return -EINVAL;
+
+	return nvme_complete(dev, q, budget);
+}
+
+static int nvme_wait(blk_request_t* req)
+{
+	nvme_t* dev = nvme;
+	nvme_queue_t* q;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!req || (req->queue >= dev->nr_queues), 0))
+		return -EINVAL;
+
+	q = dev->queues + req->queue;
+
+#ifdef NVME_POLL
+	// other tasks run, while the controller processes the request
+	while (req->status == BLK_PENDING) {
+		if (!nvme_complete(dev, q, 0))
+			reschedule();
+	}
+#else
+	if (req->status == BLK_PENDING) {
+		task_t* curr_task = per_core(current_task);
+
+		spinlock_irqsave_lock(&q->lock);
+
+		// the status is set under the queue lock => no wakeup is lost
+		while (req->status == BLK_PENDING) {
+			req->waiter = curr_task->id;
+			block_current_task();
+			spinlock_irqsave_unlock(&q->lock);
+
+			reschedule();
+
+			spinlock_irqsave_lock(&q->lock);
+		}
+		req->waiter = 0;
+
+		spinlock_irqsave_unlock(&q->lock);
+	}
+#endif
+
+	return req->status;
+}
+
+static int nvme_info(blk_info_t* info)
+{
+	nvme_t* dev = nvme;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!info, 0))
+		return -EINVAL;
+
+	memset(info, 0x00, sizeof(blk_info_t));
+	info->sectors = dev->capacity;
+	info->blk_size = 1U << dev->lba_shift;
+	info->lba_size = 1U << dev->lba_shift;
+	info->max_xfer = dev->max_xfer;
+	info->nr_queues = dev->nr_queues;
+	// one entry of each queue stays unused
+	info->queue_size = dev->queues[0].depth - 1;
+	info->flush = dev->vwc;
+	// PRP entries point to dwords
+	info->buf_align = 4;
+#ifdef NVME_POLL
+	info->polled = 1;
+#endif
+
+	return 0;
+}
+
+#ifdef __x86_64__
+static int nvme_queue_alloc(nvme_t* dev, nvme_queue_t* q, uint16_t qid, uint16_t depth)
+{
+	memset(q, 0x00, sizeof(nvme_queue_t));
+	q->qid = qid;
+	q->depth = depth;
+	q->phase = 1;
+
+	q->sq = page_alloc(depth * sizeof(struct nvme_command), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	q->cq = page_alloc(depth * sizeof(struct nvme_completion), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	q->free_cids = kmalloc(depth * sizeof(uint16_t));
+	q->reqs = kmalloc(depth * sizeof(blk_request_t*));
+	// the admin commands don't transfer more than a page
+	if (qid)
+		q->prps = page_alloc(depth * NVME_PRP_ENTRIES * sizeof(uint64_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!q->sq || !q->cq || !q->free_cids || !q->reqs || (qid && !q->prps), 0)) {
+		LOG_ERROR("nvme: not enough memory to create queue %u\n", qid);
+		return -ENOMEM;
+	}
+
+	memset(q->sq, 0x00, depth * sizeof(struct nvme_command));
+	// the phase tags of the entries are cleared => the controller starts with 1
+	memset((void*) q->cq, 0x00, depth * sizeof(struct nvme_completion));
+	memset(q->reqs, 0x00, depth * sizeof(blk_request_t*));
+	q->sq_phys = virt_to_phys((size_t) q->sq);
+	q->cq_phys = virt_to_phys((size_t) q->cq);
+	if (q->prps)
+		q->prps_phys = virt_to_phys((size_t) q->prps);
+	q->sq_db = (volatile uint32_t*) (dev->regs + NVME_REG_DBS + (2 * qid) * dev->db_stride);
+	q->cq_db = (volatile uint32_t*) (dev->regs + NVME_REG_DBS + (2 * qid + 1) * dev->db_stride);
+	spinlock_irqsave_init(&q->lock);
+
+	// a full submission queue would look like an empty one => one entry stays unused
+	for(uint16_t i=0; i<depth-1; i++)
+		q->free_cids[i] = depth - 2 - i;
+	q->nr_free = depth - 1;
+
+	return 0;
+}
+
+/*
+ * Execute an admin command and poll for its completion. The admin queue
+ * is only used by the initialization, one command at a time.
+ */
+static int nvme_admin(nvme_t* dev, struct nvme_command* cmd, uint32_t* result)
+{
+	nvme_queue_t* q = &dev->admin;
+	volatile struct nvme_completion* cqe;
+	uint16_t status;
+	uint32_t t;
+
+	cmd->cid = q->sq_tail;
+	memcpy(q->sq + q->sq_tail, cmd, sizeof(struct nvme_command));
+	if (++q->sq_tail == q->depth)
+		q->sq_tail = 0;
+	mb();
+	*q->sq_db = q->sq_tail;
+
+	for(t=0; !nvme_pending(q) && (t < NVME_ADMIN_TIMEOUT); t+=10)
+		udelay(10);
+	if (!nvme_pending(q)) {
+		LOG_ERROR("nvme: admin command 0x%x times out\n", (uint32_t) cmd->opcode);
+		return -ETIMEDOUT;
+	}
+
+	mb();
+	cqe = q->cq + q->cq_head;
+	status = cqe->status;
+	if (result)
+		*result = cqe->result;
+	nvme_cq_advance(q);
+	*q->cq_db = q->cq_head;
+
+	if (NVME_STATUS_SC(status) || NVME_STATUS_SCT(status)) {
+		LOG_ERROR("nvme: admin command 0x%x fails with status 0x%x\n", (uint32_t) cmd->opcode, (uint32_t) (status >> 1));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/* wait until the ready flag of the controller matches ready */
+static int nvme_wait_ready(nvme_t* dev, uint32_t ready)
+{
+	// CAP.TO is the worst case in units of 500 ms
+	uint32_t timeout = (NVME_CAP_TO(dev->cap) + 1) * 500;
+
+	for(uint32_t ms=0; ; ms++) {
+		uint32_t csts = nvme_read32(dev, NVME_REG_CSTS);
+
+		if (csts == 0xFFFFFFFF)
+			return -EIO;
+		if (ready && (csts & NVME_CSTS_CFS))
+			return -EIO;
+		if ((csts & NVME_CSTS_RDY) == ready)
+			return 0;
+		if (ms >= timeout)
+			return -ETIMEDOUT;
+		udelay(1000);
+	}
+}
+
+/* determine the limits of the controller and the format of the first namespace */
+static int nvme_identify(nvme_t* dev)
+{
+	struct nvme_command cmd;
+	struct nvme_id_ctrl* ctrl;
+	struct nvme_id_ns* ns;
+	struct nvme_lbaf* lbaf;
+	void* buf;
+	int ret = -ENODEV;
+
+	buf = page_alloc(PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -ENOMEM;
+	ctrl = (struct nvme_id_ctrl*) buf;
+	ns = (struct nvme_id_ns*) buf;
+
+	memset(&cmd, 0x00, sizeof(cmd));
+	cmd.opcode = NVME_ADMIN_IDENTIFY;
+	cmd.prp1 = virt_to_phys((size_t) buf);
+	cmd.cdw10 = NVME_ID_CNS_CTRL;
+	if (nvme_admin(dev, &cmd, NULL))
+		goto out;
+
+	dev->vwc = ctrl->vwc & 0x1;
+	dev->max_xfer = BLK_MAX_XFER;
+	// the minimum page size is PAGE_SIZE (see nvme_setup)
+	if (ctrl->mdts && (ctrl->mdts < 16))
+		dev->max_xfer = MIN((uint32_t) PAGE_SIZE << ctrl->mdts, BLK_MAX_XFER);
+	if (!ctrl->nn) {
+		LOG_ERROR("nvme: controller doesn't have a namespace\n");
+		goto out;
+	}
+
+	dev->nsid = 1;
+	memset(&cmd, 0x00, sizeof(cmd));
+	cmd.opcode = NVME_ADMIN_IDENTIFY;
+	cmd.nsid = dev->nsid;
+	cmd.prp1 = virt_to_phys((size_t) buf);
+	cmd.cdw10 = NVME_ID_CNS_NS;
+	if (nvme_admin(dev, &cmd, NULL))
+		goto out;
+
+	lbaf = ns->lbaf + (ns->flbas & 0xF);
+	if (lbaf->ms) {
+		LOG_ERROR("nvme: namespace %u uses %u bytes of metadata per block, which aren't supported\n", dev->nsid, (uint32_t) lbaf->ms);
+		goto out;
+	}
+	if ((lbaf->ds < BLK_SECTOR_BITS) || (lbaf->ds > PAGE_BITS)) {
+		LOG_ERROR("nvme: namespace %u doesn't have a supported block size (2^%u bytes)\n", dev->nsid, (uint32_t) lbaf->ds);
+		goto out;
+	}
+
+	dev->lba_shift = lbaf->ds;
+	dev->capacity = ns->nsze << (dev->lba_shift - BLK_SECTOR_BITS);
+	if (!dev->capacity) {
+		LOG_ERROR("nvme: namespace %u is empty\n", dev->nsid);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	page_free(buf, PAGE_SIZE);
+
+	return ret;
+}
+
+/* create the completion queue and afterwards the submission queue of a pair */
+static int nvme_queue_create(nvme_t* dev, nvme_queue_t* q, uint16_t entry)
+{
+	struct nvme_command cmd;
+
+	memset(&cmd, 0x00, sizeof(cmd));
+	cmd.opcode = NVME_ADMIN_CREATE_CQ;
+	cmd.prp1 = q->cq_phys;
+	cmd.cdw10 = ((uint32_t) (q->depth - 1) << 16) | q->qid;
+	cmd.cdw11 = NVME_QUEUE_PHYS_CONTIG;
+#ifndef NVME_POLL
+	cmd.cdw11 |= NVME_CQ_IRQ_ENABLED | ((uint32_t) entry << 16);
+#endif
+	if (nvme_admin(dev, &cmd, NULL))
+		return -EIO;
+
+	memset(&cmd, 0x00, sizeof(cmd));
+	cmd.opcode = NVME_ADMIN_CREATE_SQ;
+	cmd.prp1 = q->sq_phys;
+	cmd.cdw10 = ((uint32_t) (q->depth - 1) << 16) | q->qid;
+	cmd.cdw11 = NVME_QUEUE_PHYS_CONTIG | ((uint32_t) q->qid << 16);
+	if (nvme_admin(dev, &cmd, NULL))
+		return -EIO;
+
+	return 0;
+}
+
+#ifndef NVME_POLL
+/*
+ * Assign one MSI-X vector to each queue. Queue i is used by the cores
+ * i, i + nr_queues, ..., therefore its vector is routed to core i. The
+ * admin queue shares the first entry, its completions are polled.
+ */
+static int nvme_msix_setup(nvme_t* dev, uint16_t nr_queues)
+{
+	uint16_t i, nr = nr_queues;
+
+	if (nr > dev->pci.msix_size)
+		nr = dev->pci.msix_size;
+
+	for (i=0; i<nr; i++) {
+		int vector = irq_alloc_vector();
+
+		if (vector < 0)
+			break;
+		dev->vectors[i] = vector;
+		irq_install_handler(vector, nvme_handler);
+		pci_msix_set_vector(&dev->pci, i, vector, i % atomic_int32_read(&possible_cpus));
+		LOG_INFO("nvme: queue %u uses vector %d on core %d\n", i, vector, irq_get_affinity(vector));
+	}
+
+	dev->nr_vectors = i;
+	if (!i)
+		return -ENOSPC;
+
+	return 0;
+}
+#endif
+
+static void nvme_msix_release(nvme_t* dev)
+{
+	if (!dev->msix_enabled)
+		return;
+
+	for (uint16_t i=0; i<dev->nr_vectors; i++)
+		irq_free_vector(dev->vectors[i]);
+	dev->nr_vectors = 0;
+	pci_msi_disable(&dev->pci);
+	dev->msix_enabled = 0;
+}
+
+/* search the PCI bus for an NVMe controller and map its registers */
+static int nvme_probe(nvme_t* dev)
+{
+	pci_info_t pci_info;
+	uint32_t size;
+
+	if (pci_get_class_info(NVME_PCI_CLASS, &pci_info, 1))
+		return -ENODEV;
+
+	LOG_INFO("Found NVMe controller at %u:%u\n", pci_info.bus, pci_info.slot);
+
+	dev->pci = pci_info;
+	dev->irq = pci_info.irq;
+
+	// registers and the doorbells of all queues
+	size = dev->pci.size[0];
+	if (!size)
+		size = NVME_REG_DBS + PAGE_SIZE;
+	dev->regs = pci_map_bar(&dev->pci, 0, 0, size);
+	if (!dev->regs) {
+		LOG_ERROR("nvme: unable to map the registers\n");
+		return -ENODEV;
+	}
+
+#ifndef NVME_POLL
+	if (pci_msix_enable(&dev->pci) == 0)
+		dev->msix_enabled = 1;
+#endif
+
+	return 0;
+}
+
+static int nvme_setup(nvme_t* dev)
+{
+	struct nvme_command cmd;
+	uint32_t cpus = atomic_int32_read(&possible_cpus);
+	uint32_t result, vs;
+	uint16_t nr_queues, depth;
+
+	if (nvme_probe(dev))
+		return -ENODEV;
+
+	dev->cap = nvme_read64(dev, NVME_REG_CAP);
+	dev->db_stride = 4U << NVME_CAP_DSTRD(dev->cap);
+	vs = nvme_read32(dev, NVME_REG_VS);
+	if (!NVME_CAP_CSS_NVM(dev->cap) || (NVME_CAP_MPSMIN(dev->cap) + 12 > PAGE_BITS)) {
+		LOG_ERROR("nvme: the controller doesn't support the NVM command set with pages of %u KiB\n", PAGE_SIZE >> 10);
+		goto failed;
+	}
+
+	// reset the controller
+	nvme_write32(dev, NVME_REG_CC, 0);
+	if (nvme_wait_ready(dev, 0)) {
+		LOG_ERROR("nvme: unable to disable the controller\n");
+		goto failed;
+	}
+
+	// the admin completions are polled, the legacy interrupt stays masked until the I/O queues exist
+	if (!dev->msix_enabled)
+		nvme_write32(dev, NVME_REG_INTMS, 0x1);
+
+	if (nvme_queue_alloc(dev, &dev->admin, 0, NVME_ADMIN_DEPTH))
+		goto failed;
+	nvme_write32(dev, NVME_REG_AQA, ((NVME_ADMIN_DEPTH - 1) << 16) | (NVME_ADMIN_DEPTH - 1));
+	nvme_write64(dev, NVME_REG_ASQ, dev->admin.sq_phys);
+	nvme_write64(dev, NVME_REG_ACQ, dev->admin.cq_phys);
+	nvme_write32(dev, NVME_REG_CC, NVME_CC_EN | NVME_CC_CSS_NVM | NVME_CC_MPS(PAGE_BITS)
+		| NVME_CC_AMS_RR | NVME_CC_IOSQES | NVME_CC_IOCQES);
+	if (nvme_wait_ready(dev, NVME_CSTS_RDY)) {
+		LOG_ERROR("nvme: unable to enable the controller\n");
+		goto failed;
+	}
+
+	if (nvme_identify(dev))
+		goto failed;
+
+	// one pair of I/O queues per core
+	nr_queues = MIN(cpus, BLK_MAX_QUEUES);
+	memset(&cmd, 0x00, sizeof(cmd));
+	cmd.opcode = NVME_ADMIN_SET_FEATURES;
+	cmd.cdw10 = NVME_FEAT_NUM_QUEUES;
+	cmd.cdw11 = ((uint32_t) (nr_queues - 1) << 16) | (nr_queues - 1);
+	if (nvme_admin(dev, &cmd, &result))
+		goto failed;
+	// the controller may allocate less or more queues than requested
+	nr_queues = MIN(nr_queues, (result & 0xFFFF) + 1);
+	nr_queues = MIN(nr_queues, (result >> 16) + 1);
+	dev->nr_queues = nr_queues;
+
+#ifndef NVME_POLL
+	if (dev->msix_enabled && nvme_msix_setup(dev, nr_queues)) {
+		LOG_INFO("nvme: unable to allocate MSI-X vectors, use the legacy interrupt\n");
+		nvme_msix_release(dev);
+		nvme_write32(dev, NVME_REG_INTMS, 0x1);
+	}
+#endif
+
+	depth = MIN(NVME_CAP_MQES(dev->cap) + 1, NVME_QUEUE_LIMIT);
+	for(uint16_t i=0; i<nr_queues; i++) {
+		if (nvme_queue_alloc(dev, dev->queues+i, i+1, depth))
+			goto failed;
+		if (nvme_queue_create(dev, dev->queues+i, dev->msix_enabled ? i % dev->nr_vectors : 0))
+			goto failed;
+	}
+
+#ifndef NVME_POLL
+	if (!dev->msix_enabled) {
+		irq_install_handler(dev->irq+32, nvme_handler);
+		nvme_write32(dev, NVME_REG_INTMC, 0x1);
+	}
+#endif
+
+	LOG_INFO("nvme: version %u.%u, namespace %u with %llu sectors, block size %u, %u queues with %u entries, %u KiB per request, %s\n",
+		vs >> 16, (vs >> 8) & 0xFF, dev->nsid, dev->capacity, 1U << dev->lba_shift, dev->nr_queues, depth,
+		dev->max_xfer >> 10, dev->vwc ? "volatile write cache" : "write through");
+
+	return 0;
+
+failed:
+	nvme_write32(dev, NVME_REG_CC, 0);
+	nvme_msix_release(dev);
+
+	return -ENODEV;
+}
+#else
+/* NVMe controllers are only supported on PCI */
+static inline int nvme_setup(nvme_t* dev)
+{
+	return -ENODEV;
+}
+#endif
+
+static int nvme_init(void)
+{
+	nvme_t* dev;
+
+	if (nvme)
+		return 0;
+
+	dev = kmalloc(sizeof(nvme_t));
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENOMEM;
+	memset(dev, 0x00, sizeof(nvme_t));
+
+	// the memory of the queues isn't released, the controller may still use it
+	if (nvme_setup(dev)) {
+		if (!dev->regs)
+			kfree(dev);
+		return -ENODEV;
+	}
+
+	nvme = dev;
+
+	return 0;
+}
+
+const blk_driver_t nvme_driver = {
+	.name = "NVMe",
+	.init = nvme_init,
+	.info = nvme_info,
+	.submit = nvme_submit,
+	.poll = nvme_poll,
+	.wait = nvme_wait
+};
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __BLOCK_NVME_H__
+#define __BLOCK_NVME_H__
+
+#include <hermit/stddef.h>
+#include <hermit/block.h>
+#include <hermit/nvme.h>
+#include <hermit/spinlock.h>
+#include <asm/pci.h>
+
+/* a pair of a submission and a completion queue */
+typedef struct
+{
+	/* queue identifier, 0 is the admin queue */
+	uint16_t qid;
+	/* number of entries of both queues */
+	uint16_t depth;
+	struct nvme_command* sq;
+	volatile struct nvme_completion* cq;
+	size_t sq_phys;
+	size_t cq_phys;
+	/* doorbells of the submission queue tail and the completion queue head */
+	volatile uint32_t* sq_db;
+	volatile uint32_t* cq_db;
+	uint16_t sq_tail;
+	uint16_t cq_head;
+	/* expected phase tag of the next completion */
+	uint16_t phase;
+	/* stack of free command identifiers */
+	uint16_t* free_cids;
+	uint16_t nr_free;
+	/* protects the queues against the completion interrupt and other pollers */
+	spinlock_irqsave_t lock;
+	/* in-flight requests, indexed by the command identifier */
+	blk_request_t** reqs;
+	/* PRP lists, one per command identifier */
+	uint64_t* prps;
+	size_t prps_phys;
+	/* statistics */
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t interrupts;
+} nvme_queue_t;
+
+typedef struct
+{
+	pci_info_t pci;
+	uint8_t irq;
+	uint8_t msix_enabled;
+	/* controller registers */
+	volatile uint8_t* regs;
+	uint64_t cap;
+	/* distance between two doorbells in bytes */
+	uint32_t db_stride;
+	/* namespace, which is used as block device */
+	uint32_t nsid;
+	/* size of a logical block as power of two */
+	uint32_t lba_shift;
+	/* capacity in sectors of BLK_SECTOR_SIZE bytes */
+	uint64_t capacity;
+	/* maximum number of bytes per request */
+	uint32_t max_xfer;
+	/* the controller has a volatile write cache */
+	uint8_t vwc;
+	uint16_t nr_queues;
+	/* MSI-X vector of each I/O queue */
+	int vectors[BLK_MAX_QUEUES];
+	uint16_t nr_vectors;
+	nvme_queue_t admin;
+	nvme_queue_t queues[BLK_MAX_QUEUES];
+} nvme_t;
+
+#endif
@@ -0,0 +1,779 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Driver of virtio-blk devices with the modern PCI interface (virtio 1.x).
+ *
+ * Each core posts its requests to its own queue (VIRTIO_BLK_F_MQ), so that
+ * submitters don't share a lock, and the MSI-X vector of a queue is routed
+ * to the core, which uses it. A request consists of the header, one
+ * descriptor per physically contiguous part of the buffer and the status
+ * byte. With VIRTIO_RING_F_INDIRECT_DESC, these descriptors are placed in
+ * the indirect table of the head descriptor, so that a single ring entry
+ * describes a request and the ring holds as many requests as descriptors.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/stdlib.h>
+#include <hermit/processor.h>
+#include <hermit/tasks.h>
+#include <hermit/time.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/block.h>
+#include <hermit/virtio_blk.h>
+#include <hermit/virtio_ring.h>
+#include <hermit/virtio_pci.h>
+#include <hermit/virtio_ids.h>
+#include <hermit/vma.h>
+#include <asm/page.h>
+#include <asm/io.h>
+#include <asm/irq.h>
+#include <asm/pci.h>
+#include <block/block.h>
+#include <block/virtio_blk.h>
+#include <virtio/vpci.h>
+
+#define VENDOR_ID 0x1AF4
+/* device ID of a block device without legacy interface (0x1040 + device type) */
+#define VBLK_MODERN_ID	(0x1040 + VIRTIO_ID_BLOCK)
+#define QUEUE_LIMIT	256
+#define VBLK_RETRIES	1000
+
+/* a buffer of BLK_MAX_XFER bytes, which doesn't start at a page boundary, spans one more page */
+#define VBLK_MAX_SEGS	((BLK_MAX_XFER >> PAGE_BITS) + 1)
+/* descriptors of an indirect table: header, data and status */
+#define VBLK_TABLE_SIZE	(VBLK_MAX_SEGS + 2)
+/* number of completion callbacks, which are collected under the queue lock */
+#define VBLK_BATCH	32
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+#define VBLK_HAS(dev, f)	((dev)->features & (1UL << (f)))
+#define VBLK_EVENT_IDX(dev)	(VBLK_HAS(dev, VIRTIO_RING_F_EVENT_IDX) ? 1 : 0)
+
+static vblk_t* vblk = NULL;
+
+extern atomic_int32_t possible_cpus;
+
+/* notify the host about new requests, if it doesn't process the queue anyway */
+static inline void vblk_kick(vblk_t* dev, vblk_queue_t* vq)
+{
+	// besure that the avail index is written before we read the event index
+	mb();
+
+	if (vring_need_kick(&vq->vring, vq->last_kick, VBLK_EVENT_IDX(dev))) {
+		vpci_notify(vq->notify, vq->index);
+		vq->kicks++;
+	}
+	vq->last_kick = vq->vring.avail->idx;
+}
+
+static inline int vblk_pending(vblk_queue_t* vq)
+{
+	return vq->last_seen_used != vq->vring.used->idx;
+}
+
+static inline vblk_queue_t* vblk_queue(vblk_t* dev, uint16_t queue)
+{
+	if (queue == BLK_QUEUE_ANY)
+		queue = CORE_ID % dev->nr_queues;
+	else if (BUILTIN_EXPECT(queue >= dev->nr_queues, 0))
+		return NULL;
+
+	return dev->queues + queue;
+}
+
+/*
+ * Describe a buffer by one descriptor per physically contiguous part.
+ *
+ * @return number of descriptors or -EINVAL, if the buffer is too fragmented
+ */
+static int vblk_segments(vblk_t* dev, blk_request_t* req, uint16_t flags, struct vring_desc* segs)
+{
+	size_t addr = (size_t) req->buf;
+	size_t end = addr + req->len;
+	int n = 0;
+
+	// the caller has already translated a contiguous buffer
+	if (req->phys) {
+		segs[0].addr = req->phys;
+		segs[0].len = req->len;
+		segs[0].flags = flags;
+		return 1;
+	}
+
+	while (addr < end) {
+		size_t chunk = MIN(PAGE_SIZE - (addr & (PAGE_SIZE-1)), end - addr);
+		size_t phys;
+
+		// map lazily allocated pages, before their physical address is taken
+		(void) *((volatile uint8_t*) addr);
+		phys = virt_to_phys(addr);
+
+		if (n && (segs[n-1].addr + segs[n-1].len == phys)) {
+			segs[n-1].len += chunk;
+		} else {
+			if (BUILTIN_EXPECT(n >= dev->max_segs, 0))
+				return -EINVAL;
+
+			segs[n].addr = phys;
+			segs[n].len = chunk;
+			segs[n].flags = flags;
+			n++;
+		}
+
+		addr += chunk;
+	}
+
+	return n;
+}
+
+static int vblk_submit(blk_request_t* req, uint16_t queue)
+{
+	struct vring_desc chain[VBLK_TABLE_SIZE];
+	vblk_t* dev = vblk;
+	vblk_queue_t* vq;
+	vblk_slot_t* slot;
+	uint16_t head, id, total, ndesc;
+	int n = 0;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!req, 0))
+		return -EINVAL;
+
+	switch(req->op) {
+	case BLK_OP_WRITE:
+		if (VBLK_HAS(dev, VIRTIO_BLK_F_RO))
+			return -EROFS;
+		/* fall through */
+	case BLK_OP_READ:
+		if (BUILTIN_EXPECT((!req->buf && !req->phys) || !req->len || (req->len & (BLK_SECTOR_SIZE-1))
+		    || (req->len > dev->max_xfer), 0))
+			return -EINVAL;
+		if (BUILTIN_EXPECT((req->sector >= dev->capacity)
+		    || ((req->len >> BLK_SECTOR_BITS) > dev->capacity - req->sector), 0))
+			return -EINVAL;
+
+		// the device writes the buffer of a read request
+		n = vblk_segments(dev, req,
+			(req->op == BLK_OP_READ) ? VRING_DESC_F_WRITE : 0, chain+1);
+		if (n < 0)
+			return n;
+		break;
+	case BLK_OP_FLUSH:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	vq = vblk_queue(dev, queue);
+	if (BUILTIN_EXPECT(!vq, 0))
+		return -EINVAL;
+
+	total = n + 2;
+	ndesc = VBLK_HAS(dev, VIRTIO_RING_F_INDIRECT_DESC) ? 1 : total;
+
+	req->queue = vq - dev->queues;
+	req->waiter = 0;
+	req->status = BLK_PENDING;
+
+	spinlock_irqsave_lock(&vq->lock);
+
+	if (BUILTIN_EXPECT(vq->nr_free < ndesc, 0)) {
+		spinlock_irqsave_unlock(&vq->lock);
+		return -EBUSY;
+	}
+
+	head = vq->free_head;
+	slot = vq->slots + head;
+	slot->hdr.type = req->op;
+	slot->hdr.ioprio = 0;
+	slot->hdr.sector = (req->op == BLK_OP_FLUSH) ? 0 : req->sector;
+	slot->status = 0xFF;
+
+	chain[0].addr = vq->slots_phys + head * sizeof(vblk_slot_t);
+	chain[0].len = sizeof(struct virtio_blk_outhdr);
+	chain[0].flags = 0;
+	chain[total-1].addr = chain[0].addr + __builtin_offsetof(vblk_slot_t, status);
+	chain[total-1].len = sizeof(uint8_t);
+	chain[total-1].flags = VRING_DESC_F_WRITE;
+
+	if (ndesc == 1) {
+		struct vring_desc* table = vq->indirect + head * VBLK_TABLE_SIZE;
+
+		for(id=0; id<total; id++) {
+			table[id].addr = chain[id].addr;
+			table[id].len = chain[id].len;
+			table[id].flags = chain[id].flags | ((id+1 < total) ? VRING_DESC_F_NEXT : 0);
+			table[id].next = id + 1;
+		}
+
+		vq->free_head = vq->vring.desc[head].next;
+		vq->vring.desc[head].addr = vq->indirect_phys + head * VBLK_TABLE_SIZE * sizeof(struct vring_desc);
+		vq->vring.desc[head].len = total * sizeof(struct vring_desc);
+		vq->vring.desc[head].flags = VRING_DESC_F_INDIRECT;
+	} else {
+		// the free list already links the descriptors of the chain
+		id = head;
+		for(uint16_t i=0; i<total; i++) {
+			struct vring_desc* desc = vq->vring.desc + id;
+
+			desc->addr = chain[i].addr;
+			desc->len = chain[i].len;
+			desc->flags = chain[i].flags | ((i+1 < total) ? VRING_DESC_F_NEXT : 0);
+			id = desc->next;
+		}
+		vq->free_head = id;
+	}
+
+	vq->nr_free -= ndesc;
+	vq->ndesc[head] = ndesc;
+	vq->reqs[head] = req;
+	req->id = head;
+
+	vq->vring.avail->ring[vq->vring.avail->idx % vq->vring.num] = head;
+	// the device has to see the descriptors before the new index
+	mb();
+	vq->vring.avail->idx++;
+	vq->submitted++;
+
+	vblk_kick(dev, vq);
+
+	spinlock_irqsave_unlock(&vq->lock);
+
+	return 0;
+}
+
+/*
+ * Reap the completed requests of a queue. The waiters are woken up under
+ * the queue lock (see vblk_wait), the callbacks are invoked without it, so
+ * that they are able to post the next request.
+ */
+static int vblk_complete(vblk_t* dev, vblk_queue_t* vq, uint32_t budget)
+{
+	blk_request_t* reqs[VBLK_BATCH];
+	blk_done_t cbs[VBLK_BATCH];
+	uint32_t total = 0;
+
+	while (1) {
+		uint32_t nr_cbs = 0;
+
+		spinlock_irqsave_lock(&vq->lock);
+
+		while ((nr_cbs < VBLK_BATCH) && (!budget || (total < budget)) && vblk_pending(vq)) {
+			struct vring_used_elem* used;
+			blk_request_t* req;
+			uint16_t head, tail;
+			uint8_t status;
+
+			// read the used element after the index
+			mb();
+			used = &vq->vring.used->ring[vq->last_seen_used % vq->vring.num];
+			head = used->id;
+			vq->last_seen_used++;
+			total++;
+
+			if (BUILTIN_EXPECT((head >= vq->vring.num) || !vq->reqs[head], 0)) {
+				LOG_ERROR("vblk: device completes unknown descriptor %u (queue %u)\n", head, vq->index);
+				continue;
+			}
+
+			// return the chain to the free list
+			tail = head;
+			for(uint16_t i=1; i<vq->ndesc[head]; i++)
+				tail = vq->vring.desc[tail].next;
+			vq->vring.desc[tail].next = vq->free_head;
+			vq->free_head = head;
+			vq->nr_free += vq->ndesc[head];
+
+			req = vq->reqs[head];
+			vq->reqs[head] = NULL;
+			status = vq->slots[head].status;
+			vq->completed++;
+
+			// the owner may release the request, as soon as the status is set
+			tid_t waiter = req->waiter;
+			blk_done_t done = req->done;
+
+			if (done) {
+				reqs[nr_cbs] = req;
+				cbs[nr_cbs] = done;
+				nr_cbs++;
+			}
+
+			if (status == VIRTIO_BLK_S_OK)
+				req->status = 0;
+			else if (status == VIRTIO_BLK_S_UNSUPP)
+				req->status = -EOPNOTSUPP;
+			else
+				req->status = -EIO;
+
+			if (waiter)
+				wakeup_task(waiter);
+		}
+
+#ifndef VIRTIO_BLK_POLL
+		// interrupt for the next used buffer
+		vring_enable_cb(&vq->vring, vq->last_seen_used, VBLK_EVENT_IDX(dev));
+		mb();
+#endif
+
+		spinlock_irqsave_unlock(&vq->lock);
+
+		for(uint32_t i=0; i<nr_cbs; i++)
+			cbs[i](reqs[i]);
+
+		// check again, the device may have used a buffer before the event index was updated
+		if ((budget && (total >= budget)) || !vblk_pending(vq))
+			break;
+	}
+
+	return total;
+}
+
+/* the interrupts are installed by vblk_setup(), which requires PCI */
+#if !defined(VIRTIO_BLK_POLL) && defined(__x86_64__)
+static void vblk_handler(struct state* s)
+{
+	vblk_t* dev = vblk;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return;
+
+	// MSI-X vectors aren't shared and don't use the isr register
+	if (!dev->msix_enabled) {
+		// reading the isr register acknowledges the interrupt
+		if (!(vpci_isr(&dev->vpci) & 0x01))
+			return;
+
+		for(uint16_t i=0; i<dev->nr_queues; i++) {
+			dev->queues[i].interrupts++;
+			vblk_complete(dev, dev->queues+i, 0);
+		}
+		return;
+	}
+
+	for(uint16_t i=0; i<dev->nr_queues; i++) {
+		if (dev->vectors[i % dev->nr_vectors] != s->int_no)
+			continue;
+
+		dev->queues[i].interrupts++;
+		vblk_complete(dev, dev->queues+i, 0);
+	}
+}
+#endif
+
+static int vblk_poll(uint16_t queue, uint32_t budget)
+{
+	vblk_t* dev = vblk;
+	vblk_queue_t* vq;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+
+	vq = vblk_queue(dev, queue);
+	if (BUILTIN_EXPECT(!vq, 0))
+		return -EINVAL;
+
+	return vblk_complete(dev, vq, budget);
+}
+
+static int vblk_wait(blk_request_t* req)
+{
+	vblk_t* dev = vblk;
+	vblk_queue_t* vq;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!req || (req->queue >= dev->nr_queues), 0))
+		return -EINVAL;
+
+	vq = dev->queues + req->queue;
+
+#ifdef VIRTIO_BLK_POLL
+	// other tasks run, while the device processes the request
+	while (req->status == BLK_PENDING) {
+		if (!vblk_complete(dev, vq, 0))
+			reschedule();
+	}
+#else
+#if VIRTIO_BLK_POLL_NSEC > 0
+	// fast devices complete the request, before a sleeping task would be woken up
+	uint64_t deadline = get_rdtsc() + ns_to_tsc(VIRTIO_BLK_POLL_NSEC);
+
+	while ((req->status == BLK_PENDING) && (get_rdtsc() < deadline)) {
+		if (!vblk_complete(dev, vq, 0))
+			PAUSE;
+	}
+#endif
+
+	if (req->status == BLK_PENDING) {
+		task_t* curr_task = per_core(current_task);
+
+		spinlock_irqsave_lock(&vq->lock);
+
+		// the status is set under the queue lock => no wakeup is lost
+		while (req->status == BLK_PENDING) {
+			req->waiter = curr_task->id;
+			block_current_task();
+			spinlock_irqsave_unlock(&vq->lock);
+
+			reschedule();
+
+			spinlock_irqsave_lock(&vq->lock);
+		}
+		req->waiter = 0;
+
+		spinlock_irqsave_unlock(&vq->lock);
+	}
+#endif
+
+	return req->status;
+}
+
+static int vblk_info(blk_info_t* info)
+{
+	vblk_t* dev = vblk;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!info, 0))
+		return -EINVAL;
+
+	memset(info, 0x00, sizeof(blk_info_t));
+	info->sectors = dev->capacity;
+	info->blk_size = dev->blk_size;
+	info->lba_size = BLK_SECTOR_SIZE;
+	info->max_xfer = dev->max_xfer;
+	info->nr_queues = dev->nr_queues;
+	info->queue_size = dev->queues[0].vring.num;
+	info->read_only = VBLK_HAS(dev, VIRTIO_BLK_F_RO) ? 1 : 0;
+	info->flush = VBLK_HAS(dev, VIRTIO_BLK_F_FLUSH) ? 1 : 0;
+	info->buf_align = 1;
+#ifdef VIRTIO_BLK_POLL
+	info->polled = 1;
+#endif
+
+	return 0;
+}
+
+#ifdef __x86_64__
+static int vblk_queue_init(vblk_t* dev, vblk_queue_t* vq, uint16_t index)
+{
+	size_t vring_phys, driver, device;
+	uint32_t total_size;
+	uint16_t num, entry;
+	void* vring_base;
+
+	memset(vq, 0x00, sizeof(vblk_queue_t));
+	vq->index = index;
+
+	num = vpci_queue_size(&dev->vpci, index, QUEUE_LIMIT);
+	if (!num)
+		return -ENODEV;
+
+	total_size = vring_size(num, PAGE_SIZE);
+	vring_base = page_alloc(total_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	vq->slots = page_alloc(num * sizeof(vblk_slot_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	vq->reqs = kmalloc(num * sizeof(blk_request_t*));
+	vq->ndesc = kmalloc(num * sizeof(uint16_t));
+	if (VBLK_HAS(dev, VIRTIO_RING_F_INDIRECT_DESC))
+		vq->indirect = page_alloc(num * VBLK_TABLE_SIZE * sizeof(struct vring_desc), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!vring_base || !vq->slots || !vq->reqs || !vq->ndesc
+	    || (VBLK_HAS(dev, VIRTIO_RING_F_INDIRECT_DESC) && !vq->indirect), 0)) {
+		LOG_ERROR("vblk: not enough memory to create queue %u\n", index);
+		return -ENOMEM;
+	}
+
+	memset(vring_base, 0x00, total_size);
+	memset(vq->reqs, 0x00, num * sizeof(blk_request_t*));
+	vring_phys = virt_to_phys((size_t) vring_base);
+	vq->slots_phys = virt_to_phys((size_t) vq->slots);
+	if (vq->indirect)
+		vq->indirect_phys = virt_to_phys((size_t) vq->indirect);
+	vring_init(&vq->vring, num, vring_base, PAGE_SIZE);
+	spinlock_irqsave_init(&vq->lock);
+
+	// chain all descriptors to the free list
+	for(uint16_t i=0; i<num; i++)
+		vq->vring.desc[i].next = i + 1;
+	vq->free_head = 0;
+	vq->nr_free = num;
+
+#ifdef VIRTIO_BLK_POLL
+	// the submitters reap their completions
+	vring_disable_cb(&vq->vring);
+#endif
+
+	driver = vring_phys + ((size_t) vq->vring.avail - (size_t) vring_base);
+	device = vring_phys + ((size_t) vq->vring.used - (size_t) vring_base);
+
+	entry = dev->msix_enabled ? index % dev->nr_vectors : VIRTIO_MSI_NO_VECTOR;
+	if (vpci_queue_enable(&dev->vpci, index, vring_phys, driver, device, entry, &vq->notify)) {
+		LOG_ERROR("vblk: host doesn't accept MSI-X entry %u for queue %u\n", entry, index);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * Assign one MSI-X vector to each queue. Queue i is used by the cores
+ * i, i + nr_queues, ..., therefore its vector is routed to core i.
+ */
+static int vblk_msix_setup(vblk_t* dev, uint16_t nr_queues)
+{
+	uint16_t i, nr = nr_queues;
+
+	if (nr > dev->pci.msix_size)
+		nr = dev->pci.msix_size;
+
+	for (i=0; i<nr; i++) {
+		int vector = irq_alloc_vector();
+
+		if (vector < 0)
+			break;
+		dev->vectors[i] = vector;
+		pci_msix_set_vector(&dev->pci, i, vector, i % atomic_int32_read(&possible_cpus));
+		LOG_INFO("vblk: queue %u uses vector %d on core %d\n", i, vector, irq_get_affinity(vector));
+	}
+
+	dev->nr_vectors = i;
+	if (!i)
+		return -ENOSPC;
+
+	// configuration changes don't raise an interrupt
+	vpci_msix_config(&dev->vpci, VIRTIO_MSI_NO_VECTOR);
+
+	return 0;
+}
+
+static void vblk_msix_release(vblk_t* dev)
+{
+	if (!dev->msix_enabled)
+		return;
+
+	for (uint16_t i=0; i<dev->nr_vectors; i++)
+		irq_free_vector(dev->vectors[i]);
+	dev->nr_vectors = 0;
+	pci_msi_disable(&dev->pci);
+	dev->msix_enabled = 0;
+}
+
+/* search the PCI bus for a block device, which has a modern interface */
+static int vblk_probe(vblk_t* dev)
+{
+	pci_info_t pci_info;
+	uint32_t id;
+
+	// transitional devices use the legacy device ID
+	if (pci_get_device_info(VENDOR_ID, 0x1001, PCI_IGNORE_SUBID, &pci_info, 1) == 0)
+		id = 0x1001;
+	else if (pci_get_device_info(VENDOR_ID, VBLK_MODERN_ID, PCI_IGNORE_SUBID, &pci_info, 1) == 0)
+		id = VBLK_MODERN_ID;
+	else
+		return -ENODEV;
+
+	LOG_INFO("Found vblk (Vendor ID 0x%x, Device Id 0x%x)\n", VENDOR_ID, id);
+
+	dev->pci = pci_info;
+	dev->irq = pci_info.irq;
+
+	if (vpci_setup(&dev->vpci, &dev->pci)) {
+		LOG_ERROR("vblk: the device doesn't provide the virtio 1.x interface\n");
+		return -ENODEV;
+	}
+
+	// MSI-X changes the layout of the configuration => enable it before the first access
+	if (pci_msix_enable(&dev->pci) == 0)
+		dev->msix_enabled = 1;
+
+	return 0;
+}
+
+static int vblk_setup(vblk_t* dev)
+{
+	uint64_t features, wanted;
+	uint32_t cpus = atomic_int32_read(&possible_cpus);
+	uint16_t nr_queues = 1;
+	uint8_t status;
+
+	if (vblk_probe(dev))
+		return -ENODEV;
+
+	vpci_reset(&dev->vpci, VBLK_RETRIES);
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE);
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER);
+
+	features = vpci_get_features(&dev->vpci);
+	LOG_INFO("vblk: host features 0x%llx\n", features);
+	if (!(features & (1ULL << VIRTIO_F_VERSION_1))) {
+		LOG_ERROR("vblk: the host doesn't support virtio 1.x\n");
+		goto failed;
+	}
+
+	wanted = features & ((1ULL << VIRTIO_F_VERSION_1)
+		| (1ULL << VIRTIO_RING_F_INDIRECT_DESC)
+		| (1ULL << VIRTIO_RING_F_EVENT_IDX)
+		| (1ULL << VIRTIO_BLK_F_SEG_MAX)
+		| (1ULL << VIRTIO_BLK_F_RO)
+		| (1ULL << VIRTIO_BLK_F_BLK_SIZE)
+		| (1ULL << VIRTIO_BLK_F_FLUSH)
+		| (1ULL << VIRTIO_BLK_F_MQ));
+	vpci_set_features(&dev->vpci, wanted);
+	dev->features = wanted;
+
+	// tell the device that the features are OK and check, if the host accepts them
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK);
+	status = vpci_get_status(&dev->vpci);
+	if (!(status & VIRTIO_CONFIG_S_FEATURES_OK)) {
+		LOG_ERROR("vblk: device features are ignored: status 0x%x\n", (uint32_t) status);
+		goto failed;
+	}
+
+	vpci_cfg_read(&dev->vpci, __builtin_offsetof(struct virtio_blk_config, capacity), &dev->capacity, sizeof(uint64_t));
+
+	dev->blk_size = BLK_SECTOR_SIZE;
+	if (VBLK_HAS(dev, VIRTIO_BLK_F_BLK_SIZE))
+		vpci_cfg_read(&dev->vpci, __builtin_offsetof(struct virtio_blk_config, blk_size), &dev->blk_size, sizeof(uint32_t));
+
+	dev->max_segs = VBLK_MAX_SEGS;
+	if (VBLK_HAS(dev, VIRTIO_BLK_F_SEG_MAX)) {
+		uint32_t seg_max;
+
+		vpci_cfg_read(&dev->vpci, __builtin_offsetof(struct virtio_blk_config, seg_max), &seg_max, sizeof(uint32_t));
+		if (seg_max && (seg_max < dev->max_segs))
+			dev->max_segs = seg_max;
+	}
+
+	// one queue per core
+	if (VBLK_HAS(dev, VIRTIO_BLK_F_MQ)) {
+		vpci_cfg_read(&dev->vpci, __builtin_offsetof(struct virtio_blk_config, num_queues), &nr_queues, sizeof(uint16_t));
+		if (!nr_queues)
+			nr_queues = 1;
+	}
+	if (nr_queues > BLK_MAX_QUEUES)
+		nr_queues = BLK_MAX_QUEUES;
+	if (nr_queues > cpus)
+		nr_queues = cpus;
+	dev->nr_queues = nr_queues;
+
+#ifdef VIRTIO_BLK_POLL
+	// the requests are completed by polling => no interrupts are needed
+	if (dev->msix_enabled) {
+		pci_msi_disable(&dev->pci);
+		dev->msix_enabled = 0;
+	}
+#else
+	if (dev->msix_enabled && vblk_msix_setup(dev, nr_queues)) {
+		LOG_INFO("vblk: unable to allocate MSI-X vectors, use the legacy interrupt\n");
+		vblk_msix_release(dev);
+	}
+#endif
+
+	for(uint16_t i=0; i<nr_queues; i++) {
+		if (vblk_queue_init(dev, dev->queues+i, i))
+			goto failed;
+	}
+
+	// a chain of direct descriptors has to fit into the ring
+	if (!VBLK_HAS(dev, VIRTIO_RING_F_INDIRECT_DESC) && (dev->max_segs > dev->queues[0].vring.num - 2))
+		dev->max_segs = dev->queues[0].vring.num - 2;
+	// the largest transfer may start anywhere in a page
+	dev->max_xfer = MIN((uint32_t) (dev->max_segs - 1) << PAGE_BITS, BLK_MAX_XFER);
+	if (!dev->max_xfer)
+		dev->max_xfer = BLK_SECTOR_SIZE;
+
+#ifndef VIRTIO_BLK_POLL
+	if (dev->msix_enabled) {
+		for(uint16_t i=0; i<dev->nr_vectors; i++)
+			irq_install_handler(dev->vectors[i], vblk_handler);
+	} else irq_install_handler(dev->irq+32, vblk_handler);
+#endif
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK|VIRTIO_CONFIG_S_DRIVER_OK);
+
+	LOG_INFO("vblk: %llu sectors, block size %u, %u queues with %u descriptors, %s descriptors, %u KiB per request\n",
+		dev->capacity, dev->blk_size, dev->nr_queues, dev->queues[0].vring.num,
+		VBLK_HAS(dev, VIRTIO_RING_F_INDIRECT_DESC) ? "indirect" : "direct", dev->max_xfer >> 10);
+
+	return 0;
+
+failed:
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_FAILED);
+	vblk_msix_release(dev);
+
+	return -ENODEV;
+}
+#else
+/* virtio-mmio block devices aren't supported yet */
+static inline int vblk_setup(vblk_t* dev)
+{
+	return -ENODEV;
+}
+#endif
+
+static int vblk_init(void)
+{
+	vblk_t* dev;
+
+	if (vblk)
+		return 0;
+
+	dev = kmalloc(sizeof(vblk_t));
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENOMEM;
+	memset(dev, 0x00, sizeof(vblk_t));
+
+	// the memory of the queues isn't released, the device may still use it
+	if (vblk_setup(dev)) {
+		if (!dev->nr_queues)
+			kfree(dev);
+		return -ENODEV;
+	}
+
+	vblk = dev;
+
+	return 0;
+}
+
+const blk_driver_t vblk_driver = {
+	.name = "virtio-blk",
+	.init = vblk_init,
+	.info = vblk_info,
+	.submit = vblk_submit,
+	.poll = vblk_poll,
+	.wait = vblk_wait
+};
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __BLOCK_VIRTIO_BLK_H__
+#define __BLOCK_VIRTIO_BLK_H__
+
+#include <hermit/stddef.h>
+#include <hermit/block.h>
+#include <hermit/virtio_ring.h>
+#include <hermit/virtio_blk.h>
+#include <hermit/spinlock.h>
+#include <asm/pci.h>
+#include <virtio/vpci.h>
+
+/* header and status of a request, which the device reads and writes */
+typedef struct vblk_slot {
+	struct virtio_blk_outhdr hdr;
+	uint8_t status;
+	uint8_t reserved[15];
+} vblk_slot_t;
+
+typedef struct
+{
+	struct vring vring;
+	/* index of the queue, which is used to notify the host */
+	uint16_t index;
+	/* notification register of the queue */
+	volatile uint16_t* notify;
+	uint16_t last_seen_used;
+	/* avail index at the last notification of the host */
+	uint16_t last_kick;
+	/* head of the free descriptor list, chained by desc[].next */
+	uint16_t free_head;
+	/* number of free descriptors */
+	uint16_t nr_free;
+	/* protects the ring against the completion interrupt and other pollers */
+	spinlock_irqsave_t lock;
+	/* headers and status bytes, indexed by the head descriptor */
+	vblk_slot_t* slots;
+	size_t slots_phys;
+	/* indirect descriptor tables (VIRTIO_RING_F_INDIRECT_DESC), one per descriptor */
+	struct vring_desc* indirect;
+	size_t indirect_phys;
+	/* in-flight requests, indexed by the head descriptor */
+	blk_request_t** reqs;
+	/* number of descriptors per in-flight request, indexed by the head descriptor */
+	uint16_t* ndesc;
+	/* statistics */
+	uint64_t submitted;
+	uint64_t completed;
+	uint64_t kicks;
+	uint64_t interrupts;
+} vblk_queue_t;
+
+typedef struct
+{
+	pci_info_t pci;
+	uint8_t irq;
+	uint8_t msix_enabled;
+	/* modern interface (virtio 1.x) */
+	vpci_t vpci;
+	/* negotiated features */
+	uint64_t features;
+	/* capacity in sectors */
+	uint64_t capacity;
+	uint32_t blk_size;
+	/* maximum number of data descriptors and bytes per request */
+	uint16_t max_segs;
+	uint32_t max_xfer;
+	uint16_t nr_queues;
+	/* MSI-X vector of each queue */
+	int vectors[BLK_MAX_QUEUES];
+	uint16_t nr_vectors;
+	vblk_queue_t queues[BLK_MAX_QUEUES];
+} vblk_t;
+
+#endif
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/*
+ * Driver of virtio-fs devices with the modern PCI interface (virtio 1.x).
+ *
+ * A FUSE request is a chain of direct descriptors: one per physically
+ * contiguous part of the buffers, which the device reads, followed by the
+ * parts of the buffers, which it writes. The submitter sleeps until the
+ * interrupt reports the used chain. FORGET requests aren't answered, they
+ * are posted to the high priority queue from the slot of their head
+ * descriptor and are reclaimed by the next completion.
+ *
+ * The shared memory region of the device (the DAX window) is mapped
+ * cacheable into the kernel, because the host backs it with its page
+ * cache and not with device registers.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/stdlib.h>
+#include <hermit/processor.h>
+#include <hermit/tasks.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/virtiofs.h>
+#include <hermit/virtio_fs.h>
+#include <hermit/virtio_ring.h>
+#include <hermit/virtio_pci.h>
+#include <hermit/virtio_ids.h>
+#include <hermit/vma.h>
+#include <asm/page.h>
+#include <asm/io.h>
+#include <asm/irq.h>
+#include <asm/pci.h>
+#include <fs/virtio_fs.h>
+#include <virtio/vpci.h>
+
+#define VENDOR_ID 0x1AF4
+/* device ID of a file system device, which has only the modern interface (0x1040 + device type) */
+#define VIOFS_MODERN_ID	(0x1040 + VIRTIO_ID_FS)
+#define QUEUE_LIMIT	128
+#define VIOFS_RETRIES	1000
+
+/* a buffer of VIRTIOFS_MAX_IO bytes, which doesn't start at a page boundary, spans one more page */
+#define VIOFS_MAX_DESC	((VIRTIOFS_MAX_IO >> PAGE_BITS) + 8)
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+static viofs_t* viofs = NULL;
+
+static inline void viofs_kick(viofs_queue_t* vq)
+{
+	// besure that the avail index is written before we read the flags
+	mb();
+
+	if (vring_need_kick(&vq->vring, 0, 0))
+		vpci_notify(vq->notify, vq->index);
+}
+
+/*
+ * Describe a buffer by one descriptor per physically contiguous part.
+ *
+ * @return number of descriptors or -EINVAL, if more than max are needed
+ */
+static int viofs_segments(const void* buf, size_t len, uint16_t flags, struct vring_desc* segs, int max)
+{
+	size_t addr = (size_t) buf;
+	size_t end = addr + len;
+	int n = 0;
+
+	while (addr < end) {
+		size_t chunk = MIN(PAGE_SIZE - (addr & (PAGE_SIZE-1)), end - addr);
+		size_t phys;
+
+		// map lazily allocated pages, before their physical address is taken
+		(void) *((volatile uint8_t*) addr);
+		phys = virt_to_phys(addr);
+
+		if (n && (segs[n-1].addr + segs[n-1].len == phys)) {
+			segs[n-1].len += chunk;
+		} else {
+			if (BUILTIN_EXPECT(n >= max, 0))
+				return -EINVAL;
+
+			segs[n].addr = phys;
+			segs[n].len = chunk;
+			segs[n].flags = flags;
+			n++;
+		}
+
+		addr += chunk;
+	}
+
+	return n;
+}
+
+/* return the used chains to the free list and wake up their submitters */
+static void viofs_complete(viofs_queue_t* vq)
+{
+	spinlock_irqsave_lock(&vq->lock);
+
+	while (vq->last_seen_used != vq->vring.used->idx) {
+		struct vring_used_elem* used;
+		viofs_req_t* req;
+		uint16_t head, tail;
+
+		// read the used element after the index
+		mb();
+		used = &vq->vring.used->ring[vq->last_seen_used % vq->vring.num];
+		head = used->id;
+		vq->last_seen_used++;
+
+		if (BUILTIN_EXPECT((head >= vq->vring.num) || !vq->ndesc[head], 0)) {
+			LOG_ERROR("viofs: device completes unknown descriptor %u (queue %u)\n", head, vq->index);
+			continue;
+		}
+
+		tail = head;
+		for(uint16_t i=1; i<vq->ndesc[head]; i++)
+			tail = vq->vring.desc[tail].next;
+		vq->vring.desc[tail].next = vq->free_head;
+		vq->free_head = head;
+		vq->nr_free += vq->ndesc[head];
+		vq->ndesc[head] = 0;
+		vq->completed++;
+
+		// FORGET requests don't have a submitter, which waits
+		req = vq->reqs[head];
+		vq->reqs[head] = NULL;
+		if (req) {
+			tid_t waiter = req->waiter;
+
+			req->done = 1;
+			if (waiter)
+				wakeup_task(waiter);
+		}
+	}
+
+	spinlock_irqsave_unlock(&vq->lock);
+}
+
+/* wait under the queue lock, until total descriptors are free */
+static void viofs_reserve(viofs_queue_t* vq, uint16_t total)
+{
+	while (vq->nr_free < total) {
+		spinlock_irqsave_unlock(&vq->lock);
+		viofs_complete(vq);
+		reschedule();
+		spinlock_irqsave_lock(&vq->lock);
+	}
+}
+
+/*
+ * Post a chain, which the caller has built in chain. The caller holds the
+ * queue lock and has reserved the descriptors by viofs_reserve().
+ *
+ * @return head descriptor of the chain
+ */
+static uint16_t viofs_post(viofs_queue_t* vq, const struct vring_desc* chain, uint16_t total, viofs_req_t* req)
+{
+	uint16_t head, id;
+
+	// the free list already links the descriptors of the chain
+	head = id = vq->free_head;
+	for(uint16_t i=0; i<total; i++) {
+		struct vring_desc* desc = vq->vring.desc + id;
+
+		desc->addr = chain[i].addr;
+		desc->len = chain[i].len;
+		desc->flags = chain[i].flags | ((i+1 < total) ? VRING_DESC_F_NEXT : 0);
+		id = desc->next;
+	}
+	vq->free_head = id;
+	vq->nr_free -= total;
+	vq->ndesc[head] = total;
+	vq->reqs[head] = req;
+
+	vq->vring.avail->ring[vq->vring.avail->idx % vq->vring.num] = head;
+	// the device has to see the descriptors before the new index
+	mb();
+	vq->vring.avail->idx++;
+	vq->submitted++;
+
+	viofs_kick(vq);
+
+	return head;
+}
+
+int viofs_request(const viofs_buf_t* in, uint32_t nr_in, const viofs_buf_t* out, uint32_t nr_out)
+{
+	struct vring_desc chain[VIOFS_MAX_DESC];
+	viofs_t* dev = viofs;
+	viofs_queue_t* vq;
+	viofs_req_t req;
+	uint16_t total = 0;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+
+	for(uint32_t i=0; i<nr_in+nr_out; i++) {
+		const viofs_buf_t* b = (i < nr_in) ? in + i : out + (i - nr_in);
+		int n;
+
+		if (!b->len)
+			continue;
+
+		// the device writes the buffers of the reply
+		n = viofs_segments(b->buf, b->len, (i < nr_in) ? 0 : VRING_DESC_F_WRITE,
+			chain + total, VIOFS_MAX_DESC - total);
+		if (n < 0)
+			return n;
+		total += n;
+	}
+
+	vq = dev->queues + VIRTIO_FS_REQUEST_QUEUE;
+	if (BUILTIN_EXPECT(!total || (total > vq->vring.num), 0))
+		return -EINVAL;
+
+	req.waiter = 0;
+	req.done = 0;
+
+	spinlock_irqsave_lock(&vq->lock);
+	viofs_reserve(vq, total);
+	viofs_post(vq, chain, total, &req);
+
+	// the done flag is set under the queue lock => no wakeup is lost
+	while (!req.done) {
+		req.waiter = per_core(current_task)->id;
+		block_current_task();
+		spinlock_irqsave_unlock(&vq->lock);
+
+		reschedule();
+
+		spinlock_irqsave_lock(&vq->lock);
+	}
+
+	spinlock_irqsave_unlock(&vq->lock);
+
+	return 0;
+}
+
+int viofs_forget(uint64_t nodeid, uint64_t nlookup)
+{
+	struct vring_desc desc;
+	viofs_t* dev = viofs;
+	viofs_queue_t* vq;
+	viofs_forget_t* f;
+	uint16_t head;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+
+	vq = dev->queues + VIRTIO_FS_HIPRIO_QUEUE;
+
+	// a chain of a single descriptor => the request is placed in the slot of the head
+	spinlock_irqsave_lock(&vq->lock);
+	viofs_reserve(vq, 1);
+	head = vq->free_head;
+
+	f = dev->forgets + head;
+	memset(f, 0x00, sizeof(viofs_forget_t));
+	f->hdr.len = sizeof(viofs_forget_t);
+	f->hdr.opcode = FUSE_FORGET;
+	f->hdr.nodeid = nodeid;
+	f->arg.nlookup = nlookup;
+
+	desc.addr = dev->forgets_phys + head * sizeof(viofs_forget_t);
+	desc.len = sizeof(viofs_forget_t);
+	desc.flags = 0;
+
+	viofs_post(vq, &desc, 1, NULL);
+	spinlock_irqsave_unlock(&vq->lock);
+
+	return 0;
+}
+
+int viofs_dax_window(uint8_t** virt, size_t* phys, size_t* len)
+{
+	viofs_t* dev = viofs;
+
+	if (BUILTIN_EXPECT(!dev || !dev->dax_virt, 0))
+		return -ENODEV;
+
+	if (virt)
+		*virt = dev->dax_virt;
+	if (phys)
+		*phys = dev->dax_phys;
+	if (len)
+		*len = dev->dax_len;
+
+	return 0;
+}
+
+#ifdef __x86_64__
+static void viofs_handler(struct state* s)
+{
+	viofs_t* dev = viofs;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return;
+
+	// reading the isr register acknowledges the interrupt
+	if (!(vpci_isr(&dev->vpci) & 0x01))
+		return;
+
+	viofs_complete(dev->queues + VIRTIO_FS_REQUEST_QUEUE);
+	viofs_complete(dev->queues + VIRTIO_FS_HIPRIO_QUEUE);
+}
+
+static int viofs_queue_init(viofs_t* dev, viofs_queue_t* vq, uint16_t index)
+{
+	size_t vring_phys, driver, device;
+	uint32_t total_size;
+	uint16_t num;
+	void* vring_base;
+
+	memset(vq, 0x00, sizeof(viofs_queue_t));
+	vq->index = index;
+
+	num = vpci_queue_size(&dev->vpci, index, QUEUE_LIMIT);
+	if (!num)
+		return -ENODEV;
+
+	total_size = vring_size(num, PAGE_SIZE);
+	vring_base = page_alloc(total_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	vq->reqs = kmalloc(num * sizeof(viofs_req_t*));
+	vq->ndesc = kmalloc(num * sizeof(uint16_t));
+	if (BUILTIN_EXPECT(!vring_base || !vq->reqs || !vq->ndesc, 0)) {
+		LOG_ERROR("viofs: not enough memory to create queue %u\n", index);
+		return -ENOMEM;
+	}
+
+	memset(vring_base, 0x00, total_size);
+	memset(vq->reqs, 0x00, num * sizeof(viofs_req_t*));
+	memset(vq->ndesc, 0x00, num * sizeof(uint16_t));
+	vring_phys = virt_to_phys((size_t) vring_base);
+	vring_init(&vq->vring, num, vring_base, PAGE_SIZE);
+	spinlock_irqsave_init(&vq->lock);
+
+	// chain all descriptors to the free list
+	for(uint16_t i=0; i<num; i++)
+		vq->vring.desc[i].next = i + 1;
+	vq->free_head = 0;
+	vq->nr_free = num;
+
+	driver = vring_phys + ((size_t) vq->vring.avail - (size_t) vring_base);
+	device = vring_phys + ((size_t) vq->vring.used - (size_t) vring_base);
+
+	// the device uses the legacy interrupt only
+	return vpci_queue_enable(&dev->vpci, index, vring_phys, driver, device, VIRTIO_MSI_NO_VECTOR, &vq->notify);
+}
+
+/*
+ * Map the first VIRTIOFS_DAX_SIZE bytes of the DAX window. Unlike the
+ * registers of the device (see pci_map_bar), the window is cacheable.
+ */
+static int viofs_dax_setup(viofs_t* dev)
+{
+	size_t phys, len, viraddr;
+	uint64_t size;
+
+	if (vpci_find_shm(&dev->pci, VIRTIO_FS_SHMCAP_ID_CACHE, &phys, &size))
+		return -ENODEV;
+
+	// the window is used in chunks, which are mapped at aligned offsets
+	len = MIN(size, (uint64_t) VIRTIOFS_DAX_SIZE) & ~(VIRTIOFS_CHUNK_SIZE-1);
+	if (!len || (phys & (PAGE_SIZE-1)))
+		return -ENODEV;
+
+	viraddr = vma_alloc(len, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return -ENOMEM;
+
+	if (BUILTIN_EXPECT(page_map(viraddr, phys, len >> PAGE_BITS, PG_GLOBAL|PG_RW), 0)) {
+		vma_free(viraddr, viraddr + len);
+		return -ENOMEM;
+	}
+
+	dev->dax_virt = (uint8_t*) viraddr;
+	dev->dax_phys = phys;
+	dev->dax_len = len;
+
+	return 0;
+}
+
+static int viofs_setup(viofs_t* dev)
+{
+	pci_info_t pci_info;
+	uint64_t features;
+	uint16_t num;
+	uint8_t status;
+
+	// virtio-fs devices don't have a legacy interface
+	if (pci_get_device_info(VENDOR_ID, VIOFS_MODERN_ID, PCI_IGNORE_SUBID, &pci_info, 1))
+		return -ENODEV;
+
+	LOG_INFO("Found viofs (Vendor ID 0x%x, Device Id 0x%x)\n", VENDOR_ID, VIOFS_MODERN_ID);
+
+	dev->pci = pci_info;
+	dev->irq = pci_info.irq;
+
+	if (vpci_setup(&dev->vpci, &dev->pci)) {
+		LOG_ERROR("viofs: the device doesn't provide the virtio 1.x interface\n");
+		return -ENODEV;
+	}
+
+	vpci_reset(&dev->vpci, VIOFS_RETRIES);
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE);
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER);
+
+	features = vpci_get_features(&dev->vpci);
+	LOG_INFO("viofs: host features 0x%llx\n", features);
+	if (!(features & (1ULL << VIRTIO_F_VERSION_1))) {
+		LOG_ERROR("viofs: the host doesn't support virtio 1.x\n");
+		goto failed;
+	}
+
+	dev->features = 1ULL << VIRTIO_F_VERSION_1;
+	vpci_set_features(&dev->vpci, dev->features);
+
+	// tell the device that the features are OK and check, if the host accepts them
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK);
+	status = vpci_get_status(&dev->vpci);
+	if (!(status & VIRTIO_CONFIG_S_FEATURES_OK)) {
+		LOG_ERROR("viofs: device features are ignored: status 0x%x\n", (uint32_t) status);
+		goto failed;
+	}
+
+	vpci_cfg_read(&dev->vpci, __builtin_offsetof(struct virtio_fs_config, tag), dev->tag, sizeof(dev->tag)-1);
+
+	// we use only the first request queue
+	for(uint16_t i=0; i<2; i++) {
+		if (viofs_queue_init(dev, dev->queues+i, i))
+			goto failed;
+	}
+
+	num = dev->queues[VIRTIO_FS_HIPRIO_QUEUE].vring.num;
+	dev->forgets = page_alloc(num * sizeof(viofs_forget_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!dev->forgets, 0))
+		goto failed;
+	dev->forgets_phys = virt_to_phys((size_t) dev->forgets);
+
+	if (viofs_dax_setup(dev))
+		LOG_INFO("viofs: no DAX window available\n");
+
+	irq_install_handler(dev->irq+32, viofs_handler);
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK|VIRTIO_CONFIG_S_DRIVER_OK);
+
+	LOG_INFO("viofs: tag \"%s\", %u descriptors, DAX window of %zd MiB at 0x%zx\n",
+		dev->tag, dev->queues[VIRTIO_FS_REQUEST_QUEUE].vring.num, dev->dax_len >> 20, dev->dax_phys);
+
+	return 0;
+
+failed:
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_FAILED);
+
+	return -ENODEV;
+}
+#else
+/* virtio-mmio file system devices aren't supported yet */
+static inline int viofs_setup(viofs_t* dev)
+{
+	return -ENODEV;
+}
+#endif
+
+int viofs_init(void)
+{
+	viofs_t* dev;
+
+	if (viofs)
+		return 0;
+
+	dev = kmalloc(sizeof(viofs_t));
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENOMEM;
+	memset(dev, 0x00, sizeof(viofs_t));
+
+	// the memory of the queues isn't released, the device may still use it
+	if (viofs_setup(dev)) {
+		if (!dev->queues[0].reqs)
+			kfree(dev);
+		return -ENODEV;
+	}
+
+	viofs = dev;
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __FS_VIRTIO_FS_H__
+#define __FS_VIRTIO_FS_H__
+
+#include <hermit/stddef.h>
+#include <hermit/virtio_ring.h>
+#include <hermit/virtio_fs.h>
+#include <hermit/fuse_kernel.h>
+#include <hermit/spinlock.h>
+#include <asm/pci.h>
+#include <virtio/vpci.h>
+
+/* a request, which is awaited by its submitter */
+typedef struct viofs_req {
+	/* task, which sleeps until the device has used the request */
+	tid_t waiter;
+	volatile int done;
+} viofs_req_t;
+
+typedef struct
+{
+	struct vring vring;
+	/* index of the queue, which is used to notify the host */
+	uint16_t index;
+	/* notification register of the queue */
+	volatile uint16_t* notify;
+	uint16_t last_seen_used;
+	/* head of the free descriptor list, chained by desc[].next */
+	uint16_t free_head;
+	/* number of free descriptors */
+	uint16_t nr_free;
+	/* protects the ring against the completion interrupt */
+	spinlock_irqsave_t lock;
+	/* in-flight requests, indexed by the head descriptor */
+	viofs_req_t** reqs;
+	/* number of descriptors per in-flight request, indexed by the head descriptor */
+	uint16_t* ndesc;
+	/* statistics */
+	uint64_t submitted;
+	uint64_t completed;
+} viofs_queue_t;
+
+/* FORGET request, which is placed in the slot of its head descriptor */
+typedef struct viofs_forget {
+	struct fuse_in_header hdr;
+	struct fuse_forget_in arg;
+} viofs_forget_t;
+
+typedef struct
+{
+	pci_info_t pci;
+	uint8_t irq;
+	/* modern interface (virtio 1.x) */
+	vpci_t vpci;
+	/* negotiated features */
+	uint64_t features;
+	/* name of the file system, which the host exports */
+	char tag[37];
+	/* DAX window: mapped cacheable into the kernel */
+	uint8_t* dax_virt;
+	size_t dax_phys;
+	size_t dax_len;
+	/* high priority queue (FORGET) and the request queue */
+	viofs_queue_t queues[2];
+	/* FORGET requests, indexed by the head descriptor of the high priority queue */
+	viofs_forget_t* forgets;
+	size_t forgets_phys;
+} viofs_t;
+
+#endif
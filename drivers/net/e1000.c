@@ -44,6 +44,7 @@
 #include <lwip/ethip6.h>
 #include <netif/etharp.h>
 #include <net/e1000.h>
+#include <net/pbufcache.h>
 
 #if USE_E1000
 
@@ -126,6 +127,25 @@ static inline void e1000_flush(volatile uint8_t* base)
 	e1000_read(base, E1000_STATUS);
 }
 
+/* announce the pending TX descriptors to the device */
+static inline void e1000_tx_flush(e1000if_t* e1000if)
+{
+	if (e1000if->tx_pending) {
+		e1000if->tx_pending = 0;
+		NETSTATS_INC(&e1000if->stats, kicks);
+		e1000_write(e1000if->bar0, E1000_TDT, e1000if->tx_tail);
+	}
+}
+
+/* this function is called in the context of the tcpip thread, after the queued requests are processed */
+static void e1000if_tx_flush_cb(void* ctx)
+{
+	e1000if_t* e1000if = (e1000if_t*) ctx;
+
+	e1000if->tx_flush_scheduled = 0;
+	e1000_tx_flush(e1000if);
+}
+
 #if 1
 static uint16_t eeprom_read(volatile uint8_t* base, uint8_t addr)
 {
@@ -173,11 +193,16 @@ static err_t e1000if_output(struct netif* netif, struct pbuf* p)
 
 	if (BUILTIN_EXPECT((p->tot_len > 1792) || (p->tot_len > TX_BUF_LEN), 0)) {
 		LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_output: packet is longer than 1792 bytes\n"));
+		NETSTATS_INC(&e1000if->stats, tx_drops);
 		return ERR_IF;
 	}
 
 	if (!(e1000if->tx_desc[e1000if->tx_tail].status & 0xF)) {
 		LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_output: %i already inuse\n", e1000if->tx_tail));
+		NETSTATS_INC(&e1000if->stats, tx_ring_full);
+		NETSTATS_INC(&e1000if->stats, tx_drops);
+		// the device has to drain the ring
+		e1000_tx_flush(e1000if);
 		return ERR_IF;
 	}
 
@@ -198,30 +223,58 @@ static err_t e1000if_output(struct netif* netif, struct pbuf* p)
 	e1000if->tx_desc[e1000if->tx_tail].status = 0;
 	e1000if->tx_desc[e1000if->tx_tail].cmd = (1 << 3) | 3;
 
-	// update the tail so the hardware knows it's ready
 	e1000if->tx_tail = (e1000if->tx_tail + 1) % NUM_TX_DESCRIPTORS;
-	e1000_write(e1000if->bar0, E1000_TDT, e1000if->tx_tail);
+	e1000if->tx_pending++;
+
+	/*
+	 * Each write of the tail is an MMIO exit on emulated devices
+	 * => update the tail per batch or, if the tcpip thread has
+	 * processed the queued requests, for the remaining packets
+	 */
+	if (e1000if->tx_pending >= E1000_TX_BATCH) {
+		e1000_tx_flush(e1000if);
+	} else if (!e1000if->tx_flush_scheduled) {
+#if NO_SYS
+		e1000_tx_flush(e1000if);
+#else
+		e1000if->tx_flush_scheduled = 1;
+		if (BUILTIN_EXPECT(tcpip_trycallback(e1000if->tx_flush_msg) != ERR_OK, 0)) {
+			e1000if->tx_flush_scheduled = 0;
+			e1000_tx_flush(e1000if);
+		}
+#endif
+	}
 
 #if ETH_PAD_SIZE
 	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
 
 	LINK_STATS_INC(link.xmit);
+	NETSTATS_TX(&e1000if->stats, p->tot_len);
 
 	return ERR_OK;
 }
 
-static void e1000_rx_inthandler(struct netif* netif)
+/*
+ * Process up to budget received packets
+ *
+ * @return number of processed packets
+ */
+static int e1000_rx_inthandler(struct netif* netif, int budget)
 {
 	e1000if_t* e1000if = netif->state;
 	struct pbuf *p = NULL;
 	struct pbuf* q;
 	uint16_t length, i;
+	int work = 0;
 
-	while(e1000if->rx_desc[e1000if->rx_tail].status & (1 << 0))
+	while((work < budget) && (e1000if->rx_desc[e1000if->rx_tail].status & (1 << 0)))
 	{
+		work++;
+
 		if (!(e1000if->rx_desc[e1000if->rx_tail].status & (1 << 1))) {
 			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&e1000if->stats, rx_drops);
 			goto no_eop; // currently, we ignore packets without EOP flag
 		}
 
@@ -232,7 +285,7 @@ static void e1000_rx_inthandler(struct netif* netif)
 			length += ETH_PAD_SIZE; /* allow room for Ethernet padding */
 #endif
 
-			p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
+			p = pbuf_cache_alloc(length);
 			if (p) {
 #if ETH_PAD_SIZE
 				pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
@@ -247,35 +300,46 @@ static void e1000_rx_inthandler(struct netif* netif)
 				LINK_STATS_INC(link.recv);
 
 				// forward packet to LwIP
-				netif->input(p, netif);
+				if (netstats_input(&e1000if->stats, netif, p, 0) != ERR_OK)
+					pbuf_free(p);
 			} else {
 				LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_rx_inthandler: not enough memory!\n"));
 				LINK_STATS_INC(link.memerr);
 				LINK_STATS_INC(link.drop);
+				NETSTATS_INC(&e1000if->stats, rx_drops);
 			}
 		} else {
 			LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_rx_inthandler: RX errors (0x%x)\n", e1000if->rx_desc[e1000if->rx_tail].errors));
 			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&e1000if->stats, rx_drops);
 		}
 
 no_eop:
 		e1000if->rx_desc[e1000if->rx_tail].status = 0;
-
-		// update tail and write the value to the device
 		e1000if->rx_tail = (e1000if->rx_tail + 1) % NUM_RX_DESCRIPTORS;
+	}
+
+	// return the processed descriptors with one write of the tail
+	if (work) {
+		NETSTATS_INC(&e1000if->stats, kicks);
 		e1000_write(e1000if->bar0, E1000_RDT, e1000if->rx_tail);
 	}
 
-	e1000if->polling = 0;
-	// enable all known interrupts
-	e1000_write(e1000if->bar0, E1000_IMS, INT_MASK);
-	e1000_flush(e1000if->bar0);
+	return work;
+}
+
+static int e1000if_napi_poll(napi_t* napi, int budget)
+{
+	return e1000_rx_inthandler(napi->netif, budget);
 }
 
-/* this function is called in the context of the tcpip thread or the irq handler (by using NO_SYS) */
-static void e1000if_poll(void* ctx)
+static void e1000if_napi_enable(napi_t* napi)
 {
-	e1000_rx_inthandler(mynetif);
+	e1000if_t* e1000if = napi->netif->state;
+
+	// enable all known interrupts
+	e1000_write(e1000if->bar0, E1000_IMS, INT_MASK);
+	e1000_flush(e1000if->bar0);
 }
 
 static void e1000if_handler(struct state* s)
@@ -283,6 +347,8 @@ static void e1000if_handler(struct state* s)
 	e1000if_t* e1000if = mynetif->state;
 	uint32_t icr;
 
+	NETSTATS_INC(&e1000if->stats, interrupts);
+
 	// disable all interrupts
 	e1000_write(e1000if->bar0, E1000_IMC, INT_MASK|0xFFFE0000);
 	e1000_flush(e1000if->bar0);
@@ -303,20 +369,10 @@ static void e1000if_handler(struct state* s)
 	if (icr &  (E1000_ICR_RXT0|E1000_ICR_RXDMT0|E1000_ICR_RXO)) {
 		icr &= ~(E1000_ICR_RXT0|E1000_ICR_RXDMT0|E1000_ICR_RXO);
 
-		if (!e1000if->polling) {
-#if NO_SYS
-			e1000if_poll(NULL);
-#else
-			if (tcpip_callback_with_block(e1000if_poll, NULL, 0) == ERR_OK) {
-				e1000if->polling = 1;
-			} else {
-				LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_handler: unable to send a poll request to the tcpip thread\n"));
-			}
-#endif
- 		}
+		napi_schedule(&e1000if->napi);
 	}
 
-	if (e1000if->polling) // now, the tcpip thread will check for incoming messages
+	if (napi_scheduled(&e1000if->napi)) // now, the polling context will check for incoming messages
 		e1000_write(e1000if->bar0, E1000_IMS, INT_MASK_NO_RX);
 	else
 		e1000_write(e1000if->bar0, E1000_IMS, INT_MASK); // enable interrupts
@@ -371,6 +427,7 @@ err_t e1000if_init(struct netif* netif)
 
 	netif->state = e1000if;
 	mynetif = netif;
+	netstats_register(netif, &e1000if->stats);
 
 	e1000if->bar0 = (uint8_t*) vma_alloc(PAGE_CEIL(pci_info.size[0]), VMA_READ|VMA_WRITE);
 	if (BUILTIN_EXPECT(!e1000if->bar0, 0))
@@ -387,6 +444,7 @@ err_t e1000if_init(struct netif* netif)
 	udelay(10);
 
 	e1000if->irq = pci_info.irq;
+	e1000if->vector = pci_info.irq+32;
 	e1000if->rx_desc = page_alloc(NUM_RX_DESCRIPTORS*sizeof(rx_desc_t), VMA_READ|VMA_WRITE);
 	if (BUILTIN_EXPECT(!e1000if->rx_desc, 0))
 		goto oom;
@@ -499,8 +557,45 @@ err_t e1000if_init(struct netif* netif)
 		e1000_write(e1000if->bar0, E1000_MTA + (tmp8 * 4), 0);
 	e1000_flush(e1000if->bar0);
 
+	if (BUILTIN_EXPECT(napi_init(&e1000if->napi, netif, e1000if_napi_poll, e1000if_napi_enable), 0)) {
+		LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_init: unable to initialize the polling context\n"));
+		goto oom;
+	}
+
+#if !NO_SYS
+	e1000if->tx_flush_msg = tcpip_callbackmsg_new(e1000if_tx_flush_cb, e1000if);
+	if (BUILTIN_EXPECT(!e1000if->tx_flush_msg, 0)) {
+		LWIP_DEBUGF(NETIF_DEBUG, ("e1000if_init: unable to allocate the TX flush message\n"));
+		goto oom;
+	}
+#endif
+
+	/*
+	 * Interrupt moderation: ITR limits the interrupt rate (interval in
+	 * units of 256 ns), RDTR/RADV delay the RX interrupt to coalesce
+	 * packets. Under load, NAPI polls the device with masked interrupts.
+	 */
+	if (E1000_ITR_RATE > 0)
+		e1000_write(e1000if->bar0, E1000_ITR, 1000000000UL / (E1000_ITR_RATE * 256UL));
+	else
+		e1000_write(e1000if->bar0, E1000_ITR, 0);
+	e1000_write(e1000if->bar0, E1000_RDTR, E1000_RX_DELAY);
+	if (E1000_RX_DELAY > 0)
+		e1000_write(e1000if->bar0, E1000_RADV, 4 * E1000_RX_DELAY);
+	e1000_flush(e1000if->bar0);
+
+	// prefer MSI, which isn't shared with other devices
+	if (pci_info.msi_cap) {
+		int vector = irq_alloc_vector();
+
+		if ((vector >= 0) && (pci_msi_enable(&pci_info, vector, irq_default_core(0)) == 0))
+			e1000if->vector = vector;
+		else if (vector >= 0)
+			irq_free_vector(vector);
+	}
+
 	// set IRQ handler
-	irq_install_handler(e1000if->irq+32, e1000if_handler);
+	irq_install_handler(e1000if->vector, e1000if_handler);
 
 	/* make sure receives are disabled while setting up the descriptors */
 	tmp32 = e1000_read(e1000if->bar0, E1000_RCTL);
@@ -595,7 +690,16 @@ oom:
 			// TODO: unmap e1000if->bar0
 		}
 
-		irq_uninstall_handler(e1000if->irq+32);
+#if !NO_SYS
+		if (e1000if->tx_flush_msg)
+			tcpip_callbackmsg_delete(e1000if->tx_flush_msg);
+#endif
+
+		if (e1000if->vector >= IRQ_DYN_FIRST) {
+			pci_msi_disable(&pci_info);
+			irq_free_vector(e1000if->vector);
+		} else if (e1000if->vector)
+			irq_uninstall_handler(e1000if->vector);
 
 		kfree(e1000if);
 	}
@@ -31,6 +31,8 @@
 
 #include <hermit/stddef.h>
 #include <hermit/spinlock.h>
+#include <net/napi.h>
+#include <net/netstats.h>
 
 #ifdef USE_E1000
 
@@ -57,6 +59,8 @@
 #define E1000_RDLEN	0x02808	/* RX Descriptor Length - RW */
 #define E1000_RDH	0x02810	/* RX Descriptor Head - RW */
 #define E1000_RDT	0x02818	/* RX Descriptor Tail - RW */
+#define E1000_RDTR	0x02820	/* RX Delay Timer - RW */
+#define E1000_RADV	0x0282C	/* RX Interrupt Absolute Delay Timer - RW */
 #define E1000_TDBAL	0x03800	/* TX Descriptor Base Address Low - RW */
 #define E1000_TDBAH	0x03804	/* TX Descriptor Base Address High - RW */
 #define E1000_TDLEN	0x03808 /* TX Descriptor Length - RW */
@@ -314,10 +318,21 @@ typedef struct e1000if {
 	uint8_t*		rx_buffers;
 	volatile tx_desc_t*	tx_desc; // transmit descriptor buffer
 	uint16_t		tx_tail;
+	/* number of descriptors, which aren't announced to the device (TDT) */
+	uint16_t		tx_pending;
+	/* a flush of the TX tail is scheduled at the tcpip thread */
+	uint8_t			tx_flush_scheduled;
+	/* preallocated message to schedule the flush */
+	struct tcpip_callback_msg* tx_flush_msg;
 	volatile rx_desc_t*	rx_desc; // receive descriptor buffer
 	uint16_t		rx_tail;
 	uint8_t			irq;
-	volatile uint8_t	polling;
+	/* interrupt vector (legacy IRQ or MSI) */
+	uint8_t			vector;
+	/* polling context of the RX path */
+	napi_t			napi;
+	/* per-interface statistics */
+	netstats_t		stats;
 } e1000if_t;
 
 /*
@@ -50,8 +50,17 @@
  * - Removing of SCC related code (by Stefan Lankes)
  */
 
+/*
+ * The rings and slots may also be placed in the shared memory of an
+ * ivshmem device (ivshmem-doorbell with an ivshmem-server), which
+ * connects unikernels in separate virtual machines on the same host.
+ * Every VM is a node, its peer ID (IVPosition) is its index, and the
+ * doorbell register replaces the IPI.
+ */
+
 #include <hermit/stddef.h>
 #include <hermit/logging.h>
+#include <hermit/errno.h>
 
 #include <lwip/netif.h>		/* lwip netif */
 #include <lwip/netifapi.h>
@@ -66,15 +75,18 @@
 #include <hermit/semaphore.h>
 #include <hermit/spinlock.h>
 #include <hermit/time.h>
-#include <hermit/islelock.h>
 #include <asm/page.h>
 #include <asm/irq.h>
 #include <asm/irqflags.h>
 #if __x86_64__
 #include <asm/apic.h>
+#include <asm/pci.h>
 #endif
 
 #include <net/mmnif.h>
+#include <net/napi.h>
+#include <net/netstats.h>
+#include <net/pbufcache.h>
 
 #define TRUE	1
 #define FALSE	0
@@ -86,9 +98,18 @@
 
 #define MMNIF_AUTO_SOCKET_TIMEOUT       500
 
-#define MMNIF_RX_BUFFERLEN		(28*1024)
 #define MMNIF_IRQ			122
 
+/* ivshmem device: registers in BAR 0, shared memory in BAR 2 */
+#define IVSHMEM_VENDOR_ID		0x1AF4
+#define IVSHMEM_DEVICE_ID		0x1110
+#define IVSHMEM_INTR_MASK		0x00
+#define IVSHMEM_INTR_STATUS		0x04
+#define IVSHMEM_IV_POSITION		0x08
+#define IVSHMEM_DOORBELL		0x0C
+#define IVSHMEM_REGS_SIZE		0x100
+#define IVSHMEM_SHM_BAR			2
+
 #ifdef DEBUG_MMNIF
 #include <net/util.h>		/* hex dump */
 #endif
@@ -98,18 +119,27 @@
  */
 #define MMNIF_MAX_DESCRIPTORS		64
 
-#define MMNIF_STATUS_FREE		0x00
-#define MMNIF_STATUS_PENDING            0x01
-#define MMNIF_STATUS_RDY		0x02
-#define MMNIF_STATUS_INPROC		0x03
-#define MMNIF_STATUS_PROC		0x04
+/* every packet occupies one slot of the maximum packet size */
+#define MMNIF_SLOT_SIZE			1536
+#define MMNIF_MTU			1500
+
+#ifdef MMNIF_ZERO_COPY
+/* large frames, if the heap provides at least two slots per sender */
+#define MMNIF_BIG_SLOT_SIZE		(64*1024)
+#define MMNIF_BIG_MTU			0xFFFF
+#endif
+
+#if defined(MMNIF_ZERO_COPY) && LWIP_SUPPORT_CUSTOM_PBUF
+#define MMNIF_RX_ZERO_COPY		1
+/* small packets are cheaper to copy than to hold a whole slot */
+#define MMNIF_COPYBREAK			256
+#else
+#define MMNIF_RX_ZERO_COPY		0
+#endif
 
 // id of the HermitCore isle
 extern int32_t isle;
 extern int32_t possible_isles;
-extern char* phy_isle_locks;
-
-static spinlock_irqsave_t locallock;
 
 /* "message passing buffer" specific constants:
  * - start address
@@ -128,67 +158,44 @@ extern unsigned int heap_size;
 static struct netif* mmnif_dev = NULL;
 
 /*
+ * Every receiver owns one single-producer/single-consumer ring per sender.
+ * The rings are stored in the header of the receiver, the slots of the
+ * packets in its heap. The sender fills the slot head % mmnif_slots and
+ * increases head afterwards. The receiver copies the packet and releases
+ * the slot by increasing tail. Both counters are free running and it is
+ * the only writer of its counter. Therefore, no lock is required.
  */
-typedef struct mmnif_device_stats {
-	/* device stats (granularity in packets):
-	 * - recieve errors
-	 * - recieve successes
-	 * - recieved bytes
-	 * - transmit errors
-	 * - transmit successes
-	 * - transmitted bytes
-	 */
-	unsigned int rx_err;
-	unsigned int rx;
-	unsigned int rx_bytes;
-	unsigned int tx_err;
-	unsigned int tx;
-	unsigned int tx_bytes;
-
-	/* Heuristics :
-	 * - how many times an budget overflow occured
-	 * - how many times the polling thread polled without recieving a new message
-	 */
-	unsigned int bdg_overflow;
-	unsigned int pll_empty;
-} mmnif_device_stats_t;
-
-/* receive descror structure */
-typedef struct rx_desc {
-	/* stat : status of the descriptor
-	 * len  : length of the packet
-	 * addr : memory address of the packet
-	 * id   : packet id
-	 */
-	uint8_t stat;
-	uint16_t len;
-	size_t addr;
-} rx_desc_t;
-
-/* receive ring buffer structure */
-typedef struct mm_rx_buffer {
-	/* memory "pseudo-ring/heap"
-	 * packets are always in one single chunk of memory
-	 * head : head of allocated memory region
-	 * tail : tail of allocated memory region
-	 */
-	uint16_t head;
-	uint16_t tail;
-
-	/* descritpor queue
-	 * desc_table : descriptor table
-	 * dcount : descriptor's free in queue
-	 * dread : next descriptor to read
-	 * dwrite : next descriptor to write
-	 */
-	rx_desc_t desc_table[MMNIF_MAX_DESCRIPTORS];
-	uint8_t dcount;
-	uint8_t dread;
-	uint8_t dwrite;
-} mm_rx_buffer_t;
+typedef struct mmnif_ring {
+	/* written by the sender */
+	volatile uint32_t head;
+	uint8_t pad0[CACHE_LINE-sizeof(uint32_t)];
+	/* written by the receiver */
+	volatile uint32_t tail;
+	/* set while the receiver polls and doesn't need an interrupt */
+	volatile uint32_t polling;
+	uint8_t pad1[CACHE_LINE-2*sizeof(uint32_t)];
+	/* length of the packet in the slot, written by the sender */
+	volatile uint16_t len[MMNIF_MAX_DESCRIPTORS];
+} __attribute__ ((aligned (CACHE_LINE))) mmnif_ring_t;
+
+#if MMNIF_RX_ZERO_COPY
+/*
+ * Received packet, which LwIP references in the slot of the sender.
+ * The slots are released in order as soon as all previous ones are freed.
+ */
+typedef struct mmnif_rxbuf {
+	/* has to be the first element */
+	struct pbuf_custom pc;
+	struct mmnif* mmnif;
+	uint32_t src;
+	uint32_t pos;
+	uint8_t done;
+} mmnif_rxbuf_t;
+#endif
 
 typedef struct mmnif {
-	struct mmnif_device_stats stats;
+	/* per-interface statistics */
+	netstats_t stats;
 
 	/* Interface constants:
 	 * - ehternet address
@@ -197,30 +204,87 @@ typedef struct mmnif {
 	struct eth_addr *ethaddr;
 	uint32_t ipaddr;
 
-	// checks the TCPIP thread already the rx buffers?
-	volatile uint8_t check_in_progress;
+	/* polling context of the rx rings */
+	napi_t napi;
 
 	/* memory interaction variables:
-	 * - pointer to recive buffer
+	 * - pointer to our rings (one per sender)
+	 * - pointer to the slots of our rings
 	 */
-	volatile mm_rx_buffer_t *rx_buff;
+	volatile mmnif_ring_t *rx_rings;
 	uint8_t *rx_heap;
 
+	/* next packet to receive per sender */
+	uint32_t rx_next[MAX_ISLE];
+
+#if MMNIF_RX_ZERO_COPY
+	/* packets per sender, which LwIP holds in their slots */
+	uint32_t rx_held[MAX_ISLE];
+	/* one descriptor per slot of our rings */
+	mmnif_rxbuf_t *rx_bufs;
+	/* protects the release of the slots, LwIP frees pbufs on any core */
+	spinlock_irqsave_t rx_lock;
+#endif
+
 	/* semaphore to regulate polling vs. interrupts
 	 */
 	sem_t com_poll;
 } mmnif_t;
 
-// alread initialized by Linux
-static islelock_t* isle_locks = NULL;
+/* number of nodes (Linux and all isles) */
+static uint32_t mmnif_nodes = 0;
+
+/* slots per ring, a power of two */
+static uint32_t mmnif_slots = 0;
+
+/* size of a slot, which limits the frame size */
+static uint32_t mmnif_slot_size = MMNIF_SLOT_SIZE;
+
+/* shared memory of all nodes: the headers contain the rings, the heaps the slots */
+static uint8_t* mmnif_headers = NULL;
+static size_t mmnif_header_size = 0;
+static uint8_t* mmnif_heaps = NULL;
+static size_t mmnif_heap_size = 0;
+
+/* our node, its IP is 192.168.28.(mmnif_self + 1) */
+static uint32_t mmnif_self = 0;
+
+/* the ivshmem device, NULL if the nodes are the isles of a multi-kernel */
+typedef struct ivshmem {
+	pci_info_t pci;
+	volatile uint32_t* regs;
+	/* interrupt vector of the doorbell */
+	int vector;
+	uint8_t msix_enabled;
+} ivshmem_t;
+
+static ivshmem_t* ivshmem = NULL;
 
 // forward declaration
 static void mmnif_irqhandler(struct state* s);
+static int mmnif_napi_poll(napi_t *napi, int budget);
+static void mmnif_napi_enable(napi_t *napi);
+#if MMNIF_RX_ZERO_COPY
+static void mmnif_rx_free(struct pbuf* p);
+#endif
 
 /*
  *	memory maped interface helper functions
  */
 
+/* ring of sender src in the header of receiver dst (index = last octet of the IP - 1) */
+inline static volatile mmnif_ring_t* mmnif_ring(uint32_t dst, uint32_t src)
+{
+	return (volatile mmnif_ring_t*) (mmnif_headers + dst * mmnif_header_size) + src;
+}
+
+/* slot of the packet pos in the ring of sender src in the heap of receiver dst */
+inline static uint8_t* mmnif_slot(uint32_t dst, uint32_t src, uint32_t pos)
+{
+	return mmnif_heaps + dst * mmnif_heap_size
+		+ (src * mmnif_slots + (pos & (mmnif_slots - 1))) * mmnif_slot_size;
+}
+
 /* trigger an interrupt on the remote processor
  * so he knows there is a packet to read
  */
@@ -228,6 +292,13 @@ inline static int mmnif_trigger_irq(int dest_ip)
 {
 	int dest;
 
+	/* ring vector 0 of the peer */
+	if (ivshmem)
+	{
+		ivshmem->regs[IVSHMEM_DOORBELL / sizeof(uint32_t)] = (uint32_t) (dest_ip - 1) << 16;
+		return 0;
+	}
+
 	if (dest_ip == 1)
 		dest = 0;
 	else
@@ -250,12 +321,13 @@ static void mmnif_print_stats(void)
 
 	mmnif = (mmnif_t *) mmnif_dev->state;
 	LOG_INFO("/dev/mmnif - stats:\n");
-	LOG_INFO("Received: %d packets successfull\n", mmnif->stats.rx);
-	LOG_INFO("Received: %d bytes\n", mmnif->stats.rx_bytes);
-	LOG_INFO("Received: %d packets containuing errors\n", mmnif->stats.rx_err);
-	LOG_INFO("Transmitted: %d packests successfull\n", mmnif->stats.tx);
-	LOG_INFO("Transmitted: %d bytes\n", mmnif->stats.tx_bytes);
-	LOG_INFO("Transmitted: %d packests were dropped due to errors\n", mmnif->stats.tx_err);
+	LOG_INFO("Received: %llu packets\n", mmnif->stats.rx_packets);
+	LOG_INFO("Received: %llu bytes\n", mmnif->stats.rx_bytes);
+	LOG_INFO("Received: %llu packets were dropped\n", mmnif->stats.rx_drops);
+	LOG_INFO("Transmitted: %llu packets successfull\n", mmnif->stats.tx_packets);
+	LOG_INFO("Transmitted: %llu bytes\n", mmnif->stats.tx_bytes);
+	LOG_INFO("Transmitted: %llu packets were dropped due to errors\n", mmnif->stats.tx_drops);
+	LOG_INFO("Interrupts: %llu received, %llu sent\n", mmnif->stats.interrupts, mmnif->stats.kicks);
 }
 
 /* mmnif_print_driver_status
@@ -274,22 +346,20 @@ void mmnif_print_driver_status(void)
 
 	mmnif = (mmnif_t *) mmnif_dev->state;
 	LOG_INFO("/dev/mmnif driver status: \n\n");
-	LOG_INFO("rx_buf: 0xp\n", mmnif->rx_buff);
-	LOG_INFO("free descriptors : %d\n\n", mmnif->rx_buff->dcount);
-	LOG_INFO("descriptor table: (only print descriptors in use)\n");
-	LOG_INFO("status\taddr\tsize\n");
+	LOG_INFO("rx_rings: %p\n", mmnif->rx_rings);
+	LOG_INFO("ring heap start addr: %p\n", mmnif->rx_heap);
+	LOG_INFO("slots per ring : %u\n\n", mmnif_slots);
+	LOG_INFO("rings: (only print rings in use)\n");
+	LOG_INFO("sender\thead\ttail\n");
 
-	for (i = 0; i < MMNIF_MAX_DESCRIPTORS; i++)
+	for (i = 0; i < mmnif_nodes; i++)
 	{
-		if (mmnif->rx_buff->desc_table[i].stat != 0)
-			LOG_INFO("0x%.2X\t%p\t%X\t\n",
-				    mmnif->rx_buff->desc_table[i].stat,
-				    mmnif->rx_buff->desc_table[i].addr,
-				    mmnif->rx_buff->desc_table[i].len);
+		if (mmnif->rx_rings[i].head != mmnif->rx_rings[i].tail)
+			LOG_INFO("%d\t0x%X\t0x%X\t\n", i + 1,
+				    mmnif->rx_rings[i].head,
+				    mmnif->rx_rings[i].tail);
 	}
 
-	LOG_INFO("ring heap start addr: %p\n", mmnif->rx_buff + sizeof(mm_rx_buffer_t));
-	LOG_INFO("head: 0x%X\ttail: 0x%X\n", mmnif->rx_buff->head, mmnif->rx_buff->tail);
 	mmnif_print_stats();
 }
 
@@ -313,197 +383,61 @@ static uint8_t mmnif_get_destination(struct netif *netif, struct pbuf *p)
 	ip = iphdr->dest;
 
 	// forward packet to Linux (= isle 1), if the destination IP is a real address
+	// the peers of an ivshmem device don't forward packets => drop it
 	if ((ip4_addr1(&ip) != 192) || (ip4_addr2(&ip) != 168) || (ip4_addr3(&ip) != 28))
-		return 1;
+		return ivshmem ? 0 : 1;
 
 	return ip4_addr4(&ip);
 }
 
-/* mmnif_rxbuff_alloc():
- * this function allocates a continues chunk of memory
- * right inside of the buffer which is used for communication
- * with the remote end
- */
-static size_t mmnif_rxbuff_alloc(uint8_t dest, uint16_t len)
-{
-	size_t ret = 0;
-	volatile mm_rx_buffer_t *rb = (mm_rx_buffer_t *) ((char *)header_start_address + (dest - 1) * header_size);
-	char *memblock = (char *)heap_start_address + (dest - 1) * heap_size;
-
-//        if (rb->tail > rb->head)
-//             if ((MMNIF_RX_BUFFERLEN - rb->tail < len)&&(rb->head < len))
-//                 return NULL;
-//        else
-//            if ((rb->head - rb->tail < len)&&(rb->tail != rb->head))
-//                return NULL;
-
-	islelock_lock(isle_locks + (dest-1));
-	if (rb->dcount)
-	{
-		if (rb->tail > rb->head)
-		{
-			if (MMNIF_RX_BUFFERLEN - rb->tail > len)
-			{
-				rb->desc_table[rb->dwrite].stat = MMNIF_STATUS_PENDING;
-				ret = (size_t) (memblock + rb->tail);
-				rb->desc_table[rb->dwrite].addr = ret;
-				rb->desc_table[rb->dwrite].len = len;
-				rb->dcount--;
-				rb->dwrite = (rb->dwrite + 1) % MMNIF_MAX_DESCRIPTORS;
-				rb->tail = (rb->tail + len);
-			} else if (rb->head > len) {
-				rb->desc_table[rb->dwrite].stat = MMNIF_STATUS_PENDING;
-				ret = (size_t) memblock;
-				rb->desc_table[rb->dwrite].addr = ret;
-				rb->desc_table[rb->dwrite].len = len;
-				rb->dcount--;
-				rb->dwrite = (rb->dwrite + 1) % MMNIF_MAX_DESCRIPTORS;
-				rb->tail = len;
-			}
-		} else {
-			if (rb->head - rb->tail > len)
-			{
-				rb->desc_table[rb->dwrite].stat = MMNIF_STATUS_PENDING;
-				ret = (size_t) (memblock + rb->tail);
-				rb->desc_table[rb->dwrite].addr = ret;
-				rb->desc_table[rb->dwrite].len = len;
-				rb->dcount--;
-				rb->dwrite = (rb->dwrite + 1) % MMNIF_MAX_DESCRIPTORS;
-				rb->tail = (rb->tail + len);
-			} else if (rb->tail == rb->head) {
-				if (MMNIF_RX_BUFFERLEN - rb->tail < len)
-				{
-					rb->tail = 0;
-					if (rb->dread == rb->dwrite)
-						rb->head = 0;
-				}
-				rb->desc_table[rb->dwrite].stat = MMNIF_STATUS_PENDING;
-				ret = (size_t) (memblock + rb->tail);
-				rb->desc_table[rb->dwrite].addr = ret;
-				rb->desc_table[rb->dwrite].len = len;
-				rb->dcount--;
-				rb->dwrite = (rb->dwrite + 1) % MMNIF_MAX_DESCRIPTORS;
-				rb->tail = (rb->tail + len);
-			}
-		}
-	}
-	islelock_unlock(isle_locks + (dest-1));
-
-	return ret;
-}
-
-/* mmnif_commit_packet: this function set the state of the (in advance)
- * allocated packet to RDY so the recieve queue knows that it can be
- * processed further
- */
-static int mmnif_commit_packet(uint8_t dest, uint32_t addr)
-{
-	volatile mm_rx_buffer_t *rb = (mm_rx_buffer_t *) ((char *)header_start_address + (dest - 1) * header_size);
-	uint32_t i;
-
-	for (i = 0; i < MMNIF_MAX_DESCRIPTORS; i++)
-	{
-		if (rb->desc_table[i].addr == addr
-		    && rb->desc_table[i].stat == MMNIF_STATUS_PENDING)
-		{
-			rb->desc_table[i].stat = MMNIF_STATUS_RDY;
-
-			return 0;
-		}
-	}
-
-	return -1;
-}
-
-/* mmnif_rxbuff_free() : the opposite to mmnif_rxbuff_alloc() a from the receiver
- * already processed chunk of memory is freed so that it can be allocated again
- */
-static void mmnif_rxbuff_free(void)
-{
-	mmnif_t *mmnif = mmnif_dev->state;
-	volatile mm_rx_buffer_t *b = mmnif->rx_buff;
-	uint32_t i, j;
-	uint32_t rpos;
-	uint8_t flags;
-
-	flags = irq_nested_disable();
-	islelock_lock(isle_locks + (isle+1));
-	rpos = b->dread;
-
-	for (i = 0, j = rpos; i < MMNIF_MAX_DESCRIPTORS; i++)
-	{
-		j = (j + i) % MMNIF_MAX_DESCRIPTORS;
-		if (b->desc_table[j].stat == MMNIF_STATUS_PROC)
-		{
-			b->dcount++;
-			b->dread = (b->dread + 1) % MMNIF_MAX_DESCRIPTORS;
-			b->desc_table[j].stat = MMNIF_STATUS_FREE;
-			if (b->tail > b->head)
-			{
-				b->head += b->desc_table[j].len;
-			} else {
-				if ((b->desc_table[(j + 1) % MMNIF_MAX_DESCRIPTORS].stat != MMNIF_STATUS_FREE)
-				    && (b->desc_table[j].addr > b->desc_table[(j + 1) % MMNIF_MAX_DESCRIPTORS].addr))
-				{
-					b->head = 0;
-				} else {
-					b->head += b->desc_table[j].len;
-				}
-			}
-		} else
-			break;
-	}
-
-	islelock_unlock(isle_locks + (isle+1));
-	irq_nested_enable(flags);
-}
-
 /*
  * Transmid a packet (called by the lwip)
  */
 static err_t mmnif_tx(struct netif *netif, struct pbuf *p)
 {
 	mmnif_t *mmnif = netif->state;
-	size_t write_address;
-	uint32_t i;
+	volatile mmnif_ring_t *ring;
+	uint8_t *slot;
+	uint32_t i, head;
 	struct pbuf *q;		/* interator */
 	uint32_t dest_ip = mmnif_get_destination(netif, p);
 
 	/* check for over/underflow */
- 	if (BUILTIN_EXPECT((p->tot_len < 20 /* IP header size */) || (p->tot_len > 1536), 0)) {
+ 	if (BUILTIN_EXPECT((p->tot_len < 20 /* IP header size */) || (p->tot_len > mmnif_slot_size), 0)) {
 		LOG_ERROR("mmnif_tx: illegal packet length %d => drop\n", p->tot_len);
 		goto drop_packet;
 	}
 
 	/* check destination ip */
-	if (BUILTIN_EXPECT((dest_ip < 1) || (dest_ip > MAX_ISLE), 0)) {
+	if (BUILTIN_EXPECT((dest_ip < 1) || (dest_ip > MAX_ISLE) || (dest_ip > mmnif_nodes), 0)) {
 		LOG_ERROR("mmnif_tx: invalid destination IP %d => drop\n", dest_ip);
 		goto drop_packet;
 	}
 
-	spinlock_irqsave_lock(&locallock); // only one core should call our islelock
-
-	/* allocate memory for the packet in the remote buffer */
-realloc:
-	write_address = mmnif_rxbuff_alloc(dest_ip, p->tot_len);
-	if (!write_address)
-	{
-		LOG_DEBUG("mmnif_tx(): concurrency");
+	/*
+	 * LwIP serializes the calls of the link output function,
+	 * hence this isle is the only producer of the ring.
+	 */
+	ring = mmnif_ring(dest_ip - 1, mmnif_self);
+	head = ring->head;
 
+	/* wait for a free slot in the remote ring */
+	while (head - ring->tail >= mmnif_slots)
 		PAUSE;
-		goto realloc;
-	}
 
+	/* the receiver runs on another isle, hence bypass our caches */
+	slot = mmnif_slot(dest_ip - 1, mmnif_self, head);
 	for (q = p, i = 0; q != 0; q = q->next)
 	{
-		memcpy((char*) write_address + i, q->payload, q->len);
+		memcpy_nt(slot + i, q->payload, q->len);
 		i += q->len;
 	}
+	ring->len[head & (mmnif_slots - 1)] = p->tot_len;
 
-	if (mmnif_commit_packet(dest_ip, write_address))
-	{
-		LOG_WARNING("mmnif_tx(): packet somehow lost during commit\n");
-	}
+	/* publish the packet after its content, afterwards check if the receiver polls */
+	mb();
+	ring->head = head + 1;
+	mb();
 
 #ifdef DEBUG_MMNIF_PACKET
 //      LOG_INFO("\n SEND %p with length: %d\n",(char*)heap_start_address + (dest_ip -1)*mpb_size + pos * 1792,p->tot_len +2);
@@ -512,12 +446,15 @@ realloc:
 
 	/* just gather some stats */
 	LINK_STATS_INC(link.xmit);
-	mmnif->stats.tx++;
-	mmnif->stats.tx_bytes += p->tot_len;
-
-	spinlock_irqsave_unlock(&locallock);
+	NETSTATS_TX(&mmnif->stats, p->tot_len);
+	netstats_tx_done(p);
 
-	mmnif_trigger_irq(dest_ip);
+	/* doorbell: only an idle receiver needs an interrupt */
+	if (!ring->polling)
+	{
+		NETSTATS_INC(&mmnif->stats, kicks);
+		mmnif_trigger_irq(dest_ip);
+	}
 
 	return ERR_OK;
 
@@ -527,7 +464,7 @@ drop_packet:
 	LOG_ERROR("mmnif_tx(): packet dropped");
 
 	LINK_STATS_INC(link.drop);
-	mmnif->stats.tx_err++;
+	NETSTATS_INC(&mmnif->stats, tx_drops);
 
 	return ERR_IF;
 }
@@ -542,134 +479,314 @@ static err_t mmnif_link_layer(struct netif *netif, struct pbuf *q, ip_addr_t * i
 	return netif->linkoutput(netif, q);
 }
 
-/*
- * Init the device (called from lwip)
- * It's invoked in netif_add
+/* mmnif_page_flags(): flags of the shared segments, which are protected by the NX flag
  */
-err_t mmnif_init(struct netif *netif)
+static size_t mmnif_page_flags(void)
 {
-	mmnif_t *mmnif = NULL;
-	int num = 0;
-	int err;
-	uint32_t nodes = possible_isles + 1;
-	size_t flags;
+	size_t flags = PG_RW|PG_GLOBAL;
 
-	LOG_INFO("Initialize mmnif\n");
-
-	mmnif_dev = netif;
-
-	/* Alloc and clear memory for the device struct
-	 */
-	mmnif = kmalloc(sizeof(mmnif_t));
-	if (BUILTIN_EXPECT(!mmnif, 0))
-	{
-		LOG_ERROR("mmnif init():out of memory\n");
-		goto out;
-	}
-	memset(mmnif, 0x00, sizeof(mmnif_t));
+#if __x86_64__
+	if (has_nx())
+		flags |= PG_XD;
+#endif
 
-	/* Alloc and clear shared memory for rx_buff
-	 */
-	if (BUILTIN_EXPECT(header_size < sizeof(mm_rx_buffer_t), 0))
-	{
-		LOG_ERROR("mmnif init(): header_size is too small\n");
-		goto out;
-	}
+	return flags;
+}
 
-	if (BUILTIN_EXPECT(heap_size < MMNIF_RX_BUFFERLEN, 0))
-	{
-		LOG_ERROR("mmnif init(): heap_size is too small\n");
-		goto out;
-	}
-	LOG_INFO("mmnif_init() : size of mm_rx_buffer_t : %d\n", sizeof(mm_rx_buffer_t));
+/* mmnif_map_isles(): map the header and the heap of all isles, which the multi-kernel reserves
+ */
+static int mmnif_map_isles(uint32_t nodes)
+{
+	int err;
 
-	if (BUILTIN_EXPECT(!header_phy_start_address || !phy_isle_locks, 0))
+	if (BUILTIN_EXPECT(!header_phy_start_address, 0))
 	{
 		LOG_ERROR("mmnif init(): invalid heap or header address\n");
-		goto out;
+		return -EINVAL;
 	}
 
 	if (BUILTIN_EXPECT(!header_start_address, 0))
 	{
 		LOG_ERROR("mmnif init(): vma_alloc failed\n");
-		goto out;
+		return -ENOMEM;
 	}
 
 	err = vma_add((size_t)header_start_address, PAGE_CEIL((size_t)header_start_address + ((nodes * header_size) >> PAGE_BITS)), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
 	if (BUILTIN_EXPECT(err, 0)) {
 		LOG_ERROR("mmnif init(): vma_add failed for header_start_address %p\n", header_start_address);
-		goto out;
+		return err;
 	}
 
-	// protect mmnif shared segments by the NX flag
-	flags = PG_RW|PG_GLOBAL;
-#if __x86_64__
-	if (has_nx())
-		flags |= PG_XD;
-#endif
-
 	// map physical address in the virtual address space
-	err = page_map((size_t) header_start_address, (size_t) header_phy_start_address, (nodes * header_size) >> PAGE_BITS, flags);
+	err = page_map((size_t) header_start_address, (size_t) header_phy_start_address, (nodes * header_size) >> PAGE_BITS, mmnif_page_flags());
 	if (BUILTIN_EXPECT(err, 0)) {
 		LOG_ERROR("mmnif init(): page_map failed\n");
-		goto out;
+		return err;
 	}
 
 	LOG_INFO("map header %p at %p\n", header_phy_start_address, header_start_address);
-	mmnif->rx_buff = (mm_rx_buffer_t *) (header_start_address + header_size * (isle+1));
 
 	if (BUILTIN_EXPECT(!heap_start_address, 0)) {
 		LOG_ERROR("mmnif init(): vma_alloc failed\n");
-		goto out;
+		return -ENOMEM;
 	}
 
 	err = vma_add((size_t)heap_start_address, PAGE_CEIL((size_t)heap_start_address + ((nodes * heap_size) >> PAGE_BITS)), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
 	if (BUILTIN_EXPECT(!heap_start_address, 0))
 	{
 		LOG_ERROR("mmnif init(): vma_add failed for heap_start_address %p\n", heap_start_address);
-		goto out;
+		return -ENOMEM;
 	}
 
 	// map physical address in the virtual address space
-	err = page_map((size_t) heap_start_address, (size_t) heap_phy_start_address, (nodes * heap_size) >> PAGE_BITS, flags);
+	err = page_map((size_t) heap_start_address, (size_t) heap_phy_start_address, (nodes * heap_size) >> PAGE_BITS, mmnif_page_flags());
 	if (BUILTIN_EXPECT(err, 0)) {
 		LOG_ERROR("mmnif init(): page_map failed\n");
-		goto out;
+		return err;
 	}
 
-	// map physical address in the virtual address space
 	LOG_INFO("map heap %p at %p\n", heap_phy_start_address, heap_start_address);
-	mmnif->rx_heap = (uint8_t*) heap_start_address + heap_size * (isle+1);
 
-	memset((void*)mmnif->rx_buff, 0x00, header_size);
-	memset((void*)mmnif->rx_heap, 0x00, heap_size);
+	mmnif_headers = (uint8_t*) header_start_address;
+	mmnif_header_size = header_size;
+	mmnif_heaps = (uint8_t*) heap_start_address;
+	mmnif_heap_size = heap_size;
+	mmnif_self = isle + 1;
+
+	return 0;
+}
+
+/* mmnif_map_ivshmem(): map the shared memory of the ivshmem device
+ * all peers derive the same layout from its size: the headers of all nodes, followed by their heaps
+ */
+static int mmnif_map_ivshmem(uint32_t nodes)
+{
+	const pci_info_t *pci = &ivshmem->pci;
+	uint32_t base = pci->base[IVSHMEM_SHM_BAR];
+	size_t phys, size, viraddr;
+	int err;
+
+	if (BUILTIN_EXPECT(!base || (base & 0x1), 0))
+	{
+		LOG_ERROR("mmnif init(): ivshmem device doesn't have shared memory\n");
+		return -ENODEV;
+	}
+
+	phys = base & ~0xFULL;
+	// upper half of a 64 bit BAR
+	if ((base & 0x6) == 0x4)
+		phys |= ((size_t) pci->base[IVSHMEM_SHM_BAR+1]) << 32;
+	size = PAGE_FLOOR((size_t) pci->size[IVSHMEM_SHM_BAR]);
+
+	mmnif_header_size = PAGE_CEIL(nodes * sizeof(mmnif_ring_t));
+	if (BUILTIN_EXPECT(size < nodes * (mmnif_header_size + PAGE_SIZE), 0))
+	{
+		LOG_ERROR("mmnif init(): shared memory of the ivshmem device is too small (%zd bytes)\n", size);
+		return -ENOMEM;
+	}
+	mmnif_heap_size = PAGE_FLOOR((size - nodes * mmnif_header_size) / nodes);
 
-	isle_locks = (islelock_t*) vma_alloc(((nodes + 1) * sizeof(islelock_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
-	if (BUILTIN_EXPECT(!isle_locks, 0)) {
+	viraddr = vma_alloc(size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+	{
 		LOG_ERROR("mmnif init(): vma_alloc failed\n");
-		goto out;
+		return -ENOMEM;
 	}
 
-	// map physical address in the virtual address space
-	err = page_map((size_t) isle_locks, (size_t) phy_isle_locks, (((nodes+1) * sizeof(islelock_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)) >> PAGE_BITS, flags);
-	if (BUILTIN_EXPECT(err, 0)) {
+	// the memory of the host is cacheable, unlike the registers of a device
+	err = page_map(viraddr, phys, size >> PAGE_BITS, mmnif_page_flags());
+	if (BUILTIN_EXPECT(err, 0))
+	{
 		LOG_ERROR("mmnif init(): page_map failed\n");
+		vma_free(viraddr, viraddr + size);
+		return err;
+	}
+
+	LOG_INFO("map ivshmem memory 0x%zx (%zd KiB) at 0x%zx\n", phys, size >> 10, viraddr);
+
+	mmnif_headers = (uint8_t*) viraddr;
+	mmnif_heaps = (uint8_t*) viraddr + nodes * mmnif_header_size;
+
+	return 0;
+}
+
+/* mmnif_ivshmem_irq(): route the doorbell of the ivshmem device to the interrupt handler
+ */
+static void mmnif_ivshmem_irq(void)
+{
+	if (pci_msix_enable(&ivshmem->pci) == 0)
+	{
+		int vector = irq_alloc_vector();
+
+		if (vector >= 0)
+		{
+			ivshmem->vector = vector;
+			ivshmem->msix_enabled = 1;
+			irq_install_handler(vector, mmnif_irqhandler);
+			pci_msix_set_vector(&ivshmem->pci, 0, vector, 0);
+			return;
+		}
+
+		pci_msi_disable(&ivshmem->pci);
+	}
+
+	/* the legacy interrupt is acknowledged by reading the status register */
+	ivshmem->vector = ivshmem->pci.irq + 32;
+	irq_install_handler(ivshmem->vector, mmnif_irqhandler);
+	ivshmem->regs[IVSHMEM_INTR_MASK / sizeof(uint32_t)] = 0xFFFFFFFF;
+}
+
+/*
+ * Search an ivshmem device and determine our node. Afterwards, mmnif_init
+ * uses the device instead of the memory of the multi-kernel.
+ */
+int mmnif_ivshmem_probe(uint32_t* node)
+{
+	pci_info_t pci_info;
+	ivshmem_t *dev;
+	uint32_t pos;
+
+	if (BUILTIN_EXPECT(!node, 0))
+		return -EINVAL;
+
+	if (ivshmem)
+	{
+		*node = mmnif_self;
+		return 0;
+	}
+
+	if (pci_get_device_info(IVSHMEM_VENDOR_ID, IVSHMEM_DEVICE_ID, PCI_IGNORE_SUBID, &pci_info, 1))
+		return -ENODEV;
+
+	dev = kmalloc(sizeof(ivshmem_t));
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENOMEM;
+	memset(dev, 0x00, sizeof(ivshmem_t));
+	dev->pci = pci_info;
+
+	dev->regs = pci_map_bar(&dev->pci, 0, 0, IVSHMEM_REGS_SIZE);
+	if (BUILTIN_EXPECT(!dev->regs, 0))
+	{
+		LOG_ERROR("mmnif: unable to map the registers of the ivshmem device\n");
+		kfree(dev);
+		return -ENODEV;
+	}
+
+	/* ivshmem-plain doesn't have a peer ID and doorbells */
+	pos = dev->regs[IVSHMEM_IV_POSITION / sizeof(uint32_t)];
+	if (BUILTIN_EXPECT(pos >= MAX_ISLE, 0))
+	{
+		LOG_ERROR("mmnif: ivshmem peer ID %d isn't supported (ivshmem-doorbell with less than %d peers is required)\n", (int32_t) pos, MAX_ISLE);
+		kfree(dev);
+		return -ENODEV;
+	}
+
+	LOG_INFO("Found ivshmem device, we are peer %u\n", pos);
+
+	mmnif_self = pos;
+	ivshmem = dev;
+	*node = pos;
+
+	return 0;
+}
+
+/*
+ * Init the device (called from lwip)
+ * It's invoked in netif_add
+ */
+err_t mmnif_init(struct netif *netif)
+{
+	mmnif_t *mmnif = NULL;
+	int num = 0;
+	uint32_t i;
+	/* all peers of an ivshmem device use the same number of nodes */
+	uint32_t nodes = ivshmem ? MAX_ISLE : possible_isles + 1;
+
+	LOG_INFO("Initialize mmnif\n");
+
+	mmnif_dev = netif;
+
+	/* Alloc and clear memory for the device struct
+	 */
+	mmnif = kmalloc(sizeof(mmnif_t));
+	if (BUILTIN_EXPECT(!mmnif, 0))
+	{
+		LOG_ERROR("mmnif init():out of memory\n");
 		goto out;
 	}
-	LOG_INFO("map isle_locks %p at %p\n", phy_isle_locks, isle_locks);
+	memset(mmnif, 0x00, sizeof(mmnif_t));
 
-	/* set initial values
+	if (BUILTIN_EXPECT(nodes > MAX_ISLE, 0))
+	{
+		LOG_ERROR("mmnif init(): too many isles\n");
+		goto out;
+	}
+
+	if (ivshmem ? mmnif_map_ivshmem(nodes) : mmnif_map_isles(nodes))
+		goto out;
+
+	/* Every receiver needs one ring per sender in its header
 	 */
-	mmnif->rx_buff->dcount = MMNIF_MAX_DESCRIPTORS;
+	if (BUILTIN_EXPECT(mmnif_header_size < nodes * sizeof(mmnif_ring_t), 0))
+	{
+		LOG_ERROR("mmnif init(): header_size is too small\n");
+		goto out;
+	}
 
-	/* init the lock's for the hdr
+	/* All nodes derive the same slot size and number of slots from the heap size
 	 */
-	spinlock_irqsave_init(&locallock);
+#ifdef MMNIF_ZERO_COPY
+	if (mmnif_heap_size >= 2 * MMNIF_BIG_SLOT_SIZE * nodes)
+		mmnif_slot_size = MMNIF_BIG_SLOT_SIZE;
+	else
+		LOG_WARNING("mmnif init(): heap_size is too small for large frames\n");
+#endif
+	mmnif_slots = MMNIF_MAX_DESCRIPTORS;
+	while (mmnif_slots && (mmnif_slots * mmnif_slot_size * nodes > mmnif_heap_size))
+		mmnif_slots >>= 1;
+	if (BUILTIN_EXPECT(!mmnif_slots, 0))
+	{
+		LOG_ERROR("mmnif init(): heap_size is too small\n");
+		goto out;
+	}
+	mmnif_nodes = nodes;
+	LOG_INFO("mmnif_init() : %u rings with %u slots of %u bytes\n", nodes, mmnif_slots, mmnif_slot_size);
+
+#if MMNIF_RX_ZERO_COPY
+	mmnif->rx_bufs = kmalloc(nodes * mmnif_slots * sizeof(mmnif_rxbuf_t));
+	if (BUILTIN_EXPECT(!mmnif->rx_bufs, 0))
+	{
+		LOG_ERROR("mmnif init():out of memory\n");
+		goto out;
+	}
+	memset(mmnif->rx_bufs, 0x00, nodes * mmnif_slots * sizeof(mmnif_rxbuf_t));
+
+	for (i = 0; i < nodes * mmnif_slots; i++)
+	{
+		mmnif->rx_bufs[i].pc.custom_free_function = mmnif_rx_free;
+		mmnif->rx_bufs[i].mmnif = mmnif;
+		mmnif->rx_bufs[i].src = i / mmnif_slots;
+	}
+
+	spinlock_irqsave_init(&mmnif->rx_lock);
+#endif
+
+	mmnif->rx_rings = mmnif_ring(mmnif_self, 0);
+	mmnif->rx_heap = mmnif_heaps + mmnif_heap_size * mmnif_self;
+
+	memset((void*)mmnif->rx_rings, 0x00, mmnif_header_size);
+	memset((void*)mmnif->rx_heap, 0x00, mmnif_heap_size);
 
 	/* init the sems for communication art
 	 */
 	sem_init(&mmnif->com_poll, 0);
 
+	if (BUILTIN_EXPECT(napi_init(&mmnif->napi, netif, mmnif_napi_poll, mmnif_napi_enable), 0))
+	{
+		LOG_ERROR("mmnif init(): unable to initialize the polling context\n");
+		goto out;
+	}
+
 	/* pass the device state to lwip */
 	netif->state = mmnif;
 	mmnif_dev = netif;
@@ -679,6 +796,7 @@ err_t mmnif_init(struct netif *netif)
 	netif->name[1] = 'm';
 	netif->num = num;
 	num++;
+	netstats_register(netif, &mmnif->stats);
 
 	/* downward functions */
 	netif->output = (netif_output_fn) mmnif_link_layer;
@@ -687,7 +805,11 @@ err_t mmnif_init(struct netif *netif)
 	netif->linkoutput = mmnif_tx;
 
 	/* maximum transfer unit */
-	netif->mtu = 1500;
+	netif->mtu = MMNIF_MTU;
+#ifdef MMNIF_ZERO_COPY
+	if (mmnif_slot_size == MMNIF_BIG_SLOT_SIZE)
+		netif->mtu = MMNIF_BIG_MTU;
+#endif
 
 	/* set link up */
 	netif->flags |= NETIF_FLAG_LINK_UP;
@@ -696,88 +818,136 @@ err_t mmnif_init(struct netif *netif)
 	netif->hwaddr_len = 0;
 
 	// set interrupt handler
-	irq_install_handler(MMNIF_IRQ, mmnif_irqhandler);
+	if (ivshmem)
+		mmnif_ivshmem_irq();
+	else
+		irq_install_handler(MMNIF_IRQ, mmnif_irqhandler);
 
 	LOG_INFO("mmnif init complete\n");
 
 	return ERR_OK;
 
 out:
-	if (!mmnif)
+	if (mmnif) {
+#if MMNIF_RX_ZERO_COPY
+		if (mmnif->rx_bufs)
+			kfree(mmnif->rx_bufs);
+#endif
 		kfree(mmnif);
+	}
 
-	header_start_address = NULL;
-	heap_start_address = NULL;
+	if (!ivshmem) {
+		header_start_address = NULL;
+		heap_start_address = NULL;
+	}
 
 	return ERR_MEM;
 }
 
-/*
- * Receive a packet : recieve, pack it up and pass over to higher levels
+/* mmnif_rx_pending(): has any sender posted a packet, which we haven't received yet?
  */
-static void mmnif_rx(struct netif *netif)
+static int mmnif_rx_pending(mmnif_t *mmnif)
 {
-	mmnif_t *mmnif = netif->state;
-	volatile mm_rx_buffer_t *b = mmnif->rx_buff;
-	uint16_t length = 0;
-	struct pbuf *p;
-	struct pbuf *q;
-	char *packet = NULL;
-	uint32_t i, j, flags;
-	uint8_t rdesc;
-	err_t err = ERR_OK;
-
-anotherpacket:
-	flags = irq_nested_disable();
-	rdesc = 0xFF;
+	uint32_t i;
 
-	/* check if this call to mmnif_rx makes any sense
-	 */
-	if (b->desc_table[b->dread].stat == MMNIF_STATUS_FREE)
+	for (i = 0; i < mmnif_nodes; i++)
 	{
-		mmnif->check_in_progress = 0;
-		irq_nested_enable(flags);
-		return;
+		if (mmnif->rx_rings[i].head != mmnif->rx_next[i])
+			return 1;
 	}
 
-	/* search the packet whose transmission is finished
-	 */
-	for (i = 0, j = b->dread; i < MMNIF_MAX_DESCRIPTORS; i++)
-	{
-		if (b->desc_table[(j + i) % MMNIF_MAX_DESCRIPTORS].stat == MMNIF_STATUS_RDY)
-		{
-			rdesc = (j + i) % MMNIF_MAX_DESCRIPTORS;
-			b->desc_table[rdesc].stat = MMNIF_STATUS_INPROC;
-			packet = (char *)b->desc_table[rdesc].addr;
-			length = b->desc_table[rdesc].len;
-			break;
-		}
+	return 0;
+}
 
-		if (b->desc_table[(j + i) % MMNIF_MAX_DESCRIPTORS].stat == MMNIF_STATUS_FREE)
-		{
-			mmnif->check_in_progress = 0;
-			irq_nested_enable(flags);
-			return;
-		}
+/* mmnif_rx_release(): release the slot pos of sender src
+ * the sender reuses the slots in order, hence a slot is only released after its predecessors
+ */
+static void mmnif_rx_release(mmnif_t *mmnif, uint32_t src, uint32_t pos, int held)
+{
+	volatile mmnif_ring_t *ring = mmnif->rx_rings + src;
+#if MMNIF_RX_ZERO_COPY
+	mmnif_rxbuf_t *bufs = mmnif->rx_bufs + src * mmnif_slots;
+	uint32_t tail;
+
+	spinlock_irqsave_lock(&mmnif->rx_lock);
+	if (held)
+		mmnif->rx_held[src]--;
+	bufs[pos & (mmnif_slots - 1)].done = 1;
+
+	tail = ring->tail;
+	while ((tail != mmnif->rx_next[src]) && bufs[tail & (mmnif_slots - 1)].done)
+	{
+		bufs[tail & (mmnif_slots - 1)].done = 0;
+		tail++;
 	}
 
-	irq_nested_enable(flags);
+	mb();
+	ring->tail = tail;
+	spinlock_irqsave_unlock(&mmnif->rx_lock);
+#else
+	mb();
+	ring->tail = pos + 1;
+#endif
+}
+
+#if MMNIF_RX_ZERO_COPY
+/* releases the slot as soon as LwIP has freed the pbuf */
+static void mmnif_rx_free(struct pbuf* p)
+{
+	mmnif_rxbuf_t *buf = (mmnif_rxbuf_t *) p;
 
-	/* if there is no packet finished we encountered a random error
-	 */
-	if (rdesc == 0xFF)
-		goto out;
+	mmnif_rx_release(buf->mmnif, buf->src, buf->pos, 1);
+}
 
-	/* If length is zero return silently
+/* mmnif_rx_zero_copy(): create a pbuf, which references the packet in its slot
+ * returns NULL if the packet has to be copied
+ */
+static struct pbuf* mmnif_rx_zero_copy(mmnif_t *mmnif, uint32_t src, uint32_t pos, uint8_t *packet, uint16_t length)
+{
+	mmnif_rxbuf_t *buf = mmnif->rx_bufs + src * mmnif_slots + (pos & (mmnif_slots - 1));
+	struct pbuf *p = NULL;
+
+	/*
+	 * LwIP holds at most half of the slots, otherwise two isles, which
+	 * send to each other, may wait for the slots of the other one.
 	 */
-	if (BUILTIN_EXPECT(length == 0, 0))
+	spinlock_irqsave_lock(&mmnif->rx_lock);
+	if (mmnif->rx_held[src] < mmnif_slots / 2)
 	{
-		LOG_ERROR("mmnif_rx(): empty packet error\n");
-		goto out;
+		mmnif->rx_held[src]++;
+		buf->pos = pos;
+		p = pbuf_alloced_custom(PBUF_RAW, length, PBUF_REF, &buf->pc, packet, length);
+		if (BUILTIN_EXPECT(!p, 0))
+			mmnif->rx_held[src]--;
 	}
+	spinlock_irqsave_unlock(&mmnif->rx_lock);
+
+	return p;
+}
+#endif
+
+/* mmnif_rx_packet(): receive one packet from the ring of sender src
+ */
+static void mmnif_rx_packet(struct netif *netif, uint32_t src)
+{
+	mmnif_t *mmnif = netif->state;
+	volatile mmnif_ring_t *ring = mmnif->rx_rings + src;
+	uint32_t pos = mmnif->rx_next[src];
+	const uint64_t stamp = get_rdtsc();
+	uint16_t length;
+	struct pbuf *p = NULL;
+	struct pbuf *q;
+	uint8_t *packet;
+	uint32_t i;
+
+	/* read the packet not before the sender has published it */
+	mb();
+	length = ring->len[pos & (mmnif_slots - 1)];
+	packet = mmnif_slot(mmnif_self, src, pos);
+	mmnif->rx_next[src] = pos + 1;
 
 	/* check for over/underflow */
-        if (BUILTIN_EXPECT((length < 20 /* IP header size */) || (length > 1536), 0))
+	if (BUILTIN_EXPECT((length < 20 /* IP header size */) || (length > mmnif_slot_size), 0))
 	{
 		LOG_ERROR("mmnif_rx(): illegal packet length %d => drop the packet\n", length);
 		goto drop_packet;
@@ -791,57 +961,124 @@ anotherpacket:
 	hex_dump(length, packet);
 #endif
 
-	/* Build the pbuf for the packet so the lwip
-	 * and other higher layer can handle it
-	 */
-	p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
-	if (BUILTIN_EXPECT(!p, 0))
-	{
-		LOG_ERROR("mmnif_rx(): low on mem - packet dropped\n");
-		goto drop_packet;
-	}
+#if MMNIF_RX_ZERO_COPY
+	/* the pbuf references the slot until LwIP frees it */
+	if (length > MMNIF_COPYBREAK)
+		p = mmnif_rx_zero_copy(mmnif, src, pos, packet, length);
+#endif
 
-	/* copy packet to pbuf structure going through linked list */
-	for (q = p, i = 0; q != NULL; q = q->next)
+	if (!p)
 	{
-		memcpy((uint8_t *) q->payload, packet + i, q->len);
-		i += q->len;
-	}
+		/* Build the pbuf for the packet so the lwip
+		 * and other higher layer can handle it
+		 */
+		p = pbuf_cache_alloc(length);
+		if (BUILTIN_EXPECT(!p, 0))
+		{
+			LOG_ERROR("mmnif_rx(): low on mem - packet dropped\n");
+			goto drop_packet;
+		}
 
-	/* indicate that the copy process is done and the packet can be freed
-	 * note that we did not lock here because we are the only one editing this value
-	 */
-	mmnif->rx_buff->desc_table[rdesc].stat = MMNIF_STATUS_PROC;
-	mb();
+		/* copy packet to pbuf structure going through linked list */
+		for (q = p, i = 0; q != NULL; q = q->next)
+		{
+			memcpy((uint8_t *) q->payload, packet + i, q->len);
+			i += q->len;
+		}
 
-	/* everything is copied to a new buffer so it's save to release
-	 * the old one for new incoming packets
-	 */
-	mmnif_rxbuff_free();
+		/* everything is copied to a new buffer so it's save to release
+		 * the slot for new incoming packets
+		 */
+		mmnif_rx_release(mmnif, src, pos, 0);
+	}
+
+	/* gather some stats before the stack consumes the packet */
+	LINK_STATS_INC(link.recv);
 
 	/*
 	 * This function is called in the context of the tcpip thread.
 	 * Therefore, we are able to call directly the input functions.
 	 */
-	if ((err = mmnif_dev->input(p, mmnif_dev)) != ERR_OK)
+	if (netstats_input(&mmnif->stats, netif, p, stamp) != ERR_OK)
 	{
 		LOG_ERROR("mmnif_rx: IP input error\n");
 		pbuf_free(p);
 	}
 
-	/* gather some stats and leave the rx handler */
-	LINK_STATS_INC(link.xmit);
-	mmnif->stats.rx++;
-	mmnif->stats.rx_bytes += p->tot_len;
-	goto anotherpacket;
+	return;
 
 drop_packet:
-	/* TODO: error handling */
+	mmnif_rx_release(mmnif, src, pos, 0);
+
 	LINK_STATS_INC(link.drop);
-	mmnif->stats.rx_err++;
-out:
-	mmnif->check_in_progress = 0;
-	return;
+	NETSTATS_INC(&mmnif->stats, rx_drops);
+}
+
+/* mmnif_rx_set_polling(): tell all senders, whether we need an interrupt
+ */
+static void mmnif_rx_set_polling(mmnif_t *mmnif, uint32_t polling)
+{
+	uint32_t i;
+
+	for (i = 0; i < mmnif_nodes; i++)
+		mmnif->rx_rings[i].polling = polling;
+	mb();
+}
+
+/*
+ * Receive up to budget packets : recieve, pack them up and pass over to higher levels
+ *
+ * @return number of received packets
+ */
+static int mmnif_napi_poll(napi_t *napi, int budget)
+{
+	mmnif_t *mmnif = napi->netif->state;
+	uint32_t i, progress;
+	int work = 0;
+
+	/* visit the senders round robin, so that no one starves the others */
+	do {
+		progress = 0;
+		for (i = 0; (i < mmnif_nodes) && (work < budget); i++)
+		{
+			if (mmnif->rx_rings[i].head != mmnif->rx_next[i])
+			{
+				mmnif_rx_packet(napi->netif, i);
+				progress++;
+				work++;
+			}
+		}
+	} while (progress && (work < budget));
+
+	return work;
+}
+
+static void mmnif_napi_enable(napi_t *napi)
+{
+	mmnif_t *mmnif = napi->netif->state;
+
+#if MMNIF_POLL_NSEC > 0
+	/* streaming senders: wait a moment for the next packet instead of its interrupt */
+	uint64_t deadline = get_rdtsc() + ns_to_tsc(MMNIF_POLL_NSEC);
+
+	while (!mmnif_rx_pending(mmnif) && (get_rdtsc() < deadline))
+		PAUSE;
+
+	if (mmnif_rx_pending(mmnif))
+	{
+		napi_schedule(napi);
+		return;
+	}
+#endif
+
+	mmnif_rx_set_polling(mmnif, 0);
+
+	/* a packet, which arrived before the senders noticed it, doesn't raise an interrupt => check again */
+	if (mmnif_rx_pending(mmnif))
+	{
+		mmnif_rx_set_polling(mmnif, 1);
+		napi_schedule(napi);
+	}
 }
 
 /* mmnif_irqhandler():
@@ -858,19 +1095,17 @@ static void mmnif_irqhandler(struct state* s)
 		return;
 	}
 
+	/* the legacy interrupt of the ivshmem device may be shared */
+	if (ivshmem && !ivshmem->msix_enabled && !ivshmem->regs[IVSHMEM_INTR_STATUS / sizeof(uint32_t)])
+		return;
+
 	mmnif = (mmnif_t *) mmnif_dev->state;
-	if (!mmnif->check_in_progress) {
-#if LWIP_TCPIP_CORE_LOCKING_INPUT
-		mmnif->check_in_progress = 1;
-		mmnif_rx(mmnif_dev);
-#else
-		if (tcpip_callback_with_block((tcpip_callback_fn) mmnif_rx, (void*) mmnif_dev, 0) == ERR_OK) {
-			mmnif->check_in_progress = 1;
-		} else {
-			LOG_ERROR("mmnif_handler: unable to send a poll request to the tcpip thread\n");
-		}
-#endif
-	}
+	NETSTATS_INC(&mmnif->stats, interrupts);
+
+	/* no further interrupts while the polling context drains the rings */
+	mmnif_rx_set_polling(mmnif, 1);
+	if (BUILTIN_EXPECT(napi_schedule(&mmnif->napi), 0))
+		mmnif_rx_set_polling(mmnif, 0);
 }
 
 /*
@@ -40,6 +40,15 @@
 #include <lwip/sockets.h>
 
 err_t mmnif_init(struct netif*);
+
+/** @brief Search an ivshmem device, which connects VMs on the same host
+ *
+ * Afterwards, mmnif_init places the rings in the memory of the device.
+ *
+ * @param node receives our node (peer ID), our IP is 192.168.28.(node+1)
+ * @return 0 on success, -ENODEV if there is no (suitable) device
+ */
+int mmnif_ivshmem_probe(uint32_t* node);
 err_t mmnif_shutdown(void);
 int mmnif_worker(void *e);
 void mmnif_print_driver_status(void);
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/tasks.h>
+#include <hermit/processor.h>
+#include <hermit/spinlock.h>
+#include <asm/irq.h>
+#include <lwip/sys.h>
+#include <lwip/tcpip.h>
+#include <net/napi.h>
+
+#if !NO_SYS && (NAPI_BUSY_POLL_CORE >= 0) && LWIP_TCPIP_CORE_LOCKING
+#define NAPI_BUSY_POLL	1
+#else
+#define NAPI_BUSY_POLL	0
+#endif
+
+#if !NO_SYS && (NAPI_CONTEXTS > 0) && LWIP_TCPIP_CORE_LOCKING && !NAPI_BUSY_POLL
+#define NAPI_CTX	1
+#else
+#define NAPI_CTX	0
+#endif
+
+#if NAPI_CTX
+typedef struct {
+	/* protects the run list against the interrupt handlers */
+	spinlock_irqsave_t lock;
+	/* devices, which wait for a poll */
+	napi_t* head;
+	napi_t* tail;
+	/* task of the context, which sleeps if the run list is empty */
+	tid_t id;
+	uint8_t waiting;
+} napi_ctx_t;
+
+static napi_ctx_t contexts[NAPI_CONTEXTS];
+static uint32_t nr_contexts = 0;
+static spinlock_t contexts_lock = SPINLOCK_INIT;
+
+/* append the device to the run list and wake up the context */
+static void napi_ctx_queue(napi_ctx_t* ctx, napi_t* napi)
+{
+	spinlock_irqsave_lock(&ctx->lock);
+	napi->run_next = NULL;
+	if (ctx->tail)
+		ctx->tail->run_next = napi;
+	else
+		ctx->head = napi;
+	ctx->tail = napi;
+
+	if (ctx->waiting) {
+		ctx->waiting = 0;
+		wakeup_task(ctx->id);
+	}
+	spinlock_irqsave_unlock(&ctx->lock);
+}
+
+static int napi_ctx_thread(void* arg)
+{
+	napi_ctx_t* ctx = (napi_ctx_t*) arg;
+
+	LOG_INFO("napi: processing context %u runs on core %d\n", (uint32_t) (ctx - contexts), CORE_ID);
+
+	while(1) {
+		napi_t* napi;
+		int work;
+
+		spinlock_irqsave_lock(&ctx->lock);
+		napi = ctx->head;
+		if (napi) {
+			ctx->head = napi->run_next;
+			if (!ctx->head)
+				ctx->tail = NULL;
+		} else {
+			ctx->waiting = 1;
+			block_current_task();
+		}
+		spinlock_irqsave_unlock(&ctx->lock);
+
+		if (!napi) {
+			reschedule();
+			continue;
+		}
+
+		LOCK_TCPIP_CORE();
+		work = napi->poll(napi, NAPI_BUDGET);
+		if (work < NAPI_BUDGET) {
+			// the device is idle => back to interrupt mode
+			napi->scheduled = 0;
+			mb();
+			napi->irq_enable(napi);
+		}
+		UNLOCK_TCPIP_CORE();
+
+		// the device is still busy => poll the other devices of the context first
+		if (work >= NAPI_BUDGET)
+			napi_ctx_queue(ctx, napi);
+	}
+
+	return 0;
+}
+
+/* create one context per interrupt core (see irq_default_core), up to NAPI_CONTEXTS */
+static void napi_ctx_init(void)
+{
+	// with -irqcore, all device interrupts arrive on the same core
+	uint32_t cores = (irq_default_core(0) == irq_default_core(1)) ? 1 : housekeeping_cores();
+	uint32_t i, n = NAPI_CONTEXTS;
+
+	if (n > cores)
+		n = cores;
+
+	for(i=0; i<n; i++) {
+		napi_ctx_t* ctx = contexts + i;
+
+		spinlock_irqsave_init(&ctx->lock);
+		ctx->head = ctx->tail = NULL;
+		ctx->waiting = 0;
+
+		if (create_kernel_task_on_core(&ctx->id, napi_ctx_thread, ctx, HIGH_PRIO, irq_default_core(i))) {
+			LOG_ERROR("napi: unable to create processing context %u\n", i);
+			break;
+		}
+	}
+
+	nr_contexts = i;
+}
+#endif
+
+#if NAPI_BUSY_POLL
+/* devices, which are polled by the busy poll task */
+static napi_t* volatile busy_list = NULL;
+
+static int napi_busy_poll(void* arg)
+{
+	LOG_INFO("napi: busy poll devices on core %d\n", CORE_ID);
+
+	while(1) {
+		int work = 0;
+
+		LOCK_TCPIP_CORE();
+		for(napi_t* napi=busy_list; napi; napi=napi->next)
+			work += napi->poll(napi, NAPI_BUDGET);
+		UNLOCK_TCPIP_CORE();
+
+		if (!work)
+			PAUSE;
+	}
+
+	return 0;
+}
+#endif
+
+/* this function is called in the context of the tcpip thread or the irq handler (by using NO_SYS) */
+static void napi_run(void* ctx)
+{
+	napi_t* napi = (napi_t*) ctx;
+	int work;
+
+#if NO_SYS
+	do {
+		work = napi->poll(napi, NAPI_BUDGET);
+	} while (work >= NAPI_BUDGET);
+#else
+	work = napi->poll(napi, NAPI_BUDGET);
+
+	// the device is still busy => give other requests a chance and poll again
+	if ((work >= NAPI_BUDGET) && (tcpip_trycallback(napi->msg) == ERR_OK))
+		return;
+#endif
+
+	// the device is idle => back to interrupt mode
+	napi->scheduled = 0;
+	mb();
+	napi->irq_enable(napi);
+}
+
+int napi_init(napi_t* napi, struct netif* netif, napi_poll_t poll, napi_enable_t irq_enable)
+{
+	napi->poll = poll;
+	napi->irq_enable = irq_enable;
+	napi->netif = netif;
+	napi->scheduled = 0;
+	napi->next = NULL;
+	napi->msg = NULL;
+	napi->ctx = -1;
+	napi->run_next = NULL;
+
+#if !NO_SYS
+	napi->msg = tcpip_callbackmsg_new(napi_run, napi);
+	if (BUILTIN_EXPECT(!napi->msg, 0))
+		return -ENOMEM;
+#endif
+
+#if NAPI_BUSY_POLL
+	// the busy poll task owns the RX path permanently
+	napi->scheduled = 1;
+	napi->next = busy_list;
+	mb();
+
+	if (!busy_list) {
+		busy_list = napi;
+		if (create_kernel_task_on_core(NULL, napi_busy_poll, NULL, HIGH_PRIO, NAPI_BUSY_POLL_CORE)) {
+			LOG_ERROR("napi: unable to create busy poll task\n");
+			busy_list = NULL;
+			napi->scheduled = 0;
+		}
+	} else busy_list = napi;
+#endif
+
+	return 0;
+}
+
+void napi_set_context(napi_t* napi, uint32_t hash)
+{
+#if NAPI_CTX
+	spinlock_lock(&contexts_lock);
+	if (!nr_contexts)
+		napi_ctx_init();
+	spinlock_unlock(&contexts_lock);
+
+	if (nr_contexts)
+		napi->ctx = hash % nr_contexts;
+#endif
+}
+
+int napi_schedule(napi_t* napi)
+{
+	if (napi->scheduled)
+		return 0;
+	napi->scheduled = 1;
+
+#if NAPI_CTX
+	if (napi->ctx >= 0) {
+		napi_ctx_queue(contexts + napi->ctx, napi);
+		return 0;
+	}
+#endif
+
+#if NO_SYS
+	napi_run(napi);
+#else
+	if (BUILTIN_EXPECT(tcpip_trycallback(napi->msg) != ERR_OK, 0)) {
+		LOG_ERROR("napi: unable to send a poll request to the tcpip thread\n");
+		napi->scheduled = 0;
+		return -EIO;
+	}
+#endif
+
+	return 0;
+}
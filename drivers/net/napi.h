@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Generic polling framework for the network drivers (similar to Linux's NAPI)
+ *
+ * The interrupt handler of a driver masks the RX interrupts of the device
+ * and calls napi_schedule. The tcpip thread polls the device with a budget
+ * until the device is idle and enables the RX interrupts again. At high
+ * packet rates, the device stays in polling mode and raises no interrupts.
+ * If NAPI_BUSY_POLL_CORE is set, a task on this core polls all devices
+ * permanently and the RX interrupts stay masked.
+ *
+ * With NAPI_CONTEXTS > 0, the polls don't pass the mbox of the tcpip
+ * thread. Instead, one processing context per core (up to NAPI_CONTEXTS)
+ * polls the devices, which are bound to it by napi_set_context. A driver
+ * binds each RX queue to its own context, so that the flows, which the
+ * device steers by hash onto the queues, are processed on different cores.
+ * LwIP has a single global state, therefore a context holds the core lock
+ * while it passes a batch of packets to the stack.
+ */
+
+#ifndef __NET_NAPI_H__
+#define __NET_NAPI_H__
+
+#include <hermit/stddef.h>
+
+struct netif;
+struct napi;
+struct tcpip_callback_msg;
+
+/* process up to budget received packets and return the number of processed packets */
+typedef int (*napi_poll_t)(struct napi* napi, int budget);
+/* enable the RX interrupts of the device, which is idle now */
+typedef void (*napi_enable_t)(struct napi* napi);
+
+typedef struct napi {
+	napi_poll_t poll;
+	napi_enable_t irq_enable;
+	struct netif* netif;
+	/* set while the tcpip thread or the busy poll task owns the RX path */
+	volatile uint8_t scheduled;
+	/* preallocated message to schedule a poll, usable in interrupt context */
+	struct tcpip_callback_msg* msg;
+	/* next device of the busy poll task */
+	struct napi* next;
+	/* processing context of the device (-1 = tcpip thread) */
+	int16_t ctx;
+	/* next device, which waits for its processing context */
+	struct napi* run_next;
+} napi_t;
+
+/*
+ * Initialize the polling context of a device
+ *
+ * @return 0 on success, -ENOMEM if the message couldn't be allocated
+ */
+int napi_init(napi_t* napi, struct netif* netif, napi_poll_t poll, napi_enable_t irq_enable);
+
+/*
+ * Bind the device to a processing context. Devices (or RX queues) with
+ * the same hash share a context. Without processing contexts, the tcpip
+ * thread keeps polling the device.
+ */
+void napi_set_context(napi_t* napi, uint32_t hash);
+
+/*
+ * Schedule a poll of the device. This function is called after
+ * the driver has masked the RX interrupts.
+ *
+ * @return 0 on success, -EIO if the poll couldn't be scheduled
+ */
+int napi_schedule(napi_t* napi);
+
+/* Is the RX path owned by the polling context? Then the RX interrupts
+ * have to stay masked. */
+static inline int napi_scheduled(napi_t* napi)
+{
+	return napi->scheduled;
+}
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/spinlock.h>
+#include <hermit/time.h>
+#include <hermit/histogram.h>
+#include <lwip/netif.h>
+#include <lwip/pbuf.h>
+#include <net/netstats.h>
+
+typedef struct {
+	struct netif* netif;
+	netstats_t* stats;
+} netstats_if_t;
+
+static netstats_if_t ifs[NETSTATS_MAX_IFS];
+static spinlock_t ifs_lock = SPINLOCK_INIT;
+
+#ifdef NETSTAMP
+/* number of packets, which are timestamped at the same time */
+#define NETSTAMP_SLOTS	256
+
+enum {
+	STAGE_RX_DRIVER = 0,
+	STAGE_RX_STACK,
+	STAGE_RX_SOCKET,
+	STAGE_TX,
+	STAGES
+};
+
+static const char* stage_names[STAGES] = {
+	"net_rx_driver", "net_rx_stack", "net_rx_socket", "net_tx"
+};
+
+typedef struct {
+	const struct pbuf* p;
+	/* end of the first buffer, it doesn't move, if LwIP adds or removes headers */
+	const void* end;
+	/* RX: the driver took the packet, TX: the application passed it */
+	uint64_t start;
+	/* RX: LwIP queued the packet at the socket, 0 = still in the stack */
+	uint64_t queued;
+	uint8_t tx;
+} netstamp_t;
+
+/* the histograms are empty until netstats_register initializes them */
+static hist_t stages[STAGES];
+static uint8_t stages_init = 0;
+static netstamp_t stamps[NETSTAMP_SLOTS];
+static spinlock_t stamps_lock = SPINLOCK_INIT;
+
+static inline netstamp_t* netstamp_slot(const struct pbuf* p)
+{
+	return stamps + (((size_t) p >> 6) % NETSTAMP_SLOTS);
+}
+
+static inline const void* netstamp_end(const struct pbuf* p)
+{
+	return (const uint8_t*) p->payload + p->len;
+}
+
+static inline void netstamp_record(uint32_t stage, uint64_t cycles)
+{
+	hist_record(stages + stage, tsc_to_ns(cycles));
+}
+
+/* store the timestamp of p, a collision replaces the older packet */
+static void netstamp_set(const struct pbuf* p, uint64_t start, uint8_t tx)
+{
+	netstamp_t* slot = netstamp_slot(p);
+
+	spinlock_lock(&stamps_lock);
+	slot->p = p;
+	slot->end = netstamp_end(p);
+	slot->start = start;
+	slot->queued = 0;
+	slot->tx = tx;
+	spinlock_unlock(&stamps_lock);
+}
+
+/*
+ * Remove the timestamp of p from the table
+ *
+ * @return 0 on success, -ENOENT if p isn't known
+ */
+static int netstamp_take(const struct pbuf* p, uint8_t tx, netstamp_t* stamp)
+{
+	netstamp_t* slot = netstamp_slot(p);
+	int ret = -ENOENT;
+
+	spinlock_lock(&stamps_lock);
+	if ((slot->p == p) && (slot->tx == tx) && (slot->end == netstamp_end(p))) {
+		*stamp = *slot;
+		slot->p = NULL;
+		ret = 0;
+	}
+	spinlock_unlock(&stamps_lock);
+
+	return ret;
+}
+
+/* mark p as queued at the socket, if LwIP hasn't released it yet */
+static void netstamp_queued(const struct pbuf* p, uint64_t start, uint64_t now)
+{
+	netstamp_t* slot = netstamp_slot(p);
+
+	spinlock_lock(&stamps_lock);
+	if ((slot->p == p) && !slot->tx && (slot->start == start))
+		slot->queued = now;
+	spinlock_unlock(&stamps_lock);
+}
+
+void netstats_tx_start(const struct pbuf* p)
+{
+	if (p)
+		netstamp_set(p, get_rdtsc(), 1);
+}
+
+void netstats_tx_done(const struct pbuf* p)
+{
+	netstamp_t stamp;
+
+	if (p && !netstamp_take(p, 1, &stamp))
+		netstamp_record(STAGE_TX, get_rdtsc() - stamp.start);
+}
+
+uint64_t netstats_rx_stamp(const struct pbuf* p)
+{
+	netstamp_t stamp;
+
+	if (!p || netstamp_take(p, 0, &stamp))
+		return 0;
+
+	if (stamp.queued)
+		netstamp_record(STAGE_RX_SOCKET, get_rdtsc() - stamp.queued);
+
+	return stamp.start;
+}
+
+static void netstamp_init(void)
+{
+	uint32_t i;
+
+	// the interfaces are registered one after another during the boot
+	if (stages_init)
+		return;
+	stages_init = 1;
+
+	for(i=0; i<STAGES; i++)
+		hist_init(stages + i, stage_names[i]);
+}
+#endif
+
+int netstats_register(struct netif* netif, netstats_t* stats)
+{
+	int i, ret = -ENOSPC;
+
+	if (BUILTIN_EXPECT(!netif || !stats, 0))
+		return -EINVAL;
+
+	memset(stats, 0x00, sizeof(netstats_t));
+
+#ifdef NETSTAMP
+	netstamp_init();
+#endif
+
+	spinlock_lock(&ifs_lock);
+	for(i=0; i<NETSTATS_MAX_IFS; i++) {
+		if (!ifs[i].netif || (ifs[i].netif == netif)) {
+			ifs[i].stats = stats;
+			ifs[i].netif = netif;
+			ret = 0;
+			break;
+		}
+	}
+	spinlock_unlock(&ifs_lock);
+
+	if (ret)
+		LOG_WARNING("netstats: too many interfaces\n");
+
+	return ret;
+}
+
+int8_t netstats_input(netstats_t* stats, struct netif* netif, struct pbuf* p, uint64_t rx_start)
+{
+	const uint16_t len = p->tot_len;
+	err_t err;
+
+#ifdef NETSTATS
+	if (!rx_start)
+		rx_start = get_rdtsc();
+#endif
+#ifdef NETSTAMP
+	const uint64_t input = get_rdtsc();
+
+	netstamp_set(p, rx_start, 0);
+#endif
+
+	err = netif->input(p, netif);
+
+#ifdef NETSTATS
+	const uint64_t now = get_rdtsc();
+	uint64_t usec = tsc_to_ns(now - rx_start) / 1000ULL;
+	uint32_t bucket = usec ? 64 - __builtin_clzll(usec) : 0;
+
+	if (bucket >= NETSTATS_LAT_BUCKETS)
+		bucket = NETSTATS_LAT_BUCKETS - 1;
+
+	NETSTATS_INC(stats, rx_packets);
+	NETSTATS_ADD(stats, rx_bytes, len);
+	NETSTATS_INC(stats, rx_latency[bucket]);
+	if (err != ERR_OK)
+		NETSTATS_INC(stats, rx_drops);
+#endif
+#ifdef NETSTAMP
+	netstamp_record(STAGE_RX_DRIVER, input - rx_start);
+	netstamp_record(STAGE_RX_STACK, now - input);
+	if (err == ERR_OK)
+		netstamp_queued(p, rx_start, now);
+#endif
+
+	return err;
+}
+
+static inline void netstats_name(struct netif* netif, char* name, size_t size)
+{
+	ksnprintf(name, size, "%c%c%u", netif->name[0], netif->name[1], (uint32_t) netif->num);
+}
+
+int netstats_get(const char* ifname, netstats_t* stats)
+{
+	char name[8];
+	int i, ret = -ENODEV;
+
+	if (BUILTIN_EXPECT(!ifname || !stats, 0))
+		return -EINVAL;
+
+	spinlock_lock(&ifs_lock);
+	for(i=0; i<NETSTATS_MAX_IFS && ifs[i].netif; i++) {
+		netstats_name(ifs[i].netif, name, sizeof(name));
+		if (!strcmp(name, ifname)) {
+			memcpy(stats, ifs[i].stats, sizeof(netstats_t));
+			ret = 0;
+			break;
+		}
+	}
+	spinlock_unlock(&ifs_lock);
+
+	return ret;
+}
+
+int netstats_get_index(uint32_t idx, char* ifname, size_t size, netstats_t* stats)
+{
+	int ret = -ENODEV;
+
+	if (BUILTIN_EXPECT(!ifname || !size || !stats, 0))
+		return -EINVAL;
+
+	spinlock_lock(&ifs_lock);
+	if ((idx < NETSTATS_MAX_IFS) && ifs[idx].netif) {
+		netstats_name(ifs[idx].netif, ifname, size);
+		memcpy(stats, ifs[idx].stats, sizeof(netstats_t));
+		ret = 0;
+	}
+	spinlock_unlock(&ifs_lock);
+
+	return ret;
+}
+
+void netstats_dump(void)
+{
+	char name[8];
+	int i, j;
+
+	spinlock_lock(&ifs_lock);
+	for(i=0; i<NETSTATS_MAX_IFS && ifs[i].netif; i++) {
+		const netstats_t* s = ifs[i].stats;
+
+		netstats_name(ifs[i].netif, name, sizeof(name));
+		LOG_INFO("%s: RX %llu packets, %llu bytes, %llu drops\n", name,
+			s->rx_packets, s->rx_bytes, s->rx_drops);
+		LOG_INFO("%s: TX %llu packets, %llu bytes, %llu drops, %llu ring full\n", name,
+			s->tx_packets, s->tx_bytes, s->tx_drops, s->tx_ring_full);
+		LOG_INFO("%s: %llu interrupts, %llu kicks\n", name, s->interrupts, s->kicks);
+		for(j=0; j<NETSTATS_LAT_BUCKETS; j++) {
+			if (!s->rx_latency[j])
+				continue;
+			if (j < NETSTATS_LAT_BUCKETS-1)
+				LOG_INFO("%s: RX latency < %u us: %llu\n", name, 1U << j, s->rx_latency[j]);
+			else
+				LOG_INFO("%s: RX latency >= %u us: %llu\n", name, 1U << (j-1), s->rx_latency[j]);
+		}
+	}
+	spinlock_unlock(&ifs_lock);
+
+#ifdef NETSTAMP
+	hist_data_t* data = kmalloc(sizeof(hist_data_t));
+
+	if (data) {
+		for(i=0; i<STAGES; i++) {
+			hist_merge(stages + i, data);
+			if (data->count)
+				hist_print(data, "ns");
+		}
+		kfree(data);
+	}
+#endif
+}
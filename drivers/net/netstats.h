@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Uniform statistics of the network interfaces
+ *
+ * Every driver embeds a netstats_t in its state, registers it with
+ * netstats_register and maintains the counters with the NETSTATS_*
+ * macros. The counters are updated with relaxed atomic operations,
+ * because the interrupt handlers and polling contexts of a device may
+ * run on different cores. If NETSTATS is disabled, the macros are empty.
+ *
+ * The RX latency histogram covers the time from the moment the driver
+ * takes a packet from the device (or the start of the hand-off) until
+ * LwIP has delivered it to the socket layer.
+ *
+ * With NETSTAMP, the stages of the packet path are recorded in addition
+ * (in ns, readable by sys_hist_read) with the TSC timestamps of the
+ * packets:
+ *
+ *  net_rx_driver  the driver took the packet => netif->input. The drivers
+ *                 call the input function in the tcpip thread, so that a
+ *                 deferred hand-off (the tcpip mbox) belongs to this stage.
+ *  net_rx_stack   LwIP processed the packet and queued it at the socket
+ *  net_rx_socket  queued at the socket => received by the application
+ *  net_tx         the application passed the packet => the driver handed
+ *                 it to the device
+ *
+ * LwIP's pbuf has no room for a timestamp, so they are kept in a small
+ * table, which is indexed by the address of the pbuf. Only paths, which
+ * see the pbuf of the driver, find the timestamp of a packet: these are
+ * sys_recvmmsg() and sys_sendmmsg() of UDP sockets. LwIP copies the data
+ * of TCP segments, so that TCP packets contribute to the driver and stack
+ * stages only.
+ */
+
+#ifndef __NET_NETSTATS_H__
+#define __NET_NETSTATS_H__
+
+#include <hermit/stddef.h>
+
+/* the timestamps extend the statistics */
+#if defined(NETSTAMP) && !defined(NETSTATS)
+#undef NETSTAMP
+#endif
+
+/* maximum number of registered interfaces */
+#define NETSTATS_MAX_IFS	4
+/* bucket i counts latencies below 2^i us, the last bucket all longer ones */
+#define NETSTATS_LAT_BUCKETS	16
+
+struct netif;
+struct pbuf;
+
+typedef struct netstats {
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	/* received packets, which are dropped (errors, no memory, rejected by LwIP) */
+	uint64_t rx_drops;
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	/* packets, which aren't sent */
+	uint64_t tx_drops;
+	/* the TX ring was full, the packet is dropped or the sender has to wait */
+	uint64_t tx_ring_full;
+	uint64_t interrupts;
+	/* notifications of the device: kicks, hypercalls and tail register writes */
+	uint64_t kicks;
+	/* histogram of the RX latency */
+	uint64_t rx_latency[NETSTATS_LAT_BUCKETS];
+} netstats_t;
+
+#ifdef NETSTATS
+#define NETSTATS_INC(stats, field)	__atomic_fetch_add(&(stats)->field, 1, __ATOMIC_RELAXED)
+#define NETSTATS_ADD(stats, field, n)	__atomic_fetch_add(&(stats)->field, (n), __ATOMIC_RELAXED)
+#else
+#define NETSTATS_INC(stats, field)	do {} while(0)
+#define NETSTATS_ADD(stats, field, n)	do {} while(0)
+#endif
+
+/* account a sent packet of len bytes */
+#define NETSTATS_TX(stats, len) \
+	do { \
+		NETSTATS_INC(stats, tx_packets); \
+		NETSTATS_ADD(stats, tx_bytes, len); \
+	} while(0)
+
+/*
+ * Register the statistics of an interface
+ *
+ * @return 0 on success, -ENOSPC if too many interfaces are registered
+ */
+int netstats_register(struct netif* netif, netstats_t* stats);
+
+/*
+ * Pass a received packet to netif->input and account the packet and its
+ * RX latency since rx_start (TSC, 0 = now). The caller keeps the
+ * ownership of the pbuf, if LwIP rejects it.
+ *
+ * @return the result of netif->input
+ */
+int8_t netstats_input(netstats_t* stats, struct netif* netif, struct pbuf* p, uint64_t rx_start);
+
+/*
+ * Copy the statistics of the interface ifname (e.g. "en0")
+ *
+ * @return 0 on success, -ENODEV if the interface isn't registered
+ */
+int netstats_get(const char* ifname, netstats_t* stats);
+
+/*
+ * Copy the name and the statistics of the idx-th registered interface
+ *
+ * @return 0 on success, -ENODEV if less interfaces are registered
+ */
+int netstats_get_index(uint32_t idx, char* ifname, size_t size, netstats_t* stats);
+
+/* print the statistics of all registered interfaces */
+void netstats_dump(void);
+
+#ifdef NETSTAMP
+/* remember the TX timestamp of p, which the application passes to LwIP */
+void netstats_tx_start(const struct pbuf* p);
+
+/* record the TX latency of p, called after the driver handed p to the device */
+void netstats_tx_done(const struct pbuf* p);
+
+/*
+ * Return the RX timestamp (TSC, when the driver took the packet) of p
+ * and record the time, which p waited at the socket
+ *
+ * @return the timestamp or 0, if p isn't known
+ */
+uint64_t netstats_rx_stamp(const struct pbuf* p);
+#else
+static inline void netstats_tx_start(const struct pbuf* p) {}
+static inline void netstats_tx_done(const struct pbuf* p) {}
+static inline uint64_t netstats_rx_stamp(const struct pbuf* p) { return 0; }
+#endif
+
+#endif
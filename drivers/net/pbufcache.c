@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/slab.h>
+#include <hermit/netparams.h>
+#include <lwip/opt.h>
+#include <lwip/pbuf.h>
+#include <net/pbufcache.h>
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+
+/* size of the payload, which LwIP reserves for a pbuf of its pool */
+#define PBUF_CACHE_BUFSIZE	LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE)
+
+typedef struct pbuf_cache_buf {
+	struct pbuf_custom pc;
+	uint8_t data[PBUF_CACHE_BUFSIZE] __attribute__ ((aligned (MEM_ALIGNMENT)));
+} pbuf_cache_buf_t;
+
+static kmem_cache_t pbuf_cache = KMEM_CACHE_INIT("pbuf", sizeof(pbuf_cache_buf_t), NULL);
+
+/* number of cached pbufs, which are owned by LwIP or a driver */
+static uint32_t pbuf_cache_used = 0;
+
+static void pbuf_cache_free(struct pbuf* p)
+{
+	kmem_cache_free(&pbuf_cache, p);
+	__atomic_fetch_sub(&pbuf_cache_used, 1, __ATOMIC_RELAXED);
+}
+
+struct pbuf* pbuf_cache_alloc(uint16_t len)
+{
+	pbuf_cache_buf_t* buf;
+	struct pbuf* p;
+
+	if (len > PBUF_CACHE_BUFSIZE)
+		goto fallback;
+	if (__atomic_add_fetch(&pbuf_cache_used, 1, __ATOMIC_RELAXED) > netparams.pbuf_pool_size)
+		goto out;
+
+	buf = kmem_cache_alloc(&pbuf_cache);
+	if (BUILTIN_EXPECT(!buf, 0))
+		goto out;
+
+	buf->pc.custom_free_function = pbuf_cache_free;
+	/*
+	 * The type PBUF_POOL allows the drivers and LwIP to move the
+	 * payload back to the start of the buffer (e.g. for the padding
+	 * word), like for the pbufs of LwIP's pool.
+	 */
+	p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_POOL, &buf->pc, buf->data, PBUF_CACHE_BUFSIZE);
+	if (BUILTIN_EXPECT(!p, 0)) {
+		kmem_cache_free(&pbuf_cache, buf);
+		goto out;
+	}
+
+	return p;
+
+out:
+	__atomic_fetch_sub(&pbuf_cache_used, 1, __ATOMIC_RELAXED);
+fallback:
+	return pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+}
+
+#else
+
+struct pbuf* pbuf_cache_alloc(uint16_t len)
+{
+	return pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Per-core cache of RX pbufs
+ *
+ * pbuf_alloc(..., PBUF_POOL) and pbuf_free take LwIP's global pool lock.
+ * If the packets are received on one core and released by the
+ * applications on other cores, this lock bounces between the cores.
+ * pbuf_cache_alloc returns custom pbufs of the size of a pool pbuf
+ * instead, which are kept in an object cache (hermit/slab.h): released
+ * pbufs stay in a cache of the releasing core and are moved in batches
+ * between the cores and the common free list.
+ *
+ * The number of cached pbufs in use is limited to the size of LwIP's
+ * pool. Beyond that limit, for larger packets or without support of
+ * custom pbufs, pbuf_cache_alloc falls back to LwIP's pool.
+ */
+
+#ifndef __NET_PBUFCACHE_H__
+#define __NET_PBUFCACHE_H__
+
+#include <hermit/stddef.h>
+
+struct pbuf;
+
+/*
+ * Allocate a pbuf of the layer PBUF_RAW, which behaves like a pbuf of
+ * LwIP's pool, and is released by pbuf_free.
+ *
+ * @return pbuf or NULL if no memory is available
+ */
+struct pbuf* pbuf_cache_alloc(uint16_t len);
+
+#endif
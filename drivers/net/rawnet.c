@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/semaphore.h>
+#include <lwip/sys.h>
+#include <lwip/netif.h>
+#include <lwip/tcpip.h>
+#include <net/rawnet.h>
+
+/* registered devices */
+static rawnet_dev_t* devices = NULL;
+/* claimed queues */
+static rawnet_queue_t* handles[RAWNET_MAX_HANDLES];
+/* protects the handles */
+static spinlock_irqsave_t handles_lock = SPINLOCK_IRQSAVE_INIT;
+
+/* request, which is executed by the tcpip thread */
+typedef struct rawnet_call {
+	const char* ifname;
+	uint16_t queue;
+	/* claimed queue (open) or queue to release (close) */
+	rawnet_queue_t* q;
+	int ret;
+	sem_t done;
+} rawnet_call_t;
+
+int rawnet_register(rawnet_dev_t* dev, struct netif* netif, const rawnet_ops_t* ops, uint16_t nr_queues)
+{
+	if (BUILTIN_EXPECT(!dev || !netif || !ops || !nr_queues || (nr_queues > RAWNET_MAX_QUEUES), 0))
+		return -EINVAL;
+
+	memset(dev->queues, 0x00, sizeof(dev->queues));
+	dev->netif = netif;
+	dev->ops = ops;
+	dev->nr_queues = nr_queues;
+	for(uint16_t i=0; i<nr_queues; i++) {
+		dev->queues[i].dev = dev;
+		dev->queues[i].index = i;
+	}
+
+	// devices are registered during the initialization of LwIP
+	dev->next = devices;
+	devices = dev;
+
+	return 0;
+}
+
+rawnet_ring_t* rawnet_ring_alloc(uint32_t num_slots, uint32_t buf_size)
+{
+	rawnet_ring_t* ring;
+	size_t sz = sizeof(rawnet_ring_t) + num_slots * sizeof(rawnet_slot_t);
+
+	ring = kmalloc(sz);
+	if (BUILTIN_EXPECT(!ring, 0))
+		return NULL;
+
+	memset(ring, 0x00, sz);
+	ring->num_slots = num_slots;
+	ring->buf_size = buf_size;
+
+	return ring;
+}
+
+void rawnet_ring_free(rawnet_ring_t* ring)
+{
+	if (ring)
+		kfree(ring);
+}
+
+/* this function is called in the context of the tcpip thread */
+static void rawnet_do_open(void* ctx)
+{
+	rawnet_call_t* call = (rawnet_call_t*) ctx;
+	struct netif* netif = netif_find(call->ifname);
+	rawnet_dev_t* dev;
+	rawnet_queue_t* q;
+
+	for(dev=devices; dev && netif; dev=dev->next) {
+		if (dev->netif == netif)
+			break;
+	}
+
+	if (!netif || !dev) {
+		call->ret = -ENODEV;
+		goto out;
+	}
+
+	if (call->queue >= dev->nr_queues) {
+		call->ret = -EINVAL;
+		goto out;
+	}
+
+	q = dev->queues + call->queue;
+	if (q->claimed) {
+		call->ret = -EBUSY;
+		goto out;
+	}
+
+	call->ret = dev->ops->claim(q);
+	if (!call->ret) {
+		q->claimed = 1;
+		call->q = q;
+	}
+
+out:
+	sem_post(&call->done);
+}
+
+/* this function is called in the context of the tcpip thread */
+static void rawnet_do_close(void* ctx)
+{
+	rawnet_call_t* call = (rawnet_call_t*) ctx;
+	rawnet_queue_t* q = call->q;
+
+	q->dev->ops->release(q);
+	q->claimed = 0;
+	call->ret = 0;
+
+	sem_post(&call->done);
+}
+
+/* execute func in the tcpip thread and wait for the result */
+static int rawnet_call(tcpip_callback_fn func, rawnet_call_t* call)
+{
+	sem_init(&call->done, 0);
+
+#if NO_SYS
+	func(call);
+#else
+	if (BUILTIN_EXPECT(tcpip_callback_with_block(func, call, 1) != ERR_OK, 0)) {
+		sem_destroy(&call->done);
+		return -EIO;
+	}
+	sem_wait(&call->done, 0);
+#endif
+	sem_destroy(&call->done);
+
+	return call->ret;
+}
+
+int rawnet_open(const char* ifname, uint16_t queue, rawnet_ring_t** rx, rawnet_ring_t** tx)
+{
+	rawnet_call_t call;
+	int handle, ret;
+
+	if (BUILTIN_EXPECT(!ifname || !rx || !tx, 0))
+		return -EINVAL;
+
+	// reserve a handle, before the device is touched
+	spinlock_irqsave_lock(&handles_lock);
+	for(handle=0; handle<RAWNET_MAX_HANDLES; handle++) {
+		if (!handles[handle])
+			break;
+	}
+	if (handle < RAWNET_MAX_HANDLES)
+		handles[handle] = (rawnet_queue_t*) -1;
+	spinlock_irqsave_unlock(&handles_lock);
+
+	if (handle >= RAWNET_MAX_HANDLES)
+		return -ENFILE;
+
+	memset(&call, 0x00, sizeof(call));
+	call.ifname = ifname;
+	call.queue = queue;
+
+	ret = rawnet_call(rawnet_do_open, &call);
+	if (ret) {
+		handles[handle] = NULL;
+		return ret;
+	}
+
+	call.q->owner = per_core(current_task)->id;
+	*rx = call.q->rx;
+	*tx = call.q->tx;
+	mb();
+	handles[handle] = call.q;
+
+	LOG_INFO("rawnet: %s, queue %u is claimed by task %u\n", ifname, queue, call.q->owner);
+
+	return handle;
+}
+
+/* get the claimed queue of handle, if the caller owns it */
+static int rawnet_get(int handle, rawnet_queue_t** q)
+{
+	rawnet_queue_t* tmp;
+
+	if (BUILTIN_EXPECT((handle < 0) || (handle >= RAWNET_MAX_HANDLES), 0))
+		return -EBADF;
+
+	tmp = handles[handle];
+	if (!tmp || (tmp == (rawnet_queue_t*) -1))
+		return -EBADF;
+	if (tmp->owner != per_core(current_task)->id)
+		return -EPERM;
+
+	*q = tmp;
+
+	return 0;
+}
+
+int rawnet_sync(int handle, int flags)
+{
+	rawnet_queue_t* q;
+	int ret;
+
+	ret = rawnet_get(handle, &q);
+	if (ret)
+		return ret;
+
+	if (flags & RAWNET_SYNC_RX) {
+		rawnet_ring_t* rx = q->rx;
+		uint32_t head = rx->head;
+
+		// the application could only return the slots, which it owns
+		if (BUILTIN_EXPECT((head >= rx->num_slots) ||
+		    (rawnet_ring_dist(rx, q->rx_cur, head) > rawnet_ring_dist(rx, q->rx_cur, rx->tail)), 0))
+			return -EINVAL;
+
+		ret = q->dev->ops->rxsync(q);
+		if (ret)
+			return ret;
+	}
+
+	if (flags & RAWNET_SYNC_TX) {
+		rawnet_ring_t* tx = q->tx;
+		uint32_t head = tx->head;
+
+		if (BUILTIN_EXPECT((head >= tx->num_slots) ||
+		    (rawnet_ring_dist(tx, q->tx_cur, head) > rawnet_ring_dist(tx, q->tx_cur, tx->tail)), 0))
+			return -EINVAL;
+
+		ret = q->dev->ops->txsync(q);
+	}
+
+	return ret;
+}
+
+int rawnet_close(int handle)
+{
+	rawnet_call_t call;
+	rawnet_queue_t* q;
+	int ret;
+
+	spinlock_irqsave_lock(&handles_lock);
+	ret = rawnet_get(handle, &q);
+	if (!ret)
+		handles[handle] = (rawnet_queue_t*) -1;
+	spinlock_irqsave_unlock(&handles_lock);
+
+	if (ret)
+		return ret;
+
+	memset(&call, 0x00, sizeof(call));
+	call.q = q;
+	ret = rawnet_call(rawnet_do_close, &call);
+	if (ret) {
+		// the queue is still claimed
+		handles[handle] = q;
+		return ret;
+	}
+
+	handles[handle] = NULL;
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Raw packet interface for user-level network stacks (similar to netmap)
+ *
+ * An application claims a queue of a network device with rawnet_open and
+ * gets the RX and TX ring of the queue. The slots of the rings point
+ * directly to the buffers of the device. Packets of a claimed queue
+ * bypass LwIP completely, the other queues are still used by LwIP.
+ *
+ * On both rings, the slots from head to tail (exclusive) belong to the
+ * application, the remaining slots to the kernel. The application moves
+ * head, the kernel moves tail during rawnet_sync:
+ *
+ * RX: the slots contain received frames. The application processes them
+ * and increases head to return the buffers. rxsync refills the returned
+ * buffers and appends new frames by increasing tail.
+ *
+ * TX: the slots contain empty buffers. The application fills them, sets
+ * the length and increases head. txsync sends all new slots and increases
+ * tail by the slots, which the device has completed.
+ *
+ * A ring keeps one slot unused to distinguish a full from an empty ring.
+ * Only the task, which has claimed the queue, may access the rings.
+ */
+
+#ifndef __NET_RAWNET_H__
+#define __NET_RAWNET_H__
+
+#include <hermit/stddef.h>
+#include <hermit/tasks_types.h>
+
+struct netif;
+struct rawnet_queue;
+
+/* maximum number of queues per device */
+#define RAWNET_MAX_QUEUES	8
+/* maximum number of claimed queues */
+#define RAWNET_MAX_HANDLES	16
+
+/* RX: the frame continues in the next slot */
+#define RAWNET_SLOT_MORE	(1 << 0)
+
+/* flags of rawnet_sync */
+#define RAWNET_SYNC_RX		(1 << 0)
+#define RAWNET_SYNC_TX		(1 << 1)
+
+typedef struct rawnet_slot {
+	/* start of the frame (RX) or the buffer (TX) */
+	void* buf;
+	/* length of the frame */
+	uint32_t len;
+	uint16_t flags;
+	/* reserved for the driver */
+	uint16_t idx;
+} rawnet_slot_t;
+
+typedef struct rawnet_ring {
+	uint32_t num_slots;
+	/* usable size of a TX buffer */
+	uint32_t buf_size;
+	/* written by the application */
+	volatile uint32_t head;
+	/* written by the kernel */
+	volatile uint32_t tail;
+	rawnet_slot_t slot[];
+} rawnet_ring_t;
+
+static inline uint32_t rawnet_ring_next(const rawnet_ring_t* ring, uint32_t i)
+{
+	return (i + 1 == ring->num_slots) ? 0 : i + 1;
+}
+
+/* number of slots from i to j (exclusive) */
+static inline uint32_t rawnet_ring_dist(const rawnet_ring_t* ring, uint32_t i, uint32_t j)
+{
+	return (j >= i) ? j - i : j + ring->num_slots - i;
+}
+
+/* number of slots, which belong to the application */
+static inline uint32_t rawnet_ring_space(const rawnet_ring_t* ring)
+{
+	return rawnet_ring_dist(ring, ring->head, ring->tail);
+}
+
+/*
+ * Operations of a driver. claim and release are called in the context
+ * of the tcpip thread, which serializes them with LwIP's use of the
+ * queues. rxsync and txsync are called by the owner of the queue.
+ */
+typedef struct rawnet_ops {
+	/* take the queue away from LwIP and set up q->rx and q->tx */
+	int (*claim)(struct rawnet_queue* q);
+	/* return all buffers to the device and the queue to LwIP */
+	void (*release)(struct rawnet_queue* q);
+	int (*rxsync)(struct rawnet_queue* q);
+	int (*txsync)(struct rawnet_queue* q);
+} rawnet_ops_t;
+
+typedef struct rawnet_queue {
+	struct rawnet_dev* dev;
+	uint16_t index;
+	uint8_t claimed;
+	/* task, which has claimed the queue */
+	tid_t owner;
+	rawnet_ring_t* rx;
+	rawnet_ring_t* tx;
+	/* RX: slots before rx_cur are returned to the device */
+	uint32_t rx_cur;
+	/* TX: slots before tx_cur are passed to the device */
+	uint32_t tx_cur;
+} rawnet_queue_t;
+
+typedef struct rawnet_dev {
+	struct netif* netif;
+	const rawnet_ops_t* ops;
+	uint16_t nr_queues;
+	rawnet_queue_t queues[RAWNET_MAX_QUEUES];
+	struct rawnet_dev* next;
+} rawnet_dev_t;
+
+/*
+ * Offer the queues of a device to the raw packet interface. The dev
+ * structure is owned by the driver and has to stay valid.
+ *
+ * @return 0 on success, -EINVAL on invalid arguments
+ */
+int rawnet_register(rawnet_dev_t* dev, struct netif* netif, const rawnet_ops_t* ops, uint16_t nr_queues);
+
+/* allocate a ring with num_slots slots, the driver assigns the buffers */
+rawnet_ring_t* rawnet_ring_alloc(uint32_t num_slots, uint32_t buf_size);
+void rawnet_ring_free(rawnet_ring_t* ring);
+
+/*
+ * Claim a queue of the interface ifname (e.g. "en0")
+ *
+ * @return handle of the queue on success, otherwise
+ *  -ENODEV if the interface doesn't exist or doesn't support the raw interface,
+ *  -EINVAL if the queue doesn't exist,
+ *  -EBUSY if the queue is already claimed,
+ *  -ENFILE if all handles are in use
+ */
+int rawnet_open(const char* ifname, uint16_t queue, rawnet_ring_t** rx, rawnet_ring_t** tx);
+
+/*
+ * Synchronize the rings of a claimed queue with the device. All slots,
+ * which the application has passed to the kernel, are processed at once.
+ *
+ * @return 0 on success, -EBADF on an invalid handle, -EPERM if the caller
+ *  doesn't own the queue, -EINVAL if head is outside of the application's slots
+ */
+int rawnet_sync(int handle, int flags);
+
+/* return the queue to LwIP */
+int rawnet_close(int handle);
+
+#endif
@@ -45,6 +45,7 @@
 #include <lwip/ethip6.h>
 #include <netif/etharp.h>
 #include <net/rtl8139.h>
+#include <net/pbufcache.h>
 
 #define RX_BUF_LEN 	8192
 #define TX_BUF_LEN	4096
@@ -100,21 +101,27 @@ static err_t rtl8139if_output(struct netif* netif, struct pbuf* p)
 
 	if (BUILTIN_EXPECT((rtl8139if->tx_queue - rtl8139if->tx_complete) > 3, 0)) {
 		LOG_ERROR("rtl8139if_output: too many packets at once\n");
+		NETSTATS_INC(&rtl8139if->stats, tx_ring_full);
+		NETSTATS_INC(&rtl8139if->stats, tx_drops);
 		return ERR_IF;
 	}
 
 	if (BUILTIN_EXPECT(p->tot_len > 1792, 0)) {
 		LOG_ERROR("rtl8139if_output: packet is longer than 1792 bytes\n");
+		NETSTATS_INC(&rtl8139if->stats, tx_drops);
 		return ERR_IF;
 	}
 
 	if (rtl8139if->tx_inuse[transmitid] == 1) {
 		LOG_ERROR("rtl8139if_output: %i already inuse\n", transmitid);
+		NETSTATS_INC(&rtl8139if->stats, tx_ring_full);
+		NETSTATS_INC(&rtl8139if->stats, tx_drops);
 		return ERR_IF;
 	}
 
 	if (inportb(rtl8139if->iobase + MSR) & MSR_LINKB) {
 		LOG_ERROR("rtl8139if_output: link failure\n");
+		NETSTATS_INC(&rtl8139if->stats, tx_drops);
 		return ERR_CONN;
 	}
 
@@ -135,6 +142,7 @@ static err_t rtl8139if_output(struct netif* netif, struct pbuf* p)
 	}
 
 	// send the packet
+	NETSTATS_INC(&rtl8139if->stats, kicks);
 	outportl(rtl8139if->iobase + TSD0 + (4 * transmitid), p->tot_len); //|0x3A0000);
 
 #if ETH_PAD_SIZE
@@ -142,11 +150,17 @@ static err_t rtl8139if_output(struct netif* netif, struct pbuf* p)
 #endif
 
 	LINK_STATS_INC(link.xmit);
+	NETSTATS_TX(&rtl8139if->stats, p->tot_len);
 
 	return ERR_OK;
 }
 
-static void rtl_rx_inthandler(struct netif* netif)
+/*
+ * Process up to budget received packets
+ *
+ * @return number of processed packets
+ */
+static int rtl_rx_inthandler(struct netif* netif, int budget)
 {
 	rtl1839if_t* rtl8139if = netif->state;
 	uint16_t header;
@@ -154,9 +168,12 @@ static void rtl_rx_inthandler(struct netif* netif)
 	uint8_t cmd;
 	struct pbuf *p = NULL;
 	struct pbuf* q;
+	int work = 0;
 
 	cmd = inportb(rtl8139if->iobase + CR);
-	while(!(cmd & CR_BUFE)) {
+	while((work < budget) && !(cmd & CR_BUFE)) {
+		work++;
+
 		header = *((uint16_t*) (rtl8139if->rx_buffer+rtl8139if->rx_pos));
 		rtl8139if->rx_pos = (rtl8139if->rx_pos + 2) % RX_BUF_LEN;
 
@@ -167,7 +184,7 @@ static void rtl_rx_inthandler(struct netif* netif)
 			length += ETH_PAD_SIZE; /* allow room for Ethernet padding */
 #endif
 
-			p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
+			p = pbuf_cache_alloc(length);
 			if (p) {
 #if ETH_PAD_SIZE
 				pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
@@ -185,29 +202,31 @@ static void rtl_rx_inthandler(struct netif* netif)
 				LINK_STATS_INC(link.recv);
 
 				// forward packet to LwIP
-				netif->input(p, netif);
+				if (netstats_input(&rtl8139if->stats, netif, p, 0) != ERR_OK)
+					pbuf_free(p);
 			} else {
 				LOG_ERROR("rtl8139if_rx_inthandler: not enough memory!\n");
 				rtl8139if->rx_pos += (rtl8139if->rx_pos + length) % RX_BUF_LEN;
 				LINK_STATS_INC(link.memerr);
 				LINK_STATS_INC(link.drop);
+				NETSTATS_INC(&rtl8139if->stats, rx_drops);
 			}
 
 			// packets are dword aligned
 			rtl8139if->rx_pos = ((rtl8139if->rx_pos + 4 + 3) & ~0x3) % RX_BUF_LEN;
+			NETSTATS_INC(&rtl8139if->stats, kicks);
 			outportw(rtl8139if->iobase + CAPR, rtl8139if->rx_pos - 0x10);
 		} else {
 			LOG_ERROR("rtl8139if_rx_inthandler: invalid header 0x%x, rx_pos %d\n", (uint32_t) header, rtl8139if->rx_pos);
 			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&rtl8139if->stats, rx_drops);
 			break;
 		}
 
 		cmd = inportb(rtl8139if->iobase + CR);
 	}
 
-	rtl8139if->polling = 0;
-	// enable all known interrupts
-	outportw(rtl8139if->iobase + IMR, INT_MASK);
+	return work;
 }
 
 static void rtl_tx_inthandler(struct netif* netif)
@@ -242,10 +261,17 @@ static void rtl_tx_inthandler(struct netif* netif)
 	}
 }
 
-/* this function is called in the context of the tcpip thread or the irq handler (by using NO_SYS) */
-static void rtl8139if_poll(void* ctx)
+static int rtl8139if_napi_poll(napi_t* napi, int budget)
 {
-	rtl_rx_inthandler(mynetif);
+	return rtl_rx_inthandler(napi->netif, budget);
+}
+
+static void rtl8139if_napi_enable(napi_t* napi)
+{
+	rtl1839if_t* rtl8139if = napi->netif->state;
+
+	// enable all known interrupts
+	outportw(rtl8139if->iobase + IMR, INT_MASK);
 }
 
 static void rtl8139if_handler(struct state* s)
@@ -253,6 +279,8 @@ static void rtl8139if_handler(struct state* s)
 	rtl1839if_t* rtl8139if = mynetif->state;
 	uint16_t isr_contents;
 
+	NETSTATS_INC(&rtl8139if->stats, interrupts);
+
 	// disable all interrupts
 	outportw(rtl8139if->iobase + IMR, 0x00);
 
@@ -261,17 +289,8 @@ static void rtl8139if_handler(struct state* s)
 		if (isr_contents == 0)
 			break;
 
-		if ((isr_contents & ISR_ROK) && !rtl8139if->polling) {
-#if NO_SYS
-			rtl8139if_poll(NULL);
-#else
-			if (tcpip_callback_with_block(rtl8139if_poll, NULL, 0) == ERR_OK) {
-				rtl8139if->polling = 1;
-			} else {
-				LOG_ERROR("rtl8139if_handler: unable to send a poll request to the tcpip thread\n");
-			}
-#endif
- 		}
+		if (isr_contents & ISR_ROK)
+			napi_schedule(&rtl8139if->napi);
 
 		if (isr_contents & ISR_TOK)
 			rtl_tx_inthandler(mynetif);
@@ -291,7 +310,7 @@ static void rtl8139if_handler(struct state* s)
 		outportw(rtl8139if->iobase + ISR, isr_contents & (ISR_RXOVW|ISR_TER|ISR_RER|ISR_TOK|ISR_ROK));
 	}
 
-	if (rtl8139if->polling) // now, the tcpip thread will check for incoming messages
+	if (napi_scheduled(&rtl8139if->napi)) // now, the polling context will check for incoming messages
 		outportw(rtl8139if->iobase + IMR, INT_MASK_NO_ROK);
 	else
 		outportw(rtl8139if->iobase + IMR, INT_MASK); // enable interrupts
@@ -343,6 +362,7 @@ err_t rtl8139if_init(struct netif* netif)
 
 	netif->state = rtl8139if;
 	mynetif = netif;
+	netstats_register(netif, &rtl8139if->stats);
 
 	tmp32 = inportl(rtl8139if->iobase + TCR);
 	if (tmp32 == 0xFFFFFF) {
@@ -357,6 +377,15 @@ err_t rtl8139if_init(struct netif* netif)
 	// determine the hardware revision
 	//tmp32 = (tmp32 & TCR_HWVERID) >> TCR_HWOFFSET;
 
+	if (BUILTIN_EXPECT(napi_init(&rtl8139if->napi, netif, rtl8139if_napi_poll, rtl8139if_napi_enable), 0)) {
+		LOG_ERROR("rtl8139if_init: unable to initialize the polling context\n");
+		kfree(rtl8139if);
+		memset(netif, 0x00, sizeof(struct netif));
+		mynetif = NULL;
+
+		return ERR_MEM;
+	}
+
 	irq_install_handler(rtl8139if->irq+32, rtl8139if_handler);
 
 	/* hardware address length */
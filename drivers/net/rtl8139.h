@@ -32,6 +32,8 @@
 
 #include <hermit/stddef.h>
 #include <hermit/spinlock.h>
+#include <net/napi.h>
+#include <net/netstats.h>
 
 // the registers are at the following places
 #define IDR0    0x0		// the ethernet ID (6bytes)
@@ -226,7 +228,10 @@ typedef struct rtl1839if {
 	uint16_t	rx_pos;
 	uint8_t		tx_inuse[4];
 	uint8_t		irq;
-	volatile uint8_t polling;
+	/* polling context of the RX path */
+	napi_t		napi;
+	/* per-interface statistics */
+	netstats_t	stats;
 } rtl1839if_t;
 
 /*
@@ -44,7 +44,9 @@
 #include <hermit/mailbox.h>
 #include <hermit/logging.h>
 #include <asm/io.h>
+#include <asm/uhyve.h>
 #include <asm/irq.h>
+#include <asm/page.h>
 #include <sys/poll.h>
 #include <lwip/sys.h>
 #include <lwip/netif.h>
@@ -54,12 +56,25 @@
 #include <lwip/err.h>
 #include <lwip/stats.h>
 #include <lwip/ethip6.h>
+#include <lwip/pbuf.h>
 #include <netif/etharp.h>
+#include <net/pbufcache.h>
 
 #include "uhyve-net.h"
 
 #define UHYVE_IRQ_NET	11
 
+/* the host writes the packets behind the padding word of LwIP */
+#define UHYVE_NET_RX_LEN	(UHYVE_NET_BUF_SIZE - ETH_PAD_SIZE)
+
+/* RX buffer of the v2 ring, which LwIP receives without a copy */
+typedef struct uhyve_net_rxbuf {
+	struct pbuf_custom pc;
+	uhyve_netif_t* netif;
+	uint8_t* data;
+	uint16_t idx;
+} uhyve_net_rxbuf_t;
+
 static int8_t uhyve_net_init_ok = 0;
 static struct netif* mynetif = NULL;
 
@@ -70,16 +85,63 @@ static int uhyve_net_write_sync(uint8_t *data, int n)
 	uhyve_netwrite.len = n;
 	uhyve_netwrite.ret = 0;
 
-	outportl(UHYVE_PORT_NETWRITE, (unsigned)virt_to_phys((size_t)&uhyve_netwrite));
+	uhyve_send(UHYVE_PORT_NETWRITE, (unsigned)virt_to_phys((size_t)&uhyve_netwrite));
 
 	return uhyve_netwrite.ret;
 }
 
+/*
+ * The host reads the whole table, which therefore must not cross a page
+ * boundary. Outgoing packets are serialized by LwIP.
+ */
+static uhyve_net_iovec_t tx_iov[UHYVE_NET_MAX_IOV] __attribute__ ((aligned (UHYVE_NET_MAX_IOV*sizeof(uhyve_net_iovec_t))));
+
+/* send a whole frame with one exit, the pbufs aren't linearized */
+static int uhyve_net_writev_sync(struct pbuf* p)
+{
+	volatile uhyve_netwritev_t uhyve_netwritev;
+	uint32_t cnt = 0;
+	struct pbuf* q;
+
+	for (q = p; q != NULL; q = q->next) {
+		size_t addr = (size_t) q->payload;
+		size_t len = q->len;
+
+		// a segment has to be physically contiguous => split it at page boundaries
+		while (len > 0) {
+			size_t n = MIN(len, PAGE_SIZE - (addr & (PAGE_SIZE-1)));
+
+			if (BUILTIN_EXPECT(cnt >= UHYVE_NET_MAX_IOV, 0))
+				return -ENOBUFS;
+
+			tx_iov[cnt].addr = virt_to_phys(addr);
+			tx_iov[cnt].len = n;
+			tx_iov[cnt].flags = 0;
+			cnt++;
+
+			addr += n;
+			len -= n;
+		}
+	}
+
+	if (BUILTIN_EXPECT(!cnt, 0))
+		return 0;
+	tx_iov[cnt-1].flags = UHYVE_NET_IOV_EOP;
+
+	uhyve_netwritev.iov = (uhyve_net_iovec_t*) virt_to_phys((size_t) tx_iov);
+	uhyve_netwritev.iovcnt = cnt;
+	uhyve_netwritev.ret = 0;
+
+	uhyve_send(UHYVE_PORT_NETWRITEV, (unsigned)virt_to_phys((size_t)&uhyve_netwritev));
+
+	return uhyve_netwritev.ret;
+}
+
 int uhyve_net_stat(void)
 {
         volatile uhyve_netstat_t uhyve_netstat;
 
-        outportl(UHYVE_PORT_NETSTAT, (unsigned)virt_to_phys((size_t)&uhyve_netstat));
+	uhyve_send(UHYVE_PORT_NETSTAT, (unsigned)virt_to_phys((size_t)&uhyve_netstat));
 
         return uhyve_netstat.status;
 }
@@ -92,23 +154,164 @@ static int uhyve_net_read_sync(uint8_t *data, int *n)
 	uhyve_netread.len = *n;
 	uhyve_netread.ret = 0;
 
-	outportl(UHYVE_PORT_NETREAD, (unsigned)virt_to_phys((size_t)&uhyve_netread));
+	uhyve_send(UHYVE_PORT_NETREAD, (unsigned)virt_to_phys((size_t)&uhyve_netread));
 	*n = uhyve_netread.len;
 
 	return uhyve_netread.ret;
 }
 
 static char mac_str[18];
-static char *hermit_net_mac_str(void)
+static char *hermit_net_mac_str(uhyve_netif_t* uhyve_netif)
 {
 	volatile uhyve_netinfo_t uhyve_netinfo;
 
-	outportl(UHYVE_PORT_NETINFO, (unsigned)virt_to_phys((size_t)&uhyve_netinfo));
+	memset((void*) &uhyve_netinfo, 0x00, sizeof(uhyve_netinfo));
+
+	// offer the shared rings, a v1 host ignores them
+	if (uhyve_netif->tx_ring && uhyve_netif->rx_ring) {
+		uhyve_netinfo.version = UHYVE_NET_VERSION;
+		uhyve_netinfo.ring_size = UHYVE_NET_RING_SIZE;
+		uhyve_netinfo.tx_ring = virt_to_phys((size_t) uhyve_netif->tx_ring);
+		uhyve_netinfo.rx_ring = virt_to_phys((size_t) uhyve_netif->rx_ring);
+	}
+
+	uhyve_send(UHYVE_PORT_NETINFO, (unsigned)virt_to_phys((size_t)&uhyve_netinfo));
 	memcpy(mac_str, (void *)&uhyve_netinfo.mac_str, 18);
+	uhyve_netif->features = uhyve_netinfo.features;
+
+	if (uhyve_netinfo.version && (uhyve_netinfo.version_ack == UHYVE_NET_VERSION))
+		uhyve_netif->version = UHYVE_NET_VERSION;
+	else
+		uhyve_netif->version = 1;
 
 	return mac_str;
 }
 
+static void uhyve_net_rings_free(uhyve_netif_t* uhyve_netif)
+{
+	if (uhyve_netif->tx_ring)
+		page_free(uhyve_netif->tx_ring, sizeof(uhyve_net_ring_t));
+	if (uhyve_netif->rx_ring)
+		page_free(uhyve_netif->rx_ring, sizeof(uhyve_net_ring_t));
+	if (uhyve_netif->tx_bufs)
+		page_free(uhyve_netif->tx_bufs, UHYVE_NET_RING_SIZE*UHYVE_NET_BUF_SIZE);
+	if (uhyve_netif->rx_bufs)
+		page_free(uhyve_netif->rx_bufs, UHYVE_NET_RX_POOL*UHYVE_NET_BUF_SIZE);
+	if (uhyve_netif->rx_pool)
+		kfree(uhyve_netif->rx_pool);
+
+	uhyve_netif->tx_ring = uhyve_netif->rx_ring = NULL;
+	uhyve_netif->tx_bufs = uhyve_netif->rx_bufs = NULL;
+	uhyve_netif->rx_pool = NULL;
+}
+
+/* post the pool buffer idx in a RX slot, the host uses it after the next update of avail */
+static inline void uhyve_net_rx_post(uhyve_netif_t* uhyve_netif, uint32_t slot, uint16_t idx)
+{
+	uhyve_netif->rx_slot[slot] = idx;
+	uhyve_netif->rx_ring->desc[slot].addr = virt_to_phys((size_t) uhyve_netif->rx_pool[idx].data) + ETH_PAD_SIZE;
+	uhyve_netif->rx_ring->desc[slot].len = UHYVE_NET_RX_LEN;
+}
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+/* LwIP releases a lent buffer, may be called in any context */
+static void uhyve_net_rxbuf_free(struct pbuf* p)
+{
+	uhyve_net_rxbuf_t* rxbuf = (uhyve_net_rxbuf_t*) p;
+	uhyve_netif_t* uhyve_netif = rxbuf->netif;
+
+	spinlock_irqsave_lock(&uhyve_netif->rx_pool_lock);
+	uhyve_netif->rx_free[uhyve_netif->rx_nr_free++] = rxbuf->idx;
+	spinlock_irqsave_unlock(&uhyve_netif->rx_pool_lock);
+}
+
+/*
+ * Lend the buffer of a completed RX slot to LwIP and post an unused
+ * buffer of the pool in its place.
+ *
+ * @return pbuf of the packet or NULL if all other buffers are lent
+ */
+static struct pbuf* uhyve_net_rx_lend(uhyve_netif_t* uhyve_netif, uint32_t slot, uint32_t len)
+{
+	uhyve_net_rxbuf_t* rxbuf = uhyve_netif->rx_pool + uhyve_netif->rx_slot[slot];
+	struct pbuf* p;
+	int32_t idx = -1;
+
+	spinlock_irqsave_lock(&uhyve_netif->rx_pool_lock);
+	if (uhyve_netif->rx_nr_free)
+		idx = uhyve_netif->rx_free[--uhyve_netif->rx_nr_free];
+	spinlock_irqsave_unlock(&uhyve_netif->rx_pool_lock);
+
+	if (idx < 0)
+		return NULL;
+
+	/*
+	 * PBUF_REF: LwIP must not move the payload in front of the
+	 * buffer, the padding word is part of the packet.
+	 */
+	p = pbuf_alloced_custom(PBUF_RAW, len + ETH_PAD_SIZE, PBUF_REF, &rxbuf->pc,
+		rxbuf->data, UHYVE_NET_BUF_SIZE);
+	if (BUILTIN_EXPECT(!p, 0)) {
+		uhyve_net_rxbuf_free((struct pbuf*) &uhyve_netif->rx_pool[idx]);
+		return NULL;
+	}
+
+	uhyve_net_rx_post(uhyve_netif, slot, idx);
+
+	return p;
+}
+#else
+static inline struct pbuf* uhyve_net_rx_lend(uhyve_netif_t* uhyve_netif, uint32_t slot, uint32_t len)
+{
+	return NULL;
+}
+#endif
+
+static int uhyve_net_rings_alloc(uhyve_netif_t* uhyve_netif)
+{
+	uint32_t i;
+
+	uhyve_netif->tx_ring = page_alloc(sizeof(uhyve_net_ring_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	uhyve_netif->rx_ring = page_alloc(sizeof(uhyve_net_ring_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	uhyve_netif->tx_bufs = page_alloc(UHYVE_NET_RING_SIZE*UHYVE_NET_BUF_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	uhyve_netif->rx_bufs = page_alloc(UHYVE_NET_RX_POOL*UHYVE_NET_BUF_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	uhyve_netif->rx_pool = kmalloc(UHYVE_NET_RX_POOL*sizeof(uhyve_net_rxbuf_t));
+	if (!uhyve_netif->tx_ring || !uhyve_netif->rx_ring || !uhyve_netif->tx_bufs || !uhyve_netif->rx_bufs || !uhyve_netif->rx_pool) {
+		uhyve_net_rings_free(uhyve_netif);
+		return -ENOMEM;
+	}
+
+	memset(uhyve_netif->tx_ring, 0x00, sizeof(uhyve_net_ring_t));
+	memset(uhyve_netif->rx_ring, 0x00, sizeof(uhyve_net_ring_t));
+	memset(uhyve_netif->rx_pool, 0x00, UHYVE_NET_RX_POOL*sizeof(uhyve_net_rxbuf_t));
+	spinlock_irqsave_init(&uhyve_netif->rx_pool_lock);
+
+	for (i=0; i<UHYVE_NET_RX_POOL; i++) {
+		uhyve_netif->rx_pool[i].netif = uhyve_netif;
+		uhyve_netif->rx_pool[i].data = uhyve_netif->rx_bufs + i*UHYVE_NET_BUF_SIZE;
+		uhyve_netif->rx_pool[i].idx = i;
+#if LWIP_SUPPORT_CUSTOM_PBUF
+		uhyve_netif->rx_pool[i].pc.custom_free_function = uhyve_net_rxbuf_free;
+#endif
+	}
+
+	// every slot owns one buffer, the buffers don't have to be physically contiguous
+	for (i=0; i<UHYVE_NET_RING_SIZE; i++) {
+		uhyve_netif->tx_ring->desc[i].addr = virt_to_phys((size_t) uhyve_netif->tx_bufs + i*UHYVE_NET_BUF_SIZE);
+		uhyve_net_rx_post(uhyve_netif, i, i);
+	}
+
+	// the remaining RX buffers replace the buffers, which are lent to LwIP
+	for (i=UHYVE_NET_RING_SIZE; i<UHYVE_NET_RX_POOL; i++)
+		uhyve_netif->rx_free[uhyve_netif->rx_nr_free++] = i;
+
+	// all RX buffers are available for the host
+	uhyve_netif->rx_ring->avail = UHYVE_NET_RING_SIZE;
+	uhyve_netif->rx_last = 0;
+
+	return 0;
+}
+
 static inline uint8_t dehex(char c)
 {
         if (c >= '0' && c <= '9')
@@ -123,13 +326,60 @@ static inline uint8_t dehex(char c)
 
 //---------------------------- OUTPUT --------------------------------------------
 
+static err_t uhyve_net_ring_output(uhyve_netif_t* uhyve_netif, struct pbuf* p)
+{
+	uhyve_net_ring_t* tx = uhyve_netif->tx_ring;
+	uint32_t avail = tx->avail;
+	uint32_t slot = avail % UHYVE_NET_RING_SIZE;
+	uint8_t* buf = uhyve_netif->tx_bufs + slot*UHYVE_NET_BUF_SIZE;
+	uint32_t i;
+	struct pbuf *q;
+
+	// the rings belong to the raw packet interface
+	if (BUILTIN_EXPECT(uhyve_netif->raw_claimed, 0)) {
+		LINK_STATS_INC(link.drop);
+		NETSTATS_INC(&uhyve_netif->stats, tx_drops);
+		return ERR_IF;
+	}
+
+	if (BUILTIN_EXPECT(avail - tx->used >= UHYVE_NET_RING_SIZE, 0)) {
+		LWIP_DEBUGF(NETIF_DEBUG, ("uhyve_net_ring_output: TX ring is full\n"));
+		LINK_STATS_INC(link.drop);
+		NETSTATS_INC(&uhyve_netif->stats, tx_ring_full);
+		NETSTATS_INC(&uhyve_netif->stats, tx_drops);
+		return ERR_IF;
+	}
+
+	for (q = p, i = 0; q != 0; q = q->next) {
+		memcpy(buf + i, q->payload, q->len);
+		i += q->len;
+	}
+	tx->desc[slot].len = i;
+
+	// publish the packet, afterwards check if the host is idle
+	mb();
+	tx->avail = avail + 1;
+	mb();
+
+	// the host has already sent all previous packets => kick it
+	if (tx->used == avail) {
+		NETSTATS_INC(&uhyve_netif->stats, kicks);
+		uhyve_send(UHYVE_PORT_NETWRITE, 0);
+	}
+
+	return ERR_OK;
+}
+
 static err_t uhyve_netif_output(struct netif* netif, struct pbuf* p)
 {
+	uhyve_netif_t* uhyve_netif = netif->state;
 	uint32_t i;
 	struct pbuf *q;
+	err_t err = ERR_OK;
 
 	if(BUILTIN_EXPECT(p->tot_len > 1792, 0)) {
 		LOG_ERROR("uhyve_netif_output: packet (%i bytes) is longer than 1792 bytes\n", p->tot_len);
+		NETSTATS_INC(&uhyve_netif->stats, tx_drops);
 		return ERR_IF;
 	}
 
@@ -141,30 +391,70 @@ static err_t uhyve_netif_output(struct netif* netif, struct pbuf* p)
 	 * q traverses through linked list of pbuf's
 	 * This list MUST consist of a single packet ONLY
 	 */
-	for (q = p, i = 0; q != 0; q = q->next) {
-		// send the packet
-		uhyve_net_write_sync(q->payload, q->len);
-		i += q->len;
-	}
+	if (uhyve_netif->version >= UHYVE_NET_VERSION) {
+		err = uhyve_net_ring_output(uhyve_netif, p);
+	} else if (!(uhyve_netif->features & UHYVE_NET_FEAT_WRITEV)
+		   || (uhyve_net_writev_sync(p) == -ENOBUFS)) {
+		// old host or too many segments => one exit per segment
+		for (q = p, i = 0; q != 0; q = q->next) {
+			// send the packet
+			NETSTATS_INC(&uhyve_netif->stats, kicks);
+			uhyve_net_write_sync(q->payload, q->len);
+			i += q->len;
+		}
+	} else NETSTATS_INC(&uhyve_netif->stats, kicks);
 
 #if ETH_PAD_SIZE
 	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
 
-	LINK_STATS_INC(link.xmit);
+	if (err == ERR_OK) {
+		LINK_STATS_INC(link.xmit);
+		NETSTATS_TX(&uhyve_netif->stats, p->tot_len);
+		netstats_tx_done(p);
+	}
 
-	return ERR_OK;
+	return err;
 }
 
-static void consume_packet(void* ctx)
+/* pass all queued packets to LwIP, runs in the tcpip thread */
+static void uhyve_net_rx_deliver(void* ctx)
 {
-	struct pbuf *p = (struct pbuf*) ctx;
+	uhyve_netif_t* uhyve_netif = (uhyve_netif_t*) ctx;
+	uint32_t tail = uhyve_netif->rx_tail;
+	struct pbuf *p;
+
+	// packets, which are queued from now on, require a new callback
+	uhyve_netif->rx_scheduled = 0;
+	mb();
+
+	while (tail != uhyve_netif->rx_head) {
+		uint64_t stamp = uhyve_netif->rx_stamp[tail % UHYVE_NET_RX_BATCH];
 
-	mynetif->input(p, mynetif);
+		p = uhyve_netif->rx_queue[tail % UHYVE_NET_RX_BATCH];
+		uhyve_netif->rx_tail = ++tail;
+
+		LINK_STATS_INC(link.recv);
+		netstats_input(&uhyve_netif->stats, mynetif, p, stamp);
+	}
+}
+
+static void uhyve_net_rx_schedule(uhyve_netif_t* uhyve_netif)
+{
+	if (uhyve_netif->rx_scheduled || (uhyve_netif->rx_head == uhyve_netif->rx_tail))
+		return;
+
+	uhyve_netif->rx_scheduled = 1;
+	if (BUILTIN_EXPECT(tcpip_trycallback(uhyve_netif->rx_msg) != ERR_OK, 0)) {
+		// the mbox is full => the next interrupt tries again
+		uhyve_netif->rx_scheduled = 0;
+		uhyve_netif->rx_post_fail++;
+	}
 }
 
 //------------------------------- POLLING ----------------------------------------
 
+/* called with disabled interrupts, the packets are queued for the tcpip thread */
 static void uhyve_netif_poll(void)
 {
 	if (!uhyve_net_init_ok)
@@ -175,17 +465,29 @@ static void uhyve_netif_poll(void)
 	struct pbuf *p = NULL;
 	struct pbuf *q;
 
+	// every read is a hypercall, the last one finds no packet
+	NETSTATS_INC(&uhyve_netif->stats, kicks);
 	while (uhyve_net_read_sync(uhyve_netif->rx_buf, &len) == 0)
 	{
+		NETSTATS_INC(&uhyve_netif->stats, kicks);
+
+		if (BUILTIN_EXPECT(uhyve_netif->rx_head - uhyve_netif->rx_tail >= UHYVE_NET_RX_BATCH, 0)) {
+			uhyve_netif->rx_drop_full++;
+			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&uhyve_netif->stats, rx_drops);
+			len = RX_BUF_LEN;
+			continue;
+		}
+
 #if ETH_PAD_SIZE
 		len += ETH_PAD_SIZE; /*allow room for Ethernet padding */
 #endif
-		p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+		p = pbuf_cache_alloc(len);
 		if(p) {
 #if ETH_PAD_SIZE
 			pbuf_header(p, -ETH_PAD_SIZE); /*drop the padding word */
 #endif
-			uint8_t pos = 0;
+			uint32_t pos = 0;
 			for (q=p; q!=NULL; q=q->next) {
 				memcpy((uint8_t*) q->payload, uhyve_netif->rx_buf + pos, q->len);
 				pos += q->len;
@@ -194,27 +496,315 @@ static void uhyve_netif_poll(void)
 			pbuf_header(p, ETH_PAD_SIZE); /*reclaim the padding word */
 #endif
 
+			uhyve_netif->rx_queue[uhyve_netif->rx_head % UHYVE_NET_RX_BATCH] = p;
+			uhyve_netif->rx_stamp[uhyve_netif->rx_head % UHYVE_NET_RX_BATCH] = get_rdtsc();
+			mb();
+			uhyve_netif->rx_head++;
+		} else {
+			LOG_ERROR("uhyve_netif_poll: not enough memory!\n");
+			uhyve_netif->rx_drop_mem++;
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&uhyve_netif->stats, rx_drops);
+		}
+
+		// offer the whole buffer to the next read
+		len = RX_BUF_LEN;
+	}
+
+	// forward all packets to the IP thread with one callback
+	uhyve_net_rx_schedule(uhyve_netif);
+}
+
+/*
+ * Process up to budget packets of the v2 RX ring
+ *
+ * @return number of processed packets
+ */
+static int uhyve_net_ring_poll(napi_t* napi, int budget)
+{
+	uhyve_netif_t* uhyve_netif = napi->netif->state;
+	uhyve_net_ring_t* rx = uhyve_netif->rx_ring;
+	struct pbuf *p, *q;
+	uint32_t avail;
+	int work = 0;
+
+	// the application polls the ring itself
+	if (uhyve_netif->raw_claimed)
+		return 0;
 
-			//forward packet to the IP thread
-			if (tcpip_callback_with_block(consume_packet, p, 0) == ERR_OK) {
-				LINK_STATS_INC(link.recv);
-			} else {
-				LINK_STATS_INC(link.drop);
-				pbuf_free(p);
+	while ((work < budget) && (uhyve_netif->rx_last != rx->used))
+	{
+		uint32_t slot = uhyve_netif->rx_last % UHYVE_NET_RING_SIZE;
+		uint8_t* buf = uhyve_netif->rx_pool[uhyve_netif->rx_slot[slot]].data + ETH_PAD_SIZE;
+		const uint64_t stamp = get_rdtsc();
+		uint32_t len, pos;
+
+		// read the descriptor not before the host has completed it
+		mb();
+		len = rx->desc[slot].len;
+		if (BUILTIN_EXPECT(len > UHYVE_NET_RX_LEN, 0))
+			len = UHYVE_NET_RX_LEN;
+
+		p = uhyve_net_rx_lend(uhyve_netif, slot, len);
+		if (p) {
+			LINK_STATS_INC(link.recv);
+
+			// forward the buffer of the host to LwIP
+			netstats_input(&uhyve_netif->stats, napi->netif, p, stamp);
+		} else if ((p = pbuf_cache_alloc(len + ETH_PAD_SIZE)) != NULL) {
+			// LwIP holds all spare buffers => copy and post the buffer again
+			uhyve_netif->rx_copied++;
+#if ETH_PAD_SIZE
+			pbuf_header(p, -ETH_PAD_SIZE); /*drop the padding word */
+#endif
+			for (q=p, pos=0; q!=NULL; q=q->next) {
+				memcpy((uint8_t*) q->payload, buf + pos, q->len);
+				pos += q->len;
 			}
+#if ETH_PAD_SIZE
+			pbuf_header(p, ETH_PAD_SIZE); /*reclaim the padding word */
+#endif
+			LINK_STATS_INC(link.recv);
+
+			// forward packet to LwIP
+			netstats_input(&uhyve_netif->stats, napi->netif, p, stamp);
 		} else {
-			LOG_ERROR("uhyve_netif_poll: not enough memory!\n");
+			LOG_ERROR("uhyve_net_ring_poll: not enough memory!\n");
 			LINK_STATS_INC(link.memerr);
 			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&uhyve_netif->stats, rx_drops);
 		}
+
+		rx->desc[slot].len = UHYVE_NET_RX_LEN;
+		uhyve_netif->rx_last++;
+		work++;
+	}
+
+	if (!work)
+		return 0;
+
+	// give the buffers back to the host
+	avail = rx->avail;
+	mb();
+	rx->avail = avail + work;
+	mb();
+
+	// the host has run out of buffers => kick it
+	if (rx->used == avail) {
+		NETSTATS_INC(&uhyve_netif->stats, kicks);
+		uhyve_send(UHYVE_PORT_NETREAD, 0);
+	}
+
+	return work;
+}
+
+/* hand the RX ring over to the polling context */
+static void uhyve_net_ring_schedule(uhyve_netif_t* uhyve_netif)
+{
+	// no further interrupts while the polling context drains the ring
+	uhyve_netif->rx_ring->flags |= UHYVE_NET_F_NO_NOTIFY;
+	if (BUILTIN_EXPECT(napi_schedule(&uhyve_netif->napi), 0))
+		uhyve_netif->rx_ring->flags &= ~UHYVE_NET_F_NO_NOTIFY;
+}
+
+static void uhyve_net_ring_enable(napi_t* napi)
+{
+	uhyve_netif_t* uhyve_netif = napi->netif->state;
+	uhyve_net_ring_t* rx = uhyve_netif->rx_ring;
+
+	// a claimed ring doesn't need interrupts
+	if (uhyve_netif->raw_claimed)
+		return;
+
+	rx->flags &= ~UHYVE_NET_F_NO_NOTIFY;
+	mb();
+
+	/*
+	 * Packets, which arrive before the interrupts are enabled,
+	 * may not raise an interrupt => check again
+	 */
+	if (uhyve_netif->rx_last != rx->used) {
+		uhyve_net_ring_schedule(uhyve_netif);
 	}
 }
 
 static void uhyve_irqhandler(struct state* s)
 {
-	uhyve_netif_poll();
+	uhyve_netif_t* uhyve_netif;
+
+	if (!uhyve_net_init_ok)
+		return;
+
+	uhyve_netif = mynetif->state;
+	NETSTATS_INC(&uhyve_netif->stats, interrupts);
+	if (uhyve_netif->version >= UHYVE_NET_VERSION) {
+		uhyve_net_ring_schedule(uhyve_netif);
+	} else {
+		uhyve_netif_poll();
+	}
 }
 
+//------------------------------ RAW INTERFACE -----------------------------------
+
+/*
+ * The slots of the raw rings correspond to the descriptors of the shared
+ * rings. The application reads and writes the buffers of the host directly.
+ */
+
+/* give n RX buffers back to the host, beginning at slot first */
+static void uhyve_net_raw_repost(uhyve_netif_t* uhyve_netif, uint32_t first, uint32_t n)
+{
+	uhyve_net_ring_t* rx = uhyve_netif->rx_ring;
+	uint32_t i, avail;
+
+	if (!n)
+		return;
+
+	for (i=0; i<n; i++)
+		rx->desc[(first + i) % UHYVE_NET_RING_SIZE].len = UHYVE_NET_RX_LEN;
+
+	avail = rx->avail;
+	mb();
+	rx->avail = avail + n;
+	mb();
+
+	// the host has run out of buffers => kick it
+	if (rx->used == avail)
+		uhyve_send(UHYVE_PORT_NETREAD, 0);
+}
+
+/* this function is called in the context of the tcpip thread */
+static int uhyve_net_raw_claim(rawnet_queue_t* q)
+{
+	uhyve_netif_t* uhyve_netif = q->dev->netif->state;
+	rawnet_ring_t* rxr = rawnet_ring_alloc(UHYVE_NET_RING_SIZE, UHYVE_NET_BUF_SIZE);
+	rawnet_ring_t* txr = rawnet_ring_alloc(UHYVE_NET_RING_SIZE, UHYVE_NET_BUF_SIZE);
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(!rxr || !txr, 0)) {
+		rawnet_ring_free(rxr);
+		rawnet_ring_free(txr);
+		return -ENOMEM;
+	}
+
+	for (i=0; i<UHYVE_NET_RING_SIZE; i++) {
+		// the buffers of the slots don't change while the rings are claimed
+		rxr->slot[i].buf = uhyve_netif->rx_pool[uhyve_netif->rx_slot[i]].data + ETH_PAD_SIZE;
+		txr->slot[i].buf = uhyve_netif->tx_bufs + i*UHYVE_NET_BUF_SIZE;
+	}
+
+	// from now on, LwIP doesn't use the rings and the host doesn't interrupt us
+	uhyve_netif->raw_claimed = 1;
+	uhyve_netif->rx_ring->flags |= UHYVE_NET_F_NO_NOTIFY;
+	mb();
+
+	// the remaining RX packets are passed to the application by the first rxsync
+	q->rx_cur = rxr->head = rxr->tail = uhyve_netif->rx_last % UHYVE_NET_RING_SIZE;
+	// packets of LwIP may still be in flight
+	q->tx_cur = txr->head = uhyve_netif->tx_ring->avail % UHYVE_NET_RING_SIZE;
+	txr->tail = (uhyve_netif->tx_ring->used + UHYVE_NET_RING_SIZE - 1) % UHYVE_NET_RING_SIZE;
+
+	q->rx = rxr;
+	q->tx = txr;
+
+	return 0;
+}
+
+/* this function is called in the context of the tcpip thread */
+static void uhyve_net_raw_release(rawnet_queue_t* q)
+{
+	uhyve_netif_t* uhyve_netif = q->dev->netif->state;
+
+	// the buffers, which the application still holds, belong to the host again
+	uhyve_net_raw_repost(uhyve_netif, q->rx_cur, rawnet_ring_dist(q->rx, q->rx_cur, q->rx->tail));
+
+	rawnet_ring_free(q->rx);
+	rawnet_ring_free(q->tx);
+	q->rx = q->tx = NULL;
+
+	uhyve_netif->raw_claimed = 0;
+	mb();
+
+	// LwIP takes over the packets, which are received in the meantime
+	uhyve_net_ring_schedule(uhyve_netif);
+}
+
+static int uhyve_net_raw_rxsync(rawnet_queue_t* q)
+{
+	uhyve_netif_t* uhyve_netif = q->dev->netif->state;
+	uhyve_net_ring_t* rx = uhyve_netif->rx_ring;
+	rawnet_ring_t* ring = q->rx;
+	uint32_t head = ring->head;
+	uint32_t tail = ring->tail;
+
+	// the application has processed the slots up to head
+	uhyve_net_raw_repost(uhyve_netif, q->rx_cur, rawnet_ring_dist(ring, q->rx_cur, head));
+	q->rx_cur = head;
+
+	while ((uhyve_netif->rx_last != rx->used) && (rawnet_ring_next(ring, tail) != head))
+	{
+		uint32_t len;
+
+		// read the descriptor not before the host has completed it
+		mb();
+		len = rx->desc[tail].len;
+		if (BUILTIN_EXPECT(len > UHYVE_NET_RX_LEN, 0))
+			len = UHYVE_NET_RX_LEN;
+
+		ring->slot[tail].len = len;
+		ring->slot[tail].flags = 0;
+		tail = rawnet_ring_next(ring, tail);
+		uhyve_netif->rx_last++;
+	}
+
+	// publish the slots, afterwards the application may read them
+	mb();
+	ring->tail = tail;
+
+	return 0;
+}
+
+static int uhyve_net_raw_txsync(rawnet_queue_t* q)
+{
+	uhyve_netif_t* uhyve_netif = q->dev->netif->state;
+	uhyve_net_ring_t* tx = uhyve_netif->tx_ring;
+	rawnet_ring_t* ring = q->tx;
+	uint32_t head = ring->head;
+	uint32_t n = rawnet_ring_dist(ring, q->tx_cur, head);
+	uint32_t i, avail;
+
+	if (n) {
+		for (i=q->tx_cur; i!=head; i=rawnet_ring_next(ring, i)) {
+			uint32_t len = ring->slot[i].len;
+
+			tx->desc[i].len = (len > UHYVE_NET_BUF_SIZE) ? UHYVE_NET_BUF_SIZE : len;
+		}
+		q->tx_cur = head;
+
+		// publish the whole batch, afterwards check if the host is idle
+		avail = tx->avail;
+		mb();
+		tx->avail = avail + n;
+		mb();
+
+		if (tx->used == avail)
+			uhyve_send(UHYVE_PORT_NETWRITE, 0);
+	}
+
+	// the buffers of the sent packets belong to the application again
+	ring->tail = (tx->used + UHYVE_NET_RING_SIZE - 1) % UHYVE_NET_RING_SIZE;
+
+	return 0;
+}
+
+static const rawnet_ops_t uhyve_net_raw_ops = {
+	.claim = uhyve_net_raw_claim,
+	.release = uhyve_net_raw_release,
+	.rxsync = uhyve_net_raw_rxsync,
+	.txsync = uhyve_net_raw_txsync,
+};
+
 //--------------------------------- INIT -----------------------------------------
 
 err_t uhyve_netif_init (struct netif* netif)
@@ -231,23 +821,54 @@ err_t uhyve_netif_init (struct netif* netif)
 
 	memset(uhyve_netif, 0x00, sizeof(uhyve_netif_t));
 
-	uhyve_netif->rx_buf = page_alloc(RX_BUF_LEN + 16 /* header size */, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
-	if (!(uhyve_netif->rx_buf)) {
-		LOG_ERROR("uhyve_netif_init: out of memory\n");
-		kfree(uhyve_netif);
-		return ERR_MEM;
-	}
-	memset(uhyve_netif->rx_buf, 0x00, RX_BUF_LEN + 16);
+	// without the shared rings, we fall back to the v1 protocol
+	if (BUILTIN_EXPECT(uhyve_net_rings_alloc(uhyve_netif), 0))
+		LOG_WARNING("uhyve_netif_init: unable to allocate the shared rings\n");
 
 	netif->state = uhyve_netif;
 	mynetif = netif;
+	netstats_register(netif, &uhyve_netif->stats);
 
 	netif->hwaddr_len = ETHARP_HWADDR_LEN;
 
 	LOG_INFO("uhyve_netif_init: Found uhyve_net interface\n");
 
+	char *hermit_mac = hermit_net_mac_str(uhyve_netif);
+
+	if (uhyve_netif->version >= UHYVE_NET_VERSION) {
+		if (BUILTIN_EXPECT(napi_init(&uhyve_netif->napi, netif, uhyve_net_ring_poll, uhyve_net_ring_enable), 0)) {
+			// the host owns the rings now => don't release them
+			LOG_ERROR("uhyve_netif_init: unable to initialize the polling context\n");
+			netif->state = NULL;
+			mynetif = NULL;
+			kfree(uhyve_netif);
+			return ERR_MEM;
+		}
+
+		// applications may claim the rings
+		rawnet_register(&uhyve_netif->raw, netif, &uhyve_net_raw_ops, 1);
+	} else {
+		uhyve_net_rings_free(uhyve_netif);
+
+		uhyve_netif->rx_buf = page_alloc(RX_BUF_LEN + 16 /* header size */, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+		uhyve_netif->rx_msg = tcpip_callbackmsg_new(uhyve_net_rx_deliver, uhyve_netif);
+		if (!(uhyve_netif->rx_buf) || !(uhyve_netif->rx_msg)) {
+			LOG_ERROR("uhyve_netif_init: out of memory\n");
+			if (uhyve_netif->rx_buf)
+				page_free(uhyve_netif->rx_buf, RX_BUF_LEN + 16);
+			if (uhyve_netif->rx_msg)
+				tcpip_callbackmsg_delete(uhyve_netif->rx_msg);
+			netif->state = NULL;
+			mynetif = NULL;
+			kfree(uhyve_netif);
+			return ERR_MEM;
+		}
+		memset(uhyve_netif->rx_buf, 0x00, RX_BUF_LEN + 16);
+	}
+
+	LOG_INFO("uhyve_netif_init: use protocol version %u\n", uhyve_netif->version);
+
 	LWIP_DEBUGF(NETIF_DEBUG, ("uhyve_netif_init: MAC address "));
-	char *hermit_mac = hermit_net_mac_str();
 	for (tmp8=0; tmp8 < ETHARP_HWADDR_LEN; tmp8++) {
 		netif->hwaddr[tmp8] = dehex(*hermit_mac++) << 4;
 		netif->hwaddr[tmp8] |= dehex(*hermit_mac++);
@@ -288,7 +909,14 @@ err_t uhyve_netif_init (struct netif* netif)
 	uhyve_net_init_ok = 1;
 
 	/* check if we already receive an interrupt */
-	uhyve_netif_poll();
+	if (uhyve_netif->version >= UHYVE_NET_VERSION) {
+		uhyve_net_ring_schedule(uhyve_netif);
+	} else {
+		// the interrupt handler also fills the queue
+		uint8_t flags = irq_nested_disable();
+		uhyve_netif_poll();
+		irq_nested_enable(flags);
+	}
 
 	return ERR_OK;
 }
@@ -32,17 +32,93 @@
 
 #include <hermit/stddef.h>
 #include <hermit/spinlock.h>
+#include <net/napi.h>
+#include <net/rawnet.h>
+#include <net/netstats.h>
+
+struct pbuf;
+struct tcpip_callback_msg;
+struct uhyve_net_rxbuf;
 
 #define MIN(a, b)	(a) < (b) ? (a) : (b)
 
 #define RX_BUF_LEN 3276
 
+#if (UHYVE_NET_RX_BATCH < 1) || (UHYVE_NET_RX_BATCH & (UHYVE_NET_RX_BATCH - 1))
+#error UHYVE_NET_RX_BATCH has to be a power of two
+#endif
+
+/*
+ * uhyve-net v2 replaces the per-packet hypercalls by two rings in guest
+ * memory, which are announced via UHYVE_PORT_NETINFO.
+ *
+ * On both rings, the guest publishes descriptors by increasing avail and
+ * the host completes them in order by increasing used. Both counters are
+ * free running, the slot of a counter is (counter % UHYVE_NET_RING_SIZE).
+ *
+ * TX: the guest posts outgoing packets. It writes to UHYVE_PORT_NETWRITE
+ * only if the host has already completed all previous packets. Therefore,
+ * the host has to check avail again after updating used and before it
+ * goes to sleep.
+ *
+ * RX: the guest posts empty buffers, the host writes the packet length
+ * into the descriptor. The guest may exchange the buffer of a completed
+ * descriptor, so the host has to read the address of each descriptor,
+ * after avail has passed it. The host raises UHYVE_IRQ_NET after a batch of
+ * packets, but not while UHYVE_NET_F_NO_NOTIFY is set in the RX ring.
+ * The guest writes to UHYVE_PORT_NETREAD only if the host has run out
+ * of buffers.
+ *
+ * In v2 mode, the values, which are written to the ports, are ignored.
+ */
+#define UHYVE_NET_VERSION	2
+#define UHYVE_NET_RING_SIZE	128
+#define UHYVE_NET_BUF_SIZE	4096
+/*
+ * number of RX buffers, one ring of them is posted to the host, the
+ * others carry received packets through LwIP without a copy
+ */
+#define UHYVE_NET_RX_POOL	(2*UHYVE_NET_RING_SIZE)
+
+/* the guest is polling the ring and doesn't need an interrupt */
+#define UHYVE_NET_F_NO_NOTIFY	(1 << 0)
+
+typedef struct {
+	/* guest physical address of the buffer */
+	uint64_t addr;
+	/* buffer size (RX posted), packet length (TX, RX used) */
+	uint32_t len;
+	uint32_t reserved;
+} __attribute__((packed)) uhyve_net_desc_t;
+
+typedef struct {
+	/* written by the guest */
+	volatile uint32_t avail;
+	volatile uint32_t flags;
+	uint8_t pad0[CACHE_LINE-2*sizeof(uint32_t)];
+	/* written by the host */
+	volatile uint32_t used;
+	uint8_t pad1[CACHE_LINE-sizeof(uint32_t)];
+	uhyve_net_desc_t desc[UHYVE_NET_RING_SIZE];
+} __attribute__((packed)) uhyve_net_ring_t;
+
 // UHYVE_PORT_NETINFO
 typedef struct {
         /* OUT */
         char mac_str[18];
+        /* IN */
+        uint32_t version;
+        uint32_t ring_size;
+        uint64_t tx_ring;
+        uint64_t rx_ring;
+        /* OUT, v1 hosts leave it untouched */
+        uint32_t version_ack;
+        uint32_t features;
 } __attribute__((packed)) uhyve_netinfo_t;
 
+/* the host supports UHYVE_PORT_NETWRITEV */
+#define UHYVE_NET_FEAT_WRITEV	(1 << 0)
+
 // UHYVE_PORT_NETWRITE
 typedef struct {
         /* IN */
@@ -52,6 +128,27 @@ typedef struct {
         int ret;
 } __attribute__((packed)) uhyve_netwrite_t;
 
+// UHYVE_PORT_NETWRITEV
+#define UHYVE_NET_MAX_IOV	32
+
+/* the segment completes an Ethernet frame */
+#define UHYVE_NET_IOV_EOP	(1 << 0)
+
+typedef struct {
+	/* guest physical address of the segment */
+	uint64_t addr;
+	uint32_t len;
+	uint32_t flags;
+} __attribute__((packed)) uhyve_net_iovec_t;
+
+typedef struct {
+        /* IN */
+        const uhyve_net_iovec_t* iov;
+        uint32_t iovcnt;
+        /* OUT */
+        int ret;
+} __attribute__((packed)) uhyve_netwritev_t;
+
 // UHYVE_PORT_NETREAD
 typedef struct {
         /* IN */
@@ -76,6 +173,49 @@ typedef struct uhyve_netif {
 	struct eth_addr *ethaddr;
 	/* Add whatever per-interface state that is needed here. */
 	uint8_t* rx_buf;
+	/* v1: received packets, which wait for the tcpip thread */
+	struct pbuf* rx_queue[UHYVE_NET_RX_BATCH];
+	/* v1: TSC, when the queued packets are read from the host */
+	uint64_t rx_stamp[UHYVE_NET_RX_BATCH];
+	volatile uint32_t rx_head;
+	volatile uint32_t rx_tail;
+	/* set while a delivery callback is pending */
+	volatile uint8_t rx_scheduled;
+	struct tcpip_callback_msg* rx_msg;
+	/* packets dropped because of a full queue or missing pbufs */
+	uint32_t rx_drop_full;
+	uint32_t rx_drop_mem;
+	/* failed posts of the delivery callback (the packets stay queued) */
+	uint32_t rx_post_fail;
+	/* negotiated protocol version */
+	uint32_t version;
+	/* UHYVE_NET_FEAT_* of the host */
+	uint32_t features;
+	/* v2 rings and their buffers */
+	uhyve_net_ring_t* tx_ring;
+	uhyve_net_ring_t* rx_ring;
+	uint8_t* tx_bufs;
+	uint8_t* rx_bufs;
+	/* next RX descriptor, which the host will complete */
+	uint32_t rx_last;
+	/* v2 RX buffers as custom pbufs, which are lent to LwIP */
+	struct uhyve_net_rxbuf* rx_pool;
+	/* pool index of the buffer, which is posted in a RX slot */
+	uint16_t rx_slot[UHYVE_NET_RING_SIZE];
+	/* stack of the unused pool indices */
+	uint16_t rx_free[UHYVE_NET_RX_POOL];
+	uint32_t rx_nr_free;
+	/* protects rx_free, pbufs are released in any context */
+	spinlock_irqsave_t rx_pool_lock;
+	/* packets, which are copied, because LwIP holds all buffers */
+	uint32_t rx_copied;
+	/* polling context of the v2 RX ring */
+	napi_t napi;
+	/* v2 rings are accessible by the raw packet interface */
+	rawnet_dev_t raw;
+	/* set while an application owns the rings, LwIP doesn't use them */
+	volatile uint8_t raw_claimed;
+	netstats_t stats;
 } uhyve_netif_t;
 
 err_t uhyve_netif_init(struct netif* netif);
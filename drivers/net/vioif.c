@@ -28,13 +28,17 @@
 #include <hermit/stddef.h>
 #include <hermit/stdio.h>
 #include <hermit/string.h>
+#include <hermit/stdlib.h>
 #include <hermit/processor.h>
 #include <hermit/mailbox.h>
 #include <hermit/logging.h>
 #include <hermit/virtio_net.h>
 #include <hermit/virtio_ring.h>
 #include <hermit/virtio_pci.h>
-#include <hermit/virtio_net.h>
+#include <hermit/virtio_mmio.h>
+#include <hermit/virtio_ids.h>
+#include <hermit/vma.h>
+#include <hermit/checksum.h>
 #include <asm/page.h>
 #include <asm/io.h>
 #include <asm/irq.h>
@@ -47,8 +51,12 @@
 #include <lwip/ethip6.h>
 #include <netif/etharp.h>
 #include <net/vioif.h>
+#include <net/pbufcache.h>
+#include <virtio/vpci.h>
 
 #define VENDOR_ID 0x1AF4
+/* device ID of a network device without legacy interface (0x1040 + device type) */
+#define VIOIF_MODERN_ID	(0x1040 + VIRTIO_ID_NET)
 #define VIOIF_BUFFER_SIZE 0x2048
 #define MIN(a, b)	(a) < (b) ? (a) : (b)
 #define QUEUE_LIMIT 256
@@ -57,277 +65,1720 @@
 #define TX_NUM	1
 #define RX_NUM	0
 
+/* the queues of pair i are 2*i (RX) and 2*i+1 (TX), followed by the control queue */
+#define RX_QUEUE(vioif, i)	(&(vioif)->queues[2*(i)+RX_NUM])
+#define TX_QUEUE(vioif, i)	(&(vioif)->queues[2*(i)+TX_NUM])
+
+/* number of reclaim attempts before vioif_output gives up on a full queue */
+#define TX_RETRIES	1000
+/* maximum number of payload descriptors per packet (a 64 KiB super segment needs 17) */
+#define VIOIF_MAX_SEGS	24
+/* packets up to this size are copied into the bounce buffer */
+#define VIOIF_COPYBREAK	256
+/* buffer ID without a raw TX slot */
+#define VIOIF_RAW_NONE	0xFFFF
+
+/* size of an ethernet header without padding */
+#define VIOIF_ETH_HLEN	14
+#define VIOIF_TCP_HLEN	20
+#define VIOIF_HAS(vioif, f)	((vioif)->features & (1UL << (f)))
+#define VIOIF_EVENT_IDX(vioif)	(VIOIF_HAS(vioif, VIRTIO_RING_F_EVENT_IDX) ? 1 : 0)
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+/* number of spare RX buffers to refill the ring while LwIP holds received packets */
+#define VIOIF_RX_SPARE	128
+#else
+#define VIOIF_RX_SPARE	0
+#endif
+
+/*
+ * Description of a RX buffer. If LwIP supports custom pbufs, a received
+ * packet is passed to LwIP without copying and the buffer returns to the
+ * spare list as soon as the pbuf is freed.
+ */
+typedef struct vioif_rxbuf {
+#if LWIP_SUPPORT_CUSTOM_PBUF
+	/* has to be the first element */
+	struct pbuf_custom pc;
+#endif
+	struct vioif_rxbuf* next;
+	/* RX queue, which owns the buffer */
+	virt_queue_t* vq;
+	size_t virt;
+	size_t phys;
+} vioif_rxbuf_t;
+
+/* segment of a buffer, which is described by a single descriptor */
+typedef struct vioif_seg {
+	size_t addr;
+	uint32_t len;
+	uint16_t flags;
+} vioif_seg_t;
+
 static struct netif* mynetif = NULL;
 
-static inline void vioif_enable_interrupts(virt_queue_t* vq)
+extern atomic_int32_t possible_cpus;
+
+static inline uint32_t vioif_mmio_read(vioif_t* vioif, uint32_t off)
+{
+	return *((volatile uint32_t*) (vioif->mmio + off));
+}
+
+static inline void vioif_mmio_write(vioif_t* vioif, uint32_t off, uint32_t value)
+{
+#ifdef __aarch64__
+	// the device has to see all previous writes to the rings
+	asm volatile ("dsb st" ::: "memory");
+#endif
+	*((volatile uint32_t*) (vioif->mmio + off)) = value;
+}
+
+/*
+ * Access to the device: the legacy PCI interface uses I/O ports, the
+ * modern interface (virtio 1.x) memory mapped structures. Both versions
+ * of virtio-mmio use a single register window.
+ */
+static inline uint8_t vioif_get_status(vioif_t* vioif)
+{
+	if (vioif->mmio)
+		return vioif_mmio_read(vioif, VIRTIO_MMIO_STATUS);
+	if (vioif->modern)
+		return vpci_get_status(&vioif->vpci);
+
+	return inportb(vioif->iobase + VIRTIO_PCI_STATUS);
+}
+
+static inline void vioif_set_status(vioif_t* vioif, uint8_t status)
+{
+	if (vioif->mmio)
+		vioif_mmio_write(vioif, VIRTIO_MMIO_STATUS, status);
+	else if (vioif->modern)
+		vpci_set_status(&vioif->vpci, status);
+	else
+		outportb(vioif->iobase + VIRTIO_PCI_STATUS, status);
+}
+
+/* determine the features of the host */
+static uint64_t vioif_get_features(vioif_t* vioif)
 {
-	vq->vring.used->flags = 0;
+	uint64_t features;
+
+	if (vioif->mmio) {
+		vioif_mmio_write(vioif, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 0);
+		features = vioif_mmio_read(vioif, VIRTIO_MMIO_DEVICE_FEATURES);
+		vioif_mmio_write(vioif, VIRTIO_MMIO_DEVICE_FEATURES_SEL, 1);
+		features |= ((uint64_t) vioif_mmio_read(vioif, VIRTIO_MMIO_DEVICE_FEATURES)) << 32;
+
+		return features;
+	}
+
+	if (!vioif->modern)
+		return inportl(vioif->iobase + VIRTIO_PCI_HOST_FEATURES);
+
+	return vpci_get_features(&vioif->vpci);
+}
+
+/*
+ * Tell the host, which features we want to use.
+ *
+ * @return features, which are accepted by the host
+ */
+static uint64_t vioif_set_features(vioif_t* vioif, uint64_t features)
+{
+	if (vioif->mmio) {
+		vioif_mmio_write(vioif, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 0);
+		vioif_mmio_write(vioif, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t) features);
+		vioif_mmio_write(vioif, VIRTIO_MMIO_DRIVER_FEATURES_SEL, 1);
+		vioif_mmio_write(vioif, VIRTIO_MMIO_DRIVER_FEATURES, (uint32_t) (features >> 32));
+
+		// the device rejects unsupported features by clearing FEATURES_OK
+		return features;
+	}
+
+	if (!vioif->modern) {
+		outportl(vioif->iobase + VIRTIO_PCI_GUEST_FEATURES, (uint32_t) features);
+		return inportl(vioif->iobase + VIRTIO_PCI_GUEST_FEATURES);
+	}
+
+	vpci_set_features(&vioif->vpci, features);
+
+	// a modern device rejects unsupported features by clearing FEATURES_OK
+	return features;
+}
+
+/*
+ * Read a field of the device specific configuration. The modern interface
+ * requires accesses, which match the width of the field.
+ */
+static void vioif_cfg_read(vioif_t* vioif, uint32_t off, void* buf, uint32_t len)
+{
+	uint8_t* dst = (uint8_t*) buf;
+	uint8_t gen;
+
+	if (vioif->mmio) {
+		volatile uint8_t* cfg = vioif->mmio + VIRTIO_MMIO_CONFIG;
+
+		// the legacy interface has no generation counter and reads always 0
+		do {
+			gen = vioif_mmio_read(vioif, VIRTIO_MMIO_CONFIG_GENERATION);
+			if (len == sizeof(uint16_t))
+				*((uint16_t*) dst) = *((volatile uint16_t*) (cfg + off));
+			else if (len == sizeof(uint32_t))
+				*((uint32_t*) dst) = *((volatile uint32_t*) (cfg + off));
+			else for(uint32_t i=0; i<len; i++)
+				dst[i] = cfg[off + i];
+		} while (gen != (uint8_t) vioif_mmio_read(vioif, VIRTIO_MMIO_CONFIG_GENERATION));
+		return;
+	}
+
+	if (!vioif->modern) {
+		for(uint32_t i=0; i<len; i++)
+			dst[i] = inportb(vioif->iobase + VIRTIO_PCI_CONFIG_OFF(vioif->msix_enabled) + off + i);
+		return;
+	}
+
+	vpci_cfg_read(&vioif->vpci, off, buf, len);
+}
+
+/* reading the isr status acknowledges the legacy interrupt, virtio-mmio requires a write */
+static inline uint8_t vioif_isr(vioif_t* vioif)
+{
+	if (vioif->mmio) {
+		uint32_t isr = vioif_mmio_read(vioif, VIRTIO_MMIO_INTERRUPT_STATUS);
+
+		if (isr)
+			vioif_mmio_write(vioif, VIRTIO_MMIO_INTERRUPT_ACK, isr);
+		return isr;
+	}
+	if (vioif->modern)
+		return vpci_isr(&vioif->vpci);
+
+	return inportb(vioif->iobase + VIRTIO_PCI_ISR);
+}
+
+static inline void vioif_notify(vioif_t* vioif, virt_queue_t* vq)
+{
+	NETSTATS_INC(&vioif->stats, kicks);
+
+	if (vioif->mmio)
+		vioif_mmio_write(vioif, VIRTIO_MMIO_QUEUE_NOTIFY, vq->index);
+	else if (vioif->modern)
+		vpci_notify(vq->notify, vq->index);
+	else
+		outportw(vioif->iobase+VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
+
+static inline void vioif_enable_interrupts(vioif_t* vioif, virt_queue_t* vq)
+{
+	// interrupt for the next used buffer
+	if (vq->packed)
+		vq->pvring.driver->flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+	else
+		vring_enable_cb(&vq->vring, vq->last_seen_used, VIOIF_EVENT_IDX(vioif));
 }
 
 static inline void vioif_disable_interrupts(virt_queue_t* vq)
 {
-	vq->vring.used->flags = 1;
+	if (vq->packed)
+		vq->pvring.driver->flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+	else
+		vring_disable_cb(&vq->vring);
+}
+
+/* notify the host about new buffers, if it doesn't process the queue anyway */
+static inline void vioif_kick(vioif_t* vioif, virt_queue_t* vq)
+{
+	uint16_t cur;
+	int kick;
+
+	// besure that the avail index is written before we read the event index
+	mb();
+
+	if (vq->packed) {
+		uint16_t old = vq->last_kick & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+
+		// the position of the last kick is relative to the current wrap counter
+		if ((vq->last_kick >> VRING_PACKED_EVENT_F_WRAP_CTR) != vq->avail_wrap)
+			old -= vq->vring.num;
+		kick = vring_packed_need_kick(&vq->pvring, old, vq->next_avail, vq->avail_wrap, VIOIF_EVENT_IDX(vioif));
+		cur = vq->next_avail | (vq->avail_wrap << VRING_PACKED_EVENT_F_WRAP_CTR);
+	} else {
+		kick = vring_need_kick(&vq->vring, vq->last_kick, VIOIF_EVENT_IDX(vioif));
+		cur = vq->vring.avail->idx;
+	}
+
+	if (kick)
+		vioif_notify(vioif, vq);
+	vq->last_kick = cur;
+}
+
+/* has the host used a buffer, which we haven't processed yet? */
+static inline int vioif_vq_pending(virt_queue_t* vq)
+{
+	if (vq->packed)
+		return vring_packed_is_used(&vq->pvring, vq->last_seen_used, vq->used_wrap);
+
+	return vq->last_seen_used != vq->vring.used->idx;
+}
+
+/*
+ * Determine ID and length of the k-th used buffer, which isn't processed
+ * yet. In the packed ring, k > 0 requires that the buffers consist of a
+ * single descriptor (e.g. RX buffers).
+ *
+ * @return 0 on success, -1 if the host hasn't used the buffer yet
+ */
+static inline int vioif_vq_peek(virt_queue_t* vq, uint16_t k, uint16_t* id, uint32_t* len)
+{
+	if (BUILTIN_EXPECT(k >= vq->vring.num, 0))
+		return -1;
+
+	if (vq->packed) {
+		uint16_t pos = vq->last_seen_used + k;
+		int wrap = vq->used_wrap;
+
+		if (pos >= vq->vring.num) {
+			pos -= vq->vring.num;
+			wrap ^= 1;
+		}
+
+		if (!vring_packed_is_used(&vq->pvring, pos, wrap))
+			return -1;
+
+		// read the descriptor not before its flags
+		mb();
+		*id = vq->pvring.desc[pos].id;
+		*len = vq->pvring.desc[pos].len;
+	} else {
+		struct vring_used_elem* elem;
+
+		if ((uint16_t) (vq->vring.used->idx - vq->last_seen_used) <= k)
+			return -1;
+
+		elem = &vq->vring.used->ring[(uint16_t) (vq->last_seen_used + k) % vq->vring.num];
+		*id = elem->id;
+		*len = elem->len;
+	}
+
+	return 0;
+}
+
+/* mark the next used buffer, which consists of ndesc descriptors, as processed */
+static inline void vioif_vq_pop(virt_queue_t* vq, uint16_t ndesc)
+{
+	if (vq->packed) {
+		vq->last_seen_used += ndesc;
+		if (vq->last_seen_used >= vq->vring.num) {
+			vq->last_seen_used -= vq->vring.num;
+			vq->used_wrap ^= 1;
+		}
+	} else vq->last_seen_used++;
+}
+
+/*
+ * Reserve n consecutive descriptors of the packed ring. The split ring
+ * doesn't need a reservation, because the buffer uses a descriptor chain.
+ *
+ * @return position of the first descriptor and the wrap counter (bit 15)
+ */
+static inline uint16_t vioif_vq_reserve(virt_queue_t* vq, uint16_t n)
+{
+	uint16_t pos;
+
+	if (!vq->packed)
+		return 0;
+
+	pos = vq->next_avail | (vq->avail_wrap << VRING_PACKED_EVENT_F_WRAP_CTR);
+	vq->next_avail += n;
+	if (vq->next_avail >= vq->vring.num) {
+		vq->next_avail -= vq->vring.num;
+		vq->avail_wrap ^= 1;
+	}
+
+	return pos;
+}
+
+/*
+ * Make a buffer, which consists of n segments, available to the host.
+ * In the split ring, the buffer uses the descriptor chain beginning at id.
+ * In the packed ring, id is the buffer ID and the buffer uses the
+ * descriptors, which are reserved at pos (see vioif_vq_reserve).
+ */
+static void vioif_vq_add(virt_queue_t* vq, uint16_t id, uint16_t pos, const vioif_seg_t* segs, uint16_t n)
+{
+	if (vq->packed) {
+		uint16_t first = pos & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+		uint16_t d = first, head_flags = 0;
+		int wrap = pos >> VRING_PACKED_EVENT_F_WRAP_CTR;
+
+		for(uint16_t i=0; i<n; i++) {
+			uint16_t flags = segs[i].flags | vring_packed_avail_flags(wrap);
+
+			if (i + 1 < n)
+				flags |= VRING_DESC_F_NEXT;
+
+			vq->pvring.desc[d].addr = segs[i].addr;
+			vq->pvring.desc[d].len = segs[i].len;
+			vq->pvring.desc[d].id = id;
+			if (i)
+				vq->pvring.desc[d].flags = flags;
+			else
+				head_flags = flags;
+
+			if (++d >= vq->vring.num) {
+				d = 0;
+				wrap ^= 1;
+			}
+		}
+
+		// the host may process the buffer as soon as the first descriptor is available
+		mb();
+		vq->pvring.desc[first].flags = head_flags;
+	} else {
+		uint16_t d = id;
+
+		for(uint16_t i=0; i<n; i++) {
+			vq->vring.desc[d].addr = segs[i].addr;
+			vq->vring.desc[d].len = segs[i].len;
+			vq->vring.desc[d].flags = segs[i].flags | ((i + 1 < n) ? VRING_DESC_F_NEXT : 0);
+			d = vq->vring.desc[d].next;
+		}
+
+		// Add it in the available ring
+		vq->vring.avail->ring[vq->vring.avail->idx % vq->vring.num] = id;
+
+		// besure that everything is written
+		mb();
+
+		vq->vring.avail->idx++;
+	}
+}
+
+/*
+ * Return all descriptor chains, which the host has consumed, to the free
+ * list and release the pbufs referenced by them. Because pbuf_free may
+ * block, this function must not be called in interrupt context.
+ */
+static void vioif_tx_reclaim(virt_queue_t* vq)
+{
+	while(1)
+	{
+		struct pbuf* p;
+		uint16_t id, last, cnt;
+		uint32_t len;
+
+		spinlock_irqsave_lock(&vq->lock);
+		if (vioif_vq_peek(vq, 0, &id, &len)) {
+			spinlock_irqsave_unlock(&vq->lock);
+			break;
+		}
+
+		LOG_DEBUG("consumed TX elements: index %u, len %u\n", id, len);
+
+		p = vq->tx_pbufs[id];
+		vq->tx_pbufs[id] = NULL;
+
+		// the slot of a raw packet returns to the application by the next txsync
+		if (vq->raw_slots && (vq->raw_slots[id] != VIOIF_RAW_NONE)) {
+			vq->raw_done[vq->raw_slots[id]] = 1;
+			vq->raw_slots[id] = VIOIF_RAW_NONE;
+		}
+
+		if (vq->packed) {
+			// the descriptors are free again, the buffer ID returns to the free list
+			cnt = vq->tx_ndesc[id];
+			vq->tx_next[id] = vq->free_head;
+			vq->free_head = id;
+		} else {
+			for(last=id, cnt=1; vq->vring.desc[last].flags & VRING_DESC_F_NEXT; cnt++) {
+				vq->vring.desc[last].len = 0;
+				vq->vring.desc[last].flags = 0;
+				last = vq->vring.desc[last].next;
+			}
+			vq->vring.desc[last].len = 0;
+			vq->vring.desc[last].next = vq->free_head;
+			vq->free_head = id;
+		}
+		vq->nr_free += cnt;
+		vioif_vq_pop(vq, cnt);
+		spinlock_irqsave_unlock(&vq->lock);
+
+		if (p)
+			pbuf_free(p);
+	}
+}
+
+/*
+ * Take a chain of n descriptors from the free list. If the queue is full,
+ * the consumed descriptors are reclaimed and the host is kicked until
+ * enough descriptors get free or TX_RETRIES is reached. In the packed
+ * ring, the ID of the buffer is taken from the free list and the
+ * position of the reserved descriptors is stored in pos.
+ *
+ * @return index of the first descriptor or vq->vring.num if the queue is still full
+ */
+static uint16_t vioif_tx_get_desc(vioif_t* vioif, virt_queue_t* vq, uint16_t n, uint16_t* pos)
+{
+	uint16_t id, last;
+	uint32_t retries = 0;
+
+	while(1)
+	{
+		spinlock_irqsave_lock(&vq->lock);
+		if (vq->nr_free >= n)
+			break;
+		spinlock_irqsave_unlock(&vq->lock);
+
+		vioif_tx_reclaim(vq);
+		if (vq->nr_free >= n)
+			continue;
+		if (retries++ >= TX_RETRIES)
+			return vq->vring.num;
+
+		// the host may wait for a notification to process the queue
+		vioif_notify(vioif, vq);
+		PAUSE;
+	}
+
+	if (vq->packed) {
+		// each in-flight buffer uses at least one descriptor => a free ID exists
+		id = vq->free_head;
+		vq->free_head = vq->tx_next[id];
+		vq->tx_ndesc[id] = n;
+		*pos = vioif_vq_reserve(vq, n);
+	} else {
+		// the free list is already chained by desc[].next
+		id = last = vq->free_head;
+		for(uint16_t i=1; i<n; i++)
+			last = vq->vring.desc[last].next;
+		vq->free_head = vq->vring.desc[last].next;
+		vq->vring.desc[last].next = 0;
+		*pos = 0;
+	}
+	vq->nr_free -= n;
+
+	spinlock_irqsave_unlock(&vq->lock);
+
+	return id;
+}
+
+/* this function is called in the context of the tcpip thread or the irq handler (by using NO_SYS) */
+static void vioif_tx_poll(void* ctx)
+{
+	vioif_t* vioif = mynetif->state;
+
+	vioif->tx_polling = 0;
+	mb();
+
+	// claimed queues are reclaimed by their owner
+	for(uint16_t i=0; i<vioif->nr_pairs; i++) {
+		if (!TX_QUEUE(vioif, i)->raw)
+			vioif_tx_reclaim(TX_QUEUE(vioif, i));
+	}
+}
+
+/* add the big endian 16 bit words of data to the ones' complement sum */
+static uint32_t vioif_csum_add(uint32_t sum, const uint8_t* data, uint32_t len)
+{
+	uint32_t i;
+
+	for(i=0; i+1<len; i+=2)
+		sum += ((uint32_t) data[i] << 8) | data[i+1];
+	if (len & 1)
+		sum += (uint32_t) data[len-1] << 8;
+
+	return sum;
+}
+
+static inline uint16_t vioif_csum_fold(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xFFFF) + (sum >> 16);
+
+	return (uint16_t) sum;
+}
+
+/*
+ * Fill in the virtio header of an outgoing packet. If the host computes the
+ * TCP checksums, LwIP leaves the checksum field empty and we store the
+ * checksum of the pseudo header there. Frames larger than the MTU are TCP
+ * super segments, which the host splits into MTU sized segments.
+ */
+static err_t vioif_tx_offload(struct netif* netif, struct pbuf* p, struct virtio_net_hdr* hdr)
+{
+	vioif_t* vioif = netif->state;
+	uint8_t* data = (uint8_t*) p->payload;
+	uint32_t l3off = VIOIF_ETH_HLEN;
+	uint32_t l4off, l4len, tcp_hlen, sum;
+	uint8_t gso_type;
+
+	memset(hdr, 0x00, sizeof(struct virtio_net_hdr));
+
+	if (!vioif->tx_csum)
+		return ERR_OK;
+
+	// LwIP builds all headers in the first pbuf
+	if (p->len < l3off + 1)
+		return ERR_OK;
+
+	uint16_t type = ((uint16_t) data[12] << 8) | data[13];
+	if (type == ETHTYPE_IP) {
+		if (((data[l3off] & 0x0F) * 4 < 20) || (data[l3off+9] != IP_PROTO_TCP))
+			return ERR_OK;
+		l4off = l3off + (data[l3off] & 0x0F) * 4;
+		l4len = (((uint32_t) data[l3off+2] << 8) | data[l3off+3]) - (l4off - l3off);
+		sum = vioif_csum_add(0, data + l3off + 12, 8);
+		gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+	} else if (type == ETHTYPE_IPV6) {
+		if (data[l3off+6] != IP6_NEXTH_TCP)
+			return ERR_OK;
+		l4off = l3off + 40;
+		l4len = ((uint32_t) data[l3off+4] << 8) | data[l3off+5];
+		sum = vioif_csum_add(0, data + l3off + 8, 32);
+		gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
+	} else return ERR_OK;
+
+	if (BUILTIN_EXPECT(p->len < l4off + VIOIF_TCP_HLEN, 0)) {
+		LOG_ERROR("vioif_output: TCP header isn't part of the first pbuf\n");
+		return ERR_IF;
+	}
+	tcp_hlen = (data[l4off+12] >> 4) * 4;
+
+	// checksum of the pseudo header, the host adds the checksum of the segment
+	sum += IP_PROTO_TCP + l4len;
+	sum = vioif_csum_fold(sum);
+	data[l4off+16] = (sum >> 8) & 0xFF;
+	data[l4off+17] = sum & 0xFF;
+
+	hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+	hdr->csum_start = l4off;
+	hdr->csum_offset = 16;
+
+	if (p->tot_len > netif->mtu + VIOIF_ETH_HLEN) {
+		if (!VIOIF_HAS(vioif, (gso_type == VIRTIO_NET_HDR_GSO_TCPV4) ? VIRTIO_NET_F_HOST_TSO4 : VIRTIO_NET_F_HOST_TSO6)) {
+			LOG_ERROR("vioif_output: host doesn't support TCP segmentation\n");
+			return ERR_IF;
+		}
+
+		hdr->gso_type = gso_type;
+		hdr->hdr_len = l4off + tcp_hlen;
+		hdr->gso_size = netif->mtu - (l4off - l3off) - tcp_hlen;
+	}
+
+	return ERR_OK;
+}
+
+/*
+ * Complete the checksum of a received packet, which the host has
+ * checksummed only partially (e.g. a packet of another local guest).
+ * A packet may consist of several merged RX buffers.
+ */
+static void vioif_rx_csum(struct virtio_net_hdr* hdr, struct pbuf* p)
+{
+	uint32_t start = ETH_PAD_SIZE + hdr->csum_start;
+	uint32_t off = start + hdr->csum_offset;
+	uint32_t pos, sum = 0;
+	uint32_t odd = 0;
+	uint16_t csum;
+	struct pbuf* q;
+
+	if (!(hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM))
+		return;
+	if (BUILTIN_EXPECT(off + 2 > p->tot_len, 0))
+		return;
+
+	// the checksum field contains already the checksum of the pseudo header
+	for(q=p, pos=0; q!=NULL; pos+=q->len, q=q->next) {
+		uint32_t i = (pos < start) ? start - pos : 0;
+		uint32_t chunk;
+
+		if (i >= q->len)
+			continue;
+		chunk = csum_partial((uint8_t*) q->payload + i, q->len - i, 0);
+		// the previous pbuf ends in the middle of a 16 bit word
+		if (odd)
+			chunk = csum_swap(chunk);
+		sum = csum_add(sum, chunk);
+		odd ^= (q->len - i) & 1;
+	}
+
+	// the sum is in memory order => store it bytewise
+	csum = (uint16_t) ~csum_fold(sum);
+	pbuf_put_at(p, off, ((uint8_t*) &csum)[0]);
+	pbuf_put_at(p, off+1, ((uint8_t*) &csum)[1]);
 }
 
 /*
  * @return error code
  * - ERR_OK: packet transferred to hardware
  * - ERR_CONN: no link or link failure
- * - ERR_IF: could not transfer to link (hardware buffer full?)
+ * - ERR_IF: could not transfer to link
+ * - ERR_MEM: hardware queue is full, the caller should try again later
  */
 static err_t vioif_output(struct netif* netif, struct pbuf* p)
 {
 	vioif_t* vioif = netif->state;
-	virt_queue_t* vq = &vioif->queues[TX_NUM];
+	virt_queue_t* vq;
+	const size_t hdr_sz = vioif->hdr_sz;
+	// the first segment is the virtio header
+	vioif_seg_t segs[VIOIF_MAX_SEGS + 1];
+	struct virtio_net_hdr_mrg_rxbuf hdr;
 	struct pbuf *q;
-	uint32_t i;
-	uint16_t buffer_index;
+	uint32_t i, nsegs = 0;
+	uint16_t buffer_index, pos;
+	int copy = (p->tot_len <= VIOIF_COPYBREAK);
+	err_t ret = ERR_OK;
+
+	// all queues are claimed by the raw packet interface
+	if (BUILTIN_EXPECT(!vioif->nr_stack_pairs, 0)) {
+		LINK_STATS_INC(link.drop);
+		NETSTATS_INC(&vioif->stats, tx_drops);
+		return ERR_IF;
+	}
+
+	// every core uses its own TX queue
+	vq = TX_QUEUE(vioif, vioif->stack_pairs[CORE_ID % vioif->nr_stack_pairs]);
+
+#if ETH_PAD_SIZE
+	pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+#endif
+
+	/*
+	 * Determine the physical segments of the packet. A pbuf may cross
+	 * a page boundary and the pages aren't physically contiguous.
+	 * Packets with too many segments are copied into the bounce buffer.
+	 */
+	for (q = p; !copy && (q != 0); q = q->next) {
+		size_t addr = (size_t) q->payload;
+		uint32_t len = q->len;
+
+		while (len) {
+			uint32_t chunk = PAGE_SIZE - (addr & (PAGE_SIZE-1));
+
+			if (chunk > len)
+				chunk = len;
+			if (nsegs >= VIOIF_MAX_SEGS) {
+				copy = 1;
+				break;
+			}
+
+			nsegs++;
+			segs[nsegs].addr = virt_to_phys(addr);
+			segs[nsegs].len = chunk;
+			segs[nsegs].flags = 0;
+			addr += chunk;
+			len -= chunk;
+		}
+	}
+
+	// num_buffers is unused on the TX side
+	hdr.num_buffers = 0;
+	ret = vioif_tx_offload(netif, p, &hdr.hdr);
+	if (BUILTIN_EXPECT(ret != ERR_OK, 0)) {
+		LINK_STATS_INC(link.drop);
+		NETSTATS_INC(&vioif->stats, tx_drops);
+		goto out;
+	}
+
+	if (BUILTIN_EXPECT(copy && (p->tot_len > VIOIF_BUFFER_SIZE - hdr_sz), 0)) {
+		LOG_ERROR("vioif_output: packet is too large for the bounce buffer\n");
+		NETSTATS_INC(&vioif->stats, tx_drops);
+		ret = ERR_IF;
+		goto out;
+	}
+
+	buffer_index = vioif_tx_get_desc(vioif, vq, copy ? 1 : nsegs + 1, &pos);
+	if (BUILTIN_EXPECT(buffer_index >= vq->vring.num, 0)) {
+		LOG_DEBUG("vioif_output: TX queue is full\n");
+		LINK_STATS_INC(link.memerr);
+		NETSTATS_INC(&vioif->stats, tx_ring_full);
+		NETSTATS_INC(&vioif->stats, tx_drops);
+		ret = ERR_MEM;
+		goto out;
+	}
+	LOG_DEBUG("vioif: found free buffer %d\n", buffer_index);
+
+	memcpy((void*) (vq->virt_buffer + buffer_index * VIOIF_BUFFER_SIZE), &hdr, hdr_sz);
+
+	segs[0].addr = vq->phys_buffer + buffer_index * VIOIF_BUFFER_SIZE;
+	segs[0].flags = 0;
+
+	if (copy) {
+		// we send only one buffer because it is large enough for our packet
+		segs[0].len = p->tot_len + hdr_sz;
+		nsegs = 0;
+
+		/*
+		 * q traverses through linked list of pbuf's
+		 * This list MUST consist of a single packet ONLY
+		 */
+		for (q = p, i = 0; q != 0; q = q->next) {
+			memcpy((void*) (vq->virt_buffer + hdr_sz + buffer_index * VIOIF_BUFFER_SIZE + i), q->payload, q->len);
+			i += q->len;
+		}
+	} else {
+		// the header uses its own descriptor, followed by the payload segments
+		segs[0].len = hdr_sz;
+
+		// keep the pbuf alive until the host has consumed the chain
+		pbuf_ref(p);
+		vq->tx_pbufs[buffer_index] = p;
+	}
+
+	vioif_vq_add(vq, buffer_index, pos, segs, nsegs + 1);
+
+	/*
+	 * Ask for a completion interrupt after VIOIF_TX_BATCH packets or
+	 * after the last packet of a smaller burst.
+	 */
+	if (VIOIF_EVENT_IDX(vioif) && vq->packed) {
+		// the packed ring identifies the descriptor => interrupt after this packet
+		vq->pvring.driver->off_wrap = pos;
+		vq->pvring.driver->flags = VRING_PACKED_EVENT_FLAG_DESC;
+	} else if (VIOIF_EVENT_IDX(vioif)) {
+		uint16_t inflight = vq->vring.avail->idx - vq->last_seen_used;
+
+		if (inflight > VIOIF_TX_BATCH)
+			inflight = VIOIF_TX_BATCH;
+		vring_used_event(&vq->vring) = vq->last_seen_used + inflight - 1;
+	}
+
+	/*
+	 * Notify the changes
+	 * NOTE: RX queue is 0, TX queue is 1 - Virtio Std. §5.1.2
+	 */
+	vioif_kick(vioif, vq);
+
+	LINK_STATS_INC(link.xmit);
+	NETSTATS_TX(&vioif->stats, p->tot_len);
+	netstats_tx_done(p);
+
+out:
+#if ETH_PAD_SIZE
+	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+
+	return ret;
+}
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+/* returns a RX buffer to the spare list as soon as LwIP has freed the pbuf */
+static void vioif_rx_free(struct pbuf* p)
+{
+	vioif_rxbuf_t* buf = (vioif_rxbuf_t*) p;
+	virt_queue_t* vq = buf->vq;
+
+	spinlock_irqsave_lock(&vq->lock);
+	buf->next = vq->rx_free;
+	vq->rx_free = buf;
+	spinlock_irqsave_unlock(&vq->lock);
+}
+
+static vioif_rxbuf_t* vioif_rx_get_spare(virt_queue_t* vq)
+{
+	vioif_rxbuf_t* buf;
+
+	spinlock_irqsave_lock(&vq->lock);
+	buf = vq->rx_free;
+	if (buf)
+		vq->rx_free = buf->next;
+	spinlock_irqsave_unlock(&vq->lock);
+
+	return buf;
+}
+
+/*
+ * Pass the buffer of the used element directly to LwIP and attach a spare
+ * buffer to the descriptor.
+ *
+ * @return pbuf or NULL if no spare buffer is available
+ */
+static struct pbuf* vioif_rx_zero_copy(virt_queue_t* vq, uint16_t id, uint32_t off, uint16_t len)
+{
+	vioif_rxbuf_t* buf = vq->rx_slots[id];
+	vioif_rxbuf_t* spare;
+	struct pbuf* p;
+
+	spare = vioif_rx_get_spare(vq);
+	if (!spare)
+		return NULL;
+
+	p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &buf->pc,
+		(void*) (buf->virt + off), VIOIF_BUFFER_SIZE - off);
+	if (BUILTIN_EXPECT(!p, 0)) {
+		vioif_rx_free((struct pbuf*) spare);
+		return NULL;
+	}
+
+	vq->rx_slots[id] = spare;
+
+	return p;
+}
+#endif
+
+/* make the RX buffer of slot id available to the host */
+static inline void vioif_rx_refill(virt_queue_t* vq, uint16_t id)
+{
+	vioif_seg_t seg = { vq->rx_slots[id]->phys, VIOIF_BUFFER_SIZE, VRING_DESC_F_WRITE };
+
+	vioif_vq_add(vq, id, vioif_vq_reserve(vq, 1), &seg, 1);
+}
+
+/*
+ * Create a pbuf for the data of a single RX buffer. Only the first buffer
+ * of a packet contains the virtio header and gets the padding word.
+ */
+static struct pbuf* vioif_rx_buffer(virt_queue_t* vq, uint16_t id, uint32_t off, uint16_t len, uint16_t pad)
+{
+	vioif_rxbuf_t* buf = vq->rx_slots[id];
+	struct pbuf *p, *q;
+	uint16_t pos;
+
+#if LWIP_SUPPORT_CUSTOM_PBUF
+	// small packets are cheaper to copy than to hold a whole buffer
+	if (len > VIOIF_COPYBREAK) {
+		/* the padding word overlaps with the end of the virtio header */
+		p = vioif_rx_zero_copy(vq, id, off - pad, len + pad);
+		if (p)
+			return p;
+	}
+#endif
+
+	p = pbuf_cache_alloc(len + pad);
+	if (!p)
+		return NULL;
+
+	pbuf_header(p, -(int16_t) pad); /* drop the padding word */
+	for(q=p, pos=0; q!=NULL; q=q->next) {
+		memcpy((uint8_t*) q->payload,
+			(uint8_t*) (buf->virt + off + pos),
+			q->len);
+		pos += q->len;
+	}
+	pbuf_header(p, (int16_t) pad); /* reclaim the padding word */
+
+	return p;
+}
+
+/*
+ * Process up to budget received packets
+ *
+ * @return number of processed packets
+ */
+static int vioif_rx_inthandler(struct netif* netif, virt_queue_t* vq, int budget)
+{
+	vioif_t* vioif = netif->state;
+	const size_t hdr_sz = vioif->hdr_sz;
+	int work = 0;
+
+	while((work < budget) && vioif_vq_pending(vq))
+	{
+		struct virtio_net_hdr_mrg_rxbuf hdr;
+		struct pbuf *p = NULL, *q;
+		const uint64_t stamp = get_rdtsc();
+		uint16_t nbufs = 1, id;
+		uint32_t len;
+
+		if (vioif_vq_peek(vq, 0, &id, &len))
+			break;
+
+		memset(&hdr, 0x00, sizeof(hdr));
+		memcpy(&hdr, (void*) vq->rx_slots[id]->virt, hdr_sz);
+		if (VIOIF_HAS(vioif, VIRTIO_NET_F_MRG_RXBUF) && hdr.num_buffers)
+			nbufs = hdr.num_buffers;
+
+		LOG_DEBUG("vq->last_seen_used %d\n", vq->last_seen_used);
+		LOG_DEBUG("used id %d, len %d, buffers %d\n", id, len, nbufs);
+		LOG_DEBUG("hdr len %d, flags %d\n", hdr.hdr.hdr_len, hdr.hdr.flags);
+
+		// wait until the host has published all buffers of the packet
+		if (vioif_vq_peek(vq, nbufs - 1, &id, &len))
+			break;
+
+		// merge all buffers of the packet into a pbuf chain
+		for(uint16_t k=0; k<nbufs; k++) {
+			uint32_t off = k ? 0 : hdr_sz;
+
+			vioif_vq_peek(vq, k, &id, &len);
+			q = vioif_rx_buffer(vq, id, off, len > off ? len - off : 0, k ? 0 : ETH_PAD_SIZE);
+			if (BUILTIN_EXPECT(!q, 0)) {
+				if (p)
+					pbuf_free(p);
+				p = NULL;
+				break;
+			}
+
+			if (p)
+				pbuf_cat(p, q);
+			else
+				p = q;
+		}
+
+		// recycle the descriptors
+		for(uint16_t k=0; k<nbufs; k++) {
+			vioif_vq_peek(vq, 0, &id, &len);
+			vioif_vq_pop(vq, 1);
+			vioif_rx_refill(vq, id);
+		}
+
+		if (BUILTIN_EXPECT(!p, 0)) {
+			LOG_ERROR("vioif_rx_inthandler: not enough memory!\n");
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
+			NETSTATS_INC(&vioif->stats, rx_drops);
+			goto oom;
+		}
+
+		if (VIOIF_HAS(vioif, VIRTIO_NET_F_GUEST_CSUM))
+			vioif_rx_csum(&hdr.hdr, p);
+
+		LINK_STATS_INC(link.recv);
+
+		// forward packet to LwIP
+		if (netstats_input(&vioif->stats, netif, p, stamp) != ERR_OK)
+			pbuf_free(p);
+		work++;
+	}
+
+oom:
+	// the host may wait for new buffers
+	vioif_kick(vioif, vq);
+
+	return work;
+}
+
+static int vioif_napi_poll(napi_t* napi, int budget)
+{
+	vioif_t* vioif = napi->netif->state;
+	uint16_t i = napi - vioif->napi;
+	virt_queue_t* vq = RX_QUEUE(vioif, i);
+
+	// claimed queues are polled by their owner
+	if ((i >= vioif->nr_pairs) || vq->raw)
+		return 0;
+
+	return vioif_rx_inthandler(napi->netif, vq, budget);
+}
+
+static void vioif_napi_enable(napi_t* napi)
+{
+	vioif_t* vioif = napi->netif->state;
+	uint16_t i = napi - vioif->napi;
+	virt_queue_t* vq = RX_QUEUE(vioif, i);
+
+	// claimed queues are polled by their owner and stay masked
+	if ((i >= vioif->nr_pairs) || vq->raw)
+		return;
+
+	vioif_enable_interrupts(vioif, vq);
+	mb();
+
+	/*
+	 * Packets, which arrive before the interrupts are enabled,
+	 * don't raise an interrupt (event index) => check again
+	 */
+	if (vioif_vq_pending(vq)) {
+		vioif_disable_interrupts(vq);
+		napi_schedule(napi);
+	}
+}
+
+static void vioif_handler(struct state* s)
+{
+	vioif_t* vioif = mynetif->state;
+
+	LOG_DEBUG("vioif: receive interrupt\n");
+
+	// MSI-X vectors aren't shared and don't use the isr port
+	if (!vioif->msix_enabled) {
+		// reset interrupt by reading the isr port
+		uint8_t isr = vioif_isr(vioif);
+
+		// do we receiven an interrupt for this device?
+		if (!(isr & 0x01))
+			return;
+	}
+	NETSTATS_INC(&vioif->stats, interrupts);
+
+	// free TX queues
+	uint8_t pending = 0;
+	for(uint16_t i=0; i<vioif->nr_pairs; i++) {
+		virt_queue_t* vq = TX_QUEUE(vioif, i);
+
+		if (!vq->raw && vioif_vq_pending(vq))
+			pending = 1;
+	}
+
+	if (!vioif->tx_polling && pending)
+	{
+		// pbufs have to be released in the context of the tcpip thread
+#if NO_SYS
+		vioif_tx_poll(NULL);
+#else
+		if (tcpip_callback_with_block(vioif_tx_poll, NULL, 0) == ERR_OK) {
+			vioif->tx_polling = 1;
+		} else {
+			LOG_ERROR("vioif_handler: unable to send a TX poll request to the tcpip thread\n");
+		}
+#endif
+	}
+
+	/*
+	 * check RX qeueues
+	 * NOTE: the host steers the flows to the queues, each queue
+	 * has its own polling context
+	 */
+	for(uint16_t i=0; i<vioif->nr_pairs; i++) {
+		virt_queue_t* vq = RX_QUEUE(vioif, i);
+
+		if (vq->raw || napi_scheduled(&vioif->napi[i]))
+			continue;
+
+		vioif_disable_interrupts(vq);
+		if (vioif_vq_pending(vq))
+			napi_schedule(&vioif->napi[i]);
+
+		// now, the polling context will check for incoming messages
+		if (!napi_scheduled(&vioif->napi[i]))
+			vioif_enable_interrupts(vioif, vq);
+	}
+	mb();
+}
 
-	if (BUILTIN_EXPECT(p->tot_len > 1792, 0)) {
-		LOG_ERROR("vioif_output: packet is longer than 1792 bytes\n");
-		return ERR_IF;
-	}
+/* the queue pairs, which aren't claimed, are used by LwIP */
+static void vioif_update_stack_pairs(vioif_t* vioif)
+{
+	uint16_t n = 0;
 
-	for(buffer_index=0; buffer_index<vq->vring.num; buffer_index++) {
-		if (!vq->vring.desc[buffer_index].len) {
-			LOG_DEBUG("vioif_output: buffer %u is free\n", buffer_index);
-			break;
-		}
+	for(uint16_t i=0; i<vioif->nr_pairs; i++) {
+		if (!RX_QUEUE(vioif, i)->raw)
+			vioif->stack_pairs[n++] = i;
 	}
-	LOG_DEBUG("vioif: found free buffer %d\n", buffer_index);
+	vioif->nr_stack_pairs = n;
+}
 
-	if (BUILTIN_EXPECT(buffer_index >= vq->vring.num, 0)) {
-		LOG_ERROR("vioif_output: too many packets at once\n");
-		return ERR_IF;
+/*
+ * Raw packet interface: the slots of the RX ring point to the RX buffers
+ * of the queue, the descriptor ID is stored in the slot. A TX slot owns
+ * a buffer, which is sent with a single descriptor. The virtio header
+ * in front of the buffer stays zero, i.e. no offloading is used.
+ */
+
+/* this function is called in the context of the tcpip thread */
+static int vioif_raw_claim(rawnet_queue_t* q)
+{
+	vioif_t* vioif = q->dev->netif->state;
+	virt_queue_t* rxq = RX_QUEUE(vioif, q->index);
+	virt_queue_t* txq = TX_QUEUE(vioif, q->index);
+	const uint32_t num = txq->vring.num;
+	const size_t hdr_sz = vioif->hdr_sz;
+	rawnet_ring_t* rxr = rawnet_ring_alloc(rxq->vring.num, VIOIF_BUFFER_SIZE - hdr_sz);
+	rawnet_ring_t* txr = rawnet_ring_alloc(num, VIOIF_BUFFER_SIZE - hdr_sz);
+	uint16_t* slots = (uint16_t*) kmalloc(num * sizeof(uint16_t));
+	uint8_t* done = (uint8_t*) kmalloc(num);
+	size_t buffer = (size_t) page_alloc(num * VIOIF_BUFFER_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+
+	if (BUILTIN_EXPECT(!rxr || !txr || !slots || !done || !buffer, 0)) {
+		rawnet_ring_free(rxr);
+		rawnet_ring_free(txr);
+		if (slots)
+			kfree(slots);
+		if (done)
+			kfree(done);
+		if (buffer)
+			page_free((void*) buffer, num * VIOIF_BUFFER_SIZE);
+		return -ENOMEM;
 	}
 
-#if ETH_PAD_SIZE
-	pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
-#endif
+	memset((void*) buffer, 0x00, num * VIOIF_BUFFER_SIZE);
+	memset(done, 0x00, num);
+	for(uint32_t i=0; i<num; i++) {
+		slots[i] = VIOIF_RAW_NONE;
+		txr->slot[i].buf = (void*) (buffer + i * VIOIF_BUFFER_SIZE + hdr_sz);
+	}
 
-	const size_t hdr_sz = sizeof(struct virtio_net_hdr);
-	// NOTE: packet is fully checksummed => all flags are set to zero
-	memset((void*) (vq->virt_buffer + buffer_index * VIOIF_BUFFER_SIZE), 0x00, hdr_sz);
+	// LwIP doesn't use the queue pair from now on
+	rxq->raw = txq->raw = 1;
+	vioif_update_stack_pairs(vioif);
+	vioif_disable_interrupts(rxq);
+
+	// packets of LwIP, which are still in flight, are released by the next txsync
+	vioif_tx_reclaim(txq);
+	spinlock_irqsave_lock(&txq->lock);
+	txq->raw_slots = slots;
+	txq->raw_done = done;
+	txq->raw_virt = buffer;
+	txq->raw_phys = virt_to_phys(buffer);
+	spinlock_irqsave_unlock(&txq->lock);
+
+	// received packets are passed to the application by the first rxsync
+	q->rx_cur = rxr->head = rxr->tail = 0;
+	q->tx_cur = txr->head = 0;
+	txr->tail = num - 1;
+	q->rx = rxr;
+	q->tx = txr;
 
-	vq->vring.desc[buffer_index].addr = vq->phys_buffer + buffer_index * VIOIF_BUFFER_SIZE;
-	vq->vring.desc[buffer_index].len = p->tot_len + hdr_sz;
-	vq->vring.desc[buffer_index].flags = 0;
-	// we send only one buffer because it is large enough for our packet
-	vq->vring.desc[buffer_index].next = 0; //(buffer_index+1) % vq->vring.num;
+	return 0;
+}
 
+/* this function is called in the context of the tcpip thread */
+static void vioif_raw_release(rawnet_queue_t* q)
+{
+	vioif_t* vioif = q->dev->netif->state;
+	virt_queue_t* rxq = RX_QUEUE(vioif, q->index);
+	virt_queue_t* txq = TX_QUEUE(vioif, q->index);
+	const uint32_t num = txq->vring.num;
+	uint32_t retries = 0, i;
+	uint16_t* slots;
+	uint8_t* done;
+	int busy;
+
+	// the buffers of the raw packets have to outlive the transfer
+	while(1) {
+		vioif_tx_reclaim(txq);
+
+		spinlock_irqsave_lock(&txq->lock);
+		for(i=0, busy=0; (i<num) && !busy; i++)
+			busy = (txq->raw_slots[i] != VIOIF_RAW_NONE);
+		spinlock_irqsave_unlock(&txq->lock);
+
+		if (!busy || (retries++ >= TX_RETRIES))
+			break;
 
-	/*
-	 * q traverses through linked list of pbuf's
-	 * This list MUST consist of a single packet ONLY
-	 */
-	for (q = p, i = 0; q != 0; q = q->next) {
-		memcpy((void*) (vq->virt_buffer + hdr_sz + buffer_index * VIOIF_BUFFER_SIZE + i), q->payload, q->len);
-		i += q->len;
+		vioif_notify(vioif, txq);
+		PAUSE;
 	}
 
-	// Add it in the available ring
-	uint16_t index = vq->vring.avail->idx % vq->vring.num;
-	vq->vring.avail->ring[index] = buffer_index;
+	spinlock_irqsave_lock(&txq->lock);
+	slots = txq->raw_slots;
+	done = txq->raw_done;
+	txq->raw_slots = NULL;
+	txq->raw_done = NULL;
+	spinlock_irqsave_unlock(&txq->lock);
+
+	if (BUILTIN_EXPECT(busy, 0)) {
+		// the host still owns descriptors => leak the buffers
+		LOG_WARNING("vioif: host doesn't complete the raw packets of queue %u\n", txq->index);
+	} else {
+		page_free((void*) txq->raw_virt, num * VIOIF_BUFFER_SIZE);
+	}
+	kfree(slots);
+	kfree(done);
+	txq->raw_virt = txq->raw_phys = 0;
 
-	// besure that everything is written
-	mb();
+	// the buffers, which the application still holds, belong to the host again
+	for(i=q->rx_cur; i!=q->rx->tail; i=rawnet_ring_next(q->rx, i))
+		vioif_rx_refill(rxq, q->rx->slot[i].idx);
+	vioif_kick(vioif, rxq);
 
-	vq->vring.avail->idx++;
+	rawnet_ring_free(q->rx);
+	rawnet_ring_free(q->tx);
+	q->rx = q->tx = NULL;
 
-	// besure that everything is written
+	rxq->raw = txq->raw = 0;
+	vioif_update_stack_pairs(vioif);
 	mb();
 
-	/*
-	 * Notify the changes
-	 * NOTE: RX queue is 0, TX queue is 1 - Virtio Std. §5.1.2
-	 */
-    outportw(vioif->iobase+VIRTIO_PCI_QUEUE_NOTIFY, TX_NUM);
-
-#if ETH_PAD_SIZE
-	pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
-#endif
-
-	LINK_STATS_INC(link.xmit);
-
-	return ERR_OK;
+	// LwIP takes over the packets, which are received in the meantime
+	vioif_disable_interrupts(rxq);
+	napi_schedule(&vioif->napi[q->index]);
 }
 
-static void vioif_rx_inthandler(struct netif* netif)
+static int vioif_raw_rxsync(rawnet_queue_t* q)
 {
-	vioif_t* vioif = mynetif->state;
-	virt_queue_t* vq = &vioif->queues[RX_NUM];
+	vioif_t* vioif = q->dev->netif->state;
+	virt_queue_t* vq = RX_QUEUE(vioif, q->index);
+	rawnet_ring_t* ring = q->rx;
+	const size_t hdr_sz = vioif->hdr_sz;
+	uint32_t head = ring->head;
+	uint32_t tail = ring->tail;
+	uint32_t i;
+
+	// the application has processed the slots up to head
+	for(i=q->rx_cur; i!=head; i=rawnet_ring_next(ring, i))
+		vioif_rx_refill(vq, ring->slot[i].idx);
+	q->rx_cur = head;
 
-	while(vq->last_seen_used != vq->vring.used->idx)
+	while(vioif_vq_pending(vq))
 	{
-		const size_t hdr_sz = sizeof(struct virtio_net_hdr);
-		struct vring_used_elem* used = &vq->vring.used->ring[vq->last_seen_used % vq->vring.num];
-		struct virtio_net_hdr* hdr = (struct virtio_net_hdr*) (vq->virt_buffer + used->id * VIOIF_BUFFER_SIZE);
+		struct virtio_net_hdr_mrg_rxbuf hdr;
+		uint16_t nbufs = 1, id;
+		uint32_t len;
 
-		LOG_DEBUG("vq->vring.used->idx %d, vq->vring.used->flags %d, vq->last_seen_used %d\n", vq->vring.used->idx, vq->vring.used->flags, vq->last_seen_used);
-		LOG_DEBUG("used id %d, len %d\n", used->id, used->len);
-		LOG_DEBUG("hdr len %d, flags %d\n", hdr->hdr_len, hdr->flags);
+		if (vioif_vq_peek(vq, 0, &id, &len))
+			break;
 
-		struct pbuf* p = pbuf_alloc(PBUF_RAW, used->len, PBUF_POOL);
-		if (p) {
-			uint16_t pos;
-			struct pbuf* q;
+		memset(&hdr, 0x00, sizeof(hdr));
+		memcpy(&hdr, (void*) vq->rx_slots[id]->virt, hdr_sz);
+		if (VIOIF_HAS(vioif, VIRTIO_NET_F_MRG_RXBUF) && hdr.num_buffers)
+			nbufs = hdr.num_buffers;
 
-#if ETH_PAD_SIZE
-			pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
-#endif
-			for(q=p, pos=0; q!=NULL; q=q->next) {
-				memcpy((uint8_t*) q->payload,
-					(uint8_t*) (vq->virt_buffer + hdr_sz + used->id * VIOIF_BUFFER_SIZE + pos),
-					q->len);
-				pos += q->len;
-			}
-#if ETH_PAD_SIZE
-			pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
-#endif
-			LINK_STATS_INC(link.recv);
+		// the whole packet has to fit into the free slots
+		if (nbufs > ring->num_slots - 1 - rawnet_ring_dist(ring, head, tail))
+			break;
+		if (vioif_vq_peek(vq, nbufs - 1, &id, &len))
+			break;
 
-			// forward packet to LwIP
-			netif->input(p, netif);
-		} else {
-			LOG_ERROR("vioif_rx_inthandler: not enough memory!\n");
-			LINK_STATS_INC(link.memerr);
-			LINK_STATS_INC(link.drop);
-			goto oom;
-		}
+		for(uint16_t k=0; k<nbufs; k++) {
+			rawnet_slot_t* slot = ring->slot + tail;
+			uint32_t off = k ? 0 : hdr_sz;
 
-		vq->vring.avail->ring[vq->vring.avail->idx % vq->vring.num] = used->id;
-		vq->vring.avail->idx++;
-		vq->last_seen_used++;
+			vioif_vq_peek(vq, 0, &id, &len);
+			vioif_vq_pop(vq, 1);
+
+			slot->buf = (void*) (vq->rx_slots[id]->virt + off);
+			slot->len = len > off ? len - off : 0;
+			slot->flags = (k + 1 < nbufs) ? RAWNET_SLOT_MORE : 0;
+			slot->idx = id;
+			tail = rawnet_ring_next(ring, tail);
+		}
 	}
 
-oom:
-	vioif->polling = 0;
-	vioif_enable_interrupts(vq);
+	// publish the slots, afterwards the application may read them
 	mb();
-}
+	ring->tail = tail;
 
+	// the host may wait for new buffers
+	vioif_kick(vioif, vq);
 
-/* this function is called in the context of the tcpip thread or the irq handler (by using NO_SYS) */
-static void vioif_poll(void* ctx)
-{
-	vioif_rx_inthandler(mynetif);
+	return 0;
 }
 
-static void vioif_handler(struct state* s)
+static int vioif_raw_txsync(rawnet_queue_t* q)
 {
-	vioif_t* vioif = mynetif->state;
-
-	LOG_DEBUG("vioif: receive interrupt\n");
+	vioif_t* vioif = q->dev->netif->state;
+	virt_queue_t* vq = TX_QUEUE(vioif, q->index);
+	rawnet_ring_t* ring = q->tx;
+	const size_t hdr_sz = vioif->hdr_sz;
+	uint32_t head = ring->head;
+	uint32_t i, tail, next;
+
+	vioif_tx_reclaim(vq);
+
+	// pass all new slots to the host and notify it once
+	for(i=q->tx_cur; i!=head; i=rawnet_ring_next(ring, i)) {
+		uint32_t len = ring->slot[i].len;
+		vioif_seg_t seg;
+		uint16_t id, pos;
+
+		id = vioif_tx_get_desc(vioif, vq, 1, &pos);
+		if (BUILTIN_EXPECT(id >= vq->vring.num, 0))
+			break;
 
-	// reset interrupt by reading the isr port
-	uint8_t isr = inportb(vioif->iobase+VIRTIO_PCI_ISR);
+		seg.addr = vq->raw_phys + i * VIOIF_BUFFER_SIZE;
+		seg.len = hdr_sz + ((len > ring->buf_size) ? ring->buf_size : len);
+		seg.flags = 0;
+		vq->raw_slots[id] = i;
 
-	// do we receiven an interrupt for this device?
-	if (!(isr & 0x01))
-		return;
+		vioif_vq_add(vq, id, pos, &seg, 1);
+	}
+	// the remaining slots are sent by the next txsync
+	q->tx_cur = i;
 
-	// free TX queue
-	virt_queue_t* vq = &vioif->queues[1];
+	vioif_kick(vioif, vq);
 
-	vioif_disable_interrupts(vq);
-	while(vq->last_seen_used != vq->vring.used->idx)
-	{
-		struct vring_used_elem* used = &vq->vring.used->ring[vq->last_seen_used % vq->vring.num];
-		LOG_DEBUG("consumed TX elements: index %u, len %u\n", used->id, used->len);
-		// mark as free
-		vq->vring.desc[used->id].len = 0;
-		vq->last_seen_used++;
+	// the host may complete the buffers out of order => return them in order
+	spinlock_irqsave_lock(&vq->lock);
+	tail = ring->tail;
+	while(((next = rawnet_ring_next(ring, tail)) != q->tx_cur) && vq->raw_done[next]) {
+		vq->raw_done[next] = 0;
+		tail = next;
 	}
-	vioif_enable_interrupts(vq);
+	spinlock_irqsave_unlock(&vq->lock);
+
 	mb();
+	ring->tail = tail;
 
-	// check RX qeueue
-	vq = &vioif->queues[0];
-	vioif_disable_interrupts(vq);
-	if (!vioif->polling && (vq->last_seen_used != vq->vring.used->idx))
-	{
-#if NO_SYS
-		vioif_poll(NULL);
-#else
-		if (tcpip_callback_with_block(vioif_poll, NULL, 0) == ERR_OK) {
-			vioif->polling = 1;
+	return 0;
+}
+
+static const rawnet_ops_t vioif_raw_ops = {
+	.claim = vioif_raw_claim,
+	.release = vioif_raw_release,
+	.rxsync = vioif_raw_rxsync,
+	.txsync = vioif_raw_txsync,
+};
+
+/* create the descriptions of the ring buffers and the spare buffers */
+static int vioif_rx_setup(virt_queue_t* vq, uint32_t num)
+{
+	size_t spare_buffer = 0;
+
+	vq->rx_bufs = (vioif_rxbuf_t*) kmalloc((num + VIOIF_RX_SPARE) * sizeof(vioif_rxbuf_t));
+	vq->rx_slots = (vioif_rxbuf_t**) kmalloc(num * sizeof(vioif_rxbuf_t*));
+	if (BUILTIN_EXPECT(!vq->rx_bufs || !vq->rx_slots, 0))
+		return -1;
+
+	if (VIOIF_RX_SPARE) {
+		spare_buffer = (size_t) page_alloc(VIOIF_RX_SPARE*VIOIF_BUFFER_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+		if (BUILTIN_EXPECT(!spare_buffer, 0))
+			return -1;
+	}
+
+	memset(vq->rx_bufs, 0x00, (num + VIOIF_RX_SPARE) * sizeof(vioif_rxbuf_t));
+	vq->rx_free = NULL;
+
+	for(uint32_t i=0; i<num + VIOIF_RX_SPARE; i++) {
+		vioif_rxbuf_t* buf = vq->rx_bufs + i;
+
+		buf->vq = vq;
+		if (i < num) {
+			buf->virt = vq->virt_buffer + i * VIOIF_BUFFER_SIZE;
+			buf->phys = vq->phys_buffer + i * VIOIF_BUFFER_SIZE;
+			vq->rx_slots[i] = buf;
 		} else {
-			LOG_ERROR("rtl8139if_handler: unable to send a poll request to the tcpip thread\n");
+			// the spare buffers are physically contiguous, too
+			buf->virt = spare_buffer + (i - num) * VIOIF_BUFFER_SIZE;
+			buf->phys = virt_to_phys(spare_buffer) + (i - num) * VIOIF_BUFFER_SIZE;
+			buf->next = vq->rx_free;
+			vq->rx_free = buf;
 		}
+#if LWIP_SUPPORT_CUSTOM_PBUF
+		buf->pc.custom_free_function = vioif_rx_free;
 #endif
-	} else vioif_enable_interrupts(vq);
-	mb();
+	}
+
+	return 0;
 }
 
-static int vioif_queue_setup(vioif_t* dev)
+/* allocate the ring and the buffers of a virtual queue and register it at the host */
+static int vioif_queue_init(vioif_t* dev, virt_queue_t* vq, uint16_t index)
 {
-	virt_queue_t* vq;
 	uint32_t total_size;
+	size_t buffer_size, vring_phys;
 	unsigned int num;
 
-	for (uint32_t index=0; index<VIOIF_NUM_QUEUES; index++) {
-		vq = &dev->queues[index];
-
-	    memset(vq, 0x00, sizeof(virt_queue_t));
+	memset(vq, 0x00, sizeof(virt_queue_t));
+	vq->index = index;
+	vq->packed = VIOIF_HAS(dev, VIRTIO_F_RING_PACKED) ? 1 : 0;
 
-		// determine queue size
+	// determine queue size
+	if (dev->mmio) {
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_SEL, index);
+		num = vioif_mmio_read(dev, VIRTIO_MMIO_QUEUE_NUM_MAX);
+		// both versions of virtio-mmio let the driver choose the queue size
+		if (num > QUEUE_LIMIT) {
+			LOG_INFO("vioif: set queue limit to %u (index %u)\n", QUEUE_LIMIT, index);
+			num = QUEUE_LIMIT;
+		}
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_NUM, num);
+	} else if (dev->modern) {
+		num = vpci_queue_size(&dev->vpci, index, QUEUE_LIMIT);
+	} else {
 		outportw(dev->iobase+VIRTIO_PCI_QUEUE_SEL, index);
 		num = inportw(dev->iobase+VIRTIO_PCI_QUEUE_NUM);
-		if (!num) return -1;
+	}
+	if (!num) return -1;
 
-		LOG_INFO("vioif: queue_size %u (index %u)\n", num, index);
+	LOG_INFO("vioif: queue_size %u (index %u, %s ring)\n", num, index, vq->packed ? "packed" : "split");
 
+	if (vq->packed)
+		total_size = vring_packed_size(num);
+	else
 		total_size = vring_size(num, PAGE_SIZE);
 
-		// allocate and init memory for the virtual queue
-		void* vring_base = page_alloc(total_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
-		if (BUILTIN_EXPECT(!vring_base, 0)) {
-			LOG_INFO("Not enough memory to create queue %u\n", index);
-			return -1;
-		}
-		memset((void*)vring_base, 0x00, total_size);
+	// allocate and init memory for the virtual queue
+	void* vring_base = page_alloc(total_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!vring_base, 0)) {
+		LOG_INFO("Not enough memory to create queue %u\n", index);
+		return -1;
+	}
+	memset((void*)vring_base, 0x00, total_size);
+	vring_phys = virt_to_phys((size_t) vring_base);
+
+	if (vq->packed) {
+		vring_packed_init(&vq->pvring, num, vring_base);
+		// the number of descriptors is always taken from the split ring
+		vq->vring.num = num;
+		// both wrap counters start with 1
+		vq->avail_wrap = vq->used_wrap = 1;
+		vq->last_kick = 1 << VRING_PACKED_EVENT_F_WRAP_CTR;
+	} else {
 		vring_init(&vq->vring, num, vring_base, PAGE_SIZE);
 
 		if (num > QUEUE_LIMIT) {
 			vq->vring.num = num = QUEUE_LIMIT;
 			LOG_INFO("vioif: set queue limit to %u (index %u)\n", vq->vring.num, index);
 		}
+	}
 
-		vq->virt_buffer = (uint64_t) page_alloc(num*VIOIF_BUFFER_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
-		if (BUILTIN_EXPECT(!vq->virt_buffer, 0)) {
-			LOG_INFO("Not enough memory to create buffer %u\n", index);
+	// the control queue needs only one page for a single command
+	buffer_size = (vq == &dev->ctrl) ? PAGE_SIZE : num*VIOIF_BUFFER_SIZE;
+	vq->virt_buffer = (uint64_t) page_alloc(buffer_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!vq->virt_buffer, 0)) {
+		LOG_INFO("Not enough memory to create buffer %u\n", index);
+		return -1;
+	}
+	vq->phys_buffer = virt_to_phys(vq->virt_buffer);
+	spinlock_irqsave_init(&vq->lock);
+
+	if (vq == &dev->ctrl) {
+		// we poll for the answers of the host
+		vioif_disable_interrupts(vq);
+
+		// a command uses always the same chain (header, data, ack)
+		if (!vq->packed) {
+			vq->vring.desc[0].next = 1;
+			vq->vring.desc[1].next = 2;
+		}
+	} else if ((index % 2) == RX_NUM) {
+		/* NOTE: RX queue is 0, TX queue is 1 - Virtio Std. §5.1.2  */
+		if (vioif_rx_setup(vq, num)) {
+			LOG_INFO("Not enough memory to create RX buffers\n");
 			return -1;
 		}
-		vq->phys_buffer = virt_to_phys(vq->virt_buffer);
-
-		for(int i=0; i<num; i++) {
-			vq->vring.desc[i].addr = vq->phys_buffer + i * VIOIF_BUFFER_SIZE;
-			if (index == RX_NUM) {
-				/* NOTE: RX queue is 0, TX queue is 1 - Virtio Std. §5.1.2  */
-				vq->vring.desc[i].len = VIOIF_BUFFER_SIZE;
-				vq->vring.desc[i].flags = VRING_DESC_F_WRITE;
-				vq->vring.avail->ring[vq->vring.avail->idx % num] = i;
-				vq->vring.avail->idx++;
+
+		for(int i=0; i<num; i++)
+			vioif_rx_refill(vq, i);
+	} else {
+		if (vq->packed) {
+			// chain all buffer IDs to the free list
+			vq->tx_next = (uint16_t*) kmalloc(num * sizeof(uint16_t));
+			vq->tx_ndesc = (uint16_t*) kmalloc(num * sizeof(uint16_t));
+			if (BUILTIN_EXPECT(!vq->tx_next || !vq->tx_ndesc, 0)) {
+				LOG_INFO("Not enough memory to create queue %u\n", index);
+				return -1;
+			}
+
+			for(int i=0; i<num; i++) {
+				vq->tx_next[i] = vq->free_head;
+				vq->tx_ndesc[i] = 0;
+				vq->free_head = i;
+			}
+			vq->nr_free = num;
+		} else {
+			// chain all TX descriptors to the free list
+			for(int i=0; i<num; i++) {
+				vq->vring.desc[i].addr = vq->phys_buffer + i * VIOIF_BUFFER_SIZE;
+				vq->vring.desc[i].next = vq->free_head;
+				vq->free_head = i;
+				vq->nr_free++;
 			}
 		}
 
-		// register buffer
+		vq->tx_pbufs = (struct pbuf**) kmalloc(num * sizeof(struct pbuf*));
+		if (BUILTIN_EXPECT(!vq->tx_pbufs, 0)) {
+			LOG_INFO("Not enough memory to create queue %u\n", index);
+			return -1;
+		}
+		memset(vq->tx_pbufs, 0x00, num * sizeof(struct pbuf*));
+	}
+
+	// both queues of a pair share one MSI-X vector, the control queue is polled
+	uint16_t entry = VIRTIO_MSI_NO_VECTOR;
+	if (dev->msix_enabled && (vq != &dev->ctrl))
+		entry = (index / 2) % dev->nr_vectors;
+
+	// register buffer
+	if (dev->mmio && (dev->mmio_version == 1)) {
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_SEL, index);
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_ALIGN, PAGE_SIZE);
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_PFN, vring_phys >> PAGE_BITS);
+	} else if (dev->mmio) {
+		size_t driver, device;
+
+		if (vq->packed) {
+			driver = vring_phys + ((size_t) vq->pvring.driver - (size_t) vring_base);
+			device = vring_phys + ((size_t) vq->pvring.device - (size_t) vring_base);
+		} else {
+			driver = vring_phys + ((size_t) vq->vring.avail - (size_t) vring_base);
+			device = vring_phys + ((size_t) vq->vring.used - (size_t) vring_base);
+		}
+
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_SEL, index);
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_DESC_LOW, (uint32_t) vring_phys);
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_DESC_HIGH, (uint32_t) (vring_phys >> 32));
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_AVAIL_LOW, (uint32_t) driver);
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_AVAIL_HIGH, (uint32_t) (driver >> 32));
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_USED_LOW, (uint32_t) device);
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_USED_HIGH, (uint32_t) (device >> 32));
+		vioif_mmio_write(dev, VIRTIO_MMIO_QUEUE_READY, 1);
+	} else if (dev->modern) {
+		size_t driver, device;
+
+		if (vq->packed) {
+			driver = vring_phys + ((size_t) vq->pvring.driver - (size_t) vring_base);
+			device = vring_phys + ((size_t) vq->pvring.device - (size_t) vring_base);
+		} else {
+			driver = vring_phys + ((size_t) vq->vring.avail - (size_t) vring_base);
+			device = vring_phys + ((size_t) vq->vring.used - (size_t) vring_base);
+		}
+
+		if (vpci_queue_enable(&dev->vpci, index, vring_phys, driver, device, entry, &vq->notify)) {
+			LOG_ERROR("vioif: host doesn't accept MSI-X entry %u for queue %u\n", entry, index);
+			return -1;
+		}
+	} else {
 		outportw(dev->iobase+VIRTIO_PCI_QUEUE_SEL, index);
-		outportl(dev->iobase+VIRTIO_PCI_QUEUE_PFN, virt_to_phys((size_t) vring_base) >> PAGE_BITS);
+		outportl(dev->iobase+VIRTIO_PCI_QUEUE_PFN, vring_phys >> PAGE_BITS);
+
+		if (dev->msix_enabled) {
+			outportw(dev->iobase+VIRTIO_MSI_QUEUE_VECTOR, entry);
+			if (inportw(dev->iobase+VIRTIO_MSI_QUEUE_VECTOR) != entry) {
+				LOG_ERROR("vioif: host doesn't accept MSI-X entry %u for queue %u\n", entry, index);
+				return -1;
+			}
+		}
 	}
 
 	return 0;
 }
 
-err_t vioif_init(struct netif* netif)
+#ifdef __x86_64__
+/*
+ * Assign one MSI-X vector to each queue pair. The vectors are
+ * distributed by irq_default_core (see -irqcore and -irqaffinity).
+ */
+static int vioif_msix_setup(vioif_t* dev, uint16_t pairs)
+{
+	uint16_t i, nr = pairs;
+
+	if (nr > dev->pci.msix_size)
+		nr = dev->pci.msix_size;
+
+	for (i=0; i<nr; i++) {
+		int vector = irq_alloc_vector();
+
+		if (vector < 0)
+			break;
+		dev->vectors[i] = vector;
+		pci_msix_set_vector(&dev->pci, i, vector, irq_default_core(i));
+		LOG_INFO("vioif: queue pair %u uses vector %d on core %d\n", i, vector, irq_get_affinity(vector));
+	}
+
+	dev->nr_vectors = i;
+	if (!i)
+		return -ENOSPC;
+
+	// configuration changes don't raise an interrupt
+	if (dev->modern)
+		vpci_msix_config(&dev->vpci, VIRTIO_MSI_NO_VECTOR);
+	else
+		outportw(dev->iobase+VIRTIO_MSI_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+
+	return 0;
+}
+
+/* release the MSI-X vectors and switch back to the legacy interrupt */
+static void vioif_msix_release(vioif_t* dev)
+{
+	if (!dev->msix_enabled)
+		return;
+
+	for (uint16_t i=0; i<dev->nr_vectors; i++)
+		irq_free_vector(dev->vectors[i]);
+	dev->nr_vectors = 0;
+	pci_msi_disable(&dev->pci);
+	dev->msix_enabled = 0;
+}
+#else
+/* virtio-mmio devices have a single interrupt line */
+static inline int vioif_msix_setup(vioif_t* dev, uint16_t pairs)
+{
+	return -ENOSYS;
+}
+
+static inline void vioif_msix_release(vioif_t* dev)
+{
+}
+#endif
+
+/*
+ * Setup the RX/TX queue pairs and, if the host supports multiple queue
+ * pairs, the control queue, which follows the last possible queue pair.
+ */
+static int vioif_queue_setup(vioif_t* dev, uint16_t pairs, uint16_t max_pairs)
+{
+	for (uint16_t index=0; index<2*pairs; index++) {
+		if (vioif_queue_init(dev, &dev->queues[index], index))
+			return -1;
+	}
+
+	if (VIOIF_HAS(dev, VIRTIO_NET_F_CTRL_VQ) && vioif_queue_init(dev, &dev->ctrl, 2*max_pairs))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Send a command to the host via the control queue. The command consists
+ * of the header, the data and the acknowledgement of the host.
+ */
+static int vioif_ctrl_cmd(vioif_t* dev, uint8_t class, uint8_t cmd, const void* data, uint32_t len)
+{
+	virt_queue_t* vq = &dev->ctrl;
+	struct virtio_net_ctrl_hdr* hdr = (struct virtio_net_ctrl_hdr*) vq->virt_buffer;
+	volatile virtio_net_ctrl_ack* ack = (virtio_net_ctrl_ack*) (vq->virt_buffer + 16 + len);
+	vioif_seg_t segs[3];
+	uint32_t retries = 0;
+
+	if (BUILTIN_EXPECT(!VIOIF_HAS(dev, VIRTIO_NET_F_CTRL_VQ) || (len > PAGE_SIZE - 32), 0))
+		return -EINVAL;
+
+	hdr->class = class;
+	hdr->cmd = cmd;
+	memcpy((void*) (vq->virt_buffer + 16), data, len);
+	*ack = VIRTIO_NET_ERR;
+
+	segs[0].addr = vq->phys_buffer;
+	segs[0].len = sizeof(struct virtio_net_ctrl_hdr);
+	segs[0].flags = 0;
+	segs[1].addr = vq->phys_buffer + 16;
+	segs[1].len = len;
+	segs[1].flags = 0;
+	segs[2].addr = vq->phys_buffer + 16 + len;
+	segs[2].len = sizeof(virtio_net_ctrl_ack);
+	segs[2].flags = VRING_DESC_F_WRITE;
+
+	vioif_vq_add(vq, 0, vioif_vq_reserve(vq, 3), segs, 3);
+	mb();
+	vioif_notify(dev, vq);
+
+	// wait for the answer of the host
+	while (!vioif_vq_pending(vq)) {
+		if (retries++ >= TX_RETRIES*1000)
+			return -ETIME;
+		PAUSE;
+	}
+	vioif_vq_pop(vq, 3);
+
+	return (*ack == VIRTIO_NET_OK) ? 0 : -EIO;
+}
+
+/* determine the MTU from the configuration, the advice of the host and the buffer size */
+static uint16_t vioif_mtu(vioif_t* vioif)
+{
+	uint32_t mtu = VIOIF_MTU;
+
+	if (VIOIF_HAS(vioif, VIRTIO_NET_F_MTU)) {
+		uint16_t host_mtu;
+
+		vioif_cfg_read(vioif, __builtin_offsetof(struct virtio_net_config, mtu), &host_mtu, sizeof(host_mtu));
+
+		LOG_INFO("vioif: host advises a MTU of %u\n", host_mtu);
+		if (host_mtu && (mtu > host_mtu))
+			mtu = host_mtu;
+	}
+
+	// without merged buffers, a frame has to fit in a single RX buffer
+	if (!VIOIF_HAS(vioif, VIRTIO_NET_F_MRG_RXBUF) && (mtu > VIOIF_BUFFER_SIZE - vioif->hdr_sz - VIOIF_ETH_HLEN)) {
+		mtu = VIOIF_BUFFER_SIZE - vioif->hdr_sz - VIOIF_ETH_HLEN;
+		LOG_WARNING("vioif: host doesn't merge RX buffers, reduce MTU to %u\n", mtu);
+	}
+
+	if (mtu > 0xFFFF - VIOIF_ETH_HLEN)
+		mtu = 0xFFFF - VIOIF_ETH_HLEN;
+
+	return mtu;
+}
+
+#ifdef __x86_64__
+/* search the PCI bus for a network device */
+static int vioif_probe(vioif_t* vioif)
 {
-	static uint8_t num = 0;
-	vioif_t* vioif;
 	pci_info_t pci_info;
 	int i;
 
-	LWIP_ASSERT("netif != NULL", (netif != NULL));
-
 	for(i=0x100; i<=0x103F; i++) {
 		if ((pci_get_device_info(VENDOR_ID, i, 1, &pci_info, 1) == 0)) {
 			LOG_INFO("Found vioif (Vendor ID 0x%x, Device Id 0x%x)\n", VENDOR_ID, i);
@@ -335,8 +1786,118 @@ err_t vioif_init(struct netif* netif)
 		}
 	}
 
-	if (i > 0x103F)
-		return ERR_ARG;
+	// devices without legacy interface use the device ID 0x1040 + device type
+	if ((i > 0x103F) && (pci_get_device_info(VENDOR_ID, VIOIF_MODERN_ID, PCI_IGNORE_SUBID, &pci_info, 1) == 0)) {
+		LOG_INFO("Found vioif (Vendor ID 0x%x, Device Id 0x%x)\n", VENDOR_ID, VIOIF_MODERN_ID);
+		i = VIOIF_MODERN_ID;
+	}
+
+	if ((i > 0x103F) && (i != VIOIF_MODERN_ID))
+		return -ENODEV;
+
+	vioif->pci = pci_info;
+	vioif->iomem = pci_info.base[1];
+	vioif->iobase = pci_info.base[0];
+	vioif->irq = pci_info.irq;
+	LOG_INFO("vioif uses IRQ %d and IO port 0x%x, IO men 0x%x\n", (int32_t) vioif->irq, vioif->iobase, vioif->iomem);
+
+	// prefer the modern interface, which is also required by packed rings
+	if (vpci_setup(&vioif->vpci, &vioif->pci) == 0) {
+		vioif->modern = 1;
+		LOG_INFO("vioif uses the virtio 1.x interface\n");
+	} else if (i == VIOIF_MODERN_ID) {
+		LOG_ERROR("vioif: unable to map the configuration of the modern device\n");
+		return -ENODEV;
+	}
+
+	// MSI-X moves the device specific configuration => enable it before the first access
+	if (pci_msix_enable(&vioif->pci) == 0)
+		vioif->msix_enabled = 1;
+
+	return 0;
+}
+#else
+/*
+ * Search the virtio-mmio slots for a network device. By default, the
+ * slots of QEMU's virt machine are probed. -virtio_mmio=<base>:<irq>
+ * selects a single device, e.g. the one passed by the command line of
+ * another VMM.
+ */
+static int vioif_probe(vioif_t* vioif)
+{
+	const char* cmdline = get_cmdline();
+	const char* found = cmdline ? strstr(cmdline, "-virtio_mmio=") : NULL;
+	size_t base = VIRTIO_MMIO_BASE;
+	uint32_t irq = VIRTIO_MMIO_IRQ;
+	uint32_t slots = VIRTIO_MMIO_SLOTS;
+	size_t viraddr, size, start;
+	uint32_t i;
+
+	if (found) {
+		char* end;
+
+		base = strtoul(found + strlen("-virtio_mmio="), &end, 0);
+		irq = (*end == ':') ? strtoul(end + 1, NULL, 0) : 0;
+		slots = 1;
+	}
+
+	if (BUILTIN_EXPECT(!base || !slots, 0))
+		return -ENODEV;
+
+	start = base & (PAGE_SIZE-1);
+	size = PAGE_CEIL(start + slots * VIRTIO_MMIO_SLOT_SIZE);
+
+	viraddr = vma_alloc(size, VMA_READ|VMA_WRITE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return -ENOMEM;
+
+	if (BUILTIN_EXPECT(page_map(viraddr, PAGE_FLOOR(base), size >> PAGE_BITS, PG_GLOBAL|PG_RW|PG_DEVICE), 0)) {
+		vma_free(viraddr, viraddr + size);
+		return -ENOMEM;
+	}
+
+	for(i=0; i<slots; i++) {
+		vioif->mmio = (volatile uint8_t*) (viraddr + start + i * VIRTIO_MMIO_SLOT_SIZE);
+
+		if ((vioif_mmio_read(vioif, VIRTIO_MMIO_MAGIC_VALUE) == VIRTIO_MMIO_MAGIC)
+		    && (vioif_mmio_read(vioif, VIRTIO_MMIO_DEVICE_ID) == VIRTIO_ID_NET))
+			break;
+	}
+
+	if (i >= slots) {
+		vioif->mmio = NULL;
+		page_unmap(viraddr, size >> PAGE_BITS);
+		vma_free(viraddr, viraddr + size);
+		return -ENODEV;
+	}
+
+	// the slots of a machine use consecutive interrupts
+	vioif->irq = irq + i;
+	vioif->mmio_version = vioif_mmio_read(vioif, VIRTIO_MMIO_VERSION);
+	LOG_INFO("Found vioif at 0x%zx (virtio-mmio version %u), IRQ %u\n",
+		base + i * VIRTIO_MMIO_SLOT_SIZE, vioif->mmio_version, (uint32_t) vioif->irq);
+
+	if (vioif->mmio_version == 2) {
+		vioif->modern = 1;
+		LOG_INFO("vioif uses the virtio 1.x interface\n");
+	} else if (vioif->mmio_version == 1) {
+		// the legacy interface describes the queues by page frame numbers
+		vioif_mmio_write(vioif, VIRTIO_MMIO_GUEST_PAGE_SIZE, PAGE_SIZE);
+	} else {
+		LOG_ERROR("vioif: unsupported virtio-mmio version %u\n", vioif->mmio_version);
+		return -ENODEV;
+	}
+
+	return 0;
+}
+#endif
+
+err_t vioif_init(struct netif* netif)
+{
+	static uint8_t num = 0;
+	vioif_t* vioif;
+
+	LWIP_ASSERT("netif != NULL", (netif != NULL));
 
 	vioif = kmalloc(sizeof(vioif_t));
 	if (!vioif) {
@@ -345,54 +1906,80 @@ err_t vioif_init(struct netif* netif)
 	}
 	memset(vioif, 0x00, sizeof(vioif_t));
 
-	vioif->iomem = pci_info.base[1];
-	vioif->iobase = pci_info.base[0];
-	vioif->irq = pci_info.irq;
-	LOG_INFO("vioif uses IRQ %d and IO port 0x%x, IO men 0x%x\n", (int32_t) vioif->irq, vioif->iobase, vioif->iomem);
+	if (vioif_probe(vioif)) {
+		kfree(vioif);
+		return ERR_ARG;
+	}
 
 	// reset interface
-	outportb(vioif->iobase + VIRTIO_PCI_STATUS, 0);
-	LOG_INFO("vioif status: 0x%x\n", (uint32_t) inportb(vioif->iobase + VIRTIO_PCI_STATUS));
+	vioif_set_status(vioif, 0);
+	// a modern device signals the end of the reset by status 0
+	for(uint32_t retries=0; vioif->modern && vioif_get_status(vioif) && (retries < TX_RETRIES); retries++)
+		PAUSE;
+	LOG_INFO("vioif status: 0x%x\n", (uint32_t) vioif_get_status(vioif));
 
 	// tell the device that we have noticed it
-	outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_ACKNOWLEDGE);
+	vioif_set_status(vioif, VIRTIO_CONFIG_S_ACKNOWLEDGE);
 	// tell the device that we will support it.
-	outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER);
+	vioif_set_status(vioif, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER);
 
-	LOG_INFO("host features 0x%x\n", inportl(vioif->iobase + VIRTIO_PCI_HOST_FEATURES));
+	uint64_t features = vioif_get_features(vioif);
+	uint64_t required = (1UL << VIRTIO_NET_F_MAC) | (1UL << VIRTIO_NET_F_STATUS);
 
-	uint32_t features = inportl(vioif->iobase + VIRTIO_PCI_HOST_FEATURES);
-	uint32_t required = (1UL << VIRTIO_NET_F_MAC) | (1UL << VIRTIO_NET_F_STATUS);
+	LOG_INFO("host features 0x%llx\n", features);
 
 	if ((features & required) != required) {
 		LOG_ERROR("Host isn't able to fulfill HermitCore's requirements\n");
-		outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_FAILED);
+		vioif_set_status(vioif, VIRTIO_CONFIG_S_FAILED);
+		vioif_msix_release(vioif);
 		kfree(vioif);
 		return ERR_ARG;
 	}
 
 	required = features;
-	required &= ~(1UL << VIRTIO_NET_F_CTRL_VQ);
+	// the control queue is only used to enable multiple queue pairs
+	if (!(features & (1UL << VIRTIO_NET_F_MQ)))
+		required &= ~(1UL << VIRTIO_NET_F_CTRL_VQ);
+	required &= ~(1UL << VIRTIO_NET_F_CTRL_VLAN);
+	required &= ~(1UL << VIRTIO_NET_F_GUEST_ANNOUNCE);
+	// without MRG_RXBUF, large receive offloads require 64 KiB RX buffers
 	required &= ~(1UL << VIRTIO_NET_F_GUEST_TSO4);
 	required &= ~(1UL << VIRTIO_NET_F_GUEST_TSO6);
 	required &= ~(1UL << VIRTIO_NET_F_GUEST_UFO);
-	required &= ~(1UL << VIRTIO_RING_F_EVENT_IDX);
-	required &= ~(1UL << VIRTIO_NET_F_MRG_RXBUF);
-	required &= ~(1UL << VIRTIO_NET_F_MQ);
-
-	LOG_INFO("wanted guest features 0x%x\n", required);
-	outportl(vioif->iobase + VIRTIO_PCI_GUEST_FEATURES, required);
-	vioif->features = inportl(vioif->iobase + VIRTIO_PCI_GUEST_FEATURES);
-	LOG_INFO("current guest features 0x%x\n", vioif->features);
+	required &= ~(1UL << VIRTIO_NET_F_GUEST_ECN);
+	required &= ~(1UL << VIRTIO_NET_F_HOST_ECN);
+	required &= ~(1UL << VIRTIO_NET_F_HOST_UFO);
+	// TCP segmentation by the host requires checksum offloading
+	if (!(features & (1UL << VIRTIO_NET_F_CSUM))) {
+		required &= ~(1UL << VIRTIO_NET_F_HOST_TSO4);
+		required &= ~(1UL << VIRTIO_NET_F_HOST_TSO6);
+	}
+	if (!(features & (1UL << VIRTIO_NET_F_CTRL_VQ)))
+		required &= ~(1UL << VIRTIO_NET_F_MQ);
+	// beyond the first 32 features, we support only the modern interface and packed rings
+	required &= 0xFFFFFFFFULL | (1ULL << VIRTIO_F_VERSION_1) | (1ULL << VIRTIO_F_RING_PACKED);
+	if (!vioif->modern)
+		required &= 0xFFFFFFFFULL;
+
+	LOG_INFO("wanted guest features 0x%llx\n", required);
+	vioif->features = vioif_set_features(vioif, required);
+	LOG_INFO("current guest features 0x%llx\n", vioif->features);
+
+	// the modern interface uses always the header with the number of merged buffers
+	if (VIOIF_HAS(vioif, VIRTIO_NET_F_MRG_RXBUF) || VIOIF_HAS(vioif, VIRTIO_F_VERSION_1))
+		vioif->hdr_sz = sizeof(struct virtio_net_hdr_mrg_rxbuf);
+	else
+		vioif->hdr_sz = sizeof(struct virtio_net_hdr);
 
 	// tell the device that the features are OK
-	outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK);
+	vioif_set_status(vioif, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK);
 
 	// check if the host accept these features
-	uint8_t status = inportb(vioif->iobase + VIRTIO_PCI_STATUS);
+	uint8_t status = vioif_get_status(vioif);
 	if (!(status & VIRTIO_CONFIG_S_FEATURES_OK)) {
 		LOG_ERROR("device features are ignored: status 0x%x\n", (uint32_t) status);
-		outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_FAILED);
+		vioif_set_status(vioif, VIRTIO_CONFIG_S_FAILED);
+		vioif_msix_release(vioif);
 		kfree(vioif);
 		return ERR_ARG;
 	}
@@ -403,22 +1990,73 @@ err_t vioif_init(struct netif* netif)
 	// determine the mac address of this card
 	LWIP_DEBUGF(NETIF_DEBUG, ("vioif_init: MAC address "));
 	for (uint8_t tmp8=0; tmp8<ETHARP_HWADDR_LEN; tmp8++) {
-		netif->hwaddr[tmp8] = inportb(vioif->iobase + VIRTIO_PCI_CONFIG_OFF(vioif->msix_enabled) + tmp8);
+		vioif_cfg_read(vioif, tmp8, &netif->hwaddr[tmp8], 1);
 		LWIP_DEBUGF(NETIF_DEBUG, ("%02x ", netif->hwaddr[tmp8]));
 	}
 	LWIP_DEBUGF(NETIF_DEBUG, ("\n"));
 
+	// one queue pair per core, if the host supports multiple queue pairs
+	uint16_t max_pairs = 1, pairs = 1;
+	if (VIOIF_HAS(vioif, VIRTIO_NET_F_MQ)) {
+		vioif_cfg_read(vioif, __builtin_offsetof(struct virtio_net_config, max_virtqueue_pairs),
+			&max_pairs, sizeof(max_pairs));
+		pairs = MIN(max_pairs, atomic_int32_read(&possible_cpus));
+		pairs = MIN(pairs, VIOIF_MAX_PAIRS);
+		if (!pairs)
+			pairs = 1;
+		LOG_INFO("vioif: host supports %u queue pairs, use %u\n", max_pairs, pairs);
+	}
+	// until the host has accepted the number of pairs, we use only the first one
+	vioif->nr_pairs = 1;
+	vioif_update_stack_pairs(vioif);
+
+	if (vioif->msix_enabled && vioif_msix_setup(vioif, pairs)) {
+		LOG_WARNING("vioif: unable to assign MSI-X vectors, use the legacy interrupt\n");
+		vioif_msix_release(vioif);
+	}
+
 	// Setup virt queues
-	if (BUILTIN_EXPECT(vioif_queue_setup(vioif) < 0, 0)) {
-		outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_FAILED);
+	if (BUILTIN_EXPECT(vioif_queue_setup(vioif, pairs, max_pairs) < 0, 0)) {
+		vioif_set_status(vioif, VIRTIO_CONFIG_S_FAILED);
+		vioif_msix_release(vioif);
 		kfree(vioif);
 		return ERR_ARG;
 	}
 
 	netif->state = vioif;
 	mynetif = netif;
+	netstats_register(netif, &vioif->stats);
+
+	for(uint16_t i=0; i<pairs; i++) {
+		if (BUILTIN_EXPECT(napi_init(&vioif->napi[i], netif, vioif_napi_poll, vioif_napi_enable), 0)) {
+			LOG_ERROR("vioif_init: unable to initialize the polling context\n");
+			vioif_set_status(vioif, VIRTIO_CONFIG_S_FAILED);
+			netif->state = NULL;
+			mynetif = NULL;
+			vioif_msix_release(vioif);
+			kfree(vioif);
+			return ERR_MEM;
+		}
+
+		// the flows of each RX queue are processed on their own core
+		napi_set_context(&vioif->napi[i], i);
+	}
 
-	irq_install_handler(vioif->irq+32, vioif_handler);
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+	// the host computes the TCP checksums of outgoing packets
+	if (VIOIF_HAS(vioif, VIRTIO_NET_F_CSUM)) {
+		vioif->tx_csum = 1;
+		NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL & ~NETIF_CHECKSUM_GEN_TCP);
+	}
+#endif
+
+	if (vioif->msix_enabled) {
+		for(uint16_t i=0; i<vioif->nr_vectors; i++)
+			irq_install_handler(vioif->vectors[i], vioif_handler);
+	} else if (vioif->mmio) {
+		// virtio-mmio uses the number of the GIC interrupt
+		irq_install_handler(vioif->irq, vioif_handler);
+	} else irq_install_handler(vioif->irq+32, vioif_handler);
 
 	/*
 	 * Initialize the snmp variables and counters inside the struct netif.
@@ -438,7 +2076,7 @@ err_t vioif_init(struct netif* netif)
 	/* set maximum transfer unit
 	 * Google Compute Platform supports only a MTU of 1460
 	 */
-	netif->mtu = 1460;
+	netif->mtu = vioif_mtu(vioif);
 	/* broadcast capability */
 	netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP | NETIF_FLAG_LINK_UP | NETIF_FLAG_MLD6;
 #if LWIP_IPV6
@@ -448,11 +2086,26 @@ err_t vioif_init(struct netif* netif)
 #endif
 
 	// tell the device that the drivers is initialized
-	outportb(vioif->iobase + VIRTIO_PCI_STATUS, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_DRIVER_OK|VIRTIO_CONFIG_S_FEATURES_OK);
+	vioif_set_status(vioif, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_DRIVER_OK|VIRTIO_CONFIG_S_FEATURES_OK);
+
+	LOG_INFO("vioif status: 0x%x\n", (uint32_t) vioif_get_status(vioif));
+
+	if (pairs > 1) {
+		uint16_t vq_pairs = pairs;
+
+		if (vioif_ctrl_cmd(vioif, VIRTIO_NET_CTRL_MQ, VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, &vq_pairs, sizeof(vq_pairs)) == 0) {
+			vioif->nr_pairs = pairs;
+			vioif_update_stack_pairs(vioif);
+			mb();
+		} else LOG_WARNING("vioif: host doesn't accept %u queue pairs\n", pairs);
+	}
+
+	uint16_t link;
+	vioif_cfg_read(vioif, __builtin_offsetof(struct virtio_net_config, status), &link, sizeof(link));
+	LOG_INFO("vioif link is %s\n", link & VIRTIO_NET_S_LINK_UP ? "up" : "down");
 
-	LOG_INFO("vioif status: 0x%x\n", (uint32_t) inportb(vioif->iobase + VIRTIO_PCI_STATUS));
-	LOG_INFO("vioif link is %s\n",
-		inportl(vioif->iobase + VIRTIO_PCI_CONFIG_OFF(vioif->msix_enabled) + ETHARP_HWADDR_LEN) & VIRTIO_NET_S_LINK_UP ? "up" : "down");
+	// applications may claim the queue pairs
+	rawnet_register(&vioif->raw, netif, &vioif_raw_ops, vioif->nr_pairs);
 
 	return ERR_OK;
 }
@@ -30,15 +30,67 @@
 
 #include <hermit/stddef.h>
 #include <hermit/virtio_ring.h>
+#include <hermit/spinlock.h>
+#include <net/napi.h>
+#include <net/rawnet.h>
+#include <net/netstats.h>
+#include <asm/pci.h>
+#include <virtio/vpci.h>
 
-#define VIOIF_NUM_QUEUES	2
+/* maximum number of RX/TX queue pairs (VIRTIO_NET_F_MQ) */
+#define VIOIF_MAX_PAIRS		8
+#define VIOIF_NUM_QUEUES	(2*VIOIF_MAX_PAIRS)
+
+struct pbuf;
+struct vioif_rxbuf;
 
 typedef struct
 {
+	/* split ring (the number of descriptors is also valid for the packed ring) */
 	struct vring vring;
+	/* packed ring (VIRTIO_F_RING_PACKED) */
+	struct vring_packed pvring;
+	uint8_t packed;
+	/* wrap counters of the packed ring: next available and next used descriptor */
+	uint8_t avail_wrap;
+	uint8_t used_wrap;
+	/* position of the next available descriptor in the packed ring */
+	uint16_t next_avail;
+	/* index of the queue, which is used to notify the host */
+	uint16_t index;
+	/* notification register of the queue (modern transport) */
+	volatile uint16_t* notify;
 	uint64_t virt_buffer;
 	uint64_t phys_buffer;
+	/* split ring: used index, packed ring: position of the next used descriptor */
 	uint16_t last_seen_used;
+	/* avail index (packed ring: position and wrap counter) at the last notification of the host */
+	uint16_t last_kick;
+	/* head of the free descriptor list, chained by desc[].next (packed ring: free buffer IDs) */
+	uint16_t free_head;
+	/* number of free descriptors */
+	uint16_t nr_free;
+	/* packed ring: free list of the TX buffer IDs and number of descriptors per ID */
+	uint16_t* tx_next;
+	uint16_t* tx_ndesc;
+	/* protects the free list against the TX completion interrupt */
+	spinlock_irqsave_t lock;
+	/* pbufs referenced by in-flight TX chains, indexed by the head descriptor */
+	struct pbuf** tx_pbufs;
+	/* descriptions of all RX buffers (ring and spare buffers) */
+	struct vioif_rxbuf* rx_bufs;
+	/* RX buffer, which is currently attached to a descriptor */
+	struct vioif_rxbuf** rx_slots;
+	/* list of spare RX buffers to refill the ring */
+	struct vioif_rxbuf* rx_free;
+	/* the queue is claimed by the raw packet interface */
+	volatile uint8_t raw;
+	/* raw TX: slot of each in-flight buffer ID and completed slots */
+	uint16_t* raw_slots;
+	uint8_t* raw_done;
+	/* raw TX: buffers of the slots, each one begins with the virtio header */
+	uint64_t raw_virt;
+	uint64_t raw_phys;
 } virt_queue_t;
 
 /*
@@ -49,11 +101,37 @@ typedef struct vioif {
 	/* Add whatever per-interface state that is needed here. */
 	uint32_t		iomem;
 	uint32_t		iobase;
-	uint32_t		features;
+	uint64_t		features;
+	/* virtio 1.x transport via memory mapped structures */
+	uint8_t			modern;
+	vpci_t			vpci;
+	/* virtio-mmio transport (version 1 = legacy, 2 = virtio 1.x) */
+	volatile uint8_t*	mmio;
+	uint32_t		mmio_version;
 	uint8_t			msix_enabled;
 	uint8_t			irq;
-	uint8_t			polling;
+	uint8_t			tx_polling;
+	uint8_t			tx_csum;
+	/* size of the virtio header, which depends on VIRTIO_NET_F_MRG_RXBUF */
+	uint8_t			hdr_sz;
+	/* number of RX/TX queue pairs in use */
+	uint16_t		nr_pairs;
+	/* queue pairs, which aren't claimed by the raw packet interface */
+	uint16_t		stack_pairs[VIOIF_MAX_PAIRS];
+	uint16_t		nr_stack_pairs;
 	virt_queue_t	queues[VIOIF_NUM_QUEUES];
+	/* control queue (VIRTIO_NET_F_CTRL_VQ) */
+	virt_queue_t	ctrl;
+	/* polling context of each RX queue */
+	napi_t			napi[VIOIF_MAX_PAIRS];
+	/* PCI record of the device, required to configure MSI-X (not used by virtio-mmio) */
+	pci_info_t		pci;
+	/* MSI-X: interrupt vector of each queue pair */
+	uint8_t			vectors[VIOIF_MAX_PAIRS];
+	uint16_t		nr_vectors;
+	/* every queue pair is accessible by the raw packet interface */
+	rawnet_dev_t		raw;
+	netstats_t		stats;
 } vioif_t;
 
 /*
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/string.h>
+#include <hermit/processor.h>
+#include <hermit/errno.h>
+#include <hermit/virtio_pci.h>
+#include <asm/pci.h>
+#include <virtio/vpci.h>
+
+#ifdef __x86_64__
+int vpci_setup(vpci_t* vp, const pci_info_t* pci)
+{
+	uint8_t cap = 0;
+
+	memset(vp, 0x00, sizeof(vpci_t));
+
+	while ((cap = pci_find_capability(pci, PCI_CAP_ID_VNDR, cap)) != 0) {
+		uint8_t type = (pci_read_config(pci, cap) >> (8*VIRTIO_PCI_CAP_CFG_TYPE)) & 0xFF;
+		uint8_t bar = pci_read_config(pci, cap + VIRTIO_PCI_CAP_BAR) & 0xFF;
+		uint32_t off = pci_read_config(pci, cap + VIRTIO_PCI_CAP_OFFSET);
+		uint32_t len = pci_read_config(pci, cap + VIRTIO_PCI_CAP_LENGTH);
+
+		switch(type) {
+		case VIRTIO_PCI_CAP_COMMON_CFG:
+			if (!vp->common_cfg)
+				vp->common_cfg = pci_map_bar(pci, bar, off, len);
+			break;
+		case VIRTIO_PCI_CAP_NOTIFY_CFG:
+			if (!vp->notify_base) {
+				vp->notify_mult = pci_read_config(pci, cap + VIRTIO_PCI_NOTIFY_CAP_MULT);
+				vp->notify_base = pci_map_bar(pci, bar, off, len);
+			}
+			break;
+		case VIRTIO_PCI_CAP_ISR_CFG:
+			if (!vp->isr_cfg)
+				vp->isr_cfg = pci_map_bar(pci, bar, off, len);
+			break;
+		case VIRTIO_PCI_CAP_DEVICE_CFG:
+			if (!vp->device_cfg)
+				vp->device_cfg = pci_map_bar(pci, bar, off, len);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (!vp->common_cfg || !vp->notify_base || !vp->isr_cfg || !vp->device_cfg)
+		return -ENODEV;
+
+	return 0;
+}
+
+int vpci_find_shm(const pci_info_t* pci, uint8_t id, size_t* phys, uint64_t* len)
+{
+	uint8_t cap = 0;
+
+	while ((cap = pci_find_capability(pci, PCI_CAP_ID_VNDR, cap)) != 0) {
+		uint8_t type = (pci_read_config(pci, cap) >> (8*VIRTIO_PCI_CAP_CFG_TYPE)) & 0xFF;
+		uint32_t word = pci_read_config(pci, cap + VIRTIO_PCI_CAP_BAR);
+		uint8_t bar = word & 0xFF;
+		uint32_t base;
+		size_t addr;
+
+		if ((type != VIRTIO_PCI_CAP_SHARED_MEMORY_CFG)
+		    || (((word >> (8*(VIRTIO_PCI_CAP_ID - VIRTIO_PCI_CAP_BAR))) & 0xFF) != id))
+			continue;
+
+		// only an assigned memory BAR is usable
+		base = (bar <= 5) ? pci->base[bar] : 0;
+		if (!base || (base & 0x1))
+			return -ENODEV;
+
+		addr = base & ~0xFULL;
+		// upper half of a 64 bit BAR
+		if (((base & 0x6) == 0x4) && (bar < 5))
+			addr |= ((size_t) pci->base[bar+1]) << 32;
+
+		*phys = addr + (pci_read_config(pci, cap + VIRTIO_PCI_CAP_OFFSET)
+			| ((uint64_t) pci_read_config(pci, cap + VIRTIO_PCI_CAP_OFFSET_HI) << 32));
+		*len = pci_read_config(pci, cap + VIRTIO_PCI_CAP_LENGTH)
+			| ((uint64_t) pci_read_config(pci, cap + VIRTIO_PCI_CAP_LENGTH_HI) << 32);
+
+		return 0;
+	}
+
+	return -ENODEV;
+}
+#else
+/* the PCI support of aarch64 doesn't walk the capabilities */
+int vpci_setup(vpci_t* vp, const pci_info_t* pci)
+{
+	return -ENODEV;
+}
+
+int vpci_find_shm(const pci_info_t* pci, uint8_t id, size_t* phys, uint64_t* len)
+{
+	return -ENODEV;
+}
+#endif
+
+int vpci_reset(vpci_t* vp, uint32_t retries)
+{
+	vpci_set_status(vp, 0);
+	for(uint32_t i=0; vpci_get_status(vp); i++) {
+		if (i >= retries)
+			return -ETIMEDOUT;
+		PAUSE;
+	}
+
+	return 0;
+}
+
+uint64_t vpci_get_features(vpci_t* vp)
+{
+	uint64_t features;
+
+	vp->common_cfg->device_feature_select = 0;
+	features = vp->common_cfg->device_feature;
+	vp->common_cfg->device_feature_select = 1;
+	features |= ((uint64_t) vp->common_cfg->device_feature) << 32;
+
+	return features;
+}
+
+void vpci_set_features(vpci_t* vp, uint64_t features)
+{
+	vp->common_cfg->guest_feature_select = 0;
+	vp->common_cfg->guest_feature = (uint32_t) features;
+	vp->common_cfg->guest_feature_select = 1;
+	vp->common_cfg->guest_feature = (uint32_t) (features >> 32);
+}
+
+void vpci_cfg_read(vpci_t* vp, uint32_t off, void* buf, uint32_t len)
+{
+	uint8_t* dst = (uint8_t*) buf;
+	uint8_t gen;
+
+	do {
+		gen = vp->common_cfg->config_generation;
+		if (len == sizeof(uint16_t)) {
+			*((uint16_t*) dst) = *((volatile uint16_t*) (vp->device_cfg + off));
+		} else if (len == sizeof(uint32_t)) {
+			*((uint32_t*) dst) = *((volatile uint32_t*) (vp->device_cfg + off));
+		} else if (len == sizeof(uint64_t)) {
+			((uint32_t*) dst)[0] = *((volatile uint32_t*) (vp->device_cfg + off));
+			((uint32_t*) dst)[1] = *((volatile uint32_t*) (vp->device_cfg + off + 4));
+		} else for(uint32_t i=0; i<len; i++)
+			dst[i] = vp->device_cfg[off + i];
+	} while (gen != vp->common_cfg->config_generation);
+}
+
+uint16_t vpci_queue_size(vpci_t* vp, uint16_t index, uint16_t limit)
+{
+	uint16_t num;
+
+	vp->common_cfg->queue_select = index;
+	num = vp->common_cfg->queue_size;
+	// the modern interface is able to shrink the queue
+	if (num > limit)
+		vp->common_cfg->queue_size = num = limit;
+
+	return num;
+}
+
+int vpci_queue_enable(vpci_t* vp, uint16_t index, size_t desc, size_t driver, size_t device,
+	uint16_t entry, volatile uint16_t** notify)
+{
+	vp->common_cfg->queue_select = index;
+	vp->common_cfg->queue_desc_lo = (uint32_t) desc;
+	vp->common_cfg->queue_desc_hi = (uint32_t) (desc >> 32);
+	vp->common_cfg->queue_avail_lo = (uint32_t) driver;
+	vp->common_cfg->queue_avail_hi = (uint32_t) (driver >> 32);
+	vp->common_cfg->queue_used_lo = (uint32_t) device;
+	vp->common_cfg->queue_used_hi = (uint32_t) (device >> 32);
+	*notify = (volatile uint16_t*) (vp->notify_base
+		+ vp->common_cfg->queue_notify_off * vp->notify_mult);
+
+	// the host reads VIRTIO_MSI_NO_VECTOR, if it runs out of resources
+	if (entry != VIRTIO_MSI_NO_VECTOR) {
+		vp->common_cfg->queue_msix_vector = entry;
+		if (vp->common_cfg->queue_msix_vector != entry)
+			return -EIO;
+	}
+
+	vp->common_cfg->queue_enable = 1;
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __VIRTIO_VPCI_H__
+#define __VIRTIO_VPCI_H__
+
+#include <hermit/stddef.h>
+#include <hermit/virtio_pci.h>
+#include <asm/pci.h>
+
+/*
+ * Modern PCI transport (virtio 1.x), which is shared by the virtio
+ * drivers. The configuration structures are described by vendor specific
+ * capabilities and mapped by vpci_setup().
+ */
+typedef struct vpci {
+	volatile struct virtio_pci_common_cfg* common_cfg;
+	volatile uint8_t* notify_base;
+	uint32_t notify_mult;
+	volatile uint8_t* isr_cfg;
+	volatile uint8_t* device_cfg;
+} vpci_t;
+
+static inline uint8_t vpci_get_status(vpci_t* vp)
+{
+	return vp->common_cfg->device_status;
+}
+
+static inline void vpci_set_status(vpci_t* vp, uint8_t status)
+{
+	vp->common_cfg->device_status = status;
+}
+
+/* reading the isr status acknowledges the legacy interrupt */
+static inline uint8_t vpci_isr(vpci_t* vp)
+{
+	return *vp->isr_cfg;
+}
+
+/* notification register of a queue, see vpci_queue_enable() */
+static inline void vpci_notify(volatile uint16_t* notify, uint16_t index)
+{
+	*notify = index;
+}
+
+/* configuration changes raise the interrupt of the MSI-X entry (or none by VIRTIO_MSI_NO_VECTOR) */
+static inline void vpci_msix_config(vpci_t* vp, uint16_t entry)
+{
+	vp->common_cfg->msix_config = entry;
+}
+
+/** @brief Map the configuration structures of a device
+ *
+ * The first structure of each type is used.
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV if the device doesn't provide the virtio 1.x interface
+ */
+int vpci_setup(vpci_t* vp, const pci_info_t* pci);
+
+/** @brief Find a shared memory region of a device
+ *
+ * The region is described by a capability (VIRTIO_PCI_CAP_SHARED_MEMORY_CFG),
+ * which may exceed 4 GiB, and isn't mapped.
+ *
+ * @param id Device specific id of the region
+ * @param phys Location to store the physical address of the region
+ * @param len Location to store the length of the region
+ * @return
+ * - 0 on success
+ * - -ENODEV if the device has no such region in an assigned memory BAR
+ */
+int vpci_find_shm(const pci_info_t* pci, uint8_t id, size_t* phys, uint64_t* len);
+
+/** @brief Reset the device
+ *
+ * A modern device signals the end of the reset by status 0.
+ *
+ * @return
+ * - 0 on success
+ * - -ETIMEDOUT if the status isn't cleared after the given number of retries
+ */
+int vpci_reset(vpci_t* vp, uint32_t retries);
+
+/** @brief Determine the features of the host */
+uint64_t vpci_get_features(vpci_t* vp);
+
+/** @brief Tell the host, which features the driver uses
+ *
+ * The device rejects unsupported features by clearing FEATURES_OK.
+ */
+void vpci_set_features(vpci_t* vp, uint64_t features);
+
+/** @brief Read a field of the device specific configuration
+ *
+ * The accesses match the width of the field (64 bit fields are read as
+ * two halves) and are repeated, if the host changes the configuration
+ * in the meantime.
+ */
+void vpci_cfg_read(vpci_t* vp, uint32_t off, void* buf, uint32_t len);
+
+/** @brief Select a queue and determine its size
+ *
+ * @param limit The queue is shrunk to this size, if it is larger
+ * @return Number of descriptors or 0, if the queue doesn't exist
+ */
+uint16_t vpci_queue_size(vpci_t* vp, uint16_t index, uint16_t limit);
+
+/** @brief Pass the rings of a queue to the device and enable it
+ *
+ * @param desc Physical address of the descriptor table
+ * @param driver Physical address of the driver area (available ring)
+ * @param device Physical address of the device area (used ring)
+ * @param entry MSI-X entry of the queue or VIRTIO_MSI_NO_VECTOR
+ * @param notify Location to store the notification register of the queue
+ * @return
+ * - 0 on success
+ * - -EIO if the host doesn't accept the MSI-X entry
+ */
+int vpci_queue_enable(vpci_t* vp, uint16_t index, size_t desc, size_t driver, size_t device,
+	uint16_t entry, volatile uint16_t** notify);
+
+#endif
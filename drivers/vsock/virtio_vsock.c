@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/*
+ * Driver of virtio-vsock devices with the modern PCI interface (virtio 1.x).
+ *
+ * Every packet occupies a single descriptor, which points to a buffer of
+ * VVSOCK_BUF_SIZE bytes: the header is directly followed by the payload.
+ * The receive ring is filled with such buffers once, each buffer returns
+ * to the ring after its packet is passed to the socket layer. A packet is
+ * sent by copying it into the buffer of a free transmit descriptor, the
+ * descriptors of sent packets are reclaimed by the next sender, so that
+ * the transmit ring doesn't raise interrupts.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/stdlib.h>
+#include <hermit/processor.h>
+#include <hermit/tasks.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <hermit/vsock.h>
+#include <hermit/virtio_vsock.h>
+#include <hermit/virtio_ring.h>
+#include <hermit/virtio_pci.h>
+#include <hermit/virtio_ids.h>
+#include <hermit/vma.h>
+#include <asm/page.h>
+#include <asm/io.h>
+#include <asm/irq.h>
+#include <asm/pci.h>
+#include <vsock/virtio_vsock.h>
+#include <virtio/vpci.h>
+
+#define VENDOR_ID 0x1AF4
+/* device ID of a vsock device, which has only the modern interface (0x1040 + device type) */
+#define VVSOCK_MODERN_ID	(0x1040 + VIRTIO_ID_VSOCK)
+#define QUEUE_LIMIT	64
+/* the event ring needs only a few buffers */
+#define EVENT_LIMIT	4
+#define VVSOCK_RETRIES	1000
+
+static vvsock_t* vvsock = NULL;
+
+/* the CID is a 64 bit field, which is read as two halves */
+static uint64_t vvsock_read_cid(vvsock_t* dev)
+{
+	uint64_t cid;
+
+	vpci_cfg_read(&dev->vpci, __builtin_offsetof(struct virtio_vsock_config, guest_cid), &cid, sizeof(uint64_t));
+
+	return cid;
+}
+
+static inline void vvsock_kick(vvsock_queue_t* vq)
+{
+	// besure that the avail index is written before we read the flags
+	mb();
+
+	if (vring_need_kick(&vq->vring, 0, 0)) {
+		vpci_notify(vq->notify, vq->index);
+		vq->kicks++;
+	}
+}
+
+static inline uint8_t* vvsock_buffer(vvsock_queue_t* vq, uint16_t id)
+{
+	return vq->buffers + id * vq->buf_size;
+}
+
+/* pass the buffer of descriptor id back to the device (receive and event ring) */
+static inline void vvsock_post(vvsock_queue_t* vq, uint16_t id)
+{
+	vq->vring.desc[id].addr = vq->buffers_phys + id * vq->buf_size;
+	vq->vring.desc[id].len = vq->buf_size;
+	vq->vring.desc[id].flags = VRING_DESC_F_WRITE;
+
+	vq->vring.avail->ring[vq->vring.avail->idx % vq->vring.num] = id;
+	// the device has to see the descriptor before the new index
+	mb();
+	vq->vring.avail->idx++;
+}
+
+/* return the descriptors of sent packets to the free list, needs the queue lock */
+static void vvsock_tx_reclaim(vvsock_queue_t* vq)
+{
+	while (vq->last_seen_used != vq->vring.used->idx) {
+		uint16_t id;
+
+		// read the used element after the index
+		mb();
+		id = vq->vring.used->ring[vq->last_seen_used % vq->vring.num].id;
+		vq->last_seen_used++;
+
+		if (BUILTIN_EXPECT(id >= vq->vring.num, 0))
+			continue;
+
+		vq->vring.desc[id].next = vq->free_head;
+		vq->free_head = id;
+		vq->nr_free++;
+	}
+}
+
+int vsock_transport_send(const struct virtio_vsock_hdr* hdr, const void* buf, uint32_t len, int wait)
+{
+	vvsock_t* dev = vvsock;
+	vvsock_queue_t* vq;
+	uint8_t* slot;
+	uint16_t id;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENODEV;
+	if (BUILTIN_EXPECT(!hdr || (len > VSOCK_MAX_PKT) || (len && !buf), 0))
+		return -EINVAL;
+
+	vq = dev->queues + VIRTIO_VSOCK_VQ_TX;
+
+	spinlock_irqsave_lock(&vq->lock);
+
+	while (1) {
+		vvsock_tx_reclaim(vq);
+		if (vq->nr_free)
+			break;
+
+		if (!wait) {
+			spinlock_irqsave_unlock(&vq->lock);
+			return -EBUSY;
+		}
+
+		// the device consumes the ring without our help
+		spinlock_irqsave_unlock(&vq->lock);
+		reschedule();
+		spinlock_irqsave_lock(&vq->lock);
+	}
+
+	id = vq->free_head;
+	vq->free_head = vq->vring.desc[id].next;
+	vq->nr_free--;
+
+	slot = vvsock_buffer(vq, id);
+	memcpy(slot, hdr, sizeof(struct virtio_vsock_hdr));
+	if (len)
+		memcpy(slot + sizeof(struct virtio_vsock_hdr), buf, len);
+
+	vq->vring.desc[id].addr = vq->buffers_phys + id * vq->buf_size;
+	vq->vring.desc[id].len = sizeof(struct virtio_vsock_hdr) + len;
+	vq->vring.desc[id].flags = 0;
+
+	vq->vring.avail->ring[vq->vring.avail->idx % vq->vring.num] = id;
+	// the device has to see the descriptor before the new index
+	mb();
+	vq->vring.avail->idx++;
+	vq->packets++;
+
+	vvsock_kick(vq);
+
+	spinlock_irqsave_unlock(&vq->lock);
+
+	return 0;
+}
+
+uint64_t vsock_local_cid(void)
+{
+	return vvsock ? vvsock->guest_cid : 0;
+}
+
+#ifdef __x86_64__
+/* pass the received packets to the socket layer and refill the ring */
+static void vvsock_rx(vvsock_t* dev)
+{
+	vvsock_queue_t* vq = dev->queues + VIRTIO_VSOCK_VQ_RX;
+	uint16_t posted = 0;
+
+	spinlock_irqsave_lock(&vq->lock);
+
+	while (vq->last_seen_used != vq->vring.used->idx) {
+		struct vring_used_elem* used;
+		struct virtio_vsock_hdr* hdr;
+
+		// read the used element after the index
+		mb();
+		used = &vq->vring.used->ring[vq->last_seen_used % vq->vring.num];
+		vq->last_seen_used++;
+
+		if (BUILTIN_EXPECT(used->id >= vq->vring.num, 0))
+			continue;
+
+		hdr = (struct virtio_vsock_hdr*) vvsock_buffer(vq, used->id);
+		if (BUILTIN_EXPECT((used->len >= sizeof(struct virtio_vsock_hdr))
+		    && (hdr->len <= used->len - sizeof(struct virtio_vsock_hdr)), 1)) {
+			vq->packets++;
+			vsock_input(hdr, (const uint8_t*) (hdr + 1));
+		} else LOG_ERROR("vvsock: drop truncated packet of %u bytes\n", used->len);
+
+		vvsock_post(vq, used->id);
+		posted++;
+	}
+
+	if (posted)
+		vvsock_kick(vq);
+
+	spinlock_irqsave_unlock(&vq->lock);
+}
+
+static void vvsock_event(vvsock_t* dev)
+{
+	vvsock_queue_t* vq = dev->queues + VIRTIO_VSOCK_VQ_EVENT;
+	uint16_t posted = 0;
+
+	spinlock_irqsave_lock(&vq->lock);
+
+	while (vq->last_seen_used != vq->vring.used->idx) {
+		struct vring_used_elem* used;
+		struct virtio_vsock_event* event;
+
+		mb();
+		used = &vq->vring.used->ring[vq->last_seen_used % vq->vring.num];
+		vq->last_seen_used++;
+
+		if (BUILTIN_EXPECT(used->id >= vq->vring.num, 0))
+			continue;
+
+		event = (struct virtio_vsock_event*) vvsock_buffer(vq, used->id);
+		if (event->id == VIRTIO_VSOCK_EVENT_TRANSPORT_RESET) {
+			// e.g. after a migration, the guest may get a new CID
+			dev->guest_cid = vvsock_read_cid(dev);
+			LOG_INFO("vvsock: transport reset, guest CID %llu\n", dev->guest_cid);
+			vsock_transport_reset();
+		}
+
+		vvsock_post(vq, used->id);
+		posted++;
+	}
+
+	if (posted)
+		vvsock_kick(vq);
+
+	spinlock_irqsave_unlock(&vq->lock);
+}
+
+static void vvsock_handler(struct state* s)
+{
+	vvsock_t* dev = vvsock;
+
+	if (BUILTIN_EXPECT(!dev, 0))
+		return;
+
+	// reading the isr register acknowledges the interrupt
+	if (!(vpci_isr(&dev->vpci) & 0x01))
+		return;
+
+	vvsock_rx(dev);
+	vvsock_event(dev);
+}
+
+static int vvsock_queue_init(vvsock_t* dev, uint16_t index, uint16_t limit, uint32_t buf_size)
+{
+	vvsock_queue_t* vq = dev->queues + index;
+	size_t vring_phys, driver, device;
+	uint32_t total_size;
+	uint16_t num;
+	void* vring_base;
+
+	memset(vq, 0x00, sizeof(vvsock_queue_t));
+	vq->index = index;
+	vq->buf_size = buf_size;
+
+	num = vpci_queue_size(&dev->vpci, index, limit);
+	if (!num)
+		return -ENODEV;
+
+	total_size = vring_size(num, PAGE_SIZE);
+	vring_base = page_alloc(total_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	vq->buffers = page_alloc(num * buf_size, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!vring_base || !vq->buffers, 0)) {
+		LOG_ERROR("vvsock: not enough memory to create queue %u\n", index);
+		return -ENOMEM;
+	}
+
+	memset(vring_base, 0x00, total_size);
+	vring_phys = virt_to_phys((size_t) vring_base);
+	vq->buffers_phys = virt_to_phys((size_t) vq->buffers);
+	vring_init(&vq->vring, num, vring_base, PAGE_SIZE);
+	spinlock_irqsave_init(&vq->lock);
+
+	if (index == VIRTIO_VSOCK_VQ_TX) {
+		// chain all descriptors to the free list, sent packets are reclaimed by polling
+		for(uint16_t i=0; i<num; i++)
+			vq->vring.desc[i].next = i + 1;
+		vq->free_head = 0;
+		vq->nr_free = num;
+		vring_disable_cb(&vq->vring);
+	} else {
+		for(uint16_t i=0; i<num; i++)
+			vvsock_post(vq, i);
+	}
+
+	driver = vring_phys + ((size_t) vq->vring.avail - (size_t) vring_base);
+	device = vring_phys + ((size_t) vq->vring.used - (size_t) vring_base);
+
+	// the device uses the legacy interrupt only
+	return vpci_queue_enable(&dev->vpci, index, vring_phys, driver, device, VIRTIO_MSI_NO_VECTOR, &vq->notify);
+}
+
+static int vvsock_setup(vvsock_t* dev)
+{
+	pci_info_t pci_info;
+	uint64_t features;
+	uint8_t status;
+
+	// vsock devices don't have a legacy interface
+	if (pci_get_device_info(VENDOR_ID, VVSOCK_MODERN_ID, PCI_IGNORE_SUBID, &pci_info, 1))
+		return -ENODEV;
+
+	LOG_INFO("Found vvsock (Vendor ID 0x%x, Device Id 0x%x)\n", VENDOR_ID, VVSOCK_MODERN_ID);
+
+	dev->pci = pci_info;
+	dev->irq = pci_info.irq;
+
+	if (vpci_setup(&dev->vpci, &dev->pci)) {
+		LOG_ERROR("vvsock: the device doesn't provide the virtio 1.x interface\n");
+		return -ENODEV;
+	}
+
+	vpci_reset(&dev->vpci, VVSOCK_RETRIES);
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE);
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER);
+
+	features = vpci_get_features(&dev->vpci);
+	LOG_INFO("vvsock: host features 0x%llx\n", features);
+	if (!(features & (1ULL << VIRTIO_F_VERSION_1))) {
+		LOG_ERROR("vvsock: the host doesn't support virtio 1.x\n");
+		goto failed;
+	}
+
+	// the stream sockets don't need any optional feature
+	dev->features = 1ULL << VIRTIO_F_VERSION_1;
+	vpci_set_features(&dev->vpci, dev->features);
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK);
+	status = vpci_get_status(&dev->vpci);
+	if (!(status & VIRTIO_CONFIG_S_FEATURES_OK)) {
+		LOG_ERROR("vvsock: device features are ignored: status 0x%x\n", (uint32_t) status);
+		goto failed;
+	}
+
+	dev->guest_cid = vvsock_read_cid(dev);
+
+	if (vvsock_queue_init(dev, VIRTIO_VSOCK_VQ_RX, QUEUE_LIMIT, VVSOCK_BUF_SIZE)
+	    || vvsock_queue_init(dev, VIRTIO_VSOCK_VQ_TX, QUEUE_LIMIT, VVSOCK_BUF_SIZE)
+	    || vvsock_queue_init(dev, VIRTIO_VSOCK_VQ_EVENT, EVENT_LIMIT, sizeof(struct virtio_vsock_event)))
+		goto failed;
+
+	irq_install_handler(dev->irq+32, vvsock_handler);
+
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_ACKNOWLEDGE|VIRTIO_CONFIG_S_DRIVER|VIRTIO_CONFIG_S_FEATURES_OK|VIRTIO_CONFIG_S_DRIVER_OK);
+
+	LOG_INFO("vvsock: guest CID %llu, %u descriptors per ring\n",
+		dev->guest_cid, dev->queues[VIRTIO_VSOCK_VQ_RX].vring.num);
+
+	return 0;
+
+failed:
+	vpci_set_status(&dev->vpci, VIRTIO_CONFIG_S_FAILED);
+
+	return -ENODEV;
+}
+#else
+/* virtio-mmio vsock devices aren't supported yet */
+static inline int vvsock_setup(vvsock_t* dev)
+{
+	return -ENODEV;
+}
+#endif
+
+int vsock_init(void)
+{
+	vvsock_t* dev;
+
+	if (vvsock)
+		return 0;
+
+	dev = kmalloc(sizeof(vvsock_t));
+	if (BUILTIN_EXPECT(!dev, 0))
+		return -ENOMEM;
+	memset(dev, 0x00, sizeof(vvsock_t));
+
+	// the memory of the rings isn't released, the device may still use it
+	if (vvsock_setup(dev)) {
+		if (!dev->queues[VIRTIO_VSOCK_VQ_RX].buffers)
+			kfree(dev);
+		return -ENODEV;
+	}
+
+	vvsock = dev;
+
+	return 0;
+}
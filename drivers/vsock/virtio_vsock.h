@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __VSOCK_VIRTIO_VSOCK_H__
+#define __VSOCK_VIRTIO_VSOCK_H__
+
+#include <hermit/stddef.h>
+#include <hermit/vsock.h>
+#include <hermit/virtio_ring.h>
+#include <hermit/virtio_vsock.h>
+#include <hermit/spinlock.h>
+#include <asm/pci.h>
+#include <virtio/vpci.h>
+
+/* size of a packet buffer: header and the maximal payload */
+#define VVSOCK_BUF_SIZE	(sizeof(struct virtio_vsock_hdr) + VSOCK_MAX_PKT)
+
+typedef struct
+{
+	struct vring vring;
+	/* index of the queue, which is used to notify the host */
+	uint16_t index;
+	/* notification register of the queue */
+	volatile uint16_t* notify;
+	uint16_t last_seen_used;
+	/* head of the free descriptor list, chained by desc[].next (tx) */
+	uint16_t free_head;
+	/* number of free descriptors */
+	uint16_t nr_free;
+	/* protects the ring against the interrupt handler */
+	spinlock_irqsave_t lock;
+	/* one buffer of buf_size bytes per descriptor */
+	uint8_t* buffers;
+	uint32_t buf_size;
+	size_t buffers_phys;
+	/* statistics */
+	uint64_t packets;
+	uint64_t kicks;
+} vvsock_queue_t;
+
+typedef struct
+{
+	pci_info_t pci;
+	uint8_t irq;
+	/* modern interface (virtio 1.x) */
+	vpci_t vpci;
+	/* negotiated features */
+	uint64_t features;
+	uint64_t guest_cid;
+	vvsock_queue_t queues[VIRTIO_VSOCK_VQ_MAX];
+} vvsock_t;
+
+#endif
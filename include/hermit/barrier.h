@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/barrier.h
+ * @brief Barrier for a fixed number of tasks
+ *
+ * The arriving tasks decrement a counter. The last one starts the next
+ * episode by changing the sense of the barrier. The others spin on the
+ * sense for BARRIER_SPIN_NSEC nanoseconds and afterwards sleep on the
+ * wait queue of the barrier, which the last task releases by a single
+ * call of wakeup_tasks(), i.e. with at most one IPI per core.
+ */
+
+#ifndef __BARRIER_H__
+#define __BARRIER_H__
+
+#include <hermit/stddef.h>
+#include <hermit/spinlock_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// returned to exactly one task of each episode (like PTHREAD_BARRIER_SERIAL_THREAD)
+#define BARRIER_SERIAL_TASK	1
+
+typedef struct barrier {
+	/// number of tasks, which have to arrive
+	uint32_t count;
+	/// number of tasks, which are still missing in the current episode
+	atomic_int32_t remaining __attribute__ ((aligned (CACHE_LINE)));
+	/// number of the episode, the waiters spin on it
+	volatile uint32_t sense __attribute__ ((aligned (CACHE_LINE)));
+	/// sleeping tasks of the current episode
+	tid_t* sleepers;
+	uint32_t nr_sleepers;
+	/// protects the sleepers
+	spinlock_irqsave_t lock;
+} barrier_t;
+
+/** @brief Initialize a barrier for count tasks
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if count is 0
+ * - -ENOMEM (-12) if the wait queue couldn't be allocated
+ */
+int barrier_init(barrier_t* b, uint32_t count);
+
+/** @brief Destroy a barrier
+ *
+ * @return
+ * - 0 on success
+ * - -EBUSY (-16) if tasks wait for the barrier
+ */
+int barrier_destroy(barrier_t* b);
+
+/** @brief Wait until count tasks have arrived at the barrier
+ *
+ * @return
+ * - BARRIER_SERIAL_TASK for the last arriving task
+ * - 0 for the other tasks
+ * - -EINVAL (-22) on an invalid barrier
+ */
+int barrier_wait(barrier_t* b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/blkfs.h
+ * @brief Extent-based file system on the block device
+ *
+ * Files below BLKFS_PATH are stored on the virtio-blk device. The first
+ * block holds the superblock, the following ones a fixed table of
+ * BLKFS_MAX_FILES entries, each of which describes a file by its name,
+ * its size and up to BLKFS_MAX_EXTENTS contiguous runs of blocks. A file
+ * grows by extending its last extent in place or by a new extent of at
+ * least its current size, so that a file, which is written sequentially,
+ * needs only a few extents. Truncation keeps the extents for rewriting.
+ * The system calls handle the paths and descriptors before they forward
+ * a request to uhyve or the proxy. There are no directories.
+ *
+ * Data is transferred between the device and the buffer of the caller
+ * without copying, only the partial sectors at both ends of an unaligned
+ * transfer are read and written back. The size of a file is written to
+ * the device by blkfs_fsync() and blkfs_close(), the extents whenever
+ * they change. blkfs_map() exposes the sectors behind a file, so that an
+ * application is able to post its own requests (see hermit/block.h).
+ */
+
+#ifndef __BLKFS_H__
+#define __BLKFS_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// allocation unit of the file contents
+#define BLKFS_BLOCK_BITS	12
+#define BLKFS_BLOCK_SIZE	(1UL << BLKFS_BLOCK_BITS)
+
+/// number of entries of the file table
+#define BLKFS_MAX_FILES		64
+/// maximum number of extents per file
+#define BLKFS_MAX_EXTENTS	6
+/// maximum length of a name below the mount point (including the terminating zero)
+#define BLKFS_NAME_MAX		64
+/// minimal size of a new extent in blocks (1 MiB)
+#define BLKFS_EXTENT_MIN	256
+
+/// maximal number of open descriptors
+#define BLKFS_MAX_OPEN		128
+
+/// file descriptors of blkfs files are marked by this bit
+#define BLKFS_FD_BIT		(1 << 25)
+
+/** @brief Check the superblock of the device, format it if there is none
+ *
+ * @return 0 on success, -ENODEV without a block device, -EIO on I/O errors
+ */
+int blkfs_mount(void);
+
+/** @brief Check, if the file system is mounted and handles a path
+ *
+ * @return 1 if the blkfs handles the path, otherwise 0
+ */
+int blkfs_path(const char* name);
+
+/** @brief Open or create a file
+ *
+ * The flags are the ones of the host (Linux): O_CREAT, O_EXCL, O_TRUNC
+ * and O_APPEND are supported.
+ *
+ * @return
+ * - file descriptor of the file (BLKFS_FD_BIT is set)
+ * - -ENOENT if the file doesn't exist and O_CREAT isn't set
+ * - -EEXIST if the file exists and O_CREAT | O_EXCL is set
+ * - -ENAMETOOLONG if the name doesn't fit into the file table
+ * - -ENFILE if the file table or all descriptors are in use
+ * - -EIO if the file table could not be written
+ */
+int blkfs_open(const char* name, int flags, int mode);
+
+/** @brief Read at the file position and advance it
+ *
+ * @return number of read bytes (0 at the end of the file), -EBADF or -EIO
+ */
+ssize_t blkfs_read(int fd, void* buf, size_t len);
+
+/** @brief Write at the file position (the end with O_APPEND) and advance it
+ *
+ * @return number of written bytes, -EBADF, -ENOSPC, -EFBIG or -EIO
+ */
+ssize_t blkfs_write(int fd, const void* buf, size_t len);
+
+/** @brief Read at an offset without changing the file position */
+ssize_t blkfs_pread(int fd, void* buf, size_t len, off_t offset);
+
+/** @brief Write at an offset without changing the file position */
+ssize_t blkfs_pwrite(int fd, const void* buf, size_t len, off_t offset);
+
+/** @brief Set the file position, a position behind the end is allowed
+ *
+ * @return new position, -EBADF or -EINVAL
+ */
+off_t blkfs_lseek(int fd, off_t offset, int whence);
+
+/** @brief Write the size of the file and the cache of the device back
+ *
+ * @return 0 on success, -EBADF or -EIO
+ */
+int blkfs_fsync(int fd);
+
+/** @brief Close a descriptor, the size of the file is written back
+ *
+ * The extents of an unlinked file are released by the last close.
+ */
+int blkfs_close(int fd);
+
+/** @brief Remove a name, open descriptors keep the file
+ *
+ * @return 0 on success, -ENOENT or -EIO
+ */
+int blkfs_unlink(const char* name);
+
+/** @brief Determine the sectors behind a part of a file
+ *
+ * A writable descriptor extends the file to offset + len, the contents of
+ * the new part are undefined until the application writes them.
+ *
+ * @param offset Offset in the file, a multiple of BLK_SECTOR_SIZE
+ * @param sector First sector of the device, which holds offset
+ * @param len In: requested length, out: number of bytes, which are
+ *	stored contiguously from sector on
+ * @return 0 on success, -EBADF, -EINVAL, -ENOSPC, -EFBIG or -EIO
+ */
+int blkfs_map(int fd, off_t offset, uint64_t* sector, size_t* len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/block.h
+ * @brief Raw access to the block device
+ *
+ * The block device is an NVMe controller (e.g. passed through to the
+ * virtual machine) or a virtio-blk device; blk_init() prefers the NVMe
+ * controller. Both drivers use one request queue per core, as far as the
+ * device provides them. A request is posted to the queue of the
+ * submitting core and completes asynchronously: by the interrupt of its
+ * queue or by blk_poll(), which any task may call to reap completions
+ * without an interrupt. Positions are counted in sectors of BLK_SECTOR_SIZE
+ * bytes. The position and the length of a request have to be multiples of
+ * blk_info_t::lba_size, which is larger than a sector for NVMe namespaces
+ * with larger blocks, and its buffer has to be aligned to buf_align.
+ * blk_read() and blk_write() accept every transfer of whole sectors and
+ * pass unaligned ones through a bounce buffer.
+ * The buffer may be anywhere in the (physically fragmented) address space,
+ * the drivers translate it page by page. A caller, which already knows the
+ * physical address of a contiguous buffer, passes it in the request and
+ * saves the translation.
+ */
+
+#ifndef __BLOCK_H__
+#define __BLOCK_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLK_SECTOR_BITS		9
+#define BLK_SECTOR_SIZE		(1 << BLK_SECTOR_BITS)
+
+/// maximum number of request queues
+#define BLK_MAX_QUEUES		16
+
+/// maximum length of a single request in bytes
+#define BLK_MAX_XFER		(128 << 10)
+
+/// operations, they match the request types of virtio-blk
+#define BLK_OP_READ		0
+#define BLK_OP_WRITE		1
+#define BLK_OP_FLUSH		4
+
+/// blk_submit() selects the queue of the current core
+#define BLK_QUEUE_ANY		0xFFFF
+
+/// status of a request, which the device hasn't completed yet
+#define BLK_PENDING		1
+
+struct blk_request;
+
+/// called after the status is set, without VIRTIO_BLK_POLL/NVME_POLL in interrupt context
+typedef void (*blk_done_t)(struct blk_request* req);
+
+typedef struct blk_request {
+	/// BLK_OP_READ, BLK_OP_WRITE or BLK_OP_FLUSH
+	uint32_t op;
+	/// queue, which processes the request (set by blk_submit)
+	uint16_t queue;
+	/// head descriptor of the request (used by the driver)
+	uint16_t id;
+	/// first sector of the transfer
+	uint64_t sector;
+	void* buf;
+	/// physical address of a physically contiguous buffer, 0 = translate buf
+	size_t phys;
+	/// number of bytes, a multiple of BLK_SECTOR_SIZE up to BLK_MAX_XFER
+	size_t len;
+	/// BLK_PENDING, 0 or a negative error code
+	volatile int32_t status;
+	/// task, which waits in blk_wait (used by the driver)
+	tid_t waiter;
+	/// optional completion callback, the request must not be reused before it returns
+	blk_done_t done;
+	void* priv;
+} blk_request_t;
+
+typedef struct blk_info {
+	/// capacity of the device in sectors
+	uint64_t sectors;
+	/// optimal block size of the device in bytes
+	uint32_t blk_size;
+	/// logical block size in bytes, the unit of the requests
+	uint32_t lba_size;
+	/// maximum length of a request in bytes
+	uint32_t max_xfer;
+	/// number of request queues
+	uint16_t nr_queues;
+	/// number of descriptors per queue
+	uint16_t queue_size;
+	/// writes are rejected with -EROFS
+	uint8_t read_only;
+	/// the device has a volatile write cache, which BLK_OP_FLUSH writes back
+	uint8_t flush;
+	/// completions are only reaped by polling (VIRTIO_BLK_POLL or NVME_POLL)
+	uint8_t polled;
+	/// required alignment of a request's buffer in bytes
+	uint8_t buf_align;
+} blk_info_t;
+
+/** @brief Search and initialize the block device
+ *
+ * @return 0 on success, -ENODEV if there is no device
+ */
+int blk_init(void);
+
+/** @brief Describe the block device
+ *
+ * @return 0 on success, -ENODEV if there is no device
+ */
+int blk_info(blk_info_t* info);
+
+/** @brief Post a request to a queue without waiting for its completion
+ *
+ * The request has to stay valid until its status isn't BLK_PENDING anymore
+ * (and its callback has returned).
+ *
+ * @param queue Index of the queue or BLK_QUEUE_ANY
+ * @return
+ * - 0 if the request is posted
+ * - -EINVAL if the parameters are invalid
+ * - -EROFS if the device is read-only
+ * - -EBUSY if the queue is full (the request isn't posted)
+ * - -ENODEV if there is no device
+ */
+int blk_submit(blk_request_t* req, uint16_t queue);
+
+/** @brief Reap completed requests of a queue
+ *
+ * @param queue Index of the queue or BLK_QUEUE_ANY
+ * @param budget Maximum number of completions (0 = all)
+ * @return number of completed requests or -ENODEV
+ */
+int blk_poll(uint16_t queue, uint32_t budget);
+
+/** @brief Wait for a request, which is posted by blk_submit
+ *
+ * The task sleeps until the interrupt of the queue completes the request,
+ * the virtio-blk driver polls the queue for VIRTIO_BLK_POLL_NSEC nanoseconds
+ * before. With VIRTIO_BLK_POLL (virtio-blk) or NVME_POLL (NVMe), it polls
+ * until the request is completed.
+ *
+ * @return final status of the request
+ */
+int blk_wait(blk_request_t* req);
+
+/** @brief Synchronous transfers of arbitrary length
+ *
+ * The transfer is split into requests of BLK_MAX_XFER bytes, which are
+ * posted at once to the queue of the current core. Transfers, which don't
+ * match lba_size or buf_align, are copied through a bounce buffer; partially
+ * written logical blocks are read before.
+ *
+ * @return number of transferred bytes or a negative error code
+ */
+ssize_t blk_read(uint64_t sector, void* buf, size_t len);
+ssize_t blk_write(uint64_t sector, const void* buf, size_t len);
+
+/** @brief Write back the volatile cache of the device
+ *
+ * @return 0 on success or a negative error code
+ */
+int blk_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/boottime.h
+ * @brief Time stamps of the boot phases
+ *
+ * Each phase stores the time stamp counter at its begin and its end.
+ * The phases may be nested (e.g. page_init is part of memory_init).
+ * The loader phase ends with the first instruction of hermit_init and
+ * starts with the reset of the counter, which is the start of the
+ * virtual machine on KVM. The table is printed, before the application
+ * is started, and the host may read the symbol boot_phases directly.
+ */
+
+#ifndef __BOOTTIME_H__
+#define __BOOTTIME_H__
+
+#include <hermit/stddef.h>
+#include <asm/processor.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// boot phases in the order of their start
+enum {
+	BOOT_PHASE_LOADER = 0,
+	BOOT_PHASE_HERMIT_INIT,
+	BOOT_PHASE_MEMORY_INIT,
+	BOOT_PHASE_PAGE_INIT,
+	BOOT_PHASE_SYSTEM_CALIBRATION,
+	BOOT_PHASE_SMP_INIT,
+	BOOT_PHASE_BSS,
+	BOOT_PHASE_INIT_NETIFS,
+	BOOT_PHASE_DHCP,
+	BOOT_PHASE_LIBC_START,
+	BOOT_PHASE_MAX
+};
+
+typedef struct boot_phase {
+	/// counter value at the begin of the phase
+	uint64_t start;
+	/// counter value at the end of the phase (0 => not finished)
+	uint64_t end;
+} boot_phase_t;
+
+extern boot_phase_t boot_phases[BOOT_PHASE_MAX];
+/// frequency of the counter in Hz, is set before the table is printed
+extern uint64_t boot_phases_hz;
+
+static inline void boot_phase_begin(uint32_t phase)
+{
+	boot_phases[phase].start = get_rdtsc();
+}
+
+static inline void boot_phase_end(uint32_t phase)
+{
+	boot_phases[phase].end = get_rdtsc();
+}
+
+/// mark the start of the application and print the table
+void boottime_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/checksum.h
+ * @brief Internet checksum (RFC 1071)
+ *
+ * The partial sums are computed in the byte order of the memory, so a
+ * folded sum can be stored in a packet without a conversion. Sums of
+ * ranges, which start at an odd offset, have to be swapped by
+ * csum_swap() before they are combined.
+ */
+
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Add the 16 bit words of a range to a partial ones' complement sum
+ *
+ * On x86_64, the range is summed in 64 bit words with add-with-carry.
+ *
+ * @param data Start of the range
+ * @param len Length of the range in bytes
+ * @param sum Partial sum of the previous ranges
+ * @return new partial sum
+ */
+uint32_t csum_partial(const void* data, size_t len, uint32_t sum);
+
+/// combine two partial sums
+static inline uint32_t csum_add(uint32_t sum, uint32_t addend)
+{
+	sum += addend;
+
+	return sum + (sum < addend);
+}
+
+/// fold a partial sum to 16 bits (not complemented)
+static inline uint16_t csum_fold(uint32_t sum)
+{
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+
+	return (uint16_t) sum;
+}
+
+/// sum of a range, which starts at an odd offset of the checksummed data
+static inline uint32_t csum_swap(uint32_t sum)
+{
+	const uint16_t s = csum_fold(sum);
+
+	return (uint16_t) ((s << 8) | (s >> 8));
+}
+
+/** @brief Checksum of a range in the format of LWIP_CHKSUM
+ *
+ * The result isn't complemented and is in network byte order.
+ */
+static inline uint16_t inet_chksum_fast(const void* data, int len)
+{
+	return csum_fold(csum_partial(data, (size_t) len, 0));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/clocksource.h
+ * @brief Selection of the source of the monotonic time
+ *
+ * Every architecture provides a NULL-terminated list of clock sources in
+ * arch_clocksources. clocksource_init() probes all of them and selects
+ * the usable one with the highest rating. Afterwards, get_uptime(), the
+ * conversion of timeouts to counter values and the clock page of
+ * vclock.h are based on the selected source.
+ */
+
+#ifndef __CLOCKSOURCE_H__
+#define __CLOCKSOURCE_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct clocksource {
+	/// name of the source for the log
+	const char* name;
+	/// preference of the source, is set by probe()
+	int rating;
+	/// check, if the source is usable on the boot processor and prepare it
+	int (*probe)(struct clocksource* cs);
+	/// prepare the source on an application processor, may be NULL
+	int (*enable_cpu)(struct clocksource* cs);
+	/// time in nanoseconds since an arbitrary origin
+	uint64_t (*read)(void);
+	/// frequency of the time stamp counter in Hz, 0 if unknown
+	uint64_t freq_hz;
+	/// how the C library reads the source without system calls (VCLOCK_MODE_*)
+	uint32_t vclock_mode;
+	/// VCLOCK_MODE_PVCLOCK: time info of the hypervisor, which is valid on all cores
+	const void* pvclock;
+	/// is subtracted from read(), such that the time starts at boot time
+	uint64_t offset;
+} clocksource_t;
+
+/// list of the sources of the current architecture
+extern clocksource_t* arch_clocksources[];
+
+/** @brief Select the best clock source
+ *
+ * Must be called on the boot processor after the calibration.
+ *
+ * @return 0 on success, -ENODEV if no source is usable
+ */
+int clocksource_init(void);
+
+/// prepare the current source on an application processor
+int clocksource_enable_cpu(void);
+
+/// the selected source or NULL before clocksource_init()
+const clocksource_t* clocksource_get(void);
+
+/// monotonic time in nanoseconds since boot time
+uint64_t clocksource_ns(void);
+
+/// frequency of the time stamp counter in Hz, which deadlines are based on
+uint64_t clocksource_tsc_hz(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
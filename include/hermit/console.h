@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/console.h
+ * @brief Buffered output of stdout and stderr
+ *
+ * Writes to the descriptors 1 and 2 are collected in buffers of
+ * CONSOLE_BUFSIZE bytes per core and descriptor. A writer takes only
+ * the lock of the buffer of its own core, which is contended by
+ * console_flush() alone. A buffer is written with a single uhyve exit
+ * (or one burst to the UART), if it is full, if a newline is written
+ * after the buffered output has waited CONSOLE_FLUSH_MS, and at the
+ * latest by a kernel task CONSOLE_FLUSH_MS after the first byte has been
+ * buffered. The output of each core stays in order, the output of
+ * different cores is interleaved line by line.
+ */
+
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Start the task, which flushes the buffers periodically
+ *
+ * The output isn't buffered before.
+ *
+ * @return 0 on success, -ENOMEM if the task could not be created
+ */
+int console_init(void);
+
+/// is the output to fd buffered?
+int console_buffered(int fd);
+
+/** @brief Append the output to the buffer of the current core
+ *
+ * @return len
+ */
+ssize_t console_write(int fd, const char* buf, size_t len);
+
+/// write the buffers of all cores, e.g. before the application exits
+void console_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,11 +28,16 @@
 /**
  * @author Daniel Krebs
  * @file include/hermit/dequeue.h
- * @brief Double-ended queue implementation
+ * @brief Lock-free bounded queue with multiple producers and a single consumer
+ *
+ * Each slot of the ring carries a sequence number in front of the element
+ * (Vyukov's bounded queue): the slot is free for the producer at position
+ * pos, if its sequence is pos, and holds an element for the consumer, if
+ * it is pos+1. Producers claim a position by a CAS, the consumer doesn't
+ * need any atomic read-modify-write.
  */
 
 #include <hermit/stddef.h>
-#include <hermit/spinlock.h>
 #include <hermit/errno.h>
 #include <string.h>
 
@@ -45,19 +50,41 @@
 	}									\
 	} while(0)
 
+/// size of one slot in the buffer of dequeue_init(), which holds an element of element_size bytes
+#define DEQUEUE_SLOT_SIZE(element_size) \
+	((sizeof(size_t) + (element_size) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+
 typedef struct _dequeue_t {
-	size_t front;			///< point to first used entry
-	size_t back;			///< point to first unused entry
-	spinlock_t lock;		///< make dequeue thread safe
-	char* buffer;			///< pointer to buffer that holds elements
+	size_t back;			///< next position of the producers
+	size_t front;			///< next position of the consumer
+	char* buffer;			///< pointer to buffer that holds the slots
 	size_t buffer_length;	///< number of elements buffer can hold
 	size_t element_size;	///< size of one element in buffer
+	size_t slot_size;		///< size of one slot in buffer
 } dequeue_t;
 
+/// sequence number of the slot at position pos, the element follows it
+static inline size_t*
+dequeue_slot(dequeue_t* dequeue, size_t pos)
+{
+	return (size_t*) &dequeue->buffer[(pos % dequeue->buffer_length) * dequeue->slot_size];
+}
+
+/** @brief Initialize a queue
+ *
+ * @param buffer Memory of buffer_length * DEQUEUE_SLOT_SIZE(element_size) bytes
+ * @param buffer_length Maximal number of queued elements
+ * @param element_size Size of one element
+ */
 static inline int
 dequeue_init(dequeue_t* dequeue, void* buffer, size_t buffer_length, size_t element_size)
 {
 	NOT_NULL(dequeue);
+	NOT_NULL(buffer);
+
+	if(BUILTIN_EXPECT(!buffer_length, 0)) {
+		return -EINVAL;
+	}
 
 	dequeue->front = 0;
 	dequeue->back = 0;
@@ -65,56 +92,83 @@ dequeue_init(dequeue_t* dequeue, void* buffer, size_t buffer_length, size_t elem
 	dequeue->buffer = buffer;
 	dequeue->buffer_length = buffer_length;
 	dequeue->element_size = element_size;
+	dequeue->slot_size = DEQUEUE_SLOT_SIZE(element_size);
 
-	spinlock_init(&dequeue->lock);
+	for(size_t i = 0; i < buffer_length; i++) {
+		*dequeue_slot(dequeue, i) = i;
+	}
 
 	return 0;
 }
 
+/** @brief Append an element, safe for concurrent producers
+ *
+ * @return
+ * - 0 on success
+ * - -EOVERFLOW if the queue is full
+ */
 static inline int
 dequeue_push(dequeue_t* dequeue, void* v)
 {
 	NOT_NULL(dequeue);
-
-	spinlock_lock(&dequeue->lock);
-
-	size_t new_back = (dequeue->back + 1) % dequeue->buffer_length;
-	if(new_back == dequeue->front) {
-		spinlock_unlock(&dequeue->lock);
-		return -EOVERFLOW;
+	NOT_NULL(dequeue->buffer);
+
+	size_t pos = __atomic_load_n(&dequeue->back, __ATOMIC_RELAXED);
+	size_t* seq;
+
+	for(;;) {
+		seq = dequeue_slot(dequeue, pos);
+		ssize_t diff = (ssize_t) (__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+
+		if(diff == 0) {
+			// on failure, pos is updated to the current back
+			if(__atomic_compare_exchange_n(&dequeue->back, &pos, pos + 1, 1,
+			                               __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if(diff < 0) {
+			// the consumer hasn't released the slot of the previous round
+			return -EOVERFLOW;
+		} else {
+			pos = __atomic_load_n(&dequeue->back, __ATOMIC_RELAXED);
+		}
 	}
 
-	memcpy(&dequeue->buffer[dequeue->back * dequeue->element_size],
-	        v,
-	        dequeue->element_size);
+	memcpy(seq + 1, v, dequeue->element_size);
 
-	dequeue->back = new_back;
+	// publish the element to the consumer
+	__atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
 
-	spinlock_unlock(&dequeue->lock);
 	return 0;
 }
 
+/** @brief Remove the oldest element, only one consumer may call it at a time
+ *
+ * @return
+ * - 0 on success
+ * - -ENOENT if the queue is empty
+ */
 static inline int
 dequeue_pop(dequeue_t* dequeue, void* out)
 {
 
 	NOT_NULL(dequeue);
+	NOT_NULL(dequeue->buffer);
 	NOT_NULL(out);
 
-	spinlock_lock(&dequeue->lock);
+	const size_t pos = dequeue->front;
+	size_t* seq = dequeue_slot(dequeue, pos);
 
-	if(dequeue->front == dequeue->back) {
-		spinlock_unlock(&dequeue->lock);
+	// empty or the producer of this slot hasn't finished yet
+	if(__atomic_load_n(seq, __ATOMIC_ACQUIRE) != pos + 1) {
 		return -ENOENT;
 	}
 
-	memcpy(out,
-	       &dequeue->buffer[dequeue->front * dequeue->element_size],
-	        dequeue->element_size);
-
-	dequeue->front = (dequeue->front + 1) % dequeue->buffer_length;
+	memcpy(out, seq + 1, dequeue->element_size);
 
-	spinlock_unlock(&dequeue->lock);
+	// release the slot for the next round of the producers
+	__atomic_store_n(seq, pos + dequeue->buffer_length, __ATOMIC_RELEASE);
+	dequeue->front = pos + 1;
 
 	return 0;
 }
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/epoll.h
+ * @brief Readiness notification for LwIP sockets
+ *
+ * An epoll instance holds a set of LwIP sockets and the events, which the
+ * caller is interested in. epoll_wait() returns only the sockets, which
+ * became ready, and blocks the caller until at least one of them is ready.
+ * Readiness is signalled by the event callback of the socket's netconn,
+ * no periodic polling is involved.
+ */
+
+#ifndef __EPOLL_H__
+#define __EPOLL_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of epoll instances
+#define MAX_EPOLL		16
+
+/// file descriptors of epoll instances are marked by this bit
+#define EPOLL_FD_BIT		(1 << 29)
+
+#define EPOLLIN			0x001
+#define EPOLLPRI		0x002
+#define EPOLLOUT		0x004
+#define EPOLLERR		0x008
+#define EPOLLHUP		0x010
+/// report the socket only once, until it is rearmed by EPOLL_CTL_MOD
+#define EPOLLONESHOT		(1U << 30)
+/// edge-triggered: report the socket only, if new events arrived
+#define EPOLLET			(1U << 31)
+
+#define EPOLL_CTL_ADD		1
+#define EPOLL_CTL_DEL		2
+#define EPOLL_CTL_MOD		3
+
+typedef union epoll_data {
+	void* ptr;
+	int fd;
+	uint32_t u32;
+	uint64_t u64;
+} epoll_data_t;
+
+/// layout is compatible to Linux on x86_64
+struct epoll_event {
+	uint32_t events;
+	epoll_data_t data;
+} __attribute__((packed));
+
+/** @brief Create an epoll instance
+ *
+ * @param flags Has to be 0
+ * @return
+ * - file descriptor of the instance (EPOLL_FD_BIT is set)
+ * - -EINVAL on invalid flags
+ * - -ENFILE if all MAX_EPOLL instances are in use
+ */
+int epoll_create(int flags);
+
+/** @brief Add, modify or remove a socket of an epoll instance
+ *
+ * @param epfd File descriptor of the epoll instance
+ * @param op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+ * @param fd LwIP socket (LWIP_FD_BIT is set)
+ * @param event Events of interest and user data (ignored by EPOLL_CTL_DEL)
+ * @return
+ * - 0 on success
+ * - -EBADF if epfd or fd isn't valid
+ * - -EPERM if fd isn't an LwIP socket
+ * - -EEXIST if fd is already part of the instance (EPOLL_CTL_ADD)
+ * - -ENOENT if fd isn't part of the instance (EPOLL_CTL_MOD/DEL)
+ * - -EINVAL on invalid arguments
+ * - -ENOMEM if the registration could not be allocated
+ */
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+
+/** @brief Wait for events of an epoll instance
+ *
+ * Level-triggered sockets are reported as long as they are ready.
+ * Edge-triggered sockets (EPOLLET) are reported once per arrival of
+ * new events.
+ *
+ * @param epfd File descriptor of the epoll instance
+ * @param events Receives the ready sockets
+ * @param maxevents Number of entries in events
+ * @param timeout Timeout in milliseconds (0 = don't block, -1 = infinite)
+ * @return
+ * - number of returned events (0 after a timeout)
+ * - -EBADF if epfd isn't valid
+ * - -EINVAL on invalid arguments
+ */
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout);
+
+/** @brief Destroy an epoll instance
+ *
+ * Tasks, which still wait for the instance, return -EBADF.
+ */
+int epoll_close(int epfd);
+
+/** @brief Remove a socket from all epoll instances
+ *
+ * Has to be called before the socket is closed.
+ *
+ * @param fd LwIP socket (LWIP_FD_BIT is set)
+ */
+void epoll_socket_close(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/fiber.h
+ * @brief User-level fibers
+ *
+ * Fibers are cooperatively scheduled contexts of a task, the carrier.
+ * A switch between two fibers saves only the callee-saved registers and
+ * the FPU control words and doesn't enter the scheduler. If a fiber waits
+ * for a futex, only the fiber blocks and the carrier runs its other fibers.
+ */
+
+#ifndef __FIBER_H__
+#define __FIBER_H__
+
+#include <hermit/stddef.h>
+#include <hermit/tasks_types.h>
+#include <hermit/spinlock_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIBER_INVALID	0
+#define FIBER_READY	1
+#define FIBER_RUNNING	2
+#define FIBER_BLOCKED	3
+#define FIBER_FINISHED	4
+
+/// default stack size of a fiber
+#define FIBER_STACK_SIZE	(64*1024)
+
+struct fiber_sched;
+struct futex_waiter;
+
+/** @brief Represents a fiber */
+typedef struct fiber {
+	/// saved stack pointer of the fiber
+	size_t*		stack_ptr;
+	/// stack of the fiber (NULL for the original context of the carrier)
+	void*		stack;
+	/// entry point of the fiber
+	entry_point_t	func;
+	/// argument of the entry point
+	void*		arg;
+	/// return value of the entry point
+	int		result;
+	/// status of the fiber
+	uint8_t		status;
+	/// scheduler of the carrier
+	struct fiber_sched* sched;
+	/// next fiber in the ready queue
+	struct fiber*	next;
+	/// previous fiber in the ready queue
+	struct fiber*	prev;
+	/// next fiber of the carrier, which isn't destroyed yet
+	struct fiber*	all_next;
+	/// previous fiber of the carrier, which isn't destroyed yet
+	struct fiber*	all_prev;
+	/// futex, which the fiber waits for (see futex_cancel())
+	struct futex_waiter* waiter;
+} fiber_t;
+
+/** @brief Fiber scheduler of a carrier task */
+typedef struct fiber_sched {
+	/// original context of the carrier
+	fiber_t		main;
+	/// fiber, which is currently running
+	fiber_t*	curr;
+	/// first ready fiber
+	fiber_t*	first;
+	/// last ready fiber
+	fiber_t*	last;
+	/// created fibers, which aren't destroyed yet
+	fiber_t*	all;
+	/// id of the carrier
+	tid_t		carrier;
+	/// indicates that the carrier is blocked, because all fibers wait
+	uint8_t		idle;
+	/// lock of the ready queue
+	spinlock_irqsave_t lock;
+} fiber_sched_t;
+
+/** @brief Convert the current task into a carrier of fibers
+ *
+ * The current context becomes the first fiber of the carrier.
+ *
+ * @return
+ * - 0 on success
+ * - -EBUSY (-16) if the task is already a carrier
+ * - -ENOMEM (-12) if the scheduler couldn't be allocated
+ */
+int fiber_init(void);
+
+/** @brief Create a new fiber on the current carrier
+ *
+ * The fiber is ready, but runs not before the current fiber yields.
+ *
+ * @param fiber Location to store the new fiber
+ * @param func Entry point of the fiber
+ * @param arg Argument of the entry point
+ * @param stack_size Size of the stack (0 = FIBER_STACK_SIZE)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the current task isn't a carrier
+ * - -ENOMEM (-12) if the fiber couldn't be allocated
+ */
+int fiber_create(fiber_t** fiber, entry_point_t func, void* arg, size_t stack_size);
+
+/** @brief Pass the carrier to the next ready fiber
+ *
+ * Returns immediately, if no other fiber is ready.
+ */
+void fiber_yield(void);
+
+/** @brief Pass the carrier to a specific ready fiber
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the fiber isn't a ready fiber of the current carrier
+ */
+int fiber_switch_to(fiber_t* fiber);
+
+/** @brief Release a finished fiber
+ *
+ * @param fiber Fiber to release
+ * @param result Location to store the return value of the fiber (or NULL)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on invalid argument
+ * - -EBUSY (-16) if the fiber hasn't finished yet
+ */
+int fiber_destroy(fiber_t* fiber, int* result);
+
+/** @brief Get the running fiber of the current task
+ *
+ * @return The fiber or NULL, if the task isn't a carrier
+ */
+fiber_t* fiber_current(void);
+
+/** @brief Block the current fiber
+ *
+ * The carrier runs its other ready fibers in the meantime and blocks
+ * only, if all fibers wait. Must not be called while other locks are
+ * held, because spinlocks are owned by the carrier and not by the fiber.
+ *
+ * @param lock A lock, which is released after the fiber is marked as
+ * blocked (or NULL). The interrupt flag is restored when it's released.
+ */
+void fiber_block(spinlock_irqsave_t* lock);
+
+/** @brief Wake up a blocked fiber
+ *
+ * Can be called from any task. The carrier is woken up, if it is blocked.
+ * The fibers of a terminated carrier are released, i.e. only wakers,
+ * which find the fiber under a lock, which fiber_release() takes as
+ * well, are able to wake it up (see futex_cancel()).
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the fiber isn't blocked
+ */
+int fiber_wakeup(fiber_t* fiber);
+
+/** @brief Release the fibers of a carrier, which terminates
+ *
+ * The futex waits of the fibers are cancelled, before their stacks are
+ * released. The running fiber and the scheduler are kept, if the carrier
+ * still runs on the stack of the fiber. fiber_cleanup() releases them,
+ * after the carrier left the core.
+ */
+void fiber_release(task_t* task);
+
+/** @brief Release the remains of fiber_release(), has to be called after the carrier's last switch */
+void fiber_cleanup(task_t* task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
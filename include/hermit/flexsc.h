@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/flexsc.h
+ * @brief Exception-less system calls, which a dedicated core executes
+ *
+ * A thread registers an array of entries (its syscall page) and posts a
+ * request by writing the number and the arguments of a system call into a
+ * free entry and setting its status to FLEXSC_SUBMITTED. The syscall
+ * threads on the syscall core (see flexsc_start) collect the submitted
+ * entries of all pages in batches and execute them. Afterwards, the status
+ * is FLEXSC_DONE and ret contains the result. The caller polls the status
+ * or blocks in flexsc_wait().
+ *
+ * The file and socket code runs only on the syscall core, which keeps the
+ * caches of the compute cores hot. Only system calls, which don't depend on
+ * the calling task, are supported; others complete with -ENOSYS.
+ */
+
+#ifndef __FLEXSC_H__
+#define __FLEXSC_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// entry is unused
+#define FLEXSC_FREE		0
+/// entry contains a request, which isn't executed yet
+#define FLEXSC_SUBMITTED	1
+/// a syscall thread executes the request
+#define FLEXSC_BUSY		2
+/// request is finished, ret is valid
+#define FLEXSC_DONE		3
+
+/// maximum number of arguments of a request
+#define FLEXSC_ARGS		4
+
+typedef struct flexsc_entry {
+	/// FLEXSC_FREE, FLEXSC_SUBMITTED, FLEXSC_BUSY or FLEXSC_DONE
+	volatile uint32_t status;
+	/// number of the system call (__NR_*)
+	uint32_t nr;
+	uint64_t args[FLEXSC_ARGS];
+	/// result of the system call
+	volatile int64_t ret;
+	/// task, which waits in flexsc_wait() (used by the kernel)
+	tid_t waiter;
+	uint32_t pad[3];
+} __attribute__ ((aligned (64))) flexsc_entry_t;
+
+/** @brief Start the syscall threads on a core
+ *
+ * The core should be isolated (-isolcpus=), so that no other threads
+ * run on it.
+ *
+ * @return 0 on success, -EBUSY if they are already running on another core
+ */
+int flexsc_start(uint32_t core);
+
+/** @brief Register the syscall page of the calling thread
+ *
+ * All entries have to be FLEXSC_FREE.
+ *
+ * @return 0 on success, -EINVAL for invalid arguments, -ENOSPC if too
+ * many pages are registered, -ENXIO if the syscall threads aren't started
+ */
+int flexsc_register(flexsc_entry_t* entries, uint32_t count);
+
+/** @brief Remove a syscall page
+ *
+ * @return 0 on success, -ENOENT for an unknown page, -EBUSY if a request
+ * of the page is still submitted or executed
+ */
+int flexsc_unregister(flexsc_entry_t* entries);
+
+/** @brief Wake up a sleeping syscall thread after posting requests
+ *
+ * Costs only a memory read, while the syscall threads are polling.
+ */
+void flexsc_kick(void);
+
+/** @brief Block until a request is finished
+ *
+ * Frees the entry afterwards.
+ *
+ * @return result of the system call
+ */
+int64_t flexsc_wait(flexsc_entry_t* entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/futex.h
+ * @brief Fast user-space locking
+ *
+ * A futex is an aligned 32 bit integer in the address space of the
+ * application. User space changes it by atomic operations and enters
+ * the kernel only to wait for a change or to wake up waiting tasks.
+ */
+
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// operations of sys_futex() (compatible to Linux)
+#define FUTEX_WAIT		0
+#define FUTEX_WAKE		1
+#define FUTEX_REQUEUE		3
+#define FUTEX_CMP_REQUEUE	4
+#define FUTEX_WAKE_OP		5
+/// flag is accepted and ignored, because all futexes are private
+#define FUTEX_PRIVATE_FLAG	128
+#define FUTEX_CMD_MASK		(~FUTEX_PRIVATE_FLAG)
+
+/// operations of FUTEX_WAKE_OP on the second futex
+#define FUTEX_OP_SET		0	/* *addr2 = oparg */
+#define FUTEX_OP_ADD		1	/* *addr2 += oparg */
+#define FUTEX_OP_OR		2	/* *addr2 |= oparg */
+#define FUTEX_OP_ANDN		3	/* *addr2 &= ~oparg */
+#define FUTEX_OP_XOR		4	/* *addr2 ^= oparg */
+/// use (1 << oparg) as operand
+#define FUTEX_OP_OPARG_SHIFT	8
+
+/// comparisons of FUTEX_WAKE_OP with the old value of the second futex
+#define FUTEX_OP_CMP_EQ		0
+#define FUTEX_OP_CMP_NE		1
+#define FUTEX_OP_CMP_LT		2
+#define FUTEX_OP_CMP_LE		3
+#define FUTEX_OP_CMP_GT		4
+#define FUTEX_OP_CMP_GE		5
+
+/// encode the operation of FUTEX_WAKE_OP
+#define FUTEX_OP(op, oparg, cmp, cmparg) \
+	((((op) & 0xf) << 28) | (((cmp) & 0xf) << 24) | (((oparg) & 0xfff) << 12) | ((cmparg) & 0xfff))
+
+/** @brief Wait until the futex is woken up
+ *
+ * The task blocks only, if the futex still contains the expected value.
+ *
+ * @param addr Address of the futex
+ * @param val Expected value of the futex
+ * @param timeout Timeout in microseconds (0 = wait without timeout)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the address isn't valid
+ * - -EAGAIN (-11) if the futex doesn't contain the expected value
+ * - -ETIMEDOUT (-110) if the timeout expired
+ */
+int futex_wait(int32_t* addr, int32_t val, uint64_t timeout);
+
+/** @brief Wait until the futex is woken up (nanosecond resolution)
+ *
+ * Like futex_wait(), but timeouts within the next tick are realized by
+ * a one-shot timer (see set_timer_tsc()).
+ *
+ * @param addr Address of the futex
+ * @param val Expected value of the futex
+ * @param ns Timeout in nanoseconds (0 = wait without timeout)
+ * @return See futex_wait()
+ */
+int futex_wait_ns(int32_t* addr, int32_t val, uint64_t ns);
+
+/** @brief Wake up tasks, which wait for the futex
+ *
+ * @param addr Address of the futex
+ * @param nr Maximal number of tasks to wake up
+ * @return Number of woken tasks or -EINVAL (-22) if the address isn't valid
+ */
+int futex_wake(int32_t* addr, int32_t nr);
+
+/** @brief Wake up tasks and move the remaining waiters to another futex
+ *
+ * @param addr Address of the futex
+ * @param nr_wake Maximal number of tasks to wake up
+ * @param nr_requeue Maximal number of tasks to move to addr2
+ * @param addr2 Address of the target futex
+ * @param cmpval If not NULL, the operation fails unless the futex contains *cmpval
+ * @return Number of woken and moved tasks or
+ * - -EINVAL (-22) if an address isn't valid
+ * - -EAGAIN (-11) if the futex doesn't contain *cmpval
+ */
+int futex_requeue(int32_t* addr, int32_t nr_wake, int32_t nr_requeue, int32_t* addr2, const int32_t* cmpval);
+
+/** @brief Modify a second futex and wake up waiters of both futexes
+ *
+ * The old value of addr2 is atomically modified by op (see FUTEX_OP). Up
+ * to nr_wake waiters of addr and, if the comparison of op holds for the
+ * old value, up to nr_wake2 waiters of addr2 are woken up.
+ *
+ * @return Number of woken tasks or -EINVAL (-22) if an argument isn't valid
+ */
+int futex_wake_op(int32_t* addr, int32_t nr_wake, int32_t nr_wake2, int32_t* addr2, uint32_t op);
+
+struct futex_waiter;
+
+/** @brief Remove a waiter, whose stack is going to be released, from its futex
+ *
+ * Afterwards, no waker is able to find the waiter anymore and the wakers,
+ * which found it before, have finished.
+ */
+void futex_cancel(struct futex_waiter* waiter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
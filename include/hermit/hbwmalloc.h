@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/hbwmalloc.h
+ * @brief Allocation of high bandwidth memory
+ *
+ * The interface follows hbwmalloc of the memkind library. Consequently,
+ * errors are reported by positive error numbers.
+ */
+
+#ifndef __HBWMALLOC_H__
+#define __HBWMALLOC_H__
+
+#ifdef __KERNEL__
+#include <hermit/stddef.h>
+#else
+#include <stddef.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Placement of the allocations, if the high bandwidth memory is exhausted
+typedef enum {
+	/// fail, if no high bandwidth memory is left
+	HBW_POLICY_BIND = 1,
+	/// fall back to the main memory
+	HBW_POLICY_PREFERRED = 2,
+	/// behaves like HBW_POLICY_PREFERRED, HermitCore knows only one memory node
+	HBW_POLICY_INTERLEAVE = 3
+} hbw_policy_t;
+
+/** @brief Check if high bandwidth memory is available
+ *
+ * @return 0 if it is available, ENODEV otherwise
+ */
+int hbw_check_available(void);
+
+/** @brief Set the policy of the following allocations
+ *
+ * The policy can be changed only before the first allocation.
+ *
+ * @return
+ * - 0 on success
+ * - EINVAL for an unknown policy
+ * - EPERM after the first allocation
+ */
+int hbw_set_policy(hbw_policy_t mode);
+
+/** @brief Current policy of the allocations */
+hbw_policy_t hbw_get_policy(void);
+
+/** @brief Allocate size bytes of high bandwidth memory */
+void* hbw_malloc(size_t size);
+
+/** @brief Allocate zeroed high bandwidth memory for num elements of size bytes */
+void* hbw_calloc(size_t num, size_t size);
+
+/** @brief Resize a block of hbw_malloc()
+ *
+ * The content is kept up to the smaller of the old and new size.
+ */
+void* hbw_realloc(void* ptr, size_t size);
+
+/** @brief Allocate size bytes of high bandwidth memory at a multiple of alignment
+ *
+ * @param memptr Address of the pointer, which receives the block
+ * @param alignment Power of two and multiple of sizeof(void*)
+ * @param size Size of the block
+ * @return
+ * - 0 on success
+ * - EINVAL for an invalid alignment
+ * - ENOMEM if no memory is left
+ */
+int hbw_posix_memalign(void** memptr, size_t alignment, size_t size);
+
+/** @brief Release a block of hbw_malloc(), hbw_calloc(), hbw_realloc() or hbw_posix_memalign() */
+void hbw_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/histogram.h
+ * @brief Per-core log-linear histograms
+ *
+ * A histogram divides each power of two into HIST_SUB buckets of equal
+ * width (like HdrHistogram), so that the relative error of a bucket is at
+ * most 1/HIST_SUB. Values of 2^HIST_MAX_BITS and beyond are counted in the
+ * last bucket. Each core records into its own copy without locks or atomic
+ * instructions; hist_merge() sums the copies of all cores. The registered
+ * histograms are readable from user space by sys_hist_read().
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// log2 of the number of buckets of a power of two
+#define HIST_SUB_BITS		3
+#define HIST_SUB		(1U << HIST_SUB_BITS)
+/// values up to 2^HIST_MAX_BITS-1 have a bucket of their own
+#define HIST_MAX_BITS		40
+/// number of buckets of a histogram
+#define HIST_BUCKETS		((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+/// maximum length of the name, including the terminating zero
+#define HIST_NAME_LEN		32
+
+/// histogram of a core, is only written by the owning core
+typedef struct hist_core {
+	/// number of recorded values
+	uint64_t count;
+	/// sum of the recorded values
+	uint64_t sum;
+	/// smallest value, UINT64_MAX without values
+	uint64_t min;
+	/// largest value
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+} __attribute__ ((aligned (CACHE_LINE))) hist_core_t;
+
+/// merged histogram of all cores, the layout of sys_hist_read()
+typedef struct hist_data {
+	char name[HIST_NAME_LEN];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	/// see hist_bucket_low() for the range of a bucket
+	uint64_t buckets[HIST_BUCKETS];
+} hist_data_t;
+
+typedef struct hist {
+	const char* name;
+	/// one entry per possible core
+	hist_core_t* cores;
+	uint32_t ncores;
+	/// next registered histogram
+	struct hist* next;
+} hist_t;
+
+/// return the bucket of value
+static inline uint32_t hist_bucket(uint64_t value)
+{
+	uint32_t msb, shift;
+
+	if (value < HIST_SUB)
+		return (uint32_t) value;
+
+	msb = 63 - __builtin_clzll(value);
+	if (msb >= HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+
+	shift = msb - HIST_SUB_BITS;
+
+	return ((shift + 1) << HIST_SUB_BITS) + ((value >> shift) & (HIST_SUB - 1));
+}
+
+/// return the smallest value of a bucket
+static inline uint64_t hist_bucket_low(uint32_t bucket)
+{
+	uint32_t shift;
+
+	if (bucket < HIST_SUB)
+		return bucket;
+
+	shift = (bucket >> HIST_SUB_BITS) - 1;
+
+	return (uint64_t) (HIST_SUB | (bucket & (HIST_SUB - 1))) << shift;
+}
+
+/// return the largest value of a bucket
+static inline uint64_t hist_bucket_high(uint32_t bucket)
+{
+	if (bucket < HIST_SUB)
+		return bucket;
+	if (bucket >= HIST_BUCKETS - 1)
+		return (uint64_t) -1;
+
+	return hist_bucket_low(bucket + 1) - 1;
+}
+
+/** @brief Allocate the cores' copies and register the histogram
+ *
+ * @param name Name in sys_hist_read(), has to remain valid
+ * @return 0 on success or -ENOMEM
+ */
+int hist_init(hist_t* hist, const char* name);
+
+/// record value on the current core, may be called in interrupt handlers
+void hist_record(hist_t* hist, uint64_t value);
+
+/// sum the copies of all cores into data
+void hist_merge(const hist_t* hist, hist_data_t* data);
+
+/// add the values of src to dst
+void hist_add(hist_data_t* dst, const hist_data_t* src);
+
+/** @brief Return the percentile of a merged histogram
+ *
+ * @param ppm Percentile in parts per million, e.g. 990000 for p99
+ * @return Upper end of the bucket, which contains the percentile (at most
+ *         the largest value), or 0 for an empty histogram
+ */
+uint64_t hist_percentile(const hist_data_t* data, uint32_t ppm);
+
+/// clear the copies of all cores
+void hist_reset(hist_t* hist);
+
+/// print count, average and percentiles of a merged histogram
+void hist_print(const hist_data_t* data, const char* unit);
+
+/** @brief Copy a registered histogram
+ *
+ * @param index Position in the order of registration
+ * @return 0 on success, -ENOENT beyond the last histogram
+ */
+int hist_read(uint32_t index, hist_data_t* data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
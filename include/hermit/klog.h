@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/klog.h
+ * @brief Per-core binary ring of kernel log messages
+ *
+ * With KLOG_RING_SIZE > 0, LOG_INFO, LOG_DEBUG and LOG_VERBOSE don't
+ * format their messages. klog() stores the time stamp, the task, the
+ * pointer to the format string and the raw arguments in the ring of the
+ * current core. Strings are copied into the record, because they could
+ * be gone, when the message is formatted. The producer only disables
+ * the interrupts of its core, no lock is shared with other cores. If a
+ * ring is full, the message is dropped and counted.
+ *
+ * A task with low priority formats the records in the order of their
+ * time stamps and writes them to the console. Errors and warnings are
+ * still written synchronously. The rings are announced to uhyve
+ * (UHYVE_PORT_KLOG), so that the host or gdb (klog_rings) can dump
+ * messages, which haven't been formatted before a crash.
+ */
+
+#ifndef __KLOG_H__
+#define __KLOG_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KLOG_VERSION		1
+
+/// maximal number of arguments per message, further ones are printed as 0
+#define KLOG_MAX_ARGS		12
+/// maximal number of bytes, which are copied of a string argument
+#define KLOG_MAX_STR		64
+/// maximal size of a record
+#define KLOG_MAX_REC		512
+
+/// interval, in which the ring is drained
+#define KLOG_DRAIN_MS		20
+
+/// flag of klog(): the message continues the previous line (LOG_SAME_LINE)
+#define KLOG_CONT		(1 << 0)
+
+/** @brief Record in a ring
+ *
+ * The arguments follow the header, a string argument contains the
+ * offset of its copy behind the arguments. A record without format
+ * string pads the ring up to its end.
+ */
+typedef struct {
+	const char* fmt;
+	uint64_t tsc;
+	uint32_t task;
+	uint16_t core;
+	/// size of the record in bytes (multiple of 8)
+	uint16_t len;
+	uint8_t level;
+	uint8_t flags;
+	uint8_t reserved[6];
+	uint64_t args[];
+} __attribute__ ((packed)) klog_rec_t;
+
+typedef struct {
+	/// written by the producer, bytes since the start
+	volatile uint64_t head;
+	/// number of dropped messages
+	volatile uint64_t dropped;
+	uint8_t pad0[CACHE_LINE-2*sizeof(uint64_t)];
+	/// written by the consumer
+	volatile uint64_t tail;
+	uint8_t pad1[CACHE_LINE-sizeof(uint64_t)];
+	uint8_t data[KLOG_RING_SIZE ? KLOG_RING_SIZE : 1];
+} __attribute__ ((packed)) klog_ring_t;
+
+// UHYVE_PORT_KLOG, addresses are virtual like the buffers of the file hypercalls
+typedef struct {
+	uint32_t version;
+	uint32_t ncores;
+	uint64_t ring_size;
+	/// array of ncores pointers to klog_ring_t (NULL without ring)
+	uint64_t rings;
+} __attribute__ ((packed)) uhyve_klog_t;
+
+/** @brief Allocate the rings of all cores and start the task, which drains them
+ *
+ * Messages of cores without ring are written synchronously.
+ *
+ * @return 0 on success, -ENOMEM on failure
+ */
+int klog_init(void);
+
+/// store a message in the ring of the current core
+void klog(int level, int flags, const char* fmt, ...);
+
+/// format and write all stored messages
+void klog_drain(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/ktrace.h
+ * @brief Function trace of the kernel
+ *
+ * The modules in KERNEL_TRACE_MODULES are compiled with
+ * -finstrument-functions. Each call reserves an entry in the ring of the
+ * current core at its entry and stores the time stamp counter at its exit.
+ * The call depth is tracked per task, because tasks migrate between the
+ * cores and interrupt handlers nest on the stack of the interrupted task.
+ * The entries have the layout of XRay's trace buffer, so that
+ * XRayLoadKernelTrace() in usr/xray merges them into a user-space capture.
+ */
+
+#ifndef __KTRACE_H__
+#define __KTRACE_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximum call depth per task, deeper calls are not recorded
+#define KTRACE_DEPTH		32
+
+/// pack the call depth (bits 0-7) and the address bits 4-27 (bits 8-31) like XRay
+#define KTRACE_PACK_DEPTH_ADDR(d, a)	(((d) & 0xFF) | (((a) << 4) & 0xFFFFFF00))
+
+/// entry of the function trace, has the layout of XRay's trace buffer entry
+typedef struct ktrace_entry {
+	/// call depth and address of the function
+	uint32_t depth_addr;
+	/// always zero, index of an XRay annotation
+	uint32_t annotation_index;
+	/// time stamp counter at the entry of the function
+	uint64_t start_tick;
+	/// time stamp counter at the exit, zero as long as the call is open
+	uint64_t end_tick;
+} ktrace_entry_t;
+
+/// open call of a task
+typedef struct ktrace_frame {
+	/// called function
+	void* fn;
+	/// reserved entry of the trace, NULL if tracing was disabled
+	ktrace_entry_t* entry;
+	/// start_tick of the entry, detects that the ring has overwritten it
+	uint64_t start;
+} ktrace_frame_t;
+
+/// call stack of a task
+typedef struct ktrace_stack {
+	/// number of open calls, including the ones above KTRACE_DEPTH
+	uint32_t depth;
+	/// open calls
+	ktrace_frame_t frames[KTRACE_DEPTH];
+} ktrace_stack_t;
+
+#ifdef KERNEL_TRACE
+/// allocate the rings of all cores and start tracing, after all cores are online
+int ktrace_init(void);
+
+/** @brief Start or stop the recording
+ *
+ * Calls, which are open while the recording stops, are completed.
+ *
+ * @return Previous state
+ */
+int ktrace_enable(int enable);
+
+/** @brief Copy the trace of a core
+ *
+ * @param core Core, whose ring is copied
+ * @param buf Array of at most n entries, which receives the newest entries
+ *            (oldest first)
+ * @return Number of copied entries or a negative error code
+ */
+int ktrace_read(uint32_t core, ktrace_entry_t* buf, size_t n);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
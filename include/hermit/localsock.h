@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/localsock.h
+ * @brief Stream sockets between tasks of the same unikernel
+ *
+ * Local sockets replace TCP connections over localhost. They are named by
+ * a port number, but bypass LwIP and the loopback interface completely:
+ * a write copies the data directly into the buffer of a waiting reader
+ * or, if no reader waits, into the receive buffer of the peer. The peer
+ * is woken by wakeup_task(), no checksums or packet headers are involved.
+ */
+
+#ifndef __LOCALSOCK_H__
+#define __LOCALSOCK_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of local sockets
+#define MAX_LOCALSOCK		64
+
+/// maximal number of connections, which wait for localsock_accept()
+#define LOCALSOCK_BACKLOG	16
+
+/// file descriptors of local sockets are marked by this bit
+#define LOCALSOCK_FD_BIT	(1 << 28)
+
+/** @brief Create an unconnected local socket
+ *
+ * @return
+ * - file descriptor of the socket (LOCALSOCK_FD_BIT is set)
+ * - -ENFILE if all MAX_LOCALSOCK sockets are in use
+ */
+int localsock_socket(void);
+
+/** @brief Bind a socket to a port and accept connections
+ *
+ * @param fd Unconnected local socket
+ * @param port Port number, which is used by localsock_connect()
+ * @return
+ * - 0 on success
+ * - -EBADF if fd isn't valid
+ * - -EINVAL if the socket is already bound or connected
+ * - -EADDRINUSE if another socket listens on the port
+ */
+int localsock_listen(int fd, uint16_t port);
+
+/** @brief Wait for a connection of a listening socket
+ *
+ * @return
+ * - file descriptor of the connected socket
+ * - -EBADF if fd isn't valid or is closed while the task waits
+ * - -EINVAL if fd doesn't listen
+ * - -ENFILE if all MAX_LOCALSOCK sockets are in use
+ */
+int localsock_accept(int fd);
+
+/** @brief Connect a socket to the listening socket of a port
+ *
+ * The connection is established immediately, data can be written
+ * before the listener accepts it.
+ *
+ * @return
+ * - 0 on success
+ * - -EBADF if fd isn't valid
+ * - -EISCONN if the socket is already bound or connected
+ * - -ECONNREFUSED if no socket listens on the port or its backlog is full
+ * - -ENOMEM if the buffers could not be allocated
+ */
+int localsock_connect(int fd, uint16_t port);
+
+/** @brief Create a pair of connected sockets
+ *
+ * @param sv Receives both file descriptors
+ * @return 0 on success, -EINVAL, -ENFILE or -ENOMEM on failure
+ */
+int localsock_socketpair(int sv[2]);
+
+/** @brief Receive data, blocks until at least one byte is available
+ *
+ * @return
+ * - number of received bytes
+ * - 0 if the peer has closed the connection
+ * - -EBADF if fd isn't valid
+ * - -ENOTCONN if the socket isn't connected
+ */
+ssize_t localsock_read(int fd, void* buf, size_t len);
+
+/** @brief Send data, blocks until all data is passed to the peer
+ *
+ * @return
+ * - number of sent bytes
+ * - -EBADF if fd isn't valid
+ * - -ENOTCONN if the socket isn't connected
+ * - -EPIPE if the peer has closed the connection
+ */
+ssize_t localsock_write(int fd, const void* buf, size_t len);
+
+/** @brief Close a local socket
+ *
+ * The peer reads the remaining data and gets an end of file afterwards.
+ * Connections, which aren't accepted by a closed listener, are reset.
+ */
+int localsock_close(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -69,6 +69,24 @@ enum {
 // don't add any formatting
 #define __LOG_FORMAT_PASS(level, fmt, ...) fmt, ##__VA_ARGS__
 
+#if KLOG_RING_SIZE > 0
+#include <hermit/klog.h>
+
+// flags of the messages in the ring, which replace the formatters
+#define __LOG_FORMAT_VERBOSE_RING	0
+#define __LOG_FORMAT_PASS_RING		KLOG_CONT
+
+// Errors and warnings are written synchronously, the other messages are
+// stored in the per-core ring and formatted later (see klog.h)
+#define __LOG(level, formatter, ...) do {	\
+	if(LOG_LEVEL >= level) {	\
+	    if (level >= LOG_LEVEL_INFO)	\
+	        klog(level, CONC(formatter, RING), __VA_ARGS__);	\
+	    else	\
+	        __LOG_FUNCTION(formatter(level, __VA_ARGS__));	\
+	}	\
+} while(0)
+#else
 // The compiler will optimize the if clause away since the condition can be
 // evaluated at compile-time
 #define __LOG(level, formatter, ...) do {	\
@@ -76,6 +94,7 @@ enum {
 	    __LOG_FUNCTION(formatter(level, __VA_ARGS__));	\
 	}	\
 } while(0)
+#endif
 
 #define LOG_ERROR(...)		__LOG(LOG_LEVEL_ERROR, __LOG_FORMAT_VERBOSE, __VA_ARGS__)
 #define LOG_WARNING(...)	__LOG(LOG_LEVEL_WARNING, __LOG_FORMAT_VERBOSE, __VA_ARGS__)
@@ -126,6 +126,183 @@ extern "C" {
 		return 0; \
 	}\
 
+/** @brief Wake a waiter of a lock-free mailbox, if there is one
+ *
+ * The fence orders the preceding update of the slot before the check of
+ * the waiters, a waiter registers itself before it checks the slots again.
+ */
+inline static void mailbox_lockfree_notify(sem_t* s, uint32_t* waiters)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiters, __ATOMIC_RELAXED))
+		sem_post(s);
+}
+
+/** @brief Block on a semaphore of a lock-free mailbox
+ *
+ * @param deadline TSC deadline (0 = wait without timeout)
+ */
+inline static int mailbox_lockfree_wait(sem_t* s, uint64_t deadline)
+{
+	uint64_t now, ticks, hz;
+
+	if (!deadline)
+		return sem_wait(s, 0);
+
+	now = get_rdtsc();
+	if (now >= deadline)
+		return -ETIME;
+
+	ticks = deadline - now;
+	hz = clocksource_tsc_hz();
+
+	return sem_timedwait_ns(s, (ticks / hz) * 1000000000ULL + ((ticks % hz) * 1000000000ULL) / hz);
+}
+
+#define MAILBOX_LOCKFREE(name, type) 	\
+	inline static int mailbox_##name##_init(mailbox_##name##_t* m) { \
+		uint32_t i; \
+	\
+		if (BUILTIN_EXPECT(!m, 0)) \
+			return -EINVAL; \
+	\
+		memset(m->slots, 0x00, sizeof(m->slots)); \
+		for(i=0; i<MAILBOX_SIZE; i++) \
+			m->slots[i].seq = i; \
+		m->wpos = m->rpos = 0; \
+		m->writers = m->readers = 0; \
+		sem_init(&m->mails, 0); \
+		sem_init(&m->boxes, 0); \
+	\
+		return 0; \
+	}\
+	\
+	inline static int mailbox_##name##_destroy(mailbox_##name##_t* m) { \
+		if (BUILTIN_EXPECT(!m, 0)) \
+			return -EINVAL; \
+	\
+		sem_destroy(&m->mails); \
+		sem_destroy(&m->boxes); \
+	\
+		return 0; \
+	} \
+	\
+	/* claims the slot at wpos, fails with -EBUSY on a full mailbox */ \
+	inline static int mailbox_##name##_push(mailbox_##name##_t* m, type mail) { \
+		uint32_t pos = __atomic_load_n(&m->wpos, __ATOMIC_RELAXED); \
+		int32_t diff; \
+	\
+		for(;;) { \
+			diff = (int32_t) (__atomic_load_n(&m->slots[pos % MAILBOX_SIZE].seq, __ATOMIC_ACQUIRE) - pos); \
+			if (diff == 0) { \
+				if (__atomic_compare_exchange_n(&m->wpos, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) \
+					break; \
+			} else if (diff < 0) { \
+				return -EBUSY; \
+			} else { \
+				pos = __atomic_load_n(&m->wpos, __ATOMIC_RELAXED); \
+			} \
+		} \
+	\
+		m->slots[pos % MAILBOX_SIZE].mail = mail; \
+		__atomic_store_n(&m->slots[pos % MAILBOX_SIZE].seq, pos+1, __ATOMIC_RELEASE); \
+	\
+		return 0; \
+	} \
+	\
+	/* takes the mail at rpos, fails with -EBUSY on an empty mailbox */ \
+	inline static int mailbox_##name##_pop(mailbox_##name##_t* m, type* mail) { \
+		uint32_t pos = __atomic_load_n(&m->rpos, __ATOMIC_RELAXED); \
+		int32_t diff; \
+	\
+		for(;;) { \
+			diff = (int32_t) (__atomic_load_n(&m->slots[pos % MAILBOX_SIZE].seq, __ATOMIC_ACQUIRE) - (pos+1)); \
+			if (diff == 0) { \
+				if (__atomic_compare_exchange_n(&m->rpos, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) \
+					break; \
+			} else if (diff < 0) { \
+				return -EBUSY; \
+			} else { \
+				pos = __atomic_load_n(&m->rpos, __ATOMIC_RELAXED); \
+			} \
+		} \
+	\
+		*mail = m->slots[pos % MAILBOX_SIZE].mail; \
+		__atomic_store_n(&m->slots[pos % MAILBOX_SIZE].seq, pos+MAILBOX_SIZE, __ATOMIC_RELEASE); \
+	\
+		return 0; \
+	} \
+	\
+	inline static int mailbox_##name##_post(mailbox_##name##_t* m, type mail) { \
+		if (BUILTIN_EXPECT(!m, 0)) \
+			return -EINVAL; \
+	\
+		while (mailbox_##name##_push(m, mail)) { \
+			__atomic_fetch_add(&m->writers, 1, __ATOMIC_SEQ_CST); \
+			/* a fetch before the registration didn't see us */ \
+			if (!mailbox_##name##_push(m, mail)) { \
+				__atomic_fetch_sub(&m->writers, 1, __ATOMIC_RELAXED); \
+				break; \
+			} \
+			sem_wait(&m->boxes, 0); \
+			__atomic_fetch_sub(&m->writers, 1, __ATOMIC_RELAXED); \
+		} \
+		mailbox_lockfree_notify(&m->mails, &m->readers); \
+	\
+		return 0; \
+	} \
+	\
+	inline static int mailbox_##name##_trypost(mailbox_##name##_t* m, type mail) { \
+		if (BUILTIN_EXPECT(!m, 0)) \
+			return -EINVAL; \
+	\
+		if (mailbox_##name##_push(m, mail)) \
+			return -EBUSY; \
+		mailbox_lockfree_notify(&m->mails, &m->readers); \
+	\
+		return 0; \
+	} \
+	\
+	inline static int mailbox_##name##_fetch(mailbox_##name##_t* m, type* mail, uint32_t ms) { \
+		uint64_t deadline = 0; \
+		int err; \
+	\
+		if (BUILTIN_EXPECT(!m || !mail, 0)) \
+			return -EINVAL; \
+	\
+		while (mailbox_##name##_pop(m, mail)) { \
+			if (ms && !deadline) \
+				deadline = get_rdtsc() + ns_to_tsc((uint64_t) ms * 1000000ULL); \
+			__atomic_fetch_add(&m->readers, 1, __ATOMIC_SEQ_CST); \
+			/* a post before the registration didn't see us */ \
+			if (!mailbox_##name##_pop(m, mail)) { \
+				__atomic_fetch_sub(&m->readers, 1, __ATOMIC_RELAXED); \
+				break; \
+			} \
+			err = mailbox_lockfree_wait(&m->mails, deadline); \
+			__atomic_fetch_sub(&m->readers, 1, __ATOMIC_RELAXED); \
+			if (err) { \
+				if (!mailbox_##name##_pop(m, mail)) \
+					break; \
+				return err; \
+			} \
+		} \
+		mailbox_lockfree_notify(&m->boxes, &m->writers); \
+	\
+		return 0; \
+	} \
+	\
+	inline static int mailbox_##name##_tryfetch(mailbox_##name##_t* m, type* mail) { \
+		if (BUILTIN_EXPECT(!m || !mail, 0)) \
+			return -EINVAL; \
+	\
+		if (mailbox_##name##_pop(m, mail)) \
+			return -EINVAL; \
+		mailbox_lockfree_notify(&m->boxes, &m->writers); \
+	\
+		return 0; \
+	}\
+
 MAILBOX(wait_msg, wait_msg_t)
 MAILBOX(int32, int32_t)
 MAILBOX(int16, int16_t)
@@ -133,7 +310,7 @@ MAILBOX(int8, int8_t)
 MAILBOX(uint32, uint32_t)
 MAILBOX(uint16, uint16_t)
 MAILBOX(uint8, uint8_t)
-MAILBOX(ptr, void*)
+MAILBOX_LOCKFREE(ptr, void*)
 
 #ifdef __cplusplus
 }
@@ -59,6 +59,29 @@ typedef struct {
 		spinlock_t rlock, wlock; \
 	} mailbox_##name##_t;
 
+/** @brief Lock-free bounded mailbox
+ *
+ * A ring of slots, each slot carries a sequence number (Vyukov's MPMC
+ * queue): a slot is free for the writer at position pos, if its sequence
+ * is pos, and contains a mail for the reader at pos, if it is pos+1.
+ * The semaphores are only used to block on an empty or full mailbox, the
+ * counters of the waiting readers and writers tell whether a post has
+ * to wake somebody. Producers and consumers touch different cache lines.
+ */
+#define MAILBOX_LOCKFREE_TYPES(name, type) 	\
+	typedef struct mailbox_##name { \
+		uint32_t wpos; \
+		uint32_t writers; \
+		sem_t boxes; \
+		struct { \
+			uint32_t seq; \
+			type mail; \
+		} slots[MAILBOX_SIZE]; \
+		uint32_t rpos; \
+		uint32_t readers; \
+		sem_t mails; \
+	} mailbox_##name##_t;
+
 MAILBOX_TYPES(wait_msg, wait_msg_t)
 MAILBOX_TYPES(int32, int32_t)
 MAILBOX_TYPES(int16, int16_t)
@@ -66,7 +89,8 @@ MAILBOX_TYPES(int8, int8_t)
 MAILBOX_TYPES(uint32, uint32_t)
 MAILBOX_TYPES(uint16, uint16_t)
 MAILBOX_TYPES(uint8, uint8_t)
-MAILBOX_TYPES(ptr, void*)
+/// sys_mbox_t of LwIP, every packet passes the mailbox of the tcpip thread
+MAILBOX_LOCKFREE_TYPES(ptr, void*)
 
 #ifdef __cplusplus
 }
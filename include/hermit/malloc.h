@@ -48,35 +48,72 @@ extern "C" {
 
 #define BUDDY_LISTS	(BUDDY_MAX-BUDDY_MIN+1)
 #define BUDDY_MAGIC	0xBABE
+/// magic number of buddies, which hbw_malloc() allocates
+#define HBW_MAGIC	0xB0BE
+/// magic number of the prefix in front of a block of hbw_posix_memalign()
+#define HBW_ALIGN_MAGIC	0xA11C
 
 union buddy;
 
 /** @brief Buddy
  *
  * Every free memory block is stored in a linked list according to its size.
- *  We can use this free memory to store this buddy_t union which represents
- *  this block (the buddy_t union is alligned to the front).
- *  Therefore the address of the buddy_t union is equal with the address
- *  of the underlying free memory block.
+ *  We can use this free memory to store the list pointers behind the
+ *  buddy_t union, which represents this block (the buddy_t union is
+ *  alligned to the front). Therefore the address of the buddy_t union
+ *  is equal with the address of the underlying free memory block.
  *
  * Every allocated memory block is prefixed with its binary size exponent and
  *  a known magic number. This prefix is hidden by the user because its located
  *  before the actual memory address returned by kmalloc()
+ *
+ * The offset locates the block in the arena, from which it was split.
+ *  Free neighbours are merged by kfree().
  */
 typedef union buddy {
-	/// Pointer to the next buddy in the linked list.
-	union buddy* next;
+	/// The whole prefix
+	uint64_t value;
 	struct {
 		/// The binary exponent of the block size
 		uint8_t exponent;
 		/// Must be equal to BUDDY_MAGIC for a valid memory block
 		uint16_t magic;
+		/// Offset in the arena in multiples of the minimal buddy size
+		uint32_t offset;
 	} prefix;
 } buddy_t;
 
-/** @brief Dump free buddies */
+/// state of the buddy allocator of kmalloc(), see buddy_info()
+typedef struct buddy_info {
+	/// free_blocks[i] counts the free blocks of 2^(i+BUDDY_MIN) bytes
+	uint64_t free_blocks[BUDDY_LISTS];
+	/// free bytes in the lists
+	uint64_t free_bytes;
+	/// free bytes in the per core caches
+	uint64_t cached_bytes;
+	/// size of the largest free block
+	uint64_t largest_free;
+	/// number of arenas
+	uint64_t nr_arenas;
+	/// size of all arenas
+	uint64_t arena_bytes;
+	/// number of merged buddies
+	uint64_t nr_merges;
+	/// number of arenas, which were returned to the page allocator
+	uint64_t nr_released;
+	/// size of the returned arenas
+	uint64_t released_bytes;
+} buddy_info_t;
+
+/** @brief Dump free buddies and the statistics of the arenas */
 void buddy_dump(void);
 
+/** @brief Get the free lists and the statistics of the arenas
+ *
+ * The fragmentation of the free memory is 1 - largest_free / free_bytes.
+ */
+int buddy_info(buddy_info_t* info);
+
 #ifdef __cplusplus
 }
 #endif
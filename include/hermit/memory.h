@@ -41,6 +41,20 @@ typedef struct free_list free_list_t;
 /** @brief Initialize the memory subsystem */
 int memory_init(void);
 
+/** @brief Add physical memory at runtime
+ *
+ * The range [start, start+size) is released to the page allocator and
+ * total_pages and total_available_pages grow accordingly. uhyve grants
+ * memory this way to a running instance (UHYVE_PORT_MEMHOTADD).
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL if the range isn't page aligned or overlaps the I/O gap or the
+ *   high bandwidth memory
+ * - -EEXIST if the range starts below the end of the known memory
+ */
+int memory_hotadd(size_t start, size_t size);
+
 /** @brief Request physical page frames */
 size_t get_pages(size_t npages);
 
@@ -56,12 +70,25 @@ static inline size_t get_page(void) { return get_pages(1); }
 /** @brief Get a single huge page */
 size_t get_huge_page(void);
 
+/** @brief Get a single 1 GiB page (x86_64 only) */
+size_t get_1g_page(void);
+
 /** @brief Get a single zeroed page */
 size_t get_zeroed_page(void);
 
 /** @brief Get a single zeroed huge page */
 size_t get_zeroed_huge_page(void);
 
+/** @brief Zero a huge page in advance for get_zeroed_huge_page()
+ *
+ * Called by idle cores.
+ *
+ * @return
+ * - 1 if a page was added to the pool of zeroed huge pages
+ * - 0 if the pool is full, isn't used yet or no memory is available
+ */
+int fill_zeroed_pool(void);
+
 /** @brief release physical page frames */
 int put_pages(size_t phyaddr, size_t npages);
 
@@ -80,6 +107,12 @@ size_t hbmem_get_pages(size_t npages);
  */
 static inline size_t hbmem_get_page(void) { return hbmem_get_pages(1); }
 
+/** @brief Request physical hbmem page frames, which start at a multiple of align */
+size_t hbmem_get_aligned_pages(size_t npages, size_t align);
+
+/** @brief Get a naturally aligned huge page of high bandwidth memory */
+size_t hbmem_get_huge_page(void);
+
 /** @brief release physical page frames */
 int hbmem_put_pages(size_t phyaddr, size_t npages);
 
@@ -92,7 +125,145 @@ static inline int hbmem_put_page(size_t phyaddr) { return hbmem_put_pages(phyadd
 /** @brief check if high memory bandwidth is available */
 int is_hbmem_available(void);
 
+/** @brief check if a physical address belongs to the high bandwidth memory */
+int is_hbmem_addr(size_t phyaddr);
+
+/** @brief Free high bandwidth memory in bytes */
+size_t hbmem_available(void);
+
 /** @brief Initialize the high bandwidth memory subsystem */
 int hbmemory_init(void);
 
+/** @brief Add high bandwidth memory at runtime
+ *
+ * The pool of high bandwidth memory covers a single range, which starts
+ * with the first call, if the boot info hasn't reported one. Afterwards,
+ * it grows only at its end.
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL if the range isn't page aligned or doesn't extend the pool
+ * - -EEXIST if the range is already part of the pool
+ * - -ENOMEM if no free list entry could be allocated
+ */
+int hbmem_hotadd(size_t start, size_t size);
+
+/// number of buckets of the page fault latency histogram
+#define PF_HIST_BUCKETS	16
+/// bucket 0 counts page faults, which took less than 2^(PF_HIST_SHIFT+1) cycles
+#define PF_HIST_SHIFT	8
+
+/// kinds of resolved page faults
+#define PF_KIND_SMALL		0
+#define PF_KIND_HUGE		1
+#define PF_KIND_1G		2
+#define PF_KIND_SPURIOUS	3
+
+/** @brief Statistics of the page fault handler
+ *
+ * Bucket i of the histogram counts faults, which took
+ * [2^(i+PF_HIST_SHIFT), 2^(i+PF_HIST_SHIFT+1)) TSC cycles. The first and
+ * the last bucket are open.
+ */
+typedef struct {
+	uint64_t nr_faults;
+	uint64_t nr_small;
+	uint64_t nr_huge;
+	uint64_t nr_1g;
+	uint64_t nr_zeroed;
+	uint64_t nr_spurious;
+	uint64_t total_cycles;
+	uint64_t max_cycles;
+	uint64_t hist[PF_HIST_BUCKETS];
+} pf_stats_t;
+
+/// entry of the page fault trace (configured by PAGE_FAULT_TRACE)
+typedef struct {
+	uint64_t tsc;
+	uint64_t addr;
+	uint32_t cycles;
+	uint16_t core;
+	uint8_t kind;
+	uint8_t error;
+} pf_trace_t;
+
+/** @brief Get the page fault statistics of a core
+ *
+ * @param core The core or -1 for the sum of all cores
+ * @return 0 on success, -EINVAL if the core is invalid
+ */
+int page_fault_stats(int core, pf_stats_t* stats);
+
+/** @brief Copy the page fault traces of all cores into buf
+ *
+ * The entries of each core are ordered from the oldest to the newest.
+ *
+ * @return The number of copied entries, or -ENOSYS if tracing is disabled
+ */
+int page_fault_trace(pf_trace_t* buf, size_t n);
+
+/** @brief Account a resolved page fault
+ *
+ * Called by the page fault handler of the architecture, which started to
+ * serve the fault at the time stamp tsc.
+ *
+ * @param kind Kind of the fault (PF_KIND_*)
+ * @param error Error code of the architecture, which is traced
+ * @param zeroed The handler mapped zeroed pages
+ */
+void pf_account(size_t viraddr, uint64_t tsc, uint32_t kind, uint32_t error, int zeroed);
+
+/** @brief Get the statistics of all cores and their traces (NULL without tracing)
+ *
+ * The arrays have MAX_CORES entries and PAGE_FAULT_TRACE entries per core.
+ */
+void page_fault_buffers(const pf_stats_t** stats, const pf_trace_t** trace);
+
+/// tags of the memory accounting
+#define MEM_TAG_HEAP		0
+#define MEM_TAG_STACK		1
+#define MEM_TAG_PGTABLE		2
+#define MEM_TAG_ANON		3
+#define MEM_TAG_KMALLOC		4
+#define MEM_TAG_NET		5
+#define MEM_TAG_DRIVER		6
+#define MEM_TAG_TMPFS		7
+#define MEM_NR_TAGS		8
+
+/// usage of a tag, byte counts are only maintained for kmalloc()
+typedef struct {
+	int64_t pages;
+	int64_t max_pages;
+	int64_t bytes;
+	int64_t max_bytes;
+} mem_stat_t;
+
+/** @brief Memory usage of the whole system
+ *
+ * Allocated pages, which aren't attributed to a tag, belong to the
+ * kernel image and to other kernel allocations.
+ */
+typedef struct {
+	mem_stat_t tags[MEM_NR_TAGS];
+	uint64_t total_pages;
+	uint64_t allocated_pages;
+	uint64_t available_pages;
+} mem_stats_t;
+
+/** @brief Attribute pages and bytes to a tag
+ *
+ * Pages of the heap, of stacks and of anonymous memory are additionally
+ * attributed to the current task. Negative values release memory.
+ */
+void mem_account(uint32_t tag, int64_t pages, int64_t bytes);
+
+/** @brief Get the usage of all tags */
+int mem_get_stats(mem_stats_t* stats);
+
+/** @brief Get the name of a tag (NULL for an invalid tag) */
+const char* mem_tag_name(uint32_t tag);
+
+/** @brief Print the usage of all tags */
+void mem_print_stats(void);
+
 #endif
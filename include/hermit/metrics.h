@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/metrics.h
+ * @brief HTTP endpoint, which exports the kernel statistics
+ *
+ * If METRICS_PORT isn't 0, the kernel listens on this TCP port with
+ * LwIP's raw API. The tcpip thread answers each GET request with a
+ * snapshot of the statistics and closes the connection:
+ * - /metrics (or any other path) in the Prometheus text format
+ * - /metrics.json (or ?format=json) as JSON array of samples
+ *
+ * The snapshot covers the scheduler and the steal time of each core, the
+ * memory usage, the page faults, the network interfaces (NETSTATS) and
+ * the system and hyper calls (SYSSTAT). The counters are read without
+ * stopping the cores, so the values of different cores aren't taken at
+ * exactly the same time.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Start to listen on the TCP port
+ *
+ * Has to be called after the initialization of the TCP/IP stack.
+ *
+ * @return
+ * - 0 on success
+ * - -ENOMEM if the request couldn't be passed to the tcpip thread
+ */
+int metrics_init(uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/netparams.h
+ * @brief Boot-time parameters of the TCP/IP stack
+ *
+ * The sizes of LwIP's buffers and windows are read from the kernel command
+ * line before the stack is initialized:
+ * - -tcp_wnd=<bytes>[K|M] receive window
+ * - -tcp_snd_buf=<bytes>[K|M] send buffer of a connection
+ * - -tcp_wnd_scale=<shift> window scale option (chosen automatically for windows above 64 KiB)
+ * - -pbuf_pool_size=<n> number of pbufs in the RX pool
+ * - -lwip_mem_size=<bytes>[K|M] size of LwIP's heap
+ *
+ * Without an option, the value LwIP is compiled with is used. The memory of
+ * an enlarged pool or heap is allocated with palloc() and is passed to the
+ * LwIP port, which uses the values of netparams instead of the constants
+ * of lwipopts.h.
+ */
+
+#ifndef __NETPARAMS_H__
+#define __NETPARAMS_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal shift of the TCP window scale option (RFC 7323)
+#define NETPARAMS_MAX_WND_SCALE	14
+
+typedef struct netparams {
+	/// receive window of a TCP connection in bytes
+	uint32_t tcp_wnd;
+	/// send buffer of a TCP connection in bytes
+	uint32_t tcp_snd_buf;
+	/// shift of the window scale option (0 = disabled)
+	uint8_t tcp_wnd_scale;
+	/// number of pbufs in the RX pool
+	uint32_t pbuf_pool_size;
+	/// size of LwIP's heap in bytes
+	size_t mem_size;
+	/// memory of the pbuf pool (NULL = static pool of LwIP)
+	void* pbuf_pool;
+	/// memory of the heap (NULL = static heap of LwIP)
+	void* ram_heap;
+} netparams_t;
+
+/// parameters of the TCP/IP stack, valid after netparams_init()
+extern netparams_t netparams;
+
+/** @brief Read the parameters from the kernel command line
+ *
+ * Has to be called before tcpip_init().
+ *
+ * @return 0 on success, -ENOMEM if the pool or heap could not be allocated
+ */
+int netparams_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
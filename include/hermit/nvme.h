@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/nvme.h
+ * @brief Definitions of the NVM Express interface (revision 1.3)
+ *
+ * Only the registers, commands and data structures, which the driver
+ * uses, are described. All values are little endian.
+ */
+
+#ifndef __NVME_H__
+#define __NVME_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// class code, subclass and programming interface of an NVMe controller
+#define NVME_PCI_CLASS		0x010802
+
+/* controller registers in BAR 0 */
+#define NVME_REG_CAP		0x00	/* capabilities */
+#define NVME_REG_VS		0x08	/* version */
+#define NVME_REG_INTMS		0x0C	/* interrupt mask set */
+#define NVME_REG_INTMC		0x10	/* interrupt mask clear */
+#define NVME_REG_CC		0x14	/* controller configuration */
+#define NVME_REG_CSTS		0x1C	/* controller status */
+#define NVME_REG_AQA		0x24	/* admin queue attributes */
+#define NVME_REG_ASQ		0x28	/* admin submission queue base address */
+#define NVME_REG_ACQ		0x30	/* admin completion queue base address */
+#define NVME_REG_DBS		0x1000	/* first doorbell */
+
+#define NVME_CAP_MQES(cap)	((uint32_t) ((cap) & 0xFFFF))
+#define NVME_CAP_TO(cap)	((uint32_t) (((cap) >> 24) & 0xFF))	/* in units of 500 ms */
+#define NVME_CAP_DSTRD(cap)	((uint32_t) (((cap) >> 32) & 0xF))
+#define NVME_CAP_CSS_NVM(cap)	((uint32_t) (((cap) >> 37) & 0x1))
+#define NVME_CAP_MPSMIN(cap)	((uint32_t) (((cap) >> 48) & 0xF))
+
+#define NVME_CC_EN		(1 << 0)
+#define NVME_CC_CSS_NVM		(0 << 4)
+#define NVME_CC_MPS(bits)	(((bits) - 12) << 7)
+#define NVME_CC_AMS_RR		(0 << 11)
+#define NVME_CC_SHN_NORMAL	(1 << 14)
+#define NVME_CC_IOSQES		(6 << 16)	/* 64 byte submission queue entries */
+#define NVME_CC_IOCQES		(4 << 20)	/* 16 byte completion queue entries */
+
+#define NVME_CSTS_RDY		(1 << 0)
+#define NVME_CSTS_CFS		(1 << 1)
+
+/* opcodes of the admin command set */
+#define NVME_ADMIN_DELETE_SQ	0x00
+#define NVME_ADMIN_CREATE_SQ	0x01
+#define NVME_ADMIN_DELETE_CQ	0x04
+#define NVME_ADMIN_CREATE_CQ	0x05
+#define NVME_ADMIN_IDENTIFY	0x06
+#define NVME_ADMIN_SET_FEATURES	0x09
+
+/* opcodes of the NVM command set */
+#define NVME_CMD_FLUSH		0x00
+#define NVME_CMD_WRITE		0x01
+#define NVME_CMD_READ		0x02
+
+/* controller or namespace structure (CNS) of the identify command */
+#define NVME_ID_CNS_NS		0x00
+#define NVME_ID_CNS_CTRL	0x01
+
+/* feature identifiers */
+#define NVME_FEAT_NUM_QUEUES	0x07
+
+/* flags of the commands, which create the I/O queues */
+#define NVME_QUEUE_PHYS_CONTIG	(1 << 0)
+#define NVME_CQ_IRQ_ENABLED	(1 << 1)
+
+/* status field of a completion: phase tag, status code and status code type */
+#define NVME_STATUS_PHASE	(1 << 0)
+#define NVME_STATUS_SC(status)	(((status) >> 1) & 0xFF)
+#define NVME_STATUS_SCT(status)	(((status) >> 9) & 0x7)
+
+/* generic status codes */
+#define NVME_SC_SUCCESS		0x00
+#define NVME_SC_INVALID_OPCODE	0x01
+#define NVME_SC_LBA_RANGE	0x80
+
+/// submission queue entry
+struct nvme_command {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t cid;
+	uint32_t nsid;
+	uint64_t rsvd2;
+	uint64_t mptr;
+	uint64_t prp1;
+	uint64_t prp2;
+	uint32_t cdw10;
+	uint32_t cdw11;
+	uint32_t cdw12;
+	uint32_t cdw13;
+	uint32_t cdw14;
+	uint32_t cdw15;
+} __attribute__((packed));
+
+/// completion queue entry
+struct nvme_completion {
+	uint32_t result;
+	uint32_t rsvd;
+	uint16_t sq_head;
+	uint16_t sq_id;
+	uint16_t cid;
+	uint16_t status;
+} __attribute__((packed));
+
+/// identify controller data structure
+struct nvme_id_ctrl {
+	uint16_t vid;
+	uint16_t ssvid;
+	char sn[20];
+	char mn[40];
+	char fr[8];
+	uint8_t rab;
+	uint8_t ieee[3];
+	uint8_t cmic;
+	/// maximum data transfer size as power of two of the minimum page size (0 = unlimited)
+	uint8_t mdts;
+	uint8_t rsvd78[434];
+	uint8_t sqes;
+	uint8_t cqes;
+	uint16_t maxcmd;
+	/// number of namespaces
+	uint32_t nn;
+	uint16_t oncs;
+	uint16_t fuses;
+	uint8_t fna;
+	/// volatile write cache is present
+	uint8_t vwc;
+	uint8_t rsvd526[3570];
+} __attribute__((packed));
+
+/// LBA format of a namespace
+struct nvme_lbaf {
+	/// metadata bytes per logical block
+	uint16_t ms;
+	/// size of a logical block as power of two
+	uint8_t ds;
+	uint8_t rp;
+} __attribute__((packed));
+
+/// identify namespace data structure
+struct nvme_id_ns {
+	/// size of the namespace in logical blocks
+	uint64_t nsze;
+	uint64_t ncap;
+	uint64_t nuse;
+	uint8_t nsfeat;
+	uint8_t nlbaf;
+	/// formatted LBA size: index of the LBA format
+	uint8_t flbas;
+	uint8_t rsvd27[101];
+	struct nvme_lbaf lbaf[16];
+	uint8_t rsvd192[3904];
+} __attribute__((packed));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
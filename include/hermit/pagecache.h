@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/pagecache.h
+ * @brief Guest-side page cache of host files, which are accessed via uhyve
+ *
+ * Files, which are opened read-only, are cached in pages of PAGE_SIZE
+ * bytes. The pages are shared between all descriptors of the same file
+ * name and survive the close, so that a file, which is read repeatedly,
+ * is copied from the cache instead of the host. Sequential reads grow a
+ * readahead window up to PAGECACHE_READAHEAD pages per host call. The
+ * least recently used pages are evicted, if the cache reaches
+ * UHYVE_PAGE_CACHE_MB or the free memory of the guest runs low.
+ *
+ * The file position of a cached descriptor is maintained by the guest.
+ * Opening a file for writing and every write to it invalidate its pages,
+ * modifications by other processes on the host aren't detected.
+ */
+
+#ifndef __PAGECACHE_H__
+#define __PAGECACHE_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// descriptors above this limit aren't cached
+#define PAGECACHE_MAX_FDS	256
+
+/// maximal number of pages, which are read ahead with one host call
+#define PAGECACHE_READAHEAD	32
+
+/// register a descriptor, which is returned by the host's open
+void pagecache_open(int fd, const char* name, int flags);
+
+/// are reads of the descriptor served by the cache?
+int pagecache_cached(int fd);
+
+/** @brief Read from the current position of a cached descriptor
+ *
+ * @return number of read bytes or a negative error code
+ */
+ssize_t pagecache_read(int fd, void* buf, size_t len);
+
+/// read at offset without moving the position of a cached descriptor
+ssize_t pagecache_pread(int fd, void* buf, size_t len, off_t offset);
+
+/// reposition a cached descriptor
+off_t pagecache_lseek(int fd, off_t offset, int whence);
+
+/// invalidate the pages of the file before the descriptor writes to it
+void pagecache_write(int fd);
+
+/// unregister a descriptor, the pages of its file are kept
+void pagecache_close(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
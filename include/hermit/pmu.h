@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/pmu.h
+ * @brief Hardware performance counters of a task
+ *
+ * A task opens events similar to perf_event_open(2) and reads their counts
+ * afterwards. The counters are virtualized per task: the scheduler saves
+ * the counts of the previous task and programs the counters of the next one,
+ * so a count contains only the time slices of its task, also if the task
+ * migrates. Each event occupies one hardware counter; if all counters of the
+ * task are in use, pmu_open() fails with -EBUSY. The events only count for
+ * the calling task.
+ *
+ * The profiler samples all cores: after each period of an event, the core
+ * records the interrupted instruction, task and up to PMU_CALLCHAIN callers
+ * into its ring. The callers are found by the frame pointers, so only code
+ * compiled with -fno-omit-frame-pointer has a call chain. While it runs, it
+ * owns the last general-purpose counter; events of the tasks on this
+ * counter pause.
+ */
+
+#ifndef __PMU_H__
+#define __PMU_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// config is one of the generic events PMU_HW_*
+#define PMU_TYPE_HARDWARE	0
+/// config contains the bits 0-15 (event and umask) and 18-31 of IA32_PERFEVTSELx
+#define PMU_TYPE_RAW		1
+
+/// generic events
+enum {
+	/// core cycles, while the core isn't halted
+	PMU_HW_CPU_CYCLES = 0,
+	/// retired instructions
+	PMU_HW_INSTRUCTIONS,
+	/// reference cycles (at the TSC frequency), while the core isn't halted
+	PMU_HW_REF_CPU_CYCLES,
+	/// references of the last level cache
+	PMU_HW_CACHE_REFERENCES,
+	/// misses of the last level cache
+	PMU_HW_CACHE_MISSES,
+	/// retired branch instructions
+	PMU_HW_BRANCH_INSTRUCTIONS,
+	/// mispredicted branch instructions
+	PMU_HW_BRANCH_MISSES,
+	/// misses of the data TLB, which cause a page walk
+	PMU_HW_DTLB_MISSES,
+	/// misses of the instruction TLB, which cause a page walk
+	PMU_HW_ITLB_MISSES,
+	PMU_HW_MAX
+};
+
+/// maximum number of callers of a sample
+#define PMU_CALLCHAIN		6
+
+/// sample of the profiler
+typedef struct pmu_sample {
+	/// interrupted instruction
+	uint64_t rip;
+	/// time stamp counter
+	uint64_t tsc;
+	/// interrupted task
+	uint32_t task;
+	/// core, which took the sample
+	uint16_t core;
+	/// number of valid entries of callchain
+	uint16_t depth;
+	/// return addresses of the callers, innermost first
+	uint64_t callchain[PMU_CALLCHAIN];
+} pmu_sample_t;
+
+struct task;
+
+/** @brief Open an event for the current task
+ *
+ * The event starts counting immediately.
+ *
+ * @return Handle of the event or
+ * - -ENODEV, if the processor has no suitable PMU
+ * - -ENOENT, if the event isn't supported
+ * - -EBUSY, if all counters of the task are in use
+ */
+int pmu_open(uint32_t type, uint64_t config);
+
+/// read the count of an event of the current task
+int pmu_read(int handle, uint64_t* value);
+
+/// restart the count of an event of the current task at zero
+int pmu_reset(int handle);
+
+/// close an event of the current task
+int pmu_close(int handle);
+
+/** @brief Start the profiler on all cores
+ *
+ * The samples of the previous run are discarded.
+ *
+ * @param period Number of events between two samples (at most 2^31-1)
+ * @return 0 on success or
+ * - -ENODEV, if the processor has no suitable PMU
+ * - -ENOENT, if the event isn't supported
+ * - -EBUSY, if the profiler is already running
+ */
+int pmu_profile_start(uint32_t type, uint64_t config, uint64_t period);
+
+/// stop the profiler, the samples remain readable
+int pmu_profile_stop(void);
+
+/** @brief Copy the samples of a core
+ *
+ * @param buf Array of at most n entries, which receives the newest samples
+ *            (oldest first)
+ * @return Number of copied samples or a negative error code
+ */
+int pmu_profile_read(uint32_t core, pmu_sample_t* buf, size_t n);
+
+/** @brief Save the counters of prev and program the ones of next
+ *
+ * Is called by the scheduler with interrupts disabled.
+ */
+void pmu_switch(struct task* prev, struct task* next);
+
+/// initialize the PMU of the current core
+void pmu_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
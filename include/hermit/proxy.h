@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/proxy.h
+ * @brief Framed and pipelined protocol to the Linux-side proxy
+ *
+ * A proxy, which sends HERMIT_MAGIC_V2 instead of HERMIT_MAGIC after the
+ * connection setup, speaks the framed protocol: every request is a single
+ * frame (proxy_req_hdr_t followed by the arguments of the call), which is
+ * answered by a single frame (proxy_resp_hdr_t followed by the data of a
+ * read). Requests carry an id, which the proxy copies into the response.
+ * The proxy has to process the requests in order, but the guest doesn't
+ * wait for a response before it sends the next request. Therefore, many
+ * tasks can have calls outstanding and large writes and positional reads
+ * are split into pipelined chunks of PROXY_CHUNK_SIZE bytes. A read of
+ * the file position stays a single request, because its chunks would wait
+ * for more data than a pipe or terminal returns to one read.
+ *
+ * The guest receives the responses in a dedicated task, which copies the
+ * data of a read directly into the caller's buffer and wakes the caller.
+ *
+ * Arguments (all little endian, packed):
+ * - __NR_write: int32 fd, data[len - header]
+ * - __NR_read: int32 fd, uint64 count
+ * - __NR_open: int32 flags, int32 mode, name (NUL-terminated)
+ * - __NR_close: int32 fd
+ * - __NR_lseek: int32 fd, int64 offset, int32 whence
+ * - __NR_pread: int32 fd, uint64 count, int64 offset
+ * - __NR_pwrite: int32 fd, int64 offset, data[len - header]
+ * - __NR_exit: int32 status, isn't answered
+ */
+
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct iovec;
+
+#define HERMIT_MAGIC_V2		0x7E318
+
+/// maximal number of data bytes of a read or write frame
+#define PROXY_CHUNK_SIZE	(64*1024)
+
+/// maximal number of chunks, which one call has outstanding
+#define PROXY_MAX_CHUNKS	8
+
+typedef struct {
+	/// size of the frame including the header
+	uint32_t len;
+	uint32_t id;
+	int32_t nr;
+} __attribute__((packed)) proxy_req_hdr_t;
+
+typedef struct {
+	/// size of the frame including the header
+	uint32_t len;
+	uint32_t id;
+	/// result of the call, a read is followed by ret bytes
+	int64_t ret;
+} __attribute__((packed)) proxy_resp_hdr_t;
+
+/** @brief Switch to the framed protocol on the connection to the proxy
+ *
+ * Starts the task, which receives the responses.
+ *
+ * @return 0 on success, -ENOMEM if the task could not be created
+ */
+int proxy_init(int sd);
+
+/** @brief Does the proxy speak the framed protocol? */
+int proxy_enabled(void);
+
+/// fail all outstanding calls, has to be called before the socket is closed
+void proxy_shutdown(void);
+
+/*
+ * The connection to the proxy is either a TCP socket of LwIP or a vsock
+ * socket (VSOCK_FD_BIT), which passes the frames to the host without IP.
+ * These functions dispatch to the matching socket layer and return the
+ * number of transferred bytes or a negative value on failure.
+ */
+ssize_t host_sock_read(int sd, void* buf, size_t len);
+ssize_t host_sock_write(int sd, const void* buf, size_t len);
+ssize_t host_sock_writev(int sd, const struct iovec* iov, int iovcnt);
+int host_sock_close(int sd);
+
+ssize_t proxy_read(int fd, void* buf, size_t len);
+ssize_t proxy_write(int fd, const void* buf, size_t len);
+int proxy_open(const char* name, int flags, int mode);
+int proxy_close(int fd);
+off_t proxy_lseek(int fd, off_t offset, int whence);
+ssize_t proxy_pread(int fd, void* buf, size_t len, off_t offset);
+ssize_t proxy_pwrite(int fd, const void* buf, size_t len, off_t offset);
+void proxy_exit(int arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,11 +47,25 @@ typedef struct tas {
 typedef struct rcce_mpb {
 	int id; // session id;
 	volatile size_t mpb[MAX_ISLE];
+	volatile size_t win[MAX_ISLE];		// physical address of the RMA window
+	volatile size_t win_size[MAX_ISLE];	// size of the RMA window in bytes
 } rcce_mpb_t;
 
 #define MAX_RCCE_SESSIONS 	((PAGE_SIZE - CACHE_LINE*(RCCE_MAXNP+1)) / sizeof(rcce_mpb_t))
 
+/// the doorbell uses the first cache line behind rcce_lock
+#define RCCE_DOORBELL_OFFSET	CACHE_LINE
+
+/// give up waiting for a peer after 36 s
+#define RCCE_RENDEZVOUS_TIMEOUT	36000
+/// busy wait for the doorbell during the first 2 ms
+#define RCCE_DOORBELL_SPIN	2
+/// afterwards, check the doorbell every 100 us
+#define RCCE_DOORBELL_SLEEP_NS	100000ULL
+
 extern islelock_t* rcce_lock;
+/// incremented by every isle, which publishes a MPB or RMA window
+extern atomic_int32_t* rcce_doorbell;
 extern rcce_mpb_t* rcce_mpb;
 extern uint64_t phy_rcce_internals;
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/**
+ * @file include/hermit/reuseport.h
+ * @brief Several listening LwIP sockets on the same port (SO_REUSEPORT)
+ *
+ * LwIP delivers all connection requests of a port to a single listen PCB.
+ * reuseport_listen() collects the listening sockets of a port in a group
+ * and takes over the accept callback of their PCBs: each established
+ * connection is queued at one member, which is chosen by the hash of the
+ * connection's 4-tuple. Members on the core, which processes the packet
+ * (i.e. the core of the RX queue), are preferred, so that a connection
+ * stays on the core of its flow. Thus, each worker accepts from its own
+ * socket and its own queue.
+ *
+ * The sockets have to be bound to the same address and port, which
+ * requires SO_REUSEADDR (LwIP's SO_REUSE).
+ */
+
+#ifndef __REUSEPORT_H__
+#define __REUSEPORT_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of ports with several listeners
+#define REUSEPORT_MAX_GROUPS	16
+
+/// maximal number of listeners of a port
+#define REUSEPORT_MAX_MEMBERS	MAX_CORES
+
+/** @brief Listen on a bound socket and join the group of its port
+ *
+ * The socket is assigned to the calling core.
+ *
+ * @param fd LwIP socket (LWIP_FD_BIT is set)
+ * @param backlog Backlog of lwip_listen()
+ * @return
+ * - 0 on success
+ * - -EBADF if fd isn't a TCP socket of LwIP
+ * - -EBUSY if the socket is already a member
+ * - -ENOSPC if the port has REUSEPORT_MAX_MEMBERS listeners or
+ *   REUSEPORT_MAX_GROUPS groups are in use
+ * - the error of lwip_listen()
+ */
+int reuseport_listen(int fd, int backlog);
+
+/** @brief Remove a socket from its group
+ *
+ * Has to be called before the socket is closed.
+ *
+ * @param fd LwIP socket (LWIP_FD_BIT is set)
+ */
+void reuseport_close(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/**
+ * @file include/hermit/romfs.h
+ * @brief Read-only file system image, which is linked into the application
+ *
+ * The image is a cpio archive in the "newc" format (cpio -o -H newc),
+ * which add_romfs_image() of HermitCore-Application.cmake embeds between
+ * the symbols romfs_image_start and romfs_image_end. At boot, its regular
+ * files are indexed in a hash table. Afterwards, sys_open() serves every
+ * read-only open of an archived path from the image, without a round trip
+ * to the host. A leading "/" or "./" is ignored in both the archive and the
+ * opened path. Writable opens of the same path still reach the host.
+ */
+
+#ifndef __ROMFS_H__
+#define __ROMFS_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of open files of the image
+#define ROMFS_MAX_FILES		256
+
+/// file descriptors of the image are marked by this bit
+#define ROMFS_FD_BIT		(1 << 26)
+
+/** @brief Index the image, if the application contains one
+ *
+ * @return number of files in the image or -ENOMEM
+ */
+int romfs_init(void);
+
+/** @brief Open a file of the image
+ *
+ * @return
+ * - file descriptor of the file (ROMFS_FD_BIT is set)
+ * - -ENOENT if the image doesn't contain the file or the open isn't read-only
+ * - -ENFILE if all ROMFS_MAX_FILES descriptors are in use
+ */
+int romfs_open(const char* name, int flags);
+
+/** @brief Read at the file position and advance it
+ *
+ * @return number of read bytes (0 at the end of the file) or -EBADF
+ */
+ssize_t romfs_read(int fd, void* buf, size_t len);
+
+/** @brief Read at an offset without changing the file position */
+ssize_t romfs_pread(int fd, void* buf, size_t len, off_t offset);
+
+/** @brief Set the file position
+ *
+ * @return new position, -EBADF or -EINVAL
+ */
+off_t romfs_lseek(int fd, off_t offset, int whence);
+
+/** @brief Close a descriptor */
+int romfs_close(int fd);
+
+/** @brief Find a file and return its contents without a copy
+ *
+ * @param data points afterwards to the read-only contents in the image
+ * @param size is afterwards the size of the file in bytes
+ * @return 0 on success or -ENOENT
+ */
+int romfs_lookup(const char* name, const void** data, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/rwlock.h
+ * @brief Reader-writer spinlock
+ *
+ * Readers share the lock, while a writer holds it exclusively. A waiting
+ * writer blocks new readers, so that writers don't starve. Like the
+ * spinlocks, the writer side is recursive and a writer may also enter
+ * the read side of its own lock.
+ */
+
+#ifndef __RWLOCK_H__
+#define __RWLOCK_H__
+
+#include <hermit/stddef.h>
+#include <hermit/tasks_types.h>
+#include <hermit/errno.h>
+#include <asm/atomic.h>
+#include <asm/processor.h>
+#include <asm/irqflags.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// the lock is held by a writer
+#define RW_WRITER	(1 << 30)
+/// a writer waits for the lock
+#define RW_WAITING	(1 << 29)
+/// mask of the reader counter
+#define RW_READERS	(RW_WAITING - 1)
+
+/** @brief Irqsave reader-writer spinlock structure */
+typedef struct rwlock_irqsave {
+	/// Number of readers and the writer flags
+	atomic_int32_t value;
+	/// Writer of this lock
+	tid_t owner;
+	/// Internal counter var of the writer
+	uint32_t counter;
+	/// Interrupt flag of the writer
+	uint8_t flags;
+} rwlock_irqsave_t;
+
+/// Macro for irqsave reader-writer lock initialization
+#define RWLOCK_IRQSAVE_INIT { ATOMIC_INIT(0), MAX_TASKS, 0, 0}
+
+/** @brief Initialization of a irqsave reader-writer lock
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int rwlock_irqsave_init(rwlock_irqsave_t* rw) {
+	if (BUILTIN_EXPECT(!rw, 0))
+		return -EINVAL;
+
+	atomic_int32_set(&rw->value, 0);
+	rw->owner = MAX_TASKS;
+	rw->counter = 0;
+	rw->flags = 0;
+
+	return 0;
+}
+
+/** @brief Enter the read side of the lock and disable interrupts
+ *
+ * @param rw Pointer to the lock
+ * @param flags Receives the interrupt flag, which has to be passed to
+ * rwlock_irqsave_read_unlock()
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int rwlock_irqsave_read_lock(rwlock_irqsave_t* rw, uint8_t* flags) {
+	if (BUILTIN_EXPECT(!rw || !flags, 0))
+		return -EINVAL;
+
+	*flags = irq_nested_disable();
+
+	// the writer already excludes all others
+	if (rw->owner == per_core(current_task)->id) {
+		rw->counter++;
+		return 0;
+	}
+
+	while (1) {
+		int32_t v = atomic_int32_read(&rw->value);
+
+		if (!(v & (RW_WRITER|RW_WAITING)) && (atomic_int32_cmpxchg(&rw->value, v, v+1) == v))
+			break;
+		PAUSE;
+	}
+
+	return 0;
+}
+
+/** @brief Leave the read side of the lock and re-enable interrupts
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int rwlock_irqsave_read_unlock(rwlock_irqsave_t* rw, uint8_t flags) {
+	if (BUILTIN_EXPECT(!rw, 0))
+		return -EINVAL;
+
+	if (rw->owner == per_core(current_task)->id)
+		rw->counter--;
+	else
+		atomic_int32_dec(&rw->value);
+	irq_nested_enable(flags);
+
+	return 0;
+}
+
+/** @brief Lock exclusively on entry of critical section and disable interrupts
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int rwlock_irqsave_write_lock(rwlock_irqsave_t* rw) {
+	if (BUILTIN_EXPECT(!rw, 0))
+		return -EINVAL;
+
+	uint8_t flags = irq_nested_disable();
+
+	task_t* curr_task = per_core(current_task);
+	if (rw->owner == curr_task->id) {
+		rw->counter++;
+		return 0;
+	}
+
+	while (1) {
+		int32_t v = atomic_int32_read(&rw->value);
+
+		if (!(v & (RW_WRITER|RW_READERS))) {
+			if (atomic_int32_cmpxchg(&rw->value, v, RW_WRITER) == v)
+				break;
+		} else if (!(v & RW_WAITING)) {
+			// block new readers
+			atomic_int32_cmpxchg(&rw->value, v, v|RW_WAITING);
+		}
+		PAUSE;
+	}
+
+	rw->flags = flags;
+	rw->owner = curr_task->id;
+	rw->counter = 1;
+
+	return 0;
+}
+
+/** @brief Unlock exclusive lock on exit of critical section and re-enable interrupts
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int rwlock_irqsave_write_unlock(rwlock_irqsave_t* rw) {
+	if (BUILTIN_EXPECT(!rw, 0))
+		return -EINVAL;
+
+	rw->counter--;
+	if (!rw->counter) {
+		uint8_t flags = rw->flags;
+
+		rw->owner = MAX_TASKS;
+		// keep the flag of other waiting writers
+		atomic_int32_sub(&rw->value, RW_WRITER);
+		irq_nested_enable(flags);
+	}
+
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -40,11 +40,15 @@
 #include <hermit/spinlock.h>
 #include <hermit/errno.h>
 #include <hermit/time.h>
+#include <asm/atomic.h>
+#include <asm/processor.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+extern atomic_int32_t cpu_online;
+
 /** @brief Semaphore initialization
  *
  * Always init semaphores before use!
@@ -58,15 +62,11 @@ extern "C" {
  */
 inline static int sem_init(sem_t* s, unsigned int v)
 {
-	unsigned int i;
-
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
 	s->value = v;
-	s->rpos = s->wpos = 0;
-	for(i=0; i<MAX_TASKS; i++)
-		s->queue[i] = MAX_TASKS;
+	s->first = s->last = NULL;
 	spinlock_irqsave_init(&s->lock);
 
 	return 0;
@@ -113,74 +113,157 @@ inline static int sem_trywait(sem_t* s)
 	return ret;
 }
 
-/** @brief Blocking wait for semaphore
+/** @brief Append a task to the wait list of the semaphore
+ *
+ * Has to be called with the lock of the semaphore.
+ */
+inline static void sem_enqueue(sem_t* s, task_t* task)
+{
+	task->sem_next = NULL;
+	if (s->last)
+		s->last->sem_next = task;
+	else
+		s->first = task;
+	s->last = task;
+}
+
+/** @brief Remove a task from the wait list of the semaphore
+ *
+ * Nothing happens, if the task isn't part of the list. Has to be
+ * called with the lock of the semaphore.
+ */
+inline static void sem_dequeue(sem_t* s, task_t* task)
+{
+	task_t* prev = NULL;
+	task_t* tmp;
+
+	for(tmp = s->first; tmp; prev = tmp, tmp = tmp->sem_next) {
+		if (tmp != task)
+			continue;
+
+		if (prev)
+			prev->sem_next = task->sem_next;
+		else
+			s->first = task->sem_next;
+		if (s->last == task)
+			s->last = prev;
+		task->sem_next = NULL;
+		break;
+	}
+}
+
+/** @brief Spin a short time for the semaphore before blocking
+ *
+ * Short critical sections are released by another core quicker than two
+ * context switches. Spinning is stopped after SEM_SPIN_NSEC nanoseconds,
+ * or as soon as other tasks are queued, which have to be served first.
+ *
+ * @return
+ * - 0 if the semaphore was taken
+ * - -EBUSY (-16) if the task has to block
+ */
+inline static int sem_spin(sem_t* s)
+{
+	uint64_t start, cycles;
+
+	// on a single core, nobody could release the semaphore while we spin
+	if (!SEM_SPIN_NSEC || (atomic_int32_read(&cpu_online) <= 1))
+		return -EBUSY;
+
+	cycles = ns_to_tsc(SEM_SPIN_NSEC);
+	start = get_rdtsc();
+
+	do {
+		if (*((volatile task_t**) &s->first))
+			break;
+		if (*((volatile unsigned int*) &s->value) && !sem_trywait(s))
+			return 0;
+		PAUSE;
+	} while(get_rdtsc() - start < cycles);
+
+	return -EBUSY;
+}
+
+/** @brief Blocking wait for semaphore with nanosecond resolution
+ *
+ * The task spins a short time (see sem_spin()) before it blocks.
  *
  * @param s Address of the according sem_t structure
- * @param ms Timeout in milliseconds
+ * @param ns Timeout in nanoseconds
  * @return
  * - 0 on success
  * - -EINVAL on invalid argument
  * - -ETIME on timer expired
  */
-inline static int sem_wait(sem_t* s, uint32_t ms)
+inline static int sem_timedwait_ns(sem_t* s, uint64_t ns)
 {
 	task_t* curr_task = per_core(current_task);
+	uint64_t deadline;
 
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
-	if (!ms) {
-next_try1:
-		spinlock_irqsave_lock(&s->lock);
-		if (s->value > 0) {
-			s->value--;
-			spinlock_irqsave_unlock(&s->lock);
-		} else {
-			s->queue[s->wpos] = curr_task->id;
-			s->wpos = (s->wpos + 1) % MAX_TASKS;
-			block_current_task();
+	if (!sem_spin(s))
+		return 0;
+
+	deadline = get_rdtsc() + ns_to_tsc(ns);
+
+	spinlock_irqsave_lock(&s->lock);
+	while (!s->value) {
+		if (get_rdtsc() >= deadline) {
 			spinlock_irqsave_unlock(&s->lock);
-			reschedule();
-			goto next_try1;
-		}
-	} else {
-		uint32_t ticks = (ms * TIMER_FREQ) / 1000;
-		uint32_t remain = (ms * TIMER_FREQ) % 1000;
-
-		if (ticks) {
-			uint64_t deadline = get_clock_tick() + ticks;
-
-next_try2:
-			spinlock_irqsave_lock(&s->lock);
-			if (s->value > 0) {
-				s->value--;
-				spinlock_irqsave_unlock(&s->lock);
-				return 0;
-			} else {
-				if (get_clock_tick() >= deadline) {
-					spinlock_irqsave_unlock(&s->lock);
-					goto timeout;
-				}
-				s->queue[s->wpos] = curr_task->id;
-				s->wpos = (s->wpos + 1) % MAX_TASKS;
-				set_timer(deadline);
-				spinlock_irqsave_unlock(&s->lock);
-				reschedule();
-				goto next_try2;
-			}
+			return -ETIME;
 		}
+		sem_enqueue(s, curr_task);
+		set_timer_tsc(deadline);
+		spinlock_irqsave_unlock(&s->lock);
+		reschedule();
+		spinlock_irqsave_lock(&s->lock);
+		// after a timeout, the task is still part of the wait list
+		sem_dequeue(s, curr_task);
+	}
+	s->value--;
+	spinlock_irqsave_unlock(&s->lock);
 
-timeout:
-		while (remain) {
-			udelay(1000);
-			remain--;
+	return 0;
+}
 
-			if (!sem_trywait(s))
-				return 0;
-		}
+/** @brief Blocking wait for semaphore
+ *
+ * The task spins a short time (see sem_spin()) before it blocks.
+ *
+ * @param s Address of the according sem_t structure
+ * @param ms Timeout in milliseconds (0 = wait without timeout)
+ * @return
+ * - 0 on success
+ * - -EINVAL on invalid argument
+ * - -ETIME on timer expired
+ */
+inline static int sem_wait(sem_t* s, uint32_t ms)
+{
+	task_t* curr_task = per_core(current_task);
 
-		return -ETIME;
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+
+	if (ms)
+		return sem_timedwait_ns(s, (uint64_t) ms * 1000000ULL);
+
+	if (!sem_spin(s))
+		return 0;
+
+	spinlock_irqsave_lock(&s->lock);
+	while (!s->value) {
+		sem_enqueue(s, curr_task);
+		block_current_task();
+		spinlock_irqsave_unlock(&s->lock);
+		reschedule();
+		spinlock_irqsave_lock(&s->lock);
+		// sem_post() removes the task, but the wakeup could have another reason
+		sem_dequeue(s, curr_task);
 	}
+	s->value--;
+	spinlock_irqsave_unlock(&s->lock);
 
 	return 0;
 }
@@ -192,16 +275,20 @@ timeout:
  */
 inline static int sem_post(sem_t* s)
 {
+	task_t* task;
+
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
 	spinlock_irqsave_lock(&s->lock);
 
 	s->value++;
-	if (s->queue[s->rpos] < MAX_TASKS) {
-		wakeup_task(s->queue[s->rpos]);
-		s->queue[s->rpos] = MAX_TASKS;
-		s->rpos = (s->rpos + 1) % MAX_TASKS;
+	if ((task = s->first) != NULL) {
+		s->first = task->sem_next;
+		if (!s->first)
+			s->last = NULL;
+		task->sem_next = NULL;
+		wakeup_task(task->id);
 	}
 
 	spinlock_irqsave_unlock(&s->lock);
@@ -69,6 +69,19 @@ int hermit_kill(tid_t dest, int signum);
  */
 int hermit_signal(signal_handler_t handler);
 
+struct task;
+
+/** @brief Deliver the deferred signals of a task
+ *
+ * hermit_kill() doesn't interrupt the sending core for a destination on
+ * the same core, but marks the signal in task->signal_pending. The
+ * context switch to the task injects the handler, before the task
+ * continues. On aarch64, signals aren't supported.
+ *
+ * @param task	Task, which is switched in
+ */
+void signal_switch_in(struct task* task);
+
 #ifdef __cplusplus
 }
 #endif
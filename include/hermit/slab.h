@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/slab.h
+ * @brief Object caches for fixed-size kernel objects
+ *
+ * An object cache carves objects of one size out of slabs, which are
+ * allocated by kmalloc(). Released objects are kept in a small cache of
+ * the current core and are moved in batches to the common free list of
+ * the object cache. Slabs are only released by kmem_cache_destroy().
+ */
+
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include <hermit/stddef.h>
+#include <hermit/spinlock_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of released objects, which each core keeps
+#define KMEM_CACHE_DEPTH	16
+/// number of objects, which are moved at once between a core and the free list
+#define KMEM_CACHE_BATCH	8
+
+/// distance between two objects, the free list is linked behind each object
+#define KMEM_STRIDE(size)	((((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1)) + sizeof(void*))
+
+/** @brief Constructor, which is called once for each object of a new slab
+ *
+ * Released objects have to be in their constructed state.
+ */
+typedef void (*kmem_ctor_t)(void* obj);
+
+/** @brief Released objects of a core */
+typedef struct kmem_cpu_cache {
+	/// first released object
+	void*		first;
+	/// number of released objects
+	uint32_t	nr;
+} kmem_cpu_cache_t;
+
+/** @brief Object cache */
+typedef struct kmem_cache {
+	/// name of the cache (for debugging purposes)
+	const char*	name;
+	/// size of an object
+	size_t		size;
+	/// distance between two objects
+	size_t		stride;
+	/// constructor of the objects (or NULL)
+	kmem_ctor_t	ctor;
+	/// free objects, which aren't cached by a core
+	void*		free;
+	/// allocated slabs (linked by their first word)
+	void*		slabs;
+	/// number of allocated slabs
+	size_t		nr_slabs;
+	/// indicates that kmem_cache_create() allocated the cache
+	uint8_t		dynamic;
+	/// lock of the free list and the slabs
+	spinlock_irqsave_t lock;
+	/// released objects per core, used only by its own core with disabled interrupts
+	kmem_cpu_cache_t cpu[MAX_CORES];
+} kmem_cache_t;
+
+/// static initializer of an object cache
+#define KMEM_CACHE_INIT(name, size, ctor) \
+	{(name), (size), KMEM_STRIDE(size), (ctor), NULL, NULL, 0, 0, SPINLOCK_IRQSAVE_INIT, {[0 ... MAX_CORES-1] = {NULL, 0}}}
+
+/** @brief Create a new object cache
+ *
+ * @param name Name of the cache
+ * @param size Size of the objects
+ * @param ctor Constructor of the objects (or NULL)
+ * @return Pointer to the cache or NULL on failure
+ */
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, kmem_ctor_t ctor);
+
+/** @brief Release all slabs of an object cache
+ *
+ * All objects of the cache become invalid. A cache, which was created by
+ * kmem_cache_create(), is released as well.
+ */
+void kmem_cache_destroy(kmem_cache_t* cache);
+
+/** @brief Allocate an object
+ *
+ * @return Pointer to the object or NULL if no memory is available
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/** @brief Release an object, which was allocated by kmem_cache_alloc() */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/snapshot.h
+ * @brief Snapshot of a booted unikernel
+ *
+ * The application calls sys_snapshot() at a point, at which its
+ * initialization is complete. The guest flushes its buffers and writes
+ * to UHYVE_PORT_SNAPSHOT. The host stops all vCPUs, saves the vCPU state
+ * and the guest memory and may skip the pages of the free list. Then it
+ * writes restored = 0 and resumes the guest.
+ *
+ * An instance, which the host restores from the snapshot (e.g. by mapping
+ * the saved memory copy-on-write), resumes on the same port access with
+ * restored = 1 and the current wall-clock time in gtod. Like fork(),
+ * sys_snapshot() returns 0 after saving and 1 in a restored instance.
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// UHYVE_PORT_SNAPSHOT, addresses are guest physical addresses
+typedef struct {
+	/// written by the guest: root of the free list (free_list_t)
+	uint64_t free_list;
+	/// written by the host: wall-clock time in us since the epoch
+	uint64_t gtod;
+	/// written by the host: 0 after saving, 1 in a restored instance
+	int32_t restored;
+	/// written by the host: 0 or -errno
+	int32_t ret;
+} __attribute__ ((packed)) uhyve_snapshot_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/**
+ * @file include/hermit/softirq.h
+ * @brief Per-core deferred work of the interrupt handlers (tasklets)
+ *
+ * An interrupt handler acknowledges its device and schedules a tasklet,
+ * which does the heavy part of the work. Each core has a queue per
+ * priority; a tasklet runs on the core, which has scheduled it, at the
+ * exit of the next interrupt (after the EOI) or when the core checks its
+ * work queues in the idle loop and in the timer code. A run executes at
+ * most SOFTIRQ_BUDGET tasklets, higher priorities first; the remaining
+ * ones stay pending for the next run. No thread switch is involved.
+ *
+ * Tasklets run with disabled interrupts and must not block. A tasklet
+ * never runs concurrently on two cores, and it may schedule itself again.
+ */
+
+#ifndef __SOFTIRQ_H__
+#define __SOFTIRQ_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// priorities of the tasklets, the lowest number runs first
+#define TASKLET_PRIO_HIGH	0
+#define TASKLET_PRIO_NET	1
+#define TASKLET_PRIO_LOW	2
+#define TASKLET_NR_PRIOS	3
+
+/// tasklet is part of a queue
+#define TASKLET_SCHEDULED	(1 << 0)
+/// tasklet is executed by a core
+#define TASKLET_RUNNING		(1 << 1)
+
+typedef void (*tasklet_func_t)(void* arg);
+
+typedef struct tasklet {
+	tasklet_func_t func;
+	void* arg;
+	uint32_t prio;
+	/// TASKLET_SCHEDULED and TASKLET_RUNNING
+	uint32_t state;
+	struct tasklet* next;
+} tasklet_t;
+
+/// statistics of a core
+typedef struct softirq_stats {
+	/// number of executed tasklets per priority
+	uint64_t executed[TASKLET_NR_PRIOS];
+	/// calls of tasklet_schedule(), which have queued a tasklet
+	uint64_t scheduled;
+	/// runs, which have processed at least one tasklet
+	uint64_t runs;
+	/// runs, which have exhausted the budget
+	uint64_t exhausted;
+	/// tasklets, which were deferred because they were running on another core
+	uint64_t busy;
+	/// time stamp counter cycles in tasklets
+	uint64_t cycles;
+} softirq_stats_t;
+
+/** @brief Initialize a tasklet */
+static inline void tasklet_init(tasklet_t* t, tasklet_func_t func, void* arg, uint32_t prio)
+{
+	t->func = func;
+	t->arg = arg;
+	t->prio = prio < TASKLET_NR_PRIOS ? prio : TASKLET_PRIO_LOW;
+	t->state = 0;
+	t->next = NULL;
+}
+
+/** @brief Queue a tasklet on the current core
+ *
+ * Nothing happens, if the tasklet is already queued. May be called in
+ * interrupt and in task context.
+ */
+void tasklet_schedule(tasklet_t* t);
+
+/** @brief Run the pending tasklets of the current core within the budget
+ *
+ * Is called at the exit of an interrupt and by check_workqueues().
+ */
+void softirq_run(void);
+
+/** @brief Are tasklets pending on the current core? */
+int softirq_pending(void);
+
+/** @brief Copy the statistics of a core
+ *
+ * @return 0 on success, -EINVAL for an invalid core
+ */
+int softirq_stats(uint32_t core, softirq_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,6 +47,98 @@
 extern "C" {
 #endif
 
+#ifdef LOCKSTAT
+/** @brief Find or create the statistics entry of a lock
+ *
+ * @param lock Address of the lock
+ * @param site Function, which acquires the lock (NULL for lookups only)
+ * @return Pointer to the entry or NULL, if the table is full
+ */
+lock_stat_t* lockstat_lookup(const void* lock, const char* site);
+
+/** @brief Account an acquisition, which started to wait at start */
+void lockstat_acquired(lock_stat_t* stat, uint64_t start, int contended);
+
+/** @brief Account the release of the lock */
+void lockstat_released(lock_stat_t* stat);
+
+/** @brief Copy the statistics of at most n locks to buf
+ * @return Number of copied entries
+ */
+int lockstat_get(lock_stat_t* buf, size_t n);
+
+/** @brief Print the statistics of all locks */
+void lockstat_dump(void);
+
+/** @brief Clear the statistics of all locks */
+void lockstat_reset(void);
+
+/** @brief Install the channel, which hands the statistics to uhyve */
+int lockstat_init(void);
+
+/// function name of the call site, which is recorded by the statistics
+#define LOCKSTAT_SITE	__func__
+#else
+#define LOCKSTAT_SITE	NULL
+#endif
+
+#if defined(PVLOCK) && defined(__x86_64__)
+/// number of spins, after which a waiter halts its vCPU
+#define PVLOCK_SPINS	(1 << 11)
+
+/// set, if the hypervisor is able to wake up a halted vCPU
+extern uint8_t pvlock_enabled;
+
+/// number of waiters, which are halted or are going to halt
+extern atomic_int64_t pvlock_waiting;
+
+/** @brief Enable the paravirtual spinlocks, if KVM supports PV unhalt
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV if the hypervisor doesn't support it
+ */
+int pvlock_init(void);
+
+/** @brief Halt the vCPU until the lock may be served to ticket */
+void pvlock_wait(atomic_int64_t* dequeue, int64_t ticket);
+
+/** @brief Wake up the vCPU, which waits for ticket */
+void pvlock_kick(atomic_int64_t* dequeue, int64_t ticket);
+#endif
+
+/** @brief Wait until the lock is served to ticket
+ *
+ * On a hypervisor, the owner may be preempted by the host. Therefore,
+ * the waiter halts its vCPU after PVLOCK_SPINS spins and is woken up,
+ * when its ticket is served.
+ */
+inline static void spinlock_wait_ticket(atomic_int64_t* dequeue, int64_t ticket) {
+#if defined(PVLOCK) && defined(__x86_64__)
+	uint32_t spins = 0;
+
+	while (atomic_int64_read(dequeue) != ticket) {
+		PAUSE;
+		if (pvlock_enabled && (++spins >= PVLOCK_SPINS)) {
+			pvlock_wait(dequeue, ticket);
+			spins = 0;
+		}
+	}
+#else
+	while (atomic_int64_read(dequeue) != ticket) {
+		PAUSE;
+	}
+#endif
+}
+
+/** @brief Wake up the waiter of ticket, if it has halted its vCPU */
+inline static void spinlock_kick_ticket(atomic_int64_t* dequeue, int64_t ticket) {
+#if defined(PVLOCK) && defined(__x86_64__)
+	if (pvlock_enabled && atomic_int64_read(&pvlock_waiting))
+		pvlock_kick(dequeue, ticket);
+#endif
+}
+
 /** @brief Initialization of a spinlock
  *
  * Initialize each spinlock before use!
@@ -84,11 +176,14 @@ inline static int spinlock_destroy(spinlock_t* s) {
 }
 
 /** @brief Lock spinlock at entry of critical section
+ *
+ * Use spinlock_lock(), which passes the call site to the lock statistics.
+ *
  * @return
  * - 0 on success
  * - -EINVAL (-22) on failure
  */
-inline static int spinlock_lock(spinlock_t* s) {
+inline static int __spinlock_lock(spinlock_t* s, const char* site) {
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
@@ -98,16 +193,28 @@ inline static int spinlock_lock(spinlock_t* s) {
 		return 0;
 	}
 
+#ifdef LOCKSTAT
+	lock_stat_t* stat = lockstat_lookup(s, site);
+	uint64_t start = get_rdtsc();
+#endif
+
 	int64_t ticket = atomic_int64_inc(&s->queue);
-	while(atomic_int64_read(&s->dequeue) != ticket) {
-		PAUSE;
-	}
+#ifdef LOCKSTAT
+	int contended = (atomic_int64_read(&s->dequeue) != ticket);
+#endif
+	spinlock_wait_ticket(&s->dequeue, ticket);
 	s->owner = curr_task->id;
 	s->counter = 1;
 
+#ifdef LOCKSTAT
+	lockstat_acquired(stat, start, contended);
+#endif
+
 	return 0;
 }
 
+#define spinlock_lock(s)	__spinlock_lock((s), LOCKSTAT_SITE)
+
 /** @brief Unlock spinlock on exit of critical section
  * @return
  * - 0 on success
@@ -119,8 +226,11 @@ inline static int spinlock_unlock(spinlock_t* s) {
 
 	s->counter--;
 	if (!s->counter) {
+#ifdef LOCKSTAT
+		lockstat_released(lockstat_lookup(s, NULL));
+#endif
 		s->owner = MAX_TASKS;
-		atomic_int64_inc(&s->dequeue);
+		spinlock_kick_ticket(&s->dequeue, atomic_int64_inc(&s->dequeue));
 	}
 
 	return 0;
@@ -164,11 +274,14 @@ inline static int spinlock_irqsave_destroy(spinlock_irqsave_t* s) {
 }
 
 /** @brief Lock spinlock on entry of critical section and disable interrupts
+ *
+ * Use spinlock_irqsave_lock(), which passes the call site to the lock statistics.
+ *
  * @return
  * - 0 on success
  * - -EINVAL (-22) on failure
  */
-inline static int spinlock_irqsave_lock(spinlock_irqsave_t* s) {
+inline static int __spinlock_irqsave_lock(spinlock_irqsave_t* s, const char* site) {
 	if (BUILTIN_EXPECT(!s, 0))
 		return -EINVAL;
 
@@ -180,18 +293,30 @@ inline static int spinlock_irqsave_lock(spinlock_irqsave_t* s) {
 		return 0;
 	}
 
+#ifdef LOCKSTAT
+	lock_stat_t* stat = lockstat_lookup(s, site);
+	uint64_t start = get_rdtsc();
+#endif
+
 	int64_t ticket = atomic_int64_inc(&s->queue);
-	while (atomic_int64_read(&s->dequeue) != ticket) {
-		PAUSE;
-	}
+#ifdef LOCKSTAT
+	int contended = (atomic_int64_read(&s->dequeue) != ticket);
+#endif
+	spinlock_wait_ticket(&s->dequeue, ticket);
 
 	s->flags = flags;
 	s->owner = curr_task->id;
 	s->counter = 1;
 
+#ifdef LOCKSTAT
+	lockstat_acquired(stat, start, contended);
+#endif
+
 	return 0;
 }
 
+#define spinlock_irqsave_lock(s)	__spinlock_irqsave_lock((s), LOCKSTAT_SITE)
+
 /** @brief Unlock spinlock on exit of critical section and re-enable interrupts
  * @return
  * - 0 on success
@@ -203,14 +328,177 @@ inline static int spinlock_irqsave_unlock(spinlock_irqsave_t* s) {
 
 	s->counter--;
 	if (!s->counter) {
+#ifdef LOCKSTAT
+		lockstat_released(lockstat_lookup(s, NULL));
+#endif
 		s->owner = MAX_TASKS;
-		atomic_int64_inc(&s->dequeue);
+		spinlock_kick_ticket(&s->dequeue, atomic_int64_inc(&s->dequeue));
 		irq_nested_enable(s->flags);
 	}
 
 	return 0;
 }
 
+/// per core pools of MCS queue nodes
+extern mcs_node_t mcs_nodes[MAX_CORES][MCS_NODES];
+
+/** @brief Stop the kernel, because the core has no free MCS queue node
+ *
+ * Without a node, the lock can't be taken. Returning to the caller
+ * would break the mutual exclusion, because nobody checks the result.
+ */
+void NORETURN mcs_nodes_exhausted(mcs_spinlock_irqsave_t* s, const char* site);
+
+/** @brief Initialization of a irqsave MCS spinlock
+ *
+ * Initialize each MCS spinlock before use!
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int mcs_spinlock_irqsave_init(mcs_spinlock_irqsave_t* s) {
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+
+	atomic_int64_set(&s->tail, 0);
+	s->node = NULL;
+	s->owner = MAX_TASKS;
+	s->counter = 0;
+	s->flags = 0;
+
+	return 0;
+}
+
+/** @brief Destroy irqsave MCS spinlock after use
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int mcs_spinlock_irqsave_destroy(mcs_spinlock_irqsave_t* s) {
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+
+	s->node = NULL;
+	s->owner = MAX_TASKS;
+	s->counter = 0;
+	s->flags = 0;
+
+	return 0;
+}
+
+/** @brief Lock MCS spinlock on entry of critical section and disable interrupts
+ *
+ * The waiter enqueues a node of its core and spins only on this node.
+ * Use mcs_spinlock_irqsave_lock(), which passes the call site to the
+ * lock statistics.
+ *
+ * More than MCS_NODES nested MCS locks on a core are a fatal error
+ * (see mcs_nodes_exhausted).
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int __mcs_spinlock_irqsave_lock(mcs_spinlock_irqsave_t* s, const char* site) {
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+
+	uint8_t flags = irq_nested_disable();
+
+	task_t* curr_task = per_core(current_task);
+	if (s->owner == curr_task->id) {
+		s->counter++;
+		return 0;
+	}
+
+	/*
+	 * Only this core takes nodes from its pool. An owner, which is
+	 * migrated while it holds the lock, releases its node remotely.
+	 */
+	mcs_node_t* node = mcs_nodes[CORE_ID];
+	uint32_t slot = 0;
+
+	while ((slot < MCS_NODES) && node->busy) {
+		slot++;
+		node++;
+	}
+
+	if (BUILTIN_EXPECT(slot >= MCS_NODES, 0))
+		mcs_nodes_exhausted(s, site);
+
+	node->busy = 1;
+	node->next = NULL;
+	node->locked = 0;
+
+#ifdef LOCKSTAT
+	lock_stat_t* stat = lockstat_lookup(s, site);
+	uint64_t start = get_rdtsc();
+#endif
+
+	mcs_node_t* prev = (mcs_node_t*) atomic_int64_test_and_set(&s->tail, (int64_t) node);
+	if (prev) {
+		prev->next = node;
+		while (!node->locked) {
+			PAUSE;
+		}
+	}
+
+	s->node = node;
+	s->flags = flags;
+	s->owner = curr_task->id;
+	s->counter = 1;
+
+#ifdef LOCKSTAT
+	lockstat_acquired(stat, start, prev != NULL);
+#endif
+
+	return 0;
+}
+
+#define mcs_spinlock_irqsave_lock(s)	__mcs_spinlock_irqsave_lock((s), LOCKSTAT_SITE)
+
+/** @brief Unlock MCS spinlock on exit of critical section and re-enable interrupts
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) on failure
+ */
+inline static int mcs_spinlock_irqsave_unlock(mcs_spinlock_irqsave_t* s) {
+	if (BUILTIN_EXPECT(!s, 0))
+		return -EINVAL;
+
+	s->counter--;
+	if (!s->counter) {
+		// the next owner overwrites node and flags
+		mcs_node_t* node = s->node;
+		uint8_t flags = s->flags;
+
+#ifdef LOCKSTAT
+		lockstat_released(lockstat_lookup(s, NULL));
+#endif
+		s->owner = MAX_TASKS;
+		s->node = NULL;
+
+		if (!node->next) {
+			// no waiter => release the lock
+			if (atomic_int64_cmpxchg(&s->tail, (int64_t) node, 0) == (int64_t) node)
+				goto out;
+
+			// a waiter is enqueuing its node
+			while (!node->next) {
+				PAUSE;
+			}
+		}
+
+		node->next->locked = 1;
+out:
+		node->busy = 0;
+		irq_nested_enable(flags);
+	}
+
+	return 0;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,10 +66,71 @@ typedef struct spinlock_irqsave {
 	uint8_t flags;
 } spinlock_irqsave_t;
 
+/** @brief Queue node of a MCS spinlock
+ *
+ * Each waiter spins on its own node, so that a release touches only
+ * the cache line of the next owner.
+ */
+typedef struct mcs_node {
+	/// Next waiter in the queue
+	struct mcs_node* volatile next;
+	/// Set by the predecessor, when it hands over the lock
+	volatile uint32_t locked;
+	/// Node is used by a waiter or owner
+	volatile uint32_t busy;
+} __attribute__ ((aligned (CACHE_LINE))) mcs_node_t;
+
+/// Number of MCS queue nodes per core
+#define MCS_NODES	4
+
+/** @brief Irqsave MCS spinlock structure
+ *
+ * Drop-in alternative to spinlock_irqsave_t for heavily contended locks.
+ * Interrupts are disabled while a core waits for the lock, which allows
+ * to take the queue node from a small per core pool.
+ */
+typedef struct mcs_spinlock_irqsave {
+	/// Last waiter in the queue (mcs_node_t*)
+	atomic_int64_t tail;
+	/// Queue node of the owner
+	mcs_node_t* node;
+	/// Owner of this spinlock structure
+	tid_t owner;
+	/// Internal counter var
+	uint32_t counter;
+	/// Interrupt flag
+	uint8_t flags;
+} mcs_spinlock_irqsave_t;
+
+#ifdef LOCKSTAT
+/// Number of locks, for which statistics are recorded
+#define LOCKSTAT_SIZE	512
+
+/** @brief Contention statistics of one lock instance (times in TSC cycles) */
+typedef struct lock_stat {
+	/// Address of the lock (0 = unused entry)
+	atomic_int64_t lock;
+	/// Function, which acquired the lock first
+	const char* site;
+	/// Number of acquisitions
+	uint64_t nr_acquired;
+	/// Number of acquisitions, which had to wait
+	uint64_t nr_contended;
+	/// Total time spent waiting for the lock
+	uint64_t wait_cycles;
+	/// Longest time the lock was held
+	uint64_t max_hold;
+	/// Time stamp of the current acquisition
+	uint64_t start;
+} lock_stat_t;
+#endif
+
 /// Macro for spinlock initialization
 #define SPINLOCK_INIT { ATOMIC_INIT(0), ATOMIC_INIT(1), MAX_TASKS, 0}
 /// Macro for irqsave spinlock initialization
 #define SPINLOCK_IRQSAVE_INIT { ATOMIC_INIT(0), ATOMIC_INIT(1), MAX_TASKS, 0, 0}
+/// Macro for irqsave MCS spinlock initialization
+#define MCS_SPINLOCK_IRQSAVE_INIT { ATOMIC_INIT(0), NULL, MAX_TASKS, 0, 0}
 
 #ifdef __cplusplus
 }
@@ -72,9 +72,33 @@ extern size_t image_size;
 #define UHYVE_PORT_NETINFO		0x600
 #define UHYVE_PORT_NETWRITE		0x640
 #define UHYVE_PORT_NETREAD		0x680
+#define UHYVE_PORT_NETWRITEV		0x6C0
 #define UHYVE_PORT_NETSTAT		0x700
 
 #define UHYVE_PORT_FREELIST 		0x720
+#define UHYVE_PORT_LOCKSTAT		0x7C0
+#define UHYVE_PORT_PFSTAT		0x7E0
+#define UHYVE_PORT_DISCARD		0x800
+#define UHYVE_PORT_DIRTY		0x840
+#define UHYVE_PORT_READV		0x880
+#define UHYVE_PORT_WRITEV		0x8C0
+#define UHYVE_PORT_IORING		0x900
+#define UHYVE_PORT_MMAP			0x940
+#define UHYVE_PORT_PREAD		0x980
+#define UHYVE_PORT_PWRITE		0x9C0
+#define UHYVE_PORT_PREADV		0xA00
+#define UHYVE_PORT_PWRITEV		0xA40
+#define UHYVE_PORT_KLOG			0xA80
+#define UHYVE_PORT_SNAPSHOT		0xAC0
+#define UHYVE_PORT_MEMHOTADD		0xB00
+
+/* uhyve sets the feature bits together with the uhyve flag of the boot info */
+#define UHYVE_FEAT_VECTORED_IO		(1 << 1)
+#define UHYVE_FEAT_FILE_MMAP		(1 << 2)
+#define UHYVE_FEAT_POSITIONAL_IO	(1 << 3)
+#define UHYVE_FEAT_SNAPSHOT		(1 << 4)
+/* the guest memory is zeroed by the host => .kbss and .bss are already cleared */
+#define UHYVE_FEAT_ZEROED_MEM		(1 << 5)
 
 /* Ports and data structures for uhyve command line arguments and envp
  * forwarding */
@@ -57,6 +57,11 @@ int kputchar(int);
  */
 int kprintf(const char*, ...);
 
+/**
+ * Works like the ANSI C function vprintf
+ */
+int kvprintf_console(const char* fmt, va_list ap);
+
 /**
  * Initialize the I/O functions 
  */
@@ -75,6 +75,14 @@ void* kmalloc(size_t sz);
  */
 void* create_stack(size_t sz);
 
+/** @brief Create a stack with guard pages, whose pages are mapped on demand
+ *
+ * Only the top of the stack is mapped in advance. Without LAZY_STACKS,
+ * the function behaves like create_stack(). Stacks, which are used by the
+ * interrupt handlers (IST), have to be created by create_stack().
+ */
+void* create_lazy_stack(size_t sz);
+
 /** @brief Destroy stack with its guard pages
  */
 int destroy_stack(void* addr, size_t sz);
@@ -99,7 +107,8 @@ void kfree(void* addr);
 /** @brief Kernel's more general memory allocator function.
  *
  * This function lets you choose flags for the newly allocated memory.
- * The new region is always page aligned.
+ * The new region is always page aligned. Drivers use it for their rings
+ * and buffers, consequently the pages are accounted as MEM_TAG_DRIVER.
  *
  * @param sz Desired size of the new memory
  * @param flags Flags to specify
@@ -57,8 +57,67 @@ extern "C" {
 struct sem;
 typedef struct sem sem_t;
 
+struct barrier;
+typedef struct barrier barrier_t;
+
+struct blk_request;
+typedef struct blk_request blk_request_t;
+
+struct blk_info;
+typedef struct blk_info blk_info_t;
+
+struct vclock;
+
 typedef void (*signal_handler_t)(int);
 
+/*
+ * Placement policies for new threads (see sys_clone_policy)
+ */
+/// use the policy, which is selected at boot time
+#define PLACEMENT_DEFAULT	0
+/// distribute the threads round-robin over all cores
+#define PLACEMENT_ROUND_ROBIN	1
+/// use the core with the lowest number of tasks
+#define PLACEMENT_LEAST_LOADED	2
+/// prefer the least loaded core, which shares the cache with the creator
+#define PLACEMENT_CACHE_NEAR	3
+
+/*
+ * Protection, flags and advices of anonymous memory mappings (see sys_mmap),
+ * the values match Linux
+ */
+#ifndef PROT_NONE
+#define PROT_NONE		0x0
+#define PROT_READ		0x1
+#define PROT_WRITE		0x2
+#define PROT_EXEC		0x4
+#endif
+
+#ifndef MAP_PRIVATE
+#define MAP_SHARED		0x01
+#define MAP_PRIVATE		0x02
+#define MAP_FIXED		0x10
+#define MAP_ANONYMOUS		0x20
+#define MAP_POPULATE		0x8000
+#define MAP_HUGETLB		0x40000
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+/// log2 of the huge page size is encoded in the bits 26-31 of the flags
+#define MAP_HUGE_SHIFT		26
+#define MAP_HUGE_MASK		0x3f
+#define MAP_HUGE_2MB		(21 << MAP_HUGE_SHIFT)
+#define MAP_HUGE_1GB		(30 << MAP_HUGE_SHIFT)
+#endif
+
+#ifndef MADV_NORMAL
+#define MADV_NORMAL		0
+#define MADV_RANDOM		1
+#define MADV_SEQUENTIAL		2
+#define MADV_WILLNEED		3
+#define MADV_DONTNEED		4
+#endif
+
 /*
  * HermitCore is a libOS.
  * => classical system calls are realized as normal function
@@ -73,22 +132,124 @@ int sys_setprio(tid_t* id, int prio);
 void NORETURN sys_exit(int arg);
 ssize_t sys_read(int fd, char* buf, size_t len);
 ssize_t sys_write(int fd, const char* buf, size_t len);
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+int sys_recvmmsg(int s, void* msgvec, unsigned int vlen, int flags);
+int sys_sendmmsg(int s, void* msgvec, unsigned int vlen, int flags);
+int sys_sock_timestamp(int s, int enable);
 ssize_t sys_sbrk(ssize_t incr);
 int sys_open(const char* name, int flags, int mode);
 int sys_close(int fd);
+int sys_unlink(const char* name);
+int sys_stat(const char* file, void* st);
+int sys_romfs_lookup(const char* name, const void** data, size_t* size);
+int sys_fsync(int fd);
+int sys_blkfs_map(int fd, off_t offset, uint64_t* sector, size_t* len);
+int sys_blk_info(blk_info_t* info);
+int sys_blk_submit(blk_request_t* req, uint16_t queue);
+int sys_blk_poll(uint16_t queue, uint32_t budget);
+int sys_blk_wait(blk_request_t* req);
+ssize_t sys_blk_read(uint64_t sector, void* buf, size_t len);
+ssize_t sys_blk_write(uint64_t sector, const void* buf, size_t len);
+int sys_blk_flush(void);
 void sys_msleep(unsigned int ms);
+int sys_nanosleep(uint64_t ns);
 int sys_sem_init(sem_t** sem, unsigned int value);
 int sys_sem_destroy(sem_t* sem);
 int sys_sem_wait(sem_t* sem);
 int sys_sem_post(sem_t* sem);
 int sys_sem_timedwait(sem_t *sem, unsigned int ms);
+int sys_sem_timedwait_ns(sem_t *sem, uint64_t ns);
 int sys_sem_cancelablewait(sem_t* sem, unsigned int ms);
+int sys_futex(int32_t* addr, int op, int32_t val, uint64_t timeout, int32_t* addr2, int32_t val3);
+int sys_barrier_init(barrier_t** barrier, unsigned int count);
+int sys_barrier_destroy(barrier_t* barrier);
+int sys_barrier_wait(barrier_t* barrier);
+int sys_ready_tasks(void);
+int sys_spin_wait(int32_t* addr, int32_t val, uint64_t spin_ns, uint64_t timeout);
+int sys_futexsleep(uint32_t* addr, uint32_t val, int64_t ns);
+int sys_futexwakeup(uint32_t* addr, uint32_t cnt);
+int sys_usleep(uint32_t us);
+void sys_sched_yield(void);
+int sys_getproccount(void);
+int sys_pin_hint(int32_t p);
 int sys_clone(tid_t* id, void* ep, void* argv);
+int sys_clone_policy(tid_t* id, void* ep, void* argv, int policy);
+int sys_sched_setaffinity(tid_t* id, size_t size, const void* mask);
+int sys_set_timeslice(tid_t* id, uint32_t us);
+int sys_set_prio_timeslice(uint8_t prio, uint32_t us);
+int sys_set_timer_slack(tid_t* id, uint32_t ns);
+int sys_cpu_up(uint32_t core_id);
+int sys_cpu_down(uint32_t core_id);
+int sys_sched_getaffinity(tid_t* id, size_t size, void* mask);
+int sys_sched_getstats(tid_t* id, size_t size, void* stats);
+int sys_sched_setdeadline(tid_t* id, uint64_t runtime, uint64_t deadline, uint64_t period);
+int sys_gang_create(const tid_t* ids, uint32_t n);
+int sys_gang_destroy(int gang);
+int sys_fiber_init(void);
+int sys_fiber_create(void** fiber, int (*func)(void*), void* arg, size_t stack_size);
+void sys_fiber_yield(void);
+int sys_fiber_switch(void* fiber);
+int sys_fiber_destroy(void* fiber, int* result);
+int sys_epoll_create(int flags);
+int sys_epoll_ctl(int epfd, int op, int fd, void* event);
+int sys_epoll_wait(int epfd, void* events, int maxevents, int timeout);
+int sys_rawnet_open(const char* ifname, uint16_t queue, void** rx, void** tx);
+int sys_rawnet_sync(int handle, int flags);
+int sys_rawnet_close(int handle);
+int sys_network_wait(unsigned int timeout_ms);
+int sys_reuseport_listen(int fd, int backlog);
+int sys_localsock_socket(void);
+int sys_localsock_listen(int fd, uint16_t port);
+int sys_localsock_accept(int fd);
+int sys_localsock_connect(int fd, uint16_t port);
+int sys_localsock_socketpair(int* sv);
+int sys_vsock_socket(void);
+int sys_vsock_listen(int fd, uint32_t port);
+int sys_vsock_accept(int fd, uint64_t* cid, uint32_t* port);
+int sys_vsock_connect(int fd, uint64_t cid, uint32_t port);
+int sys_netstats(const char* ifname, void* stats, size_t size);
+int sys_mmap(void** addr, size_t len, int prot, int flags);
+int sys_mmap_file(void** addr, size_t len, int prot, int flags, int fd, off_t offset);
+int sys_munmap(void* addr, size_t len);
+int sys_mprotect(void* addr, size_t len, int prot);
+int sys_madvise(void* addr, size_t len, int advice);
+int sys_lockstat(size_t size, void* stats);
+int sys_sysstat(size_t size, void* stats);
+int sys_hcstat(size_t size, void* stats);
+int sys_hist_read(uint32_t index, void* buf);
+int sys_pfstat(int core, size_t size, void* stats);
+int sys_irqstat(size_t size, void* stats);
+int sys_pftrace(size_t size, void* buf);
+int sys_ktrace(int enable);
+int sys_ktrace_read(int core, size_t size, void* buf);
+int sys_pmu_open(uint32_t type, uint64_t config);
+int sys_pmu_read(int fd, uint64_t* value);
+int sys_pmu_reset(int fd);
+int sys_pmu_close(int fd);
+int sys_pmu_profile_start(uint32_t type, uint64_t config, uint64_t period);
+int sys_pmu_profile_stop(void);
+int sys_pmu_profile_read(int core, size_t size, void* buf);
+int sys_memstat(size_t size, void* stats);
+int sys_buddyinfo(size_t size, void* info);
+int sys_softirq_stats(uint32_t core, size_t size, void* stats);
+int sys_flexsc_start(uint32_t core);
+int sys_flexsc_register(void* entries, uint32_t count);
+int sys_flexsc_unregister(void* entries);
+void sys_flexsc_kick(void);
+int64_t sys_flexsc_wait(void* entry);
 off_t sys_lseek(int fd, off_t offset, int whence);
+ssize_t sys_pread(int fd, char* buf, size_t len, off_t offset);
+ssize_t sys_pwrite(int fd, const char* buf, size_t len, off_t offset);
 size_t sys_get_ticks(void);
+const struct vclock* sys_vclock(void);
+int sys_snapshot(void);
+int sys_pstate_boost(int enable);
 int sys_rcce_init(int session_id);
 size_t sys_rcce_malloc(int session_id, int ue);
 int sys_rcce_fini(int session_id);
+size_t sys_rcce_win_alloc(int session_id, size_t size);
+size_t sys_rcce_win_map(int session_id, int ue, size_t* size);
+int sys_rcce_win_free(int session_id, int ue, size_t vaddr);
 void sys_yield(void);
 int sys_kill(tid_t dest, int signum);
 int sys_signal(signal_handler_t handler);
@@ -131,8 +292,36 @@ int setcontext(ucontext_t *ucp);
 #define __NR_clone		27
 #define __NR_sem_cancelablewait	28
 #define __NR_get_ticks		29
+#define __NR_pread		30
+#define __NR_pwrite		31
+
+/// number of entries of sys_call_table
+#define __NR_MAX		32
+
+/** @brief Entry points of the system calls, indexed by the __NR_* numbers
+ *
+ * Application and kernel share the address space and the privilege
+ * level. Therefore, syscall() calls the entry point directly instead of
+ * trapping into the kernel. Numbers without an implementation point to
+ * sys_nosys().
+ */
+extern const void* const sys_call_table[__NR_MAX];
+
+long sys_nosys(void);
 
 #ifndef __KERNEL__
+typedef long (*sys_call_t)(unsigned long, unsigned long, unsigned long);
+
+#ifndef HERMIT_SYSCALL_TRAP
+inline static long
+syscall(int nr, unsigned long arg0, unsigned long arg1, unsigned long arg2)
+{
+	if ((unsigned int) nr >= __NR_MAX)
+		return sys_nosys();
+
+	return ((sys_call_t) sys_call_table[nr])(arg0, arg1, arg2);
+}
+#else
 inline static long
 syscall(int nr, unsigned long arg0, unsigned long arg1, unsigned long arg2)
 {
@@ -146,6 +335,7 @@ syscall(int nr, unsigned long arg0, unsigned long arg1, unsigned long arg2)
 
 	return res;
 }
+#endif
 
 #define SYSCALL0(NR) \
 	syscall(NR, 0, 0, 0)
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/sysstat.h
+ * @brief Call counters and latency histograms of the system calls
+ *
+ * With SYSSTAT, the instrumented system calls count their calls and
+ * record their latency in a histogram with log2 bins: bin i counts the
+ * calls, which took between 2^i and 2^(i+1)-1 ns. The latencies are kept
+ * in a per-core histogram of hermit/histogram.h for each system call,
+ * which sys_hist_read() also exports, and are merged by sysstat_get().
+ * The statistics are printed at the exit of the application and by
+ * sys_sysstat(0, NULL); the histograms use the layout of hist_print_log2()
+ * in usr/benchmarks.
+ *
+ * Additionally, uhyve_send() counts the hypercalls per port and the time
+ * stamp counter cycles, for which they block the vCPU (sys_hcstat).
+ */
+
+#ifndef __SYSSTAT_H__
+#define __SYSSTAT_H__
+
+#include <hermit/stddef.h>
+#include <hermit/vclock.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// number of log2 bins of a latency histogram
+#define SYSSTAT_HIST_BINS	32
+
+/// instrumented system calls
+enum {
+	SYSSTAT_READ = 0,
+	SYSSTAT_WRITE,
+	SYSSTAT_READV,
+	SYSSTAT_WRITEV,
+	SYSSTAT_PREAD,
+	SYSSTAT_PWRITE,
+	SYSSTAT_PREADV,
+	SYSSTAT_PWRITEV,
+	SYSSTAT_OPEN,
+	SYSSTAT_CLOSE,
+	SYSSTAT_LSEEK,
+	SYSSTAT_SENDFILE,
+	SYSSTAT_SBRK,
+	SYSSTAT_MMAP,
+	SYSSTAT_MUNMAP,
+	SYSSTAT_SEM_WAIT,
+	SYSSTAT_SEM_TIMEDWAIT,
+	SYSSTAT_SEM_POST,
+	SYSSTAT_FUTEX,
+	SYSSTAT_SPIN_WAIT,
+	SYSSTAT_BARRIER_WAIT,
+	SYSSTAT_MSLEEP,
+	SYSSTAT_NANOSLEEP,
+	SYSSTAT_YIELD,
+	SYSSTAT_CLONE,
+	SYSSTAT_EPOLL_WAIT,
+	SYSSTAT_MAX
+};
+
+typedef struct sysstat {
+	/// name of the system call
+	char name[16];
+	/// number of calls
+	uint64_t calls;
+	/// sum of the latencies in ns
+	uint64_t total_ns;
+	/// longest call in ns
+	uint64_t max_ns;
+	/// hist[i] counts the calls of 2^i .. 2^(i+1)-1 ns
+	uint64_t hist[SYSSTAT_HIST_BINS];
+} sysstat_t;
+
+/// statistics of the hypercalls to a port of uhyve
+typedef struct hcstat {
+	/// name of the hypercall
+	char name[16];
+	/// I/O port (x86) or address (aarch64)
+	uint32_t port;
+	uint32_t reserved;
+	/// number of calls
+	uint64_t calls;
+	/// sum of the time stamp counter cycles, for which the vCPU was blocked
+	uint64_t cycles;
+	/// longest call in cycles
+	uint64_t max_cycles;
+} hcstat_t;
+
+#ifdef SYSSTAT
+/// allocate the statistics of the online cores, before nothing is recorded
+int sysstat_init(void);
+
+typedef struct sysstat_probe {
+	uint32_t nr;
+	uint64_t start;
+} sysstat_probe_t;
+
+/// account a call of nr, which has started at the counter value start
+void sysstat_account(uint32_t nr, uint64_t start);
+
+/// is called, when the probe of SYSSTAT_ENTER leaves its scope
+static inline void sysstat_leave(sysstat_probe_t* probe)
+{
+	sysstat_account(probe->nr, probe->start);
+}
+
+/** @brief Start the measurement of the current system call
+ *
+ * The call is accounted on every return path of the enclosing function.
+ */
+#define SYSSTAT_ENTER(nr) \
+	sysstat_probe_t __sysstat_probe __attribute__ ((cleanup(sysstat_leave))) = { (nr), vclock_read() }
+
+/** @brief Merge the statistics of all cores
+ *
+ * @param buf Array of at most n entries
+ * @return Number of copied entries, including system calls without calls
+ */
+int sysstat_get(sysstat_t* buf, size_t n);
+
+/// print the statistics of all system calls, which have been called
+void sysstat_dump(void);
+
+/// clear the statistics
+void sysstat_reset(void);
+
+/// account a hypercall to port, which has blocked the vCPU for cycles
+void hcstat_account(uint32_t port, uint64_t cycles);
+
+/** @brief Copy the statistics of the hypercalls
+ *
+ * @param buf Array of at most n entries
+ * @return Number of copied entries, only ports with calls are included
+ */
+int hcstat_get(hcstat_t* buf, size_t n);
+#else
+#define SYSSTAT_ENTER(nr)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -38,6 +38,7 @@
 
 #include <hermit/stddef.h>
 #include <hermit/tasks_types.h>
+#include <hermit/softirq.h>
 #include <asm/tasks.h>
 
 #ifdef __cplusplus
@@ -58,6 +59,16 @@ void NORETURN sys_exit(int);
  */
 size_t** scheduler(void);
 
+/** @brief Task switcher at a preemption point (interrupt)
+ *
+ * In contrast to scheduler(), which is also used to yield the core, a
+ * running task keeps the core until its time slice expires, if the ready
+ * task has the same priority.
+ *
+ * @return see scheduler()
+ */
+size_t** preempt_scheduler(void);
+
 
 /** @brief Initialize the multitasking subsystem
  *
@@ -71,6 +82,20 @@ size_t** scheduler(void);
 int multitasking_init(void);
 
 
+/** @brief Read the scheduler related boot parameters
+ *
+ * Currently, the option "-steal<n>" enables work stealing. An idle core
+ * steals a ready task from the busiest core, if this core has at least
+ * <n> tasks. "-steal0" disables work stealing.
+ * "-placement=<rr|load|cache>" selects the default placement policy of
+ * new threads (round-robin, least loaded or cache near).
+ * "-fpu=<lazy|eager>" selects the FPU switching mode.
+ *
+ * @return 0 in any case
+ */
+int sched_init(void);
+
+
 /** @brief Clone current task with a specific entry point
  *
  * @todo Don't acquire table_lock for the whole task creation.
@@ -79,13 +104,13 @@ int multitasking_init(void);
  * @param ep Pointer to the function the task shall start with
  * @param arg Arguments list
  * @param prio Desired priority of the new task
- * @param core_id Start the new task on the core with this id
+ * @param policy Placement policy to select the core of the new task
  *
  * @return
  * - 0 on success
  * - -ENOMEM (-12) or -EINVAL (-22) on failure
  */
-int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio);
+int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, int policy);
 
 
 /** @brief Create a task with a specific entry point
@@ -166,6 +191,20 @@ void reschedule(void);
  */
 int wakeup_task(tid_t);
 
+/** @brief Wake up a set of blocked tasks
+ *
+ * All tasks are enqueued before the destination cores are
+ * interrupted. Each core gets at most one IPI, independent
+ * of the number of tasks, which are woken on it.
+ *
+ * @param ids Array of task ids
+ * @param n Number of entries in ids
+ * @return
+ * - number of tasks, which were blocked and are ready now
+ * - -EINVAL (-22) on invalid argument
+ */
+int wakeup_tasks(const tid_t* ids, uint32_t n);
+
 /** @brief Wake up a core_id
  *
  * Wakeup core to be sure that
@@ -175,6 +214,12 @@ int wakeup_task(tid_t);
  */
 void wakeup_core(uint32_t core_id);
 
+/** @brief Force a core to call the scheduler
+ *
+ * @param core_id Specifies the core
+ */
+void reschedule_core(uint32_t core_id);
+
 /** @brief Block current task
  *
  * The current task's status will be changed to TASK_BLOCKED
@@ -190,10 +235,215 @@ int block_current_task(void);
  */
 void wait_for_task(void);
 
+/** @brief Steal a ready task from the busiest core
+ *
+ * Called by an idle core to move a ready task from the busiest
+ * core to its own readyqueue.
+ *
+ * @return
+ * - 0 if a task was moved to the readyqueue of the current core
+ * - -ENOSYS (-38) if work stealing is disabled
+ * - -EAGAIN (-11) if no task could be stolen
+ */
+int steal_task(void);
+
+/** @brief Set the cores, on which a task is allowed to run
+ *
+ * A ready task is moved immediately to the least loaded core of the
+ * new set. A running task leaves its core at the next scheduling
+ * point. Blocked tasks are moved after their next context switch.
+ *
+ * @param id Id of the task
+ * @param affinity Bitmap of AFFINITY_WORDS words, bit n represents core n
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task isn't valid or the set contains no available core
+ * - -EBUSY (-16) if the set excludes the core of an EDF task
+ */
+int set_task_affinity(tid_t id, const uint64_t* affinity);
+
+/** @brief Is the core isolated by the command line option -isolcpus=?
+ *
+ * An isolated core runs only threads, whose affinity contains no other
+ * core. It doesn't steal work, doesn't poll for work with the timer and
+ * doesn't receive device interrupts or network processing. With one
+ * runnable task and DYNAMIC_TICKS, the core receives no timer interrupts,
+ * as long as the task doesn't start timers.
+ */
+int core_is_isolated(uint32_t core_id);
+
+/** @brief Get the n-th core, which is neither isolated nor offline
+ *
+ * Is used to distribute device interrupts and kernel threads.
+ * n wraps around the number of these cores.
+ */
+uint32_t housekeeping_core(uint32_t n);
+
+/// number of cores, which are neither isolated nor offline
+uint32_t housekeeping_cores(void);
+
+/** @brief Is the core parked by cpu_down() or the command line option -maxcpus=?
+ *
+ * An offline core runs the idle task and halts. It doesn't receive new
+ * threads, doesn't steal work and doesn't receive device interrupts.
+ */
+int core_is_offline(uint32_t core_id);
+
+/** @brief Take a core offline
+ *
+ * Moves the ready tasks and the device interrupts of the core to the
+ * other cores; the current task leaves the core at its next context
+ * switch, sleeping tasks when they wake up.
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the core doesn't exist
+ * - -EBUSY (-16) for the boot processor or if a task can't leave the core
+ *   (an EDF task or a gang member on the core, or an affinity without
+ *   another available core)
+ */
+int cpu_down(uint32_t core_id);
+
+/** @brief Bring an offline core back online
+ *
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the core id is invalid
+ * - -ENODEV (-19) if the processor wasn't started at boot time
+ */
+int cpu_up(uint32_t core_id);
+
+/** @brief Schedule a task by the earliest deadline first
+ *
+ * EDF tasks precede all priorities. Each one is served by a constant
+ * bandwidth server, which guarantees the runtime within every period on
+ * the current core of the task, but throttles the task until the end of
+ * its period as soon as the runtime is consumed. The task stays on its
+ * core as long as it is an EDF task.
+ *
+ * @param id Id of the task
+ * @param runtime Reserved runtime per period in nanoseconds (0 = schedule
+ * the task by its priority again)
+ * @param deadline Relative deadline in nanoseconds (0 = period)
+ * @param period Period in nanoseconds (0 = deadline)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task isn't valid or runtime <= deadline <= period is violated
+ * - -EBUSY (-16) if the EDF tasks would reserve more than 95% of the core
+ */
+int set_task_deadline(tid_t id, uint64_t runtime, uint64_t deadline, uint64_t period);
+
+/** @brief Register a group of tasks as gang
+ *
+ * The members of a gang are co-scheduled: time is divided into slots,
+ * whose boundaries are aligned on all cores, and the gangs own these
+ * slots in round robin order, followed by a slot for the remaining tasks.
+ * Within the slot of its gang, a member precedes all tasks of the same or
+ * a lower priority, so that all members run at the same time and are
+ * preempted together at the end of the slot. Each member is bound to its
+ * current core, so all members have to be located on different cores.
+ *
+ * @param ids Array of task ids
+ * @param n Number of members
+ * @return
+ * - id of the gang on success
+ * - -EINVAL (-22) if a task isn't valid
+ * - -EBUSY (-16) if two members share a core or a task is already part of a
+ *   gang or an EDF task
+ * - -ENOMEM (-12) if MAX_GANGS gangs are already registered
+ */
+int create_gang(const tid_t* ids, uint32_t n);
+
+/** @brief Dissolve a gang
+ *
+ * The former members keep their affinity to their cores.
+ *
+ * @param gang Id of the gang
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the gang doesn't exist
+ */
+int destroy_gang(int gang);
+
+/** @brief Get the cores, on which a task is allowed to run
+ *
+ * @param id Id of the task
+ * @param affinity Bitmap of AFFINITY_WORDS words to store the set
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task isn't valid
+ */
+int get_task_affinity(tid_t id, uint64_t* affinity);
+
+/** @brief Set the time slice of a task
+ *
+ * While tasks of the same priority are ready, a task is preempted after
+ * its time slice, the one-shot timer enforces the end of the slice. The
+ * new slice is used from the next context switch.
+ *
+ * @param id Id of the task
+ * @param us Time slice in microseconds (0 = time slice of the priority)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task isn't valid
+ */
+int set_task_timeslice(tid_t id, uint32_t us);
+
+/** @brief Set the timer slack of a task
+ *
+ * The high-resolution timers of the task may expire up to ns nanoseconds
+ * after their timeout, so that timers of a core with nearby deadlines
+ * are serviced by one interrupt. The slack is used from the next timer
+ * and inherited by new threads of the task.
+ *
+ * @param id Id of the task
+ * @param ns Slack in nanoseconds (0 = expire as exactly as possible)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task isn't valid
+ */
+int set_task_timer_slack(tid_t id, uint32_t ns);
+
+/** @brief Set the time slice of all tasks of a priority, which have no own slice
+ *
+ * @param prio Priority (1 to MAX_PRIO)
+ * @param us Time slice in microseconds (0 = no preemption within the priority)
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the priority isn't valid
+ */
+int set_prio_timeslice(uint8_t prio, uint32_t us);
+
+/** @brief Get the scheduler statistics of a task
+ *
+ * The run time includes the current time slice of a running task.
+ *
+ * @param id Id of the task
+ * @param stats Location to store the statistics, times are given in microseconds
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the task isn't valid
+ */
+int get_task_stats(tid_t id, task_stats_t* stats);
+
+/** @brief Get the scheduler statistics of a core
+ *
+ * @param core_id Id of the core
+ * @param stats Location to store the statistics
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if the core isn't available
+ */
+int get_core_stats(uint32_t core_id, core_stats_t* stats);
+
+/** @brief Print the scheduler statistics of all cores and tasks */
+void sched_stats_dump(void);
+
 /** @brief Get readyqueue of the current core
  *
  * @return
- *  - address of the readyqueue
+ *  - address of the cache line of the readyqueue, which is written
+ *    by a wakeup (contains nr_tasks)
  */
 void* get_readyqueue(void);
 
@@ -219,6 +469,18 @@ int get_task(tid_t id, task_t** task);
  */
 int set_timer(uint64_t deadline);
 
+/** @brief Block current task until a high-resolution timer expires
+ *
+ * Deadlines beyond the next tick are passed to the timer wheel, which
+ * could wake up the task up to one tick too early.
+ *
+ * @param deadline TSC value, when the timer expires
+ * @return
+ *  - 0 on success
+ *  - -EINVAL (-22) on failure
+ */
+int set_timer_tsc(uint64_t deadline);
+
 /** @brief check is a timer is expired */
 void check_timers(void);
 
@@ -239,9 +501,35 @@ void check_scheduling(void);
 /** @brief return true if a task is available and ready. */
 int is_task_available(void);
 
+/** @brief return the number of ready tasks on the current core
+ *
+ * The counter is read without the lock of the ready queue and is only a hint.
+ */
+uint32_t get_ready_tasks(void);
+
+/** @brief Spin, while *addr contains val
+ *
+ * The core is handed over, as long as a task of the same or a higher
+ * priority is ready on it (e.g. the task, which has to change the value).
+ *
+ * @param addr Address of the watched value
+ * @param val Value, which keeps the task spinning
+ * @param ns Duration of the spinning in nanoseconds (the conversion
+ * saturates, i.e. (uint64_t) -1 spins until the value changes)
+ * @return 1 if the value has changed, 0 if the time is up
+ */
+int spin_while_equal(const volatile uint32_t* addr, uint32_t val, uint64_t ns);
+
 /** @brief This function shutdowns the (ip) network */
 int network_shutdown(void);
 
+/** @brief Wait until the network interface has an (ip) address
+ *
+ * @param timeout_ms Maximal waiting time in milliseconds (0 = don't wait)
+ * @return 0 if the network is ready, -ETIMEDOUT otherwise
+ */
+int network_wait(uint32_t timeout_ms);
+
 
 #ifdef DYNAMIC_TICKS
 /** @brief check, if the tick counter has to be updated
@@ -266,8 +554,11 @@ static inline void check_workqueues_in_irqhandler(int irq)
 
 	if (go_down)
 		shutdown_system();
-	if (irq < 0)
+	if (irq < 0) {
+		// the interrupt handlers run the deferred work after the EOI
+		softirq_run();
 		check_scheduling();
+	}
 }
 
 static inline void check_workqueues(void)
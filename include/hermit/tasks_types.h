@@ -41,6 +41,7 @@
 #include <hermit/spinlock_types.h>
 #include <hermit/vma.h>
 #include <hermit/signal.h>
+#include <hermit/ktrace.h>
 #include <asm/tasks_types.h>
 #include <asm/atomic.h>
 
@@ -59,6 +60,13 @@ extern "C" {
 #define TASK_FPU_INIT		(1 << 0)
 #define TASK_FPU_USED		(1 << 1)
 #define TASK_TIMER		(1 << 2)
+#define TASK_HRTIMER		(1 << 3)
+
+/// number of 64 bit words to describe a set of cores
+#define AFFINITY_WORDS	((MAX_CORES + 63) / 64)
+
+/// maximal number of gangs, which are co-scheduled at the same time
+#define MAX_GANGS	8
 
 #define MAX_PRIO	31
 #define REALTIME_PRIO	31
@@ -69,7 +77,73 @@ extern "C" {
 
 typedef int (*entry_point_t)(void*);
 
-/** @brief Represents a the process control block */
+/** @brief Scheduler statistics of a task
+ *
+ * The kernel counts the times in TSC cycles. get_task_stats() converts
+ * them to microseconds.
+ */
+typedef struct task_stats {
+	/// time, which the task was running
+	uint64_t	run_time;
+	/// time, which the task was ready, but waited for the CPU
+	uint64_t	wait_time;
+	/// number of context switches, because the task blocked or terminated
+	uint64_t	nr_voluntary;
+	/// number of context switches, because the task was preempted
+	uint64_t	nr_involuntary;
+	/// number of moves to another core
+	uint64_t	nr_migrations;
+	/// pages of the heap, of stacks and anonymous memory, which the task has allocated
+	int64_t		mem_pages;
+	/// high-water mark of mem_pages
+	int64_t		mem_max_pages;
+} task_stats_t;
+
+/** @brief Scheduler statistics of a core */
+typedef struct core_stats {
+	/// number of context switches
+	uint64_t	nr_switches;
+	/// number of tasks, which this core stole from other cores
+	uint64_t	nr_steals;
+	/// number of tasks, which were moved to this core
+	uint64_t	nr_migrations;
+	/// time in us, which the hypervisor has stolen from this core
+	uint64_t	steal_time;
+} core_stats_t;
+
+/** @brief Parameters and state of an EDF task
+ *
+ * An EDF task is served by a constant bandwidth server (CBS), which
+ * guarantees the runtime within each period, but throttles the task as
+ * soon as the runtime is consumed. All times are counted in TSC cycles.
+ * Tasks with runtime 0 are scheduled by their priority.
+ */
+typedef struct sched_dl {
+	/// reserved runtime per period
+	uint64_t	runtime;
+	/// deadline relative to the start of a job
+	uint64_t	deadline;
+	/// period of the server
+	uint64_t	period;
+	/// absolute deadline of the current job
+	uint64_t	abs_deadline;
+	/// remaining runtime of the current job
+	int64_t		budget;
+	/// TSC, when the runtime was accounted last
+	uint64_t	tsc;
+} sched_dl_t;
+
+struct fiber_sched;
+
+/** @brief Represents a the process control block
+ *
+ * The fields are grouped by their use: the first cache line holds the
+ * fields of the scheduler and of wakeups, which other cores write as
+ * well, the second one the remaining fields of the context switch. The
+ * rest is touched rarely and starts on a new cache line. The FPU state
+ * is out-of-line, because it spans many cache lines and is only touched
+ * by the FPU switch.
+ */
 typedef struct task {
 	/// Task id = position in the task table
 	tid_t			id __attribute__ ((aligned (CACHE_LINE)));
@@ -77,40 +151,72 @@ typedef struct task {
 	uint32_t		status;
 	/// last core id on which the task was running
 	uint32_t		last_core;
-	/// copy of the stack pointer before a context switch
-	size_t*			last_stack_pointer;
-	/// start address of the stack 
-	void*			stack;
-	/// interrupt stack for IST1
-	void*			ist_addr;
 	/// Additional status flags. For instance, to signalize the using of the FPU
 	uint8_t			flags;
 	/// Task priority
 	uint8_t			prio;
+	/// gang of the task (0 = none, otherwise the gang id + 1)
+	uint8_t			gang;
+	/// copy of the stack pointer before a context switch
+	size_t*			last_stack_pointer;
+	/// next task in the queue
+	struct task*		next;
+	/// previous task in the queue
+	struct task*		prev;
 	/// timeout for a blocked task
 	uint64_t		timeout;
-	/// starting time/tick of the task
-	uint64_t		start_tick;
+	/// latest TSC, at which a high-resolution timer has to expire (timeout + slack)
+	uint64_t		timeout_max;
 	/// last TSC, when the task got the CPU
 	uint64_t		last_tsc;
+
+	/// TSC of the last change between running, ready and blocked
+	uint64_t		stats_tsc __attribute__ ((aligned (CACHE_LINE)));
+	/// slot of the timer wheel, which contains the task
+	struct task**		timer_slot;
+	/// next task, which waits for the same semaphore
+	struct task*		sem_next;
+	/// FPU state, see fpu_table
+	union fpu_state*	fpu;
+	/// start address of the stack 
+	void*			stack;
+	/// interrupt stack for IST1
+	void*			ist_addr;
+	/// TLS address
+	size_t			tls_addr;
+	/// signals for the next switch to the task, bit n represents signal n
+	uint32_t		signal_pending;
+	/// time slice in microseconds (0 = time slice of the priority)
+	uint32_t		timeslice;
+
+	/// starting time/tick of the task
+	uint64_t		start_tick __attribute__ ((aligned (CACHE_LINE)));
 	/// the userspace heap
 	vma_t*			heap;
 	/// parent thread
 	tid_t			parent;
-	/// next task in the queue
-	struct task*	next;
-	/// previous task in the queue
-	struct task*	prev;
-	/// TLS address
-	size_t		tls_addr;
+	/// nanoseconds, by which the high-resolution timers of the task may expire late
+	uint32_t		timer_slack;
 	/// TLS file size
-	size_t		tls_size;
+	size_t			tls_size;
 	/// LwIP error code
-	int		lwip_err;
+	int			lwip_err;
 	/// Handler for (POSIX) Signals
-	signal_handler_t signal_handler;
-	/// FPU state
-	union fpu_state	fpu;
+	signal_handler_t	signal_handler;
+	/// scheduler statistics
+	task_stats_t		stats;
+	/// EDF parameters
+	sched_dl_t		dl;
+	/// fiber scheduler, if the task is a carrier of fibers
+	struct fiber_sched*	fibers;
+	/// cores, on which the task is allowed to run
+	uint64_t		affinity[AFFINITY_WORDS];
+	/// performance counters, NULL if the task hasn't opened an event
+	struct pmu_task*	pmu;
+#ifdef KERNEL_TRACE
+	/// open calls of the kernel function trace
+	ktrace_stack_t		ktrace;
+#endif
 } task_t;
 
 typedef struct {
@@ -118,24 +224,77 @@ typedef struct {
         task_t* last;
 } task_list_t;
 
-/** @brief Represents a queue for all runable tasks */
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SIZE	(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS	4
+
+/** @brief Hierarchical timer wheel for the sleeping tasks of a core
+ *
+ * Level l holds deadlines up to 64^(l+1) ticks ahead with a granularity
+ * of 64^l ticks. Whenever the wheel reaches the start of a slot, the tasks
+ * of this slot are cascaded to the lower levels. Deadlines beyond the
+ * last level are clamped and cascaded again.
+ */
+typedef struct {
+	/// tick, which is currently serviced
+	uint64_t	clk;
+	/// indicates the used slots of each level
+	uint64_t	bitmap[TIMER_WHEEL_LEVELS];
+	/// first task of each slot
+	task_t*		slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+} timer_wheel_t;
+
+/** @brief Represents a queue for all runable tasks
+ *
+ * The first part is written only by the own core. The lock and the
+ * fields, which other cores change while they hold the lock (e.g. to
+ * wake up a task), are located on cache lines of their own. Otherwise,
+ * a core, which spins on the lock or wakes up a task, would steal the
+ * lines of the scheduler of the owner.
+ */
 typedef struct {
 	/// idle task
 	task_t*		idle __attribute__ ((aligned (CACHE_LINE)));
-        /// previous task
+	/// previous task
 	task_t*		old_task;
+	/// task, which is currently running on this core
+	task_t*		curr_task;
+	/// task, which is switched out, but whose context switch isn't finished
+	task_t*		prev_task;
 	/// last task, which used the FPU
 	tid_t		fpu_owner;
-	/// total number of tasks in the queue
-	uint32_t	nr_tasks;
+	/// percentage of the time, which the hypervisor steals (moving average)
+	uint32_t	steal_pct;
+	/// TSC, when the budget of the running EDF task is consumed (0 = none)
+	uint64_t	dl_timer;
+	/// TSC, when the current gang slot ends (0 = none)
+	uint64_t	gang_timer;
+	/// TSC, when the time slice of the current task ends (0 = no task of the same priority waits)
+	uint64_t	slice_timer;
+	/// steal time of the core in ns at the last context switch
+	uint64_t	steal_ns;
+	/// the scheduler is called at a preemption point (see preempt_scheduler)
+	uint8_t		preempt;
+
+	/// lock for this runqueue
+	spinlock_irqsave_t lock __attribute__ ((aligned (CACHE_LINE)));
+
+	/// total number of tasks in the queue, has to be part of the cache
+	/// line, which is monitored by an idle core (see wait_for_task)
+	uint32_t	nr_tasks __attribute__ ((aligned (CACHE_LINE)));
 	/// indicates the used priority queues
 	uint32_t	prio_bitmap;
 	/// a queue for each priority
 	task_list_t	queue[MAX_PRIO];
-	/// a queue for timers
-	task_list_t     timers;
-	/// lock for this runqueue
-	spinlock_irqsave_t lock;
+	/// ready EDF tasks, sorted by their absolute deadline
+	task_list_t	edf;
+	/// bandwidth, which is reserved by the EDF tasks of this core
+	uint64_t	dl_bw;
+	/// number of gangs, which have a member on this core
+	uint32_t	nr_gang;
+	/// member of each gang on this core
+	task_t*		gang[MAX_GANGS];
 } readyqueues_t;
 
 
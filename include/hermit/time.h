@@ -35,6 +35,8 @@
 #define __TIME_H__
 
 #include <asm/time.h>
+#include <asm/processor.h>
+#include <hermit/clocksource.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -87,6 +89,44 @@ static inline void sleep(unsigned int sec) { timer_wait(sec*TIMER_FREQ); }
 /** @brief Get milliseconds since system boot */
 uint64_t get_uptime(void);
 
+/** @brief Get the wall-clock time at system boot
+ *
+ * @return Microseconds since the epoch or 0, if the time is unknown
+ */
+uint64_t get_boot_time(void);
+
+/** @brief Convert nanoseconds to TSC cycles */
+static inline uint64_t ns_to_tsc(uint64_t ns)
+{
+	const uint64_t hz = clocksource_tsc_hz();
+
+	// avoid the overflow of ns * hz
+	return (ns / 1000000000ULL) * hz + ((ns % 1000000000ULL) * hz) / 1000000000ULL;
+}
+
+/** @brief Convert TSC cycles to nanoseconds */
+static inline uint64_t tsc_to_ns(uint64_t tsc)
+{
+	const uint64_t hz = clocksource_tsc_hz();
+
+	if (BUILTIN_EXPECT(!hz, 0))
+		return 0;
+
+	// avoid the overflow of tsc * 10^9
+	return (tsc / hz) * 1000000000ULL + ((tsc % hz) * 1000000000ULL) / hz;
+}
+
+/** @brief Block the current task with nanosecond resolution
+ *
+ * Timeouts within the next tick are realized by a one-shot timer,
+ * which is programmed to the exact TSC deadline.
+ *
+ * @param ns Amount of nanoseconds to wait
+ * @return
+ * - 0 on success
+ */
+int timer_wait_ns(uint64_t ns);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/tmpfs.h
+ * @brief In-memory file system for scratch files
+ *
+ * Files below TMPFS_PATH are kept in chunks of TMPFS_CHUNK_SIZE bytes,
+ * which are allocated from the page allocator. The system calls handle
+ * them before they forward a request to uhyve or the proxy, so that
+ * temporary files never leave the unikernel. There are no directories: every
+ * name below the mount point is a file. The contents are lost at shutdown.
+ */
+
+#ifndef __TMPFS_H__
+#define __TMPFS_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of open tmpfs files
+#define TMPFS_MAX_FILES		256
+
+/// binary exponent of the allocation unit of the file contents
+#define TMPFS_CHUNK_BITS	16 // 64 KByte
+#define TMPFS_CHUNK_SIZE	(1UL << TMPFS_CHUNK_BITS)
+
+/// file descriptors of tmpfs files are marked by this bit
+#define TMPFS_FD_BIT		(1 << 27)
+
+/** @brief Check, if a path is located below the mount point
+ *
+ * @return 1 if the tmpfs handles the path, otherwise 0
+ */
+int tmpfs_path(const char* name);
+
+/** @brief Open or create a file
+ *
+ * The flags are the ones of the host (Linux), which uhyve and the proxy
+ * pass through: O_CREAT, O_EXCL, O_TRUNC and O_APPEND are supported.
+ *
+ * @return
+ * - file descriptor of the file (TMPFS_FD_BIT is set)
+ * - -ENOENT if the file doesn't exist and O_CREAT isn't set
+ * - -EEXIST if the file exists and O_CREAT | O_EXCL is set
+ * - -ENFILE if all TMPFS_MAX_FILES descriptors are in use
+ * - -ENOMEM if the file could not be allocated
+ */
+int tmpfs_open(const char* name, int flags, int mode);
+
+/** @brief Read at the file position and advance it
+ *
+ * @return number of read bytes (0 at the end of the file) or -EBADF
+ */
+ssize_t tmpfs_read(int fd, void* buf, size_t len);
+
+/** @brief Write at the file position (the end with O_APPEND) and advance it
+ *
+ * @return number of written bytes, -EBADF or -ENOMEM
+ */
+ssize_t tmpfs_write(int fd, const void* buf, size_t len);
+
+/** @brief Read at an offset without changing the file position */
+ssize_t tmpfs_pread(int fd, void* buf, size_t len, off_t offset);
+
+/** @brief Write at an offset without changing the file position */
+ssize_t tmpfs_pwrite(int fd, const void* buf, size_t len, off_t offset);
+
+/** @brief Set the file position, a position behind the end creates a hole
+ *
+ * @return new position, -EBADF or -EINVAL
+ */
+off_t tmpfs_lseek(int fd, off_t offset, int whence);
+
+/** @brief Close a descriptor
+ *
+ * The contents of an unlinked file are released by the last close.
+ */
+int tmpfs_close(int fd);
+
+/** @brief Remove a name, open descriptors keep the file
+ *
+ * @return 0 on success or -ENOENT
+ */
+int tmpfs_unlink(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
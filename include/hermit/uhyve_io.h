@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file include/hermit/uhyve_io.h
+ * @brief Asynchronous file I/O between the guest and uhyve
+ *
+ * The guest announces a submission ring (SQ) and a completion ring (CQ)
+ * via UHYVE_PORT_IORING. Tasks, which call read, write, open, lseek or
+ * close, publish a request in the SQ and block in the scheduler, while
+ * the vCPU keeps running other tasks. The host completes the requests in
+ * any order, posts the results in the CQ and raises UHYVE_IRQ_IO.
+ *
+ * On both rings, the producer increases tail and the consumer head. Both
+ * counters are free running, the slot of a counter is
+ * (counter % UHYVE_IO_RING_SIZE). The guest writes to UHYVE_PORT_IORING
+ * only if the host has set UHYVE_IO_F_NEED_WAKEUP in the SQ. Therefore,
+ * all requests, which are submitted while the host is busy, share one
+ * exit. The host has to check tail again after setting the flag and
+ * before it goes to sleep.
+ *
+ * Like the synchronous hypercalls, buffers are described by their virtual
+ * addresses and file names by their physical addresses. If the host
+ * doesn't acknowledge the ring, the synchronous hypercalls are used.
+ */
+
+#ifndef __UHYVE_IO_H__
+#define __UHYVE_IO_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UHYVE_IO_VERSION	1
+#define UHYVE_IO_RING_SIZE	64
+
+/// interrupt line, which signals new completions
+#define UHYVE_IRQ_IO		12
+
+/// the host sleeps and has to be woken by a write to UHYVE_PORT_IORING
+#define UHYVE_IO_F_NEED_WAKEUP	(1 << 0)
+
+#define UHYVE_IO_OP_READ	1
+#define UHYVE_IO_OP_WRITE	2
+#define UHYVE_IO_OP_OPEN	3
+#define UHYVE_IO_OP_CLOSE	4
+#define UHYVE_IO_OP_LSEEK	5
+/// only used, if the host sets UHYVE_FEAT_POSITIONAL_IO
+#define UHYVE_IO_OP_PREAD	6
+#define UHYVE_IO_OP_PWRITE	7
+
+/*
+ * Submission entry
+ * - read/write: fd, addr = buffer, len
+ * - open: addr = physical address of the name, len = flags, off = mode
+ * - close: fd
+ * - lseek: fd, off = offset, len = whence
+ * - pread/pwrite: fd, addr = buffer, len, off = file offset
+ */
+typedef struct {
+	/// returned unchanged in the completion entry
+	uint64_t user_data;
+	uint32_t op;
+	int32_t fd;
+	uint64_t addr;
+	uint64_t len;
+	int64_t off;
+} __attribute__((packed)) uhyve_io_sqe_t;
+
+typedef struct {
+	uint64_t user_data;
+	/// result of the host call (negative values are errors)
+	int64_t res;
+} __attribute__((packed)) uhyve_io_cqe_t;
+
+typedef struct {
+	/// written by the producer
+	volatile uint32_t tail;
+	volatile uint32_t flags;
+	uint8_t pad0[CACHE_LINE-2*sizeof(uint32_t)];
+	/// written by the consumer
+	volatile uint32_t head;
+	uint8_t pad1[CACHE_LINE-sizeof(uint32_t)];
+} __attribute__((packed)) uhyve_io_ring_hdr_t;
+
+typedef struct {
+	uhyve_io_ring_hdr_t hdr;
+	uhyve_io_sqe_t sqe[UHYVE_IO_RING_SIZE];
+} __attribute__((packed)) uhyve_io_sq_t;
+
+typedef struct {
+	uhyve_io_ring_hdr_t hdr;
+	uhyve_io_cqe_t cqe[UHYVE_IO_RING_SIZE];
+} __attribute__((packed)) uhyve_io_cq_t;
+
+// UHYVE_PORT_IORING
+typedef struct {
+	/* IN */
+	uint32_t version;
+	uint32_t ring_size;
+	uint64_t sq;
+	uint64_t cq;
+	/* OUT, older hosts leave it untouched */
+	uint32_t version_ack;
+} __attribute__((packed)) uhyve_ioinfo_t;
+
+/** @brief Announce the rings to the host
+ *
+ * @return 0 if the host uses the rings, otherwise -ENOSYS
+ */
+int uhyve_io_init(void);
+
+/** @brief Is the asynchronous path available for the current task? */
+int uhyve_io_enabled(void);
+
+/** @brief Submit a request and block the task until it is completed
+ *
+ * @return result of the host call
+ */
+int64_t uhyve_io_submit(uint32_t op, int32_t fd, uint64_t addr, uint64_t len, int64_t off);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
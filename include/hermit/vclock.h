@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/vclock.h
+ * @brief Clock reads without a system call
+ *
+ * vclock_init() publishes a page, which holds everything to convert the
+ * time stamp counter into nanoseconds: the counter value at boot time,
+ * a multiplier and a shift, which replace the division by the frequency,
+ * and the wall-clock time at boot time. The page is written once and is
+ * read-only afterwards, such that the C library can compute
+ * clock_gettime() and gettimeofday() inline from the pointer, which
+ * sys_vclock() returns, with one counter read and one multiplication.
+ * If the clock source is kvmclock and the hypervisor guarantees a time
+ * info, which is valid on all cores, the page points to this time info
+ * instead, such that the time stays correct after a migration. The header doesn't depend on kernel headers and may be included by
+ * the C library.
+ */
+
+#ifndef __VCLOCK_H__
+#define __VCLOCK_H__
+
+#ifdef __KERNEL__
+#include <hermit/stddef.h>
+#else
+#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// layout version of vclock_t, is 0 until the page is initialized
+#define VCLOCK_VERSION	2
+
+/// the time is computed from the counter with mult and shift
+#define VCLOCK_MODE_TSC		0
+/// the time is computed from the time info of the hypervisor
+#define VCLOCK_MODE_PVCLOCK	1
+
+/// shift of the multiplier, which converts counter cycles to nanoseconds
+#define VCLOCK_SHIFT	32
+
+/// the time info is valid on all cores
+#define PVCLOCK_TSC_STABLE_BIT	(1 << 0)
+
+/// time info, which KVM updates for kvmclock (MSR_KVM_SYSTEM_TIME_NEW)
+typedef struct pvclock_vcpu_time_info {
+	uint32_t version;
+	uint32_t pad0;
+	uint64_t tsc_timestamp;
+	uint64_t system_time;
+	uint32_t tsc_to_system_mul;
+	int8_t tsc_shift;
+	uint8_t flags;
+	uint8_t pad[2];
+} __attribute__ ((packed)) pvclock_vcpu_time_info_t;
+
+typedef struct vclock {
+	/// VCLOCK_VERSION
+	uint32_t version;
+	/// ns = (cycles * mult) >> shift
+	uint32_t shift;
+	uint64_t mult;
+	/// counter frequency in Hz
+	uint64_t freq_hz;
+	/// counter value at boot time, the origin of the monotonic clock
+	uint64_t base_tsc;
+	/// wall-clock time at boot time in nanoseconds since the epoch
+	uint64_t wall_ns;
+	/// VCLOCK_MODE_*
+	uint32_t mode;
+	uint32_t reserved;
+	/// VCLOCK_MODE_PVCLOCK: time info and its time at boot time
+	const volatile pvclock_vcpu_time_info_t* pvclock;
+	uint64_t pvclock_base;
+} vclock_t;
+
+#ifdef __KERNEL__
+/** @brief Publish the clock page
+ *
+ * Must be called after the calibration of the counter frequency.
+ *
+ * @return 0 on success, -ENOMEM if no page is available
+ */
+int vclock_init(void);
+
+/// the clock page or NULL before vclock_init()
+extern const vclock_t* vclock_page;
+
+/// set the wall-clock time at boot in ns since the epoch (e.g. after a restore)
+void vclock_set_wall(uint64_t wall_ns);
+#endif
+
+/// read the counter, on which the clock page is based
+static inline uint64_t vclock_read(void)
+{
+#ifdef __aarch64__
+	uint64_t value;
+	asm volatile("mrs %0, cntpct_el0" : "=r" (value) :: "memory");
+	return value;
+#else
+	uint32_t lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32ULL | (uint64_t)lo);
+#endif
+}
+
+/// nanoseconds of the hypervisor's clock
+static inline uint64_t pvclock_read_ns(const volatile pvclock_vcpu_time_info_t* ti)
+{
+	uint32_t version;
+	uint64_t delta, ns;
+
+	do {
+		version = ti->version;
+		asm volatile("" ::: "memory");
+
+#ifndef __aarch64__
+		// the counter must not be read before the version
+		asm volatile("lfence" ::: "memory");
+#endif
+		delta = vclock_read() - ti->tsc_timestamp;
+		if (ti->tsc_shift >= 0)
+			delta <<= ti->tsc_shift;
+		else
+			delta >>= -ti->tsc_shift;
+		ns = ti->system_time + (uint64_t) (((unsigned __int128) delta * ti->tsc_to_system_mul) >> 32);
+
+		asm volatile("" ::: "memory");
+	} while ((version & 1) || (version != ti->version));
+
+	return ns;
+}
+
+/// nanoseconds since boot time for the counter value tsc
+static inline uint64_t vclock_tsc_to_ns(const vclock_t* vc, uint64_t tsc)
+{
+	return (uint64_t) (((unsigned __int128) (tsc - vc->base_tsc) * vc->mult) >> vc->shift);
+}
+
+/// nanoseconds since boot time (CLOCK_MONOTONIC)
+static inline uint64_t vclock_monotonic_ns(const vclock_t* vc)
+{
+	if (vc->mode == VCLOCK_MODE_PVCLOCK)
+		return pvclock_read_ns(vc->pvclock) - vc->pvclock_base;
+
+	return vclock_tsc_to_ns(vc, vclock_read());
+}
+
+/// nanoseconds since the epoch (CLOCK_REALTIME)
+static inline uint64_t vclock_realtime_ns(const vclock_t* vc)
+{
+	return vc->wall_ns + vclock_monotonic_ns(vc);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __VIRTIO_FS_H
+#define __VIRTIO_FS_H
+/* SPDX-License-Identifier: ((GPL-2.0 WITH Linux-syscall-note) OR BSD-3-Clause) */
+#include <hermit/stdlib.h>
+#include <hermit/virtio_ids.h>
+#include <hermit/virtio_config.h>
+#include <hermit/virtio_types.h>
+
+struct virtio_fs_config {
+	/* Filesystem name (UTF-8, not NUL-terminated, padded with NULs) */
+	__u8 tag[36];
+
+	/* Number of request queues */
+	__le32 num_request_queues;
+} __attribute__((packed));
+
+/* Queue 0 is the high priority queue (FORGET), the request queues follow */
+#define VIRTIO_FS_HIPRIO_QUEUE	0
+#define VIRTIO_FS_REQUEST_QUEUE	1
+
+/* For the id field in virtio_pci_shm_cap */
+#define VIRTIO_FS_SHMCAP_ID_CACHE 0
+
+#endif /* __VIRTIO_FS_H */
@@ -37,7 +37,7 @@
  */
 
 #ifndef __VIRTIO_PCI_H
-#define __VIRTIO_PCI_Hq
+#define __VIRTIO_PCI_H
 
 #include <hermit/stdlib.h>
 #include <hermit/virtio_types.h>
@@ -114,6 +114,8 @@
 #define VIRTIO_PCI_CAP_DEVICE_CFG	4
 /* PCI configuration access */
 #define VIRTIO_PCI_CAP_PCI_CFG		5
+/* Shared memory region, e.g. the DAX window of virtio-fs */
+#define VIRTIO_PCI_CAP_SHARED_MEMORY_CFG 8
 
 /* This is the PCI capability header: */
 struct virtio_pci_cap {
@@ -170,8 +172,12 @@ struct virtio_pci_cfg_cap {
 #define VIRTIO_PCI_CAP_LEN		2
 #define VIRTIO_PCI_CAP_CFG_TYPE		3
 #define VIRTIO_PCI_CAP_BAR		4
+#define VIRTIO_PCI_CAP_ID		5
 #define VIRTIO_PCI_CAP_OFFSET		8
 #define VIRTIO_PCI_CAP_LENGTH		12
+/* Upper halves of offset and length in the capability of a shared memory region */
+#define VIRTIO_PCI_CAP_OFFSET_HI	16
+#define VIRTIO_PCI_CAP_LENGTH_HI	20
 
 #define VIRTIO_PCI_NOTIFY_CAP_MULT	16
 
@@ -59,6 +59,30 @@
  * at the end of the used ring. Guest should ignore the used->flags field. */
 #define VIRTIO_RING_F_EVENT_IDX		29
 
+/*
+ * Mark a descriptor as available or used in packed ring.
+ * Notice: they are defined as shifts instead of shifted values.
+ */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
+/* Enable events in packed ring. */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+/* Disable events in packed ring. */
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+/*
+ * Enable events for a specific descriptor in packed ring.
+ * (as specified by Descriptor Ring Change Event Offset/Wrap Counter).
+ * Only valid if VIRTIO_RING_F_EVENT_IDX has been negotiated.
+ */
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+
+/*
+ * Wrap counter bit shift in event suppression structure
+ * of packed ring.
+ */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
 /* Virtio ring descriptors: 16 bytes.  These can chain together via "next". */
 struct vring_desc {
 	/* Address (guest-physical). */
@@ -101,6 +125,35 @@ struct vring {
 	struct vring_used *used;
 };
 
+struct vring_packed_desc_event {
+	/* Descriptor Ring Change Event Offset/Wrap Counter. */
+	__le16 off_wrap;
+	/* Descriptor Ring Change Event Flags. */
+	__le16 flags;
+};
+
+struct vring_packed_desc {
+	/* Buffer Address. */
+	__le64 addr;
+	/* Buffer Length. */
+	__le32 len;
+	/* Buffer ID. */
+	__le16 id;
+	/* The flags depending on descriptor type. */
+	__le16 flags;
+};
+
+struct vring_packed {
+	unsigned int num;
+
+	struct vring_packed_desc *desc;
+
+	/* event suppression of the driver and the device */
+	struct vring_packed_desc_event *driver;
+
+	struct vring_packed_desc_event *device;
+};
+
 /* Alignment requirements for vring elements.
  * When using pre-virtio 1.0 layout, these fall out naturally.
  */
@@ -168,4 +221,90 @@ static __inline__ int vring_need_event(__u16 event_idx, __u16 new_idx, __u16 old
 	return (__u16)(new_idx - event_idx - 1) < (__u16)(new_idx - old);
 }
 
+/* Has the driver to notify the device about the buffers, which are added
+ * since the avail index was old? The caller has to issue a memory barrier
+ * after updating the avail index. */
+static __inline__ int vring_need_kick(const struct vring *vr, __u16 old, int event_idx)
+{
+	if (event_idx)
+		return vring_need_event(vring_avail_event(vr), vr->avail->idx, old);
+	return !(vr->used->flags & VRING_USED_F_NO_NOTIFY);
+}
+
+/* Ask the device for an interrupt as soon as the used index passes idx.
+ * Without event index, the device interrupts for every used buffer. */
+static __inline__ void vring_enable_cb(struct vring *vr, __u16 idx, int event_idx)
+{
+	vr->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+	if (event_idx)
+		vring_used_event(vr) = idx;
+}
+
+/* With event index, this is only a hint. The device doesn't interrupt
+ * until the used event index is moved forward. */
+static __inline__ void vring_disable_cb(struct vring *vr)
+{
+	vr->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+}
+
+/* The packed ring is a continuous chunk of memory, too:
+ *
+ *	// The descriptor ring (16 bytes each)
+ *	struct vring_packed_desc desc[num];
+ *
+ *	// Event suppression of the driver and the device (4 bytes each)
+ *	struct vring_packed_desc_event driver;
+ *	struct vring_packed_desc_event device;
+ *
+ * In contrast to the split ring, num doesn't need to be a power of 2.
+ */
+static __inline__ void vring_packed_init(struct vring_packed *vr, unsigned int num, void *p)
+{
+	vr->num = num;
+	vr->desc = p;
+	vr->driver = p + num*sizeof(struct vring_packed_desc);
+	vr->device = (void *)vr->driver + sizeof(struct vring_packed_desc_event);
+}
+
+static __inline__ unsigned vring_packed_size(unsigned int num)
+{
+	return sizeof(struct vring_packed_desc) * num
+		+ sizeof(struct vring_packed_desc_event) * 2;
+}
+
+/* Flags of a descriptor, which the driver makes available with the wrap counter */
+static __inline__ __u16 vring_packed_avail_flags(int wrap)
+{
+	return wrap ? (1 << VRING_PACKED_DESC_F_AVAIL) : (1 << VRING_PACKED_DESC_F_USED);
+}
+
+/* Has the device used the descriptor at this position? */
+static __inline__ int vring_packed_is_used(const struct vring_packed *vr, __u16 pos, int wrap)
+{
+	__u16 flags = vr->desc[pos].flags;
+	int avail = !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL));
+	int used = !!(flags & (1 << VRING_PACKED_DESC_F_USED));
+
+	return (avail == used) && (used == wrap);
+}
+
+/* Does the device need a notification? The descriptors between the
+ * positions old and new are made available since the last kick. */
+static __inline__ int vring_packed_need_kick(const struct vring_packed *vr,
+	__u16 old, __u16 new_idx, int wrap, int event_idx)
+{
+	__u16 flags = vr->device->flags;
+	__u16 off_wrap, event;
+
+	if (!event_idx || (flags != VRING_PACKED_EVENT_FLAG_DESC))
+		return (flags != VRING_PACKED_EVENT_FLAG_DISABLE);
+
+	off_wrap = vr->device->off_wrap;
+	event = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) != wrap)
+		event -= vr->num;
+
+	return vring_need_event(event, new_idx, old);
+}
+
 #endif /* _LINUX_VIRTIO_RING_H */
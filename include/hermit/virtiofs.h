@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/virtiofs.h
+ * @brief Host files over virtio-fs (FUSE) with a DAX window
+ *
+ * Files below VIRTIOFS_PATH are files of the host directory, which the
+ * virtio-fs device exports. The system calls are translated into FUSE
+ * requests, which are passed to the device by its request queue.
+ *
+ * If the device provides a cache window (DAX), 2 MiB chunks of the files
+ * are mapped into the window by FUSE_SETUPMAPPING. The window is backed
+ * by the page cache of the host, so that a read copies the data straight
+ * from the host's page cache and doesn't need a request, as long as the
+ * chunk stays mapped, and sys_mmap_file() maps the pages of the window
+ * into the application without any copy. The chunks are replaced in LRU
+ * order, chunks of an application mapping are pinned until sys_munmap().
+ * Without a window, a read request transfers the data directly into the
+ * buffer of the caller. Writes are always requests, the host updates the
+ * shared pages, which keeps the window coherent.
+ */
+
+#ifndef __VIRTIOFS_H__
+#define __VIRTIOFS_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// maximal number of open descriptors
+#define VIRTIOFS_MAX_OPEN	64
+
+/// file descriptors of virtio-fs files are marked by this bit
+#define VIRTIOFS_FD_BIT		(1 << 23)
+
+/// files are mapped into the DAX window in chunks of this size (2 MiB)
+#define VIRTIOFS_CHUNK_BITS	21
+#define VIRTIOFS_CHUNK_SIZE	(1UL << VIRTIOFS_CHUNK_BITS)
+
+/// maximal number of data bytes of a read or write request
+#define VIRTIOFS_MAX_IO		(128*1024)
+
+/** @brief Initialize the FUSE session with the virtio-fs device
+ *
+ * @return
+ * - 0 on success or if VIRTIOFS_PATH is empty
+ * - -ENODEV if there is no device
+ * - -EPROTO if the host doesn't speak a compatible FUSE version
+ */
+int virtiofs_mount(void);
+
+/// Is the name below VIRTIOFS_PATH and is the file system mounted?
+int virtiofs_path(const char* name);
+
+/** @brief Open a host file
+ *
+ * @param name Absolute path below VIRTIOFS_PATH
+ * @param flags Flags of the host (Linux)
+ * @return
+ * - file descriptor (VIRTIOFS_FD_BIT is set)
+ * - -ENFILE if VIRTIOFS_MAX_OPEN descriptors are open
+ * - the error of the host (e.g. -ENOENT, -EACCES)
+ */
+int virtiofs_open(const char* name, int flags, int mode);
+
+ssize_t virtiofs_read(int fd, void* buf, size_t len);
+ssize_t virtiofs_write(int fd, const void* buf, size_t len);
+ssize_t virtiofs_pread(int fd, void* buf, size_t len, off_t offset);
+ssize_t virtiofs_pwrite(int fd, const void* buf, size_t len, off_t offset);
+off_t virtiofs_lseek(int fd, off_t offset, int whence);
+int virtiofs_fsync(int fd);
+int virtiofs_close(int fd);
+int virtiofs_unlink(const char* name);
+
+/** @brief Map a range of a file into the DAX window and pin it
+ *
+ * The range covers whole chunks, which occupy contiguous slots of the
+ * window. They stay mapped until virtiofs_dax_unmap() releases them.
+ *
+ * @param fd Descriptor of the file
+ * @param offset Offset in the file, multiple of VIRTIOFS_CHUNK_SIZE
+ * @param len Length of the range in bytes
+ * @param write Is the range writable?
+ * @param phys Receives the physical address of the range
+ * @return
+ * - 0 on success
+ * - -ENODEV if the device doesn't provide a DAX window
+ * - -EINVAL if the offset isn't aligned
+ * - -ENOMEM if no contiguous unpinned slots are available
+ */
+int virtiofs_dax_map(int fd, off_t offset, size_t len, int write, size_t* phys);
+
+/// unpin the chunks of a range, which virtiofs_dax_map() has mapped at phys
+void virtiofs_dax_unmap(size_t phys, size_t len);
+
+/*
+ * Interface between the FUSE client (kernel/virtiofs.c) and the driver
+ * of the device (drivers/fs/virtio_fs.c).
+ */
+
+/** @brief Part of a request, which is placed in guest memory */
+typedef struct viofs_buf {
+	void* buf;
+	uint32_t len;
+} viofs_buf_t;
+
+/// initialize the virtio-fs device, -ENODEV if there is none
+int viofs_init(void);
+
+/** @brief Pass a FUSE request to the device and wait for its completion
+ *
+ * The device reads the buffers in and writes the buffers out, which
+ * start with the fuse_in_header and the fuse_out_header.
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV if no device is initialized
+ * - -EINVAL if the buffers need too many descriptors
+ */
+int viofs_request(const viofs_buf_t* in, uint32_t nr_in, const viofs_buf_t* out, uint32_t nr_out);
+
+/// send a FUSE_FORGET by the high priority queue, which isn't answered
+int viofs_forget(uint64_t nodeid, uint64_t nlookup);
+
+/** @brief DAX window of the device
+ *
+ * @param virt Receives the kernel address of the window (cacheable)
+ * @param phys Receives the physical address of the window
+ * @param len Receives the usable length (at most VIRTIOFS_DAX_SIZE)
+ * @return 0 on success, -ENODEV if the device has no window
+ */
+int viofs_dax_window(uint8_t** virt, size_t* phys, size_t* len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -56,6 +56,16 @@ extern "C" {
 #define VMA_NO_ACCESS	(1 << 4)
 /// This VMA should be part of the userspace
 #define VMA_USER	(1 << 5)
+/// Anonymous memory, which the page fault handler maps on demand (mmap)
+#define VMA_ANON	(1 << 6)
+/// Back this VMA by 2 MiB pages
+#define VMA_HUGE	(1 << 7)
+/// Back this VMA by 1 GiB pages, if the CPU supports them
+#define VMA_HUGE_1G	(1 << 8)
+/// Private mapping of a host file, which the page fault handler reads on demand
+#define VMA_FILE	(1 << 9)
+/// Mapping of a virtio-fs file, whose frames (DAX window or a FUSE copy) are mapped at once
+#define VMA_DAX		(1 << 10)
 /// A collection of flags used for the kernel heap (kmalloc)
 #define VMA_HEAP	(VMA_READ|VMA_WRITE|VMA_CACHEABLE)
 
@@ -70,7 +80,8 @@ struct vma;
 /** @brief VMA structure definition
  *
  * Each item in this linked list marks a used part of the virtual address space.
- * Its used by vm_alloc() to find holes between them.
+ * Its used by vm_alloc() to find holes between them. In addition, the items
+ * build a red-black tree, which is ordered by the start address.
  */
 typedef struct vma {
 	/// Start address of the memory area
@@ -83,6 +94,14 @@ typedef struct vma {
 	struct vma* next;
 	/// Pointer to previous VMA element in the list
 	struct vma* prev;
+	/// Children and parent in the tree of VMAs
+	struct vma* left;
+	struct vma* right;
+	struct vma* parent;
+	/// Largest free gap in front of a VMA within this subtree
+	size_t gap_max;
+	/// Color of the tree node
+	uint8_t color;
 } vma_t;
 
 /** @brief Initalize the kernelspace VMA list
@@ -139,9 +158,55 @@ size_t vma_alloc(size_t size, uint32_t flags);
  */
 int vma_free(size_t start, size_t end);
 
+/** @brief Search the VMA, which contains an address
+ *
+ * @param addr Address within the VMA
+ * @param vma Receives a copy of start, end and flags of the VMA
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if no VMA contains the address
+ */
+int vma_lookup(size_t addr, vma_t* vma);
+
+/** @brief Change the flags of a part of a VMA
+ *
+ * @param start Start address of the area
+ * @param end End address of the area
+ * @param flags New flags of the area
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) or -ENOMEM (-12) on failure
+ */
+int vma_set_flags(size_t start, size_t end, uint32_t flags);
+
 /** @brief Dump information about this task's VMAs into the terminal. */
 void vma_dump(void);
 
+/** @brief Search the file mapping, which contains an address
+ *
+ * Adjacent file mappings may share one VMA, hence the mappings are
+ * kept apart from the VMAs (see sys_mmap_file).
+ *
+ * @param addr Address within a VMA with the flag VMA_FILE
+ * @param fd Receives the host file descriptor
+ * @param offset Receives the file offset, which is mapped at start
+ * @param start Receives the start address of the mapping
+ * @param end Receives the end address of the mapping
+ * @return
+ * - 0 on success
+ * - -EINVAL (-22) if no file mapping contains the address
+ */
+int mmap_file_lookup(size_t addr, int* fd, off_t* offset, size_t* start, size_t* end);
+
+/** @brief Defer closing a host file, which is still mapped
+ *
+ * @param fd Host file descriptor
+ * @return
+ * - 1 if the descriptor is closed by the last sys_munmap() of the file
+ * - 0 if the file isn't mapped
+ */
+int mmap_file_close(int fd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file include/hermit/vsock.h
+ * @brief Stream sockets between the guest and the host over virtio-vsock
+ *
+ * A vsock connection is addressed by a context id (CID) and a port on
+ * both sides. The packets are passed to the host by the rings of the
+ * virtio-vsock device, IP, TCP and the virtual NIC aren't involved.
+ * The flow control is based on credits: each header announces the size
+ * of the receive buffer (buf_alloc) and the number of bytes, which the
+ * reader has consumed (fwd_cnt), so that the sender never exceeds the
+ * free space of the peer and packets are never dropped.
+ */
+
+#ifndef __VSOCK_H__
+#define __VSOCK_H__
+
+#include <hermit/stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct virtio_vsock_hdr;
+
+/// maximal number of vsock sockets
+#define MAX_VSOCK		32
+
+/// maximal number of connections, which wait for vsock_accept()
+#define VSOCK_BACKLOG		8
+
+/// maximal number of payload bytes of a packet
+#define VSOCK_MAX_PKT		4096
+
+/// file descriptors of vsock sockets are marked by this bit
+#define VSOCK_FD_BIT		(1 << 24)
+
+/** @brief Initialize the virtio-vsock device
+ *
+ * @return
+ * - 0 on success
+ * - -ENODEV if the host doesn't provide a virtio-vsock device
+ * - -ENOMEM if the rings could not be allocated
+ */
+int vsock_init(void);
+
+/// CID of the guest, 0 if no device is initialized
+uint64_t vsock_local_cid(void);
+
+/** @brief Create an unconnected vsock socket
+ *
+ * @return
+ * - file descriptor of the socket (VSOCK_FD_BIT is set)
+ * - -ENODEV if no device is initialized
+ * - -ENFILE if all MAX_VSOCK sockets are in use
+ */
+int vsock_socket(void);
+
+/** @brief Bind a socket to a port and accept connections
+ *
+ * @return
+ * - 0 on success
+ * - -EBADF if fd isn't valid
+ * - -EINVAL if the socket is already bound or connected
+ * - -EADDRINUSE if another socket listens on the port
+ */
+int vsock_listen(int fd, uint32_t port);
+
+/** @brief Wait for a connection of a listening socket
+ *
+ * @param cid Receives the CID of the peer, may be NULL
+ * @param port Receives the port of the peer, may be NULL
+ * @return
+ * - file descriptor of the connected socket
+ * - -EBADF if fd isn't valid or is closed while the task waits
+ * - -EINVAL if fd doesn't listen
+ */
+int vsock_accept(int fd, uint64_t* cid, uint32_t* port);
+
+/** @brief Connect a socket to a port of another context (e.g. VMADDR_CID_HOST)
+ *
+ * @return
+ * - 0 on success
+ * - -EBADF if fd isn't valid
+ * - -EISCONN if the socket is already bound or connected
+ * - -ECONNREFUSED if the peer resets the connection request
+ * - -ENETDOWN if the device is reset by the host
+ */
+int vsock_connect(int fd, uint64_t cid, uint32_t port);
+
+/** @brief Receive data, blocks until at least one byte is available
+ *
+ * @return
+ * - number of received bytes
+ * - 0 if the peer has shut down the connection
+ * - -EBADF if fd isn't valid
+ * - -ENOTCONN if the socket isn't connected
+ * - -ECONNRESET if the peer has reset the connection
+ */
+ssize_t vsock_read(int fd, void* buf, size_t len);
+
+/** @brief Send data, blocks until all data is passed to the device
+ *
+ * @return
+ * - number of sent bytes
+ * - -EBADF if fd isn't valid
+ * - -ENOTCONN if the socket isn't connected
+ * - -EPIPE if the peer doesn't receive any longer
+ * - -ECONNRESET if the peer has reset the connection
+ */
+ssize_t vsock_write(int fd, const void* buf, size_t len);
+
+/** @brief Close a vsock socket
+ *
+ * The peer gets an end of file after the data, which is already sent.
+ * Connections, which aren't accepted by a closed listener, are reset.
+ */
+int vsock_close(int fd);
+
+/*
+ * Interface between the socket layer (kernel/vsock.c) and the driver
+ * of the device (drivers/vsock/virtio_vsock.c).
+ */
+
+/** @brief Pass a packet to the device
+ *
+ * The header and the payload are copied, the buffers are free after the
+ * call. If wait is zero, the function doesn't block and returns -EBUSY,
+ * if the ring is full (used in interrupt context).
+ *
+ * @return 0 on success, -ENODEV, -EINVAL or -EBUSY on failure
+ */
+int vsock_transport_send(const struct virtio_vsock_hdr* hdr, const void* buf, uint32_t len, int wait);
+
+/// called by the driver for each received packet (interrupt context)
+void vsock_input(const struct virtio_vsock_hdr* hdr, const uint8_t* payload);
+
+/// called by the driver, if the host resets the transport (interrupt context)
+void vsock_transport_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/barrier.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/errno.h>
+#include <hermit/processor.h>
+#include <hermit/semaphore.h>
+#include <asm/atomic.h>
+
+int barrier_init(barrier_t* b, uint32_t count)
+{
+	if (BUILTIN_EXPECT(!b || !count || (count > 0x7FFFFFFF), 0))
+		return -EINVAL;
+
+	memset(b, 0x00, sizeof(barrier_t));
+
+	// all tasks except the last one may sleep
+	if (count > 1) {
+		b->sleepers = kmalloc((count - 1) * sizeof(tid_t));
+		if (BUILTIN_EXPECT(!b->sleepers, 0))
+			return -ENOMEM;
+	}
+
+	b->count = count;
+	atomic_int32_set(&b->remaining, count);
+	spinlock_irqsave_init(&b->lock);
+
+	return 0;
+}
+
+int barrier_destroy(barrier_t* b)
+{
+	if (BUILTIN_EXPECT(!b, 0))
+		return -EINVAL;
+
+	if (atomic_int32_read(&b->remaining) != (int32_t) b->count)
+		return -EBUSY;
+
+	spinlock_irqsave_destroy(&b->lock);
+	if (b->sleepers)
+		kfree(b->sleepers);
+	b->sleepers = NULL;
+
+	return 0;
+}
+
+/** @brief Spin for BARRIER_SPIN_NSEC, while the episode sense is running
+ *
+ * @return 1 if the episode has ended, 0 if the task has to sleep
+ */
+static inline int barrier_spin(barrier_t* b, uint32_t sense)
+{
+	// on a single core, only a ready task could arrive
+	if (!BARRIER_SPIN_NSEC || (atomic_int32_read(&cpu_online) <= 1))
+		return 0;
+
+	return spin_while_equal(&b->sense, sense, BARRIER_SPIN_NSEC);
+}
+
+int barrier_wait(barrier_t* b)
+{
+	task_t* curr_task = per_core(current_task);
+	uint32_t sense;
+
+	if (BUILTIN_EXPECT(!b || !b->count, 0))
+		return -EINVAL;
+
+	// the sense has to be read before the arrival is counted
+	sense = __atomic_load_n(&b->sense, __ATOMIC_ACQUIRE);
+
+	if (atomic_int32_dec(&b->remaining) == 0) {
+		// nobody can arrive before the sense has changed
+		atomic_int32_set(&b->remaining, b->count);
+
+		spinlock_irqsave_lock(&b->lock);
+		__atomic_store_n(&b->sense, sense + 1, __ATOMIC_RELEASE);
+		// all sleepers are enqueued, before their cores are interrupted
+		if (b->nr_sleepers)
+			wakeup_tasks(b->sleepers, b->nr_sleepers);
+		b->nr_sleepers = 0;
+		spinlock_irqsave_unlock(&b->lock);
+
+		return BARRIER_SERIAL_TASK;
+	}
+
+	if (barrier_spin(b, sense))
+		return 0;
+
+	spinlock_irqsave_lock(&b->lock);
+
+	// the sense has to be checked after the lock is taken, the last task takes it as well
+	if ((b->sense == sense) && (b->nr_sleepers < b->count - 1)) {
+		b->sleepers[b->nr_sleepers++] = curr_task->id;
+
+		/*
+		 * The last task removes all sleepers, when it changes the sense.
+		 * Thus, a task, which is woken up in the same episode, is still
+		 * enqueued and just blocks again.
+		 */
+		do {
+			block_current_task();
+			spinlock_irqsave_unlock(&b->lock);
+
+			reschedule();
+
+			spinlock_irqsave_lock(&b->lock);
+		} while (b->sense == sense);
+	}
+
+	spinlock_irqsave_unlock(&b->lock);
+
+	// more tasks than count use the barrier => the surplus tasks yield
+	while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) == sense)
+		reschedule();
+
+	return 0;
+}
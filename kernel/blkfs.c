@@ -0,0 +1,811 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/blkfs.h>
+#include <hermit/block.h>
+#include <hermit/semaphore.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+
+/// flags of the host (Linux)
+#define BLKFS_O_ACCMODE		3
+#define BLKFS_O_RDONLY		0
+#define BLKFS_O_WRONLY		1
+#define BLKFS_O_CREAT		0100
+#define BLKFS_O_EXCL		0200
+#define BLKFS_O_TRUNC		01000
+#define BLKFS_O_APPEND		02000
+
+#define BLKFS_SEEK_SET		0
+#define BLKFS_SEEK_CUR		1
+#define BLKFS_SEEK_END		2
+
+/// "HCBLKFS1"
+#define BLKFS_MAGIC		0x3153464B4C424348ULL
+#define BLKFS_VERSION		1
+
+#define BLKFS_SECTORS		(BLKFS_BLOCK_SIZE >> BLK_SECTOR_BITS)
+#define BLKFS_TABLE_START	1
+#define BLKFS_TABLE_SIZE	(BLKFS_MAX_FILES * sizeof(blkfs_entry_t))
+#define BLKFS_TABLE_BLOCKS	((BLKFS_TABLE_SIZE + BLKFS_BLOCK_SIZE - 1) >> BLKFS_BLOCK_BITS)
+#define BLKFS_DATA_START	(BLKFS_TABLE_START + BLKFS_TABLE_BLOCKS)
+
+#ifndef MIN
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)		((a) > (b) ? (a) : (b))
+#endif
+
+/// run of blocks on the device
+typedef struct blkfs_extent {
+	uint32_t start;
+	uint32_t count;
+} blkfs_extent_t;
+
+/// entry of the file table on the device, a free entry has an empty name
+typedef struct blkfs_entry {
+	char name[BLKFS_NAME_MAX];
+	uint64_t size;
+	uint32_t nr_extents;
+	uint32_t reserved;
+	blkfs_extent_t extents[BLKFS_MAX_EXTENTS];
+} blkfs_entry_t;
+
+typedef struct blkfs_super {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t block_size;
+	uint64_t nr_blocks;
+	uint32_t max_files;
+	uint32_t table_start;
+	uint32_t data_start;
+} blkfs_super_t;
+
+/// state of a table entry, which isn't stored on the device
+typedef struct blkfs_file {
+	/// number of descriptors
+	uint32_t refs;
+	/// the size has changed since the table was written
+	uint8_t dirty;
+} blkfs_file_t;
+
+typedef struct blkfs_fd {
+	/// index of the table entry + 1, 0 marks a free descriptor
+	uint32_t file;
+	off_t pos;
+	int flags;
+} blkfs_fd_t;
+
+/// the table is also the buffer, which is written to the device
+static blkfs_entry_t* table = NULL;
+static blkfs_file_t files[BLKFS_MAX_FILES];
+static blkfs_fd_t fds[BLKFS_MAX_OPEN];
+static uint8_t* zero_block = NULL;
+static uint64_t nr_blocks = 0;
+static sem_t blkfs_sem = SEM_INIT(1);
+
+int blkfs_path(const char* name)
+{
+	const size_t len = sizeof(BLKFS_PATH) - 1;
+
+	if (!len || !name || !table)
+		return 0;
+
+	return !strncmp(name, BLKFS_PATH, len) && (name[len] == '/') && name[len+1];
+}
+
+static inline blkfs_fd_t* blkfs_get(int fd)
+{
+	fd &= ~BLKFS_FD_BIT;
+
+	if ((fd < 0) || (fd >= BLKFS_MAX_OPEN) || !fds[fd].file)
+		return NULL;
+
+	return fds + fd;
+}
+
+static inline blkfs_entry_t* fd_entry(blkfs_fd_t* desc)
+{
+	return table + desc->file - 1;
+}
+
+static int table_write(void)
+{
+	ssize_t ret = blk_write(BLKFS_TABLE_START * BLKFS_SECTORS, table, BLKFS_TABLE_BLOCKS * BLKFS_BLOCK_SIZE);
+
+	if (ret < 0) {
+		LOG_ERROR("blkfs: unable to write the file table: %d\n", (int) ret);
+		return -EIO;
+	}
+
+	for (uint32_t i=0; i<BLKFS_MAX_FILES; i++)
+		files[i].dirty = 0;
+
+	return 0;
+}
+
+static uint64_t entry_blocks(const blkfs_entry_t* e)
+{
+	uint64_t blocks = 0;
+
+	for (uint32_t i=0; i<e->nr_extents; i++)
+		blocks += e->extents[i].count;
+
+	return blocks;
+}
+
+/// is no block of the run used by a file (including unlinked files, which are still open)?
+static int blocks_free(uint64_t start, uint64_t count)
+{
+	if ((start < BLKFS_DATA_START) || (start + count > nr_blocks))
+		return 0;
+
+	for (uint32_t i=0; i<BLKFS_MAX_FILES; i++) {
+		for (uint32_t j=0; j<table[i].nr_extents; j++) {
+			const blkfs_extent_t* ext = table[i].extents + j;
+
+			if ((start < (uint64_t) ext->start + ext->count) && (ext->start < start + count))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/// first fit: skip the extents, which overlap the candidate, until it fits
+static int blocks_find(uint64_t count, uint32_t* start)
+{
+	uint64_t cand = BLKFS_DATA_START;
+	int moved;
+
+	do {
+		moved = 0;
+		for (uint32_t i=0; i<BLKFS_MAX_FILES; i++) {
+			for (uint32_t j=0; j<table[i].nr_extents; j++) {
+				const blkfs_extent_t* ext = table[i].extents + j;
+				uint64_t end = (uint64_t) ext->start + ext->count;
+
+				if ((cand < end) && (ext->start < cand + count)) {
+					cand = end;
+					moved = 1;
+				}
+			}
+		}
+	} while (moved && (cand + count <= nr_blocks));
+
+	if (cand + count > nr_blocks)
+		return -ENOSPC;
+
+	*start = cand;
+
+	return 0;
+}
+
+/*
+ * Allocate the blocks up to size. The file grows at least by its current
+ * size (and BLKFS_EXTENT_MIN), if there is enough space, to keep the
+ * number of extents of a growing file logarithmic.
+ */
+static int entry_grow(blkfs_entry_t* e, uint64_t size)
+{
+	uint64_t need = (size + BLKFS_BLOCK_SIZE - 1) >> BLKFS_BLOCK_BITS;
+	uint64_t have = entry_blocks(e);
+	uint64_t missing, want;
+	uint32_t start;
+
+	if (need <= have)
+		return 0;
+
+	missing = need - have;
+	want = MAX(missing, MAX(have, BLKFS_EXTENT_MIN));
+	if (missing > 0xFFFFFFFFULL)
+		return -EFBIG;
+	if (want > 0xFFFFFFFFULL)
+		want = missing;
+
+	if (e->nr_extents) {
+		blkfs_extent_t* last = e->extents + e->nr_extents - 1;
+		uint64_t end = (uint64_t) last->start + last->count;
+
+		if (((uint64_t) last->count + want <= 0xFFFFFFFFULL) && blocks_free(end, want)) {
+			last->count += want;
+			goto out;
+		}
+		if (((uint64_t) last->count + missing <= 0xFFFFFFFFULL) && blocks_free(end, missing)) {
+			last->count += missing;
+			goto out;
+		}
+	}
+
+	if (e->nr_extents >= BLKFS_MAX_EXTENTS)
+		return -EFBIG;
+
+	if (blocks_find(want, &start) == 0) {
+		e->extents[e->nr_extents].count = want;
+	} else if (blocks_find(missing, &start) == 0) {
+		e->extents[e->nr_extents].count = missing;
+	} else return -ENOSPC;
+
+	e->extents[e->nr_extents].start = start;
+	e->nr_extents++;
+
+out:
+	// the extents are written at once, the size lazily
+	return table_write();
+}
+
+/// determine the sector, which holds the byte at pos, and the contiguous bytes behind it
+static int extent_locate(const blkfs_extent_t* ext, uint32_t nr, uint64_t pos, uint64_t* sector, size_t* avail)
+{
+	uint64_t base = 0;
+
+	for (uint32_t i=0; i<nr; i++) {
+		uint64_t bytes = (uint64_t) ext[i].count << BLKFS_BLOCK_BITS;
+
+		if (pos < base + bytes) {
+			*sector = (((uint64_t) ext[i].start << BLKFS_BLOCK_BITS) + pos - base) >> BLK_SECTOR_BITS;
+			*avail = MIN(base + bytes - pos, (uint64_t) ((size_t) -1 >> 1));
+			return 0;
+		}
+		base += bytes;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Transfer between the buffer and the blocks of a file. Whole sectors
+ * are transferred directly, partial sectors through a bounce buffer. If
+ * buf is NULL, zeros are written.
+ */
+static ssize_t extent_transfer(const blkfs_extent_t* ext, uint32_t nr, uint8_t* buf, size_t len, uint64_t pos, int write)
+{
+	uint8_t bounce[BLK_SECTOR_SIZE];
+	size_t done = 0;
+
+	while (done < len) {
+		const size_t off = (pos + done) & (BLK_SECTOR_SIZE-1);
+		uint64_t sector;
+		size_t chunk;
+		ssize_t ret;
+
+		if (BUILTIN_EXPECT(extent_locate(ext, nr, pos + done, &sector, &chunk), 0))
+			return done ? (ssize_t) done : -EIO;
+		chunk = MIN(chunk, len - done);
+
+		if (off || (chunk < BLK_SECTOR_SIZE)) {
+			chunk = MIN(chunk, BLK_SECTOR_SIZE - off);
+			ret = blk_read(sector, bounce, BLK_SECTOR_SIZE);
+			if ((ret >= 0) && write) {
+				if (buf)
+					memcpy(bounce + off, buf + done, chunk);
+				else
+					memset(bounce + off, 0x00, chunk);
+				ret = blk_write(sector, bounce, BLK_SECTOR_SIZE);
+			} else if (ret >= 0) {
+				memcpy(buf + done, bounce + off, chunk);
+			}
+		} else {
+			chunk &= ~((size_t) BLK_SECTOR_SIZE - 1);
+			if (!buf) {
+				chunk = MIN(chunk, BLKFS_BLOCK_SIZE);
+				ret = blk_write(sector, zero_block, chunk);
+			} else if (write) {
+				ret = blk_write(sector, buf + done, chunk);
+			} else {
+				ret = blk_read(sector, buf + done, chunk);
+			}
+		}
+
+		if (ret < 0)
+			return done ? (ssize_t) done : -EIO;
+		done += chunk;
+	}
+
+	return done;
+}
+
+static ssize_t file_read(blkfs_fd_t* desc, void* buf, size_t len, uint64_t pos)
+{
+	blkfs_extent_t ext[BLKFS_MAX_EXTENTS];
+	blkfs_entry_t* e;
+	uint32_t nr;
+
+	sem_wait(&blkfs_sem, 0);
+
+	e = fd_entry(desc);
+	if (pos >= e->size) {
+		sem_post(&blkfs_sem);
+		return 0;
+	}
+	len = MIN(len, e->size - pos);
+
+	// the extents only grow => the I/O uses a snapshot without the lock
+	nr = e->nr_extents;
+	memcpy(ext, e->extents, sizeof(ext));
+
+	sem_post(&blkfs_sem);
+
+	return extent_transfer(ext, nr, buf, len, pos, 0);
+}
+
+static ssize_t file_write(blkfs_fd_t* desc, const void* buf, size_t len, uint64_t pos)
+{
+	blkfs_extent_t ext[BLKFS_MAX_EXTENTS];
+	blkfs_entry_t* e;
+	uint64_t old_size;
+	uint32_t nr;
+	ssize_t ret;
+
+	if (!len)
+		return 0;
+
+	sem_wait(&blkfs_sem, 0);
+
+	e = fd_entry(desc);
+	ret = entry_grow(e, pos + len);
+	if (ret) {
+		sem_post(&blkfs_sem);
+		return ret;
+	}
+
+	old_size = e->size;
+	nr = e->nr_extents;
+	memcpy(ext, e->extents, sizeof(ext));
+
+	sem_post(&blkfs_sem);
+
+	// a write behind the end must not reveal stale blocks
+	if (pos > old_size) {
+		ret = extent_transfer(ext, nr, NULL, pos - old_size, old_size, 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = extent_transfer(ext, nr, (uint8_t*) buf, len, pos, 1);
+	if (ret <= 0)
+		return ret;
+
+	sem_wait(&blkfs_sem, 0);
+	e = fd_entry(desc);
+	if (pos + ret > e->size) {
+		e->size = pos + ret;
+		files[desc->file - 1].dirty = 1;
+	}
+	sem_post(&blkfs_sem);
+
+	return ret;
+}
+
+int blkfs_mount(void)
+{
+	blkfs_super_t* sb;
+	blk_info_t info;
+	int ret;
+
+	if (!(sizeof(BLKFS_PATH) - 1) || table)
+		return 0;
+
+	if (blk_info(&info))
+		return -ENODEV;
+
+	if (info.sectors / BLKFS_SECTORS <= BLKFS_DATA_START) {
+		LOG_ERROR("blkfs: device is too small (%llu sectors)\n", info.sectors);
+		return -ENOSPC;
+	}
+
+	sb = kmalloc(BLKFS_BLOCK_SIZE);
+	table = kmalloc(BLKFS_TABLE_BLOCKS * BLKFS_BLOCK_SIZE);
+	zero_block = kmalloc(BLKFS_BLOCK_SIZE);
+	if (BUILTIN_EXPECT(!sb || !table || !zero_block, 0)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(zero_block, 0x00, BLKFS_BLOCK_SIZE);
+	memset(table, 0x00, BLKFS_TABLE_BLOCKS * BLKFS_BLOCK_SIZE);
+	memset(files, 0x00, sizeof(files));
+
+	nr_blocks = MIN(info.sectors / BLKFS_SECTORS, 0xFFFFFFFFULL);
+
+	ret = blk_read(0, sb, BLKFS_BLOCK_SIZE);
+	if (ret < 0)
+		goto out;
+
+	if ((sb->magic != BLKFS_MAGIC) || (sb->version != BLKFS_VERSION) || (sb->block_size != BLKFS_BLOCK_SIZE)
+	    || (sb->max_files != BLKFS_MAX_FILES) || (sb->table_start != BLKFS_TABLE_START)
+	    || (sb->data_start != BLKFS_DATA_START)) {
+		if (info.read_only) {
+			LOG_ERROR("blkfs: read-only device isn't formatted\n");
+			ret = -EROFS;
+			goto out;
+		}
+
+		LOG_INFO("blkfs: format device with %llu blocks\n", nr_blocks);
+
+		memset(sb, 0x00, BLKFS_BLOCK_SIZE);
+		sb->magic = BLKFS_MAGIC;
+		sb->version = BLKFS_VERSION;
+		sb->block_size = BLKFS_BLOCK_SIZE;
+		sb->nr_blocks = nr_blocks;
+		sb->max_files = BLKFS_MAX_FILES;
+		sb->table_start = BLKFS_TABLE_START;
+		sb->data_start = BLKFS_DATA_START;
+
+		// the table has to be valid, before the superblock refers to it
+		ret = table_write();
+		if (!ret)
+			ret = blk_flush();
+		if (!ret && (blk_write(0, sb, BLKFS_BLOCK_SIZE) < 0))
+			ret = -EIO;
+		if (!ret)
+			ret = blk_flush();
+		if (ret)
+			goto out;
+	} else {
+		ret = blk_read(BLKFS_TABLE_START * BLKFS_SECTORS, table, BLKFS_TABLE_BLOCKS * BLKFS_BLOCK_SIZE);
+		if (ret < 0)
+			goto out;
+		ret = 0;
+
+		nr_blocks = MIN(nr_blocks, sb->nr_blocks);
+
+		// drop free and inconsistent entries
+		for (uint32_t i=0; i<BLKFS_MAX_FILES; i++) {
+			blkfs_entry_t* e = table + i;
+			uint32_t j;
+
+			e->name[BLKFS_NAME_MAX-1] = '\0';
+			for (j=0; (j<e->nr_extents) && (j<BLKFS_MAX_EXTENTS); j++) {
+				if ((e->extents[j].start < BLKFS_DATA_START)
+				    || ((uint64_t) e->extents[j].start + e->extents[j].count > nr_blocks))
+					break;
+			}
+
+			if (e->name[0] && ((e->nr_extents > BLKFS_MAX_EXTENTS) || (j < e->nr_extents)
+			    || (e->size > (entry_blocks(e) << BLKFS_BLOCK_BITS)))) {
+				LOG_ERROR("blkfs: file %s is inconsistent and dropped\n", e->name);
+				e->name[0] = '\0';
+			}
+			if (!e->name[0])
+				memset(e, 0x00, sizeof(blkfs_entry_t));
+		}
+	}
+
+	LOG_INFO("blkfs: %s mounted with %llu blocks of %lu bytes\n", BLKFS_PATH, nr_blocks, BLKFS_BLOCK_SIZE);
+
+out:
+	if (sb)
+		kfree(sb);
+	if (ret < 0) {
+		if (table)
+			kfree(table);
+		if (zero_block)
+			kfree(zero_block);
+		table = NULL;
+		zero_block = NULL;
+		return ret;
+	}
+
+	return 0;
+}
+
+int blkfs_open(const char* name, int flags, int mode)
+{
+	const char* rel = name + sizeof(BLKFS_PATH);
+	blkfs_entry_t* e = NULL;
+	int fd, ret;
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(strlen(rel) >= BLKFS_NAME_MAX, 0))
+		return -ENAMETOOLONG;
+
+	sem_wait(&blkfs_sem, 0);
+
+	for (fd = 0; (fd < BLKFS_MAX_OPEN) && fds[fd].file; fd++)
+		;
+	if (BUILTIN_EXPECT(fd >= BLKFS_MAX_OPEN, 0)) {
+		ret = -ENFILE;
+		goto out;
+	}
+
+	for (i = 0; i < BLKFS_MAX_FILES; i++) {
+		if (table[i].name[0] && !strcmp(table[i].name, rel)) {
+			e = table + i;
+			break;
+		}
+	}
+
+	if (e) {
+		if ((flags & (BLKFS_O_CREAT|BLKFS_O_EXCL)) == (BLKFS_O_CREAT|BLKFS_O_EXCL)) {
+			ret = -EEXIST;
+			goto out;
+		}
+		// the extents are kept for rewriting
+		if ((flags & BLKFS_O_TRUNC) && ((flags & BLKFS_O_ACCMODE) != BLKFS_O_RDONLY) && e->size) {
+			e->size = 0;
+			files[i].dirty = 1;
+		}
+	} else {
+		if (!(flags & BLKFS_O_CREAT)) {
+			ret = -ENOENT;
+			goto out;
+		}
+
+		// a free entry isn't used by an unlinked file, which is still open
+		for (i = 0; (i < BLKFS_MAX_FILES) && (table[i].name[0] || files[i].refs); i++)
+			;
+		if (BUILTIN_EXPECT(i >= BLKFS_MAX_FILES, 0)) {
+			ret = -ENFILE;
+			goto out;
+		}
+
+		e = table + i;
+		memset(e, 0x00, sizeof(blkfs_entry_t));
+		strcpy(e->name, rel);
+
+		ret = table_write();
+		if (ret) {
+			e->name[0] = '\0';
+			goto out;
+		}
+	}
+
+	files[i].refs++;
+	fds[fd].file = i + 1;
+	fds[fd].pos = 0;
+	fds[fd].flags = flags;
+	ret = fd | BLKFS_FD_BIT;
+
+out:
+	sem_post(&blkfs_sem);
+
+	return ret;
+}
+
+ssize_t blkfs_read(int fd, void* buf, size_t len)
+{
+	blkfs_fd_t* desc = blkfs_get(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & BLKFS_O_ACCMODE) == BLKFS_O_WRONLY), 0))
+		return -EBADF;
+
+	ret = file_read(desc, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+	return ret;
+}
+
+ssize_t blkfs_write(int fd, const void* buf, size_t len)
+{
+	blkfs_fd_t* desc = blkfs_get(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & BLKFS_O_ACCMODE) == BLKFS_O_RDONLY), 0))
+		return -EBADF;
+
+	if (desc->flags & BLKFS_O_APPEND)
+		desc->pos = fd_entry(desc)->size;
+
+	ret = file_write(desc, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+	return ret;
+}
+
+ssize_t blkfs_pread(int fd, void* buf, size_t len, off_t offset)
+{
+	blkfs_fd_t* desc = blkfs_get(fd);
+
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & BLKFS_O_ACCMODE) == BLKFS_O_WRONLY), 0))
+		return -EBADF;
+
+	return file_read(desc, buf, len, offset);
+}
+
+ssize_t blkfs_pwrite(int fd, const void* buf, size_t len, off_t offset)
+{
+	blkfs_fd_t* desc = blkfs_get(fd);
+
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & BLKFS_O_ACCMODE) == BLKFS_O_RDONLY), 0))
+		return -EBADF;
+
+	return file_write(desc, buf, len, offset);
+}
+
+off_t blkfs_lseek(int fd, off_t offset, int whence)
+{
+	blkfs_fd_t* desc;
+	off_t ret;
+
+	sem_wait(&blkfs_sem, 0);
+
+	desc = blkfs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	switch(whence) {
+	case BLKFS_SEEK_SET:
+		ret = offset;
+		break;
+	case BLKFS_SEEK_CUR:
+		ret = desc->pos + offset;
+		break;
+	case BLKFS_SEEK_END:
+		ret = (off_t) fd_entry(desc)->size + offset;
+		break;
+	default:
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (BUILTIN_EXPECT(ret < 0, 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	desc->pos = ret;
+
+out:
+	sem_post(&blkfs_sem);
+
+	return ret;
+}
+
+int blkfs_fsync(int fd)
+{
+	blkfs_fd_t* desc;
+	int ret = 0;
+
+	sem_wait(&blkfs_sem, 0);
+
+	desc = blkfs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0))
+		ret = -EBADF;
+	else if (files[desc->file - 1].dirty)
+		ret = table_write();
+
+	sem_post(&blkfs_sem);
+
+	if (!ret && blk_flush())
+		ret = -EIO;
+
+	return ret;
+}
+
+int blkfs_close(int fd)
+{
+	blkfs_fd_t* desc;
+	uint32_t i;
+	int ret = 0;
+
+	sem_wait(&blkfs_sem, 0);
+
+	desc = blkfs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		sem_post(&blkfs_sem);
+		return -EBADF;
+	}
+
+	i = desc->file - 1;
+	desc->file = 0;
+
+	files[i].refs--;
+	if (!table[i].name[0]) {
+		// the unlinked file is already free on the device
+		if (!files[i].refs)
+			memset(table + i, 0x00, sizeof(blkfs_entry_t));
+	} else if (files[i].dirty) {
+		ret = table_write();
+	}
+
+	sem_post(&blkfs_sem);
+
+	return ret;
+}
+
+int blkfs_unlink(const char* name)
+{
+	const char* rel = name + sizeof(BLKFS_PATH);
+	int ret = -ENOENT;
+
+	sem_wait(&blkfs_sem, 0);
+
+	for (uint32_t i=0; i<BLKFS_MAX_FILES; i++) {
+		if (!table[i].name[0] || strcmp(table[i].name, rel))
+			continue;
+
+		// open descriptors keep the extents until the last close
+		if (files[i].refs)
+			table[i].name[0] = '\0';
+		else
+			memset(table + i, 0x00, sizeof(blkfs_entry_t));
+
+		ret = table_write();
+		break;
+	}
+
+	sem_post(&blkfs_sem);
+
+	return ret;
+}
+
+int blkfs_map(int fd, off_t offset, uint64_t* sector, size_t* len)
+{
+	blkfs_fd_t* desc;
+	blkfs_entry_t* e;
+	size_t avail;
+	int ret;
+
+	if (BUILTIN_EXPECT((offset < 0) || (offset & (BLK_SECTOR_SIZE-1)) || !sector || !len || !*len, 0))
+		return -EINVAL;
+
+	sem_wait(&blkfs_sem, 0);
+
+	desc = blkfs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	e = fd_entry(desc);
+	if ((desc->flags & BLKFS_O_ACCMODE) != BLKFS_O_RDONLY) {
+		ret = entry_grow(e, offset + *len);
+		if (ret)
+			goto out;
+		if (offset + *len > e->size) {
+			e->size = offset + *len;
+			files[desc->file - 1].dirty = 1;
+		}
+	} else if ((uint64_t) offset >= e->size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = extent_locate(e->extents, e->nr_extents, offset, sector, &avail);
+	if (!ret)
+		*len = MIN(*len, avail);
+
+out:
+	sem_post(&blkfs_sem);
+
+	return ret;
+}
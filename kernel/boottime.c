@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file kernel/boottime.c
+ * @brief Time stamps of the boot phases
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/boottime.h>
+#include <hermit/clocksource.h>
+#include <hermit/logging.h>
+
+/*
+ * The table is written before the .bss section is initialized by initd
+ * => we place it explicitly in the .data section
+ */
+boot_phase_t boot_phases[BOOT_PHASE_MAX] __attribute__ ((section (".data"))) = {[0 ... BOOT_PHASE_MAX-1] = {0, 0}};
+uint64_t boot_phases_hz __attribute__ ((section (".data"))) = 0;
+
+static const char* const boot_phase_names[BOOT_PHASE_MAX] = {
+	[BOOT_PHASE_LOADER] = "loader",
+	[BOOT_PHASE_HERMIT_INIT] = "hermit_init",
+	[BOOT_PHASE_MEMORY_INIT] = "memory_init",
+	[BOOT_PHASE_PAGE_INIT] = "page_init",
+	[BOOT_PHASE_SYSTEM_CALIBRATION] = "system_calibration",
+	[BOOT_PHASE_SMP_INIT] = "smp_init",
+	[BOOT_PHASE_BSS] = "bss",
+	[BOOT_PHASE_INIT_NETIFS] = "init_netifs",
+	[BOOT_PHASE_DHCP] = "dhcp",
+	[BOOT_PHASE_LIBC_START] = "libc_start",
+};
+
+/// convert counter values to us without overflowing the multiplication
+static uint64_t ticks_to_us(uint64_t ticks, uint64_t hz)
+{
+	return (ticks / hz) * 1000000ULL + ((ticks % hz) * 1000000ULL) / hz;
+}
+
+void boottime_dump(void)
+{
+	const uint64_t hz = clocksource_tsc_hz();
+	uint32_t i;
+
+	boot_phase_begin(BOOT_PHASE_LIBC_START);
+	boot_phases[BOOT_PHASE_LIBC_START].end = boot_phases[BOOT_PHASE_LIBC_START].start;
+	boot_phases_hz = hz;
+
+	if (BUILTIN_EXPECT(!hz, 0))
+		return;
+
+	LOG_INFO("Boot phases (start in us since the loader, duration in us):\n");
+	for (i = 0; i < BOOT_PHASE_MAX; i++) {
+		const boot_phase_t* phase = boot_phases + i;
+
+		if (!phase->end)
+			continue;
+
+		LOG_INFO("  %-20s %10llu %10llu\n", boot_phase_names[i],
+			ticks_to_us(phase->start, hz),
+			ticks_to_us(phase->end - phase->start, hz));
+	}
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file kernel/clocksource.c
+ * @brief Selection of the source of the monotonic time
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/clocksource.h>
+#include <hermit/processor.h>
+#include <hermit/time.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+static clocksource_t* curr_cs = NULL;
+
+int clocksource_init(void)
+{
+	clocksource_t* best = NULL;
+	uint32_t i;
+
+	if (curr_cs)
+		return 0;
+
+	for(i=0; arch_clocksources[i]; i++) {
+		clocksource_t* cs = arch_clocksources[i];
+
+		if (cs->probe(cs))
+			continue;
+
+		LOG_INFO("clocksource: %s is usable (rating %d, %zd Hz)\n", cs->name, cs->rating, cs->freq_hz);
+
+		if (!best || (cs->rating > best->rating))
+			best = cs;
+	}
+
+	if (BUILTIN_EXPECT(!best, 0)) {
+		LOG_WARNING("clocksource: no usable source, keep the calibrated frequency\n");
+		return -ENODEV;
+	}
+
+	// continue the uptime, which has been measured so far
+	best->offset = best->read() - 1000000ULL * get_uptime();
+
+	mb();
+	curr_cs = best;
+
+	LOG_INFO("clocksource: use %s\n", best->name);
+
+	return 0;
+}
+
+int clocksource_enable_cpu(void)
+{
+	clocksource_t* cs = curr_cs;
+
+	if (!cs || !cs->enable_cpu)
+		return 0;
+
+	return cs->enable_cpu(cs);
+}
+
+const clocksource_t* clocksource_get(void)
+{
+	return curr_cs;
+}
+
+uint64_t clocksource_ns(void)
+{
+	const clocksource_t* cs = curr_cs;
+
+	if (BUILTIN_EXPECT(!cs, 0))
+		return 1000000ULL * get_uptime();
+
+	return cs->read() - cs->offset;
+}
+
+uint64_t clocksource_tsc_hz(void)
+{
+	const clocksource_t* cs = curr_cs;
+
+	if (cs && cs->freq_hz)
+		return cs->freq_hz;
+
+#ifdef __aarch64__
+	// get_rdtsc() reads the counter of the generic timer
+	return get_cntfrq();
+#else
+	return 1000000ULL * (uint64_t) get_cpu_frequency();
+#endif
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/console.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/semaphore.h>
+#include <hermit/time.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/atomic.h>
+#include <asm/uhyve.h>
+
+typedef struct {
+	spinlock_irqsave_t lock;
+	uint32_t len;
+	/// time stamp of the oldest buffered byte
+	uint64_t first;
+	char data[CONSOLE_BUFSIZE ? CONSOLE_BUFSIZE : 1];
+} __attribute__ ((aligned (CACHE_LINE))) conbuf_t;
+
+extern spinlock_irqsave_t stdio_lock;
+
+/// one buffer per core for stdout and stderr
+static conbuf_t conbuf[MAX_CORES][2];
+static volatile uint8_t enabled = 0;
+/// is the flusher already woken up?
+static atomic_int32_t armed = ATOMIC_INIT(0);
+static sem_t flush_sem = SEM_INIT(0);
+
+static void con_output(int fd, const char* buf, size_t len)
+{
+	size_t i;
+
+	if (is_uhyve()) {
+		uhyve_write_t uhyve_args = {fd, buf, len};
+
+		uhyve_send(UHYVE_PORT_WRITE, (unsigned)virt_to_phys((size_t)&uhyve_args));
+	} else {
+		spinlock_irqsave_lock(&stdio_lock);
+		for(i=0; i<len; i++)
+			kputchar(buf[i]);
+		spinlock_irqsave_unlock(&stdio_lock);
+	}
+}
+
+/// has to be called with cb->lock held
+static inline void con_flush(conbuf_t* cb, int fd)
+{
+	if (cb->len) {
+		con_output(fd, cb->data, cb->len);
+		cb->len = 0;
+	}
+}
+
+static int console_flusher(void* arg)
+{
+	while (1) {
+		sem_wait(&flush_sem, 0);
+		timer_wait_ns(CONSOLE_FLUSH_MS * 1000000ULL);
+
+		// new output arms the flusher again
+		atomic_int32_set(&armed, 0);
+		console_flush();
+	}
+
+	return 0;
+}
+
+int console_init(void)
+{
+	if (!CONSOLE_BUFSIZE)
+		return 0;
+
+	for(uint32_t i=0; i<MAX_CORES; i++) {
+		spinlock_irqsave_init(&conbuf[i][0].lock);
+		spinlock_irqsave_init(&conbuf[i][1].lock);
+	}
+
+	if (BUILTIN_EXPECT(create_kernel_task(NULL, console_flusher, NULL, HIGH_PRIO), 0)) {
+		LOG_ERROR("console: unable to create the flusher\n");
+		return -ENOMEM;
+	}
+
+	enabled = 1;
+
+	return 0;
+}
+
+int console_buffered(int fd)
+{
+	return enabled && ((fd == 1) || (fd == 2));
+}
+
+ssize_t console_write(int fd, const char* buf, size_t len)
+{
+	conbuf_t* cb = &conbuf[CORE_ID][fd-1];
+	int arm = 0, newline = 0;
+	size_t i;
+
+	// the lock is taken on the current core => a migration is harmless
+	spinlock_irqsave_lock(&cb->lock);
+
+	if (cb->len + len > CONSOLE_BUFSIZE)
+		con_flush(cb, fd);
+
+	// large writes don't need the buffer
+	if (len >= CONSOLE_BUFSIZE) {
+		con_output(fd, buf, len);
+		spinlock_irqsave_unlock(&cb->lock);
+		return len;
+	}
+
+	if (!cb->len) {
+		cb->first = get_rdtsc();
+		arm = 1;
+	}
+
+	for(i=0; i<len; i++) {
+		cb->data[cb->len+i] = buf[i];
+		if (buf[i] == '\n')
+			newline = 1;
+	}
+	cb->len += len;
+
+	if (newline && (get_rdtsc() - cb->first >= ns_to_tsc(CONSOLE_FLUSH_MS * 1000000ULL))) {
+		con_flush(cb, fd);
+		arm = 0;
+	}
+
+	spinlock_irqsave_unlock(&cb->lock);
+
+	if (arm && !atomic_int32_test_and_set(&armed, 1))
+		sem_post(&flush_sem);
+
+	return len;
+}
+
+void console_flush(void)
+{
+	conbuf_t* cb;
+	uint32_t i;
+	int fd;
+
+	if (!enabled)
+		return;
+
+	for(i=0; i<MAX_CORES; i++) {
+		for(fd=1; fd<=2; fd++) {
+			cb = &conbuf[i][fd-1];
+			// unlocked check, the writer arms the flusher again
+			if (!cb->len)
+				continue;
+
+			spinlock_irqsave_lock(&cb->lock);
+			con_flush(cb, fd);
+			spinlock_irqsave_unlock(&cb->lock);
+		}
+	}
+}
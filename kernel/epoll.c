@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/epoll.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/time.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+#include <lwip/opt.h>
+#include <lwip/api.h>
+#include <lwip/sockets.h>
+#include <lwip/priv/sockets_priv.h>
+
+#define NUM_SOCKETS		MEMP_NUM_NETCONN
+
+/// events, which are always reported
+#define EPOLL_ALWAYS		(EPOLLERR|EPOLLHUP)
+#define EPOLL_FLAGS		(EPOLLET|EPOLLONESHOT)
+
+struct epoll;
+
+/** @brief Registration of a socket at an epoll instance */
+typedef struct epitem {
+	/// owning epoll instance
+	struct epoll* ep;
+	/// index of the socket in epoll_socks
+	int sock;
+	/// file descriptor, as it is passed by the user
+	int fd;
+	/// events of interest, EPOLLET and EPOLLONESHOT
+	uint32_t events;
+	epoll_data_t data;
+	/// is the item part of the ready list?
+	uint8_t ready;
+	/// next item of the instance
+	struct epitem* ep_next;
+	/// next item of the same socket
+	struct epitem* sock_next;
+	/// next item of the ready list
+	struct epitem* rd_next;
+} epitem_t;
+
+/** @brief Task, which waits in epoll_wait() */
+typedef struct epoll_waiter {
+	task_t* task;
+	struct epoll_waiter* next;
+} epoll_waiter_t;
+
+/** @brief Represents an epoll instance */
+typedef struct epoll {
+	uint8_t used;
+	/// incremented by epoll_close() to detect a stale descriptor
+	uint32_t gen;
+	epitem_t* items;
+	epitem_t* rd_first;
+	epitem_t* rd_last;
+	epoll_waiter_t* waiters;
+} epoll_t;
+
+/** @brief Sockets, which are registered at least at one instance */
+typedef struct epoll_sock {
+	struct lwip_sock* sock;
+	struct netconn* conn;
+	epitem_t* items;
+} epoll_sock_t;
+
+static epoll_t epolls[MAX_EPOLL];
+static epoll_sock_t epoll_socks[NUM_SOCKETS];
+/// protects all instances and registrations
+static spinlock_irqsave_t epoll_lock = SPINLOCK_IRQSAVE_INIT;
+/// event callback of LwIP's socket layer
+static netconn_callback lwip_event_callback = NULL;
+
+/*
+ * Reads LwIP's socket state without its lock. All fields are single
+ * words and a stale value is corrected by the next event callback.
+ */
+static uint32_t epoll_sock_poll(struct lwip_sock* sock)
+{
+	uint32_t revents = 0;
+
+	if ((sock->rcvevent > 0) || sock->lastdata.pbuf)
+		revents |= EPOLLIN;
+	if (sock->sendevent)
+		revents |= EPOLLOUT;
+	if (sock->errevent)
+		revents |= EPOLLERR;
+
+	return revents;
+}
+
+static inline uint32_t epitem_poll(epitem_t* item)
+{
+	// a disarmed one-shot item doesn't report errors either
+	if ((item->events & EPOLLONESHOT) && !(item->events & ~EPOLL_FLAGS))
+		return 0;
+
+	return epoll_sock_poll(epoll_socks[item->sock].sock) & (item->events | EPOLL_ALWAYS);
+}
+
+static void epoll_wakeup(epoll_t* ep)
+{
+	epoll_waiter_t* w;
+
+	for(w = ep->waiters; w; w = w->next)
+		wakeup_task(w->task->id);
+	ep->waiters = NULL;
+}
+
+static void epoll_dequeue_waiter(epoll_t* ep, epoll_waiter_t* waiter)
+{
+	epoll_waiter_t** w;
+
+	// after a timeout, the task is still part of the wait list
+	for(w = &ep->waiters; *w; w = &(*w)->next) {
+		if (*w == waiter) {
+			*w = waiter->next;
+			break;
+		}
+	}
+}
+
+static void epoll_ready(epitem_t* item)
+{
+	epoll_t* ep = item->ep;
+
+	if (item->ready)
+		return;
+
+	item->ready = 1;
+	item->rd_next = NULL;
+	if (ep->rd_last)
+		ep->rd_last->rd_next = item;
+	else
+		ep->rd_first = item;
+	ep->rd_last = item;
+
+	epoll_wakeup(ep);
+}
+
+static void epoll_unready(epitem_t* item)
+{
+	epoll_t* ep = item->ep;
+	epitem_t* prev = NULL;
+	epitem_t* tmp;
+
+	if (!item->ready)
+		return;
+
+	for(tmp = ep->rd_first; tmp; prev = tmp, tmp = tmp->rd_next) {
+		if (tmp != item)
+			continue;
+
+		if (prev)
+			prev->rd_next = item->rd_next;
+		else
+			ep->rd_first = item->rd_next;
+		if (ep->rd_last == item)
+			ep->rd_last = prev;
+		break;
+	}
+
+	item->rd_next = NULL;
+	item->ready = 0;
+}
+
+/*
+ * Wraps the event callback of LwIP's socket layer. Accepted connections
+ * inherit the callback of the listening netconn and pass it on unchanged,
+ * if they aren't registered.
+ */
+static void epoll_event_callback(struct netconn* conn, enum netconn_evt evt, u16_t len)
+{
+	epoll_sock_t* es;
+	epitem_t* item;
+	int s;
+
+	lwip_event_callback(conn, evt, len);
+
+	// only rising edges could make a socket ready
+	if ((evt == NETCONN_EVT_RCVMINUS) || (evt == NETCONN_EVT_SENDMINUS))
+		return;
+
+	s = conn->socket - LWIP_SOCKET_OFFSET;
+	if ((s < 0) || (s >= NUM_SOCKETS))
+		return;
+
+	spinlock_irqsave_lock(&epoll_lock);
+	es = epoll_socks + s;
+	if (es->conn == conn) {
+		for(item = es->items; item; item = item->sock_next) {
+			if (epitem_poll(item))
+				epoll_ready(item);
+		}
+	}
+	spinlock_irqsave_unlock(&epoll_lock);
+}
+
+static inline epoll_t* epoll_get(int epfd)
+{
+	int i;
+
+	if (!(epfd & EPOLL_FD_BIT))
+		return NULL;
+
+	i = epfd & ~EPOLL_FD_BIT;
+	if ((i < 0) || (i >= MAX_EPOLL) || !epolls[i].used)
+		return NULL;
+
+	return epolls + i;
+}
+
+static void epitem_remove(epitem_t* item)
+{
+	epoll_t* ep = item->ep;
+	epoll_sock_t* es = epoll_socks + item->sock;
+	epitem_t** tmp;
+
+	epoll_unready(item);
+
+	for(tmp = &ep->items; *tmp; tmp = &(*tmp)->ep_next) {
+		if (*tmp == item) {
+			*tmp = item->ep_next;
+			break;
+		}
+	}
+
+	for(tmp = &es->items; *tmp; tmp = &(*tmp)->sock_next) {
+		if (*tmp == item) {
+			*tmp = item->sock_next;
+			break;
+		}
+	}
+
+	// restore LwIP's callback, if the socket isn't registered anymore
+	if (!es->items) {
+		if (es->conn && (es->conn->callback == epoll_event_callback))
+			es->conn->callback = lwip_event_callback;
+		es->conn = NULL;
+		es->sock = NULL;
+	}
+
+	kfree(item);
+}
+
+int epoll_create(int flags)
+{
+	int i, ret = -ENFILE;
+
+	if (BUILTIN_EXPECT(flags, 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&epoll_lock);
+	for(i = 0; i < MAX_EPOLL; i++) {
+		if (!epolls[i].used) {
+			epolls[i].used = 1;
+			epolls[i].items = NULL;
+			epolls[i].rd_first = epolls[i].rd_last = NULL;
+			epolls[i].waiters = NULL;
+			ret = i | EPOLL_FD_BIT;
+			break;
+		}
+	}
+	spinlock_irqsave_unlock(&epoll_lock);
+
+	return ret;
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
+{
+	struct lwip_sock* sock;
+	epoll_sock_t* es;
+	epitem_t* item;
+	epitem_t* new_item = NULL;
+	epoll_t* ep;
+	int s, ret = 0;
+
+	if (!(fd & LWIP_FD_BIT))
+		return -EPERM;
+	if (BUILTIN_EXPECT((op != EPOLL_CTL_DEL) && !event, 0))
+		return -EINVAL;
+
+	s = (fd & ~LWIP_FD_BIT) - LWIP_SOCKET_OFFSET;
+	if ((s < 0) || (s >= NUM_SOCKETS))
+		return -EBADF;
+
+	sock = lwip_socket_dbg_get_socket(fd & ~LWIP_FD_BIT);
+	if (!sock || !sock->conn)
+		return -EBADF;
+
+	// allocate outside of the lock, which is also taken by LwIP's callback
+	if (op == EPOLL_CTL_ADD) {
+		new_item = kmalloc(sizeof(epitem_t));
+		if (BUILTIN_EXPECT(!new_item, 0))
+			return -ENOMEM;
+	}
+
+	spinlock_irqsave_lock(&epoll_lock);
+
+	ep = epoll_get(epfd);
+	if (!ep) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	es = epoll_socks + s;
+	// the slot could still belong to a closed socket
+	if (es->conn && (es->conn != sock->conn)) {
+		es->conn = NULL;
+		while (es->items)
+			epitem_remove(es->items);
+	}
+
+	for(item = es->items; item; item = item->sock_next) {
+		if (item->ep == ep)
+			break;
+	}
+
+	switch(op) {
+	case EPOLL_CTL_ADD:
+		if (item) {
+			ret = -EEXIST;
+			break;
+		}
+
+		if (!lwip_event_callback)
+			lwip_event_callback = sock->conn->callback;
+		if (BUILTIN_EXPECT(!lwip_event_callback, 0)) {
+			ret = -EPERM;
+			break;
+		}
+
+		item = new_item;
+		new_item = NULL;
+		memset(item, 0x00, sizeof(epitem_t));
+		item->ep = ep;
+		item->sock = s;
+		item->fd = fd;
+		item->events = event->events;
+		item->data = event->data;
+		item->ep_next = ep->items;
+		ep->items = item;
+		item->sock_next = es->items;
+		es->items = item;
+		es->sock = sock;
+		es->conn = sock->conn;
+		sock->conn->callback = epoll_event_callback;
+
+		if (epitem_poll(item))
+			epoll_ready(item);
+		break;
+	case EPOLL_CTL_MOD:
+		if (!item) {
+			ret = -ENOENT;
+			break;
+		}
+
+		epoll_unready(item);
+		item->events = event->events;
+		item->data = event->data;
+		if (epitem_poll(item))
+			epoll_ready(item);
+		break;
+	case EPOLL_CTL_DEL:
+		if (!item) {
+			ret = -ENOENT;
+			break;
+		}
+
+		epitem_remove(item);
+		break;
+	default:
+		ret = -EINVAL;
+	}
+
+out:
+	spinlock_irqsave_unlock(&epoll_lock);
+
+	if (new_item)
+		kfree(new_item);
+
+	return ret;
+}
+
+/*
+ * Moves ready items to the user's buffer. Level-triggered items, which
+ * are still ready, are requeued behind the reported ones, so that a busy
+ * socket doesn't starve the others.
+ */
+static int epoll_harvest(epoll_t* ep, struct epoll_event* events, int maxevents)
+{
+	epitem_t* requeue_first = NULL;
+	epitem_t* requeue_last = NULL;
+	epitem_t* item;
+	uint32_t revents;
+	int n = 0;
+
+	while ((n < maxevents) && ep->rd_first) {
+		item = ep->rd_first;
+		ep->rd_first = item->rd_next;
+		if (!ep->rd_first)
+			ep->rd_last = NULL;
+		item->rd_next = NULL;
+		item->ready = 0;
+
+		revents = epitem_poll(item);
+		if (!revents)
+			continue;
+
+		events[n].events = revents;
+		events[n].data = item->data;
+		n++;
+
+		if (item->events & EPOLLONESHOT) {
+			// disarmed until EPOLL_CTL_MOD
+			item->events &= EPOLL_FLAGS;
+		} else if (!(item->events & EPOLLET)) {
+			item->ready = 1;
+			if (requeue_last)
+				requeue_last->rd_next = item;
+			else
+				requeue_first = item;
+			requeue_last = item;
+		}
+	}
+
+	if (requeue_first) {
+		if (ep->rd_last)
+			ep->rd_last->rd_next = requeue_first;
+		else
+			ep->rd_first = requeue_first;
+		ep->rd_last = requeue_last;
+	}
+
+	return n;
+}
+
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout)
+{
+	task_t* curr_task = per_core(current_task);
+	epoll_waiter_t waiter;
+	uint64_t deadline = 0;
+	epoll_t* ep;
+	uint32_t gen;
+	int n;
+
+	if (BUILTIN_EXPECT(!events || (maxevents <= 0), 0))
+		return -EINVAL;
+
+	if (timeout > 0)
+		deadline = get_rdtsc() + ns_to_tsc((uint64_t) timeout * 1000000ULL);
+
+	spinlock_irqsave_lock(&epoll_lock);
+
+	ep = epoll_get(epfd);
+	if (!ep) {
+		spinlock_irqsave_unlock(&epoll_lock);
+		return -EBADF;
+	}
+	gen = ep->gen;
+
+	while (1) {
+		n = epoll_harvest(ep, events, maxevents);
+		if (n || !timeout)
+			break;
+		if (deadline && (get_rdtsc() >= deadline))
+			break;
+
+		waiter.task = curr_task;
+		waiter.next = ep->waiters;
+		ep->waiters = &waiter;
+		if (deadline)
+			set_timer_tsc(deadline);
+		else
+			block_current_task();
+		spinlock_irqsave_unlock(&epoll_lock);
+		reschedule();
+		spinlock_irqsave_lock(&epoll_lock);
+
+		if (!ep->used || (ep->gen != gen)) {
+			n = -EBADF;
+			break;
+		}
+		epoll_dequeue_waiter(ep, &waiter);
+	}
+
+	spinlock_irqsave_unlock(&epoll_lock);
+
+	return n;
+}
+
+int epoll_close(int epfd)
+{
+	epoll_t* ep;
+
+	spinlock_irqsave_lock(&epoll_lock);
+
+	ep = epoll_get(epfd);
+	if (!ep) {
+		spinlock_irqsave_unlock(&epoll_lock);
+		return -EBADF;
+	}
+
+	while (ep->items)
+		epitem_remove(ep->items);
+
+	epoll_wakeup(ep);
+	ep->gen++;
+	ep->used = 0;
+
+	spinlock_irqsave_unlock(&epoll_lock);
+
+	return 0;
+}
+
+void epoll_socket_close(int fd)
+{
+	epoll_sock_t* es;
+	int s;
+
+	s = (fd & ~LWIP_FD_BIT) - LWIP_SOCKET_OFFSET;
+	if ((s < 0) || (s >= NUM_SOCKETS))
+		return;
+
+	spinlock_irqsave_lock(&epoll_lock);
+	es = epoll_socks + s;
+	while (es->items)
+		epitem_remove(es->items);
+	spinlock_irqsave_unlock(&epoll_lock);
+}
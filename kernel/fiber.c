@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/fiber.h>
+#include <hermit/futex.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/tasks.h>
+
+static inline void fiber_queue_push(fiber_sched_t* sched, fiber_t* fiber)
+{
+	fiber->next = NULL;
+	fiber->prev = sched->last;
+	if (sched->last)
+		sched->last->next = fiber;
+	else
+		sched->first = fiber;
+	sched->last = fiber;
+}
+
+static inline void fiber_queue_remove(fiber_sched_t* sched, fiber_t* fiber)
+{
+	if (fiber->prev)
+		fiber->prev->next = fiber->next;
+	else
+		sched->first = fiber->next;
+	if (fiber->next)
+		fiber->next->prev = fiber->prev;
+	else
+		sched->last = fiber->prev;
+	fiber->next = fiber->prev = NULL;
+}
+
+/** @brief Pass the carrier to the next ready fiber
+ *
+ * Has to be called with the lock of the scheduler, which is released.
+ * The current fiber isn't ready (blocked or finished). If no fiber is
+ * ready, the carrier blocks until a fiber is woken up.
+ */
+static void fiber_schedule(fiber_sched_t* sched)
+{
+	fiber_t* curr = sched->curr;
+	fiber_t* next;
+
+	while(1) {
+		// the fiber was woken up before it left the carrier
+		if (curr->status == FIBER_READY) {
+			curr->status = FIBER_RUNNING;
+			spinlock_irqsave_unlock(&sched->lock);
+			return;
+		}
+
+		if ((next = sched->first) != NULL) {
+			fiber_queue_remove(sched, next);
+			next->status = FIBER_RUNNING;
+			sched->curr = next;
+			spinlock_irqsave_unlock(&sched->lock);
+
+			fiber_switch(&curr->stack_ptr, next->stack_ptr);
+			return;
+		}
+
+		// all fibers wait => the carrier blocks until fiber_wakeup()
+		sched->idle = 1;
+		block_current_task();
+		spinlock_irqsave_unlock(&sched->lock);
+
+		reschedule();
+
+		spinlock_irqsave_lock(&sched->lock);
+	}
+}
+
+/** @brief First function of a new fiber, called by fiber_switch() */
+static void NORETURN fiber_entry(void)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+	fiber_t* curr = sched->curr;
+
+	curr->result = curr->func(curr->arg);
+
+	spinlock_irqsave_lock(&sched->lock);
+	curr->status = FIBER_FINISHED;
+	fiber_schedule(sched);
+
+	// a finished fiber is never selected again
+	LOG_ERROR("Kernel panic: finished fiber %p got the carrier\n", curr);
+	while(1) {
+		HALT;
+	}
+}
+
+int fiber_init(void)
+{
+	task_t* curr_task = per_core(current_task);
+	fiber_sched_t* sched;
+
+	if (BUILTIN_EXPECT(curr_task->fibers != NULL, 0))
+		return -EBUSY;
+
+	sched = kmalloc(sizeof(fiber_sched_t));
+	if (BUILTIN_EXPECT(!sched, 0))
+		return -ENOMEM;
+
+	memset(sched, 0x00, sizeof(fiber_sched_t));
+	spinlock_irqsave_init(&sched->lock);
+	sched->carrier = curr_task->id;
+	sched->main.status = FIBER_RUNNING;
+	sched->main.sched = sched;
+	sched->curr = &sched->main;
+
+	curr_task->fibers = sched;
+
+	return 0;
+}
+
+int fiber_create(fiber_t** fiber, entry_point_t func, void* arg, size_t stack_size)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+	fiber_t* new_fiber;
+
+	if (BUILTIN_EXPECT(!fiber || !func || !sched, 0))
+		return -EINVAL;
+
+	if (!stack_size)
+		stack_size = FIBER_STACK_SIZE;
+
+	new_fiber = kmalloc(sizeof(fiber_t));
+	if (BUILTIN_EXPECT(!new_fiber, 0))
+		return -ENOMEM;
+
+	memset(new_fiber, 0x00, sizeof(fiber_t));
+	new_fiber->stack = kmalloc(stack_size);
+	if (BUILTIN_EXPECT(!new_fiber->stack, 0)) {
+		kfree(new_fiber);
+		return -ENOMEM;
+	}
+
+	new_fiber->stack_ptr = create_fiber_frame(new_fiber->stack, stack_size, fiber_entry);
+	new_fiber->func = func;
+	new_fiber->arg = arg;
+	new_fiber->sched = sched;
+	new_fiber->status = FIBER_READY;
+
+	spinlock_irqsave_lock(&sched->lock);
+	fiber_queue_push(sched, new_fiber);
+	new_fiber->all_next = sched->all;
+	if (sched->all)
+		sched->all->all_prev = new_fiber;
+	sched->all = new_fiber;
+	spinlock_irqsave_unlock(&sched->lock);
+
+	*fiber = new_fiber;
+
+	return 0;
+}
+
+void fiber_yield(void)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+	fiber_t* curr;
+	fiber_t* next;
+
+	if (!sched)
+		return;
+
+	spinlock_irqsave_lock(&sched->lock);
+
+	if (!(next = sched->first)) {
+		spinlock_irqsave_unlock(&sched->lock);
+		return;
+	}
+
+	curr = sched->curr;
+	fiber_queue_remove(sched, next);
+	curr->status = FIBER_READY;
+	fiber_queue_push(sched, curr);
+	next->status = FIBER_RUNNING;
+	sched->curr = next;
+
+	spinlock_irqsave_unlock(&sched->lock);
+
+	fiber_switch(&curr->stack_ptr, next->stack_ptr);
+}
+
+int fiber_switch_to(fiber_t* fiber)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+	fiber_t* curr;
+
+	if (BUILTIN_EXPECT(!sched || !fiber || (fiber->sched != sched), 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&sched->lock);
+
+	if (BUILTIN_EXPECT(fiber->status != FIBER_READY, 0)) {
+		spinlock_irqsave_unlock(&sched->lock);
+		return -EINVAL;
+	}
+
+	curr = sched->curr;
+	fiber_queue_remove(sched, fiber);
+	curr->status = FIBER_READY;
+	fiber_queue_push(sched, curr);
+	fiber->status = FIBER_RUNNING;
+	sched->curr = fiber;
+
+	spinlock_irqsave_unlock(&sched->lock);
+
+	fiber_switch(&curr->stack_ptr, fiber->stack_ptr);
+
+	return 0;
+}
+
+int fiber_destroy(fiber_t* fiber, int* result)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+
+	if (BUILTIN_EXPECT(!sched || !fiber || (fiber->sched != sched) || !fiber->stack, 0))
+		return -EINVAL;
+
+	if (fiber->status != FIBER_FINISHED)
+		return -EBUSY;
+
+	if (result)
+		*result = fiber->result;
+
+	spinlock_irqsave_lock(&sched->lock);
+	if (fiber->all_prev)
+		fiber->all_prev->all_next = fiber->all_next;
+	else
+		sched->all = fiber->all_next;
+	if (fiber->all_next)
+		fiber->all_next->all_prev = fiber->all_prev;
+	spinlock_irqsave_unlock(&sched->lock);
+
+	kfree(fiber->stack);
+	kfree(fiber);
+
+	return 0;
+}
+
+fiber_t* fiber_current(void)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+
+	return sched ? sched->curr : NULL;
+}
+
+void fiber_block(spinlock_irqsave_t* lock)
+{
+	fiber_sched_t* sched = per_core(current_task)->fibers;
+
+	spinlock_irqsave_lock(&sched->lock);
+	sched->curr->status = FIBER_BLOCKED;
+
+	// a waker needs the lock to find the fiber => it sees the fiber blocked
+	if (lock) {
+		spinlock_irqsave_unlock(&sched->lock);
+		spinlock_irqsave_unlock(lock);
+		spinlock_irqsave_lock(&sched->lock);
+	}
+
+	fiber_schedule(sched);
+}
+
+int fiber_wakeup(fiber_t* fiber)
+{
+	fiber_sched_t* sched;
+	tid_t carrier = 0;
+
+	if (BUILTIN_EXPECT(!fiber, 0))
+		return -EINVAL;
+
+	sched = fiber->sched;
+	spinlock_irqsave_lock(&sched->lock);
+
+	if (BUILTIN_EXPECT(fiber->status != FIBER_BLOCKED, 0)) {
+		spinlock_irqsave_unlock(&sched->lock);
+		return -EINVAL;
+	}
+
+	fiber->status = FIBER_READY;
+
+	// the current fiber hasn't left the carrier yet => fiber_schedule() continues it
+	if (fiber != sched->curr)
+		fiber_queue_push(sched, fiber);
+
+	if (sched->idle) {
+		sched->idle = 0;
+		carrier = sched->carrier;
+	}
+
+	spinlock_irqsave_unlock(&sched->lock);
+
+	// the scheduler isn't touched after the unlock, a finished carrier ignores the wakeup
+	if (carrier)
+		wakeup_task(carrier);
+
+	return 0;
+}
+
+void fiber_release(task_t* task)
+{
+	fiber_sched_t* sched = task->fibers;
+	fiber_t* fiber;
+	fiber_t* next;
+
+	if (!sched)
+		return;
+
+	// afterwards, no waker knows the fibers anymore
+	if (sched->main.waiter)
+		futex_cancel(sched->main.waiter);
+	for(fiber = sched->all; fiber; fiber = fiber->all_next) {
+		if (fiber->waiter)
+			futex_cancel(fiber->waiter);
+	}
+
+	// the carrier runs on the stack of the current fiber until its last switch
+	for(fiber = sched->all; fiber; fiber = next) {
+		next = fiber->all_next;
+		if (fiber == sched->curr)
+			continue;
+
+		kfree(fiber->stack);
+		kfree(fiber);
+	}
+
+	if (sched->curr != &sched->main) {
+		sched->all = sched->curr;
+		sched->curr->all_next = sched->curr->all_prev = NULL;
+		return;
+	}
+
+	kfree(sched);
+	task->fibers = NULL;
+}
+
+void fiber_cleanup(task_t* task)
+{
+	fiber_sched_t* sched = task->fibers;
+
+	if (!sched)
+		return;
+
+	if (sched->all) {
+		kfree(sched->all->stack);
+		kfree(sched->all);
+	}
+
+	kfree(sched);
+	task->fibers = NULL;
+}
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/flexsc.h>
+#include <hermit/syscall.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/time.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <asm/processor.h>
+
+/// maximum number of registered syscall pages
+#define FLEXSC_MAX_PAGES	64
+/// maximum number of requests, which a syscall thread claims at once
+#define FLEXSC_BATCH		16
+
+typedef struct flexsc_page {
+	flexsc_entry_t* entries;
+	uint32_t count;
+	/// next entry, which the scan checks first
+	uint32_t next;
+} flexsc_page_t;
+
+/// protects the pages, the state transitions of the entries and the sleepers
+static spinlock_irqsave_t flexsc_lock = SPINLOCK_IRQSAVE_INIT;
+static flexsc_page_t pages[FLEXSC_MAX_PAGES];
+/// highest used slot of pages + 1
+static uint32_t nr_pages = 0;
+/// page, at which the next scan starts
+static uint32_t scan_start = 0;
+static int32_t flexsc_core = -1;
+/// syscall threads, which wait for requests
+static tid_t sleepers[FLEXSC_THREADS];
+static volatile uint32_t nr_sleepers = 0;
+
+/// collect up to FLEXSC_BATCH submitted entries, caller holds flexsc_lock
+static uint32_t flexsc_claim(flexsc_entry_t** batch)
+{
+	uint32_t n = 0;
+	uint32_t i, j;
+
+	for(i=0; (i < nr_pages) && (n < FLEXSC_BATCH); i++) {
+		flexsc_page_t* p = pages + ((scan_start + i) % nr_pages);
+
+		if (!p->entries)
+			continue;
+
+		for(j=0; (j < p->count) && (n < FLEXSC_BATCH); j++) {
+			flexsc_entry_t* e = p->entries + ((p->next + j) % p->count);
+
+			if (e->status != FLEXSC_SUBMITTED)
+				continue;
+
+			e->status = FLEXSC_BUSY;
+			batch[n++] = e;
+			// continue behind the claimed entry next time
+			p->next = (p->next + j + 1) % p->count;
+		}
+	}
+
+	// be fair to the pages, which didn't fit into the batch
+	if (nr_pages)
+		scan_start = (scan_start + 1) % nr_pages;
+
+	return n;
+}
+
+static int64_t flexsc_execute(flexsc_entry_t* e)
+{
+	uint64_t* a = e->args;
+
+	switch(e->nr) {
+	case __NR_write:
+		return sys_write((int) a[0], (const char*) a[1], (size_t) a[2]);
+	case __NR_read:
+		return sys_read((int) a[0], (char*) a[1], (size_t) a[2]);
+	case __NR_pwrite:
+		return sys_pwrite((int) a[0], (const char*) a[1], (size_t) a[2], (off_t) a[3]);
+	case __NR_pread:
+		return sys_pread((int) a[0], (char*) a[1], (size_t) a[2], (off_t) a[3]);
+	case __NR_open:
+		return sys_open((const char*) a[0], (int) a[1], (int) a[2]);
+	case __NR_close:
+		return sys_close((int) a[0]);
+	case __NR_lseek:
+		return sys_lseek((int) a[0], (off_t) a[1], (int) a[2]);
+	case __NR_unlink:
+		return sys_unlink((const char*) a[0]);
+	case __NR_stat:
+		return sys_stat((const char*) a[0], (void*) a[1]);
+	default:
+		// calls like getpid, sbrk or the semaphores depend on the caller
+		return -ENOSYS;
+	}
+}
+
+static void flexsc_complete(flexsc_entry_t* e, int64_t ret)
+{
+	tid_t waiter;
+
+	e->ret = ret;
+
+	spinlock_irqsave_lock(&flexsc_lock);
+	e->status = FLEXSC_DONE;
+	waiter = e->waiter;
+	e->waiter = 0;
+	spinlock_irqsave_unlock(&flexsc_lock);
+
+	if (waiter)
+		wakeup_task(waiter);
+}
+
+static int flexsc_thread(void* arg)
+{
+	flexsc_entry_t* batch[FLEXSC_BATCH];
+	const uint64_t poll_tsc = ns_to_tsc((uint64_t) FLEXSC_POLL_US * 1000ULL);
+	uint64_t last = get_rdtsc();
+	uint32_t n, i;
+
+	while(1) {
+		spinlock_irqsave_lock(&flexsc_lock);
+		n = flexsc_claim(batch);
+
+		if (!n && (get_rdtsc() - last >= poll_tsc)) {
+			// announce the sleep before the final check, flexsc_kick()
+			// reads nr_sleepers after setting the status
+			sleepers[nr_sleepers] = per_core(current_task)->id;
+			nr_sleepers++;
+			mb();
+
+			n = flexsc_claim(batch);
+			if (n) {
+				nr_sleepers--;
+			} else {
+				block_current_task();
+				spinlock_irqsave_unlock(&flexsc_lock);
+				reschedule();
+				last = get_rdtsc();
+				continue;
+			}
+		}
+		spinlock_irqsave_unlock(&flexsc_lock);
+
+		if (!n) {
+			// let the other syscall threads finish their blocked requests
+			reschedule();
+			PAUSE;
+			continue;
+		}
+
+		for(i=0; i<n; i++)
+			flexsc_complete(batch[i], flexsc_execute(batch[i]));
+
+		last = get_rdtsc();
+	}
+
+	return 0;
+}
+
+int flexsc_start(uint32_t core)
+{
+	uint32_t i;
+	int ret;
+
+	spinlock_irqsave_lock(&flexsc_lock);
+	if (flexsc_core >= 0) {
+		ret = ((uint32_t) flexsc_core == core) ? 0 : -EBUSY;
+		spinlock_irqsave_unlock(&flexsc_lock);
+		return ret;
+	}
+	flexsc_core = core;
+	spinlock_irqsave_unlock(&flexsc_lock);
+
+	for(i=0; i<FLEXSC_THREADS; i++) {
+		ret = create_kernel_task_on_core(NULL, flexsc_thread, NULL, HIGH_PRIO, core);
+		if (BUILTIN_EXPECT(ret, 0)) {
+			LOG_ERROR("flexsc: unable to create syscall thread on core %u\n", core);
+			// without a single thread, the core isn't usable
+			if (!i) {
+				flexsc_core = -1;
+				return ret;
+			}
+			break;
+		}
+	}
+
+	LOG_INFO("flexsc: %u syscall threads on core %u\n", i, core);
+
+	return 0;
+}
+
+int flexsc_register(flexsc_entry_t* entries, uint32_t count)
+{
+	uint32_t i;
+	int ret = -ENOSPC;
+
+	if (BUILTIN_EXPECT(!entries || !count, 0))
+		return -EINVAL;
+
+	for(i=0; i<count; i++) {
+		if (BUILTIN_EXPECT(entries[i].status != FLEXSC_FREE, 0))
+			return -EINVAL;
+		entries[i].waiter = 0;
+	}
+
+	spinlock_irqsave_lock(&flexsc_lock);
+	if (flexsc_core < 0) {
+		ret = -ENXIO;
+		goto out;
+	}
+
+	for(i=0; i<FLEXSC_MAX_PAGES; i++) {
+		if (pages[i].entries == entries) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	for(i=0; i<FLEXSC_MAX_PAGES; i++) {
+		if (!pages[i].entries) {
+			pages[i].entries = entries;
+			pages[i].count = count;
+			pages[i].next = 0;
+			if (i >= nr_pages)
+				nr_pages = i + 1;
+			ret = 0;
+			break;
+		}
+	}
+
+out:
+	spinlock_irqsave_unlock(&flexsc_lock);
+
+	return ret;
+}
+
+int flexsc_unregister(flexsc_entry_t* entries)
+{
+	uint32_t i, j;
+	int ret = -ENOENT;
+
+	spinlock_irqsave_lock(&flexsc_lock);
+	for(i=0; i<nr_pages; i++) {
+		if (pages[i].entries != entries)
+			continue;
+
+		ret = 0;
+		for(j=0; j<pages[i].count; j++) {
+			if ((entries[j].status == FLEXSC_SUBMITTED) || (entries[j].status == FLEXSC_BUSY)) {
+				ret = -EBUSY;
+				goto out;
+			}
+		}
+
+		pages[i].entries = NULL;
+		pages[i].count = 0;
+		while(nr_pages && !pages[nr_pages-1].entries)
+			nr_pages--;
+		break;
+	}
+
+out:
+	spinlock_irqsave_unlock(&flexsc_lock);
+
+	return ret;
+}
+
+void flexsc_kick(void)
+{
+	tid_t id = 0;
+
+	// pairs with the barrier of a syscall thread, which goes to sleep
+	mb();
+	if (!nr_sleepers)
+		return;
+
+	spinlock_irqsave_lock(&flexsc_lock);
+	if (nr_sleepers) {
+		nr_sleepers--;
+		id = sleepers[nr_sleepers];
+	}
+	spinlock_irqsave_unlock(&flexsc_lock);
+
+	if (id)
+		wakeup_task(id);
+}
+
+int64_t flexsc_wait(flexsc_entry_t* entry)
+{
+	int64_t ret;
+
+	flexsc_kick();
+
+	while(1) {
+		spinlock_irqsave_lock(&flexsc_lock);
+		if (entry->status == FLEXSC_DONE) {
+			spinlock_irqsave_unlock(&flexsc_lock);
+			break;
+		}
+
+		if (BUILTIN_EXPECT(entry->status == FLEXSC_FREE, 0)) {
+			spinlock_irqsave_unlock(&flexsc_lock);
+			return -EINVAL;
+		}
+
+		entry->waiter = per_core(current_task)->id;
+		block_current_task();
+		spinlock_irqsave_unlock(&flexsc_lock);
+
+		reschedule();
+	}
+
+	ret = entry->ret;
+	entry->status = FLEXSC_FREE;
+
+	return ret;
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/futex.h>
+#include <hermit/fiber.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/errno.h>
+#include <hermit/time.h>
+#include <hermit/logging.h>
+#include <asm/atomic.h>
+
+#define FUTEX_HASH_BITS		8
+#define FUTEX_HASH_SIZE		(1 << FUTEX_HASH_BITS)
+// maximum number of waiters, which are collected before they are woken
+#define FUTEX_WAKE_BATCH	32
+
+/** @brief Waiting task, which is located on the stack of the task */
+typedef struct futex_waiter {
+	/// address of the futex
+	int32_t*		addr;
+	/// id of the waiting task
+	tid_t			id;
+	/// waiting fiber, if only the fiber blocks and not its carrier
+	fiber_t*		fiber;
+	/// set by the waker, after the waiter has been removed from its bucket
+	int			woken;
+	/// next waiter in the bucket
+	struct futex_waiter*	next;
+	/// previous waiter in the bucket
+	struct futex_waiter*	prev;
+} futex_waiter_t;
+
+/** @brief List of waiters, whose futex addresses have the same hash */
+typedef struct futex_bucket {
+	/// first waiter
+	futex_waiter_t*		first;
+	/// last waiter
+	futex_waiter_t*		last;
+	/// protects the list
+	spinlock_irqsave_t	lock;
+} __attribute__ ((aligned (CACHE_LINE))) futex_bucket_t;
+
+static futex_bucket_t futex_buckets[FUTEX_HASH_SIZE] = {
+	[0 ... FUTEX_HASH_SIZE-1] = {NULL, NULL, SPINLOCK_IRQSAVE_INIT}};
+
+static inline futex_bucket_t* futex_bucket(const int32_t* addr)
+{
+	// multiplicative hashing of the word address
+	const uint64_t key = ((size_t) addr >> 2) * 0x9E3779B97F4A7C15ULL;
+
+	return futex_buckets + (key >> (64 - FUTEX_HASH_BITS));
+}
+
+static inline int futex_valid(const int32_t* addr)
+{
+	return addr && !((size_t) addr & (sizeof(int32_t) - 1));
+}
+
+static inline void futex_enqueue(futex_bucket_t* bucket, futex_waiter_t* waiter)
+{
+	waiter->next = NULL;
+	waiter->prev = bucket->last;
+	if (bucket->last)
+		bucket->last->next = waiter;
+	else
+		bucket->first = waiter;
+	bucket->last = waiter;
+}
+
+static inline void futex_dequeue(futex_bucket_t* bucket, futex_waiter_t* waiter)
+{
+	if (waiter->prev)
+		waiter->prev->next = waiter->next;
+	else
+		bucket->first = waiter->next;
+	if (waiter->next)
+		waiter->next->prev = waiter->prev;
+	else
+		bucket->last = waiter->prev;
+	waiter->next = waiter->prev = NULL;
+}
+
+/** @brief Lock two buckets in a fixed order to avoid deadlocks */
+static inline void futex_lock_pair(futex_bucket_t* b1, futex_bucket_t* b2)
+{
+	if (b1 == b2) {
+		spinlock_irqsave_lock(&b1->lock);
+	} else if (b1 < b2) {
+		spinlock_irqsave_lock(&b1->lock);
+		spinlock_irqsave_lock(&b2->lock);
+	} else {
+		spinlock_irqsave_lock(&b2->lock);
+		spinlock_irqsave_lock(&b1->lock);
+	}
+}
+
+static inline void futex_unlock_pair(futex_bucket_t* b1, futex_bucket_t* b2)
+{
+	spinlock_irqsave_unlock(&b1->lock);
+	if (b1 != b2)
+		spinlock_irqsave_unlock(&b2->lock);
+}
+
+/** @brief Lock the bucket, which currently contains the waiter
+ *
+ * The bucket could change by futex_requeue() until the lock is taken.
+ */
+static futex_bucket_t* futex_lock_waiter(futex_waiter_t* waiter)
+{
+	futex_bucket_t* bucket;
+
+	while(1) {
+		bucket = futex_bucket(waiter->addr);
+		spinlock_irqsave_lock(&bucket->lock);
+		if (bucket == futex_bucket(waiter->addr))
+			return bucket;
+		spinlock_irqsave_unlock(&bucket->lock);
+	}
+}
+
+/** @brief Wake up to nr waiters of addr
+ *
+ * Has to be called with the lock of the bucket.
+ */
+static int futex_wake_locked(futex_bucket_t* bucket, int32_t* addr, int32_t nr)
+{
+	futex_waiter_t* waiter;
+	futex_waiter_t* next;
+	tid_t ids[FUTEX_WAKE_BATCH];
+	uint32_t n = 0;
+	int woken = 0;
+
+	for(waiter = bucket->first; waiter && (woken < nr); waiter = next) {
+		next = waiter->next;
+		if (waiter->addr != addr)
+			continue;
+
+		futex_dequeue(bucket, waiter);
+		waiter->woken = 1;
+		woken++;
+
+		if (waiter->fiber) {
+			fiber_wakeup(waiter->fiber);
+			continue;
+		}
+
+		ids[n++] = waiter->id;
+
+		// wake the waiters in batches => at most one IPI per core and batch
+		if (n == FUTEX_WAKE_BATCH) {
+			wakeup_tasks(ids, n);
+			n = 0;
+		}
+	}
+
+	if (n)
+		wakeup_tasks(ids, n);
+
+	return woken;
+}
+
+int futex_wait(int32_t* addr, int32_t val, uint64_t timeout)
+{
+	// timeouts of more than 584 years are treated as infinite
+	if (timeout > (uint64_t) -1 / 1000ULL)
+		timeout = 0;
+
+	return futex_wait_ns(addr, val, timeout * 1000ULL);
+}
+
+int futex_wait_ns(int32_t* addr, int32_t val, uint64_t ns)
+{
+	task_t* curr_task = per_core(current_task);
+	futex_waiter_t waiter;
+	futex_bucket_t* bucket;
+	uint64_t deadline = 0;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT(!futex_valid(addr), 0))
+		return -EINVAL;
+
+	// a TSC deadline, short timeouts don't have to wait for the next tick
+	if (ns)
+		deadline = get_rdtsc() + ns_to_tsc(ns);
+
+	waiter.addr = addr;
+	waiter.id = curr_task->id;
+	waiter.woken = 0;
+	// a fiber without timeout blocks alone, the carrier runs the other fibers
+	waiter.fiber = deadline ? NULL : fiber_current();
+
+	bucket = futex_bucket(addr);
+	spinlock_irqsave_lock(&bucket->lock);
+
+	// the value has to be checked after the bucket is locked, a waker locks it as well
+	if (*((volatile int32_t*) addr) != val) {
+		spinlock_irqsave_unlock(&bucket->lock);
+		return -EAGAIN;
+	}
+
+	futex_enqueue(bucket, &waiter);
+	if (waiter.fiber)
+		waiter.fiber->waiter = &waiter;
+
+	while(1) {
+		if (waiter.fiber) {
+			// releases the lock of the bucket
+			fiber_block(&bucket->lock);
+		} else {
+			if (deadline)
+				set_timer_tsc(deadline);
+			else
+				block_current_task();
+			spinlock_irqsave_unlock(&bucket->lock);
+
+			reschedule();
+		}
+
+		bucket = futex_lock_waiter(&waiter);
+		if (waiter.woken)
+			break;
+
+		if (deadline && (get_rdtsc() >= deadline)) {
+			futex_dequeue(bucket, &waiter);
+			ret = -ETIMEDOUT;
+			break;
+		}
+	}
+
+	if (waiter.fiber)
+		waiter.fiber->waiter = NULL;
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	return ret;
+}
+
+int futex_wake(int32_t* addr, int32_t nr)
+{
+	futex_bucket_t* bucket;
+	int ret;
+
+	if (BUILTIN_EXPECT(!futex_valid(addr), 0))
+		return -EINVAL;
+	if (nr <= 0)
+		return 0;
+
+	bucket = futex_bucket(addr);
+	spinlock_irqsave_lock(&bucket->lock);
+	ret = futex_wake_locked(bucket, addr, nr);
+	spinlock_irqsave_unlock(&bucket->lock);
+
+	return ret;
+}
+
+int futex_requeue(int32_t* addr, int32_t nr_wake, int32_t nr_requeue, int32_t* addr2, const int32_t* cmpval)
+{
+	futex_bucket_t* bucket;
+	futex_bucket_t* bucket2;
+	futex_waiter_t* waiter;
+	futex_waiter_t* next;
+	int ret, moved = 0;
+
+	if (BUILTIN_EXPECT(!futex_valid(addr) || !futex_valid(addr2), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT((nr_wake < 0) || (nr_requeue < 0), 0))
+		return -EINVAL;
+
+	bucket = futex_bucket(addr);
+	bucket2 = futex_bucket(addr2);
+	futex_lock_pair(bucket, bucket2);
+
+	if (cmpval && (*((volatile int32_t*) addr) != *cmpval)) {
+		futex_unlock_pair(bucket, bucket2);
+		return -EAGAIN;
+	}
+
+	ret = futex_wake_locked(bucket, addr, nr_wake);
+
+	for(waiter = bucket->first; waiter && (moved < nr_requeue); waiter = next) {
+		next = waiter->next;
+		if (waiter->addr != addr)
+			continue;
+
+		if (bucket != bucket2) {
+			futex_dequeue(bucket, waiter);
+			futex_enqueue(bucket2, waiter);
+		}
+		waiter->addr = addr2;
+		moved++;
+	}
+
+	futex_unlock_pair(bucket, bucket2);
+
+	return ret + moved;
+}
+
+int futex_wake_op(int32_t* addr, int32_t nr_wake, int32_t nr_wake2, int32_t* addr2, uint32_t op)
+{
+	futex_bucket_t* bucket;
+	futex_bucket_t* bucket2;
+	const uint32_t cmd = (op >> 28) & 0x7;
+	const uint32_t cmp = (op >> 24) & 0xf;
+	// the arguments are signed 12 bit values
+	int32_t oparg = ((int32_t) (op << 8)) >> 20;
+	const int32_t cmparg = ((int32_t) (op << 20)) >> 20;
+	int32_t oldval, newval, curr;
+	int ret, cond;
+
+	if (BUILTIN_EXPECT(!futex_valid(addr) || !futex_valid(addr2), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT((cmd > FUTEX_OP_XOR) || (cmp > FUTEX_OP_CMP_GE), 0))
+		return -EINVAL;
+
+	if ((op >> 28) & FUTEX_OP_OPARG_SHIFT) {
+		if (BUILTIN_EXPECT((oparg < 0) || (oparg > 31), 0))
+			return -EINVAL;
+		oparg = 1 << oparg;
+	}
+
+	bucket = futex_bucket(addr);
+	bucket2 = futex_bucket(addr2);
+	futex_lock_pair(bucket, bucket2);
+
+	// user space modifies the futex without our locks => atomic update
+	curr = *((volatile int32_t*) addr2);
+	do {
+		oldval = curr;
+		switch(cmd) {
+		case FUTEX_OP_SET:
+			newval = oparg;
+			break;
+		case FUTEX_OP_ADD:
+			newval = oldval + oparg;
+			break;
+		case FUTEX_OP_OR:
+			newval = oldval | oparg;
+			break;
+		case FUTEX_OP_ANDN:
+			newval = oldval & ~oparg;
+			break;
+		default:
+			newval = oldval ^ oparg;
+			break;
+		}
+		curr = atomic_int32_cmpxchg((atomic_int32_t*) addr2, oldval, newval);
+	} while(curr != oldval);
+
+	switch(cmp) {
+	case FUTEX_OP_CMP_EQ:
+		cond = (oldval == cmparg);
+		break;
+	case FUTEX_OP_CMP_NE:
+		cond = (oldval != cmparg);
+		break;
+	case FUTEX_OP_CMP_LT:
+		cond = (oldval < cmparg);
+		break;
+	case FUTEX_OP_CMP_LE:
+		cond = (oldval <= cmparg);
+		break;
+	case FUTEX_OP_CMP_GT:
+		cond = (oldval > cmparg);
+		break;
+	default:
+		cond = (oldval >= cmparg);
+		break;
+	}
+
+	ret = futex_wake_locked(bucket, addr, nr_wake);
+	if (cond)
+		ret += futex_wake_locked(bucket2, addr2, nr_wake2);
+
+	futex_unlock_pair(bucket, bucket2);
+
+	return ret;
+}
+
+void futex_cancel(futex_waiter_t* waiter)
+{
+	futex_bucket_t* bucket = futex_lock_waiter(waiter);
+
+	// a waker, which dequeued the waiter, held the lock until it's done
+	if (!waiter->woken) {
+		futex_dequeue(bucket, waiter);
+		waiter->woken = 1;
+	}
+
+	spinlock_irqsave_unlock(&bucket->lock);
+}
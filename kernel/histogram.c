@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file kernel/histogram.c
+ * @brief Per-core log-linear histograms
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/spinlock.h>
+#include <hermit/histogram.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/irqflags.h>
+
+/// registered histograms, in the order of registration
+static hist_t* hist_first = NULL;
+static hist_t* hist_last = NULL;
+static spinlock_t hist_lock = SPINLOCK_INIT;
+
+extern int32_t possible_cpus;
+
+static void hist_core_clear(hist_core_t* core)
+{
+	memset(core, 0x00, sizeof(hist_core_t));
+	core->min = (uint64_t) -1;
+}
+
+int hist_init(hist_t* hist, const char* name)
+{
+	uint32_t i, ncores = possible_cpus;
+
+	if (ncores > MAX_CORES)
+		ncores = MAX_CORES;
+	if (!ncores)
+		ncores = 1;
+
+	hist->cores = kmalloc(ncores * sizeof(hist_core_t));
+	if (BUILTIN_EXPECT(!hist->cores, 0)) {
+		LOG_ERROR("histogram %s: unable to allocate the copies of %u cores\n", name, ncores);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ncores; i++)
+		hist_core_clear(hist->cores + i);
+
+	hist->name = name;
+	hist->ncores = ncores;
+	hist->next = NULL;
+
+	spinlock_lock(&hist_lock);
+	if (hist_last)
+		hist_last->next = hist;
+	else
+		hist_first = hist;
+	hist_last = hist;
+	spinlock_unlock(&hist_lock);
+
+	return 0;
+}
+
+void hist_record(hist_t* hist, uint64_t value)
+{
+	const uint32_t bucket = hist_bucket(value);
+	hist_core_t* core;
+	uint32_t core_id;
+	uint8_t flags;
+
+	// the task must not be migrated or interrupted by another caller
+	flags = irq_nested_disable();
+	core_id = CORE_ID;
+	if (BUILTIN_EXPECT(hist->cores && (core_id < hist->ncores), 1)) {
+		core = hist->cores + core_id;
+		core->count++;
+		core->sum += value;
+		if (value < core->min)
+			core->min = value;
+		if (value > core->max)
+			core->max = value;
+		core->buckets[bucket]++;
+	}
+	irq_nested_enable(flags);
+}
+
+void hist_merge(const hist_t* hist, hist_data_t* data)
+{
+	uint32_t i, k;
+
+	memset(data, 0x00, sizeof(hist_data_t));
+	data->min = (uint64_t) -1;
+	if (hist->name)
+		strncpy(data->name, hist->name, HIST_NAME_LEN-1);
+
+	// a snapshot, the cores may record while we read their copies
+	for (i = 0; hist->cores && (i < hist->ncores); i++) {
+		const hist_core_t* core = hist->cores + i;
+
+		data->count += core->count;
+		data->sum += core->sum;
+		if (core->min < data->min)
+			data->min = core->min;
+		if (core->max > data->max)
+			data->max = core->max;
+		for (k = 0; k < HIST_BUCKETS; k++)
+			data->buckets[k] += core->buckets[k];
+	}
+}
+
+void hist_add(hist_data_t* dst, const hist_data_t* src)
+{
+	uint32_t k;
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	for (k = 0; k < HIST_BUCKETS; k++)
+		dst->buckets[k] += src->buckets[k];
+}
+
+uint64_t hist_percentile(const hist_data_t* data, uint32_t ppm)
+{
+	uint64_t rank, seen = 0;
+	uint32_t k;
+
+	if (!data->count)
+		return 0;
+	if (ppm > 1000000)
+		ppm = 1000000;
+
+	// rank of the value, counted from 1
+	rank = (uint64_t) (((unsigned __int128) data->count * ppm + 999999) / 1000000);
+	if (!rank)
+		rank = 1;
+
+	for (k = 0; k < HIST_BUCKETS; k++) {
+		seen += data->buckets[k];
+		if (seen >= rank) {
+			uint64_t high = hist_bucket_high(k);
+
+			return high < data->max ? high : data->max;
+		}
+	}
+
+	return data->max;
+}
+
+void hist_reset(hist_t* hist)
+{
+	uint32_t i;
+
+	for (i = 0; hist->cores && (i < hist->ncores); i++) {
+		uint8_t flags = irq_nested_disable();
+		hist_core_clear(hist->cores + i);
+		irq_nested_enable(flags);
+	}
+}
+
+void hist_print(const hist_data_t* data, const char* unit)
+{
+	if (!data->count)
+		return;
+
+	LOG_INFO("%s: %llu values, min %llu %s, avg %llu %s, max %llu %s\n",
+		data->name, data->count, data->min, unit,
+		data->sum / data->count, unit, data->max, unit);
+	LOG_INFO("%s: p50 %llu %s, p90 %llu %s, p99 %llu %s, p99.9 %llu %s\n",
+		data->name, hist_percentile(data, 500000), unit,
+		hist_percentile(data, 900000), unit, hist_percentile(data, 990000), unit,
+		hist_percentile(data, 999000), unit);
+}
+
+int hist_read(uint32_t index, hist_data_t* data)
+{
+	hist_t* hist;
+
+	spinlock_lock(&hist_lock);
+	for (hist = hist_first; hist && index; hist = hist->next)
+		index--;
+	spinlock_unlock(&hist_lock);
+
+	// histograms are never unregistered
+	if (!hist)
+		return -ENOENT;
+
+	hist_merge(hist, data);
+
+	return 0;
+}
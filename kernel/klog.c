@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/stdarg.h>
+#include <hermit/klog.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/time.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/uhyve.h>
+
+#define KLOG_ARG_NONE	0
+#define KLOG_ARG_INT	1
+#define KLOG_ARG_LONG	2
+#define KLOG_ARG_PTR	3
+#define KLOG_ARG_STR	4
+
+/// rings of all cores, global to be found by gdb
+klog_ring_t* klog_rings[MAX_CORES] = {[0 ... MAX_CORES-1] = NULL};
+
+extern int32_t possible_cpus;
+
+/// serializes the consumers (drain task and klog_drain)
+static spinlock_t drain_lock = SPINLOCK_INIT;
+static uint64_t reported_drops[MAX_CORES];
+
+static const char* level_prefix[] = {
+	"", LOG_LEVEL_ERROR_PREFIX, LOG_LEVEL_WARNING_PREFIX, LOG_LEVEL_INFO_PREFIX,
+	LOG_LEVEL_DEBUG_PREFIX, LOG_LEVEL_VERBOSE_PREFIX
+};
+
+/*
+ * Parses the conversion behind a '%' like kvprintf(). Stores the types of
+ * the consumed arguments (at most three) in types and returns the length
+ * of the conversion or 0, if kvprintf() stops the formatting.
+ */
+static size_t parse_conversion(const char* fmt, uint8_t* types, int* nargs)
+{
+	const char* p = fmt;
+	int lflag = 0;
+
+	*nargs = 0;
+
+	for (;; p++) {
+		switch (*p) {
+		case '.': case '#': case '+': case '-': case '0':
+		case '1': case '2': case '3': case '4': case '5':
+		case '6': case '7': case '8': case '9':
+			break;
+		case '*':
+			types[(*nargs)++] = KLOG_ARG_INT;
+			break;
+		case 'h':
+			break;
+		case 'l': case 'q': case 'j': case 'z': case 't':
+			lflag = 1;
+			break;
+		case '%':
+			return p - fmt + 1;
+		case 'b':
+			types[(*nargs)++] = KLOG_ARG_INT;
+			types[(*nargs)++] = KLOG_ARG_PTR;
+			return p - fmt + 1;
+		case 'D':
+			types[(*nargs)++] = KLOG_ARG_PTR;
+			types[(*nargs)++] = KLOG_ARG_PTR;
+			return p - fmt + 1;
+		case 'c': case 'd': case 'i': case 'o': case 'u':
+		case 'x': case 'X': case 'r': case 'y':
+			types[(*nargs)++] = lflag ? KLOG_ARG_LONG : KLOG_ARG_INT;
+			return p - fmt + 1;
+		case 'p': case 'n':
+			types[(*nargs)++] = KLOG_ARG_PTR;
+			return p - fmt + 1;
+		case 's':
+			types[(*nargs)++] = KLOG_ARG_STR;
+			return p - fmt + 1;
+		default:
+			return 0;
+		}
+	}
+}
+
+/*
+ * Fills the record with the arguments of fmt and returns its size.
+ * The copies of the strings follow the arguments.
+ */
+static uint16_t klog_record(klog_rec_t* rec, const char* fmt, va_list ap)
+{
+	const char* strs[KLOG_MAX_ARGS];
+	const char* end = (const char*) rec + KLOG_MAX_REC;
+	const char* p;
+	char* dst;
+	uint8_t types[3];
+	int i, nargs, n = 0;
+	size_t len, max;
+
+	for (p = fmt; *p && (n < KLOG_MAX_ARGS); p++) {
+		if (*p != '%')
+			continue;
+
+		len = parse_conversion(p+1, types, &nargs);
+		if (!len)
+			break;
+		p += len;
+
+		for (i = 0; (i < nargs) && (n < KLOG_MAX_ARGS); i++, n++) {
+			strs[n] = NULL;
+			switch (types[i]) {
+			case KLOG_ARG_INT:
+				rec->args[n] = va_arg(ap, unsigned int);
+				break;
+			case KLOG_ARG_LONG:
+				rec->args[n] = va_arg(ap, uint64_t);
+				break;
+			case KLOG_ARG_PTR:
+				rec->args[n] = (size_t) va_arg(ap, void*);
+				break;
+			case KLOG_ARG_STR:
+				strs[n] = va_arg(ap, const char*);
+				if (!strs[n])
+					strs[n] = "(null)";
+				break;
+			}
+		}
+	}
+
+	dst = (char*) (rec->args + n);
+	for (i = 0; i < n; i++) {
+		if (!strs[i])
+			continue;
+
+		// offset 0 marks a string, which didn't fit into the record
+		rec->args[i] = 0;
+		if (dst + 1 >= end)
+			continue;
+
+		max = end - dst - 1;
+		if (max > KLOG_MAX_STR)
+			max = KLOG_MAX_STR;
+		for (len = 0; (len < max) && strs[i][len]; len++)
+			dst[len] = strs[i][len];
+		dst[len] = '\0';
+
+		rec->args[i] = (size_t) dst - (size_t) rec;
+		dst += len + 1;
+	}
+
+	return (((size_t) dst - (size_t) rec) + 7) & ~7UL;
+}
+
+/// has to be called with disabled interrupts
+static int klog_push(klog_ring_t* ring, const klog_rec_t* rec)
+{
+	uint64_t head = ring->head;
+	uint64_t pos = head & (KLOG_RING_SIZE-1);
+	uint64_t pad = 0;
+
+	// a record isn't split => pad the ring up to its end
+	if (pos + rec->len > KLOG_RING_SIZE)
+		pad = KLOG_RING_SIZE - pos;
+
+	if (head + pad + rec->len - ring->tail > KLOG_RING_SIZE) {
+		ring->dropped++;
+		return -ENOMEM;
+	}
+
+	// the padding has only room for the format string
+	if (pad) {
+		((klog_rec_t*) (ring->data + pos))->fmt = NULL;
+		head += pad;
+		pos = 0;
+	}
+
+	memcpy(ring->data + pos, rec, rec->len);
+
+	// the consumer reads the record after the new head
+	mb();
+	ring->head = head + rec->len;
+
+	return 0;
+}
+
+void klog(int level, int flags, const char* fmt, ...)
+{
+	uint64_t buf[KLOG_MAX_REC / sizeof(uint64_t)];
+	klog_rec_t* rec = (klog_rec_t*) buf;
+	task_t* task = per_core(current_task);
+	klog_ring_t* ring;
+	uint8_t irq_flags;
+	va_list ap;
+
+	va_start(ap, fmt);
+
+	irq_flags = irq_nested_disable();
+	ring = klog_rings[CORE_ID];
+	irq_nested_enable(irq_flags);
+
+	// no ring yet => write it synchronously
+	if (!ring) {
+		if (!(flags & KLOG_CONT))
+			kprintf("[%d.%03d][%d:%d][%s] ", (int) (get_uptime() / 1000), (int) (get_uptime() % 1000),
+				CORE_ID, task ? task->id : 0, level_prefix[level]);
+		kvprintf_console(fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	rec->tsc = get_rdtsc();
+	rec->fmt = fmt;
+	rec->task = task ? task->id : 0;
+	rec->core = CORE_ID;
+	rec->level = level;
+	rec->flags = flags;
+	rec->len = klog_record(rec, fmt, ap);
+	va_end(ap);
+
+	// the ring is only written on its own core => no lock is needed
+	irq_flags = irq_nested_disable();
+	ring = klog_rings[CORE_ID];
+	if (ring)
+		klog_push(ring, rec);
+	irq_nested_enable(irq_flags);
+}
+
+/*
+ * Formats the record into line. Returns the length of the line.
+ */
+static size_t klog_format(const klog_rec_t* rec, char* line, size_t size)
+{
+	char spec[32];
+	const char* p;
+	uint64_t a[3];
+	uint8_t types[3];
+	size_t len, pos = 0;
+	uint64_t ms;
+	int i, nargs, n = 0;
+
+	if (!(rec->flags & KLOG_CONT)) {
+		// time stamp relative to the boot
+		ms = get_uptime() - tsc_to_ns(get_rdtsc() - rec->tsc) / 1000000ULL;
+		pos = ksnprintf(line, size, "[%d.%03d][%d:%d][%s] ", (int) (ms / 1000), (int) (ms % 1000),
+			rec->core, rec->task, level_prefix[rec->level]);
+	}
+
+	for (p = rec->fmt; *p && (pos < size - 1); ) {
+		if (*p != '%') {
+			line[pos++] = *p++;
+			continue;
+		}
+
+		len = parse_conversion(p+1, types, &nargs);
+		if (!len || (len + 2 > sizeof(spec)))
+			break;
+
+		// format each conversion on its own
+		memcpy(spec, p, len + 1);
+		spec[len + 1] = '\0';
+		p += len + 1;
+
+		for (i = 0; i < 3; i++)
+			a[i] = 0;
+		for (i = 0; i < nargs; i++, n++) {
+			if (n >= KLOG_MAX_ARGS)
+				continue;
+			a[i] = rec->args[n];
+			if (types[i] == KLOG_ARG_STR)
+				a[i] = a[i] ? (size_t) rec + a[i] : (size_t) "(...)";
+		}
+
+		pos += ksnprintf(line + pos, size - pos, spec, a[0], a[1], a[2]);
+		if (pos > size - 1)
+			pos = size - 1;
+	}
+
+	line[pos] = '\0';
+
+	return pos;
+}
+
+void klog_drain(void)
+{
+	uint64_t buf[KLOG_MAX_REC / sizeof(uint64_t)];
+	char line[256];
+	klog_rec_t* rec;
+	klog_ring_t* ring;
+	klog_ring_t* oldest;
+	uint64_t tsc = 0;
+	uint32_t i;
+
+	spinlock_lock(&drain_lock);
+
+	while (1) {
+		oldest = NULL;
+
+		// merge the rings in the order of the time stamps
+		for (i = 0; i < MAX_CORES; i++) {
+			ring = klog_rings[i];
+			if (!ring)
+				continue;
+
+			if (ring->dropped != reported_drops[i]) {
+				kprintf("[klog] core %u dropped %zu messages\n", i, (size_t) (ring->dropped - reported_drops[i]));
+				reported_drops[i] = ring->dropped;
+			}
+
+			while (ring->tail != ring->head) {
+				rec = (klog_rec_t*) (ring->data + (ring->tail & (KLOG_RING_SIZE-1)));
+				if (rec->fmt)
+					break;
+				// skip the padding
+				ring->tail += KLOG_RING_SIZE - (ring->tail & (KLOG_RING_SIZE-1));
+			}
+			if (ring->tail == ring->head)
+				continue;
+
+			rec = (klog_rec_t*) (ring->data + (ring->tail & (KLOG_RING_SIZE-1)));
+			if (!oldest || ((int64_t) (rec->tsc - tsc) < 0)) {
+				oldest = ring;
+				tsc = rec->tsc;
+			}
+		}
+
+		if (!oldest)
+			break;
+
+		// copy the record, before the producer may reuse the space
+		rec = (klog_rec_t*) (oldest->data + (oldest->tail & (KLOG_RING_SIZE-1)));
+		memcpy(buf, rec, rec->len);
+		mb();
+		oldest->tail += rec->len;
+
+		klog_format((klog_rec_t*) buf, line, sizeof(line));
+		kputs(line);
+	}
+
+	spinlock_unlock(&drain_lock);
+}
+
+static int klog_task(void* arg)
+{
+	while (1) {
+		klog_drain();
+		timer_wait_ns(KLOG_DRAIN_MS * 1000000ULL);
+	}
+
+	return 0;
+}
+
+int klog_init(void)
+{
+	uint32_t i, ncores = possible_cpus;
+
+	if (!KLOG_RING_SIZE)
+		return 0;
+
+	if (ncores > MAX_CORES)
+		ncores = MAX_CORES;
+
+	for (i = 0; i < ncores; i++) {
+		klog_ring_t* ring = kmalloc(sizeof(klog_ring_t));
+
+		if (BUILTIN_EXPECT(!ring, 0)) {
+			LOG_ERROR("klog: unable to allocate the ring of core %u\n", i);
+			return -ENOMEM;
+		}
+
+		ring->head = ring->tail = ring->dropped = 0;
+		klog_rings[i] = ring;
+	}
+
+	if (BUILTIN_EXPECT(create_kernel_task(NULL, klog_task, NULL, LOW_PRIO), 0)) {
+		LOG_ERROR("klog: unable to create the drain task\n");
+		return -ENOMEM;
+	}
+
+	if (is_uhyve()) {
+		uhyve_klog_t uhyve_klog = {KLOG_VERSION, ncores, KLOG_RING_SIZE, (size_t) klog_rings};
+
+		uhyve_send(UHYVE_PORT_KLOG, (unsigned)virt_to_phys((size_t) &uhyve_klog));
+	}
+
+	return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+/**
+ * @file kernel/ktrace.c
+ * @brief Function trace of the instrumented kernel modules
+ *
+ * This file is never instrumented. The hooks use only inline functions of
+ * include/hermit and include/asm, which are excluded from the
+ * instrumentation as well (see CMakeLists.txt). The symbols of the hooks are
+ * renamed in libhermit.a, so that they don't collide with XRay's hooks of
+ * the application.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/tasks.h>
+#include <hermit/ktrace.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/processor.h>
+
+#ifdef KERNEL_TRACE
+
+#if (KERNEL_TRACE_SIZE <= 0) || (KERNEL_TRACE_SIZE & (KERNEL_TRACE_SIZE - 1))
+#error KERNEL_TRACE_SIZE has to be a power of two
+#endif
+
+#define KTRACE_HOOK	__attribute__ ((no_instrument_function))
+
+/// trace of a core, is only written by the tasks running on the core
+typedef struct ktrace_ring {
+	/// number of reserved entries
+	uint64_t head;
+	/// KERNEL_TRACE_SIZE entries
+	ktrace_entry_t* entries;
+} __attribute__ ((aligned (CACHE_LINE))) ktrace_ring_t;
+
+static ktrace_ring_t ktrace_rings[MAX_CORES];
+
+/// is set, after the per-core data of all cores is valid
+static volatile int ktrace_ready = 0;
+/// is set, while the calls are recorded
+static volatile int ktrace_enabled = 0;
+
+extern int32_t possible_cpus;
+
+int ktrace_init(void)
+{
+	uint32_t i, ncores = possible_cpus;
+
+	if (ncores > MAX_CORES)
+		ncores = MAX_CORES;
+
+	for (i = 0; i < ncores; i++) {
+		ktrace_entry_t* entries = kmalloc(KERNEL_TRACE_SIZE * sizeof(ktrace_entry_t));
+
+		if (BUILTIN_EXPECT(!entries, 0)) {
+			LOG_ERROR("ktrace: unable to allocate the trace of core %u\n", i);
+			return -ENOMEM;
+		}
+
+		memset(entries, 0x00, KERNEL_TRACE_SIZE * sizeof(ktrace_entry_t));
+		ktrace_rings[i].head = 0;
+		ktrace_rings[i].entries = entries;
+	}
+
+	LOG_INFO("ktrace: record %d calls per core\n", KERNEL_TRACE_SIZE);
+
+	ktrace_ready = 1;
+	ktrace_enabled = 1;
+
+	return 0;
+}
+
+int ktrace_enable(int enable)
+{
+	int prev = ktrace_enabled;
+
+	if (BUILTIN_EXPECT(!ktrace_ready, 0))
+		return -EINVAL;
+
+	ktrace_enabled = !!enable;
+
+	return prev;
+}
+
+int ktrace_read(uint32_t core, ktrace_entry_t* buf, size_t n)
+{
+	ktrace_ring_t* ring;
+	uint64_t first, head;
+	size_t copied = 0;
+
+	if (BUILTIN_EXPECT(!buf || (core >= MAX_CORES), 0))
+		return -EINVAL;
+
+	ring = &ktrace_rings[core];
+	if (!ring->entries)
+		return -EINVAL;
+
+	// a snapshot, the core may overwrite entries while we copy them
+	head = ring->head;
+	first = head > KERNEL_TRACE_SIZE ? head - KERNEL_TRACE_SIZE : 0;
+	if (head - first > n)
+		first = head - n;
+
+	for (; first < head; first++) {
+		const ktrace_entry_t* entry = ring->entries + (first & (KERNEL_TRACE_SIZE - 1));
+
+		// skip the calls, which haven't returned yet
+		if (entry->end_tick)
+			buf[copied++] = *entry;
+	}
+
+	return (int) copied;
+}
+
+/*
+ * The depth is incremented before the frame is written and decremented
+ * after it is read. An interrupt handler uses the same stack, but only the
+ * frames above the depth, and leaves it balanced.
+ */
+void KTRACE_HOOK __cyg_profile_func_enter(void* fn, void* call_site)
+{
+	ktrace_entry_t* entry = NULL;
+	ktrace_stack_t* stack;
+	task_t* task;
+	uint64_t now;
+	uint32_t depth;
+
+	if (BUILTIN_EXPECT(!ktrace_ready, 0))
+		return;
+
+	task = per_core(current_task);
+	if (BUILTIN_EXPECT(!task, 0))
+		return;
+
+	stack = &task->ktrace;
+	depth = stack->depth++;
+	// only interrupts of this core race with us
+	asm volatile("" ::: "memory");
+
+	if (BUILTIN_EXPECT(depth >= KTRACE_DEPTH, 0))
+		return;
+
+	now = get_rdtsc();
+	if (ktrace_enabled) {
+		ktrace_ring_t* ring = &ktrace_rings[CORE_ID];
+		uint64_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+
+		entry = ring->entries + (slot & (KERNEL_TRACE_SIZE - 1));
+		entry->depth_addr = KTRACE_PACK_DEPTH_ADDR(depth, (uint32_t) (size_t) fn);
+		entry->annotation_index = 0;
+		entry->start_tick = now;
+		entry->end_tick = 0;
+	}
+
+	stack->frames[depth].fn = fn;
+	stack->frames[depth].entry = entry;
+	stack->frames[depth].start = now;
+}
+
+void KTRACE_HOOK __cyg_profile_func_exit(void* fn, void* call_site)
+{
+	ktrace_stack_t* stack;
+	task_t* task;
+	uint32_t depth;
+
+	if (BUILTIN_EXPECT(!ktrace_ready, 0))
+		return;
+
+	task = per_core(current_task);
+	if (BUILTIN_EXPECT(!task, 0))
+		return;
+
+	stack = &task->ktrace;
+	depth = stack->depth;
+	if (BUILTIN_EXPECT(!depth, 0))
+		return;
+
+	if (depth <= KTRACE_DEPTH) {
+		ktrace_frame_t* frame = stack->frames + depth - 1;
+
+		// the function was entered before the trace was ready
+		if (BUILTIN_EXPECT(frame->fn != fn, 0))
+			return;
+
+		if (frame->entry && (frame->entry->start_tick == frame->start))
+			frame->entry->end_tick = get_rdtsc();
+	}
+
+	// only interrupts of this core race with us
+	asm volatile("" ::: "memory");
+	stack->depth = depth - 1;
+}
+
+#endif
@@ -0,0 +1,593 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/localsock.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+#if LOCALSOCK_BUFSIZE & (LOCALSOCK_BUFSIZE - 1)
+#error LOCALSOCK_BUFSIZE has to be a power of two
+#endif
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+#define LOCALSOCK_FREE		0
+#define LOCALSOCK_UNBOUND	1
+#define LOCALSOCK_LISTEN	2
+#define LOCALSOCK_CONNECTED	3
+
+/** @brief Task, which waits for a state change */
+typedef struct localsock_waiter {
+	task_t* task;
+	struct localsock_waiter* next;
+} localsock_waiter_t;
+
+/** @brief Reader, which waits with its buffer for a direct copy */
+typedef struct localsock_reader {
+	task_t* task;
+	uint8_t* buf;
+	size_t len;
+	size_t done;
+} localsock_reader_t;
+
+/** @brief One direction of a connection
+ *
+ * If a reader waits, the writer copies the data directly into the buffer
+ * of the reader. Otherwise, the data is buffered in a ring. The reader
+ * posts its buffer only, if the ring is empty, which keeps the order.
+ */
+typedef struct localsock_pipe {
+	uint8_t* data;
+	/// free running counters of the ring
+	uint32_t head;
+	uint32_t tail;
+	localsock_reader_t* reader;
+	/// further readers and the writers, which wait for space
+	localsock_waiter_t* waiters;
+} localsock_pipe_t;
+
+/** @brief Connection between two local sockets (ends 0 and 1) */
+typedef struct localsock_conn {
+	spinlock_t lock;
+	/// pipe[i] carries the data to end i
+	localsock_pipe_t pipe[2];
+	/// is end i still open?
+	uint8_t open[2];
+} localsock_conn_t;
+
+typedef struct localsock {
+	uint8_t state;
+	/// end of the connection, which belongs to the socket
+	uint8_t end;
+	uint16_t port;
+	/// incremented by localsock_close() to detect a stale descriptor
+	uint32_t gen;
+	localsock_conn_t* conn;
+	/// connections, which aren't accepted yet (free running counters)
+	localsock_conn_t* backlog[LOCALSOCK_BACKLOG];
+	uint32_t bl_head;
+	uint32_t bl_tail;
+	/// tasks, which wait in localsock_accept()
+	localsock_waiter_t* waiters;
+} localsock_t;
+
+static localsock_t socks[MAX_LOCALSOCK];
+/// protects the socket table and the backlogs
+static spinlock_t localsock_lock = SPINLOCK_INIT;
+
+static void localsock_wakeup(localsock_waiter_t** waiters)
+{
+	localsock_waiter_t* w;
+
+	for(w = *waiters; w; w = w->next)
+		wakeup_task(w->task->id);
+	*waiters = NULL;
+}
+
+/*
+ * Blocks the current task until it is woken by localsock_wakeup() and
+ * removes it from the wait list, if it is woken otherwise.
+ */
+static void localsock_wait(spinlock_t* lock, localsock_waiter_t** waiters)
+{
+	localsock_waiter_t waiter;
+	localsock_waiter_t** w;
+
+	waiter.task = per_core(current_task);
+	waiter.next = *waiters;
+	*waiters = &waiter;
+
+	block_current_task();
+	spinlock_unlock(lock);
+	reschedule();
+	spinlock_lock(lock);
+
+	for(w = waiters; *w; w = &(*w)->next) {
+		if (*w == &waiter) {
+			*w = waiter.next;
+			break;
+		}
+	}
+}
+
+static inline localsock_t* localsock_get(int fd)
+{
+	int i;
+
+	if (!(fd & LOCALSOCK_FD_BIT))
+		return NULL;
+
+	i = fd & ~LOCALSOCK_FD_BIT;
+	if ((i < 0) || (i >= MAX_LOCALSOCK) || (socks[i].state == LOCALSOCK_FREE))
+		return NULL;
+
+	return socks + i;
+}
+
+/* has to be called with localsock_lock held */
+static int localsock_alloc(uint8_t state)
+{
+	int i;
+
+	for(i = 0; i < MAX_LOCALSOCK; i++) {
+		if (socks[i].state == LOCALSOCK_FREE) {
+			socks[i].state = state;
+			socks[i].end = 0;
+			socks[i].port = 0;
+			socks[i].conn = NULL;
+			socks[i].bl_head = socks[i].bl_tail = 0;
+			socks[i].waiters = NULL;
+			return i;
+		}
+	}
+
+	return -ENFILE;
+}
+
+static localsock_conn_t* localsock_conn_create(void)
+{
+	localsock_conn_t* conn;
+
+	conn = kmalloc(sizeof(localsock_conn_t));
+	if (BUILTIN_EXPECT(!conn, 0))
+		return NULL;
+	memset(conn, 0x00, sizeof(localsock_conn_t));
+
+	conn->pipe[0].data = kmalloc(2 * LOCALSOCK_BUFSIZE);
+	if (BUILTIN_EXPECT(!conn->pipe[0].data, 0)) {
+		kfree(conn);
+		return NULL;
+	}
+	conn->pipe[1].data = conn->pipe[0].data + LOCALSOCK_BUFSIZE;
+
+	spinlock_init(&conn->lock);
+	conn->open[0] = conn->open[1] = 1;
+
+	return conn;
+}
+
+/* close one end of a connection, the last one releases it */
+static void localsock_conn_release(localsock_conn_t* conn, uint8_t end)
+{
+	int destroy;
+
+	spinlock_lock(&conn->lock);
+
+	conn->open[end] = 0;
+	// the peer's writers get EPIPE, its readers EOF
+	if (conn->pipe[!end].reader) {
+		wakeup_task(conn->pipe[!end].reader->task->id);
+		conn->pipe[!end].reader = NULL;
+	}
+	localsock_wakeup(&conn->pipe[!end].waiters);
+	localsock_wakeup(&conn->pipe[end].waiters);
+	destroy = !conn->open[!end];
+
+	spinlock_unlock(&conn->lock);
+
+	if (destroy) {
+		kfree(conn->pipe[0].data);
+		kfree(conn);
+	}
+}
+
+int localsock_socket(void)
+{
+	int ret;
+
+	spinlock_lock(&localsock_lock);
+	ret = localsock_alloc(LOCALSOCK_UNBOUND);
+	spinlock_unlock(&localsock_lock);
+
+	return ret < 0 ? ret : ret | LOCALSOCK_FD_BIT;
+}
+
+int localsock_listen(int fd, uint16_t port)
+{
+	localsock_t* sock;
+	int i, ret = 0;
+
+	spinlock_lock(&localsock_lock);
+
+	sock = localsock_get(fd);
+	if (!sock) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (sock->state != LOCALSOCK_UNBOUND) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for(i = 0; i < MAX_LOCALSOCK; i++) {
+		if ((socks[i].state == LOCALSOCK_LISTEN) && (socks[i].port == port)) {
+			ret = -EADDRINUSE;
+			goto out;
+		}
+	}
+
+	sock->port = port;
+	sock->state = LOCALSOCK_LISTEN;
+
+out:
+	spinlock_unlock(&localsock_lock);
+
+	return ret;
+}
+
+int localsock_accept(int fd)
+{
+	localsock_t* sock;
+	localsock_conn_t* conn;
+	uint32_t gen;
+	int ret;
+
+	spinlock_lock(&localsock_lock);
+
+	sock = localsock_get(fd);
+	if (!sock) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (sock->state != LOCALSOCK_LISTEN) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	gen = sock->gen;
+	while (sock->bl_head == sock->bl_tail) {
+		localsock_wait(&localsock_lock, &sock->waiters);
+
+		if ((sock->state != LOCALSOCK_LISTEN) || (sock->gen != gen)) {
+			ret = -EBADF;
+			goto out;
+		}
+	}
+
+	// the connection stays in the backlog, if no socket is available
+	ret = localsock_alloc(LOCALSOCK_CONNECTED);
+	if (ret < 0)
+		goto out;
+
+	conn = sock->backlog[sock->bl_tail % LOCALSOCK_BACKLOG];
+	sock->bl_tail++;
+
+	socks[ret].conn = conn;
+	socks[ret].end = 1;
+	socks[ret].port = sock->port;
+	ret |= LOCALSOCK_FD_BIT;
+
+out:
+	spinlock_unlock(&localsock_lock);
+
+	return ret;
+}
+
+int localsock_connect(int fd, uint16_t port)
+{
+	localsock_t* sock;
+	localsock_t* listener = NULL;
+	localsock_conn_t* conn;
+	int i, ret = 0;
+
+	// allocate outside of the lock
+	conn = localsock_conn_create();
+	if (BUILTIN_EXPECT(!conn, 0))
+		return -ENOMEM;
+
+	spinlock_lock(&localsock_lock);
+
+	sock = localsock_get(fd);
+	if (!sock) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (sock->state != LOCALSOCK_UNBOUND) {
+		ret = -EISCONN;
+		goto out;
+	}
+
+	for(i = 0; i < MAX_LOCALSOCK; i++) {
+		if ((socks[i].state == LOCALSOCK_LISTEN) && (socks[i].port == port)) {
+			listener = socks + i;
+			break;
+		}
+	}
+
+	if (!listener || (listener->bl_head - listener->bl_tail >= LOCALSOCK_BACKLOG)) {
+		ret = -ECONNREFUSED;
+		goto out;
+	}
+
+	listener->backlog[listener->bl_head % LOCALSOCK_BACKLOG] = conn;
+	listener->bl_head++;
+	localsock_wakeup(&listener->waiters);
+
+	sock->conn = conn;
+	sock->end = 0;
+	sock->port = port;
+	sock->state = LOCALSOCK_CONNECTED;
+	conn = NULL;
+
+out:
+	spinlock_unlock(&localsock_lock);
+
+	if (conn) {
+		kfree(conn->pipe[0].data);
+		kfree(conn);
+	}
+
+	return ret;
+}
+
+int localsock_socketpair(int sv[2])
+{
+	localsock_conn_t* conn;
+	int s0, s1;
+
+	if (BUILTIN_EXPECT(!sv, 0))
+		return -EINVAL;
+
+	conn = localsock_conn_create();
+	if (BUILTIN_EXPECT(!conn, 0))
+		return -ENOMEM;
+
+	spinlock_lock(&localsock_lock);
+	s0 = localsock_alloc(LOCALSOCK_CONNECTED);
+	s1 = s0 < 0 ? s0 : localsock_alloc(LOCALSOCK_CONNECTED);
+	if (s1 < 0) {
+		if (s0 >= 0)
+			socks[s0].state = LOCALSOCK_FREE;
+	} else {
+		socks[s0].conn = socks[s1].conn = conn;
+		socks[s1].end = 1;
+	}
+	spinlock_unlock(&localsock_lock);
+
+	if (s1 < 0) {
+		kfree(conn->pipe[0].data);
+		kfree(conn);
+		return s1;
+	}
+
+	sv[0] = s0 | LOCALSOCK_FD_BIT;
+	sv[1] = s1 | LOCALSOCK_FD_BIT;
+
+	return 0;
+}
+
+ssize_t localsock_read(int fd, void* buf, size_t len)
+{
+	localsock_t* sock = localsock_get(fd);
+	localsock_reader_t reader;
+	localsock_conn_t* conn;
+	localsock_pipe_t* pipe;
+	uint32_t avail, pos, n;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!sock, 0))
+		return -EBADF;
+	if (BUILTIN_EXPECT(sock->state != LOCALSOCK_CONNECTED, 0))
+		return -ENOTCONN;
+	if (!len)
+		return 0;
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -EINVAL;
+
+	conn = sock->conn;
+	pipe = conn->pipe + sock->end;
+
+	spinlock_lock(&conn->lock);
+
+	while (1) {
+		avail = pipe->head - pipe->tail;
+		if (avail) {
+			ret = n = MIN(avail, len);
+			pos = pipe->tail & (LOCALSOCK_BUFSIZE - 1);
+			if (pos + n > LOCALSOCK_BUFSIZE) {
+				memcpy(buf, pipe->data + pos, LOCALSOCK_BUFSIZE - pos);
+				memcpy((uint8_t*) buf + LOCALSOCK_BUFSIZE - pos, pipe->data, n - (LOCALSOCK_BUFSIZE - pos));
+			} else memcpy(buf, pipe->data + pos, n);
+			pipe->tail += n;
+
+			// writers could wait for space
+			localsock_wakeup(&pipe->waiters);
+			break;
+		}
+
+		if (!conn->open[!sock->end]) {
+			ret = 0;
+			break;
+		}
+
+		if (pipe->reader) {
+			// another reader has already posted its buffer
+			localsock_wait(&conn->lock, &pipe->waiters);
+			continue;
+		}
+
+		reader.task = per_core(current_task);
+		reader.buf = buf;
+		reader.len = len;
+		reader.done = 0;
+		pipe->reader = &reader;
+
+		block_current_task();
+		spinlock_unlock(&conn->lock);
+		reschedule();
+		spinlock_lock(&conn->lock);
+
+		if (pipe->reader == &reader)
+			pipe->reader = NULL;
+		if (reader.done) {
+			ret = reader.done;
+			break;
+		}
+	}
+
+	spinlock_unlock(&conn->lock);
+
+	return ret;
+}
+
+ssize_t localsock_write(int fd, const void* buf, size_t len)
+{
+	localsock_t* sock = localsock_get(fd);
+	localsock_conn_t* conn;
+	localsock_pipe_t* pipe;
+	uint32_t space, pos, n;
+	size_t done = 0;
+	ssize_t ret = 0;
+
+	if (BUILTIN_EXPECT(!sock, 0))
+		return -EBADF;
+	if (BUILTIN_EXPECT(sock->state != LOCALSOCK_CONNECTED, 0))
+		return -ENOTCONN;
+	if (BUILTIN_EXPECT(len && !buf, 0))
+		return -EINVAL;
+
+	conn = sock->conn;
+	pipe = conn->pipe + !sock->end;
+
+	spinlock_lock(&conn->lock);
+
+	while (done < len) {
+		if (!conn->open[!sock->end]) {
+			ret = -EPIPE;
+			break;
+		}
+
+		// single copy into the buffer of the waiting reader
+		if (pipe->reader) {
+			localsock_reader_t* reader = pipe->reader;
+
+			n = MIN(len - done, reader->len - reader->done);
+			memcpy(reader->buf + reader->done, (const uint8_t*) buf + done, n);
+			reader->done += n;
+			done += n;
+
+			pipe->reader = NULL;
+			wakeup_task(reader->task->id);
+			continue;
+		}
+
+		space = LOCALSOCK_BUFSIZE - (pipe->head - pipe->tail);
+		if (space) {
+			n = MIN(space, len - done);
+			pos = pipe->head & (LOCALSOCK_BUFSIZE - 1);
+			if (pos + n > LOCALSOCK_BUFSIZE) {
+				memcpy(pipe->data + pos, (const uint8_t*) buf + done, LOCALSOCK_BUFSIZE - pos);
+				memcpy(pipe->data, (const uint8_t*) buf + done + LOCALSOCK_BUFSIZE - pos, n - (LOCALSOCK_BUFSIZE - pos));
+			} else memcpy(pipe->data + pos, (const uint8_t*) buf + done, n);
+			pipe->head += n;
+			done += n;
+
+			// further readers could wait
+			localsock_wakeup(&pipe->waiters);
+			continue;
+		}
+
+		// the ring is full => wait for the reader
+		localsock_wait(&conn->lock, &pipe->waiters);
+	}
+
+	spinlock_unlock(&conn->lock);
+
+	return done ? (ssize_t) done : ret;
+}
+
+int localsock_close(int fd)
+{
+	localsock_conn_t* backlog[LOCALSOCK_BACKLOG];
+	localsock_conn_t* conn = NULL;
+	localsock_t* sock;
+	uint32_t i, n = 0;
+	uint8_t end = 0;
+
+	spinlock_lock(&localsock_lock);
+
+	sock = localsock_get(fd);
+	if (!sock) {
+		spinlock_unlock(&localsock_lock);
+		return -EBADF;
+	}
+
+	if (sock->state == LOCALSOCK_LISTEN) {
+		// reset the connections, which aren't accepted
+		while (sock->bl_tail != sock->bl_head) {
+			backlog[n++] = sock->backlog[sock->bl_tail % LOCALSOCK_BACKLOG];
+			sock->bl_tail++;
+		}
+		localsock_wakeup(&sock->waiters);
+	} else if (sock->state == LOCALSOCK_CONNECTED) {
+		conn = sock->conn;
+		end = sock->end;
+	}
+
+	sock->gen++;
+	sock->conn = NULL;
+	sock->state = LOCALSOCK_FREE;
+
+	spinlock_unlock(&localsock_lock);
+
+	for(i = 0; i < n; i++)
+		localsock_conn_release(backlog[i], 1);
+	if (conn)
+		localsock_conn_release(conn, end);
+
+	return 0;
+}
@@ -28,18 +28,37 @@
 #include <hermit/stddef.h>
 #include <hermit/stdio.h>
 #include <hermit/string.h>
+#include <hermit/stdlib.h>
 #include <hermit/time.h>
 #include <hermit/tasks.h>
 #include <hermit/processor.h>
 #include <hermit/tasks.h>
 #include <hermit/syscall.h>
 #include <hermit/memory.h>
+#include <hermit/semaphore.h>
 #include <hermit/logging.h>
+#include <hermit/netparams.h>
+#include <hermit/uhyve_io.h>
+#include <hermit/console.h>
+#include <hermit/klog.h>
+#include <hermit/vclock.h>
+#include <hermit/clocksource.h>
+#include <hermit/sysstat.h>
+#include <hermit/ktrace.h>
+#include <hermit/boottime.h>
+#include <hermit/proxy.h>
+#include <hermit/romfs.h>
+#include <hermit/metrics.h>
+#include <hermit/block.h>
+#include <hermit/blkfs.h>
+#include <hermit/vsock.h>
+#include <hermit/virtiofs.h>
 #include <asm/irq.h>
 #include <asm/page.h>
 #include <asm/uart.h>
 #ifdef __x86_64__
 #include <asm/multiboot.h>
+#include <asm/numa.h>
 #endif
 #include <asm/uhyve.h>
 
@@ -62,6 +81,7 @@
 #include <net/e1000.h>
 #include <net/vioif.h>
 #include <net/uhyve-net.h>
+#include <net/netstats.h>
 
 #define HERMIT_PORT	0x494E
 #define HERMIT_MAGIC	0x7E317
@@ -98,6 +118,10 @@ extern const void percore_end;
 extern atomic_int64_t total_pages;
 extern atomic_int64_t total_allocated_pages;
 extern atomic_int64_t total_available_pages;
+#ifdef __x86_64__
+extern atomic_int64_t node_allocated_pages[MAX_NUMA_NODES];
+extern atomic_int64_t node_available_pages[MAX_NUMA_NODES];
+#endif
 
 extern atomic_int32_t cpu_online;
 extern atomic_int32_t possible_cpus;
@@ -113,12 +137,16 @@ extern void signal_init();
 
 static int hermit_init(void)
 {
+	boot_phase_end(BOOT_PHASE_LOADER);
+	boot_phase_begin(BOOT_PHASE_HERMIT_INIT);
+
 	clock_init();
 
 	size_t sz = (size_t) &percore_end0 - (size_t) &percore_start;
 
-	// initialize .kbss sections
-	memset((void*)&tdata_end, 0x00, (size_t) &__bss_start - (size_t) &tdata_end);
+	// initialize .kbss sections, if the loader doesn't pass zeroed memory
+	if (!(is_uhyve() & UHYVE_FEAT_ZEROED_MEM))
+		memset((void*)&tdata_end, 0x00, (size_t) &__bss_start - (size_t) &tdata_end);
 
 	// initialize .percore section => copy first section to all other sections
 	for(uint32_t i=1; i<MAX_CORES; i++)
@@ -128,10 +156,72 @@ static int hermit_init(void)
 
 	system_init();
 	irq_init();
+#ifdef LOCKSTAT
+	lockstat_init();
+#endif
 	timer_init();
 	multitasking_init();
+	boot_phase_begin(BOOT_PHASE_MEMORY_INIT);
 	memory_init();
+	boot_phase_end(BOOT_PHASE_MEMORY_INIT);
 	signal_init();
+	sched_init();
+
+	boot_phase_end(BOOT_PHASE_HERMIT_INIT);
+
+	return 0;
+}
+
+/// maximal time in milliseconds, which the boot waits for a DHCP lease
+#define DHCP_TIMEOUT_MSECS	(20*DHCP_FINE_TIMER_MSECS)
+
+/*
+ * Reads the IPv4 address of the option name (e.g. -ip=) from the kernel
+ * command line.
+ *
+ * @return 1 if the option is set, otherwise 0
+ */
+static int cmdline_ip4(const char* name, ip_addr_t* addr)
+{
+	const char* cmdline = get_cmdline();
+	const char* found = cmdline ? strstr(cmdline, name) : NULL;
+	char buf[16];
+	size_t i;
+
+	if (!found)
+		return 0;
+
+	found += strlen(name);
+	for(i=0; (i<sizeof(buf)-1) && found[i] && (found[i] != ' '); i++)
+		buf[i] = found[i];
+	buf[i] = '\0';
+
+	if (!ip4addr_aton(buf, ip_2_ip4(addr))) {
+		LOG_WARNING("Invalid address %s%s on the kernel command line\n", name, buf);
+		return 0;
+	}
+	IP_SET_TYPE_VAL(*addr, IPADDR_TYPE_V4);
+
+	return 1;
+}
+
+#if LWIP_NETIF_STATUS_CALLBACK
+static void netif_status_changed(struct netif* netif)
+{
+	if (netif_is_up(netif) && ip_2_ip4(&netif->ip_addr)->addr)
+		LOG_INFO("Network is ready after %d ms: %s\n", (int) get_uptime(), ip4addr_ntoa(netif_ip4_addr(netif)));
+}
+#endif
+
+int network_wait(uint32_t timeout_ms)
+{
+	uint64_t start = get_uptime();
+
+	while(!ip_2_ip4(&default_netif.ip_addr)->addr) {
+		if (get_uptime() - start >= timeout_ms)
+			return -ETIMEDOUT;
+		sys_msleep(1);
+	}
 
 	return 0;
 }
@@ -142,9 +232,42 @@ static void tcpip_init_done(void* arg)
 
 	LOG_INFO("LwIP's tcpip thread has task id %d\n", per_core(current_task)->id);
 
+	// the timeouts of LwIP don't have to be exact => share the interrupts of other timers
+	set_task_timer_slack(per_core(current_task)->id, LWIP_TIMER_SLACK_NSEC);
+
 	sys_sem_signal(sem);
 }
 
+#ifndef __aarch64__
+static struct netif	ivshmem_netif;
+
+/* co-located unikernels exchange their packets in the shared memory of an ivshmem device */
+static void init_ivshmem_netif(void)
+{
+	ip_addr_t	ipaddr;
+	ip_addr_t	netmask;
+	ip_addr_t	gw;
+	uint32_t	node;
+	err_t		err;
+
+	if (mmnif_ivshmem_probe(&node))
+		return;
+
+	IP_ADDR4(&gw, 0,0,0,0);
+	IP_ADDR4(&ipaddr, 192,168,28,node+1);
+	IP_ADDR4(&netmask, 255,255,255,0);
+
+	/* mmnif passes the packets to ip_input in the context of the tcpip thread */
+	if ((err = netifapi_netif_add(&ivshmem_netif, ip_2_ip4(&ipaddr), ip_2_ip4(&netmask), ip_2_ip4(&gw), NULL, mmnif_init, ip_input)) != ERR_OK) {
+		LOG_ERROR("Unable to add the ivshmem network interface: err = %d\n", err);
+		return;
+	}
+
+	netifapi_netif_set_up(&ivshmem_netif);
+	LOG_INFO("ivshmem interface uses the address %s\n", ip4addr_ntoa(ip_2_ip4(&ipaddr)));
+}
+#endif
+
 static int init_netifs(void)
 {
 	ip_addr_t	ipaddr;
@@ -153,6 +276,9 @@ static int init_netifs(void)
 	sys_sem_t	sem;
 	err_t		err;
 
+	// the sizes of LwIP's buffers have to be known before its initialization
+	netparams_init();
+
 	if(sys_sem_new(&sem, 0) != ERR_OK)
 		LWIP_ASSERT("Failed to create semaphore", 0);
 
@@ -210,25 +336,35 @@ static int init_netifs(void)
 		netifapi_netif_set_default(&default_netif);
 		netifapi_netif_set_up(&default_netif);
 	} else {
-#ifdef __aarch64__
-		LOG_ERROR("Unable to add the network interface\n");
+		const char* cmdline = get_cmdline();
+		int static_ip = 0;
 
-		return -ENODEV;
-#else
 		/* Clear network address because we use DHCP to get an ip address */
 		IP_ADDR4(&gw, 0,0,0,0);
 		IP_ADDR4(&ipaddr, 0,0,0,0);
 		IP_ADDR4(&netmask, 0,0,0,0);
 
-		/* Note: Our drivers guarantee that the input function will be called in the context of the tcpip thread.
+		/* -ip=a.b.c.d [-netmask=a.b.c.d] [-gateway=a.b.c.d] disable DHCP */
+		if (cmdline_ip4("-ip=", &ipaddr)) {
+			static_ip = 1;
+			if (!cmdline_ip4("-netmask=", &netmask))
+				IP_ADDR4(&netmask, 255,255,255,0);
+			cmdline_ip4("-gateway=", &gw);
+		}
+
+		/* Note: Our drivers guarantee that the input function will be called in the context of the tcpip thread
+		 * or of a processing context (NAPI_CONTEXTS), which holds the core lock.
 		 * => Therefore, we are able to use ethernet_input instead of tcpip_input */
 		if ((err = netifapi_netif_add(&default_netif, ip_2_ip4(&ipaddr), ip_2_ip4(&netmask), ip_2_ip4(&gw), NULL, vioif_init, ethernet_input)) == ERR_OK)
 			goto success;
+#ifndef __aarch64__
+		/* aarch64 has no PCI bus, vioif uses the virtio-mmio transport */
 		if ((err = netifapi_netif_add(&default_netif, ip_2_ip4(&ipaddr), ip_2_ip4(&netmask), ip_2_ip4(&gw), NULL, rtl8139if_init, ethernet_input)) == ERR_OK)
 			goto success;
 #ifdef USE_E1000
 		if ((err = netifapi_netif_add(&default_netif, ip_2_ip4(&ipaddr), ip_2_ip4(&netmask), ip_2_ip4(&gw), NULL, e1000if_init, ethernet_input)) == ERR_OK)
 			goto success;
+#endif
 #endif
 
 		LOG_ERROR("Unable to add the network interface: err = %d\n", err);
@@ -236,38 +372,36 @@ static int init_netifs(void)
 		return -ENODEV;
 
 success:
+#if LWIP_NETIF_STATUS_CALLBACK
+		netif_set_status_callback(&default_netif, netif_status_changed);
+#endif
 		netifapi_netif_set_default(&default_netif);
 		netifapi_netif_set_up(&default_netif);
 
+#ifndef __aarch64__
+		init_ivshmem_netif();
+#endif
+
+		if (static_ip) {
+			LOG_INFO("Use the static address %s\n", ip4addr_ntoa(ip_2_ip4(&ipaddr)));
+			return 0;
+		}
+
+		/* the tcpip thread runs the DHCP timers */
 		LOG_INFO("Starting DHCPD...\n");
+		boot_phase_begin(BOOT_PHASE_DHCP);
 		netifapi_dhcp_start(&default_netif);
 
-		int mscnt = 0;
-		int ip_counter = 0;
-		/* wait for ip address */
-		while(!ip_2_ip4(&default_netif.ip_addr)->addr && (ip_counter < 20)) {
-			uint64_t end_tsc, start_tsc = get_rdtsc();
-
-			do {
-				if (ip_2_ip4(&default_netif.ip_addr)->addr)
-					return 0;
-				check_workqueues();
-				end_tsc = get_rdtsc();
-			} while(((end_tsc - start_tsc) / (get_cpu_frequency() * 1000)) < DHCP_FINE_TIMER_MSECS);
-
-			dhcp_fine_tmr();
-			mscnt += DHCP_FINE_TIMER_MSECS;
-			if (mscnt >= DHCP_COARSE_TIMER_SECS*1000) {
-				dhcp_coarse_tmr();
-				mscnt = 0;
-			}
-
-			ip_counter++;
+		/* -dhcp=async => the application starts without lease (see sys_network_wait) */
+		if (cmdline && strstr(cmdline, "-dhcp=async")) {
+			LOG_INFO("Don't wait for the DHCP lease\n");
+			return 0;
 		}
 
-		if (!ip_2_ip4(&default_netif.ip_addr)->addr)
+		const int ret = network_wait(DHCP_TIMEOUT_MSECS);
+		boot_phase_end(BOOT_PHASE_DHCP);
+		if (ret)
 			return -ENODEV;
-#endif
 	}
 
 	return 0;
@@ -280,11 +414,15 @@ int network_shutdown(void)
 	if (libc_sd >= 0) {
 		int s = libc_sd;
 		libc_sd = -1;
-		lwip_close(s);
+		proxy_shutdown();
+		host_sock_close(s);
 	}
 
 	//mmnif_shutdown();
 	//stats_display();
+#ifdef NETSTATS
+	netstats_dump();
+#endif
 
 	return 0;
 }
@@ -292,6 +430,7 @@ int network_shutdown(void)
 #if MAX_CORES > 1
 int smp_main(void)
 {
+	clocksource_enable_cpu();
 	timer_init();
 #ifdef DYNAMIC_TICKS
 	enable_dynticks();
@@ -306,7 +445,9 @@ int smp_main(void)
 
 	while(1) {
 		check_workqueues();
-		wait_for_task();
+		// don't halt, if the budget has left deferred work
+		if (!softirq_pending())
+			wait_for_task();
 	}
 
 	return 0;
@@ -317,13 +458,115 @@ int libc_start(int argc, char** argv, char** env);
 
 char* itoa(uint64_t input, char* str);
 
+#ifndef __aarch64__
+/// memory, which -prefault=all leaves to the kernel
+#define PREFAULT_RESERVE	(64ULL << 20)
+
+typedef struct {
+	size_t start;
+	size_t end;
+	int ret;
+	sem_t* done;
+} prefault_t;
+
+static int prefault_worker(void* arg)
+{
+	prefault_t* p = (prefault_t*) arg;
+
+	p->ret = page_prefault(p->start, p->end);
+	sem_post(p->done);
+
+	return 0;
+}
+
+/*
+ * Maps the first part of the heap ahead of its first use, if the
+ * kernel command line contains -prefault=<size>[K|M|G] or -prefault=all.
+ * The range is split between all online cores.
+ */
+static void prefault_heap(void)
+{
+	static prefault_t prefault[MAX_CORES];
+	const char* cmdline = get_cmdline();
+	const char* found = cmdline ? strstr(cmdline, "-prefault=") : NULL;
+	const uint32_t ncores = atomic_int32_read(&cpu_online);
+	size_t size, chunk, start = HEAP_START;
+	uint64_t tsc;
+	uint32_t i, n;
+	sem_t done;
+	char* end;
+
+	if (!found)
+		return;
+
+	found += strlen("-prefault=");
+	if (!strncmp(found, "all", 3)) {
+		size = atomic_int64_read(&total_available_pages) * PAGE_SIZE;
+		size = (size > PREFAULT_RESERVE) ? size - PREFAULT_RESERVE : 0;
+	} else {
+		size = strtoul(found, &end, 10);
+		switch(*end) {
+		case 'G':
+		case 'g':
+			size <<= 10;
+		case 'M':
+		case 'm':
+			size <<= 10;
+		case 'K':
+		case 'k':
+			size <<= 10;
+		default:
+			break;
+		}
+	}
+
+	if (size > HEAP_SIZE)
+		size = HEAP_SIZE;
+	size = HUGE_PAGE_FLOOR(size);
+	if (!size)
+		return;
+
+	// 1 GiB pages require 1 GiB aligned chunks
+	chunk = HUGE_PAGE_CEIL(size / ncores);
+	if (chunk > PAGE_1G_SIZE)
+		chunk = (chunk + PAGE_1G_SIZE - 1) & PAGE_1G_MASK;
+
+	sem_init(&done, 0);
+	tsc = get_rdtsc();
+
+	for(i=0, n=0; (i<ncores) && (i<MAX_CORES) && (n*chunk<size); i++, n++) {
+		prefault[i].start = start + n * chunk;
+		prefault[i].end = start + ((n+1)*chunk < size ? (n+1)*chunk : size);
+		prefault[i].ret = 0;
+		prefault[i].done = &done;
+
+		if (BUILTIN_EXPECT(create_kernel_task_on_core(NULL, prefault_worker, prefault+i, HIGH_PRIO, i), 0)) {
+			// map this part on the current core
+			prefault_worker(prefault+i);
+		}
+	}
+
+	for(i=0; i<n; i++)
+		sem_wait(&done, 0);
+	sem_destroy(&done);
+
+	for(i=0; i<n; i++) {
+		if (BUILTIN_EXPECT(prefault[i].ret, 0))
+			LOG_WARNING("Unable to prefault heap range 0x%zx - 0x%zx: %d\n", prefault[i].start, prefault[i].end, prefault[i].ret);
+	}
+
+	LOG_INFO("Prefault %zd MiB of the heap on %u cores within %llu ms\n", size >> 20, n,
+		(get_rdtsc() - tsc) / ((uint64_t) get_cpu_frequency() * 1000ULL));
+}
+#endif
+
 // init task => creates all other tasks and initializes the LwIP
 static int initd(void* arg)
 {
 	int s = -1, c = -1;
 	int i, j, flag;
 	int len, err;
-	int magic = 0;
+	int magic = 0, vsock;
 	struct sockaddr_in6 server, client;
 	task_t* curr_task = per_core(current_task);
 	int argc, envc;
@@ -333,7 +576,11 @@ static int initd(void* arg)
 	LOG_INFO("Initd is running\n");
 
 	// initialized bss section
-	memset((void*)&__bss_start, 0x00, (size_t) &kernel_start + image_size - (size_t) &__bss_start);
+	// => the memset touches every page, skip it if the loader passes zeroed memory
+	boot_phase_begin(BOOT_PHASE_BSS);
+	if (!(is_uhyve() & UHYVE_FEAT_ZEROED_MEM))
+		memset((void*)&__bss_start, 0x00, (size_t) &kernel_start + image_size - (size_t) &__bss_start);
+	boot_phase_end(BOOT_PHASE_BSS);
 
 	// setup heap
 	if (!curr_task->heap)
@@ -353,13 +600,34 @@ static int initd(void* arg)
 	vma_free(curr_task->heap->start, curr_task->heap->start+PAGE_SIZE);
 	vma_add(curr_task->heap->start, curr_task->heap->start+PAGE_SIZE, VMA_HEAP|VMA_USER);
 
+#ifndef __aarch64__
+	prefault_heap();
+#endif
+
 #ifndef __aarch64__
 	// initialize network
+	boot_phase_begin(BOOT_PHASE_INIT_NETIFS);
 	err = init_netifs();
+	boot_phase_end(BOOT_PHASE_INIT_NETIFS);
+#if METRICS_PORT
+	if (!err)
+		metrics_init(METRICS_PORT);
+#endif
 #else
 	err = -EINVAL;
 #endif
 
+	// direct block I/O and the file system on top of it
+	if ((blk_init() == 0) && (blkfs_mount() < 0))
+		LOG_ERROR("Unable to mount the file system of the block device\n");
+
+	// host files, which virtio-fs shares with the guest
+	if ((viofs_init() == 0) && (virtiofs_mount() < 0))
+		LOG_ERROR("Unable to mount the virtio-fs file system\n");
+
+	// the proxy reaches us without IP, if the host provides a vsock device
+	vsock = (vsock_init() == 0);
+
 	if (is_uhyve()) {
 		int i;
 		uhyve_cmdsize_t uhyve_cmdsize;
@@ -393,6 +661,7 @@ static int initd(void* arg)
 				(unsigned)virt_to_phys((size_t)&uhyve_cmdval_phys));
 
 		LOG_INFO("Boot time: %d ms\n", get_uptime());
+		boottime_dump();
 		libc_start(uhyve_cmdsize.argc, uhyve_cmdval.argv, uhyve_cmdval.envp);
 
 		for(i=0; i<uhyve_cmdsize.argc; i++)
@@ -407,21 +676,50 @@ static int initd(void* arg)
 		return 0;
 	}
 
-	if ((err != 0) || !is_proxy())
+	if (((err != 0) && !vsock) || !is_proxy())
 	{
 		char* dummy[] = {"app_name", NULL};
 
 		LOG_INFO("Boot time: %d ms\n", (get_clock_tick() * 1000) / TIMER_FREQ);
+		boottime_dump();
 		// call user code
 		libc_start(1, dummy, NULL); //argc, argv, environ);
 
 		return 0;
 	}
 
+	// the proxy requires an address (DHCP may run asynchronously)
+	if (!vsock && network_wait(DHCP_TIMEOUT_MSECS)) {
+		LOG_ERROR("Network isn't ready, unable to wait for the proxy\n");
+		return -ENODEV;
+	}
+
 	// initialize iRCCE
 	if (!is_single_kernel())
 		init_rcce();
 
+	if (vsock) {
+		s = vsock_socket();
+		if ((s < 0) || ((err = vsock_listen(s, HERMIT_PORT)) < 0)) {
+			LOG_ERROR("vsock: unable to listen on port %d: %d\n", HERMIT_PORT, s < 0 ? s : err);
+			if (s >= 0)
+				vsock_close(s);
+			return -1;
+		}
+
+		LOG_INFO("Boot time: %d ms\n", (get_clock_tick() * 1000) / TIMER_FREQ);
+		LOG_INFO("vsock server is listening on CID %llu.\n", vsock_local_cid());
+
+		if ((c = vsock_accept(s, NULL, NULL)) < 0) {
+			LOG_ERROR("accept failed: %d\n", c);
+			vsock_close(s);
+			return -1;
+		}
+
+		LOG_INFO("Establish vsock connection\n");
+		goto handshake;
+	}
+
 	s = lwip_socket(AF_INET6, SOCK_STREAM , 0);
 	if (s < 0) {
 		LOG_ERROR("socket failed: %d\n", server);
@@ -469,16 +767,18 @@ static int initd(void* arg)
 	flag = 0;
 	lwip_setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, (char *) &flag, sizeof(flag));
 
+handshake:
 	magic = 0;
-	lwip_read(c, &magic, sizeof(magic));
-	if (magic != HERMIT_MAGIC)
+	host_sock_read(c, &magic, sizeof(magic));
+	if ((magic != HERMIT_MAGIC) && (magic != HERMIT_MAGIC_V2))
 	{
 		LOG_ERROR("Invalid magic number %d\n", magic);
-		lwip_close(c);
+		host_sock_close(c);
+		host_sock_close(s);
 		return -1;
 	}
 
-	err = lwip_read(c, &argc, sizeof(argc));
+	err = host_sock_read(c, &argc, sizeof(argc));
 	if (err != sizeof(argc))
 		goto out;
 
@@ -489,7 +789,7 @@ static int initd(void* arg)
 
 	for(i=0; i<argc; i++)
 	{
-		err = lwip_read(c, &len, sizeof(len));
+		err = host_sock_read(c, &len, sizeof(len));
 		if (err != sizeof(len))
 			goto out;
 
@@ -499,7 +799,7 @@ static int initd(void* arg)
 
 		j = 0;
 		while(j < len) {
-			err = lwip_read(c, argv[i]+j, len-j);
+			err = host_sock_read(c, argv[i]+j, len-j);
 			if (err < 0)
 				goto out;
 			j += err;
@@ -507,7 +807,7 @@ static int initd(void* arg)
 
 	}
 
-	err = lwip_read(c, &envc, sizeof(envc));
+	err = host_sock_read(c, &envc, sizeof(envc));
 	if (err != sizeof(envc))
 		goto out;
 
@@ -518,7 +818,7 @@ static int initd(void* arg)
 
 	for(i=0; i<envc; i++)
 	{
-		err = lwip_read(c, &len, sizeof(len));
+		err = host_sock_read(c, &len, sizeof(len));
 		if (err != sizeof(len))
 			goto out;
 
@@ -528,14 +828,19 @@ static int initd(void* arg)
 
 		j = 0;
 		while(j < len) {
-			err = lwip_read(c, environ[i]+j, len-j);
+			err = host_sock_read(c, environ[i]+j, len-j);
 			if (err < 0)
 				goto out;
 			j += err;
 		}
 	}
 
+	// a proxy, which sends the new magic number, speaks the framed protocol
+	if ((magic == HERMIT_MAGIC_V2) && proxy_init(c))
+		goto out;
+
 	// call user code
+	boottime_dump();
 	libc_sd = c;
 	libc_start(argc, argv, environ);
 
@@ -560,11 +865,11 @@ out:
 	}
 
 	if (c > 0)
-		lwip_close(c);
+		host_sock_close(c);
 	libc_sd = -1;
 
 	if (s > 0)
-		lwip_close(s);
+		host_sock_close(s);
 
 	return 0;
 }
@@ -647,7 +952,18 @@ static int measure_context(void* arg)
 int hermit_main(void)
 {
 	hermit_init();
+	boot_phase_begin(BOOT_PHASE_SYSTEM_CALIBRATION);
 	system_calibration(); // enables also interrupts
+	boot_phase_end(BOOT_PHASE_SYSTEM_CALIBRATION);
+
+	// publish the clock page, which the C library reads without system calls
+	vclock_init();
+#ifdef SYSSTAT
+	sysstat_init();
+#endif
+
+	// store the log messages in per-core rings, if configured
+	klog_init();
 
 	LOG_INFO("This is Hermit %s, build on %s\n", PACKAGE_VERSION, __DATE__);
 	//LOG_INFO("Isle %d of %d possible isles\n", isle, possible_isles);
@@ -661,6 +977,12 @@ int hermit_main(void)
 	LOG_INFO("Total memory: %zd MiB\n", atomic_int64_read(&total_pages) * PAGE_SIZE / (1024ULL*1024ULL));
 	LOG_INFO("Current allocated memory: %zd KiB\n", atomic_int64_read(&total_allocated_pages) * PAGE_SIZE / 1024ULL);
 	LOG_INFO("Current available memory: %zd MiB\n", atomic_int64_read(&total_available_pages) * PAGE_SIZE / (1024ULL*1024ULL));
+#ifdef __x86_64__
+	for(uint32_t i=0; (numa_nodes() > 1) && (i<numa_nodes()); i++)
+		LOG_INFO("Node %u: allocated memory %zd MiB, available memory %zd MiB\n", i,
+			atomic_int64_read(node_allocated_pages+i) * PAGE_SIZE / (1024ULL*1024ULL),
+			atomic_int64_read(node_available_pages+i) * PAGE_SIZE / (1024ULL*1024ULL));
+#endif
 	LOG_INFO("Core %d is the boot processor\n", boot_processor);
 	LOG_INFO("System is able to use %d processors\n", possible_cpus);
 	if (get_cmdline())
@@ -680,9 +1002,24 @@ int hermit_main(void)
 	while(atomic_int32_read(&cpu_online) < atomic_int32_read(&possible_cpus))
 		PAUSE;
 
+#ifdef KERNEL_TRACE
+	// the hooks need the per-core data of all cores
+	ktrace_init();
+#endif
+
 	print_cpu_status(isle);
 	//vma_dump();
 
+	// asynchronous file I/O, if the host supports it
+	uhyve_io_init();
+
+	// buffer stdout and stderr
+	console_init();
+
+	// index the file system image, which is linked into the application
+	if (romfs_init() < 0)
+		LOG_ERROR("Unable to index the file system image\n");
+
 #ifdef MEASURE_CONTEXT
 	create_kernel_task_on_core(NULL, dummy_task, NULL, NORMAL_PRIO, boot_processor);
 	create_kernel_task_on_core(NULL, measure_context, NULL, NORMAL_PRIO, boot_processor);
@@ -692,7 +1029,9 @@ int hermit_main(void)
 
 	while(1) {
 		check_workqueues();
-		wait_for_task();
+		// don't halt, if the budget has left deferred work
+		if (!softirq_pending())
+			wait_for_task();
 	}
 
 	return 0;
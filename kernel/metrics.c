@@ -0,0 +1,477 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/stdarg.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <hermit/time.h>
+#include <hermit/tasks.h>
+#include <hermit/memory.h>
+#include <hermit/sysstat.h>
+#include <hermit/metrics.h>
+#include <lwip/tcp.h>
+#include <lwip/tcpip.h>
+#include <net/netstats.h>
+
+/// space in front of the body, which takes the HTTP header
+#define METRICS_HDR_SIZE	160
+/// space of the body, which every core needs
+#define METRICS_CORE_SIZE	1024
+/// space of the body without the cores
+#define METRICS_BASE_SIZE	(32*1024)
+/// the connection is closed after METRICS_POLL poll intervals (500 ms each) without a request
+#define METRICS_POLL		4
+
+typedef struct metrics_conn {
+	/// header and body of the response
+	char* buf;
+	/// start of the response in buf
+	size_t start;
+	/// end of the response in buf
+	size_t len;
+	/// size of buf
+	size_t size;
+	/// number of bytes, which are passed to tcp_write
+	size_t sent;
+	/// is the response generated?
+	uint8_t responded;
+	/// JSON instead of the Prometheus text format
+	uint8_t json;
+	/// a sample is already written (JSON needs the separators)
+	uint8_t first;
+	/// number of poll intervals without a request
+	uint8_t idle;
+} metrics_conn_t;
+
+static void metrics_putchar(int c, void* arg)
+{
+	metrics_conn_t* conn = (metrics_conn_t*) arg;
+
+	// the last byte stays free for the termination
+	if (conn->len + 1 < conn->size)
+		conn->buf[conn->len++] = (char) c;
+}
+
+static void metrics_printf(metrics_conn_t* conn, const char* fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	kvprintf(fmt, metrics_putchar, conn, 10, ap);
+	va_end(ap);
+}
+
+/// the type of a metric family, only the text format contains it
+static void metrics_type(metrics_conn_t* conn, const char* name, const char* type)
+{
+	if (!conn->json)
+		metrics_printf(conn, "# TYPE hermit_%s %s\n", name, type);
+}
+
+/// write a sample with an optional label
+static void metrics_sample(metrics_conn_t* conn, const char* name, const char* label, const char* lvalue, uint64_t value)
+{
+	if (conn->json) {
+		metrics_printf(conn, "%s\n{\"name\":\"hermit_%s\"", conn->first ? "" : ",", name);
+		if (label)
+			metrics_printf(conn, ",\"labels\":{\"%s\":\"%s\"}", label, lvalue);
+		metrics_printf(conn, ",\"value\":%llu}", value);
+	} else if (label) {
+		metrics_printf(conn, "hermit_%s{%s=\"%s\"} %llu\n", name, label, lvalue, value);
+	} else {
+		metrics_printf(conn, "hermit_%s %llu\n", name, value);
+	}
+
+	conn->first = 0;
+}
+
+static void metrics_cores(metrics_conn_t* conn)
+{
+	static const struct {
+		const char* name;
+		const char* type;
+		uint8_t pf;
+		size_t off;
+	} fields[] = {
+		{"core_switches_total", "counter", 0, __builtin_offsetof(core_stats_t, nr_switches)},
+		{"core_steals_total", "counter", 0, __builtin_offsetof(core_stats_t, nr_steals)},
+		{"core_migrations_total", "counter", 0, __builtin_offsetof(core_stats_t, nr_migrations)},
+		{"core_steal_time_us_total", "counter", 0, __builtin_offsetof(core_stats_t, steal_time)},
+		{"core_page_faults_total", "counter", 1, __builtin_offsetof(pf_stats_t, nr_faults)}
+	};
+	core_stats_t cstats;
+	pf_stats_t pstats;
+	char core[12];
+	uint32_t i, f;
+
+	// one family after the other, Prometheus expects the samples grouped
+	for(f=0; f<sizeof(fields)/sizeof(fields[0]); f++) {
+		metrics_type(conn, fields[f].name, fields[f].type);
+		for(i=0; i<MAX_CORES; i++) {
+			const void* src;
+
+			if (get_core_stats(i, &cstats))
+				continue;
+			if (fields[f].pf) {
+				if (page_fault_stats(i, &pstats))
+					continue;
+				src = &pstats;
+			} else {
+				src = &cstats;
+			}
+
+			ksnprintf(core, sizeof(core), "%u", i);
+			metrics_sample(conn, fields[f].name, "core", core,
+				*(const uint64_t*) ((const uint8_t*) src + fields[f].off));
+		}
+	}
+}
+
+static void metrics_memory(metrics_conn_t* conn)
+{
+	mem_stats_t mstats;
+	pf_stats_t pstats;
+	uint32_t i;
+
+	if (!mem_get_stats(&mstats)) {
+		metrics_type(conn, "memory_total_bytes", "gauge");
+		metrics_sample(conn, "memory_total_bytes", NULL, NULL, mstats.total_pages * PAGE_SIZE);
+		metrics_type(conn, "memory_allocated_bytes", "gauge");
+		metrics_sample(conn, "memory_allocated_bytes", NULL, NULL, mstats.allocated_pages * PAGE_SIZE);
+		metrics_type(conn, "memory_available_bytes", "gauge");
+		metrics_sample(conn, "memory_available_bytes", NULL, NULL, mstats.available_pages * PAGE_SIZE);
+
+		metrics_type(conn, "memory_tag_bytes", "gauge");
+		for(i=0; i<MEM_NR_TAGS; i++) {
+			int64_t pages = mstats.tags[i].pages;
+
+			metrics_sample(conn, "memory_tag_bytes", "tag", mem_tag_name(i),
+				(pages > 0) ? (uint64_t) pages * PAGE_SIZE : 0);
+		}
+	}
+
+	if (!page_fault_stats(-1, &pstats)) {
+		metrics_type(conn, "page_faults_total", "counter");
+		metrics_sample(conn, "page_faults_total", "kind", "small", pstats.nr_small);
+		metrics_sample(conn, "page_faults_total", "kind", "huge", pstats.nr_huge);
+		metrics_sample(conn, "page_faults_total", "kind", "1g", pstats.nr_1g);
+		metrics_sample(conn, "page_faults_total", "kind", "spurious", pstats.nr_spurious);
+		metrics_type(conn, "page_fault_cycles_total", "counter");
+		metrics_sample(conn, "page_fault_cycles_total", NULL, NULL, pstats.total_cycles);
+	}
+}
+
+static void metrics_net(metrics_conn_t* conn)
+{
+	static const struct {
+		const char* name;
+		size_t off;
+	} fields[] = {
+		{"net_rx_packets_total", __builtin_offsetof(netstats_t, rx_packets)},
+		{"net_rx_bytes_total", __builtin_offsetof(netstats_t, rx_bytes)},
+		{"net_rx_drops_total", __builtin_offsetof(netstats_t, rx_drops)},
+		{"net_tx_packets_total", __builtin_offsetof(netstats_t, tx_packets)},
+		{"net_tx_bytes_total", __builtin_offsetof(netstats_t, tx_bytes)},
+		{"net_tx_drops_total", __builtin_offsetof(netstats_t, tx_drops)},
+		{"net_tx_ring_full_total", __builtin_offsetof(netstats_t, tx_ring_full)},
+		{"net_interrupts_total", __builtin_offsetof(netstats_t, interrupts)},
+		{"net_kicks_total", __builtin_offsetof(netstats_t, kicks)}
+	};
+	netstats_t nstats;
+	char ifname[8];
+	uint32_t i, f;
+
+	if (netstats_get_index(0, ifname, sizeof(ifname), &nstats))
+		return;
+
+	for(f=0; f<sizeof(fields)/sizeof(fields[0]); f++) {
+		metrics_type(conn, fields[f].name, "counter");
+		for(i=0; !netstats_get_index(i, ifname, sizeof(ifname), &nstats); i++)
+			metrics_sample(conn, fields[f].name, "interface", ifname,
+				*(const uint64_t*) ((const uint8_t*) &nstats + fields[f].off));
+	}
+}
+
+#ifdef SYSSTAT
+#define METRICS_HCSTATS	64
+
+static void metrics_calls(metrics_conn_t* conn)
+{
+	sysstat_t* sstats;
+	hcstat_t* hstats;
+	int i, n;
+
+	sstats = kmalloc(SYSSTAT_MAX * sizeof(sysstat_t));
+	if (sstats) {
+		n = sysstat_get(sstats, SYSSTAT_MAX);
+
+		metrics_type(conn, "syscalls_total", "counter");
+		for(i=0; i<n; i++)
+			metrics_sample(conn, "syscalls_total", "syscall", sstats[i].name, sstats[i].calls);
+		metrics_type(conn, "syscall_ns_total", "counter");
+		for(i=0; i<n; i++)
+			metrics_sample(conn, "syscall_ns_total", "syscall", sstats[i].name, sstats[i].total_ns);
+		metrics_type(conn, "syscall_max_ns", "gauge");
+		for(i=0; i<n; i++)
+			metrics_sample(conn, "syscall_max_ns", "syscall", sstats[i].name, sstats[i].max_ns);
+
+		kfree(sstats);
+	}
+
+	hstats = kmalloc(METRICS_HCSTATS * sizeof(hcstat_t));
+	if (hstats) {
+		n = hcstat_get(hstats, METRICS_HCSTATS);
+
+		metrics_type(conn, "hypercalls_total", "counter");
+		for(i=0; i<n; i++)
+			metrics_sample(conn, "hypercalls_total", "hypercall", hstats[i].name, hstats[i].calls);
+		metrics_type(conn, "hypercall_cycles_total", "counter");
+		for(i=0; i<n; i++)
+			metrics_sample(conn, "hypercall_cycles_total", "hypercall", hstats[i].name, hstats[i].cycles);
+
+		kfree(hstats);
+	}
+}
+#endif
+
+/// create the response in front of the body
+static void metrics_respond(metrics_conn_t* conn)
+{
+	char hdr[METRICS_HDR_SIZE];
+	int n;
+
+	conn->len = METRICS_HDR_SIZE;
+	conn->first = 1;
+
+	if (conn->json)
+		metrics_printf(conn, "[");
+	metrics_type(conn, "uptime_ms", "counter");
+	metrics_sample(conn, "uptime_ms", NULL, NULL, get_uptime());
+	metrics_cores(conn);
+	metrics_memory(conn);
+	metrics_net(conn);
+#ifdef SYSSTAT
+	metrics_calls(conn);
+#endif
+	if (conn->json)
+		metrics_printf(conn, "\n]\n");
+
+	n = ksnprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+		conn->json ? "application/json" : "text/plain; version=0.0.4",
+		(uint32_t) (conn->len - METRICS_HDR_SIZE));
+
+	conn->start = METRICS_HDR_SIZE - n;
+	memcpy(conn->buf + conn->start, hdr, n);
+	conn->sent = conn->start;
+	conn->responded = 1;
+}
+
+static void metrics_free(metrics_conn_t* conn)
+{
+	kfree(conn->buf);
+	kfree(conn);
+}
+
+static void metrics_close(struct tcp_pcb* pcb, metrics_conn_t* conn)
+{
+	tcp_arg(pcb, NULL);
+	tcp_recv(pcb, NULL);
+	tcp_sent(pcb, NULL);
+	tcp_poll(pcb, NULL, 0);
+	tcp_err(pcb, NULL);
+
+	if (conn)
+		metrics_free(conn);
+
+	if (tcp_close(pcb) != ERR_OK)
+		tcp_abort(pcb);
+}
+
+/// pass as much of the response to LwIP as the send buffer takes
+static void metrics_send(struct tcp_pcb* pcb, metrics_conn_t* conn)
+{
+	while (conn->sent < conn->len) {
+		size_t n = conn->len - conn->sent;
+
+		if (n > tcp_sndbuf(pcb))
+			n = tcp_sndbuf(pcb);
+		if (n > 0xFFFF)
+			n = 0xFFFF;
+		if (!n)
+			break;
+
+		// the data is copied, the buffer is released before it is acknowledged
+		if (tcp_write(pcb, conn->buf + conn->sent, (u16_t) n, TCP_WRITE_FLAG_COPY) != ERR_OK)
+			break;
+		conn->sent += n;
+	}
+
+	tcp_output(pcb);
+
+	if (conn->sent >= conn->len)
+		metrics_close(pcb, conn);
+}
+
+static err_t metrics_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+	metrics_conn_t* conn = (metrics_conn_t*) arg;
+
+	if (conn)
+		metrics_send(pcb, conn);
+
+	return ERR_OK;
+}
+
+static err_t metrics_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+	metrics_conn_t* conn = (metrics_conn_t*) arg;
+	char line[64];
+	u16_t n;
+
+	// the peer has closed the connection
+	if (!p) {
+		metrics_close(pcb, conn);
+		return ERR_OK;
+	}
+
+	tcp_recved(pcb, p->tot_len);
+
+	if (conn && !conn->responded && (err == ERR_OK)) {
+		// the request line is enough, the remaining header is ignored
+		n = pbuf_copy_partial(p, line, sizeof(line)-1, 0);
+		line[n] = '\0';
+
+		if (strncmp(line, "GET ", 4)) {
+			pbuf_free(p);
+			metrics_close(pcb, conn);
+			return ERR_OK;
+		}
+
+		conn->json = (strstr(line, "/metrics.json") != NULL) || (strstr(line, "format=json") != NULL);
+		metrics_respond(conn);
+		metrics_send(pcb, conn);
+	}
+
+	pbuf_free(p);
+
+	return ERR_OK;
+}
+
+static err_t metrics_poll(void* arg, struct tcp_pcb* pcb)
+{
+	metrics_conn_t* conn = (metrics_conn_t*) arg;
+
+	if (!conn) {
+		metrics_close(pcb, NULL);
+	} else if (conn->responded) {
+		metrics_send(pcb, conn);
+	} else if (++conn->idle >= METRICS_POLL) {
+		metrics_close(pcb, conn);
+	}
+
+	return ERR_OK;
+}
+
+static void metrics_err(void* arg, err_t err)
+{
+	metrics_conn_t* conn = (metrics_conn_t*) arg;
+
+	// LwIP has already released the pcb
+	if (conn)
+		metrics_free(conn);
+}
+
+static err_t metrics_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+	metrics_conn_t* conn;
+
+	if (BUILTIN_EXPECT((err != ERR_OK) || !pcb, 0))
+		return ERR_VAL;
+
+	conn = kmalloc(sizeof(metrics_conn_t));
+	if (BUILTIN_EXPECT(!conn, 0))
+		return ERR_MEM;
+
+	memset(conn, 0x00, sizeof(metrics_conn_t));
+	conn->size = METRICS_HDR_SIZE + METRICS_BASE_SIZE + MAX_CORES * METRICS_CORE_SIZE;
+	conn->buf = kmalloc(conn->size);
+	if (BUILTIN_EXPECT(!conn->buf, 0)) {
+		kfree(conn);
+		return ERR_MEM;
+	}
+
+	tcp_arg(pcb, conn);
+	tcp_recv(pcb, metrics_recv);
+	tcp_sent(pcb, metrics_sent);
+	tcp_poll(pcb, metrics_poll, 1);
+	tcp_err(pcb, metrics_err);
+
+	return ERR_OK;
+}
+
+static void metrics_listen(void* arg)
+{
+	const uint16_t port = (uint16_t) (size_t) arg;
+	struct tcp_pcb* pcb;
+	struct tcp_pcb* lpcb;
+
+	pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+	if (BUILTIN_EXPECT(!pcb, 0)) {
+		LOG_ERROR("metrics: unable to create a pcb\n");
+		return;
+	}
+
+	if (tcp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK) {
+		LOG_ERROR("metrics: unable to bind port %u\n", (uint32_t) port);
+		tcp_close(pcb);
+		return;
+	}
+
+	lpcb = tcp_listen(pcb);
+	if (BUILTIN_EXPECT(!lpcb, 0)) {
+		LOG_ERROR("metrics: unable to listen on port %u\n", (uint32_t) port);
+		tcp_close(pcb);
+		return;
+	}
+
+	tcp_accept(lpcb, metrics_accept);
+
+	LOG_INFO("Serve the kernel statistics on TCP port %u\n", (uint32_t) port);
+}
+
+int metrics_init(uint16_t port)
+{
+	if (tcpip_callback_with_block(metrics_listen, (void*) (size_t) port, 0) != ERR_OK)
+		return -ENOMEM;
+
+	return 0;
+}
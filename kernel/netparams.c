@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/netparams.h>
+#include <hermit/vma.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/page.h>
+
+#include <lwip/opt.h>
+#include <lwip/pbuf.h>
+
+#if LWIP_WND_SCALE
+#define NETPARAMS_WND_SCALE	TCP_RCV_SCALE
+#else
+#define NETPARAMS_WND_SCALE	0
+#endif
+
+/// size of a pbuf in the RX pool, including its header
+#define NETPARAMS_PBUF_SIZE	(LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf)) + LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE))
+
+/// the defaults are the values, which LwIP is compiled with
+netparams_t netparams = {
+	.tcp_wnd = TCP_WND,
+	.tcp_snd_buf = TCP_SND_BUF,
+	.tcp_wnd_scale = NETPARAMS_WND_SCALE,
+	.pbuf_pool_size = PBUF_POOL_SIZE,
+	.mem_size = MEM_SIZE,
+	.pbuf_pool = NULL,
+	.ram_heap = NULL
+};
+
+/*
+ * Reads the size of the option name (e.g. -tcp_wnd=) from the kernel command
+ * line, K and M are accepted as suffixes.
+ *
+ * @return 1 if the option is set, otherwise 0
+ */
+static int cmdline_size(const char* name, size_t* value)
+{
+	const char* cmdline = get_cmdline();
+	const char* found = cmdline ? strstr(cmdline, name) : NULL;
+	size_t size;
+	char* end;
+
+	if (!found)
+		return 0;
+
+	size = strtoul(found + strlen(name), &end, 10);
+	switch(*end) {
+	case 'M':
+	case 'm':
+		size <<= 10;
+	case 'K':
+	case 'k':
+		size <<= 10;
+	default:
+		break;
+	}
+
+	if (!size) {
+		LOG_WARNING("Invalid value of %s on the kernel command line\n", name);
+		return 0;
+	}
+
+	*value = size;
+
+	return 1;
+}
+
+int netparams_init(void)
+{
+	size_t value;
+	uint32_t max_wnd;
+	int scale_set = 0;
+
+	if (cmdline_size("-tcp_wnd=", &value))
+		netparams.tcp_wnd = value > 0x3FFFFFFF ? 0x3FFFFFFF : value;
+	if (cmdline_size("-tcp_snd_buf=", &value))
+		netparams.tcp_snd_buf = value > 0x3FFFFFFF ? 0x3FFFFFFF : value;
+	if (cmdline_size("-pbuf_pool_size=", &value))
+		netparams.pbuf_pool_size = value;
+	if (cmdline_size("-lwip_mem_size=", &value))
+		netparams.mem_size = value;
+	// a shift of 0 is a valid choice, which disables the scaling
+	if (get_cmdline() && strstr(get_cmdline(), "-tcp_wnd_scale=")) {
+		netparams.tcp_wnd_scale = strtoul(strstr(get_cmdline(), "-tcp_wnd_scale=") + strlen("-tcp_wnd_scale="), NULL, 10);
+		if (netparams.tcp_wnd_scale > NETPARAMS_MAX_WND_SCALE)
+			netparams.tcp_wnd_scale = NETPARAMS_MAX_WND_SCALE;
+		scale_set = 1;
+	}
+
+	// the announced window is limited to 16 bits => choose the smallest sufficient shift
+	if (!scale_set) {
+		while ((netparams.tcp_wnd_scale < NETPARAMS_MAX_WND_SCALE) && ((netparams.tcp_wnd >> netparams.tcp_wnd_scale) > 0xFFFF))
+			netparams.tcp_wnd_scale++;
+	}
+	max_wnd = 0xFFFFU << netparams.tcp_wnd_scale;
+	if (netparams.tcp_wnd > max_wnd) {
+		LOG_WARNING("TCP window is limited to %u bytes by the window scale %u\n", max_wnd, (uint32_t) netparams.tcp_wnd_scale);
+		netparams.tcp_wnd = max_wnd;
+	}
+
+	// a connection has to be able to send at least two segments
+	if (netparams.tcp_snd_buf < 2 * TCP_MSS)
+		netparams.tcp_snd_buf = 2 * TCP_MSS;
+
+	if (netparams.pbuf_pool_size != PBUF_POOL_SIZE) {
+		netparams.pbuf_pool = palloc(PAGE_CEIL(netparams.pbuf_pool_size * NETPARAMS_PBUF_SIZE), VMA_HEAP);
+		if (BUILTIN_EXPECT(!netparams.pbuf_pool, 0)) {
+			LOG_ERROR("Unable to allocate a pool of %u pbufs\n", netparams.pbuf_pool_size);
+			netparams.pbuf_pool_size = PBUF_POOL_SIZE;
+			return -ENOMEM;
+		}
+	}
+
+	if (netparams.mem_size != MEM_SIZE) {
+		// reserve space for the alignment and the management of the heap
+		netparams.ram_heap = palloc(PAGE_CEIL(netparams.mem_size + PAGE_SIZE), VMA_HEAP);
+		if (BUILTIN_EXPECT(!netparams.ram_heap, 0)) {
+			LOG_ERROR("Unable to allocate a heap of %zd bytes for LwIP\n", netparams.mem_size);
+			netparams.mem_size = MEM_SIZE;
+			return -ENOMEM;
+		}
+	}
+
+	LOG_INFO("LwIP: TCP window %u (scale %u), send buffer %u, %u pbufs, heap %zd bytes\n",
+		netparams.tcp_wnd, (uint32_t) netparams.tcp_wnd_scale, netparams.tcp_snd_buf,
+		netparams.pbuf_pool_size, netparams.mem_size);
+
+	return 0;
+}
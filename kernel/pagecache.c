@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/pagecache.h>
+#include <hermit/uhyve_io.h>
+#include <hermit/semaphore.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/atomic.h>
+#include <asm/uhyve.h>
+#include <asm/page.h>
+
+/// maximal number of cached pages
+#define PC_MAX_PAGES		((size_t) UHYVE_PAGE_CACHE_MB * ((1 << 20) / PAGE_SIZE))
+/// the cache shrinks, if less pages are available (16 MiB)
+#define PC_MIN_FREE_PAGES	((16 << 20) / PAGE_SIZE)
+#define PC_HASH_SIZE		1024
+
+#define PC_O_ACCMODE		3
+#define PC_O_RDONLY		0
+
+#define PC_SEEK_SET		0
+#define PC_SEEK_CUR		1
+#define PC_SEEK_END		2
+
+#ifndef MIN
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)		((a) > (b) ? (a) : (b))
+#endif
+
+extern atomic_int64_t total_available_pages;
+
+/** @brief Cached file, identified by its name */
+typedef struct pc_file {
+	char* name;
+	/// number of descriptors
+	uint32_t refs;
+	/// number of descriptors with write access
+	uint32_t writers;
+	/// number of cached pages
+	size_t pages;
+	struct pc_file* next;
+} pc_file_t;
+
+typedef struct pc_page {
+	pc_file_t* file;
+	uint64_t index;
+	/// valid bytes, a page with less than PAGE_SIZE bytes ends the file
+	uint32_t len;
+	struct pc_page* hash_next;
+	struct pc_page* lru_prev;
+	struct pc_page* lru_next;
+	uint8_t data[PAGE_SIZE];
+} pc_page_t;
+
+typedef struct pc_fd {
+	pc_file_t* file;
+	off_t pos;
+	uint8_t cached;
+	uint8_t writer;
+	/// next page of a sequential reader and its readahead window
+	uint64_t ra_next;
+	uint32_t ra_win;
+} pc_fd_t;
+
+static pc_fd_t fds[PAGECACHE_MAX_FDS];
+static pc_file_t* files = NULL;
+static pc_page_t* hash[PC_HASH_SIZE];
+/// most recently used page at the head
+static pc_page_t* lru_head = NULL;
+static pc_page_t* lru_tail = NULL;
+static size_t npages = 0;
+/// buffer of the readahead
+static uint8_t* bounce = NULL;
+/// the host calls could block => semaphore
+static sem_t pc_sem = SEM_INIT(1);
+
+static ssize_t host_read(int fd, void* buf, size_t len)
+{
+	if (uhyve_io_enabled())
+		return uhyve_io_submit(UHYVE_IO_OP_READ, fd, (size_t) buf, len, 0);
+
+	uhyve_read_t uhyve_args = {fd, (char*) buf, len, -1};
+
+	uhyve_send(UHYVE_PORT_READ, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+	return uhyve_args.ret;
+}
+
+static off_t host_lseek(int fd, off_t offset, int whence)
+{
+	if (uhyve_io_enabled())
+		return uhyve_io_submit(UHYVE_IO_OP_LSEEK, fd, 0, whence, offset);
+
+	uhyve_lseek_t uhyve_lseek = { fd, offset, whence };
+
+	uhyve_send(UHYVE_PORT_LSEEK, (unsigned)virt_to_phys((size_t) &uhyve_lseek));
+
+	return uhyve_lseek.offset;
+}
+
+static inline uint32_t pc_hash(pc_file_t* file, uint64_t index)
+{
+	return (uint32_t) ((((size_t) file >> 4) ^ (index * 0x9E3779B1ULL)) % PC_HASH_SIZE);
+}
+
+static inline pc_fd_t* pc_get(int fd)
+{
+	if ((fd < 0) || (fd >= PAGECACHE_MAX_FDS) || !fds[fd].file)
+		return NULL;
+
+	return fds + fd;
+}
+
+static pc_page_t* pc_lookup(pc_file_t* file, uint64_t index)
+{
+	pc_page_t* page;
+
+	for(page = hash[pc_hash(file, index)]; page; page = page->hash_next) {
+		if ((page->file == file) && (page->index == index))
+			return page;
+	}
+
+	return NULL;
+}
+
+static void lru_unlink(pc_page_t* page)
+{
+	if (page->lru_prev)
+		page->lru_prev->lru_next = page->lru_next;
+	else
+		lru_head = page->lru_next;
+	if (page->lru_next)
+		page->lru_next->lru_prev = page->lru_prev;
+	else
+		lru_tail = page->lru_prev;
+}
+
+static void lru_push(pc_page_t* page)
+{
+	page->lru_prev = NULL;
+	page->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = page;
+	else
+		lru_tail = page;
+	lru_head = page;
+}
+
+static void pc_file_put(pc_file_t* file)
+{
+	pc_file_t** tmp;
+
+	if (file->refs || file->pages)
+		return;
+
+	for(tmp = &files; *tmp; tmp = &(*tmp)->next) {
+		if (*tmp == file) {
+			*tmp = file->next;
+			break;
+		}
+	}
+
+	kfree(file->name);
+	kfree(file);
+}
+
+static void pc_page_free(pc_page_t* page)
+{
+	pc_page_t** tmp;
+
+	for(tmp = hash + pc_hash(page->file, page->index); *tmp; tmp = &(*tmp)->hash_next) {
+		if (*tmp == page) {
+			*tmp = page->hash_next;
+			break;
+		}
+	}
+
+	lru_unlink(page);
+	npages--;
+	page->file->pages--;
+	pc_file_put(page->file);
+
+	kfree(page);
+}
+
+static void pc_invalidate(pc_file_t* file)
+{
+	pc_page_t* page = lru_head;
+	pc_page_t* next;
+
+	while (file->pages && page) {
+		next = page->lru_next;
+		if (page->file == file)
+			pc_page_free(page);
+		page = next;
+	}
+}
+
+static pc_page_t* pc_page_alloc(pc_file_t* file, uint64_t index)
+{
+	pc_page_t* page;
+
+	// evict the least recently used pages
+	while (lru_tail && ((npages >= PC_MAX_PAGES) || (atomic_int64_read(&total_available_pages) < PC_MIN_FREE_PAGES)))
+		pc_page_free(lru_tail);
+
+	if (npages >= PC_MAX_PAGES)
+		return NULL;
+
+	page = kmalloc(sizeof(pc_page_t));
+	if (BUILTIN_EXPECT(!page, 0))
+		return NULL;
+
+	page->file = file;
+	page->index = index;
+	page->len = 0;
+	page->hash_next = hash[pc_hash(file, index)];
+	hash[pc_hash(file, index)] = page;
+	lru_push(page);
+	npages++;
+	file->pages++;
+
+	return page;
+}
+
+/*
+ * Reads the page index and the following pages of the readahead window
+ * from the host.
+ *
+ * @return the page index, NULL if no memory is available or the host fails
+ */
+static pc_page_t* pc_fill(int fd, pc_fd_t* f, uint64_t index, size_t len)
+{
+	pc_page_t* first = NULL;
+	pc_page_t* page;
+	ssize_t got, ret;
+	uint32_t count, i;
+
+	if (!bounce) {
+		bounce = kmalloc(PAGECACHE_READAHEAD * PAGE_SIZE);
+		if (BUILTIN_EXPECT(!bounce, 0))
+			return NULL;
+	}
+
+	// sequential access => double the readahead window
+	if (index == f->ra_next)
+		f->ra_win = f->ra_win ? MIN(2 * f->ra_win, PAGECACHE_READAHEAD) : 2;
+	else
+		f->ra_win = 1;
+
+	count = MAX(f->ra_win, (uint32_t) MIN(PAGE_CEIL(len) / PAGE_SIZE, PAGECACHE_READAHEAD));
+	// don't read pages again, which are already cached
+	for(i = 1; i < count; i++) {
+		if (pc_lookup(f->file, index + i))
+			break;
+	}
+	count = i;
+
+	if (host_lseek(fd, (off_t) (index * PAGE_SIZE), PC_SEEK_SET) < 0)
+		return NULL;
+
+	for(got = 0; got < count * PAGE_SIZE; got += ret) {
+		ret = host_read(fd, bounce + got, count * PAGE_SIZE - got);
+		if (ret < 0)
+			return NULL;
+		if (!ret)
+			break;
+	}
+
+	for(i = 0; i < count; i++) {
+		// a page behind the end of the file is only cached as the first one
+		if (i && (got <= (ssize_t) i * PAGE_SIZE))
+			break;
+
+		page = pc_page_alloc(f->file, index + i);
+		if (!page)
+			break;
+
+		if (got > (ssize_t) i * PAGE_SIZE)
+			page->len = MIN((size_t) got - i * PAGE_SIZE, PAGE_SIZE);
+		memcpy(page->data, bounce + i * PAGE_SIZE, page->len);
+		if (!i)
+			first = page;
+	}
+	f->ra_next = index + i;
+
+	return first;
+}
+
+void pagecache_open(int fd, const char* name, int flags)
+{
+	pc_file_t* file;
+	pc_fd_t* f;
+	int i;
+
+	if (!UHYVE_PAGE_CACHE_MB || (fd < 0) || (fd >= PAGECACHE_MAX_FDS))
+		return;
+
+	sem_wait(&pc_sem, 0);
+
+	for(file = files; file; file = file->next) {
+		if (!strcmp(file->name, name))
+			break;
+	}
+
+	if (!file) {
+		file = kmalloc(sizeof(pc_file_t));
+		if (BUILTIN_EXPECT(!file, 0))
+			goto out;
+		memset(file, 0x00, sizeof(pc_file_t));
+
+		file->name = kmalloc(strlen(name) + 1);
+		if (BUILTIN_EXPECT(!file->name, 0)) {
+			kfree(file);
+			goto out;
+		}
+		strcpy(file->name, name);
+
+		file->next = files;
+		files = file;
+	}
+
+	f = fds + fd;
+	memset(f, 0x00, sizeof(pc_fd_t));
+	f->file = file;
+	file->refs++;
+
+	if ((flags & PC_O_ACCMODE) != PC_O_RDONLY) {
+		f->writer = 1;
+		file->writers++;
+		pc_invalidate(file);
+
+		// readers of this file have to use the host from now on
+		for(i = 0; i < PAGECACHE_MAX_FDS; i++) {
+			if ((fds[i].file == file) && fds[i].cached) {
+				host_lseek(i, fds[i].pos, PC_SEEK_SET);
+				fds[i].cached = 0;
+			}
+		}
+	}
+
+	// the content of a file, which is open for writing, could change
+	f->cached = !file->writers;
+
+out:
+	sem_post(&pc_sem);
+}
+
+int pagecache_cached(int fd)
+{
+	pc_fd_t* f = pc_get(fd);
+
+	return f && f->cached;
+}
+
+/*
+ * Reads at pos and, unless the read is positional, advances the offset
+ * of the descriptor.
+ */
+static ssize_t pc_read(int fd, void* buf, size_t len, off_t pos, int positional)
+{
+	pc_fd_t* f;
+	pc_page_t* page;
+	size_t done = 0, off, n;
+	uint64_t index;
+	ssize_t ret;
+
+	sem_wait(&pc_sem, 0);
+
+	f = pc_get(fd);
+	if (BUILTIN_EXPECT(!f || !f->cached, 0)) {
+		sem_post(&pc_sem);
+		return -EBADF;
+	}
+
+	if (!positional)
+		pos = f->pos;
+
+	while (done < len) {
+		index = pos / PAGE_SIZE;
+		off = pos % PAGE_SIZE;
+
+		page = pc_lookup(f->file, index);
+		if (page) {
+			lru_unlink(page);
+			lru_push(page);
+		} else {
+			page = pc_fill(fd, f, index, len - done);
+		}
+
+		if (!page) {
+			// no memory for the cache => the host reads directly
+			f->cached = 0;
+			ret = host_lseek(fd, pos, PC_SEEK_SET);
+			if (ret >= 0) {
+				ret = host_read(fd, (uint8_t*) buf + done, len - done);
+				// a positional read doesn't move the offset of the descriptor
+				if (positional)
+					host_lseek(fd, f->pos, PC_SEEK_SET);
+			}
+			sem_post(&pc_sem);
+
+			if (ret < 0)
+				return done ? (ssize_t) done : ret;
+			return done + ret;
+		}
+
+		// end of file
+		if (off >= page->len)
+			break;
+
+		n = MIN(page->len - off, len - done);
+		memcpy((uint8_t*) buf + done, page->data + off, n);
+		done += n;
+		pos += n;
+	}
+
+	if (!positional)
+		f->pos = pos;
+
+	sem_post(&pc_sem);
+
+	return done;
+}
+
+ssize_t pagecache_read(int fd, void* buf, size_t len)
+{
+	return pc_read(fd, buf, len, 0, 0);
+}
+
+ssize_t pagecache_pread(int fd, void* buf, size_t len, off_t offset)
+{
+	return pc_read(fd, buf, len, offset, 1);
+}
+
+off_t pagecache_lseek(int fd, off_t offset, int whence)
+{
+	pc_fd_t* f;
+	off_t pos;
+
+	sem_wait(&pc_sem, 0);
+
+	f = pc_get(fd);
+	if (BUILTIN_EXPECT(!f || !f->cached, 0)) {
+		pos = -EBADF;
+		goto out;
+	}
+
+	switch(whence) {
+	case PC_SEEK_SET:
+		pos = offset;
+		break;
+	case PC_SEEK_CUR:
+		pos = f->pos + offset;
+		break;
+	case PC_SEEK_END:
+		// only the host knows the size of the file
+		pos = host_lseek(fd, offset, PC_SEEK_END);
+		break;
+	default:
+		pos = -EINVAL;
+	}
+
+	if (pos < 0) {
+		if (whence != PC_SEEK_END)
+			pos = -EINVAL;
+		goto out;
+	}
+
+	f->pos = pos;
+
+out:
+	sem_post(&pc_sem);
+
+	return pos;
+}
+
+void pagecache_write(int fd)
+{
+	pc_fd_t* f;
+
+	sem_wait(&pc_sem, 0);
+	f = pc_get(fd);
+	if (f && f->file->pages)
+		pc_invalidate(f->file);
+	sem_post(&pc_sem);
+}
+
+void pagecache_close(int fd)
+{
+	pc_file_t* file;
+	pc_fd_t* f;
+
+	sem_wait(&pc_sem, 0);
+
+	f = pc_get(fd);
+	if (f) {
+		file = f->file;
+		file->refs--;
+		if (f->writer)
+			file->writers--;
+		memset(f, 0x00, sizeof(pc_fd_t));
+		pc_file_put(file);
+	}
+
+	sem_post(&pc_sem);
+}
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/proxy.h>
+#include <hermit/syscall.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/semaphore.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <hermit/vsock.h>
+
+#include <lwip/sockets.h>
+
+/** @brief Call, which waits for its response */
+typedef struct proxy_call {
+	uint32_t id;
+	task_t* task;
+	volatile uint8_t done;
+	int64_t ret;
+	/// destination of the data of a read
+	uint8_t* buf;
+	size_t len;
+	struct proxy_call* next;
+} proxy_call_t;
+
+static int proxy_sd = -1;
+static volatile uint8_t enabled = 0;
+static uint32_t next_id = 1;
+/// outstanding calls, protected by pending_lock
+static proxy_call_t* pending = NULL;
+static spinlock_t pending_lock = SPINLOCK_INIT;
+/// serializes the frames on the socket, because a write could block
+static sem_t send_sem = SEM_INIT(1);
+
+ssize_t host_sock_read(int sd, void* buf, size_t len)
+{
+	if (sd & VSOCK_FD_BIT)
+		return vsock_read(sd, buf, len);
+
+	return lwip_read(sd, buf, len);
+}
+
+ssize_t host_sock_write(int sd, const void* buf, size_t len)
+{
+	if (sd & VSOCK_FD_BIT)
+		return vsock_write(sd, buf, len);
+
+	return lwip_write(sd, buf, len);
+}
+
+ssize_t host_sock_writev(int sd, const struct iovec* iov, int iovcnt)
+{
+	ssize_t ret, sz = 0;
+
+	if (!(sd & VSOCK_FD_BIT))
+		return lwip_writev(sd, iov, iovcnt);
+
+	// the frames are split into packets anyway => no need to gather them
+	for(int i=0; i<iovcnt; i++) {
+		ret = vsock_write(sd, iov[i].iov_base, iov[i].iov_len);
+		if (ret < 0)
+			return sz ? sz : ret;
+		sz += ret;
+		if (ret < iov[i].iov_len)
+			break;
+	}
+
+	return sz;
+}
+
+int host_sock_close(int sd)
+{
+	if (sd & VSOCK_FD_BIT)
+		return vsock_close(sd);
+
+	return lwip_close(sd);
+}
+
+static int proxy_send_all(struct iovec* iov, int iovcnt)
+{
+	int ret;
+
+	while (iovcnt > 0) {
+		ret = host_sock_writev(proxy_sd, iov, iovcnt);
+		if (ret < 0)
+			return -EIO;
+
+		// skip the sent buffers
+		while ((iovcnt > 0) && (ret >= iov->iov_len)) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t*) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+static int proxy_recv_all(void* buf, size_t len)
+{
+	size_t sz = 0;
+	int ret;
+
+	while (sz < len) {
+		ret = host_sock_read(proxy_sd, (uint8_t*) buf + sz, len - sz);
+		if (ret <= 0)
+			return -EIO;
+		sz += ret;
+	}
+
+	return 0;
+}
+
+static void proxy_remove(proxy_call_t* call)
+{
+	proxy_call_t** tmp;
+
+	for(tmp = &pending; *tmp; tmp = &(*tmp)->next) {
+		if (*tmp == call) {
+			*tmp = call->next;
+			break;
+		}
+	}
+}
+
+static void proxy_complete(proxy_call_t* call, int64_t ret)
+{
+	spinlock_lock(&pending_lock);
+	call->ret = ret;
+	call->done = 1;
+	wakeup_task(call->task->id);
+	spinlock_unlock(&pending_lock);
+}
+
+/*
+ * Sends a request as one frame. If call isn't NULL, the call is registered
+ * before the frame is sent, because the response could arrive at once.
+ */
+static int proxy_send(proxy_call_t* call, int32_t nr, const void* args, size_t args_len, const void* data, size_t data_len)
+{
+	proxy_req_hdr_t hdr;
+	struct iovec iov[3];
+	int iovcnt = 0, ret;
+
+	if (!enabled)
+		return -EIO;
+
+	hdr.len = sizeof(hdr) + args_len + data_len;
+	hdr.nr = nr;
+	hdr.id = 0;
+
+	if (call) {
+		call->task = per_core(current_task);
+		call->done = 0;
+		call->ret = -EIO;
+
+		spinlock_lock(&pending_lock);
+		call->id = hdr.id = next_id++;
+		call->next = pending;
+		pending = call;
+		spinlock_unlock(&pending_lock);
+	}
+
+	iov[iovcnt].iov_base = &hdr;
+	iov[iovcnt++].iov_len = sizeof(hdr);
+	if (args_len) {
+		iov[iovcnt].iov_base = (void*) args;
+		iov[iovcnt++].iov_len = args_len;
+	}
+	if (data_len) {
+		iov[iovcnt].iov_base = (void*) data;
+		iov[iovcnt++].iov_len = data_len;
+	}
+
+	sem_wait(&send_sem, 0);
+	ret = proxy_send_all(iov, iovcnt);
+	sem_post(&send_sem);
+
+	if (ret && call) {
+		spinlock_lock(&pending_lock);
+		proxy_remove(call);
+		spinlock_unlock(&pending_lock);
+	}
+
+	return ret;
+}
+
+static int64_t proxy_wait(proxy_call_t* call)
+{
+	spinlock_lock(&pending_lock);
+	while (!call->done) {
+		block_current_task();
+		spinlock_unlock(&pending_lock);
+		reschedule();
+		spinlock_lock(&pending_lock);
+	}
+	spinlock_unlock(&pending_lock);
+
+	return call->ret;
+}
+
+/* fail all outstanding calls */
+static void proxy_fail_all(void)
+{
+	proxy_call_t* call;
+
+	spinlock_lock(&pending_lock);
+	while (pending) {
+		call = pending;
+		pending = call->next;
+		call->ret = -EIO;
+		call->done = 1;
+		wakeup_task(call->task->id);
+	}
+	spinlock_unlock(&pending_lock);
+}
+
+static int proxy_rx_task(void* arg)
+{
+	uint8_t scratch[256];
+	proxy_resp_hdr_t hdr;
+	proxy_call_t* call;
+	size_t payload, n;
+
+	while (enabled) {
+		if (proxy_recv_all(&hdr, sizeof(hdr)))
+			break;
+		if (BUILTIN_EXPECT(hdr.len < sizeof(hdr), 0)) {
+			LOG_ERROR("proxy: invalid frame of %u bytes\n", hdr.len);
+			break;
+		}
+		payload = hdr.len - sizeof(hdr);
+
+		spinlock_lock(&pending_lock);
+		for(call = pending; call && (call->id != hdr.id); call = call->next)
+			;
+		if (call)
+			proxy_remove(call);
+		spinlock_unlock(&pending_lock);
+
+		if (BUILTIN_EXPECT(!call, 0))
+			LOG_WARNING("proxy: response %u without request\n", hdr.id);
+
+		// the data of a read is copied directly into the caller's buffer
+		if (call && call->buf && payload) {
+			n = payload < call->len ? payload : call->len;
+			if (proxy_recv_all(call->buf, n)) {
+				proxy_complete(call, -EIO);
+				break;
+			}
+			payload -= n;
+		}
+
+		while (payload) {
+			n = payload < sizeof(scratch) ? payload : sizeof(scratch);
+			if (proxy_recv_all(scratch, n))
+				break;
+			payload -= n;
+		}
+
+		if (call)
+			proxy_complete(call, hdr.ret);
+	}
+
+	enabled = 0;
+	proxy_fail_all();
+
+	return 0;
+}
+
+int proxy_init(int sd)
+{
+	int ret;
+
+	proxy_sd = sd;
+	enabled = 1;
+
+	ret = create_kernel_task(NULL, proxy_rx_task, NULL, HIGH_PRIO);
+	if (ret) {
+		LOG_ERROR("proxy: unable to create the receive task\n");
+		enabled = 0;
+		return -ENOMEM;
+	}
+
+	LOG_INFO("proxy: use the framed protocol\n");
+
+	return 0;
+}
+
+int proxy_enabled(void)
+{
+	return enabled;
+}
+
+void proxy_shutdown(void)
+{
+	enabled = 0;
+	proxy_fail_all();
+}
+
+ssize_t proxy_read(int fd, void* buf, size_t len)
+{
+	struct __attribute__((packed)) {
+		int32_t fd;
+		uint64_t count;
+	} args = {fd, len};
+	proxy_call_t call;
+	int ret;
+
+	call.buf = buf;
+	call.len = len;
+
+	ret = proxy_send(&call, __NR_read, &args, sizeof(args), NULL, 0);
+	if (ret)
+		return ret;
+
+	return proxy_wait(&call);
+}
+
+/*
+ * Splits a write into pipelined chunks. Positional writes carry the file
+ * offset of each chunk.
+ */
+static ssize_t proxy_write_chunks(int fd, const void* buf, size_t len, off_t offset, int positional)
+{
+	proxy_call_t calls[PROXY_MAX_CHUNKS];
+	ssize_t total = 0;
+	size_t off = 0, chunk;
+	struct __attribute__((packed)) {
+		int32_t fd;
+		int64_t offset;
+	} args = {fd, 0};
+	int64_t ret;
+	int i, n, stop = 0;
+
+	do {
+		// pipeline the chunks, the proxy writes them in order
+		for(n = 0; (n < PROXY_MAX_CHUNKS) && (off < len); n++, off += chunk) {
+			chunk = len - off < PROXY_CHUNK_SIZE ? len - off : PROXY_CHUNK_SIZE;
+			calls[n].buf = NULL;
+			calls[n].len = chunk;
+			args.offset = offset + off;
+			if (proxy_send(calls + n, positional ? __NR_pwrite : __NR_write, &args,
+			    positional ? sizeof(args) : sizeof(int32_t), (const uint8_t*) buf + off, chunk)) {
+				stop = 1;
+				break;
+			}
+		}
+
+		if (!n)
+			return total ? total : -EIO;
+
+		for(i = 0; i < n; i++) {
+			ret = proxy_wait(calls + i);
+			if (stop)
+				continue;
+			if (ret < 0) {
+				if (!total)
+					total = ret;
+				stop = 1;
+				continue;
+			}
+			total += ret;
+			// short write => report only the contiguous part
+			if (ret < calls[i].len)
+				stop = 1;
+		}
+	} while (!stop && (off < len));
+
+	return total;
+}
+
+ssize_t proxy_write(int fd, const void* buf, size_t len)
+{
+	return proxy_write_chunks(fd, buf, len, 0, 0);
+}
+
+ssize_t proxy_pwrite(int fd, const void* buf, size_t len, off_t offset)
+{
+	return proxy_write_chunks(fd, buf, len, offset, 1);
+}
+
+/*
+ * Splits a positional read into pipelined chunks. The first short chunk
+ * ends the contiguous part of the buffer.
+ */
+ssize_t proxy_pread(int fd, void* buf, size_t len, off_t offset)
+{
+	proxy_call_t calls[PROXY_MAX_CHUNKS];
+	ssize_t total = 0;
+	size_t off = 0, chunk;
+	struct __attribute__((packed)) {
+		int32_t fd;
+		uint64_t count;
+		int64_t offset;
+	} args = {fd, 0, 0};
+	int64_t ret;
+	int i, n, stop = 0;
+
+	do {
+		for(n = 0; (n < PROXY_MAX_CHUNKS) && (off < len); n++, off += chunk) {
+			chunk = len - off < PROXY_CHUNK_SIZE ? len - off : PROXY_CHUNK_SIZE;
+			calls[n].buf = (uint8_t*) buf + off;
+			calls[n].len = chunk;
+			args.count = chunk;
+			args.offset = offset + off;
+			if (proxy_send(calls + n, __NR_pread, &args, sizeof(args), NULL, 0)) {
+				stop = 1;
+				break;
+			}
+		}
+
+		if (!n)
+			return total ? total : -EIO;
+
+		for(i = 0; i < n; i++) {
+			ret = proxy_wait(calls + i);
+			if (stop)
+				continue;
+			if (ret < 0) {
+				if (!total)
+					total = ret;
+				stop = 1;
+				continue;
+			}
+			total += ret;
+			// end of file => the following chunks are empty
+			if (ret < calls[i].len)
+				stop = 1;
+		}
+	} while (!stop && (off < len));
+
+	return total;
+}
+
+int proxy_open(const char* name, int flags, int mode)
+{
+	int32_t args[2] = {flags, mode};
+	proxy_call_t call;
+	int ret;
+
+	call.buf = NULL;
+	ret = proxy_send(&call, __NR_open, args, sizeof(args), name, strlen(name)+1);
+	if (ret)
+		return ret;
+
+	return proxy_wait(&call);
+}
+
+int proxy_close(int fd)
+{
+	int32_t args = fd;
+	proxy_call_t call;
+	int ret;
+
+	call.buf = NULL;
+	ret = proxy_send(&call, __NR_close, &args, sizeof(args), NULL, 0);
+	if (ret)
+		return ret;
+
+	return proxy_wait(&call);
+}
+
+off_t proxy_lseek(int fd, off_t offset, int whence)
+{
+	struct __attribute__((packed)) {
+		int32_t fd;
+		int64_t offset;
+		int32_t whence;
+	} args = {fd, offset, whence};
+	proxy_call_t call;
+	int ret;
+
+	call.buf = NULL;
+	ret = proxy_send(&call, __NR_lseek, &args, sizeof(args), NULL, 0);
+	if (ret)
+		return ret;
+
+	return proxy_wait(&call);
+}
+
+void proxy_exit(int arg)
+{
+	int32_t args = arg;
+
+	// isn't answered
+	proxy_send(NULL, __NR_exit, &args, sizeof(args), NULL, 0);
+	enabled = 0;
+}
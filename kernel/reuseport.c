@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/reuseport.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+#include <lwip/opt.h>
+#include <lwip/api.h>
+#include <lwip/tcp.h>
+#include <lwip/tcpip.h>
+#include <lwip/sockets.h>
+#include <lwip/priv/sockets_priv.h>
+
+typedef struct reuseport_member {
+	struct netconn* conn;
+	struct tcp_pcb_listen* pcb;
+	uint32_t core;
+} reuseport_member_t;
+
+/** @brief Listening sockets of a local address and port */
+typedef struct reuseport_group {
+	ip_addr_t local_ip;
+	u16_t local_port;
+	uint32_t count;
+	reuseport_member_t members[REUSEPORT_MAX_MEMBERS];
+} reuseport_group_t;
+
+/// the groups are protected by LwIP's core lock, which the accept callback holds
+static reuseport_group_t groups[REUSEPORT_MAX_GROUPS];
+/// accept callback of the netconn API
+static tcp_accept_fn netconn_accept_fn = NULL;
+
+static inline uint32_t reuseport_mix(uint32_t h, uint32_t v)
+{
+	h ^= v;
+	h *= 0x9E3779B1U;
+
+	return h ^ (h >> 16);
+}
+
+static uint32_t reuseport_hash(const struct tcp_pcb* pcb)
+{
+	uint32_t h = ((uint32_t) pcb->remote_port << 16) | pcb->local_port;
+
+#if LWIP_IPV6
+	if (IP_IS_V6(&pcb->remote_ip)) {
+		int i;
+
+		for(i = 0; i < 4; i++)
+			h = reuseport_mix(h, ip_2_ip6(&pcb->remote_ip)->addr[i]);
+
+		return h;
+	}
+#endif
+
+	return reuseport_mix(h, ip4_addr_get_u32(ip_2_ip4(&pcb->remote_ip)));
+}
+
+static reuseport_group_t* reuseport_find(struct netconn* conn, uint32_t* index)
+{
+	uint32_t g, i;
+
+	for(g = 0; g < REUSEPORT_MAX_GROUPS; g++) {
+		for(i = 0; i < groups[g].count; i++) {
+			if (groups[g].members[i].conn == conn) {
+				if (index)
+					*index = i;
+				return groups + g;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Replaces the accept callback of the members' listen PCBs. LwIP passes
+ * the netconn of the PCB, which has received the connection request, as arg.
+ */
+static err_t reuseport_accept(void* arg, struct tcp_pcb* newpcb, err_t err)
+{
+	reuseport_group_t* group;
+	reuseport_member_t* local[REUSEPORT_MAX_MEMBERS];
+	uint32_t i, nlocal = 0, h;
+
+	group = reuseport_find((struct netconn*) arg, NULL);
+	if (BUILTIN_EXPECT(!group || !newpcb || (err != ERR_OK), 0))
+		return netconn_accept_fn(arg, newpcb, err);
+
+	h = reuseport_hash(newpcb);
+
+	// keep the connection on the core, which processes its packets
+	for(i = 0; i < group->count; i++) {
+		if (group->members[i].core == CORE_ID)
+			local[nlocal++] = group->members + i;
+	}
+
+	if (nlocal)
+		return netconn_accept_fn(local[h % nlocal]->conn, newpcb, err);
+
+	return netconn_accept_fn(group->members[h % group->count].conn, newpcb, err);
+}
+
+int reuseport_listen(int fd, int backlog)
+{
+	struct lwip_sock* sock;
+	struct netconn* conn;
+	struct tcp_pcb_listen* pcb;
+	reuseport_group_t* group = NULL;
+	uint32_t g;
+	int ret = 0;
+
+	if (!(fd & LWIP_FD_BIT))
+		return -EBADF;
+
+	sock = lwip_socket_dbg_get_socket(fd & ~LWIP_FD_BIT);
+	if (!sock || !sock->conn || (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP))
+		return -EBADF;
+	conn = sock->conn;
+
+	LOCK_TCPIP_CORE();
+	if (reuseport_find(conn, NULL))
+		ret = -EBUSY;
+	UNLOCK_TCPIP_CORE();
+	if (ret)
+		return ret;
+
+	if (lwip_listen(fd & ~LWIP_FD_BIT, backlog) < 0)
+		return -errno;
+
+	LOCK_TCPIP_CORE();
+
+	pcb = (struct tcp_pcb_listen*) conn->pcb.tcp;
+	if (BUILTIN_EXPECT(!pcb || (pcb->state != LISTEN), 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	for(g = 0; g < REUSEPORT_MAX_GROUPS; g++) {
+		if (groups[g].count && (groups[g].local_port == pcb->local_port)
+		    && ip_addr_cmp(&groups[g].local_ip, &pcb->local_ip)) {
+			group = groups + g;
+			break;
+		}
+		if (!group && !groups[g].count)
+			group = groups + g;
+	}
+
+	if (!group || (group->count >= REUSEPORT_MAX_MEMBERS)) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	if (!group->count) {
+		ip_addr_copy(group->local_ip, pcb->local_ip);
+		group->local_port = pcb->local_port;
+	}
+
+	if (!netconn_accept_fn)
+		netconn_accept_fn = pcb->accept;
+
+	group->members[group->count].conn = conn;
+	group->members[group->count].pcb = pcb;
+	group->members[group->count].core = CORE_ID;
+	group->count++;
+
+	tcp_accept((struct tcp_pcb*) pcb, reuseport_accept);
+
+	LOG_DEBUG("reuseport: socket %d listens on port %u (core %u, %u listeners)\n",
+		fd, (uint32_t) pcb->local_port, CORE_ID, group->count);
+
+out:
+	UNLOCK_TCPIP_CORE();
+
+	return ret;
+}
+
+void reuseport_close(int fd)
+{
+	struct lwip_sock* sock;
+	reuseport_group_t* group;
+	uint32_t i;
+
+	if (!(fd & LWIP_FD_BIT))
+		return;
+
+	sock = lwip_socket_dbg_get_socket(fd & ~LWIP_FD_BIT);
+	if (!sock || !sock->conn)
+		return;
+
+	LOCK_TCPIP_CORE();
+
+	group = reuseport_find(sock->conn, &i);
+	if (group) {
+		// the PCB is still alive, until the socket is closed
+		if (group->members[i].pcb->accept == reuseport_accept)
+			tcp_accept((struct tcp_pcb*) group->members[i].pcb, netconn_accept_fn);
+
+		group->count--;
+		group->members[i] = group->members[group->count];
+	}
+
+	UNLOCK_TCPIP_CORE();
+}
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/romfs.h>
+#include <hermit/spinlock.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+/// flags of the host (Linux)
+#define ROMFS_O_ACCMODE		3
+#define ROMFS_O_RDONLY		0
+#define ROMFS_O_CREAT		0100
+#define ROMFS_O_TRUNC		01000
+
+#define ROMFS_SEEK_SET		0
+#define ROMFS_SEEK_CUR		1
+#define ROMFS_SEEK_END		2
+
+/// size of a header of the "newc" format and the offsets of its fields
+#define CPIO_HEADER_SIZE	110
+#define CPIO_MODE		14
+#define CPIO_FILESIZE		54
+#define CPIO_NAMESIZE		94
+
+#define CPIO_S_IFMT		0170000
+#define CPIO_S_IFREG		0100000
+
+#define CPIO_ALIGN(x)		(((x) + 3) & ~((size_t) 3))
+
+#ifndef MIN
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#endif
+
+typedef struct romfs_file {
+	/// points into the image
+	const char* name;
+	const uint8_t* data;
+	size_t size;
+	struct romfs_file* hash_next;
+} romfs_file_t;
+
+typedef struct romfs_fd {
+	romfs_file_t* file;
+	off_t pos;
+} romfs_fd_t;
+
+/// defined by the application, if it contains an image
+extern const uint8_t romfs_image_start[] __attribute__ ((weak));
+extern const uint8_t romfs_image_end[] __attribute__ ((weak));
+
+static romfs_file_t* files = NULL;
+static romfs_file_t** hash = NULL;
+/// number of buckets, a power of two
+static size_t hash_size = 0;
+static romfs_fd_t fds[ROMFS_MAX_FILES];
+static spinlock_t romfs_lock = SPINLOCK_INIT;
+
+static uint32_t romfs_hash(const char* name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (uint8_t) *name++) * 16777619U;
+
+	return h;
+}
+
+/// the archive and the applications may start the path with "/" or "./"
+static const char* romfs_normalize(const char* name)
+{
+	while (1) {
+		if (name[0] == '/')
+			name++;
+		else if ((name[0] == '.') && (name[1] == '/'))
+			name += 2;
+		else
+			return name;
+	}
+}
+
+static int cpio_field(const uint8_t* hdr, size_t off, size_t* val)
+{
+	size_t i;
+
+	*val = 0;
+	for (i = 0; i < 8; i++) {
+		uint8_t c = hdr[off + i];
+
+		if ((c >= '0') && (c <= '9'))
+			*val = (*val << 4) | (c - '0');
+		else if ((c >= 'a') && (c <= 'f'))
+			*val = (*val << 4) | (c - 'a' + 10);
+		else if ((c >= 'A') && (c <= 'F'))
+			*val = (*val << 4) | (c - 'A' + 10);
+		else
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static romfs_file_t* romfs_find(const char* name)
+{
+	romfs_file_t* file;
+
+	if (!hash_size || !name)
+		return NULL;
+
+	name = romfs_normalize(name);
+	for (file = hash[romfs_hash(name) & (hash_size - 1)]; file; file = file->hash_next) {
+		if (!strcmp(file->name, name))
+			return file;
+	}
+
+	return NULL;
+}
+
+int romfs_init(void)
+{
+	const uint8_t* pos = romfs_image_start;
+	const uint8_t* end = romfs_image_end;
+	size_t count = 0, i;
+
+	if (!pos || !end || (end <= pos))
+		return 0;
+
+	// the archive is a sequence of headers, names and contents
+	while (pos + CPIO_HEADER_SIZE <= end) {
+		size_t mode, filesize, namesize;
+		const char* name;
+		const uint8_t* data;
+		romfs_file_t* file;
+
+		if (strncmp((const char*) pos, "07070", 5) || ((pos[5] != '1') && (pos[5] != '2'))
+		    || cpio_field(pos, CPIO_MODE, &mode)
+		    || cpio_field(pos, CPIO_FILESIZE, &filesize)
+		    || cpio_field(pos, CPIO_NAMESIZE, &namesize)) {
+			LOG_WARNING("romfs: invalid cpio header at offset 0x%zx\n", (size_t) (pos - romfs_image_start));
+			break;
+		}
+
+		name = (const char*) pos + CPIO_HEADER_SIZE;
+		data = pos + CPIO_ALIGN(CPIO_HEADER_SIZE + namesize);
+		if ((data > end) || (filesize > (size_t) (end - data)) || !namesize || name[namesize-1]) {
+			LOG_WARNING("romfs: truncated image\n");
+			break;
+		}
+
+		if (!strcmp(name, "TRAILER!!!"))
+			break;
+
+		if ((mode & CPIO_S_IFMT) == CPIO_S_IFREG) {
+			file = kmalloc(sizeof(romfs_file_t));
+			if (BUILTIN_EXPECT(!file, 0))
+				return -ENOMEM;
+
+			file->name = romfs_normalize(name);
+			file->data = data;
+			file->size = filesize;
+			file->hash_next = files;
+			files = file;
+			count++;
+		}
+
+		pos = data + CPIO_ALIGN(filesize);
+	}
+
+	if (!count)
+		return 0;
+
+	// at most one file per bucket on average
+	for (hash_size = 1; hash_size < count; hash_size <<= 1)
+		;
+	hash = kmalloc(hash_size * sizeof(romfs_file_t*));
+	if (BUILTIN_EXPECT(!hash, 0)) {
+		hash_size = 0;
+		return -ENOMEM;
+	}
+	for (i = 0; i < hash_size; i++)
+		hash[i] = NULL;
+
+	// move the files from the list into the buckets
+	while (files) {
+		romfs_file_t* file = files;
+		size_t b = romfs_hash(file->name) & (hash_size - 1);
+
+		files = file->hash_next;
+		file->hash_next = hash[b];
+		hash[b] = file;
+	}
+
+	LOG_INFO("romfs: image contains %zd files (%zd bytes)\n", count, (size_t) (end - romfs_image_start));
+
+	return count;
+}
+
+static inline romfs_fd_t* romfs_get(int fd)
+{
+	fd &= ~ROMFS_FD_BIT;
+
+	if ((fd < 0) || (fd >= ROMFS_MAX_FILES) || !fds[fd].file)
+		return NULL;
+
+	return fds + fd;
+}
+
+int romfs_open(const char* name, int flags)
+{
+	romfs_file_t* file;
+	int fd;
+
+	// the image can't be modified => the host handles writers
+	if (((flags & ROMFS_O_ACCMODE) != ROMFS_O_RDONLY) || (flags & (ROMFS_O_CREAT|ROMFS_O_TRUNC)))
+		return -ENOENT;
+
+	file = romfs_find(name);
+	if (!file)
+		return -ENOENT;
+
+	spinlock_lock(&romfs_lock);
+	for (fd = 0; (fd < ROMFS_MAX_FILES) && fds[fd].file; fd++)
+		;
+	if (BUILTIN_EXPECT(fd >= ROMFS_MAX_FILES, 0)) {
+		spinlock_unlock(&romfs_lock);
+		return -ENFILE;
+	}
+	fds[fd].file = file;
+	fds[fd].pos = 0;
+	spinlock_unlock(&romfs_lock);
+
+	return fd | ROMFS_FD_BIT;
+}
+
+ssize_t romfs_pread(int fd, void* buf, size_t len, off_t offset)
+{
+	romfs_fd_t* desc = romfs_get(fd);
+
+	if (BUILTIN_EXPECT(!desc, 0))
+		return -EBADF;
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+
+	if ((size_t) offset >= desc->file->size)
+		return 0;
+
+	len = MIN(len, desc->file->size - (size_t) offset);
+	memcpy(buf, desc->file->data + offset, len);
+
+	return len;
+}
+
+ssize_t romfs_read(int fd, void* buf, size_t len)
+{
+	romfs_fd_t* desc = romfs_get(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!desc, 0))
+		return -EBADF;
+
+	ret = romfs_pread(fd, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+	return ret;
+}
+
+off_t romfs_lseek(int fd, off_t offset, int whence)
+{
+	romfs_fd_t* desc = romfs_get(fd);
+	off_t pos;
+
+	if (BUILTIN_EXPECT(!desc, 0))
+		return -EBADF;
+
+	switch(whence) {
+	case ROMFS_SEEK_SET:
+		pos = offset;
+		break;
+	case ROMFS_SEEK_CUR:
+		pos = desc->pos + offset;
+		break;
+	case ROMFS_SEEK_END:
+		pos = (off_t) desc->file->size + offset;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (BUILTIN_EXPECT(pos < 0, 0))
+		return -EINVAL;
+
+	desc->pos = pos;
+
+	return pos;
+}
+
+int romfs_close(int fd)
+{
+	romfs_fd_t* desc = romfs_get(fd);
+
+	if (BUILTIN_EXPECT(!desc, 0))
+		return -EBADF;
+
+	spinlock_lock(&romfs_lock);
+	desc->file = NULL;
+	spinlock_unlock(&romfs_lock);
+
+	return 0;
+}
+
+int romfs_lookup(const char* name, const void** data, size_t* size)
+{
+	romfs_file_t* file;
+
+	if (BUILTIN_EXPECT(!name || !data || !size, 0))
+		return -EINVAL;
+
+	file = romfs_find(name);
+	if (!file)
+		return -ENOENT;
+
+	*data = file->data;
+	*size = file->size;
+
+	return 0;
+}
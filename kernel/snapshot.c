@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file kernel/snapshot.c
+ * @brief Snapshot of a booted unikernel
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/errno.h>
+#include <hermit/memory.h>
+#include <hermit/time.h>
+#include <hermit/console.h>
+#include <hermit/vclock.h>
+#include <hermit/snapshot.h>
+#include <hermit/logging.h>
+#include <asm/page.h>
+#include <asm/uhyve.h>
+
+int sys_snapshot(void)
+{
+	uhyve_snapshot_t arg;
+
+	if (!(is_uhyve() & UHYVE_FEAT_SNAPSHOT))
+		return -ENOSYS;
+
+	// buffered output must not be written once per restored instance
+	console_flush();
+
+	arg.free_list = virt_to_phys((size_t) get_free_list());
+	arg.gtod = 0;
+	arg.restored = 0;
+	arg.ret = -ENOSYS;
+
+	uhyve_send(UHYVE_PORT_SNAPSHOT, (unsigned) virt_to_phys((size_t) &arg));
+
+	if (arg.ret)
+		return arg.ret;
+
+	if (!arg.restored) {
+		LOG_INFO("snapshot: saved at %d ms\n", get_uptime());
+		return 0;
+	}
+
+	// the uptime continues, but the wall clock has moved on
+	if (arg.gtod)
+		vclock_set_wall(1000ULL * arg.gtod - 1000000ULL * get_uptime());
+
+	LOG_INFO("snapshot: restored at %d ms\n", get_uptime());
+
+	return 1;
+}
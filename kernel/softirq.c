@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/string.h>
+#include <hermit/softirq.h>
+#include <hermit/tasks.h>
+#include <hermit/errno.h>
+#include <asm/irqflags.h>
+#include <asm/processor.h>
+
+typedef struct softirq_queue {
+	tasklet_t* first[TASKLET_NR_PRIOS];
+	tasklet_t* last[TASKLET_NR_PRIOS];
+	/// number of queued tasklets
+	uint32_t pending;
+	/// prevents a nested run by a tasklet, which checks the work queues
+	uint32_t active;
+	softirq_stats_t stats;
+} __attribute__ ((aligned (CACHE_LINE))) softirq_queue_t;
+
+static softirq_queue_t queues[MAX_CORES];
+
+/// caller has disabled the interrupts
+static inline void softirq_enqueue(softirq_queue_t* q, tasklet_t* t)
+{
+	t->next = NULL;
+	if (q->last[t->prio])
+		q->last[t->prio]->next = t;
+	else
+		q->first[t->prio] = t;
+	q->last[t->prio] = t;
+	q->pending++;
+}
+
+/// caller has disabled the interrupts
+static inline tasklet_t* softirq_dequeue(softirq_queue_t* q)
+{
+	uint32_t prio;
+
+	for(prio = 0; prio < TASKLET_NR_PRIOS; prio++) {
+		tasklet_t* t = q->first[prio];
+
+		if (!t)
+			continue;
+
+		q->first[prio] = t->next;
+		if (!q->first[prio])
+			q->last[prio] = NULL;
+		q->pending--;
+
+		return t;
+	}
+
+	return NULL;
+}
+
+void tasklet_schedule(tasklet_t* t)
+{
+	softirq_queue_t* q;
+	uint8_t flags;
+
+	if (__atomic_fetch_or(&t->state, TASKLET_SCHEDULED, __ATOMIC_ACQ_REL) & TASKLET_SCHEDULED)
+		return;
+
+	// the task can't migrate, while the interrupts are disabled
+	flags = irq_nested_disable();
+	q = queues + CORE_ID;
+	softirq_enqueue(q, t);
+	q->stats.scheduled++;
+	irq_nested_enable(flags);
+}
+
+int softirq_pending(void)
+{
+	return queues[CORE_ID].pending != 0;
+}
+
+void softirq_run(void)
+{
+	softirq_queue_t* q;
+	uint32_t budget = SOFTIRQ_BUDGET, done = 0;
+	uint8_t flags;
+	uint64_t start;
+
+	// the tasklets run with disabled interrupts, even in task context,
+	// otherwise the task could migrate to another core
+	flags = irq_nested_disable();
+	q = queues + CORE_ID;
+	if (!q->pending || q->active) {
+		irq_nested_enable(flags);
+		return;
+	}
+	q->active = 1;
+
+	start = get_rdtsc();
+	while (budget && q->pending) {
+		tasklet_t* t = softirq_dequeue(q);
+
+		if (__atomic_fetch_or(&t->state, TASKLET_RUNNING, __ATOMIC_ACQUIRE) & TASKLET_RUNNING) {
+			// another core executes the tasklet => retry in the next run
+			softirq_enqueue(q, t);
+			q->stats.busy++;
+			break;
+		}
+
+		// the tasklet may schedule itself again
+		__atomic_fetch_and(&t->state, ~TASKLET_SCHEDULED, __ATOMIC_RELEASE);
+
+		t->func(t->arg);
+
+		__atomic_fetch_and(&t->state, ~TASKLET_RUNNING, __ATOMIC_RELEASE);
+
+		q->stats.executed[t->prio]++;
+		budget--;
+		done++;
+	}
+
+	if (done) {
+		q->stats.runs++;
+		q->stats.cycles += get_rdtsc() - start;
+	}
+	if (!budget && q->pending)
+		q->stats.exhausted++;
+
+	q->active = 0;
+	irq_nested_enable(flags);
+}
+
+int softirq_stats(uint32_t core, softirq_stats_t* stats)
+{
+	uint8_t flags;
+
+	if (BUILTIN_EXPECT((core >= MAX_CORES) || !stats, 0))
+		return -EINVAL;
+
+	flags = irq_nested_disable();
+	memcpy(stats, &queues[core].stats, sizeof(softirq_stats_t));
+	irq_nested_enable(flags);
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/spinlock.h>
+#include <hermit/logging.h>
+
+/*
+ * Queue nodes of the MCS spinlocks. A core takes a node with disabled
+ * interrupts from its own pool and returns it, when the lock is released.
+ */
+mcs_node_t mcs_nodes[MAX_CORES][MCS_NODES];
+
+void mcs_nodes_exhausted(mcs_spinlock_irqsave_t* s, const char* site)
+{
+	LOG_ERROR("Kernel panic: core %u has no free MCS node for lock %p (%s)\n",
+		CORE_ID, s, site ? site : "unknown site");
+
+	while(1) {
+		HALT;
+	}
+}
+
+#ifdef LOCKSTAT
+
+#include <hermit/string.h>
+#include <asm/io.h>
+#include <asm/uhyve.h>
+#include <asm/irq.h>
+#include <asm/page.h>
+
+#define UHYVE_IRQ_LOCKSTAT	13
+
+/*
+ * Statistics of all locks, which are indexed by the hashed lock address.
+ * An entry is claimed once and afterwards only written by the owner of
+ * its lock.
+ */
+static lock_stat_t lockstat_table[LOCKSTAT_SIZE];
+
+/// number of acquisitions without statistics, because the table was full
+static atomic_int64_t lockstat_dropped = ATOMIC_INIT(0);
+
+static inline uint32_t lockstat_hash(const void* lock)
+{
+	return (uint32_t) ((((size_t) lock >> 3) * 0x9E3779B97F4A7C15ULL) >> 32) % LOCKSTAT_SIZE;
+}
+
+lock_stat_t* lockstat_lookup(const void* lock, const char* site)
+{
+	uint32_t idx = lockstat_hash(lock);
+
+	// linear probing
+	for(uint32_t i=0; i<LOCKSTAT_SIZE; i++) {
+		lock_stat_t* stat = lockstat_table + idx;
+		int64_t addr = atomic_int64_read(&stat->lock);
+
+		if (addr == (int64_t) lock)
+			return stat;
+
+		if (!addr) {
+			// a lookup without site doesn't create an entry
+			if (!site)
+				return NULL;
+
+			addr = atomic_int64_cmpxchg(&stat->lock, 0, (int64_t) lock);
+			if (!addr) {
+				stat->site = site;
+				return stat;
+			}
+			if (addr == (int64_t) lock)
+				return stat;
+		}
+
+		idx = (idx + 1) % LOCKSTAT_SIZE;
+	}
+
+	if (site)
+		atomic_int64_inc(&lockstat_dropped);
+
+	return NULL;
+}
+
+void lockstat_acquired(lock_stat_t* stat, uint64_t start, int contended)
+{
+	if (BUILTIN_EXPECT(!stat, 0))
+		return;
+
+	stat->start = get_rdtsc();
+	stat->nr_acquired++;
+	stat->wait_cycles += stat->start - start;
+	if (contended)
+		stat->nr_contended++;
+}
+
+void lockstat_released(lock_stat_t* stat)
+{
+	if (BUILTIN_EXPECT(!stat || !stat->start, 0))
+		return;
+
+	uint64_t hold = get_rdtsc() - stat->start;
+
+	if (hold > stat->max_hold)
+		stat->max_hold = hold;
+	stat->start = 0;
+}
+
+int lockstat_get(lock_stat_t* buf, size_t n)
+{
+	size_t ret = 0;
+
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -EINVAL;
+
+	for(uint32_t i=0; (i<LOCKSTAT_SIZE) && (ret<n); i++) {
+		if (!atomic_int64_read(&lockstat_table[i].lock))
+			continue;
+
+		memcpy(buf + ret, lockstat_table + i, sizeof(lock_stat_t));
+		ret++;
+	}
+
+	return (int) ret;
+}
+
+void lockstat_dump(void)
+{
+	for(uint32_t i=0; i<LOCKSTAT_SIZE; i++) {
+		lock_stat_t* stat = lockstat_table + i;
+		int64_t addr = atomic_int64_read(&stat->lock);
+
+		if (!addr || !stat->nr_contended)
+			continue;
+
+		LOG_INFO("lock %p (%s): %llu acquired, %llu contended, %llu wait cycles, %llu max hold cycles\n",
+			(void*) addr, stat->site ? stat->site : "?", stat->nr_acquired,
+			stat->nr_contended, stat->wait_cycles, stat->max_hold);
+	}
+
+	LOG_INFO("lock statistics: %llu acquisitions dropped\n", atomic_int64_read(&lockstat_dropped));
+}
+
+void lockstat_reset(void)
+{
+	for(uint32_t i=0; i<LOCKSTAT_SIZE; i++) {
+		lockstat_table[i].nr_acquired = 0;
+		lockstat_table[i].nr_contended = 0;
+		lockstat_table[i].wait_cycles = 0;
+		lockstat_table[i].max_hold = 0;
+	}
+
+	atomic_int64_set(&lockstat_dropped, 0);
+}
+
+static void uhyve_irq_lockstat_handler(struct state* s)
+{
+	uhyve_send(UHYVE_PORT_LOCKSTAT, (unsigned)virt_to_phys((size_t)lockstat_table));
+}
+
+int lockstat_init(void)
+{
+	if (is_uhyve()) {
+		LOG_INFO("lock statistics channel uses irq %d\n", UHYVE_IRQ_LOCKSTAT);
+		irq_install_handler(32+UHYVE_IRQ_LOCKSTAT, uhyve_irq_lockstat_handler);
+	}
+
+	return 0;
+}
+
+#endif
@@ -27,23 +27,57 @@
 
 #include <hermit/stddef.h>
 #include <hermit/stdio.h>
+#include <hermit/string.h>
 #include <hermit/tasks.h>
 #include <hermit/errno.h>
 #include <hermit/syscall.h>
 #include <hermit/spinlock.h>
 #include <hermit/semaphore.h>
+#include <hermit/futex.h>
+#include <hermit/barrier.h>
+#include <hermit/fiber.h>
+#include <hermit/epoll.h>
+#include <hermit/localsock.h>
+#include <hermit/vsock.h>
+#include <hermit/tmpfs.h>
+#include <hermit/romfs.h>
+#include <hermit/blkfs.h>
+#include <hermit/virtiofs.h>
+#include <hermit/block.h>
+#include <hermit/reuseport.h>
+#include <hermit/softirq.h>
+#include <hermit/flexsc.h>
+#include <hermit/uhyve_io.h>
+#include <hermit/proxy.h>
+#include <hermit/pagecache.h>
+#include <hermit/console.h>
+#include <hermit/klog.h>
+#include <hermit/sysstat.h>
+#include <hermit/histogram.h>
+#include <hermit/ktrace.h>
+#include <hermit/pmu.h>
+#include <hermit/slab.h>
+#include <hermit/malloc.h>
 #include <hermit/time.h>
+#include <hermit/vclock.h>
 #include <hermit/rcce.h>
 #include <hermit/memory.h>
+#include <hermit/vma.h>
 #include <hermit/signal.h>
 #include <hermit/logging.h>
 #include <asm/uhyve.h>
 #include <asm/io.h>
 #include <sys/poll.h>
+#include <net/rawnet.h>
+#include <net/netstats.h>
 
 #include <lwip/sockets.h>
 #include <lwip/err.h>
 #include <lwip/stats.h>
+#include <lwip/api.h>
+#include <lwip/tcp.h>
+#include <lwip/tcpip.h>
+#include <lwip/priv/sockets_priv.h>
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
@@ -51,8 +85,12 @@
  */
 extern const void kernel_start;
 
-//TODO: don't use one big kernel lock to comminicate with all proxies
-static spinlock_irqsave_t lwip_lock = SPINLOCK_IRQSAVE_INIT;
+/*
+ * Serializes the requests to the proxy, which share one socket. Sockets of
+ * the application don't need it, LwIP protects them by itself. A semaphore
+ * is used, because the requests block until the proxy answers.
+ */
+static sem_t proxy_sem = SEM_INIT(1);
 
 extern spinlock_irqsave_t stdio_lock;
 extern int32_t isle;
@@ -64,7 +102,7 @@ static inline int socket_send(int fd, const 	void* buf, size_t len)
 	int ret, sz = 0;
 
 	do {
-		ret = lwip_write(fd, (char*)buf + sz, len-sz);
+		ret = host_sock_write(fd, (char*)buf + sz, len-sz);
 		if (ret >= 0)
 			sz += ret;
 		else
@@ -79,7 +117,7 @@ static inline int socket_recv(int fd, void* buf, size_t len)
 	int ret, sz = 0;
 
 	do {
-		ret = lwip_read(fd, (char*)buf + sz, len-sz);
+		ret = host_sock_read(fd, (char*)buf + sz, len-sz);
 		if (ret >= 0)
 			sz += ret;
 		else
@@ -120,27 +158,36 @@ typedef struct {
 /** @brief To be called by the systemcall to exit tasks */
 void NORETURN sys_exit(int arg)
 {
+#ifdef SYSSTAT
+	sysstat_dump();
+#endif
+	klog_drain();
+	console_flush();
+
 	if (is_uhyve()) {
 		uhyve_send(UHYVE_PORT_EXIT, (unsigned) virt_to_phys((size_t) &arg));
 	} else {
 		sys_exit_t sysargs = {__NR_exit, arg};
 
-		spinlock_irqsave_lock(&lwip_lock);
+		sem_wait(&proxy_sem, 0);
 		if (libc_sd >= 0)
 		{
 			int s = libc_sd;
 
-			socket_send(s, &sysargs, sizeof(sysargs));
+			if (proxy_enabled())
+				proxy_exit(arg);
+			else
+				socket_send(s, &sysargs, sizeof(sysargs));
 			libc_sd = -1;
 
-			spinlock_irqsave_unlock(&lwip_lock);
+			sem_post(&proxy_sem);
 
 			// switch to LwIP thread
 			reschedule();
 
-			lwip_close(s);
+			host_sock_close(s);
 		} else {
-			spinlock_irqsave_unlock(&lwip_lock);
+			sem_post(&proxy_sem);
 		}
 	}
 
@@ -153,29 +200,45 @@ typedef struct {
 	size_t len;
 } __attribute__((packed)) sys_read_t;
 
-typedef struct {
-	int fd;
-	char* buf;
-        size_t len;
-	ssize_t ret;
-} __attribute__((packed)) uhyve_read_t;
-
 ssize_t sys_read(int fd, char* buf, size_t len)
 {
+	SYSSTAT_ENTER(SYSSTAT_READ);
 	sys_read_t sysargs = {__NR_read, fd, len};
 	ssize_t j, ret;
 
 	// do we have an LwIP file descriptor?
 	if (fd & LWIP_FD_BIT) {
-		spinlock_irqsave_lock(&lwip_lock);
 		ret = lwip_read(fd & ~LWIP_FD_BIT, buf, len);
-		spinlock_irqsave_unlock(&lwip_lock);
 		if (ret < 0)
 			return -errno;
 
 		return ret;
 	}
 
+	if (fd & LOCALSOCK_FD_BIT)
+		return localsock_read(fd, buf, len);
+
+	if (fd & VSOCK_FD_BIT)
+		return vsock_read(fd, buf, len);
+
+	if (fd & TMPFS_FD_BIT)
+		return tmpfs_read(fd, buf, len);
+
+	if (fd & ROMFS_FD_BIT)
+		return romfs_read(fd, buf, len);
+
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_read(fd, buf, len);
+
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_read(fd, buf, len);
+
+	if (pagecache_cached(fd))
+		return pagecache_read(fd, buf, len);
+
+	if (uhyve_io_enabled())
+		return uhyve_io_submit(UHYVE_IO_OP_READ, fd, (size_t) buf, len, 0);
+
 	if (is_uhyve()) {
 		uhyve_read_t uhyve_args = {fd, (char*) buf, len, -1};
 
@@ -187,7 +250,10 @@ ssize_t sys_read(int fd, char* buf, size_t len)
 	if (libc_sd < 0)
 		return -ENOSYS;
 
-	spinlock_irqsave_lock(&lwip_lock);
+	if (proxy_enabled())
+		return proxy_read(fd, buf, len);
+
+	sem_wait(&proxy_sem, 0);
 
 	int s = libc_sd;
 	socket_send(s, &sysargs, sizeof(sysargs));
@@ -196,23 +262,215 @@ ssize_t sys_read(int fd, char* buf, size_t len)
 	ssize_t i=0;
 	while(i < j)
 	{
-		ret = lwip_read(s, (char*)buf+i, j-i);
+		ret = host_sock_read(s, (char*)buf+i, j-i);
 		if (ret < 0) {
-			spinlock_irqsave_unlock(&lwip_lock);
+			sem_post(&proxy_sem);
 			return ret;
 		}
 
 		i += ret;
 	}
 
-	spinlock_irqsave_unlock(&lwip_lock);
+	sem_post(&proxy_sem);
 
 	return j;
 }
 
+/// number of buffers, which uhyve handles with one exit
+#define UHYVE_IOV_MAX	16
+
+typedef struct {
+	const char* base;
+	size_t len;
+} __attribute__((packed)) uhyve_iovec_t;
+
+typedef struct {
+	int fd;
+	const uhyve_iovec_t* iov;
+	int iovcnt;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_rwv_t;
+
+// UHYVE_PORT_PREADV and UHYVE_PORT_PWRITEV
+typedef struct {
+	int fd;
+	const uhyve_iovec_t* iov;
+	int iovcnt;
+	off_t offset;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_prwv_t;
+
+/*
+ * Hand up to UHYVE_IOV_MAX buffers per exit to uhyve. Like in sys_read()
+ * and sys_write(), the buffers are described by their virtual addresses.
+ * A non-negative offset selects the positional ports.
+ */
+static ssize_t uhyve_rwv(unsigned short port, int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	// the host reads the whole table, which therefore mustn't cross a page boundary
+	uhyve_iovec_t table[UHYVE_IOV_MAX] __attribute__ ((aligned (UHYVE_IOV_MAX*sizeof(uhyve_iovec_t))));
+	uhyve_rwv_t uhyve_args;
+	uhyve_prwv_t uhyve_pargs;
+	ssize_t total = 0, ret;
+	size_t len;
+	int i, n;
+
+	while (iovcnt > 0) {
+		n = (iovcnt < UHYVE_IOV_MAX) ? iovcnt : UHYVE_IOV_MAX;
+		for(i=0, len=0; i<n; i++) {
+			table[i].base = (const char*) iov[i].iov_base;
+			table[i].len = iov[i].iov_len;
+			len += iov[i].iov_len;
+		}
+
+		if (offset >= 0) {
+			uhyve_pargs.fd = fd;
+			uhyve_pargs.iov = (const uhyve_iovec_t*) virt_to_phys((size_t) table);
+			uhyve_pargs.iovcnt = n;
+			uhyve_pargs.offset = offset + total;
+			uhyve_pargs.ret = -1;
+
+			uhyve_send(port, (unsigned)virt_to_phys((size_t)&uhyve_pargs));
+			ret = uhyve_pargs.ret;
+		} else {
+			uhyve_args.fd = fd;
+			uhyve_args.iov = (const uhyve_iovec_t*) virt_to_phys((size_t) table);
+			uhyve_args.iovcnt = n;
+			uhyve_args.ret = -1;
+
+			uhyve_send(port, (unsigned)virt_to_phys((size_t)&uhyve_args));
+			ret = uhyve_args.ret;
+		}
+
+		if (ret < 0)
+			return total ? total : ret;
+		total += ret;
+
+		// short read or write => don't touch the remaining buffers
+		if (ret < len)
+			break;
+
+		iov += n;
+		iovcnt -= n;
+	}
+
+	return total;
+}
+
 ssize_t readv(int d, const struct iovec *iov, int iovcnt)
 {
-	return -ENOSYS;
+	SYSSTAT_ENTER(SYSSTAT_READV);
+	sys_read_t sysargs = {__NR_read, d, 0};
+	ssize_t i, j, ret;
+	size_t off;
+	int k;
+
+	if (BUILTIN_EXPECT((iovcnt < 0) || (iovcnt && !iov), 0))
+		return -EINVAL;
+
+	// do we have an LwIP file descriptor?
+	if (d & LWIP_FD_BIT) {
+		ret = lwip_readv(d & ~LWIP_FD_BIT, iov, iovcnt);
+		if (ret < 0)
+			return -errno;
+
+		return ret;
+	}
+
+	if (d & (LOCALSOCK_FD_BIT|VSOCK_FD_BIT|TMPFS_FD_BIT|ROMFS_FD_BIT|BLKFS_FD_BIT|VIRTIOFS_FD_BIT)) {
+		for(k=0, i=0; k<iovcnt; k++) {
+			if (d & TMPFS_FD_BIT)
+				ret = tmpfs_read(d, iov[k].iov_base, iov[k].iov_len);
+			else if (d & ROMFS_FD_BIT)
+				ret = romfs_read(d, iov[k].iov_base, iov[k].iov_len);
+			else if (d & BLKFS_FD_BIT)
+				ret = blkfs_read(d, iov[k].iov_base, iov[k].iov_len);
+			else if (d & VIRTIOFS_FD_BIT)
+				ret = virtiofs_read(d, iov[k].iov_base, iov[k].iov_len);
+			else if (d & VSOCK_FD_BIT)
+				ret = vsock_read(d, iov[k].iov_base, iov[k].iov_len);
+			else
+				ret = localsock_read(d, iov[k].iov_base, iov[k].iov_len);
+			if (ret < 0)
+				return i ? i : ret;
+			i += ret;
+			if (ret < iov[k].iov_len)
+				break;
+		}
+
+		return i;
+	}
+
+	if (is_uhyve()) {
+		if ((is_uhyve() & UHYVE_FEAT_VECTORED_IO) && !pagecache_cached(d))
+			return uhyve_rwv(UHYVE_PORT_READV, d, iov, iovcnt, -1);
+
+		// older hosts or a cached file => one call per buffer
+		for(k=0, i=0; k<iovcnt; k++) {
+			ret = sys_read(d, (char*) iov[k].iov_base, iov[k].iov_len);
+			if (ret < 0)
+				return i ? i : ret;
+			i += ret;
+			if (ret < iov[k].iov_len)
+				break;
+		}
+
+		return i;
+	}
+
+	if (libc_sd < 0)
+		return -ENOSYS;
+
+	// the framed protocol pipelines the requests => one call per buffer
+	if (proxy_enabled()) {
+		for(k=0, i=0; k<iovcnt; k++) {
+			ret = proxy_read(d, iov[k].iov_base, iov[k].iov_len);
+			if (ret < 0)
+				return i ? i : ret;
+			i += ret;
+			if (ret < iov[k].iov_len)
+				break;
+		}
+
+		return i;
+	}
+
+	for(k=0; k<iovcnt; k++)
+		sysargs.len += iov[k].iov_len;
+
+	sem_wait(&proxy_sem, 0);
+
+	// one request for the whole vector
+	int s = libc_sd;
+	socket_send(s, &sysargs, sizeof(sysargs));
+	socket_recv(s, &j, sizeof(j));
+
+	// scatter the answer over the buffers
+	for(i=0, k=0, off=0; (i<j) && (k<iovcnt); ) {
+		size_t n = iov[k].iov_len - off;
+
+		if (!n) {
+			k++;
+			off = 0;
+			continue;
+		}
+
+		if (n > j-i)
+			n = j-i;
+
+		ret = host_sock_read(s, (char*)iov[k].iov_base+off, n);
+		if (ret < 0) {
+			sem_post(&proxy_sem);
+			return ret;
+		}
+
+		i += ret;
+		off += ret;
+	}
+
+	sem_post(&proxy_sem);
+
+	return j;
 }
 
 typedef struct {
@@ -221,14 +479,9 @@ typedef struct {
 	size_t len;
 } __attribute__((packed)) sys_write_t;
 
-typedef struct {
-	int fd;
-	const char* buf;
-	size_t len;
-} __attribute__((packed)) uhyve_write_t;
-
 ssize_t sys_write(int fd, const char* buf, size_t len)
 {
+	SYSSTAT_ENTER(SYSSTAT_WRITE);
 	if (BUILTIN_EXPECT(!buf, 0))
 		return -EINVAL;
 
@@ -237,15 +490,42 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 
 	// do we have an LwIP file descriptor?
 	if (fd & LWIP_FD_BIT) {
-		spinlock_irqsave_lock(&lwip_lock);
 		ret = lwip_write(fd & ~LWIP_FD_BIT, buf, len);
-		spinlock_irqsave_unlock(&lwip_lock);
 		if (ret < 0)
 			return -errno;
 
 		return ret;
 	}
 
+	if (fd & LOCALSOCK_FD_BIT)
+		return localsock_write(fd, buf, len);
+
+	if (fd & VSOCK_FD_BIT)
+		return vsock_write(fd, buf, len);
+
+	if (fd & TMPFS_FD_BIT)
+		return tmpfs_write(fd, buf, len);
+
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_write(fd, buf, len);
+
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_write(fd, buf, len);
+
+	// the image is read-only
+	if (fd & ROMFS_FD_BIT)
+		return -EBADF;
+
+	// stdout and stderr of uhyve and the console are collected per core
+	if (console_buffered(fd) && (is_uhyve() || (libc_sd < 0)))
+		return console_write(fd, buf, len);
+
+	if (is_uhyve())
+		pagecache_write(fd);
+
+	if (uhyve_io_enabled())
+		return uhyve_io_submit(UHYVE_IO_OP_WRITE, fd, (size_t) buf, len, 0);
+
 	if (is_uhyve()) {
 		uhyve_write_t uhyve_args = {fd, (const char*) buf, len};
 
@@ -264,7 +544,10 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 		return len;
 	}
 
-	spinlock_irqsave_lock(&lwip_lock);
+	if (proxy_enabled())
+		return proxy_write(fd, buf, len);
+
+	sem_wait(&proxy_sem, 0);
 
 	int s = libc_sd;
 	socket_send(s, &sysargs, sizeof(sysargs));
@@ -272,9 +555,9 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 	i=0;
 	while(i < len)
 	{
-		ret = lwip_write(s, (char*)buf+i, len-i);
+		ret = host_sock_write(s, (char*)buf+i, len-i);
 		if (ret < 0) {
-			spinlock_irqsave_unlock(&lwip_lock);
+			sem_post(&proxy_sem);
 			return ret;
 		}
 
@@ -286,344 +569,1989 @@ ssize_t sys_write(int fd, const char* buf, size_t len)
 		int temp = socket_recv(s, &i, sizeof(i));
 		if (temp < 0)
 		{
+			sem_post(&proxy_sem);
 			return (ssize_t) temp;
 		}
 	}
 
-	spinlock_irqsave_unlock(&lwip_lock);
+	sem_post(&proxy_sem);
 
 	return i;
 }
 
 ssize_t writev(int fildes, const struct iovec *iov, int iovcnt)
 {
-	return -ENOSYS;
-}
+	SYSSTAT_ENTER(SYSSTAT_WRITEV);
+	sys_write_t sysargs = {__NR_write, fildes, 0};
+	ssize_t i, ret;
+	int k;
 
-ssize_t sys_sbrk(ssize_t incr)
-{
-	ssize_t ret;
-	vma_t* heap = per_core(current_task)->heap;
-	static spinlock_t heap_lock = SPINLOCK_INIT;
+	if (BUILTIN_EXPECT((iovcnt < 0) || (iovcnt && !iov), 0))
+		return -EINVAL;
 
-	if (BUILTIN_EXPECT(!heap, 0)) {
-		LOG_ERROR("sys_sbrk: missing heap!\n");
-		do_abort();
+	// do we have an LwIP file descriptor?
+	if (fildes & LWIP_FD_BIT) {
+		ret = lwip_writev(fildes & ~LWIP_FD_BIT, iov, iovcnt);
+		if (ret < 0)
+			return -errno;
+
+		return ret;
 	}
 
-	spinlock_lock(&heap_lock);
+	if (fildes & ROMFS_FD_BIT)
+		return -EBADF;
+
+	if (fildes & (LOCALSOCK_FD_BIT|VSOCK_FD_BIT|TMPFS_FD_BIT|BLKFS_FD_BIT|VIRTIOFS_FD_BIT)) {
+		for(k=0, i=0; k<iovcnt; k++) {
+			if (fildes & TMPFS_FD_BIT)
+				ret = tmpfs_write(fildes, iov[k].iov_base, iov[k].iov_len);
+			else if (fildes & BLKFS_FD_BIT)
+				ret = blkfs_write(fildes, iov[k].iov_base, iov[k].iov_len);
+			else if (fildes & VIRTIOFS_FD_BIT)
+				ret = virtiofs_write(fildes, iov[k].iov_base, iov[k].iov_len);
+			else if (fildes & VSOCK_FD_BIT)
+				ret = vsock_write(fildes, iov[k].iov_base, iov[k].iov_len);
+			else
+				ret = localsock_write(fildes, iov[k].iov_base, iov[k].iov_len);
+			if (ret < 0)
+				return i ? i : ret;
+			i += ret;
+		}
 
-	ret = heap->end;
+		return i;
+	}
 
-	// check heapp boundaries
-	if ((heap->end >= HEAP_START) && (heap->end+incr < HEAP_START + HEAP_SIZE)) {
-		heap->end += incr;
+	if ((is_uhyve() & UHYVE_FEAT_VECTORED_IO) && !console_buffered(fildes)) {
+		pagecache_write(fildes);
+		return uhyve_rwv(UHYVE_PORT_WRITEV, fildes, iov, iovcnt, -1);
+	}
 
-		// reserve VMA regions
-		if (PAGE_FLOOR(heap->end) > PAGE_FLOOR(ret)) {
-			// region is already reserved for the heap, we have to change the
-			// property
-			vma_free(PAGE_FLOOR(ret), PAGE_CEIL(heap->end));
-			vma_add(PAGE_FLOOR(ret), PAGE_CEIL(heap->end), VMA_HEAP|VMA_USER);
+	// older uhyve hosts, the console or the framed proxy protocol => one call per buffer
+	if (is_uhyve() || (libc_sd < 0) || proxy_enabled()) {
+		for(k=0, i=0; k<iovcnt; k++) {
+			ret = sys_write(fildes, (const char*) iov[k].iov_base, iov[k].iov_len);
+			if (ret < 0)
+				return i ? i : ret;
+			i += ret;
+			if (ret < iov[k].iov_len)
+				break;
 		}
-	} else ret = -ENOMEM;
-
-	// allocation and mapping of new pages for the heap
-	// is catched by the pagefault handler
 
-	spinlock_unlock(&heap_lock);
+		return i;
+	}
 
-	return ret;
-}
+	for(k=0; k<iovcnt; k++)
+		sysargs.len += iov[k].iov_len;
 
-typedef struct {
-	const char* name;
-	int flags;
-	int mode;
-	int ret;
-} __attribute__((packed)) uhyve_open_t;
+	sem_wait(&proxy_sem, 0);
 
-int sys_open(const char* name, int flags, int mode)
-{
-	if (is_uhyve()) {
-		uhyve_open_t uhyve_open = {(const char*)virt_to_phys((size_t)name), flags, mode, -1};
+	// one request for the whole vector
+	int s = libc_sd;
+	socket_send(s, &sysargs, sizeof(sysargs));
 
-		uhyve_send(UHYVE_PORT_OPEN, (unsigned)virt_to_phys((size_t) &uhyve_open));
+	for(k=0; k<iovcnt; k++) {
+		ret = socket_send(s, iov[k].iov_base, iov[k].iov_len);
+		if (ret < 0) {
+			sem_post(&proxy_sem);
+			return ret;
+		}
+	}
 
-		return uhyve_open.ret;
+	i = sysargs.len;
+	if (fildes > 2)
+	{
+		int temp = socket_recv(s, &i, sizeof(i));
+		if (temp < 0)
+		{
+			sem_post(&proxy_sem);
+			return (ssize_t) temp;
+		}
 	}
 
-	int s, i, ret, sysnr = __NR_open;
-	size_t len;
+	sem_post(&proxy_sem);
 
-	spinlock_irqsave_lock(&lwip_lock);
-	if (libc_sd < 0) {
-		ret = -EINVAL;
-		goto out;
-	}
+	return i;
+}
 
-	s = libc_sd;
-	len = strlen(name)+1;
+/// whence of sys_lseek (values of newlib and Linux)
+#ifndef SEEK_SET
+#define SEEK_SET	0
+#define SEEK_CUR	1
+#endif
 
-	//i = 0;
-	//lwip_setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *) &i, sizeof(i));
+/// size of the chunks, which sys_sendfile() reads from the host
+#define SENDFILE_CHUNK		(64*1024)
+/// maximal number of chunks, which wait for the acknowledgement of the peer
+#define SENDFILE_CHUNKS		4
+/// interval to check for acknowledged chunks
+#define SENDFILE_ACK_NSEC	100000ULL
 
-	ret = socket_send(s, &sysnr, sizeof(sysnr));
-	if (ret < 0)
-		goto out;
+/* read the file into a bounce buffer and write it to out_fd */
+static ssize_t sendfile_copy(int out_fd, int in_fd, size_t count)
+{
+	size_t chunk = (count < SENDFILE_CHUNK) ? count : SENDFILE_CHUNK;
+	ssize_t total = 0, n, ret = 0;
+	char* buf;
 
-	ret = socket_send(s, &len, sizeof(len));
-	if (ret < 0)
-		goto out;
+	if (!count)
+		return 0;
 
-	i=0;
-	while(i<len)
-	{
-		ret = socket_send(s, name+i, len-i);
-		if (ret < 0)
-			goto out;
-		i += ret;
-	}
+	buf = kmalloc(chunk);
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -ENOMEM;
 
-	ret = socket_send(s, &flags, sizeof(flags));
-	if (ret < 0)
-		goto out;
+	while (total < count) {
+		size_t want = (count - total < chunk) ? count - total : chunk;
 
-	ret = socket_send(s, &mode, sizeof(mode));
-	if (ret < 0)
-		goto out;
+		n = sys_read(in_fd, buf, want);
+		if (n <= 0) {
+			ret = n;
+			break;
+		}
 
-	//i = 1;
-	//lwip_setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *) &i, sizeof(i));
+		ret = sys_write(out_fd, buf, n);
+		if (ret < n) {
+			// the data, which isn't written, remains unread
+			sys_lseek(in_fd, (ret > 0 ? ret : 0) - n, SEEK_CUR);
+			if (ret > 0)
+				total += ret;
+			break;
+		}
 
-	socket_recv(s, &ret, sizeof(ret));
+		total += n;
+		if (n < want)
+			break;
+	}
 
-out:
-	spinlock_irqsave_unlock(&lwip_lock);
+	kfree(buf);
 
-	return ret;
+	return total ? total : ret;
 }
 
+#if LWIP_TCPIP_CORE_LOCKING
 typedef struct {
-	int sysnr;
-	int fd;
-} __attribute__((packed)) sys_close_t;
-
-typedef struct {
-        int fd;
-        int ret;
-} __attribute__((packed)) uhyve_close_t;
+	char* buf;
+	/// sequence number behind the last byte of the chunk
+	u32_t seq;
+	/// LwIP's segments reference the chunk
+	uint8_t busy;
+} sendfile_chunk_t;
 
-int sys_close(int fd)
+static int sendfile_acked(struct netconn* conn, u32_t seq)
 {
-	int ret, s;
-	sys_close_t sysargs = {__NR_close, fd};
+	struct tcp_pcb* pcb;
+	int acked;
 
-	// do we have an LwIP file descriptor?
-	if (fd & LWIP_FD_BIT) {
-		ret = lwip_close(fd & ~LWIP_FD_BIT);
-		if (ret < 0)
-			return -errno;
+	LOCK_TCPIP_CORE();
+	pcb = conn->pcb.tcp;
+	// without PCB, LwIP has already released all segments
+	acked = !pcb || ((int32_t) (pcb->lastack - seq) >= 0);
+	UNLOCK_TCPIP_CORE();
 
-		return 0;
-	}
+	return acked;
+}
 
-	if (is_uhyve()) {
-		uhyve_close_t uhyve_close = {fd, -1};
+static inline void sendfile_release(struct netconn* conn, sendfile_chunk_t* chunk)
+{
+	if (!chunk->busy)
+		return;
 
-		uhyve_send(UHYVE_PORT_CLOSE, (unsigned)virt_to_phys((size_t) &uhyve_close));
+	while (!sendfile_acked(conn, chunk->seq))
+		timer_wait_ns(SENDFILE_ACK_NSEC);
+	chunk->busy = 0;
+}
 
-		return uhyve_close.ret;
-	}
+/*
+ * Read the file chunk by chunk and pass the chunks to the TCP connection
+ * without copying (NETCONN_NOCOPY). Unacknowledged segments may be
+ * retransmitted, therefore a chunk is reused or released not before the
+ * peer has acknowledged it.
+ */
+static ssize_t sendfile_tcp(struct netconn* conn, int in_fd, size_t count)
+{
+	sendfile_chunk_t chunks[SENDFILE_CHUNKS];
+	size_t chunk = (count < SENDFILE_CHUNK) ? count : SENDFILE_CHUNK;
+	ssize_t total = 0, ret = 0;
+	uint32_t i;
+
+	memset(chunks, 0x00, sizeof(chunks));
+
+	for(i=0; total < count; i++) {
+		sendfile_chunk_t* c = chunks + (i % SENDFILE_CHUNKS);
+		size_t want = (count - total < chunk) ? count - total : chunk;
+		size_t written = 0;
+		ssize_t n;
+		err_t err;
+
+		if (!c->buf) {
+			c->buf = kmalloc(chunk);
+			if (BUILTIN_EXPECT(!c->buf, 0)) {
+				ret = -ENOMEM;
+				break;
+			}
+		} else sendfile_release(conn, c);
 
-	spinlock_irqsave_lock(&lwip_lock);
+		n = sys_read(in_fd, c->buf, want);
+		if (n <= 0) {
+			ret = n;
+			break;
+		}
+
+		err = netconn_write_partly(conn, c->buf, n,
+			NETCONN_NOCOPY | ((total + n < count) ? NETCONN_MORE : 0), &written);
+		if (written) {
+			LOCK_TCPIP_CORE();
+			c->seq = conn->pcb.tcp ? conn->pcb.tcp->snd_lbb : 0;
+			c->busy = (conn->pcb.tcp != NULL);
+			UNLOCK_TCPIP_CORE();
+		}
+		total += written;
+
+		if (written < n) {
+			// the data, which isn't sent, remains unread
+			sys_lseek(in_fd, (off_t) written - n, SEEK_CUR);
+			ret = (err != ERR_OK) ? -err_to_errno(err) : 0;
+			break;
+		}
+
+		if (n < want)
+			break;
+	}
+
+	for(i=0; i<SENDFILE_CHUNKS; i++) {
+		if (!chunks[i].buf)
+			continue;
+
+		sendfile_release(conn, chunks + i);
+		kfree(chunks[i].buf);
+	}
+
+	return total ? total : ret;
+}
+#endif
+
+/*
+ * Send count bytes of in_fd to out_fd. If offset is NULL, the file is read
+ * from its current position, which is updated. Otherwise, the file is read
+ * from *offset, which is updated, and the file position isn't changed.
+ *
+ * TCP sockets of LwIP get the data without copying it into pbufs.
+ */
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t* offset, size_t count)
+{
+	SYSSTAT_ENTER(SYSSTAT_SENDFILE);
+	ssize_t ret = -EINVAL;
+	off_t pos = 0;
+#if LWIP_TCPIP_CORE_LOCKING
+	struct lwip_sock* sock = NULL;
+#endif
+
+	// the input has to be a file of the host
+	if (BUILTIN_EXPECT(in_fd & LWIP_FD_BIT, 0))
+		return -EINVAL;
+
+	if (offset) {
+		pos = sys_lseek(in_fd, 0, SEEK_CUR);
+		if (pos < 0)
+			return pos;
+		if (sys_lseek(in_fd, *offset, SEEK_SET) < 0)
+			return -EINVAL;
+	}
+
+#if LWIP_TCPIP_CORE_LOCKING
+	if (out_fd & LWIP_FD_BIT)
+		sock = lwip_socket_dbg_get_socket(out_fd & ~LWIP_FD_BIT);
+
+	if (sock && sock->conn && (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP))
+		ret = sendfile_tcp(sock->conn, in_fd, count);
+	else
+#endif
+		ret = sendfile_copy(out_fd, in_fd, count);
+
+	if (offset) {
+		if (ret > 0)
+			*offset += ret;
+		sys_lseek(in_fd, pos, SEEK_SET);
+	}
+
+	return ret;
+}
+
+/// flag of sys_recvmmsg: block only for the first datagram
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE	0x10000
+#endif
+#ifndef MSG_TRUNC
+#define MSG_TRUNC	0x04
+#endif
+#ifndef MSG_CTRUNC
+#define MSG_CTRUNC	0x08
+#endif
+#ifndef SO_TIMESTAMP
+#define SO_TIMESTAMP	29
+#endif
+#ifndef SCM_TIMESTAMP
+#define SCM_TIMESTAMP	SO_TIMESTAMP
+#endif
+
+/// maximal number of datagrams per sys_recvmmsg/sys_sendmmsg (as Linux)
+#define MMSG_MAX	1024
+
+/// message header of sys_recvmmsg/sys_sendmmsg (layout of Linux)
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+
+/// connections with SO_TIMESTAMP, indexed by the socket
+static struct netconn* mmsg_stamp_conns[MEMP_NUM_NETCONN];
+
+static struct netconn* mmsg_get_conn(int s)
+{
+	struct lwip_sock* sock;
+
+	if (!(s & LWIP_FD_BIT))
+		return NULL;
+
+	sock = lwip_socket_dbg_get_socket(s & ~LWIP_FD_BIT);
+	if (!sock || !sock->conn || (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_UDP))
+		return NULL;
+
+	return sock->conn;
+}
+
+/* store the sender of a datagram as sockaddr in msg_name */
+static void mmsg_set_name(struct msghdr* msg, const ip_addr_t* addr, u16_t port)
+{
+	union {
+		struct sockaddr_in sin;
+#if LWIP_IPV6
+		struct sockaddr_in6 sin6;
+#endif
+	} name;
+	socklen_t len;
+
+	memset(&name, 0x00, sizeof(name));
+
+#if LWIP_IPV6
+	if (IP_IS_V6(addr)) {
+		len = sizeof(name.sin6);
+		name.sin6.sin6_len = len;
+		name.sin6.sin6_family = AF_INET6;
+		name.sin6.sin6_port = lwip_htons(port);
+		inet6_addr_from_ip6addr(&name.sin6.sin6_addr, ip_2_ip6(addr));
+	} else
+#endif
+	{
+		len = sizeof(name.sin);
+		name.sin.sin_len = len;
+		name.sin.sin_family = AF_INET;
+		name.sin.sin_port = lwip_htons(port);
+		inet_addr_from_ip4addr(&name.sin.sin_addr, ip_2_ip4(addr));
+	}
+
+	memcpy(msg->msg_name, &name, (msg->msg_namelen < len) ? msg->msg_namelen : len);
+	msg->msg_namelen = len;
+}
+
+/* return the slot of s in mmsg_stamp_conns or -1 */
+static inline int mmsg_stamp_index(int s)
+{
+	int idx = (s & ~LWIP_FD_BIT) - LWIP_SOCKET_OFFSET;
+
+	return ((idx >= 0) && (idx < MEMP_NUM_NETCONN)) ? idx : -1;
+}
+
+/* store the time, when the driver took the datagram, as SCM_TIMESTAMP in msg_control */
+static void mmsg_set_stamp(struct msghdr* msg, uint64_t stamp)
+{
+	struct cmsghdr* cmsg = (struct cmsghdr*) msg->msg_control;
+	struct timeval tv;
+	uint64_t ns;
+
+	if (!stamp || !vclock_page) {
+		msg->msg_controllen = 0;
+		return;
+	}
+
+	if (!cmsg || (msg->msg_controllen < CMSG_SPACE(sizeof(tv)))) {
+		msg->msg_flags |= MSG_CTRUNC;
+		msg->msg_controllen = 0;
+		return;
+	}
+
+	ns = vclock_realtime_ns(vclock_page) - tsc_to_ns(get_rdtsc() - stamp);
+	tv.tv_sec = ns / 1000000000ULL;
+	tv.tv_usec = (ns % 1000000000ULL) / 1000ULL;
+
+	cmsg->cmsg_len = CMSG_LEN(sizeof(tv));
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_TIMESTAMP;
+	memcpy(CMSG_DATA(cmsg), &tv, sizeof(tv));
+	msg->msg_controllen = CMSG_SPACE(sizeof(tv));
+}
+
+/* convert the destination in msg_name to an LwIP address */
+static int mmsg_get_name(const struct msghdr* msg, ip_addr_t* addr, u16_t* port)
+{
+	const struct sockaddr* sa = (const struct sockaddr*) msg->msg_name;
+
+	if ((msg->msg_namelen >= sizeof(struct sockaddr_in)) && (sa->sa_family == AF_INET)) {
+		const struct sockaddr_in* sin = (const struct sockaddr_in*) sa;
+
+		inet_addr_to_ip4addr(ip_2_ip4(addr), &sin->sin_addr);
+		IP_SET_TYPE_VAL(*addr, IPADDR_TYPE_V4);
+		*port = lwip_ntohs(sin->sin_port);
+		return 0;
+	}
+
+#if LWIP_IPV6
+	if ((msg->msg_namelen >= sizeof(struct sockaddr_in6)) && (sa->sa_family == AF_INET6)) {
+		const struct sockaddr_in6* sin6 = (const struct sockaddr_in6*) sa;
+
+		inet6_addr_to_ip6addr(ip_2_ip6(addr), &sin6->sin6_addr);
+		IP_SET_TYPE_VAL(*addr, IPADDR_TYPE_V6);
+		*port = lwip_ntohs(sin6->sin6_port);
+		return 0;
+	}
+#endif
+
+	return -EINVAL;
+}
+
+/* gather the vector of a message in a pbuf of the transport layer */
+static int mmsg_get_pbuf(const struct msghdr* msg, struct pbuf** p)
+{
+	size_t len = 0;
+	u16_t off = 0;
+	int k;
+
+	if (BUILTIN_EXPECT((msg->msg_iovlen < 0) || (msg->msg_iovlen && !msg->msg_iov), 0))
+		return -EINVAL;
+
+	for(k=0; k<msg->msg_iovlen; k++)
+		len += msg->msg_iov[k].iov_len;
+	if (BUILTIN_EXPECT(len > 0xFFFF, 0))
+		return -EMSGSIZE;
+
+	// the drivers may reference a pbuf after the call => copy the data
+	*p = pbuf_alloc(PBUF_TRANSPORT, (u16_t) len, PBUF_RAM);
+	if (BUILTIN_EXPECT(!*p, 0))
+		return -ENOMEM;
+
+	for(k=0; k<msg->msg_iovlen; k++) {
+		if (!msg->msg_iov[k].iov_len)
+			continue;
+
+		pbuf_take_at(*p, msg->msg_iov[k].iov_base, (u16_t) msg->msg_iov[k].iov_len, off);
+		off += (u16_t) msg->msg_iov[k].iov_len;
+	}
+
+	// the stages of the TX path start here
+	netstats_tx_start(*p);
+
+	return 0;
+}
+
+/*
+ * Receive up to vlen datagrams of the UDP socket s. Like recvmmsg() of
+ * Linux, the call blocks for every datagram, unless MSG_DONTWAIT is set
+ * or MSG_WAITFORONE is set and at least one datagram is received. If
+ * SO_TIMESTAMP is enabled by sys_sock_timestamp(), msg_control receives
+ * the time, when the driver took the datagram from the device.
+ *
+ * Returns the number of datagrams or a negative error code, if no
+ * datagram is received.
+ */
+int sys_recvmmsg(int s, void* msgvec, unsigned int vlen, int flags)
+{
+	struct mmsghdr* vec = (struct mmsghdr*) msgvec;
+	struct netconn* conn = mmsg_get_conn(s);
+	const int idx = mmsg_stamp_index(s);
+	int stamped;
+	unsigned int i;
+
+	if (BUILTIN_EXPECT(!conn, 0))
+		return -ENOTSOCK;
+	stamped = (idx >= 0) && (mmsg_stamp_conns[idx] == conn);
+	if (BUILTIN_EXPECT(vlen && !vec, 0))
+		return -EINVAL;
+	if (vlen > MMSG_MAX)
+		vlen = MMSG_MAX;
+
+	for(i=0; i<vlen; i++) {
+		struct msghdr* msg = &vec[i].msg_hdr;
+		struct netbuf* buf;
+		u8_t apiflags = 0;
+		u16_t len, copied = 0;
+		uint64_t stamp;
+		err_t err;
+		int k;
+
+		if (BUILTIN_EXPECT((msg->msg_iovlen < 0) || (msg->msg_iovlen && !msg->msg_iov), 0))
+			return i ? (int) i : -EINVAL;
+
+		if ((flags & MSG_DONTWAIT) || netconn_is_nonblocking(conn) || (i && (flags & MSG_WAITFORONE)))
+			apiflags = NETCONN_DONTBLOCK;
+
+		err = netconn_recv_udp_raw_netbuf_flags(conn, &buf, apiflags);
+		if (err != ERR_OK)
+			return i ? (int) i : -err_to_errno(err);
+
+		// also accounts the time, which the datagram waited at the socket
+		stamp = netstats_rx_stamp(buf->p);
+
+		len = netbuf_len(buf);
+		for(k=0; (k<msg->msg_iovlen) && (copied<len); k++) {
+			u16_t n = (msg->msg_iov[k].iov_len < len - copied) ? (u16_t) msg->msg_iov[k].iov_len : len - copied;
+
+			copied += netbuf_copy_partial(buf, msg->msg_iov[k].iov_base, n, copied);
+		}
+
+		msg->msg_flags = (copied < len) ? MSG_TRUNC : 0;
+		mmsg_set_stamp(msg, stamped ? stamp : 0);
+		if (msg->msg_name && msg->msg_namelen)
+			mmsg_set_name(msg, netbuf_fromaddr(buf), netbuf_fromport(buf));
+		else
+			msg->msg_namelen = 0;
+		vec[i].msg_len = copied;
+
+		netbuf_delete(buf);
+	}
+
+	return (int) i;
+}
+
+/*
+ * Send up to vlen datagrams with the UDP socket s. All datagrams are passed
+ * to LwIP with a single acquisition of the core lock, which avoids a
+ * message to the tcpip thread per datagram.
+ *
+ * Returns the number of sent datagrams or a negative error code, if no
+ * datagram is sent.
+ */
+int sys_sendmmsg(int s, void* msgvec, unsigned int vlen, int flags)
+{
+	struct mmsghdr* vec = (struct mmsghdr*) msgvec;
+	struct netconn* conn = mmsg_get_conn(s);
+	unsigned int i;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT(!conn, 0))
+		return -ENOTSOCK;
+	if (BUILTIN_EXPECT(vlen && !vec, 0))
+		return -EINVAL;
+	if (vlen > MMSG_MAX)
+		vlen = MMSG_MAX;
+
+#if LWIP_TCPIP_CORE_LOCKING
+	LOCK_TCPIP_CORE();
+	for(i=0; i<vlen; i++) {
+		struct msghdr* msg = &vec[i].msg_hdr;
+		struct udp_pcb* pcb = conn->pcb.udp;
+		struct pbuf* p;
+		ip_addr_t addr;
+		u16_t port;
+		err_t err;
+
+		if (BUILTIN_EXPECT(!pcb, 0)) {
+			ret = -EBADF;
+			break;
+		}
+
+		if (msg->msg_name && ((ret = mmsg_get_name(msg, &addr, &port)) < 0))
+			break;
+
+		ret = mmsg_get_pbuf(msg, &p);
+		if (ret < 0)
+			break;
+
+		vec[i].msg_len = p->tot_len;
+		if (msg->msg_name)
+			err = udp_sendto(pcb, p, &addr, port);
+		else
+			err = udp_send(pcb, p);
+		pbuf_free(p);
+
+		if (err != ERR_OK) {
+			ret = -err_to_errno(err);
+			break;
+		}
+	}
+	UNLOCK_TCPIP_CORE();
+#else
+	for(i=0; i<vlen; i++) {
+		struct msghdr* msg = &vec[i].msg_hdr;
+		struct netbuf buf;
+		err_t err;
+
+		memset(&buf, 0x00, sizeof(buf));
+
+		if (msg->msg_name && ((ret = mmsg_get_name(msg, &buf.addr, &buf.port)) < 0))
+			break;
+
+		ret = mmsg_get_pbuf(msg, &buf.p);
+		if (ret < 0)
+			break;
+
+		vec[i].msg_len = buf.p->tot_len;
+		// without destination, LwIP uses the connected address
+		err = netconn_send(conn, &buf);
+		pbuf_free(buf.p);
+
+		if (err != ERR_OK) {
+			ret = -err_to_errno(err);
+			break;
+		}
+	}
+#endif
+
+	return i ? (int) i : ret;
+}
+
+/*
+ * Enable or disable SO_TIMESTAMP for the UDP socket s. LwIP doesn't know
+ * the option, therefore it isn't set by setsockopt(). The timestamps are
+ * only available, if the kernel is built with NETSTAMP.
+ *
+ * Returns 0 or a negative error code.
+ */
+int sys_sock_timestamp(int s, int enable)
+{
+	struct netconn* conn = mmsg_get_conn(s);
+	const int idx = mmsg_stamp_index(s);
+
+	if (BUILTIN_EXPECT(!conn, 0))
+		return -ENOTSOCK;
+	if (BUILTIN_EXPECT(idx < 0, 0))
+		return -EBADF;
+#ifndef NETSTAMP
+	if (enable)
+		return -EOPNOTSUPP;
+#endif
+
+	// a new connection of the socket disables the option again
+	mmsg_stamp_conns[idx] = enable ? conn : NULL;
+
+	return 0;
+}
+
+ssize_t sys_sbrk(ssize_t incr)
+{
+	SYSSTAT_ENTER(SYSSTAT_SBRK);
+	ssize_t ret;
+	vma_t* heap = per_core(current_task)->heap;
+	static spinlock_t heap_lock = SPINLOCK_INIT;
+
+	if (BUILTIN_EXPECT(!heap, 0)) {
+		LOG_ERROR("sys_sbrk: missing heap!\n");
+		do_abort();
+	}
+
+	spinlock_lock(&heap_lock);
+
+	ret = heap->end;
+
+	// check heapp boundaries
+	if ((incr >= 0) && (heap->end >= HEAP_START) && (heap->end+incr < HEAP_START + HEAP_SIZE)) {
+		heap->end += incr;
+
+		// reserve VMA regions
+		if (PAGE_FLOOR(heap->end) > PAGE_FLOOR(ret)) {
+			// region is already reserved for the heap, we have to change the
+			// property
+			vma_free(PAGE_FLOOR(ret), PAGE_CEIL(heap->end));
+			vma_add(PAGE_FLOOR(ret), PAGE_CEIL(heap->end), VMA_HEAP|VMA_USER);
+		}
+	} else if ((incr < 0) && (heap->end + incr >= heap->start)) {
+		// the first page of the heap remains part of the VMA
+		size_t vma_end = PAGE_CEIL(heap->end + incr);
+
+		heap->end += incr;
+
+		if (vma_end < heap->start + PAGE_SIZE)
+			vma_end = heap->start + PAGE_SIZE;
+
+		// return the space to the reservation of the heap
+		if (vma_end < PAGE_CEIL(ret)) {
+			vma_free(vma_end, PAGE_CEIL(ret));
+			vma_add(vma_end, PAGE_CEIL(ret), VMA_NO_ACCESS);
+		}
+
+		// release the huge pages above the new end
+		page_trim((heap->end + HUGE_PAGE_SIZE - 1) & HUGE_PAGE_MASK,
+			(ret + HUGE_PAGE_SIZE - 1) & HUGE_PAGE_MASK);
+	} else ret = -ENOMEM;
+
+	// allocation and mapping of new pages for the heap
+	// is catched by the pagefault handler
+
+	spinlock_unlock(&heap_lock);
+
+	return ret;
+}
+
+typedef struct {
+	const char* name;
+	int flags;
+	int mode;
+	int ret;
+} __attribute__((packed)) uhyve_open_t;
+
+int sys_open(const char* name, int flags, int mode)
+{
+	SYSSTAT_ENTER(SYSSTAT_OPEN);
+	// scratch files never leave the unikernel
+	if (tmpfs_path(name))
+		return tmpfs_open(name, flags, mode);
+
+	// files on the block device
+	if (blkfs_path(name))
+		return blkfs_open(name, flags, mode);
+
+	if (virtiofs_path(name))
+		return virtiofs_open(name, flags, mode);
+
+	// files of the embedded image are read from memory
+	const int romfd = romfs_open(name, flags);
+	if (romfd != -ENOENT)
+		return romfd;
+
+	if (is_uhyve()) {
+		uhyve_open_t uhyve_open = {(const char*)virt_to_phys((size_t)name), flags, mode, -1};
+
+		if (uhyve_io_enabled()) {
+			uhyve_open.ret = uhyve_io_submit(UHYVE_IO_OP_OPEN, -1, virt_to_phys((size_t) name), flags, mode);
+		} else {
+			uhyve_send(UHYVE_PORT_OPEN, (unsigned)virt_to_phys((size_t) &uhyve_open));
+		}
+
+		if (uhyve_open.ret >= 0)
+			pagecache_open(uhyve_open.ret, name, flags);
+
+		return uhyve_open.ret;
+	}
+
+	int s, i, ret, sysnr = __NR_open;
+	size_t len;
+
+	if (proxy_enabled())
+		return proxy_open(name, flags, mode);
+
+	sem_wait(&proxy_sem, 0);
 	if (libc_sd < 0) {
-		ret = 0;
+		ret = -EINVAL;
+		goto out;
+	}
+
+	s = libc_sd;
+	len = strlen(name)+1;
+
+	//i = 0;
+	//lwip_setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *) &i, sizeof(i));
+
+	ret = socket_send(s, &sysnr, sizeof(sysnr));
+	if (ret < 0)
+		goto out;
+
+	ret = socket_send(s, &len, sizeof(len));
+	if (ret < 0)
 		goto out;
+
+	i=0;
+	while(i<len)
+	{
+		ret = socket_send(s, name+i, len-i);
+		if (ret < 0)
+			goto out;
+		i += ret;
+	}
+
+	ret = socket_send(s, &flags, sizeof(flags));
+	if (ret < 0)
+		goto out;
+
+	ret = socket_send(s, &mode, sizeof(mode));
+	if (ret < 0)
+		goto out;
+
+	//i = 1;
+	//lwip_setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *) &i, sizeof(i));
+
+	socket_recv(s, &ret, sizeof(ret));
+
+out:
+	sem_post(&proxy_sem);
+
+	return ret;
+}
+
+typedef struct {
+	int sysnr;
+	int fd;
+} __attribute__((packed)) sys_close_t;
+
+typedef struct {
+        int fd;
+        int ret;
+} __attribute__((packed)) uhyve_close_t;
+
+int sys_close(int fd)
+{
+	SYSSTAT_ENTER(SYSSTAT_CLOSE);
+	int ret, s;
+	sys_close_t sysargs = {__NR_close, fd};
+
+	// do we have an LwIP file descriptor?
+	if (fd & LWIP_FD_BIT) {
+		epoll_socket_close(fd);
+		reuseport_close(fd);
+
+		ret = lwip_close(fd & ~LWIP_FD_BIT);
+		if (ret < 0)
+			return -errno;
+
+		return 0;
+	}
+
+	if (fd & EPOLL_FD_BIT)
+		return epoll_close(fd);
+
+	if (fd & LOCALSOCK_FD_BIT)
+		return localsock_close(fd);
+
+	if (fd & VSOCK_FD_BIT)
+		return vsock_close(fd);
+
+	if (fd & TMPFS_FD_BIT)
+		return tmpfs_close(fd);
+
+	if (fd & ROMFS_FD_BIT)
+		return romfs_close(fd);
+
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_close(fd);
+
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_close(fd);
+
+	if (is_uhyve()) {
+		pagecache_close(fd);
+
+		// the host descriptor is closed by the last sys_munmap() of the file
+		if (mmap_file_close(fd))
+			return 0;
+	}
+
+	if (uhyve_io_enabled())
+		return uhyve_io_submit(UHYVE_IO_OP_CLOSE, fd, 0, 0, 0);
+
+	if (is_uhyve()) {
+		uhyve_close_t uhyve_close = {fd, -1};
+
+		uhyve_send(UHYVE_PORT_CLOSE, (unsigned)virt_to_phys((size_t) &uhyve_close));
+
+		return uhyve_close.ret;
+	}
+
+	if (proxy_enabled())
+		return proxy_close(fd);
+
+	sem_wait(&proxy_sem, 0);
+	if (libc_sd < 0) {
+		ret = 0;
+		goto out;
+	}
+
+	s = libc_sd;
+	ret = socket_send(s, &sysargs, sizeof(sysargs));
+	if (ret != sizeof(sysargs))
+		goto out;
+	socket_recv(s, &ret, sizeof(ret));
+
+out:
+	sem_post(&proxy_sem);
+
+	return ret;
+}
+
+/// object caches of the locks and semaphores, which are created by the application
+static kmem_cache_t spinlock_cache = KMEM_CACHE_INIT("spinlock", sizeof(spinlock_t), NULL);
+static kmem_cache_t sem_cache = KMEM_CACHE_INIT("sem", sizeof(sem_t), NULL);
+static kmem_cache_t barrier_cache = KMEM_CACHE_INIT("barrier", sizeof(barrier_t), NULL);
+
+int sys_spinlock_init(spinlock_t** lock)
+{
+	int ret;
+
+	if (BUILTIN_EXPECT(!lock, 0))
+		return -EINVAL;
+
+	*lock = (spinlock_t*) kmem_cache_alloc(&spinlock_cache);
+	if (BUILTIN_EXPECT(!(*lock), 0))
+		return -ENOMEM;
+
+	ret = spinlock_init(*lock);
+	if (ret) {
+		kmem_cache_free(&spinlock_cache, *lock);
+		*lock = NULL;
+	}
+
+	return ret;
+}
+
+int sys_spinlock_destroy(spinlock_t* lock)
+{
+	int ret;
+
+	if (BUILTIN_EXPECT(!lock, 0))
+		return -EINVAL;
+
+	ret = spinlock_destroy(lock);
+	if (!ret)
+		kmem_cache_free(&spinlock_cache, lock);
+
+	return ret;
+}
+
+int sys_spinlock_lock(spinlock_t* lock)
+{
+	if (BUILTIN_EXPECT(!lock, 0))
+		return -EINVAL;
+
+	return spinlock_lock(lock);
+}
+
+int sys_spinlock_unlock(spinlock_t* lock)
+{
+	if (BUILTIN_EXPECT(!lock, 0))
+		return -EINVAL;
+
+	return spinlock_unlock(lock);
+}
+
+void sys_msleep(unsigned int ms)
+{
+	SYSSTAT_ENTER(SYSSTAT_MSLEEP);
+	if (ms > 0)
+		timer_wait_ns((uint64_t) ms * 1000000ULL);
+}
+
+int sys_nanosleep(uint64_t ns)
+{
+	SYSSTAT_ENTER(SYSSTAT_NANOSLEEP);
+	if (ns > 0)
+		return timer_wait_ns(ns);
+
+	return 0;
+}
+
+int sys_sem_init(sem_t** sem, unsigned int value)
+{
+	int ret;
+
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	*sem = (sem_t*) kmem_cache_alloc(&sem_cache);
+	if (BUILTIN_EXPECT(!(*sem), 0))
+		return -ENOMEM;
+
+	ret = sem_init(*sem, value);
+	if (ret) {
+		kmem_cache_free(&sem_cache, *sem);
+		*sem = NULL;
+	}
+
+	return ret;
+}
+
+int sys_sem_destroy(sem_t* sem)
+{
+	int ret;
+
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	ret = sem_destroy(sem);
+	if (!ret)
+		kmem_cache_free(&sem_cache, sem);
+
+	return ret;
+}
+
+int sys_sem_wait(sem_t* sem)
+{
+	SYSSTAT_ENTER(SYSSTAT_SEM_WAIT);
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	return sem_wait(sem, 0);
+}
+
+int sys_sem_post(sem_t* sem)
+{
+	SYSSTAT_ENTER(SYSSTAT_SEM_POST);
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	return sem_post(sem);
+}
+
+int sys_sem_timedwait(sem_t *sem, unsigned int ms)
+{
+	SYSSTAT_ENTER(SYSSTAT_SEM_TIMEDWAIT);
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	return sem_wait(sem, ms);
+}
+
+int sys_sem_timedwait_ns(sem_t *sem, uint64_t ns)
+{
+	SYSSTAT_ENTER(SYSSTAT_SEM_TIMEDWAIT);
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	return sem_timedwait_ns(sem, ns);
+}
+
+int sys_sem_cancelablewait(sem_t* sem, unsigned int ms)
+{
+	if (BUILTIN_EXPECT(!sem, 0))
+		return -EINVAL;
+
+	return sem_wait(sem, ms);
+}
+
+int sys_futex(int32_t* addr, int op, int32_t val, uint64_t timeout, int32_t* addr2, int32_t val3)
+{
+	SYSSTAT_ENTER(SYSSTAT_FUTEX);
+	// as in Linux, timeout contains the second count of the requeue operations
+	switch(op & FUTEX_CMD_MASK) {
+	case FUTEX_WAIT:
+		return futex_wait(addr, val, timeout);
+	case FUTEX_WAKE:
+		return futex_wake(addr, val);
+	case FUTEX_REQUEUE:
+		return futex_requeue(addr, val, (int32_t) timeout, addr2, NULL);
+	case FUTEX_CMP_REQUEUE:
+		return futex_requeue(addr, val, (int32_t) timeout, addr2, &val3);
+	case FUTEX_WAKE_OP:
+		return futex_wake_op(addr, val, (int32_t) timeout, addr2, (uint32_t) val3);
+	default:
+		return -ENOSYS;
+	}
+}
+
+int sys_barrier_init(barrier_t** barrier, unsigned int count)
+{
+	int ret;
+
+	if (BUILTIN_EXPECT(!barrier, 0))
+		return -EINVAL;
+
+	*barrier = (barrier_t*) kmem_cache_alloc(&barrier_cache);
+	if (BUILTIN_EXPECT(!(*barrier), 0))
+		return -ENOMEM;
+
+	ret = barrier_init(*barrier, count);
+	if (ret) {
+		kmem_cache_free(&barrier_cache, *barrier);
+		*barrier = NULL;
+	}
+
+	return ret;
+}
+
+int sys_barrier_destroy(barrier_t* barrier)
+{
+	int ret;
+
+	if (BUILTIN_EXPECT(!barrier, 0))
+		return -EINVAL;
+
+	ret = barrier_destroy(barrier);
+	if (!ret)
+		kmem_cache_free(&barrier_cache, barrier);
+
+	return ret;
+}
+
+/*
+ * Replaces a barrier of semaphores (one post and one wait per task and
+ * episode): the tasks spin for BARRIER_SPIN_NSEC and the last arriving
+ * task releases all sleepers at once. Returns BARRIER_SERIAL_TASK to the
+ * last task, 0 to the others.
+ */
+int sys_barrier_wait(barrier_t* barrier)
+{
+	SYSSTAT_ENTER(SYSSTAT_BARRIER_WAIT);
+	return barrier_wait(barrier);
+}
+
+int sys_ready_tasks(void)
+{
+	return (int) get_ready_tasks();
+}
+
+/*
+ * Hybrid wait for the wait policies of the OpenMP runtimes: while *addr
+ * contains val, the task spins for spin_ns nanoseconds and afterwards
+ * sleeps on the futex addr, which is released by sys_futex(FUTEX_WAKE).
+ * The spinning hands over the core, as long as a task of the same or a
+ * higher priority is ready on it (e.g. an oversubscribed worker, which
+ * has to reach the barrier). The timeout in microseconds covers both
+ * phases (0 = wait without timeout).
+ *
+ * Returns 0 if *addr doesn't contain val (anymore) or the task was woken
+ * up, -ETIMEDOUT if the timeout expired, -EINVAL on invalid arguments.
+ */
+int sys_spin_wait(int32_t* addr, int32_t val, uint64_t spin_ns, uint64_t timeout)
+{
+	uint64_t start, spun;
+	int ret;
+
+	SYSSTAT_ENTER(SYSSTAT_SPIN_WAIT);
+	if (BUILTIN_EXPECT(!addr || ((size_t) addr & 3), 0))
+		return -EINVAL;
+
+	// on a single core, only a ready task could change the value
+	if ((atomic_int32_read(&cpu_online) <= 1) && !is_task_available())
+		spin_ns = 0;
+	if (timeout && (spin_ns > timeout * 1000ULL))
+		spin_ns = timeout * 1000ULL;
+
+	// (uint64_t) -1 never sleeps, the task spins until the timeout expires
+	start = get_rdtsc();
+	if (spin_while_equal((const volatile uint32_t*) addr, (uint32_t) val, spin_ns))
+		return 0;
+
+	if (timeout) {
+		// the yields can take longer than the spinning phase
+		spun = tsc_to_ns(get_rdtsc() - start) / 1000ULL;
+		if (spun >= timeout)
+			return -ETIMEDOUT;
+		timeout -= spun;
+	}
+
+	ret = futex_wait(addr, val, timeout);
+	if (ret == -EAGAIN)
+		return 0;
+
+	return ret;
+}
+
+/*
+ * Entry points for the scheduler of the Go runtime (gccgo, see
+ * runtime_osinit() in page.c), which follow the semantics of its
+ * futexsleep, futexwakeup, usleep, osyield and getproccount. In contrast
+ * to sys_futex() and sys_msleep(), all timeouts have nanosecond resolution.
+ */
+int sys_futexsleep(uint32_t* addr, uint32_t val, int64_t ns)
+{
+	SYSSTAT_ENTER(SYSSTAT_FUTEX);
+	// a negative timeout means forever, as in Go
+	if (ns < 0)
+		ns = 0;
+	else if (!ns)
+		return -ETIMEDOUT;
+
+	return futex_wait_ns((int32_t*) addr, (int32_t) val, (uint64_t) ns);
+}
+
+int sys_futexwakeup(uint32_t* addr, uint32_t cnt)
+{
+	SYSSTAT_ENTER(SYSSTAT_FUTEX);
+	return futex_wake((int32_t*) addr, (int32_t) cnt);
+}
+
+int sys_usleep(uint32_t us)
+{
+	SYSSTAT_ENTER(SYSSTAT_NANOSLEEP);
+	if (us > 0)
+		return timer_wait_ns((uint64_t) us * 1000ULL);
+
+	return 0;
+}
+
+void sys_sched_yield(void)
+{
+	SYSSTAT_ENTER(SYSSTAT_YIELD);
+	// in contrast to sys_yield(), tasks of the same priority get the core as well
+	if (get_ready_tasks() && (get_highest_priority() >= per_core(current_task)->prio))
+		reschedule();
+}
+
+int sys_getproccount(void)
+{
+	uint64_t affinity[AFFINITY_WORDS];
+	uint32_t i, online = atomic_int32_read(&cpu_online);
+	int count = 0;
+
+	if (get_task_affinity(per_core(current_task)->id, affinity))
+		return 1;
+
+	for(i=0; i<online && i<MAX_CORES; i++) {
+		if ((affinity[i / 64] & (1ULL << (i % 64))) && !core_is_offline(i))
+			count++;
+	}
+
+	return count ? count : 1;
+}
+
+/*
+ * Hint of the Go scheduler that the current thread runs the processor
+ * (P) p. The thread is pinned to core p modulo the number of cores, so
+ * that the goroutines of a P don't move between the caches. A negative
+ * value releases the thread. Cores outside of the original affinity
+ * aren't used.
+ */
+int sys_pin_hint(int32_t p)
+{
+	task_t* curr_task = per_core(current_task);
+	uint64_t affinity[AFFINITY_WORDS];
+	uint32_t core_id, online = atomic_int32_read(&cpu_online);
+
+	if (p < 0) {
+		memset(affinity, 0xFF, sizeof(affinity));
+		return set_task_affinity(curr_task->id, affinity);
+	}
+
+	core_id = (uint32_t) p % online;
+	if (core_id >= MAX_CORES)
+		return -EINVAL;
+
+	if (get_task_affinity(curr_task->id, affinity) == 0
+	    && !(affinity[core_id / 64] & (1ULL << (core_id % 64))))
+		return -EINVAL;
+
+	memset(affinity, 0x00, sizeof(affinity));
+	affinity[core_id / 64] = 1ULL << (core_id % 64);
+
+	return set_task_affinity(curr_task->id, affinity);
+}
+
+int sys_clone(tid_t* id, void* ep, void* argv)
+{
+	return clone_task(id, ep, argv, per_core(current_task)->prio, PLACEMENT_DEFAULT);
+}
+
+int sys_clone_policy(tid_t* id, void* ep, void* argv, int policy)
+{
+	SYSSTAT_ENTER(SYSSTAT_CLONE);
+	return clone_task(id, ep, argv, per_core(current_task)->prio, policy);
+}
+
+int sys_sched_setaffinity(tid_t* id, size_t size, const void* mask)
+{
+	uint64_t affinity[AFFINITY_WORDS];
+
+	if (BUILTIN_EXPECT(!mask, 0))
+		return -EINVAL;
+
+	// cores beyond the mask are excluded, cores beyond MAX_CORES ignored
+	memset(affinity, 0x00, sizeof(affinity));
+	memcpy(affinity, mask, size < sizeof(affinity) ? size : sizeof(affinity));
+
+	return set_task_affinity(id ? *id : per_core(current_task)->id, affinity);
+}
+
+int sys_set_timeslice(tid_t* id, uint32_t us)
+{
+	return set_task_timeslice(id ? *id : per_core(current_task)->id, us);
+}
+
+int sys_set_prio_timeslice(uint8_t prio, uint32_t us)
+{
+	return set_prio_timeslice(prio, us);
+}
+
+int sys_set_timer_slack(tid_t* id, uint32_t ns)
+{
+	return set_task_timer_slack(id ? *id : per_core(current_task)->id, ns);
+}
+
+int sys_cpu_up(uint32_t core_id)
+{
+	return cpu_up(core_id);
+}
+
+int sys_cpu_down(uint32_t core_id)
+{
+	return cpu_down(core_id);
+}
+
+int sys_sched_getaffinity(tid_t* id, size_t size, void* mask)
+{
+	uint64_t affinity[AFFINITY_WORDS];
+	int ret;
+
+	if (BUILTIN_EXPECT(!mask, 0))
+		return -EINVAL;
+
+	ret = get_task_affinity(id ? *id : per_core(current_task)->id, affinity);
+	if (ret)
+		return ret;
+
+	memset(mask, 0x00, size);
+	memcpy(mask, affinity, size < sizeof(affinity) ? size : sizeof(affinity));
+
+	return 0;
+}
+
+int sys_sched_setdeadline(tid_t* id, uint64_t runtime, uint64_t deadline, uint64_t period)
+{
+	return set_task_deadline(id ? *id : per_core(current_task)->id, runtime, deadline, period);
+}
+
+int sys_gang_create(const tid_t* ids, uint32_t n)
+{
+	return create_gang(ids, n);
+}
+
+int sys_gang_destroy(int gang)
+{
+	return destroy_gang(gang);
+}
+
+int sys_fiber_init(void)
+{
+	return fiber_init();
+}
+
+int sys_fiber_create(void** fiber, int (*func)(void*), void* arg, size_t stack_size)
+{
+	return fiber_create((fiber_t**) fiber, func, arg, stack_size);
+}
+
+void sys_fiber_yield(void)
+{
+	fiber_yield();
+}
+
+int sys_fiber_switch(void* fiber)
+{
+	return fiber_switch_to((fiber_t*) fiber);
+}
+
+int sys_fiber_destroy(void* fiber, int* result)
+{
+	return fiber_destroy((fiber_t*) fiber, result);
+}
+
+int sys_epoll_create(int flags)
+{
+	return epoll_create(flags);
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, void* event)
+{
+	return epoll_ctl(epfd, op, fd, (struct epoll_event*) event);
+}
+
+int sys_epoll_wait(int epfd, void* events, int maxevents, int timeout)
+{
+	SYSSTAT_ENTER(SYSSTAT_EPOLL_WAIT);
+	return epoll_wait(epfd, (struct epoll_event*) events, maxevents, timeout);
+}
+
+int sys_rawnet_open(const char* ifname, uint16_t queue, void** rx, void** tx)
+{
+	return rawnet_open(ifname, queue, (rawnet_ring_t**) rx, (rawnet_ring_t**) tx);
+}
+
+int sys_rawnet_sync(int handle, int flags)
+{
+	return rawnet_sync(handle, flags);
+}
+
+int sys_rawnet_close(int handle)
+{
+	return rawnet_close(handle);
+}
+
+int sys_network_wait(unsigned int timeout_ms)
+{
+	return network_wait(timeout_ms);
+}
+
+int sys_reuseport_listen(int fd, int backlog)
+{
+	return reuseport_listen(fd, backlog);
+}
+
+int sys_localsock_socket(void)
+{
+	return localsock_socket();
+}
+
+int sys_localsock_listen(int fd, uint16_t port)
+{
+	return localsock_listen(fd, port);
+}
+
+int sys_localsock_accept(int fd)
+{
+	return localsock_accept(fd);
+}
+
+int sys_localsock_connect(int fd, uint16_t port)
+{
+	return localsock_connect(fd, port);
+}
+
+int sys_localsock_socketpair(int* sv)
+{
+	return localsock_socketpair(sv);
+}
+
+int sys_vsock_socket(void)
+{
+	return vsock_socket();
+}
+
+int sys_vsock_listen(int fd, uint32_t port)
+{
+	return vsock_listen(fd, port);
+}
+
+int sys_vsock_accept(int fd, uint64_t* cid, uint32_t* port)
+{
+	return vsock_accept(fd, cid, port);
+}
+
+int sys_vsock_connect(int fd, uint64_t cid, uint32_t port)
+{
+	return vsock_connect(fd, cid, port);
+}
+
+int sys_netstats(const char* ifname, void* stats, size_t size)
+{
+	netstats_t netstats;
+	int ret;
+
+	// without an interface, print the statistics of all interfaces
+	if (!ifname) {
+		netstats_dump();
+		return 0;
 	}
 
-	s = libc_sd;
-	ret = socket_send(s, &sysargs, sizeof(sysargs));
-	if (ret != sizeof(sysargs))
-		goto out;
-	socket_recv(s, &ret, sizeof(ret));
+	if (BUILTIN_EXPECT(!stats, 0))
+		return -EINVAL;
 
-out:
-	spinlock_irqsave_unlock(&lwip_lock);
+	ret = netstats_get(ifname, &netstats);
+	if (ret)
+		return ret;
 
-	return ret;
+	// older applications may know only the first counters
+	memset(stats, 0x00, size);
+	memcpy(stats, &netstats, size < sizeof(netstats) ? size : sizeof(netstats));
+
+	return 0;
 }
 
-int sys_spinlock_init(spinlock_t** lock)
+int sys_sched_getstats(tid_t* id, size_t size, void* stats)
 {
+	task_stats_t task_stats;
 	int ret;
 
-	if (BUILTIN_EXPECT(!lock, 0))
+	if (BUILTIN_EXPECT(!stats, 0))
 		return -EINVAL;
 
-	*lock = (spinlock_t*) kmalloc(sizeof(spinlock_t));
-	if (BUILTIN_EXPECT(!(*lock), 0))
-		return -ENOMEM;
+	ret = get_task_stats(id ? *id : per_core(current_task)->id, &task_stats);
+	if (ret)
+		return ret;
 
-	ret = spinlock_init(*lock);
-	if (ret) {
-		kfree(*lock);
-		*lock = NULL;
+	// older applications may know only the first counters
+	memset(stats, 0x00, size);
+	memcpy(stats, &task_stats, size < sizeof(task_stats) ? size : sizeof(task_stats));
+
+	return 0;
+}
+
+int sys_lockstat(size_t size, void* stats)
+{
+#ifdef LOCKSTAT
+	if (BUILTIN_EXPECT(!stats, 0))
+		return -EINVAL;
+
+	return lockstat_get((lock_stat_t*) stats, size / sizeof(lock_stat_t));
+#else
+	return -ENOSYS;
+#endif
+}
+
+int sys_sysstat(size_t size, void* stats)
+{
+#ifdef SYSSTAT
+	// without a buffer, print the statistics of all system calls
+	if (!stats) {
+		sysstat_dump();
+		return 0;
 	}
 
-	return ret;
+	return sysstat_get((sysstat_t*) stats, size / sizeof(sysstat_t));
+#else
+	return -ENOSYS;
+#endif
 }
 
-int sys_spinlock_destroy(spinlock_t* lock)
+int sys_hcstat(size_t size, void* stats)
+{
+#ifdef SYSSTAT
+	if (BUILTIN_EXPECT(!stats, 0))
+		return -EINVAL;
+
+	return hcstat_get((hcstat_t*) stats, size / sizeof(hcstat_t));
+#else
+	return -ENOSYS;
+#endif
+}
+
+int sys_hist_read(uint32_t index, void* buf)
+{
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -EINVAL;
+
+	return hist_read(index, (hist_data_t*) buf);
+}
+
+int sys_pfstat(int core, size_t size, void* stats)
 {
+	pf_stats_t pf_stats;
 	int ret;
 
-	if (BUILTIN_EXPECT(!lock, 0))
+	if (BUILTIN_EXPECT(!stats, 0))
 		return -EINVAL;
 
-	ret = spinlock_destroy(lock);
-	if (!ret)
-		kfree(lock);
+	ret = page_fault_stats(core, &pf_stats);
+	if (ret)
+		return ret;
 
-	return ret;
+	// older applications may know only the first counters
+	memset(stats, 0x00, size);
+	memcpy(stats, &pf_stats, size < sizeof(pf_stats) ? size : sizeof(pf_stats));
+
+	return 0;
 }
 
-int sys_spinlock_lock(spinlock_t* lock)
+int sys_memstat(size_t size, void* stats)
 {
-	if (BUILTIN_EXPECT(!lock, 0))
+	mem_stats_t mem_stats;
+	int ret;
+
+	if (BUILTIN_EXPECT(!stats, 0))
 		return -EINVAL;
 
-	return spinlock_lock(lock);
+	ret = mem_get_stats(&mem_stats);
+	if (ret)
+		return ret;
+
+	// older applications may know only the first counters
+	memset(stats, 0x00, size);
+	memcpy(stats, &mem_stats, size < sizeof(mem_stats) ? size : sizeof(mem_stats));
+
+	return 0;
 }
 
-int sys_spinlock_unlock(spinlock_t* lock)
+int sys_buddyinfo(size_t size, void* info)
 {
-	if (BUILTIN_EXPECT(!lock, 0))
+	buddy_info_t buddy;
+	int ret;
+
+	if (BUILTIN_EXPECT(!info, 0))
 		return -EINVAL;
 
-	return spinlock_unlock(lock);
+	ret = buddy_info(&buddy);
+	if (ret)
+		return ret;
+
+	memset(info, 0x00, size);
+	memcpy(info, &buddy, size < sizeof(buddy) ? size : sizeof(buddy));
+
+	return 0;
 }
 
-void sys_msleep(unsigned int ms)
+int sys_softirq_stats(uint32_t core, size_t size, void* stats)
+{
+	softirq_stats_t s;
+	int ret;
+
+	if (BUILTIN_EXPECT(!stats, 0))
+		return -EINVAL;
+
+	ret = softirq_stats(core, &s);
+	if (ret)
+		return ret;
+
+	memset(stats, 0x00, size);
+	memcpy(stats, &s, size < sizeof(s) ? size : sizeof(s));
+
+	return 0;
+}
+
+int sys_flexsc_start(uint32_t core)
 {
-	if (ms * TIMER_FREQ / 1000 > 0)
-		timer_wait(ms * TIMER_FREQ / 1000);
-	else if (ms > 0)
-		udelay(ms * 1000);
+	return flexsc_start(core);
 }
 
-int sys_sem_init(sem_t** sem, unsigned int value)
+int sys_flexsc_register(void* entries, uint32_t count)
 {
-	int ret;
+	return flexsc_register((flexsc_entry_t*) entries, count);
+}
 
-	if (BUILTIN_EXPECT(!sem, 0))
+int sys_flexsc_unregister(void* entries)
+{
+	return flexsc_unregister((flexsc_entry_t*) entries);
+}
+
+void sys_flexsc_kick(void)
+{
+	flexsc_kick();
+}
+
+int64_t sys_flexsc_wait(void* entry)
+{
+	if (BUILTIN_EXPECT(!entry, 0))
 		return -EINVAL;
 
-	*sem = (sem_t*) kmalloc(sizeof(sem_t));
-	if (BUILTIN_EXPECT(!(*sem), 0))
-		return -ENOMEM;
+	return flexsc_wait((flexsc_entry_t*) entry);
+}
 
-	ret = sem_init(*sem, value);
-	if (ret) {
-		kfree(*sem);
-		*sem = NULL;
+int sys_pftrace(size_t size, void* buf)
+{
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -EINVAL;
+
+	return page_fault_trace((pf_trace_t*) buf, size / sizeof(pf_trace_t));
+}
+
+int sys_ktrace(int enable)
+{
+#ifdef KERNEL_TRACE
+	return ktrace_enable(enable);
+#else
+	return -ENOSYS;
+#endif
+}
+
+int sys_ktrace_read(int core, size_t size, void* buf)
+{
+#ifdef KERNEL_TRACE
+	if (BUILTIN_EXPECT(core < 0, 0))
+		return -EINVAL;
+
+	return ktrace_read((uint32_t) core, (ktrace_entry_t*) buf, size / sizeof(ktrace_entry_t));
+#else
+	return -ENOSYS;
+#endif
+}
+
+int sys_pmu_open(uint32_t type, uint64_t config)
+{
+	return pmu_open(type, config);
+}
+
+int sys_pmu_read(int fd, uint64_t* value)
+{
+	return pmu_read(fd, value);
+}
+
+int sys_pmu_reset(int fd)
+{
+	return pmu_reset(fd);
+}
+
+int sys_pmu_close(int fd)
+{
+	return pmu_close(fd);
+}
+
+int sys_pmu_profile_start(uint32_t type, uint64_t config, uint64_t period)
+{
+	return pmu_profile_start(type, config, period);
+}
+
+int sys_pmu_profile_stop(void)
+{
+	return pmu_profile_stop();
+}
+
+int sys_pmu_profile_read(int core, size_t size, void* buf)
+{
+	if (BUILTIN_EXPECT(core < 0, 0))
+		return -EINVAL;
+
+	return pmu_profile_read((uint32_t) core, (pmu_sample_t*) buf, size / sizeof(pmu_sample_t));
+}
+
+typedef struct {
+	int sysnr;
+	int fd;
+	off_t offset;
+	int whence;
+} __attribute__((packed)) sys_lseek_t;
+
+off_t sys_lseek(int fd, off_t offset, int whence)
+{
+	SYSSTAT_ENTER(SYSSTAT_LSEEK);
+	if (fd & TMPFS_FD_BIT)
+		return tmpfs_lseek(fd, offset, whence);
+
+	if (fd & ROMFS_FD_BIT)
+		return romfs_lseek(fd, offset, whence);
+
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_lseek(fd, offset, whence);
+
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_lseek(fd, offset, whence);
+
+	if (pagecache_cached(fd))
+		return pagecache_lseek(fd, offset, whence);
+
+	if (uhyve_io_enabled())
+		return uhyve_io_submit(UHYVE_IO_OP_LSEEK, fd, 0, whence, offset);
+
+	if (is_uhyve()) {
+		uhyve_lseek_t uhyve_lseek = { fd, offset, whence };
+
+		uhyve_send(UHYVE_PORT_LSEEK, (unsigned)virt_to_phys((size_t) &uhyve_lseek));
+
+		return uhyve_lseek.offset;
+	}
+
+	off_t off;
+	sys_lseek_t sysargs = {__NR_lseek, fd, offset, whence};
+	int s;
+
+	if (proxy_enabled())
+		return proxy_lseek(fd, offset, whence);
+
+	sem_wait(&proxy_sem, 0);
+
+	if (libc_sd < 0) {
+		sem_post(&proxy_sem);
+		return -ENOSYS;
 	}
 
+	s = libc_sd;
+	socket_send(s, &sysargs, sizeof(sysargs));
+	socket_recv(s, &off, sizeof(off));
+
+	sem_post(&proxy_sem);
+
+	return off;
+}
+
+// UHYVE_PORT_PREAD and UHYVE_PORT_PWRITE
+typedef struct {
+	int fd;
+	char* buf;
+	size_t len;
+	off_t offset;
+	ssize_t ret;
+} __attribute__((packed)) uhyve_prw_t;
+
+/// serializes the emulation of positional I/O by sys_lseek()
+static sem_t pio_sem = SEM_INIT(1);
+
+/*
+ * Older hosts and the classic proxy protocol don't know positional I/O
+ * => move the offset of the descriptor and restore it afterwards. Only
+ * other emulated calls are excluded, not concurrent reads and writes.
+ */
+static ssize_t pio_emulate(int fd, char* buf, size_t len, off_t offset, int write)
+{
+	off_t cur;
+	ssize_t ret;
+
+	sem_wait(&pio_sem, 0);
+
+	cur = sys_lseek(fd, 0, SEEK_CUR);
+	if (cur < 0) {
+		ret = cur;
+		goto out;
+	}
+
+	ret = sys_lseek(fd, offset, SEEK_SET);
+	if (ret < 0)
+		goto out;
+
+	ret = write ? sys_write(fd, buf, len) : sys_read(fd, buf, len);
+
+	sys_lseek(fd, cur, SEEK_SET);
+
+out:
+	sem_post(&pio_sem);
+
 	return ret;
 }
 
-int sys_sem_destroy(sem_t* sem)
+ssize_t sys_pread(int fd, char* buf, size_t len, off_t offset)
 {
-	int ret;
-
-	if (BUILTIN_EXPECT(!sem, 0))
+	SYSSTAT_ENTER(SYSSTAT_PREAD);
+	if (BUILTIN_EXPECT(offset < 0, 0))
 		return -EINVAL;
 
-	ret = sem_destroy(sem);
-	if (!ret)
-		kfree(sem);
+	// sockets and epoll instances aren't seekable
+	if (fd & (LWIP_FD_BIT|EPOLL_FD_BIT|LOCALSOCK_FD_BIT|VSOCK_FD_BIT))
+		return -ESPIPE;
 
-	return ret;
-}
+	if (fd & TMPFS_FD_BIT)
+		return tmpfs_pread(fd, buf, len, offset);
 
-int sys_sem_wait(sem_t* sem)
-{
-	if (BUILTIN_EXPECT(!sem, 0))
-		return -EINVAL;
+	if (fd & ROMFS_FD_BIT)
+		return romfs_pread(fd, buf, len, offset);
 
-	return sem_wait(sem, 0);
-}
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_pread(fd, buf, len, offset);
 
-int sys_sem_post(sem_t* sem)
-{
-	if (BUILTIN_EXPECT(!sem, 0))
-		return -EINVAL;
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_pread(fd, buf, len, offset);
 
-	return sem_post(sem);
+	if (pagecache_cached(fd))
+		return pagecache_pread(fd, buf, len, offset);
+
+	if (is_uhyve() & UHYVE_FEAT_POSITIONAL_IO) {
+		if (uhyve_io_enabled())
+			return uhyve_io_submit(UHYVE_IO_OP_PREAD, fd, (size_t) buf, len, offset);
+
+		uhyve_prw_t uhyve_args = {fd, buf, len, offset, -1};
+
+		uhyve_send(UHYVE_PORT_PREAD, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+		return uhyve_args.ret;
+	}
+
+	if (proxy_enabled())
+		return proxy_pread(fd, buf, len, offset);
+
+	return pio_emulate(fd, buf, len, offset, 0);
 }
 
-int sys_sem_timedwait(sem_t *sem, unsigned int ms)
+ssize_t sys_pwrite(int fd, const char* buf, size_t len, off_t offset)
 {
-	if (BUILTIN_EXPECT(!sem, 0))
+	SYSSTAT_ENTER(SYSSTAT_PWRITE);
+	if (BUILTIN_EXPECT(!buf || (offset < 0), 0))
 		return -EINVAL;
 
-	return sem_wait(sem, ms);
+	if (fd & (LWIP_FD_BIT|EPOLL_FD_BIT|LOCALSOCK_FD_BIT|VSOCK_FD_BIT))
+		return -ESPIPE;
+
+	if (fd & TMPFS_FD_BIT)
+		return tmpfs_pwrite(fd, buf, len, offset);
+
+	if (fd & ROMFS_FD_BIT)
+		return -EBADF;
+
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_pwrite(fd, buf, len, offset);
+
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_pwrite(fd, buf, len, offset);
+
+	if (is_uhyve())
+		pagecache_write(fd);
+
+	if (is_uhyve() & UHYVE_FEAT_POSITIONAL_IO) {
+		if (uhyve_io_enabled())
+			return uhyve_io_submit(UHYVE_IO_OP_PWRITE, fd, (size_t) buf, len, offset);
+
+		uhyve_prw_t uhyve_args = {fd, (char*) buf, len, offset, -1};
+
+		uhyve_send(UHYVE_PORT_PWRITE, (unsigned)virt_to_phys((size_t)&uhyve_args));
+
+		return uhyve_args.ret;
+	}
+
+	if (proxy_enabled())
+		return proxy_pwrite(fd, buf, len, offset);
+
+	return pio_emulate(fd, (char*) buf, len, offset, 1);
 }
 
-int sys_sem_cancelablewait(sem_t* sem, unsigned int ms)
+ssize_t preadv(int d, const struct iovec *iov, int iovcnt, off_t offset)
 {
-	if (BUILTIN_EXPECT(!sem, 0))
+	SYSSTAT_ENTER(SYSSTAT_PREADV);
+	ssize_t i, ret;
+	int k;
+
+	if (BUILTIN_EXPECT((iovcnt < 0) || (iovcnt && !iov) || (offset < 0), 0))
 		return -EINVAL;
 
-	return sem_wait(sem, ms);
-}
+	if (d & (LWIP_FD_BIT|EPOLL_FD_BIT|LOCALSOCK_FD_BIT|VSOCK_FD_BIT))
+		return -ESPIPE;
 
-int sys_clone(tid_t* id, void* ep, void* argv)
-{
-	return clone_task(id, ep, argv, per_core(current_task)->prio);
-}
+	if (((is_uhyve() & (UHYVE_FEAT_VECTORED_IO|UHYVE_FEAT_POSITIONAL_IO)) == (UHYVE_FEAT_VECTORED_IO|UHYVE_FEAT_POSITIONAL_IO))
+	    && !(d & (TMPFS_FD_BIT|ROMFS_FD_BIT|BLKFS_FD_BIT|VIRTIOFS_FD_BIT)) && !pagecache_cached(d))
+		return uhyve_rwv(UHYVE_PORT_PREADV, d, iov, iovcnt, offset);
 
-typedef struct {
-	int sysnr;
-	int fd;
-	off_t offset;
-	int whence;
-} __attribute__((packed)) sys_lseek_t;
+	// one positional call per buffer
+	for(k=0, i=0; k<iovcnt; k++) {
+		ret = sys_pread(d, (char*) iov[k].iov_base, iov[k].iov_len, offset + i);
+		if (ret < 0)
+			return i ? i : ret;
+		i += ret;
+		if (ret < iov[k].iov_len)
+			break;
+	}
 
-typedef struct {
-	int fd;
-	off_t offset;
-	int whence;
-} __attribute__((packed)) uhyve_lseek_t;
+	return i;
+}
 
-off_t sys_lseek(int fd, off_t offset, int whence)
+ssize_t pwritev(int fildes, const struct iovec *iov, int iovcnt, off_t offset)
 {
-	if (is_uhyve()) {
-		uhyve_lseek_t uhyve_lseek = { fd, offset, whence };
+	SYSSTAT_ENTER(SYSSTAT_PWRITEV);
+	ssize_t i, ret;
+	int k;
 
-		outportl(UHYVE_PORT_LSEEK, (unsigned)virt_to_phys((size_t) &uhyve_lseek));
+	if (BUILTIN_EXPECT((iovcnt < 0) || (iovcnt && !iov) || (offset < 0), 0))
+		return -EINVAL;
 
-		return uhyve_lseek.offset;
+	if (fildes & (LWIP_FD_BIT|EPOLL_FD_BIT|LOCALSOCK_FD_BIT|VSOCK_FD_BIT))
+		return -ESPIPE;
+
+	if (((is_uhyve() & (UHYVE_FEAT_VECTORED_IO|UHYVE_FEAT_POSITIONAL_IO)) == (UHYVE_FEAT_VECTORED_IO|UHYVE_FEAT_POSITIONAL_IO))
+	    && !(fildes & (TMPFS_FD_BIT|ROMFS_FD_BIT|BLKFS_FD_BIT|VIRTIOFS_FD_BIT))) {
+		pagecache_write(fildes);
+		return uhyve_rwv(UHYVE_PORT_PWRITEV, fildes, iov, iovcnt, offset);
 	}
 
-	off_t off;
-	sys_lseek_t sysargs = {__NR_lseek, fd, offset, whence};
-	int s;
+	for(k=0, i=0; k<iovcnt; k++) {
+		ret = sys_pwrite(fildes, (const char*) iov[k].iov_base, iov[k].iov_len, offset + i);
+		if (ret < 0)
+			return i ? i : ret;
+		i += ret;
+		if (ret < iov[k].iov_len)
+			break;
+	}
 
-	spinlock_irqsave_lock(&lwip_lock);
+	return i;
+}
 
-	if (libc_sd < 0) {
-		spinlock_irqsave_unlock(&lwip_lock);
-		return -ENOSYS;
-	}
+/*
+ * Wait until another isle rings the doorbell, i.e. its value differs from seq.
+ * Peers typically register within a few microseconds to milliseconds, so we
+ * spin for a short time, before we block for RCCE_DOORBELL_SLEEP_NS.
+ */
+static int rcce_doorbell_wait(int32_t seq, uint64_t start, uint64_t timeout)
+{
+	uint64_t now;
 
-	s = libc_sd;
-	socket_send(s, &sysargs, sizeof(sysargs));
-	socket_recv(s, &off, sizeof(off));
+	while (atomic_int32_read(rcce_doorbell) == seq) {
+		now = get_uptime();
+		if (now - start >= timeout)
+			return -ETIME;
 
-	spinlock_irqsave_unlock(&lwip_lock);
+		if (now - start < RCCE_DOORBELL_SPIN)
+			PAUSE;
+		else
+			timer_wait_ns(RCCE_DOORBELL_SLEEP_NS);
+	}
 
-	return off;
+	return 0;
 }
 
 int sys_rcce_init(int session_id)
@@ -675,6 +2603,9 @@ int sys_rcce_init(int session_id)
 
 	rcce_mpb[i].mpb[isle] = paddr;
 
+	// wake up the isles, which are waiting for our MPB
+	atomic_int32_inc(rcce_doorbell);
+
 out:
 	islelock_unlock(rcce_lock);
 
@@ -686,7 +2617,9 @@ out:
 size_t sys_rcce_malloc(int session_id, int ue)
 {
 	size_t vaddr = 0;
-	int i, counter = 0;
+	uint64_t start = get_uptime();
+	int32_t seq;
+	int i;
 
 	if (is_single_kernel())
 		return -ENOSYS;
@@ -694,21 +2627,19 @@ size_t sys_rcce_malloc(int session_id, int ue)
 	if (session_id <= 0)
 		return -EINVAL;
 
-	// after 120 retries (= 120*300 ms) we give up
+	// the doorbell is read before the table => a MPB, which is published
+	// after the scan, is not missed
 	do {
+		seq = atomic_int32_read(rcce_doorbell);
+
 		for(i=0; i<MAX_RCCE_SESSIONS; i++)
 		{
 			if ((rcce_mpb[i].id == session_id) && rcce_mpb[i].mpb[ue])
 				break;
 		}
+	} while((i >= MAX_RCCE_SESSIONS) && !rcce_doorbell_wait(seq, start, RCCE_RENDEZVOUS_TIMEOUT));
 
-		if (i >= MAX_RCCE_SESSIONS) {
-			counter++;
-			timer_wait((300*TIMER_FREQ)/1000);
-		}
-	} while((i >= MAX_RCCE_SESSIONS) && (counter < 120));
-
-	LOG_DEBUG("i = %d, counter = %d, max %d\n", i, counter, MAX_RCCE_SESSIONS);
+	LOG_DEBUG("i = %d, waited %zd ms, max %d\n", i, get_uptime() - start, MAX_RCCE_SESSIONS);
 
 	// create new session
 	if (i >= MAX_RCCE_SESSIONS)
@@ -770,6 +2701,16 @@ int sys_rcce_fini(int session_id)
 	}
 	rcce_mpb[i].mpb[isle] = 0;
 
+	// release a window, which wasn't freed by the application
+	if (rcce_mpb[i].win[isle]) {
+		if (is_hbmem_available())
+			hbmem_put_pages(rcce_mpb[i].win[isle], rcce_mpb[i].win_size[isle] / PAGE_SIZE);
+		else
+			put_pages(rcce_mpb[i].win[isle], rcce_mpb[i].win_size[isle] / PAGE_SIZE);
+	}
+	rcce_mpb[i].win[isle] = 0;
+	rcce_mpb[i].win_size[isle] = 0;
+
 	for(j=0; (j<MAX_ISLE) && !rcce_mpb[i].mpb[j]; j++) {
 		PAUSE;
 	}
@@ -784,6 +2725,172 @@ out:
 	return ret;
 }
 
+static int rcce_find_session(int session_id)
+{
+	int i;
+
+	for(i=0; i<MAX_RCCE_SESSIONS; i++)
+	{
+		if (rcce_mpb[i].id == session_id)
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+static size_t rcce_win_vmap(size_t paddr, size_t size)
+{
+	size_t vaddr;
+
+	vaddr = vma_alloc(size, VMA_READ|VMA_WRITE|VMA_USER|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!vaddr, 0))
+		return 0;
+
+	if (page_map(vaddr, paddr, size / PAGE_SIZE, PG_RW|PG_USER|PG_PRESENT)) {
+		vma_free(vaddr, vaddr + size);
+		return 0;
+	}
+
+	return vaddr;
+}
+
+/*
+ * Allocate the RMA window of this isle, publish its physical address
+ * in the session table and map it into the own address space. In
+ * contrast to the MPB, the window is not staged: other isles map the
+ * same pages via sys_rcce_win_map() and access them directly.
+ */
+size_t sys_rcce_win_alloc(int session_id, size_t size)
+{
+	size_t paddr, vaddr = 0;
+	int i;
+
+	if (is_single_kernel())
+		return 0;
+
+	if ((session_id <= 0) || !size)
+		return 0;
+
+	size = PAGE_CEIL(size);
+
+	islelock_lock(rcce_lock);
+
+	i = rcce_find_session(session_id);
+	if ((i < 0) || rcce_mpb[i].win[isle])
+		goto out;
+
+	if (is_hbmem_available())
+		paddr = hbmem_get_pages(size / PAGE_SIZE);
+	else
+		paddr = get_pages(size / PAGE_SIZE);
+	if (BUILTIN_EXPECT(!paddr, 0))
+		goto out;
+
+	vaddr = rcce_win_vmap(paddr, size);
+	if (BUILTIN_EXPECT(!vaddr, 0)) {
+		if (is_hbmem_available())
+			hbmem_put_pages(paddr, size / PAGE_SIZE);
+		else
+			put_pages(paddr, size / PAGE_SIZE);
+		goto out;
+	}
+
+	memset((void*)vaddr, 0x0, size);
+
+	rcce_mpb[i].win_size[isle] = size;
+	rcce_mpb[i].win[isle] = paddr;
+	atomic_int32_inc(rcce_doorbell);
+
+	LOG_INFO("Create RMA window of session %d at 0x%zx (%zd bytes), using of slot %d\n", session_id, paddr, size, i);
+
+out:
+	islelock_unlock(rcce_lock);
+
+	return vaddr;
+}
+
+/*
+ * Map the RMA window of isle ue. The window has to be published before,
+ * which the application guarantees by a barrier after sys_rcce_win_alloc().
+ */
+size_t sys_rcce_win_map(int session_id, int ue, size_t* size)
+{
+	size_t paddr = 0, len = 0, vaddr;
+	int i;
+
+	if (is_single_kernel())
+		return 0;
+
+	if ((session_id <= 0) || (ue < 0) || (ue >= MAX_ISLE))
+		return 0;
+
+	islelock_lock(rcce_lock);
+	i = rcce_find_session(session_id);
+	if (i >= 0) {
+		paddr = rcce_mpb[i].win[ue];
+		len = rcce_mpb[i].win_size[ue];
+	}
+	islelock_unlock(rcce_lock);
+
+	if ((i < 0) || !paddr) {
+		LOG_ERROR("Didn't find a RMA window for session %d, isle %d\n", session_id, ue);
+		return 0;
+	}
+
+	vaddr = rcce_win_vmap(paddr, len);
+	if (BUILTIN_EXPECT(!vaddr, 0))
+		return 0;
+
+	LOG_INFO("Map RMA window of session %d at 0x%zx, isle %d\n", session_id, vaddr, ue);
+
+	if (size)
+		*size = len;
+
+	return vaddr;
+}
+
+/*
+ * Unmap the window of isle ue. The own window is released, thus all other
+ * isles have to unmap their view before.
+ */
+int sys_rcce_win_free(int session_id, int ue, size_t vaddr)
+{
+	size_t size;
+	int i, ret = 0;
+
+	if (is_single_kernel())
+		return -ENOSYS;
+
+	if ((session_id <= 0) || (ue < 0) || (ue >= MAX_ISLE) || !vaddr)
+		return -EINVAL;
+
+	islelock_lock(rcce_lock);
+
+	i = rcce_find_session(session_id);
+	if ((i < 0) || !rcce_mpb[i].win[ue]) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	size = rcce_mpb[i].win_size[ue];
+	page_unmap(vaddr, size / PAGE_SIZE);
+	vma_free(vaddr, vaddr + size);
+
+	if (ue == isle) {
+		if (is_hbmem_available())
+			hbmem_put_pages(rcce_mpb[i].win[isle], size / PAGE_SIZE);
+		else
+			put_pages(rcce_mpb[i].win[isle], size / PAGE_SIZE);
+		rcce_mpb[i].win[isle] = 0;
+		rcce_mpb[i].win_size[isle] = 0;
+	}
+
+out:
+	islelock_unlock(rcce_lock);
+
+	return ret;
+}
+
 size_t sys_get_ticks(void)
 {
 	return get_clock_tick();
@@ -796,6 +2903,7 @@ int sys_stat(const char* file, /*struct stat *st*/ void* st)
 
 void sys_yield(void)
 {
+	SYSSTAT_ENTER(SYSSTAT_YIELD);
 #if 0
 	check_workqueues();
 #else
@@ -841,3 +2949,116 @@ void __sys_env_unlock(void)
 {
 	spinlock_irqsave_unlock(&env_lock);
 }
+
+int sys_romfs_lookup(const char* name, const void** data, size_t* size)
+{
+	return romfs_lookup(name, data, size);
+}
+
+int sys_unlink(const char* name)
+{
+	if (BUILTIN_EXPECT(!name, 0))
+		return -EINVAL;
+
+	if (tmpfs_path(name))
+		return tmpfs_unlink(name);
+
+	if (blkfs_path(name))
+		return blkfs_unlink(name);
+
+	if (virtiofs_path(name))
+		return virtiofs_unlink(name);
+
+	// the host interfaces don't forward unlink()
+	return -ENOSYS;
+}
+
+int sys_fsync(int fd)
+{
+	if (fd & BLKFS_FD_BIT)
+		return blkfs_fsync(fd);
+
+	if (fd & VIRTIOFS_FD_BIT)
+		return virtiofs_fsync(fd);
+
+	// scratch files and the image have nothing to write back
+	if (fd & (TMPFS_FD_BIT|ROMFS_FD_BIT))
+		return 0;
+
+	// the host interfaces don't forward fsync()
+	return -ENOSYS;
+}
+
+int sys_blkfs_map(int fd, off_t offset, uint64_t* sector, size_t* len)
+{
+	return blkfs_map(fd, offset, sector, len);
+}
+
+int sys_blk_info(blk_info_t* info)
+{
+	return blk_info(info);
+}
+
+int sys_blk_submit(blk_request_t* req, uint16_t queue)
+{
+	return blk_submit(req, queue);
+}
+
+int sys_blk_poll(uint16_t queue, uint32_t budget)
+{
+	return blk_poll(queue, budget);
+}
+
+int sys_blk_wait(blk_request_t* req)
+{
+	return blk_wait(req);
+}
+
+ssize_t sys_blk_read(uint64_t sector, void* buf, size_t len)
+{
+	return blk_read(sector, buf, len);
+}
+
+ssize_t sys_blk_write(uint64_t sector, const void* buf, size_t len)
+{
+	return blk_write(sector, buf, len);
+}
+
+int sys_blk_flush(void)
+{
+	return blk_flush();
+}
+
+long sys_nosys(void)
+{
+	return -ENOSYS;
+}
+
+const void* const sys_call_table[__NR_MAX] = {
+	[0 ... __NR_MAX-1] = sys_nosys,
+	[__NR_exit] = sys_exit,
+	[__NR_write] = sys_write,
+	[__NR_open] = sys_open,
+	[__NR_close] = sys_close,
+	[__NR_unlink] = sys_unlink,
+	[__NR_read] = sys_read,
+	[__NR_lseek] = sys_lseek,
+	[__NR_getpid] = sys_getpid,
+	[__NR_kill] = sys_kill,
+	[__NR_sbrk] = sys_sbrk,
+	[__NR_stat] = sys_stat,
+	[__NR_msleep] = sys_msleep,
+	[__NR_yield] = sys_yield,
+	[__NR_sem_init] = sys_sem_init,
+	[__NR_sem_destroy] = sys_sem_destroy,
+	[__NR_sem_wait] = sys_sem_wait,
+	[__NR_sem_post] = sys_sem_post,
+	[__NR_sem_timedwait] = sys_sem_timedwait,
+	[__NR_getprio] = sys_getprio,
+	[__NR_setprio] = sys_setprio,
+	[__NR_clone] = sys_clone,
+	[__NR_sem_cancelablewait] = sys_sem_cancelablewait,
+	[__NR_get_ticks] = sys_get_ticks,
+	[__NR_pread] = sys_pread,
+	[__NR_pwrite] = sys_pwrite,
+};
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file kernel/sysstat.c
+ * @brief Call counters and latency histograms of the system calls
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/sysstat.h>
+#include <hermit/histogram.h>
+#include <hermit/vclock.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/irqflags.h>
+
+#ifdef SYSSTAT
+
+static const char* const sysstat_names[SYSSTAT_MAX] = {
+	[SYSSTAT_READ] = "read",
+	[SYSSTAT_WRITE] = "write",
+	[SYSSTAT_READV] = "readv",
+	[SYSSTAT_WRITEV] = "writev",
+	[SYSSTAT_PREAD] = "pread",
+	[SYSSTAT_PWRITE] = "pwrite",
+	[SYSSTAT_PREADV] = "preadv",
+	[SYSSTAT_PWRITEV] = "pwritev",
+	[SYSSTAT_OPEN] = "open",
+	[SYSSTAT_CLOSE] = "close",
+	[SYSSTAT_LSEEK] = "lseek",
+	[SYSSTAT_SENDFILE] = "sendfile",
+	[SYSSTAT_SBRK] = "sbrk",
+	[SYSSTAT_MMAP] = "mmap",
+	[SYSSTAT_MUNMAP] = "munmap",
+	[SYSSTAT_SEM_WAIT] = "sem_wait",
+	[SYSSTAT_SEM_TIMEDWAIT] = "sem_timedwait",
+	[SYSSTAT_SEM_POST] = "sem_post",
+	[SYSSTAT_FUTEX] = "futex",
+	[SYSSTAT_SPIN_WAIT] = "spin_wait",
+	[SYSSTAT_BARRIER_WAIT] = "barrier_wait",
+	[SYSSTAT_MSLEEP] = "msleep",
+	[SYSSTAT_NANOSLEEP] = "nanosleep",
+	[SYSSTAT_YIELD] = "yield",
+	[SYSSTAT_CLONE] = "clone",
+	[SYSSTAT_EPOLL_WAIT] = "epoll_wait",
+};
+
+/// latencies in ns of each system call
+static hist_t sysstat_hists[SYSSTAT_MAX];
+
+/// the ports of uhyve lie between 0x400 and 0xBFF and are 16 bytes apart at least
+#define HCSTAT_BASE		UHYVE_PORT_WRITE
+#define HCSTAT_SHIFT		4
+#define HCSTAT_SLOTS		128
+
+typedef struct hcstat_slot {
+	uint64_t calls;
+	uint64_t cycles;
+	uint64_t max_cycles;
+} __attribute__ ((aligned (CACHE_LINE))) hcstat_slot_t;
+
+/// every hypercall leaves the guest, an atomic add per call doesn't matter
+static hcstat_slot_t hcstat_slots[HCSTAT_SLOTS];
+
+static const struct {
+	uint32_t port;
+	const char* name;
+} hcstat_names[] = {
+	{UHYVE_PORT_WRITE, "write"},
+	{UHYVE_PORT_OPEN, "open"},
+	{UHYVE_PORT_CLOSE, "close"},
+	{UHYVE_PORT_READ, "read"},
+	{UHYVE_PORT_EXIT, "exit"},
+	{UHYVE_PORT_LSEEK, "lseek"},
+	{UHYVE_PORT_PFAULT, "pfault"},
+	{UHYVE_PORT_NETINFO, "netinfo"},
+	{UHYVE_PORT_NETWRITE, "netwrite"},
+	{UHYVE_PORT_NETREAD, "netread"},
+	{UHYVE_PORT_NETWRITEV, "netwritev"},
+	{UHYVE_PORT_NETSTAT, "netstat"},
+	{UHYVE_PORT_FREELIST, "freelist"},
+	{UHYVE_PORT_CMDSIZE, "cmdsize"},
+	{UHYVE_PORT_CMDVAL, "cmdval"},
+	{UHYVE_PORT_LOCKSTAT, "lockstat"},
+	{UHYVE_PORT_PFSTAT, "pfstat"},
+	{UHYVE_PORT_DISCARD, "discard"},
+	{UHYVE_PORT_DIRTY, "dirty"},
+	{UHYVE_PORT_READV, "readv"},
+	{UHYVE_PORT_WRITEV, "writev"},
+	{UHYVE_PORT_IORING, "ioring"},
+	{UHYVE_PORT_MMAP, "mmap"},
+	{UHYVE_PORT_PREAD, "pread"},
+	{UHYVE_PORT_PWRITE, "pwrite"},
+	{UHYVE_PORT_PREADV, "preadv"},
+	{UHYVE_PORT_PWRITEV, "pwritev"},
+	{UHYVE_PORT_KLOG, "klog"},
+	{UHYVE_PORT_SNAPSHOT, "snapshot"},
+	{UHYVE_PORT_MEMHOTADD, "memhotadd"},
+};
+
+int sysstat_init(void)
+{
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < SYSSTAT_MAX; i++) {
+		ret = hist_init(sysstat_hists + i, sysstat_names[i]);
+		if (BUILTIN_EXPECT(ret, 0))
+			return ret;
+	}
+
+	return 0;
+}
+
+void sysstat_account(uint32_t nr, uint64_t start)
+{
+	const uint64_t end = vclock_read();
+	const vclock_t* vc = vclock_page;
+	uint64_t ns;
+
+	if (BUILTIN_EXPECT(!vc || (nr >= SYSSTAT_MAX), 0))
+		return;
+
+	ns = (uint64_t) (((unsigned __int128) (end - start) * vc->mult) >> vc->shift);
+	hist_record(sysstat_hists + nr, ns);
+}
+
+/// merge the statistics of nr of all cores
+static void sysstat_merge(uint32_t nr, sysstat_t* stat, hist_data_t* data)
+{
+	uint32_t k;
+
+	hist_merge(sysstat_hists + nr, data);
+
+	memset(stat, 0x00, sizeof(sysstat_t));
+	strncpy(stat->name, sysstat_names[nr], sizeof(stat->name)-1);
+	stat->calls = data->count;
+	stat->total_ns = data->sum;
+	stat->max_ns = data->max;
+
+	// each bucket of the histogram lies within one log2 bin
+	for (k = 0; k < HIST_BUCKETS; k++) {
+		uint64_t low = hist_bucket_low(k);
+		uint32_t bin = low ? 63 - __builtin_clzll(low) : 0;
+
+		if (bin >= SYSSTAT_HIST_BINS)
+			bin = SYSSTAT_HIST_BINS - 1;
+		stat->hist[bin] += data->buckets[k];
+	}
+}
+
+int sysstat_get(sysstat_t* buf, size_t n)
+{
+	hist_data_t* data;
+	uint32_t i;
+
+	if (n > SYSSTAT_MAX)
+		n = SYSSTAT_MAX;
+
+	data = kmalloc(sizeof(hist_data_t));
+	if (BUILTIN_EXPECT(!data, 0))
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++)
+		sysstat_merge(i, buf + i, data);
+
+	kfree(data);
+
+	return n;
+}
+
+void hcstat_account(uint32_t port, uint64_t cycles)
+{
+	hcstat_slot_t* slot;
+	uint64_t max;
+
+	if (BUILTIN_EXPECT((port < HCSTAT_BASE) || (((port - HCSTAT_BASE) >> HCSTAT_SHIFT) >= HCSTAT_SLOTS), 0))
+		return;
+
+	slot = hcstat_slots + ((port - HCSTAT_BASE) >> HCSTAT_SHIFT);
+	__atomic_fetch_add(&slot->calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&slot->cycles, cycles, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&slot->max_cycles, __ATOMIC_RELAXED);
+	while ((cycles > max) && !__atomic_compare_exchange_n(&slot->max_cycles,
+		&max, cycles, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/// copy the statistics of a slot, returns 0 if the slot has no calls
+static int hcstat_fill(uint32_t i, hcstat_t* stat)
+{
+	hcstat_slot_t* slot = hcstat_slots + i;
+	uint32_t port = HCSTAT_BASE + (i << HCSTAT_SHIFT);
+	uint32_t k;
+
+	if (!slot->calls)
+		return 0;
+
+	memset(stat, 0x00, sizeof(hcstat_t));
+	stat->calls = slot->calls;
+	stat->cycles = slot->cycles;
+	stat->max_cycles = slot->max_cycles;
+
+	// a slot covers 16 ports, e.g. read and pfault (0x500, 0x511)
+	stat->port = port;
+	ksnprintf(stat->name, sizeof(stat->name), "0x%x", port);
+	for (k = 0; k < sizeof(hcstat_names) / sizeof(hcstat_names[0]); k++) {
+		if ((hcstat_names[k].port >> HCSTAT_SHIFT) == (port >> HCSTAT_SHIFT)) {
+			stat->port = hcstat_names[k].port;
+			strncpy(stat->name, hcstat_names[k].name, sizeof(stat->name)-1);
+			break;
+		}
+	}
+
+	return 1;
+}
+
+int hcstat_get(hcstat_t* buf, size_t n)
+{
+	uint32_t i;
+	size_t count = 0;
+
+	for (i = 0; (i < HCSTAT_SLOTS) && (count < n); i++)
+		count += hcstat_fill(i, buf + count);
+
+	return count;
+}
+
+void sysstat_dump(void)
+{
+	hist_data_t* data;
+	sysstat_t stat;
+	uint32_t i, k;
+
+	// too large for the stack
+	data = kmalloc(sizeof(hist_data_t));
+	if (BUILTIN_EXPECT(!data, 0))
+		return;
+
+	for (i = 0; i < SYSSTAT_MAX; i++) {
+		sysstat_merge(i, &stat, data);
+		if (!stat.calls)
+			continue;
+
+		LOG_INFO("syscall %s: %llu calls, %llu ns total, %llu ns avg, %llu ns max\n",
+			stat.name, stat.calls, stat.total_ns, stat.total_ns / stat.calls, stat.max_ns);
+		LOG_INFO("syscall %s: p50 %llu ns, p99 %llu ns, p99.9 %llu ns\n", stat.name,
+			hist_percentile(data, 500000), hist_percentile(data, 990000),
+			hist_percentile(data, 999000));
+
+		// same layout as hist_print_log2() in usr/benchmarks
+		kprintf("Histogram (%u bins with log2 ns each)\n", SYSSTAT_HIST_BINS);
+		for (k = 0; k < SYSSTAT_HIST_BINS; k++) {
+			if (!stat.hist[k])
+				continue;
+
+			kprintf("     %5u : %5llu..%5llu : %-10llu\n", k,
+				k ? 1ULL << k : 0ULL, (2ULL << k) - 1, stat.hist[k]);
+		}
+	}
+
+	kfree(data);
+
+	for (i = 0; i < HCSTAT_SLOTS; i++) {
+		hcstat_t hc;
+
+		if (!hcstat_fill(i, &hc))
+			continue;
+
+		LOG_INFO("hypercall %s (0x%x): %llu calls, %llu cycles total, %llu cycles avg, %llu cycles max\n",
+			hc.name, hc.port, hc.calls, hc.cycles, hc.cycles / hc.calls, hc.max_cycles);
+	}
+}
+
+void sysstat_reset(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < SYSSTAT_MAX; i++)
+		hist_reset(sysstat_hists + i);
+
+	memset(hcstat_slots, 0x00, sizeof(hcstat_slots));
+}
+
+#endif
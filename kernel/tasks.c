@@ -37,778 +37,2773 @@
 #include <hermit/syscall.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/fiber.h>
+#include <hermit/pmu.h>
 #include <asm/processor.h>
+#include <asm/irq.h>
 
 /*
  * Note that linker symbols are not variables, they have no memory allocated for
  * maintaining a value, rather their address is their value.
  */
 extern atomic_int32_t cpu_online;
+extern atomic_int32_t possible_cpus;
+extern uint32_t boot_processor;
 
 volatile uint32_t go_down = 0;
 
-/** @brief Array of task structures (aka PCB)
+/// number of task structures, which are statically allocated (at least the idle tasks)
+#define NR_STATIC_TASKS		(MAX_TASKS < 2*MAX_CORES+2 ? MAX_TASKS : 2*MAX_CORES+2)
+/// number of task structures, which are allocated at once beyond the static ones
+#define TASK_CHUNK_SIZE		32
+/// number of chunks to cover all task ids
+#define NR_TASK_CHUNKS		((MAX_TASKS - NR_STATIC_TASKS + TASK_CHUNK_SIZE - 1) / TASK_CHUNK_SIZE)
+/// maximal number of free task structures, which are cached per core
+#define MAX_CACHED_TASKS	8
+
+/** @brief FPU states of the static task structures
  *
- * A task's id will be its position in this array.
+ * The FPU state spans many cache lines and is only used by the FPU
+ * switch. Therefore, it is kept out of the task structure, whose fpu
+ * points to the state. The pointer is set, when the task id is used
+ * the first time, and remains valid afterwards.
  */
-static task_t task_table[MAX_TASKS] = { \
-        [0]                 = {0, TASK_IDLE, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}, \
-        [1 ... MAX_TASKS-1] = {0, TASK_INVALID, 0, NULL, NULL, NULL, TASK_DEFAULT_FLAGS, 0, 0, 0, 0, NULL, 0, NULL, NULL, 0, 0, 0, NULL, FPU_STATE_INIT}};
+static union fpu_state fpu_table[NR_STATIC_TASKS] __attribute__ ((aligned (CACHE_LINE)));
 
-static spinlock_irqsave_t table_lock = SPINLOCK_IRQSAVE_INIT;
+/** @brief Array of task structures (aka PCB)
+ *
+ * A task's id will be its position in this array. Task ids beyond
+ * NR_STATIC_TASKS are located in chunks, which are allocated on demand.
+ */
+static task_t task_table[NR_STATIC_TASKS] = { \
+        [0]                 = {.status = TASK_IDLE, .flags = TASK_DEFAULT_FLAGS, .fpu = fpu_table, .affinity = {[0 ... AFFINITY_WORDS-1] = (uint64_t) -1}}, \
+        [1 ... NR_STATIC_TASKS-1] = {.status = TASK_INVALID, .flags = TASK_DEFAULT_FLAGS, .affinity = {[0 ... AFFINITY_WORDS-1] = (uint64_t) -1}}};
 
-#if MAX_CORES > 1
-static readyqueues_t readyqueues[MAX_CORES] = { \
-		[0 ... MAX_CORES-1]   = {NULL, NULL, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {NULL, NULL}, SPINLOCK_IRQSAVE_INIT}};
-#else
-static readyqueues_t readyqueues[1] = {[0] = {task_table+0, NULL, 0, 0, 0, {[0 ... MAX_PRIO-2] = {NULL, NULL}}, {NULL, NULL}, SPINLOCK_IRQSAVE_INIT}};
+#if NR_TASK_CHUNKS > 0
+/// dynamically allocated task structures, protected by table_lock
+static task_t* task_chunks[NR_TASK_CHUNKS] = {[0 ... NR_TASK_CHUNKS-1] = NULL};
 #endif
 
-DEFINE_PER_CORE(task_t*, current_task, task_table+0);
+/// list of released task structures (linked by next), protected by table_lock
+static task_t* free_tasks = NULL;
 
-#if MAX_CORES > 1
-DEFINE_PER_CORE(uint32_t, __core_id, 0);
-#endif
+/// task ids beyond this value have never been used, protected by table_lock
+static tid_t nr_used_ids = 1;
 
-static void update_timer(task_t* first)
-{
-	if (first) {
-		if(first->timeout > get_clock_tick()) {
-			timer_deadline((uint32_t) (first->timeout - get_clock_tick()));
-		} else {
-			// workaround: start timer so new head will be serviced
-			timer_deadline(1);
-		}
-	} else {
-		// prevent spurious interrupts
-		timer_disable();
-	}
-}
+/// per core cache of released task structures, used only by its own core
+static struct {
+	task_t*		first;
+	uint32_t	nr;
+} free_cache[MAX_CORES] = {[0 ... MAX_CORES-1] = {NULL, 0}};
 
+static mcs_spinlock_irqsave_t table_lock = MCS_SPINLOCK_IRQSAVE_INIT;
 
-static void timer_queue_remove(uint32_t core_id, task_t* task)
+/** @brief Get the task structure of a task id
+ *
+ * @return Pointer to the task structure or NULL, if the id was never in use
+ */
+static inline task_t* task_by_id(tid_t id)
 {
-	if(BUILTIN_EXPECT(!task, 0)) {
-		return;
-	}
+	if (BUILTIN_EXPECT(id >= MAX_TASKS, 0))
+		return NULL;
 
-	task_list_t* timer_queue = &readyqueues[core_id].timers;
+#if NR_TASK_CHUNKS > 0
+	if (id >= NR_STATIC_TASKS) {
+		task_t* chunk;
 
-#ifdef DYNAMIC_TICKS
-	// if task is first in timer queue, we need to update the oneshot
-	// timer for the next task
-	if(timer_queue->first == task) {
-		update_timer(task->next);
+		id -= NR_STATIC_TASKS;
+		chunk = task_chunks[id / TASK_CHUNK_SIZE];
+
+		return chunk ? chunk + (id % TASK_CHUNK_SIZE) : NULL;
 	}
 #endif
 
-	task_list_remove_task(timer_queue, task);
+	return task_table+id;
 }
 
-
-static void timer_queue_push(uint32_t core_id, task_t* task)
+#if NR_TASK_CHUNKS > 0
+/** @brief Allocate the chunk of task structures for the task id
+ *
+ * Has to be called without holding table_lock, because kmalloc()
+ * could map new pages.
+ */
+static int task_chunk_alloc(tid_t id)
 {
-	task_list_t* timer_queue = &readyqueues[core_id].timers;
+	const uint32_t chunk = (id - NR_STATIC_TASKS) / TASK_CHUNK_SIZE;
+	union fpu_state* fpus;
+	task_t* tasks;
+	void* mem;
+	uint32_t i;
 
-	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	// the chunks are never released => align them without keeping the original address
+	mem = kmalloc(TASK_CHUNK_SIZE * (sizeof(task_t) + sizeof(union fpu_state)) + CACHE_LINE);
+	if (BUILTIN_EXPECT(!mem, 0))
+		return -ENOMEM;
+
+	// the FPU states follow the task structures, whose size is a multiple of CACHE_LINE
+	tasks = (task_t*) (((size_t) mem + CACHE_LINE - 1) & ~((size_t) CACHE_LINE - 1));
+	fpus = (union fpu_state*) (tasks + TASK_CHUNK_SIZE);
+	memset(tasks, 0x00, TASK_CHUNK_SIZE * (sizeof(task_t) + sizeof(union fpu_state)));
+	for(i=0; i<TASK_CHUNK_SIZE; i++) {
+		tasks[i].id = NR_STATIC_TASKS + chunk * TASK_CHUNK_SIZE + i;
+		tasks[i].status = TASK_INVALID;
+		tasks[i].flags = TASK_DEFAULT_FLAGS;
+		tasks[i].fpu = fpus + i;
+	}
 
-	task_t* first = timer_queue->first;
+	mcs_spinlock_irqsave_lock(&table_lock);
+	if (!task_chunks[chunk]) {
+		task_chunks[chunk] = tasks;
+		mem = NULL;
+	}
+	mcs_spinlock_irqsave_unlock(&table_lock);
 
-	if(!first) {
-		timer_queue->first = timer_queue->last = task;
-		task->next = task->prev = NULL;
+	// another core was faster
+	if (mem)
+		kfree(mem);
 
-#ifdef DYNAMIC_TICKS
-		update_timer(task);
+	return 0;
+}
 #endif
-	} else {
-		// lookup position where to insert task
-		task_t* tmp = first;
-		while(tmp && (task->timeout >= tmp->timeout))
-			tmp = tmp->next;
-
-		if(!tmp) {
-			// insert at the end of queue
-			task->next = NULL;
-			task->prev = timer_queue->last;
-
-			// there has to be a last element because there is also a first one
-			timer_queue->last->next = task;
-			timer_queue->last = task;
-		} else {
-			task->next = tmp;
-			task->prev = tmp->prev;
-			tmp->prev = task;
 
-			if(task->prev)
-				task->prev->next = task;
+/** @brief Get an unused task structure
+ *
+ * At first, the cache of the current core is used. Afterwards, released
+ * tasks and finally never used task ids are taken.
+ *
+ * @return Pointer to the task structure or NULL, if all task ids are in use
+ */
+static task_t* task_alloc(void)
+{
+	task_t* task = NULL;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+	if ((task = free_cache[CORE_ID].first) != NULL) {
+		free_cache[CORE_ID].first = task->next;
+		free_cache[CORE_ID].nr--;
+	}
+	irq_nested_enable(flags);
 
-			if(timer_queue->first == tmp) {
-				timer_queue->first = task;
+	while(!task) {
+		tid_t id = MAX_TASKS;
 
-#ifdef DYNAMIC_TICKS
-				update_timer(task);
+		mcs_spinlock_irqsave_lock(&table_lock);
+		if ((task = free_tasks) != NULL) {
+			free_tasks = task->next;
+		} else if (nr_used_ids < MAX_TASKS) {
+			id = nr_used_ids;
+#if NR_TASK_CHUNKS > 0
+			if ((id < NR_STATIC_TASKS) || task_chunks[(id - NR_STATIC_TASKS) / TASK_CHUNK_SIZE])
 #endif
+			{
+				task = task_by_id(id);
+				task->id = id;
+				if (id < NR_STATIC_TASKS)
+					task->fpu = fpu_table + id;
+				nr_used_ids++;
 			}
 		}
+		mcs_spinlock_irqsave_unlock(&table_lock);
+
+		// all task ids are in use
+		if (!task && (id >= MAX_TASKS))
+			return NULL;
+
+#if NR_TASK_CHUNKS > 0
+		if (!task && task_chunk_alloc(id))
+			return NULL;
+#endif
 	}
 
-	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
-}
+	task->next = task->prev = NULL;
+#ifdef KERNEL_TRACE
+	// the previous owner of the id may have left open calls
+	task->ktrace.depth = 0;
+#endif
 
+	return task;
+}
 
-static inline void readyqueues_push_back(uint32_t core_id, task_t* task)
+/** @brief Release a task structure, whose status is TASK_INVALID
+ *
+ * @param task Pointer to the task structure
+ * @param cache 1, if the structure could be kept in the cache of the current core
+ * @return 0, if the task structure has to be passed to task_release() again
+ * without the cache
+ */
+static int task_release(task_t* task, int cache)
 {
-	// idle task (prio=0) doesn't have a queue
-	task_list_t* readyqueue = &readyqueues[core_id].queue[task->prio - 1];
+	uint8_t flags;
 
-	task_list_push_back(readyqueue, task);
+	if (cache) {
+		int ret = 0;
 
-	// update priority bitmap
-	readyqueues[core_id].prio_bitmap |= (1 << task->prio);
+		flags = irq_nested_disable();
+		if (free_cache[CORE_ID].nr < MAX_CACHED_TASKS) {
+			task->next = free_cache[CORE_ID].first;
+			free_cache[CORE_ID].first = task;
+			free_cache[CORE_ID].nr++;
+			ret = 1;
+		}
+		irq_nested_enable(flags);
+
+		return ret;
+	}
+
+	mcs_spinlock_irqsave_lock(&table_lock);
+	task->next = free_tasks;
+	free_tasks = task;
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	return 1;
 }
 
+/** @brief Number of cores, for which the per-core structures of the scheduler exist
+ *
+ * The readyqueues, the statistics and the timers of the cores are
+ * allocated by sched_init() for the detected cores instead of MAX_CORES.
+ * Core ids are below possible_cpus.
+ */
+static uint32_t nr_core_slots = 0;
 
-static inline void readyqueues_remove(uint32_t core_id, task_t* task)
-{
-	// idle task (prio=0) doesn't have a queue
-	task_list_t* readyqueue = &readyqueues[core_id].queue[task->prio - 1];
+static readyqueues_t* readyqueues = NULL;
 
-	task_list_remove_task(readyqueue, task);
+/** @brief Minimal number of tasks on a core before an idle core steals one
+ *
+ * A value of 0 disables work stealing.
+ */
+static uint32_t steal_threshold = STEAL_THRESHOLD;
 
-	// no valid task in queue => update priority bitmap
-	if (readyqueue->first == NULL)
-		readyqueues[core_id].prio_bitmap &= ~(1 << task->prio);
-}
+/// placement policy, which is used by default for new threads
+static int placement_policy = PLACEMENT_ROUND_ROBIN;
 
+/// switch the FPU state eagerly during a context switch
+static int eager_fpu = 0;
 
-void fpu_handler(void)
-{
-	task_t* task = per_core(current_task);
-	uint32_t core_id = CORE_ID;
+/// time slice of each priority in microseconds (0 = no slice)
+static uint32_t prio_timeslice[MAX_PRIO] = {[0 ... MAX_PRIO-1] = TIMESLICE_US};
 
-	task->flags |= TASK_FPU_USED;
+/** @brief Scheduler statistics of each core
+ *
+ * The statistics are protected by the lock of the corresponding readyqueue.
+ */
+static core_stats_t* core_stats = NULL;
 
-	if (!(task->flags & TASK_FPU_INIT))  {
-		// use the FPU at the first time => Initialize FPU
-		fpu_init(&task->fpu);
-		task->flags |= TASK_FPU_INIT;
-	}
+DEFINE_PER_CORE(task_t*, current_task, task_table+0);
 
-	if (readyqueues[core_id].fpu_owner == task->id)
-		return;
+#if MAX_CORES > 1
+DEFINE_PER_CORE(uint32_t, __core_id, 0);
+#endif
 
-	spinlock_irqsave_lock(&readyqueues[core_id].lock);
-	// did another already use the the FPU? => save FPU state
-	if (readyqueues[core_id].fpu_owner) {
-		save_fpu_state(&(task_table[readyqueues[core_id].fpu_owner].fpu));
-		task_table[readyqueues[core_id].fpu_owner].flags &= ~TASK_FPU_USED;
-	}
-	readyqueues[core_id].fpu_owner = task->id;
-	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+static inline int core_allowed(const uint64_t* affinity, uint32_t core_id)
+{
+	return (affinity[core_id / 64] >> (core_id % 64)) & 1;
+}
+
+/// cores, which run only explicitly pinned threads (see core_is_isolated)
+static uint64_t isolated_cores[AFFINITY_WORDS] = {[0 ... AFFINITY_WORDS-1] = 0};
+static uint32_t nr_isolated = 0;
 
-	restore_fpu_state(&task->fpu);
+int core_is_isolated(uint32_t core_id)
+{
+	return (core_id < MAX_CORES) && core_allowed(isolated_cores, core_id);
 }
 
-int is_task_available(void)
+/// cores, which are parked by cpu_down() or -maxcpus= (see core_is_offline)
+static uint64_t offline_cores[AFFINITY_WORDS] = {[0 ... AFFINITY_WORDS-1] = 0};
+static uint32_t nr_offline = 0;
+/// serializes cpu_up() and cpu_down()
+static spinlock_t hotplug_lock = SPINLOCK_INIT;
+
+int core_is_offline(uint32_t core_id)
 {
-	uint32_t core_id = CORE_ID;
+	return (core_id < MAX_CORES) && core_allowed(offline_cores, core_id);
+}
 
-	return readyqueues[core_id].nr_tasks > 0 ? 1 : 0;
+/// is the core started and not parked?
+static inline int core_available(uint32_t core_id)
+{
+	return (core_id < nr_core_slots) && readyqueues[core_id].idle && !core_is_offline(core_id);
 }
 
-void check_scheduling(void)
+uint32_t housekeeping_cores(void)
 {
-	uint32_t prio = get_highest_priority();
-	task_t* curr_task = per_core(current_task);
+	uint32_t ncores = atomic_int32_read(&possible_cpus);
+	uint32_t i, n = 0;
 
-	if (prio > curr_task->prio) {
-		reschedule();
-#ifdef DYNAMIC_TICKS
-	} else if ((prio > 0) && (prio == curr_task->prio)) {
-		// if a task is ready, check if the current task runs already one tick (one time slice)
-		// => reschedule to realize round robin
+	if (ncores > MAX_CORES)
+		ncores = MAX_CORES;
+	if (!ncores)
+		ncores = 1;
 
-		const uint64_t diff_cycles = get_rdtsc() - curr_task->last_tsc;
-		const uint64_t cpu_freq_hz = 1000000ULL * (uint64_t) get_cpu_frequency();
+	if (!nr_offline) {
+		// the boot processor is never isolated
+		return (nr_isolated < ncores) ? ncores - nr_isolated : 1;
+	}
 
-		if (((diff_cycles * (uint64_t) TIMER_FREQ) / cpu_freq_hz) > 0) {
-			LOG_DEBUG("Time slice expired for task %d on core %d. New task has priority %u.\n", curr_task->id, CORE_ID, prio);
-			reschedule();
-		}
-#endif
+	for(i=0; i<ncores; i++) {
+		if (!core_is_isolated(i) && !core_is_offline(i))
+			n++;
 	}
-}
 
+	// the boot processor is neither isolated nor offline
+	return n ? n : 1;
+}
 
-uint32_t get_highest_priority(void)
+uint32_t housekeeping_core(uint32_t n)
 {
-	uint32_t prio = msb(readyqueues[CORE_ID].prio_bitmap);
+	uint32_t ncores = atomic_int32_read(&possible_cpus);
+	uint32_t i;
 
-	if (prio > MAX_PRIO)
-		return 0;
-	return prio;
-}
+	if (!nr_isolated && !nr_offline)
+		return n % (ncores ? ncores : 1);
 
+	n %= housekeeping_cores();
+	for(i=0; (i<ncores) && (i<nr_core_slots); i++) {
+		if (core_is_isolated(i) || core_is_offline(i))
+			continue;
+		if (!n--)
+			return i;
+	}
 
-void* get_readyqueue(void)
-{
-	return &readyqueues[CORE_ID];
+	return 0;
 }
 
-
-int multitasking_init(void)
+/** @brief Affinity, which is used to place a thread
+ *
+ * Isolated cores are only used, if the affinity contains no other
+ * available core.
+ */
+static const uint64_t* placement_affinity(const uint64_t* affinity, uint64_t* buf)
 {
-	uint32_t core_id = CORE_ID;
+	uint32_t i;
 
-	if (BUILTIN_EXPECT(task_table[0].status != TASK_IDLE, 0)) {
-		LOG_ERROR("Task 0 is not an idle task\n");
-		return -ENOMEM;
+	if (!nr_isolated)
+		return affinity;
+
+	for(i=0; i<AFFINITY_WORDS; i++)
+		buf[i] = affinity[i] & ~isolated_cores[i];
+
+	for(i=0; i<nr_core_slots; i++) {
+		if (core_available(i) && core_allowed(buf, i))
+			return buf;
 	}
 
-	task_table[0].prio = IDLE_PRIO;
-	task_table[0].stack = NULL; // will be initialized later
-	task_table[0].ist_addr = NULL; // will be initialized later
-	set_per_core(current_task, task_table+0);
+	return affinity;
+}
 
-	readyqueues[core_id].idle = task_table+0;
+/** @brief Timer wheel of each core
+ *
+ * A timer wheel is protected by the lock of the corresponding readyqueue.
+ */
+static timer_wheel_t* timer_wheels = NULL;
 
-	return 0;
+/// return value of timer_wheel_next(), if the wheel is empty
+#define TIMER_WHEEL_IDLE	((uint64_t) -1)
+
+/** @brief High-resolution timers of each core
+ *
+ * The tasks are sorted by their deadline (TSC value) and linked by
+ * next/prev. The list is protected by the lock of the corresponding
+ * readyqueue. Only deadlines within the next tick are queued here,
+ * all other ones are managed by the timer wheel.
+ */
+static task_list_t* hr_timers = NULL;
+
+/// number of TSC cycles per tick
+static inline uint64_t tsc_per_tick(void)
+{
+	return clocksource_tsc_hz() / TIMER_FREQ;
 }
 
-int set_boot_stack(tid_t id, size_t stack, size_t ist_addr)
+static void hr_timer_insert(task_list_t* list, task_t* task)
 {
-	if (id < MAX_CORES) {
-		task_table[id].stack = (void*) stack;
-		task_table[id].ist_addr = (void*) ist_addr;
+	task_t* tmp = list->last;
+
+	// search backwards, later deadlines are more likely
+	while (tmp && (tmp->timeout > task->timeout))
+		tmp = tmp->prev;
+
+	task->prev = tmp;
+	task->next = tmp ? tmp->next : list->first;
+	if (task->next)
+		task->next->prev = task;
+	else
+		list->last = task;
+	if (tmp)
+		tmp->next = task;
+	else
+		list->first = task;
+}
+
+/** @brief Determine the TSC, at which the high-resolution timers have to be serviced
+ *
+ * A timer may expire between its timeout and timeout_max. The one-shot
+ * timer is programmed to the earliest timeout_max, all timers, whose
+ * timeout has passed until then, are serviced by the same interrupt.
+ *
+ * @return TSC of the next interrupt or 0, if the list is empty
+ */
+static uint64_t hr_timer_deadline(const task_list_t* list)
+{
+	const task_t* task = list->first;
+	uint64_t deadline;
 
+	if (!task)
 		return 0;
+
+	// the list is sorted by the timeouts => later timers can't reduce the deadline
+	deadline = task->timeout_max;
+	for(task = task->next; task && (task->timeout < deadline); task = task->next) {
+		if (task->timeout_max < deadline)
+			deadline = task->timeout_max;
 	}
 
-	return -EINVAL;
+	return deadline;
 }
 
-tid_t set_idle_task(void)
+static inline int timer_wheel_empty(timer_wheel_t* wheel)
 {
-	uint32_t core_id = CORE_ID;
-	tid_t id = ~0;
-
-	spinlock_irqsave_lock(&table_lock);
-
-	for(uint32_t i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = id = i;
-			task_table[i].status = TASK_IDLE;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = NULL;
-			task_table[i].ist_addr = NULL;
-			task_table[i].prio = IDLE_PRIO;
-			task_table[i].heap = NULL;
-			readyqueues[core_id].idle = task_table+i;
-			set_per_core(current_task, readyqueues[core_id].idle);
+	uint32_t level;
 
-			break;
-		}
+	for(level=0; level<TIMER_WHEEL_LEVELS; level++) {
+		if (wheel->bitmap[level])
+			return 0;
 	}
 
-	spinlock_irqsave_unlock(&table_lock);
-
-	return id;
+	return 1;
 }
 
-void finish_task_switch(void)
+static void timer_wheel_insert(timer_wheel_t* wheel, task_t* task)
 {
-	task_t* old;
-	const uint32_t core_id = CORE_ID;
+	const uint64_t range = 1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS);
+	uint64_t timeout = task->timeout;
+	uint32_t level = 0;
+	uint32_t idx;
+	task_t** slot;
+
+	if (timeout < wheel->clk) {
+		// deadline is already expired => service it with the current tick
+		timeout = wheel->clk;
+	} else {
+		// far deadlines are cascaded again, when the wheel reaches the slot
+		if (timeout - wheel->clk >= range)
+			timeout = wheel->clk + range - 1;
 
-	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+		while((level < TIMER_WHEEL_LEVELS-1) && (timeout - wheel->clk >= (1ULL << ((level+1) * TIMER_WHEEL_BITS))))
+			level++;
+	}
 
-	if ((old = readyqueues[core_id].old_task) != NULL) {
-		readyqueues[core_id].old_task = NULL;
+	idx = (timeout >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+	slot = &wheel->slots[level][idx];
 
-		if (old->status == TASK_FINISHED) {
-			/* cleanup task */
-			if (old->stack) {
-				//LOG_INFO("Release stack at 0x%zx\n", old->stack);
-				destroy_stack(old->stack, DEFAULT_STACK_SIZE);
-				old->stack = NULL;
-			}
+	task->prev = NULL;
+	task->next = *slot;
+	if (task->next)
+		task->next->prev = task;
+	*slot = task;
+	task->timer_slot = slot;
 
-			if (!old->parent && old->heap) {
-				kfree(old->heap);
-				old->heap = NULL;
-			}
+	wheel->bitmap[level] |= (1ULL << idx);
+}
 
-			if (old->ist_addr) {
-				destroy_stack(old->ist_addr, KERNEL_STACK_SIZE);
-				old->ist_addr = NULL;
-			}
+static void timer_wheel_remove(timer_wheel_t* wheel, task_t* task)
+{
+	task_t** slot = task->timer_slot;
 
-			old->last_stack_pointer = NULL;
+	if (task->next)
+		task->next->prev = task->prev;
+	if (task->prev)
+		task->prev->next = task->next;
+	else
+		*slot = task->next;
 
-			if (readyqueues[core_id].fpu_owner == old->id)
-				readyqueues[core_id].fpu_owner = 0;
+	if (!*slot) {
+		const size_t nr = slot - &wheel->slots[0][0];
 
-			/* signalizes that this task could be reused */
-			old->status = TASK_INVALID;
-		} else {
-			// re-enqueue old task
-			readyqueues_push_back(core_id, old);
-		}
+		wheel->bitmap[nr >> TIMER_WHEEL_BITS] &= ~(1ULL << (nr & TIMER_WHEEL_MASK));
 	}
 
-	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	task->next = task->prev = NULL;
+	task->timer_slot = NULL;
 }
 
-
-void NORETURN do_exit(int arg)
+/** @brief Determine the next tick, at which the wheel has to be serviced
+ *
+ * This is either the deadline of a task in the first level or the
+ * start of a used slot in the upper levels.
+ *
+ * @return Tick of the next event or TIMER_WHEEL_IDLE
+ */
+static uint64_t timer_wheel_next(timer_wheel_t* wheel)
 {
-	task_t* curr_task = per_core(current_task);
-	const uint32_t core_id = CORE_ID;
+	uint64_t next = TIMER_WHEEL_IDLE;
+	uint32_t level;
+
+	for(level=0; level<TIMER_WHEEL_LEVELS; level++) {
+		const uint32_t shift = level * TIMER_WHEEL_BITS;
+		const uint64_t base = wheel->clk >> shift;
+		const uint32_t idx = base & TIMER_WHEEL_MASK;
+		uint64_t bitmap = wheel->bitmap[level];
+		uint64_t tick, k;
+
+		if (!bitmap)
+			continue;
+
+		// rotate the bitmap => bit k represents the slot k steps ahead
+		if (idx)
+			bitmap = (bitmap >> idx) | (bitmap << (TIMER_WHEEL_SIZE - idx));
+
+		if (!level)
+			k = __builtin_ctzll(bitmap);
+		else if (bitmap & ~1ULL) // the current slot is already cascaded
+			k = __builtin_ctzll(bitmap & ~1ULL);
+		else
+			k = TIMER_WHEEL_SIZE;
+
+		tick = (base + k) << shift;
+		if (tick < next)
+			next = tick;
+	}
 
-	LOG_INFO("Terminate task: %u, return value %d\n", curr_task->id, arg);
+	return next;
+}
 
-	uint8_t flags = irq_nested_disable();
+/** @brief Move the wheel forward and cascade the slots, which start at this tick
+ *
+ * The caller has to guarantee that there is no event between the current
+ * position of the wheel and the new one (see timer_wheel_next()).
+ */
+static void timer_wheel_forward(timer_wheel_t* wheel, uint64_t tick)
+{
+	uint32_t level;
 
-	// decrease the number of active tasks
-	spinlock_irqsave_lock(&readyqueues[core_id].lock);
-	readyqueues[core_id].nr_tasks--;
-	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	wheel->clk = tick;
 
-	// release the thread local storage
-	destroy_tls();
+	for(level=1; level<TIMER_WHEEL_LEVELS; level++) {
+		const uint32_t shift = level * TIMER_WHEEL_BITS;
+		const uint32_t idx = (tick >> shift) & TIMER_WHEEL_MASK;
+		task_t* task;
 
-	curr_task->status = TASK_FINISHED;
+		if (tick & ((1ULL << shift) - 1))
+			break;
 
-	reschedule();
+		task = wheel->slots[level][idx];
+		wheel->slots[level][idx] = NULL;
+		wheel->bitmap[level] &= ~(1ULL << idx);
 
-	irq_nested_enable(flags);
+		while(task) {
+			task_t* next = task->next;
 
-	LOG_ERROR("Kernel panic: scheduler found no valid task\n");
-	while(1) {
-		HALT;
+			timer_wheel_insert(wheel, task);
+			task = next;
+		}
 	}
 }
 
+/** @brief Get a task, whose deadline is expired
+ *
+ * The task isn't removed from the wheel.
+ *
+ * @return Pointer to the task or NULL, if no deadline is expired
+ */
+static task_t* timer_wheel_expired(timer_wheel_t* wheel, uint64_t now)
+{
+	while(1) {
+		task_t* task = wheel->slots[0][wheel->clk & TIMER_WHEEL_MASK];
+		uint64_t next;
 
-void NORETURN leave_kernel_task(void) {
-	int result;
+		if (task)
+			return (wheel->clk <= now) ? task : NULL;
 
-	result = 0; //get_return_value();
-	do_exit(result);
+		if (wheel->clk >= now)
+			return NULL;
+
+		next = timer_wheel_next(wheel);
+		timer_wheel_forward(wheel, next < now ? next : now);
+	}
+}
+
+static void update_timer(uint32_t core_id)
+{
+	const uint64_t next = timer_wheel_next(&timer_wheels[core_id]);
+	const uint64_t dl_timer = readyqueues[core_id].dl_timer;
+	const uint64_t gang_timer = readyqueues[core_id].gang_timer;
+	const uint64_t slice_timer = readyqueues[core_id].slice_timer;
+	uint64_t hr_deadline = hr_timer_deadline(&hr_timers[core_id]);
+	uint64_t ticks = 0;
+
+	// the budget of the running EDF task is handled like a high-resolution timer
+	if (dl_timer && (!hr_deadline || (dl_timer < hr_deadline)))
+		hr_deadline = dl_timer;
+
+	// the end of a gang slot as well
+	if (gang_timer && (!hr_deadline || (gang_timer < hr_deadline)))
+		hr_deadline = gang_timer;
+
+	// and the end of a time slice
+	if (slice_timer && (!hr_deadline || (slice_timer < hr_deadline)))
+		hr_deadline = slice_timer;
+
+	if (next != TIMER_WHEEL_IDLE) {
+		if(next > get_clock_tick()) {
+			ticks = next - get_clock_tick();
+		} else {
+			// workaround: start timer so new head will be serviced
+			ticks = 1;
+		}
+	}
+
+	// does a high-resolution timer expire before the next tick of the wheel?
+	if (hr_deadline && (!ticks || (hr_deadline < get_rdtsc() + ticks * tsc_per_tick()))) {
+		timer_deadline_tsc(hr_deadline);
+	} else if (ticks) {
+		timer_deadline((uint32_t) ticks);
+	} else {
+		// prevent spurious interrupts
+		timer_disable();
+	}
+}
+
+
+static void timer_queue_remove(uint32_t core_id, task_t* task)
+{
+	if(BUILTIN_EXPECT(!task, 0)) {
+		return;
+	}
+
+	timer_wheel_t* wheel = &timer_wheels[core_id];
+
+#ifdef DYNAMIC_TICKS
+	const uint64_t next = timer_wheel_next(wheel);
+	const uint64_t hr = hr_timer_deadline(&hr_timers[core_id]);
+#endif
+
+	if (task->flags & TASK_HRTIMER) {
+		task->flags &= ~TASK_HRTIMER;
+		task_list_remove_task(&hr_timers[core_id], task);
+	} else {
+		timer_wheel_remove(wheel, task);
+	}
+
+#ifdef DYNAMIC_TICKS
+	// if the next event has changed, we need to update the oneshot
+	// timer, but only the local one is reachable
+	if ((core_id == CORE_ID) && ((next != timer_wheel_next(wheel)) || (hr != hr_timer_deadline(&hr_timers[core_id]))))
+		update_timer(core_id);
+#endif
+}
+
+
+static void timer_queue_push(uint32_t core_id, task_t* task)
+{
+	timer_wheel_t* wheel = &timer_wheels[core_id];
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	// an empty wheel could be moved to the current tick without cascading
+	if (timer_wheel_empty(wheel))
+		wheel->clk = get_clock_tick();
+
+#ifdef DYNAMIC_TICKS
+	const uint64_t next = timer_wheel_next(wheel);
+#endif
+
+	timer_wheel_insert(wheel, task);
+
+#ifdef DYNAMIC_TICKS
+	if (next != timer_wheel_next(wheel))
+		update_timer(core_id);
+#endif
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+}
+
+
+static void hr_timer_push(uint32_t core_id, task_t* task)
+{
+	uint64_t hr;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	hr = hr_timer_deadline(&hr_timers[core_id]);
+	hr_timer_insert(&hr_timers[core_id], task);
+
+	// the new timer has to expire before the programmed interrupt
+	if (hr != hr_timer_deadline(&hr_timers[core_id]))
+		update_timer(core_id);
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+}
+
+
+/// fixed point value of the EDF bandwidth, which represents a whole core
+#define DL_BW_UNIT	(1ULL << 20)
+/// EDF tasks must leave 5% of each core to the other tasks
+#define DL_BW_LIMIT	((DL_BW_UNIT * 95) / 100)
+
+static inline int is_dl_task(const task_t* task)
+{
+	return task->dl.runtime != 0;
+}
+
+/// length of the time slice of a task in TSC cycles (0 = no slice)
+static inline uint64_t timeslice_tsc(const task_t* task)
+{
+	const uint32_t us = task->timeslice ? task->timeslice : prio_timeslice[task->prio - 1];
+
+	return ns_to_tsc(1000ULL * (uint64_t) us);
+}
+
+/** @brief Determine the end of the time slice of the current task
+ *
+ * The slice is only enforced, while a task of the same priority waits.
+ * EDF tasks and gang members are preempted by their own timers. With
+ * periodic ticks, the timer interrupt checks the slice at each tick. Has
+ * to be called with the lock of the readyqueue.
+ */
+static void slice_update(uint32_t core_id)
+{
+	task_t* curr_task = readyqueues[core_id].curr_task;
+	uint64_t end = 0;
+
+#ifdef DYNAMIC_TICKS
+	if (curr_task && (curr_task->status == TASK_RUNNING) && !is_dl_task(curr_task) && !curr_task->gang
+	    && (curr_task->prio > 0) && (curr_task->prio <= MAX_PRIO)
+	    && readyqueues[core_id].queue[curr_task->prio-1].first) {
+		const uint64_t len = timeslice_tsc(curr_task);
+
+		if (len) {
+			const uint64_t now = get_rdtsc();
+
+			// an expired slice ends as soon as possible
+			end = curr_task->last_tsc + len;
+			if (end < now)
+				end = now;
+		}
+	}
+#endif
+
+	readyqueues[core_id].slice_timer = end;
+}
+
+static inline uint64_t dl_bw(uint64_t runtime, uint64_t period)
+{
+	return period ? (runtime * DL_BW_UNIT) / period : 0;
+}
+
+/** @brief Start a new job of an EDF task, which becomes ready
+ *
+ * CBS wakeup rule: the current job is kept only, if its remaining budget
+ * doesn't exceed the reserved bandwidth until its deadline.
+ */
+static void dl_task_wakeup(task_t* task)
+{
+	const uint64_t now = get_rdtsc();
+
+	if ((now >= task->dl.abs_deadline) ||
+	    ((__int128) task->dl.budget * task->dl.period > (__int128) (task->dl.abs_deadline - now) * task->dl.runtime)) {
+		task->dl.abs_deadline = now + task->dl.deadline;
+		task->dl.budget = task->dl.runtime;
+	}
+}
+
+/** @brief Throttle an EDF task, which has consumed its budget
+ *
+ * The task is blocked until the deadline of its current job, afterwards
+ * the timer wakes it up and the server replenishes the budget.
+ * Has to be called with the lock of the readyqueue.
+ */
+static void dl_task_throttle(uint32_t core_id, task_t* task)
+{
+	LOG_DEBUG("throttle EDF task %d on core %d\n", task->id, core_id);
+
+	task->status = TASK_BLOCKED;
+	readyqueues[core_id].nr_tasks--;
+
+	task->flags |= TASK_TIMER|TASK_HRTIMER;
+	task->timeout = task->timeout_max = task->dl.abs_deadline;
+	hr_timer_insert(&hr_timers[core_id], task);
+}
+
+static void dl_list_insert(task_list_t* list, task_t* task)
+{
+	task_t* tmp = list->last;
+
+	// search backwards, new jobs have usually the latest deadline
+	while (tmp && (tmp->dl.abs_deadline > task->dl.abs_deadline))
+		tmp = tmp->prev;
+
+	task->prev = tmp;
+	task->next = tmp ? tmp->next : list->first;
+	if (task->next)
+		task->next->prev = task;
+	else
+		list->last = task;
+	if (tmp)
+		tmp->next = task;
+	else
+		list->first = task;
+}
+
+
+/// length of a gang slot in ticks
+#define GANG_SLICE	1
+
+/// number of members of each gang (0 = unused), protected by gang_lock
+static uint32_t gang_members[MAX_GANGS] = {[0 ... MAX_GANGS-1] = 0};
+/// registered gangs in the order of their slots, protected by gang_lock
+static uint8_t gang_order[MAX_GANGS];
+static volatile uint32_t nr_gangs = 0;
+static spinlock_irqsave_t gang_lock = SPINLOCK_IRQSAVE_INIT;
+
+/** @brief Determine the gang member, which owns the current slot of a core
+ *
+ * The slots are derived from the TSC, so that the slot boundaries of all
+ * cores are aligned. The registered gangs and the remaining tasks own the
+ * slots in round robin order. Has to be called with the lock of the
+ * readyqueue.
+ *
+ * @return The member of the current gang on this core or NULL
+ */
+static task_t* gang_slot_member(uint32_t core_id)
+{
+	const uint64_t len = GANG_SLICE * tsc_per_tick();
+	const uint32_t n = nr_gangs;
+	const uint64_t slot = get_rdtsc() / len;
+
+	// all members preempt their tasks at the end of the slot
+	readyqueues[core_id].gang_timer = (slot + 1) * len;
+
+	if (slot % (n + 1) >= n)
+		return NULL; // slot of the remaining tasks
+
+	return readyqueues[core_id].gang[gang_order[slot % (n + 1)]];
+}
+
+/** @brief Remove a gang from the slot rotation
+ *
+ * Has to be called with gang_lock.
+ */
+static void gang_unregister(uint32_t gang)
+{
+	uint32_t i, j;
+
+	for(i=0, j=0; i<nr_gangs; i++) {
+		if (gang_order[i] != gang)
+			gang_order[j++] = gang_order[i];
+	}
+	nr_gangs = j;
+	gang_members[gang] = 0;
+}
+
+/** @brief Remove a task from its gang */
+static void gang_leave(task_t* task)
+{
+	const uint32_t gang = task->gang - 1;
+	const uint32_t core_id = task->last_core;
+
+	spinlock_irqsave_lock(&gang_lock);
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	if (readyqueues[core_id].gang[gang] == task) {
+		readyqueues[core_id].gang[gang] = NULL;
+		readyqueues[core_id].nr_gang--;
+		if (!readyqueues[core_id].nr_gang)
+			readyqueues[core_id].gang_timer = 0;
+	}
+	task->gang = 0;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	if (gang_members[gang] && !--gang_members[gang])
+		gang_unregister(gang);
+
+	spinlock_irqsave_unlock(&gang_lock);
+}
+
+
+static inline void readyqueues_push_back(uint32_t core_id, task_t* task)
+{
+	if (is_dl_task(task)) {
+		dl_list_insert(&readyqueues[core_id].edf, task);
+		return;
+	}
+
+	// idle task (prio=0) doesn't have a queue
+	task_list_t* readyqueue = &readyqueues[core_id].queue[task->prio - 1];
+
+	task_list_push_back(readyqueue, task);
+
+	// update priority bitmap
+	readyqueues[core_id].prio_bitmap |= (1 << task->prio);
+}
+
+
+static inline void readyqueues_remove(uint32_t core_id, task_t* task)
+{
+	if (is_dl_task(task)) {
+		task_list_remove_task(&readyqueues[core_id].edf, task);
+		return;
+	}
+
+	// idle task (prio=0) doesn't have a queue
+	task_list_t* readyqueue = &readyqueues[core_id].queue[task->prio - 1];
+
+	task_list_remove_task(readyqueue, task);
+
+	// no valid task in queue => update priority bitmap
+	if (readyqueue->first == NULL)
+		readyqueues[core_id].prio_bitmap &= ~(1 << task->prio);
+}
+
+static inline int readyqueues_contains(uint32_t core_id, task_t* task)
+{
+	task_t* tmp;
+
+	tmp = is_dl_task(task) ? readyqueues[core_id].edf.first : readyqueues[core_id].queue[task->prio - 1].first;
+	for(; tmp; tmp = tmp->next) {
+		if (tmp == task)
+			return 1;
+	}
+
+	return 0;
+}
+
+static uint32_t get_least_loaded_core_id(int near, const uint64_t* affinity);
+
+/** @brief Check if a ready task is allowed to migrate to another core
+ *
+ * The task must not run on its current core, its context has to
+ * be completely saved and its FPU state must not be live in the registers
+ * of its current core.
+ */
+static inline int is_stealable(uint32_t core_id, task_t* task)
+{
+	if (task->status != TASK_READY)
+		return 0;
+	if ((task == readyqueues[core_id].curr_task) || (task == readyqueues[core_id].prev_task))
+		return 0;
+	if (readyqueues[core_id].fpu_owner == task->id)
+		return 0;
+	// gang members are bound to their cores
+	if (task->gang)
+		return 0;
+
+	return 1;
+}
+
+/** @brief Enqueue a ready task on the least loaded core of its affinity
+ *
+ * The task must not be part of any readyqueue and the caller must not
+ * hold a lock of a readyqueue.
+ */
+static void readyqueues_migrate(task_t* task)
+{
+	uint64_t buf[AFFINITY_WORDS];
+	uint32_t core_id = get_least_loaded_core_id(0, placement_affinity(task->affinity, buf));
+
+	// no available core in the affinity => keep the last one
+	if (BUILTIN_EXPECT(core_id >= nr_core_slots, 0))
+		core_id = task->last_core;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	task->last_core = core_id;
+	task->stats.nr_migrations++;
+	core_stats[core_id].nr_migrations++;
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+
+	if (readyqueues[core_id].nr_tasks == 1)
+		wakeup_core(core_id);
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	LOG_DEBUG("Migrate task %d to core %d\n", task->id, core_id);
+}
+
+
+void fpu_handler(void)
+{
+	task_t* task = per_core(current_task);
+	uint32_t core_id = CORE_ID;
+
+	task->flags |= TASK_FPU_USED;
+
+	if (!(task->flags & TASK_FPU_INIT))  {
+		// use the FPU at the first time => Initialize FPU
+		fpu_init(task->fpu);
+		task->flags |= TASK_FPU_INIT;
+	}
+
+	if (readyqueues[core_id].fpu_owner == task->id)
+		return;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	// did another already use the the FPU? => save FPU state
+	if (readyqueues[core_id].fpu_owner) {
+		task_t* owner = task_by_id(readyqueues[core_id].fpu_owner);
+
+		save_fpu_state(owner->fpu);
+		owner->flags &= ~TASK_FPU_USED;
+	}
+	readyqueues[core_id].fpu_owner = task->id;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	restore_fpu_state(task->fpu);
+}
+
+int is_task_available(void)
+{
+	uint32_t core_id = CORE_ID;
+
+	return readyqueues[core_id].nr_tasks > 0 ? 1 : 0;
+}
+
+uint32_t get_ready_tasks(void)
+{
+	return readyqueues[CORE_ID].nr_tasks;
+}
+
+int spin_while_equal(const volatile uint32_t* addr, uint32_t val, uint64_t ns)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint64_t hz = clocksource_tsc_hz();
+	uint64_t start, cycles;
+
+	// one second of slack for the remainder, which ns_to_tsc() adds
+	if (hz && (ns / 1000000000ULL >= (uint64_t) -1 / hz - 1))
+		cycles = (uint64_t) -1;
+	else
+		cycles = ns_to_tsc(ns);
+	start = get_rdtsc();
+
+	while (__atomic_load_n(addr, __ATOMIC_ACQUIRE) == val) {
+		if (get_rdtsc() - start >= cycles)
+			return 0;
+
+		if (get_ready_tasks() && (get_highest_priority() >= curr_task->prio))
+			reschedule();
+		else
+			PAUSE;
+	}
+
+	return 1;
+}
+
+void check_scheduling(void)
+{
+	uint32_t prio = get_highest_priority();
+	task_t* curr_task = per_core(current_task);
+
+	if (prio > curr_task->prio) {
+		reschedule();
+#ifdef DYNAMIC_TICKS
+	} else if ((prio > 0) && (prio == curr_task->prio)) {
+		// if a task is ready, check if the current task has consumed its time slice
+		// (one tick, if the priority has no slice) => reschedule to realize round robin
+
+		const uint64_t diff_cycles = get_rdtsc() - curr_task->last_tsc;
+		uint64_t len = timeslice_tsc(curr_task);
+
+		if (!len)
+			len = tsc_per_tick();
+
+		if (diff_cycles >= len) {
+			LOG_DEBUG("Time slice expired for task %d on core %d. New task has priority %u.\n", curr_task->id, CORE_ID, prio);
+			reschedule();
+		}
+#endif
+	}
+}
+
+
+uint32_t get_highest_priority(void)
+{
+	// EDF tasks precede all priorities
+	if (readyqueues[CORE_ID].edf.first)
+		return MAX_PRIO + 1;
+
+	uint32_t prio = msb(readyqueues[CORE_ID].prio_bitmap);
+
+	if (prio > MAX_PRIO)
+		return 0;
+	return prio;
+}
+
+
+void* get_readyqueue(void)
+{
+	return &readyqueues[CORE_ID].nr_tasks;
+}
+
+
+int multitasking_init(void)
+{
+	uint32_t core_id = CORE_ID;
+
+	if (BUILTIN_EXPECT(task_table[0].status != TASK_IDLE, 0)) {
+		LOG_ERROR("Task 0 is not an idle task\n");
+		return -ENOMEM;
+	}
+
+	task_table[0].prio = IDLE_PRIO;
+	task_table[0].stack = NULL; // will be initialized later
+	task_table[0].ist_addr = NULL; // will be initialized later
+	task_table[0].stats_tsc = get_rdtsc();
+	task_table[0].last_core = core_id;
+	set_per_core(current_task, task_table+0);
+
+	return 0;
+}
+
+/** @brief Allocate the per-core structures of the scheduler
+ *
+ * Called by sched_init(), after the memory management is usable and before
+ * the application processors are started. The boot processor becomes the
+ * first user of its readyqueue.
+ */
+static int readyqueues_init(void)
+{
+	const uint32_t core_id = CORE_ID;
+	uint32_t i, n = atomic_int32_read(&possible_cpus);
+
+	if (n <= core_id)
+		n = core_id + 1;
+	if (n > MAX_CORES)
+		n = MAX_CORES;
+
+	readyqueues = palloc(n * sizeof(readyqueues_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	core_stats = kmalloc(n * sizeof(core_stats_t));
+	timer_wheels = kmalloc(n * sizeof(timer_wheel_t));
+	hr_timers = kmalloc(n * sizeof(task_list_t));
+	if (BUILTIN_EXPECT(!readyqueues || !core_stats || !timer_wheels || !hr_timers, 0)) {
+		LOG_ERROR("Unable to allocate the readyqueues of %u cores\n", n);
+		return -ENOMEM;
+	}
+
+	memset(readyqueues, 0x00, n * sizeof(readyqueues_t));
+	memset(core_stats, 0x00, n * sizeof(core_stats_t));
+	memset(timer_wheels, 0x00, n * sizeof(timer_wheel_t));
+	memset(hr_timers, 0x00, n * sizeof(task_list_t));
+	for(i=0; i<n; i++)
+		spinlock_irqsave_init(&readyqueues[i].lock);
+
+	readyqueues[core_id].idle = per_core(current_task);
+	readyqueues[core_id].curr_task = per_core(current_task);
+	nr_core_slots = n;
+
+	LOG_INFO("Allocate the readyqueues of %u cores\n", n);
+
+	return 0;
+}
+
+int sched_init(void)
+{
+	const char* cmdline = get_cmdline();
+	int ret = readyqueues_init();
+
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	if (cmdline) {
+		// search in the command line for the steal threshold
+		char* found = strstr(cmdline, "-steal");
+		if (found)
+			steal_threshold = atoi(found+strlen("-steal"));
+	}
+
+	if (cmdline) {
+		// search in the command line for the default placement policy
+		char* found = strstr(cmdline, "-placement=");
+		if (found) {
+			found += strlen("-placement=");
+			if (!strncmp(found, "rr", strlen("rr")))
+				placement_policy = PLACEMENT_ROUND_ROBIN;
+			else if (!strncmp(found, "load", strlen("load")))
+				placement_policy = PLACEMENT_LEAST_LOADED;
+			else if (!strncmp(found, "cache", strlen("cache")))
+				placement_policy = PLACEMENT_CACHE_NEAR;
+			else
+				LOG_WARNING("Unknown placement policy, use round-robin\n");
+		}
+	}
+
+	if (cmdline) {
+		// search in the command line for the FPU switching mode
+		if (strstr(cmdline, "-fpu=eager"))
+			eager_fpu = 1;
+		else if (strstr(cmdline, "-fpu=lazy"))
+			eager_fpu = 0;
+	}
+
+	if (cmdline) {
+		// search in the command line for isolated cores, e.g. -isolcpus=2,4-7
+		char* found = strstr(cmdline, "-isolcpus=");
+		if (found) {
+			found += strlen("-isolcpus=");
+			while ((*found >= '0') && (*found <= '9')) {
+				uint32_t first = atoi(found), last;
+
+				while ((*found >= '0') && (*found <= '9'))
+					found++;
+				last = first;
+				if (*found == '-') {
+					last = atoi(++found);
+					while ((*found >= '0') && (*found <= '9'))
+						found++;
+				}
+
+				for(; (first <= last) && (first < nr_core_slots); first++) {
+					// the boot processor handles the interrupts and the kernel threads
+					if ((first == CORE_ID) || core_is_isolated(first))
+						continue;
+					isolated_cores[first / 64] |= (1ULL << (first % 64));
+					nr_isolated++;
+				}
+
+				if (*found != ',')
+					break;
+				found++;
+			}
+		}
+	}
+
+	if (cmdline) {
+		// search in the command line for the number of cores, which start online
+		char* found = strstr(cmdline, "-maxcpus=");
+		if (found) {
+			uint32_t i, n = atoi(found+strlen("-maxcpus="));
+
+			for(i=(n ? n : 1); i<nr_core_slots; i++) {
+				// the boot processor handles the interrupts and the kernel threads
+				if (i == CORE_ID)
+					continue;
+				offline_cores[i / 64] |= (1ULL << (i % 64));
+			}
+
+			// count only the existing cores
+			for(i=0; i<nr_core_slots; i++) {
+				if (core_is_offline(i))
+					nr_offline++;
+			}
+		}
+	}
+
+	if (steal_threshold)
+		LOG_INFO("Work stealing is enabled (threshold %u)\n", steal_threshold);
+	if (nr_isolated)
+		LOG_INFO("%u cores are isolated and run only pinned threads\n", nr_isolated);
+	if (nr_offline)
+		LOG_INFO("%u cores are offline until cpu_up()\n", nr_offline);
+	LOG_INFO("Use %s FPU switching\n", eager_fpu ? "eager" : "lazy");
+	LOG_INFO("Default placement policy of new threads: %s\n",
+		placement_policy == PLACEMENT_LEAST_LOADED ? "least loaded" :
+		placement_policy == PLACEMENT_CACHE_NEAR ? "cache near" : "round-robin");
+
+	return 0;
+}
+
+int set_boot_stack(tid_t id, size_t stack, size_t ist_addr)
+{
+	if (id < MAX_CORES) {
+		task_t* task = task_by_id(id);
+
+		task->stack = (void*) stack;
+		task->ist_addr = (void*) ist_addr;
+
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+tid_t set_idle_task(void)
+{
+	uint32_t core_id = CORE_ID;
+	task_t* task;
+
+	// the core hasn't been detected by sched_init()
+	if (BUILTIN_EXPECT(core_id >= nr_core_slots, 0))
+		return ~0;
+
+	task = task_alloc();
+	if (BUILTIN_EXPECT(!task, 0))
+		return ~0;
+
+	task->status = TASK_IDLE;
+	task->last_core = core_id;
+	task->last_stack_pointer = NULL;
+	task->stack = NULL;
+	task->ist_addr = NULL;
+	task->prio = IDLE_PRIO;
+	task->heap = NULL;
+	task->stats_tsc = get_rdtsc();
+	memset(&task->stats, 0x00, sizeof(task->stats));
+	memset(&task->dl, 0x00, sizeof(task->dl));
+	task->gang = 0;
+	task->fibers = NULL;
+	task->pmu = NULL;
+	task->signal_pending = 0;
+	task->timeslice = 0;
+	task->timer_slack = 0;
+	readyqueues[core_id].idle = task;
+	readyqueues[core_id].curr_task = task;
+	set_per_core(current_task, readyqueues[core_id].idle);
+
+	return task->id;
+}
+
+/** @brief Load the FPU state of the current task during its context switch
+ *
+ * Only tasks, which already used the FPU, are loaded eagerly. All other
+ * tasks get the FPU lazily by fpu_handler(). The state of the previous
+ * owner is saved by XSAVEOPT/XSAVES, if available, which skips
+ * unmodified components.
+ */
+static void fpu_switch_eager(uint32_t core_id)
+{
+	task_t* curr_task = per_core(current_task);
+	const tid_t owner = readyqueues[core_id].fpu_owner;
+
+	if ((curr_task->status == TASK_IDLE) || !(curr_task->flags & TASK_FPU_INIT))
+		return;
+
+	if (owner != curr_task->id) {
+		if (owner) {
+			task_t* owner_task = task_by_id(owner);
+
+			save_fpu_state_of(owner_task);
+			owner_task->flags &= ~TASK_FPU_USED;
+		}
+
+		fpu_enable();
+		restore_fpu_state(curr_task->fpu);
+		readyqueues[core_id].fpu_owner = curr_task->id;
+	} else {
+		fpu_enable();
+	}
+
+	curr_task->flags |= TASK_FPU_USED;
+}
+
+void finish_task_switch(void)
+{
+	task_t* old;
+	task_t* migrate = NULL;
+	task_t* release = NULL;
+	const uint32_t core_id = CORE_ID;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	// the context of the previous task is saved => it could be stolen
+	readyqueues[core_id].prev_task = NULL;
+
+	if ((old = readyqueues[core_id].old_task) != NULL) {
+		readyqueues[core_id].old_task = NULL;
+
+		if (old->status == TASK_FINISHED) {
+			/* cleanup task */
+			if (old->stack) {
+				//LOG_INFO("Release stack at 0x%zx\n", old->stack);
+				destroy_stack(old->stack, DEFAULT_STACK_SIZE);
+				old->stack = NULL;
+			}
+
+			if (!old->parent && old->heap) {
+				kfree(old->heap);
+				old->heap = NULL;
+			}
+
+			if (old->ist_addr) {
+				destroy_stack(old->ist_addr, KERNEL_STACK_SIZE);
+				old->ist_addr = NULL;
+			}
+
+			if (old->pmu) {
+				kfree(old->pmu);
+				old->pmu = NULL;
+			}
+
+			// the stack of the fiber, which called exit
+			fiber_cleanup(old);
+
+			old->last_stack_pointer = NULL;
+
+			if (readyqueues[core_id].fpu_owner == old->id)
+				readyqueues[core_id].fpu_owner = 0;
+
+			/* signalizes that this task could be reused */
+			old->status = TASK_INVALID;
+			if (!task_release(old, 1))
+				release = old;
+		} else if (BUILTIN_EXPECT(!core_allowed(old->affinity, core_id) || core_is_offline(core_id), 0)) {
+			// the FPU state has to leave the core together with the task
+			if (readyqueues[core_id].fpu_owner == old->id) {
+				save_fpu_state_of(old);
+				old->flags &= ~TASK_FPU_USED;
+				readyqueues[core_id].fpu_owner = 0;
+			}
+
+			readyqueues[core_id].nr_tasks--;
+			migrate = old;
+		} else {
+			// re-enqueue old task
+			readyqueues_push_back(core_id, old);
+		}
+	}
+
+	if (eager_fpu)
+		fpu_switch_eager(core_id);
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	// the affinity of the old task excludes this core
+	if (migrate)
+		readyqueues_migrate(migrate);
+
+	// the cache of released tasks is full
+	if (release)
+		task_release(release, 0);
+}
+
+
+void NORETURN do_exit(int arg)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint32_t core_id = CORE_ID;
+
+	LOG_INFO("Terminate task: %u, return value %d\n", curr_task->id, arg);
+
+	uint8_t flags = irq_nested_disable();
+
+	if (curr_task->gang)
+		gang_leave(curr_task);
+
+	// decrease the number of active tasks
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues[core_id].nr_tasks--;
+	// release the reserved bandwidth of an EDF task
+	if (is_dl_task(curr_task)) {
+		readyqueues[core_id].dl_bw -= dl_bw(curr_task->dl.runtime, curr_task->dl.period);
+		memset(&curr_task->dl, 0x00, sizeof(curr_task->dl));
+	}
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	// release the thread local storage
+	destroy_tls();
+
+	// fibers don't outlive their carrier
+	fiber_release(curr_task);
+
+	curr_task->status = TASK_FINISHED;
+
+	reschedule();
+
+	irq_nested_enable(flags);
+
+	LOG_ERROR("Kernel panic: scheduler found no valid task\n");
+	while(1) {
+		HALT;
+	}
+}
+
+
+void NORETURN leave_kernel_task(void) {
+	int result;
+
+	result = 0; //get_return_value();
+	do_exit(result);
+}
+
+
+void NORETURN do_abort(void) {
+	do_exit(-1);
+}
+
+
+static uint32_t get_next_core_id(const uint64_t* affinity)
+{
+	uint32_t i;
+	static uint32_t core_id = MAX_CORES;
+
+	if (core_id >= nr_core_slots)
+		core_id = CORE_ID;
+
+	// we assume OpenMP applications
+	// => number of threads is (normaly) equal to the number of cores
+	// => search next available core
+	for(i=0, core_id=(core_id+1)%nr_core_slots; i<2*nr_core_slots; i++, core_id=(core_id+1)%nr_core_slots)
+		if (core_available(core_id) && core_allowed(affinity, core_id))
+			break;
+
+	if (BUILTIN_EXPECT(!core_available(core_id) || !core_allowed(affinity, core_id), 0)) {
+		LOG_ERROR("BUG: no core available!\n");
+		return MAX_CORES;
+	}
+
+	return core_id;
+}
+
+/** @brief Search the core with the lowest number of tasks
+ *
+ * nr_tasks is read without locking and used only as hint. The search starts
+ * behind the current core to distribute equally loaded cores.
+ *
+ * @param near Consider only cores, which share the cache with the current core
+ * @param affinity Set of the allowed cores
+ * @return Id of the core or MAX_CORES, if no core is available
+ */
+static uint32_t get_least_loaded_core_id(int near, const uint64_t* affinity)
+{
+	const uint32_t domain = get_cache_domain(CORE_ID);
+	uint32_t i, core_id, ret = MAX_CORES;
+	uint32_t min = (uint32_t) -1;
+
+	for(i=0, core_id=(CORE_ID+1)%nr_core_slots; i<nr_core_slots; i++, core_id=(core_id+1)%nr_core_slots) {
+		if (!core_available(core_id) || !core_allowed(affinity, core_id))
+			continue;
+		if (near && (get_cache_domain(core_id) != domain))
+			continue;
+		if (readyqueues[core_id].nr_tasks < min) {
+			min = readyqueues[core_id].nr_tasks;
+			ret = core_id;
+		}
+	}
+
+	return ret;
+}
+
+static uint32_t select_core_id(int policy, const uint64_t* affinity)
+{
+	uint64_t buf[AFFINITY_WORDS];
+	uint32_t core_id, near_id;
+
+	affinity = placement_affinity(affinity, buf);
+
+	if (policy == PLACEMENT_DEFAULT)
+		policy = placement_policy;
+
+	switch(policy) {
+	case PLACEMENT_LEAST_LOADED:
+		core_id = get_least_loaded_core_id(0, affinity);
+		break;
+	case PLACEMENT_CACHE_NEAR:
+		core_id = get_least_loaded_core_id(0, affinity);
+		near_id = get_least_loaded_core_id(1, affinity);
+		// a sibling wins, if it isn't busier than the least loaded core
+		if ((near_id < MAX_CORES) && (core_id < MAX_CORES)
+		    && (readyqueues[near_id].nr_tasks <= readyqueues[core_id].nr_tasks))
+			core_id = near_id;
+		break;
+	default:
+		core_id = get_next_core_id(affinity);
+		break;
+	}
+
+	return core_id;
+}
+
+
+int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, int policy)
+{
+	int ret = -EINVAL;
+	void* stack = NULL;
+	void* ist = NULL;
+	task_t* task;
+	task_t* curr_task;
+	uint32_t core_id;
+
+	if (BUILTIN_EXPECT(!ep, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(prio == IDLE_PRIO, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(prio > MAX_PRIO, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT((policy < PLACEMENT_DEFAULT) || (policy > PLACEMENT_CACHE_NEAR), 0))
+		return -EINVAL;
+
+	curr_task = per_core(current_task);
+
+	stack = create_lazy_stack(DEFAULT_STACK_SIZE);
+	if (BUILTIN_EXPECT(!stack, 0))
+		return -ENOMEM;
+
+	ist =  create_stack(KERNEL_STACK_SIZE);
+	if (BUILTIN_EXPECT(!ist, 0)) {
+		destroy_stack(stack, DEFAULT_STACK_SIZE);
+		return -ENOMEM;
+	}
+
+	task = task_alloc();
+	if (BUILTIN_EXPECT(!task, 0)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	mcs_spinlock_irqsave_lock(&table_lock);
+
+	core_id = select_core_id(policy, curr_task->affinity);
+	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
+	{
+		mcs_spinlock_irqsave_unlock(&table_lock);
+		task_release(task, 0);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	task->status = TASK_READY;
+	task->last_core = core_id;
+	task->last_stack_pointer = NULL;
+	task->stack = stack;
+	task->prio = prio;
+	task->heap = curr_task->heap;
+	task->start_tick = get_clock_tick();
+	task->last_tsc = 0;
+	task->parent = curr_task->id;
+	task->tls_addr = curr_task->tls_addr;
+	task->tls_size = curr_task->tls_size;
+	task->ist_addr = ist;
+	task->lwip_err = 0;
+	task->signal_handler = NULL;
+	task->stats_tsc = get_rdtsc();
+	memset(&task->stats, 0x00, sizeof(task->stats));
+	memset(&task->dl, 0x00, sizeof(task->dl));
+	task->gang = 0;
+	task->fibers = NULL;
+	task->pmu = NULL;
+	task->signal_pending = 0;
+	task->timeslice = 0;
+	task->timer_slack = curr_task->timer_slack;
+	memcpy(task->affinity, curr_task->affinity, sizeof(curr_task->affinity));
+
+	if (id)
+		*id = task->id;
+
+	ret = create_default_frame(task, ep, arg, core_id);
+	if (ret) {
+		task->status = TASK_INVALID;
+		mcs_spinlock_irqsave_unlock(&table_lock);
+		task_release(task, 0);
+		goto out;
+	}
+
+	// add task in the readyqueues
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	// should we wakeup the core?
+	if (readyqueues[core_id].nr_tasks == 1)
+		wakeup_core(core_id);
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	LOG_DEBUG("start new thread %d on core %d with stack address %p\n", task->id, core_id, stack);
+
+out:
+	if (ret) {
+		destroy_stack(stack, DEFAULT_STACK_SIZE);
+		destroy_stack(ist, KERNEL_STACK_SIZE);
+	}
+
+	return ret;
+}
+
+
+int create_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, uint32_t core_id)
+{
+	int ret = -ENOMEM;
+	void* stack = NULL;
+	void* ist = NULL;
+	task_t* task;
+
+	if (BUILTIN_EXPECT(!ep, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(prio == IDLE_PRIO, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(prio > MAX_PRIO, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!core_available(core_id), 0))
+		return -EINVAL;
+
+	stack = create_lazy_stack(DEFAULT_STACK_SIZE);
+	if (BUILTIN_EXPECT(!stack, 0))
+		return -ENOMEM;
+
+	ist = create_stack(KERNEL_STACK_SIZE);
+	if (BUILTIN_EXPECT(!ist, 0)) {
+		destroy_stack(stack, DEFAULT_STACK_SIZE);
+		return -ENOMEM;
+	}
+
+	task = task_alloc();
+	if (BUILTIN_EXPECT(!task, 0))
+		goto out;
+
+	mcs_spinlock_irqsave_lock(&table_lock);
+
+	task->status = TASK_READY;
+	task->last_core = core_id;
+	task->last_stack_pointer = NULL;
+	task->stack = stack;
+	task->prio = prio;
+	task->heap = NULL;
+	task->start_tick = get_clock_tick();
+	task->last_tsc = 0;
+	task->parent = 0;
+	task->ist_addr = ist;
+	task->tls_addr = 0;
+	task->tls_size = 0;
+	task->lwip_err = 0;
+	task->signal_handler = NULL;
+	task->stats_tsc = get_rdtsc();
+	memset(&task->stats, 0x00, sizeof(task->stats));
+	memset(&task->dl, 0x00, sizeof(task->dl));
+	task->gang = 0;
+	task->fibers = NULL;
+	task->pmu = NULL;
+	task->signal_pending = 0;
+	task->timeslice = 0;
+	task->timer_slack = TIMER_SLACK_NSEC;
+	memset(task->affinity, 0xFF, sizeof(task->affinity));
+
+	if (id)
+		*id = task->id;
+
+	ret = create_default_frame(task, ep, arg, core_id);
+	if (ret) {
+		task->status = TASK_INVALID;
+		mcs_spinlock_irqsave_unlock(&table_lock);
+		task_release(task, 0);
+		goto out;
+	}
+
+	// add task in the readyqueues
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	LOG_INFO("start new task %d on core %d with stack address %p\n", task->id, core_id, stack);
+
+out:
+	if (ret) {
+		destroy_stack(stack, DEFAULT_STACK_SIZE);
+		destroy_stack(ist, KERNEL_STACK_SIZE);
+	}
+
+	return ret;
+}
+
+
+int create_kernel_task_on_core(tid_t* id, entry_point_t ep, void* args, uint8_t prio, uint32_t core_id)
+{
+	if (prio > MAX_PRIO)
+		prio = NORMAL_PRIO;
+
+	return create_task(id, ep, args, prio, core_id);
+}
+
+
+int create_kernel_task(tid_t* id, entry_point_t ep, void* args, uint8_t prio)
+{
+	if (prio > MAX_PRIO)
+		prio = NORMAL_PRIO;
+
+	return create_task(id, ep, args, prio, CORE_ID);
+}
+
+
+/** @brief Cores, which have to be interrupted after a batch of wakeups
+ *
+ * The IPIs are sent after all locks are released and at most once per core.
+ */
+typedef struct {
+	uint64_t wakeup[AFFINITY_WORDS];
+	uint64_t resched[AFFINITY_WORDS];
+} wakeup_set_t;
+
+static int __wakeup_task(tid_t id, wakeup_set_t* set)
+{
+	task_t* task;
+	uint32_t core_id;
+	int ret = -EINVAL;
+
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task, 0))
+		return -EINVAL;
+
+	mcs_spinlock_irqsave_lock(&table_lock);
+	core_id = task->last_core;
+
+	if (task->status == TASK_BLOCKED) {
+		LOG_DEBUG("wakeup task %d on core %d\n", id, core_id);
+
+		task->status = TASK_READY;
+		task->stats_tsc = get_rdtsc();
+		mcs_spinlock_irqsave_unlock(&table_lock);
+
+		ret = 0;
+
+		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+		// if task is in timer queue, remove it
+		if (task->flags & TASK_TIMER) {
+			task->flags &= ~TASK_TIMER;
+
+			timer_queue_remove(core_id, task);
+		}
+
+		/*
+		 * the core is parked => continue on another one, if the core has
+		 * finished switching away from the task. Otherwise the task is
+		 * enqueued and finish_task_switch() migrates it.
+		 */
+		if (BUILTIN_EXPECT(core_is_offline(core_id) && !is_dl_task(task) && is_stealable(core_id, task), 0)) {
+			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+			readyqueues_migrate(task);
+			return 0;
+		}
+
+		if (is_dl_task(task))
+			dl_task_wakeup(task);
+
+		// add task to the ready queue
+		readyqueues_push_back(core_id, task);
+
+		// increase the number of ready tasks
+		readyqueues[core_id].nr_tasks++;
+
+		// should we wakeup the core?
+		if (readyqueues[core_id].nr_tasks == 1)
+			set->wakeup[core_id / 64] |= (1ULL << (core_id % 64));
+		else if (is_dl_task(task) || task->gang)
+			set->resched[core_id / 64] |= (1ULL << (core_id % 64)); // an EDF task or a gang member preempts the current task
+		else if (!readyqueues[core_id].slice_timer && readyqueues[core_id].curr_task
+		         && (readyqueues[core_id].curr_task->prio == task->prio)) {
+			// the current task competes now with a task of the same priority => start its time slice
+			if (core_id == CORE_ID) {
+				slice_update(core_id);
+				if (readyqueues[core_id].slice_timer)
+					update_timer(core_id);
+			} else {
+				set->resched[core_id / 64] |= (1ULL << (core_id % 64));
+			}
+		}
+
+		LOG_DEBUG("update nr_tasks on core %d to %d\n", core_id, readyqueues[core_id].nr_tasks);
+
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	} else {
+		mcs_spinlock_irqsave_unlock(&table_lock);
+	}
+
+	return ret;
+}
+
+static void wakeup_set_kick(const wakeup_set_t* set)
+{
+	uint32_t i;
+
+	for(i=0; i<AFFINITY_WORDS; i++) {
+		uint64_t wakeup = set->wakeup[i];
+		uint64_t resched = set->resched[i] & ~wakeup;
+
+		while (wakeup) {
+			uint32_t bit = __builtin_ctzll(wakeup);
+
+			wakeup &= wakeup - 1;
+			wakeup_core(i * 64 + bit);
+		}
+
+		while (resched) {
+			uint32_t bit = __builtin_ctzll(resched);
+
+			resched &= resched - 1;
+			reschedule_core(i * 64 + bit);
+		}
+	}
+}
+
+int wakeup_task(tid_t id)
+{
+	wakeup_set_t set = {{0}, {0}};
+	int ret;
+
+	ret = __wakeup_task(id, &set);
+	wakeup_set_kick(&set);
+
+	return ret;
+}
+
+int wakeup_tasks(const tid_t* ids, uint32_t n)
+{
+	wakeup_set_t set = {{0}, {0}};
+	uint32_t i;
+	int woken = 0;
+
+	if (BUILTIN_EXPECT(!ids && n, 0))
+		return -EINVAL;
+
+	for(i=0; i<n; i++) {
+		if (!__wakeup_task(ids[i], &set))
+			woken++;
+	}
+
+	wakeup_set_kick(&set);
+
+	return woken;
+}
+
+
+int block_task(tid_t id)
+{
+	task_t* task;
+	uint32_t core_id;
+	int ret = -EINVAL;
+	uint8_t flags;
+
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task, 0))
+		return -EINVAL;
+
+	flags = irq_nested_disable();
+
+	core_id = task->last_core;
+
+	if (task->status == TASK_RUNNING) {
+		LOG_DEBUG("block task %d on core %d\n", id, core_id);
+
+		task->status = TASK_BLOCKED;
+
+		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+		// remove task from ready queue
+		readyqueues_remove(core_id, task);
+
+		// reduce the number of ready tasks
+		readyqueues[core_id].nr_tasks--;
+		LOG_DEBUG("update nr_tasks on core %d to %d\n", core_id, readyqueues[core_id].nr_tasks);
+
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+		ret = 0;
+	}
+
+	irq_nested_enable(flags);
+
+	return ret;
 }
 
 
-void NORETURN do_abort(void) {
-	do_exit(-1);
+int block_current_task(void)
+{
+	return block_task(per_core(current_task)->id);
 }
 
 
-static uint32_t get_next_core_id(void)
+int set_timer(uint64_t deadline)
 {
-	uint32_t i;
-	static uint32_t core_id = MAX_CORES;
+	task_t* curr_task;
+	uint32_t core_id;
+	uint8_t flags;
+	int ret = -EINVAL;
 
-	if (core_id >= MAX_CORES)
-		core_id = CORE_ID;
+	flags = irq_nested_disable();
 
-	// we assume OpenMP applications
-	// => number of threads is (normaly) equal to the number of cores
-	// => search next available core
-	for(i=0, core_id=(core_id+1)%MAX_CORES; i<2*MAX_CORES; i++, core_id=(core_id+1)%MAX_CORES)
-		if (readyqueues[core_id].idle)
-			break;
+	curr_task = per_core(current_task);
+	core_id = CORE_ID;
 
-	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0)) {
-		LOG_ERROR("BUG: no core available!\n");
-		return MAX_CORES;
+	if (curr_task->status == TASK_RUNNING) {
+		// blocks task and removes from ready queue
+		block_task(curr_task->id);
+
+		curr_task->flags |= TASK_TIMER;
+		curr_task->timeout = deadline;
+
+		timer_queue_push(core_id, curr_task);
+
+		ret = 0;
+	} else {
+		LOG_INFO("Task is already blocked. No timer will be set!\n");
 	}
 
-	return core_id;
+	irq_nested_enable(flags);
+
+	return ret;
 }
 
 
-int clone_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio)
+int set_timer_tsc(uint64_t deadline)
 {
-	int ret = -EINVAL;
-	uint32_t i;
-	void* stack = NULL;
-	void* ist = NULL;
 	task_t* curr_task;
 	uint32_t core_id;
+	uint64_t now, cycles;
+	uint8_t flags;
+	int ret = -EINVAL;
 
-	if (BUILTIN_EXPECT(!ep, 0))
+	now = get_rdtsc();
+	cycles = tsc_per_tick();
+
+	// the wheel is cheaper for long timeouts, it wakes up the task early enough
+	if (!cycles || (deadline >= now + cycles))
+		return set_timer(get_clock_tick() + (cycles ? (deadline - now) / cycles : 1));
+
+	flags = irq_nested_disable();
+
+	curr_task = per_core(current_task);
+	core_id = CORE_ID;
+
+	if (curr_task->status == TASK_RUNNING) {
+		// blocks task and removes from ready queue
+		block_task(curr_task->id);
+
+		curr_task->flags |= TASK_TIMER|TASK_HRTIMER;
+		curr_task->timeout = deadline;
+		curr_task->timeout_max = deadline + ns_to_tsc(curr_task->timer_slack);
+
+		hr_timer_push(core_id, curr_task);
+
+		ret = 0;
+	} else {
+		LOG_INFO("Task is already blocked. No timer will be set!\n");
+	}
+
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
+
+void check_timers(void)
+{
+	readyqueues_t* readyqueue = &readyqueues[CORE_ID];
+	timer_wheel_t* wheel = &timer_wheels[CORE_ID];
+	spinlock_irqsave_lock(&readyqueue->lock);
+
+	// since IRQs are disabled, get_clock_tick() won't increase here
+	const uint64_t current_tick = get_clock_tick();
+
+	// wakeup tasks whose deadline has expired
+	task_t* task;
+	while ((task = timer_wheel_expired(wheel, current_tick)))
+	{
+		// pops task from timer wheel
+		wakeup_task(task->id);
+
+		// a task, which isn't blocked, has to leave the wheel anyway
+		if (task->flags & TASK_TIMER) {
+			task->flags &= ~TASK_TIMER;
+			timer_wheel_remove(wheel, task);
+		}
+	}
+
+	// wakeup tasks whose high-resolution timer has expired
+	const uint64_t current_tsc = get_rdtsc();
+	while ((task = hr_timers[CORE_ID].first) && (task->timeout <= current_tsc))
+	{
+		// pops task from the list
+		wakeup_task(task->id);
+
+		if (task->flags & TASK_TIMER) {
+			task->flags &= ~(TASK_TIMER|TASK_HRTIMER);
+			task_list_remove_task(&hr_timers[CORE_ID], task);
+		}
+	}
+
+#ifdef DYNAMIC_TICKS
+	if (!timer_wheel_empty(wheel) || hr_timers[CORE_ID].first || readyqueue->dl_timer || readyqueue->gang_timer || readyqueue->slice_timer) {
+		update_timer(CORE_ID);
+	}
+#endif
+
+	spinlock_irqsave_unlock(&readyqueue->lock);
+}
+
+
+int steal_task(void)
+{
+	const uint32_t core_id = CORE_ID;
+	const uint32_t ncores = atomic_int32_read(&cpu_online);
+	uint32_t i, prio, bitmap, victim = MAX_CORES, max_tasks = 0;
+	uint32_t pct, load, max_load = 0;
+	task_t* task = NULL;
+
+	// isolated and offline cores don't look for work
+	if (!steal_threshold || core_is_isolated(core_id) || core_is_offline(core_id))
+		return -ENOSYS;
+
+	// determine the busiest core, the values are only used as hint
+	for(i=0; (i<ncores) && (i<nr_core_slots); i++) {
+		if ((i == core_id) || !readyqueues[i].idle)
+			continue;
+
+		// the host steals time from the core => its tasks progress slower
+		pct = readyqueues[i].steal_pct;
+		load = (readyqueues[i].nr_tasks * 100) / (100 - ((pct < 90) ? pct : 90));
+		if (load > max_load) {
+			max_load = load;
+			max_tasks = readyqueues[i].nr_tasks;
+			victim = i;
+		}
+	}
+
+	if ((victim >= MAX_CORES) || (max_tasks < steal_threshold))
+		return -EAGAIN;
+
+	spinlock_irqsave_lock(&readyqueues[victim].lock);
+
+	if (readyqueues[victim].nr_tasks >= steal_threshold) {
+		// search from the highest priority downwards
+		bitmap = readyqueues[victim].prio_bitmap;
+		while(!task && ((prio = msb(bitmap)) <= MAX_PRIO)) {
+			// start at the end of the queue, these tasks have to wait the longest time
+			for(task = readyqueues[victim].queue[prio-1].last; task; task = task->prev) {
+				if (is_stealable(victim, task) && core_allowed(task->affinity, core_id))
+					break;
+			}
+
+			bitmap &= ~(1 << prio);
+		}
+
+		if (task) {
+			readyqueues_remove(victim, task);
+			readyqueues[victim].nr_tasks--;
+			task->last_core = core_id;
+		}
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[victim].lock);
+
+	if (!task)
+		return -EAGAIN;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	task->stats.nr_migrations++;
+	core_stats[core_id].nr_steals++;
+	core_stats[core_id].nr_migrations++;
+	readyqueues_push_back(core_id, task);
+	readyqueues[core_id].nr_tasks++;
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	LOG_DEBUG("Core %d steals task %d from core %d\n", core_id, task->id, victim);
+
+	return 0;
+}
+
+
+int set_task_affinity(tid_t id, const uint64_t* affinity)
+{
+	task_t* task;
+	uint32_t i, core_id;
+	int migrate = 0, running = 0;
+
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task || !affinity, 0))
 		return -EINVAL;
-	if (BUILTIN_EXPECT(prio == IDLE_PRIO, 0))
+
+	// at least one available core has to be part of the set
+	for(i=0; i<nr_core_slots; i++) {
+		if (core_available(i) && core_allowed(affinity, i))
+			break;
+	}
+	if (BUILTIN_EXPECT(i >= nr_core_slots, 0))
 		return -EINVAL;
-	if (BUILTIN_EXPECT(prio > MAX_PRIO, 0))
+
+	mcs_spinlock_irqsave_lock(&table_lock);
+
+	if ((task->status == TASK_INVALID) || (task->status == TASK_IDLE) || (task->status == TASK_FINISHED)) {
+		mcs_spinlock_irqsave_unlock(&table_lock);
 		return -EINVAL;
+	}
 
-	curr_task = per_core(current_task);
+	// the bandwidth of an EDF task is reserved on its core, a gang member is bound to it
+	if (BUILTIN_EXPECT((is_dl_task(task) || task->gang) && !core_allowed(affinity, task->last_core), 0)) {
+		mcs_spinlock_irqsave_unlock(&table_lock);
+		return -EBUSY;
+	}
 
-	stack = create_stack(DEFAULT_STACK_SIZE);
-	if (BUILTIN_EXPECT(!stack, 0))
-		return -ENOMEM;
+	memcpy(task->affinity, affinity, sizeof(task->affinity));
+	core_id = task->last_core;
+
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	if (core_allowed(affinity, core_id))
+		return 0;
+
+	// the scheduler moves the current task away
+	if (task == per_core(current_task)) {
+		reschedule();
+		return 0;
+	}
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	if ((task->last_core == core_id) && is_stealable(core_id, task) && readyqueues_contains(core_id, task)) {
+		readyqueues_remove(core_id, task);
+		readyqueues[core_id].nr_tasks--;
+		migrate = 1;
+	} else if (task == readyqueues[core_id].curr_task) {
+		running = 1;
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	// all other tasks migrate after their next context switch
+	if (migrate)
+		readyqueues_migrate(task);
+	else if (running)
+		reschedule_core(core_id);
+
+	return 0;
+}
+
+/** @brief Move the ready tasks of a core to the available cores
+ *
+ * The current task, the previous one and the owner of the FPU state
+ * leave the core after their next context switch.
+ */
+static void readyqueues_drain(uint32_t core_id)
+{
+	task_t* list = NULL;
+	task_t* task;
+	uint32_t prio;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+
+	for(prio=1; prio<=MAX_PRIO; prio++) {
+		task = readyqueues[core_id].queue[prio-1].first;
+		while(task) {
+			task_t* next = task->next;
+
+			if (is_stealable(core_id, task)) {
+				readyqueues_remove(core_id, task);
+				readyqueues[core_id].nr_tasks--;
+				task->next = list;
+				list = task;
+			}
+
+			task = next;
+		}
+	}
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	while(list) {
+		task = list;
+		list = task->next;
+		task->next = NULL;
+		readyqueues_migrate(task);
+	}
+}
+
+int cpu_down(uint32_t core_id)
+{
+	task_t* task;
+	uint32_t i;
+	tid_t id;
+	int ret = 0;
+
+	if (BUILTIN_EXPECT((core_id >= nr_core_slots) || !readyqueues[core_id].idle, 0))
+		return -EINVAL;
+	// the boot processor handles the interrupts and the kernel threads
+	if (BUILTIN_EXPECT(core_id == boot_processor, 0))
+		return -EBUSY;
+
+	spinlock_lock(&hotplug_lock);
+
+	if (core_is_offline(core_id))
+		goto out;
+
+	mcs_spinlock_irqsave_lock(&table_lock);
+
+	for(id=0; (id<nr_used_ids) && !ret; id++) {
+		task = task_by_id(id);
+		if (!task || (task->status == TASK_INVALID) || (task->status == TASK_IDLE) || (task->status == TASK_FINISHED))
+			continue;
+
+		// the bandwidth of an EDF task is reserved on its core, a gang member is bound to it
+		if ((task->last_core == core_id) && (is_dl_task(task) || task->gang)) {
+			ret = -EBUSY;
+			break;
+		}
+
+		// the affinity has to contain another available core
+		for(i=0; i<nr_core_slots; i++) {
+			if ((i != core_id) && core_available(i) && core_allowed(task->affinity, i))
+				break;
+		}
+		if (i >= nr_core_slots)
+			ret = -EBUSY;
+	}
+
+	if (!ret) {
+		offline_cores[core_id / 64] |= (1ULL << (core_id % 64));
+		nr_offline++;
+	}
+
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	if (ret) {
+		LOG_WARNING("Core %u runs tasks, which can't leave it\n", core_id);
+		goto out;
+	}
+
+	irq_migrate_core(core_id);
+	readyqueues_drain(core_id);
+	// the current task migrates at its next context switch
+	reschedule_core(core_id);
+
+	LOG_INFO("Core %u is offline\n", core_id);
+
+out:
+	spinlock_unlock(&hotplug_lock);
+
+	// no IPI to the own core => switch away directly
+	if (!ret && (core_id == CORE_ID))
+		reschedule();
+
+	return ret;
+}
+
+int cpu_up(uint32_t core_id)
+{
+	if (BUILTIN_EXPECT(core_id >= nr_core_slots, 0))
+		return -EINVAL;
+	// the processor hasn't been started at boot time
+	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0))
+		return -ENODEV;
+
+	spinlock_lock(&hotplug_lock);
+
+	if (core_is_offline(core_id)) {
+		offline_cores[core_id / 64] &= ~(1ULL << (core_id % 64));
+		nr_offline--;
+
+		LOG_INFO("Core %u is online\n", core_id);
+	}
+
+	spinlock_unlock(&hotplug_lock);
+
+	return 0;
+}
+
+
+int set_task_deadline(tid_t id, uint64_t runtime, uint64_t deadline, uint64_t period)
+{
+	task_t* task;
+	uint32_t core_id = 0;
+	uint64_t bw, old_bw, now;
+	int ret = 0, queued, running = 0;
 
-	ist =  create_stack(KERNEL_STACK_SIZE);
-	if (BUILTIN_EXPECT(!ist, 0)) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task, 0))
+		return -EINVAL;
+
+	if (runtime) {
+		if (!deadline)
+			deadline = period;
+		if (!period)
+			period = deadline;
+		if (BUILTIN_EXPECT(!deadline || (runtime > deadline) || (deadline > period), 0))
+			return -EINVAL;
+
+		runtime = ns_to_tsc(runtime);
+		deadline = ns_to_tsc(deadline);
+		period = ns_to_tsc(period);
+		if (BUILTIN_EXPECT(!runtime, 0))
+			return -EINVAL;
+	} else {
+		deadline = period = 0;
 	}
 
-	spinlock_irqsave_lock(&table_lock);
+	bw = dl_bw(runtime, period);
 
-	core_id = get_next_core_id();
-	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
-	{
-		spinlock_irqsave_unlock(&table_lock);
+	mcs_spinlock_irqsave_lock(&table_lock);
+
+	if ((task->status == TASK_INVALID) || (task->status == TASK_IDLE) || (task->status == TASK_FINISHED)) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_READY;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = stack;
-			task_table[i].prio = prio;
-			task_table[i].heap = curr_task->heap;
-			task_table[i].start_tick = get_clock_tick();
-			task_table[i].last_tsc = 0;
-			task_table[i].parent = curr_task->id;
-			task_table[i].tls_addr = curr_task->tls_addr;
-			task_table[i].tls_size = curr_task->tls_size;
-			task_table[i].ist_addr = ist;
-			task_table[i].lwip_err = 0;
-			task_table[i].signal_handler = NULL;
-
-			if (id)
-				*id = i;
-
-			ret = create_default_frame(task_table+i, ep, arg, core_id);
-			if (ret)
-				goto out;
-
-                        // add task in the readyqueues
-			spinlock_irqsave_lock(&readyqueues[core_id].lock);
-			readyqueues[core_id].prio_bitmap |= (1 << prio);
-			readyqueues[core_id].nr_tasks++;
-			if (!readyqueues[core_id].queue[prio-1].first) {
-				task_table[i].next = task_table[i].prev = NULL;
-				readyqueues[core_id].queue[prio-1].first = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			} else {
-				task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
-				task_table[i].next = NULL;
-				readyqueues[core_id].queue[prio-1].last->next = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			}
-			// should we wakeup the core?
-			if (readyqueues[core_id].nr_tasks == 1)
-				wakeup_core(core_id);
-			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
- 			break;
-		}
+	// a gang member is scheduled by the slots of its gang
+	if (BUILTIN_EXPECT(runtime && task->gang, 0)) {
+		ret = -EBUSY;
+		goto out;
 	}
 
-	spinlock_irqsave_unlock(&table_lock);
+	core_id = task->last_core;
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
 
-	if (!ret) {
-		LOG_DEBUG("start new thread %d on core %d with stack address %p\n", i, core_id, stack);
+	// admission control => the deadlines of all EDF tasks remain feasible
+	old_bw = is_dl_task(task) ? dl_bw(task->dl.runtime, task->dl.period) : 0;
+	if (BUILTIN_EXPECT(readyqueues[core_id].dl_bw - old_bw + bw > DL_BW_LIMIT, 0)) {
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+		ret = -EBUSY;
+		goto out;
 	}
+	readyqueues[core_id].dl_bw = readyqueues[core_id].dl_bw - old_bw + bw;
+
+	// the task changes its queue
+	queued = (task->status == TASK_READY) && readyqueues_contains(core_id, task);
+	if (queued)
+		readyqueues_remove(core_id, task);
+
+	now = get_rdtsc();
+	task->dl.runtime = runtime;
+	task->dl.deadline = deadline;
+	task->dl.period = period;
+	task->dl.abs_deadline = now + deadline;
+	task->dl.budget = (int64_t) runtime;
+	task->dl.tsc = now;
+
+	if (queued)
+		readyqueues_push_back(core_id, task);
+	else if (task == readyqueues[core_id].curr_task)
+		running = 1;
+
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 
 out:
-	if (ret) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		destroy_stack(ist, KERNEL_STACK_SIZE);
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	// the scheduler arms the budget timer of the running task
+	if (running) {
+		if (core_id == CORE_ID)
+			reschedule();
+		else
+			reschedule_core(core_id);
 	}
 
 	return ret;
 }
 
-
-int create_task(tid_t* id, entry_point_t ep, void* arg, uint8_t prio, uint32_t core_id)
+int create_gang(const tid_t* ids, uint32_t n)
 {
-	int ret = -ENOMEM;
-	uint32_t i;
-	void* stack = NULL;
-	void* ist = NULL;
-	void* counter = NULL;
+	uint64_t cores[AFFINITY_WORDS];
+	uint64_t affinity[AFFINITY_WORDS];
+	task_t* task;
+	uint32_t i, core_id, gang;
+	int ret = 0;
 
-	if (BUILTIN_EXPECT(!ep, 0))
-		return -EINVAL;
-	if (BUILTIN_EXPECT(prio == IDLE_PRIO, 0))
-		return -EINVAL;
-	if (BUILTIN_EXPECT(prio > MAX_PRIO, 0))
-		return -EINVAL;
-	if (BUILTIN_EXPECT(core_id >= MAX_CORES, 0))
-		return -EINVAL;
-	if (BUILTIN_EXPECT(!readyqueues[core_id].idle, 0))
+	if (BUILTIN_EXPECT(!ids || !n || (n > MAX_CORES), 0))
 		return -EINVAL;
 
-	stack = create_stack(DEFAULT_STACK_SIZE);
-	if (BUILTIN_EXPECT(!stack, 0))
-		return -ENOMEM;
-
-	ist = create_stack(KERNEL_STACK_SIZE);
-	if (BUILTIN_EXPECT(!ist, 0)) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		return -ENOMEM;
-	}
+	spinlock_irqsave_lock(&gang_lock);
 
-	counter = kmalloc(sizeof(atomic_int64_t));
-	if (BUILTIN_EXPECT(!counter, 0)) {
-		destroy_stack(stack, KERNEL_STACK_SIZE);
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
+	for(gang=0; (gang<MAX_GANGS) && gang_members[gang]; gang++)
+		;
+	if (BUILTIN_EXPECT(gang >= MAX_GANGS, 0)) {
+		spinlock_irqsave_unlock(&gang_lock);
 		return -ENOMEM;
 	}
-	atomic_int64_set((atomic_int64_t*) counter, 0);
-
-	spinlock_irqsave_lock(&table_lock);
-
-	for(i=0; i<MAX_TASKS; i++) {
-		if (task_table[i].status == TASK_INVALID) {
-			task_table[i].id = i;
-			task_table[i].status = TASK_READY;
-			task_table[i].last_core = core_id;
-			task_table[i].last_stack_pointer = NULL;
-			task_table[i].stack = stack;
-			task_table[i].prio = prio;
-			task_table[i].heap = NULL;
-			task_table[i].start_tick = get_clock_tick();
-			task_table[i].last_tsc = 0;
-			task_table[i].parent = 0;
-			task_table[i].ist_addr = ist;
-			task_table[i].tls_addr = 0;
-			task_table[i].tls_size = 0;
-			task_table[i].lwip_err = 0;
-			task_table[i].signal_handler = NULL;
-
-			if (id)
-				*id = i;
-
-			ret = create_default_frame(task_table+i, ep, arg, core_id);
-			if (ret)
-				goto out;
-
-			// add task in the readyqueues
-			spinlock_irqsave_lock(&readyqueues[core_id].lock);
-			readyqueues[core_id].prio_bitmap |= (1 << prio);
-			readyqueues[core_id].nr_tasks++;
-			if (!readyqueues[core_id].queue[prio-1].first) {
-				task_table[i].next = task_table[i].prev = NULL;
-				readyqueues[core_id].queue[prio-1].first = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			} else {
-				task_table[i].prev = readyqueues[core_id].queue[prio-1].last;
-				task_table[i].next = NULL;
-				readyqueues[core_id].queue[prio-1].last->next = task_table+i;
-				readyqueues[core_id].queue[prio-1].last = task_table+i;
-			}
-			spinlock_irqsave_unlock(&readyqueues[core_id].lock);
-			break;
-		}
-	}
 
-	if (!ret)
-		LOG_INFO("start new task %d on core %d with stack address %p\n", i, core_id, stack);
+	mcs_spinlock_irqsave_lock(&table_lock);
 
-out:
-	spinlock_irqsave_unlock(&table_lock);
+	// the members have to run on different cores
+	memset(cores, 0x00, sizeof(cores));
+	for(i=0; i<n; i++) {
+		task = task_by_id(ids[i]);
+		if (BUILTIN_EXPECT(!task || (task->status == TASK_INVALID) || (task->status == TASK_IDLE)
+		    || (task->status == TASK_FINISHED), 0)) {
+			ret = -EINVAL;
+			goto out;
+		}
 
-	if (ret) {
-		destroy_stack(stack, DEFAULT_STACK_SIZE);
-		destroy_stack(ist, KERNEL_STACK_SIZE);
-		kfree(counter);
+		core_id = task->last_core;
+		if (BUILTIN_EXPECT(task->gang || is_dl_task(task) || (cores[core_id / 64] & (1ULL << (core_id % 64))), 0)) {
+			ret = -EBUSY;
+			goto out;
+		}
+		cores[core_id / 64] |= (1ULL << (core_id % 64));
 	}
 
-	return ret;
-}
+	// bind the members to their current cores
+	for(i=0; i<n; i++) {
+		task = task_by_id(ids[i]);
+		core_id = task->last_core;
 
+		memset(affinity, 0x00, sizeof(affinity));
+		affinity[core_id / 64] = (1ULL << (core_id % 64));
+		memcpy(task->affinity, affinity, sizeof(affinity));
 
-int create_kernel_task_on_core(tid_t* id, entry_point_t ep, void* args, uint8_t prio, uint32_t core_id)
-{
-	if (prio > MAX_PRIO)
-		prio = NORMAL_PRIO;
+		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+		task->gang = gang + 1;
+		readyqueues[core_id].gang[gang] = task;
+		readyqueues[core_id].nr_gang++;
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	}
 
-	return create_task(id, ep, args, prio, core_id);
-}
+	gang_members[gang] = n;
+	gang_order[nr_gangs] = gang;
+	nr_gangs++;
+	ret = gang;
 
+	LOG_INFO("Create gang %d with %u members\n", gang, n);
 
-int create_kernel_task(tid_t* id, entry_point_t ep, void* args, uint8_t prio)
-{
-	if (prio > MAX_PRIO)
-		prio = NORMAL_PRIO;
+out:
+	mcs_spinlock_irqsave_unlock(&table_lock);
+	spinlock_irqsave_unlock(&gang_lock);
 
-	return create_task(id, ep, args, prio, CORE_ID);
+	return ret;
 }
 
-
-int wakeup_task(tid_t id)
+int destroy_gang(int gang)
 {
-	task_t* task;
 	uint32_t core_id;
-	int ret = -EINVAL;
+	task_t* task;
 
-	spinlock_irqsave_lock(&table_lock);
-	task = &task_table[id];
-	core_id = task->last_core;
+	if (BUILTIN_EXPECT((gang < 0) || (gang >= MAX_GANGS), 0))
+		return -EINVAL;
 
-	if (task->status == TASK_BLOCKED) {
-		LOG_DEBUG("wakeup task %d on core %d\n", id, core_id);
+	spinlock_irqsave_lock(&gang_lock);
 
-		task->status = TASK_READY;
-		spinlock_irqsave_unlock(&table_lock);
+	if (BUILTIN_EXPECT(!gang_members[gang], 0)) {
+		spinlock_irqsave_unlock(&gang_lock);
+		return -EINVAL;
+	}
 
-		ret = 0;
+	for(core_id=0; core_id<nr_core_slots; core_id++) {
+		if (!readyqueues[core_id].idle)
+			continue;
 
 		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+		if ((task = readyqueues[core_id].gang[gang]) != NULL) {
+			readyqueues[core_id].gang[gang] = NULL;
+			readyqueues[core_id].nr_gang--;
+			if (!readyqueues[core_id].nr_gang)
+				readyqueues[core_id].gang_timer = 0;
+			task->gang = 0;
+		}
+		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	}
 
-		// if task is in timer queue, remove it
-		if (task->flags & TASK_TIMER) {
-			task->flags &= ~TASK_TIMER;
+	gang_unregister(gang);
 
-			timer_queue_remove(core_id, task);
-		}
+	spinlock_irqsave_unlock(&gang_lock);
 
-		// add task to the ready queue
-		readyqueues_push_back(core_id, task);
+	return 0;
+}
 
-		// increase the number of ready tasks
-		readyqueues[core_id].nr_tasks++;
+int get_task_affinity(tid_t id, uint64_t* affinity)
+{
+	task_t* task;
+	int ret = -EINVAL;
 
-		// should we wakeup the core?
-		if (readyqueues[core_id].nr_tasks == 1)
-			wakeup_core(core_id);
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task || !affinity, 0))
+		return -EINVAL;
 
-		LOG_DEBUG("update nr_tasks on core %d to %d\n", core_id, readyqueues[core_id].nr_tasks);
+	mcs_spinlock_irqsave_lock(&table_lock);
 
-		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
-	} else {
-		spinlock_irqsave_unlock(&table_lock);
+	if ((task->status != TASK_INVALID) && (task->status != TASK_IDLE)) {
+		memcpy(affinity, task->affinity, sizeof(task->affinity));
+		ret = 0;
 	}
 
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
 	return ret;
 }
 
-
-int block_task(tid_t id)
+int set_task_timeslice(tid_t id, uint32_t us)
 {
 	task_t* task;
-	uint32_t core_id;
 	int ret = -EINVAL;
-	uint8_t flags;
 
-	flags = irq_nested_disable();
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task, 0))
+		return -EINVAL;
 
-	task = &task_table[id];
-	core_id = task->last_core;
+	mcs_spinlock_irqsave_lock(&table_lock);
 
-	if (task->status == TASK_RUNNING) {
-		LOG_DEBUG("block task %d on core %d\n", id, core_id);
+	if ((task->status != TASK_INVALID) && (task->status != TASK_IDLE) && (task->status != TASK_FINISHED)) {
+		task->timeslice = us;
+		ret = 0;
+	}
 
-		task->status = TASK_BLOCKED;
+	mcs_spinlock_irqsave_unlock(&table_lock);
 
-		spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	return ret;
+}
 
-		// remove task from ready queue
-		readyqueues_remove(core_id, task);
+int set_task_timer_slack(tid_t id, uint32_t ns)
+{
+	task_t* task;
+	int ret = -EINVAL;
 
-		// reduce the number of ready tasks
-		readyqueues[core_id].nr_tasks--;
-		LOG_DEBUG("update nr_tasks on core %d to %d\n", core_id, readyqueues[core_id].nr_tasks);
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task, 0))
+		return -EINVAL;
 
-		spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+	mcs_spinlock_irqsave_lock(&table_lock);
 
+	if ((task->status != TASK_INVALID) && (task->status != TASK_IDLE) && (task->status != TASK_FINISHED)) {
+		task->timer_slack = ns;
 		ret = 0;
 	}
 
-	irq_nested_enable(flags);
+	mcs_spinlock_irqsave_unlock(&table_lock);
 
 	return ret;
 }
 
-
-int block_current_task(void)
+int set_prio_timeslice(uint8_t prio, uint32_t us)
 {
-	return block_task(per_core(current_task)->id);
-}
+	if (BUILTIN_EXPECT(!prio || (prio > MAX_PRIO), 0))
+		return -EINVAL;
 
+	prio_timeslice[prio-1] = us;
 
-int set_timer(uint64_t deadline)
+	return 0;
+}
+
+int get_task_stats(tid_t id, task_stats_t* stats)
 {
-	task_t* curr_task;
-	uint32_t core_id;
-	uint8_t flags;
+	task_t* task;
+	uint64_t freq;
 	int ret = -EINVAL;
 
-	flags = irq_nested_disable();
-
-	curr_task = per_core(current_task);
-	core_id = CORE_ID;
-
-	if (curr_task->status == TASK_RUNNING) {
-		// blocks task and removes from ready queue
-		block_task(curr_task->id);
-
-		curr_task->flags |= TASK_TIMER;
-		curr_task->timeout = deadline;
+	task = task_by_id(id);
+	if (BUILTIN_EXPECT(!task || !stats, 0))
+		return -EINVAL;
 
-		timer_queue_push(core_id, curr_task);
+	mcs_spinlock_irqsave_lock(&table_lock);
 
+	if (task->status != TASK_INVALID) {
+		memcpy(stats, &task->stats, sizeof(task->stats));
+		// add the current time slice
+		if (task->status == TASK_RUNNING)
+			stats->run_time += get_rdtsc() - task->stats_tsc;
 		ret = 0;
-	} else {
-		LOG_INFO("Task is already blocked. No timer will be set!\n");
 	}
 
-	irq_nested_enable(flags);
+	mcs_spinlock_irqsave_unlock(&table_lock);
+
+	if (!ret) {
+		// convert TSC cycles to microseconds
+		freq = clocksource_tsc_hz() / 1000000ULL;
+		if (BUILTIN_EXPECT(!freq, 0))
+			freq = 1;
+		stats->run_time /= freq;
+		stats->wait_time /= freq;
+	}
 
 	return ret;
 }
 
+int get_core_stats(uint32_t core_id, core_stats_t* stats)
+{
+	if (BUILTIN_EXPECT((core_id >= nr_core_slots) || !readyqueues[core_id].idle || !stats, 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&readyqueues[core_id].lock);
+	memcpy(stats, core_stats+core_id, sizeof(core_stats_t));
+	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
+
+	stats->steal_time = get_steal_time(core_id) / 1000ULL;
 
-void check_timers(void)
+	return 0;
+}
+
+void sched_stats_dump(void)
 {
-	readyqueues_t* readyqueue = &readyqueues[CORE_ID];
-	spinlock_irqsave_lock(&readyqueue->lock);
+	task_stats_t stats;
+	core_stats_t cstats;
+	tid_t i;
 
-	// since IRQs are disabled, get_clock_tick() won't increase here
-	const uint64_t current_tick = get_clock_tick();
+	for(i=0; i<nr_core_slots; i++) {
+		if (get_core_stats(i, &cstats))
+			continue;
 
-	// wakeup tasks whose deadline has expired
-	task_t* task;
-	while ((task = readyqueue->timers.first) && (task->timeout <= current_tick))
-	{
-		// pops task from timer queue, so next iteration has new first element
-		wakeup_task(task->id);
+		LOG_INFO("core %u: %llu switches, %llu steals, %llu migrations, %llu us stolen by the host\n",
+			i, cstats.nr_switches, cstats.nr_steals, cstats.nr_migrations, cstats.steal_time);
 	}
 
-#ifdef DYNAMIC_TICKS
-	task = readyqueue->timers.first;
-	if (task) {
-		update_timer(task);
+	for(i=0; i<nr_used_ids; i++) {
+		if (get_task_stats(i, &stats))
+			continue;
+
+		LOG_INFO("task %u: run %llu us, wait %llu us, %llu voluntary, %llu involuntary, %llu migrations\n",
+			i, stats.run_time, stats.wait_time, stats.nr_voluntary,
+			stats.nr_involuntary, stats.nr_migrations);
 	}
-#endif
+}
 
-	spinlock_irqsave_unlock(&readyqueue->lock);
+
+/** @brief Account a context switch from prev to next
+ *
+ * Has to be called with the lock of the readyqueue.
+ */
+static inline void sched_stats_switch(uint32_t core_id, task_t* prev, task_t* next)
+{
+	const uint64_t now = get_rdtsc();
+	const uint64_t steal_ns = get_steal_time(core_id);
+	const uint64_t elapsed = now - prev->stats_tsc;
+	uint64_t stolen = 0;
+
+	/*
+	 * prev runs since the last context switch of this core => the time,
+	 * which the host has stolen in the meantime, isn't charged to prev
+	 */
+	if (steal_ns > readyqueues[core_id].steal_ns) {
+		stolen = ns_to_tsc(steal_ns - readyqueues[core_id].steal_ns);
+		if (stolen > elapsed)
+			stolen = elapsed;
+	}
+	readyqueues[core_id].steal_ns = steal_ns;
+	if (elapsed)
+		readyqueues[core_id].steal_pct = (3 * readyqueues[core_id].steal_pct + (uint32_t) ((stolen * 100) / elapsed)) / 4;
+
+	prev->stats.run_time += elapsed - stolen;
+	prev->stats_tsc = now;
+	// a preempted task is still ready
+	if (prev->status == TASK_READY)
+		prev->stats.nr_involuntary++;
+	else if (prev->status != TASK_IDLE)
+		prev->stats.nr_voluntary++;
+
+	// the idle task doesn't wait for the CPU
+	if (next->status != TASK_IDLE)
+		next->stats.wait_time += now - next->stats_tsc;
+	next->stats_tsc = now;
+
+	core_stats[core_id].nr_switches++;
 }
 
+size_t** preempt_scheduler(void)
+{
+	// the interrupts are disabled => the flag belongs to this core
+	readyqueues[CORE_ID].preempt = 1;
+
+	return scheduler();
+}
 
 size_t** scheduler(void)
 {
 	task_t* orig_task;
 	task_t* curr_task;
+	task_t* dl_task;
+	task_t* gang_member;
 	const uint32_t core_id = CORE_ID;
+	const uint64_t dl_timer = readyqueues[core_id].dl_timer;
+	const uint64_t gang_timer = readyqueues[core_id].gang_timer;
+	const uint64_t slice_timer = readyqueues[core_id].slice_timer;
 	uint64_t prio;
+	uint8_t preempt;
 
 	orig_task = curr_task = per_core(current_task);
 	curr_task->last_core = core_id;
 
 	spinlock_irqsave_lock(&readyqueues[core_id].lock);
 
+	preempt = readyqueues[core_id].preempt;
+	readyqueues[core_id].preempt = 0;
+
 	/* signalizes that this task could be realized */
 	if (curr_task->status == TASK_FINISHED)
 		readyqueues[core_id].old_task = curr_task;
@@ -822,19 +2817,105 @@ size_t** scheduler(void)
 		set_per_core(current_task, curr_task);
 	}
 
+	readyqueues[core_id].dl_timer = 0;
+
+	// the slot of the gangs has to be known also while an EDF task runs
+	gang_member = readyqueues[core_id].nr_gang ? gang_slot_member(core_id) : NULL;
+
+	// EDF tasks precede all priorities
+	if (is_dl_task(curr_task) || readyqueues[core_id].edf.first) {
+		const uint64_t now = get_rdtsc();
+
+		// account the runtime of the current EDF task, also if it blocks
+		if (is_dl_task(curr_task) && (curr_task->status != TASK_FINISHED)) {
+			curr_task->dl.budget -= (int64_t) (now - curr_task->dl.tsc);
+			curr_task->dl.tsc = now;
+
+			if ((curr_task->status == TASK_RUNNING) && (curr_task->dl.budget <= 0))
+				dl_task_throttle(core_id, curr_task);
+		}
+
+		// tasks, which were woken up without budget, wait for their replenishment
+		while ((dl_task = readyqueues[core_id].edf.first) && (dl_task->dl.budget <= 0)) {
+			task_list_pop_front(&readyqueues[core_id].edf);
+			dl_task_throttle(core_id, dl_task);
+		}
+
+		// the current EDF task has still the earliest deadline
+		if ((curr_task->status == TASK_RUNNING) && is_dl_task(curr_task)
+		    && (!dl_task || (curr_task->dl.abs_deadline <= dl_task->dl.abs_deadline))) {
+			readyqueues[core_id].dl_timer = now + curr_task->dl.budget;
+			goto get_task_out;
+		}
+
+		if (dl_task) {
+			if (curr_task->status == TASK_RUNNING) {
+				curr_task->status = TASK_READY;
+				readyqueues[core_id].old_task = curr_task;
+			}
+
+			curr_task = task_list_pop_front(&readyqueues[core_id].edf);
+			curr_task->status = TASK_RUNNING;
+			curr_task->last_tsc = now;
+			curr_task->dl.tsc = now;
+			readyqueues[core_id].dl_timer = now + curr_task->dl.budget;
+			set_per_core(current_task, curr_task);
+			goto get_task_out;
+		}
+	}
+
 	// determine highest priority
 	prio = msb(readyqueues[core_id].prio_bitmap);
 
+	// within its slot, a gang member precedes all tasks of the same or a lower priority
+	if (gang_member) {
+		if ((gang_member == curr_task) && (curr_task->status == TASK_RUNNING)
+		    && ((prio > MAX_PRIO) || (prio <= curr_task->prio)))
+			goto get_task_out;
+
+		if ((gang_member != curr_task) && (gang_member->status == TASK_READY)
+		    && (gang_member->prio == prio) && ((curr_task->status != TASK_RUNNING) || (curr_task->prio <= prio))
+		    && readyqueues_contains(core_id, gang_member)) {
+			if (curr_task->status == TASK_RUNNING) {
+				curr_task->status = TASK_READY;
+				readyqueues[core_id].old_task = curr_task;
+			}
+
+			readyqueues_remove(core_id, gang_member);
+			curr_task = gang_member;
+			curr_task->status = TASK_RUNNING;
+			curr_task->last_tsc = get_rdtsc();
+			set_per_core(current_task, curr_task);
+			goto get_task_out;
+		}
+	}
+
+	// a running task, whose affinity excludes this core, has to leave it (also if the core is offline)
+	const int must_leave = (curr_task->status == TASK_RUNNING)
+		&& (!core_allowed(curr_task->affinity, core_id) || core_is_offline(core_id));
+
 	const int readyqueue_empty = prio > MAX_PRIO;
 	if (readyqueue_empty) {
 
-		if ((curr_task->status == TASK_RUNNING) || (curr_task->status == TASK_IDLE))
+		if (((curr_task->status == TASK_RUNNING) && !must_leave) || (curr_task->status == TASK_IDLE))
 			goto get_task_out;
+
+		// finish_task_switch() migrates the current task
+		if (must_leave) {
+			curr_task->status = TASK_READY;
+			readyqueues[core_id].old_task = curr_task;
+		}
+
 		curr_task = readyqueues[core_id].idle;
 		set_per_core(current_task, curr_task);
 	} else {
 		// Does the current task have an higher priority? => no task switch
-		if ((curr_task->prio > prio) && (curr_task->status == TASK_RUNNING))
+		if ((curr_task->prio > prio) && (curr_task->status == TASK_RUNNING) && !must_leave)
+			goto get_task_out;
+
+		// round robin: at a preemption point, the current task keeps the core until its time slice expires
+		if (preempt && (curr_task->prio == prio) && (curr_task->status == TASK_RUNNING) && !must_leave
+		    && !curr_task->gang && (get_rdtsc() < curr_task->last_tsc + timeslice_tsc(curr_task)))
 			goto get_task_out;
 
 		// mark current task for later cleanup by finish_task_switch()
@@ -864,13 +2945,25 @@ size_t** scheduler(void)
 
 		// finally make it the new current task
 		curr_task->status = TASK_RUNNING;
-#ifdef DYNAMIC_TICKS
 		curr_task->last_tsc = get_rdtsc();
-#endif
 		set_per_core(current_task, curr_task);
 	}
 
 get_task_out:
+	readyqueues[core_id].curr_task = curr_task;
+	if (curr_task != orig_task) {
+		readyqueues[core_id].prev_task = orig_task;
+		sched_stats_switch(core_id, orig_task, curr_task);
+		pmu_switch(orig_task, curr_task);
+	}
+
+	slice_update(core_id);
+
+	// the budget of an EDF task, the slots of the gangs and the time slices are enforced by the timer
+	if ((dl_timer != readyqueues[core_id].dl_timer) || (gang_timer != readyqueues[core_id].gang_timer)
+	    || (slice_timer != readyqueues[core_id].slice_timer))
+		update_timer(core_id);
+
 	spinlock_irqsave_unlock(&readyqueues[core_id].lock);
 
 	if (curr_task != orig_task) {
@@ -893,11 +2986,11 @@ int get_task(tid_t id, task_t** task)
 		return -ENOENT;
 	}
 
-	if (BUILTIN_EXPECT(task_table[id].status == TASK_INVALID, 0)) {
+	*task = task_by_id(id);
+	if (BUILTIN_EXPECT(!*task || ((*task)->status == TASK_INVALID), 0)) {
+		*task = NULL;
 		return -EINVAL;
 	}
 
-	*task = &task_table[id];
-
 	return 0;
 }
@@ -26,6 +26,8 @@
  */
 
 #include <hermit/stdlib.h>
+#include <hermit/tasks.h>
+#include <hermit/time.h>
 
 struct itimerval;
 
@@ -38,3 +40,28 @@ int setitimer(int which, const struct itimerval *restrict value, struct itimerva
 {
 	return 0;
 }
+
+int timer_wait_ns(uint64_t ns)
+{
+	task_t* curr_task = per_core(current_task);
+	const uint64_t deadline = get_rdtsc() + ns_to_tsc(ns);
+
+	if (curr_task->status == TASK_IDLE) {
+		// the idle task isn't allowed to block
+		while (get_rdtsc() < deadline) {
+			check_workqueues();
+			PAUSE;
+		}
+
+		return 0;
+	}
+
+	// the timer wheel could wake up the task too early
+	while (get_rdtsc() < deadline) {
+		if (set_timer_tsc(deadline))
+			break;
+		reschedule();
+	}
+
+	return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/tmpfs.h>
+#include <hermit/semaphore.h>
+#include <hermit/memory.h>
+#include <hermit/vma.h>
+#include <hermit/errno.h>
+#include <asm/page.h>
+
+/// flags of the host (Linux)
+#define TMPFS_O_ACCMODE		3
+#define TMPFS_O_RDONLY		0
+#define TMPFS_O_WRONLY		1
+#define TMPFS_O_CREAT		0100
+#define TMPFS_O_EXCL		0200
+#define TMPFS_O_TRUNC		01000
+#define TMPFS_O_APPEND		02000
+
+#define TMPFS_SEEK_SET		0
+#define TMPFS_SEEK_CUR		1
+#define TMPFS_SEEK_END		2
+
+#define TMPFS_CHUNK_PAGES	(TMPFS_CHUNK_SIZE >> PAGE_BITS)
+
+#ifndef MIN
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)		((a) > (b) ? (a) : (b))
+#endif
+
+typedef struct tmpfs_file {
+	/// NULL, if the file is unlinked
+	char* name;
+	/// number of descriptors
+	uint32_t refs;
+	size_t size;
+	/// contents, a missing chunk is a hole
+	char** chunks;
+	size_t nr_chunks;
+	struct tmpfs_file* next;
+} tmpfs_file_t;
+
+typedef struct tmpfs_fd {
+	tmpfs_file_t* file;
+	off_t pos;
+	int flags;
+} tmpfs_fd_t;
+
+static tmpfs_fd_t fds[TMPFS_MAX_FILES];
+static tmpfs_file_t* files = NULL;
+static sem_t tmpfs_sem = SEM_INIT(1);
+
+int tmpfs_path(const char* name)
+{
+	const size_t len = sizeof(TMPFS_PATH) - 1;
+
+	if (!len || !name)
+		return 0;
+
+	return !strncmp(name, TMPFS_PATH, len) && (name[len] == '/') && name[len+1];
+}
+
+static inline tmpfs_fd_t* tmpfs_get(int fd)
+{
+	fd &= ~TMPFS_FD_BIT;
+
+	if ((fd < 0) || (fd >= TMPFS_MAX_FILES) || !fds[fd].file)
+		return NULL;
+
+	return fds + fd;
+}
+
+static tmpfs_file_t* tmpfs_lookup(const char* name)
+{
+	tmpfs_file_t* file;
+
+	for (file = files; file; file = file->next) {
+		if (!strcmp(file->name, name))
+			return file;
+	}
+
+	return NULL;
+}
+
+static char* chunk_alloc(void)
+{
+	char* chunk = page_alloc(TMPFS_CHUNK_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+
+	if (BUILTIN_EXPECT(!chunk, 0))
+		return NULL;
+
+	// page_alloc() books the pages for the drivers
+	mem_account(MEM_TAG_DRIVER, -(int64_t) TMPFS_CHUNK_PAGES, 0);
+	mem_account(MEM_TAG_TMPFS, TMPFS_CHUNK_PAGES, 0);
+
+	// a partially written chunk must not reveal stale data
+	memset(chunk, 0x00, TMPFS_CHUNK_SIZE);
+
+	return chunk;
+}
+
+static void chunk_free(char* chunk)
+{
+	page_free(chunk, TMPFS_CHUNK_SIZE);
+	mem_account(MEM_TAG_DRIVER, TMPFS_CHUNK_PAGES, 0);
+	mem_account(MEM_TAG_TMPFS, -(int64_t) TMPFS_CHUNK_PAGES, 0);
+}
+
+/// release all chunks behind size
+static void file_truncate(tmpfs_file_t* file, size_t size)
+{
+	size_t i;
+
+	for (i = (size + TMPFS_CHUNK_SIZE - 1) >> TMPFS_CHUNK_BITS; i < file->nr_chunks; i++) {
+		if (file->chunks[i]) {
+			chunk_free(file->chunks[i]);
+			file->chunks[i] = NULL;
+		}
+	}
+
+	// the tail of the last chunk is read as hole, if the file grows again
+	if ((size & (TMPFS_CHUNK_SIZE - 1)) && (size < file->size)) {
+		char* chunk = file->chunks[size >> TMPFS_CHUNK_BITS];
+
+		if (chunk)
+			memset(chunk + (size & (TMPFS_CHUNK_SIZE - 1)), 0x00,
+				TMPFS_CHUNK_SIZE - (size & (TMPFS_CHUNK_SIZE - 1)));
+	}
+
+	file->size = size;
+}
+
+static void file_release(tmpfs_file_t* file)
+{
+	file_truncate(file, 0);
+	kfree(file->chunks);
+	kfree(file);
+}
+
+/// grow the chunk array, so that it contains index
+static int file_reserve(tmpfs_file_t* file, size_t index)
+{
+	size_t nr_chunks;
+	char** chunks;
+
+	if (index < file->nr_chunks)
+		return 0;
+
+	nr_chunks = MAX(MAX(2 * file->nr_chunks, 16UL), index + 1);
+	chunks = kmalloc(nr_chunks * sizeof(char*));
+	if (BUILTIN_EXPECT(!chunks, 0))
+		return -ENOMEM;
+
+	if (file->nr_chunks)
+		memcpy(chunks, file->chunks, file->nr_chunks * sizeof(char*));
+	memset(chunks + file->nr_chunks, 0x00, (nr_chunks - file->nr_chunks) * sizeof(char*));
+
+	kfree(file->chunks);
+	file->chunks = chunks;
+	file->nr_chunks = nr_chunks;
+
+	return 0;
+}
+
+static ssize_t file_read(tmpfs_file_t* file, char* buf, size_t len, size_t pos)
+{
+	size_t done = 0;
+
+	if (pos >= file->size)
+		return 0;
+	len = MIN(len, file->size - pos);
+
+	while (done < len) {
+		size_t index = pos >> TMPFS_CHUNK_BITS;
+		size_t off = pos & (TMPFS_CHUNK_SIZE - 1);
+		size_t n = MIN(len - done, TMPFS_CHUNK_SIZE - off);
+
+		if ((index < file->nr_chunks) && file->chunks[index])
+			memcpy(buf + done, file->chunks[index] + off, n);
+		else
+			memset(buf + done, 0x00, n);
+
+		done += n;
+		pos += n;
+	}
+
+	return done;
+}
+
+static ssize_t file_write(tmpfs_file_t* file, const char* buf, size_t len, size_t pos)
+{
+	size_t done = 0;
+
+	if (!len)
+		return 0;
+
+	if (file_reserve(file, (pos + len - 1) >> TMPFS_CHUNK_BITS))
+		return -ENOMEM;
+
+	while (done < len) {
+		size_t index = pos >> TMPFS_CHUNK_BITS;
+		size_t off = pos & (TMPFS_CHUNK_SIZE - 1);
+		size_t n = MIN(len - done, TMPFS_CHUNK_SIZE - off);
+
+		if (!file->chunks[index]) {
+			file->chunks[index] = chunk_alloc();
+			if (BUILTIN_EXPECT(!file->chunks[index], 0))
+				break;
+		}
+
+		memcpy(file->chunks[index] + off, buf + done, n);
+
+		done += n;
+		pos += n;
+	}
+
+	file->size = MAX(file->size, pos);
+
+	return done ? (ssize_t) done : -ENOMEM;
+}
+
+int tmpfs_open(const char* name, int flags, int mode)
+{
+	tmpfs_file_t* file;
+	int fd, ret;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	for (fd = 0; (fd < TMPFS_MAX_FILES) && fds[fd].file; fd++)
+		;
+	if (BUILTIN_EXPECT(fd >= TMPFS_MAX_FILES, 0)) {
+		ret = -ENFILE;
+		goto out;
+	}
+
+	file = tmpfs_lookup(name);
+	if (file) {
+		if ((flags & (TMPFS_O_CREAT|TMPFS_O_EXCL)) == (TMPFS_O_CREAT|TMPFS_O_EXCL)) {
+			ret = -EEXIST;
+			goto out;
+		}
+		if ((flags & TMPFS_O_TRUNC) && ((flags & TMPFS_O_ACCMODE) != TMPFS_O_RDONLY))
+			file_truncate(file, 0);
+	} else {
+		if (!(flags & TMPFS_O_CREAT)) {
+			ret = -ENOENT;
+			goto out;
+		}
+
+		file = kmalloc(sizeof(tmpfs_file_t));
+		if (BUILTIN_EXPECT(!file, 0)) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		memset(file, 0x00, sizeof(tmpfs_file_t));
+
+		file->name = kmalloc(strlen(name) + 1);
+		if (BUILTIN_EXPECT(!file->name, 0)) {
+			kfree(file);
+			ret = -ENOMEM;
+			goto out;
+		}
+		strcpy(file->name, name);
+
+		file->next = files;
+		files = file;
+	}
+
+	file->refs++;
+	fds[fd].file = file;
+	fds[fd].pos = 0;
+	fds[fd].flags = flags;
+	ret = fd | TMPFS_FD_BIT;
+
+out:
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
+
+ssize_t tmpfs_read(int fd, void* buf, size_t len)
+{
+	tmpfs_fd_t* desc;
+	ssize_t ret;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	desc = tmpfs_get(fd);
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & TMPFS_O_ACCMODE) == TMPFS_O_WRONLY), 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	ret = file_read(desc->file, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+out:
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
+
+ssize_t tmpfs_write(int fd, const void* buf, size_t len)
+{
+	tmpfs_fd_t* desc;
+	ssize_t ret;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	desc = tmpfs_get(fd);
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & TMPFS_O_ACCMODE) == TMPFS_O_RDONLY), 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (desc->flags & TMPFS_O_APPEND)
+		desc->pos = desc->file->size;
+
+	ret = file_write(desc->file, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+out:
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
+
+ssize_t tmpfs_pread(int fd, void* buf, size_t len, off_t offset)
+{
+	tmpfs_fd_t* desc;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	desc = tmpfs_get(fd);
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & TMPFS_O_ACCMODE) == TMPFS_O_WRONLY), 0))
+		ret = -EBADF;
+	else
+		ret = file_read(desc->file, buf, len, offset);
+
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
+
+ssize_t tmpfs_pwrite(int fd, const void* buf, size_t len, off_t offset)
+{
+	tmpfs_fd_t* desc;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	desc = tmpfs_get(fd);
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & TMPFS_O_ACCMODE) == TMPFS_O_RDONLY), 0))
+		ret = -EBADF;
+	else
+		ret = file_write(desc->file, buf, len, offset);
+
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
+
+off_t tmpfs_lseek(int fd, off_t offset, int whence)
+{
+	tmpfs_fd_t* desc;
+	off_t ret;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	desc = tmpfs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	switch(whence) {
+	case TMPFS_SEEK_SET:
+		ret = offset;
+		break;
+	case TMPFS_SEEK_CUR:
+		ret = desc->pos + offset;
+		break;
+	case TMPFS_SEEK_END:
+		ret = (off_t) desc->file->size + offset;
+		break;
+	default:
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (BUILTIN_EXPECT(ret < 0, 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	desc->pos = ret;
+
+out:
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
+
+int tmpfs_close(int fd)
+{
+	tmpfs_fd_t* desc;
+	tmpfs_file_t* file;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	desc = tmpfs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		sem_post(&tmpfs_sem);
+		return -EBADF;
+	}
+
+	file = desc->file;
+	desc->file = NULL;
+
+	file->refs--;
+	if (!file->refs && !file->name)
+		file_release(file);
+
+	sem_post(&tmpfs_sem);
+
+	return 0;
+}
+
+int tmpfs_unlink(const char* name)
+{
+	tmpfs_file_t* file;
+	tmpfs_file_t** prev;
+	int ret = -ENOENT;
+
+	sem_wait(&tmpfs_sem, 0);
+
+	for (prev = &files; (file = *prev) != NULL; prev = &file->next) {
+		if (strcmp(file->name, name))
+			continue;
+
+		*prev = file->next;
+		kfree(file->name);
+		file->name = NULL;
+
+		// open descriptors keep the contents until the last close
+		if (!file->refs)
+			file_release(file);
+
+		ret = 0;
+		break;
+	}
+
+	sem_post(&tmpfs_sem);
+
+	return ret;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/uhyve_io.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/vma.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/uhyve.h>
+#include <asm/irq.h>
+#include <asm/irqflags.h>
+#include <asm/page.h>
+
+/** @brief Request of a task, which waits for its completion */
+typedef struct uhyve_io_req {
+	task_t* task;
+	volatile uint8_t done;
+	int64_t res;
+} uhyve_io_req_t;
+
+/** @brief Task, which waits for a free slot */
+typedef struct uhyve_io_waiter {
+	task_t* task;
+	struct uhyve_io_waiter* next;
+} uhyve_io_waiter_t;
+
+static uhyve_io_sq_t* sq = NULL;
+static uhyve_io_cq_t* cq = NULL;
+static uint8_t enabled = 0;
+/// submitted requests without completion, limited by the size of the CQ
+static uint32_t inflight = 0;
+static uhyve_io_waiter_t* waiters = NULL;
+/// protects both rings, is also taken by the interrupt handler
+static spinlock_irqsave_t io_lock = SPINLOCK_IRQSAVE_INIT;
+
+static void uhyve_io_handler(struct state* s)
+{
+	uhyve_io_waiter_t* w;
+	uhyve_io_cqe_t* cqe;
+	uhyve_io_req_t* req;
+
+	spinlock_irqsave_lock(&io_lock);
+
+	while (cq->hdr.head != cq->hdr.tail) {
+		// read the entry after the tail
+		rmb();
+		cqe = cq->cqe + (cq->hdr.head % UHYVE_IO_RING_SIZE);
+		req = (uhyve_io_req_t*) (size_t) cqe->user_data;
+		req->res = cqe->res;
+		req->done = 1;
+		wakeup_task(req->task->id);
+
+		cq->hdr.head++;
+		inflight--;
+	}
+
+	for(w = waiters; w; w = w->next)
+		wakeup_task(w->task->id);
+	waiters = NULL;
+
+	spinlock_irqsave_unlock(&io_lock);
+}
+
+int uhyve_io_init(void)
+{
+	volatile uhyve_ioinfo_t info;
+
+	if (!is_uhyve())
+		return -ENOSYS;
+
+	sq = page_alloc(sizeof(uhyve_io_sq_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	cq = page_alloc(sizeof(uhyve_io_cq_t), VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!sq || !cq, 0))
+		goto out;
+
+	memset(sq, 0x00, sizeof(uhyve_io_sq_t));
+	memset(cq, 0x00, sizeof(uhyve_io_cq_t));
+
+	// the host could complete requests immediately after the announcement
+	irq_install_handler(32+UHYVE_IRQ_IO, uhyve_io_handler);
+
+	memset((void*) &info, 0x00, sizeof(info));
+	info.version = UHYVE_IO_VERSION;
+	info.ring_size = UHYVE_IO_RING_SIZE;
+	info.sq = virt_to_phys((size_t) sq);
+	info.cq = virt_to_phys((size_t) cq);
+
+	uhyve_send(UHYVE_PORT_IORING, (unsigned)virt_to_phys((size_t)&info));
+
+	if (info.version_ack == UHYVE_IO_VERSION) {
+		enabled = 1;
+		LOG_INFO("uhyve: asynchronous I/O ring with %u entries uses irq %d\n", UHYVE_IO_RING_SIZE, UHYVE_IRQ_IO);
+		return 0;
+	}
+
+	LOG_INFO("uhyve: host doesn't support the asynchronous I/O ring\n");
+
+out:
+	if (sq)
+		page_free(sq, sizeof(uhyve_io_sq_t));
+	if (cq)
+		page_free(cq, sizeof(uhyve_io_cq_t));
+	sq = NULL;
+	cq = NULL;
+
+	return -ENOSYS;
+}
+
+int uhyve_io_enabled(void)
+{
+	// the idle task and code with disabled interrupts mustn't block
+	return enabled && is_irq_enabled() && (per_core(current_task)->status != TASK_IDLE);
+}
+
+int64_t uhyve_io_submit(uint32_t op, int32_t fd, uint64_t addr, uint64_t len, int64_t off)
+{
+	task_t* curr_task = per_core(current_task);
+	uhyve_io_waiter_t waiter;
+	uhyve_io_waiter_t** w;
+	uhyve_io_sqe_t* sqe;
+	uhyve_io_req_t req;
+
+	req.task = curr_task;
+	req.done = 0;
+	req.res = -EIO;
+
+	spinlock_irqsave_lock(&io_lock);
+
+	// the CQ has to be able to take all completions
+	while (inflight >= UHYVE_IO_RING_SIZE) {
+		waiter.task = curr_task;
+		waiter.next = waiters;
+		waiters = &waiter;
+
+		block_current_task();
+		spinlock_irqsave_unlock(&io_lock);
+		reschedule();
+		spinlock_irqsave_lock(&io_lock);
+
+		for(w = &waiters; *w; w = &(*w)->next) {
+			if (*w == &waiter) {
+				*w = waiter.next;
+				break;
+			}
+		}
+	}
+	inflight++;
+
+	sqe = sq->sqe + (sq->hdr.tail % UHYVE_IO_RING_SIZE);
+	sqe->user_data = (uint64_t) (size_t) &req;
+	sqe->op = op;
+	sqe->fd = fd;
+	sqe->addr = addr;
+	sqe->len = len;
+	sqe->off = off;
+
+	// block before the publication, the completion may arrive at once
+	block_current_task();
+
+	// publish the entry, afterwards check if the host sleeps
+	wmb();
+	sq->hdr.tail++;
+	mb();
+	if (sq->hdr.flags & UHYVE_IO_F_NEED_WAKEUP)
+		uhyve_send(UHYVE_PORT_IORING, 0);
+
+	spinlock_irqsave_unlock(&io_lock);
+	reschedule();
+
+	spinlock_irqsave_lock(&io_lock);
+	while (!req.done) {
+		block_current_task();
+		spinlock_irqsave_unlock(&io_lock);
+		reschedule();
+		spinlock_irqsave_lock(&io_lock);
+	}
+	spinlock_irqsave_unlock(&io_lock);
+
+	return req.res;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file kernel/vclock.c
+ * @brief Initialization of the clock page
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/syscall.h>
+#include <hermit/vclock.h>
+#include <hermit/clocksource.h>
+#include <hermit/time.h>
+#include <hermit/processor.h>
+#include <hermit/vma.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/page.h>
+
+const vclock_t* vclock_page = NULL;
+
+int vclock_init(void)
+{
+	const clocksource_t* cs = clocksource_get();
+	uint64_t freq_hz, tsc, ns;
+	vclock_t* vc;
+
+	if (vclock_page)
+		return 0;
+
+	freq_hz = clocksource_tsc_hz();
+	if (BUILTIN_EXPECT(!freq_hz, 0))
+		return -EINVAL;
+
+	vc = (vclock_t*) palloc(PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!vc, 0))
+		return -ENOMEM;
+
+	memset(vc, 0x00, PAGE_SIZE);
+	vc->shift = VCLOCK_SHIFT;
+	vc->mult = (1000000000ULL << VCLOCK_SHIFT) / freq_hz;
+	vc->freq_hz = freq_hz;
+	// the counter value, at which the clock source has started
+	tsc = vclock_read();
+	ns = clocksource_ns();
+	vc->base_tsc = tsc - ns_to_tsc(ns);
+	if (cs && (cs->vclock_mode == VCLOCK_MODE_PVCLOCK) && cs->pvclock) {
+		vc->mode = VCLOCK_MODE_PVCLOCK;
+		vc->pvclock = (const volatile pvclock_vcpu_time_info_t*) cs->pvclock;
+		vc->pvclock_base = cs->offset;
+	}
+	vc->wall_ns = 1000ULL * get_boot_time();
+	vc->version = VCLOCK_VERSION;
+
+	// from now on, the page is only read
+	page_set_flags((size_t) vc, 1, VMA_READ|VMA_CACHEABLE);
+
+	mb();
+	vclock_page = vc;
+
+	LOG_INFO("vclock: mode %u, mult %zd, shift %u, wall clock at boot %zd s\n",
+		vc->mode, vc->mult, vc->shift, vc->wall_ns / 1000000000ULL);
+
+	return 0;
+}
+
+void vclock_set_wall(uint64_t wall_ns)
+{
+	vclock_t* vc = (vclock_t*) vclock_page;
+
+	if (BUILTIN_EXPECT(!vc, 0))
+		return;
+
+	// a single store => readers see either the old or the new time
+	page_set_flags((size_t) vc, 1, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
+	*((volatile uint64_t*) &vc->wall_ns) = wall_ns;
+	page_set_flags((size_t) vc, 1, VMA_READ|VMA_CACHEABLE);
+}
+
+const vclock_t* sys_vclock(void)
+{
+	return vclock_page;
+}
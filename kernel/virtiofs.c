@@ -0,0 +1,904 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/tasks.h>
+#include <hermit/virtiofs.h>
+#include <hermit/fuse_kernel.h>
+#include <hermit/semaphore.h>
+#include <hermit/logging.h>
+#include <hermit/errno.h>
+#include <asm/atomic.h>
+
+/// flags of the host (Linux)
+#define VIRTIOFS_O_ACCMODE	3
+#define VIRTIOFS_O_RDONLY	0
+#define VIRTIOFS_O_WRONLY	1
+#define VIRTIOFS_O_CREAT	0100
+#define VIRTIOFS_O_EXCL		0200
+#define VIRTIOFS_O_NOCTTY	0400
+#define VIRTIOFS_O_TRUNC	01000
+#define VIRTIOFS_O_APPEND	02000
+
+#define VIRTIOFS_SEEK_SET	0
+#define VIRTIOFS_SEEK_CUR	1
+#define VIRTIOFS_SEEK_END	2
+
+#define VIRTIOFS_NAME_MAX	255
+#define VIRTIOFS_S_IFMT		0170000
+#define VIRTIOFS_S_IFDIR	0040000
+
+#ifndef MIN
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#endif
+
+typedef struct virtiofs_fd {
+	/// node of the host, 0 marks a free descriptor
+	uint64_t nodeid;
+	/// handle of the host
+	uint64_t fh;
+	/// size of the file at the last reply of the host
+	uint64_t size;
+	off_t pos;
+	int flags;
+} virtiofs_fd_t;
+
+/// slot of the DAX window, which holds a chunk of a file
+typedef struct dax_slot {
+	/// node of the chunk, 0 marks a slot without a valid chunk
+	uint64_t nodeid;
+	/// offset of the chunk in the file >> VIRTIOFS_CHUNK_BITS
+	uint64_t chunk;
+	/// number of copies and application mappings, which use the slot
+	uint32_t pins;
+	/// the host has mapped the chunk writable
+	uint8_t writable;
+	/// time of the last use (LRU)
+	uint64_t last_use;
+} dax_slot_t;
+
+static virtiofs_fd_t fds[VIRTIOFS_MAX_OPEN];
+static sem_t virtiofs_sem = SEM_INIT(1);
+static atomic_int64_t unique = ATOMIC_INIT(0);
+static int mounted = 0;
+/// maximal number of data bytes per request, which the host accepts
+static uint32_t max_io = VIRTIOFS_MAX_IO;
+/// DAX window, the slots are protected by virtiofs_sem
+static uint8_t* dax_virt = NULL;
+static size_t dax_phys = 0;
+static dax_slot_t* slots = NULL;
+static uint32_t nr_slots = 0;
+static uint64_t dax_clock = 0;
+
+int virtiofs_path(const char* name)
+{
+	const size_t len = sizeof(VIRTIOFS_PATH) - 1;
+
+	if (!len || !name || !mounted)
+		return 0;
+
+	return !strncmp(name, VIRTIOFS_PATH, len) && (name[len] == '/') && name[len+1];
+}
+
+static inline virtiofs_fd_t* virtiofs_get(int fd)
+{
+	fd &= ~VIRTIOFS_FD_BIT;
+
+	if ((fd < 0) || (fd >= VIRTIOFS_MAX_OPEN) || !fds[fd].nodeid)
+		return NULL;
+
+	return fds + fd;
+}
+
+/*
+ * Send a request to the host. The argument and the data follow the header
+ * of the request, the reply and its data follow the header of the reply.
+ *
+ * @return number of bytes behind the header of the reply or the error of the host
+ */
+static ssize_t fuse_call(uint32_t opcode, uint64_t nodeid, const void* arg, uint32_t arg_len,
+	const void* data, uint32_t data_len, void* reply, uint32_t reply_len, void* rdata, uint32_t rdata_len)
+{
+	struct fuse_in_header hdr;
+	struct fuse_out_header out_hdr;
+	viofs_buf_t in[3], out[3];
+	uint32_t nr_in = 0, nr_out = 0;
+	int ret;
+
+	memset(&hdr, 0x00, sizeof(hdr));
+	hdr.len = sizeof(hdr) + arg_len + data_len;
+	hdr.opcode = opcode;
+	hdr.unique = atomic_int64_inc(&unique);
+	hdr.nodeid = nodeid;
+	hdr.pid = per_core(current_task)->id;
+
+	in[nr_in].buf = &hdr;
+	in[nr_in++].len = sizeof(hdr);
+	if (arg_len) {
+		in[nr_in].buf = (void*) arg;
+		in[nr_in++].len = arg_len;
+	}
+	if (data_len) {
+		in[nr_in].buf = (void*) data;
+		in[nr_in++].len = data_len;
+	}
+
+	memset(&out_hdr, 0x00, sizeof(out_hdr));
+	out[nr_out].buf = &out_hdr;
+	out[nr_out++].len = sizeof(out_hdr);
+	if (reply_len) {
+		out[nr_out].buf = reply;
+		out[nr_out++].len = reply_len;
+	}
+	if (rdata_len) {
+		out[nr_out].buf = rdata;
+		out[nr_out++].len = rdata_len;
+	}
+
+	ret = viofs_request(in, nr_in, out, nr_out);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	// the host replies with a negative error number
+	if (out_hdr.error)
+		return (out_hdr.error < 0) ? out_hdr.error : -EIO;
+	if (BUILTIN_EXPECT(out_hdr.len < sizeof(out_hdr), 0))
+		return -EIO;
+
+	return out_hdr.len - sizeof(out_hdr);
+}
+
+/// the root isn't counted by the host
+static inline void fuse_forget_node(uint64_t nodeid)
+{
+	if (nodeid != FUSE_ROOT_ID)
+		viofs_forget(nodeid, 1);
+}
+
+static int fuse_lookup(uint64_t parent, const char* name, struct fuse_entry_out* entry)
+{
+	ssize_t ret;
+
+	memset(entry, 0x00, sizeof(struct fuse_entry_out));
+	ret = fuse_call(FUSE_LOOKUP, parent, name, strlen(name) + 1, NULL, 0,
+		entry, sizeof(struct fuse_entry_out), NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	// a negative entry is a cached miss of the host
+	if (!entry->nodeid)
+		return -ENOENT;
+
+	return 0;
+}
+
+/*
+ * Look up the directory, which contains the last component of the path
+ * (below VIRTIOFS_PATH). The caller has to forget the directory.
+ */
+static int path_parent(const char* name, uint64_t* parent, char* last)
+{
+	struct fuse_entry_out entry;
+	const char* p = name + sizeof(VIRTIOFS_PATH);
+	uint64_t node = FUSE_ROOT_ID;
+	int ret;
+
+	while (1) {
+		size_t len = 0;
+
+		while (p[len] && (p[len] != '/'))
+			len++;
+
+		if (BUILTIN_EXPECT(len > VIRTIOFS_NAME_MAX, 0)) {
+			fuse_forget_node(node);
+			return -ENAMETOOLONG;
+		}
+
+		memcpy(last, p, len);
+		last[len] = '\0';
+
+		if (!p[len]) {
+			// a trailing slash names a directory
+			if (BUILTIN_EXPECT(!len, 0)) {
+				fuse_forget_node(node);
+				return -EISDIR;
+			}
+
+			*parent = node;
+			return 0;
+		}
+
+		// empty components are skipped
+		if (len) {
+			ret = fuse_lookup(node, last, &entry);
+			fuse_forget_node(node);
+			if (ret)
+				return ret;
+			node = entry.nodeid;
+		}
+
+		p += len + 1;
+	}
+}
+
+static int file_getattr(virtiofs_fd_t* desc)
+{
+	struct fuse_getattr_in in;
+	struct fuse_attr_out out;
+	ssize_t ret;
+
+	memset(&in, 0x00, sizeof(in));
+	in.getattr_flags = FUSE_GETATTR_FH;
+	in.fh = desc->fh;
+
+	ret = fuse_call(FUSE_GETATTR, desc->nodeid, &in, sizeof(in), NULL, 0, &out, sizeof(out), NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	desc->size = out.attr.size;
+
+	return 0;
+}
+
+static inline uint8_t* slot_addr(uint32_t i)
+{
+	return dax_virt + ((size_t) i << VIRTIOFS_CHUNK_BITS);
+}
+
+/// let the host map a chunk of the file into the slot, has to be called with virtiofs_sem held
+static int slot_setup(uint32_t i, virtiofs_fd_t* desc, uint64_t chunk, int write)
+{
+	struct fuse_setupmapping_in in;
+	ssize_t ret;
+
+	memset(&in, 0x00, sizeof(in));
+	in.fh = desc->fh;
+	in.foffset = chunk << VIRTIOFS_CHUNK_BITS;
+	in.len = VIRTIOFS_CHUNK_SIZE;
+	in.flags = FUSE_SETUPMAPPING_FLAG_READ | (write ? FUSE_SETUPMAPPING_FLAG_WRITE : 0);
+	in.moffset = (uint64_t) i << VIRTIOFS_CHUNK_BITS;
+
+	ret = fuse_call(FUSE_SETUPMAPPING, desc->nodeid, &in, sizeof(in), NULL, 0, NULL, 0, NULL, 0);
+	if (ret < 0) {
+		// the host doesn't support DAX => don't ask again
+		if (ret == -ENOSYS) {
+			LOG_WARNING("virtiofs: the host doesn't map files into the DAX window\n");
+			nr_slots = 0;
+		}
+
+		// the previous chunk isn't reliable anymore
+		slots[i].nodeid = 0;
+		return ret;
+	}
+
+	slots[i].nodeid = desc->nodeid;
+	slots[i].chunk = chunk;
+	slots[i].writable = write ? 1 : 0;
+
+	return 0;
+}
+
+/*
+ * Find the slot, which holds the chunk, or map the chunk into the least
+ * recently used slot without pins. The slot is pinned on success. Has to
+ * be called with virtiofs_sem held.
+ */
+static int slot_get(virtiofs_fd_t* desc, uint64_t chunk, uint32_t* slot)
+{
+	uint32_t i, victim = nr_slots;
+	uint64_t oldest = 0;
+	int ret;
+
+	for (i = 0; i < nr_slots; i++) {
+		uint64_t age;
+
+		if ((slots[i].nodeid == desc->nodeid) && (slots[i].chunk == chunk))
+			goto found;
+		if (slots[i].pins)
+			continue;
+
+		// empty slots are used first
+		age = slots[i].nodeid ? slots[i].last_use : 0;
+		if ((victim == nr_slots) || (age < oldest)) {
+			victim = i;
+			oldest = age;
+		}
+	}
+
+	if (victim == nr_slots)
+		return -ENOMEM;
+
+	i = victim;
+	ret = slot_setup(i, desc, chunk, 0);
+	if (ret)
+		return ret;
+
+found:
+	slots[i].pins++;
+	slots[i].last_use = ++dax_clock;
+	*slot = i;
+
+	return 0;
+}
+
+/*
+ * The host may reuse the ID after the last FORGET of a node => the slots
+ * of the node are invalidated. Pinned slots keep their chunk for the
+ * application mappings, but aren't found by slot_get() anymore.
+ */
+static void slots_forget(uint64_t nodeid)
+{
+	struct {
+		struct fuse_removemapping_in in;
+		struct fuse_removemapping_one one;
+	} __attribute__((packed)) rm;
+
+	for (uint32_t i = 0; i < nr_slots; i++) {
+		if (slots[i].nodeid != nodeid)
+			continue;
+
+		slots[i].nodeid = 0;
+		if (slots[i].pins)
+			continue;
+
+		memset(&rm, 0x00, sizeof(rm));
+		rm.in.count = 1;
+		rm.one.moffset = (uint64_t) i << VIRTIOFS_CHUNK_BITS;
+		rm.one.len = VIRTIOFS_CHUNK_SIZE;
+		fuse_call(FUSE_REMOVEMAPPING, nodeid, &rm, sizeof(rm), NULL, 0, NULL, 0, NULL, 0);
+	}
+}
+
+/// the host transfers the data directly into the buffer
+static ssize_t fuse_read(virtiofs_fd_t* desc, uint8_t* buf, size_t len, uint64_t pos)
+{
+	struct fuse_read_in in;
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		memset(&in, 0x00, sizeof(in));
+		in.fh = desc->fh;
+		in.offset = pos + done;
+		in.size = MIN(len - done, max_io);
+
+		ret = fuse_call(FUSE_READ, desc->nodeid, &in, sizeof(in), NULL, 0, NULL, 0, buf + done, in.size);
+		if (ret < 0)
+			return done ? (ssize_t) done : ret;
+
+		done += ret;
+		// end of the file
+		if (ret < in.size)
+			break;
+	}
+
+	return done;
+}
+
+static ssize_t file_read(virtiofs_fd_t* desc, void* buf, size_t len, uint64_t pos)
+{
+	uint8_t* dst = (uint8_t*) buf;
+	size_t done = 0;
+	ssize_t ret;
+
+	if (!len)
+		return 0;
+
+	// the file may have grown on the host
+	if (pos + len > desc->size) {
+		ret = file_getattr(desc);
+		if (ret)
+			return ret;
+	}
+	if (pos >= desc->size)
+		return 0;
+	len = MIN(len, desc->size - pos);
+
+	while (done < len) {
+		const uint64_t off = pos + done;
+		const size_t n = MIN(len - done, VIRTIOFS_CHUNK_SIZE - (off & (VIRTIOFS_CHUNK_SIZE-1)));
+		uint32_t i;
+
+		sem_wait(&virtiofs_sem, 0);
+		ret = nr_slots ? slot_get(desc, off >> VIRTIOFS_CHUNK_BITS, &i) : -ENODEV;
+		sem_post(&virtiofs_sem);
+
+		// without a free slot, the host copies the rest
+		if (ret) {
+			ret = fuse_read(desc, dst + done, len - done, off);
+			if (ret < 0)
+				return done ? (ssize_t) done : ret;
+			return done + ret;
+		}
+
+		// the pin keeps the chunk in the slot
+		memcpy(dst + done, slot_addr(i) + (off & (VIRTIOFS_CHUNK_SIZE-1)), n);
+
+		sem_wait(&virtiofs_sem, 0);
+		slots[i].pins--;
+		sem_post(&virtiofs_sem);
+
+		done += n;
+	}
+
+	return done;
+}
+
+/// the host updates its page cache, which backs the DAX window
+static ssize_t file_write(virtiofs_fd_t* desc, const void* buf, size_t len, uint64_t pos)
+{
+	struct fuse_write_in in;
+	struct fuse_write_out out;
+	size_t done = 0;
+	ssize_t ret;
+
+	while (done < len) {
+		memset(&in, 0x00, sizeof(in));
+		in.fh = desc->fh;
+		in.offset = pos + done;
+		in.size = MIN(len - done, max_io);
+
+		memset(&out, 0x00, sizeof(out));
+		ret = fuse_call(FUSE_WRITE, desc->nodeid, &in, sizeof(in), (const uint8_t*) buf + done, in.size,
+			&out, sizeof(out), NULL, 0);
+		if (ret < 0)
+			return done ? (ssize_t) done : ret;
+
+		done += out.size;
+		if (out.size < in.size)
+			break;
+	}
+
+	if (pos + done > desc->size)
+		desc->size = pos + done;
+
+	return done;
+}
+
+int virtiofs_mount(void)
+{
+	struct fuse_init_in in;
+	struct fuse_init_out out;
+	size_t dax_len;
+	ssize_t ret;
+
+	if (!(sizeof(VIRTIOFS_PATH) - 1) || mounted)
+		return 0;
+
+	if (viofs_init())
+		return -ENODEV;
+
+	memset(&in, 0x00, sizeof(in));
+	in.major = FUSE_KERNEL_VERSION;
+	in.minor = FUSE_KERNEL_MINOR_VERSION;
+	in.flags = FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES | FUSE_MAX_PAGES | FUSE_MAP_ALIGNMENT;
+
+	// older hosts send a shorter reply
+	memset(&out, 0x00, sizeof(out));
+	ret = fuse_call(FUSE_INIT, 0, &in, sizeof(in), NULL, 0, &out, sizeof(out), NULL, 0);
+	if (ret < 0) {
+		LOG_ERROR("virtiofs: FUSE_INIT failed: %d\n", (int) ret);
+		return ret;
+	}
+	if (out.major != FUSE_KERNEL_VERSION) {
+		LOG_ERROR("virtiofs: the host speaks FUSE %u.%u\n", out.major, out.minor);
+		return -EPROTO;
+	}
+
+	if (out.max_write && (out.max_write < max_io))
+		max_io = out.max_write;
+	if ((out.flags & FUSE_MAX_PAGES) && out.max_pages && (((uint32_t) out.max_pages << PAGE_BITS) < max_io))
+		max_io = (uint32_t) out.max_pages << PAGE_BITS;
+
+	if (viofs_dax_window(&dax_virt, &dax_phys, &dax_len) == 0) {
+		// the slots are aligned to the chunk size
+		if ((out.flags & FUSE_MAP_ALIGNMENT) && (out.map_alignment > VIRTIOFS_CHUNK_BITS)) {
+			LOG_WARNING("virtiofs: the host requires an alignment of 2^%u bytes in the DAX window\n", out.map_alignment);
+		} else {
+			slots = kmalloc((dax_len >> VIRTIOFS_CHUNK_BITS) * sizeof(dax_slot_t));
+			if (slots) {
+				nr_slots = dax_len >> VIRTIOFS_CHUNK_BITS;
+				memset(slots, 0x00, nr_slots * sizeof(dax_slot_t));
+			}
+		}
+	}
+
+	mounted = 1;
+
+	LOG_INFO("virtiofs: FUSE %u.%u at %s, %u KiB per request, %u DAX slots of %lu MiB\n",
+		out.major, out.minor, VIRTIOFS_PATH, max_io >> 10, nr_slots, VIRTIOFS_CHUNK_SIZE >> 20);
+
+	return 0;
+}
+
+int virtiofs_open(const char* name, int flags, int mode)
+{
+	char last[VIRTIOFS_NAME_MAX+1];
+	struct fuse_entry_out entry;
+	struct fuse_open_out open_out;
+	uint64_t parent;
+	ssize_t ret;
+	int fd;
+
+	sem_wait(&virtiofs_sem, 0);
+
+	for (fd = 0; (fd < VIRTIOFS_MAX_OPEN) && fds[fd].nodeid; fd++)
+		;
+	if (BUILTIN_EXPECT(fd >= VIRTIOFS_MAX_OPEN, 0)) {
+		ret = -ENFILE;
+		goto out;
+	}
+
+	ret = path_parent(name, &parent, last);
+	if (ret)
+		goto out;
+
+	memset(&open_out, 0x00, sizeof(open_out));
+	ret = fuse_lookup(parent, last, &entry);
+	if (!ret) {
+		struct fuse_open_in in;
+
+		if ((flags & (VIRTIOFS_O_CREAT|VIRTIOFS_O_EXCL)) == (VIRTIOFS_O_CREAT|VIRTIOFS_O_EXCL)) {
+			ret = -EEXIST;
+		} else if ((entry.attr.mode & VIRTIOFS_S_IFMT) == VIRTIOFS_S_IFDIR) {
+			// directories aren't supported
+			ret = -EISDIR;
+		} else {
+			memset(&in, 0x00, sizeof(in));
+			in.flags = flags & ~(VIRTIOFS_O_CREAT|VIRTIOFS_O_EXCL|VIRTIOFS_O_NOCTTY);
+			ret = fuse_call(FUSE_OPEN, entry.nodeid, &in, sizeof(in), NULL, 0,
+				&open_out, sizeof(open_out), NULL, 0);
+		}
+
+		if (ret < 0) {
+			fuse_forget_node(entry.nodeid);
+			goto out_parent;
+		}
+
+		if ((flags & VIRTIOFS_O_TRUNC) && ((flags & VIRTIOFS_O_ACCMODE) != VIRTIOFS_O_RDONLY))
+			entry.attr.size = 0;
+	} else if ((ret == -ENOENT) && (flags & VIRTIOFS_O_CREAT)) {
+		struct fuse_create_in in;
+
+		memset(&in, 0x00, sizeof(in));
+		in.flags = flags & ~VIRTIOFS_O_NOCTTY;
+		in.mode = mode;
+
+		// the reply contains the entry and the handle
+		ret = fuse_call(FUSE_CREATE, parent, &in, sizeof(in), last, strlen(last) + 1,
+			&entry, sizeof(entry), &open_out, sizeof(open_out));
+		if (ret < 0)
+			goto out_parent;
+	} else goto out_parent;
+
+	fds[fd].nodeid = entry.nodeid;
+	fds[fd].fh = open_out.fh;
+	fds[fd].size = entry.attr.size;
+	fds[fd].pos = 0;
+	fds[fd].flags = flags;
+	ret = fd | VIRTIOFS_FD_BIT;
+
+out_parent:
+	fuse_forget_node(parent);
+out:
+	sem_post(&virtiofs_sem);
+
+	return ret;
+}
+
+ssize_t virtiofs_read(int fd, void* buf, size_t len)
+{
+	virtiofs_fd_t* desc = virtiofs_get(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & VIRTIOFS_O_ACCMODE) == VIRTIOFS_O_WRONLY), 0))
+		return -EBADF;
+
+	ret = file_read(desc, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+	return ret;
+}
+
+ssize_t virtiofs_write(int fd, const void* buf, size_t len)
+{
+	virtiofs_fd_t* desc = virtiofs_get(fd);
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & VIRTIOFS_O_ACCMODE) == VIRTIOFS_O_RDONLY), 0))
+		return -EBADF;
+
+	// the host appends anyway, but the position has to follow the end
+	if (desc->flags & VIRTIOFS_O_APPEND) {
+		ret = file_getattr(desc);
+		if (ret)
+			return ret;
+		desc->pos = desc->size;
+	}
+
+	ret = file_write(desc, buf, len, desc->pos);
+	if (ret > 0)
+		desc->pos += ret;
+
+	return ret;
+}
+
+ssize_t virtiofs_pread(int fd, void* buf, size_t len, off_t offset)
+{
+	virtiofs_fd_t* desc = virtiofs_get(fd);
+
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & VIRTIOFS_O_ACCMODE) == VIRTIOFS_O_WRONLY), 0))
+		return -EBADF;
+
+	return file_read(desc, buf, len, offset);
+}
+
+ssize_t virtiofs_pwrite(int fd, const void* buf, size_t len, off_t offset)
+{
+	virtiofs_fd_t* desc = virtiofs_get(fd);
+
+	if (BUILTIN_EXPECT(offset < 0, 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!desc || ((desc->flags & VIRTIOFS_O_ACCMODE) == VIRTIOFS_O_RDONLY), 0))
+		return -EBADF;
+
+	return file_write(desc, buf, len, offset);
+}
+
+off_t virtiofs_lseek(int fd, off_t offset, int whence)
+{
+	virtiofs_fd_t* desc;
+	off_t ret;
+
+	sem_wait(&virtiofs_sem, 0);
+
+	desc = virtiofs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	switch(whence) {
+	case VIRTIOFS_SEEK_SET:
+		ret = offset;
+		break;
+	case VIRTIOFS_SEEK_CUR:
+		ret = desc->pos + offset;
+		break;
+	case VIRTIOFS_SEEK_END:
+		ret = file_getattr(desc);
+		if (ret)
+			goto out;
+		ret = (off_t) desc->size + offset;
+		break;
+	default:
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (BUILTIN_EXPECT(ret < 0, 0)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	desc->pos = ret;
+
+out:
+	sem_post(&virtiofs_sem);
+
+	return ret;
+}
+
+int virtiofs_fsync(int fd)
+{
+	virtiofs_fd_t* desc = virtiofs_get(fd);
+	struct fuse_fsync_in in;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!desc, 0))
+		return -EBADF;
+
+	memset(&in, 0x00, sizeof(in));
+	in.fh = desc->fh;
+
+	ret = fuse_call(FUSE_FSYNC, desc->nodeid, &in, sizeof(in), NULL, 0, NULL, 0, NULL, 0);
+
+	return (ret < 0) ? ret : 0;
+}
+
+int virtiofs_close(int fd)
+{
+	virtiofs_fd_t* desc;
+	struct fuse_release_in in;
+	uint64_t nodeid;
+	int shared = 0;
+	ssize_t ret;
+
+	sem_wait(&virtiofs_sem, 0);
+
+	desc = virtiofs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		sem_post(&virtiofs_sem);
+		return -EBADF;
+	}
+
+	nodeid = desc->nodeid;
+	memset(&in, 0x00, sizeof(in));
+	in.fh = desc->fh;
+	in.flags = desc->flags;
+	desc->nodeid = 0;
+
+	// the chunks stay valid, as long as another descriptor refers to the node
+	for (uint32_t i = 0; i < VIRTIOFS_MAX_OPEN; i++) {
+		if (fds[i].nodeid == nodeid)
+			shared = 1;
+	}
+	if (!shared)
+		slots_forget(nodeid);
+
+	ret = fuse_call(FUSE_RELEASE, nodeid, &in, sizeof(in), NULL, 0, NULL, 0, NULL, 0);
+	fuse_forget_node(nodeid);
+
+	sem_post(&virtiofs_sem);
+
+	return (ret < 0) ? ret : 0;
+}
+
+int virtiofs_unlink(const char* name)
+{
+	char last[VIRTIOFS_NAME_MAX+1];
+	uint64_t parent;
+	ssize_t ret;
+
+	ret = path_parent(name, &parent, last);
+	if (ret)
+		return ret;
+
+	// open descriptors keep the file on the host until the last close
+	ret = fuse_call(FUSE_UNLINK, parent, last, strlen(last) + 1, NULL, 0, NULL, 0, NULL, 0);
+	fuse_forget_node(parent);
+
+	return (ret < 0) ? ret : 0;
+}
+
+/// can the slots [start, start+n) hold the chunks [first, first+n) of the node?
+static int run_usable(uint32_t start, uint32_t n, uint64_t nodeid, uint64_t first)
+{
+	if (start + n > nr_slots)
+		return 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		const dax_slot_t* s = slots + start + i;
+
+		if (s->pins && ((s->nodeid != nodeid) || (s->chunk != first + i)))
+			return 0;
+	}
+
+	return 1;
+}
+
+int virtiofs_dax_map(int fd, off_t offset, size_t len, int write, size_t* phys)
+{
+	virtiofs_fd_t* desc;
+	uint64_t first;
+	uint32_t i, n, start;
+	int ret = -ENOMEM;
+
+	if (BUILTIN_EXPECT((offset < 0) || (offset & (VIRTIOFS_CHUNK_SIZE-1)) || !len || !phys, 0))
+		return -EINVAL;
+
+	first = offset >> VIRTIOFS_CHUNK_BITS;
+
+	sem_wait(&virtiofs_sem, 0);
+
+	if (!nr_slots) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	desc = virtiofs_get(fd);
+	if (BUILTIN_EXPECT(!desc, 0)) {
+		ret = -EBADF;
+		goto out;
+	}
+	if (write && ((desc->flags & VIRTIOFS_O_ACCMODE) == VIRTIOFS_O_RDONLY)) {
+		ret = -EACCES;
+		goto out;
+	}
+
+	if (len > ((size_t) nr_slots << VIRTIOFS_CHUNK_BITS))
+		goto out;
+	n = (len + VIRTIOFS_CHUNK_SIZE - 1) >> VIRTIOFS_CHUNK_BITS;
+
+	// prefer the run, which starts with the first chunk, otherwise the first run without pins
+	start = nr_slots;
+	for (i = 0; i < nr_slots; i++) {
+		if ((slots[i].nodeid == desc->nodeid) && (slots[i].chunk == first)) {
+			if (run_usable(i, n, desc->nodeid, first))
+				start = i;
+			break;
+		}
+	}
+	for (i = 0; (start == nr_slots) && (i + n <= nr_slots); i++) {
+		if (run_usable(i, n, desc->nodeid, first))
+			start = i;
+	}
+	if (start == nr_slots)
+		goto out;
+
+	for (i = 0; i < n; i++) {
+		dax_slot_t* s = slots + start + i;
+
+		if ((s->nodeid != desc->nodeid) || (s->chunk != first + i) || (write && !s->writable)) {
+			ret = slot_setup(start + i, desc, first + i, write);
+			if (ret) {
+				while (i--)
+					slots[start + i].pins--;
+				goto out;
+			}
+		}
+
+		s->pins++;
+		s->last_use = ++dax_clock;
+	}
+
+	*phys = dax_phys + ((size_t) start << VIRTIOFS_CHUNK_BITS);
+	ret = 0;
+
+out:
+	sem_post(&virtiofs_sem);
+
+	return ret;
+}
+
+void virtiofs_dax_unmap(size_t phys, size_t len)
+{
+	uint32_t start, end;
+
+	if (!slots || (phys < dax_phys))
+		return;
+
+	start = (phys - dax_phys) >> VIRTIOFS_CHUNK_BITS;
+	end = start + ((len + VIRTIOFS_CHUNK_SIZE - 1) >> VIRTIOFS_CHUNK_BITS);
+
+	sem_wait(&virtiofs_sem, 0);
+
+	// an orphaned slot without pins is free again
+	for (uint32_t i = start; (i < end) && (i < nr_slots); i++) {
+		if (slots[i].pins)
+			slots[i].pins--;
+	}
+
+	sem_post(&virtiofs_sem);
+}
@@ -0,0 +1,815 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/stdlib.h>
+#include <hermit/string.h>
+#include <hermit/vsock.h>
+#include <hermit/virtio_vsock.h>
+#include <hermit/tasks.h>
+#include <hermit/spinlock.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+
+#if VSOCK_BUFSIZE & (VSOCK_BUFSIZE - 1)
+#error VSOCK_BUFSIZE has to be a power of two
+#endif
+
+#ifndef MIN
+#define MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+#define VSOCK_FREE		0
+#define VSOCK_UNBOUND		1
+#define VSOCK_LISTEN		2
+#define VSOCK_CONNECTING	3
+#define VSOCK_CONNECTED		4
+/// reset by the peer or the transport, the socket waits for vsock_close()
+#define VSOCK_CLOSED		5
+
+/// first port, which vsock_connect() assigns
+#define VSOCK_EPHEMERAL_PORT	49152
+
+/** @brief Task, which waits for a state change */
+typedef struct vsock_waiter {
+	task_t* task;
+	struct vsock_waiter* next;
+} vsock_waiter_t;
+
+typedef struct vsock {
+	uint8_t state;
+	/// VIRTIO_VSOCK_SHUTDOWN_* flags, which the peer has sent
+	uint8_t peer_shutdown;
+	/// is a CREDIT_REQUEST outstanding?
+	uint8_t credit_requested;
+	/// reported after a reset (0, -ECONNREFUSED, -ECONNRESET or -ENETDOWN)
+	int error;
+	/// incremented by vsock_close() to detect a stale descriptor
+	uint32_t gen;
+	uint32_t local_port;
+	uint32_t peer_port;
+	uint64_t peer_cid;
+	/// receive ring of VSOCK_BUFSIZE bytes, kept after the socket is closed
+	uint8_t* data;
+	/// free running counters of the ring
+	uint32_t head;
+	uint32_t tail;
+	/// bytes, which the reader has consumed, and the value announced to the peer
+	uint32_t fwd_cnt;
+	uint32_t last_fwd_cnt;
+	/// credit of the peer: tx_cnt may exceed peer_fwd_cnt by peer_buf_alloc bytes
+	uint32_t peer_buf_alloc;
+	uint32_t peer_fwd_cnt;
+	uint32_t tx_cnt;
+	/// connections, which aren't accepted yet (free running counters)
+	int backlog[VSOCK_BACKLOG];
+	uint32_t bl_head;
+	uint32_t bl_tail;
+	/// readers, writers and tasks in vsock_accept() or vsock_connect()
+	vsock_waiter_t* waiters;
+} vsock_t;
+
+static vsock_t socks[MAX_VSOCK];
+static uint32_t next_port = VSOCK_EPHEMERAL_PORT;
+/// protects the sockets, the receive path takes it in interrupt context
+static spinlock_irqsave_t vsock_lock = SPINLOCK_IRQSAVE_INIT;
+
+static void vsock_wakeup(vsock_waiter_t** waiters)
+{
+	vsock_waiter_t* w;
+
+	for(w = *waiters; w; w = w->next)
+		wakeup_task(w->task->id);
+	*waiters = NULL;
+}
+
+/*
+ * Blocks the current task until it is woken by vsock_wakeup() and
+ * removes it from the wait list, if it is woken otherwise.
+ */
+static void vsock_wait(vsock_waiter_t** waiters)
+{
+	vsock_waiter_t waiter;
+	vsock_waiter_t** w;
+
+	waiter.task = per_core(current_task);
+	waiter.next = *waiters;
+	*waiters = &waiter;
+
+	block_current_task();
+	spinlock_irqsave_unlock(&vsock_lock);
+	reschedule();
+	spinlock_irqsave_lock(&vsock_lock);
+
+	for(w = waiters; *w; w = &(*w)->next) {
+		if (*w == &waiter) {
+			*w = waiter.next;
+			break;
+		}
+	}
+}
+
+static inline vsock_t* vsock_get(int fd)
+{
+	int i;
+
+	if (!(fd & VSOCK_FD_BIT))
+		return NULL;
+
+	i = fd & ~VSOCK_FD_BIT;
+	if ((i < 0) || (i >= MAX_VSOCK) || (socks[i].state == VSOCK_FREE))
+		return NULL;
+
+	return socks + i;
+}
+
+static void vsock_reset_state(vsock_t* s, uint8_t state)
+{
+	s->state = state;
+	s->peer_shutdown = 0;
+	s->credit_requested = 0;
+	s->error = 0;
+	s->local_port = s->peer_port = 0;
+	s->peer_cid = 0;
+	s->head = s->tail = 0;
+	s->fwd_cnt = s->last_fwd_cnt = 0;
+	s->peer_buf_alloc = s->peer_fwd_cnt = s->tx_cnt = 0;
+	s->bl_head = s->bl_tail = 0;
+	s->waiters = NULL;
+}
+
+/*
+ * Has to be called with vsock_lock held. In interrupt context, only
+ * sockets with a receive ring are taken (need_data), because the ring
+ * can't be allocated there.
+ */
+static int vsock_alloc(uint8_t state, int need_data)
+{
+	int i;
+
+	for(i = 0; i < MAX_VSOCK; i++) {
+		if ((socks[i].state == VSOCK_FREE) && (!need_data || socks[i].data)) {
+			vsock_reset_state(socks + i, state);
+			return i;
+		}
+	}
+
+	return -ENFILE;
+}
+
+/*
+ * Allocate the receive rings of free sockets, so that a listener is able
+ * to take VSOCK_BACKLOG connection requests in interrupt context.
+ */
+static void vsock_prealloc(void)
+{
+	int i, ready = 0;
+
+	for(i = 0; (i < MAX_VSOCK) && (ready < VSOCK_BACKLOG); i++) {
+		uint8_t* data;
+
+		if (socks[i].state != VSOCK_FREE)
+			continue;
+		if (socks[i].data) {
+			ready++;
+			continue;
+		}
+
+		// allocate outside of the lock
+		data = kmalloc(VSOCK_BUFSIZE);
+		if (BUILTIN_EXPECT(!data, 0))
+			return;
+
+		spinlock_irqsave_lock(&vsock_lock);
+		if (socks[i].data) {
+			spinlock_irqsave_unlock(&vsock_lock);
+			kfree(data);
+		} else {
+			socks[i].data = data;
+			spinlock_irqsave_unlock(&vsock_lock);
+		}
+		ready++;
+	}
+}
+
+/* build a header, which announces our credit, has to be called with vsock_lock held */
+static void vsock_hdr(vsock_t* s, struct virtio_vsock_hdr* hdr, uint16_t op, uint32_t flags, uint32_t len)
+{
+	memset(hdr, 0x00, sizeof(struct virtio_vsock_hdr));
+	hdr->src_cid = vsock_local_cid();
+	hdr->dst_cid = s->peer_cid;
+	hdr->src_port = s->local_port;
+	hdr->dst_port = s->peer_port;
+	hdr->len = len;
+	hdr->type = VIRTIO_VSOCK_TYPE_STREAM;
+	hdr->op = op;
+	hdr->flags = flags;
+	hdr->buf_alloc = VSOCK_BUFSIZE;
+	hdr->fwd_cnt = s->fwd_cnt;
+	s->last_fwd_cnt = s->fwd_cnt;
+}
+
+/* send a control packet without blocking, has to be called with vsock_lock held */
+static inline void vsock_ctrl(vsock_t* s, uint16_t op, uint32_t flags)
+{
+	struct virtio_vsock_hdr hdr;
+
+	vsock_hdr(s, &hdr, op, flags, 0);
+	if (vsock_transport_send(&hdr, NULL, 0, 0))
+		LOG_WARNING("vsock: transmit ring is full, drop control packet %u\n", (uint32_t) op);
+}
+
+/* answer a packet, which doesn't belong to a connection */
+static void vsock_reply_rst(const struct virtio_vsock_hdr* in)
+{
+	struct virtio_vsock_hdr hdr;
+
+	if (in->op == VIRTIO_VSOCK_OP_RST)
+		return;
+
+	memset(&hdr, 0x00, sizeof(struct virtio_vsock_hdr));
+	hdr.src_cid = in->dst_cid;
+	hdr.dst_cid = in->src_cid;
+	hdr.src_port = in->dst_port;
+	hdr.dst_port = in->src_port;
+	hdr.type = in->type;
+	hdr.op = VIRTIO_VSOCK_OP_RST;
+	vsock_transport_send(&hdr, NULL, 0, 0);
+}
+
+/* has to be called with vsock_lock held */
+static vsock_t* vsock_lookup(const struct virtio_vsock_hdr* hdr)
+{
+	int i;
+
+	for(i = 0; i < MAX_VSOCK; i++) {
+		vsock_t* s = socks + i;
+
+		if (((s->state == VSOCK_CONNECTING) || (s->state == VSOCK_CONNECTED))
+		    && (s->local_port == hdr->dst_port) && (s->peer_port == hdr->src_port)
+		    && (s->peer_cid == hdr->src_cid))
+			return s;
+	}
+
+	return NULL;
+}
+
+/* a connection request to a listening port, has to be called with vsock_lock held */
+static void vsock_request(const struct virtio_vsock_hdr* hdr)
+{
+	vsock_t* listener = NULL;
+	vsock_t* s;
+	int i;
+
+	for(i = 0; i < MAX_VSOCK; i++) {
+		if ((socks[i].state == VSOCK_LISTEN) && (socks[i].local_port == hdr->dst_port)) {
+			listener = socks + i;
+			break;
+		}
+	}
+
+	if (!listener || (listener->bl_head - listener->bl_tail >= VSOCK_BACKLOG)) {
+		vsock_reply_rst(hdr);
+		return;
+	}
+
+	i = vsock_alloc(VSOCK_CONNECTED, 1);
+	if (i < 0) {
+		LOG_WARNING("vsock: no socket available for a connection to port %u\n", hdr->dst_port);
+		vsock_reply_rst(hdr);
+		return;
+	}
+
+	s = socks + i;
+	s->local_port = hdr->dst_port;
+	s->peer_port = hdr->src_port;
+	s->peer_cid = hdr->src_cid;
+	s->peer_buf_alloc = hdr->buf_alloc;
+	s->peer_fwd_cnt = hdr->fwd_cnt;
+	vsock_ctrl(s, VIRTIO_VSOCK_OP_RESPONSE, 0);
+
+	listener->backlog[listener->bl_head % VSOCK_BACKLOG] = i;
+	listener->bl_head++;
+	vsock_wakeup(&listener->waiters);
+}
+
+/* reset a connection, has to be called with vsock_lock held */
+static void vsock_abort(vsock_t* s, int error)
+{
+	s->state = VSOCK_CLOSED;
+	s->error = error;
+	vsock_wakeup(&s->waiters);
+}
+
+void vsock_input(const struct virtio_vsock_hdr* hdr, const uint8_t* payload)
+{
+	vsock_t* s;
+
+	if (BUILTIN_EXPECT(hdr->type != VIRTIO_VSOCK_TYPE_STREAM, 0)) {
+		vsock_reply_rst(hdr);
+		return;
+	}
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_lookup(hdr);
+	if (!s) {
+		if (hdr->op == VIRTIO_VSOCK_OP_REQUEST)
+			vsock_request(hdr);
+		else
+			vsock_reply_rst(hdr);
+		goto out;
+	}
+
+	// every header carries the credit of the peer
+	s->peer_buf_alloc = hdr->buf_alloc;
+	s->peer_fwd_cnt = hdr->fwd_cnt;
+	s->credit_requested = 0;
+
+	switch(hdr->op) {
+	case VIRTIO_VSOCK_OP_RESPONSE:
+		if (s->state == VSOCK_CONNECTING)
+			s->state = VSOCK_CONNECTED;
+		break;
+	case VIRTIO_VSOCK_OP_RW:
+		if (s->state != VSOCK_CONNECTED)
+			break;
+
+		// the peer has to respect our credit
+		if (BUILTIN_EXPECT(hdr->len > VSOCK_BUFSIZE - (s->head - s->tail), 0)) {
+			LOG_ERROR("vsock: peer exceeds the credit of port %u\n", s->local_port);
+			vsock_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+			vsock_abort(s, -ECONNRESET);
+			goto out;
+		} else {
+			uint32_t off = s->head & (VSOCK_BUFSIZE - 1);
+			uint32_t n = MIN(hdr->len, VSOCK_BUFSIZE - off);
+
+			memcpy(s->data + off, payload, n);
+			memcpy(s->data, payload + n, hdr->len - n);
+			s->head += hdr->len;
+		}
+		break;
+	case VIRTIO_VSOCK_OP_CREDIT_REQUEST:
+		vsock_ctrl(s, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0);
+		break;
+	case VIRTIO_VSOCK_OP_SHUTDOWN:
+		s->peer_shutdown |= hdr->flags & (VIRTIO_VSOCK_SHUTDOWN_RCV|VIRTIO_VSOCK_SHUTDOWN_SEND);
+		// the peer closes the connection => confirm it, the buffered data remains readable
+		if (s->peer_shutdown == (VIRTIO_VSOCK_SHUTDOWN_RCV|VIRTIO_VSOCK_SHUTDOWN_SEND))
+			vsock_ctrl(s, VIRTIO_VSOCK_OP_RST, 0);
+		break;
+	case VIRTIO_VSOCK_OP_RST:
+		if (s->state == VSOCK_CONNECTING)
+			vsock_abort(s, -ECONNREFUSED);
+		else if (s->peer_shutdown & VIRTIO_VSOCK_SHUTDOWN_SEND)
+			vsock_abort(s, 0);
+		else
+			vsock_abort(s, -ECONNRESET);
+		break;
+	default:
+		break;
+	}
+
+	vsock_wakeup(&s->waiters);
+
+out:
+	spinlock_irqsave_unlock(&vsock_lock);
+}
+
+void vsock_transport_reset(void)
+{
+	int i;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	// the host has forgotten all connections, the listeners remain
+	for(i = 0; i < MAX_VSOCK; i++) {
+		if ((socks[i].state == VSOCK_CONNECTING) || (socks[i].state == VSOCK_CONNECTED))
+			vsock_abort(socks + i, -ENETDOWN);
+	}
+
+	spinlock_irqsave_unlock(&vsock_lock);
+}
+
+int vsock_socket(void)
+{
+	int ret;
+
+	if (!vsock_local_cid())
+		return -ENODEV;
+
+	spinlock_irqsave_lock(&vsock_lock);
+	ret = vsock_alloc(VSOCK_UNBOUND, 0);
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	return ret < 0 ? ret : ret | VSOCK_FD_BIT;
+}
+
+int vsock_listen(int fd, uint32_t port)
+{
+	vsock_t* s;
+	int i, ret = 0;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_get(fd);
+	if (!s) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (s->state != VSOCK_UNBOUND) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for(i = 0; i < MAX_VSOCK; i++) {
+		if ((socks[i].state == VSOCK_LISTEN) && (socks[i].local_port == port)) {
+			ret = -EADDRINUSE;
+			goto out;
+		}
+	}
+
+	s->local_port = port;
+	s->state = VSOCK_LISTEN;
+
+out:
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	if (!ret)
+		vsock_prealloc();
+
+	return ret;
+}
+
+int vsock_accept(int fd, uint64_t* cid, uint32_t* port)
+{
+	vsock_t* s;
+	uint32_t gen;
+	int ret;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_get(fd);
+	if (!s) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (s->state != VSOCK_LISTEN) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	gen = s->gen;
+	while (s->bl_head == s->bl_tail) {
+		vsock_wait(&s->waiters);
+
+		if ((s->state != VSOCK_LISTEN) || (s->gen != gen)) {
+			ret = -EBADF;
+			goto out;
+		}
+	}
+
+	ret = s->backlog[s->bl_tail % VSOCK_BACKLOG];
+	s->bl_tail++;
+
+	if (cid)
+		*cid = socks[ret].peer_cid;
+	if (port)
+		*port = socks[ret].peer_port;
+	ret |= VSOCK_FD_BIT;
+
+out:
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	// replace the ring, which the connection has taken
+	if (ret >= 0)
+		vsock_prealloc();
+
+	return ret;
+}
+
+/* has to be called with vsock_lock held */
+static uint32_t vsock_ephemeral_port(void)
+{
+	int i;
+
+	while (1) {
+		uint32_t port = next_port++;
+
+		if (next_port == 0)
+			next_port = VSOCK_EPHEMERAL_PORT;
+
+		for(i = 0; i < MAX_VSOCK; i++) {
+			if ((socks[i].state != VSOCK_FREE) && (socks[i].local_port == port))
+				break;
+		}
+
+		if (i == MAX_VSOCK)
+			return port;
+	}
+}
+
+int vsock_connect(int fd, uint64_t cid, uint32_t port)
+{
+	struct virtio_vsock_hdr hdr;
+	uint8_t* data = NULL;
+	vsock_t* s;
+	uint32_t gen;
+	int ret = 0;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_get(fd);
+	if (!s) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	if (s->state != VSOCK_UNBOUND) {
+		ret = -EISCONN;
+		goto out;
+	}
+
+	// allocate outside of the lock
+	if (!s->data) {
+		spinlock_irqsave_unlock(&vsock_lock);
+		data = kmalloc(VSOCK_BUFSIZE);
+		if (BUILTIN_EXPECT(!data, 0))
+			return -ENOMEM;
+		spinlock_irqsave_lock(&vsock_lock);
+
+		if ((s != vsock_get(fd)) || (s->state != VSOCK_UNBOUND)) {
+			ret = -EBADF;
+			goto out;
+		}
+		if (!s->data) {
+			s->data = data;
+			data = NULL;
+		}
+	}
+
+	s->local_port = vsock_ephemeral_port();
+	s->peer_port = port;
+	s->peer_cid = cid;
+	s->state = VSOCK_CONNECTING;
+	gen = s->gen;
+	vsock_hdr(s, &hdr, VIRTIO_VSOCK_OP_REQUEST, 0, 0);
+
+	spinlock_irqsave_unlock(&vsock_lock);
+	ret = vsock_transport_send(&hdr, NULL, 0, 1);
+	spinlock_irqsave_lock(&vsock_lock);
+
+	if (s->gen != gen) {
+		ret = -EBADF;
+		goto out;
+	}
+	if (ret) {
+		vsock_reset_state(s, VSOCK_UNBOUND);
+		goto out;
+	}
+
+	while (s->state == VSOCK_CONNECTING) {
+		vsock_wait(&s->waiters);
+
+		if (s->gen != gen) {
+			ret = -EBADF;
+			goto out;
+		}
+	}
+
+	if (s->state != VSOCK_CONNECTED) {
+		ret = s->error ? s->error : -ECONNREFUSED;
+		// the socket may try again
+		vsock_reset_state(s, VSOCK_UNBOUND);
+	}
+
+out:
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	if (data)
+		kfree(data);
+
+	return ret;
+}
+
+ssize_t vsock_read(int fd, void* buf, size_t len)
+{
+	struct virtio_vsock_hdr hdr;
+	vsock_t* s;
+	uint32_t gen, avail;
+	int update = 0;
+	ssize_t ret;
+
+	if (BUILTIN_EXPECT(!buf && len, 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_get(fd);
+	if (!s) {
+		ret = -EBADF;
+		goto out;
+	}
+
+	gen = s->gen;
+	while (1) {
+		if ((s->state != VSOCK_CONNECTED) && (s->state != VSOCK_CLOSED)) {
+			ret = -ENOTCONN;
+			goto out;
+		}
+
+		avail = s->head - s->tail;
+		if (avail || !len)
+			break;
+
+		// the buffered data is readable after a shutdown or a reset
+		if (s->state == VSOCK_CLOSED) {
+			ret = s->error;
+			goto out;
+		}
+		if (s->peer_shutdown & VIRTIO_VSOCK_SHUTDOWN_SEND) {
+			ret = 0;
+			goto out;
+		}
+
+		vsock_wait(&s->waiters);
+
+		if (s->gen != gen) {
+			ret = -EBADF;
+			goto out;
+		}
+	}
+
+	ret = MIN(len, avail);
+	if (ret) {
+		uint32_t off = s->tail & (VSOCK_BUFSIZE - 1);
+		uint32_t n = MIN((uint32_t) ret, VSOCK_BUFSIZE - off);
+
+		memcpy(buf, s->data + off, n);
+		memcpy((uint8_t*) buf + n, s->data, ret - n);
+		s->tail += ret;
+		s->fwd_cnt += ret;
+	}
+
+	// announce the free space, before the peer runs out of credit
+	if ((s->state == VSOCK_CONNECTED) && (s->fwd_cnt - s->last_fwd_cnt >= VSOCK_BUFSIZE / 4)) {
+		vsock_hdr(s, &hdr, VIRTIO_VSOCK_OP_CREDIT_UPDATE, 0, 0);
+		update = 1;
+	}
+
+out:
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	if (update)
+		vsock_transport_send(&hdr, NULL, 0, 1);
+
+	return ret;
+}
+
+ssize_t vsock_write(int fd, const void* buf, size_t len)
+{
+	struct virtio_vsock_hdr hdr;
+	vsock_t* s;
+	uint32_t gen, credit, n;
+	size_t sent = 0;
+	int ret;
+
+	if (BUILTIN_EXPECT(!buf && len, 0))
+		return -EINVAL;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_get(fd);
+	if (!s) {
+		spinlock_irqsave_unlock(&vsock_lock);
+		return -EBADF;
+	}
+
+	gen = s->gen;
+	while (sent < len) {
+		if (s->gen != gen) {
+			ret = -EBADF;
+			goto out;
+		}
+		if (s->state == VSOCK_CLOSED) {
+			ret = s->error ? s->error : -EPIPE;
+			goto out;
+		}
+		if (s->state != VSOCK_CONNECTED) {
+			ret = -ENOTCONN;
+			goto out;
+		}
+		if (s->peer_shutdown & VIRTIO_VSOCK_SHUTDOWN_RCV) {
+			ret = -EPIPE;
+			goto out;
+		}
+
+		credit = s->peer_buf_alloc - (s->tx_cnt - s->peer_fwd_cnt);
+		if (!credit || (credit > s->peer_buf_alloc)) {
+			// the peer will announce its free space
+			if (!s->credit_requested) {
+				vsock_ctrl(s, VIRTIO_VSOCK_OP_CREDIT_REQUEST, 0);
+				s->credit_requested = 1;
+			}
+			vsock_wait(&s->waiters);
+			continue;
+		}
+
+		n = MIN(MIN(len - sent, credit), VSOCK_MAX_PKT);
+		vsock_hdr(s, &hdr, VIRTIO_VSOCK_OP_RW, 0, n);
+		s->tx_cnt += n;
+
+		// the packet is copied into the ring, which may take a while, if it is full
+		spinlock_irqsave_unlock(&vsock_lock);
+		ret = vsock_transport_send(&hdr, (const uint8_t*) buf + sent, n, 1);
+		spinlock_irqsave_lock(&vsock_lock);
+
+		if (ret)
+			goto out;
+		sent += n;
+	}
+	ret = 0;
+
+out:
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	return sent ? (ssize_t) sent : ret;
+}
+
+int vsock_close(int fd)
+{
+	struct virtio_vsock_hdr hdr;
+	vsock_t* s;
+	int shutdown = 0;
+
+	spinlock_irqsave_lock(&vsock_lock);
+
+	s = vsock_get(fd);
+	if (!s) {
+		spinlock_irqsave_unlock(&vsock_lock);
+		return -EBADF;
+	}
+
+	switch(s->state) {
+	case VSOCK_LISTEN:
+		// reset the connections, which aren't accepted
+		while (s->bl_tail != s->bl_head) {
+			vsock_t* conn = socks + s->backlog[s->bl_tail % VSOCK_BACKLOG];
+
+			s->bl_tail++;
+			if (conn->state == VSOCK_CONNECTED)
+				vsock_ctrl(conn, VIRTIO_VSOCK_OP_RST, 0);
+			conn->state = VSOCK_FREE;
+			conn->gen++;
+		}
+		break;
+	case VSOCK_CONNECTING:
+	case VSOCK_CONNECTED:
+		// the peer confirms the shutdown by a reset, which doesn't find the socket any more
+		vsock_hdr(s, &hdr, VIRTIO_VSOCK_OP_SHUTDOWN, VIRTIO_VSOCK_SHUTDOWN_RCV|VIRTIO_VSOCK_SHUTDOWN_SEND, 0);
+		shutdown = 1;
+		break;
+	default:
+		break;
+	}
+
+	vsock_wakeup(&s->waiters);
+	s->state = VSOCK_FREE;
+	s->gen++;
+
+	spinlock_irqsave_unlock(&vsock_lock);
+
+	if (shutdown)
+		vsock_transport_send(&hdr, NULL, 0, 1);
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <hermit/stddef.h>
+#include <hermit/checksum.h>
+
+/*
+ * The ones' complement sum is independent of the word size: the carries
+ * of wider words are folded back at the end. The kernel doesn't use the
+ * vector registers, which belong to the application.
+ */
+uint32_t csum_partial(const void* data, size_t len, uint32_t sum)
+{
+	const uint8_t* p = (const uint8_t*) data;
+	uint64_t acc = sum;
+
+#ifdef __x86_64__
+	// four independent loads per iteration, the carry chain is folded into acc
+	for(; len >= 32; p += 32, len -= 32) {
+		asm volatile ("addq 0(%[p]), %[acc]\n\t"
+			"adcq 8(%[p]), %[acc]\n\t"
+			"adcq 16(%[p]), %[acc]\n\t"
+			"adcq 24(%[p]), %[acc]\n\t"
+			"adcq $0, %[acc]"
+			: [acc] "+r"(acc) : [p] "r"(p) : "memory", "cc");
+	}
+	for(; len >= 8; p += 8, len -= 8) {
+		asm volatile ("addq 0(%[p]), %[acc]\n\t"
+			"adcq $0, %[acc]"
+			: [acc] "+r"(acc) : [p] "r"(p) : "memory", "cc");
+	}
+
+	// the remaining bytes keep their position in a zero padded word
+	uint64_t tail = 0;
+
+	__builtin_memcpy(&tail, p, len);
+	asm volatile ("addq %[tail], %[acc]\n\t"
+		"adcq $0, %[acc]"
+		: [acc] "+r"(acc) : [tail] "r"(tail) : "cc");
+#else
+	// 32 bit words don't overflow the 64 bit accumulator
+	for(; len >= 4; p += 4, len -= 4) {
+		uint32_t w;
+
+		__builtin_memcpy(&w, p, 4);
+		acc += w;
+	}
+
+	if (len) {
+		uint32_t w = 0;
+
+		__builtin_memcpy(&w, p, len);
+		acc += w;
+	}
+#endif
+
+	acc = (acc & 0xFFFFFFFFULL) + (acc >> 32);
+	acc = (acc & 0xFFFFFFFFULL) + (acc >> 32);
+
+	return (uint32_t) acc;
+}
@@ -477,6 +477,11 @@ static void _putchar(int c, void *arg)
 	kputchar(c);
 }
 
+int kvprintf_console(const char *fmt, va_list ap)
+{
+	return kvprintf(fmt, _putchar, NULL, 10, ap);
+}
+
 int kprintf(const char *fmt, ...)
 {
 	int ret;
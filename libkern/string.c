@@ -10,15 +10,36 @@
 
 #include <hermit/string.h>
 
+/*
+ * The kernel doesn't use the vector registers, which belong to the
+ * application. Therefore, the comparisons process a word at a time.
+ * Aligned loads don't cross a page boundary, hence reading past the
+ * terminating zero is safe.
+ */
+#define WORD_SIZE	sizeof(size_t)
+#define WORD_ONES	((size_t) -1 / 0xFF)
+#define WORD_HIGHS	(WORD_ONES * 0x80)
+
+/// nonzero, if a byte of x is zero
+#define WORD_HAS_ZERO(x)	(((x) - WORD_ONES) & ~(x) & WORD_HIGHS)
+
+#define WORD_ALIGNED(p)		(!((size_t) (p) & (WORD_SIZE - 1)))
+
 #if !HAVE_ARCH_MEMCPY
 void *_memcpy(void *dest, const void *src, size_t count)
 {
-	size_t i;
+	size_t i = 0;
 
 	if (BUILTIN_EXPECT(!dest || !src, 0))
 		return dest;
 
-	for (i = 0; i < count; i++)
+	// copy whole words, if both addresses are aligned
+	if (!(((size_t) dest | (size_t) src) & (sizeof(size_t) - 1))) {
+		for (; i + sizeof(size_t) <= count; i += sizeof(size_t))
+			*(size_t*) ((char*)dest + i) = *(const size_t*) ((const char*)src + i);
+	}
+
+	for (; i < count; i++)
 		((char*)dest)[i] = ((char*)src)[i];
 
 	return dest;
@@ -28,12 +49,19 @@ void *_memcpy(void *dest, const void *src, size_t count)
 #if !HAVE_ARCH_MEMSET
 void *_memset(void *dest, int val, size_t count)
 {
-	size_t i;
+	size_t i = 0;
 
 	if (BUILTIN_EXPECT(!dest, 0))
 		return dest;
 
-	for (i = 0; i < count; i++)
+	if (!((size_t) dest & (sizeof(size_t) - 1))) {
+		const size_t pattern = ((size_t) -1 / 0xFF) * (unsigned char) val;
+
+		for (; i + sizeof(size_t) <= count; i += sizeof(size_t))
+			*(size_t*) ((char*)dest + i) = pattern;
+	}
+
+	for (; i < count; i++)
 		((char*) dest)[i] = (char) val;
 
 	return dest;
@@ -46,6 +74,21 @@ int _memcmp(const void *s1, const void *s2, size_t n)
 	if (n != 0) {
 		const unsigned char *p1 = s1, *p2 = s2;
 
+		// skip the equal words, the differing word is compared bytewise
+		if (((size_t) p1 & (WORD_SIZE - 1)) == ((size_t) p2 & (WORD_SIZE - 1))) {
+			while (!WORD_ALIGNED(p1) && (n > 1) && (*p1 == *p2)) {
+				p1++;
+				p2++;
+				n--;
+			}
+
+			while ((n > WORD_SIZE) && (*(const size_t*) p1 == *(const size_t*) p2)) {
+				p1 += WORD_SIZE;
+				p2 += WORD_SIZE;
+				n -= WORD_SIZE;
+			}
+		}
+
 		do {
 			if (*p1++ != *p2++)
 				return (*--p1 - *--p2);
@@ -61,9 +104,20 @@ size_t _strlen(const char *str)
 {
 	size_t len = 0;
 
+	const size_t* w;
+
 	if (BUILTIN_EXPECT(!str, 0))
 		return len;
 
+	while (!WORD_ALIGNED(str + len)) {
+		if (str[len] == '\0')
+			return len;
+		len++;
+	}
+
+	for (w = (const size_t*) (str + len); !WORD_HAS_ZERO(*w); w++)
+		len += WORD_SIZE;
+
 	while (str[len] != '\0')
 		len++;
 
@@ -109,11 +163,30 @@ char* _strcpy(char *dest, const char *src)
 #if !HAVE_ARCH_STRCMP
 int _strcmp(const char *s1, const char *s2)
 {
+	if (((size_t) s1 & (WORD_SIZE - 1)) == ((size_t) s2 & (WORD_SIZE - 1))) {
+		while (!WORD_ALIGNED(s1)) {
+			if (*s1 == '\0' || *s1 != *s2)
+				goto out;
+			s1++;
+			s2++;
+		}
+
+		while (1) {
+			const size_t w = *(const size_t*) s1;
+
+			if ((w != *(const size_t*) s2) || WORD_HAS_ZERO(w))
+				break;
+			s1 += WORD_SIZE;
+			s2 += WORD_SIZE;
+		}
+	}
+
 	while (*s1 != '\0' && *s1 == *s2) {
 		s1++;
 		s2++;
 	}
 
+out:
 	return (*(unsigned char *) s1) - (*(unsigned char *) s2);
 }
 #endif
@@ -124,6 +197,24 @@ int _strncmp(const char *s1, const char *s2, size_t n)
 	if (BUILTIN_EXPECT(n == 0, 0))
 		return 0;
 
+	if (((size_t) s1 & (WORD_SIZE - 1)) == ((size_t) s2 & (WORD_SIZE - 1))) {
+		while (!WORD_ALIGNED(s1) && (n > 1) && (*s1 != '\0') && (*s1 == *s2)) {
+			s1++;
+			s2++;
+			n--;
+		}
+
+		while (WORD_ALIGNED(s1) && (n > WORD_SIZE)) {
+			const size_t w = *(const size_t*) s1;
+
+			if ((w != *(const size_t*) s2) || WORD_HAS_ZERO(w))
+				break;
+			s1 += WORD_SIZE;
+			s2 += WORD_SIZE;
+			n -= WORD_SIZE;
+		}
+	}
+
 	while (n-- != 0 && *s1 == *s2) {
 		if (n == 0 || *s1 == '\0')
 			break;
@@ -44,6 +44,36 @@
 #include <hermit/ctype.h>
 #include <asm/limits.h>
 
+/*
+ * Find the first c or the terminating zero in s, a word at a time.
+ * Aligned loads don't cross a page boundary.
+ */
+static inline const char *
+strscan(const char *s, char c)
+{
+	const size_t ones = (size_t) -1 / 0xFF;
+	const size_t pattern = ones * (unsigned char) c;
+	size_t w;
+
+	while ((size_t) s & (sizeof(size_t) - 1)) {
+		if (*s == c || *s == '\0')
+			return s;
+		s++;
+	}
+
+	for (;; s += sizeof(size_t)) {
+		w = *(const size_t *) s;
+		if (((w - ones) & ~w & (ones * 0x80)) ||
+		    (((w ^ pattern) - ones) & ~(w ^ pattern) & (ones * 0x80)))
+			break;
+	}
+
+	while (*s != c && *s != '\0')
+		s++;
+
+	return s;
+}
+
 /*
  * Find the first occurrence of find in s.
  */
@@ -62,10 +92,9 @@ _strstr(s, find)
 	if ((c = *find++) != 0) {
 		len = strlen(find);
 		do {
-			do {
-				if ((sc = *s++) == 0)
-					return (NULL);
-			} while (sc != c);
+			s = strscan(s, c);
+			if ((sc = *s++) == 0)
+				return (NULL);
 		} while (strncmp(s, find, len) != 0);
 		s--;
 	}
@@ -31,20 +31,147 @@
 
 #include <hermit/stdio.h>
 #include <hermit/malloc.h>
+#include <hermit/hbwmalloc.h>
+#include <hermit/errno.h>
+#include <hermit/string.h>
 #include <hermit/spinlock.h>
 #include <hermit/memory.h>
 #include <hermit/logging.h>
+#include <hermit/vma.h>
 #include <asm/page.h>
+#include <asm/irqflags.h>
+#include <asm/processor.h>
 
-/// A linked list for each binary size exponent
-static buddy_t* buddy_lists[BUDDY_LISTS] = { [0 ... BUDDY_LISTS-1] = NULL };
+/** @brief Free buddy, which is linked in the list of its size */
+typedef struct buddy_free {
+	/// prefix with the exponent and the offset in its arena
+	buddy_t			buddy;
+	/// next free buddy of the same size
+	struct buddy_free*	next;
+	/// previous free buddy of the same size
+	struct buddy_free*	prev;
+} buddy_free_t;
 
-extern spinlock_irqsave_t hermit_mm_lock;
+struct buddy_arena;
+
+/** @brief Free lists and arenas, which share the same kind of memory */
+typedef struct buddy_pool {
+	/// A linked list for each binary size exponent
+	buddy_free_t*		lists[BUDDY_LISTS];
+	/// all arenas of the pool
+	struct buddy_arena*	arenas;
+	/// magic number of the allocated buddies
+	uint16_t		magic;
+} buddy_pool_t;
+
+/** @brief Memory region, which is allocated by palloc() and split into buddies
+ *
+ * The header is located in front of the buddies. The bitmap marks the
+ * start of each free buddy at a granularity of the minimal buddy size. The
+ * last word in front of the buddies points to the header.
+ */
+typedef struct buddy_arena {
+	/// next arena
+	struct buddy_arena*	next;
+	/// previous arena
+	struct buddy_arena*	prev;
+	/// pool, which owns the arena
+	buddy_pool_t*		pool;
+	/// start of the buddies
+	size_t			base;
+	/// size of the region, which includes the header
+	size_t			size;
+	/// binary exponent of the arena
+	uint8_t			exponent;
+	/// free buddies
+	uint64_t		bitmap[];
+} buddy_arena_t;
+
+/// buddies of kmalloc()
+static buddy_pool_t kmalloc_pool = { { [0 ... BUDDY_LISTS-1] = NULL }, NULL, BUDDY_MAGIC };
+
+/// buddies of hbw_malloc(), which are placed in high bandwidth memory
+static buddy_pool_t hbw_pool = { { [0 ... BUDDY_LISTS-1] = NULL }, NULL, HBW_MAGIC };
+
+/// policy of hbw_malloc(), which is fixed by the first allocation
+static int hbw_policy = HBW_POLICY_PREFERRED;
+static uint8_t hbw_policy_fixed = 0;
+
+/// statistics of the buddy allocator, protected by hermit_mm_lock
+static struct {
+	/// number of arenas
+	size_t	nr_arenas;
+	/// size of all arenas
+	size_t	arena_bytes;
+	/// number of merged buddies
+	size_t	nr_merges;
+	/// number of arenas, which were returned to the page allocator
+	size_t	nr_released;
+	/// size of the returned arenas
+	size_t	released_bytes;
+} buddy_stats = {0, 0, 0, 0, 0};
+
+extern mcs_spinlock_irqsave_t hermit_mm_lock;
+
+/// number of stack sizes, which are cached per core (kernel/user and IST stacks)
+#define STACK_CACHE_SIZES	2
+
+/// marks the size of a lazily mapped stack in the stack cache
+#define STACK_LAZY		1
+
+/// number of pages at the top of a lazily mapped stack, which are mapped in advance
+#define STACK_EAGER_PAGES	2
+
+/// the word, which links a released stack of size sz in the cache
+#define STACK_LINK(stack, sz)	((void**) ((size_t) (stack) + ((sz) & PAGE_MASK) - sizeof(void*)))
+
+/// access rights of the stacks
+#define STACK_VMA_FLAGS		(VMA_READ|VMA_WRITE|VMA_CACHEABLE)
+
+/** @brief Cache of released stacks with the same size
+ *
+ * The stacks are still mapped and linked by their last word, which lies
+ * in a mapped page also for lazily mapped stacks.
+ */
+typedef struct stack_cache {
+	/// size of the cached stacks (0 = unused entry)
+	size_t sz;
+	/// first released stack
+	void* first;
+	/// number of cached stacks
+	uint32_t nr;
+} stack_cache_t;
+
+/// released stacks per core, used only by its own core with disabled interrupts
+static stack_cache_t stack_cache[MAX_CORES][STACK_CACHE_SIZES] = {[0 ... MAX_CORES-1] = {[0 ... STACK_CACHE_SIZES-1] = {0, NULL, 0}}};
+
+#if MALLOC_CACHE_DEPTH > 0
+/// largest binary exponent, which is cached per core
+#define MALLOC_CACHE_MAX	12 // 4 KByte
+#define MALLOC_CACHE_LISTS	(MALLOC_CACHE_MAX-BUDDY_MIN+1)
+/// number of buddies, which are moved at once between a cache and the free lists
+#define MALLOC_CACHE_BATCH	((MALLOC_CACHE_DEPTH + 1) / 2)
+
+/** @brief Cache of released buddies with the same size
+ *
+ * The buddies are linked by the next pointer of buddy_free_t and remain
+ * allocated from the view of the free lists.
+ */
+typedef struct malloc_cache {
+	/// first cached buddy
+	struct buddy_free* first;
+	/// number of cached buddies
+	uint32_t nr;
+} malloc_cache_t;
+
+/// released buddies per core, used only by its own core with disabled interrupts
+static malloc_cache_t malloc_cache[MAX_CORES][MALLOC_CACHE_LISTS] = {[0 ... MAX_CORES-1] = {[0 ... MALLOC_CACHE_LISTS-1] = {NULL, 0}}};
+#endif
 
 /** @brief Check if larger free buddies are available */
-static inline int buddy_large_avail(uint8_t exp)
+static inline int buddy_large_avail(buddy_pool_t* pool, uint8_t exp)
 {
-	while ((exp<BUDDY_MAX) && !buddy_lists[exp-BUDDY_MIN])
+	while ((exp<BUDDY_MAX) && !pool->lists[exp-BUDDY_MIN])
 		exp++;
 
 	return exp != BUDDY_MAX;
@@ -64,51 +191,187 @@ static inline int buddy_exp(size_t sz)
 	return exp;
 }
 
+/** @brief Get the arena of a buddy */
+static inline buddy_arena_t* buddy_arena(buddy_t* buddy)
+{
+	size_t base = (size_t) buddy - ((size_t) buddy->prefix.offset << BUDDY_MIN);
+
+	return ((buddy_arena_t**) base)[-1];
+}
+
+/** @brief Insert a free buddy in its list and mark it in the bitmap of its arena */
+static void buddy_list_insert(buddy_arena_t* arena, buddy_free_t* buddy, uint8_t exp, uint32_t offset)
+{
+	buddy_free_t** list = &arena->pool->lists[exp-BUDDY_MIN];
+
+	buddy->buddy.prefix.exponent = exp;
+	buddy->buddy.prefix.magic = 0;
+	buddy->buddy.prefix.offset = offset;
+	buddy->prev = NULL;
+	buddy->next = *list;
+	if (*list)
+		(*list)->prev = buddy;
+	*list = buddy;
+
+	arena->bitmap[offset / 64] |= (1ULL << (offset % 64));
+}
+
+/** @brief Remove a free buddy from its list */
+static void buddy_list_remove(buddy_arena_t* arena, buddy_free_t* buddy)
+{
+	const uint32_t offset = buddy->buddy.prefix.offset;
+
+	if (buddy->prev)
+		buddy->prev->next = buddy->next;
+	else
+		arena->pool->lists[buddy->buddy.prefix.exponent-BUDDY_MIN] = buddy->next;
+	if (buddy->next)
+		buddy->next->prev = buddy->prev;
+
+	arena->bitmap[offset / 64] &= ~(1ULL << (offset % 64));
+}
+
+static void* hbw_palloc(size_t sz);
+
+/** @brief Allocate a new arena, which is completely used by one buddy
+ *
+ * Has to be called with hermit_mm_lock.
+ */
+static buddy_free_t* buddy_arena_create(buddy_pool_t* pool, int exp)
+{
+	const size_t bitmap = (1ULL << (exp - BUDDY_MIN)) / 8;
+	const size_t header = PAGE_CEIL(sizeof(buddy_arena_t) + bitmap + sizeof(buddy_arena_t*));
+	buddy_arena_t* arena;
+	buddy_free_t* buddy;
+
+	if (pool == &hbw_pool)
+		arena = (buddy_arena_t*) hbw_palloc(header + (1ULL << exp));
+	else
+		arena = (buddy_arena_t*) palloc(header + (1ULL << exp), VMA_HEAP|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!arena, 0))
+		return NULL;
+
+	memset(arena, 0x00, sizeof(buddy_arena_t) + bitmap);
+	arena->base = (size_t) arena + header;
+	arena->size = header + (1ULL << exp);
+	arena->exponent = exp;
+	arena->pool = pool;
+	((buddy_arena_t**) arena->base)[-1] = arena;
+
+	arena->next = pool->arenas;
+	if (pool->arenas)
+		pool->arenas->prev = arena;
+	pool->arenas = arena;
+
+	buddy_stats.nr_arenas++;
+	buddy_stats.arena_bytes += arena->size;
+	mem_account(MEM_TAG_KMALLOC, arena->size >> PAGE_BITS, 0);
+
+	buddy = (buddy_free_t*) arena->base;
+	buddy->buddy.prefix.exponent = exp;
+	buddy->buddy.prefix.offset = 0;
+
+	return buddy;
+}
+
+/** @brief Return a completely free arena to the page allocator
+ *
+ * Has to be called with hermit_mm_lock.
+ */
+static void buddy_arena_release(buddy_arena_t* arena)
+{
+	const size_t viraddr = (size_t) arena;
+	const size_t npages = arena->size >> PAGE_BITS;
+	size_t phyaddr;
+
+	if (arena->prev)
+		arena->prev->next = arena->next;
+	else
+		arena->pool->arenas = arena->next;
+	if (arena->next)
+		arena->next->prev = arena->prev;
+
+	buddy_stats.nr_arenas--;
+	buddy_stats.arena_bytes -= arena->size;
+	buddy_stats.nr_released++;
+	buddy_stats.released_bytes += arena->size;
+	mem_account(MEM_TAG_KMALLOC, -(int64_t) npages, 0);
+
+	phyaddr = virt_to_phys(viraddr);
+	page_unmap(viraddr, npages);
+	vma_free(viraddr, viraddr + arena->size);
+	if (phyaddr)
+		put_pages(phyaddr, npages);
+}
+
 /** @brief Get a free buddy by potentially splitting a larger one */
-static buddy_t* buddy_get(int exp)
+static buddy_t* buddy_get(buddy_pool_t* pool, int exp)
 {
-	spinlock_irqsave_lock(&hermit_mm_lock);
-	buddy_t** list = &buddy_lists[exp-BUDDY_MIN];
-	buddy_t* buddy = *list;
-	buddy_t* split;
+	mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+	buddy_free_t* buddy = pool->lists[exp-BUDDY_MIN];
+	buddy_free_t* split;
 
 	if (buddy)
 		// there is already a free buddy =>
 		// we remove it from the list
-		*list = buddy->next;
-	else if ((exp >= BUDDY_ALLOC) && !buddy_large_avail(exp))
+		buddy_list_remove(buddy_arena(&buddy->buddy), buddy);
+	else if ((exp >= BUDDY_ALLOC) && !buddy_large_avail(pool, exp))
 		// theres no free buddy larger than exp =>
 		// we can allocate new memory
-		buddy = (buddy_t*) palloc(1<<exp, VMA_HEAP|VMA_CACHEABLE);
+		buddy = buddy_arena_create(pool, exp);
 	else {
 		// we recursivly request a larger buddy...
-		buddy = buddy_get(exp+1);
+		buddy = (buddy_free_t*) buddy_get(pool, exp+1);
 		if (BUILTIN_EXPECT(!buddy, 0))
 			goto out;
 
 		// ... and split it, by putting the second half back to the list
-		split = (buddy_t*) ((size_t) buddy + (1<<exp));
-		split->next = *list;
-		*list = split;
+		split = (buddy_free_t*) ((size_t) buddy + (1<<exp));
+		buddy_list_insert(buddy_arena(&buddy->buddy), split, exp,
+			buddy->buddy.prefix.offset + (1 << (exp - BUDDY_MIN)));
 	}
 
 out:
-	spinlock_irqsave_unlock(&hermit_mm_lock);
+	mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
 
-	return buddy;
+	return (buddy_t*) buddy;
 }
 
 /** @brief Put a buddy back to its free list
  *
- * TODO: merge adjacent buddies (memory compaction)
+ * The buddy is merged with its free neighbours. A completely free arena
+ * is returned to the page allocator, unless it is the last one.
  */
 static void buddy_put(buddy_t* buddy)
 {
-	spinlock_irqsave_lock(&hermit_mm_lock);
-	buddy_t** list = &buddy_lists[buddy->prefix.exponent-BUDDY_MIN];
-	buddy->next = *list;
-	*list = buddy;
-	spinlock_irqsave_unlock(&hermit_mm_lock);
+	mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+	buddy_arena_t* arena = buddy_arena(buddy);
+	uint32_t offset = buddy->prefix.offset;
+	uint8_t exp = buddy->prefix.exponent;
+
+	while (exp < arena->exponent) {
+		const uint32_t mask = 1 << (exp - BUDDY_MIN);
+		const uint32_t other = offset ^ mask;
+		buddy_free_t* neighbour = (buddy_free_t*) (arena->base + ((size_t) other << BUDDY_MIN));
+
+		// is the neighbour a free buddy of the same size?
+		if (!(arena->bitmap[other / 64] & (1ULL << (other % 64))))
+			break;
+		if (neighbour->buddy.prefix.exponent != exp)
+			break;
+
+		buddy_list_remove(arena, neighbour);
+		buddy_stats.nr_merges++;
+		offset &= ~mask;
+		exp++;
+	}
+
+	if ((exp == arena->exponent) && ((arena->next) || (arena->prev)))
+		buddy_arena_release(arena);
+	else
+		buddy_list_insert(arena, (buddy_free_t*) (arena->base + ((size_t) offset << BUDDY_MIN)), exp, offset);
+
+	mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
 }
 
 void buddy_dump(void)
@@ -116,31 +379,198 @@ void buddy_dump(void)
 	size_t free = 0;
 	int i;
 
+	mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+
 	for (i=0; i<BUDDY_LISTS; i++) {
-		buddy_t* buddy;
+		buddy_free_t* buddy;
 		int exp = i+BUDDY_MIN;
 
-		if (buddy_lists[i])
+		if (kmalloc_pool.lists[i])
 			LOG_INFO("buddy_list[%u] (exp=%u, size=%lu bytes):\n", i, exp, 1<<exp);
 
-		for (buddy=buddy_lists[i]; buddy; buddy=buddy->next) {
+		for (buddy=kmalloc_pool.lists[i]; buddy; buddy=buddy->next) {
 			LOG_INFO("  %p -> %p \n", buddy, buddy->next);
 			free += 1<<exp;
 		}
 	}
 	LOG_INFO("free buddies: %lu bytes\n", free);
+#if MALLOC_CACHE_DEPTH > 0
+	{
+		size_t cached = 0;
+		uint32_t core_id;
+
+		for (core_id=0; core_id<MAX_CORES; core_id++) {
+			for (i=0; i<MALLOC_CACHE_LISTS; i++)
+				cached += (size_t) malloc_cache[core_id][i].nr << (i+BUDDY_MIN);
+		}
+		LOG_INFO("buddies in the per core caches: %zd bytes\n", cached);
+	}
+#endif
+	LOG_INFO("arenas: %zd (%zd bytes), merged buddies: %zd, released arenas: %zd (%zd bytes)\n",
+		buddy_stats.nr_arenas, buddy_stats.arena_bytes, buddy_stats.nr_merges,
+		buddy_stats.nr_released, buddy_stats.released_bytes);
+
+	mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+}
+
+int buddy_info(buddy_info_t* info)
+{
+	int i;
+
+	if (BUILTIN_EXPECT(!info, 0))
+		return -EINVAL;
+
+	memset(info, 0x00, sizeof(buddy_info_t));
+
+	mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+
+	for (i=0; i<BUDDY_LISTS; i++) {
+		buddy_free_t* buddy;
+
+		for (buddy=kmalloc_pool.lists[i]; buddy; buddy=buddy->next)
+			info->free_blocks[i]++;
+
+		info->free_bytes += info->free_blocks[i] << (i+BUDDY_MIN);
+		if (info->free_blocks[i])
+			info->largest_free = 1ULL << (i+BUDDY_MIN);
+	}
+#if MALLOC_CACHE_DEPTH > 0
+	{
+		uint32_t core_id;
+
+		for (core_id=0; core_id<MAX_CORES; core_id++) {
+			for (i=0; i<MALLOC_CACHE_LISTS; i++)
+				info->cached_bytes += (uint64_t) malloc_cache[core_id][i].nr << (i+BUDDY_MIN);
+		}
+	}
+#endif
+	info->nr_arenas = buddy_stats.nr_arenas;
+	info->arena_bytes = buddy_stats.arena_bytes;
+	info->nr_merges = buddy_stats.nr_merges;
+	info->nr_released = buddy_stats.nr_released;
+	info->released_bytes = buddy_stats.released_bytes;
+
+	mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+
+	return 0;
+}
+
+#if MALLOC_CACHE_DEPTH > 0
+/** @brief Get a buddy from the cache of the current core
+ *
+ * An empty cache is refilled by MALLOC_CACHE_BATCH buddies, which are
+ * taken at once from the free lists.
+ */
+static buddy_t* malloc_cache_get(int exp)
+{
+	malloc_cache_t* cache;
+	buddy_free_t* buddy;
+	uint8_t flags;
+	uint32_t i;
+
+	flags = irq_nested_disable();
+	cache = &malloc_cache[CORE_ID][exp-BUDDY_MIN];
+
+	if (!cache->first) {
+		mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+		for(i=0; i<MALLOC_CACHE_BATCH; i++) {
+			buddy = (buddy_free_t*) buddy_get(&kmalloc_pool, exp);
+			if (BUILTIN_EXPECT(!buddy, 0))
+				break;
+
+			buddy->next = cache->first;
+			cache->first = buddy;
+			cache->nr++;
+		}
+		mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+	}
+
+	buddy = cache->first;
+	if (buddy) {
+		cache->first = buddy->next;
+		cache->nr--;
+	}
+	irq_nested_enable(flags);
+
+	return (buddy_t*) buddy;
+}
+
+/** @brief Put a buddy in the cache of the current core
+ *
+ * A full cache returns MALLOC_CACHE_BATCH buddies at once to the free lists.
+ */
+static void malloc_cache_put(buddy_t* buddy)
+{
+	malloc_cache_t* cache;
+	buddy_free_t* tmp;
+	uint8_t flags;
+	uint32_t i;
+
+	// a cached buddy isn't valid for kfree()
+	buddy->prefix.magic = 0;
+
+	flags = irq_nested_disable();
+	cache = &malloc_cache[CORE_ID][buddy->prefix.exponent-BUDDY_MIN];
+
+	((buddy_free_t*) buddy)->next = cache->first;
+	cache->first = (buddy_free_t*) buddy;
+	cache->nr++;
+
+	if (cache->nr > MALLOC_CACHE_DEPTH) {
+		mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+		for(i=0; i<MALLOC_CACHE_BATCH; i++) {
+			tmp = cache->first;
+			cache->first = tmp->next;
+			cache->nr--;
+			buddy_put(&tmp->buddy);
+		}
+		mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+	}
+	irq_nested_enable(flags);
+}
+#endif
+
+/** @brief Reserve virtual address space, which starts at a multiple of align
+ *
+ * The region is allocated larger and trimmed (see mmap_region).
+ */
+static size_t vma_alloc_aligned(size_t size, size_t align, uint32_t flags)
+{
+	size_t start, aligned, total = size + align - PAGE_SIZE;
+
+	// the lock is recursive => allocate and trim the region atomically
+	mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+
+	start = vma_alloc(total, flags);
+	if (BUILTIN_EXPECT(!start, 0)) {
+		mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+		return 0;
+	}
+
+	aligned = (start + align - 1) & ~(align - 1);
+	if (aligned > start)
+		vma_free(start, aligned);
+	if (aligned + size < start + total)
+		vma_free(aligned + size, start + total);
+
+	mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+
+	return aligned;
 }
 
 void* palloc(size_t sz, uint32_t flags)
 {
-	size_t phyaddr, viraddr, bits;
+	size_t phyaddr, viraddr, bits, off, n;
 	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
-	int err;
+	int err = 0;
 
 	LOG_DEBUG("palloc(%zd) (%u pages)\n", sz, npages);
 
-	// get free virtual address space
-	viraddr = vma_alloc(PAGE_CEIL(sz), flags);
+	// get free virtual address space, large regions are backed by huge pages
+	if (PAGE_CEIL(sz) >= HUGE_PAGE_SIZE)
+		viraddr = vma_alloc_aligned(PAGE_CEIL(sz), HUGE_PAGE_SIZE, flags);
+	else
+		viraddr = vma_alloc(PAGE_CEIL(sz), flags);
 	if (BUILTIN_EXPECT(!viraddr, 0))
 		return NULL;
 
@@ -154,9 +584,21 @@ void* palloc(size_t sz, uint32_t flags)
 	//TODO: interpretation of from (vma) flags is missing
 	bits = PG_RW|PG_GLOBAL|PG_NX;
 
-	// map physical pages to VMA
-	err = page_map(viraddr, phyaddr, npages, bits);
+	/*
+	 * map physical pages to VMA: page_map creates a huge page for each
+	 * aligned chunk of HUGE_PAGE_SIZE, the tail is mapped by small pages
+	 */
+	for(off=0; !err && (off < (size_t) npages*PAGE_SIZE); off+=n*PAGE_SIZE) {
+		if (!((viraddr + off) & (HUGE_PAGE_SIZE-1)) && !((phyaddr + off) & (HUGE_PAGE_SIZE-1))
+		    && ((size_t) npages*PAGE_SIZE - off >= HUGE_PAGE_SIZE))
+			n = HUGE_PAGE_SIZE >> PAGE_BITS;
+		else
+			n = npages - (off >> PAGE_BITS);
+
+		err = page_map(viraddr + off, phyaddr + off, n, bits);
+	}
 	if (BUILTIN_EXPECT(err, 0)) {
+		page_unmap(viraddr, npages);
 		vma_free(viraddr, viraddr+npages*PAGE_SIZE);
 		put_pages(phyaddr, npages);
 		return NULL;
@@ -165,10 +607,74 @@ void* palloc(size_t sz, uint32_t flags)
 	return (void*) viraddr;
 }
 
+/** @brief Take a stack of the given size from the cache of the current core
+ *
+ * @return Pointer to the stack or NULL, if no stack is cached
+ */
+static void* stack_cache_get(size_t sz)
+{
+	void* stack = NULL;
+	uint8_t flags;
+	uint32_t i;
+
+	flags = irq_nested_disable();
+	for(i=0; i<STACK_CACHE_SIZES; i++) {
+		stack_cache_t* cache = &stack_cache[CORE_ID][i];
+
+		if ((cache->sz == sz) && cache->first) {
+			stack = cache->first;
+			cache->first = *STACK_LINK(stack, sz);
+			cache->nr--;
+			break;
+		}
+	}
+	irq_nested_enable(flags);
+
+	return stack;
+}
+
+/** @brief Put a stack in the cache of the current core
+ *
+ * @return 0 on success, -ENOMEM if the cache is full
+ */
+static int stack_cache_put(void* stack, size_t sz)
+{
+	stack_cache_t* cache = NULL;
+	int ret = -ENOMEM;
+	uint8_t flags;
+	uint32_t i;
+
+	flags = irq_nested_disable();
+	for(i=0; i<STACK_CACHE_SIZES; i++) {
+		stack_cache_t* entry = &stack_cache[CORE_ID][i];
+
+		if (entry->sz == sz) {
+			cache = entry;
+			break;
+		}
+
+		// use the first free entry for this size
+		if (!cache && !entry->nr)
+			cache = entry;
+	}
+
+	if (cache && (cache->nr < STACK_CACHE_DEPTH)) {
+		cache->sz = sz;
+		*STACK_LINK(stack, sz) = cache->first;
+		cache->first = stack;
+		cache->nr++;
+		ret = 0;
+	}
+	irq_nested_enable(flags);
+
+	return ret;
+}
+
 void* create_stack(size_t sz)
 {
 	size_t phyaddr, viraddr, bits;
 	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+	void* stack;
 	int err;
 
 	LOG_DEBUG("create_stack(0x%zx) (%u pages)\n", DEFAULT_STACK_SIZE, npages);
@@ -176,6 +682,11 @@ void* create_stack(size_t sz)
 	if (BUILTIN_EXPECT(!sz, 0))
 		return NULL;
 
+	// reuse a released stack, which is still mapped
+	stack = stack_cache_get(PAGE_CEIL(sz));
+	if (stack)
+		return stack;
+
 	// get free virtual address space
 	viraddr = vma_alloc((npages+2)*PAGE_SIZE, VMA_READ|VMA_WRITE|VMA_CACHEABLE);
 	if (BUILTIN_EXPECT(!viraddr, 0))
@@ -197,14 +708,64 @@ void* create_stack(size_t sz)
 		put_pages(phyaddr, npages);
 		return NULL;
 	}
+	mem_account(MEM_TAG_STACK, npages, 0);
 
 	return (void*) (viraddr+PAGE_SIZE);
 }
 
+void* create_lazy_stack(size_t sz)
+{
+#if defined(LAZY_STACKS) && defined(__x86_64__)
+	size_t viraddr, top;
+	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+	void* stack;
+
+	LOG_DEBUG("create_lazy_stack(0x%zx) (%u pages)\n", sz, npages);
+
+	if (BUILTIN_EXPECT(!sz, 0))
+		return NULL;
+	if (npages <= STACK_EAGER_PAGES)
+		return create_stack(sz);
+
+	stack = stack_cache_get(PAGE_CEIL(sz) | STACK_LAZY);
+	if (stack)
+		return stack;
+
+	// the guard pages aren't anonymous memory => an access is an error
+	viraddr = vma_alloc((npages+2)*PAGE_SIZE, STACK_VMA_FLAGS);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return NULL;
+
+	// the page fault handler maps the remaining pages on demand
+	if (BUILTIN_EXPECT(vma_set_flags(viraddr+PAGE_SIZE, viraddr+(npages+1)*PAGE_SIZE, STACK_VMA_FLAGS|VMA_ANON), 0))
+		goto out;
+
+	// the initial frame and the first calls are located at the top
+	top = viraddr + (npages+1)*PAGE_SIZE;
+	if (BUILTIN_EXPECT(page_populate(top - STACK_EAGER_PAGES*PAGE_SIZE, top, STACK_VMA_FLAGS|VMA_ANON), 0)) {
+		page_discard(viraddr+PAGE_SIZE, npages);
+		vma_free(viraddr+PAGE_SIZE, viraddr+(npages+1)*PAGE_SIZE);
+		goto out;
+	}
+
+	return (void*) (viraddr+PAGE_SIZE);
+
+out:
+	vma_free(viraddr, viraddr+PAGE_SIZE);
+	vma_free(viraddr+(npages+1)*PAGE_SIZE, viraddr+(npages+2)*PAGE_SIZE);
+	return NULL;
+#else
+	return create_stack(sz);
+#endif
+}
+
 int destroy_stack(void* viraddr, size_t sz)
 {
 	size_t phyaddr;
 	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+#if defined(LAZY_STACKS) && defined(__x86_64__)
+	vma_t vma;
+#endif
 
 	LOG_DEBUG("destroy_stack(0x%zx) (size 0x%zx)\n", viraddr, DEFAULT_STACK_SIZE);
 
@@ -213,6 +774,26 @@ int destroy_stack(void* viraddr, size_t sz)
 	if (BUILTIN_EXPECT(!sz, 0))
 		return -EINVAL;
 
+#if defined(LAZY_STACKS) && defined(__x86_64__)
+	// lazily mapped stacks are anonymous memory
+	if (!vma_lookup((size_t) viraddr, &vma) && (vma.flags & VMA_ANON)) {
+		if (!stack_cache_put(viraddr, PAGE_CEIL(sz) | STACK_LAZY))
+			return 0;
+
+		// releases only the mapped pages
+		page_discard((size_t) viraddr, npages);
+		vma_free((size_t) viraddr, (size_t) viraddr+npages*PAGE_SIZE);
+		vma_free((size_t) viraddr-PAGE_SIZE, (size_t) viraddr);
+		vma_free((size_t) viraddr+npages*PAGE_SIZE, (size_t) viraddr+(npages+1)*PAGE_SIZE);
+
+		return 0;
+	}
+#endif
+
+	// keep the stack mapped for the next thread
+	if (!stack_cache_put(viraddr, PAGE_CEIL(sz)))
+		return 0;
+
 	phyaddr = virt_to_phys((size_t)viraddr);
 	if (BUILTIN_EXPECT(!phyaddr, 0))
 		return -ENOMEM;
@@ -221,6 +802,7 @@ int destroy_stack(void* viraddr, size_t sz)
 	vma_free((size_t)viraddr-PAGE_SIZE, (size_t)viraddr+(npages+1)*PAGE_SIZE);
 	page_unmap((size_t)viraddr, npages);
 	put_pages(phyaddr, npages);
+	mem_account(MEM_TAG_STACK, -(int64_t) npages, 0);
 
 	return 0;
 }
@@ -237,13 +819,18 @@ void* kmalloc(size_t sz)
 	if (BUILTIN_EXPECT(!exp, 0))
 		return NULL;
 
-	buddy_t* buddy = buddy_get(exp);
+#if MALLOC_CACHE_DEPTH > 0
+	buddy_t* buddy = (exp <= MALLOC_CACHE_MAX) ? malloc_cache_get(exp) : buddy_get(&kmalloc_pool, exp);
+#else
+	buddy_t* buddy = buddy_get(&kmalloc_pool, exp);
+#endif
 	if (BUILTIN_EXPECT(!buddy, 0))
 		return NULL;
 
 	// setup buddy prefix
 	buddy->prefix.magic = BUDDY_MAGIC;
 	buddy->prefix.exponent = exp;
+	mem_account(MEM_TAG_KMALLOC, 0, 1LL << exp);
 
 	LOG_DEBUG("kmalloc(%zd) = %p\n", sz, buddy+1);
 
@@ -264,5 +851,237 @@ void kfree(void *addr)
 	if (BUILTIN_EXPECT(buddy->prefix.magic != BUDDY_MAGIC, 0))
 		return;
 
+	mem_account(MEM_TAG_KMALLOC, 0, -(1LL << buddy->prefix.exponent));
+
+#if MALLOC_CACHE_DEPTH > 0
+	if (buddy->prefix.exponent <= MALLOC_CACHE_MAX) {
+		malloc_cache_put(buddy);
+		return;
+	}
+#endif
+
+	buddy_put(buddy);
+}
+
+/** @brief Allocate and map pages for an arena of hbw_malloc()
+ *
+ * The pages are taken from the high bandwidth memory. The main memory is
+ * used as fallback, unless the policy is HBW_POLICY_BIND.
+ */
+static void* hbw_palloc(size_t sz)
+{
+	size_t phyaddr = 0, viraddr, bits;
+	uint32_t npages = PAGE_CEIL(sz) >> PAGE_BITS;
+	int err;
+
+	LOG_DEBUG("hbw_palloc(%zd) (%u pages)\n", sz, npages);
+
+	// get free virtual address space
+	viraddr = vma_alloc(PAGE_CEIL(sz), VMA_HEAP|VMA_CACHEABLE);
+	if (BUILTIN_EXPECT(!viraddr, 0))
+		return NULL;
+
+	// get continous physical pages
+#ifndef __aarch64__
+	if (has_hbmem())
+		phyaddr = hbmem_get_pages(npages);
+#endif
+	if (!phyaddr && (hbw_policy != HBW_POLICY_BIND))
+		phyaddr = get_pages(npages);
+	if (BUILTIN_EXPECT(!phyaddr, 0)) {
+		vma_free(viraddr, viraddr+npages*PAGE_SIZE);
+		return NULL;
+	}
+
+	bits = PG_RW|PG_GLOBAL|PG_NX;
+
+	// map physical pages to VMA
+	err = page_map(viraddr, phyaddr, npages, bits);
+	if (BUILTIN_EXPECT(err, 0)) {
+		vma_free(viraddr, viraddr+npages*PAGE_SIZE);
+		put_pages(phyaddr, npages);
+		return NULL;
+	}
+
+	return (void*) viraddr;
+}
+
+/** @brief Allocate a buddy of hbw_pool, which contains an aligned block of size bytes
+ *
+ * An alignment larger than the prefix moves the block into the buddy. A
+ * second prefix in front of the block points back to the buddy.
+ */
+static void* hbw_alloc(size_t size, size_t alignment)
+{
+	size_t sz, addr;
+	buddy_t* buddy;
+	int exp;
+
+	if (BUILTIN_EXPECT(!size, 0))
+		return NULL;
+
+	// add space for the prefix and the alignment
+	sz = size + sizeof(buddy_t);
+	if (alignment > sizeof(buddy_t))
+		sz += alignment;
+	if (BUILTIN_EXPECT(sz < size, 0))
+		return NULL;
+
+	exp = buddy_exp(sz);
+	if (BUILTIN_EXPECT(!exp, 0))
+		return NULL;
+
+	hbw_policy_fixed = 1;
+
+	buddy = buddy_get(&hbw_pool, exp);
+	if (BUILTIN_EXPECT(!buddy, 0))
+		return NULL;
+
+	// setup buddy prefix
+	buddy->prefix.magic = HBW_MAGIC;
+	buddy->prefix.exponent = exp;
+
+	addr = (size_t) (buddy+1);
+	if ((alignment > sizeof(buddy_t)) && (addr & (alignment-1))) {
+		buddy_t* prefix;
+
+		addr = (addr + alignment - 1) & ~(alignment - 1);
+		prefix = (buddy_t*) addr - 1;
+		prefix->prefix.magic = HBW_ALIGN_MAGIC;
+		prefix->prefix.exponent = 0;
+		prefix->prefix.offset = (addr - (size_t) buddy) / sizeof(buddy_t);
+	}
+
+	LOG_DEBUG("hbw_alloc(%zd, %zd) = %p\n", size, alignment, addr);
+
+	return (void*) addr;
+}
+
+/** @brief Get the buddy of a block, which hbw_alloc() returned
+ *
+ * @return Pointer to the buddy or NULL for an invalid block
+ */
+static buddy_t* hbw_buddy(void* ptr)
+{
+	buddy_t* buddy = (buddy_t*) ptr - 1;
+
+	if (buddy->prefix.magic == HBW_ALIGN_MAGIC)
+		buddy = (buddy_t*) ptr - buddy->prefix.offset;
+
+	if (BUILTIN_EXPECT(buddy->prefix.magic != HBW_MAGIC, 0))
+		return NULL;
+
+	return buddy;
+}
+
+int hbw_check_available(void)
+{
+	return has_hbmem() ? 0 : ENODEV;
+}
+
+int hbw_set_policy(hbw_policy_t mode)
+{
+	if (BUILTIN_EXPECT((mode < HBW_POLICY_BIND) || (mode > HBW_POLICY_INTERLEAVE), 0))
+		return EINVAL;
+	if (hbw_policy_fixed)
+		return EPERM;
+
+	hbw_policy = mode;
+
+	return 0;
+}
+
+hbw_policy_t hbw_get_policy(void)
+{
+	return hbw_policy;
+}
+
+void* hbw_malloc(size_t size)
+{
+	return hbw_alloc(size, 0);
+}
+
+void* hbw_calloc(size_t num, size_t size)
+{
+	void* ptr;
+
+	if (BUILTIN_EXPECT(num && (size > ((size_t) -1) / num), 0))
+		return NULL;
+
+	ptr = hbw_alloc(num * size, 0);
+	if (ptr)
+		memset(ptr, 0x00, num * size);
+
+	return ptr;
+}
+
+void* hbw_realloc(void* ptr, size_t size)
+{
+	buddy_t* buddy;
+	size_t avail;
+	void* new_ptr;
+
+	if (!ptr)
+		return hbw_alloc(size, 0);
+
+	if (!size) {
+		hbw_free(ptr);
+		return NULL;
+	}
+
+	buddy = hbw_buddy(ptr);
+	if (BUILTIN_EXPECT(!buddy, 0))
+		return NULL;
+
+	// does the block still fit into its buddy?
+	avail = (1ULL << buddy->prefix.exponent) - ((size_t) ptr - (size_t) buddy);
+	if (size <= avail)
+		return ptr;
+
+	new_ptr = hbw_alloc(size, 0);
+	if (BUILTIN_EXPECT(!new_ptr, 0))
+		return NULL;
+
+	memcpy(new_ptr, ptr, avail);
+	hbw_free(ptr);
+
+	return new_ptr;
+}
+
+int hbw_posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+	if (BUILTIN_EXPECT(!memptr, 0))
+		return EINVAL;
+	if (BUILTIN_EXPECT((alignment < sizeof(void*)) || (alignment & (alignment - 1)), 0))
+		return EINVAL;
+
+	if (!size) {
+		*memptr = NULL;
+		return 0;
+	}
+
+	*memptr = hbw_alloc(size, alignment);
+
+	return *memptr ? 0 : ENOMEM;
+}
+
+void hbw_free(void* ptr)
+{
+	buddy_t* buddy;
+
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return;
+
+	LOG_DEBUG("hbw_free(%p)\n", ptr);
+
+	buddy = hbw_buddy(ptr);
+	if (BUILTIN_EXPECT(!buddy, 0))
+		return;
+
+	// a released block isn't valid for hbw_free()
+	if (buddy != (buddy_t*) ptr - 1)
+		((buddy_t*) ptr - 1)->prefix.magic = 0;
+	buddy->prefix.magic = 0;
+
 	buddy_put(buddy);
 }
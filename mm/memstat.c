@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Memory accounting per subsystem and per task
+ *
+ * The counters are updated by atomic operations. The high-water marks
+ * are raised by compare-and-swap, which happens only, if the usage grows
+ * beyond the previous maximum.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/errno.h>
+#include <hermit/tasks.h>
+#include <hermit/memory.h>
+#include <hermit/logging.h>
+#include <asm/atomic.h>
+#include <asm/irqflags.h>
+
+extern atomic_int64_t total_pages;
+extern atomic_int64_t total_allocated_pages;
+extern atomic_int64_t total_available_pages;
+
+static struct {
+	atomic_int64_t pages;
+	atomic_int64_t max_pages;
+	atomic_int64_t bytes;
+	atomic_int64_t max_bytes;
+} __attribute__ ((aligned (CACHE_LINE))) mem_tags[MEM_NR_TAGS];
+
+static const char* const mem_tag_names[MEM_NR_TAGS] = {
+	"heap", "stack", "page tables", "anonymous", "kmalloc", "network", "drivers",
+	"tmpfs"
+};
+
+static inline void raise_max(atomic_int64_t* max, int64_t val)
+{
+	int64_t old = atomic_int64_read(max);
+
+	while ((val > old) && (atomic_int64_cmpxchg(max, old, val) != old))
+		old = atomic_int64_read(max);
+}
+
+void mem_account(uint32_t tag, int64_t pages, int64_t bytes)
+{
+	if (BUILTIN_EXPECT(tag >= MEM_NR_TAGS, 0))
+		return;
+
+	if (pages) {
+		raise_max(&mem_tags[tag].max_pages, atomic_int64_add(&mem_tags[tag].pages, pages));
+
+		if ((tag == MEM_TAG_HEAP) || (tag == MEM_TAG_STACK) || (tag == MEM_TAG_ANON)) {
+			uint8_t flags = irq_nested_disable();
+			task_t* task = per_core(current_task);
+
+			// only the task itself changes its counters
+			task->stats.mem_pages += pages;
+			if (task->stats.mem_pages > task->stats.mem_max_pages)
+				task->stats.mem_max_pages = task->stats.mem_pages;
+			irq_nested_enable(flags);
+		}
+	}
+
+	if (bytes)
+		raise_max(&mem_tags[tag].max_bytes, atomic_int64_add(&mem_tags[tag].bytes, bytes));
+}
+
+const char* mem_tag_name(uint32_t tag)
+{
+	return (tag < MEM_NR_TAGS) ? mem_tag_names[tag] : NULL;
+}
+
+int mem_get_stats(mem_stats_t* stats)
+{
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(!stats, 0))
+		return -EINVAL;
+
+	for(i=0; i<MEM_NR_TAGS; i++) {
+		stats->tags[i].pages = atomic_int64_read(&mem_tags[i].pages);
+		stats->tags[i].max_pages = atomic_int64_read(&mem_tags[i].max_pages);
+		stats->tags[i].bytes = atomic_int64_read(&mem_tags[i].bytes);
+		stats->tags[i].max_bytes = atomic_int64_read(&mem_tags[i].max_bytes);
+	}
+
+	stats->total_pages = atomic_int64_read(&total_pages);
+	stats->allocated_pages = atomic_int64_read(&total_allocated_pages);
+	stats->available_pages = atomic_int64_read(&total_available_pages);
+
+	return 0;
+}
+
+void mem_print_stats(void)
+{
+	mem_stats_t stats;
+	int64_t other;
+	uint32_t i;
+
+	mem_get_stats(&stats);
+
+	other = stats.allocated_pages;
+	LOG_INFO("Memory usage: %-12s %10s %10s %12s %12s\n", "tag", "KiB", "max KiB", "bytes", "max bytes");
+	for(i=0; i<MEM_NR_TAGS; i++) {
+		LOG_INFO("Memory usage: %-12s %10lld %10lld %12lld %12lld\n", mem_tag_names[i],
+			stats.tags[i].pages * (PAGE_SIZE >> 10), stats.tags[i].max_pages * (PAGE_SIZE >> 10),
+			stats.tags[i].bytes, stats.tags[i].max_bytes);
+		other -= stats.tags[i].pages;
+	}
+	LOG_INFO("Memory usage: %-12s %10lld\n", "other", other * (PAGE_SIZE >> 10));
+	LOG_INFO("Memory usage: %zd of %zd KiB allocated\n",
+		stats.allocated_pages * (PAGE_SIZE >> 10), stats.total_pages * (PAGE_SIZE >> 10));
+}
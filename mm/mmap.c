@@ -0,0 +1,674 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/syscall.h>
+#include <hermit/vma.h>
+#include <hermit/spinlock.h>
+#include <hermit/sysstat.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <hermit/virtiofs.h>
+#include <asm/page.h>
+
+/*
+ * Anonymous memory mappings
+ *
+ * Each mapping is a VMA with the flag VMA_ANON. The page fault handler maps
+ * zeroed pages on demand, MAP_POPULATE maps the whole region at once.
+ *
+ * Private mappings of host files use the flag VMA_FILE. The page fault
+ * handler asks uhyve to copy the file into new page frames (see
+ * page_map_file). VMAs with equal flags are merged, consequently the
+ * file and the offset are kept in a separate list of mappings.
+ *
+ * Mappings of virtio-fs files use the flag VMA_DAX. The chunks of the file
+ * are pinned in the DAX window and its frames are mapped at once, so that
+ * the application accesses the page cache of the host without copies or
+ * page faults. The pins are released, when a mapping is removed as a
+ * whole; a partial sys_munmap() keeps them. Without a usable DAX window,
+ * the file is read via FUSE into new frames, which are handled like the
+ * pinned chunks.
+ *
+ * The aarch64 port lacks page_populate, page_discard, page_set_flags and
+ * page_map_file. There, anonymous mappings and mappings of host files are
+ * refused with -ENOSYS instead of failing on the first page fault.
+ */
+
+#ifdef __aarch64__
+#define HAVE_PAGE_ON_DEMAND	0
+#define HAVE_PAGE_MAP_FRAMES	0
+#else
+#define HAVE_PAGE_ON_DEMAND	1
+#define HAVE_PAGE_MAP_FRAMES	1
+#endif
+
+extern mcs_spinlock_irqsave_t hermit_mm_lock;
+
+typedef struct mmap_file {
+	size_t start;
+	size_t end;
+	int fd;
+	off_t offset;
+	/// sys_close() was called, while the file was mapped
+	uint8_t closed;
+	/// pinned range of the DAX window (VMA_DAX), 0 for other mappings
+	size_t dax;
+	size_t dax_len;
+	/// frames of a VMA_DAX mapping, which was read via FUSE
+	size_t copy;
+	size_t copy_len;
+	struct mmap_file* next;
+} mmap_file_t;
+
+/// newest mapping at the head, it hides older ones at the same address
+static mmap_file_t* mmap_files = NULL;
+static spinlock_irqsave_t mmap_files_lock = SPINLOCK_IRQSAVE_INIT;
+
+static uint32_t prot_to_vma(int prot)
+{
+	uint32_t flags = 0;
+
+	if (prot == PROT_NONE)
+		return VMA_NO_ACCESS;
+
+	if (prot & PROT_READ)
+		flags |= VMA_READ;
+	if (prot & PROT_WRITE)
+		flags |= VMA_READ|VMA_WRITE;
+	if (prot & PROT_EXEC)
+		flags |= VMA_READ|VMA_EXECUTE;
+
+	return flags;
+}
+
+/// page size, which backs the VMA
+static inline size_t vma_page_size(uint32_t flags)
+{
+#ifdef PAGE_1G_SIZE
+	if (flags & VMA_HUGE_1G)
+		return PAGE_1G_SIZE;
+#endif
+	if (flags & (VMA_HUGE|VMA_HUGE_1G))
+		return HUGE_PAGE_SIZE;
+
+	return PAGE_SIZE;
+}
+
+/*
+ * Determines the anonymous or file VMA, which contains [start, start+len).
+ * Huge pages are released as a whole, consequently the range has to be
+ * aligned to the page size of the VMA.
+ */
+static int anon_range(size_t start, size_t len, vma_t* vma)
+{
+	size_t size;
+
+	if (BUILTIN_EXPECT(!len || (start & (PAGE_SIZE-1)), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(vma_lookup(start, vma), 0))
+		return -EINVAL;
+	if (BUILTIN_EXPECT(!(vma->flags & (VMA_ANON|VMA_FILE|VMA_DAX)) || (start + len > vma->end), 0))
+		return -EINVAL;
+
+	size = vma_page_size(vma->flags);
+	if (BUILTIN_EXPECT((start & (size-1)) || (len & (size-1)), 0))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Reserves the virtual address space of a mapping, which starts at a
+ * multiple of align. MAP_FIXED expects an aligned address in *addr.
+ */
+static int mmap_region(void** addr, size_t len, size_t align, uint32_t vflags, int flags)
+{
+	size_t start, size;
+	int ret;
+
+	if (flags & MAP_FIXED) {
+		start = (size_t) *addr;
+		if (BUILTIN_EXPECT(start & (align-1), 0))
+			return -EINVAL;
+
+		ret = vma_add(start, start + len, vflags);
+		if (BUILTIN_EXPECT(ret, 0))
+			return ret;
+	} else {
+		// the lock is recursive => allocate and trim the region atomically
+		mcs_spinlock_irqsave_lock(&hermit_mm_lock);
+
+		size = len + align - PAGE_SIZE;
+		start = vma_alloc(size, vflags);
+		if (BUILTIN_EXPECT(!start, 0)) {
+			mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+			return -ENOMEM;
+		}
+
+		// release the parts in front and behind of the aligned region
+		if (start & (align-1)) {
+			size_t aligned = (start + align - 1) & ~(align - 1);
+
+			vma_free(start, aligned);
+			size -= aligned - start;
+			start = aligned;
+		}
+		if (size > len)
+			vma_free(start + len, start + size);
+
+		mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
+	}
+
+	*addr = (void*) start;
+
+	return 0;
+}
+
+int sys_mmap(void** addr, size_t len, int prot, int flags)
+{
+	SYSSTAT_ENTER(SYSSTAT_MMAP);
+	uint32_t vflags = VMA_ANON|VMA_USER|VMA_CACHEABLE|prot_to_vma(prot);
+	size_t start, align = PAGE_SIZE;
+	int ret;
+
+	if (BUILTIN_EXPECT(!addr || !len, 0))
+		return -EINVAL;
+	// file mappings are created by sys_mmap_file, shared memory between processes isn't supported
+	if (BUILTIN_EXPECT(!(flags & MAP_ANONYMOUS) || (flags & MAP_SHARED), 0))
+		return -ENOSYS;
+	if (BUILTIN_EXPECT(!HAVE_PAGE_ON_DEMAND, 0))
+		return -ENOSYS;
+
+	if (flags & MAP_HUGETLB) {
+		vflags |= VMA_HUGE;
+		align = HUGE_PAGE_SIZE;
+#ifdef PAGE_1G_SIZE
+		if ((((flags >> MAP_HUGE_SHIFT) & MAP_HUGE_MASK) == PAGE_1G_BITS) && has_1gbhp()) {
+			vflags |= VMA_HUGE_1G;
+			align = PAGE_1G_SIZE;
+		}
+#endif
+	}
+
+	len = (len + align - 1) & ~(align - 1);
+
+	ret = mmap_region(addr, len, align, vflags, flags);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+	start = (size_t) *addr;
+
+	if (flags & MAP_POPULATE) {
+		ret = page_populate(start, start + len, vflags);
+		if (BUILTIN_EXPECT(ret, 0)) {
+			page_discard(start, len >> PAGE_BITS);
+			vma_free(start, start + len);
+			return ret;
+		}
+	}
+
+	LOG_DEBUG("sys_mmap: map 0x%zx - 0x%zx, flags 0x%x\n", start, start + len, vflags);
+
+	return 0;
+}
+
+/// maps the file pages of [start, end) ahead of their first use
+static int file_populate(size_t start, size_t end, uint32_t flags)
+{
+	size_t addr = start;
+	vma_t vma;
+
+	if (BUILTIN_EXPECT(vma_lookup(start, &vma), 0))
+		return -EINVAL;
+
+	while (addr < end) {
+		addr = page_map_file(addr, vma.start, vma.end, flags);
+		if (BUILTIN_EXPECT(!addr, 0))
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Maps the chunks of a virtio-fs file, which the host has placed into the
+ * DAX window. The frames belong to the page cache of the host, therefore
+ * a private mapping has to be read-only.
+ */
+static int mmap_dax(void** addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	uint32_t vflags = VMA_DAX|VMA_USER|VMA_CACHEABLE|prot_to_vma(prot);
+	size_t delta = offset & (VIRTIOFS_CHUNK_SIZE-1);
+	size_t start, phys, align = PAGE_SIZE;
+	mmap_file_t* map;
+	int ret;
+
+	// copy-on-write isn't supported for the frames of the window
+	if (BUILTIN_EXPECT(!HAVE_PAGE_MAP_FRAMES || (!(flags & MAP_SHARED) && (prot & PROT_WRITE)), 0))
+		return -ENOSYS;
+
+	len = PAGE_CEIL(len);
+	// whole chunks are backed by huge pages
+	if (!delta && !(len & (HUGE_PAGE_SIZE-1)) && (HUGE_PAGE_SIZE == VIRTIOFS_CHUNK_SIZE)
+	    && (!(flags & MAP_FIXED) || !((size_t) *addr & (HUGE_PAGE_SIZE-1)))) {
+		vflags |= VMA_HUGE;
+		align = HUGE_PAGE_SIZE;
+	}
+
+	map = kmalloc(sizeof(mmap_file_t));
+	if (BUILTIN_EXPECT(!map, 0))
+		return -ENOMEM;
+
+	ret = virtiofs_dax_map(fd, offset - delta, delta + len, (flags & MAP_SHARED) && (prot & PROT_WRITE), &phys);
+	if (BUILTIN_EXPECT(ret, 0)) {
+		kfree(map);
+		return ret;
+	}
+
+	ret = mmap_region(addr, len, align, vflags, flags);
+	if (BUILTIN_EXPECT(ret, 0)) {
+		virtiofs_dax_unmap(phys, delta + len);
+		kfree(map);
+		return ret;
+	}
+	start = (size_t) *addr;
+
+	ret = page_map_frames(start, phys + delta, len >> PAGE_BITS, vflags);
+	if (BUILTIN_EXPECT(ret, 0)) {
+		page_unmap(start, len >> PAGE_BITS);
+		vma_free(start, start + len);
+		virtiofs_dax_unmap(phys, delta + len);
+		kfree(map);
+		return ret;
+	}
+
+	// the pins keep the chunks, the descriptor may be closed before sys_munmap()
+	map->start = start;
+	map->end = start + len;
+	map->fd = -1;
+	map->offset = offset;
+	map->closed = 0;
+	map->dax = phys;
+	map->dax_len = delta + len;
+	map->copy = 0;
+	map->copy_len = 0;
+
+	spinlock_irqsave_lock(&mmap_files_lock);
+	map->next = mmap_files;
+	mmap_files = map;
+	spinlock_irqsave_unlock(&mmap_files_lock);
+
+	LOG_DEBUG("sys_mmap_file: map DAX window 0x%zx of fd %d at 0x%zx - 0x%zx, flags 0x%x\n",
+		phys + delta, fd, start, start + len, vflags);
+
+	return 0;
+}
+
+/*
+ * Reads a virtio-fs file into new frames, if the DAX window is missing,
+ * too small or can't be mapped. The mapping is a snapshot of the file:
+ * modifications aren't written back, therefore a writable shared mapping
+ * is refused.
+ */
+static int mmap_fuse(void** addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	uint32_t vflags = VMA_DAX|VMA_USER|VMA_CACHEABLE|prot_to_vma(prot);
+	size_t start, phys, npages, bits = PG_USER;
+	mmap_file_t* map;
+	ssize_t nread;
+	int ret;
+
+	if (BUILTIN_EXPECT(((flags & MAP_SHARED) && (prot & PROT_WRITE)) || !(prot & PROT_READ), 0))
+		return -ENOSYS;
+
+	len = PAGE_CEIL(len);
+	npages = len >> PAGE_BITS;
+	if (prot & PROT_WRITE)
+		bits |= PG_RW;
+	if (!(prot & PROT_EXEC))
+		bits |= PG_NX;
+
+	map = kmalloc(sizeof(mmap_file_t));
+	if (BUILTIN_EXPECT(!map, 0))
+		return -ENOMEM;
+
+	phys = get_pages(npages);
+	if (BUILTIN_EXPECT(!phys, 0)) {
+		kfree(map);
+		return -ENOMEM;
+	}
+
+	ret = mmap_region(addr, len, PAGE_SIZE, vflags, flags);
+	if (BUILTIN_EXPECT(ret, 0))
+		goto out_pages;
+	start = (size_t) *addr;
+
+	// the kernel fills the frames through a writable mapping
+	ret = page_map(start, phys, npages, PG_USER|PG_RW|PG_NX);
+	if (BUILTIN_EXPECT(ret, 0))
+		goto out_vma;
+
+	nread = virtiofs_pread(fd, (void*) start, len, offset);
+	if (BUILTIN_EXPECT(nread < 0, 0)) {
+		ret = (int) nread;
+		goto out_vma;
+	}
+	// the mapping ends behind the end of the file
+	memset((void*) start + nread, 0x00, len - nread);
+
+	if (bits != (PG_USER|PG_RW|PG_NX)) {
+		page_unmap(start, npages);
+		ret = page_map(start, phys, npages, bits);
+		if (BUILTIN_EXPECT(ret, 0))
+			goto out_vma;
+	}
+
+	mem_account(MEM_TAG_ANON, npages, 0);
+
+	map->start = start;
+	map->end = start + len;
+	map->fd = -1;
+	map->offset = offset;
+	map->closed = 0;
+	map->dax = 0;
+	map->dax_len = 0;
+	map->copy = phys;
+	map->copy_len = len;
+
+	spinlock_irqsave_lock(&mmap_files_lock);
+	map->next = mmap_files;
+	mmap_files = map;
+	spinlock_irqsave_unlock(&mmap_files_lock);
+
+	LOG_DEBUG("sys_mmap_file: read fd %d via FUSE into 0x%zx - 0x%zx, flags 0x%x\n",
+		fd, start, start + len, vflags);
+
+	return 0;
+
+out_vma:
+	page_unmap(start, npages);
+	vma_free(start, start + len);
+out_pages:
+	put_pages(phys, npages);
+	kfree(map);
+
+	return ret;
+}
+
+int sys_mmap_file(void** addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+	SYSSTAT_ENTER(SYSSTAT_MMAP);
+	uint32_t vflags = VMA_FILE|VMA_USER|VMA_CACHEABLE|prot_to_vma(prot);
+	size_t start, align = PAGE_SIZE;
+	mmap_file_t* map;
+	int ret;
+
+	if (BUILTIN_EXPECT(!addr || !len || (fd < 0) || (offset < 0) || (offset & (PAGE_SIZE-1)), 0))
+		return -EINVAL;
+	if (fd & VIRTIOFS_FD_BIT) {
+		ret = mmap_dax(addr, len, prot, flags, fd, offset);
+		// no DAX window, the window is too small or its frames can't be mapped
+		if ((ret == -ENOSYS) || (ret == -ENODEV) || (ret == -ENOMEM))
+			ret = mmap_fuse(addr, len, prot, flags, fd, offset);
+		return ret;
+	}
+	// only uhyve is able to copy file pages into the guest memory
+	if (BUILTIN_EXPECT(!HAVE_PAGE_ON_DEMAND || !(is_uhyve() & UHYVE_FEAT_FILE_MMAP), 0))
+		return -ENOSYS;
+	// modifications aren't written back to the host
+	if (BUILTIN_EXPECT((flags & MAP_SHARED) && (prot & PROT_WRITE), 0))
+		return -ENOSYS;
+
+	len = PAGE_CEIL(len);
+	// large mappings are aligned for the readahead into huge pages
+	if ((len >= HUGE_PAGE_SIZE) && !(flags & MAP_FIXED))
+		align = HUGE_PAGE_SIZE;
+
+	map = kmalloc(sizeof(mmap_file_t));
+	if (BUILTIN_EXPECT(!map, 0))
+		return -ENOMEM;
+
+	ret = mmap_region(addr, len, align, vflags, flags);
+	if (BUILTIN_EXPECT(ret, 0)) {
+		kfree(map);
+		return ret;
+	}
+	start = (size_t) *addr;
+
+	map->start = start;
+	map->end = start + len;
+	map->fd = fd;
+	map->offset = offset;
+	map->closed = 0;
+	map->dax = 0;
+	map->dax_len = 0;
+	map->copy = 0;
+	map->copy_len = 0;
+
+	spinlock_irqsave_lock(&mmap_files_lock);
+	map->next = mmap_files;
+	mmap_files = map;
+	spinlock_irqsave_unlock(&mmap_files_lock);
+
+	if (flags & MAP_POPULATE) {
+		ret = file_populate(start, start + len, vflags);
+		if (BUILTIN_EXPECT(ret, 0)) {
+			sys_munmap((void*) start, len);
+			return ret;
+		}
+	}
+
+	LOG_DEBUG("sys_mmap_file: map fd %d at 0x%zx - 0x%zx, flags 0x%x\n", fd, start, start + len, vflags);
+
+	return 0;
+}
+
+int mmap_file_lookup(size_t addr, int* fd, off_t* offset, size_t* start, size_t* end)
+{
+	mmap_file_t* map;
+	int ret = -EINVAL;
+
+	spinlock_irqsave_lock(&mmap_files_lock);
+
+	for(map = mmap_files; map; map = map->next) {
+		if ((addr >= map->start) && (addr < map->end)) {
+			*fd = map->fd;
+			*offset = map->offset;
+			*start = map->start;
+			*end = map->end;
+			ret = 0;
+			break;
+		}
+	}
+
+	spinlock_irqsave_unlock(&mmap_files_lock);
+
+	return ret;
+}
+
+int mmap_file_close(int fd)
+{
+	mmap_file_t* map;
+	int ret = 0;
+
+	spinlock_irqsave_lock(&mmap_files_lock);
+
+	for(map = mmap_files; map; map = map->next) {
+		if (map->fd == fd) {
+			map->closed = 1;
+			ret = 1;
+		}
+	}
+
+	spinlock_irqsave_unlock(&mmap_files_lock);
+
+	return ret;
+}
+
+/*
+ * Removes the file mappings, which lie completely within [start, end).
+ * The host file is closed, if sys_close() was deferred and no mapping of
+ * the file is left. The chunks of a DAX mapping are unpinned, the frames
+ * of a FUSE copy are released.
+ */
+static void mmap_file_unmap(size_t start, size_t end)
+{
+	mmap_file_t** tmp;
+	mmap_file_t* map;
+	mmap_file_t* other;
+	size_t dax, dax_len;
+	int fd;
+
+	spinlock_irqsave_lock(&mmap_files_lock);
+
+	tmp = &mmap_files;
+	while (*tmp) {
+		map = *tmp;
+		if ((map->start < start) || (map->end > end)) {
+			tmp = &map->next;
+			continue;
+		}
+
+		*tmp = map->next;
+		fd = map->closed ? map->fd : -1;
+		dax = map->dax;
+		dax_len = map->dax_len;
+		if (map->copy) {
+			put_pages(map->copy, map->copy_len >> PAGE_BITS);
+			mem_account(MEM_TAG_ANON, -(int64_t) (map->copy_len >> PAGE_BITS), 0);
+		}
+		kfree(map);
+
+		for(other = mmap_files; (fd >= 0) && other; other = other->next) {
+			if (other->fd == fd)
+				fd = -1;
+		}
+
+		// both may sleep => release the lock
+		if ((fd >= 0) || dax) {
+			spinlock_irqsave_unlock(&mmap_files_lock);
+			if (fd >= 0)
+				sys_close(fd);
+			if (dax)
+				virtiofs_dax_unmap(dax, dax_len);
+			spinlock_irqsave_lock(&mmap_files_lock);
+			tmp = &mmap_files;
+		}
+	}
+
+	spinlock_irqsave_unlock(&mmap_files_lock);
+}
+
+int sys_munmap(void* addr, size_t len)
+{
+	SYSSTAT_ENTER(SYSSTAT_MUNMAP);
+	size_t start = (size_t) addr;
+	vma_t vma;
+	int ret;
+
+	len = PAGE_CEIL(len);
+	ret = anon_range(start, len, &vma);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	// the frames of the DAX window aren't released
+	if (vma.flags & VMA_DAX)
+		page_unmap(start, len >> PAGE_BITS);
+	else
+		page_discard(start, len >> PAGE_BITS);
+
+	ret = vma_free(start, start + len);
+
+	if (vma.flags & (VMA_FILE|VMA_DAX))
+		mmap_file_unmap(start, start + len);
+
+	return ret;
+}
+
+int sys_mprotect(void* addr, size_t len, int prot)
+{
+	size_t start = (size_t) addr;
+	uint32_t flags;
+	vma_t vma;
+	int ret;
+
+	len = PAGE_CEIL(len);
+	ret = anon_range(start, len, &vma);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	// a private DAX mapping would modify the file of the host
+	if (BUILTIN_EXPECT((vma.flags & VMA_DAX) && (prot & PROT_WRITE) && !(vma.flags & VMA_WRITE), 0))
+		return -EACCES;
+
+	if (BUILTIN_EXPECT(!HAVE_PAGE_ON_DEMAND, 0))
+		return -ENOSYS;
+
+	flags = (vma.flags & ~(VMA_READ|VMA_WRITE|VMA_EXECUTE|VMA_NO_ACCESS)) | prot_to_vma(prot);
+
+	ret = vma_set_flags(start, start + len, flags);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	return page_set_flags(start, len >> PAGE_BITS, flags);
+}
+
+int sys_madvise(void* addr, size_t len, int advice)
+{
+	size_t start = (size_t) addr;
+	vma_t vma;
+	int ret;
+
+	len = PAGE_CEIL(len);
+	ret = anon_range(start, len, &vma);
+	if (BUILTIN_EXPECT(ret, 0))
+		return ret;
+
+	switch(advice) {
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+		return 0;
+	case MADV_WILLNEED:
+		// the frames of a DAX mapping are mapped at once
+		if (vma.flags & VMA_DAX)
+			return 0;
+		if (vma.flags & VMA_FILE)
+			return file_populate(start, start + len, vma.flags);
+		return page_populate(start, start + len, vma.flags);
+	case MADV_DONTNEED:
+		if (vma.flags & VMA_DAX)
+			return 0;
+		// the next access gets a zeroed page or reads the file again
+		return page_discard(start, len >> PAGE_BITS);
+	default:
+		return -EINVAL;
+	}
+}
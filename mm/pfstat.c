@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Statistics and trace of the page fault handlers
+ *
+ * The handlers of the architectures classify a resolved fault and account
+ * it by pf_account(). Each core writes only its own entry, with interrupts
+ * disabled. sizeof(pf_stats_t) is a multiple of the cache line. The time
+ * stamps are TSC cycles, on aarch64 ticks of the generic timer.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/string.h>
+#include <hermit/errno.h>
+#include <hermit/memory.h>
+#include <asm/processor.h>
+#include <asm/irqflags.h>
+
+static pf_stats_t pf_stats[MAX_CORES] __attribute__ ((aligned (CACHE_LINE)));
+
+#if PAGE_FAULT_TRACE > 0
+/// ring buffer of the recent page faults per core
+static pf_trace_t pf_trace[MAX_CORES][PAGE_FAULT_TRACE];
+#endif
+
+void pf_account(size_t viraddr, uint64_t tsc, uint32_t kind, uint32_t error, int zeroed)
+{
+	uint8_t flags = irq_nested_disable();
+	uint64_t cycles = get_rdtsc() - tsc;
+	uint32_t core_id = CORE_ID;
+	pf_stats_t* stats = pf_stats + core_id;
+	int bucket = 63 - __builtin_clzll(cycles | 1) - PF_HIST_SHIFT;
+
+#if PAGE_FAULT_TRACE > 0
+	pf_trace_t* t = &pf_trace[core_id][stats->nr_faults % PAGE_FAULT_TRACE];
+
+	t->tsc = tsc;
+	t->addr = viraddr;
+	t->cycles = cycles > 0xFFFFFFFFULL ? 0xFFFFFFFF : (uint32_t) cycles;
+	t->core = core_id;
+	t->kind = kind;
+	t->error = error;
+#endif
+
+	if (bucket < 0)
+		bucket = 0;
+	else if (bucket >= PF_HIST_BUCKETS)
+		bucket = PF_HIST_BUCKETS-1;
+
+	stats->nr_faults++;
+	switch(kind) {
+	case PF_KIND_SMALL:
+		stats->nr_small++;
+		break;
+	case PF_KIND_HUGE:
+		stats->nr_huge++;
+		break;
+	case PF_KIND_1G:
+		stats->nr_1g++;
+		break;
+	default:
+		stats->nr_spurious++;
+	}
+	if (zeroed)
+		stats->nr_zeroed++;
+	stats->total_cycles += cycles;
+	if (cycles > stats->max_cycles)
+		stats->max_cycles = cycles;
+	stats->hist[bucket]++;
+
+	irq_nested_enable(flags);
+}
+
+int page_fault_stats(int core, pf_stats_t* stats)
+{
+	uint32_t i, j;
+
+	if (BUILTIN_EXPECT(!stats || (core < -1) || (core >= (int) MAX_CORES), 0))
+		return -EINVAL;
+
+	if (core >= 0) {
+		memcpy(stats, pf_stats + core, sizeof(pf_stats_t));
+		return 0;
+	}
+
+	memset(stats, 0x00, sizeof(pf_stats_t));
+	for(i=0; i<MAX_CORES; i++) {
+		const pf_stats_t* c = pf_stats + i;
+
+		stats->nr_faults += c->nr_faults;
+		stats->nr_small += c->nr_small;
+		stats->nr_huge += c->nr_huge;
+		stats->nr_1g += c->nr_1g;
+		stats->nr_zeroed += c->nr_zeroed;
+		stats->nr_spurious += c->nr_spurious;
+		stats->total_cycles += c->total_cycles;
+		if (c->max_cycles > stats->max_cycles)
+			stats->max_cycles = c->max_cycles;
+		for(j=0; j<PF_HIST_BUCKETS; j++)
+			stats->hist[j] += c->hist[j];
+	}
+
+	return 0;
+}
+
+int page_fault_trace(pf_trace_t* buf, size_t n)
+{
+#if PAGE_FAULT_TRACE > 0
+	size_t copied = 0;
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(!buf, 0))
+		return -EINVAL;
+
+	for(i=0; (i<MAX_CORES) && (copied<n); i++) {
+		// a snapshot, the core may overwrite entries while we copy them
+		uint64_t nr = pf_stats[i].nr_faults;
+		uint64_t first = nr > PAGE_FAULT_TRACE ? nr - PAGE_FAULT_TRACE : 0;
+
+		for(; (first<nr) && (copied<n); first++)
+			buf[copied++] = pf_trace[i][first % PAGE_FAULT_TRACE];
+	}
+
+	return (int) copied;
+#else
+	return -ENOSYS;
+#endif
+}
+
+void page_fault_buffers(const pf_stats_t** stats, const pf_trace_t** trace)
+{
+	*stats = pf_stats;
+#if PAGE_FAULT_TRACE > 0
+	*trace = &pf_trace[0][0];
+#else
+	*trace = NULL;
+#endif
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/malloc.h>
+#include <hermit/slab.h>
+#include <hermit/spinlock.h>
+#include <hermit/logging.h>
+#include <asm/irqflags.h>
+
+/// size of a slab, so that kmalloc() uses exactly one page
+#define KMEM_SLAB_SIZE	(PAGE_SIZE - sizeof(buddy_t))
+/// minimal number of objects per slab
+#define KMEM_SLAB_MIN	8
+
+/// link to the next free object, which is located behind the object
+static inline void** kmem_link(kmem_cache_t* cache, void* obj)
+{
+	return (void**) ((size_t) obj + cache->stride - sizeof(void*));
+}
+
+/** @brief Put up to KMEM_CACHE_BATCH objects of the free list in the cache of a core
+ *
+ * A new slab is allocated, if the free list is empty. Has to be called
+ * with disabled interrupts.
+ */
+static void kmem_cache_refill(kmem_cache_t* cache, kmem_cpu_cache_t* cpu)
+{
+	size_t size, nr, i;
+	void* slab;
+	void* obj;
+
+	spinlock_irqsave_lock(&cache->lock);
+	if (!cache->free) {
+		spinlock_irqsave_unlock(&cache->lock);
+
+		// the first word links the slabs
+		nr = (KMEM_SLAB_SIZE - sizeof(void*)) / cache->stride;
+		if (nr < KMEM_SLAB_MIN)
+			nr = KMEM_SLAB_MIN;
+		size = sizeof(void*) + nr * cache->stride;
+
+		// kmalloc() may use the cache as well => no lock is held
+		slab = kmalloc(size);
+		if (BUILTIN_EXPECT(!slab, 0))
+			return;
+
+		LOG_DEBUG("kmem_cache %s: new slab %p with %zd objects\n", cache->name, slab, nr);
+
+		spinlock_irqsave_lock(&cache->lock);
+		*((void**) slab) = cache->slabs;
+		cache->slabs = slab;
+		cache->nr_slabs++;
+
+		for(i=0; i<nr; i++) {
+			obj = (void*) ((size_t) slab + sizeof(void*) + i * cache->stride);
+			if (cache->ctor)
+				cache->ctor(obj);
+			*kmem_link(cache, obj) = cache->free;
+			cache->free = obj;
+		}
+	}
+
+	for(i=0; (i<KMEM_CACHE_BATCH) && cache->free; i++) {
+		obj = cache->free;
+		cache->free = *kmem_link(cache, obj);
+		*kmem_link(cache, obj) = cpu->first;
+		cpu->first = obj;
+		cpu->nr++;
+	}
+	spinlock_irqsave_unlock(&cache->lock);
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, kmem_ctor_t ctor)
+{
+	kmem_cache_t* cache;
+
+	if (BUILTIN_EXPECT(!size, 0))
+		return NULL;
+
+	cache = (kmem_cache_t*) kmalloc(sizeof(kmem_cache_t));
+	if (BUILTIN_EXPECT(!cache, 0))
+		return NULL;
+
+	memset(cache, 0x00, sizeof(kmem_cache_t));
+	cache->name = name;
+	cache->size = size;
+	cache->stride = KMEM_STRIDE(size);
+	cache->ctor = ctor;
+	cache->dynamic = 1;
+	spinlock_irqsave_init(&cache->lock);
+
+	return cache;
+}
+
+void kmem_cache_destroy(kmem_cache_t* cache)
+{
+	void* slab;
+	uint32_t i;
+
+	if (BUILTIN_EXPECT(!cache, 0))
+		return;
+
+	spinlock_irqsave_lock(&cache->lock);
+	while ((slab = cache->slabs) != NULL) {
+		cache->slabs = *((void**) slab);
+		kfree(slab);
+	}
+	cache->nr_slabs = 0;
+	cache->free = NULL;
+	for(i=0; i<MAX_CORES; i++) {
+		cache->cpu[i].first = NULL;
+		cache->cpu[i].nr = 0;
+	}
+	spinlock_irqsave_unlock(&cache->lock);
+
+	if (cache->dynamic)
+		kfree(cache);
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+	kmem_cpu_cache_t* cpu;
+	uint8_t flags;
+	void* obj;
+
+	if (BUILTIN_EXPECT(!cache, 0))
+		return NULL;
+
+	flags = irq_nested_disable();
+	cpu = &cache->cpu[CORE_ID];
+
+	if (!cpu->first)
+		kmem_cache_refill(cache, cpu);
+
+	obj = cpu->first;
+	if (obj) {
+		cpu->first = *kmem_link(cache, obj);
+		cpu->nr--;
+	}
+	irq_nested_enable(flags);
+
+	return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj)
+{
+	kmem_cpu_cache_t* cpu;
+	uint8_t flags;
+	uint32_t i;
+	void* tmp;
+
+	if (BUILTIN_EXPECT(!cache || !obj, 0))
+		return;
+
+	flags = irq_nested_disable();
+	cpu = &cache->cpu[CORE_ID];
+
+	*kmem_link(cache, obj) = cpu->first;
+	cpu->first = obj;
+	cpu->nr++;
+
+	// return a batch to the free list
+	if (cpu->nr > KMEM_CACHE_DEPTH) {
+		spinlock_irqsave_lock(&cache->lock);
+		for(i=0; i<KMEM_CACHE_BATCH; i++) {
+			tmp = cpu->first;
+			cpu->first = *kmem_link(cache, tmp);
+			cpu->nr--;
+			*kmem_link(cache, tmp) = cache->free;
+			cache->free = tmp;
+		}
+		spinlock_irqsave_unlock(&cache->lock);
+	}
+	irq_nested_enable(flags);
+}
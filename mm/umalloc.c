@@ -0,0 +1,845 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Allocator of the application (malloc() and its relatives of newlib)
+ *
+ * newlib's allocator serializes all threads by __sys_malloc_lock(). This
+ * one keeps an arena per core, which is used only by its core with
+ * disabled interrupts, like the caches of kmalloc() and of the slabs.
+ *
+ * Small blocks (up to UMALLOC_SMALL_MAX bytes) are taken from spans of
+ * UMALLOC_SPAN_SIZE bytes, which contain blocks of a single size class and
+ * start with their header. A block returns to the free list of its span,
+ * if it is released on the core owning the span. Otherwise, it is pushed
+ * to the lock-free remote list of the span, which the owner collects, as
+ * soon as the span runs out of blocks. A full span leaves the lists of its
+ * arena. The first remote release passes it back to the owner. The remote
+ * list of a detached span holds a flag instead of a block, so that a
+ * single atomic operation pushes the block and claims the span.
+ *
+ * Larger blocks get their own anonymous mapping (see sys_mmap()). Each
+ * core caches a few released ones of moderate size.
+ *
+ * The header of a block is always located at (ptr - 1) rounded down to the
+ * span size.
+ *
+ * This file defines only the functions of newlib's allocator. Therefore,
+ * newlib's allocator isn't pulled in, as soon as the linker resolves
+ * malloc() by libhermit.
+ */
+
+#include <hermit/stddef.h>
+#include <hermit/stdlib.h>
+#include <hermit/stdio.h>
+#include <hermit/string.h>
+#include <hermit/syscall.h>
+#include <hermit/errno.h>
+#include <hermit/logging.h>
+#include <asm/page.h>
+#include <asm/irqflags.h>
+#include <asm/processor.h>
+
+#ifdef USER_MALLOC
+
+/// binary exponent of the size of a span
+#define UMALLOC_SPAN_BITS	16 // 64 KByte
+#define UMALLOC_SPAN_SIZE	(1UL << UMALLOC_SPAN_BITS)
+#define UMALLOC_SPAN_MASK	(~(UMALLOC_SPAN_SIZE - 1))
+/// space of the header in front of the blocks of a span
+#define UMALLOC_HDR_SIZE	(2 * CACHE_LINE)
+/// largest block, which is taken from a span
+#define UMALLOC_SMALL_MAX	8192
+/// 8 classes in steps of 16 bytes, afterwards 4 classes per power of two
+#define UMALLOC_CLASSES		32
+/// class of a block with its own mapping
+#define UMALLOC_LARGE		0xFFFF
+/// minimal alignment of all blocks
+#define UMALLOC_ALIGN		16
+#define UMALLOC_MAGIC		0xA110
+/// value of the remote list of a full span, which left the lists of its arena
+#define UMALLOC_DETACHED	((void*) 1)
+/// number of empty spans, which each core keeps mapped
+#define UMALLOC_EMPTY_SPANS	4
+/// number of released large blocks, which each core keeps mapped
+#define UMALLOC_LARGE_CACHE	4
+/// largest mapping, which is kept in the cache of released large blocks
+#define UMALLOC_LARGE_CACHE_MAX	(1UL << 20)
+
+/** @brief Header of a span or of a large block */
+typedef struct umalloc_span {
+	/// Must be equal to UMALLOC_MAGIC
+	uint16_t		magic;
+	/// size class or UMALLOC_LARGE
+	uint16_t		sclass;
+	/// core, whose arena owns the span
+	uint32_t		core;
+	/// block size of a span, size of the mapping of a large block
+	size_t			size;
+	/// start of the mapping
+	size_t			base;
+	/// released blocks, used only by the owner
+	void*			free;
+	/// blocks, which other cores released (lock-free stack) or UMALLOC_DETACHED
+	void*			remote;
+	/// next full span with remote blocks in the arena of the owner
+	struct umalloc_span*	remote_next;
+	/// next span of the same class
+	struct umalloc_span*	next;
+	/// previous span of the same class
+	struct umalloc_span*	prev;
+	/// offset of the first block, which was never allocated
+	uint32_t		bump;
+	/// allocated blocks, including the uncollected remote ones
+	uint32_t		nr_used;
+	/// a large block was already used (otherwise its pages are zeroed)
+	uint32_t		dirty;
+} umalloc_span_t;
+
+/** @brief Released large block in the cache of a core */
+typedef struct umalloc_large {
+	/// start of the mapping (0 = unused entry)
+	size_t base;
+	/// size of the mapping
+	size_t size;
+} umalloc_large_t;
+
+/** @brief Spans and caches of a core */
+typedef struct umalloc_arena {
+	/// spans with free blocks, the first one is used for allocations
+	umalloc_span_t*	spans[UMALLOC_CLASSES];
+	/// empty spans, which aren't assigned to a class
+	umalloc_span_t*	empty;
+	/// number of empty spans
+	uint32_t	nr_empty;
+	/// full spans, which got blocks by other cores (lock-free stack)
+	umalloc_span_t*	remote;
+	/// released large blocks
+	umalloc_large_t	large[UMALLOC_LARGE_CACHE];
+	/// allocated bytes on this core minus the released ones
+	int64_t		used;
+} __attribute__ ((aligned (CACHE_LINE))) umalloc_arena_t;
+
+/// layout of newlib's struct mallinfo
+struct mallinfo {
+	size_t arena;
+	size_t ordblks;
+	size_t smblks;
+	size_t hblks;
+	size_t hblkhd;
+	size_t usmblks;
+	size_t fsmblks;
+	size_t uordblks;
+	size_t fordblks;
+	size_t keepcost;
+};
+
+static umalloc_arena_t umalloc_arenas[MAX_CORES];
+
+/// size of all mappings
+static size_t umalloc_mapped = 0;
+static size_t umalloc_max_mapped = 0;
+
+/// newlib expects errno in the first member of struct _reent
+static inline void umalloc_enomem(void* reent)
+{
+	if (reent)
+		*((int*) reent) = ENOMEM;
+}
+
+static inline uint32_t umalloc_class(size_t sz)
+{
+	uint32_t e;
+
+	if (sz <= 128)
+		return sz ? (sz - 1) / 16 : 0;
+
+	e = msb(sz - 1);
+
+	return 8 + (e - 7) * 4 + ((sz - 1) >> (e - 2)) - 4;
+}
+
+static inline size_t umalloc_class_size(uint32_t sclass)
+{
+	if (sclass < 8)
+		return 16 * (sclass + 1);
+
+	return (size_t) (5 + (sclass - 8) % 4) << (5 + (sclass - 8) / 4);
+}
+
+/// the header of a block, NULL if the block isn't part of a span
+static inline umalloc_span_t* umalloc_span(void* ptr)
+{
+	umalloc_span_t* span = (umalloc_span_t*) (((size_t) ptr - 1) & UMALLOC_SPAN_MASK);
+
+	if (BUILTIN_EXPECT(!ptr || (span->magic != UMALLOC_MAGIC), 0))
+		return NULL;
+
+	return span;
+}
+
+static inline size_t umalloc_usable(umalloc_span_t* span, void* ptr)
+{
+	if (span->sclass == UMALLOC_LARGE)
+		return span->base + span->size - (size_t) ptr;
+
+	return span->size;
+}
+
+/*
+ * Maps size bytes at a multiple of align, has to be called with enabled
+ * interrupts, because the page tables are changed.
+ */
+static size_t umalloc_map(size_t size, size_t align)
+{
+	const size_t len = size + align - PAGE_SIZE;
+	void* addr = NULL;
+	size_t start, aligned, mapped;
+
+	if (BUILTIN_EXPECT(sys_mmap(&addr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS), 0))
+		return 0;
+
+	// release the parts in front and behind of the aligned region
+	start = (size_t) addr;
+	aligned = (start + align - 1) & ~(align - 1);
+	if (aligned > start)
+		sys_munmap((void*) start, aligned - start);
+	if (start + len > aligned + size)
+		sys_munmap((void*) (aligned + size), start + len - aligned - size);
+
+	mapped = __atomic_add_fetch(&umalloc_mapped, size, __ATOMIC_RELAXED);
+	if (mapped > umalloc_max_mapped)
+		umalloc_max_mapped = mapped;
+
+	return aligned;
+}
+
+static void umalloc_unmap(size_t base, size_t size)
+{
+	sys_munmap((void*) base, size);
+	__atomic_sub_fetch(&umalloc_mapped, size, __ATOMIC_RELAXED);
+}
+
+static inline void umalloc_list_push(umalloc_span_t** list, umalloc_span_t* span)
+{
+	span->prev = NULL;
+	span->next = *list;
+	if (*list)
+		(*list)->prev = span;
+	*list = span;
+}
+
+static inline void umalloc_list_remove(umalloc_span_t** list, umalloc_span_t* span)
+{
+	if (span->prev)
+		span->prev->next = span->next;
+	else
+		*list = span->next;
+	if (span->next)
+		span->next->prev = span->prev;
+	span->next = span->prev = NULL;
+}
+
+static void umalloc_span_init(umalloc_span_t* span, uint32_t sclass, uint32_t core)
+{
+	span->magic = UMALLOC_MAGIC;
+	span->sclass = sclass;
+	span->core = core;
+	span->size = umalloc_class_size(sclass);
+	span->base = (size_t) span;
+	span->free = NULL;
+	span->remote = NULL;
+	span->remote_next = NULL;
+	span->next = span->prev = NULL;
+	span->bump = UMALLOC_HDR_SIZE;
+	span->nr_used = 0;
+	span->dirty = 1;
+}
+
+/// takes a block of the span, has to be called by the owner with disabled interrupts
+static void* umalloc_span_pop(umalloc_arena_t* arena, umalloc_span_t* span)
+{
+	void* obj = span->free;
+	uint32_t nr = 0;
+
+	if (obj) {
+		span->free = *((void**) obj);
+	} else if (span->bump + span->size <= UMALLOC_SPAN_SIZE) {
+		obj = (void*) ((size_t) span + span->bump);
+		span->bump += span->size;
+	} else {
+		obj = __atomic_exchange_n(&span->remote, NULL, __ATOMIC_ACQUIRE);
+		if (!obj)
+			return NULL;
+
+		span->free = *((void**) obj);
+		for(void* p = obj; p; p = *((void**) p))
+			nr++;
+
+		// the collected blocks are released now
+		span->nr_used -= nr;
+		arena->used -= (int64_t) (nr * span->size);
+	}
+
+	span->nr_used++;
+	arena->used += span->size;
+
+	return obj;
+}
+
+/*
+ * Removes a full span from the lists of its arena. Returns 1, if a remote
+ * block arrived meanwhile and the span has to stay in the lists.
+ */
+static int umalloc_span_detach(umalloc_arena_t* arena, umalloc_span_t* span)
+{
+	void* head = NULL;
+
+	umalloc_list_remove(&arena->spans[span->sclass], span);
+
+	// pairs with umalloc_remote_free(): either the owner sees the block or the sender the flag
+	if (!__atomic_compare_exchange_n(&span->remote, &head, UMALLOC_DETACHED, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		umalloc_list_push(&arena->spans[span->sclass], span);
+		return 1;
+	}
+
+	return 0;
+}
+
+/// links the full spans, which got remote blocks, into the lists again
+static void umalloc_arena_collect(umalloc_arena_t* arena)
+{
+	umalloc_span_t* span = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+	umalloc_span_t* next;
+
+	while (span) {
+		next = span->remote_next;
+		umalloc_list_push(&arena->spans[span->sclass], span);
+		span = next;
+	}
+}
+
+static void* umalloc_arena_alloc(umalloc_arena_t* arena, uint32_t sclass)
+{
+	umalloc_span_t* span;
+	void* obj;
+
+	if (__atomic_load_n(&arena->remote, __ATOMIC_RELAXED))
+		umalloc_arena_collect(arena);
+
+	while ((span = arena->spans[sclass])) {
+		obj = umalloc_span_pop(arena, span);
+		if (obj)
+			return obj;
+
+		if (!umalloc_span_detach(arena, span) && !arena->spans[sclass] && arena->remote)
+			umalloc_arena_collect(arena);
+	}
+
+	span = arena->empty;
+	if (!span)
+		return NULL;
+
+	arena->empty = span->next;
+	arena->nr_empty--;
+
+	umalloc_span_init(span, sclass, arena - umalloc_arenas);
+	umalloc_list_push(&arena->spans[sclass], span);
+
+	return umalloc_span_pop(arena, span);
+}
+
+static void* umalloc_small(void* reent, size_t sz)
+{
+	const uint32_t sclass = umalloc_class(sz);
+	umalloc_arena_t* arena;
+	umalloc_span_t* span;
+	uint8_t flags;
+	void* obj;
+
+	while(1) {
+		flags = irq_nested_disable();
+		obj = umalloc_arena_alloc(&umalloc_arenas[CORE_ID], sclass);
+		irq_nested_enable(flags);
+
+		if (obj)
+			return obj;
+
+		span = (umalloc_span_t*) umalloc_map(UMALLOC_SPAN_SIZE, UMALLOC_SPAN_SIZE);
+		if (BUILTIN_EXPECT(!span, 0)) {
+			umalloc_enomem(reent);
+			return NULL;
+		}
+
+		// the task could run on another core now
+		flags = irq_nested_disable();
+		arena = &umalloc_arenas[CORE_ID];
+		span->next = arena->empty;
+		arena->empty = span;
+		arena->nr_empty++;
+		irq_nested_enable(flags);
+	}
+}
+
+/// pushes a block, which was allocated by another core, to the remote list of its span
+static void umalloc_remote_free(umalloc_span_t* span, void* ptr)
+{
+	umalloc_arena_t* arena = &umalloc_arenas[span->core];
+	void* head = __atomic_load_n(&span->remote, __ATOMIC_RELAXED);
+	umalloc_span_t* first;
+
+	/*
+	 * Pushing the block replaces the flag of a detached span. Afterwards,
+	 * only the sender, which claimed the span, is allowed to touch it. The
+	 * owner could otherwise collect the block and release the span.
+	 */
+	do {
+		*((void**) ptr) = (head == UMALLOC_DETACHED) ? NULL : head;
+	} while (!__atomic_compare_exchange_n(&span->remote, &head, ptr, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	// the first remote block of a full span passes it back to its owner
+	if (head == UMALLOC_DETACHED) {
+		first = __atomic_load_n(&arena->remote, __ATOMIC_RELAXED);
+		do {
+			span->remote_next = first;
+		} while (!__atomic_compare_exchange_n(&arena->remote, &first, span, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+}
+
+static void umalloc_small_free(umalloc_span_t* span, void* ptr)
+{
+	umalloc_arena_t* arena;
+	size_t release = 0;
+	uint8_t flags;
+
+	flags = irq_nested_disable();
+
+	if (span->core != CORE_ID) {
+		irq_nested_enable(flags);
+		umalloc_remote_free(span, ptr);
+		return;
+	}
+
+	arena = &umalloc_arenas[span->core];
+	*((void**) ptr) = span->free;
+	span->free = ptr;
+	span->nr_used--;
+	arena->used -= span->size;
+
+	if (__atomic_load_n(&span->remote, __ATOMIC_RELAXED) == UMALLOC_DETACHED) {
+		void* head = UMALLOC_DETACHED;
+
+		// a remote block could have passed the span to the arena already
+		if (__atomic_compare_exchange_n(&span->remote, &head, NULL, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			umalloc_list_push(&arena->spans[span->sclass], span);
+	} else if (!span->nr_used && (span->prev || span->next)) {
+		// keep the last span of a class, the other empty ones are cached or released
+		umalloc_list_remove(&arena->spans[span->sclass], span);
+		if (arena->nr_empty < UMALLOC_EMPTY_SPANS) {
+			span->next = arena->empty;
+			arena->empty = span;
+			arena->nr_empty++;
+		} else {
+			span->magic = 0;
+			release = (size_t) span;
+		}
+	}
+
+	irq_nested_enable(flags);
+
+	if (release)
+		umalloc_unmap(release, UMALLOC_SPAN_SIZE);
+}
+
+static void* umalloc_large_alloc(void* reent, size_t sz, size_t align)
+{
+	const size_t offset = align > UMALLOC_HDR_SIZE ? align : UMALLOC_HDR_SIZE;
+	const size_t size = PAGE_CEIL(sz + offset);
+	umalloc_arena_t* arena;
+	umalloc_span_t* span;
+	size_t base = 0, mapped = size;
+	uint32_t i, dirty = 0;
+	uint8_t flags;
+
+	if (BUILTIN_EXPECT(sz > HEAP_SIZE, 0)) {
+		umalloc_enomem(reent);
+		return NULL;
+	}
+
+	// reuse a released block of this core, which isn't much larger
+	if ((align <= UMALLOC_SPAN_SIZE / 2) && (size <= UMALLOC_LARGE_CACHE_MAX)) {
+		flags = irq_nested_disable();
+		arena = &umalloc_arenas[CORE_ID];
+		for(i=0; i<UMALLOC_LARGE_CACHE; i++) {
+			if (arena->large[i].base && (arena->large[i].size >= size) && (arena->large[i].size <= 2 * size)) {
+				base = arena->large[i].base;
+				mapped = arena->large[i].size;
+				arena->large[i].base = 0;
+				dirty = 1;
+				break;
+			}
+		}
+		irq_nested_enable(flags);
+	}
+
+	if (!base) {
+		base = umalloc_map(size, align > UMALLOC_SPAN_SIZE ? align : UMALLOC_SPAN_SIZE);
+		if (BUILTIN_EXPECT(!base, 0)) {
+			umalloc_enomem(reent);
+			return NULL;
+		}
+	}
+
+	// the header is in the span in front of the block
+	span = (umalloc_span_t*) ((base + offset - 1) & UMALLOC_SPAN_MASK);
+	span->magic = UMALLOC_MAGIC;
+	span->sclass = UMALLOC_LARGE;
+	span->size = mapped;
+	span->base = base;
+	span->dirty = dirty;
+
+	flags = irq_nested_disable();
+	span->core = CORE_ID;
+	umalloc_arenas[CORE_ID].used += mapped;
+	irq_nested_enable(flags);
+
+	return (void*) (base + offset);
+}
+
+static void umalloc_large_free(umalloc_span_t* span)
+{
+	const size_t base = span->base;
+	const size_t size = span->size;
+	umalloc_arena_t* arena;
+	size_t release = base;
+	uint32_t i;
+	uint8_t flags;
+
+	span->magic = 0;
+
+	flags = irq_nested_disable();
+	arena = &umalloc_arenas[CORE_ID];
+	arena->used -= size;
+
+	// only blocks with the header at the start of the mapping can be reused
+	if (((size_t) span == base) && (size <= UMALLOC_LARGE_CACHE_MAX)) {
+		for(i=0; i<UMALLOC_LARGE_CACHE; i++) {
+			if (!arena->large[i].base) {
+				arena->large[i].base = base;
+				arena->large[i].size = size;
+				release = 0;
+				break;
+			}
+		}
+	}
+
+	irq_nested_enable(flags);
+
+	if (release)
+		umalloc_unmap(release, size);
+}
+
+static void* umalloc(void* reent, size_t sz, size_t align)
+{
+	size_t asz = sz;
+
+	// a power of two larger than the alignment is aligned in a span
+	if ((align > UMALLOC_ALIGN) && (align <= UMALLOC_HDR_SIZE)) {
+		if (asz < align)
+			asz = align;
+		asz = 1UL << (msb(asz - 1) + 1);
+	}
+
+	if ((asz <= UMALLOC_SMALL_MAX) && (align <= UMALLOC_HDR_SIZE))
+		return umalloc_small(reent, asz);
+
+	return umalloc_large_alloc(reent, sz, align > UMALLOC_ALIGN ? align : UMALLOC_ALIGN);
+}
+
+void* _malloc_r(void* reent, size_t sz)
+{
+	return umalloc(reent, sz, UMALLOC_ALIGN);
+}
+
+void _free_r(void* reent, void* ptr)
+{
+	umalloc_span_t* span;
+
+	if (!ptr)
+		return;
+
+	span = umalloc_span(ptr);
+	if (BUILTIN_EXPECT(!span, 0)) {
+		LOG_ERROR("free: %p isn't a block of malloc()\n", ptr);
+		return;
+	}
+
+	if (span->sclass == UMALLOC_LARGE)
+		umalloc_large_free(span);
+	else
+		umalloc_small_free(span, ptr);
+}
+
+void* _calloc_r(void* reent, size_t num, size_t size)
+{
+	umalloc_span_t* span;
+	size_t sz = num * size;
+	void* ptr;
+
+	if (BUILTIN_EXPECT(size && (sz / size != num), 0)) {
+		umalloc_enomem(reent);
+		return NULL;
+	}
+
+	ptr = _malloc_r(reent, sz);
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return NULL;
+
+	// new mappings are already zeroed
+	span = umalloc_span(ptr);
+	if (span->dirty)
+		memset(ptr, 0x00, sz);
+
+	return ptr;
+}
+
+void* _realloc_r(void* reent, void* ptr, size_t sz)
+{
+	umalloc_span_t* span;
+	size_t usable;
+	void* new_ptr;
+
+	if (!ptr)
+		return _malloc_r(reent, sz);
+	if (!sz) {
+		_free_r(reent, ptr);
+		return NULL;
+	}
+
+	span = umalloc_span(ptr);
+	if (BUILTIN_EXPECT(!span, 0)) {
+		LOG_ERROR("realloc: %p isn't a block of malloc()\n", ptr);
+		return NULL;
+	}
+
+	// keep the block, if doesn't shrink too much
+	usable = umalloc_usable(span, ptr);
+	if ((sz <= usable) && (sz > usable / 2))
+		return ptr;
+
+	new_ptr = _malloc_r(reent, sz);
+	if (BUILTIN_EXPECT(!new_ptr, 0))
+		return NULL;
+
+	memcpy(new_ptr, ptr, sz < usable ? sz : usable);
+	_free_r(reent, ptr);
+
+	return new_ptr;
+}
+
+void* _memalign_r(void* reent, size_t align, size_t sz)
+{
+	if (BUILTIN_EXPECT(align & (align - 1), 0)) {
+		if (reent)
+			*((int*) reent) = EINVAL;
+		return NULL;
+	}
+
+	return umalloc(reent, sz, align);
+}
+
+void* _valloc_r(void* reent, size_t sz)
+{
+	return _memalign_r(reent, PAGE_SIZE, sz);
+}
+
+void* _pvalloc_r(void* reent, size_t sz)
+{
+	return _memalign_r(reent, PAGE_SIZE, PAGE_CEIL(sz));
+}
+
+size_t _malloc_usable_size_r(void* reent, void* ptr)
+{
+	umalloc_span_t* span = umalloc_span(ptr);
+
+	return span ? umalloc_usable(span, ptr) : 0;
+}
+
+struct mallinfo _mallinfo_r(void* reent)
+{
+	struct mallinfo info;
+	int64_t used = 0;
+	uint32_t i;
+
+	for(i=0; i<MAX_CORES; i++)
+		used += umalloc_arenas[i].used;
+
+	memset(&info, 0x00, sizeof(info));
+	info.arena = umalloc_mapped;
+	info.usmblks = umalloc_max_mapped;
+	info.uordblks = used > 0 ? (size_t) used : 0;
+	info.fordblks = info.arena > info.uordblks ? info.arena - info.uordblks : 0;
+
+	return info;
+}
+
+void _malloc_stats_r(void* reent)
+{
+	struct mallinfo info = _mallinfo_r(reent);
+
+	kprintf("max system bytes = %10zu\n", info.usmblks);
+	kprintf("system bytes     = %10zu\n", info.arena);
+	kprintf("in use bytes     = %10zu\n", info.uordblks);
+}
+
+int _mallopt_r(void* reent, int param, int value)
+{
+	// the arenas don't have tunables
+	return 0;
+}
+
+/// releases the cached spans and large blocks of the calling core
+int _malloc_trim_r(void* reent, size_t pad)
+{
+	umalloc_arena_t* arena;
+	umalloc_span_t* span;
+	umalloc_large_t large;
+	uint32_t i;
+	uint8_t flags;
+	int ret = 0;
+
+	while(1) {
+		flags = irq_nested_disable();
+		arena = &umalloc_arenas[CORE_ID];
+		span = arena->empty;
+		if (span) {
+			arena->empty = span->next;
+			arena->nr_empty--;
+		}
+		irq_nested_enable(flags);
+
+		if (!span)
+			break;
+
+		umalloc_unmap((size_t) span, UMALLOC_SPAN_SIZE);
+		ret = 1;
+	}
+
+	for(i=0; i<UMALLOC_LARGE_CACHE; i++) {
+		flags = irq_nested_disable();
+		arena = &umalloc_arenas[CORE_ID];
+		large = arena->large[i];
+		arena->large[i].base = 0;
+		irq_nested_enable(flags);
+
+		if (large.base) {
+			umalloc_unmap(large.base, large.size);
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
+
+void* malloc(size_t sz)
+{
+	return _malloc_r(NULL, sz);
+}
+
+void free(void* ptr)
+{
+	_free_r(NULL, ptr);
+}
+
+void* calloc(size_t num, size_t size)
+{
+	return _calloc_r(NULL, num, size);
+}
+
+void* realloc(void* ptr, size_t sz)
+{
+	return _realloc_r(NULL, ptr, sz);
+}
+
+void* memalign(size_t align, size_t sz)
+{
+	return _memalign_r(NULL, align, sz);
+}
+
+void* valloc(size_t sz)
+{
+	return _valloc_r(NULL, sz);
+}
+
+void* pvalloc(size_t sz)
+{
+	return _pvalloc_r(NULL, sz);
+}
+
+int posix_memalign(void** memptr, size_t align, size_t sz)
+{
+	void* ptr;
+
+	if (BUILTIN_EXPECT(!memptr || (align & (align - 1)) || (align % sizeof(void*)), 0))
+		return EINVAL;
+
+	ptr = umalloc(NULL, sz, align);
+	if (BUILTIN_EXPECT(!ptr, 0))
+		return ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+	return _malloc_usable_size_r(NULL, ptr);
+}
+
+struct mallinfo mallinfo(void)
+{
+	return _mallinfo_r(NULL);
+}
+
+void malloc_stats(void)
+{
+	_malloc_stats_r(NULL);
+}
+
+int mallopt(int param, int value)
+{
+	return _mallopt_r(NULL, param, value);
+}
+
+int malloc_trim(size_t pad)
+{
+	return _malloc_trim_r(NULL, pad);
+}
+
+#endif
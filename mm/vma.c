@@ -27,12 +27,14 @@
 
 #include <hermit/vma.h>
 #include <hermit/stdlib.h>
+#include <hermit/slab.h>
 #include <hermit/stdio.h>
 #include <hermit/tasks_types.h>
 #include <hermit/spinlock.h>
 #include <hermit/errno.h>
 #include <hermit/logging.h>
 #include <asm/io.h>
+#include <asm/uhyve.h>
 #include <asm/irq.h>
 
 #define UHYVE_IRQ_FREELIST 12
@@ -47,16 +49,376 @@ extern const void kernel_start;
  *
  * For bootstrapping we initialize the VMA list with one empty VMA
  * (start == end) and expand this VMA by calls to vma_alloc()
+ *
+ * Besides the sorted list, all VMAs are part of a red-black tree, which is
+ * ordered by the start address. Each node knows the largest free gap in
+ * front of a VMA within its subtree, which reduces the search for a free
+ * area to O(log n).
  */
 static vma_t vma_boot = { VMA_MIN, VMA_MIN, VMA_HEAP };
 static vma_t* vma_list = &vma_boot;
-spinlock_irqsave_t hermit_mm_lock = SPINLOCK_IRQSAVE_INIT;
+static vma_t* vma_root = &vma_boot;
+
+#define VMA_BLACK	0
+#define VMA_RED		1
+
+/// object cache of the VMA descriptors
+static kmem_cache_t vma_cache = KMEM_CACHE_INIT("vma", sizeof(vma_t), NULL);
+mcs_spinlock_irqsave_t hermit_mm_lock = MCS_SPINLOCK_IRQSAVE_INIT;
+
+/// free space between the predecessor and the VMA, which vma_alloc() may use
+static inline size_t vma_gap(vma_t* vma)
+{
+	size_t begin = vma->prev ? vma->prev->end : VMA_MIN;
+
+	if ((begin < VMA_MIN) || (vma->start <= begin))
+		return 0;
+
+	return vma->start - begin;
+}
+
+static inline void vma_recompute(vma_t* vma)
+{
+	size_t max = vma_gap(vma);
+
+	if (vma->left && (vma->left->gap_max > max))
+		max = vma->left->gap_max;
+	if (vma->right && (vma->right->gap_max > max))
+		max = vma->right->gap_max;
+
+	vma->gap_max = max;
+}
+
+/// update the largest gaps from vma up to the root
+static void vma_update_path(vma_t* vma)
+{
+	for(; vma; vma = vma->parent)
+		vma_recompute(vma);
+}
+
+static void vma_rotate_left(vma_t* x)
+{
+	vma_t* y = x->right;
+
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (!x->parent)
+		vma_root = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+
+	vma_recompute(x);
+	vma_recompute(y);
+}
+
+static void vma_rotate_right(vma_t* x)
+{
+	vma_t* y = x->left;
+
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (!x->parent)
+		vma_root = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+
+	vma_recompute(x);
+	vma_recompute(y);
+}
+
+/// insert vma, which is already linked into the list, behind its predecessor
+static void vma_tree_insert(vma_t* vma)
+{
+	vma_t* pred = vma->prev;
+	vma_t* node;
+
+	vma->left = vma->right = NULL;
+	vma->color = VMA_RED;
+
+	if (!vma_root) {
+		vma->parent = NULL;
+		vma_root = vma;
+	} else if (!pred) {
+		// new list head => leftmost node
+		for(node = vma_root; node->left; node = node->left)
+			;
+		node->left = vma;
+		vma->parent = node;
+	} else if (!pred->right) {
+		pred->right = vma;
+		vma->parent = pred;
+	} else {
+		// the successor of pred hasn't a left child
+		node = vma->next;
+		node->left = vma;
+		vma->parent = node;
+	}
+
+	vma_update_path(vma);
+	if (vma->next)
+		vma_update_path(vma->next);
+
+	// restore the red-black properties
+	while (vma->parent && (vma->parent->color == VMA_RED)) {
+		vma_t* parent = vma->parent;
+		vma_t* gparent = parent->parent;
+
+		if (parent == gparent->left) {
+			vma_t* uncle = gparent->right;
+
+			if (uncle && (uncle->color == VMA_RED)) {
+				parent->color = uncle->color = VMA_BLACK;
+				gparent->color = VMA_RED;
+				vma = gparent;
+				continue;
+			}
+
+			if (vma == parent->right) {
+				vma = parent;
+				vma_rotate_left(vma);
+				parent = vma->parent;
+			}
+
+			parent->color = VMA_BLACK;
+			gparent->color = VMA_RED;
+			vma_rotate_right(gparent);
+		} else {
+			vma_t* uncle = gparent->left;
+
+			if (uncle && (uncle->color == VMA_RED)) {
+				parent->color = uncle->color = VMA_BLACK;
+				gparent->color = VMA_RED;
+				vma = gparent;
+				continue;
+			}
+
+			if (vma == parent->left) {
+				vma = parent;
+				vma_rotate_right(vma);
+				parent = vma->parent;
+			}
+
+			parent->color = VMA_BLACK;
+			gparent->color = VMA_RED;
+			vma_rotate_left(gparent);
+		}
+	}
+
+	vma_root->color = VMA_BLACK;
+}
+
+static void vma_transplant(vma_t* u, vma_t* v)
+{
+	if (!u->parent)
+		vma_root = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if (v)
+		v->parent = u->parent;
+}
+
+/// remove vma, which is already unlinked from the list, from the tree
+static void vma_tree_remove(vma_t* z)
+{
+	vma_t *x, *parent, *y = z;
+	uint8_t color = z->color;
+
+	if (!z->left) {
+		x = z->right;
+		parent = z->parent;
+		vma_transplant(z, z->right);
+	} else if (!z->right) {
+		x = z->left;
+		parent = z->parent;
+		vma_transplant(z, z->left);
+	} else {
+		for(y = z->right; y->left; y = y->left)
+			;
+		color = y->color;
+		x = y->right;
+		if (y->parent == z) {
+			parent = y;
+		} else {
+			parent = y->parent;
+			vma_transplant(y, y->right);
+			y->right = z->right;
+			y->right->parent = y;
+		}
+		vma_transplant(z, y);
+		y->left = z->left;
+		y->left->parent = y;
+		y->color = z->color;
+	}
+
+	vma_update_path(parent);
+
+	if (color != VMA_BLACK)
+		return;
+
+	// restore the red-black properties
+	while ((x != vma_root) && (!x || (x->color == VMA_BLACK))) {
+		vma_t* w;
+
+		if (x == parent->left) {
+			w = parent->right;
+			if (w->color == VMA_RED) {
+				w->color = VMA_BLACK;
+				parent->color = VMA_RED;
+				vma_rotate_left(parent);
+				w = parent->right;
+			}
+
+			if ((!w->left || (w->left->color == VMA_BLACK)) &&
+			    (!w->right || (w->right->color == VMA_BLACK))) {
+				w->color = VMA_RED;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!w->right || (w->right->color == VMA_BLACK)) {
+					w->left->color = VMA_BLACK;
+					w->color = VMA_RED;
+					vma_rotate_right(w);
+					w = parent->right;
+				}
+
+				w->color = parent->color;
+				parent->color = VMA_BLACK;
+				if (w->right)
+					w->right->color = VMA_BLACK;
+				vma_rotate_left(parent);
+				x = vma_root;
+			}
+		} else {
+			w = parent->left;
+			if (w->color == VMA_RED) {
+				w->color = VMA_BLACK;
+				parent->color = VMA_RED;
+				vma_rotate_right(parent);
+				w = parent->left;
+			}
+
+			if ((!w->left || (w->left->color == VMA_BLACK)) &&
+			    (!w->right || (w->right->color == VMA_BLACK))) {
+				w->color = VMA_RED;
+				x = parent;
+				parent = x->parent;
+			} else {
+				if (!w->left || (w->left->color == VMA_BLACK)) {
+					w->right->color = VMA_BLACK;
+					w->color = VMA_RED;
+					vma_rotate_left(w);
+					w = parent->left;
+				}
+
+				w->color = parent->color;
+				parent->color = VMA_BLACK;
+				if (w->left)
+					w->left->color = VMA_BLACK;
+				vma_rotate_right(parent);
+				x = vma_root;
+			}
+		}
+	}
+
+	if (x)
+		x->color = VMA_BLACK;
+}
+
+/// link a new VMA between pred and succ
+static void vma_link(vma_t* new, vma_t* pred, vma_t* succ)
+{
+	new->next = succ;
+	new->prev = pred;
+
+	if (succ)
+		succ->prev = new;
+	if (pred)
+		pred->next = new;
+	else
+		vma_list = new;
+
+	vma_tree_insert(new);
+}
+
+static void vma_unlink(vma_t* vma)
+{
+	vma_t* succ = vma->next;
+
+	if (vma == vma_list)
+		vma_list = vma->next; // update list head
+	if (vma->prev)
+		vma->prev->next = vma->next;
+	if (vma->next)
+		vma->next->prev = vma->prev;
+
+	vma_tree_remove(vma);
+	if (succ)
+		vma_update_path(succ);
+}
+
+/// last VMA, which starts at or below addr
+static vma_t* vma_floor(size_t addr)
+{
+	vma_t* vma = vma_root;
+	vma_t* ret = NULL;
+
+	while (vma) {
+		if (vma->start <= addr) {
+			ret = vma;
+			vma = vma->right;
+		} else vma = vma->left;
+	}
+
+	return ret;
+}
+
+/// first VMA with a free gap in front of it, which is larger than size
+static vma_t* vma_first_fit(size_t size)
+{
+	vma_t* vma = vma_root;
+
+	while (vma && (vma->gap_max > size)) {
+		if (vma->left && (vma->left->gap_max > size))
+			vma = vma->left;
+		else if (vma_gap(vma) > size)
+			return vma;
+		else
+			vma = vma->right;
+	}
+
+	return NULL;
+}
+
+/// last element of the list
+static vma_t* vma_last(void)
+{
+	vma_t* vma = vma_root;
+
+	while (vma && vma->right)
+		vma = vma->right;
+
+	return vma;
+}
 
 typedef struct free_list free_list_t;
 
 static void uhyve_irq_freelist_handler(struct state* s)
 {
-	outportl(UHYVE_PORT_FREELIST, (unsigned)virt_to_phys((size_t)get_free_list()));
+	uhyve_send(UHYVE_PORT_FREELIST, (unsigned)virt_to_phys((size_t)get_free_list()));
 }
 
 int vma_init(void)
@@ -94,8 +456,7 @@ out:
 
 size_t vma_alloc(size_t size, uint32_t flags)
 {
-	spinlock_irqsave_t* lock = &hermit_mm_lock;
-	vma_t** list = &vma_list;
+	mcs_spinlock_irqsave_t* lock = &hermit_mm_lock;
 
 	LOG_DEBUG("vma_alloc: size = %#lx, flags = %#x\n", size, flags);
 
@@ -108,100 +469,84 @@ size_t vma_alloc(size_t size, uint32_t flags)
 
 	size = PAGE_CEIL(size);
 
-	spinlock_irqsave_lock(lock);
+	mcs_spinlock_irqsave_lock(lock);
 
 	// first fit search for free memory area
-	vma_t* pred = NULL;  // vma before current gap
-	vma_t* succ = *list; // vma after current gap
-	do {
-		start = (pred) ? pred->end : base;
-		end = (succ) ? succ->start : limit;
+	vma_t* succ = vma_first_fit(size); // vma after current gap
+	vma_t* pred = (succ) ? succ->prev : vma_last(); // vma before current gap
 
-		if (start + size < end && start >= base && start + size < limit)
-			goto found; // we found a gap which is large enough and in the bounds
+	start = (pred) ? pred->end : base;
+	end = (succ) ? succ->start : limit;
 
-		pred = succ;
-		succ = (pred) ? pred->next : NULL;
-	} while (pred || succ);
+	if (start + size < end && start >= base && start + size < limit)
+		goto found; // we found a gap which is large enough and in the bounds
 
 fail:
-	spinlock_irqsave_unlock(lock);	// we were unlucky to find a free gap
+	mcs_spinlock_irqsave_unlock(lock);	// we were unlucky to find a free gap
 
 	return 0;
 
 found:
 	if (pred && pred->flags == flags) {
 		pred->end += size; // resize VMA
+		if (succ)
+			vma_update_path(succ);
 		LOG_DEBUG("vma_alloc: resize vma, start 0x%zx, pred->start 0x%zx, pred->end 0x%zx\n", start, pred->start, pred->end);
 	} else {
 		// insert new VMA
-		vma_t* new = kmalloc(sizeof(vma_t));
+		vma_t* new = kmem_cache_alloc(&vma_cache);
 		if (BUILTIN_EXPECT(!new, 0))
 			goto fail;
 
 		new->start = start;
 		new->end = start + size;
 		new->flags = flags;
-		new->next = succ;
-		new->prev = pred;
 		LOG_DEBUG("vma_alloc: create new vma, new->start 0x%zx, new->end 0x%zx\n", new->start, new->end);
 
-		if (succ)
-			succ->prev = new;
-		if (pred)
-			pred->next = new;
-		else
-			*list = new;
+		vma_link(new, pred, succ);
 	}
 
-	spinlock_irqsave_unlock(lock);
+	mcs_spinlock_irqsave_unlock(lock);
 
 	return start;
 }
 
 int vma_free(size_t start, size_t end)
 {
-	spinlock_irqsave_t* lock = &hermit_mm_lock;
+	mcs_spinlock_irqsave_t* lock = &hermit_mm_lock;
 	vma_t* vma;
-	vma_t** list = &vma_list;
 
 	LOG_DEBUG("vma_free: start = %#lx, end = %#lx\n", start, end);
 
 	if (BUILTIN_EXPECT(start >= end, 0))
 		return -EINVAL;
 
-	spinlock_irqsave_lock(lock);
+	mcs_spinlock_irqsave_lock(lock);
 
 	// search vma
-	vma = *list;
-	while (vma) {
-		if (start >= vma->start && end <= vma->end) break;
-		vma = vma->next;
-	}
-
-	if (BUILTIN_EXPECT(!vma, 0)) {
-		spinlock_irqsave_unlock(lock);
+	vma = vma_floor(start);
+	if (BUILTIN_EXPECT(!vma || (end > vma->end), 0)) {
+		mcs_spinlock_irqsave_unlock(lock);
 		return -EINVAL;
 	}
 
 	// free/resize vma
 	if (start == vma->start && end == vma->end) {
-		if (vma == *list)
-			*list = vma->next; // update list head
-		if (vma->prev)
-			vma->prev->next = vma->next;
-		if (vma->next)
-			vma->next->prev = vma->prev;
-		kfree(vma);
+		vma_unlink(vma);
+		if (vma != &vma_boot)
+			kmem_cache_free(&vma_cache, vma);
 	}
-	else if (start == vma->start)
+	else if (start == vma->start) {
 		vma->start = end;
-	else if (end == vma->end)
+		vma_update_path(vma);
+	} else if (end == vma->end) {
 		vma->end = start;
-	else {
-		vma_t* new = kmalloc(sizeof(vma_t));
+		if (vma->next)
+			vma_update_path(vma->next);
+	} else {
+		vma_t* new = kmem_cache_alloc(&vma_cache);
 		if (BUILTIN_EXPECT(!new, 0)) {
-			spinlock_irqsave_unlock(lock);
+			mcs_spinlock_irqsave_unlock(lock);
 			return -ENOMEM;
 		}
 
@@ -211,20 +556,17 @@ int vma_free(size_t start, size_t end)
 		vma->end = start;
 		new->start = end;
 
-		new->next = vma->next;
-		vma->next = new;
-		new->prev = vma;
+		vma_link(new, vma, vma->next);
 	}
 
-	spinlock_irqsave_unlock(lock);
+	mcs_spinlock_irqsave_unlock(lock);
 
 	return 0;
 }
 
 int vma_add(size_t start, size_t end, uint32_t flags)
 {
-	spinlock_irqsave_t* lock = &hermit_mm_lock;
-	vma_t** list = &vma_list;
+	mcs_spinlock_irqsave_t* lock = &hermit_mm_lock;
 	int ret = 0;
 
 	if (BUILTIN_EXPECT(start >= end, 0))
@@ -232,32 +574,25 @@ int vma_add(size_t start, size_t end, uint32_t flags)
 
 	LOG_DEBUG("vma_add: start = %#lx, end = %#lx, flags = %#x\n", start, end, flags);
 
-	spinlock_irqsave_lock(lock);
+	mcs_spinlock_irqsave_lock(lock);
 
 	// search gap
-	vma_t* pred = NULL;
-	vma_t* succ = *list;
-
-	while (pred || succ) {
-		if ((!pred || pred->end <= start) &&
-		    (!succ || succ->start >= end))
-			break;
-
-		pred = succ;
-		succ = (succ) ? succ->next : NULL;
-	}
+	vma_t* pred = vma_floor(start);
+	vma_t* succ = (pred) ? pred->next : vma_list;
 
-	if (BUILTIN_EXPECT(*list && !pred && !succ, 0)) {
+	if (BUILTIN_EXPECT((pred && (pred->end > start)) || (succ && (succ->start < end)), 0)) {
 		ret = -EINVAL;
 		goto fail;
 	}
 
 	if (pred && (pred->end == start) && (pred->flags == flags)) {
 		pred->end = end; // resize VMA
+		if (succ)
+			vma_update_path(succ);
 		LOG_DEBUG("vma_add: resize vma, start 0x%zx, pred->start 0x%zx, pred->end 0x%zx\n", start, pred->start, pred->end);
 	} else {
 		// insert new VMA
-		vma_t* new = kmalloc(sizeof(vma_t));
+		vma_t* new = kmem_cache_alloc(&vma_cache);
 		if (BUILTIN_EXPECT(!new, 0)) {
 			ret = -ENOMEM;
 			goto fail;
@@ -266,21 +601,51 @@ int vma_add(size_t start, size_t end, uint32_t flags)
 		new->start = start;
 		new->end = end;
 		new->flags = flags;
-		new->next = succ;
-		new->prev = pred;
 		LOG_DEBUG("vma_add: create new vma, new->start 0x%zx, new->end 0x%zx\n", new->start, new->end);
 
-		if (succ)
-			succ->prev = new;
-
-		if (pred)
-			pred->next = new;
-		else
-			*list = new;
+		vma_link(new, pred, succ);
 	}
 
 fail:
-	spinlock_irqsave_unlock(lock);
+	mcs_spinlock_irqsave_unlock(lock);
+
+	return ret;
+}
+
+int vma_lookup(size_t addr, vma_t* result)
+{
+	mcs_spinlock_irqsave_t* lock = &hermit_mm_lock;
+	vma_t* vma;
+	int ret = -EINVAL;
+
+	mcs_spinlock_irqsave_lock(lock);
+
+	vma = vma_floor(addr);
+	if (vma && (addr < vma->end)) {
+		result->start = vma->start;
+		result->end = vma->end;
+		result->flags = vma->flags;
+		ret = 0;
+	}
+
+	mcs_spinlock_irqsave_unlock(lock);
+
+	return ret;
+}
+
+int vma_set_flags(size_t start, size_t end, uint32_t flags)
+{
+	mcs_spinlock_irqsave_t* lock = &hermit_mm_lock;
+	int ret;
+
+	// the lock is recursive => nobody sees the gap between both calls
+	mcs_spinlock_irqsave_lock(lock);
+
+	ret = vma_free(start, end);
+	if (!ret)
+		ret = vma_add(start, end, flags);
+
+	mcs_spinlock_irqsave_unlock(lock);
 
 	return ret;
 }
@@ -300,7 +665,7 @@ static void print_vma(vma_t *vma)
 void vma_dump(void)
 {
 	LOG_INFO("VMAs:\n");
-	spinlock_irqsave_lock(&hermit_mm_lock);
+	mcs_spinlock_irqsave_lock(&hermit_mm_lock);
 	print_vma(vma_list);
-	spinlock_irqsave_unlock(&hermit_mm_lock);
+	mcs_spinlock_irqsave_unlock(&hermit_mm_lock);
 }
@@ -35,6 +35,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sched.h>
+#include <stdint.h>
+#include "bench.h"
 #ifndef __hermit__
 #include <sys/syscall.h>
 
@@ -49,6 +51,24 @@ static inline long mygetpid(void)
 }
 
 int sched_yield(void);
+
+#include "hist.h"
+
+/* layout of sysstat_t in include/hermit/sysstat.h */
+#define SYSSTAT_HIST_BINS	32
+#define SYSSTAT_MAX		64
+
+struct sysstat {
+	char name[16];
+	uint64_t calls;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t hist[SYSSTAT_HIST_BINS];
+};
+
+static struct sysstat sysstats[SYSSTAT_MAX];
+
+int sys_sysstat(size_t size, void* stats);
 #endif
 
 #define N		10000
@@ -57,25 +77,6 @@ int sched_yield(void);
 
 static char* buff[M];
 
-#if 1
-inline static unsigned long long rdtsc(void)
-{
-	unsigned long lo, hi;
-	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
-	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
-}
-#else
-inline static unsigned long long rdtsc(void)
-{
-	unsigned int lo, hi;
-	unsigned int id;
-
-	asm volatile ("rdtscp" : "=a"(lo), "=c"(id), "=d"(hi));
-
-	return ((unsigned long long)hi << 32ULL | (unsigned long long)lo);
-}
-#endif
-
 int main(int argc, char** argv)
 {
 	long i, j, ret;
@@ -83,62 +84,78 @@ int main(int argc, char** argv)
 	const char str[] = "H";
 	size_t len = strlen(str);
 
-	printf("Determine systems performance\n");
-	printf("=============================\n");
+	bench_init("basic");
 
 	// cache warm-up
 	ret = mygetpid();
 	ret = mygetpid();
 
-	start = rdtsc();
+	start = bench_now();
 	for(i=0; i<N; i++)
 		ret = mygetpid();
-	end = rdtsc();
+	end = bench_now();
 
-	printf("Average time for getpid: %lld cycles, pid %ld\n", (end - start) / N, ret);
+	bench_value("getpid", "cycles", (double) (end - start) / N, BENCH_LOWER);
 
 	// cache warm-up
 	sched_yield();
 	sched_yield();
 
-	start = rdtsc();
+	start = bench_now();
 	for(i=0; i<N; i++)
 		sched_yield();
-	end = rdtsc();
+	end = bench_now();
 
-	printf("Average time for sched_yield: %lld cycles\n", (end - start) / N);
+	bench_value("sched_yield", "cycles", (double) (end - start) / N, BENCH_LOWER);
 
 	// cache warm-up
 	buff[0] = (char*) malloc(BUFFSZ);
 
-	start = rdtsc();
+	start = bench_now();
 	for(i=1; i<M; i++)
 		buff[i] = (char*) malloc(BUFFSZ);
-	end = rdtsc();
+	end = bench_now();
 
-	printf("Average time for malloc: %lld cycles\n", (end - start) / (M-1));
+	bench_value("malloc", "cycles", (double) (end - start) / (M-1), BENCH_LOWER);
 
 	// cache warm-up
 	for(j=0; j<BUFFSZ; j+=4096)
 		buff[0][j] = '1';
 
-	start = rdtsc();
+	start = bench_now();
 	for(i=1; i<M; i++)
 		for(j=0; j<BUFFSZ; j+=4096)
 			buff[i][j] = '1';
-	end = rdtsc();
+	end = bench_now();
 
-	printf("Average time for the first page access: %lld cycles\n", (end - start) / ((M-1)*BUFFSZ/4096));
+	bench_value("first page access", "cycles", (double) (end - start) / ((M-1)*BUFFSZ/4096), BENCH_LOWER);
 
 #if 0
 	write(2, (const void *)str, len);
 	write(2, (const void *)str, len);
-	start = rdtsc();
+	start = bench_now();
 	for(i=0; i<N; i++)
 		write(2, (const void *)str, len);
-	end = rdtsc();
+	end = bench_now();
+
+	bench_value("write", "cycles", (double) (end - start) / N, BENCH_LOWER);
+#endif
 
-	printf("\nAverage time for write: %lld cycles\n", (end - start) / N);
+	bench_finish();
+
+#ifdef __hermit__
+	// the kernel is built with SYSSTAT => print the profile of the system calls
+	ret = sys_sysstat(sizeof(sysstats), sysstats);
+	for(i=0; i<ret; i++) {
+		if (!sysstats[i].calls)
+			continue;
+
+		printf("\nsys_%s: %llu calls, %llu ns avg, %llu ns max\n", sysstats[i].name,
+			(unsigned long long) sysstats[i].calls,
+			(unsigned long long) (sysstats[i].total_ns / sysstats[i].calls),
+			(unsigned long long) sysstats[i].max_ns);
+		hist_print_log2(sysstats[i].hist, SYSSTAT_HIST_BINS);
+	}
 #endif
 
 	return 0;
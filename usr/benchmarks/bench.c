@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __hermit__
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include "bench.h"
+
+#define BENCH_TEXT	0
+#define BENCH_CSV	1
+#define BENCH_JSON	2
+
+#ifdef __hermit__
+typedef unsigned int tid_t;
+
+int sys_sched_getaffinity(tid_t* id, size_t size, void* mask);
+int sys_sched_setaffinity(tid_t* id, size_t size, const void* mask);
+int sched_yield(void);
+const int32_t is_uhyve(void);
+const int32_t is_single_kernel(void);
+#endif
+
+static int format = BENCH_TEXT;
+static const char* bench_program = "";
+static uint64_t tps = 0;
+static unsigned int nresults = 0;
+
+uint64_t bench_ticks_per_sec(void)
+{
+	if (!tps)
+		tps = rdtsc_ticks_per_sec();
+
+	return tps;
+}
+
+unsigned int bench_cores(void)
+{
+#ifdef __hermit__
+	uint64_t mask[8];
+	unsigned int i, n = 0;
+
+	memset(mask, 0x00, sizeof(mask));
+	if (sys_sched_getaffinity(NULL, sizeof(mask), mask))
+		return 1;
+
+	for (i = 0; i < sizeof(mask) / sizeof(mask[0]); i++)
+		n += __builtin_popcountll(mask[i]);
+
+	return n ? n : 1;
+#else
+	cpu_set_t set;
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return 1;
+
+	return CPU_COUNT(&set);
+#endif
+}
+
+void bench_pin(unsigned int core)
+{
+#ifdef __hermit__
+	uint64_t mask[8];
+
+	if (core >= 64 * sizeof(mask) / sizeof(mask[0]))
+		return;
+
+	memset(mask, 0x00, sizeof(mask));
+	mask[core / 64] = 1ULL << (core % 64);
+	sys_sched_setaffinity(NULL, sizeof(mask), mask);
+#else
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+#endif
+	// migrate now
+	sched_yield();
+}
+
+int bench_text(void)
+{
+	return format == BENCH_TEXT;
+}
+
+static const char* bench_platform(void)
+{
+#ifdef __hermit__
+	if (is_uhyve())
+		return "uhyve";
+	if (is_single_kernel())
+		return "qemu";
+	return "multi-kernel";
+#else
+	return "host";
+#endif
+}
+
+/* write a string without the characters, which JSON or CSV would have to escape */
+static void bench_string(const char* str)
+{
+	for (; *str; str++) {
+		if ((*str != '"') && (*str != '\\') && (*str != ',') && ((unsigned char) *str >= ' '))
+			putchar(*str);
+	}
+}
+
+void bench_init(const char* program)
+{
+	const char* env = getenv("BENCH_FORMAT");
+
+	if (env && !strcmp(env, "csv"))
+		format = BENCH_CSV;
+	else if (env && !strcmp(env, "json"))
+		format = BENCH_JSON;
+	else
+		format = BENCH_TEXT;
+
+	bench_program = program;
+	nresults = 0;
+
+	switch (format) {
+	case BENCH_CSV:
+		printf("program,platform,cores,tsc_mhz,name,unit,better,n,min,median,mean,p99,p999,max\n");
+		break;
+	case BENCH_JSON:
+		printf("{\"program\":\"");
+		bench_string(program);
+		printf("\",\"env\":{\"platform\":\"%s\",\"cores\":%u,\"tsc_mhz\":%llu},\"results\":[",
+			bench_platform(), bench_cores(),
+			(unsigned long long) (bench_ticks_per_sec() / 1000000ULL));
+		break;
+	default:
+		printf("%s on %s, %u cores, %llu MHz\n", program, bench_platform(), bench_cores(),
+			(unsigned long long) (bench_ticks_per_sec() / 1000000ULL));
+		break;
+	}
+}
+
+void bench_finish(void)
+{
+	if (format == BENCH_JSON)
+		printf("]}\n");
+	fflush(stdout);
+}
+
+static void bench_record(const char* name, const char* unit, int better, size_t n,
+	double min, double median, double mean, double p99, double p999, double max)
+{
+	switch (format) {
+	case BENCH_CSV:
+		bench_string(bench_program);
+		printf(",%s,%u,%llu,", bench_platform(), bench_cores(),
+			(unsigned long long) (bench_ticks_per_sec() / 1000000ULL));
+		bench_string(name);
+		printf(",%s,%s,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", unit,
+			better == BENCH_HIGHER ? "higher" : "lower", n, min, median, mean, p99, p999, max);
+		break;
+	case BENCH_JSON:
+		printf("%s{\"name\":\"", nresults ? "," : "");
+		bench_string(name);
+		printf("\",\"unit\":\"%s\",\"better\":\"%s\",\"n\":%zu,\"min\":%.3f,\"median\":%.3f,"
+			"\"mean\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f}", unit,
+			better == BENCH_HIGHER ? "higher" : "lower", n, min, median, mean, p99, p999, max);
+		break;
+	default:
+		if (n > 1)
+			printf("%-40s: min %10.0f  median %10.0f  p99 %10.0f %s\n", name, min, median, p99, unit);
+		else
+			printf("%-40s: %12.1f %s\n", name, median, unit);
+		break;
+	}
+
+	nresults++;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+	const uint64_t x = *(const uint64_t*) a;
+	const uint64_t y = *(const uint64_t*) b;
+
+	return (x > y) - (x < y);
+}
+
+void bench_samples(const char* name, const char* unit, uint64_t* samples, size_t n)
+{
+	double sum = 0.0;
+	size_t i;
+
+	if (!n)
+		return;
+
+	qsort(samples, n, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += (double) samples[i];
+
+	bench_record(name, unit, BENCH_LOWER, n, (double) samples[0], (double) samples[n / 2],
+		sum / (double) n, (double) samples[(n * 99) / 100], (double) samples[(n * 999) / 1000],
+		(double) samples[n - 1]);
+}
+
+void bench_value(const char* name, const char* unit, double value, int better)
+{
+	bench_record(name, unit, better, 1, value, value, value, value, value, value);
+}
+
+void bench_run(const char* name, void (*fn)(void* arg), void* arg,
+	unsigned int warmup, unsigned int repetitions)
+{
+	uint64_t* samples;
+	unsigned int i;
+
+	if (!repetitions)
+		return;
+
+	samples = malloc(repetitions * sizeof(uint64_t));
+	if (!samples) {
+		fprintf(stderr, "%s: unable to allocate the samples\n", name);
+		return;
+	}
+
+	for (i = 0; i < warmup; i++)
+		fn(arg);
+
+	for (i = 0; i < repetitions; i++) {
+		uint64_t start = bench_now();
+
+		fn(arg);
+		samples[i] = bench_now() - start;
+	}
+
+	bench_samples(name, "cycles", samples, repetitions);
+	free(samples);
+}
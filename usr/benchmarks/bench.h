@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Common harness of the benchmarks: time stamps, repetitions with warmup
+ * and the output of the results. The environment variable BENCH_FORMAT
+ * selects the format:
+ *
+ *   text   readable lines (default)
+ *   csv    one line per result, preceded by a header
+ *   json   one line with a JSON object per program, which contains the
+ *          environment and all results (see tools/bench-compare.py)
+ *
+ * The environment contains the frequency of the time stamp counter, the
+ * number of cores and the platform (uhyve, qemu or the host's OS).
+ *
+ * stream.c and the OpenMP microbenchmarks in usr/openmpbench keep their
+ * own output. Both are third-party suites, whose output formats are known
+ * to their users, and STREAM's license asks to label results of modified
+ * code.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rdtsc.h"
+
+/* direction of improvement of a result */
+#define BENCH_LOWER	0
+#define BENCH_HIGHER	1
+
+/* start the output of program */
+void bench_init(const char* program);
+
+/* finish the output, e.g. close the JSON object */
+void bench_finish(void);
+
+/* frequency of the time stamp counter */
+uint64_t bench_ticks_per_sec(void);
+
+/* number of cores, on which the program may run */
+unsigned int bench_cores(void);
+
+/* restrict the calling thread to core and migrate it at once */
+void bench_pin(unsigned int core);
+
+/* are the results readable lines? => details besides the results may be printed */
+int bench_text(void);
+
+static inline uint64_t bench_now(void)
+{
+	uint64_t t = 0;
+
+	rdtsc_serialized(&t);
+
+	return t;
+}
+
+/* report the distribution of samples (min, median, mean, p99, p99.9, max), sorts them */
+void bench_samples(const char* name, const char* unit, uint64_t* samples, size_t n);
+
+/* report a single value, e.g. a throughput */
+void bench_value(const char* name, const char* unit, double value, int better);
+
+/* measure warmup + repetitions calls of fn and report the cycles of the repetitions */
+void bench_run(const char* name, void (*fn)(void* arg), void* arg,
+	unsigned int warmup, unsigned int repetitions);
+
+#endif
@@ -21,6 +21,7 @@
 #include "setup.h"
 #include "run.h"
 #include "report.h"
+#include "bench.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,7 +31,7 @@ struct result results = {0};
 
 int main(int argc, char *argv[])
 {
-    printf("hourglass\n");
+    bench_init("hourglass");
 
     opt(argc, argv, &opts);
     init(&opts);
@@ -47,5 +48,7 @@ int main(int argc, char *argv[])
 
     deinit(&opts);
 
+    bench_finish();
+
     return EXIT_SUCCESS;
 }
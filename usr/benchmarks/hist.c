@@ -76,3 +76,30 @@ int hist_print(void)
     return 0;
 }
 
+int hist_print_log2(const uint64_t *bins, unsigned cnt)
+{
+    unsigned i;
+    uint64_t max=0;
+    unsigned digits;
+    const size_t bar_width = 30;
+    char bar[bar_width+1];
+
+    for (i=0; i<cnt; i++) {
+        if (bins[i] > max) max = bins[i];
+    }
+    digits = (unsigned)ceil(log10((double)max));
+    if (digits == 0) digits = 1;
+    memset(bar, '*', bar_width);
+    bar[bar_width] = 0;
+
+    printf("Histogram (%u bins with log2 ns each)\n", cnt);
+    for (i=0; i<cnt; i++) {
+        if (!bins[i]) continue;
+        printf("     %5u : %5llu..%5llu : %-10llu  %s\n", i,
+                (unsigned long long)(i ? 1ULL << i : 0ULL),
+                (unsigned long long)((2ULL << i) - 1),
+                (unsigned long long)bins[i],
+                (char*)bar+(unsigned)(bar_width-((log10(bins[i]+1.)*bar_width)/digits)));
+    }
+    return 0;
+}
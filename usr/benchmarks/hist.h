@@ -28,4 +28,7 @@ int hist_reset(void);
 void hist_add(uint64_t t);
 int hist_print(void);
 
+/* print a histogram, whose bin i counts the values 2^i..2^(i+1)-1 */
+int hist_print_log2(const uint64_t *bins, unsigned cnt);
+
 #endif // __HIST_H__
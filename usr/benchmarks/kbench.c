@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Microbenchmarks of the kernel's core primitives, as regression baseline
+ * for kernel changes. Each benchmark reports min, median and p99 in cycles
+ * through the harness of bench.h. The application runs in the address
+ * space of the kernel, so that it can call kmalloc() and
+ * ipi_tlb_flush_sync() directly. The first argument overrides the number
+ * of iterations.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "bench.h"
+
+#define ITERATIONS	10000
+#define WARMUP		100
+#define MAX_THREADS	8
+
+/* kernel interface, see include/hermit/syscall.h */
+typedef unsigned int tid_t;
+typedef struct sem ksem_t;
+
+int sys_sem_init(ksem_t** sem, unsigned int value);
+int sys_sem_destroy(ksem_t* sem);
+int sys_sem_wait(ksem_t* sem);
+int sys_sem_post(ksem_t* sem);
+int sys_nanosleep(uint64_t ns);
+int sys_mmap(void** addr, size_t len, int prot, int flags);
+int sys_munmap(void* addr, size_t len);
+void* kmalloc(size_t sz);
+void kfree(void* addr);
+int ipi_tlb_flush_sync(void);
+
+#define PROT_READ	0x1
+#define PROT_WRITE	0x2
+#define MAP_PRIVATE	0x02
+#define MAP_ANONYMOUS	0x20
+#define MAP_HUGETLB	0x40000
+#define MAP_HUGE_2MB	(21 << 26)
+
+int sched_yield(void);
+
+static unsigned long iterations = ITERATIONS;
+static unsigned int ncores = 1;
+
+/* shared state of the two threads of a benchmark */
+static ksem_t* sem_ping;
+static ksem_t* sem_pong;
+static volatile int running;
+static volatile uint64_t post_tsc;
+
+static void bench_syscall(uint64_t* samples)
+{
+	unsigned long i;
+
+	for (i = 0; i < WARMUP; i++)
+		getpid();
+
+	for (i = 0; i < iterations; i++) {
+		uint64_t start = bench_now();
+		getpid();
+		samples[i] = bench_now() - start;
+	}
+
+	bench_samples("syscall (getpid)", "cycles", samples, iterations);
+}
+
+/* the partner of a benchmark, the argument is its core */
+static void* yield_partner(void* arg)
+{
+	bench_pin((unsigned int) (uintptr_t) arg);
+	while (running)
+		sched_yield();
+
+	return NULL;
+}
+
+static void* pong_partner(void* arg)
+{
+	unsigned long i;
+
+	bench_pin((unsigned int) (uintptr_t) arg);
+	for (i = 0; i < iterations + WARMUP; i++) {
+		sys_sem_wait(sem_ping);
+		sys_sem_post(sem_pong);
+	}
+
+	return NULL;
+}
+
+static void* wakeup_partner(void* arg)
+{
+	uint64_t* samples = (uint64_t*) arg;
+	unsigned long i;
+
+	bench_pin(1);
+	for (i = 0; i < iterations + WARMUP; i++) {
+		sys_sem_wait(sem_ping);
+		if (i >= WARMUP)
+			samples[i - WARMUP] = bench_now() - post_tsc;
+		sys_sem_post(sem_pong);
+	}
+
+	return NULL;
+}
+
+static void bench_yield(uint64_t* samples)
+{
+	pthread_t thread;
+	unsigned long i;
+
+	bench_pin(0);
+	running = 1;
+	pthread_create(&thread, NULL, yield_partner, (void*) 0);
+
+	for (i = 0; i < WARMUP; i++)
+		sched_yield();
+
+	// a yield switches to the partner and back
+	for (i = 0; i < iterations; i++) {
+		uint64_t start = bench_now();
+		sched_yield();
+		samples[i] = (bench_now() - start) / 2;
+	}
+
+	running = 0;
+	pthread_join(thread, NULL);
+
+	bench_samples("context switch (same core)", "cycles", samples, iterations);
+}
+
+static void bench_pingpong(uint64_t* samples, unsigned int core, const char* name)
+{
+	pthread_t thread;
+	unsigned long i;
+
+	bench_pin(0);
+	sys_sem_init(&sem_ping, 0);
+	sys_sem_init(&sem_pong, 0);
+	pthread_create(&thread, NULL, pong_partner, (void*) (uintptr_t) core);
+
+	for (i = 0; i < WARMUP; i++) {
+		sys_sem_post(sem_ping);
+		sys_sem_wait(sem_pong);
+	}
+
+	// a round trip contains two wakeups and two context switches
+	for (i = 0; i < iterations; i++) {
+		uint64_t start = bench_now();
+		sys_sem_post(sem_ping);
+		sys_sem_wait(sem_pong);
+		samples[i] = (bench_now() - start) / 2;
+	}
+
+	pthread_join(thread, NULL);
+	sys_sem_destroy(sem_ping);
+	sys_sem_destroy(sem_pong);
+
+	bench_samples(name, "cycles", samples, iterations);
+}
+
+static void bench_wakeup(uint64_t* samples)
+{
+	pthread_t thread;
+	unsigned long i;
+
+	bench_pin(0);
+	sys_sem_init(&sem_ping, 0);
+	sys_sem_init(&sem_pong, 0);
+	pthread_create(&thread, NULL, wakeup_partner, samples);
+
+	for (i = 0; i < iterations + WARMUP; i++) {
+		uint64_t start = bench_now();
+
+		// give the partner time to block
+		while (bench_now() - start < 20000)
+			;
+
+		post_tsc = bench_now();
+		sys_sem_post(sem_ping);
+		sys_sem_wait(sem_pong);
+	}
+
+	pthread_join(thread, NULL);
+	sys_sem_destroy(sem_ping);
+	sys_sem_destroy(sem_pong);
+
+	// the time stamp counters of the cores are synchronized
+	bench_samples("wakeup latency (cross core)", "cycles", samples, iterations);
+}
+
+struct kmalloc_arg {
+	size_t size;
+	unsigned int core;
+	uint64_t* samples;
+};
+
+static void* kmalloc_thread(void* arg)
+{
+	struct kmalloc_arg* ka = (struct kmalloc_arg*) arg;
+	unsigned long i;
+
+	bench_pin(ka->core);
+	for (i = 0; i < WARMUP; i++)
+		kfree(kmalloc(ka->size));
+
+	for (i = 0; i < iterations; i++) {
+		uint64_t start = bench_now();
+		void* p = kmalloc(ka->size);
+		kfree(p);
+		ka->samples[i] = bench_now() - start;
+	}
+
+	return NULL;
+}
+
+static void bench_kmalloc(uint64_t* samples)
+{
+	static const size_t sizes[] = {16, 256, 4096, 65536};
+	pthread_t threads[MAX_THREADS];
+	struct kmalloc_arg args[MAX_THREADS];
+	unsigned int s, n, i;
+	char name[64];
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (n = 1; (n <= MAX_THREADS) && (n <= ncores); n *= 2) {
+			for (i = 0; i < n; i++) {
+				args[i].size = sizes[s];
+				args[i].core = i;
+				args[i].samples = samples + i * iterations;
+				pthread_create(threads + i, NULL, kmalloc_thread, args + i);
+			}
+
+			for (i = 0; i < n; i++)
+				pthread_join(threads[i], NULL);
+
+			snprintf(name, sizeof(name), "kmalloc/kfree %zu B, %u threads", sizes[s], n);
+			bench_samples(name, "cycles", samples, n * iterations);
+		}
+	}
+}
+
+static void bench_pagefault(uint64_t* samples, size_t page_size, int flags, const char* name)
+{
+	const unsigned long pages = page_size > 4096 ? 64 : iterations;
+	size_t len = pages * page_size;
+	void* addr = NULL;
+	volatile char* p;
+	unsigned long i;
+
+	if (sys_mmap(&addr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|flags) || !addr) {
+		fprintf(stderr, "%s: unable to map %zu bytes\n", name, len);
+		return;
+	}
+
+	p = (volatile char*) addr;
+	for (i = 0; i < pages; i++) {
+		uint64_t start = bench_now();
+		p[i * page_size] = 1;
+		samples[i] = bench_now() - start;
+	}
+
+	sys_munmap(addr, len);
+
+	bench_samples(name, "cycles", samples, pages);
+}
+
+static void* busy_thread(void* arg)
+{
+	bench_pin((unsigned int) (uintptr_t) arg);
+	while (running)
+		;
+
+	return NULL;
+}
+
+static void bench_tlb_flush(uint64_t* samples)
+{
+	pthread_t threads[MAX_THREADS];
+	unsigned int busy, i;
+	unsigned long j;
+	char name[64];
+
+	bench_pin(0);
+
+	// all other cores receive the IPI, the busy ones don't have to wake up
+	for (busy = 0; (busy < ncores) && (busy <= MAX_THREADS); busy = busy ? busy * 2 : 1) {
+		running = 1;
+		for (i = 0; i < busy && i + 1 < ncores; i++)
+			pthread_create(threads + i, NULL, busy_thread, (void*) (uintptr_t) (i + 1));
+
+		for (j = 0; j < WARMUP; j++)
+			ipi_tlb_flush_sync();
+
+		for (j = 0; j < iterations; j++) {
+			uint64_t start = bench_now();
+			ipi_tlb_flush_sync();
+			samples[j] = bench_now() - start;
+		}
+
+		running = 0;
+		for (i = 0; i < busy && i + 1 < ncores; i++)
+			pthread_join(threads[i], NULL);
+
+		snprintf(name, sizeof(name), "ipi_tlb_flush, %u of %u cores busy",
+			busy < ncores ? busy : ncores - 1, ncores - 1);
+		bench_samples(name, "cycles", samples, iterations);
+
+		if (busy + 1 >= ncores)
+			break;
+	}
+}
+
+static void bench_timer(uint64_t* samples)
+{
+	static const uint64_t delays[] = {10000, 100000, 1000000};
+	const uint64_t mhz = bench_ticks_per_sec() / 1000000ULL;
+	unsigned long i, n = iterations > 100 ? 100 : iterations;
+	unsigned int d;
+	char name[64];
+
+	for (d = 0; d < sizeof(delays) / sizeof(delays[0]); d++) {
+		const uint64_t expected = (delays[d] * mhz) / 1000;
+
+		for (i = 0; i < n; i++) {
+			uint64_t start = bench_now();
+			uint64_t elapsed;
+
+			sys_nanosleep(delays[d]);
+			elapsed = bench_now() - start;
+			// overshoot of the requested delay
+			samples[i] = elapsed > expected ? elapsed - expected : 0;
+		}
+
+		snprintf(name, sizeof(name), "nanosleep %llu us overshoot",
+			(unsigned long long) delays[d] / 1000);
+		bench_samples(name, "cycles", samples, n);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t* samples;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 10);
+	if (iterations < 1)
+		iterations = 1;
+
+	ncores = bench_cores();
+	samples = malloc(MAX_THREADS * iterations * sizeof(uint64_t));
+	if (!samples) {
+		fprintf(stderr, "Unable to allocate the samples\n");
+		return 1;
+	}
+
+	bench_init("kbench");
+
+	bench_syscall(samples);
+	bench_yield(samples);
+	bench_pingpong(samples, 0, "sem_post/sem_wait (same core)");
+	if (ncores > 1) {
+		bench_pingpong(samples, 1, "sem_post/sem_wait (cross core)");
+		bench_wakeup(samples);
+	}
+	bench_kmalloc(samples);
+	bench_pagefault(samples, 4096, 0, "page fault 4 KiB");
+	bench_pagefault(samples, 2UL << 20, MAP_HUGETLB|MAP_HUGE_2MB, "page fault 2 MiB");
+	if (ncores > 1)
+		bench_tlb_flush(samples);
+	bench_timer(samples);
+
+	free(samples);
+	bench_finish();
+
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Benchmark of the memory allocators: malloc()/free() of the user heap,
+ * which grows by sys_sbrk(), and kmalloc()/kfree() of the kernel. Each run
+ * combines a size distribution, a number of threads and a free pattern:
+ *
+ *   local     each thread replaces random blocks of its working set
+ *   remote    thread 2i allocates, thread 2i+1 frees (producer/consumer)
+ *
+ * It reports the operations per second (allocations and frees), the growth
+ * of the allocated pages and, for kmalloc, the fragmentation of the free
+ * buddies (1 - largest free block / free bytes) through the harness of
+ * bench.h. The first argument overrides the number of operations per
+ * thread.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include "bench.h"
+
+#define OPERATIONS	200000
+#define WORKING_SET	1024
+#define MAX_THREADS	8
+#define RING_SIZE	256
+
+/* kernel interface, see include/hermit/syscall.h */
+typedef unsigned int tid_t;
+
+int sys_memstat(size_t size, void* stats);
+int sys_buddyinfo(size_t size, void* info);
+void* kmalloc(size_t sz);
+void kfree(void* addr);
+int sched_yield(void);
+
+/* layout of mem_stats_t in include/hermit/memory.h */
+#define MEM_NR_TAGS	8
+#define MEM_TAG_HEAP	0
+
+struct mem_stats {
+	struct {
+		int64_t pages;
+		int64_t max_pages;
+		int64_t bytes;
+		int64_t max_bytes;
+	} tags[MEM_NR_TAGS];
+	uint64_t total_pages;
+	uint64_t allocated_pages;
+	uint64_t available_pages;
+};
+
+/* layout of buddy_info_t in include/hermit/malloc.h */
+#define BUDDY_LISTS	27
+
+struct buddy_info {
+	uint64_t free_blocks[BUDDY_LISTS];
+	uint64_t free_bytes;
+	uint64_t cached_bytes;
+	uint64_t largest_free;
+	uint64_t nr_arenas;
+	uint64_t arena_bytes;
+	uint64_t nr_merges;
+	uint64_t nr_released;
+	uint64_t released_bytes;
+};
+
+enum { DIST_SMALL = 0, DIST_BIMODAL, DIST_LARGE, DIST_MAX };
+enum { PATTERN_LOCAL = 0, PATTERN_REMOTE, PATTERN_MAX };
+
+static const char* const dist_names[DIST_MAX] = {"small", "bimodal", "large"};
+static const char* const pattern_names[PATTERN_MAX] = {"local", "remote"};
+
+typedef struct {
+	void* (*alloc)(size_t);
+	void (*release)(void*);
+	const char* name;
+} ALLOCATOR;
+
+static const ALLOCATOR allocators[] = {
+	{malloc, free, "malloc"},
+	{kmalloc, kfree, "kmalloc"}
+};
+
+/* single producer, single consumer ring of a thread pair */
+typedef struct {
+	void* volatile slots[RING_SIZE];
+	volatile unsigned long head;
+	volatile unsigned long tail;
+} __attribute__ ((aligned (64))) RING;
+
+typedef struct {
+	const ALLOCATOR* allocator;
+	int dist;
+	int pattern;
+	unsigned int id;
+	RING* ring;
+	uint64_t ops;
+} WORKER;
+
+static unsigned long operations = OPERATIONS;
+static unsigned int ncores = 1;
+static RING rings[MAX_THREADS / 2];
+
+static uint64_t xorshift(uint64_t* state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return *state = x;
+}
+
+static size_t next_size(int dist, uint64_t* state)
+{
+	const uint64_t r = xorshift(state);
+
+	switch (dist) {
+	case DIST_SMALL:
+		// 16 .. 256 bytes
+		return 16 + (r % 241);
+	case DIST_BIMODAL:
+		// 90% small objects and 10% buffers
+		return (r % 10) ? 32 + (r >> 8) % 33 : 4096 + (r >> 8) % 61441;
+	default:
+		// 64 KiB .. 1 MiB
+		return 65536 + (r % 983041);
+	}
+}
+
+static void run_local(WORKER* w, uint64_t* state)
+{
+	void* set[WORKING_SET];
+	unsigned long i;
+
+	memset(set, 0x00, sizeof(set));
+	for (i = 0; i < operations; i++) {
+		void** slot = set + (xorshift(state) % WORKING_SET);
+
+		if (*slot) {
+			w->allocator->release(*slot);
+			w->ops++;
+		}
+
+		*slot = w->allocator->alloc(next_size(w->dist, state));
+		if (*slot)
+			*(volatile char*) *slot = 1;
+		w->ops++;
+	}
+
+	for (i = 0; i < WORKING_SET; i++) {
+		if (set[i]) {
+			w->allocator->release(set[i]);
+			w->ops++;
+		}
+	}
+}
+
+static void run_producer(WORKER* w, uint64_t* state)
+{
+	RING* ring = w->ring;
+	unsigned long i;
+
+	for (i = 0; i < operations; i++) {
+		void* p = w->allocator->alloc(next_size(w->dist, state));
+
+		if (p)
+			*(volatile char*) p = 1;
+		// the partner may share the core
+		while (ring->head - ring->tail >= RING_SIZE)
+			sched_yield();
+		ring->slots[ring->head % RING_SIZE] = p;
+		__sync_synchronize();
+		ring->head++;
+		w->ops++;
+	}
+}
+
+static void run_consumer(WORKER* w)
+{
+	RING* ring = w->ring;
+	unsigned long i;
+
+	for (i = 0; i < operations; i++) {
+		void* p;
+
+		while (ring->tail == ring->head)
+			sched_yield();
+		p = ring->slots[ring->tail % RING_SIZE];
+		__sync_synchronize();
+		ring->tail++;
+		if (p)
+			w->allocator->release(p);
+		w->ops++;
+	}
+}
+
+static void* worker(void* arg)
+{
+	WORKER* w = (WORKER*) arg;
+	uint64_t state = 0x9E3779B97F4A7C15ULL * (w->id + 1);
+
+	bench_pin(w->id % ncores);
+	w->ops = 0;
+
+	if (w->pattern == PATTERN_LOCAL)
+		run_local(w, &state);
+	else if (w->id % 2)
+		run_consumer(w);
+	else
+		run_producer(w, &state);
+
+	return NULL;
+}
+
+static void run(const ALLOCATOR* allocator, int dist, int pattern, unsigned int threads)
+{
+	pthread_t thread[MAX_THREADS];
+	WORKER workers[MAX_THREADS];
+	struct mem_stats before, after;
+	struct buddy_info buddy;
+	uint64_t start, end, ops = 0;
+	unsigned int i;
+	char name[64];
+
+	memset(rings, 0x00, sizeof(rings));
+	memset(&before, 0x00, sizeof(before));
+	memset(&after, 0x00, sizeof(after));
+	sys_memstat(sizeof(before), &before);
+
+	start = bench_now();
+	for (i = 0; i < threads; i++) {
+		workers[i].allocator = allocator;
+		workers[i].dist = dist;
+		workers[i].pattern = pattern;
+		workers[i].id = i;
+		workers[i].ring = rings + i / 2;
+		pthread_create(thread + i, NULL, worker, workers + i);
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+		ops += workers[i].ops;
+	}
+	end = bench_now();
+
+	sys_memstat(sizeof(after), &after);
+
+	snprintf(name, sizeof(name), "%s %s %s %u threads", allocator->name,
+		dist_names[dist], pattern_names[pattern], threads);
+	bench_value(name, "ops/s", ((double) ops * bench_ticks_per_sec()) / (double) (end - start),
+		BENCH_HIGHER);
+
+	snprintf(name, sizeof(name), "%s %s %s %u threads pages", allocator->name,
+		dist_names[dist], pattern_names[pattern], threads);
+	bench_value(name, "pages", (double) (after.allocated_pages - before.allocated_pages), BENCH_LOWER);
+
+	snprintf(name, sizeof(name), "%s %s %s %u threads heap", allocator->name,
+		dist_names[dist], pattern_names[pattern], threads);
+	bench_value(name, "pages", (double) (after.tags[MEM_TAG_HEAP].pages - before.tags[MEM_TAG_HEAP].pages),
+		BENCH_LOWER);
+
+	if ((allocator->alloc == kmalloc) && !sys_buddyinfo(sizeof(buddy), &buddy) && buddy.free_bytes) {
+		snprintf(name, sizeof(name), "%s %s %s %u threads fragmentation", allocator->name,
+			dist_names[dist], pattern_names[pattern], threads);
+		bench_value(name, "%", 100.0 * (1.0 - (double) buddy.largest_free / (double) buddy.free_bytes),
+			BENCH_LOWER);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int a, d, p, threads;
+
+	if (argc > 1)
+		operations = strtoul(argv[1], NULL, 10);
+	if (operations < 1)
+		operations = 1;
+
+	ncores = bench_cores();
+	bench_init("mallocbench");
+
+	for (a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+		for (d = 0; d < DIST_MAX; d++) {
+			for (p = 0; p < PATTERN_MAX; p++) {
+				// the remote pattern needs pairs of threads
+				for (threads = p == PATTERN_REMOTE ? 2 : 1; threads <= MAX_THREADS; threads *= 2) {
+					if (threads > ncores && threads > (p == PATTERN_REMOTE ? 2 : 1))
+						break;
+					run(allocators + a, d, p, threads);
+				}
+			}
+		}
+	}
+
+	bench_finish();
+
+	return 0;
+}
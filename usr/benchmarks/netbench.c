@@ -0,0 +1,550 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Network benchmarks beyond netio's single TCP stream:
+ *
+ *   netbench -s [-p port]                    server of all benchmarks
+ *   netbench -c host rr [size]               TCP request/response latency
+ *   netbench -c host conn                    TCP connection setup rate
+ *   netbench -c host streams threads [conns] TCP throughput of threads
+ *                                            streams, each thread serves
+ *                                            conns connections
+ *   netbench -c host udp [size]              UDP packets per second
+ *
+ * The program is plain POSIX, so that the peer is either another
+ * HermitCore isle (e.g. via mmnif) or the host, where it is built with
+ * "gcc -O2 -pthread netbench.c bench.c rdtsc.c". The network interface of HermitCore
+ * (vioif, uhyve-net or mmnif) is selected by the loader as usual.
+ *
+ * Each TCP connection starts with a CONTROL header: with CMD_ECHO, the
+ * server returns each message of data bytes; with CMD_SINK, it discards
+ * everything; with CMD_CLOSE, it closes the connection. The UDP server
+ * counts datagrams until a datagram with the first byte being non-zero
+ * arrives and returns the count in its reply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#ifndef __hermit__
+#include <time.h>
+#endif
+#include "bench.h"
+
+typedef struct
+{
+	uint32_t cmd;
+	uint32_t data;
+} CONTROL;
+
+#define CMD_ECHO	1
+#define CMD_SINK	2
+#define CMD_CLOSE	3
+
+#define DEFAULTPORT	0x4E42
+#define DURATION_NS	(5ULL * 1000000000ULL)
+#define RR_SAMPLES	10000
+#define MAXSIZE		65536
+#define UDPMAXSIZE	1472
+#define MAX_THREADS	64
+#define MAX_CONNS	1024
+
+static int nPort = DEFAULTPORT;
+static struct in_addr addr_server;
+
+#ifdef __hermit__
+extern unsigned int get_cpufreq(void);
+
+inline static unsigned long long rdtsc(void)
+{
+	unsigned long lo, hi;
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+}
+
+static uint64_t now_ns(void)
+{
+	static uint64_t freq = 0; /* in MHz */
+
+	if (!freq)
+		freq = get_cpufreq();
+
+	return (rdtsc() * 1000ULL) / freq;
+}
+#else
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static int send_all(int s, const char* buf, size_t size)
+{
+	while (size) {
+		ssize_t rc = send(s, buf, size, 0);
+
+		if (rc <= 0)
+			return -1;
+		buf += rc;
+		size -= rc;
+	}
+
+	return 0;
+}
+
+static int recv_all(int s, char* buf, size_t size)
+{
+	while (size) {
+		ssize_t rc = recv(s, buf, size, 0);
+
+		if (rc <= 0)
+			return -1;
+		buf += rc;
+		size -= rc;
+	}
+
+	return 0;
+}
+
+static int tcp_connect(uint32_t cmd, uint32_t data)
+{
+	struct sockaddr_in sa;
+	CONTROL ctl;
+	int s, one = 1;
+
+	if ((s = socket(PF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*) &one, sizeof(one));
+
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(nPort);
+	sa.sin_addr = addr_server;
+
+	if (connect(s, (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+		close(s);
+		return -1;
+	}
+
+	ctl.cmd = htonl(cmd);
+	ctl.data = htonl(data);
+	if (send_all(s, (char*) &ctl, sizeof(ctl))) {
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+/* server side of a TCP connection */
+static void* tcp_handler(void* arg)
+{
+	int s = (int) (intptr_t) arg;
+	char* buf = malloc(MAXSIZE);
+	CONTROL ctl;
+	size_t size;
+	int one = 1;
+
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*) &one, sizeof(one));
+
+	if (!buf || recv_all(s, (char*) &ctl, sizeof(ctl)))
+		goto out;
+
+	size = ntohl(ctl.data);
+	if (size > MAXSIZE)
+		size = MAXSIZE;
+
+	switch (ntohl(ctl.cmd)) {
+	case CMD_ECHO:
+		while (!recv_all(s, buf, size) && !send_all(s, buf, size))
+			;
+		break;
+	case CMD_SINK:
+		while (recv(s, buf, MAXSIZE, 0) > 0)
+			;
+		break;
+	default:
+		break;
+	}
+
+out:
+	close(s);
+	free(buf);
+
+	return NULL;
+}
+
+static void* udp_server(void* arg)
+{
+	char buf[UDPMAXSIZE];
+	struct sockaddr_in sa, peer;
+	socklen_t len;
+	uint64_t count = 0;
+	int s;
+
+	if ((s = socket(PF_INET, SOCK_DGRAM, 0)) < 0) {
+		printf("UDP socket failed: %d\n", errno);
+		return NULL;
+	}
+
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(nPort);
+	sa.sin_addr.s_addr = INADDR_ANY;
+	if (bind(s, (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+		printf("UDP bind failed: %d\n", errno);
+		close(s);
+		return NULL;
+	}
+
+	while (1) {
+		ssize_t rc;
+
+		len = sizeof(peer);
+		rc = recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr*) &peer, &len);
+		if (rc <= 0)
+			continue;
+
+		if (!buf[0]) {
+			count++;
+			continue;
+		}
+
+		// final datagram => report the count and start again
+		memcpy(buf, &count, sizeof(count));
+		sendto(s, buf, sizeof(count), 0, (struct sockaddr*) &peer, len);
+		count = 0;
+	}
+
+	return NULL;
+}
+
+static int server(void)
+{
+	struct sockaddr_in sa;
+	pthread_t thread;
+	int s, one = 1;
+
+	if (pthread_create(&thread, NULL, udp_server, NULL))
+		printf("Unable to start the UDP server\n");
+
+	if ((s = socket(PF_INET, SOCK_STREAM, 0)) < 0) {
+		printf("socket failed: %d\n", errno);
+		return -1;
+	}
+
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char*) &one, sizeof(one));
+
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(nPort);
+	sa.sin_addr.s_addr = INADDR_ANY;
+
+	if (bind(s, (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+		printf("bind failed: %d\n", errno);
+		close(s);
+		return -1;
+	}
+
+	if (listen(s, 128) < 0) {
+		printf("listen failed: %d\n", errno);
+		close(s);
+		return -1;
+	}
+
+	printf("netbench server on port %d\n", nPort);
+
+	while (1) {
+		int client = accept(s, NULL, NULL);
+
+		if (client < 0)
+			continue;
+
+		if (pthread_create(&thread, NULL, tcp_handler, (void*) (intptr_t) client)) {
+			close(client);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	return 0;
+}
+
+static int bench_rr(size_t size)
+{
+	uint64_t* samples = malloc(RR_SAMPLES * sizeof(uint64_t));
+	char* buf = malloc(size);
+	char name[64];
+	int i, s, err = -1;
+
+	if (!samples || !buf || (s = tcp_connect(CMD_ECHO, size)) < 0) {
+		fprintf(stderr, "rr: unable to connect\n");
+		goto out;
+	}
+
+	memset(buf, 0x00, size);
+	for (i = -100; i < RR_SAMPLES; i++) {
+		uint64_t start = now_ns();
+
+		if (send_all(s, buf, size) || recv_all(s, buf, size)) {
+			fprintf(stderr, "rr: connection lost\n");
+			close(s);
+			goto out;
+		}
+
+		if (i >= 0)
+			samples[i] = now_ns() - start;
+	}
+	close(s);
+
+	snprintf(name, sizeof(name), "TCP rr %zu bytes", size);
+	bench_samples(name, "ns", samples, RR_SAMPLES);
+	err = 0;
+
+out:
+	free(samples);
+	free(buf);
+
+	return err;
+}
+
+static int bench_conn(void)
+{
+	uint64_t start = now_ns(), end;
+	uint64_t count = 0;
+	char c;
+
+	do {
+		int s = tcp_connect(CMD_CLOSE, 0);
+
+		if (s < 0) {
+			fprintf(stderr, "conn: connect failed after %llu connections\n", (unsigned long long) count);
+			return -1;
+		}
+
+		// wait for the close of the server
+		recv(s, &c, 1, 0);
+		close(s);
+		count++;
+		end = now_ns();
+	} while (end - start < DURATION_NS);
+
+	bench_value("TCP connection setup", "connections/s",
+		((double) count * 1e9) / (double) (end - start), BENCH_HIGHER);
+
+	return 0;
+}
+
+typedef struct
+{
+	int conns;
+	uint64_t bytes;
+	int err;
+} STREAM;
+
+static void* stream_thread(void* arg)
+{
+	STREAM* st = (STREAM*) arg;
+	int s[MAX_CONNS];
+	char* buf = malloc(MAXSIZE);
+	uint64_t start;
+	int i;
+
+	st->bytes = 0;
+	st->err = -1;
+	if (!buf)
+		return NULL;
+
+	memset(buf, 0x00, MAXSIZE);
+	for (i = 0; i < st->conns; i++) {
+		if ((s[i] = tcp_connect(CMD_SINK, 0)) < 0) {
+			while (i--)
+				close(s[i]);
+			free(buf);
+			return NULL;
+		}
+	}
+
+	// serve the connections of the thread round robin
+	start = now_ns();
+	for (i = 0; now_ns() - start < DURATION_NS; i = (i + 1) % st->conns) {
+		if (send_all(s[i], buf, MAXSIZE))
+			break;
+		st->bytes += MAXSIZE;
+	}
+
+	for (i = 0; i < st->conns; i++)
+		close(s[i]);
+	free(buf);
+	st->err = 0;
+
+	return NULL;
+}
+
+static int bench_streams(int threads, int conns)
+{
+	pthread_t thread[MAX_THREADS];
+	STREAM st[MAX_THREADS];
+	uint64_t start, end, bytes = 0;
+	char name[64];
+	int i;
+
+	if (threads < 1 || threads > MAX_THREADS || conns < 1 || conns > MAX_CONNS) {
+		fprintf(stderr, "streams: at most %d threads with %d connections\n", MAX_THREADS, MAX_CONNS);
+		return -1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < threads; i++) {
+		st[i].conns = conns;
+		pthread_create(thread + i, NULL, stream_thread, st + i);
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+		if (st[i].err)
+			fprintf(stderr, "streams: thread %d failed\n", i);
+		bytes += st[i].bytes;
+	}
+	end = now_ns();
+
+	snprintf(name, sizeof(name), "TCP %d threads x %d connections", threads, conns);
+	bench_value(name, "MBytes/s", ((double) bytes * 1e9) / ((double) (end - start) * 1024.0 * 1024.0),
+		BENCH_HIGHER);
+
+	return 0;
+}
+
+static int bench_udp(size_t size)
+{
+	char buf[UDPMAXSIZE];
+	struct sockaddr_in sa;
+	struct timeval tv;
+	uint64_t start, end, sent = 0, received = 0;
+	char name[64];
+	int s, i;
+
+	if (size < sizeof(uint64_t) || size > UDPMAXSIZE)
+		size = UDPMAXSIZE;
+
+	if ((s = socket(PF_INET, SOCK_DGRAM, 0)) < 0) {
+		fprintf(stderr, "udp: socket failed: %d\n", errno);
+		return -1;
+	}
+
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(nPort);
+	sa.sin_addr = addr_server;
+
+	memset(buf, 0x00, sizeof(buf));
+	start = now_ns();
+	do {
+		if (sendto(s, buf, size, 0, (struct sockaddr*) &sa, sizeof(sa)) > 0)
+			sent++;
+		end = now_ns();
+	} while (end - start < DURATION_NS);
+
+	// the final datagram may get lost, too
+	tv.tv_sec = 1;
+	tv.tv_usec = 0;
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (char*) &tv, sizeof(tv));
+	for (i = 0; i < 5; i++) {
+		buf[0] = 1;
+		sendto(s, buf, size, 0, (struct sockaddr*) &sa, sizeof(sa));
+		if (recv(s, buf, sizeof(buf), 0) >= (ssize_t) sizeof(received)) {
+			memcpy(&received, buf, sizeof(received));
+			break;
+		}
+	}
+	close(s);
+
+	snprintf(name, sizeof(name), "UDP %zu bytes Tx", size);
+	bench_value(name, "packets/s", ((double) sent * 1e9) / (double) (end - start), BENCH_HIGHER);
+	snprintf(name, sizeof(name), "UDP %zu bytes Rx", size);
+	bench_value(name, "packets/s", ((double) received * 1e9) / (double) (end - start), BENCH_HIGHER);
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("usage: netbench -s [-p port]\n");
+	printf("       netbench [-p port] -c host rr [size] | conn | streams threads [conns] | udp [size]\n");
+}
+
+int main(int argc, char** argv)
+{
+	int i = 1, err = 1;
+
+	if (i + 1 < argc && !strcmp(argv[i], "-p")) {
+		nPort = atoi(argv[i + 1]);
+		i += 2;
+	}
+
+	if (i < argc && !strcmp(argv[i], "-s"))
+		return server();
+
+	if (i + 2 >= argc || strcmp(argv[i], "-c")) {
+		usage();
+		return 1;
+	}
+
+	addr_server.s_addr = inet_addr(argv[i + 1]);
+	i += 2;
+
+	bench_init("netbench");
+	if (!strcmp(argv[i], "rr"))
+		err = bench_rr(i + 1 < argc ? atoi(argv[i + 1]) : 1);
+	else if (!strcmp(argv[i], "conn"))
+		err = bench_conn();
+	else if (!strcmp(argv[i], "streams") && i + 1 < argc)
+		err = bench_streams(atoi(argv[i + 1]), i + 2 < argc ? atoi(argv[i + 2]) : 1);
+	else if (!strcmp(argv[i], "udp"))
+		err = bench_udp(i + 1 < argc ? atoi(argv[i + 1]) : 64);
+	else
+		usage();
+	bench_finish();
+
+	return err;
+}
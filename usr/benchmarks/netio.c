@@ -47,10 +47,27 @@
 
 /* See http://www.nwlab.net/art/netio/netio.html to get the netio tool */
 
+/*
+ * The servers run until they are stopped and only log their transfers, the
+ * throughput is reported by the netio client on the other side. The client
+ * modes report their results through the harness of bench.h, the progress
+ * messages go to stderr.
+ */
+
+/*
+ * In addition, a UDP batch mode measures sys_sendmmsg/sys_recvmmsg. The client
+ * sends datagrams with the first byte being zero in batches of UDP_BATCH
+ * datagrams for 6 seconds and then one final datagram with the first byte
+ * being non-zero. The server receives the datagrams in batches and reports
+ * the number of datagrams and bytes.
+ */
+
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <netdb.h>
+#include <hermit/syscall.h>
+#include "bench.h"
 
 typedef struct
 {
@@ -70,17 +87,38 @@ typedef struct
 static int tSizes[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32767};
 static size_t ntSizes = sizeof(tSizes) / sizeof(int);
 static int nPort = DEFAULTPORT;
+
+/* datagram sizes of the UDP batch mode (1472 bytes fill an Ethernet frame) */
+static int uSizes[] = {16, 64, 256, 512, 1024, 1472};
+static size_t nuSizes = sizeof(uSizes) / sizeof(int);
+
+#define UDP_BATCH 32
+#define UDPMAXSIZE 1472
+
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0x10000
+#endif
+
+/* message header of sys_sendmmsg/sys_recvmmsg */
+typedef struct
+{
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+} MMSG;
 static const int sobufsize = 131072;
 static struct in_addr addr_local;
 static struct in_addr addr_server;
 
-extern unsigned int get_cpufreq(void);
+/* duration of a transfer in nanoseconds */
+static uint64_t ticks_to_ns(uint64_t ticks)
+{
+	return (uint64_t) (((double) ticks * 1000000000.0) / (double) bench_ticks_per_sec());
+}
 
-inline static unsigned long long rdtsc(void)
+/* throughput in MiB/s */
+static double mbytes_per_sec(uint64_t bytes, uint64_t ticks)
 {
-	unsigned long lo, hi;
-	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
-	return ((unsigned long long) hi << 32ULL | (unsigned long long) lo);
+	return ((double) bytes / (1024.0 * 1024.0)) * (double) bench_ticks_per_sec() / (double) ticks;
 }
 
 static int send_data(int socket, void *buffer, size_t size, int flags)
@@ -150,7 +188,7 @@ static int TCPServer(void)
 	int nByte;
 	int err;
 	uint64_t start, end;
-	uint32_t freq = get_cpufreq(); /* in MHz */
+	const uint64_t six_sec = 6ULL * bench_ticks_per_sec();
 
 	if ((cBuffer = InitBuffer(TMAXSIZE)) == NULL) {
     		printf("Netio: Not enough memory\n");
@@ -226,7 +264,7 @@ static int TCPServer(void)
 
 			if (ctl.cmd == CMD_C2S)
 			{
-				start = rdtsc();
+				start = bench_now();
 
 				printf("\nReceiving from client, packet size %s ... \n", PacketSize(ctl.data));
 				cBuffer[0] = 0;
@@ -250,10 +288,10 @@ static int TCPServer(void)
 					nData += ctl.data;
 				} while (cBuffer[0] == 0 && rc > 0);
 
-				end = rdtsc();
-				printf("Time to receive %llu bytes: %llu nsec (ticks %llu)\n", nData, ((end-start)*1000ULL)/freq, end-start);
+				end = bench_now();
+				printf("Time to receive %llu bytes: %llu nsec (ticks %llu)\n", nData, ticks_to_ns(end-start), end-start);
 			} else if (ctl.cmd == CMD_S2C) {
-				start = rdtsc();
+				start = bench_now();
 
 				printf("\nSending to client, packet size %s ... \n", PacketSize(ctl.data));
 				cBuffer[0] = 0;
@@ -278,16 +316,16 @@ static int TCPServer(void)
 					}
 
 					nData += ctl.data;
-					end = rdtsc();
-				} while((end-start)/freq < 6000000ULL /* = 6s */);
+					end = bench_now();
+				} while(end-start < six_sec);
 
 				cBuffer[0] = 1;
 
 				if (send_data(client, cBuffer, ctl.data, 0))
 					break;
 
-				end = rdtsc();
-				printf("Time to send %llu bytes: %llu nsec (ticks %llu)\n", nData, ((end-start)*1000ULL)/freq, end-start);
+				end = bench_now();
+				printf("Time to send %llu bytes: %llu nsec (ticks %llu)\n", nData, ticks_to_ns(end-start), end-start);
 			} else /* quit */
 				break;
 		}
@@ -317,17 +355,17 @@ int TCP_Bench(void)
 	int rc, err;
 	int nByte;
 	uint64_t start, end;
-	uint32_t freq = get_cpufreq(); /* in MHz */
+	const uint64_t six_sec = 6ULL * bench_ticks_per_sec();
 
 	if ((cBuffer = InitBuffer(TMAXSIZE)) == NULL)
 	{
-		printf("Netio: Not enough memory\n");
+		fprintf(stderr, "Netio: Not enough memory\n");
 		return -1;
 	}
 
 	if ((server = socket(PF_INET, SOCK_STREAM, 0)) < 0)
 	{
-		printf("socket failed: %d\n", errno);
+		fprintf(stderr, "socket failed: %d\n", errno);
 		free(cBuffer);
 		return -2;
 	}
@@ -341,17 +379,18 @@ int TCP_Bench(void)
 
 	if ((err = connect(server, (struct sockaddr *) &sa_server, sizeof(sa_server))) < 0)
 	{
-		printf("connect failed: %d\n", errno);
+		fprintf(stderr, "connect failed: %d\n", errno);
 		close(server);
 		free(cBuffer);
 		return -2;
 	}
 
-	printf("\nTCP connection established.\n");
+	fprintf(stderr, "TCP connection established.\n");
+	bench_init("netio-tcp");
 
 	for (i = 0; i < ntSizes; i++)
 	{
-		printf("Packet size %s bytes: ", PacketSize(tSizes[i]));
+		char name[64];
 
 		/* tell the server we will send it data now */
 
@@ -363,7 +402,7 @@ int TCP_Bench(void)
 
 		/* 1 - Tx test */
 
-		start = rdtsc();
+		start = bench_now();
 		nData = 0;
 		cBuffer[0] = 0;
 
@@ -377,7 +416,7 @@ int TCP_Bench(void)
 
 				if (rc < 0)
 				{
-					printf("send failed: %d\n", errno);
+					fprintf(stderr, "send failed: %d\n", errno);
 					return -1;
 				}
 
@@ -386,12 +425,11 @@ int TCP_Bench(void)
 			}
 
 			nData += tSizes[i];
-			end = rdtsc();
-		} while((end-start)/freq < 6000000ULL /* = 6s */);
+			end = bench_now();
+		} while(end-start < six_sec);
 
-		printf("%llu/100 MBytes/s", ((100ULL*nData)/(1024ULL*1024ULL))/((end-start)/(1000000ULL*freq)));
-
-		printf(" Tx, ");
+		snprintf(name, sizeof(name), "tcp tx %d bytes", tSizes[i]);
+		bench_value(name, "MiB/s", mbytes_per_sec(nData, end-start), BENCH_HIGHER);
 
 		cBuffer[0] = 1;
 
@@ -408,7 +446,7 @@ int TCP_Bench(void)
 
 		/* 2 - Rx test */
 
-		start = rdtsc();
+		start = bench_now();
 		nData = 0;
 		cBuffer[0] = 0;
 		rc = 0;
@@ -421,7 +459,7 @@ int TCP_Bench(void)
 
 				if (rc < 0)
 				{
-					printf("recv failed: %d\n", errno);
+					fprintf(stderr, "recv failed: %d\n", errno);
 					return -1;
 				}
 
@@ -432,10 +470,9 @@ int TCP_Bench(void)
 			nData += tSizes[i];
 		} while (cBuffer[0] == 0 && rc > 0);
 
-		end = rdtsc();
-		printf("%llu/100 MBytes/s", ((100ULL*nData)/(1024ULL*1024ULL))/((end-start)/(1000000ULL*freq)));
-
-		printf(" Rx.\n");
+		end = bench_now();
+		snprintf(name, sizeof(name), "tcp rx %d bytes", tSizes[i]);
+		bench_value(name, "MiB/s", mbytes_per_sec(nData, end-start), BENCH_HIGHER);
 	}
 
 	ctl.cmd = htonl(CMD_QUIT);
@@ -443,7 +480,195 @@ int TCP_Bench(void)
 
 	send_data(server, (void *) &ctl, CTLSIZE, 0);
 
-	printf("Done.\n");
+	bench_finish();
+
+	close(server);
+	free(cBuffer);
+
+	return 0;
+}
+
+static void InitBatch(MMSG *msgs, struct iovec *iov, char *cBuffer, size_t nSize, struct sockaddr_in *sa)
+{
+	int i;
+
+	memset(msgs, 0x00, UDP_BATCH * sizeof(MMSG));
+
+	for (i = 0; i < UDP_BATCH; i++)
+	{
+		iov[i].iov_base = cBuffer + i * UDPMAXSIZE;
+		iov[i].iov_len = nSize;
+		msgs[i].msg_hdr.msg_iov = iov + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = sa;
+		msgs[i].msg_hdr.msg_namelen = sa ? sizeof(*sa) : 0;
+	}
+}
+
+static int UDPServer(void)
+{
+	char *cBuffer;
+	MMSG msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	struct sockaddr_in sa_server;
+	uint64_t nData, nPackets, nCalls;
+	int server;
+	int i, rc, done;
+	uint64_t start, end;
+
+	if ((cBuffer = InitBuffer(UDP_BATCH * UDPMAXSIZE)) == NULL) {
+		printf("Netio: Not enough memory\n");
+		return -1;
+	}
+
+	if ((server = socket(PF_INET, SOCK_DGRAM, 0)) < 0) {
+		printf("socket failed: %d\n", server);
+		free(cBuffer);
+		return -1;
+	}
+
+	setsockopt(server, SOL_SOCKET, SO_RCVBUF, (char *) &sobufsize, sizeof(sobufsize));
+
+	memset((char *) &sa_server, 0x00, sizeof(sa_server));
+	sa_server.sin_family = AF_INET;
+	sa_server.sin_port = htons(nPort);
+	sa_server.sin_addr = addr_local;
+
+	if (bind(server, (struct sockaddr *) &sa_server, sizeof(sa_server)) < 0)
+	{
+		printf("bind failed: %d\n", errno);
+		close(server);
+		free(cBuffer);
+		return -1;
+	}
+
+	for (;;)
+	{
+		printf("UDP server waiting for datagrams, batch size %d.\n", UDP_BATCH);
+
+		nData = nPackets = nCalls = 0;
+		done = 0;
+		start = 0;
+
+		do
+		{
+			InitBatch(msgs, iov, cBuffer, UDPMAXSIZE, NULL);
+
+			rc = sys_recvmmsg(server, msgs, UDP_BATCH, MSG_WAITFORONE);
+			if (rc < 0)
+			{
+				printf("recvmmsg failed: %d\n", rc);
+				break;
+			}
+
+			if (!start)
+				start = bench_now();
+			nCalls++;
+
+			for (i = 0; i < rc; i++)
+			{
+				if (((char *) iov[i].iov_base)[0] != 0)
+					done = 1;
+				nData += msgs[i].msg_len;
+			}
+			nPackets += rc;
+		} while (!done);
+
+		if (rc < 0)
+			break;
+
+		end = bench_now();
+		printf("Received %llu datagrams (%llu bytes) with %llu calls: %llu nsec (ticks %llu)\n",
+			nPackets, nData, nCalls, ticks_to_ns(end-start), end-start);
+	}
+
+	close(server);
+	free(cBuffer);
+
+	return 0;
+}
+
+int UDP_Bench(void)
+{
+	char *cBuffer;
+	MMSG msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	struct sockaddr_in sa_server;
+	uint64_t nData, nPackets;
+	size_t i;
+	int server;
+	int rc;
+	uint64_t start, end;
+	const uint64_t six_sec = 6ULL * bench_ticks_per_sec();
+
+	if ((cBuffer = InitBuffer(UDP_BATCH * UDPMAXSIZE)) == NULL)
+	{
+		fprintf(stderr, "Netio: Not enough memory\n");
+		return -1;
+	}
+
+	if ((server = socket(PF_INET, SOCK_DGRAM, 0)) < 0)
+	{
+		fprintf(stderr, "socket failed: %d\n", errno);
+		free(cBuffer);
+		return -2;
+	}
+
+	setsockopt(server, SOL_SOCKET, SO_SNDBUF, (char *) &sobufsize, sizeof(sobufsize));
+
+	memset((char *) &sa_server, 0x00, sizeof(sa_server));
+	sa_server.sin_family = AF_INET;
+	sa_server.sin_port = htons(nPort);
+	sa_server.sin_addr = addr_server;
+
+	fprintf(stderr, "UDP batch mode, batch size %d.\n", UDP_BATCH);
+	bench_init("netio-udp");
+
+	for (i = 0; i < nuSizes; i++)
+	{
+		char name[64];
+
+		InitBatch(msgs, iov, cBuffer, uSizes[i], &sa_server);
+		memset(cBuffer, 0x00, UDP_BATCH * UDPMAXSIZE);
+
+		start = bench_now();
+		nData = nPackets = 0;
+
+		do
+		{
+			rc = sys_sendmmsg(server, msgs, UDP_BATCH, 0);
+
+			if (rc < 0)
+			{
+				// the send buffers are full => try it again
+				if (rc == -ENOMEM || rc == -ENOBUFS)
+					continue;
+				fprintf(stderr, "sendmmsg failed: %d\n", rc);
+				close(server);
+				free(cBuffer);
+				return -1;
+			}
+
+			nPackets += rc;
+			nData += (uint64_t) rc * uSizes[i];
+			end = bench_now();
+		} while(end-start < six_sec);
+
+		snprintf(name, sizeof(name), "udp tx %d bytes datagrams", uSizes[i]);
+		bench_value(name, "1/s", (double) nPackets * (double) bench_ticks_per_sec() / (double) (end-start), BENCH_HIGHER);
+		snprintf(name, sizeof(name), "udp tx %d bytes", uSizes[i]);
+		bench_value(name, "MiB/s", mbytes_per_sec(nData, end-start), BENCH_HIGHER);
+
+		/* final datagram */
+		cBuffer[0] = 1;
+		rc = sys_sendmmsg(server, msgs, 1, 0);
+		if (rc < 0)
+			fprintf(stderr, "sendmmsg failed: %d\n", rc);
+
+		sleep(1);
+	}
+
+	bench_finish();
 
 	close(server);
 	free(cBuffer);
@@ -459,7 +684,12 @@ int main(int argc, char** argv)
 	//addr_server.s_addr = inet_addr("192.168.28.254");
 	addr_server.s_addr = inet_addr("192.168.28.1");
 
-	err = TCPServer();
+	if (argc > 1 && !strcmp(argv[1], "-u"))
+		err = UDPServer();
+	else if (argc > 1 && !strcmp(argv[1], "-U"))
+		err = UDP_Bench();
+	else
+		err = TCPServer();
 
 	return err;
 }
@@ -17,6 +17,7 @@
  */
 
 #include "report.h"
+#include "bench.h"
 #include "hist.h"
 
 #include <stdio.h>
@@ -24,6 +25,9 @@
 
 int report_params(const struct opt *opt)
 {
+    if (!bench_text())
+        return 0;
+
     printf("init: tps = %llu\n", (unsigned long long)opt->tps);
     printf("secs      : %u\n", opt->secs);
     printf("threshold : %llu\n", (unsigned long long)opt->threshold);
@@ -35,18 +39,20 @@ int report_params(const struct opt *opt)
     return 0;
 }
 
+/* the loops of the extremes are details besides the results of bench.h */
 static int report_stat(const struct result *result)
 {
-    printf("   # loops  : %15llu\n",
-            (unsigned long long)result->cnt);
-    printf("   Min.     : %15llu     (@loop #%llu)\n",
-            (unsigned long long)result->min,
-            (unsigned long long)result->t_min);
-    printf("   Avg.     : %18.2lf\n",
-            (double)result->sum/(double)result->cnt);
-    printf("   Max.     : %15llu     (@loop #%llu)\n",
-            (unsigned long long)result->max,
-            (unsigned long long)result->t_max);
+    bench_value("loops", "loops", (double)result->cnt, BENCH_HIGHER);
+    bench_value("gap min", "cycles", (double)result->min, BENCH_LOWER);
+    bench_value("gap mean", "cycles",
+            result->cnt ? (double)result->sum/(double)result->cnt : 0.0, BENCH_LOWER);
+    bench_value("gap max", "cycles", (double)result->max, BENCH_LOWER);
+
+    if (bench_text()) {
+        printf("   Min. @loop #%llu, Max. @loop #%llu\n",
+                (unsigned long long)result->t_min,
+                (unsigned long long)result->t_max);
+    }
     return 0;
 }
 
@@ -57,10 +63,13 @@ int report(const struct opt *opt, const struct result *result)
      * depending on opt
      */
 
-    printf("Dummy result: %llu \n", (unsigned long long)result->dummy);
-
     report_stat(result);
 
+    if (!bench_text())
+        return 0;
+
+    printf("Dummy result: %llu \n", (unsigned long long)result->dummy);
+
     if (opt->mode == hist) {
         hist_print();
     } else if (opt->mode == list) {
@@ -46,6 +46,14 @@
 # include <float.h>
 # include <limits.h>
 # include <sys/time.h>
+# include <string.h>
+# include <stdlib.h>
+# include <stdint.h>
+# include <hermit/hbwmalloc.h>
+#ifdef __x86_64__
+# include <cpuid.h>
+# include <emmintrin.h>
+#endif
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -176,9 +184,37 @@
 #define STREAM_TYPE double
 #endif
 
-static STREAM_TYPE	a[STREAM_ARRAY_SIZE+OFFSET],
-			b[STREAM_ARRAY_SIZE+OFFSET],
-			c[STREAM_ARRAY_SIZE+OFFSET];
+static STREAM_TYPE	a_main[STREAM_ARRAY_SIZE+OFFSET],
+			b_main[STREAM_ARRAY_SIZE+OFFSET],
+			c_main[STREAM_ARRAY_SIZE+OFFSET];
+
+/*
+ * HermitCore extensions, which probe the memory subsystem:
+ *   --hbw             arrays in the high bandwidth memory
+ *   --pages=4k|2m|1g  arrays in an anonymous mapping with this page size
+ *   --prefault        map the pages at the allocation (MAP_POPULATE)
+ *                     instead of the first touch by the initialization
+ *   --node=N          place the arrays on NUMA node N: the pages are taken
+ *                     from the node of the core, which maps them
+ *   --nt              non-temporal stores in the kernels
+ *   --all             run all available configurations and summarize them
+ * Without any option, the static arrays of the original code are used.
+ */
+enum { BACKING_STATIC, BACKING_4K, BACKING_2M, BACKING_1G, BACKING_HBW };
+
+static const char *backing_name[] = { "static", "4k", "2m", "1g", "hbw" };
+
+typedef struct {
+    int	backing;
+    int	prefault;
+    int	node;		/* -1 = no binding */
+    int	nt;
+    double	rate[4];	/* best rate in MB/s */
+} stream_config_t;
+
+#define MAX_CONFIGS	256
+
+static STREAM_TYPE	*a = a_main, *b = b_main, *c = c_main;
 
 static double	avgtime[4] = {0}, maxtime[4] = {0},
 		mintime[4] = {FLT_MAX,FLT_MAX,FLT_MAX,FLT_MAX};
@@ -204,82 +240,277 @@ extern void tuned_STREAM_Triad(STREAM_TYPE scalar);
 #ifdef _OPENMP
 extern int omp_get_num_threads();
 #endif
-int
-main()
-    {
-    int			quantum, checktick();
-    int			BytesPerWord;
-    int			k;
-    ssize_t		j;
-    STREAM_TYPE		scalar;
-    double		t, times[4][NTIMES];
 
-    /* --- SETUP --- determine precision and check timing --- */
+/* system calls and NUMA topology of the kernel, which shares the address space */
+extern int sys_mmap(void** addr, size_t len, int prot, int flags);
+extern int sys_munmap(void* addr, size_t len);
+extern int sys_sched_setaffinity(unsigned int* id, size_t size, const void* mask);
+extern int sys_sched_getaffinity(unsigned int* id, size_t size, void* mask);
+#ifdef __x86_64__
+extern unsigned int numa_nodes(void);
+extern unsigned int numa_core_node(unsigned int core_id);
+#endif
+
+#define STREAM_PROT			0x3		/* PROT_READ|PROT_WRITE */
+#define STREAM_MAP			0x22		/* MAP_PRIVATE|MAP_ANONYMOUS */
+#define STREAM_MAP_POPULATE		0x8000
+#define STREAM_MAP_HUGETLB		0x40000
+#define STREAM_MAP_HUGE_2MB		(21 << 26)
+#define STREAM_MAP_HUGE_1GB		(30 << 26)
 
-    printf(HLINE);
-    printf("STREAM version $Revision: 5.10 $\n");
-    printf(HLINE);
-    BytesPerWord = sizeof(STREAM_TYPE);
-    printf("This system uses %d bytes per array element.\n",
-	BytesPerWord);
+#define AFFINITY_WORDS	8
 
-    printf(HLINE);
-#ifdef N
-    printf("*****  WARNING: ******\n");
-    printf("      It appears that you set the preprocessor variable N when compiling this code.\n");
-    printf("      This version of the code uses the preprocesor variable STREAM_ARRAY_SIZE to control the array size\n");
-    printf("      Reverting to default value of STREAM_ARRAY_SIZE=%llu\n",(unsigned long long) STREAM_ARRAY_SIZE);
-    printf("*****  WARNING: ******\n");
+static uint64_t	affinity[AFFINITY_WORDS];
+static void	*mapping = NULL;
+static size_t	mapping_size = 0;
+
+static int has_1g_pages(void)
+{
+#ifdef __x86_64__
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000001)
+	return 0;
+    __cpuid(0x80000001, eax, ebx, ecx, edx);
+    return (edx >> 26) & 1;
+#else
+    return 0;
 #endif
+}
 
-    printf("Array size = %llu (elements), Offset = %d (elements)\n" , (unsigned long long) STREAM_ARRAY_SIZE, OFFSET);
-    printf("Memory per array = %.1f MiB (= %.1f GiB).\n", 
-	BytesPerWord * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.0),
-	BytesPerWord * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.0/1024.0));
-    printf("Total memory required = %.1f MiB (= %.1f GiB).\n",
-	(3.0 * BytesPerWord) * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.),
-	(3.0 * BytesPerWord) * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024./1024.));
-    printf("Each kernel will be executed %d times.\n", NTIMES);
-    printf(" The *best* time for each kernel (excluding the first iteration)\n"); 
-    printf(" will be used to compute the reported bandwidth.\n");
+static unsigned int stream_nodes(void)
+{
+#ifdef __x86_64__
+    return numa_nodes();
+#else
+    return 1;
+#endif
+}
 
-#ifdef _OPENMP
-    printf(HLINE);
-#pragma omp parallel 
-    {
-#pragma omp master
-	{
-	    k = omp_get_num_threads();
-	    printf ("Number of Threads requested = %i\n",k);
-        }
+/* Moves the calling thread to the first allowed core of node. */
+static int stream_bind(int node)
+{
+#ifdef __x86_64__
+    uint64_t mask[AFFINITY_WORDS];
+    unsigned int core;
+
+    memset(affinity, 0x00, sizeof(affinity));
+    if (sys_sched_getaffinity(NULL, sizeof(affinity), affinity))
+	return -1;
+
+    for (core = 0; core < 64 * AFFINITY_WORDS; core++) {
+	if (!(affinity[core / 64] & (1ULL << (core % 64))))
+	    continue;
+	if (numa_core_node(core) != (unsigned int) node)
+	    continue;
+
+	memset(mask, 0x00, sizeof(mask));
+	mask[core / 64] = 1ULL << (core % 64);
+	return sys_sched_setaffinity(NULL, sizeof(mask), mask) ? -1 : 0;
     }
 #endif
+    return -1;
+}
 
-#ifdef _OPENMP
-	k = 0;
+static void stream_unbind(void)
+{
+    sys_sched_setaffinity(NULL, sizeof(affinity), affinity);
+}
+
+static void stream_config_name(const stream_config_t *cfg, char *buf, size_t len)
+{
+    char node[16] = "";
+
+    if (cfg->node >= 0)
+	snprintf(node, sizeof(node), " node=%d", cfg->node);
+    snprintf(buf, len, "%s %s%s %s", backing_name[cfg->backing],
+	(cfg->prefault || cfg->backing == BACKING_HBW) ? "prefault" : "first-touch",
+	node, cfg->nt ? "nt" : "regular");
+}
+
+/* Places the arrays, the caller is already bound to the node of cfg. */
+static int stream_alloc(const stream_config_t *cfg)
+{
+    const size_t size = sizeof(STREAM_TYPE) * (STREAM_ARRAY_SIZE+OFFSET);
+    size_t page, stride;
+    int flags = STREAM_MAP;
+    void *p;
+
+    if (cfg->backing == BACKING_STATIC) {
+	a = a_main; b = b_main; c = c_main;
+	return 0;
+    }
+
+    if (cfg->backing == BACKING_HBW) {
+	void *ha, *hb, *hc;
+
+	if (hbw_posix_memalign(&ha, 2 << 20, size))
+	    return -1;
+	if (hbw_posix_memalign(&hb, 2 << 20, size)) {
+	    hbw_free(ha);
+	    return -1;
+	}
+	if (hbw_posix_memalign(&hc, 2 << 20, size)) {
+	    hbw_free(ha);
+	    hbw_free(hb);
+	    return -1;
+	}
+	a = ha; b = hb; c = hc;
+	return 0;
+    }
+
+    switch (cfg->backing) {
+    case BACKING_2M:
+	page = 2UL << 20;
+	flags |= STREAM_MAP_HUGETLB|STREAM_MAP_HUGE_2MB;
+	break;
+    case BACKING_1G:
+	page = 1UL << 30;
+	flags |= STREAM_MAP_HUGETLB|STREAM_MAP_HUGE_1GB;
+	break;
+    default:
+	page = 4096;
+	break;
+    }
+    if (cfg->prefault)
+	flags |= STREAM_MAP_POPULATE;
+
+    /* one mapping for all arrays, 1 GiB pages would be wasted otherwise */
+    stride = (size + 4095) & ~4095UL;
+    mapping_size = (3 * stride + page - 1) & ~(page - 1);
+    if (sys_mmap(&p, mapping_size, STREAM_PROT, flags))
+	return -1;
+
+    mapping = p;
+    a = p;
+    b = (STREAM_TYPE *) ((char *) p + stride);
+    c = (STREAM_TYPE *) ((char *) p + 2 * stride);
+    return 0;
+}
+
+static void stream_free(const stream_config_t *cfg)
+{
+    if (cfg->backing == BACKING_HBW) {
+	hbw_free(a);
+	hbw_free(b);
+	hbw_free(c);
+    } else if (mapping) {
+	sys_munmap(mapping, mapping_size);
+	mapping = NULL;
+    }
+    a = a_main; b = b_main; c = c_main;
+}
+
+#ifdef __x86_64__
+/* Stores without reading the line first and without polluting the caches. */
+static inline void stream_store_nt(STREAM_TYPE *p, STREAM_TYPE v)
+{
+    if (sizeof(STREAM_TYPE) == 8) {
+	long long i;
+	memcpy(&i, &v, sizeof(i));
+	_mm_stream_si64((long long *) p, i);
+    } else {
+	int i;
+	memcpy(&i, &v, sizeof(i));
+	_mm_stream_si32((int *) p, i);
+    }
+}
+
+/* The stores are weakly ordered => each thread fences its own stores. */
+static void nt_STREAM_Copy()
+{
+    ssize_t j;
 #pragma omp parallel
-#pragma omp atomic 
-		k++;
-    printf ("Number of Threads counted = %i\n",k);
+    {
+#pragma omp for nowait
+	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	    stream_store_nt(&c[j], a[j]);
+	_mm_sfence();
+    }
+}
+
+static void nt_STREAM_Scale(STREAM_TYPE scalar)
+{
+    ssize_t j;
+#pragma omp parallel
+    {
+#pragma omp for nowait
+	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	    stream_store_nt(&b[j], scalar*c[j]);
+	_mm_sfence();
+    }
+}
+
+static void nt_STREAM_Add()
+{
+    ssize_t j;
+#pragma omp parallel
+    {
+#pragma omp for nowait
+	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	    stream_store_nt(&c[j], a[j]+b[j]);
+	_mm_sfence();
+    }
+}
+
+static void nt_STREAM_Triad(STREAM_TYPE scalar)
+{
+    ssize_t j;
+#pragma omp parallel
+    {
+#pragma omp for nowait
+	for (j=0; j<STREAM_ARRAY_SIZE; j++)
+	    stream_store_nt(&a[j], b[j]+scalar*c[j]);
+	_mm_sfence();
+    }
+}
 #endif
 
-    /* Get initial value for system clock. */
+/* Runs the kernels NTIMES with one configuration, returns 0 on success. */
+static int stream_run(stream_config_t *cfg, int quantum, int verbose)
+{
+    int			k;
+    ssize_t		j;
+    STREAM_TYPE		scalar;
+    double		t, times[4][NTIMES];
+    char		name[64];
+
+    stream_config_name(cfg, name, sizeof(name));
+    printf("Configuration: %s\n", name);
+
+    if (cfg->node >= 0 && stream_bind(cfg->node)) {
+	printf("No core of node %d is available\n", cfg->node);
+	printf(HLINE);
+	return 1;
+    }
+
+    if (stream_alloc(cfg)) {
+	if (cfg->node >= 0)
+	    stream_unbind();
+	printf("Unable to allocate the arrays\n");
+	printf(HLINE);
+	return 1;
+    }
+    if (cfg->backing == BACKING_1G && (((size_t) a) & ((1UL << 30) - 1)))
+	printf("1 GiB pages aren't supported, the kernel used 2 MiB pages\n");
+
+    /* the first touch has to happen on the node => without the other threads */
+    if (cfg->node >= 0 && !cfg->prefault) {
+	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+	    a[j] = 1.0;
+	    b[j] = 2.0;
+	    c[j] = 0.0;
+	}
+    } else {
 #pragma omp parallel for
-    for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
 	    a[j] = 1.0;
 	    b[j] = 2.0;
 	    c[j] = 0.0;
 	}
-    printf(HLINE);
-
-    if  ( (quantum = checktick()) >= 1) 
-	printf("Your clock granularity/precision appears to be "
-	    "%d microseconds.\n", quantum);
-    else {
-	printf("Your clock granularity appears to be "
-	    "less than one microsecond.\n");
-	quantum = 1;
     }
+    if (cfg->node >= 0)
+	stream_unbind();
 
     t = mysecond();
 #pragma omp parallel for
@@ -287,18 +518,20 @@ main()
 		a[j] = 2.0E0 * a[j];
     t = 1.0E6 * (mysecond() - t);
 
-    printf("Each test below will take on the order"
-	" of %d microseconds.\n", (int) t  );
-    printf("   (= %d clock ticks)\n", (int) (t/quantum) );
-    printf("Increase the size of the arrays if this shows that\n");
-    printf("you are not getting at least 20 clock ticks per test.\n");
+    if (verbose) {
+	printf("Each test below will take on the order"
+	    " of %d microseconds.\n", (int) t  );
+	printf("   (= %d clock ticks)\n", (int) (t/quantum) );
+	printf("Increase the size of the arrays if this shows that\n");
+	printf("you are not getting at least 20 clock ticks per test.\n");
 
-    printf(HLINE);
+	printf(HLINE);
 
-    printf("WARNING -- The above is only a rough guideline.\n");
-    printf("For best results, please be sure you know the\n");
-    printf("precision of your system timer.\n");
-    printf(HLINE);
+	printf("WARNING -- The above is only a rough guideline.\n");
+	printf("For best results, please be sure you know the\n");
+	printf("precision of your system timer.\n");
+	printf(HLINE);
+    }
 
     /*	--- MAIN LOOP --- repeat test cases NTIMES times --- */
 
@@ -306,6 +539,12 @@ main()
     for (k=0; k<NTIMES; k++)
 	{
 	times[0][k] = mysecond();
+#ifdef __x86_64__
+	if (cfg->nt)
+	    nt_STREAM_Copy();
+	else
+#endif
+	{
 #ifdef TUNED
         tuned_STREAM_Copy();
 #else
@@ -313,9 +552,16 @@ main()
 	for (j=0; j<STREAM_ARRAY_SIZE; j++)
 	    c[j] = a[j];
 #endif
+	}
 	times[0][k] = mysecond() - times[0][k];
 	
 	times[1][k] = mysecond();
+#ifdef __x86_64__
+	if (cfg->nt)
+	    nt_STREAM_Scale(scalar);
+	else
+#endif
+	{
 #ifdef TUNED
         tuned_STREAM_Scale(scalar);
 #else
@@ -323,9 +569,16 @@ main()
 	for (j=0; j<STREAM_ARRAY_SIZE; j++)
 	    b[j] = scalar*c[j];
 #endif
+	}
 	times[1][k] = mysecond() - times[1][k];
 	
 	times[2][k] = mysecond();
+#ifdef __x86_64__
+	if (cfg->nt)
+	    nt_STREAM_Add();
+	else
+#endif
+	{
 #ifdef TUNED
         tuned_STREAM_Add();
 #else
@@ -333,9 +586,16 @@ main()
 	for (j=0; j<STREAM_ARRAY_SIZE; j++)
 	    c[j] = a[j]+b[j];
 #endif
+	}
 	times[2][k] = mysecond() - times[2][k];
 	
 	times[3][k] = mysecond();
+#ifdef __x86_64__
+	if (cfg->nt)
+	    nt_STREAM_Triad(scalar);
+	else
+#endif
+	{
 #ifdef TUNED
         tuned_STREAM_Triad(scalar);
 #else
@@ -343,11 +603,18 @@ main()
 	for (j=0; j<STREAM_ARRAY_SIZE; j++)
 	    a[j] = b[j]+scalar*c[j];
 #endif
+	}
 	times[3][k] = mysecond() - times[3][k];
 	}
 
     /*	--- SUMMARY --- */
 
+    for (j=0; j<4; j++) {
+	avgtime[j] = 0;
+	maxtime[j] = 0;
+	mintime[j] = FLT_MAX;
+    }
+
     for (k=1; k<NTIMES; k++) /* note -- skip first iteration */
 	{
 	for (j=0; j<4; j++)
@@ -361,9 +628,10 @@ main()
     printf("Function    Best Rate MB/s  Avg time     Min time     Max time\n");
     for (j=0; j<4; j++) {
 		avgtime[j] = avgtime[j]/(double)(NTIMES-1);
+		cfg->rate[j] = 1.0E-06 * bytes[j]/mintime[j];
 
 		printf("%s%12.1f  %11.6f  %11.6f  %11.6f\n", label[j],
-	       1.0E-06 * bytes[j]/mintime[j],
+	       cfg->rate[j],
 	       avgtime[j],
 	       mintime[j],
 	       maxtime[j]);
@@ -374,9 +642,200 @@ main()
     checkSTREAMresults();
     printf(HLINE);
 
+    stream_free(cfg);
+
     return 0;
 }
 
+static void usage(const char *prog)
+{
+    printf("usage: %s [--hbw | --pages=4k|2m|1g] [--prefault] [--node=N] [--nt] [--all]\n", prog);
+}
+
+int
+main(int argc, char** argv)
+    {
+    int			quantum, checktick();
+    int			BytesPerWord;
+    int			k;
+    stream_config_t	opt = { BACKING_STATIC, 0, -1, 0 };
+    stream_config_t	*configs;
+    int			num_configs = 0, sweep = 0, failed = 0;
+
+    for (k = 1; k < argc; k++) {
+	if (!strcmp(argv[k], "--hbw"))
+	    opt.backing = BACKING_HBW;
+	else if (!strcmp(argv[k], "--pages=4k"))
+	    opt.backing = BACKING_4K;
+	else if (!strcmp(argv[k], "--pages=2m"))
+	    opt.backing = BACKING_2M;
+	else if (!strcmp(argv[k], "--pages=1g"))
+	    opt.backing = BACKING_1G;
+	else if (!strcmp(argv[k], "--prefault"))
+	    opt.prefault = 1;
+	else if (!strncmp(argv[k], "--node=", 7))
+	    opt.node = atoi(argv[k] + 7);
+	else if (!strcmp(argv[k], "--nt"))
+	    opt.nt = 1;
+	else if (!strcmp(argv[k], "--all"))
+	    sweep = 1;
+	else {
+	    usage(argv[0]);
+	    return 1;
+	}
+    }
+
+    printf(HLINE);
+    printf("STREAM version $Revision: 5.10 $\n");
+    printf("Results are based on a variant of the STREAM benchmark code\n");
+    printf(HLINE);
+
+#ifndef __x86_64__
+    if (opt.nt || opt.node >= 0) {
+	printf("Non-temporal stores and NUMA binding are supported only on x86_64\n");
+	return 1;
+    }
+#endif
+    if (opt.node >= (int) stream_nodes()) {
+	printf("Node %d doesn't exist, the system has %u node(s)\n", opt.node, stream_nodes());
+	return 1;
+    }
+    /* the static arrays are already placed, a binding needs a mapping */
+    if ((opt.node >= 0 || opt.prefault) && opt.backing == BACKING_STATIC)
+	opt.backing = BACKING_4K;
+
+    if (opt.backing == BACKING_HBW || sweep) {
+	if (hbw_check_available()) {
+	    if (!sweep) {
+		printf("High bandwidth memory isn't available\n");
+		return 1;
+	    }
+	} else {
+	    /* don't fall back to the main memory, the results would be misleading */
+	    hbw_set_policy(HBW_POLICY_BIND);
+	}
+    }
+
+    configs = calloc(MAX_CONFIGS, sizeof(stream_config_t));
+    if (!configs) {
+	printf("Unable to allocate the configurations\n");
+	return 1;
+    }
+
+    if (sweep) {
+	int backing, prefault, node, nt;
+	int hbw = !hbw_check_available();
+	int nodes = stream_nodes() > 1 ? (int) stream_nodes() : 0;
+#ifdef __x86_64__
+	int nts = 2;
+#else
+	int nts = 1;
+#endif
+
+	for (backing = BACKING_4K; backing <= BACKING_HBW; backing++) {
+	    if (backing == BACKING_1G && !has_1g_pages())
+		continue;
+	    if (backing == BACKING_HBW && !hbw)
+		continue;
+	    /* high bandwidth memory is mapped at the allocation and has no node binding */
+	    for (prefault = (backing == BACKING_HBW); prefault < 2; prefault++)
+		for (node = -1; node < (backing == BACKING_HBW ? 0 : nodes); node++)
+		    for (nt = 0; nt < nts && num_configs < MAX_CONFIGS; nt++) {
+			stream_config_t *cfg = &configs[num_configs++];
+			cfg->backing = backing;
+			cfg->prefault = prefault;
+			cfg->node = node;
+			cfg->nt = nt;
+		    }
+	}
+    } else {
+	configs[num_configs++] = opt;
+    }
+
+    BytesPerWord = sizeof(STREAM_TYPE);
+    printf("This system uses %d bytes per array element.\n",
+	BytesPerWord);
+
+    printf(HLINE);
+#ifdef N
+    printf("*****  WARNING: ******\n");
+    printf("      It appears that you set the preprocessor variable N when compiling this code.\n");
+    printf("      This version of the code uses the preprocesor variable STREAM_ARRAY_SIZE to control the array size\n");
+    printf("      Reverting to default value of STREAM_ARRAY_SIZE=%llu\n",(unsigned long long) STREAM_ARRAY_SIZE);
+    printf("*****  WARNING: ******\n");
+#endif
+
+    printf("Array size = %llu (elements), Offset = %d (elements)\n" , (unsigned long long) STREAM_ARRAY_SIZE, OFFSET);
+    printf("Memory per array = %.1f MiB (= %.1f GiB).\n", 
+	BytesPerWord * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.0),
+	BytesPerWord * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.0/1024.0));
+    printf("Total memory required = %.1f MiB (= %.1f GiB).\n",
+	(3.0 * BytesPerWord) * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024.),
+	(3.0 * BytesPerWord) * ( (double) STREAM_ARRAY_SIZE / 1024.0/1024./1024.));
+    printf("Each kernel will be executed %d times.\n", NTIMES);
+    printf(" The *best* time for each kernel (excluding the first iteration)\n"); 
+    printf(" will be used to compute the reported bandwidth.\n");
+    printf("NUMA nodes = %u, 1 GiB pages = %s, high bandwidth memory = %s\n",
+	stream_nodes(), has_1g_pages() ? "yes" : "no",
+	hbw_check_available() ? "no" : "yes");
+
+#ifdef _OPENMP
+    printf(HLINE);
+#pragma omp parallel 
+    {
+#pragma omp master
+	{
+	    k = omp_get_num_threads();
+	    printf ("Number of Threads requested = %i\n",k);
+        }
+    }
+#endif
+
+#ifdef _OPENMP
+	k = 0;
+#pragma omp parallel
+#pragma omp atomic 
+		k++;
+    printf ("Number of Threads counted = %i\n",k);
+#endif
+
+    printf(HLINE);
+
+    /* the arrays are initialized by stream_run() */
+    if  ( (quantum = checktick()) >= 1) 
+	printf("Your clock granularity/precision appears to be "
+	    "%d microseconds.\n", quantum);
+    else {
+	printf("Your clock granularity appears to be "
+	    "less than one microsecond.\n");
+	quantum = 1;
+    }
+    printf(HLINE);
+
+    for (k = 0; k < num_configs; k++)
+	failed += stream_run(&configs[k], quantum, !k);
+
+    if (sweep) {
+	printf("Summary of the best rates in MB/s\n");
+	printf("%-32s %10s %10s %10s %10s\n", "Configuration", "Copy", "Scale", "Add", "Triad");
+	for (k = 0; k < num_configs; k++) {
+	    char name[64];
+
+	    stream_config_name(&configs[k], name, sizeof(name));
+	    if (configs[k].rate[0] == 0.0)
+		printf("%-32s %10s\n", name, "failed");
+	    else
+		printf("%-32s %10.1f %10.1f %10.1f %10.1f\n", name, configs[k].rate[0],
+		    configs[k].rate[1], configs[k].rate[2], configs[k].rate[3]);
+	}
+	printf(HLINE);
+    }
+
+    free(configs);
+
+    return failed ? 1 : 0;
+}
+
 # define	M	20
 
 int
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+
+"""Copyright (c) 2018, RWTH Aachen University
+
+All rights reserved.
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the University nor the names of its contributors
+     may be used to endorse or promote products derived from this
+     software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."""
+
+"""Compare two result sets of the benchmarks (see usr/benchmarks/bench.h).
+
+A result set is one or more logs of benchmarks, which ran with
+BENCH_FORMAT=json or BENCH_FORMAT=csv; other lines are ignored. Results are
+matched by program and name and compared by their median. The exit code is
+1, if a result got worse by more than the threshold.
+
+usage: bench-compare.py [-t percent] [-s statistic] old.log [...] -- new.log [...]
+"""
+
+import argparse
+import csv
+import json
+import sys
+
+
+def load(files):
+	results = {}
+	for f in files:
+		with open(f) as log:
+			lines = log.read().splitlines()
+		header = None
+		for line in lines:
+			if line.startswith('{"program"'):
+				try:
+					obj = json.loads(line)
+				except ValueError:
+					continue
+				for r in obj["results"]:
+					results[(obj["program"], r["name"])] = r
+			elif line.startswith("program,platform,"):
+				header = line.split(",")
+			elif header and line.count(",") == len(header) - 1:
+				row = dict(zip(header, next(csv.reader([line]))))
+				for k in ("n", "min", "median", "mean", "p99", "p999", "max"):
+					if k in row:
+						row[k] = float(row[k])
+				results[(row["program"], row["name"])] = row
+	return results
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Compare two result sets of the benchmarks")
+	parser.add_argument("-t", "--threshold", type=float, default=5.0,
+		help="tolerated change in percent (default: 5)")
+	parser.add_argument("-s", "--statistic", default="median",
+		choices=["min", "median", "mean", "p99", "p999", "max"],
+		help="compared statistic (default: median)")
+	parser.add_argument("files", nargs="+", help="old logs -- new logs")
+	args = parser.parse_args()
+
+	if "--" in args.files:
+		i = args.files.index("--")
+		old_files, new_files = args.files[:i], args.files[i+1:]
+	elif len(args.files) == 2:
+		old_files, new_files = args.files[:1], args.files[1:]
+	else:
+		parser.error("separate the old and the new logs by --")
+
+	old = load(old_files)
+	new = load(new_files)
+	regressions = 0
+
+	print("%-60s %14s %14s %8s" % ("benchmark", "old", "new", "change"))
+	for key in sorted(set(old) | set(new)):
+		name = "%s: %s" % key
+		if key not in old or key not in new:
+			print("%-60s %s" % (name, "only in the new set" if key in new else "only in the old set"))
+			continue
+
+		o = old[key][args.statistic]
+		n = new[key][args.statistic]
+		change = 100.0 * (n - o) / o if o else 0.0
+		# a positive value is an improvement
+		gain = change if new[key]["better"] == "higher" else -change
+		mark = ""
+		if gain < -args.threshold:
+			mark = "  REGRESSION"
+			regressions += 1
+		elif gain > args.threshold:
+			mark = "  improved"
+		print("%-60s %14.1f %14.1f %+7.1f%%%s %s" % (name, o, n, change, mark, new[key]["unit"]))
+
+	if regressions:
+		print("%d regression(s) beyond %.1f%%" % (regressions, args.threshold))
+	return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -18,6 +18,9 @@
 
 import gdb
 
+# see kernel/tasks.c
+TASK_CHUNK_SIZE = 32
+
 
 def task_lists():
     task_table = gdb.parse_and_eval("task_table")
@@ -27,6 +30,21 @@ def task_lists():
         if task['status'] != 0:
             yield task
 
+    # tasks beyond the static table are allocated in chunks
+    try:
+        task_chunks = gdb.parse_and_eval("task_chunks")
+    except gdb.error:
+        return
+
+    for c in range(task_chunks.type.range()[1] + 1):
+        chunk = task_chunks[c]
+        if int(chunk) == 0:
+            continue
+        for i in range(TASK_CHUNK_SIZE):
+            task = chunk[i]
+            if task['status'] != 0:
+                yield task
+
 def get_task_by_pid(pid):
     for task in task_lists():
         if int(task['id']) == pid:
@@ -146,6 +164,37 @@ class HermitLsSighandler(gdb.Command):
 HermitLsSighandler()
 
 
+class HermitSchedStats(gdb.Command):
+    """Dump scheduler statistics per task (times in TSC cycles)."""
+
+    def __init__(self):
+        super(HermitSchedStats, self).__init__("hermit-sched-stats", gdb.COMMAND_DATA)
+
+    def invoke(self, arg, from_tty):
+
+        rowfmt = "{id:>3} | {run:>16} | {wait:>16} | {vol:>8} | {invol:>8} | {migr:>8}\n"
+
+        header = rowfmt.format(id='ID', run='RUN', wait='WAIT',
+                               vol='VOL', invol='INVOL', migr='MIGR')
+
+        gdb.write(header)
+        gdb.write((len(header) - 1) * '-' + '\n')
+
+        for task in task_lists():
+            stats = task['stats']
+
+            gdb.write(rowfmt.format(
+                id=int(task["id"]),
+                run=int(stats['run_time']),
+                wait=int(stats['wait_time']),
+                vol=int(stats['nr_voluntary']),
+                invol=int(stats['nr_involuntary']),
+                migr=int(stats['nr_migrations'])
+                ))
+
+HermitSchedStats()
+
+
 
 def stripSymbol(value):
     s = "%s" % value
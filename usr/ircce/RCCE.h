@@ -179,6 +179,17 @@ typedef unsigned char RCCE_FLAG_STATUS;
 typedef ssize_t RCCE_FLAG_STATUS;
 #endif
 
+typedef struct tree_s {
+  int parent; // UE of parent
+  int num_children;
+  int child[RCCE_MAXNP]; // UEs of children
+} tree_t;
+
+// barrier algorithms, which can be selected by RCCE_barrier_tune()
+#define RCCE_BARRIER_LINEAR                0
+#define RCCE_BARRIER_TREE                  1
+#define RCCE_BARRIER_HIERARCHICAL          2
+
 typedef struct {
   int size;
   int my_rank;
@@ -194,6 +205,9 @@ typedef struct {
   volatile int count;
   int step;
   int label;
+  int barrier;      // algorithm used by RCCE_barrier (RCCE_BARRIER_*)
+  tree_t tree;      // binary tree over the members
+  tree_t hier;      // two-level tree: socket members, then socket leaders
 } RCCE_COMM;
 
 typedef struct _RCCE_SEND_REQUEST {
@@ -246,11 +260,21 @@ typedef struct _RCCE_RECV_REQUEST {
   struct _RCCE_RECV_REQUEST *next;
 } RCCE_RECV_REQUEST;
 
-typedef struct tree_s {
-  int parent; // UE of parent
-  int num_children;
-  int child[RCCE_MAXNP]; // UEs of children
-} tree_t;
+#ifdef __hermit__
+typedef struct _RCCE_WIN {
+  t_vcharp base[RCCE_MAXNP]; // local mapping of the window of each UE
+  size_t   size[RCCE_MAXNP]; // size of the window of each UE (bytes)
+} RCCE_WIN;
+#endif
+
+typedef struct {
+  size_t total;       // MPB space managed by RCCE_malloc (bytes)
+  size_t used;        // space handed out, flags included
+  size_t peak;        // high-water mark of used
+  size_t flags;       // space taken by flag-sized (single line) allocations
+  size_t largest;     // largest block that can still be allocated
+  int    free_blocks; // number of free extents (fragmentation)
+} RCCE_MPB_USAGE;
 
 #ifdef RC_POWER_MANAGEMENT
 typedef struct{
@@ -340,6 +364,20 @@ t_vcharp RCCE_shmalloc(size_t);
 void     RCCE_shfree(t_vcharp);
 void     RCCE_shflush(void);
 t_vcharp RCCE_shrealloc(t_vcharp, size_t);
+void     RCCE_mpb_usage(RCCE_MPB_USAGE *);
+void     RCCE_mpb_report(void);
+
+#ifdef __hermit__
+// one-sided access to RMA windows:
+int      RCCE_win_create(size_t, RCCE_WIN *);
+int      RCCE_win_free(RCCE_WIN *);
+t_vcharp RCCE_win_base(int, RCCE_WIN *);
+int      RCCE_win_put(char *, size_t, size_t, int, RCCE_WIN *);
+int      RCCE_win_get(char *, size_t, size_t, int, RCCE_WIN *);
+int      RCCE_win_accumulate(char *, int, size_t, int, int, int, RCCE_WIN *);
+int      RCCE_win_flush(int, RCCE_WIN *);
+int      RCCE_win_fence(RCCE_WIN *);
+#endif
 
 // LfBS-customized functions:
 void*  RCCE_memcpy_get(void *, const void *, size_t);
@@ -358,6 +396,10 @@ int    RCCE_tournament_barrier(RCCE_COMM *);
 int    RCCE_tournament_fixed_barrier(RCCE_COMM *);
 int    RCCE_dissemination_barrier(RCCE_COMM *);
 int    RCCE_TNS_barrier(RCCE_COMM *);
+#ifndef GORY
+int    RCCE_hierarchical_barrier(RCCE_COMM *);
+int    RCCE_barrier_tune(RCCE_COMM *);
+#endif
 int    RCCE_AIR_barrier(RCCE_COMM *);
 int    RCCE_AIR_barrier2(RCCE_COMM *);
 int    RCCE_nb_barrier(RCCE_COMM *);
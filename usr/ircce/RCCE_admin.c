@@ -43,7 +43,6 @@
   #include <sys/mman.h>
   #include "SCC_API.h"
 #else
-  #define RCCE_SESSION_ID	42
   #include "syscall.h"
   extern unsigned int get_cpufreq();
 #endif
@@ -1169,6 +1168,8 @@ int RCCE_init(
   {
     printf("### %s: Remaining MPB space for communication: %zd Bytes per core\n", executable_name, RCCE_chunk); fflush(stdout);
   }
+
+  RCCE_barrier_tune(&RCCE_COMM_WORLD);
 #endif
 
   RCCE_barrier(&RCCE_COMM_WORLD);
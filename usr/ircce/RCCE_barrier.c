@@ -0,0 +1,191 @@
+//***************************************************************************************
+// Topology-aware barrier selection.
+//***************************************************************************************
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+//    RCCE_barrier_tune() is called for every communicator when it is created.
+//    It measures the barrier variants, which are applicable to the communicator,
+//    and stores the fastest one in the communicator; RCCE_barrier dispatches to
+//    it afterwards. The hierarchical barrier synchronizes the UEs on the same
+//    socket first and afterwards the socket leaders.
+//
+//    Only the tree based barriers are candidates: they leave all flags unset
+//    on exit, so that the algorithms can be mixed between communicators. The
+//    dissemination barrier doesn't guarantee this for back-to-back calls.
+//
+#include "RCCE_lib.h"
+
+#ifndef GORY
+
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#define RCCE_BARRIER_NUM          3
+#define RCCE_BARRIER_WARMUP       4
+#define RCCE_BARRIER_ITERATIONS  32
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_socket_id
+//--------------------------------------------------------------------------------------
+// return the package id of the calling core (0, if it can't be determined)
+//--------------------------------------------------------------------------------------
+static int RCCE_socket_id(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  unsigned int eax, ebx, ecx, edx;
+  unsigned int level, shift = 0;
+
+  // the extended topology leaf enumerates the levels below the package
+  if (__get_cpuid_max(0, NULL) < 0xB)
+    return 0;
+
+  for (level = 0; ; level++) {
+    __cpuid_count(0xB, level, eax, ebx, ecx, edx);
+    if (!((ecx >> 8) & 0xFF))
+      break;
+    shift = eax & 0x1F;
+  }
+
+  return (int) (edx >> shift);
+#else
+  return 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_barrier_trees
+//--------------------------------------------------------------------------------------
+// build the binary and the two-level tree of the calling UE, socket contains the
+// socket of each rank; returns the number of sockets
+//--------------------------------------------------------------------------------------
+static int RCCE_barrier_trees(RCCE_COMM *comm, const int *socket) {
+  int leader[RCCE_MAXNP];
+  tree_t *tree = &comm->tree, *hier = &comm->hier;
+  int me = comm->my_rank, r, s, num_sockets = 0;
+
+  // binary tree, rooted at rank 0
+  tree->parent = me ? comm->member[(me-1)/2] : -1;
+  tree->num_children = 0;
+  for (r = 2*me+1; r <= 2*me+2 && r < comm->size; r++)
+    tree->child[tree->num_children++] = comm->member[r];
+
+  // the socket leader is the lowest rank on each socket
+  for (r = 0; r < comm->size; r++) {
+    for (s = 0; socket[s] != socket[r]; s++) ;
+    leader[r] = s;
+    if (s == r) num_sockets++;
+  }
+
+  // intra-socket: all members report to their leader
+  hier->parent = (leader[me] != me) ? comm->member[leader[me]] : -1;
+  hier->num_children = 0;
+  if (leader[me] == me) {
+    for (r = 0; r < comm->size; r++)
+      if (r != me && leader[r] == me)
+        hier->child[hier->num_children++] = comm->member[r];
+  }
+
+  // inter-socket: the leaders report to rank 0
+  if (leader[me] == me && me) hier->parent = comm->member[0];
+  if (!me) {
+    for (r = 1; r < comm->size; r++)
+      if (leader[r] == r)
+        hier->child[hier->num_children++] = comm->member[r];
+  }
+
+  return num_sockets;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_hierarchical_barrier
+//--------------------------------------------------------------------------------------
+// barrier over the two-level tree; the tree is set up by RCCE_barrier_tune()
+//--------------------------------------------------------------------------------------
+int RCCE_hierarchical_barrier(RCCE_COMM *comm) {
+  return RCCE_tree_barrier(comm, &comm->hier);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_barrier_dispatch
+//--------------------------------------------------------------------------------------
+// run the barrier algorithm, which was selected for the communicator
+//--------------------------------------------------------------------------------------
+int RCCE_barrier_dispatch(RCCE_COMM *comm) {
+  switch (comm->barrier) {
+    case RCCE_BARRIER_TREE:          return RCCE_tree_barrier(comm, &comm->tree);
+    case RCCE_BARRIER_HIERARCHICAL:  return RCCE_tree_barrier(comm, &comm->hier);
+    default:                         return(RCCE_error_return(RCCE_debug_synch,RCCE_ERROR_ILLEGAL_OP));
+  }
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_barrier_tune
+//--------------------------------------------------------------------------------------
+// collective: determine the socket layout of the communicator and select the fastest
+// barrier algorithm for it
+//--------------------------------------------------------------------------------------
+int RCCE_barrier_tune(RCCE_COMM *comm) {
+  int socket_in[RCCE_MAXNP], socket[RCCE_MAXNP];
+  double time_in[RCCE_BARRIER_NUM], time[RCCE_BARRIER_NUM];
+  int usable[RCCE_BARRIER_NUM];
+  int num_sockets, algo, best, i, error;
+  double start;
+
+  comm->barrier = RCCE_BARRIER_LINEAR;
+  if (comm->size <= 2) return(RCCE_SUCCESS);
+
+  // exchange the socket ids (shifted by one, so that zero is neutral for RCCE_MAX)
+  memset(socket_in, 0x00, sizeof(socket_in));
+  socket_in[comm->my_rank] = RCCE_socket_id() + 1;
+  if ((error = RCCE_allreduce((char *)socket_in, (char *)socket, comm->size, RCCE_INT, RCCE_MAX, *comm)))
+    return(RCCE_error_return(RCCE_debug_synch,error));
+
+  num_sockets = RCCE_barrier_trees(comm, socket);
+
+  usable[RCCE_BARRIER_LINEAR] = 1;
+  usable[RCCE_BARRIER_TREE] = 1;
+  // with one UE per socket or a single socket, it is just another flat tree
+  usable[RCCE_BARRIER_HIERARCHICAL] = (num_sockets > 1) && (num_sockets < comm->size);
+
+  for (algo = 0; algo < RCCE_BARRIER_NUM; algo++) {
+    time_in[algo] = 0.0;
+    if (!usable[algo]) continue;
+
+    comm->barrier = algo;
+    for (i = 0; i < RCCE_BARRIER_WARMUP; i++)
+      RCCE_barrier(comm);
+    start = RCCE_wtime();
+    for (i = 0; i < RCCE_BARRIER_ITERATIONS; i++)
+      RCCE_barrier(comm);
+    time_in[algo] = RCCE_wtime() - start;
+  }
+
+  // all UEs have to agree on the same algorithm => use the slowest UE's view
+  comm->barrier = RCCE_BARRIER_LINEAR;
+  if ((error = RCCE_allreduce((char *)time_in, (char *)time, RCCE_BARRIER_NUM, RCCE_DOUBLE, RCCE_MAX, *comm)))
+    return(RCCE_error_return(RCCE_debug_synch,error));
+
+  for (best = RCCE_BARRIER_LINEAR, algo = 1; algo < RCCE_BARRIER_NUM; algo++)
+    if (usable[algo] && time[algo] < time[best]) best = algo;
+
+  if (RCCE_debug_synch)
+    fprintf(STDERR,"UE %d uses barrier algorithm %d (%d sockets)\n", RCCE_IAM, best, num_sockets);
+
+  comm->barrier = best;
+
+  return(RCCE_SUCCESS);
+}
+
+#endif
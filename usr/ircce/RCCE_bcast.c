@@ -2,7 +2,8 @@
 // Broadcast functions. 
 //***************************************************************************************
 // Since only collective operations require communication domains, they are the only ones 
-// that use communicators. All collectives implementations are naive, linear operations. 
+// that use communicators. Small messages are broadcast along a binomial tree, large
+// messages are pipelined in chunks of the MPB size along a chain of the UEs.
 // There may not be any overlap between target and source.
 //
 // Author: Rob F. Van der Wijngaart
@@ -37,6 +38,64 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define MIN(x,y) ( (x) < (y) ? (x) : (y) )
+
+#ifndef GORY
+//--------------------------------------------------------------------------------------
+// RCCE_bcast_tree
+//--------------------------------------------------------------------------------------
+// binomial tree: in round k, the UEs with a virtual rank below 2^k send to the UE
+// 2^k ranks further, hence the broadcast takes log2(size) messages
+//--------------------------------------------------------------------------------------
+static int RCCE_bcast_tree(char *buf, size_t num, int root, int me, RCCE_COMM comm) {
+
+  int vrank = (me - root + comm.size) % comm.size;
+  int mask, ierr;
+
+  // receive from the parent, which clears the lowest set bit of the virtual rank
+  for (mask=1; mask<comm.size; mask<<=1) if (vrank & mask) {
+    if ((ierr=RCCE_recv(buf, num, comm.member[(vrank - mask + root) % comm.size])))
+      return(ierr);
+    break;
+  }
+
+  // forward to the children, the farthest child first
+  for (mask>>=1; mask>0; mask>>=1) if (vrank + mask < comm.size)
+    if ((ierr=RCCE_send(buf, num, comm.member[(vrank + mask + root) % comm.size])))
+      return(ierr);
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// RCCE_bcast_chain
+//--------------------------------------------------------------------------------------
+// pipelined chain: each UE receives a chunk from its predecessor and forwards it to
+// its successor, before it receives the next chunk
+//--------------------------------------------------------------------------------------
+static int RCCE_bcast_chain(char *buf, size_t num, size_t chunk, int root, int me,
+  RCCE_COMM comm) {
+
+  int vrank = (me - root + comm.size) % comm.size;
+  int prev = comm.member[(vrank - 1 + root + comm.size) % comm.size];
+  int next = comm.member[(vrank + 1 + root) % comm.size];
+  size_t off, len;
+  int ierr;
+
+  for (off=0; off<num; off+=len) {
+    len = MIN(chunk, num - off);
+    if (vrank > 0)
+      if ((ierr=RCCE_recv(buf+off, len, prev)))
+        return(ierr);
+    if (vrank < comm.size - 1)
+      if ((ierr=RCCE_send(buf+off, len, next)))
+        return(ierr);
+  }
+
+  return(RCCE_SUCCESS);
+}
+#endif
+
 //--------------------------------------------------------------------------------------
 // RCCE_bcast
 //--------------------------------------------------------------------------------------
@@ -49,7 +108,8 @@ int RCCE_bcast(
   RCCE_COMM comm // communication domain
   ) {
 
-  int ue, ierr;
+  int me, depth, ierr;
+  size_t chunk, chunks;
 #ifdef GORY
   printf("Collectives only implemented for simplified API\n");
   return(1);
@@ -58,13 +118,23 @@ int RCCE_bcast(
   if (root<0 || root >= comm.size) 
   return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_ID));
 
-  if (RCCE_IAM == comm.member[root]) {
-    for (ue=0; ue<comm.size; ue++) if (ue != root)
-      if((ierr=RCCE_send(buf, num, comm.member[ue])))
-         return(RCCE_error_return(RCCE_debug_comm,ierr));
-  }
-  else if((ierr=RCCE_recv(buf, num, comm.member[root])))
-         return(RCCE_error_return(RCCE_debug_comm,ierr));
+  for (me=0; me<comm.size; me++) if (comm.member[me] == RCCE_IAM) break;
+  if (me == comm.size || comm.size == 1) return(RCCE_SUCCESS);
+
+  // a message of the MPB size is the unit of the pipeline
+  chunk = RCCE_chunk & ~((size_t) RCCE_LINE_SIZE - 1);
+  if (!chunk) chunk = RCCE_LINE_SIZE;
+  chunks = (num + chunk - 1) / chunk;
+  for (depth=0; (1<<depth) < comm.size; depth++);
+
+  // the chain needs size-1+chunks-1 steps, the tree depth*chunks steps
+  if (comm.size > 2 && comm.size - 2 + chunks < depth * chunks)
+    ierr = RCCE_bcast_chain(buf, num, chunk, root, me, comm);
+  else
+    ierr = RCCE_bcast_tree(buf, num, root, me, comm);
+
+  if (ierr)
+    return(RCCE_error_return(RCCE_debug_comm,ierr));
 
   return(RCCE_SUCCESS);
 #endif
@@ -80,7 +80,8 @@ int RCCE_comm_split(
   // note: we only need to allocate new synch flags if the communicator has not yet been
   // initialized. It is legal to overwrite an initialized communcator, in which case the 
   // membership may change, but the same synchronization flags can be used       
-  if (comm->initialized == RCCE_COMM_INITIALIZED) return(RCCE_SUCCESS);
+  comm->barrier = RCCE_BARRIER_LINEAR;
+  if (comm->initialized == RCCE_COMM_INITIALIZED) goto tune;
 
 #ifndef USE_FAT_BARRIER
   if((error=RCCE_flag_alloc(&(comm->gather))))
@@ -99,6 +100,13 @@ int RCCE_comm_split(
 
   comm->initialized = RCCE_COMM_INITIALIZED;
 
+tune:
+#ifndef GORY
+  // the global communicator is tuned at the end of RCCE_init, after the
+  // allocation of the barrier flags
+  if (comm != &RCCE_COMM_WORLD) return RCCE_barrier_tune(comm);
+#endif
+
   return(RCCE_SUCCESS);
 }
 
@@ -41,14 +41,18 @@
 
 void *RCCE_memcpy_get(void *dest, const void *src, size_t count)
 { // function wrapper for external usage of improved memcpy()...
-#ifdef COPPERRIDGE
+#ifdef __hermit__
+  return rte_memcpy_get(dest, src, count);
+#elif defined(COPPERRIDGE)
   return memcpy_from_mpb(dest, src, count);
 #else
   return memcpy(dest, src, count);
 #endif
 }
 
-#ifdef COPPERRIDGE
+#ifdef __hermit__
+#define RCCE_memcpy_get(a,b,c) rte_memcpy_get(a,b,c)
+#elif defined(COPPERRIDGE)
 #define RCCE_memcpy_get(a,b,c) memcpy_from_mpb(a,b,c)
 #else
 #define RCCE_memcpy_get(a,b,c) memcpy(a,b,c)
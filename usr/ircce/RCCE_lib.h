@@ -214,8 +214,13 @@ typedef volatile unsigned int  t_vint;
 typedef struct rcce_block {
   t_vcharp space;          // pointer to space for data in block             
   size_t free_size;        // actual free space in block (0 or whole block)  
-  size_t size;             // size of an allocated block
-  struct rcce_block *next; // pointer to next block in circular linked list 
+  size_t size;             // size of the block, whether allocated or not
+  unsigned int lines;      // flag slab: bitmap of the lines in use
+  int slab;                // block is a slab of flag-sized lines
+  struct rcce_block *next; // next block in address order
+  struct rcce_block *prev; // previous block in address order
+  struct rcce_block *bin_next; // next block in size class bin (or slab list)
+  struct rcce_block *bin_prev; // previous block in size class bin (or slab list)
 } RCCE_BLOCK;
 
 #if defined(SINGLEBITFLAGS) || defined(USE_BYTE_FLAGS)
@@ -228,8 +233,20 @@ typedef struct rcce_flag_line {
 #endif
 
 
+#define RCCE_MALLOC_BINS       16 // size classes of free blocks: floor(log2(lines))
+#define RCCE_MALLOC_SLAB_LINES 32 // lines per flag slab, one bit each in RCCE_BLOCK.lines
+
 typedef struct  {
-  RCCE_BLOCK *tail;     // "last" block in linked list of blocks           
+  RCCE_BLOCK *head;     // first block in address ordered list of blocks
+  RCCE_BLOCK *bin[RCCE_MALLOC_BINS]; // free blocks, binned by size class
+  RCCE_BLOCK *slabs;    // slabs handing out flag-sized lines
+  RCCE_BLOCK **owner;   // block starting at (or slab covering) each line
+  t_vcharp mem;         // start of managed space
+  size_t size;          // size of managed space
+  size_t alloc;         // space in allocated blocks, slabs included
+  size_t slab_size;     // space in slabs
+  size_t flags;         // lines handed out by slabs (bytes)
+  size_t peak;          // high-water mark of used space
 } RCCE_BLOCK_S;
 
 #ifdef AIR
@@ -271,6 +288,10 @@ extern t_vcharp     RCCE_flag_buffer[RCCE_MAXNP];
 #ifndef __hermit__
 extern t_vcharp     RCCE_fool_write_combine_buffer;
 #endif
+#ifdef __hermit__
+// key of our session in the isle-wide MPB table
+#define RCCE_SESSION_ID     42
+#endif
 extern t_vcharp     RCCE_comm_buffer[RCCE_MAXNP];
 extern int          RCCE_NP;
 extern int          RCCE_BUFF_SIZE;
@@ -306,6 +327,10 @@ int      id_compare(const void *, const void *);
 int      RCCE_probe(RCCE_FLAG);
 #endif
 int      RCCE_error_return(int, int);
+void     RCCE_reduce_op(char *, const char *, int, int, int);
+#ifndef GORY
+int      RCCE_barrier_dispatch(RCCE_COMM *);
+#endif
 #ifdef __hermit__
 #define RC_cache_invalidate()	{}
 #else
@@ -27,15 +27,199 @@
 //......................................................................................
 // GLOBAL VARIABLES USED BY THE LIBRARY
 //......................................................................................
+#ifndef GORY
+#define RCCE_MALLOC_WORDS ((RCCE_BUFF_SIZE_MAX/RCCE_LINE_SIZE+63)/64)
+static t_vcharp RCCE_mpb_base;    // start of the managed MPB space
+static size_t RCCE_mpb_size;      // size of the managed MPB space
+static size_t RCCE_mpb_peak;      // high-water mark of the flag area
+static unsigned long long RCCE_free_lines[RCCE_MALLOC_WORDS]; // released flag lines
+static int RCCE_free_count;       // number of bits set in RCCE_free_lines
+#ifdef _OPENMP
+#pragma omp threadprivate (RCCE_mpb_base, RCCE_mpb_size, RCCE_mpb_peak)
+#pragma omp threadprivate (RCCE_free_lines, RCCE_free_count)
+#endif
+#else
 static RCCE_BLOCK_S RCCE_space;   // data structure used for trscking MPB memory blocks
 static RCCE_BLOCK_S *RCCE_spacep; // pointer to RCCE_space
 #ifdef _OPENMP
 #pragma omp threadprivate (RCCE_space, RCCE_spacep)
 #endif
+#endif
 
 // END GLOBAL VARIABLES USED BY THE LIBRARY
 //......................................................................................
 
+#ifdef GORY
+
+#define RCCE_LINE_INDEX(p)    ((size_t) ((p) - RCCE_spacep->mem) / RCCE_LINE_SIZE)
+#define RCCE_SLAB_FULL        (~0U >> (32 - RCCE_MALLOC_SLAB_LINES))
+
+// size class of a block with the given number of lines
+static int RCCE_size_class(size_t lines) {
+  int c = 0;
+
+  while (lines >>= 1) c++;
+  return (c < RCCE_MALLOC_BINS) ? c : RCCE_MALLOC_BINS-1;
+}
+
+static void RCCE_bin_insert(RCCE_BLOCK *b) {
+  RCCE_BLOCK **bin = &RCCE_spacep->bin[RCCE_size_class(b->free_size/RCCE_LINE_SIZE)];
+
+  b->bin_prev = NULL;
+  b->bin_next = *bin;
+  if (*bin) (*bin)->bin_prev = b;
+  *bin = b;
+}
+
+static void RCCE_bin_remove(RCCE_BLOCK *b) {
+  if (b->bin_prev) b->bin_prev->bin_next = b->bin_next;
+  else RCCE_spacep->bin[RCCE_size_class(b->free_size/RCCE_LINE_SIZE)] = b->bin_next;
+  if (b->bin_next) b->bin_next->bin_prev = b->bin_prev;
+}
+
+static void RCCE_space_used(void) {
+  size_t used = RCCE_spacep->alloc - RCCE_spacep->slab_size + RCCE_spacep->flags;
+
+  if (used > RCCE_spacep->peak) RCCE_spacep->peak = used;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_block_alloc
+//--------------------------------------------------------------------------------------
+// take a block of size bytes from the bins; the own size class may hold blocks that are
+// too small, every block of a larger class fits
+//--------------------------------------------------------------------------------------
+static RCCE_BLOCK *RCCE_block_alloc(size_t size) {
+  RCCE_BLOCK *b, *r;
+  int c = RCCE_size_class(size/RCCE_LINE_SIZE);
+
+  for (b = RCCE_spacep->bin[c]; b && b->free_size < size; b = b->bin_next) ;
+  for (c++; !b && c < RCCE_MALLOC_BINS; c++) b = RCCE_spacep->bin[c];
+  if (!b) return NULL;
+
+  RCCE_bin_remove(b);
+  if (b->size > size) { // split block; the remainder stays free
+    r = (RCCE_BLOCK *) malloc(sizeof(RCCE_BLOCK));
+    if (!r) {
+      RCCE_bin_insert(b);
+      return NULL;
+    }
+    r->space     = b->space + size;
+    r->size      = b->size - size;
+    r->free_size = r->size;
+    r->slab      = 0;
+    r->prev      = b;
+    r->next      = b->next;
+    if (b->next) b->next->prev = r;
+    b->next      = r;
+    b->size      = size;
+    RCCE_spacep->owner[RCCE_LINE_INDEX(r->space)] = r;
+    RCCE_bin_insert(r);
+  }
+  b->free_size = 0;
+  RCCE_spacep->alloc += b->size;
+
+  return b;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_block_release
+//--------------------------------------------------------------------------------------
+// return a block to the bins and merge it with its free neighbors
+//--------------------------------------------------------------------------------------
+static void RCCE_block_release(RCCE_BLOCK *b) {
+  RCCE_BLOCK *n;
+
+  RCCE_spacep->alloc -= b->size;
+
+  n = b->next;
+  if (n && n->free_size) { // merge (b,n) into b
+    RCCE_bin_remove(n);
+    b->size += n->size;
+    b->next  = n->next;
+    if (n->next) n->next->prev = b;
+    RCCE_spacep->owner[RCCE_LINE_INDEX(n->space)] = NULL;
+    free(n);
+  }
+
+  n = b->prev;
+  if (n && n->free_size) { // merge (n,b) into n
+    RCCE_bin_remove(n);
+    n->size += b->size;
+    n->next  = b->next;
+    if (b->next) b->next->prev = n;
+    RCCE_spacep->owner[RCCE_LINE_INDEX(b->space)] = NULL;
+    free(b);
+    b = n;
+  }
+
+  b->free_size = b->size;
+  RCCE_bin_insert(b);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_line_alloc
+//--------------------------------------------------------------------------------------
+// flag-sized allocations come from slabs of RCCE_MALLOC_SLAB_LINES lines, whose lines
+// are tracked by a bitmap; if no slab fits anymore, a single line block is used
+//--------------------------------------------------------------------------------------
+static t_vcharp RCCE_line_alloc(void) {
+  RCCE_BLOCK *s;
+  size_t line;
+  int bit;
+
+  for (s = RCCE_spacep->slabs; s && s->lines == RCCE_SLAB_FULL; s = s->bin_next) ;
+
+  if (!s) {
+    s = RCCE_block_alloc(RCCE_MALLOC_SLAB_LINES*RCCE_LINE_SIZE);
+    if (!s) {
+      s = RCCE_block_alloc(RCCE_LINE_SIZE);
+      return s ? s->space : NULL;
+    }
+    s->slab  = 1;
+    s->lines = 0;
+    for (line = 1; line < RCCE_MALLOC_SLAB_LINES; line++)
+      RCCE_spacep->owner[RCCE_LINE_INDEX(s->space)+line] = s;
+    s->bin_prev = NULL;
+    s->bin_next = RCCE_spacep->slabs;
+    if (RCCE_spacep->slabs) RCCE_spacep->slabs->bin_prev = s;
+    RCCE_spacep->slabs = s;
+    RCCE_spacep->slab_size += s->size;
+  }
+
+  bit = __builtin_ctz(~s->lines);
+  s->lines |= 1U << bit;
+  RCCE_spacep->flags += RCCE_LINE_SIZE;
+
+  return s->space + bit*RCCE_LINE_SIZE;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_line_free
+//--------------------------------------------------------------------------------------
+// release a line of slab s; an empty slab is given back to the bins
+//--------------------------------------------------------------------------------------
+static void RCCE_line_free(RCCE_BLOCK *s, t_vcharp ptr) {
+  unsigned int mask = 1U << ((ptr - s->space)/RCCE_LINE_SIZE);
+  size_t line;
+
+  if (!(s->lines & mask)) return;
+  s->lines &= ~mask;
+  RCCE_spacep->flags -= RCCE_LINE_SIZE;
+  if (s->lines) return;
+
+  if (s->bin_prev) s->bin_prev->bin_next = s->bin_next;
+  else RCCE_spacep->slabs = s->bin_next;
+  if (s->bin_next) s->bin_next->bin_prev = s->bin_prev;
+  for (line = 1; line < RCCE_MALLOC_SLAB_LINES; line++)
+    RCCE_spacep->owner[RCCE_LINE_INDEX(s->space)+line] = NULL;
+  RCCE_spacep->slab_size -= s->size;
+  s->slab = 0;
+  RCCE_block_release(s);
+}
+
+#endif
+
 //--------------------------------------------------------------------------------------
 // FUNCTION: RCCE_malloc_init
 //--------------------------------------------------------------------------------------
@@ -53,15 +237,36 @@ void RCCE_malloc_init(
   RCCE_chunk       = size;
   RCCE_buff_ptr    = mem;
 
+  RCCE_mpb_base    = mem;
+  RCCE_mpb_size    = size;
+  RCCE_mpb_peak    = 0;
+  RCCE_free_count  = 0;
+  memset(RCCE_free_lines, 0x00, sizeof(RCCE_free_lines));
+
 #else
 
+  RCCE_BLOCK *b;
+
   // create one block containing all memory for truly dynamic memory allocator
   RCCE_spacep = &RCCE_space;
-  RCCE_spacep->tail = (RCCE_BLOCK *) malloc(sizeof(RCCE_BLOCK));
-  RCCE_spacep->tail->free_size = size;
-  RCCE_spacep->tail->space = mem;
-  /* make a circular list by connecting tail to itself */
-  RCCE_spacep->tail->next = RCCE_spacep->tail;
+  memset(RCCE_spacep, 0x00, sizeof(RCCE_BLOCK_S));
+  RCCE_spacep->mem   = mem;
+  RCCE_spacep->size  = size;
+  RCCE_spacep->owner = (RCCE_BLOCK **) calloc(size/RCCE_LINE_SIZE+1, sizeof(RCCE_BLOCK *));
+  if (!RCCE_spacep->owner) {
+    RCCE_spacep = NULL;
+    return;
+  }
+
+  b = (RCCE_BLOCK *) malloc(sizeof(RCCE_BLOCK));
+  b->space     = mem;
+  b->size      = size - size%RCCE_LINE_SIZE;
+  b->free_size = b->size;
+  b->slab      = 0;
+  b->next      = b->prev = NULL;
+  RCCE_spacep->head = b;
+  RCCE_spacep->owner[0] = b;
+  if (b->size) RCCE_bin_insert(b);
 
 #endif
 }
@@ -70,10 +275,11 @@ void RCCE_malloc_init(
 // FUNCTION: RCCE_malloc
 //--------------------------------------------------------------------------------------
 // Allocate memory inside MPB. In restricted mode we only use it to allocate new
-// flags prompted by the creation of new communicators. Since communicators are never
-// deleted, we do not need to deallocate MPB memory, so we can simply keep running
-// pointers of where the next flag will be stored, and where payload data can go. In
-// GORY mode we need to support fully dynamic memory allocation and deallocation.
+// flags prompted by the creation of new communicators. We keep running pointers of
+// where the next flag will be stored, and where payload data can go; lines of freed
+// communicators are recycled through a bitmap. The payload area never grows back, so
+// that its location stays the same on all UEs. In GORY mode we need to support fully
+// dynamic memory allocation and deallocation.
 //--------------------------------------------------------------------------------------
 t_vcharp RCCE_malloc(
   size_t size // requested space
@@ -83,6 +289,8 @@ t_vcharp RCCE_malloc(
 
 #ifndef GORY
 
+  int i, bit;
+
   // new flag takes exactly one cache line, whether using single bit flags are not
   if (size != RCCE_LINE_SIZE) {
     fprintf(stderr, "ERROR in RCCE_malloc(): size != RCCE_LINE_SIZE!\n");
@@ -90,6 +298,15 @@ t_vcharp RCCE_malloc(
     return(0);
   }
 
+  // reuse the lowest released flag line first
+  if (RCCE_free_count) {
+    for (i = 0; !RCCE_free_lines[i]; i++) ;
+    bit = __builtin_ctzll(RCCE_free_lines[i]);
+    RCCE_free_lines[i] &= ~(1ULL << bit);
+    RCCE_free_count--;
+    return(RCCE_mpb_base + (size_t) (64*i+bit)*RCCE_LINE_SIZE);
+  }
+
   // if chunk size becomes zero, we have allocated too many flags
   if (!(RCCE_chunk-RCCE_LINE_SIZE)) {
     fprintf(stderr, "ERROR in RCCE_malloc(): No more MPB space left!\n");
@@ -107,64 +324,36 @@ t_vcharp RCCE_malloc(
 
   // move running pointer to new start of payload data area
   RCCE_buff_ptr    += RCCE_LINE_SIZE;
+
+  if ((size_t) (RCCE_flags_start - RCCE_mpb_base) > RCCE_mpb_peak)
+    RCCE_mpb_peak = RCCE_flags_start - RCCE_mpb_base;
   return(result);
 
 #else
 
-  // simple memory allocator, loosely based on public domain code developed by
-  // Michael B. Allen and published on "The Scripts--IT /Developers Network".
-  // Approach: 
-  // - maintain linked list of pointers to memory. A block is either completely
-  //   malloced (free_size = 0), or completely free (free_size > 0).
-  //   The space field always points to the beginning of the block
-  // - malloc: traverse linked list for first block that has enough space    
-  // - free: Check if pointer exists. If yes, check if the new block should be 
-  //         merged with neighbors. Could be one or two neighbors.
-
-  RCCE_BLOCK *b1, *b2, *b3;   // running pointers for blocks              
-
-  if (size==0 || size%RCCE_LINE_SIZE!=0) return 0;
-
-  // always first check if the tail block has enough space, because that
-  // is the most likely. If it does and it is exactly enough, we still
-  // create a new block that will be the new tail, whose free space is 
-  // zero. This acts as a marker of where free space of predecessor ends   
-  b1 = RCCE_spacep->tail;
-  if (b1->free_size >= size) {
-    // need to insert new block; new order is: b1->b2 (= new tail)         
-    b2 = (RCCE_BLOCK *) malloc(sizeof(RCCE_BLOCK));
-    b2->next      = b1->next;
-    b1->next      = b2;
-    b2->free_size = b1->free_size-size;
-    b2->space     = b1->space + size;
-    b1->free_size = 0;
-    // need to update the tail                                             
-    RCCE_spacep->tail = b2;
-    return(b1->space);
-  }
+  // segregated fit allocator:
+  // - all blocks are kept in an address ordered, doubly linked list. A block is
+  //   either completely malloced (free_size = 0), or completely free (free_size > 0)
+  // - free blocks are additionally kept in bins by size class (floor(log2(lines)))
+  // - single lines (flags) are handed out from slabs tracked by a bitmap
+  // - free: a table maps each line to its block, neighbors are merged in O(1)
 
-  // tail didn't have enough space; loop over whole list from beginning    
-  while (b1->next->free_size < size) {
-    if (b1->next == RCCE_spacep->tail) {
-      return NULL; // we came full circle 
-    }
-    b1 = b1->next;
+  RCCE_BLOCK *b;
+
+  if (size==0 || size%RCCE_LINE_SIZE!=0 || !RCCE_spacep) return 0;
+
+  if (size == RCCE_LINE_SIZE) {
+    result = RCCE_line_alloc();
+  } else {
+    b = RCCE_block_alloc(size);
+    result = b ? b->space : NULL;
   }
 
-  b2 = b1->next;
-  if (b2->free_size > size) { // split block; new block order: b1->b2->b3  
-    b3            = (RCCE_BLOCK *) malloc(sizeof(RCCE_BLOCK));
-    b3->next      = b2->next; // reconnect pointers to add block b3        
-    b2->next      = b3;       //     "         "     "  "    "    "        
-    b3->free_size = b2->free_size - size; // b3 gets remainder free space  
-    b3->space     = b2->space + size; // need to shift space pointer       
-  } 
-  b2->free_size = 0;          // block b2 is completely used               
-  return (b2->space);
+  if (result) RCCE_space_used();
+  return(result);
 #endif
 }
 
-
 t_vcharp RCCE_palloc(
   size_t size,        // requested space
   int CoreID // location
@@ -181,55 +370,99 @@ t_vcharp RCCE_palloc(
 //--------------------------------------------------------------------------------------
 // FUNCTION: RCCE_free
 //--------------------------------------------------------------------------------------
-// Deallocate memory in MPB; only used in GORY mode
+// Deallocate memory in MPB; without GORY, only flag lines are released
 //--------------------------------------------------------------------------------------
 void RCCE_free(
   t_vcharp ptr // pointer to data to be freed
   ) {
 
-  RCCE_BLOCK *b1, *b2, *b3;   // running block pointers                    
-  int j1, j2;                 // booleans determining merging of blocks    
+#ifndef GORY
+
+  size_t line;
 
-  // loop over whole list from the beginning until we locate space ptr     
-  b1 = RCCE_spacep->tail;
-  while (b1->next->space != ptr && b1->next != RCCE_spacep->tail) { 
-    b1 = b1->next;
-  }
+  if (ptr < RCCE_mpb_base || ptr >= RCCE_flags_start ||
+      (ptr - RCCE_mpb_base) % RCCE_LINE_SIZE) return;
+
+  line = (ptr - RCCE_mpb_base) / RCCE_LINE_SIZE;
+  if (RCCE_free_lines[line/64] & (1ULL << (line%64))) return;
+
+  RCCE_free_lines[line/64] |= 1ULL << (line%64);
+  RCCE_free_count++;
+
+#else
+
+  RCCE_BLOCK *b;
+
+  if (!RCCE_spacep || ptr < RCCE_spacep->mem || ptr >= RCCE_spacep->mem + RCCE_spacep->size ||
+      (ptr - RCCE_spacep->mem) % RCCE_LINE_SIZE) return;
+
+  b = RCCE_spacep->owner[RCCE_LINE_INDEX(ptr)];
+  if (!b) return;
 
-  // b2 is target block whose space must be freed    
-  b2 = b1->next;              
-  // tail either has zero free space, or hasn't been malloc'ed             
-  if (b2 == RCCE_spacep->tail) return;      
-
-  // reset free space for target block (entire block)                      
-  b3 = b2->next;
-  b2->free_size = b3->space - b2->space;
-
-  // determine with what non-empty blocks the target block can be merged   
-  j1 = (b1->free_size>0 && b1!=RCCE_spacep->tail); // predecessor block    
-  j2 = (b3->free_size>0 || b3==RCCE_spacep->tail); // successor block      
-
-  if (j1) {
-    if (j2) { // splice all three blocks together: (b1,b2,b3) into b1      
-      b1->next = b3->next;
-      b1->free_size +=  b3->free_size + b2->free_size;
-      if (b3==RCCE_spacep->tail) RCCE_spacep->tail = b1;
-      free(b3);
-    } 
-    else {    // only merge (b1,b2) into b1                                
-      b1->free_size += b2->free_size;
-      b1->next = b3;
+  if (b->slab) RCCE_line_free(b, ptr);
+  // ptr has to be the start of an allocated block
+  else if (b->space == ptr && !b->free_size) RCCE_block_release(b);
+
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_mpb_usage
+//--------------------------------------------------------------------------------------
+// return usage statistics of the MPB space managed by RCCE_malloc
+//--------------------------------------------------------------------------------------
+void RCCE_mpb_usage(
+  RCCE_MPB_USAGE *usage // statistics of the calling UE
+  ) {
+
+#ifndef GORY
+
+  size_t released = (size_t) RCCE_free_count * RCCE_LINE_SIZE;
+
+  // the flag area grows from the bottom, the payload chunk takes the rest
+  usage->total       = RCCE_mpb_size;
+  usage->flags       = (RCCE_flags_start - RCCE_mpb_base) - released;
+  usage->used        = usage->flags + RCCE_chunk;
+  usage->peak        = RCCE_mpb_peak + RCCE_chunk;
+  usage->largest     = RCCE_chunk;
+  usage->free_blocks = RCCE_free_count;
+
+#else
+
+  RCCE_BLOCK *b;
+  int c;
+
+  memset(usage, 0x00, sizeof(RCCE_MPB_USAGE));
+  if (!RCCE_spacep) return;
+
+  usage->total = RCCE_spacep->size;
+  usage->used  = RCCE_spacep->alloc - RCCE_spacep->slab_size + RCCE_spacep->flags;
+  usage->peak  = RCCE_spacep->peak;
+  usage->flags = RCCE_spacep->flags;
+
+  for (c = 0; c < RCCE_MALLOC_BINS; c++) {
+    for (b = RCCE_spacep->bin[c]; b; b = b->bin_next) {
+      usage->free_blocks++;
+      if (b->free_size > usage->largest) usage->largest = b->free_size;
     }
-    free(b2);
-  } 
-  else {
-    if (j2) { // only merge (b2,b3) into b2                                
-      b2->next = b3->next;
-      b2->free_size += b3->free_size;
-      if (b3==RCCE_spacep->tail) RCCE_spacep->tail = b2;
-      free(b3);
-    } 
   }
+
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_mpb_report
+//--------------------------------------------------------------------------------------
+// print the MPB usage statistics of the calling UE
+//--------------------------------------------------------------------------------------
+void RCCE_mpb_report(void) {
+  RCCE_MPB_USAGE usage;
+
+  RCCE_mpb_usage(&usage);
+  printf("UE %d: MPB %zd Bytes, used %zd (peak %zd), flags %zd, largest free block %zd, "
+         "%d free blocks\n", RCCE_IAM, usage.total, usage.used, usage.peak, usage.flags,
+         usage.largest, usage.free_blocks);
+  fflush(stdout);
 }
 
 //--------------------------------------------------------------------------------------
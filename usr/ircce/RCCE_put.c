@@ -39,7 +39,7 @@
 void *RCCE_memcpy_put(void *dest, const void *src, size_t count)
 { // function wrapper for external usage of improved memcpy()...
 #ifdef __hermit__
-  return rte_memcpy(dest, src, count);
+  return rte_memcpy_put(dest, src, count);
 #elif defined(COPPERRIDGE)
   return memcpy_to_mpb(dest, src, count);
 #else
@@ -47,7 +47,9 @@ void *RCCE_memcpy_put(void *dest, const void *src, size_t count)
 #endif
 }
 
-#if defined(COPPERRIDGE) && !defined(__hermit__)
+#ifdef __hermit__
+#define RCCE_memcpy_put(a,b,c) rte_memcpy_put(a, b, c)
+#elif defined(COPPERRIDGE)
 #define RCCE_memcpy_put(a,b,c) memcpy_to_mpb(a, b, c)
 #else
 #define RCCE_memcpy_put(a,b,c) memcpy(a, b, c)
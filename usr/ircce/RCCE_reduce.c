@@ -3,9 +3,9 @@
 //***************************************************************************************
 // Since reduction is the only message passing operation that depends on the data type, 
 // it is carried as a parameter. Also, since only collective operations require
-// communication domains, they are the only ones that use communicators. All collectives 
-// implementations are naive, linear operations. There may not be any overlap between
-// target and source.
+// communication domains, they are the only ones that use communicators. The reductions
+// combine the partial results along a binomial tree. There may not be any overlap
+// between target and source.
 //
 // Author: Rob F. Van der Wijngaart
 //         Intel Corporation
@@ -34,10 +34,221 @@
 #include <stdlib.h>
 #include <string.h>
 
+// use combination of operation and data type to reduce number of switch statements.
+// The loops are vectorized by the compiler, the code is instantiated for each
+// instruction set, which is selected at runtime.
+#define RCCE_REDUCE_OP_BODY                                                              \
+  int i;                                                                                 \
+  int    *restrict iout = (int *)    outbuf; const int    *restrict iin = (int *)    inbuf; \
+  long   *restrict lout = (long *)   outbuf; const long   *restrict lin = (long *)   inbuf; \
+  float  *restrict fout = (float *)  outbuf; const float  *restrict fin = (float *)  inbuf; \
+  double *restrict dout = (double *) outbuf; const double *restrict din = (double *) inbuf; \
+                                                                                         \
+  switch (op+(RCCE_NUM_OPS)*(type)) {                                                    \
+    case RCCE_SUM_INT:     for (i=0; i<num; i++) iout[i] += iin[i];             break;   \
+    case RCCE_MAX_INT:     for (i=0; i<num; i++) iout[i] = MAX(iout[i],iin[i]); break;   \
+    case RCCE_MIN_INT:     for (i=0; i<num; i++) iout[i] = MIN(iout[i],iin[i]); break;   \
+    case RCCE_PROD_INT:    for (i=0; i<num; i++) iout[i] *= iin[i];             break;   \
+                                                                                         \
+    case RCCE_SUM_LONG:    for (i=0; i<num; i++) lout[i] += lin[i];             break;   \
+    case RCCE_MAX_LONG:    for (i=0; i<num; i++) lout[i] = MAX(lout[i],lin[i]); break;   \
+    case RCCE_MIN_LONG:    for (i=0; i<num; i++) lout[i] = MIN(lout[i],lin[i]); break;   \
+    case RCCE_PROD_LONG:   for (i=0; i<num; i++) lout[i] *= lin[i];             break;   \
+                                                                                         \
+    case RCCE_SUM_FLOAT:   for (i=0; i<num; i++) fout[i] += fin[i];             break;   \
+    case RCCE_MAX_FLOAT:   for (i=0; i<num; i++) fout[i] = MAX(fout[i],fin[i]); break;   \
+    case RCCE_MIN_FLOAT:   for (i=0; i<num; i++) fout[i] = MIN(fout[i],fin[i]); break;   \
+    case RCCE_PROD_FLOAT:  for (i=0; i<num; i++) fout[i] *= fin[i];             break;   \
+                                                                                         \
+    case RCCE_SUM_DOUBLE:  for (i=0; i<num; i++) dout[i] += din[i];             break;   \
+    case RCCE_MAX_DOUBLE:  for (i=0; i<num; i++) dout[i] = MAX(dout[i],din[i]); break;   \
+    case RCCE_MIN_DOUBLE:  for (i=0; i<num; i++) dout[i] = MIN(dout[i],din[i]); break;   \
+    case RCCE_PROD_DOUBLE: for (i=0; i<num; i++) dout[i] *= din[i];             break;   \
+  }
+
+typedef void (*RCCE_REDUCE_KERNEL)(char *, const char *, int, int, int);
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_reduce_op_*
+//--------------------------------------------------------------------------------------
+//  combine num elements of inbuf into outbuf
+//--------------------------------------------------------------------------------------
+static void RCCE_reduce_op_generic(char *outbuf, const char *inbuf, int num, int type, int op) {
+  RCCE_REDUCE_OP_BODY
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+
+__attribute__((target("avx2")))
+static void RCCE_reduce_op_avx2(char *outbuf, const char *inbuf, int num, int type, int op) {
+  RCCE_REDUCE_OP_BODY
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static void RCCE_reduce_op_avx512(char *outbuf, const char *inbuf, int num, int type, int op) {
+  RCCE_REDUCE_OP_BODY
+}
+
+// the operating system has to save the vector registers (see XCR0)
+static unsigned long long RCCE_xgetbv(void) {
+  unsigned int eax, edx;
+
+  asm volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((unsigned long long) edx << 32) | eax;
+}
+
+static RCCE_REDUCE_KERNEL RCCE_reduce_select(void) {
+  unsigned int eax, ebx, ecx, edx;
+  unsigned long long xcr0;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    return RCCE_reduce_op_generic;
+  xcr0 = RCCE_xgetbv();
+  if ((xcr0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return RCCE_reduce_op_generic;
+
+  if ((ebx & bit_AVX512F) && (ebx & bit_AVX512DQ) && (xcr0 & 0xE0) == 0xE0)
+    return RCCE_reduce_op_avx512;
+  if (ebx & bit_AVX2)
+    return RCCE_reduce_op_avx2;
+
+  return RCCE_reduce_op_generic;
+}
+#else
+static RCCE_REDUCE_KERNEL RCCE_reduce_select(void) {
+  return RCCE_reduce_op_generic;
+}
+#endif
+
+static RCCE_REDUCE_KERNEL RCCE_reduce_kernel = NULL;
+
+void RCCE_reduce_op(char *outbuf, const char *inbuf, int num, int type, int op) {
+  if (!RCCE_reduce_kernel) RCCE_reduce_kernel = RCCE_reduce_select();
+  RCCE_reduce_kernel(outbuf, inbuf, num, type, op);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_allreduce_doubling
+//--------------------------------------------------------------------------------------
+//  recursive doubling: in step k, the UEs exchange the partial results with the UE,
+//  whose rank differs in bit k. With a size, which isn't a power of two, the first
+//  2*rem UEs combine their data pairwise before and the results are passed back after
+//  the exchange. outbuf contains the source data of the calling UE.
+//--------------------------------------------------------------------------------------
+static int RCCE_allreduce_doubling(char *outbuf, char *tmp, int num, int type_size,
+  int type, int op, int me, RCCE_COMM comm) {
+
+  size_t bytes = (size_t) num*type_size;
+  int pof2, rem, vrank, mask, dest, ierr;
+
+  for (pof2=1; pof2*2 <= comm.size; pof2*=2);
+  rem = comm.size - pof2;
+
+  if (me < 2*rem) {
+    if (!(me & 1)) {
+      if ((ierr=RCCE_send(outbuf, bytes, comm.member[me+1])))
+        return(ierr);
+      vrank = -1;
+    } else {
+      if ((ierr=RCCE_recv(tmp, bytes, comm.member[me-1])))
+        return(ierr);
+      RCCE_reduce_op(outbuf, tmp, num, type, op);
+      vrank = me / 2;
+    }
+  } else vrank = me - rem;
+
+  if (vrank >= 0) for (mask=1; mask<pof2; mask<<=1) {
+    dest = vrank ^ mask;
+    dest = (dest < rem) ? dest*2 + 1 : dest + rem;
+
+    // the synchronous send requires an order of both partners
+    if (me < dest) {
+      if ((ierr=RCCE_send(outbuf, bytes, comm.member[dest])) ||
+          (ierr=RCCE_recv(tmp, bytes, comm.member[dest])))
+        return(ierr);
+    } else {
+      if ((ierr=RCCE_recv(tmp, bytes, comm.member[dest])) ||
+          (ierr=RCCE_send(outbuf, bytes, comm.member[dest])))
+        return(ierr);
+    }
+    RCCE_reduce_op(outbuf, tmp, num, type, op);
+  }
+
+  if (me < 2*rem) {
+    if (!(me & 1))
+      return(RCCE_recv(outbuf, bytes, comm.member[me+1]));
+    else
+      return(RCCE_send(outbuf, bytes, comm.member[me-1]));
+  }
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_allreduce_ring
+//--------------------------------------------------------------------------------------
+//  ring allreduce for large vectors: the vector is split into size blocks. In the
+//  reduce-scatter phase each UE passes a block to its successor in size-1 steps and
+//  combines the received block, while the neighbours transfer their blocks. Afterwards
+//  the reduced blocks circulate in size-1 steps (allgather). Each UE transfers only
+//  2*(size-1)/size of the vector. outbuf contains the source data of the calling UE.
+//--------------------------------------------------------------------------------------
+#define RCCE_BLOCK_OFF(b) ((size_t) (b) * (num / comm.size) + MIN((b), num % comm.size))
+#define RCCE_BLOCK_LEN(b) (num / comm.size + ((b) < num % comm.size))
+
+static int RCCE_ring_step(char *sbuf, size_t slen, char *rbuf, size_t rlen, int me,
+  RCCE_COMM comm) {
+
+  int next = comm.member[(me + 1) % comm.size];
+  int prev = comm.member[(me - 1 + comm.size) % comm.size];
+  int ierr;
+
+  // even UEs send first, odd UEs receive first, which avoids a cycle of senders
+  if (!(me & 1)) {
+    if ((ierr=RCCE_send(sbuf, slen, next)) || (ierr=RCCE_recv(rbuf, rlen, prev)))
+      return(ierr);
+  } else {
+    if ((ierr=RCCE_recv(rbuf, rlen, prev)) || (ierr=RCCE_send(sbuf, slen, next)))
+      return(ierr);
+  }
+
+  return(RCCE_SUCCESS);
+}
+
+static int RCCE_allreduce_ring(char *outbuf, char *tmp, int num, int type_size,
+  int type, int op, int me, RCCE_COMM comm) {
+
+  int step, sb, rb, ierr;
+
+  for (step=0; step<comm.size-1; step++) {
+    sb = (me - step + comm.size) % comm.size;
+    rb = (me - step - 1 + 2*comm.size) % comm.size;
+    if ((ierr=RCCE_ring_step(outbuf + RCCE_BLOCK_OFF(sb)*type_size, RCCE_BLOCK_LEN(sb)*type_size,
+                             tmp, RCCE_BLOCK_LEN(rb)*type_size, me, comm)))
+      return(ierr);
+    RCCE_reduce_op(outbuf + RCCE_BLOCK_OFF(rb)*type_size, tmp, RCCE_BLOCK_LEN(rb), type, op);
+  }
+
+  // now, block me+1 is completely reduced
+  for (step=0; step<comm.size-1; step++) {
+    sb = (me + 1 - step + comm.size) % comm.size;
+    rb = (me - step + comm.size) % comm.size;
+    if ((ierr=RCCE_ring_step(outbuf + RCCE_BLOCK_OFF(sb)*type_size, RCCE_BLOCK_LEN(sb)*type_size,
+                             outbuf + RCCE_BLOCK_OFF(rb)*type_size, RCCE_BLOCK_LEN(rb)*type_size,
+                             me, comm)))
+      return(ierr);
+  }
+
+  return(RCCE_SUCCESS);
+}
+
 //--------------------------------------------------------------------------------------
 // FUNCTION: RCCE_reduce_general
 //--------------------------------------------------------------------------------------
-//  function used to implement both reduce and allreduce
+//  function used to implement both reduce and allreduce. The partial results of reduce
+//  are combined along a binomial tree, hence the reduction takes log2(size) steps.
+//  allreduce uses recursive doubling or, for large vectors, a ring.
 //--------------------------------------------------------------------------------------
 static int RCCE_reduce_general(
   char *inbuf,   // source buffer for reduction datan
@@ -50,16 +261,8 @@ static int RCCE_reduce_general(
   RCCE_COMM comm // communication domain within which to reduce
   ) {
 
-  int ue, i, type_size, ierr;
-  int    *iin, *iout;
-  long   *lin, *lout;
-  float  *fin, *fout;
-  double *din, *dout;
-  // create aliases for source and target buffers to simplify arithmetic operations
-  iin = (int *)    inbuf; iout = (int *)    outbuf;
-  lin = (long *)   inbuf; lout = (long *)   outbuf;
-  fin = (float *)  inbuf; fout = (float *)  outbuf;
-  din = (double *) inbuf; dout = (double *) outbuf;
+  int me, vrank, mask, type_size, ierr = RCCE_SUCCESS;
+  char *acc, *tmp;
 
 #ifdef GORY
   printf("Reduction only implemented for non-gory API\n");
@@ -85,51 +288,64 @@ static int RCCE_reduce_general(
     default: return(RCCE_ERROR_ILLEGAL_TYPE);
   }
 
-  if (RCCE_IAM != comm.member[root]) {
-    // non-root UEs send their source buffers to the root
-    if ((ierr=RCCE_send(inbuf, num*type_size, comm.member[root])))
-      return(ierr);
-    // in case of allreduce they also receive the reduced buffer
-    if (all) if ((ierr=RCCE_recv(outbuf, num*type_size, comm.member[root])))
+  for (me=0; me<comm.size; me++) if (comm.member[me] == RCCE_IAM) break;
+  if (me == comm.size) return(RCCE_ERROR_ID);
+
+  if (all && comm.size > 1) {
+    tmp = (char *) malloc(num*type_size);
+    if (!tmp) return(RCCE_ERROR_MALLOC);
+    memcpy(outbuf, inbuf, num*type_size);
+
+    // large vectors are bandwidth bound, small vectors latency bound
+    if (comm.size > 2 && num >= comm.size && (size_t) num*type_size >= 2*RCCE_chunk)
+      ierr = RCCE_allreduce_ring(outbuf, tmp, num, type_size, type, op, me, comm);
+    else
+      ierr = RCCE_allreduce_doubling(outbuf, tmp, num, type_size, type, op, me, comm);
+
+    free(tmp);
+    return(ierr);
+  }
+
+  vrank = (me - root + comm.size) % comm.size;
+
+  // a leaf of the tree sends its source buffer without a copy
+  if (vrank & 1) {
+    if ((ierr=RCCE_send(inbuf, num*type_size, comm.member[(vrank - 1 + root) % comm.size])))
       return(ierr);
+    goto bcast;
   }
-  else {
-    // the root can copy directly from source to target buffer
-    memcpy(outbuf, inbuf, num*type_size);
-    for (ue=0; ue<comm.size; ue++) if (ue != root) {
-      if ((ierr=RCCE_recv(inbuf, num*type_size, comm.member[ue])))
-        return(ierr);
-      
-      // use combination of operation and data type to reduce number of switch statements
-      switch (op+(RCCE_NUM_OPS)*(type)) {
-
-        case RCCE_SUM_INT:     for (i=0; i<num; i++) iout[i] += iin[i];             break;
-        case RCCE_MAX_INT:     for (i=0; i<num; i++) iout[i] = MAX(iout[i],iin[i]); break;
-        case RCCE_MIN_INT:     for (i=0; i<num; i++) iout[i] = MIN(iout[i],iin[i]); break;
-        case RCCE_PROD_INT:    for (i=0; i<num; i++) iout[i] *= iin[i];             break;
-
-        case RCCE_SUM_LONG:    for (i=0; i<num; i++) lout[i] += lin[i];             break;
-        case RCCE_MAX_LONG:    for (i=0; i<num; i++) lout[i] = MAX(lout[i],lin[i]); break;
-        case RCCE_MIN_LONG:    for (i=0; i<num; i++) lout[i] = MIN(lout[i],lin[i]); break;
-        case RCCE_PROD_LONG:   for (i=0; i<num; i++) lout[i] *= lin[i];             break;
-
-        case RCCE_SUM_FLOAT:   for (i=0; i<num; i++) fout[i] += fin[i];             break;
-        case RCCE_MAX_FLOAT:   for (i=0; i<num; i++) fout[i] = MAX(fout[i],fin[i]); break;
-        case RCCE_MIN_FLOAT:   for (i=0; i<num; i++) fout[i] = MIN(fout[i],fin[i]); break;
-        case RCCE_PROD_FLOAT:  for (i=0; i<num; i++) fout[i] *= fin[i];             break;
-
-        case RCCE_SUM_DOUBLE:  for (i=0; i<num; i++) dout[i] += din[i];             break;
-        case RCCE_MAX_DOUBLE:  for (i=0; i<num; i++) dout[i] = MAX(dout[i],din[i]); break;
-        case RCCE_MIN_DOUBLE:  for (i=0; i<num; i++) dout[i] = MIN(dout[i],din[i]); break;
-        case RCCE_PROD_DOUBLE: for (i=0; i<num; i++) dout[i] *= din[i];             break;
-      }
-    }
 
-    // in case of allreduce the root sends the reduction results to all non-root UEs
-    if (all) for (ue=0; ue<comm.size; ue++) if (ue != root)
-             if((ierr=RCCE_send(outbuf, num*type_size, comm.member[ue])))
-                return(ierr);
+  // the target buffer of non-root UEs is only used by allreduce
+  tmp = (char *) malloc(num*type_size);
+  acc = (all || vrank == 0) ? outbuf : (char *) malloc(num*type_size);
+  if (!tmp || !acc) {
+    ierr = RCCE_ERROR_MALLOC;
+    goto out;
   }
+  memcpy(acc, inbuf, num*type_size);
+
+  for (mask=1; mask<comm.size; mask<<=1) {
+    if (vrank & mask) {
+      // pass the partial result to the parent
+      ierr = RCCE_send(acc, num*type_size, comm.member[(vrank - mask + root) % comm.size]);
+      break;
+    }
+    if (vrank + mask < comm.size) {
+      if ((ierr=RCCE_recv(tmp, num*type_size, comm.member[(vrank + mask + root) % comm.size])))
+        break;
+      RCCE_reduce_op(acc, tmp, num, type, op);
+    }
+  }
+
+out:
+  free(tmp);
+  if (acc != outbuf) free(acc);
+  if (ierr) return(ierr);
+
+bcast:
+  // in case of allreduce the root sends the reduction results to all non-root UEs
+  if (all) return(RCCE_bcast(outbuf, num*type_size, root, comm));
+
   return(RCCE_SUCCESS);
 #endif // GORY
 }
@@ -127,6 +127,12 @@ int RCCE_test_flag(RCCE_FLAG flag, RCCE_FLAG_STATUS val, int *result) {
 // very simple, linear barrier 
 //--------------------------------------------------------------------------------------
 int RCCE_barrier(RCCE_COMM *comm) {
+
+#ifndef GORY
+  // use the algorithm selected by RCCE_barrier_tune()
+  if (comm->barrier != RCCE_BARRIER_LINEAR)
+    return RCCE_barrier_dispatch(comm);
+#endif
  
   t_vchar           cyclechar[RCCE_LINE_SIZE] __attribute__ ((aligned (RCCE_LINE_SIZE)));
   t_vchar           valchar  [RCCE_LINE_SIZE] __attribute__ ((aligned (RCCE_LINE_SIZE)));
@@ -338,6 +344,12 @@ int RCCE_test_tagged(RCCE_FLAG flag, RCCE_FLAG_STATUS val, int *result, void *ta
 // very simple, linear barrier 
 //--------------------------------------------------------------------------------------
 int RCCE_barrier(RCCE_COMM *comm) {
+
+#ifndef GORY
+  // use the algorithm selected by RCCE_barrier_tune()
+  if (comm->barrier != RCCE_BARRIER_LINEAR)
+    return RCCE_barrier_dispatch(comm);
+#endif
  
   volatile unsigned char cyclechar[RCCE_LINE_SIZE] __attribute__ ((aligned (RCCE_LINE_SIZE)));
   volatile unsigned char   valchar[RCCE_LINE_SIZE] __attribute__ ((aligned (RCCE_LINE_SIZE)));
@@ -0,0 +1,204 @@
+//***************************************************************************************
+// One-sided access to RMA windows.
+//***************************************************************************************
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+//    An RMA window is a region of an isle's memory, which is mapped once into
+//    the address space of all other UEs. In contrast to RCCE_put/RCCE_get,
+//    data isn't staged through the small MPB: put/get copy directly between
+//    the private buffer and the remote window, and RCCE_win_base() allows
+//    plain loads and stores into the windows of the neighbours.
+//
+//    Access epochs are separated by RCCE_win_fence() (collective) or
+//    completed per target by RCCE_win_flush().
+//
+#include "RCCE_lib.h"
+
+#ifdef __hermit__
+
+#include <string.h>
+#include "syscall.h"
+
+static int RCCE_win_type_size(int type) {
+  switch (type) {
+    case RCCE_INT:    return sizeof(int);
+    case RCCE_LONG:   return sizeof(long);
+    case RCCE_FLOAT:  return sizeof(float);
+    case RCCE_DOUBLE: return sizeof(double);
+    default:          return 0;
+  }
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_create
+//--------------------------------------------------------------------------------------
+// collective: allocate a window of size bytes on every UE and map the windows of all
+// other UEs
+//--------------------------------------------------------------------------------------
+int RCCE_win_create(size_t size, RCCE_WIN *win) {
+  int ue, error = RCCE_SUCCESS;
+
+  if (!win || !size) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_MALLOC));
+
+  memset(win, 0x00, sizeof(RCCE_WIN));
+
+  win->base[RCCE_IAM] = (t_vcharp) sys_rcce_win_alloc(RCCE_SESSION_ID, size);
+  if (!win->base[RCCE_IAM]) error = RCCE_ERROR_MALLOC;
+  else win->size[RCCE_IAM] = size;
+
+  // all windows are published after the barrier
+  RCCE_barrier(&RCCE_COMM_WORLD);
+
+  for (ue=0; ue<RCCE_NP; ue++) {
+    if (ue == RCCE_IAM) continue;
+    win->base[ue] = (t_vcharp) sys_rcce_win_map(RCCE_SESSION_ID, RC_COREID[ue], &win->size[ue]);
+    if (!win->base[ue]) error = RCCE_ERROR_MALLOC;
+  }
+
+  if (error != RCCE_SUCCESS) return(RCCE_error_return(RCCE_debug_comm,error));
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_free
+//--------------------------------------------------------------------------------------
+// collective: unmap all windows and release the own one
+//--------------------------------------------------------------------------------------
+int RCCE_win_free(RCCE_WIN *win) {
+  int ue;
+
+  if (!win) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_ID));
+
+  RCCE_barrier(&RCCE_COMM_WORLD);
+
+  for (ue=0; ue<RCCE_NP; ue++) {
+    if ((ue == RCCE_IAM) || !win->base[ue]) continue;
+    sys_rcce_win_free(RCCE_SESSION_ID, RC_COREID[ue], (size_t) win->base[ue]);
+    win->base[ue] = NULL;
+  }
+
+  // nobody references our window anymore
+  RCCE_barrier(&RCCE_COMM_WORLD);
+
+  if (win->base[RCCE_IAM])
+    sys_rcce_win_free(RCCE_SESSION_ID, RC_COREID[RCCE_IAM], (size_t) win->base[RCCE_IAM]);
+  memset(win, 0x00, sizeof(RCCE_WIN));
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_base
+//--------------------------------------------------------------------------------------
+// return the local mapping of the window of ue for direct loads and stores
+//--------------------------------------------------------------------------------------
+t_vcharp RCCE_win_base(int ue, RCCE_WIN *win) {
+  if (!win || ue < 0 || ue >= RCCE_NP) return NULL;
+
+  return win->base[ue];
+}
+
+static int RCCE_win_check(size_t offset, size_t size, int ue, RCCE_WIN *win) {
+  if (!win || ue < 0 || ue >= RCCE_NP || !win->base[ue]) return(RCCE_ERROR_ID);
+  if (offset > win->size[ue] || size > win->size[ue] - offset) return(RCCE_ERROR_MESSAGE_LENGTH);
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_put
+//--------------------------------------------------------------------------------------
+// copy size bytes from the private buffer into the window of ue at offset
+//--------------------------------------------------------------------------------------
+int RCCE_win_put(char *privbuf, size_t size, size_t offset, int ue, RCCE_WIN *win) {
+  int error = RCCE_win_check(offset, size, ue, win);
+
+  if (error != RCCE_SUCCESS) return(RCCE_error_return(RCCE_debug_comm,error));
+
+  RCCE_memcpy_put((void *)(win->base[ue] + offset), privbuf, size);
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_get
+//--------------------------------------------------------------------------------------
+// copy size bytes from the window of ue at offset into the private buffer
+//--------------------------------------------------------------------------------------
+int RCCE_win_get(char *privbuf, size_t size, size_t offset, int ue, RCCE_WIN *win) {
+  int error = RCCE_win_check(offset, size, ue, win);
+
+  if (error != RCCE_SUCCESS) return(RCCE_error_return(RCCE_debug_comm,error));
+
+  RCCE_memcpy_get(privbuf, (void *)(win->base[ue] + offset), size);
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_accumulate
+//--------------------------------------------------------------------------------------
+// combine num elements of the private buffer with the window of ue at offset; the
+// update is atomic with respect to other accumulates targeting the same UE
+//--------------------------------------------------------------------------------------
+int RCCE_win_accumulate(char *privbuf, int num, size_t offset, int type, int op,
+  int ue, RCCE_WIN *win) {
+  int type_size = RCCE_win_type_size(type);
+  int error;
+
+  if (!type_size) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_ILLEGAL_TYPE));
+  if (op < RCCE_SUM || op > RCCE_PROD) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_ILLEGAL_OP));
+  if (num < 0) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_MESSAGE_LENGTH));
+
+  error = RCCE_win_check(offset, (size_t)num*type_size, ue, win);
+  if (error != RCCE_SUCCESS) return(RCCE_error_return(RCCE_debug_comm,error));
+
+  RCCE_acquire_lock(ue);
+  RCCE_reduce_op((char *)(win->base[ue] + offset), privbuf, num, type, op);
+  RCCE_release_lock(ue);
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_flush
+//--------------------------------------------------------------------------------------
+// complete all outstanding puts to ue; afterwards, they are visible to ue
+//--------------------------------------------------------------------------------------
+int RCCE_win_flush(int ue, RCCE_WIN *win) {
+  if (!win || ue < 0 || ue >= RCCE_NP) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_ID));
+
+  // the isles are cache coherent, only the write-combining buffers of
+  // the streaming stores have to be drained
+  asm volatile ("mfence" ::: "memory");
+
+  return(RCCE_SUCCESS);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: RCCE_win_fence
+//--------------------------------------------------------------------------------------
+// collective: close the current access epoch, all puts and accumulates of all UEs
+// are visible afterwards
+//--------------------------------------------------------------------------------------
+int RCCE_win_fence(RCCE_WIN *win) {
+  if (!win) return(RCCE_error_return(RCCE_debug_comm,RCCE_ERROR_ID));
+
+  asm volatile ("mfence" ::: "memory");
+
+  return RCCE_barrier(&RCCE_COMM_WORLD);
+}
+
+#endif
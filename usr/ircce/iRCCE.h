@@ -82,6 +82,8 @@ extern const int iRCCE_ANY_LENGTH;
 
 extern const int iRCCE_ANY_SOURCE;
 
+struct _iRCCE_WAIT_LISTELEM;
+
 typedef struct _iRCCE_SEND_REQUEST {
   char *privbuf;    // source buffer in local private memory (send buffer)
   t_vcharp combuf;  // intermediate buffer in MPB
@@ -103,6 +105,8 @@ typedef struct _iRCCE_SEND_REQUEST {
   int label;        // jump/goto label for the reentrance of the respective poll function
   int finished;     // flag that indicates whether the request has already been finished
 
+  struct _iRCCE_WAIT_LISTELEM *waitelem; // wait list entry to be completed on finish
+
   struct _iRCCE_SEND_REQUEST *next;
 } iRCCE_SEND_REQUEST;
 
@@ -129,6 +133,8 @@ typedef struct _iRCCE_RECV_REQUEST {
   int finished;     // flag that indicates whether the request has already been finished
   int started;      // flag that indicates whether message parts have already been received
 
+  struct _iRCCE_WAIT_LISTELEM *waitelem; // wait list entry to be completed on finish
+
   struct _iRCCE_RECV_REQUEST *next;
 } iRCCE_RECV_REQUEST;
 
@@ -138,12 +144,16 @@ typedef struct _iRCCE_RECV_REQUEST {
 typedef struct _iRCCE_WAIT_LISTELEM {
 	int type;
 	struct _iRCCE_WAIT_LISTELEM * next;
+	struct _iRCCE_WAIT_LIST * list;
 	void * req;
 } iRCCE_WAIT_LISTELEM;
 
+// first/last form the queue of completed, not yet reported requests;
+// pending counts the requests that are still in flight
 typedef struct _iRCCE_WAIT_LIST {
 	iRCCE_WAIT_LISTELEM * first;
 	iRCCE_WAIT_LISTELEM * last;
+	int pending;
 } iRCCE_WAIT_LIST;
 
 #ifdef AIR
@@ -175,6 +185,10 @@ int   iRCCE_irecv_test(iRCCE_RECV_REQUEST *, int *);
 int   iRCCE_irecv_wait(iRCCE_RECV_REQUEST *);
 int   iRCCE_irecv_push(void);
 //
+//  Background progress of pending non-blocking requests:
+int   iRCCE_progress_start(unsigned int);
+int   iRCCE_progress_stop(void);
+//
 //  Pipelined send/recv functions: (syncronous and blocking)
 int   iRCCE_ssend(char *, ssize_t, int);
 int   iRCCE_srecv(char *, ssize_t, int);
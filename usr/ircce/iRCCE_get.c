@@ -39,7 +39,7 @@
 void* iRCCE_memcpy_get(void *dest, const void *src, size_t count)
 {
 #ifdef __hermit__
-  return rte_memcpy(dest, src, count);
+  return rte_memcpy_get(dest, src, count);
 #elif defined COPPERRIDGE || defined SCC
   return memcpy_from_mpb(dest, src, count);
 #else
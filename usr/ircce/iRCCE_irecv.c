@@ -69,7 +69,7 @@
 #warning iRCCE_ANY_LENGTH: for using this wildcard, iRCCE must be built against RCCE release V1.0.13!
 #endif
 
-static int iRCCE_push_recv_request(iRCCE_RECV_REQUEST *request) {
+static int iRCCE_progress_recv_request(iRCCE_RECV_REQUEST *request) {
 
 	char padline[RCCE_LINE_SIZE]; // copy buffer, used if message not multiple of line size
 	int  test;                    // flag for calling iRCCE_test_flag()
@@ -174,6 +174,23 @@ label3:
 	return(iRCCE_SUCCESS);
 }
 
+static int iRCCE_push_recv_request(iRCCE_RECV_REQUEST *request) {
+
+	int ret;
+
+	if(request->finished) return(iRCCE_SUCCESS);
+
+	ret = iRCCE_progress_recv_request(request);
+
+	// hand the request over to the completion queue of its wait list
+	if(request->finished && request->waitelem) {
+		iRCCE_wait_list_complete(request->waitelem);
+		request->waitelem = NULL;
+	}
+
+	return ret;
+}
+
 static void iRCCE_init_recv_request(
 		char *privbuf,    // source buffer in local private memory (send buffer)
 		t_vcharp combuf,  // intermediate buffer in MPB
@@ -208,6 +225,7 @@ static void iRCCE_init_recv_request(
 	request->finished  = 0;
 	request->started   = 0;
 
+	request->waitelem  = NULL;
 	request->next      = NULL;
 
 #ifndef _iRCCE_ANY_LENGTH_
@@ -368,12 +386,24 @@ inline static int iRCCE_irecv_generic(char *privbuf, ssize_t size, int source, i
 
 int iRCCE_irecv(char *privbuf, ssize_t size, int dest, iRCCE_RECV_REQUEST *request) {
 
-	return iRCCE_irecv_generic(privbuf, size, dest, request, 0);
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_irecv_generic(privbuf, size, dest, request, 0);
+	iRCCE_progress_unlock();
+
+	return ret;
 }
 
 int iRCCE_isrecv(char *privbuf, ssize_t size, int dest, iRCCE_RECV_REQUEST *request) {
 
-	return iRCCE_irecv_generic(privbuf, size, dest, request, 1);
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_irecv_generic(privbuf, size, dest, request, 1);
+	iRCCE_progress_unlock();
+
+	return ret;
 }
 
 
@@ -382,7 +412,7 @@ int iRCCE_isrecv(char *privbuf, ssize_t size, int dest, iRCCE_RECV_REQUEST *requ
 //--------------------------------------------------------------------------------------
 // probe for incomming messages (non-blocking / does not receive)
 //--------------------------------------------------------------------------------------
-int iRCCE_iprobe(int source, int* test_rank, int* test_flag)
+static int iRCCE_iprobe_source(int source, int* test_rank, int* test_flag)
 {
 	// determine source of request if given source = iRCCE_ANY_SOURCE
 	if( source == iRCCE_ANY_SOURCE ) {
@@ -418,6 +448,17 @@ int iRCCE_iprobe(int source, int* test_rank, int* test_flag)
 	return  iRCCE_SUCCESS;
 }
 
+int iRCCE_iprobe(int source, int* test_rank, int* test_flag)
+{
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_iprobe_source(source, test_rank, test_flag);
+	iRCCE_progress_unlock();
+
+	return ret;
+}
+
 
 //--------------------------------------------------------------------------------------
 // FUNCTION: iRCCE_irecv_test
@@ -425,7 +466,7 @@ int iRCCE_iprobe(int source, int* test_rank, int* test_flag)
 // test function for completion of the requestes non-blocking recv operation
 // Just provide NULL instead of the testvar if you don't need it
 //--------------------------------------------------------------------------------------
-int iRCCE_irecv_test(iRCCE_RECV_REQUEST *request, int *test) {
+static int iRCCE_irecv_test_request(iRCCE_RECV_REQUEST *request, int *test) {
 
 	int source;
 
@@ -535,6 +576,17 @@ int iRCCE_irecv_test(iRCCE_RECV_REQUEST *request, int *test) {
 	}
 }
 
+int iRCCE_irecv_test(iRCCE_RECV_REQUEST *request, int *test) {
+
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_irecv_test_request(request, test);
+	iRCCE_progress_unlock();
+
+	return ret;
+}
+
 
 //--------------------------------------------------------------------------------------
 // FUNCTION: iRCCE_irecv_push
@@ -563,7 +615,7 @@ static int iRCCE_irecv_push_source(int source) {
 	return(iRCCE_PENDING);
 }
 
-int iRCCE_irecv_push(void) {
+static int iRCCE_irecv_push_queues(void) {
 	iRCCE_RECV_REQUEST* help_request;
 	
 	// first check sourceless requests
@@ -614,6 +666,17 @@ int iRCCE_irecv_push(void) {
 	return (iRCCE_irecv_any_source_queue == NULL)? retval : iRCCE_RESERVED;
 }
 
+int iRCCE_irecv_push(void) {
+
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_irecv_push_queues();
+	iRCCE_progress_unlock();
+
+	return ret;
+}
+
 //--------------------------------------------------------------------------------------
 // FUNCTION: iRCCE_irecv_wait
 //--------------------------------------------------------------------------------------
@@ -643,7 +706,7 @@ int iRCCE_irecv_wait(iRCCE_RECV_REQUEST *request) {
 //--------------------------------------------------------------------------------------
 // try to cancel a pending non-blocking recv request
 //--------------------------------------------------------------------------------------
-int iRCCE_irecv_cancel(iRCCE_RECV_REQUEST *request, int *test) {
+static int iRCCE_irecv_cancel_request(iRCCE_RECV_REQUEST *request, int *test) {
   
 	int source;
 	iRCCE_RECV_REQUEST *run;
@@ -709,4 +772,13 @@ int iRCCE_irecv_cancel(iRCCE_RECV_REQUEST *request, int *test) {
 	return iRCCE_NOT_ENQUEUED;
 }
 
+int iRCCE_irecv_cancel(iRCCE_RECV_REQUEST *request, int *test) {
+
+	int ret;
 
+	iRCCE_progress_lock();
+	ret = iRCCE_irecv_cancel_request(request, test);
+	iRCCE_progress_unlock();
+
+	return ret;
+}
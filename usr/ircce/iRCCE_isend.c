@@ -53,7 +53,7 @@
 #define memcpy_scc memcpy
 #endif
 
-static int iRCCE_push_send_request(iRCCE_SEND_REQUEST *request) {
+static int iRCCE_progress_send_request(iRCCE_SEND_REQUEST *request) {
 
 	char padline[RCCE_LINE_SIZE]; // copy buffer, used if message not multiple of line size
 	int   test;       // flag for calling iRCCE_test_flag()
@@ -137,6 +137,23 @@ label3:
 	return(iRCCE_SUCCESS);
 }
 
+static int iRCCE_push_send_request(iRCCE_SEND_REQUEST *request) {
+
+	int ret;
+
+	if(request->finished) return(iRCCE_SUCCESS);
+
+	ret = iRCCE_progress_send_request(request);
+
+	// hand the request over to the completion queue of its wait list
+	if(request->finished && request->waitelem) {
+		iRCCE_wait_list_complete(request->waitelem);
+		request->waitelem = NULL;
+	}
+
+	return ret;
+}
+
 static void iRCCE_init_send_request(
 		char *privbuf,    // source buffer in local private memory (send buffer)
 		t_vcharp combuf,  // intermediate buffer in MPB
@@ -170,6 +187,7 @@ static void iRCCE_init_send_request(
 
 	request->finished  = 0;
 
+	request->waitelem  = NULL;
 	request->next      = NULL;
 
 #ifndef _iRCCE_ANY_LENGTH_
@@ -256,12 +274,24 @@ inline static int iRCCE_isend_generic(char *privbuf, ssize_t size, int dest, iRC
 
 int iRCCE_isend(char *privbuf, ssize_t size, int dest, iRCCE_SEND_REQUEST *request) {
 
-	return iRCCE_isend_generic(privbuf, size, dest, request, 0);
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_isend_generic(privbuf, size, dest, request, 0);
+	iRCCE_progress_unlock();
+
+	return ret;
 }
 
 int iRCCE_issend(char *privbuf, ssize_t size, int dest, iRCCE_SEND_REQUEST *request) {
 
-	return iRCCE_isend_generic(privbuf, size, dest, request, 1);
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_isend_generic(privbuf, size, dest, request, 1);
+	iRCCE_progress_unlock();
+
+	return ret;
 }
 
 
@@ -271,7 +301,7 @@ int iRCCE_issend(char *privbuf, ssize_t size, int dest, iRCCE_SEND_REQUEST *requ
 //--------------------------------------------------------------------------------------
 // progress function for pending requests in the isend queue 
 //--------------------------------------------------------------------------------------
-int iRCCE_isend_push(void) {
+static int iRCCE_isend_push_queue(void) {
 
 	iRCCE_SEND_REQUEST *request = iRCCE_isend_queue;
 
@@ -293,6 +323,17 @@ int iRCCE_isend_push(void) {
 	return(iRCCE_PENDING);
 }
 
+int iRCCE_isend_push(void) {
+
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_isend_push_queue();
+	iRCCE_progress_unlock();
+
+	return ret;
+}
+
 
 //--------------------------------------------------------------------------------------
 // FUNCTION: iRCCE_isend_test
@@ -300,7 +341,7 @@ int iRCCE_isend_push(void) {
 // test function for completion of the requestes non-blocking send operation
 // Just provide NULL instead of testvar if you don't need it
 //--------------------------------------------------------------------------------------
-int iRCCE_isend_test(iRCCE_SEND_REQUEST *request, int *test) {
+static int iRCCE_isend_test_request(iRCCE_SEND_REQUEST *request, int *test) {
 
 	if(request == NULL) {
 
@@ -344,6 +385,17 @@ int iRCCE_isend_test(iRCCE_SEND_REQUEST *request, int *test) {
 	return(iRCCE_PENDING);
 }
 
+int iRCCE_isend_test(iRCCE_SEND_REQUEST *request, int *test) {
+
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_isend_test_request(request, test);
+	iRCCE_progress_unlock();
+
+	return ret;
+}
+
 
 //--------------------------------------------------------------------------------------
 // FUNCTION: iRCCE_isend_wait
@@ -378,7 +430,7 @@ int iRCCE_isend_wait(iRCCE_SEND_REQUEST *request) {
 //--------------------------------------------------------------------------------------
 // try to cancel a pending non-blocking send request
 //--------------------------------------------------------------------------------------
-int iRCCE_isend_cancel(iRCCE_SEND_REQUEST *request, int *test) {
+static int iRCCE_isend_cancel_request(iRCCE_SEND_REQUEST *request, int *test) {
   
 	iRCCE_SEND_REQUEST *run;
   
@@ -412,3 +464,14 @@ int iRCCE_isend_cancel(iRCCE_SEND_REQUEST *request, int *test) {
 	if (test) (*test) = 0;
 	return iRCCE_NOT_ENQUEUED;
 }
+
+int iRCCE_isend_cancel(iRCCE_SEND_REQUEST *request, int *test) {
+
+	int ret;
+
+	iRCCE_progress_lock();
+	ret = iRCCE_isend_cancel_request(request, test);
+	iRCCE_progress_unlock();
+
+	return ret;
+}
@@ -55,6 +55,20 @@ extern int iRCCE_recent_length;
 #pragma omp threadprivate (iRCCE_isend_queue, iRCCE_irecv_queue, iRCCE_irecv_any_source_queue, iRCCE_recent_source, iRCCE_recent_length)
 #endif
 
+// default sleep time (in usec) of the progress thread while no request is pending
+#define iRCCE_PROGRESS_INTERVAL 100
+
+#ifdef __hermit__
+extern volatile int iRCCE_progress_active;
+void iRCCE_progress_lock(void);
+void iRCCE_progress_unlock(void);
+#else
+#define iRCCE_progress_lock()
+#define iRCCE_progress_unlock()
+#endif
+
+void iRCCE_wait_list_complete(iRCCE_WAIT_LISTELEM *elem);
+
 int iRCCE_test_flag(RCCE_FLAG, RCCE_FLAG_STATUS, int *);
 int iRCCE_push_ssend_request(iRCCE_SEND_REQUEST *request);
 int iRCCE_push_srecv_request(iRCCE_RECV_REQUEST *request);
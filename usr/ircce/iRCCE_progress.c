@@ -0,0 +1,168 @@
+//***************************************************************************************
+// Asynchronous progress engine for non-blocking send/recv requests.
+//***************************************************************************************
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+//    Without this engine, pending requests in the isend/irecv queues only move
+//    forward when the application calls one of the push/test/wait functions.
+//    iRCCE_progress_start() spawns a helper thread that pushes both queues in
+//    the background, so that large non-blocking transfers complete while the
+//    application is computing. All functions touching the request queues
+//    serialize against this thread via iRCCE_progress_lock().
+//
+
+#ifdef GORY
+#error iRCCE _cannot_ be built in GORY mode!
+#endif
+
+#include "iRCCE_lib.h"
+
+#ifdef __hermit__
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+volatile int iRCCE_progress_active = 0;
+
+static pthread_mutex_t iRCCE_progress_mutex;
+static pthread_t iRCCE_progress_thread;
+static volatile int iRCCE_progress_stopping = 0;
+static unsigned int iRCCE_progress_interval = iRCCE_PROGRESS_INTERVAL;
+
+static int iRCCE_progress_idle(void)
+{
+	int i;
+
+	if (iRCCE_isend_queue || iRCCE_irecv_any_source_queue)
+		return 0;
+
+	for(i=0; i<RCCE_NP; i++)
+		if (iRCCE_irecv_queue[i])
+			return 0;
+
+	return 1;
+}
+
+static void* iRCCE_progress_loop(void* arg)
+{
+	int idle;
+
+	while(!iRCCE_progress_stopping) {
+		idle = 1;
+
+		// never block the application: if it is inside the library,
+		// it is making progress on its own
+		if (pthread_mutex_trylock(&iRCCE_progress_mutex) == 0) {
+			iRCCE_isend_push();
+			iRCCE_irecv_push();
+			idle = iRCCE_progress_idle();
+			pthread_mutex_unlock(&iRCCE_progress_mutex);
+		}
+
+		if (idle && iRCCE_progress_interval)
+			usleep(iRCCE_progress_interval);
+		else
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: iRCCE_progress_lock / iRCCE_progress_unlock
+//--------------------------------------------------------------------------------------
+// serialize access to the request queues against the progress thread; the lock is
+// recursive, because the public functions call each other
+//--------------------------------------------------------------------------------------
+void iRCCE_progress_lock(void)
+{
+	if (iRCCE_progress_active)
+		pthread_mutex_lock(&iRCCE_progress_mutex);
+}
+
+void iRCCE_progress_unlock(void)
+{
+	if (iRCCE_progress_active)
+		pthread_mutex_unlock(&iRCCE_progress_mutex);
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: iRCCE_progress_start
+//--------------------------------------------------------------------------------------
+// start the background progress thread; while no request is pending, the thread
+// sleeps for interval microseconds between two polls (0 = yield only)
+//--------------------------------------------------------------------------------------
+int iRCCE_progress_start(unsigned int interval)
+{
+	pthread_mutexattr_t attr;
+
+	if (iRCCE_progress_active)
+		return iRCCE_SUCCESS;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (pthread_mutex_init(&iRCCE_progress_mutex, &attr)) {
+		pthread_mutexattr_destroy(&attr);
+		return iRCCE_ERROR;
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	iRCCE_progress_interval = interval;
+	iRCCE_progress_stopping = 0;
+	// enable locking before the thread touches any queue
+	iRCCE_progress_active = 1;
+
+	if (pthread_create(&iRCCE_progress_thread, NULL, iRCCE_progress_loop, NULL)) {
+		iRCCE_progress_active = 0;
+		pthread_mutex_destroy(&iRCCE_progress_mutex);
+		return iRCCE_ERROR;
+	}
+
+	return iRCCE_SUCCESS;
+}
+
+//--------------------------------------------------------------------------------------
+// FUNCTION: iRCCE_progress_stop
+//--------------------------------------------------------------------------------------
+// stop the progress thread; pending requests are left in their queues and are
+// progressed by the application's push/test/wait calls again
+//--------------------------------------------------------------------------------------
+int iRCCE_progress_stop(void)
+{
+	if (!iRCCE_progress_active)
+		return iRCCE_SUCCESS;
+
+	iRCCE_progress_stopping = 1;
+	pthread_join(iRCCE_progress_thread, NULL);
+
+	iRCCE_progress_active = 0;
+	pthread_mutex_destroy(&iRCCE_progress_mutex);
+
+	return iRCCE_SUCCESS;
+}
+
+#else
+
+int iRCCE_progress_start(unsigned int interval)
+{
+	return iRCCE_ERROR;
+}
+
+int iRCCE_progress_stop(void)
+{
+	return iRCCE_SUCCESS;
+}
+
+#endif
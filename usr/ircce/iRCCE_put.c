@@ -41,7 +41,9 @@
 
 void* iRCCE_memcpy_put(void *dest, const void *src, size_t count)
 {
-#if defined COPPERRIDGE || defined SCC
+#ifdef __hermit__
+  return rte_memcpy_put(dest, src, count);
+#elif defined COPPERRIDGE || defined SCC
   return memcpy_to_mpb(dest, src, count);
 #else
   return memcpy(dest, src, count);
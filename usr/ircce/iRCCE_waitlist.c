@@ -31,18 +31,50 @@ void iRCCE_init_wait_list(iRCCE_WAIT_LIST *list)
 {
 	list->first = NULL;
 	list->last = NULL;
+	list->pending = 0;
 }
 
-static void iRCCE_add_wait_list_generic(iRCCE_WAIT_LIST *list, iRCCE_WAIT_LISTELEM * elem)
+//--------------------------------------------------------------------------------------
+// FUNCTION: iRCCE_wait_list_complete
+//--------------------------------------------------------------------------------------
+// Called by the push routines when a request of a wait list has been finished:
+// appends its element to the completion queue of the list
+//--------------------------------------------------------------------------------------
+void iRCCE_wait_list_complete(iRCCE_WAIT_LISTELEM *elem)
 {
-	if (list->first == NULL) {
+	iRCCE_WAIT_LIST *list = elem->list;
+
+	elem->next = NULL;
+	if (list->first == NULL)
 		list->first = elem;
-		list->last = elem;
-		return;
+	else
+		list->last->next = elem;
+	list->last = elem;
+	list->pending--;
+}
+
+static iRCCE_WAIT_LISTELEM* iRCCE_wait_list_dequeue(iRCCE_WAIT_LIST *list)
+{
+	iRCCE_WAIT_LISTELEM *elem = list->first;
+
+	if (elem != NULL) {
+		list->first = elem->next;
+		if (list->first == NULL)
+			list->last = NULL;
 	}
 
-	list->last->next = elem;
-	list->last = elem;
+	return elem;
+}
+
+static void iRCCE_add_wait_list_generic(iRCCE_WAIT_LIST *list, iRCCE_WAIT_LISTELEM * elem, int finished)
+{
+	elem->next = NULL;
+	elem->list = list;
+
+	// already finished requests are directly queued as completed
+	list->pending++;
+	if (finished)
+		iRCCE_wait_list_complete(elem);
 }
 
 //--------------------------------------------------------------------------------------
@@ -56,9 +88,13 @@ void iRCCE_add_send_to_wait_list(iRCCE_WAIT_LIST *list, iRCCE_SEND_REQUEST * req
 	elem = (iRCCE_WAIT_LISTELEM*)malloc(sizeof(iRCCE_WAIT_LISTELEM));
 
 	elem->type = iRCCE_WAIT_LIST_SEND_TYPE;
-	elem->next = NULL;
 	elem->req = (void*)req;
-	iRCCE_add_wait_list_generic(list, elem);
+
+	iRCCE_progress_lock();
+	if (!req->finished)
+		req->waitelem = elem;
+	iRCCE_add_wait_list_generic(list, elem, req->finished);
+	iRCCE_progress_unlock();
 
 	return;
 }
@@ -74,9 +110,13 @@ void iRCCE_add_recv_to_wait_list(iRCCE_WAIT_LIST *list, iRCCE_RECV_REQUEST * req
 	elem = (iRCCE_WAIT_LISTELEM*)malloc(sizeof(iRCCE_WAIT_LISTELEM));
 
 	elem->type = iRCCE_WAIT_LIST_RECV_TYPE;
-	elem->next = NULL;
 	elem->req = (void*)req;
-	iRCCE_add_wait_list_generic(list, elem);
+
+	iRCCE_progress_lock();
+	if (!req->finished)
+		req->waitelem = elem;
+	iRCCE_add_wait_list_generic(list, elem, req->finished);
+	iRCCE_progress_unlock();
 
 	return;
 }
@@ -115,43 +155,19 @@ int iRCCE_wait_all(iRCCE_WAIT_LIST *list)
 int iRCCE_test_all(iRCCE_WAIT_LIST *list, int *test)
 {
 	int retval = iRCCE_SUCCESS;
-	int req_state;
 	iRCCE_WAIT_LISTELEM *pElem;
-	iRCCE_WAIT_LISTELEM *pLastElem;
-	iRCCE_WAIT_LISTELEM *pTemp;
-	pLastElem = NULL;
-	pElem = list->first;
-
-	while (pElem != NULL) {
-		if (pElem->type == iRCCE_WAIT_LIST_SEND_TYPE)
-			req_state = iRCCE_isend_test((iRCCE_SEND_REQUEST*)pElem->req, NULL);
-		else
-			req_state = iRCCE_irecv_test((iRCCE_RECV_REQUEST*)pElem->req, NULL);
 
-		if (req_state == iRCCE_SUCCESS) {
-			// Remove this element from the list
-			if (pElem == list->first) {
-				list->first = pElem->next;
-			}
-			else if (pElem == list->last) {
-				list->last = pLastElem;
-				pLastElem->next = NULL;
-			}
-			else {
-				pLastElem->next = pElem->next;
-			}
-
-			pTemp = pElem->next;
-			free(pElem);
-			pElem = pTemp;
-		} 
-		else {
-			retval = iRCCE_PENDING;
+	// progress the request queues; finished requests of this list are
+	// moved to its completion queue by the push routines
+	iRCCE_isend_push();
+	iRCCE_irecv_push();
 
-			pLastElem = pElem;
-			pElem = pElem->next;
-		}
-	}
+	iRCCE_progress_lock();
+	while ((pElem = iRCCE_wait_list_dequeue(list)) != NULL)
+		free(pElem);
+	if (list->pending)
+		retval = iRCCE_PENDING;
+	iRCCE_progress_unlock();
 
 	if (test) {
 		if (retval ==  iRCCE_SUCCESS) {
@@ -184,60 +200,42 @@ int iRCCE_wait_any(iRCCE_WAIT_LIST *list, iRCCE_SEND_REQUEST ** send_request, iR
 //--------------------------------------------------------------------------------------
 int iRCCE_test_any(iRCCE_WAIT_LIST *list, iRCCE_SEND_REQUEST ** send_request, iRCCE_RECV_REQUEST ** recv_request)
 {
-	int req_state;
-	
 	iRCCE_WAIT_LISTELEM *pElem;
-	iRCCE_WAIT_LISTELEM *pLastElem;
-	iRCCE_WAIT_LISTELEM *pTemp;
-	pLastElem = NULL;
-	pElem = list->first;
-
-	while (pElem != NULL) {
-		if (pElem->type == iRCCE_WAIT_LIST_SEND_TYPE)
-			req_state = iRCCE_isend_test((iRCCE_SEND_REQUEST*)pElem->req, NULL);
-		else
-			req_state = iRCCE_irecv_test((iRCCE_RECV_REQUEST*)pElem->req, NULL);
 
-		if (req_state == iRCCE_SUCCESS) {
-			// Remove this element from the list
-			if (pElem == list->first) {
-				list->first = pElem->next;
-			}
-			else if (pElem == list->last) {
-				list->last = pLastElem;
-				pLastElem->next = NULL;
-			}
-			else {
-				pLastElem->next = pElem->next;
-			}
+	iRCCE_progress_lock();
+	pElem = iRCCE_wait_list_dequeue(list);
+	iRCCE_progress_unlock();
+
+	if (pElem == NULL) {
+		iRCCE_isend_push();
+		iRCCE_irecv_push();
 
-			if (pElem->type == iRCCE_WAIT_LIST_SEND_TYPE) {
-				if(send_request) {
-					(*send_request) = (iRCCE_SEND_REQUEST*)pElem->req;
-				}
-				if(recv_request) {
-					(*recv_request) = NULL;
-				}
+		iRCCE_progress_lock();
+		pElem = iRCCE_wait_list_dequeue(list);
+		iRCCE_progress_unlock();
+	}
+
+	if (pElem != NULL) {
+		if (pElem->type == iRCCE_WAIT_LIST_SEND_TYPE) {
+			if(send_request) {
+				(*send_request) = (iRCCE_SEND_REQUEST*)pElem->req;
 			}
-			else {
-				if(send_request) {
-					(*send_request) = NULL;
-				}
-				if(recv_request) {
-					(*recv_request) = (iRCCE_RECV_REQUEST*)pElem->req;
-				}
+			if(recv_request) {
+				(*recv_request) = NULL;
 			}
-
-			pTemp = pElem->next;
-			free(pElem);
-			pElem = pTemp;
-			
-			return iRCCE_SUCCESS;
-		} 
+		}
 		else {
-			pLastElem = pElem;
-			pElem = pElem->next;
+			if(send_request) {
+				(*send_request) = NULL;
+			}
+			if(recv_request) {
+				(*recv_request) = (iRCCE_RECV_REQUEST*)pElem->req;
+			}
 		}
+
+		free(pElem);
+
+		return iRCCE_SUCCESS;
 	}
 
 	if(send_request) {
@@ -889,6 +889,160 @@ static inline void * rte_memcpy(void *dst, const void *src, size_t n)
 
 #endif
 
+/**
+ * Copies into the MPB of another isle, which are larger than this threshold,
+ * bypass the caches of the sender (see rte_memcpy_put).
+ */
+#ifndef RTE_MEMCPY_NT_THRESHOLD
+#define RTE_MEMCPY_NT_THRESHOLD		(8*1024)
+#endif
+
+/**
+ * Distance in bytes, which the receiver prefetches ahead (see rte_memcpy_get).
+ */
+#define RTE_MEMCPY_PREFETCH		512
+
+typedef void (*rte_memcpy_nt_t)(uint8_t *dst, const uint8_t *src, size_t n);
+
+/**
+ * Copy n bytes, which are a multiple of 64, to the 64-byte aligned dst with
+ * non-temporal stores. The variants are selected at runtime.
+ */
+__attribute__((target("avx512f")))
+static inline void
+rte_mov_nt_avx512(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 64; n -= 64, dst += 64, src += 64) {
+		_mm_prefetch((const char *)(src + RTE_MEMCPY_PREFETCH), _MM_HINT_NTA);
+		_mm512_stream_si512((void *)dst, _mm512_loadu_si512((const void *)src));
+	}
+}
+
+__attribute__((target("avx")))
+static inline void
+rte_mov_nt_avx(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 64; n -= 64, dst += 64, src += 64) {
+		_mm_prefetch((const char *)(src + RTE_MEMCPY_PREFETCH), _MM_HINT_NTA);
+		_mm256_stream_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+		_mm256_stream_si256((__m256i *)(dst + 32), _mm256_loadu_si256((const __m256i *)(src + 32)));
+	}
+}
+
+__attribute__((target("sse2")))
+static inline void
+rte_mov_nt_sse2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 64; n -= 64, dst += 64, src += 64) {
+		_mm_prefetch((const char *)(src + RTE_MEMCPY_PREFETCH), _MM_HINT_NTA);
+		_mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+		_mm_stream_si128((__m128i *)(dst + 16), _mm_loadu_si128((const __m128i *)(src + 16)));
+		_mm_stream_si128((__m128i *)(dst + 32), _mm_loadu_si128((const __m128i *)(src + 32)));
+		_mm_stream_si128((__m128i *)(dst + 48), _mm_loadu_si128((const __m128i *)(src + 48)));
+	}
+}
+
+/**
+ * Select the widest non-temporal copy, which the processor and the
+ * operating system (XCR0) support.
+ */
+static inline rte_memcpy_nt_t
+rte_memcpy_nt_select(void)
+{
+	uint32_t eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+	__asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "0"(1), "2"(0));
+	if (!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+		return rte_mov_nt_sse2;
+
+	__asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	if ((xcr0_lo & 0x6) != 0x6)
+		return rte_mov_nt_sse2;
+
+	__asm__ volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "0"(7), "2"(0));
+	if ((ebx & (1 << 16)) && ((xcr0_lo & 0xE0) == 0xE0))
+		return rte_mov_nt_avx512;
+
+	return rte_mov_nt_avx;
+}
+
+/**
+ * Copy bytes with non-temporal stores, which don't evict the working set
+ * of the caller. The stores are ordered by a sfence.
+ */
+static inline void *
+rte_memcpy_nt(void *dst, const void *src, size_t n)
+{
+	static rte_memcpy_nt_t mov_nt = NULL;
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	size_t head = (64 - ((uintptr_t)d & 63)) & 63;
+
+	if (n < head + 64)
+		return rte_memcpy(dst, src, n);
+
+	if (!mov_nt)
+		mov_nt = rte_memcpy_nt_select();
+
+	// the streaming stores require an aligned destination
+	rte_memcpy(d, s, head);
+	d += head;
+	s += head;
+	n -= head;
+
+	mov_nt(d, s, n & ~(size_t)63);
+	d += n & ~(size_t)63;
+	s += n & ~(size_t)63;
+	rte_memcpy(d, s, n & 63);
+
+	_mm_sfence();
+
+	return dst;
+}
+
+/**
+ * Copy into the MPB of another isle, large copies use non-temporal stores.
+ */
+static inline void *
+rte_memcpy_put(void *dst, const void *src, size_t n)
+{
+	if (n >= RTE_MEMCPY_NT_THRESHOLD)
+		return rte_memcpy_nt(dst, src, n);
+
+	return rte_memcpy(dst, src, n);
+}
+
+/**
+ * Copy from the MPB of another isle, large copies prefetch the source ahead,
+ * because the data isn't in the cache of the receiver.
+ */
+static inline void *
+rte_memcpy_get(void *dst, const void *src, size_t n)
+{
+	const uint8_t *s = (const uint8_t *)src;
+	uint8_t *d = (uint8_t *)dst;
+	size_t i, len;
+
+	if (n < RTE_MEMCPY_NT_THRESHOLD)
+		return rte_memcpy(dst, src, n);
+
+	for (i = 0; i < RTE_MEMCPY_PREFETCH; i += 64)
+		_mm_prefetch((const char *)(s + i), _MM_HINT_T0);
+
+	for (i = 0; i < n; i += len) {
+		len = n - i < RTE_MEMCPY_PREFETCH ? n - i : RTE_MEMCPY_PREFETCH;
+		if (i + len + RTE_MEMCPY_PREFETCH <= n) {
+			size_t j;
+
+			for (j = 0; j < len; j += 64)
+				_mm_prefetch((const char *)(s + i + RTE_MEMCPY_PREFETCH + j), _MM_HINT_T0);
+		}
+		rte_memcpy(d + i, s + i, len);
+	}
+
+	return dst;
+}
+
 #ifdef __cplusplus
 }
 #endif
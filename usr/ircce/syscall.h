@@ -87,6 +87,9 @@ size_t sys_get_ticks(void);
 int sys_rcce_init(int session_id);
 size_t sys_rcce_malloc(int session_id, int ue);
 int sys_rcce_fini(int session_id);
+size_t sys_rcce_win_alloc(int session_id, size_t size);
+size_t sys_rcce_win_map(int session_id, int ue, size_t* size);
+int sys_rcce_win_free(int session_id, int ue, size_t vaddr);
 
 #define __NR_exit 		0
 #define __NR_write		1
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2018, RWTH Aachen University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the University nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <hermit/syscall.h>
+
+#define THREAD_COUNT	4
+#define ITERATIONS	100000
+
+#define FUTEX_WAIT	0
+#define FUTEX_WAKE	1
+
+#define EAGAIN		11
+#define ETIMEDOUT	110
+
+// 0 = unlocked, 1 = locked, 2 = locked with waiters
+static int32_t mutex = 0;
+static volatile int counter = 0;
+
+static void mutex_lock(int32_t* m)
+{
+	int32_t c = __sync_val_compare_and_swap(m, 0, 1);
+
+	// uncontended case without a system call
+	if (!c)
+		return;
+
+	if (c != 2)
+		c = __sync_lock_test_and_set(m, 2);
+	while (c) {
+		sys_futex(m, FUTEX_WAIT, 2, 0, NULL, 0);
+		c = __sync_lock_test_and_set(m, 2);
+	}
+}
+
+static void mutex_unlock(int32_t* m)
+{
+	if (__sync_fetch_and_sub(m, 1) != 1) {
+		*m = 0;
+		__sync_synchronize();
+		sys_futex(m, FUTEX_WAKE, 1, 0, NULL, 0);
+	}
+}
+
+static void* thread_func(void* arg)
+{
+	for(int i=0; i<ITERATIONS; i++) {
+		mutex_lock(&mutex);
+		counter++;
+		mutex_unlock(&mutex);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	pthread_t threads[THREAD_COUNT];
+	int32_t val = 42;
+	int i, ret;
+
+	ret = sys_futex(&val, FUTEX_WAIT, 0, 0, NULL, 0);
+	if (ret != -EAGAIN) {
+		printf("FUTEX_WAIT with wrong value returns %d\n", ret);
+		return 1;
+	}
+
+	// wait 10 ms
+	ret = sys_futex(&val, FUTEX_WAIT, 42, 10000, NULL, 0);
+	if (ret != -ETIMEDOUT) {
+		printf("FUTEX_WAIT with timeout returns %d\n", ret);
+		return 1;
+	}
+
+	for(i=0; i<THREAD_COUNT; i++) {
+		ret = pthread_create(threads+i, NULL, thread_func, NULL);
+		if (ret) {
+			printf("Thread creation failed! error =  %d\n", ret);
+			return ret;
+		}
+	}
+
+	for(i=0; i<THREAD_COUNT; i++)
+		pthread_join(threads[i], NULL);
+
+	if (counter != THREAD_COUNT * ITERATIONS) {
+		printf("Counter is %d, expected %d\n", counter, THREAD_COUNT * ITERATIONS);
+		return 1;
+	}
+
+	printf("Futex test passed\n");
+
+	return 0;
+}
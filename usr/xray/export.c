@@ -0,0 +1,284 @@
+/* Copyright (c) 2013 The Chromium Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+
+/* XRay -- a simple profiler for Native Client */
+
+/* Exports the raw trace as timeline: Chrome Trace Event JSON (for       */
+/* chrome://tracing or Perfetto) and 'perf script' text (for FlameGraph's */
+/* stackcollapse-perf.pl). Time stamps are converted to nanoseconds.      */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xray_priv.h"
+
+#if defined(XRAY)
+
+struct XRayExportEntry {
+  int thread;
+  uint32_t depth;
+  uint32_t addr;
+  uint64_t start_tick;
+  uint64_t end_tick;
+  int parent;         /* index of the calling entry, -1 for roots */
+  uint64_t child_ticks;
+};
+
+struct XRayExport {
+  struct XRayExportEntry* entries;
+  int count;
+  int capacity;
+  double ns_per_tick;
+  uint64_t base_tick; /* start of the oldest frame, time 0 of the export */
+};
+
+
+static XRAY_NO_INSTRUMENT void XRayExportAppend(struct XRayExport* ex,
+    int thread, struct XRayTraceBufferEntry* be) {
+  struct XRayExportEntry* e;
+  if (ex->count == ex->capacity) {
+    struct XRayExportEntry* entries;
+    ex->capacity = ex->capacity ? 2 * ex->capacity : 1024;
+    entries = (struct XRayExportEntry*)
+      XRayMalloc(ex->capacity * sizeof(struct XRayExportEntry));
+    if (NULL != ex->entries) {
+      memcpy(entries, ex->entries, ex->count * sizeof(struct XRayExportEntry));
+      XRayFree(ex->entries);
+    }
+    ex->entries = entries;
+  }
+  e = &ex->entries[ex->count++];
+  e->thread = thread;
+  e->depth = XRAY_EXTRACT_DEPTH(be->depth_addr);
+  e->addr = XRAY_EXTRACT_ADDR(be->depth_addr);
+  e->start_tick = be->start_tick;
+  e->end_tick = be->end_tick > be->start_tick ? be->end_tick : be->start_tick;
+  e->parent = -1;
+  e->child_ticks = 0;
+}
+
+
+/* Links each entry to its caller. Entries of a thread are in call order, */
+/* so the caller is the innermost preceding entry that contains the call. */
+static XRAY_NO_INSTRUMENT void XRayExportLink(struct XRayExport* ex,
+                                              int first) {
+  int i;
+  int top = -1;
+  for (i = first; i < ex->count; ++i) {
+    struct XRayExportEntry* e = &ex->entries[i];
+    while (top >= 0 && (ex->entries[top].thread != e->thread ||
+                        ex->entries[top].end_tick < e->end_tick ||
+                        ex->entries[top].depth >= e->depth))
+      top = ex->entries[top].parent;
+    e->parent = top;
+    if (top >= 0)
+      ex->entries[top].child_ticks += e->end_tick - e->start_tick;
+    top = i;
+  }
+}
+
+
+/* Collects the entries of all threads, which were entered during frame. */
+static XRAY_NO_INSTRUMENT void XRayExportFrame(struct XRayExport* ex,
+    struct XRayTraceCapture* capture, int frame) {
+  struct XRayThreadCapture* thread;
+  uint64_t frame_start = XRayFrameGetStartTSC(capture, frame);
+  uint64_t frame_end = XRayFrameGetEndTSC(capture, frame);
+  int first = ex->count;
+  int index = XRayFrameGetTraceStartIndex(capture, frame);
+  int end = XRayFrameGetTraceEndIndex(capture, frame);
+  while (index != end) {
+    if (!XRayTraceIsAnnotation(capture, index))
+      XRayExportAppend(ex, 0, XRayTraceGetEntry(capture, index));
+    index = XRayTraceNextEntry(capture, index);
+  }
+  for (thread = XRayThreadGetFirst(capture); NULL != thread;
+       thread = XRayThreadGetNext(thread)) {
+    int size = XRayThreadGetBufferSize(thread);
+    int i;
+    index = XRayThreadGetBufferIndex(thread);
+    for (i = 0; i < size; ++i, index = (index + 1 < size) ? index + 1 : 0) {
+      struct XRayTraceBufferEntry* be = XRayThreadGetEntry(thread, index);
+      if (0 == be->end_tick || be->start_tick < frame_start ||
+          be->start_tick >= frame_end)
+        continue;
+      XRayExportAppend(ex, XRayThreadGetID(thread), be);
+    }
+  }
+  XRayExportLink(ex, first);
+}
+
+
+/* Collects the entries of all valid frames. */
+static XRAY_NO_INSTRUMENT void XRayExportCollect(struct XRayExport* ex,
+    struct XRayTraceCapture* capture) {
+  int head = XRayFrameGetHead(capture);
+  int frame = XRayFrameGetTail(capture);
+  memset(ex, 0, sizeof(*ex));
+  ex->ns_per_tick = 1e9 / (double)XRayGetTicksPerSecond();
+  if (frame != head)
+    ex->base_tick = XRayFrameGetStartTSC(capture, frame);
+  while (frame != head) {
+    if (XRayFrameIsValid(capture, frame))
+      XRayExportFrame(ex, capture, frame);
+    frame = XRayFrameGetNext(capture, frame);
+  }
+}
+
+
+static XRAY_NO_INSTRUMENT double XRayExportNS(struct XRayExport* ex,
+                                              uint64_t tick) {
+  return (double)(tick - ex->base_tick) * ex->ns_per_tick;
+}
+
+
+/* Writes a quoted JSON string. */
+static XRAY_NO_INSTRUMENT void XRayExportString(FILE* f, const char* str) {
+  fputc('"', f);
+  for (; *str; ++str) {
+    if ('"' == *str || '\\' == *str)
+      fputc('\\', f);
+    if ((unsigned char)*str >= ' ')
+      fputc(*str, f);
+  }
+  fputc('"', f);
+}
+
+
+/* Writes the symbol name, or the address if it's unknown. */
+static XRAY_NO_INSTRUMENT const char* XRayExportName(
+    struct XRayTraceCapture* capture, uint32_t addr, char* buffer) {
+  struct XRaySymbol* symbol =
+    XRaySymbolTableLookup(XRayGetSymbolTable(capture), addr);
+  if (NULL != symbol)
+    return XRaySymbolGetName(symbol);
+  snprintf(buffer, XRAY_MAX_LABEL, "0x%08X", (unsigned int)addr);
+  return buffer;
+}
+
+
+/* Dumps the trace in the Chrome Trace Event format. Every call becomes a */
+/* complete event ("ph":"X") on the track of its thread; each frame is an */
+/* additional event on thread 0. Time stamps are in microseconds.         */
+void XRayChromeTrace(struct XRayTraceCapture* capture, FILE* f) {
+  struct XRayExport ex;
+  int head = XRayFrameGetHead(capture);
+  int frame = XRayFrameGetTail(capture);
+  int counter = 0;
+  int i;
+  struct XRayThreadCapture* thread;
+  char buffer[XRAY_MAX_LABEL];
+  if (NULL == f) {
+    f = stdout;
+  }
+  XRayExportCollect(&ex, capture);
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+             "\"args\":{\"name\":\"thread 0\"}}");
+  for (thread = XRayThreadGetFirst(capture); NULL != thread;
+       thread = XRayThreadGetNext(thread)) {
+    XRayThreadMakeLabel(thread, buffer);
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+               "\"tid\":%d,\"args\":{\"name\":",
+            XRayThreadGetID(thread));
+    XRayExportString(f, buffer);
+    fprintf(f, "}}");
+  }
+  while (frame != head) {
+    char label[XRAY_MAX_LABEL];
+    uint64_t start = XRayFrameGetStartTSC(capture, frame);
+    uint64_t end = XRayFrameGetEndTSC(capture, frame);
+    XRayFrameMakeLabel(capture, counter, label);
+    fprintf(f, ",\n{\"name\":");
+    XRayExportString(f, label);
+    fprintf(f, ",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,"
+               "\"ts\":%.3f,\"dur\":%.3f}",
+            XRayExportNS(&ex, start) / 1000.0,
+            (double)(end - start) * ex.ns_per_tick / 1000.0);
+    ++counter;
+    frame = XRayFrameGetNext(capture, frame);
+  }
+  for (i = 0; i < ex.count; ++i) {
+    struct XRayExportEntry* e = &ex.entries[i];
+    fprintf(f, ",\n{\"name\":");
+    XRayExportString(f, XRayExportName(capture, e->addr, buffer));
+    fprintf(f, ",\"cat\":\"call\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+               "\"ts\":%.3f,\"dur\":%.3f}",
+            e->thread, XRayExportNS(&ex, e->start_tick) / 1000.0,
+            (double)(e->end_tick - e->start_tick) * ex.ns_per_tick / 1000.0);
+  }
+  fprintf(f, "\n]}\n");
+  if (NULL != ex.entries)
+    XRayFree(ex.entries);
+  fflush(f);
+}
+
+
+/* Dumps the trace in the text format of 'perf script'. Every call is one */
+/* sample at its start time with the call chain as stack; the period is   */
+/* the time spent in the function itself (ns), so that flame graphs built */
+/* from it are weighted by time instead of by calls.                      */
+void XRayPerfScript(struct XRayTraceCapture* capture, FILE* f) {
+  struct XRayExport ex;
+  int i;
+  char buffer[XRAY_MAX_LABEL];
+  if (NULL == f) {
+    f = stdout;
+  }
+  XRayExportCollect(&ex, capture);
+  for (i = 0; i < ex.count; ++i) {
+    struct XRayExportEntry* e = &ex.entries[i];
+    uint64_t ticks = e->end_tick - e->start_tick;
+    uint64_t self = ticks > e->child_ticks ? ticks - e->child_ticks : 0;
+    uint64_t ns = (uint64_t)XRayExportNS(&ex, e->start_tick);
+    int j;
+    fprintf(f, "xray %d/%d %" PRIu64 ".%09" PRIu64 ": %" PRIu64
+               " task-clock:\n",
+            e->thread, e->thread, (uint64_t)(ns / 1000000000ULL),
+            (uint64_t)(ns % 1000000000ULL),
+            (uint64_t)((double)self * ex.ns_per_tick));
+    for (j = i; j >= 0; j = ex.entries[j].parent) {
+      fprintf(f, "\t%16" PRIx64 " %s ([xray])\n",
+              (uint64_t)ex.entries[j].addr,
+              XRayExportName(capture, ex.entries[j].addr, buffer));
+    }
+    fprintf(f, "\n");
+  }
+  if (NULL != ex.entries)
+    XRayFree(ex.entries);
+  fflush(f);
+}
+
+
+/* Write the trace as Chrome Trace Event JSON file. */
+void XRaySaveChromeTrace(struct XRayTraceCapture* capture,
+                         const char* filename) {
+  FILE* f;
+  f = fopen(filename, "w");
+  if (NULL != f) {
+    XRayChromeTrace(capture, f);
+    fclose(f);
+  } else {
+	  printf("Cannot open file '%s'\n", filename);
+  }
+}
+
+
+/* Write the trace as 'perf script' text file. */
+void XRaySavePerfScript(struct XRayTraceCapture* capture,
+                        const char* filename) {
+  FILE* f;
+  f = fopen(filename, "w");
+  if (NULL != f) {
+    XRayPerfScript(capture, f);
+    fclose(f);
+  } else {
+	  printf("Cannot open file '%s'\n", filename);
+  }
+}
+
+#endif  /* XRAY */
@@ -130,6 +130,13 @@ void* XRayHashTableAtIndex(struct XRayHashTable* table, int i) {
 }
 
 
+uint32_t XRayHashTableKeyAtIndex(struct XRayHashTable* table, int i) {
+  if ((i < 0) || (i >= table->capacity))
+    return 0;
+  return table->array[i].key;
+}
+
+
 /* Grows the hash table by doubling its capacity, */
 /* then re-inserts all the elements into the new table. */
 void XRayHashTableGrow(struct XRayHashTable* table) {
@@ -0,0 +1,295 @@
+/* Copyright (c) 2013 The Chromium Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file. */
+
+
+/* XRay -- a simple profiler for Native Client */
+
+/* Reports of the kernel's PMU profiler: each core takes a sample after a */
+/* period of CPU cycles, which contains the interrupted address and the    */
+/* return addresses of its callers. The samples are mapped to functions    */
+/* with the symbol table of the capture, which covers the kernel and the   */
+/* application.                                                            */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xray_priv.h"
+
+#if defined(XRAY)
+
+/* has to match PMU_CALLCHAIN and pmu_sample_t of the kernel (hermit/pmu.h) */
+#define XRAY_PROFILE_CALLCHAIN (6)
+#define XRAY_PROFILE_CORE_SAMPLES (8192)
+
+struct XRayProfileSample {
+  uint64_t rip;
+  uint64_t tsc;
+  uint32_t task;
+  uint16_t core;
+  uint16_t depth;
+  uint64_t callchain[XRAY_PROFILE_CALLCHAIN];
+};
+
+struct XRayProfileFunction {
+  uint32_t addr;
+  struct XRaySymbol* symbol;  /* NULL, if the address is unknown */
+  int self;
+  int total;
+  int last_sample;            /* avoids counting recursion twice */
+};
+
+#if defined(__hermit__)
+extern int sys_pmu_profile_start(uint32_t type, uint64_t config,
+                                 uint64_t period);
+extern int sys_pmu_profile_stop(void);
+extern int sys_pmu_profile_read(int core, size_t size, void* buf);
+#endif
+
+
+/* Starts the profiler of the kernel on all cores, which takes a sample */
+/* every period CPU cycles. Returns 0 or a negative error code.         */
+int XRayProfileStart(uint64_t period) {
+#if defined(__hermit__)
+  /* PMU_TYPE_HARDWARE, PMU_HW_CPU_CYCLES */
+  return sys_pmu_profile_start(0, 0, period);
+#else
+  return -1;
+#endif
+}
+
+
+/* Stops the profiler, the samples remain available for the reports. */
+int XRayProfileStop(void) {
+#if defined(__hermit__)
+  return sys_pmu_profile_stop();
+#else
+  return -1;
+#endif
+}
+
+
+/* Copies the samples of all cores, returns the number of samples. */
+static XRAY_NO_INSTRUMENT int XRayProfileCollect(
+    struct XRayProfileSample** samples) {
+  int count = 0;
+#if defined(__hermit__)
+  int core;
+  *samples = (struct XRayProfileSample*)XRayMalloc(
+      XRAY_PROFILE_CORE_SAMPLES * sizeof(struct XRayProfileSample));
+  for (core = 0; ; ++core) {
+    struct XRayProfileSample* s;
+    int n;
+    s = (struct XRayProfileSample*)XRayMalloc(
+        (count + XRAY_PROFILE_CORE_SAMPLES) * sizeof(*s));
+    memcpy(s, *samples, count * sizeof(*s));
+    XRayFree(*samples);
+    *samples = s;
+    n = sys_pmu_profile_read(core, XRAY_PROFILE_CORE_SAMPLES * sizeof(*s),
+                             s + count);
+    if (n < 0)
+      break;
+    count += n;
+  }
+#else
+  *samples = NULL;
+#endif
+  return count;
+}
+
+
+/* Returns the function, which contains addr. */
+static XRAY_NO_INSTRUMENT struct XRayProfileFunction* XRayProfileGetFunction(
+    struct XRayTraceCapture* capture, struct XRayHashTable* functions,
+    uint64_t addr) {
+  struct XRayProfileFunction* fn;
+  struct XRaySymbol* symbol = NULL;
+  uint32_t start = (uint32_t)addr;
+  if (addr <= 0xFFFFFFFFULL)
+    symbol = XRaySymbolTableLookupNearest(XRayGetSymbolTable(capture),
+                                          (uint32_t)addr, &start);
+  fn = (struct XRayProfileFunction*)XRayHashTableLookup(functions, start);
+  if (NULL == fn) {
+    fn = (struct XRayProfileFunction*)XRayMalloc(sizeof(*fn));
+    fn->addr = start;
+    fn->symbol = symbol;
+    fn->self = 0;
+    fn->total = 0;
+    fn->last_sample = -1;
+    XRayHashTableInsert(functions, fn, start);
+  }
+  return fn;
+}
+
+
+/* Writes the symbol name, or the address if it's unknown. */
+static XRAY_NO_INSTRUMENT const char* XRayProfileName(
+    struct XRayTraceCapture* capture, uint64_t addr, char* buffer) {
+  struct XRaySymbol* symbol = NULL;
+  if (addr <= 0xFFFFFFFFULL)
+    symbol = XRaySymbolTableLookupNearest(XRayGetSymbolTable(capture),
+                                          (uint32_t)addr, NULL);
+  if (NULL != symbol)
+    return XRaySymbolGetName(symbol);
+  snprintf(buffer, XRAY_MAX_LABEL, "0x%016" PRIx64, addr);
+  return buffer;
+}
+
+
+static XRAY_NO_INSTRUMENT int XRayProfileCompare(const void* a,
+                                                 const void* b) {
+  const struct XRayProfileFunction* x =
+      *(const struct XRayProfileFunction* const*)a;
+  const struct XRayProfileFunction* y =
+      *(const struct XRayProfileFunction* const*)b;
+  if (x->self != y->self)
+    return y->self - x->self;
+  return y->total - x->total;
+}
+
+
+/* Dumps a flat profile: for each function, the samples inside the      */
+/* function itself (self) and inside the function or one of its callees */
+/* (total), as far as the call chain reaches. Functions below           */
+/* percent_cutoff of all samples (self) are omitted.                    */
+void XRayProfileReport(struct XRayTraceCapture* capture,
+                       FILE* f,
+                       float percent_cutoff) {
+  struct XRayProfileSample* samples;
+  struct XRayHashTable* functions;
+  struct XRayProfileFunction** sorted;
+  int count = XRayProfileCollect(&samples);
+  int capacity;
+  int num_functions = 0;
+  int i, j;
+  char buffer[XRAY_MAX_LABEL];
+  if (NULL == f) {
+    f = stdout;
+  }
+  functions = XRayHashTableCreate(XRAY_DEFAULT_SYMBOL_TABLE_SIZE);
+  for (i = 0; i < count; ++i) {
+    struct XRayProfileSample* s = &samples[i];
+    struct XRayProfileFunction* fn;
+    fn = XRayProfileGetFunction(capture, functions, s->rip);
+    ++fn->self;
+    ++fn->total;
+    fn->last_sample = i;
+    for (j = 0; j < s->depth && j < XRAY_PROFILE_CALLCHAIN; ++j) {
+      /* a return address belongs to the caller, it may be the next symbol */
+      fn = XRayProfileGetFunction(capture, functions, s->callchain[j] - 1);
+      if (fn->last_sample != i) {
+        ++fn->total;
+        fn->last_sample = i;
+      }
+    }
+  }
+
+  capacity = XRayHashTableGetCapacity(functions);
+  sorted = (struct XRayProfileFunction**)XRayMalloc(
+      (XRayHashTableGetCount(functions) + 1) * sizeof(*sorted));
+  for (i = 0; i < capacity; ++i) {
+    void* fn = XRayHashTableAtIndex(functions, i);
+    if (NULL != fn)
+      sorted[num_functions++] = (struct XRayProfileFunction*)fn;
+  }
+  qsort(sorted, num_functions, sizeof(*sorted), XRayProfileCompare);
+
+  fprintf(f, "\n");
+  fprintf(f, "Profile: %d samples, %d functions\n", count, num_functions);
+  fprintf(f, "   Self          Total         Function\n");
+  fprintf(f, "---------------------------------------------------------\n");
+  for (i = 0; i < num_functions; ++i) {
+    struct XRayProfileFunction* fn = sorted[i];
+    float self = 100.0f * (float)fn->self / (float)count;
+    float total = 100.0f * (float)fn->total / (float)count;
+    if (self < percent_cutoff)
+      continue;
+    if (NULL != fn->symbol) {
+      fprintf(f, "%7d %5.1f%% %7d %5.1f%%  %s\n", fn->self, self, fn->total,
+              total, XRaySymbolGetName(fn->symbol));
+    } else {
+      snprintf(buffer, XRAY_MAX_LABEL, "0x%08X", (unsigned int)fn->addr);
+      fprintf(f, "%7d %5.1f%% %7d %5.1f%%  %s\n", fn->self, self, fn->total,
+              total, buffer);
+    }
+  }
+  fprintf(f, "\n");
+
+  for (i = 0; i < num_functions; ++i)
+    XRayFree(sorted[i]);
+  XRayFree(sorted);
+  XRayHashTableFree(functions);
+  if (NULL != samples)
+    XRayFree(samples);
+  fflush(f);
+}
+
+
+/* Dumps the samples in the text format of 'perf script', e.g. for      */
+/* FlameGraph's stackcollapse-perf.pl. Each sample has a weight of one. */
+void XRayProfilePerfScript(struct XRayTraceCapture* capture, FILE* f) {
+  struct XRayProfileSample* samples;
+  int count = XRayProfileCollect(&samples);
+  double ns_per_tick = 1e9 / (double)XRayGetTicksPerSecond();
+  uint64_t base_tick = 0;
+  int i, j;
+  char buffer[XRAY_MAX_LABEL];
+  if (NULL == f) {
+    f = stdout;
+  }
+  for (i = 0; i < count; ++i) {
+    if (0 == i || samples[i].tsc < base_tick)
+      base_tick = samples[i].tsc;
+  }
+  for (i = 0; i < count; ++i) {
+    struct XRayProfileSample* s = &samples[i];
+    uint64_t ns = (uint64_t)((double)(s->tsc - base_tick) * ns_per_tick);
+    fprintf(f, "xray %u/%u [%03u] %" PRIu64 ".%09" PRIu64 ": 1 cycles:\n",
+            (unsigned int)s->task, (unsigned int)s->task,
+            (unsigned int)s->core, (uint64_t)(ns / 1000000000ULL),
+            (uint64_t)(ns % 1000000000ULL));
+    fprintf(f, "\t%16" PRIx64 " %s ([hermit])\n", s->rip,
+            XRayProfileName(capture, s->rip, buffer));
+    for (j = 0; j < s->depth && j < XRAY_PROFILE_CALLCHAIN; ++j) {
+      fprintf(f, "\t%16" PRIx64 " %s ([hermit])\n", s->callchain[j],
+              XRayProfileName(capture, s->callchain[j] - 1, buffer));
+    }
+    fprintf(f, "\n");
+  }
+  if (NULL != samples)
+    XRayFree(samples);
+  fflush(f);
+}
+
+
+/* Write the flat profile into a file. */
+void XRaySaveProfileReport(struct XRayTraceCapture* capture,
+                           const char* filename,
+                           float percent_cutoff) {
+  FILE* f;
+  f = fopen(filename, "w");
+  if (NULL != f) {
+    XRayProfileReport(capture, f, percent_cutoff);
+    fclose(f);
+  } else {
+	  printf("Cannot open file '%s'\n", filename);
+  }
+}
+
+
+/* Write the samples as 'perf script' text file. */
+void XRaySaveProfilePerfScript(struct XRayTraceCapture* capture,
+                               const char* filename) {
+  FILE* f;
+  f = fopen(filename, "w");
+  if (NULL != f) {
+    XRayProfilePerfScript(capture, f);
+    fclose(f);
+  } else {
+	  printf("Cannot open file '%s'\n", filename);
+  }
+}
+
+#endif  /* XRAY */
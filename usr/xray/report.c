@@ -47,6 +47,8 @@ void XRayTraceReport(struct XRayTraceCapture* capture,
       "====================================================================\n");
   if (NULL != label)
     fprintf(f, "label %s\n", label);
+  if (NULL != XRayThreadGetFirst(capture))
+    fprintf(f, "thread 0\n");
   fprintf(f, "\n");
   fprintf(f,
       "   Address          Ticks   Percent      Function    [annotation...]\n");
@@ -87,6 +89,93 @@ void XRayTraceReport(struct XRayTraceCapture* capture,
 }
 
 
+int tcompare(const void* a, const void* b) {
+  struct XRayThreadCapture* ta = *(struct XRayThreadCapture**)a;
+  struct XRayThreadCapture* tb = *(struct XRayThreadCapture**)b;
+  return XRayThreadGetID(ta) - XRayThreadGetID(tb);
+}
+
+
+/* Dumps the entries each other thread recorded during a given frame. */
+/* The thread buffers are not tied to frames, an entry belongs to the */
+/* frame, if the function was entered between start and end of the frame. */
+void XRayThreadReport(struct XRayTraceCapture* capture,
+                      FILE* f,
+                      int frame,
+                      float percent_cutoff,
+                      int ticks_cutoff) {
+  int i;
+  int t;
+  int count = 0;
+  float total;
+  uint64_t frame_start;
+  uint64_t frame_end;
+  char space[257];
+  char label[XRAY_MAX_LABEL];
+  struct XRayThreadCapture* thread;
+  struct XRayThreadCapture** threads;
+  struct XRaySymbolTable* symbols = XRayGetSymbolTable(capture);
+  memset(space, ' ', 256);
+  space[256] = 0;
+  if (NULL == f) {
+    f = stdout;
+  }
+  /* the list contains also the cores of XRayLoadKernelTrace() */
+  for (thread = XRayThreadGetFirst(capture); NULL != thread;
+       thread = XRayThreadGetNext(thread))
+    ++count;
+  threads = (struct XRayThreadCapture**)
+    alloca(count * sizeof(struct XRayThreadCapture*));
+  count = 0;
+  for (thread = XRayThreadGetFirst(capture); NULL != thread;
+       thread = XRayThreadGetNext(thread))
+    threads[count++] = thread;
+  qsort(threads, count, sizeof(struct XRayThreadCapture*), tcompare);
+  total = XRayFrameGetTotalTicks(capture, frame);
+  frame_start = XRayFrameGetStartTSC(capture, frame);
+  frame_end = XRayFrameGetEndTSC(capture, frame);
+  for (t = 0; t < count; ++t) {
+    int size = XRayThreadGetBufferSize(threads[t]);
+    int index = XRayThreadGetBufferIndex(threads[t]);
+    int captures = 0;
+    uint64_t busy = 0;
+    fprintf(f,
+      "--------------------------------------------------------------------\n");
+    XRayThreadMakeLabel(threads[t], label);
+    fprintf(f, "%s\n", label);
+    fprintf(f, "\n");
+    /* walk the ring buffer from the oldest entry */
+    for (i = 0; i < size; ++i, index = (index + 1 < size) ? index + 1 : 0) {
+      struct XRayTraceBufferEntry* e = XRayThreadGetEntry(threads[t], index);
+      uint32_t depth = XRAY_EXTRACT_DEPTH(e->depth_addr);
+      uint32_t addr = XRAY_EXTRACT_ADDR(e->depth_addr);
+      uint64_t ticks;
+      float percent;
+      /* skip unused slots and functions which haven't returned yet */
+      if (0 == e->end_tick || e->start_tick < frame_start ||
+          e->start_tick >= frame_end)
+        continue;
+      ticks = e->end_tick > e->start_tick ? e->end_tick - e->start_tick : 0;
+      percent = 100.0f * (float)ticks / total;
+      ++captures;
+      if (0 == depth)
+        busy += ticks;
+      if (percent >= percent_cutoff && ticks >= ticks_cutoff) {
+        struct XRaySymbol* symbol = XRaySymbolTableLookup(symbols, addr);
+        /* indent like the frame's own trace, which starts at depth 1 */
+        fprintf(f, "0x%08X   %12" PRIu64 "     %5.1f     %s%s\n",
+                (unsigned int)addr, ticks, percent,
+                &space[256 - (depth + 1)], XRaySymbolGetName(symbol));
+      }
+    }
+    fprintf(f, "\n");
+    fprintf(f, "%s: %d capture(s)    %" PRIu64 " ticks at top level\n",
+            label, captures, busy);
+  }
+  fflush(f);
+}
+
+
 int qcompare(const void* a, const void* b) {
   struct XRayTotal* ia = (struct XRayTotal*)a;
   struct XRayTotal* ib = (struct XRayTotal*)b;
@@ -137,7 +226,11 @@ void XRayFrameReport(struct XRayTraceCapture* capture, FILE* f) {
   fprintf(f,
       "--------------------------------------------------------------------\n");
   fprintf(f,
-  "XRay: %d frame(s)    %d total capture(s)\n", counter, total_capture);
+  "XRay: %d frame(s)    %d total capture(s)    %d other thread(s)\n",
+      counter, total_capture, XRayThreadGetCount(capture));
+  if (XRayGetSampleInterval(capture) > 1)
+    fprintf(f, "XRay: sampled every %u-th call (with callees)\n",
+            XRayGetSampleInterval(capture));
   fprintf(f, "\n");
   /* Sort and take average of the median cut */
   qsort(totals, counter, sizeof(struct XRayTotal), qcompare);
@@ -168,6 +261,7 @@ void XRayFrameReport(struct XRayTraceCapture* capture, FILE* f) {
 
 
 /* Dump a frame report followed by trace report(s) for each frame. */
+/* The trace of each frame is merged with the entries of all other threads. */
 void XRayReport(struct XRayTraceCapture* capture,
                 FILE* f,
                 float percent_cutoff,
@@ -182,6 +276,7 @@ void XRayReport(struct XRayTraceCapture* capture,
     fprintf(f, "\n");
     XRayFrameMakeLabel(capture, counter, label);
     XRayTraceReport(capture, f, frame, label, percent_cutoff, ticks_cutoff);
+    XRayThreadReport(capture, f, frame, percent_cutoff, ticks_cutoff);
     ++counter;
     frame = XRayFrameGetNext(capture, frame);
   }
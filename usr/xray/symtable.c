@@ -46,11 +46,20 @@ struct XRaySymbolPool {
 };
 
 
+/* Symbol by start address, for the lookup of addresses inside functions. */
+struct XRaySymbolRange {
+  uint32_t addr;
+  struct XRaySymbol* symbol;
+};
+
+
 struct XRaySymbolTable {
   int num_symbols;
   struct XRayHashTable* hash_table;
   struct XRayStringPool* string_pool;
   struct XRaySymbolPool* symbol_pool;
+  struct XRaySymbolRange* ranges;  /* sorted, built on demand */
+  int num_ranges;
 };
 
 
@@ -170,6 +179,67 @@ struct XRaySymbol* XRaySymbolTableLookup(struct XRaySymbolTable* symtab,
 }
 
 
+static XRAY_NO_INSTRUMENT int XRaySymbolRangeCompare(const void* a,
+                                                      const void* b) {
+  uint32_t x = ((const struct XRaySymbolRange*)a)->addr;
+  uint32_t y = ((const struct XRaySymbolRange*)b)->addr;
+  return (x > y) - (x < y);
+}
+
+
+/* Sorts the symbols by address, after symbols were added. */
+static XRAY_NO_INSTRUMENT void XRaySymbolTableSortRanges(
+    struct XRaySymbolTable* symtab) {
+  int capacity = XRayHashTableGetCapacity(symtab->hash_table);
+  int i;
+  if (NULL != symtab->ranges) {
+    if (symtab->num_ranges == symtab->num_symbols)
+      return;
+    XRayFree(symtab->ranges);
+  }
+  symtab->ranges = (struct XRaySymbolRange*)XRayMalloc(
+      (symtab->num_symbols + 1) * sizeof(struct XRaySymbolRange));
+  symtab->num_ranges = 0;
+  for (i = 0; i < capacity; ++i) {
+    struct XRaySymbol* symbol = (struct XRaySymbol*)
+        XRayHashTableAtIndex(symtab->hash_table, i);
+    if (NULL != symbol) {
+      symtab->ranges[symtab->num_ranges].addr =
+          XRayHashTableKeyAtIndex(symtab->hash_table, i);
+      symtab->ranges[symtab->num_ranges].symbol = symbol;
+      ++symtab->num_ranges;
+    }
+  }
+  qsort(symtab->ranges, symtab->num_ranges, sizeof(struct XRaySymbolRange),
+        XRaySymbolRangeCompare);
+}
+
+
+/* Returns the symbol with the highest address <= addr, i.e. the function, */
+/* which contains an arbitrary code address (e.g. of a PMU sample). The     */
+/* start address of the symbol is stored in start.                          */
+struct XRaySymbol* XRaySymbolTableLookupNearest(struct XRaySymbolTable* symtab,
+                                                uint32_t addr,
+                                                uint32_t* start) {
+  int lo = 0;
+  int hi;
+  XRaySymbolTableSortRanges(symtab);
+  hi = symtab->num_ranges;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (symtab->ranges[mid].addr <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (0 == lo)
+    return NULL;
+  if (NULL != start)
+    *start = symtab->ranges[lo - 1].addr;
+  return symtab->ranges[lo - 1].symbol;
+}
+
+
 /* Returns total number of symbols in the table. */
 int XRaySymbolCount(struct XRaySymbolTable* symtab) {
   return symtab->num_symbols;
@@ -184,6 +254,8 @@ struct XRaySymbolTable* XRaySymbolTableCreate(int size) {
   symtab->string_pool = XRayStringPoolCreate();
   symtab->hash_table = XRayHashTableCreate(size);
   symtab->symbol_pool = XRaySymbolPoolCreate();
+  symtab->ranges = NULL;
+  symtab->num_ranges = 0;
   return symtab;
 }
 
@@ -193,6 +265,8 @@ void XRaySymbolTableFree(struct XRaySymbolTable* symtab) {
   XRayStringPoolFree(symtab->string_pool);
   XRaySymbolPoolFree(symtab->symbol_pool);
   XRayHashTableFree(symtab->hash_table);
+  if (NULL != symtab->ranges)
+    XRayFree(symtab->ranges);
   symtab->num_symbols = 0;
   XRayFree(symtab);
 }
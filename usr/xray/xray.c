@@ -39,10 +39,52 @@ uint64_t GTOD() {
 #define GTSC(_x) _x = GTOD();
 #endif
 
+#if defined(__hermit__)
+extern unsigned int get_cpufreq(void);
+extern int sys_ktrace(int enable);
+extern int sys_ktrace_read(int core, size_t size, void* buf);
+#endif
+
+/* Returns the frequency of the GTSC time base in Hz. */
+uint64_t XRayGetTicksPerSecond(void) {
+#if (defined(__amd64__) || defined(__i386__)) && !defined(XRAY_NO_RDTSC)
+#if defined(__hermit__)
+  /* get_cpufreq() reports MHz */
+  return (uint64_t)get_cpufreq() * 1000000ULL;
+#else
+  /* calibrate the time stamp counter against gettimeofday() */
+  struct timeval tv0, tv1;
+  uint64_t tsc0, tsc1, usec;
+  gettimeofday(&tv0, NULL);
+  GTSC(tsc0);
+  do {
+    gettimeofday(&tv1, NULL);
+    usec = (uint64_t)(tv1.tv_sec - tv0.tv_sec) * 1000000ULL +
+           tv1.tv_usec - tv0.tv_usec;
+  } while (usec < 10000);
+  GTSC(tsc1);
+  return (tsc1 - tsc0) * 1000000ULL / usec;
+#endif
+#else
+  /* gettimeofday() ticks in microseconds */
+  return 1000000ULL;
+#endif
+}
+
 /* Use a TLS variable for cheap thread uid. */
 __thread struct XRayTraceCapture* g_xray_capture = NULL;
 __thread int g_xray_thread_id_placeholder = 0;
 
+/* Capture other threads record into while its owner is inside a frame. */
+/* Thread buffers of an older capture are stale once the generation moved. */
+static struct XRayTraceCapture* volatile g_xray_global = NULL;
+static volatile uint32_t g_xray_generation = 0;
+__thread struct XRayThreadCapture* g_xray_thread = NULL;
+__thread uint32_t g_xray_thread_generation = 0;
+__thread bool g_xray_thread_attaching = false;
+/* Calls left until the next one is sampled (see XRaySetSampleInterval). */
+__thread int32_t g_xray_sample_countdown = 0;
+
 
 struct XRayTraceStackEntry {
   uint32_t depth_addr;
@@ -77,11 +119,27 @@ struct XRayTraceFrame {
 };
 
 
+/* Trace buffer of a thread, which didn't call XRayStartFrame() */
+struct XRayThreadCapture {
+  int thread_id;
+  uint32_t stack_depth;
+  uint32_t sample_depth;
+  int buffer_index;
+  int buffer_size;
+  struct XRayTraceCapture* capture;
+  struct XRayThreadCapture* next;
+  struct XRayTraceStackEntry stack[XRAY_TRACE_STACK_SIZE] XRAY_ALIGN64;
+  struct XRayTraceBufferEntry* buffer;
+} XRAY_ALIGN64;
+
+
 struct XRayTraceCapture {
   /* Common variables share cache line */
   bool recording;
   uint32_t stack_depth;
   uint32_t max_stack_depth;
+  uint32_t sample_interval;
+  uint32_t sample_depth;
   int buffer_index;
   int buffer_size;
   int disabled;
@@ -98,6 +156,10 @@ struct XRayTraceCapture {
   struct XRayTraceBufferEntry* buffer;
   struct XRayTraceFrame frame;
   char frame_labels[XRAY_FRAME_LBL_BUFSIZE][XRAY_MAX_LABEL];
+  /* Registry of the per-thread trace buffers */
+  int thread_buffer_size;
+  int thread_count;
+  struct XRayThreadCapture* volatile threads;
 
 #ifndef XRAY_DISABLE_BROWSER_INTEGRATION
   int32_t thread_id;
@@ -323,6 +385,166 @@ void XRayFree(void* data) {
 }
 
 
+/* Decides whether a call at depth is recorded. With sampling, every */
+/* interval-th call is recorded together with all calls below it, so that */
+/* each recorded call still has its whole subtree in the trace. */
+static XRAY_INLINE bool XRaySampleEnter(uint32_t* sample_depth,
+                                              uint32_t depth,
+                                              uint32_t interval) {
+  if (interval <= 1 || *sample_depth < depth)
+    return true;
+  if (--g_xray_sample_countdown > 0)
+    return false;
+  g_xray_sample_countdown = interval;
+  *sample_depth = depth;
+  return true;
+}
+
+
+/* Leaves the sampled subtree when its root returns. */
+static XRAY_INLINE void XRaySampleExit(uint32_t* sample_depth,
+                                             uint32_t depth) {
+  if (*sample_depth == depth)
+    *sample_depth = XRAY_NO_SAMPLE;
+}
+
+
+/* Registers a trace buffer for the calling thread with the global capture. */
+/* Only called from the profile hooks, while the capture is recording. */
+static XRAY_NO_INSTRUMENT struct XRayThreadCapture* XRayThreadAttach(
+    struct XRayTraceCapture* capture) {
+  struct XRayThreadCapture* thread;
+  if (g_xray_thread_attaching)
+    return NULL;
+  g_xray_thread_attaching = true;
+  thread = (struct XRayThreadCapture*)XRayMalloc(
+      sizeof(struct XRayThreadCapture));
+  thread->buffer_size = capture->thread_buffer_size;
+  thread->buffer = (struct XRayTraceBufferEntry*)XRayMalloc(
+      sizeof(thread->buffer[0]) * thread->buffer_size);
+  thread->capture = capture;
+  thread->sample_depth = XRAY_NO_SAMPLE;
+  thread->thread_id = __sync_add_and_fetch(&capture->thread_count, 1);
+  do {
+    thread->next = capture->threads;
+  } while (!__sync_bool_compare_and_swap(&capture->threads,
+                                         thread->next, thread));
+  g_xray_thread = thread;
+  g_xray_thread_generation = g_xray_generation;
+  g_xray_thread_attaching = false;
+  return thread;
+}
+
+
+/* Returns the trace buffer of the calling thread, if attach is set */
+/* a new one is registered while the global capture is recording. */
+static XRAY_INLINE struct XRayThreadCapture* XRayThreadGet(
+    bool attach) {
+  struct XRayTraceCapture* capture;
+  if (NULL != g_xray_thread) {
+    if (g_xray_thread_generation == g_xray_generation)
+      return g_xray_thread;
+    g_xray_thread = NULL;
+  }
+  capture = g_xray_global;
+  if (!attach || NULL == capture || !capture->recording)
+    return NULL;
+  return XRayThreadAttach(capture);
+}
+
+
+/* Profile hook for threads without an own frame. The call depth is */
+/* always tracked, slots are only reserved while the capture records. */
+static XRAY_NO_INSTRUMENT void XRayThreadEnter(void* this_fn) {
+  struct XRayThreadCapture* thread = XRayThreadGet(true);
+  if (NULL != thread) {
+    uint32_t depth = thread->stack_depth;
+    if (depth < thread->capture->max_stack_depth) {
+      struct XRayTraceStackEntry* se = &thread->stack[depth];
+      if (thread->capture->recording &&
+          XRaySampleEnter(&thread->sample_depth, depth,
+                          thread->capture->sample_interval)) {
+        uint32_t addr = (uint32_t)(uintptr_t)this_fn;
+        se->depth_addr = XRAY_PACK_DEPTH_ADDR(depth, addr);
+        se->dest = thread->buffer_index;
+        /* mark the slot as open until the function returns */
+        thread->buffer[se->dest].end_tick = 0;
+        GTSC(se->tsc);
+        thread->buffer_index = (thread->buffer_index + 1 <
+            thread->buffer_size) ? thread->buffer_index + 1 : 0;
+      } else {
+        se->dest = XRAY_NO_SLOT;
+      }
+    }
+    ++thread->stack_depth;
+  }
+}
+
+
+static XRAY_NO_INSTRUMENT void XRayThreadExit(void* this_fn) {
+  struct XRayThreadCapture* thread = XRayThreadGet(false);
+  /* ignore returns from functions entered before the thread attached */
+  if (NULL != thread && 0 != thread->stack_depth) {
+    --thread->stack_depth;
+    XRaySampleExit(&thread->sample_depth, thread->stack_depth);
+    if (thread->stack_depth < thread->capture->max_stack_depth) {
+      struct XRayTraceStackEntry* se = &thread->stack[thread->stack_depth];
+      if (XRAY_NO_SLOT != se->dest) {
+        struct XRayTraceBufferEntry* be = &thread->buffer[se->dest];
+        uint64_t tsc;
+        GTSC(tsc);
+        be->depth_addr = se->depth_addr;
+        be->annotation_index = 0;
+        be->start_tick = se->tsc;
+        be->end_tick = tsc;
+      }
+    }
+  }
+}
+
+
+struct XRayThreadCapture* XRayThreadGetFirst(
+    struct XRayTraceCapture* capture) {
+  return capture->threads;
+}
+
+struct XRayThreadCapture* XRayThreadGetNext(
+    struct XRayThreadCapture* thread) {
+  return thread->next;
+}
+
+int XRayThreadGetID(struct XRayThreadCapture* thread) {
+  return thread->thread_id;
+}
+
+int XRayThreadGetCount(struct XRayTraceCapture* capture) {
+  return capture->thread_count;
+}
+
+int XRayThreadGetBufferSize(struct XRayThreadCapture* thread) {
+  return thread->buffer_size;
+}
+
+/* The slot written next is the oldest entry of the ring buffer. */
+int XRayThreadGetBufferIndex(struct XRayThreadCapture* thread) {
+  return thread->buffer_index;
+}
+
+struct XRayTraceBufferEntry* XRayThreadGetEntry(
+    struct XRayThreadCapture* thread, int index) {
+  return &thread->buffer[index];
+}
+
+/* Thread ids from XRAY_KERNEL_THREAD_ID on are the cores of the kernel. */
+void XRayThreadMakeLabel(struct XRayThreadCapture* thread, char* label) {
+  if (thread->thread_id >= XRAY_KERNEL_THREAD_ID)
+    snprintf(label, XRAY_MAX_LABEL, "kernel core %d",
+             thread->thread_id - XRAY_KERNEL_THREAD_ID);
+  else
+    snprintf(label, XRAY_MAX_LABEL, "thread %d", thread->thread_id);
+}
+
+
 /* Main profile capture function that is called at the start */
 /* of every instrumented function.  This function is implicitly */
 /* called when code is compilied with the -finstrument-functions option */
@@ -336,15 +558,22 @@ void __cyg_profile_func_enter(void* this_fn, void* call_site) {
     uint32_t depth = capture->stack_depth;
     if (depth < capture->max_stack_depth) {
       struct XRayTraceStackEntry* se = &capture->stack[depth];
-      uint32_t addr = (uint32_t)(uintptr_t)this_fn;
-      se->depth_addr = XRAY_PACK_DEPTH_ADDR(depth, addr);
-      se->dest = capture->buffer_index;
       se->annotation_index = 0;
-      GTSC(se->tsc);
-      capture->buffer_index =
-        XRayTraceIncrementIndexInline(capture, capture->buffer_index);
+      if (XRaySampleEnter(&capture->sample_depth, depth,
+                          capture->sample_interval)) {
+        uint32_t addr = (uint32_t)(uintptr_t)this_fn;
+        se->depth_addr = XRAY_PACK_DEPTH_ADDR(depth, addr);
+        se->dest = capture->buffer_index;
+        GTSC(se->tsc);
+        capture->buffer_index =
+          XRayTraceIncrementIndexInline(capture, capture->buffer_index);
+      } else {
+        se->dest = XRAY_NO_SLOT;
+      }
     }
     ++capture->stack_depth;
+  } else if (NULL == capture) {
+    XRayThreadEnter(this_fn);
   }
 }
 
@@ -360,10 +589,17 @@ void __cyg_profile_func_exit(void* this_fn, void* call_site) {
   struct XRayTraceCapture* capture = g_xray_capture;
   if (capture && capture->recording) {
     --capture->stack_depth;
+    XRaySampleExit(&capture->sample_depth, capture->stack_depth);
     if (capture->stack_depth < capture->max_stack_depth) {
       uint32_t depth = capture->stack_depth;
       struct XRayTraceStackEntry* se = &capture->stack[depth];
       uint32_t buffer_index = se->dest;
+      if (XRAY_NO_SLOT == buffer_index) {
+        /* drop annotations of calls which weren't sampled */
+        if (0 != se->annotation_index)
+          capture->annotation[(se - 1)->annotation_index] = 0;
+        return;
+      }
       uint64_t tsc;
       struct XRayTraceBufferEntry* be = &capture->buffer[buffer_index];
       GTSC(tsc);
@@ -374,6 +610,8 @@ void __cyg_profile_func_exit(void* this_fn, void* call_site) {
       if (0 != se->annotation_index)
         __xray_profile_append_annotation(capture, se, be);
     }
+  } else if (NULL == capture) {
+    XRayThreadExit(this_fn);
   }
 }
 
@@ -516,6 +754,22 @@ void XRaySetMaxStackDepth(struct XRayTraceCapture* capture, int stack_depth) {
 }
 
 
+/* Record only every interval-th call and its callees (1 = all calls). */
+/* Calls which aren't sampled still cost the hook, but no time stamps. */
+void XRaySetSampleInterval(struct XRayTraceCapture* capture,
+                           uint32_t interval) {
+  assert(capture);
+  assert(capture->initialized);
+  assert(!capture->recording);
+  capture->sample_interval = interval < 1 ? 1 : interval;
+}
+
+
+uint32_t XRayGetSampleInterval(struct XRayTraceCapture* capture) {
+  return capture->sample_interval;
+}
+
+
 int XRayFrameGetCount(struct XRayTraceCapture* capture) {
   return capture->frame.count;
 }
@@ -550,6 +804,14 @@ uint64_t XRayFrameGetTotalTicks(struct XRayTraceCapture* capture, int i) {
   return capture->frame.entry[i].total_ticks;
 }
 
+uint64_t XRayFrameGetStartTSC(struct XRayTraceCapture* capture, int i) {
+  return capture->frame.entry[i].start_tsc;
+}
+
+uint64_t XRayFrameGetEndTSC(struct XRayTraceCapture* capture, int i) {
+  return capture->frame.entry[i].end_tsc;
+}
+
 int XRayFrameGetAnnotationCount(struct XRayTraceCapture* capture, int i) {
   return capture->frame.entry[i].annotation_count;
 }
@@ -613,9 +875,9 @@ int XRayFrameFindTail(struct XRayTraceCapture* capture) {
 
 
 /* Starts a new frame and enables capturing, and must be paired with */
-/* XRayEndFrame()  Trace capturing only occurs on the thread which called */
-/* XRayBeginFrame() and each instance of capture can only trace one thread */
-/* at a time. */
+/* XRayEndFrame()  The thread which called XRayBeginFrame() records into */
+/* the capture itself, all other threads record into their own buffers, */
+/* which are registered with the capture on their first traced call. */
 void XRayStartFrame(struct XRayTraceCapture* capture) {
   int i;
   assert(NULL == g_xray_capture);
@@ -632,6 +894,7 @@ void XRayStartFrame(struct XRayTraceCapture* capture) {
   capture->frame.entry[i].start = capture->buffer_index;
   capture->disabled = 0;
   capture->stack_depth = 1;
+  capture->sample_depth = XRAY_NO_SAMPLE;
 
   /* The trace stack[0] is reserved */
   memset(&capture->stack[0], 0, sizeof(capture->stack[0]));
@@ -767,12 +1030,18 @@ struct XRayTraceCapture* XRayInit(int stack_depth,
   capture->frame.tail = 0;
   capture->disabled = 0;
   capture->annotation_filter = 0xFFFFFFFF;
+  capture->sample_interval = 1;
+  capture->sample_depth = XRAY_NO_SAMPLE;
   capture->guard0 = XRAY_GUARD_VALUE_0x12345678;
   capture->guard1 = XRAY_GUARD_VALUE_0x12345678;
   capture->guard2 = XRAY_GUARD_VALUE_0x87654321;
   capture->guard3 = XRAY_GUARD_VALUE_0x12345678;
   capture->initialized = true;
   capture->recording = false;
+  capture->thread_buffer_size = buffer_size < XRAY_THREAD_BUFFER_SIZE ?
+      buffer_size : XRAY_THREAD_BUFFER_SIZE;
+  capture->thread_count = 0;
+  capture->threads = NULL;
   XRaySetMaxStackDepth(capture, stack_depth);
   XRayReset(capture);
 
@@ -787,16 +1056,88 @@ struct XRayTraceCapture* XRayInit(int stack_depth,
   capture->thread_id = (int32_t)(&g_xray_thread_id_placeholder);
 #endif
 
+  /* Invalidate the thread buffers of a previous capture. */
+  __sync_add_and_fetch(&g_xray_generation, 1);
+  g_xray_global = capture;
+
   return capture;
 }
 
 
+/* Sets the trace buffer size (in entries) of threads attaching afterwards. */
+void XRaySetThreadBufferSize(struct XRayTraceCapture* capture,
+                             int buffer_size) {
+  assert(capture);
+  assert(capture->initialized);
+  if (buffer_size < 1)
+    buffer_size = 1;
+  capture->thread_buffer_size = buffer_size;
+}
+
+
+/* Copies the function trace of each kernel core into a thread buffer of */
+/* the capture (see KERNEL_TRACE_MODULES). The kernel records the time  */
+/* stamp counter, so the trace only lines up with an RDTSC time base.    */
+/* Call it once after the last frame; returns the number of cores.      */
+int XRayLoadKernelTrace(struct XRayTraceCapture* capture) {
+#if defined(__hermit__) && (defined(__amd64__) || defined(__i386__)) && \
+    !defined(XRAY_NO_RDTSC)
+  int core;
+  int enabled;
+  assert(capture);
+  assert(capture->initialized);
+  assert(!capture->recording);
+  /* the kernel isn't traced, if it doesn't know the system call */
+  enabled = sys_ktrace(0);
+  if (enabled < 0)
+    return 0;
+  for (core = 0; ; ++core) {
+    struct XRayThreadCapture* thread;
+    int n;
+    thread = (struct XRayThreadCapture*)XRayMalloc(
+        sizeof(struct XRayThreadCapture));
+    thread->buffer_size = capture->thread_buffer_size;
+    thread->buffer = (struct XRayTraceBufferEntry*)XRayMalloc(
+        sizeof(thread->buffer[0]) * thread->buffer_size);
+    n = sys_ktrace_read(core, sizeof(thread->buffer[0]) * thread->buffer_size,
+                        thread->buffer);
+    if (n < 0) {
+      XRayFree(thread->buffer);
+      XRayFree(thread);
+      break;
+    }
+    /* the entries are copied oldest first */
+    thread->buffer_index = n % thread->buffer_size;
+    thread->capture = capture;
+    thread->sample_depth = XRAY_NO_SAMPLE;
+    thread->thread_id = XRAY_KERNEL_THREAD_ID + core;
+    thread->next = capture->threads;
+    capture->threads = thread;
+  }
+  sys_ktrace(enabled);
+  return core;
+#else
+  return 0;
+#endif
+}
+
+
 /* Shut down and free memory used by XRay. */
 void XRayShutdown(struct XRayTraceCapture* capture) {
   assert(capture);
   assert(capture->initialized);
   assert(!capture->recording);
   XRayCheckGuards(capture);
+  if (g_xray_global == capture) {
+    g_xray_global = NULL;
+    __sync_add_and_fetch(&g_xray_generation, 1);
+  }
+  while (NULL != capture->threads) {
+    struct XRayThreadCapture* thread = capture->threads;
+    capture->threads = thread->next;
+    XRayFree(thread->buffer);
+    XRayFree(thread);
+  }
   if (NULL != capture->symbols) {
     XRaySymbolTableFree(capture->symbols);
   }
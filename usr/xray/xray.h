@@ -54,6 +54,11 @@ XRAY_NO_INSTRUMENT void XRayEndFrame(struct XRayTraceCapture* capture);
 XRAY_NO_INSTRUMENT void XRayLabelFrame(const char* fmt, ...);
 XRAY_NO_INSTRUMENT void XRaySetAnnotationFilter(
     struct XRayTraceCapture* capture, uint32_t filter);
+XRAY_NO_INSTRUMENT void XRaySetThreadBufferSize(
+    struct XRayTraceCapture* capture, int buffer_size);
+XRAY_NO_INSTRUMENT void XRaySetSampleInterval(
+    struct XRayTraceCapture* capture, uint32_t interval);
+XRAY_NO_INSTRUMENT int XRayLoadKernelTrace(struct XRayTraceCapture* capture);
 XRAY_NO_INSTRUMENT void XRaySaveReport(struct XRayTraceCapture* capture,
                                        const char* filename,
                                        float percent_cutoff,
@@ -62,6 +67,25 @@ XRAY_NO_INSTRUMENT void XRayReport(struct XRayTraceCapture* capture,
                                    FILE* f,
                                    float percent_cutoff,
                                    int ticks_cutoff);
+XRAY_NO_INSTRUMENT void XRaySaveChromeTrace(struct XRayTraceCapture* capture,
+                                            const char* filename);
+XRAY_NO_INSTRUMENT void XRayChromeTrace(struct XRayTraceCapture* capture,
+                                        FILE* f);
+XRAY_NO_INSTRUMENT void XRaySavePerfScript(struct XRayTraceCapture* capture,
+                                           const char* filename);
+XRAY_NO_INSTRUMENT void XRayPerfScript(struct XRayTraceCapture* capture,
+                                       FILE* f);
+XRAY_NO_INSTRUMENT int XRayProfileStart(uint64_t period);
+XRAY_NO_INSTRUMENT int XRayProfileStop(void);
+XRAY_NO_INSTRUMENT void XRaySaveProfileReport(
+    struct XRayTraceCapture* capture, const char* filename,
+    float percent_cutoff);
+XRAY_NO_INSTRUMENT void XRayProfileReport(struct XRayTraceCapture* capture,
+                                          FILE* f, float percent_cutoff);
+XRAY_NO_INSTRUMENT void XRaySaveProfilePerfScript(
+    struct XRayTraceCapture* capture, const char* filename);
+XRAY_NO_INSTRUMENT void XRayProfilePerfScript(
+    struct XRayTraceCapture* capture, FILE* f);
 
 #ifndef XRAY_DISABLE_BROWSER_INTEGRATION
 XRAY_NO_INSTRUMENT void XRayBrowserTraceReport(
@@ -100,6 +124,13 @@ inline void XRayLabelFrame(const char* fmt, ...) {}
 
 inline void XRaySetAnnotationFilter(struct XRayTraceCapture* capture,
                                     uint32_t filter) {}
+inline void XRaySetThreadBufferSize(struct XRayTraceCapture* capture,
+                                    int buffer_size) {}
+inline void XRaySetSampleInterval(struct XRayTraceCapture* capture,
+                                  uint32_t interval) {}
+inline int XRayLoadKernelTrace(struct XRayTraceCapture* capture) {
+  return 0;
+}
 inline void XRaySaveReport(struct XRayTraceCapture* capture,
                            const char* filename,
                            float percent_cutoff,
@@ -108,6 +139,27 @@ inline void XRayReport(struct XRayTraceCapture* capture,
                        FILE* f,
                        float percent_cutoff,
                        int ticks_cutoff) {}
+inline void XRaySaveChromeTrace(struct XRayTraceCapture* capture,
+                                const char* filename) {}
+inline void XRayChromeTrace(struct XRayTraceCapture* capture, FILE* f) {}
+inline void XRaySavePerfScript(struct XRayTraceCapture* capture,
+                               const char* filename) {}
+inline void XRayPerfScript(struct XRayTraceCapture* capture, FILE* f) {}
+inline int XRayProfileStart(uint64_t period) {
+  return -1;
+}
+inline int XRayProfileStop(void) {
+  return -1;
+}
+inline void XRaySaveProfileReport(struct XRayTraceCapture* capture,
+                                  const char* filename,
+                                  float percent_cutoff) {}
+inline void XRayProfileReport(struct XRayTraceCapture* capture, FILE* f,
+                              float percent_cutoff) {}
+inline void XRaySaveProfilePerfScript(struct XRayTraceCapture* capture,
+                                      const char* filename) {}
+inline void XRayProfilePerfScript(struct XRayTraceCapture* capture,
+                                  FILE* f) {}
 
 #ifndef XRAY_DISABLE_BROWSER_INTEGRATION
 inline void XRayBrowserTraceReport(struct XRayTraceCapture* capture) {}
@@ -49,6 +49,10 @@ extern "C" {
 #define XRAY_PACK_DEPTH(x) ((x) & XRAY_DEPTH_MASK)
 #define XRAY_PACK_DEPTH_ADDR(d, a) (XRAY_PACK_DEPTH(d) | XRAY_PACK_ADDR(a))
 #define XRAY_ALIGN64 __attribute((aligned(64)))
+#define XRAY_THREAD_BUFFER_SIZE (262144)
+#define XRAY_KERNEL_THREAD_ID (0x10000)
+#define XRAY_NO_SLOT (0xFFFFFFFF)
+#define XRAY_NO_SAMPLE (0xFFFFFFFF)
 
 struct XRayStringPool;
 struct XRayHashTable;
@@ -56,6 +60,7 @@ struct XRaySymbolPool;
 struct XRaySymbol;
 struct XRaySymbolTable;
 struct XRayTraceCapture;
+struct XRayThreadCapture;
 
 struct XRayTraceBufferEntry {
   uint32_t depth_addr;
@@ -79,6 +84,8 @@ XRAY_NO_INSTRUMENT void* XRayHashTableInsert(struct XRayHashTable* table,
     void* data, uint32_t addr);
 XRAY_NO_INSTRUMENT void* XRayHashTableAtIndex(
   struct XRayHashTable* table, int i);
+XRAY_NO_INSTRUMENT uint32_t XRayHashTableKeyAtIndex(
+  struct XRayHashTable* table, int i);
 XRAY_NO_INSTRUMENT int XRayHashTableGetCapacity(struct XRayHashTable* table);
 XRAY_NO_INSTRUMENT int XRayHashTableGetCount(struct XRayHashTable* table);
 XRAY_NO_INSTRUMENT struct XRayHashTable* XRayHashTableCreate(int capacity);
@@ -110,6 +117,8 @@ XRAY_NO_INSTRUMENT struct XRaySymbol* XRaySymbolTableAddByName(
 XRAY_NO_INSTRUMENT int XRaySymbolTableGetCount(struct XRaySymbolTable* symtab);
 XRAY_NO_INSTRUMENT struct XRaySymbol* XRaySymbolTableLookup(
     struct XRaySymbolTable* symbols, uint32_t addr);
+XRAY_NO_INSTRUMENT struct XRaySymbol* XRaySymbolTableLookupNearest(
+    struct XRaySymbolTable* symbols, uint32_t addr, uint32_t* start);
 XRAY_NO_INSTRUMENT struct XRaySymbol* XRaySymbolTableAtIndex(
     struct XRaySymbolTable* symbols, int i);
 XRAY_NO_INSTRUMENT struct XRaySymbolTable* XRaySymbolTableCreate(int size);
@@ -159,6 +168,27 @@ XRAY_NO_INSTRUMENT int XRayFrameGetAnnotationCount(
     struct XRayTraceCapture* capture, int frame);
 XRAY_NO_INSTRUMENT bool XRayFrameIsValid(
     struct XRayTraceCapture* capture, int frame);
+XRAY_NO_INSTRUMENT uint64_t XRayFrameGetStartTSC(
+    struct XRayTraceCapture* capture, int frame);
+XRAY_NO_INSTRUMENT uint64_t XRayFrameGetEndTSC(
+    struct XRayTraceCapture* capture, int frame);
+
+XRAY_NO_INSTRUMENT struct XRayThreadCapture* XRayThreadGetFirst(
+    struct XRayTraceCapture* capture);
+XRAY_NO_INSTRUMENT struct XRayThreadCapture* XRayThreadGetNext(
+    struct XRayThreadCapture* thread);
+XRAY_NO_INSTRUMENT int XRayThreadGetID(struct XRayThreadCapture* thread);
+XRAY_NO_INSTRUMENT int XRayThreadGetCount(struct XRayTraceCapture* capture);
+XRAY_NO_INSTRUMENT uint32_t XRayGetSampleInterval(
+    struct XRayTraceCapture* capture);
+XRAY_NO_INSTRUMENT int XRayThreadGetBufferSize(
+    struct XRayThreadCapture* thread);
+XRAY_NO_INSTRUMENT int XRayThreadGetBufferIndex(
+    struct XRayThreadCapture* thread);
+XRAY_NO_INSTRUMENT struct XRayTraceBufferEntry* XRayThreadGetEntry(
+    struct XRayThreadCapture* thread, int index);
+XRAY_NO_INSTRUMENT void XRayThreadMakeLabel(struct XRayThreadCapture* thread,
+                                            char* label);
 
 
 XRAY_NO_INSTRUMENT void XRayTraceReport(struct XRayTraceCapture* capture,
@@ -169,6 +199,13 @@ XRAY_NO_INSTRUMENT void XRayTraceReport(struct XRayTraceCapture* capture,
                                         int ticks_cutoff);
 XRAY_NO_INSTRUMENT void XRayFrameReport(struct XRayTraceCapture* capture,
                                         FILE* f);
+XRAY_NO_INSTRUMENT void XRayThreadReport(struct XRayTraceCapture* capture,
+                                         FILE* f,
+                                         int frame,
+                                         float percent_cutoff,
+                                         int ticks_cutoff);
+
+XRAY_NO_INSTRUMENT uint64_t XRayGetTicksPerSecond(void);
 
 XRAY_NO_INSTRUMENT void* XRayMalloc(size_t t);
 XRAY_NO_INSTRUMENT void XRayFree(void* data);